@@ -378,7 +378,8 @@ static inline unsigned long ukarch_read_sp(void)
 
 static inline void ukarch_spinwait(void)
 {
-	/* Intelligent busy wait not supported on arm64. */
+	/* Hint that we spin, so that a sibling hardware thread may run */
+	__asm__ __volatile__("yield" : : : "memory");
 }
 
 #endif /* !__ASSEMBLY__ */
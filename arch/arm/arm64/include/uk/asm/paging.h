@@ -283,6 +283,9 @@ static inline int ukarch_pt_write_base(__paddr_t pt_paddr)
 	return 0;
 }
 
+/* TLB invalidations are broadcast to all CPUs in the inner shareable domain */
+#define UKARCH_TLB_FLUSH_BROADCAST
+
 static inline void ukarch_tlb_flush_entry(__vaddr_t vaddr)
 {
 	__u64 page_number = vaddr >> PAGE_SHIFT;
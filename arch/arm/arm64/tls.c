@@ -48,6 +48,9 @@
 #include <uk/essentials.h>
 #include <uk/arch/types.h>
 #include <uk/arch/tls.h>
+#if CONFIG_LIBUKSP_TLS
+#include <uk/sp.h>
+#endif /* CONFIG_LIBUKSP_TLS */
 
 #if CONFIG_LIBUKDEBUG
 #include <uk/assert.h>
@@ -254,6 +257,9 @@ void ukarch_tls_area_init(void *tls_area)
 	ukarch_tls_tcb_init(writepos);
 #else /* !CONFIG_UKARCH_TLS_HAVE_TCB */
 	memset(writepos, 0x0, ukarch_tls_tcb_size());
+#if CONFIG_LIBUKSP_TLS
+	*uk_sp_tls_guard_ptr(ukarch_tls_tlsp(tls_area)) = uk_sp_tls_guard();
+#endif /* CONFIG_LIBUKSP_TLS */
 #endif /*!CONFIG_UKARCH_TLS_HAVE_TCB */
 	writepos += ukarch_tls_tcb_size();
 	UK_ASSERT(ukarch_tls_tlsp(tls_area) ==
@@ -39,6 +39,7 @@
 
 /* APIC MSR registers */
 #define APIC_MSR_BASE			0x01b
+#define APIC_MSR_TSC_DEADLINE		0x6e0
 
 /* The following MSRs are only accessible in x2APIC mode */
 #define APIC_MSR_ID			0x802
@@ -77,6 +78,13 @@
 #define APIC_SVR_VECTOR_MASK		0x00000000000000ffUL
 #define APIC_SVR_EOI_BROADCAST		(1 << 12)
 
+/* APIC local vector table (LVT) */
+#define APIC_LVT_VECTOR_MASK		0x000000ff
+#define APIC_LVT_MASKED			(1 << 16)
+#define APIC_LVT_TIMER_ONESHOT		(0 << 17)
+#define APIC_LVT_TIMER_PERIODIC		(1 << 17)
+#define APIC_LVT_TIMER_TSC_DEADLINE	(2 << 17)
+
 /* APIC error status registers (ESR) */
 #define APIC_ESR_SEND_CHECKSUM		(1 << 0) /* only Pentium and P6 */
 #define APIC_ESR_RECV_CHECKSUM		(1 << 1) /* only Pentium and P6 */
@@ -96,6 +104,8 @@
 #define APIC_ICR_DMODE_INIT		(5 << 8)
 #define APIC_ICR_DMODE_SUP		(6 << 8)
 
+#define APIC_ICR_BUSY			(1 << 12) /* only xAPIC */
+
 #define APIC_ICR_DESTMODE_PHYSICAL	0
 #define APIC_ICR_DESTMODE_LOGICAL	(1 << 11)
 #define APIC_ICR_LEVEL_DEASSERT		0
@@ -134,20 +134,39 @@ static inline void ukarch_spinwait(void)
 {
 	__asm__ __volatile__("pause" : : : "memory");
 }
+
+/* Makes the next access to the x87, SSE, or AVX registers raise #NM */
+static inline void ukarch_x86_ectx_trap_set(void)
+{
+	unsigned long cr0;
+
+	__asm__ __volatile__("mov %%cr0, %0" : "=r"(cr0));
+	__asm__ __volatile__("mov %0, %%cr0"
+			     : : "r"(cr0 | X86_CR0_TS) : "memory");
+}
+
+/* Allows accesses to the x87, SSE, and AVX registers again */
+static inline void ukarch_x86_ectx_trap_clear(void)
+{
+	__asm__ __volatile__("clts" : : : "memory");
+}
 #endif /* !__ASSEMBLY__ */
 
 /* CPUID feature bits in ECX and EDX when EAX=1 */
 #define X86_CPUID1_ECX_x2APIC   (1 << 21)
+#define X86_CPUID1_ECX_TSCDEADLINE (1 << 24)
 #define X86_CPUID1_ECX_XSAVE    (1 << 26)
 #define X86_CPUID1_ECX_OSXSAVE  (1 << 27)
 #define X86_CPUID1_ECX_AVX      (1 << 28)
 #define X86_CPUID1_ECX_RDRAND	(1 << 30)
+#define X86_CPUID1_ECX_HYPERVISOR (1U << 31)
 #define X86_CPUID1_EDX_FPU      (1 << 0)
 #define X86_CPUID1_EDX_PAT      (1 << 16)
 #define X86_CPUID1_EDX_FXSR     (1 << 24)
 #define X86_CPUID1_EDX_SSE      (1 << 25)
 /* CPUID feature bits in EBX and ECX when EAX=7, ECX=0 */
 #define X86_CPUID7_EBX_FSGSBASE (1 << 0)
+#define X86_CPUID7_EBX_ERMS	(1 << 9)
 #define X86_CPUID7_ECX_PKU	(1 << 3)
 #define X86_CPUID7_ECX_OSPKE	(1 << 4)
 #define X86_CPUID7_ECX_LA57		(1 << 16)
@@ -62,6 +62,10 @@ struct ukarch_trap_ctx {
 #define UKARCH_TRAP_BUS_ERROR		trap_bus_error
 
 #define UKARCH_TRAP_MATH		trap_math
+/* Trap number of the device-not-available exception (#NM), which is raised
+ * as UKARCH_TRAP_MATH
+ */
+#define UKARCH_TRAP_X86_NM_TRAPNR	7
 
 #define UKARCH_TRAP_SECURITY		trap_security
 
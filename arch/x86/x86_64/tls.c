@@ -45,10 +45,18 @@
 #include <uk/essentials.h>
 #include <uk/arch/types.h>
 #include <uk/arch/tls.h>
+#if CONFIG_LIBUKSP_TLS
+#include <uk/sp.h>
+#endif /* CONFIG_LIBUKSP_TLS */
 
 #ifndef __UKARCH_TLS_HAVE_TCB__
 #ifndef TCB_SIZE
+#if CONFIG_LIBUKSP_TLS
+/* Self pointer up to the stack protector canary */
+#define TCB_SIZE (UK_SP_TLS_GUARD_OFFSET + sizeof(unsigned long))
+#else /* !CONFIG_LIBUKSP_TLS */
 #define TCB_SIZE (sizeof(void *))
+#endif /* !CONFIG_LIBUKSP_TLS */
 #endif /* !TCB_SIZE */
 #endif /* !__UKARCH_TLS_HAVE_TCB__ */
 
@@ -199,6 +207,8 @@ void ukarch_tls_area_init(void *tls_area)
 
 #if CONFIG_UKARCH_TLS_HAVE_TCB
 	ukarch_tls_tcb_init((void *) ukarch_tls_tlsp(tls_area));
+#elif CONFIG_LIBUKSP_TLS
+	*uk_sp_tls_guard_ptr(ukarch_tls_tlsp(tls_area)) = uk_sp_tls_guard();
 #endif /* CONFIG_UKARCH_TLS_HAVE_TCB */
 
 	uk_hexdumpCd(tls_area, ukarch_tls_area_size());
@@ -0,0 +1,235 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * Definitions of the NVM Express base specification (revision 1.4) that the
+ * driver uses. Only the NVM command set is covered.
+ */
+#ifndef __NVME_NVME_H__
+#define __NVME_NVME_H__
+
+#include <uk/arch/types.h>
+#include <uk/essentials.h>
+
+/* PCI class code of NVMe controllers: mass storage, NVM, NVMe */
+#define NVME_PCI_CLASS			0x010802
+
+/*
+ * Controller registers (BAR0)
+ */
+#define NVME_REG_CAP			0x00	/* Capabilities, 64 bits */
+#define NVME_REG_VS			0x08	/* Version */
+#define NVME_REG_INTMS			0x0c	/* Interrupt mask set */
+#define NVME_REG_INTMC			0x10	/* Interrupt mask clear */
+#define NVME_REG_CC			0x14	/* Controller configuration */
+#define NVME_REG_CSTS			0x1c	/* Controller status */
+#define NVME_REG_AQA			0x24	/* Admin queue attributes */
+#define NVME_REG_ASQ			0x28	/* Admin SQ base, 64 bits */
+#define NVME_REG_ACQ			0x30	/* Admin CQ base, 64 bits */
+#define NVME_REG_DBS			0x1000	/* First doorbell */
+
+#define NVME_CAP_MQES(cap)		((__u16)((cap) & 0xffff))
+#define NVME_CAP_TO(cap)		((__u32)(((cap) >> 24) & 0xff))
+#define NVME_CAP_DSTRD(cap)		((__u32)(((cap) >> 32) & 0xf))
+#define NVME_CAP_CSS_NVM(cap)		(((cap) >> 37) & 0x1)
+#define NVME_CAP_MPSMIN(cap)		((__u32)(((cap) >> 48) & 0xf))
+
+#define NVME_CC_EN			(1 << 0)
+#define NVME_CC_CSS_NVM			(0 << 4)
+#define NVME_CC_MPS(shift)		(((shift) - 12) << 7)
+#define NVME_CC_AMS_RR			(0 << 11)
+#define NVME_CC_SHN_NORMAL		(1 << 14)
+#define NVME_CC_SHN_MASK		(3 << 14)
+#define NVME_CC_IOSQES(shift)		((shift) << 16)
+#define NVME_CC_IOCQES(shift)		((shift) << 20)
+
+#define NVME_CSTS_RDY			(1 << 0)
+#define NVME_CSTS_CFS			(1 << 1)
+#define NVME_CSTS_SHST_MASK		(3 << 2)
+#define NVME_CSTS_SHST_CMPLT		(2 << 2)
+
+/* Timeouts in CAP.TO are given in units of 500 ms */
+#define NVME_CAP_TO_UNIT_MS		500
+
+/*
+ * Queues
+ */
+#define NVME_SQE_SHIFT			6	/* 64 byte entries */
+#define NVME_CQE_SHIFT			4	/* 16 byte entries */
+
+/* Submission queue entry */
+struct nvme_sqe {
+	__u8	opc;
+	__u8	flags;
+	__u16	cid;
+	__u32	nsid;
+	__u64	rsvd;
+	__u64	mptr;
+	__u64	prp1;
+	__u64	prp2;
+	__u32	cdw10;
+	__u32	cdw11;
+	__u32	cdw12;
+	__u32	cdw13;
+	__u32	cdw14;
+	__u32	cdw15;
+} __packed;
+
+UK_CTASSERT(sizeof(struct nvme_sqe) == (1 << NVME_SQE_SHIFT));
+
+/* Completion queue entry */
+struct nvme_cqe {
+	__u32	dw0;
+	__u32	dw1;
+	__u16	sq_head;
+	__u16	sq_id;
+	__u16	cid;
+	__u16	status;
+} __packed;
+
+UK_CTASSERT(sizeof(struct nvme_cqe) == (1 << NVME_CQE_SHIFT));
+
+#define NVME_CQE_PHASE			(1 << 0)
+/* Status code and status code type, without the phase tag */
+#define NVME_CQE_STATUS(status)		(((status) >> 1) & 0x7ff)
+
+/*
+ * Admin commands
+ */
+#define NVME_ADMIN_DELETE_SQ		0x00
+#define NVME_ADMIN_CREATE_SQ		0x01
+#define NVME_ADMIN_DELETE_CQ		0x04
+#define NVME_ADMIN_CREATE_CQ		0x05
+#define NVME_ADMIN_IDENTIFY		0x06
+#define NVME_ADMIN_SET_FEATURES		0x09
+
+/* Queue creation (CDW11) */
+#define NVME_QUEUE_PC			(1 << 0)	/* Phys. contiguous */
+#define NVME_CQ_IEN			(1 << 1)	/* Interrupts enabled */
+#define NVME_CQ_IV(iv)			((__u32)(iv) << 16)
+#define NVME_SQ_CQID(qid)		((__u32)(qid) << 16)
+
+/* Identify (CDW10.CNS) */
+#define NVME_IDENTIFY_NS		0x00
+#define NVME_IDENTIFY_CTRL		0x01
+#define NVME_IDENTIFY_NS_LIST		0x02
+#define NVME_IDENTIFY_SIZE		4096
+
+/* Features */
+#define NVME_FEAT_NUM_QUEUES		0x07
+
+/* Identify controller data structure, up to the fields that are used */
+struct nvme_id_ctrl {
+	__u16	vid;
+	__u16	ssvid;
+	char	sn[20];
+	char	mn[40];
+	char	fr[8];
+	__u8	rab;
+	__u8	ieee[3];
+	__u8	cmic;
+	__u8	mdts;		/* Max. transfer size, 2^n min. pages */
+	__u8	rsvd78[434];
+	__u8	sqes;
+	__u8	cqes;
+	__u16	maxcmd;
+	__u32	nn;		/* Number of namespaces */
+	__u16	oncs;		/* Optional NVM command support */
+	__u16	fuses;
+	__u8	fna;
+	__u8	vwc;		/* Volatile write cache */
+	__u16	awun;
+	__u16	awupf;
+	__u8	nvscc;
+	__u8	nwpc;
+	__u16	acwu;
+	__u16	rsvd534;
+	__u32	sgls;
+	__u8	rsvd540[3556];
+} __packed;
+
+UK_CTASSERT(sizeof(struct nvme_id_ctrl) == NVME_IDENTIFY_SIZE);
+
+#define NVME_ONCS_DSM			(1 << 2)
+#define NVME_ONCS_WRITE_ZEROES		(1 << 3)
+#define NVME_VWC_PRESENT		(1 << 0)
+
+struct nvme_lbaf {
+	__u16	ms;
+	__u8	lbads;		/* LBA data size, 2^n bytes */
+	__u8	rp;
+} __packed;
+
+/* Identify namespace data structure, up to the fields that are used */
+struct nvme_id_ns {
+	__u64	nsze;		/* Namespace size in logical blocks */
+	__u64	ncap;
+	__u64	nuse;
+	__u8	nsfeat;
+	__u8	nlbaf;
+	__u8	flbas;		/* Formatted LBA size */
+	__u8	mc;
+	__u8	dpc;
+	__u8	dps;
+	__u8	nmic;
+	__u8	rescap;
+	__u8	fpi;
+	__u8	dlfeat;
+	__u16	nawun;
+	__u16	nawupf;
+	__u16	nacwu;
+	__u16	nabsn;
+	__u16	nabo;
+	__u16	nabspf;
+	__u16	noiob;
+	__u8	nvmcap[16];
+	__u16	npwg;
+	__u16	npwa;
+	__u16	npdg;
+	__u16	npda;
+	__u16	nows;
+	__u8	rsvd74[18];
+	__u32	anagrpid;
+	__u8	rsvd96[3];
+	__u8	nsattr;
+	__u16	nvmsetid;
+	__u16	endgid;
+	__u8	nguid[16];
+	__u8	eui64[8];
+	struct nvme_lbaf lbaf[16];
+	__u8	rsvd192[3904];
+} __packed;
+
+UK_CTASSERT(sizeof(struct nvme_id_ns) == NVME_IDENTIFY_SIZE);
+
+#define NVME_NS_FLBAS_IDX(flbas)	((flbas) & 0xf)
+
+/*
+ * NVM commands
+ */
+#define NVME_CMD_FLUSH			0x00
+#define NVME_CMD_WRITE			0x01
+#define NVME_CMD_READ			0x02
+#define NVME_CMD_WRITE_ZEROES		0x08
+#define NVME_CMD_DSM			0x09
+
+/* Read and write (CDW12) */
+#define NVME_RW_FUA			(1 << 30)
+/* Write zeroes (CDW12): deallocate the range */
+#define NVME_WZ_DEAC			(1 << 25)
+/* Dataset management (CDW11): deallocate the ranges */
+#define NVME_DSM_AD			(1 << 2)
+
+/* Number of logical blocks is a 0's based 16-bit value */
+#define NVME_RW_MAX_NLB			0x10000
+
+struct nvme_dsm_range {
+	__u32	cattr;
+	__u32	nlb;
+	__u64	slba;
+} __packed;
+
+#endif /* __NVME_NVME_H__ */
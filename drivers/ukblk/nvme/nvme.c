@@ -0,0 +1,1259 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * NVMe PCI driver
+ *
+ * Every ukblkdev queue is an I/O submission/completion queue pair of the
+ * controller with its own MSI-X vector. The vector is routed to the lcpu
+ * that uk_blkdev_queue_id_lcpu() maps to the queue, so that completions are
+ * handled where the requests were submitted. Queues configured in polled
+ * mode are created without interrupts. The admin queue is only used while
+ * setting up the device and is polled.
+ *
+ * Data buffers are described with PRPs, one entry per memory page that the
+ * buffer touches, so that they need not be physically contiguous. Every
+ * command slot has a PRP list of its own, which also holds the range of
+ * discard requests.
+ *
+ * The driver exposes the first active namespace of the controller.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <uk/alloc.h>
+#include <uk/arch/lcpu.h>
+#include <uk/arch/limits.h>
+#include <uk/arch/time.h>
+#include <uk/assert.h>
+#include <uk/blkdev.h>
+#include <uk/blkdev_driver.h>
+#include <uk/bus/pci.h>
+#include <uk/errptr.h>
+#include <uk/essentials.h>
+#include <uk/intctlr.h>
+#include <uk/plat/io.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/time.h>
+#include <uk/print.h>
+#include <nvme/nvme.h>
+
+#define DRIVER_NAME		"nvme"
+
+/* Number of entries of the admin queues */
+#define NVME_ADMIN_QSIZE	32
+/* Number of entries of I/O queues if the user does not choose */
+#define NVME_IO_QSIZE_DEF	256
+/* Upper limit for the number of entries of I/O queues */
+#define NVME_IO_QSIZE_MAX	1024
+
+/* Entries of the PRP list of a command slot. Limits the transfer size. */
+#define NVME_PRP_ENTRIES	64
+#define NVME_PRP_LIST_SIZE	(NVME_PRP_ENTRIES * sizeof(__u64))
+
+#define NVME_ADMIN_TIMEOUT	ukarch_time_sec_to_nsec(5)
+
+#define	NVME_INTR_EN		(1 << 0)
+#define	NVME_INTR_USR_EN	(1 << 1)
+
+#define to_nvmedev(bdev) \
+	__containerof(bdev, struct nvme_dev, blkdev)
+
+static struct uk_alloc *a;
+static const char *drv_name = DRIVER_NAME;
+
+struct nvme_slot {
+	/* Request in flight, NULL if the slot is free */
+	struct uk_blkreq *req;
+	/* PRP list or the range of a discard request */
+	__u64 *prps;
+	__paddr_t prps_paddr;
+};
+
+struct uk_blkdev_queue {
+	/* Reference to the device */
+	struct nvme_dev *ndev;
+	/* Allocator of the queue memory */
+	struct uk_alloc *a;
+	/* Queue ID of the controller, 0 is the admin queue */
+	__u16 qid;
+	/* The libukblkdev queue identifier */
+	__u16 lqueue_id;
+	/* Number of entries of the submission and completion queue */
+	__u16 qsize;
+	struct nvme_sqe *sq;
+	volatile struct nvme_cqe *cq;
+	volatile __u32 *sq_db;
+	volatile __u32 *cq_db;
+	__u16 sq_tail;
+	__u16 cq_head;
+	/* Phase tag of new completion queue entries */
+	__u16 cq_phase;
+	/* Command slots, indexed by command ID. There is one less than
+	 * queue entries, so the submission queue cannot overflow.
+	 */
+	struct nvme_slot *slots;
+	__u16 nb_slots;
+	__u16 next_slot;
+	__u16 inflight;
+	void *prp_pool;
+	/* The flag to interrupt on the queue */
+	__u8 intr_enabled;
+	/* The queue was created with an interrupt vector */
+	__u8 has_intr;
+	/* MSI-X message that is routed to the lcpu of the queue */
+	__u64 msix_addr;
+	__u32 msix_data;
+};
+
+struct nvme_dev {
+	/* Pointer to Unikraft Block Device */
+	struct uk_blkdev blkdev;
+	/* The blkdevice identifier */
+	__u16 uid;
+	/* PCI device */
+	struct pci_device *pdev;
+	/* Controller registers */
+	void *regs;
+	/* Capabilities register */
+	__u64 cap;
+	/* Distance between doorbell registers in bytes */
+	__u32 db_stride;
+	/* Timeout of controller state changes */
+	__nsec timeout;
+	/* Namespace that is exposed */
+	__u32 nsid;
+	/* Max. entries of I/O queues */
+	__u16 max_qsize;
+	/* Nb of I/O queues the controller granted */
+	__u16 max_queues;
+	/* Nb of queues the user configured */
+	__u16 nb_queues;
+	struct uk_blkdev_queue admin;
+	struct uk_blkdev_queue *qs;
+	/* IRQs of the MSI-X vectors of I/O queues. Entry 0 belongs to the
+	 * admin queue and is not used, so `msix_irqs[i]` is for queue i + 1.
+	 * NULL if the device does not support MSI-X.
+	 */
+	unsigned int *msix_irqs;
+	/* The controller was shut down */
+	__u8 shutdown;
+};
+
+static inline __u32 nvme_read32(struct nvme_dev *d, __u32 reg)
+{
+	return *(volatile __u32 *)((__u8 *)d->regs + reg);
+}
+
+static inline void nvme_write32(struct nvme_dev *d, __u32 reg, __u32 val)
+{
+	*(volatile __u32 *)((__u8 *)d->regs + reg) = val;
+}
+
+/* 64-bit registers are accessed in halves, lower one first */
+static inline __u64 nvme_read64(struct nvme_dev *d, __u32 reg)
+{
+	__u64 lo = nvme_read32(d, reg);
+
+	return lo | ((__u64)nvme_read32(d, reg + 4) << 32);
+}
+
+static inline void nvme_write64(struct nvme_dev *d, __u32 reg, __u64 val)
+{
+	nvme_write32(d, reg, (__u32)val);
+	nvme_write32(d, reg + 4, (__u32)(val >> 32));
+}
+
+static inline void nvme_sq_push(struct uk_blkdev_queue *q,
+				const struct nvme_sqe *cmd)
+{
+	memcpy(&q->sq[q->sq_tail], cmd, sizeof(*cmd));
+	if (++q->sq_tail == q->qsize)
+		q->sq_tail = 0;
+}
+
+static inline void nvme_sq_ring(struct uk_blkdev_queue *q)
+{
+	/* Entries must be visible before the controller fetches them */
+	wmb();
+	*q->sq_db = q->sq_tail;
+}
+
+static inline int nvme_cq_pending(struct uk_blkdev_queue *q)
+{
+	return (q->cq[q->cq_head].status & NVME_CQE_PHASE) == q->cq_phase;
+}
+
+static inline void nvme_cq_advance(struct uk_blkdev_queue *q)
+{
+	if (++q->cq_head == q->qsize) {
+		q->cq_head = 0;
+		q->cq_phase ^= 1;
+	}
+}
+
+static int nvme_wait_csts(struct nvme_dev *d, __u32 mask, __u32 val)
+{
+	__nsec deadline = ukplat_monotonic_clock() + d->timeout;
+	__u32 csts;
+
+	for (;;) {
+		csts = nvme_read32(d, NVME_REG_CSTS);
+		if (unlikely(csts == 0xffffffff))
+			return -ENODEV;
+		if ((csts & mask) == val)
+			return 0;
+		if (unlikely(csts & NVME_CSTS_CFS))
+			return -EIO;
+		if (ukplat_monotonic_clock() > deadline)
+			return -ETIMEDOUT;
+	}
+}
+
+/* Issues an admin command and waits for its completion */
+static int nvme_admin_cmd(struct nvme_dev *d, struct nvme_sqe *cmd,
+			  __u32 *dw0)
+{
+	struct uk_blkdev_queue *q = &d->admin;
+	volatile struct nvme_cqe *cqe;
+	__nsec deadline;
+	__u16 status;
+
+	/* Admin commands are issued one at a time */
+	cmd->cid = q->sq_tail;
+	nvme_sq_push(q, cmd);
+	nvme_sq_ring(q);
+
+	deadline = ukplat_monotonic_clock() + NVME_ADMIN_TIMEOUT;
+	while (!nvme_cq_pending(q)) {
+		if (ukplat_monotonic_clock() > deadline) {
+			uk_pr_err(DRIVER_NAME": Admin command %02x timed out\n",
+				  cmd->opc);
+			return -ETIMEDOUT;
+		}
+	}
+	rmb();
+
+	cqe = &q->cq[q->cq_head];
+	status = NVME_CQE_STATUS(cqe->status);
+	if (dw0)
+		*dw0 = cqe->dw0;
+	nvme_cq_advance(q);
+	*q->cq_db = q->cq_head;
+
+	if (unlikely(status)) {
+		uk_pr_err(DRIVER_NAME": Admin command %02x failed: status %#x\n",
+			  cmd->opc, status);
+		return -EIO;
+	}
+	return 0;
+}
+
+static void nvme_queue_free(struct uk_blkdev_queue *q)
+{
+	if (q->prp_pool)
+		uk_free(q->a, q->prp_pool);
+	if (q->slots)
+		uk_free(q->a, q->slots);
+	if (q->cq)
+		uk_free(q->a, (void *)q->cq);
+	if (q->sq)
+		uk_free(q->a, q->sq);
+	q->prp_pool = NULL;
+	q->slots = NULL;
+	q->cq = NULL;
+	q->sq = NULL;
+}
+
+/* Allocates the memory of a queue pair. Queues are physically contiguous
+ * (NVME_QUEUE_PC), which allocations of the page size and above are.
+ */
+static int nvme_queue_alloc(struct nvme_dev *d, struct uk_blkdev_queue *q,
+			    struct uk_alloc *qa, __u16 qid, __u16 qsize)
+{
+	__u8 *doorbells = (__u8 *)d->regs + NVME_REG_DBS;
+	__u16 i;
+
+	UK_ASSERT(qsize >= 2);
+
+	memset(q, 0, sizeof(*q));
+	q->ndev = d;
+	q->a = qa;
+	q->qid = qid;
+	q->qsize = qsize;
+	q->nb_slots = qsize - 1;
+	q->cq_phase = 1;
+	q->sq_db = (volatile __u32 *)(doorbells + (2 * qid) * d->db_stride);
+	q->cq_db = (volatile __u32 *)(doorbells +
+				      (2 * qid + 1) * d->db_stride);
+
+	q->sq = uk_memalign(qa, __PAGE_SIZE, qsize << NVME_SQE_SHIFT);
+	q->cq = uk_memalign(qa, __PAGE_SIZE, qsize << NVME_CQE_SHIFT);
+	q->slots = uk_calloc(qa, q->nb_slots, sizeof(*q->slots));
+	q->prp_pool = uk_memalign(qa, __PAGE_SIZE,
+				  q->nb_slots * NVME_PRP_LIST_SIZE);
+	if (unlikely(!q->sq || !q->cq || !q->slots || !q->prp_pool)) {
+		nvme_queue_free(q);
+		return -ENOMEM;
+	}
+
+	memset(q->sq, 0, qsize << NVME_SQE_SHIFT);
+	memset((void *)q->cq, 0, qsize << NVME_CQE_SHIFT);
+	for (i = 0; i < q->nb_slots; i++) {
+		q->slots[i].prps = (__u64 *)((__u8 *)q->prp_pool +
+					     i * NVME_PRP_LIST_SIZE);
+		q->slots[i].prps_paddr = ukplat_virt_to_phys(q->slots[i].prps);
+	}
+	return 0;
+}
+
+static struct nvme_slot *nvme_slot_get(struct uk_blkdev_queue *q,
+				       __u16 *cid)
+{
+	__u16 i, idx;
+
+	/* Slots are mostly released in order, so the next one is free */
+	for (i = 0; i < q->nb_slots; i++) {
+		idx = q->next_slot;
+		if (++q->next_slot == q->nb_slots)
+			q->next_slot = 0;
+		if (!__atomic_load_n(&q->slots[idx].req, __ATOMIC_ACQUIRE)) {
+			*cid = idx;
+			return &q->slots[idx];
+		}
+	}
+	return NULL;
+}
+
+/* Describes a data buffer with PRP entries, one per memory page */
+static int nvme_prp_build(struct nvme_slot *slot, void *buf, __sz len,
+			  struct nvme_sqe *cmd)
+{
+	__uptr end = (__uptr)buf + len;
+	__uptr addr;
+	unsigned int n = 0;
+
+	cmd->prp1 = ukplat_virt_to_phys(buf);
+
+	addr = ALIGN_DOWN((__uptr)buf, __PAGE_SIZE) + __PAGE_SIZE;
+	if (addr >= end)
+		return 0;
+
+	if (addr + __PAGE_SIZE >= end) {
+		cmd->prp2 = ukplat_virt_to_phys((void *)addr);
+		return 0;
+	}
+
+	for (; addr < end; addr += __PAGE_SIZE) {
+		if (unlikely(n == NVME_PRP_ENTRIES))
+			return -EINVAL;
+		slot->prps[n++] = ukplat_virt_to_phys((void *)addr);
+	}
+	cmd->prp2 = slot->prps_paddr;
+	return 0;
+}
+
+static int nvme_cmd_rw(struct uk_blkdev_queue *q, struct nvme_slot *slot,
+		       struct uk_blkreq *req, struct nvme_sqe *cmd)
+{
+	struct uk_blkdev_cap *cap = &q->ndev->blkdev.capabilities;
+
+	if (unlikely(req->flags & ~UK_BLKREQ_F_FUA))
+		return -EINVAL;
+
+	if (unlikely((req->flags & UK_BLKREQ_F_FUA) &&
+		     req->operation != UK_BLKREQ_WRITE))
+		return -EINVAL;
+
+	if (unlikely(req->aio_buf == NULL))
+		return -EINVAL;
+
+	/* PRP entries must be dword aligned */
+	if (unlikely(!IS_ALIGNED((__uptr)req->aio_buf, cap->ioalign)))
+		return -EINVAL;
+
+	if (unlikely(req->nb_sectors == 0))
+		return -EINVAL;
+
+	if (unlikely(req->start_sector + req->nb_sectors > cap->sectors))
+		return -EINVAL;
+
+	if (unlikely(req->nb_sectors > cap->max_sectors_per_req))
+		return -EINVAL;
+
+	cmd->opc = (req->operation == UK_BLKREQ_WRITE) ?
+		   NVME_CMD_WRITE : NVME_CMD_READ;
+	cmd->cdw10 = (__u32)req->start_sector;
+	cmd->cdw11 = (__u32)(req->start_sector >> 32);
+	cmd->cdw12 = (__u32)(req->nb_sectors - 1);
+	if (req->flags & UK_BLKREQ_F_FUA)
+		cmd->cdw12 |= NVME_RW_FUA;
+
+	return nvme_prp_build(slot, req->aio_buf, req->nb_sectors * cap->ssize,
+			      cmd);
+}
+
+static int nvme_cmd_dwz(struct uk_blkdev_queue *q, struct nvme_slot *slot,
+			struct uk_blkreq *req, struct nvme_sqe *cmd)
+{
+	struct uk_blkdev_cap *cap = &q->ndev->blkdev.capabilities;
+	struct nvme_dsm_range *range;
+	__sector max_sectors;
+
+	if (req->operation == UK_BLKREQ_DISCARD) {
+		if (unlikely(!(cap->features & UK_BLKDEV_CAP_DISCARD)))
+			return -ENOTSUP;
+		if (unlikely(req->flags))
+			return -EINVAL;
+		max_sectors = cap->max_discard_sectors;
+	} else {
+		if (unlikely(!(cap->features & UK_BLKDEV_CAP_WRITE_ZEROES)))
+			return -ENOTSUP;
+		if (unlikely(req->flags & ~UK_BLKREQ_F_UNMAP))
+			return -EINVAL;
+		max_sectors = cap->max_write_zeroes_sectors;
+	}
+
+	if (unlikely(req->nb_sectors == 0 || req->nb_sectors > max_sectors))
+		return -EINVAL;
+
+	if (unlikely(req->start_sector + req->nb_sectors > cap->sectors))
+		return -EINVAL;
+
+	if (req->operation == UK_BLKREQ_DISCARD) {
+		/* A single range, which takes the place of the PRP list */
+		range = (struct nvme_dsm_range *)slot->prps;
+		range->cattr = 0;
+		range->nlb = (__u32)req->nb_sectors;
+		range->slba = req->start_sector;
+
+		cmd->opc = NVME_CMD_DSM;
+		cmd->prp1 = slot->prps_paddr;
+		cmd->cdw10 = 0;
+		cmd->cdw11 = NVME_DSM_AD;
+		return 0;
+	}
+
+	cmd->opc = NVME_CMD_WRITE_ZEROES;
+	cmd->cdw10 = (__u32)req->start_sector;
+	cmd->cdw11 = (__u32)(req->start_sector >> 32);
+	cmd->cdw12 = (__u32)(req->nb_sectors - 1);
+	if (req->flags & UK_BLKREQ_F_UNMAP)
+		cmd->cdw12 |= NVME_WZ_DEAC;
+	return 0;
+}
+
+/* Returns the number of free slots after the request, or an error */
+static int nvme_queue_enqueue(struct uk_blkdev_queue *q,
+			      struct uk_blkreq *req)
+{
+	struct nvme_slot *slot;
+	struct nvme_sqe cmd;
+	__u16 inflight;
+	__u16 cid;
+	int rc;
+
+	UK_ASSERT(q);
+	UK_ASSERT(req);
+
+	inflight = __atomic_load_n(&q->inflight, __ATOMIC_ACQUIRE);
+	if (unlikely(inflight >= q->nb_slots))
+		return -ENOSPC;
+
+	slot = nvme_slot_get(q, &cid);
+	if (unlikely(!slot))
+		return -ENOSPC;
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.cid = cid;
+	cmd.nsid = q->ndev->nsid;
+
+	switch (req->operation) {
+	case UK_BLKREQ_READ:
+	case UK_BLKREQ_WRITE:
+		rc = nvme_cmd_rw(q, slot, req, &cmd);
+		break;
+	case UK_BLKREQ_FFLUSH:
+		cmd.opc = NVME_CMD_FLUSH;
+		rc = 0;
+		break;
+	case UK_BLKREQ_DISCARD:
+	case UK_BLKREQ_WRITE_ZEROES:
+		rc = nvme_cmd_dwz(q, slot, req, &cmd);
+		break;
+	default:
+		rc = -EINVAL;
+		break;
+	}
+	if (unlikely(rc))
+		return rc;
+
+	slot->req = req;
+	inflight = __atomic_add_fetch(&q->inflight, 1, __ATOMIC_RELEASE);
+	nvme_sq_push(q, &cmd);
+
+	return q->nb_slots - inflight;
+}
+
+static int nvme_submit_request(struct uk_blkdev *dev __unused,
+			       struct uk_blkdev_queue *queue,
+			       struct uk_blkreq *req)
+{
+	int status = 0x0;
+	int rc;
+
+	UK_ASSERT(req);
+	UK_ASSERT(queue);
+
+	rc = nvme_queue_enqueue(queue, req);
+	if (unlikely(rc < 0)) {
+		if (rc != -ENOSPC)
+			uk_pr_err("Failed to enqueue request: %d\n", rc);
+		return rc;
+	}
+
+	nvme_sq_ring(queue);
+	status |= UK_BLKDEV_STATUS_SUCCESS;
+	status |= likely(rc > 0) ? UK_BLKDEV_STATUS_MORE : 0x0;
+	return status;
+}
+
+static int nvme_submit_burst(struct uk_blkdev *dev __unused,
+			     struct uk_blkdev_queue *queue,
+			     struct uk_blkreq *reqs[], __u16 cnt)
+{
+	__u16 i;
+	int rc = 0;
+
+	UK_ASSERT(queue);
+	UK_ASSERT(reqs || cnt == 0);
+
+	for (i = 0; i < cnt; i++) {
+		rc = nvme_queue_enqueue(queue, reqs[i]);
+		if (unlikely(rc < 0)) {
+			if (rc != -ENOSPC)
+				uk_pr_err("Failed to enqueue request: %d\n",
+					  rc);
+			break;
+		}
+		if (rc == 0) {
+			/* The queue is full after this request */
+			i++;
+			break;
+		}
+	}
+
+	if (i == 0)
+		return (rc == -ENOSPC) ? 0 : rc;
+
+	/* One doorbell write for all new commands */
+	nvme_sq_ring(queue);
+	return (int) i;
+}
+
+static inline void nvme_queue_intr_unmask(struct uk_blkdev_queue *q)
+{
+	pci_msix_set_entry(q->ndev->pdev, q->qid, q->msix_addr, q->msix_data);
+}
+
+static int nvme_complete_reqs(struct uk_blkdev *dev __unused,
+			      struct uk_blkdev_queue *q)
+{
+	volatile struct nvme_cqe *cqe;
+	struct nvme_slot *slot;
+	struct uk_blkreq *req;
+	unsigned int cnt = 0;
+	__u16 cid, status;
+
+	/* Queue interrupts have to be off when calling receive */
+	UK_ASSERT(!(q->intr_enabled & NVME_INTR_EN));
+
+	while (nvme_cq_pending(q)) {
+		rmb();
+		cqe = &q->cq[q->cq_head];
+		cid = cqe->cid;
+		status = NVME_CQE_STATUS(cqe->status);
+		nvme_cq_advance(q);
+
+		if (unlikely(cid >= q->nb_slots || !q->slots[cid].req)) {
+			uk_pr_err(DRIVER_NAME": Completion of unknown command %"
+				  __PRIu16" on queue %"__PRIu16"\n",
+				  cid, q->qid);
+			continue;
+		}
+
+		slot = &q->slots[cid];
+		req = slot->req;
+		req->result = status ? -EIO : 0;
+		if (unlikely(status))
+			uk_pr_debug(DRIVER_NAME": Request failed: status %#x\n",
+				    status);
+
+		/* Release the slot first, the callback may submit again */
+		__atomic_store_n(&slot->req, NULL, __ATOMIC_RELEASE);
+		__atomic_sub_fetch(&q->inflight, 1, __ATOMIC_RELEASE);
+
+		uk_blkreq_finished(req);
+		if (req->cb)
+			req->cb(req, req->cb_cookie);
+		cnt++;
+	}
+
+	if (cnt)
+		*q->cq_db = q->cq_head;
+
+	/* Enable interrupt only when user had previously enabled it. A
+	 * completion that arrived while the vector was masked is signaled
+	 * when it is unmasked.
+	 */
+	if (q->intr_enabled & NVME_INTR_USR_EN) {
+		q->intr_enabled |= NVME_INTR_EN;
+		nvme_queue_intr_unmask(q);
+	}
+
+	return cnt;
+}
+
+static int nvme_queue_irq(void *arg)
+{
+	struct uk_blkdev_queue *q = (struct uk_blkdev_queue *)arg;
+
+	UK_ASSERT(q);
+
+	/* MSI-X vectors are not shared, so the interrupt is ours */
+	pci_msix_mask_entry(q->ndev->pdev, q->qid);
+	q->intr_enabled &= ~(NVME_INTR_EN);
+
+	uk_blkdev_drv_queue_event(&q->ndev->blkdev, q->lqueue_id);
+	return 1;
+}
+
+static int nvme_queue_intr_enable(struct uk_blkdev *dev __unused,
+				  struct uk_blkdev_queue *q)
+{
+	UK_ASSERT(q);
+
+	if (!q->has_intr)
+		return -ENOTSUP;
+
+	/* If the interrupt is enabled */
+	if (q->intr_enabled & NVME_INTR_EN)
+		return 0;
+
+	q->intr_enabled = NVME_INTR_USR_EN | NVME_INTR_EN;
+	nvme_queue_intr_unmask(q);
+	return 0;
+}
+
+static int nvme_queue_intr_disable(struct uk_blkdev *dev __unused,
+				   struct uk_blkdev_queue *q)
+{
+	UK_ASSERT(q);
+
+	if (q->has_intr)
+		pci_msix_mask_entry(q->ndev->pdev, q->qid);
+	q->intr_enabled &= ~(NVME_INTR_USR_EN | NVME_INTR_EN);
+	return 0;
+}
+
+static int nvme_queue_delete(struct nvme_dev *d, __u8 opc, __u16 qid)
+{
+	struct nvme_sqe cmd;
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.opc = opc;
+	cmd.cdw10 = qid;
+	return nvme_admin_cmd(d, &cmd, NULL);
+}
+
+/* Creates the queue pair on the controller, with an interrupt vector
+ * that is routed to the lcpu of the queue unless `poll` is set
+ */
+static int nvme_queue_create(struct nvme_dev *d, struct uk_blkdev_queue *q,
+			     int poll)
+{
+	struct nvme_sqe cmd;
+	unsigned int irq = 0;
+	__lcpuidx lcpu;
+	int rc;
+
+	q->has_intr = !poll && d->msix_irqs;
+	if (q->has_intr) {
+		irq = d->msix_irqs[q->qid - 1];
+		lcpu = q->lqueue_id % ukplat_lcpu_count();
+		rc = uk_intctlr_irq_msi_compose(irq, lcpu,
+						pci_requester_id(d->pdev),
+						&q->msix_addr, &q->msix_data);
+		if (unlikely(rc))
+			return rc;
+
+		rc = uk_intctlr_irq_register(irq, nvme_queue_irq, q);
+		if (unlikely(rc))
+			return rc;
+	}
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.opc = NVME_ADMIN_CREATE_CQ;
+	cmd.prp1 = ukplat_virt_to_phys((void *)q->cq);
+	cmd.cdw10 = ((__u32)(q->qsize - 1) << 16) | q->qid;
+	cmd.cdw11 = NVME_QUEUE_PC;
+	if (q->has_intr)
+		cmd.cdw11 |= NVME_CQ_IEN | NVME_CQ_IV(q->qid);
+	rc = nvme_admin_cmd(d, &cmd, NULL);
+	if (unlikely(rc))
+		goto err_unregister;
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.opc = NVME_ADMIN_CREATE_SQ;
+	cmd.prp1 = ukplat_virt_to_phys(q->sq);
+	cmd.cdw10 = ((__u32)(q->qsize - 1) << 16) | q->qid;
+	cmd.cdw11 = NVME_QUEUE_PC | NVME_SQ_CQID(q->qid);
+	rc = nvme_admin_cmd(d, &cmd, NULL);
+	if (unlikely(rc))
+		goto err_delete_cq;
+
+	return 0;
+
+err_delete_cq:
+	nvme_queue_delete(d, NVME_ADMIN_DELETE_CQ, q->qid);
+err_unregister:
+	if (q->has_intr)
+		uk_intctlr_irq_unregister(irq, nvme_queue_irq);
+	return rc;
+}
+
+static struct uk_blkdev_queue *nvme_queue_setup(struct uk_blkdev *dev,
+		__u16 queue_id,
+		__u16 nb_desc,
+		const struct uk_blkdev_queue_conf *queue_conf)
+{
+	struct uk_blkdev_queue *q;
+	struct nvme_dev *d;
+	int rc;
+
+	UK_ASSERT(dev != NULL);
+	UK_ASSERT(queue_conf != NULL);
+
+	d = to_nvmedev(dev);
+	if (unlikely(queue_id >= d->nb_queues)) {
+		uk_pr_err("Invalid queue_id %"__PRIu16"\n", queue_id);
+		return ERR2PTR(-EINVAL);
+	}
+
+	if (!nb_desc)
+		nb_desc = MIN(d->max_qsize, NVME_IO_QSIZE_DEF);
+	if (unlikely(nb_desc < 2 || nb_desc > d->max_qsize)) {
+		uk_pr_err("Invalid number of descriptors: %"__PRIu16"\n",
+			  nb_desc);
+		return ERR2PTR(-EINVAL);
+	}
+
+	q = &d->qs[queue_id];
+	rc = nvme_queue_alloc(d, q, queue_conf->a, queue_id + 1, nb_desc);
+	if (unlikely(rc))
+		return ERR2PTR(rc);
+	q->lqueue_id = queue_id;
+
+	rc = nvme_queue_create(d, q,
+			       queue_conf->flags & UK_BLKDEV_QUEUE_F_POLL);
+	if (unlikely(rc)) {
+		uk_pr_err("Failed to create queue %"__PRIu16": %d\n",
+			  queue_id, rc);
+		nvme_queue_free(q);
+		return ERR2PTR(rc);
+	}
+
+	return q;
+}
+
+static int nvme_queue_release(struct uk_blkdev *dev,
+			      struct uk_blkdev_queue *q)
+{
+	struct nvme_dev *d;
+	int rc;
+
+	UK_ASSERT(dev != NULL);
+	UK_ASSERT(q != NULL);
+	d = to_nvmedev(dev);
+
+	/* A controller that was shut down does not take commands anymore */
+	if (!d->shutdown) {
+		rc = nvme_queue_delete(d, NVME_ADMIN_DELETE_SQ, q->qid);
+		if (likely(!rc))
+			rc = nvme_queue_delete(d, NVME_ADMIN_DELETE_CQ,
+					       q->qid);
+		if (unlikely(rc))
+			return rc;
+	}
+
+	if (q->has_intr) {
+		pci_msix_mask_entry(d->pdev, q->qid);
+		uk_intctlr_irq_unregister(d->msix_irqs[q->qid - 1],
+					  nvme_queue_irq);
+	}
+
+	nvme_queue_free(q);
+	return 0;
+}
+
+static int nvme_queue_info_get(struct uk_blkdev *dev,
+			       __u16 queue_id,
+			       struct uk_blkdev_queue_info *qinfo)
+{
+	struct nvme_dev *d;
+
+	UK_ASSERT(dev);
+	UK_ASSERT(qinfo);
+
+	d = to_nvmedev(dev);
+	if (unlikely(queue_id >= d->nb_queues)) {
+		uk_pr_err("Invalid queue_id %"__PRIu16"\n", queue_id);
+		return -EINVAL;
+	}
+
+	qinfo->nb_min = 2;
+	qinfo->nb_max = d->max_qsize;
+	qinfo->nb_is_power_of_two = 0;
+	return 0;
+}
+
+static int nvme_configure(struct uk_blkdev *dev,
+			  const struct uk_blkdev_conf *conf)
+{
+	struct nvme_dev *d;
+
+	UK_ASSERT(dev != NULL);
+	UK_ASSERT(conf != NULL);
+
+	d = to_nvmedev(dev);
+	if (unlikely(conf->nb_queues > d->max_queues)) {
+		uk_pr_err("Queue number not supported: %"__PRIu16"\n",
+			  conf->nb_queues);
+		return -ENOTSUP;
+	}
+
+	d->qs = uk_calloc(a, conf->nb_queues, sizeof(*d->qs));
+	if (unlikely(!d->qs)) {
+		uk_pr_err("Failed to allocate memory for queue management\n");
+		return -ENOMEM;
+	}
+	d->nb_queues = conf->nb_queues;
+
+	uk_pr_info(DRIVER_NAME": %"__PRIu16" configured\n", d->uid);
+	return 0;
+}
+
+static int nvme_start(struct uk_blkdev *dev)
+{
+	struct nvme_dev *d;
+
+	UK_ASSERT(dev != NULL);
+
+	d = to_nvmedev(dev);
+	if (unlikely(d->shutdown)) {
+		uk_pr_warn(DRIVER_NAME": %"__PRIu16" Restart is not supported\n",
+			   d->uid);
+		return -ENOTSUP;
+	}
+
+	uk_pr_info(DRIVER_NAME": %"__PRIu16" started\n", d->uid);
+	return 0;
+}
+
+/* Shuts the controller down, so that its volatile write cache is written
+ * back. If one queue has requests in flight it returns -EBUSY.
+ */
+static int nvme_stop(struct uk_blkdev *dev)
+{
+	struct nvme_dev *d;
+	__u16 q_id;
+	__u32 cc;
+	int rc;
+
+	UK_ASSERT(dev != NULL);
+
+	d = to_nvmedev(dev);
+	for (q_id = 0; q_id < d->nb_queues; ++q_id) {
+		if (unlikely(__atomic_load_n(&d->qs[q_id].inflight,
+					     __ATOMIC_ACQUIRE))) {
+			uk_pr_err("Queue:%"__PRIu16" has requests in flight\n",
+				  q_id);
+			return -EBUSY;
+		}
+	}
+
+	cc = nvme_read32(d, NVME_REG_CC);
+	nvme_write32(d, NVME_REG_CC,
+		     (cc & ~NVME_CC_SHN_MASK) | NVME_CC_SHN_NORMAL);
+	rc = nvme_wait_csts(d, NVME_CSTS_SHST_MASK, NVME_CSTS_SHST_CMPLT);
+	if (unlikely(rc)) {
+		uk_pr_err(DRIVER_NAME": %"__PRIu16" Failed to shut down: %d\n",
+			  d->uid, rc);
+		return rc;
+	}
+
+	d->shutdown = 1;
+	uk_pr_info(DRIVER_NAME": %"__PRIu16" stopped\n", d->uid);
+	return 0;
+}
+
+static int nvme_unconfigure(struct uk_blkdev *dev)
+{
+	struct nvme_dev *d;
+
+	UK_ASSERT(dev != NULL);
+
+	d = to_nvmedev(dev);
+	uk_free(a, d->qs);
+	d->qs = NULL;
+	d->nb_queues = 0;
+	return 0;
+}
+
+static void nvme_get_info(struct uk_blkdev *dev,
+			  struct uk_blkdev_info *dev_info)
+{
+	struct nvme_dev *d;
+
+	UK_ASSERT(dev != NULL);
+	UK_ASSERT(dev_info != NULL);
+
+	d = to_nvmedev(dev);
+	dev_info->max_queues = d->max_queues;
+}
+
+static const struct uk_blkdev_ops nvme_ops = {
+	.get_info = nvme_get_info,
+	.dev_configure = nvme_configure,
+	.queue_get_info = nvme_queue_info_get,
+	.queue_configure = nvme_queue_setup,
+	.queue_intr_enable = nvme_queue_intr_enable,
+	.dev_start = nvme_start,
+	.dev_stop = nvme_stop,
+	.queue_intr_disable = nvme_queue_intr_disable,
+	.queue_unconfigure = nvme_queue_release,
+	.dev_unconfigure = nvme_unconfigure,
+};
+
+/* Resets the controller and enables it with the admin queue */
+static int nvme_ctrl_enable(struct nvme_dev *d)
+{
+	struct uk_blkdev_queue *q = &d->admin;
+	__u32 cc;
+	int rc;
+
+	cc = nvme_read32(d, NVME_REG_CC);
+	if (cc & NVME_CC_EN) {
+		/* A controller must be ready before it can be reset */
+		nvme_wait_csts(d, NVME_CSTS_RDY, NVME_CSTS_RDY);
+		nvme_write32(d, NVME_REG_CC, cc & ~NVME_CC_EN);
+	}
+	rc = nvme_wait_csts(d, NVME_CSTS_RDY, 0);
+	if (unlikely(rc))
+		return rc;
+
+	nvme_write32(d, NVME_REG_AQA,
+		     ((__u32)(q->qsize - 1) << 16) | (q->qsize - 1));
+	nvme_write64(d, NVME_REG_ASQ, ukplat_virt_to_phys(q->sq));
+	nvme_write64(d, NVME_REG_ACQ, ukplat_virt_to_phys((void *)q->cq));
+
+	cc = NVME_CC_EN | NVME_CC_CSS_NVM | NVME_CC_MPS(__PAGE_SHIFT) |
+	     NVME_CC_AMS_RR | NVME_CC_IOSQES(NVME_SQE_SHIFT) |
+	     NVME_CC_IOCQES(NVME_CQE_SHIFT);
+	nvme_write32(d, NVME_REG_CC, cc);
+	return nvme_wait_csts(d, NVME_CSTS_RDY, NVME_CSTS_RDY);
+}
+
+static int nvme_identify(struct nvme_dev *d, __u32 cns, __u32 nsid,
+			 void *buf)
+{
+	struct nvme_sqe cmd;
+
+	/* The buffer is a single page, so one PRP entry is enough */
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.opc = NVME_ADMIN_IDENTIFY;
+	cmd.nsid = nsid;
+	cmd.prp1 = ukplat_virt_to_phys(buf);
+	cmd.cdw10 = cns;
+	return nvme_admin_cmd(d, &cmd, NULL);
+}
+
+/* Asks for `nr` I/O queue pairs and returns how many were granted */
+static int nvme_queues_request(struct nvme_dev *d, __u16 nr)
+{
+	struct nvme_sqe cmd;
+	__u32 dw0;
+	int rc;
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.opc = NVME_ADMIN_SET_FEATURES;
+	cmd.cdw10 = NVME_FEAT_NUM_QUEUES;
+	cmd.cdw11 = ((__u32)(nr - 1) << 16) | (nr - 1);
+	rc = nvme_admin_cmd(d, &cmd, &dw0);
+	if (unlikely(rc))
+		return rc;
+
+	/* The numbers of submission and completion queues are 0's based */
+	return MIN(MIN(dw0 & 0xffff, dw0 >> 16) + 1, (__u32)nr);
+}
+
+/* Sets up the namespace and the capabilities of the block device */
+static int nvme_ns_setup(struct nvme_dev *d, void *buf)
+{
+	struct uk_blkdev_cap *cap = &d->blkdev.capabilities;
+	struct nvme_id_ctrl *ctrl = buf;
+	struct nvme_id_ns *ns = buf;
+	__sz max_transfer;
+	__u32 *nslist = buf;
+	__u16 oncs;
+	__u8 lbads;
+	int rc;
+
+	rc = nvme_identify(d, NVME_IDENTIFY_CTRL, 0, buf);
+	if (unlikely(rc))
+		return rc;
+
+	/* The PRP list of a slot and a possibly unaligned buffer limit the
+	 * transfer size as much as the controller does
+	 */
+	max_transfer = NVME_PRP_ENTRIES * __PAGE_SIZE;
+	if (ctrl->mdts)
+		max_transfer = MIN(max_transfer,
+				   (__sz)1 << (ctrl->mdts + 12 +
+					       NVME_CAP_MPSMIN(d->cap)));
+	oncs = ctrl->oncs;
+
+	/* Use the first active namespace. The list is not available before
+	 * NVMe 1.1, where namespace 1 is taken.
+	 */
+	d->nsid = 1;
+	rc = nvme_identify(d, NVME_IDENTIFY_NS_LIST, 0, buf);
+	if (likely(!rc) && nslist[0])
+		d->nsid = nslist[0];
+
+	rc = nvme_identify(d, NVME_IDENTIFY_NS, d->nsid, buf);
+	if (unlikely(rc))
+		return rc;
+
+	lbads = ns->lbaf[NVME_NS_FLBAS_IDX(ns->flbas)].lbads;
+	if (unlikely(!ns->nsze || lbads < 9 || lbads > __PAGE_SHIFT)) {
+		uk_pr_err(DRIVER_NAME": Namespace %"__PRIu32" not usable\n",
+			  d->nsid);
+		return -ENODEV;
+	}
+
+	cap->ssize = 1UL << lbads;
+	cap->sectors = ns->nsze;
+	cap->mode = O_RDWR;
+	cap->ioalign = sizeof(__u32);
+	cap->max_sectors_per_req = MIN(max_transfer >> lbads,
+				       (__sz)NVME_RW_MAX_NLB);
+
+	/* FUA is part of every write command */
+	cap->features = UK_BLKDEV_CAP_FUA;
+	if (oncs & NVME_ONCS_DSM) {
+		cap->features |= UK_BLKDEV_CAP_DISCARD;
+		cap->max_discard_sectors = __U32_MAX;
+		cap->discard_align = 1;
+	}
+	if (oncs & NVME_ONCS_WRITE_ZEROES) {
+		cap->features |= UK_BLKDEV_CAP_WRITE_ZEROES;
+		cap->max_write_zeroes_sectors = NVME_RW_MAX_NLB;
+	}
+	return 0;
+}
+
+/* Allocates one MSI-X vector per I/O queue. Without MSI-X, queues can
+ * only be polled.
+ */
+static void nvme_msix_setup(struct nvme_dev *d)
+{
+	__u16 count = pci_msix_count(d->pdev);
+	unsigned int *irqs;
+	int rc;
+
+	if (count < 2) {
+		uk_pr_warn(DRIVER_NAME": No MSI-X, queues must be polled\n");
+		return;
+	}
+
+	/* Vector 0 belongs to the admin queue */
+	d->max_queues = MIN(d->max_queues, count - 1);
+
+	irqs = uk_malloc(a, d->max_queues * sizeof(*irqs));
+	if (unlikely(!irqs))
+		return;
+
+	rc = uk_intctlr_irq_alloc(irqs, d->max_queues);
+	if (unlikely(rc))
+		goto err_free;
+
+	rc = pci_msix_enable(d->pdev);
+	if (unlikely(rc))
+		goto err_irq_free;
+
+	d->msix_irqs = irqs;
+	return;
+
+err_irq_free:
+	uk_intctlr_irq_free(irqs, d->max_queues);
+err_free:
+	uk_free(a, irqs);
+	uk_pr_warn(DRIVER_NAME": Failed to enable MSI-X: %d\n", rc);
+}
+
+static int nvme_probe(struct nvme_dev *d)
+{
+	void *buf;
+	__u32 cmd;
+	int rc;
+
+	d->regs = pci_bar_map(d->pdev, 0, 0, NVME_REG_DBS);
+	if (unlikely(PTRISERR(d->regs)))
+		return PTR2ERR(d->regs);
+
+	d->cap = nvme_read64(d, NVME_REG_CAP);
+	d->db_stride = 4U << NVME_CAP_DSTRD(d->cap);
+	d->timeout = ukarch_time_msec_to_nsec(MAX(NVME_CAP_TO(d->cap), 1U) *
+					      NVME_CAP_TO_UNIT_MS);
+	d->max_qsize = MIN(NVME_CAP_MQES(d->cap) + 1, NVME_IO_QSIZE_MAX);
+	if (unlikely(!NVME_CAP_CSS_NVM(d->cap) ||
+		     NVME_CAP_MPSMIN(d->cap) + 12 > __PAGE_SHIFT)) {
+		uk_pr_err(DRIVER_NAME": Unsupported controller\n");
+		return -ENOTSUP;
+	}
+
+	/* Doorbells of the admin queue and of all I/O queues we may use */
+	d->regs = pci_bar_map(d->pdev, 0, 0, NVME_REG_DBS +
+			      2 * (CONFIG_LIBUKBLKDEV_MAXNBQUEUES + 1) *
+			      d->db_stride);
+	if (unlikely(PTRISERR(d->regs)))
+		return PTR2ERR(d->regs);
+
+	/* The controller accesses queues and buffers with DMA. The upper
+	 * half is the status, whose bits are cleared by writing ones.
+	 */
+	cmd = pci_config_read32(d->pdev, PCI_COMMAND) & 0xffff;
+	pci_config_write32(d->pdev, PCI_COMMAND,
+			   cmd | PCI_COMMAND_MEMORY | PCI_COMMAND_MASTER);
+
+	rc = nvme_queue_alloc(d, &d->admin, a, 0, NVME_ADMIN_QSIZE);
+	if (unlikely(rc))
+		return rc;
+
+	rc = nvme_ctrl_enable(d);
+	if (unlikely(rc)) {
+		uk_pr_err(DRIVER_NAME": Failed to enable controller: %d\n",
+			  rc);
+		goto err_free_admin;
+	}
+
+	buf = uk_memalign(a, __PAGE_SIZE, NVME_IDENTIFY_SIZE);
+	if (unlikely(!buf)) {
+		rc = -ENOMEM;
+		goto err_free_admin;
+	}
+	rc = nvme_ns_setup(d, buf);
+	uk_free(a, buf);
+	if (unlikely(rc))
+		goto err_free_admin;
+
+	rc = nvme_queues_request(d, CONFIG_LIBUKBLKDEV_MAXNBQUEUES);
+	if (unlikely(rc < 0))
+		goto err_free_admin;
+	d->max_queues = rc;
+
+	nvme_msix_setup(d);
+	return 0;
+
+err_free_admin:
+	nvme_queue_free(&d->admin);
+	return rc;
+}
+
+static int nvme_add_dev(struct pci_device *pdev)
+{
+	struct nvme_dev *d;
+	int rc;
+
+	UK_ASSERT(pdev != NULL);
+
+	if ((pci_config_read32(pdev, PCI_CLASS_REVISION) >> 8) !=
+	    NVME_PCI_CLASS)
+		return -ENODEV;
+
+	d = uk_calloc(a, 1, sizeof(*d));
+	if (unlikely(!d))
+		return -ENOMEM;
+
+	d->pdev = pdev;
+	rc = nvme_probe(d);
+	if (unlikely(rc)) {
+		uk_pr_err(DRIVER_NAME": Failed to probe device: %d\n", rc);
+		goto err_free;
+	}
+
+	d->blkdev.finish_reqs = nvme_complete_reqs;
+	d->blkdev.submit_one = nvme_submit_request;
+	d->blkdev.submit_burst = nvme_submit_burst;
+	d->blkdev.dev_ops = &nvme_ops;
+
+	rc = uk_blkdev_drv_register(&d->blkdev, a, drv_name);
+	if (unlikely(rc < 0)) {
+		uk_pr_err("Failed to register nvme device: %d\n", rc);
+		goto err_free;
+	}
+	d->uid = rc;
+
+	uk_pr_info(DRIVER_NAME": %"__PRIu16" namespace %"__PRIu32": %"
+		   __PRIu64" sectors of %"__PRIsz" bytes, %"__PRIu16
+		   " queues\n", d->uid, d->nsid,
+		   (__u64)d->blkdev.capabilities.sectors,
+		   d->blkdev.capabilities.ssize, d->max_queues);
+	return 0;
+
+err_free:
+	uk_free(a, d);
+	return rc;
+}
+
+static int nvme_drv_init(struct uk_alloc *drv_allocator)
+{
+	/* driver initialization */
+	if (unlikely(!drv_allocator))
+		return -EINVAL;
+
+	a = drv_allocator;
+	return 0;
+}
+
+/* Controllers are matched by ID since the class code is not matched
+ * consistently across architectures. nvme_add_dev() checks it.
+ */
+static const struct pci_device_id nvme_pci_ids[] = {
+	{PCI_DEVICE_ID(0x1b36, 0x0010)},	/* QEMU */
+	{PCI_DEVICE_ID(0x8086, 0x0953)},	/* Intel DC P3x00 */
+	{PCI_DEVICE_ID(0x8086, 0x0a53)},	/* Intel DC P3520 */
+	{PCI_DEVICE_ID(0x8086, 0x0a54)},	/* Intel DC P4x00 */
+	{PCI_DEVICE_ID(0x8086, 0xf1a5)},	/* Intel 600P */
+	{PCI_DEVICE_ID(0x144d, 0xa802)},	/* Samsung SM951 */
+	{PCI_DEVICE_ID(0x144d, 0xa804)},	/* Samsung 960 */
+	{PCI_DEVICE_ID(0x144d, 0xa808)},	/* Samsung 970 */
+	{PCI_DEVICE_ID(0x144d, 0xa80a)},	/* Samsung 980 Pro */
+	{PCI_DEVICE_ID(0x1d0f, 0x0061)},	/* Amazon EBS */
+	{PCI_DEVICE_ID(0x1d0f, 0x8061)},	/* Amazon EBS */
+	{PCI_DEVICE_ID(0x1d0f, 0xcd00)},	/* Amazon instance storage */
+	{PCI_DEVICE_ID(0x1d0f, 0xcd01)},	/* Amazon instance storage */
+	/* End of Driver List */
+	{PCI_ANY_DEVICE_ID},
+};
+
+static struct pci_driver nvme_pci_drv = {
+	.device_ids = nvme_pci_ids,
+	.init = nvme_drv_init,
+	.add_dev = nvme_add_dev
+};
+PCI_REGISTER_DRIVER(&nvme_pci_drv);
@@ -62,6 +62,27 @@
 #define DEVFN(dev, fn)   ((dev << PCI_FN_BIT_NBR) | fn)
 #define SIZE_PER_PCI_DEV 0x20	/* legacy pci device size, no msi */
 
+__u32 pci_config_read32(struct pci_device *dev, __u16 off)
+{
+	__u32 val;
+
+	UK_ASSERT(dev);
+
+	pci_generic_config_read(dev->addr.bus,
+				DEVFN(dev->addr.devid, dev->addr.function),
+				off, 4, &val);
+	return val;
+}
+
+void pci_config_write32(struct pci_device *dev, __u16 off, __u32 val)
+{
+	UK_ASSERT(dev);
+
+	pci_generic_config_write(dev->addr.bus,
+				 DEVFN(dev->addr.devid, dev->addr.function),
+				 off, 4, val);
+}
+
 static int arch_pci_driver_add_device(struct pci_driver *drv,
 					struct pci_address *addr,
 					struct pci_device_id *devid,
@@ -65,6 +65,30 @@
 		*(ret) = (type) _conf_data;				\
 	} while (0)
 
+static inline __u32 pci_config_addr(struct pci_device *dev, __u16 off)
+{
+	UK_ASSERT(dev);
+	UK_ASSERT(!(off & 0x3) && off < 0x100);
+
+	return (PCI_ENABLE_BIT)
+		| (dev->addr.bus << PCI_BUS_SHIFT)
+		| (dev->addr.devid << PCI_DEVICE_SHIFT)
+		| (dev->addr.function << PCI_FUNCTION_SHIFT)
+		| off;
+}
+
+__u32 pci_config_read32(struct pci_device *dev, __u16 off)
+{
+	outl(PCI_CONFIG_ADDR, pci_config_addr(dev, off));
+	return inl(PCI_CONFIG_DATA);
+}
+
+void pci_config_write32(struct pci_device *dev, __u16 off, __u32 val)
+{
+	outl(PCI_CONFIG_ADDR, pci_config_addr(dev, off));
+	outl(PCI_CONFIG_DATA, val);
+}
+
 static inline int pci_driver_add_device(struct pci_driver *drv,
 					struct pci_address *addr,
 					struct pci_device_id *devid)
@@ -159,6 +159,11 @@ struct pci_device {
 
 	unsigned long base;
 	unsigned long irq;
+
+	/* MSI-X state, see pci_msix_enable() */
+	__u8 msix_cap;		/* Offset of the capability, 0 if none */
+	__u16 msix_count;	/* Number of table entries */
+	volatile __u32 *msix_table;
 };
 
 
@@ -292,6 +297,35 @@ static struct pci_bus_handler ph __unused;
 #define  PCI_COMMAND_INTX_DISABLE 0x400 /* INTx Emulation Disable */
 #define PCI_COMMAND_DECODE_ENABLE	(PCI_COMMAND_MEMORY | PCI_COMMAND_IO)
 
+#define PCI_STATUS_CAP_LIST	0x10	/* Support Capability List */
+
+/* Capability lists */
+#define PCI_CAP_LIST_ID		0	/* Capability ID */
+#define  PCI_CAP_ID_VNDR	0x09	/* Vendor specific */
+#define  PCI_CAP_ID_MSIX	0x11	/* MSI-X */
+#define PCI_CAP_LIST_NEXT	1	/* Next capability in the list */
+
+/* MSI-X capability */
+#define PCI_MSIX_FLAGS		2	/* Message Control, 16 bits */
+#define  PCI_MSIX_FLAGS_QSIZE	0x07ff	/* Table size - 1 */
+#define  PCI_MSIX_FLAGS_MASKALL	0x4000	/* Mask all vectors */
+#define  PCI_MSIX_FLAGS_ENABLE	0x8000	/* MSI-X enable */
+#define PCI_MSIX_TABLE		4	/* Table offset and BAR indicator */
+#define  PCI_MSIX_TABLE_BIR	0x00000007
+#define  PCI_MSIX_TABLE_OFFSET	0xfffffff8
+
+/* MSI-X table entries, in 32-bit words */
+#define PCI_MSIX_ENTRY_SIZE		16
+#define PCI_MSIX_ENTRY_LOWER_ADDR	0
+#define PCI_MSIX_ENTRY_UPPER_ADDR	1
+#define PCI_MSIX_ENTRY_DATA		2
+#define PCI_MSIX_ENTRY_VECTOR_CTRL	3
+#define  PCI_MSIX_ENTRY_CTRL_MASKBIT	0x1
+
+#define  PCI_BASE_ADDRESS_SPACE_IO	0x01
+#define  PCI_BASE_ADDRESS_MEM_TYPE_64	0x04
+#define  PCI_BASE_ADDRESS_MEM_MASK	(~0x0fUL)
+
 /* 0x35-0x3b are reserved */
 #define PCI_INTERRUPT_LINE	0x3c	/* 8 bits */
 #define PCI_INTERRUPT_PIN	0x3d	/* 8 bits */
@@ -300,6 +334,154 @@ static struct pci_bus_handler ph __unused;
 
 struct pci_driver *pci_find_driver(struct pci_device_id *id);
 
+/**
+ * Reads a 32-bit word of the configuration space of a device
+ *
+ * @param dev
+ *   The PCI device
+ * @param off
+ *   Offset in the configuration space, aligned to 4 bytes
+ */
+__u32 pci_config_read32(struct pci_device *dev, __u16 off);
+
+/**
+ * Writes a 32-bit word of the configuration space of a device
+ *
+ * @param dev
+ *   The PCI device
+ * @param off
+ *   Offset in the configuration space, aligned to 4 bytes
+ * @param val
+ *   Value to write
+ */
+void pci_config_write32(struct pci_device *dev, __u16 off, __u32 val);
+
+static inline __u16 pci_config_read16(struct pci_device *dev, __u16 off)
+{
+	return (__u16)(pci_config_read32(dev, off & ~0x3) >> ((off & 0x2) * 8));
+}
+
+static inline __u8 pci_config_read8(struct pci_device *dev, __u16 off)
+{
+	return (__u8)(pci_config_read32(dev, off & ~0x3) >> ((off & 0x3) * 8));
+}
+
+/**
+ * Returns the requester ID (bus, device, function) that identifies the
+ * messages sent by a device within its domain
+ */
+static inline __u16 pci_requester_id(struct pci_device *dev)
+{
+	return (__u16)((dev->addr.bus << 8) | (dev->addr.devid << 3) |
+		       dev->addr.function);
+}
+
+/**
+ * Returns the offset of a capability in the configuration space of a device,
+ * or 0 if the device does not have the capability
+ *
+ * @param dev
+ *   The PCI device
+ * @param cap_id
+ *   Capability ID (PCI_CAP_ID_*)
+ */
+__u8 pci_find_capability(struct pci_device *dev, __u8 cap_id);
+
+/**
+ * Like `pci_find_capability()`, but continues the search after the
+ * capability at `pos`. Allows to iterate over capabilities that occur more
+ * than once, e.g., vendor specific ones.
+ */
+__u8 pci_find_next_capability(struct pci_device *dev, __u8 pos, __u8 cap_id);
+
+/**
+ * Returns the physical address of a memory BAR
+ *
+ * @param dev
+ *   The PCI device
+ * @param bir
+ *   Index of the BAR (0-5)
+ * @return
+ *   The physical base address of the BAR, or 0 if it is not a memory BAR
+ */
+__paddr_t pci_bar_addr(struct pci_device *dev, unsigned int bir);
+
+/**
+ * Returns the size of a memory BAR. Memory decoding of the device is
+ * disabled while the BAR is sized.
+ *
+ * @param dev
+ *   The PCI device
+ * @param bir
+ *   Index of the BAR (0-5)
+ * @return
+ *   The size of the BAR in bytes, or 0 if it is not a memory BAR
+ */
+__sz pci_bar_size(struct pci_device *dev, unsigned int bir);
+
+/**
+ * Makes a range of a memory BAR accessible
+ *
+ * @param dev
+ *   The PCI device
+ * @param bar
+ *   Index of the BAR (0-5)
+ * @param off
+ *   Offset of the range within the BAR
+ * @param len
+ *   Length of the range
+ * @return
+ *   The virtual address of the range, or an error pointer: -ENOTSUP if the
+ *   BAR is not a memory BAR, or the error of mapping the range
+ */
+void *pci_bar_map(struct pci_device *dev, unsigned int bar, __u32 off,
+		  __sz len);
+
+/**
+ * Returns the number of MSI-X vectors of a device, or 0 if the device does
+ * not support MSI-X
+ */
+__u16 pci_msix_count(struct pci_device *dev);
+
+/**
+ * Maps the MSI-X table of a device, masks all its entries, and enables
+ * MSI-X. The device stops signaling its legacy INTx interrupt.
+ *
+ * @param dev
+ *   The PCI device
+ * @return
+ *   0 on success, -ENOTSUP if the device does not support MSI-X, or a
+ *   negative error code if the table could not be mapped
+ */
+int pci_msix_enable(struct pci_device *dev);
+
+/**
+ * Disables MSI-X for a device, so that it falls back to INTx
+ */
+void pci_msix_disable(struct pci_device *dev);
+
+/**
+ * Programs an MSI-X table entry with a message and unmasks it. The message
+ * is provided by the interrupt controller (see
+ * `uk_intctlr_irq_msi_compose()`).
+ *
+ * @param dev
+ *   The PCI device, with MSI-X enabled
+ * @param idx
+ *   Index of the table entry
+ * @param addr
+ *   Message address
+ * @param data
+ *   Message data
+ */
+void pci_msix_set_entry(struct pci_device *dev, __u16 idx, __u64 addr,
+			__u32 data);
+
+/**
+ * Masks an MSI-X table entry
+ */
+void pci_msix_mask_entry(struct pci_device *dev, __u16 idx);
+
 #ifdef __cplusplus
 }
 #endif
@@ -412,7 +412,7 @@ static int gen_pci_probe(struct pf_device *pfdev __unused)
 	dtb = (void *)ukplat_bootinfo_get()->dtb;
 	/* 1.Get the base and size of config space */
 	comp = gen_pci_match_table[0].compatible;
-	gen_pci_fdt = fdt_node_offset_by_compatible(dtb, -1, comp);
+	gen_pci_fdt = fdt_node_offset_by_compatible_cached(dtb, -1, comp);
 	if (gen_pci_fdt < 0) {
 		uk_pr_info("Error in searching pci controller in fdt\n");
 		goto error_exit;
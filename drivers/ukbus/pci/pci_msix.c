@@ -0,0 +1,287 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * Capability lists and MSI-X
+ *
+ * With MSI-X, a device signals each interrupt source with a memory write
+ * that the interrupt controller turns into a dedicated interrupt. The
+ * messages are programmed into a table in one of the memory BARs of the
+ * device.
+ */
+#include <errno.h>
+#include <uk/assert.h>
+#include <uk/essentials.h>
+#include <uk/print.h>
+#include <uk/bus/pci.h>
+#include <uk/errptr.h>
+#if CONFIG_PAGING
+#include <uk/plat/paging.h>
+#endif /* CONFIG_PAGING */
+
+/* Capabilities start after the standard header */
+#define PCI_CAP_MIN_OFFSET	0x40
+
+/* Searches the capability list from the capability pointer at `pos` */
+static __u8 pci_find_capability_from(struct pci_device *dev, __u8 pos,
+				     __u8 cap_id)
+{
+	unsigned int ttl = (0x100 - PCI_CAP_MIN_OFFSET) / 4;
+
+	pos = pci_config_read8(dev, pos);
+	/* Guard against loops in a broken list */
+	while (ttl-- && pos >= PCI_CAP_MIN_OFFSET) {
+		pos &= ~0x3;
+		if (pci_config_read8(dev, pos + PCI_CAP_LIST_ID) == cap_id)
+			return pos;
+		pos = pci_config_read8(dev, pos + PCI_CAP_LIST_NEXT);
+	}
+
+	return 0;
+}
+
+__u8 pci_find_capability(struct pci_device *dev, __u8 cap_id)
+{
+	UK_ASSERT(dev);
+
+	if (!(pci_config_read16(dev, PCI_STATUS_OFFSET) & PCI_STATUS_CAP_LIST))
+		return 0;
+
+	return pci_find_capability_from(dev, PCI_CAPABILITIES_PTR, cap_id);
+}
+
+__u8 pci_find_next_capability(struct pci_device *dev, __u8 pos, __u8 cap_id)
+{
+	UK_ASSERT(dev);
+	UK_ASSERT(pos >= PCI_CAP_MIN_OFFSET);
+
+	return pci_find_capability_from(dev, pos + PCI_CAP_LIST_NEXT, cap_id);
+}
+
+__u16 pci_msix_count(struct pci_device *dev)
+{
+	UK_ASSERT(dev);
+
+	if (!dev->msix_cap) {
+		dev->msix_cap = pci_find_capability(dev, PCI_CAP_ID_MSIX);
+		if (!dev->msix_cap)
+			return 0;
+	}
+
+	return (pci_config_read16(dev, dev->msix_cap + PCI_MSIX_FLAGS)
+		& PCI_MSIX_FLAGS_QSIZE) + 1;
+}
+
+__paddr_t pci_bar_addr(struct pci_device *dev, unsigned int bir)
+{
+	__u16 off = PCI_BASE_ADDRESS_0 + bir * 4;
+	__u64 bar;
+
+	bar = pci_config_read32(dev, off);
+	if (bar & PCI_BASE_ADDRESS_SPACE_IO)
+		return 0;
+
+	if (bar & PCI_BASE_ADDRESS_MEM_TYPE_64) {
+		if (unlikely(bir >= 5))
+			return 0;
+		bar |= (__u64)pci_config_read32(dev, off + 4) << 32;
+	}
+
+	return (__paddr_t)(bar & PCI_BASE_ADDRESS_MEM_MASK);
+}
+
+__sz pci_bar_size(struct pci_device *dev, unsigned int bir)
+{
+	__u16 off = PCI_BASE_ADDRESS_0 + bir * 4;
+	__u32 lo, hi, cmd;
+	__u64 mask;
+
+	if (unlikely(bir > 5))
+		return 0;
+
+	lo = pci_config_read32(dev, off);
+	if (lo & PCI_BASE_ADDRESS_SPACE_IO)
+		return 0;
+	if ((lo & PCI_BASE_ADDRESS_MEM_TYPE_64) && unlikely(bir >= 5))
+		return 0;
+
+	/* The BAR must not decode while it holds the sizing pattern. The
+	 * upper half of the command register is the status, whose bits are
+	 * cleared by writing ones.
+	 */
+	cmd = pci_config_read32(dev, PCI_COMMAND) & 0xffff;
+	pci_config_write32(dev, PCI_COMMAND, cmd & ~PCI_COMMAND_MEMORY);
+
+	pci_config_write32(dev, off, ~0U);
+	mask = pci_config_read32(dev, off) & PCI_BASE_ADDRESS_MEM_MASK;
+	pci_config_write32(dev, off, lo);
+	if (lo & PCI_BASE_ADDRESS_MEM_TYPE_64) {
+		hi = pci_config_read32(dev, off + 4);
+		pci_config_write32(dev, off + 4, ~0U);
+		mask |= (__u64)pci_config_read32(dev, off + 4) << 32;
+		pci_config_write32(dev, off + 4, hi);
+	} else {
+		mask |= 0xffffffff00000000ULL;
+	}
+
+	pci_config_write32(dev, PCI_COMMAND, cmd);
+
+	/* Unimplemented BARs are hardwired to zero */
+	mask &= ~0x0fULL;
+	if (!mask || mask == 0xffffffff00000000ULL)
+		return 0;
+	return (__sz)(~mask + 1);
+}
+
+/* Makes device memory accessible, see `uk_bus_pf_devmap()` */
+static void *pci_mem_map(__paddr_t paddr, __sz len)
+{
+#if CONFIG_PAGING
+	unsigned long attr = PAGE_ATTR_PROT_RW;
+	__vaddr_t vaddr = ALIGN_DOWN(paddr, __PAGE_SIZE);
+	unsigned long pages;
+	int rc;
+
+#ifdef CONFIG_ARCH_ARM_64
+	attr |= PAGE_ATTR_TYPE_DEVICE_nGnRnE;
+#endif /* CONFIG_ARCH_ARM_64 */
+
+	pages = ALIGN_UP(paddr + len - vaddr, __PAGE_SIZE) >> PAGE_SHIFT;
+	rc = ukplat_page_map(ukplat_pt_get_active(), vaddr, vaddr, pages,
+			     attr, 0);
+	if (rc == -EEXIST)
+		rc = ukplat_page_set_attr(ukplat_pt_get_active(), vaddr,
+					  pages, attr, 0);
+	if (unlikely(rc))
+		return ERR2PTR(rc);
+#endif /* CONFIG_PAGING */
+
+	/* Device memory is mapped 1:1 */
+	return (void *)paddr;
+}
+
+void *pci_bar_map(struct pci_device *dev, unsigned int bar, __u32 off,
+		  __sz len)
+{
+	__paddr_t base;
+
+	UK_ASSERT(dev);
+
+	if (unlikely(bar > 5))
+		return ERR2PTR(-EINVAL);
+
+	base = pci_bar_addr(dev, bar);
+	if (unlikely(!base))
+		return ERR2PTR(-ENOTSUP);
+
+	return pci_mem_map(base + off, len);
+}
+
+static inline void pci_msix_flags_set(struct pci_device *dev, __u16 clear,
+				      __u16 set)
+{
+	__u16 off = dev->msix_cap;
+	__u32 val;
+
+	/* The capability ID and next pointer in the lower half are read-only */
+	val = pci_config_read32(dev, off);
+	val &= ~((__u32)clear << 16);
+	val |= (__u32)set << 16;
+	pci_config_write32(dev, off, val);
+}
+
+int pci_msix_enable(struct pci_device *dev)
+{
+	__u32 table, cmd;
+	__paddr_t base;
+	__u16 count, i;
+
+	UK_ASSERT(dev);
+
+	count = pci_msix_count(dev);
+	if (!count)
+		return -ENOTSUP;
+
+	if (!dev->msix_table) {
+		table = pci_config_read32(dev, dev->msix_cap + PCI_MSIX_TABLE);
+		base = pci_bar_addr(dev, table & PCI_MSIX_TABLE_BIR);
+		if (unlikely(!base)) {
+			uk_pr_err("PCI %02x:%02x.%02x: MSI-X table not in a memory BAR\n",
+				  (int)dev->addr.bus, (int)dev->addr.devid,
+				  (int)dev->addr.function);
+			return -ENOTSUP;
+		}
+
+		dev->msix_table = pci_mem_map(base +
+					      (table & PCI_MSIX_TABLE_OFFSET),
+					      count * PCI_MSIX_ENTRY_SIZE);
+		if (unlikely(PTRISERR(dev->msix_table))) {
+			int rc = PTR2ERR(dev->msix_table);
+
+			dev->msix_table = NULL;
+			return rc;
+		}
+	}
+	dev->msix_count = count;
+
+	/* Keep all vectors masked while the entries are set up */
+	pci_msix_flags_set(dev, 0, PCI_MSIX_FLAGS_ENABLE |
+			   PCI_MSIX_FLAGS_MASKALL);
+	for (i = 0; i < count; i++)
+		pci_msix_mask_entry(dev, i);
+	pci_msix_flags_set(dev, PCI_MSIX_FLAGS_MASKALL, 0);
+
+	/* Messages are memory writes, so the device needs to be bus master.
+	 * The upper half is the status, whose bits are cleared by writing ones.
+	 */
+	cmd = pci_config_read32(dev, PCI_COMMAND) & 0xffff;
+	pci_config_write32(dev, PCI_COMMAND, cmd | PCI_COMMAND_MASTER |
+			   PCI_COMMAND_MEMORY | PCI_COMMAND_INTX_DISABLE);
+
+	return 0;
+}
+
+void pci_msix_disable(struct pci_device *dev)
+{
+	__u32 cmd;
+
+	UK_ASSERT(dev);
+	UK_ASSERT(dev->msix_cap);
+
+	pci_msix_flags_set(dev, PCI_MSIX_FLAGS_ENABLE, 0);
+
+	cmd = pci_config_read32(dev, PCI_COMMAND) & 0xffff;
+	pci_config_write32(dev, PCI_COMMAND, cmd & ~PCI_COMMAND_INTX_DISABLE);
+}
+
+static inline volatile __u32 *pci_msix_entry(struct pci_device *dev,
+					     __u16 idx)
+{
+	UK_ASSERT(dev->msix_table);
+	UK_ASSERT(idx < dev->msix_count);
+
+	return dev->msix_table + idx * (PCI_MSIX_ENTRY_SIZE / 4);
+}
+
+void pci_msix_set_entry(struct pci_device *dev, __u16 idx, __u64 addr,
+			__u32 data)
+{
+	volatile __u32 *entry = pci_msix_entry(dev, idx);
+
+	/* Only change the message while the entry is masked */
+	entry[PCI_MSIX_ENTRY_VECTOR_CTRL] |= PCI_MSIX_ENTRY_CTRL_MASKBIT;
+	entry[PCI_MSIX_ENTRY_LOWER_ADDR] = (__u32)addr;
+	entry[PCI_MSIX_ENTRY_UPPER_ADDR] = (__u32)(addr >> 32);
+	entry[PCI_MSIX_ENTRY_DATA] = data;
+	entry[PCI_MSIX_ENTRY_VECTOR_CTRL] &= ~PCI_MSIX_ENTRY_CTRL_MASKBIT;
+}
+
+void pci_msix_mask_entry(struct pci_device *dev, __u16 idx)
+{
+	volatile __u32 *entry = pci_msix_entry(dev, idx);
+
+	entry[PCI_MSIX_ENTRY_VECTOR_CTRL] |= PCI_MSIX_ENTRY_CTRL_MASKBIT;
+}
@@ -0,0 +1,679 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/* GICv3 interrupt translation service (ITS)
+ *
+ * The ITS translates MSI writes of a device (identified by its device ID)
+ * into LPIs. LPIs are not mapped to a separate IRQ number space: IRQ n,
+ * as allocated with uk_intctlr_irq_alloc(), is delivered as LPI
+ * GIC_LPI_BASE + n and devices signal it with event ID n. This way, the
+ * ITS needs no event allocator and handlers are dispatched by IRQ number
+ * as for SPIs. Each device gets an interrupt translation table (ITT) that
+ * covers all IRQ numbers. Each redistributor is the target of one
+ * collection, whose ID is the index of the redistributor and thus of the
+ * logical CPU that receives its LPIs.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <uk/alloc.h>
+#include <uk/arch/limits.h>
+#include <uk/arch/lcpu.h>
+#include <uk/assert.h>
+#include <uk/config.h>
+#include <uk/essentials.h>
+#include <uk/print.h>
+#include <uk/plat/io.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/spinlock.h>
+#ifdef CONFIG_UKPLAT_ACPI
+#include <uk/plat/common/acpi.h>
+#else /* !CONFIG_UKPLAT_ACPI */
+#include <libfdt.h>
+#include <uk/ofw/fdt.h>
+#include <uk/plat/common/bootinfo.h>
+#endif /* !CONFIG_UKPLAT_ACPI */
+#include <arm/cpu.h>
+#include <uk/intctlr/gic-v3.h>
+#include <uk/intctlr/limits.h>
+
+/* LPI INTIDs up to 2^14 - 1 cover GIC_LPI_BASE + UK_INTCTLR_MAX_IRQ */
+#define ITS_LPI_IDBITS		14
+#define ITS_LPI_PROP_SIZE	((1UL << ITS_LPI_IDBITS) - GIC_LPI_BASE)
+#define ITS_LPI_PEND_SIZE	((1UL << ITS_LPI_IDBITS) / 8)
+#define ITS_LPI_PEND_ALIGN	0x10000
+
+/* Event IDs are IRQ numbers */
+#define ITS_EVENT_BITS		10
+#define ITS_ITT_ALIGN		256
+
+#define ITS_CMD_SIZE		32
+#define ITS_CMDQ_SIZE		0x10000
+#define ITS_CMDQ_ALIGN		0x10000
+#define ITS_CMDQ_ENTRIES	(ITS_CMDQ_SIZE / ITS_CMD_SIZE)
+
+/* Polls of GITS_CREADR before a command is considered lost */
+#define ITS_CMD_POLL_MAX	10000000UL
+
+#define ITS_DEVICE_BITS		CONFIG_LIBUKINTCTLR_GICV3_ITS_DEVICE_BITS
+#define ITS_MAX_DEVICES		CONFIG_LIBUKINTCTLR_GICV3_ITS_MAX_DEVICES
+
+#define GIC_RDIST_FRAME(i)					\
+	(gicv3_drv.rdist_mem_addr + (__u64)(i) * GICR_STRIDE)
+
+extern struct _gic_dev gicv3_drv;
+extern void clean_and_invalidate_dcache_range(unsigned long, unsigned long);
+
+struct its_cmd {
+	__u64 dw[4];
+};
+
+struct its_device {
+	__u32 devid;
+	void *itt;
+};
+
+struct its_irq {
+	__u32 devid;
+	__u16 icid;
+	__u8 mapped;
+};
+
+static struct {
+	__u64 base;
+	__u64 size;
+	__u64 typer;
+	/* Number of redistributors, i.e., collections */
+	unsigned int nrdist;
+	unsigned int devbits;
+	__sz itt_size;
+	/* The tables are not coherent with the GIC, writes must be cleaned */
+	int flush;
+	int ready;
+	struct uk_alloc *a;
+	struct its_cmd *cmdq;
+	unsigned int cmdq_idx;
+	__u8 *prop;
+	struct its_device devices[ITS_MAX_DEVICES];
+	unsigned int ndevices;
+	struct its_irq irqs[UK_INTCTLR_MAX_IRQ + 1];
+	__spinlock lock;
+} its;
+
+static inline __u64 read_gits64(__u64 offset)
+{
+	return ioreg_read64((__u64 *)(its.base + offset));
+}
+
+static inline void write_gits64(__u64 offset, __u64 val)
+{
+	ioreg_write64((__u64 *)(its.base + offset), val);
+}
+
+static inline __u32 read_gits32(__u64 offset)
+{
+	return ioreg_read32((__u32 *)(its.base + offset));
+}
+
+static inline void write_gits32(__u64 offset, __u32 val)
+{
+	ioreg_write32((__u32 *)(its.base + offset), val);
+}
+
+static inline __u64 read_gicr64(unsigned int rdist, __u64 offset)
+{
+	return ioreg_read64((__u64 *)(GIC_RDIST_FRAME(rdist) + offset));
+}
+
+static inline void write_gicr64(unsigned int rdist, __u64 offset, __u64 val)
+{
+	ioreg_write64((__u64 *)(GIC_RDIST_FRAME(rdist) + offset), val);
+}
+
+static inline __u32 read_gicr32(unsigned int rdist, __u64 offset)
+{
+	return ioreg_read32((__u32 *)(GIC_RDIST_FRAME(rdist) + offset));
+}
+
+static inline void write_gicr32(unsigned int rdist, __u64 offset, __u32 val)
+{
+	ioreg_write32((__u32 *)(GIC_RDIST_FRAME(rdist) + offset), val);
+}
+
+static inline void its_flush(const void *addr, __sz len)
+{
+	if (its.flush)
+		clean_and_invalidate_dcache_range((unsigned long)addr, len);
+	dsb(sy);
+}
+
+static void *its_table_alloc(__sz align, __sz size)
+{
+	void *table;
+
+	table = uk_memalign(its.a, align, size);
+	if (unlikely(!table))
+		return __NULL;
+
+	memset(table, 0, size);
+	/* Make sure no dirty line is written back over GIC updates */
+	clean_and_invalidate_dcache_range((unsigned long)table, size);
+	return table;
+}
+
+/* Target address of a collection as expected by MAPC and SYNC */
+static __u64 its_rdbase(unsigned int rdist)
+{
+	if (its.typer & GITS_TYPER_PTA)
+		return GIC_RDIST_FRAME(rdist) >> 16;
+
+	return (read_gicr64(rdist, GICR_TYPER) & GICR_TYPER_PROC_NUM_MASK)
+	       >> GICR_TYPER_PROC_NUM_SHIFT;
+}
+
+/* Must be called with its.lock held */
+static int its_cmd(__u8 op, __u32 devid, __u64 dw1, __u64 dw2)
+{
+	struct its_cmd *slot;
+	unsigned int next;
+	unsigned long n;
+
+	next = (its.cmdq_idx + 1) % ITS_CMDQ_ENTRIES;
+
+	/* Wait for the ITS to free a slot if the queue is full */
+	for (n = 0; (read_gits64(GITS_CREADR) & GITS_CREADR_OFFSET_MASK) ==
+		    (__u64)next * ITS_CMD_SIZE; n++) {
+		if (unlikely(n == ITS_CMD_POLL_MAX))
+			return -ETIMEDOUT;
+		ukarch_spinwait();
+	}
+
+	slot = &its.cmdq[its.cmdq_idx];
+	slot->dw[0] = op | ((__u64)devid << 32);
+	slot->dw[1] = dw1;
+	slot->dw[2] = dw2;
+	slot->dw[3] = 0;
+	its_flush(slot, sizeof(*slot));
+
+	its.cmdq_idx = next;
+	write_gits64(GITS_CWRITER, (__u64)next * ITS_CMD_SIZE);
+	return 0;
+}
+
+/* Waits until the ITS processed all queued commands */
+static int its_cmd_wait(void)
+{
+	unsigned long n;
+	__u64 val;
+
+	for (n = 0; n < ITS_CMD_POLL_MAX; n++) {
+		val = read_gits64(GITS_CREADR);
+		if (unlikely(val & GITS_CREADR_STALLED))
+			return -EIO;
+		if ((val & GITS_CREADR_OFFSET_MASK) ==
+		    (__u64)its.cmdq_idx * ITS_CMD_SIZE)
+			return 0;
+		ukarch_spinwait();
+	}
+
+	return -ETIMEDOUT;
+}
+
+static int its_cmd_sync(unsigned int rdist)
+{
+	int rc;
+
+	rc = its_cmd(GITS_CMD_SYNC, 0, 0,
+		     its_rdbase(rdist) << GITS_CMD_RDBASE_SHIFT);
+	if (unlikely(rc))
+		return rc;
+
+	return its_cmd_wait();
+}
+
+/* Must be called with its.lock held */
+static int its_device_map(__u32 devid)
+{
+	struct its_device *dev;
+	unsigned int i;
+	int rc;
+
+	for (i = 0; i < its.ndevices; i++)
+		if (its.devices[i].devid == devid)
+			return 0;
+
+	if (unlikely(its.ndevices == ITS_MAX_DEVICES))
+		return -ENOSPC;
+
+	dev = &its.devices[its.ndevices];
+	dev->itt = its_table_alloc(ITS_ITT_ALIGN, its.itt_size);
+	if (unlikely(!dev->itt))
+		return -ENOMEM;
+
+	rc = its_cmd(GITS_CMD_MAPD, devid, ITS_EVENT_BITS - 1,
+		     GITS_CMD_VALID |
+		     (ukplat_virt_to_phys(dev->itt) & GITS_CMD_ITT_MASK));
+	if (unlikely(rc)) {
+		uk_free(its.a, dev->itt);
+		return rc;
+	}
+
+	dev->devid = devid;
+	its.ndevices++;
+	return 0;
+}
+
+int gicv3_its_msi_compose(unsigned int irq, __lcpuidx lcpu, __u32 devid,
+			  __u64 *addr, __u32 *data)
+{
+	struct its_irq *ii;
+	unsigned long flags;
+	int rc = 0;
+
+	if (unlikely(!its.ready))
+		return -ENOTSUP;
+	if (unlikely(irq < UK_INTCTLR_FIRST_ALLOCABLE_IRQ ||
+		     irq > UK_INTCTLR_MAX_IRQ || lcpu >= its.nrdist))
+		return -EINVAL;
+	if (unlikely(devid >> its.devbits))
+		return -ERANGE;
+
+	ii = &its.irqs[irq];
+
+	ukplat_spin_lock_irqsave(&its.lock, flags);
+
+	if (ii->mapped) {
+		/* An IRQ is the event of a single device */
+		if (unlikely(ii->devid != devid)) {
+			rc = -EBUSY;
+			goto out;
+		}
+		if (ii->icid == lcpu)
+			goto out;
+
+		rc = its_cmd(GITS_CMD_MOVI, devid, irq, lcpu);
+	} else {
+		rc = its_device_map(devid);
+		if (unlikely(rc))
+			goto out;
+
+		rc = its_cmd(GITS_CMD_MAPTI, devid,
+			     irq | ((__u64)(GIC_LPI_BASE + irq) << 32), lcpu);
+	}
+	if (likely(!rc))
+		rc = its_cmd_sync(lcpu);
+	if (unlikely(rc))
+		goto out;
+
+	ii->devid = devid;
+	ii->icid = lcpu;
+	ii->mapped = 1;
+
+out:
+	ukplat_spin_unlock_irqrestore(&its.lock, flags);
+	if (unlikely(rc)) {
+		uk_pr_err("Failed to map event %u of device 0x%x: %d\n",
+			  irq, devid, rc);
+		return rc;
+	}
+
+	*addr = its.base + GITS_TRANSLATER;
+	*data = irq;
+	return 0;
+}
+
+int gicv3_its_irq_is_lpi(__u32 irq)
+{
+	return irq <= UK_INTCTLR_MAX_IRQ && its.irqs[irq].mapped;
+}
+
+int gicv3_its_irq_set_affinity(__u32 irq, __lcpuidx lcpu)
+{
+	struct its_irq *ii = &its.irqs[irq];
+	unsigned long flags;
+	int rc = 0;
+
+	UK_ASSERT(gicv3_its_irq_is_lpi(irq));
+
+	if (unlikely(lcpu >= its.nrdist))
+		return -EINVAL;
+
+	ukplat_spin_lock_irqsave(&its.lock, flags);
+
+	if (ii->icid != lcpu) {
+		rc = its_cmd(GITS_CMD_MOVI, ii->devid, irq, lcpu);
+		if (likely(!rc))
+			rc = its_cmd_sync(lcpu);
+		if (likely(!rc))
+			ii->icid = lcpu;
+	}
+
+	ukplat_spin_unlock_irqrestore(&its.lock, flags);
+
+	if (unlikely(rc))
+		uk_pr_err("Failed to move LPI of IRQ %u to CPU %u: %d\n",
+			  irq, lcpu, rc);
+	return rc;
+}
+
+void gicv3_its_irq_enable(__u32 irq, int enable)
+{
+	struct its_irq *ii = &its.irqs[irq];
+	unsigned long flags;
+	int rc;
+
+	UK_ASSERT(gicv3_its_irq_is_lpi(irq));
+
+	ukplat_spin_lock_irqsave(&its.lock, flags);
+
+	if (enable)
+		its.prop[irq] |= GIC_LPI_PROP_ENABLE;
+	else
+		its.prop[irq] &= ~GIC_LPI_PROP_ENABLE;
+	its_flush(&its.prop[irq], 1);
+
+	/* Redistributors may cache the configuration */
+	rc = its_cmd(GITS_CMD_INV, ii->devid, irq, 0);
+	if (likely(!rc))
+		rc = its_cmd_sync(ii->icid);
+
+	ukplat_spin_unlock_irqrestore(&its.lock, flags);
+
+	if (unlikely(rc))
+		uk_pr_err("Failed to %s LPI of IRQ %u: %d\n",
+			  enable ? "enable" : "disable", irq, rc);
+}
+
+/* Sets up the device or collection table of GITS_BASERn */
+static int its_baser_init(unsigned int n)
+{
+	__u64 val, type, esz, entries, size;
+	void *table;
+
+	val = read_gits64(GITS_BASER(n));
+	type = GITS_BASER_TYPE(val);
+	esz = GITS_BASER_ESZ(val);
+
+	if (type == GITS_BASER_TYPE_DEVICE) {
+		/* A flat table must fit into GITS_BASER_PAGES_MAX pages */
+		while ((esz << its.devbits) >
+		       GITS_BASER_PAGES_MAX * __PAGE_SIZE)
+			its.devbits--;
+		entries = 1ULL << its.devbits;
+	} else if (type == GITS_BASER_TYPE_COLLECTION) {
+		entries = its.nrdist;
+	} else {
+		/* No table of other types is needed for physical LPIs */
+		return 0;
+	}
+
+	size = ALIGN_UP(entries * esz, __PAGE_SIZE);
+	table = its_table_alloc(__PAGE_SIZE, size);
+	if (unlikely(!table))
+		return -ENOMEM;
+
+	val &= ~(GITS_BASER_VALID | GITS_BASER_INDIRECT |
+		 GITS_BASER_INNER_MASK | GITS_BASER_SHARE_MASK |
+		 GITS_BASER_PAGE_MASK | GITS_BASER_PA_MASK | 0xff);
+	val |= GITS_BASER_VALID | GITS_BASER_PAGE_4K |
+	       GITS_BASER_INNER_WAWB | GITS_BASER_SHARE_INNER |
+	       (ukplat_virt_to_phys(table) & GITS_BASER_PA_MASK) |
+	       (size / __PAGE_SIZE - 1);
+	write_gits64(GITS_BASER(n), val);
+
+	val = read_gits64(GITS_BASER(n));
+	if (unlikely((val & GITS_BASER_PAGE_MASK) != GITS_BASER_PAGE_4K)) {
+		uk_pr_err("ITS does not support 4 KiB table pages\n");
+		write_gits64(GITS_BASER(n), 0);
+		uk_free(its.a, table);
+		return -ENOTSUP;
+	}
+	if (!(val & GITS_BASER_SHARE_MASK)) {
+		val &= ~GITS_BASER_INNER_MASK;
+		write_gits64(GITS_BASER(n), val | GITS_BASER_INNER_NC);
+		its.flush = 1;
+	}
+
+	return 0;
+}
+
+static int its_cmdq_init(void)
+{
+	__u64 val;
+
+	its.cmdq = its_table_alloc(ITS_CMDQ_ALIGN, ITS_CMDQ_SIZE);
+	if (unlikely(!its.cmdq))
+		return -ENOMEM;
+
+	val = GITS_CBASER_VALID | GITS_CBASER_INNER_WAWB |
+	      GITS_CBASER_SHARE_INNER |
+	      (ukplat_virt_to_phys(its.cmdq) & GITS_CBASER_PA_MASK) |
+	      (ITS_CMDQ_SIZE / __PAGE_SIZE - 1);
+	write_gits64(GITS_CBASER, val);
+
+	val = read_gits64(GITS_CBASER);
+	if (!(val & GITS_CBASER_SHARE_MASK)) {
+		val &= ~GITS_CBASER_INNER_MASK;
+		write_gits64(GITS_CBASER, val | GITS_CBASER_INNER_NC);
+		its.flush = 1;
+	}
+
+	its.cmdq_idx = 0;
+	write_gits64(GITS_CWRITER, 0);
+	return 0;
+}
+
+/* Points a redistributor to the LPI tables and enables LPIs on it */
+static int its_rdist_init(unsigned int rdist)
+{
+	__u64 val;
+	void *pend;
+
+	if (unlikely(!(read_gicr64(rdist, GICR_TYPER) & GICR_TYPER_PLPIS)))
+		return -ENOTSUP;
+
+	/* The tables cannot be changed once LPIs are enabled */
+	if (unlikely(read_gicr32(rdist, GICR_CTLR) & GICR_CTLR_ENABLE_LPIS)) {
+		uk_pr_err("LPIs of redistributor %u already enabled\n", rdist);
+		return -EBUSY;
+	}
+
+	pend = its_table_alloc(ITS_LPI_PEND_ALIGN, ITS_LPI_PEND_SIZE);
+	if (unlikely(!pend))
+		return -ENOMEM;
+
+	val = (ukplat_virt_to_phys(its.prop) & GICR_PROPBASER_PA_MASK) |
+	      GICR_BASER_INNER_WAWB | GICR_BASER_SHARE_INNER |
+	      (ITS_LPI_IDBITS - 1);
+	write_gicr64(rdist, GICR_PROPBASER, val);
+	if (!(read_gicr64(rdist, GICR_PROPBASER) & GICR_BASER_SHARE_MASK)) {
+		val &= ~(GICR_BASER_INNER_MASK | GICR_BASER_SHARE_MASK);
+		write_gicr64(rdist, GICR_PROPBASER, val | GICR_BASER_INNER_NC);
+		its.flush = 1;
+	}
+
+	val = (ukplat_virt_to_phys(pend) & GICR_PENDBASER_PA_MASK) |
+	      GICR_BASER_INNER_WAWB | GICR_BASER_SHARE_INNER |
+	      GICR_PENDBASER_PTZ;
+	write_gicr64(rdist, GICR_PENDBASER, val);
+	if (!(read_gicr64(rdist, GICR_PENDBASER) & GICR_BASER_SHARE_MASK)) {
+		val &= ~(GICR_BASER_INNER_MASK | GICR_BASER_SHARE_MASK);
+		write_gicr64(rdist, GICR_PENDBASER, val | GICR_BASER_INNER_NC);
+	}
+
+	dsb(sy);
+	write_gicr32(rdist, GICR_CTLR,
+		     read_gicr32(rdist, GICR_CTLR) | GICR_CTLR_ENABLE_LPIS);
+	dsb(sy);
+	return 0;
+}
+
+/* Counts the redistributors up to the one flagged as last */
+static unsigned int its_rdist_count(void)
+{
+	unsigned int n = 0;
+
+	while (n < CONFIG_UKPLAT_LCPU_MAXCOUNT &&
+	       (n + 1) * GICR_STRIDE <= gicv3_drv.rdist_mem_size) {
+		if (read_gicr64(n++, GICR_TYPER) & GICR_TYPER_LAST)
+			break;
+	}
+
+	return n;
+}
+
+int gicv3_its_init(struct uk_alloc *a)
+{
+	unsigned int i;
+	__u32 val;
+	int rc;
+
+	UK_ASSERT(its.base);
+
+	if (unlikely(!a))
+		return -ENOMEM;
+
+	val = ioreg_read32(GIC_DIST_REG(gicv3_drv, GICD_TYPER));
+	if (unlikely(!(val & GICD_TYPE_LPIS) ||
+		     GICD_TYPE_ID_BITS(val) < ITS_LPI_IDBITS)) {
+		uk_pr_err("GICv3 distributor does not support LPIs\n");
+		return -ENOTSUP;
+	}
+
+	its.typer = read_gits64(GITS_TYPER);
+	if (unlikely(!(its.typer & GITS_TYPER_PHYSICAL) ||
+		     GITS_TYPER_IDBITS(its.typer) < ITS_EVENT_BITS)) {
+		uk_pr_err("ITS does not support physical LPIs\n");
+		return -ENOTSUP;
+	}
+
+	/* The ITS must be disabled and quiescent to be reconfigured */
+	val = read_gits32(GITS_CTLR);
+	if (val & GITS_CTLR_ENABLED)
+		write_gits32(GITS_CTLR, val & ~GITS_CTLR_ENABLED);
+	while (!(read_gits32(GITS_CTLR) & GITS_CTLR_QUIESCENT))
+		ukarch_spinwait();
+
+	its.a = a;
+	its.nrdist = its_rdist_count();
+	its.devbits = MIN(GITS_TYPER_DEVBITS(its.typer),
+			  (__u64)ITS_DEVICE_BITS);
+	its.itt_size = ALIGN_UP(GITS_TYPER_ITT_ESZ(its.typer)
+				<< ITS_EVENT_BITS, ITS_ITT_ALIGN);
+	ukarch_spin_init(&its.lock);
+
+	/* All LPIs start disabled with the default priority */
+	its.prop = uk_memalign(a, __PAGE_SIZE, ITS_LPI_PROP_SIZE);
+	if (unlikely(!its.prop))
+		return -ENOMEM;
+	memset(its.prop, GIC_LPI_PROP_PRIO_DEF, ITS_LPI_PROP_SIZE);
+	clean_and_invalidate_dcache_range((unsigned long)its.prop,
+					  ITS_LPI_PROP_SIZE);
+
+	for (i = 0; i < its.nrdist; i++) {
+		rc = its_rdist_init(i);
+		if (unlikely(rc))
+			return rc;
+	}
+
+	for (i = 0; i < GITS_BASER_NR; i++) {
+		rc = its_baser_init(i);
+		if (unlikely(rc))
+			return rc;
+	}
+
+	rc = its_cmdq_init();
+	if (unlikely(rc))
+		return rc;
+
+	write_gits32(GITS_CTLR, read_gits32(GITS_CTLR) | GITS_CTLR_ENABLED);
+
+	/* One collection per redistributor */
+	for (i = 0; i < its.nrdist; i++) {
+		rc = its_cmd(GITS_CMD_MAPC, 0, 0,
+			     GITS_CMD_VALID |
+			     (its_rdbase(i) << GITS_CMD_RDBASE_SHIFT) | i);
+		if (likely(!rc))
+			rc = its_cmd_sync(i);
+		if (unlikely(rc)) {
+			uk_pr_err("Failed to map collection %u: %d\n", i, rc);
+			return rc;
+		}
+	}
+
+	its.ready = 1;
+	uk_pr_info("GICv3 ITS initialized: %u collections, %u device ID "
+		   "bits\n", its.nrdist, its.devbits);
+	return 0;
+}
+
+#if defined(CONFIG_UKPLAT_ACPI)
+static int its_do_probe(void)
+{
+	union {
+		struct acpi_madt_gic_its *its;
+		struct acpi_subsdt_hdr *h;
+	} m;
+	struct acpi_madt *madt;
+	__sz off, len;
+
+	madt = acpi_get_madt();
+	UK_ASSERT(madt);
+
+	/* We only use the first ITS */
+	len = madt->hdr.tab_len - sizeof(*madt);
+	for (off = 0; off < len; off += m.h->len) {
+		m.h = (struct acpi_subsdt_hdr *)(madt->entries + off);
+
+		if (m.h->type != ACPI_MADT_GIC_ITS)
+			continue;
+
+		/* Control and translation register frames */
+		its.base = m.its->paddr;
+		its.size = 0x20000;
+		return 0;
+	}
+
+	return -ENOENT;
+}
+#else /* CONFIG_UKPLAT_ACPI */
+static int its_do_probe(void)
+{
+	struct ukplat_bootinfo *bi = ukplat_bootinfo_get();
+	int fdt_its, r;
+	void *fdt;
+
+	UK_ASSERT(bi);
+	fdt = (void *)bi->dtb;
+
+	/* We only use the first ITS */
+	fdt_its = fdt_node_offset_by_compatible_cached(fdt, -1,
+						       "arm,gic-v3-its");
+	if (fdt_its < 0)
+		return -ENOENT;
+
+	r = fdt_get_address(fdt, fdt_its, 0, &its.base, &its.size);
+	if (unlikely(r < 0)) {
+		uk_pr_err("Could not find GICv3 ITS region!\n");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+#endif /* !CONFIG_UKPLAT_ACPI */
+
+int gicv3_its_probe(void)
+{
+	int rc;
+
+	rc = its_do_probe();
+	if (rc)
+		return rc;
+
+	uk_pr_info("\tITS          : 0x%lx - 0x%lx\n", its.base,
+		   its.base + its.size - 1);
+	return 0;
+}
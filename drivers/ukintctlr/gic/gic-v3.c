@@ -201,6 +201,13 @@ static void gicv3_enable_irq(__u32 irq)
 {
 	UK_ASSERT(irq <= GIC_MAX_IRQ);
 
+#if CONFIG_LIBUKINTCTLR_GICV3_ITS
+	if (gicv3_its_irq_is_lpi(irq)) {
+		gicv3_its_irq_enable(irq, 1);
+		return;
+	}
+#endif /* CONFIG_LIBUKINTCTLR_GICV3_ITS */
+
 	dist_lock(gicv3_drv);
 
 #ifdef CONFIG_HAVE_SMP
@@ -283,6 +290,13 @@ static void gicv3_disable_irq(__u32 irq)
 {
 	UK_ASSERT(irq <= GIC_MAX_IRQ);
 
+#if CONFIG_LIBUKINTCTLR_GICV3_ITS
+	if (gicv3_its_irq_is_lpi(irq)) {
+		gicv3_its_irq_enable(irq, 0);
+		return;
+	}
+#endif /* CONFIG_LIBUKINTCTLR_GICV3_ITS */
+
 	dist_lock(gicv3_drv);
 
 	if (irq >= GIC_SPI_BASE)
@@ -467,9 +481,11 @@ static void gicv3_init_dist(void)
 		irq_number = GIC_MAX_IRQ + 1;
 	uk_pr_info("GICv3 Max interrupt lines: %d\n", irq_number);
 
+#if !CONFIG_LIBUKINTCTLR_GICV3_ITS
 	/* Check for LPI support */
 	if (val & GICD_TYPE_LPIS)
-		uk_pr_warn("LPI support is not implemented by this driver!\n");
+		uk_pr_warn("LPI support is not enabled in this driver!\n");
+#endif /* !CONFIG_LIBUKINTCTLR_GICV3_ITS */
 
 	/* Configure all SPIs as non-secure Group 1 */
 	for (i = GIC_SPI_BASE; i < irq_number; i += GICD_I_PER_IGROUPRn)
@@ -513,7 +529,7 @@ static void gicv3_handle_irq(struct __regs *regs)
 
 	do {
 		stat = gicv3_ack_irq();
-		irq = stat & GICC_IAR_INTID_MASK;
+		irq = stat & GICV3_IAR_INTID_MASK;
 
 #ifndef CONFIG_HAVE_SMP
 		uk_pr_debug("EL1 IRQ#%"__PRIu32" caught\n", irq);
@@ -531,6 +547,16 @@ static void gicv3_handle_irq(struct __regs *regs)
 			continue;
 		}
 
+#if CONFIG_LIBUKINTCTLR_GICV3_ITS
+		/* LPIs have no active state and need no deactivation */
+		if (irq >= GIC_LPI_BASE) {
+			uk_intctlr_irq_handle(regs, irq - GIC_LPI_BASE);
+			SYSREG_WRITE32(ICC_EOIR1_EL1, stat);
+			isb();
+			continue;
+		}
+#endif /* CONFIG_LIBUKINTCTLR_GICV3_ITS */
+
 		/* EoI should only be signaled for non-spurious interrupts */
 		if (irq != GICC_IAR_INTID_SPURIOUS)
 			gicv3_eoi_irq(stat);
@@ -731,6 +757,10 @@ int gicv3_probe(struct _gic_dev **dev)
 	uk_pr_info("\tRedistributor: 0x%lx - 0x%lx\n", gicv3_drv.rdist_mem_addr,
 		   gicv3_drv.rdist_mem_addr + gicv3_drv.rdist_mem_size - 1);
 
+#if CONFIG_LIBUKINTCTLR_GICV3_ITS
+	gicv3_drv.has_its = !gicv3_its_probe();
+#endif /* CONFIG_LIBUKINTCTLR_GICV3_ITS */
+
 	/* GICv3 is present */
 	gicv3_drv.is_present = 1;
 	gicv3_set_ops();
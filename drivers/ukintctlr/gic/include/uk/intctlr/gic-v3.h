@@ -115,6 +115,8 @@
 #define GICR_INVALLR			(0x00B0)
 #define GICR_SYNCR			(0x00C0)
 
+#define GICR_CTLR_ENABLE_LPIS		(1U << 0)
+
 #define GICR_TYPER_PLPIS		(1U << 0)
 #define GICR_TYPER_VLPIS		(1U << 1)
 #define GICR_TYPER_LAST			(1U << 4)
@@ -370,6 +372,84 @@
 #define GICC_IAR_INTID_MASK		0x3FF
 #define GICC_IAR_INTID_SPURIOUS	1023
 
+/* With LPIs, the INTID in ICC_IAR1_EL1 has 24 bits */
+#define GICV3_IAR_INTID_MASK	0xFFFFFF
+
+/* Locality-specific peripheral interrupts (LPI) */
+#define GIC_LPI_BASE		8192
+
+/* LPI configuration and pending tables (GICR_PROPBASER/PENDBASER) */
+#define GICR_BASER_INNER_WAWB		(7ULL << 7)
+#define GICR_BASER_INNER_MASK		(7ULL << 7)
+#define GICR_BASER_INNER_NC		(1ULL << 7)
+#define GICR_BASER_SHARE_INNER		(1ULL << 10)
+#define GICR_BASER_SHARE_MASK		(3ULL << 10)
+#define GICR_PROPBASER_PA_MASK		0x000ffffffffff000ULL
+#define GICR_PENDBASER_PA_MASK		0x000fffffffff0000ULL
+#define GICR_PENDBASER_PTZ		(1ULL << 62)
+
+#define GIC_LPI_PROP_ENABLE		(1U << 0)
+#define GIC_LPI_PROP_PRIO_DEF		0x80
+
+/* Interrupt translation service (ITS) */
+#define GITS_CTLR			(0x0000)
+#define GITS_TYPER			(0x0008)
+#define GITS_CBASER			(0x0080)
+#define GITS_CWRITER			(0x0088)
+#define GITS_CREADR			(0x0090)
+#define GITS_BASER(n)			(0x0100 + 8 * (n))
+#define GITS_BASER_NR			8
+#define GITS_TRANSLATER			(0x10040)
+
+#define GITS_CTLR_ENABLED		(1U << 0)
+#define GITS_CTLR_QUIESCENT		(1U << 31)
+
+#define GITS_TYPER_PHYSICAL		(1ULL << 0)
+#define GITS_TYPER_ITT_ESZ(r)		((((r) >> 4) & 0xf) + 1)
+#define GITS_TYPER_IDBITS(r)		((((r) >> 8) & 0x1f) + 1)
+#define GITS_TYPER_DEVBITS(r)		((((r) >> 13) & 0x1f) + 1)
+#define GITS_TYPER_PTA			(1ULL << 19)
+
+#define GITS_CBASER_VALID		(1ULL << 63)
+#define GITS_CBASER_INNER_WAWB		(7ULL << 59)
+#define GITS_CBASER_INNER_MASK		(7ULL << 59)
+#define GITS_CBASER_INNER_NC		(1ULL << 59)
+#define GITS_CBASER_SHARE_INNER		(1ULL << 10)
+#define GITS_CBASER_SHARE_MASK		(3ULL << 10)
+#define GITS_CBASER_PA_MASK		0x000ffffffffff000ULL
+
+#define GITS_CREADR_STALLED		(1ULL << 0)
+#define GITS_CREADR_OFFSET_MASK		0x00000000000fffe0ULL
+
+#define GITS_BASER_VALID		(1ULL << 63)
+#define GITS_BASER_INDIRECT		(1ULL << 62)
+#define GITS_BASER_INNER_WAWB		(7ULL << 59)
+#define GITS_BASER_INNER_MASK		(7ULL << 59)
+#define GITS_BASER_INNER_NC		(1ULL << 59)
+#define GITS_BASER_TYPE(r)		(((r) >> 56) & 0x7)
+#define GITS_BASER_TYPE_NONE		0
+#define GITS_BASER_TYPE_DEVICE		1
+#define GITS_BASER_TYPE_COLLECTION	4
+#define GITS_BASER_ESZ(r)		((((r) >> 48) & 0x1f) + 1)
+#define GITS_BASER_PA_MASK		0x0000fffffffff000ULL
+#define GITS_BASER_SHARE_INNER		(1ULL << 10)
+#define GITS_BASER_SHARE_MASK		(3ULL << 10)
+#define GITS_BASER_PAGE_4K		(0ULL << 8)
+#define GITS_BASER_PAGE_MASK		(3ULL << 8)
+#define GITS_BASER_PAGES_MAX		256
+
+/* ITS commands */
+#define GITS_CMD_MOVI			0x01
+#define GITS_CMD_SYNC			0x05
+#define GITS_CMD_MAPD			0x08
+#define GITS_CMD_MAPC			0x09
+#define GITS_CMD_MAPTI			0x0a
+#define GITS_CMD_INV			0x0c
+
+#define GITS_CMD_VALID			(1ULL << 63)
+#define GITS_CMD_ITT_MASK		0x000fffffffffff00ULL
+#define GITS_CMD_RDBASE_SHIFT		16
+
 /**
  * Probe device tree or ACPI for GICv3
  * NOTE: First time must not be called from multiple CPUs in parallel
@@ -379,4 +459,52 @@
  */
 int gicv3_probe(struct _gic_dev **dev);
 
+#if CONFIG_LIBUKINTCTLR_GICV3_ITS
+struct uk_alloc;
+
+/**
+ * Probe device tree or ACPI for a GICv3 interrupt translation service (ITS)
+ *
+ * @return 0 if an ITS is available, < 0 otherwise
+ */
+int gicv3_its_probe(void);
+
+/**
+ * Set up the LPI tables of all redistributors as well as the tables and
+ * the command queue of the ITS, then enable LPIs
+ *
+ * @param a allocator for the tables
+ * @return 0 on success, < 0 otherwise
+ */
+int gicv3_its_init(struct uk_alloc *a);
+
+/**
+ * Map the event `irq` of device `devid` to the LPI of `irq` on `lcpu`
+ *
+ * @param irq interrupt number [UK_INTCTLR_FIRST_ALLOCABLE_IRQ..GIC_MAX_IRQ]
+ * @param lcpu index of the logical CPU that receives the LPI
+ * @param devid ITS device ID, i.e., the PCI requester ID
+ * @param [out] addr receives the address of the ITS translation register
+ * @param [out] data receives the event ID
+ * @return 0 on success, < 0 otherwise
+ */
+int gicv3_its_msi_compose(unsigned int irq, __lcpuidx lcpu, __u32 devid,
+			  __u64 *addr, __u32 *data);
+
+/**
+ * @return non-zero if `irq` is delivered as LPI
+ */
+int gicv3_its_irq_is_lpi(__u32 irq);
+
+/**
+ * Enable or disable the LPI of `irq`
+ */
+void gicv3_its_irq_enable(__u32 irq, int enable);
+
+/**
+ * Move the LPI of `irq` to the redistributor of logical CPU `lcpu`
+ */
+int gicv3_its_irq_set_affinity(__u32 irq, __lcpuidx lcpu);
+#endif /* CONFIG_LIBUKINTCTLR_GICV3_ITS */
+
 #endif /* __UK_INTCTLR_GICV3_H__ */
@@ -128,6 +128,8 @@ struct _gic_dev {
 	/** Pointer to the lock for distributor access */
 	__spinlock * dist_lock;
 #endif /* CONFIG_HAVE_SMP */
+	/** Indicates if an interrupt translation service is present (GICv3) */
+	__u8 has_its;
 
 	/** Driver operations */
 	struct _gic_operations ops;
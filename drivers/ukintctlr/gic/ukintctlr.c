@@ -9,6 +9,7 @@
 #include <uk/intctlr/limits.h>
 #include <uk/intctlr/gic-v2.h>
 #include <uk/intctlr/gic-v3.h>
+#include <uk/plat/common/lcpu.h>
 
 struct _gic_dev *gic;
 struct uk_intctlr_desc intctlr;
@@ -83,6 +84,33 @@ static int configure_irq(struct uk_intctlr_irq *irq)
 	return 0;
 }
 
+static int set_affinity(unsigned int irq, __lcpuidx lcpu)
+{
+	__u64 mpidr = lcpu_get(lcpu)->id;
+
+#if CONFIG_LIBUKINTCTLR_GICV3_ITS
+	if (gic->has_its && gicv3_its_irq_is_lpi(irq))
+		return gicv3_its_irq_set_affinity(irq, lcpu);
+#endif /* CONFIG_LIBUKINTCTLR_GICV3_ITS */
+
+	/* SGIs and PPIs are banked per CPU */
+	if (unlikely(irq < GIC_SPI_BASE || irq > UK_INTCTLR_MAX_IRQ))
+		return -EINVAL;
+
+	if (gic->version == GIC_V2) {
+		/* As for SGIs, the CPU interface number is taken from Aff0 */
+		gic->ops.set_irq_affinity(irq, 1 << (mpidr % 8));
+	} else {
+		gic->ops.set_irq_affinity(irq,
+					  ((mpidr & MPIDR_AFF3_MASK) >> 8) |
+					  (mpidr & (MPIDR_AFF2_MASK |
+						    MPIDR_AFF1_MASK |
+						    MPIDR_AFF0_MASK)));
+	}
+
+	return 0;
+}
+
 int uk_intctlr_probe(void)
 {
 	int rc = -ENODEV;
@@ -114,9 +142,17 @@ init:
 	ops.configure_irq = configure_irq;
 	ops.mask_irq = gic->ops.disable_irq;
 	ops.unmask_irq = gic->ops.enable_irq;
+	ops.set_affinity = set_affinity;
 #if CONFIG_LIBUKOFW
 	ops.fdt_xlat = fdt_xlat;
 #endif /* CONFIG_LIBUKOFW */
+#if CONFIG_LIBUKINTCTLR_GICV3_ITS
+	/* MSIs are translated to LPIs by the ITS, if there is one */
+	if (gic->version == GIC_V3 && gic->has_its) {
+		ops.init = gicv3_its_init;
+		ops.msi_compose = gicv3_its_msi_compose;
+	}
+#endif /* CONFIG_LIBUKINTCTLR_GICV3_ITS */
 
 	intctlr.ops = &ops;
 
@@ -0,0 +1,228 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <errno.h>
+#include <uk/arch/lcpu.h>
+#include <uk/arch/limits.h>
+#include <uk/assert.h>
+#include <uk/config.h>
+#include <uk/essentials.h>
+#include <uk/intctlr/apic.h>
+#include <uk/plat/io.h>
+#include <uk/plat/lcpu.h>
+#include <uk/print.h>
+
+#if CONFIG_PAGING
+/* The page tables keep the direct map of the boot page table */
+#define __PLAT_CMN_ARCH_PAGING_H__
+#include <x86/paging.h>
+#endif /* CONFIG_PAGING */
+
+/* xAPIC splits the ICR into two registers. Writing the low one sends. */
+#define APIC_MMIO_ICR_LO	0x300
+#define APIC_MMIO_ICR_HI	0x310
+#define APIC_XAPIC_DEST_MAX	0xff
+
+#define APIC_MODE_NONE		0
+#define APIC_MODE_XAPIC		1
+#define APIC_MODE_X2APIC	2
+
+__vaddr_t apic_mmio_base;
+
+static int apic_mode = APIC_MODE_NONE;
+
+#if CONFIG_LIBUKINTCTLR_APIC_PV_EOI
+#define KVM_FEATURE_PV_EOI	(1 << 6)
+#define MSR_KVM_PV_EOI_EN	0x4b564d04
+#define KVM_MSR_ENABLED		1
+
+/* The hypervisor sets this bit when it injects an interrupt that does not
+ * need an EOI write, i.e., one that would exit to the hypervisor
+ */
+#define KVM_PV_EOI_PENDING	1U
+
+struct apic_pv_eoi {
+	__u32 word;
+} __align64;
+
+static UKPLAT_PER_LCPU_DEFINE(struct apic_pv_eoi, apic_pv_eoi);
+static int apic_pv_eoi_enabled;
+
+static int apic_pv_eoi_supported(void)
+{
+	return !!(kvm_cpuid_features() & KVM_FEATURE_PV_EOI);
+}
+
+static void apic_pv_eoi_init(void)
+{
+	struct apic_pv_eoi *pv = &ukplat_per_lcpu_current(apic_pv_eoi);
+	__paddr_t paddr;
+
+	if (apic_mode == APIC_MODE_NONE)
+		apic_pv_eoi_enabled = apic_pv_eoi_supported();
+	if (!apic_pv_eoi_enabled)
+		return;
+
+	pv->word = 0;
+	paddr = ukplat_virt_to_phys(&pv->word);
+	wrmsrl(MSR_KVM_PV_EOI_EN, paddr | KVM_MSR_ENABLED);
+}
+
+void apic_ack_interrupt(void)
+{
+	__u32 *word;
+
+	if (apic_pv_eoi_enabled) {
+		word = &ukplat_per_lcpu_current(apic_pv_eoi).word;
+		if (__atomic_fetch_and(word, ~KVM_PV_EOI_PENDING,
+				       __ATOMIC_RELAXED) & KVM_PV_EOI_PENDING)
+			return;
+	}
+	apic_write(APIC_MSR_EOI, 0);
+}
+#else /* !CONFIG_LIBUKINTCTLR_APIC_PV_EOI */
+#define apic_pv_eoi_enabled	0
+#define apic_pv_eoi_init()	do {} while (0)
+
+void apic_ack_interrupt(void)
+{
+	apic_write(APIC_MSR_EOI, 0);
+}
+#endif /* !CONFIG_LIBUKINTCTLR_APIC_PV_EOI */
+
+static __vaddr_t apic_mmio_map(__paddr_t paddr)
+{
+#if CONFIG_PAGING
+	return x86_directmap_paddr_to_vaddr(paddr);
+#else /* !CONFIG_PAGING */
+	/* The boot page table maps the first 4 GiB 1:1 */
+	return (__vaddr_t)paddr;
+#endif /* !CONFIG_PAGING */
+}
+
+static int apic_select_mode(__u64 base)
+{
+	__u32 eax, ebx, ecx, edx;
+
+	cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+	if (ecx & X86_CPUID1_ECX_x2APIC)
+		return APIC_MODE_X2APIC;
+
+	apic_mmio_base = apic_mmio_map(base & APIC_BASE_ADDR_MASK);
+	return APIC_MODE_XAPIC;
+}
+
+int apic_enable(void)
+{
+	__u32 eax, edx;
+	__u32 svr;
+	int mode;
+
+	/* Check if APIC is active */
+	rdmsr(APIC_MSR_BASE, &eax, &edx);
+	if (unlikely(!(eax & APIC_BASE_EN)))
+		return -ENOTSUP;
+
+	mode = apic_mode;
+	if (mode == APIC_MODE_NONE)
+		mode = apic_select_mode(((__u64)edx << 32) | eax);
+
+	/* Switch to x2APIC mode */
+	if (mode == APIC_MODE_X2APIC && !(eax & APIC_BASE_EXTD)) {
+		eax |= APIC_BASE_EXTD;
+		wrmsr(APIC_MSR_BASE, eax, edx);
+	}
+
+	/* Set APIC software enable flag if necessary */
+	svr = apic_read(APIC_MSR_SVR);
+	if ((svr & APIC_SVR_EN) == 0)
+		apic_write(APIC_MSR_SVR, svr | APIC_SVR_EN);
+
+	/*
+	 * TODO: Configure spurious interrupt vector number
+	 * After power-up or reset this is 0xff, which might not be
+	 * configured in the trap table
+	 */
+
+	apic_pv_eoi_init();
+
+	if (apic_mode == APIC_MODE_NONE) {
+		uk_pr_info("APIC: %s mode%s\n",
+			   (mode == APIC_MODE_X2APIC) ? "x2APIC" : "xAPIC",
+			   apic_pv_eoi_enabled ? ", PV-EOI" : "");
+		apic_mode = mode;
+	}
+
+	return 0;
+}
+
+static void apic_send(__u32 icr, int dest)
+{
+	unsigned long irqf;
+
+	if (likely(apic_mode == APIC_MODE_X2APIC)) {
+		wrmsr(APIC_MSR_ICR, icr, dest);
+		return;
+	}
+
+	UK_ASSERT(dest >= 0 && dest <= APIC_XAPIC_DEST_MAX);
+
+	/* Interrupt handlers may send IPIs between the two writes */
+	irqf = ukplat_lcpu_save_irqf();
+	while (*(volatile __u32 *)(apic_mmio_base + APIC_MMIO_ICR_LO)
+	       & APIC_ICR_BUSY)
+		ukarch_spinwait();
+	*(volatile __u32 *)(apic_mmio_base + APIC_MMIO_ICR_HI) = dest << 24;
+	*(volatile __u32 *)(apic_mmio_base + APIC_MMIO_ICR_LO) = icr;
+	ukplat_lcpu_restore_irqf(irqf);
+}
+
+void apic_send_ipi(int irqno, int dest)
+{
+	UK_ASSERT(((32 + irqno) & 0xff) == (32 + irqno));
+
+	apic_send(APIC_ICR_TRIGGER_LEVEL | APIC_ICR_LEVEL_ASSERT
+		  | APIC_ICR_DESTMODE_PHYSICAL | APIC_ICR_DMODE_FIXED
+		  | (32 + irqno), dest);
+}
+
+void apic_send_self_ipi(int irqno)
+{
+	UK_ASSERT(((32 + irqno) & 0xff) == (32 + irqno));
+
+	if (likely(apic_mode == APIC_MODE_X2APIC)) {
+		wrmsr(APIC_MSR_SELF_IPI, 32 + irqno, 0);
+		return;
+	}
+	apic_send(APIC_ICR_DSTSH_SELF | APIC_ICR_LEVEL_ASSERT
+		  | APIC_ICR_DMODE_FIXED | (32 + irqno), 0);
+}
+
+void apic_send_nmi(int dest)
+{
+	apic_send(APIC_ICR_TRIGGER_LEVEL | APIC_ICR_LEVEL_ASSERT
+		  | APIC_ICR_DESTMODE_PHYSICAL | APIC_ICR_DMODE_NMI, dest);
+}
+
+void apic_send_sipi(__vaddr_t addr, int dest)
+{
+	UK_ASSERT((addr & (APIC_ICR_VECTOR_MASK << __PAGE_SHIFT)) == addr);
+
+	apic_send(APIC_ICR_TRIGGER_LEVEL | APIC_ICR_LEVEL_ASSERT
+		  | APIC_ICR_DESTMODE_PHYSICAL | APIC_ICR_DMODE_SUP
+		  | (addr >> __PAGE_SHIFT), dest);
+}
+
+void apic_send_iipi(int dest)
+{
+	apic_send(APIC_ICR_TRIGGER_LEVEL | APIC_ICR_LEVEL_ASSERT
+		  | APIC_ICR_DESTMODE_PHYSICAL | APIC_ICR_DMODE_INIT, dest);
+}
+
+void apic_clear_errors(void)
+{
+	apic_write(APIC_MSR_ESR, 0);
+}
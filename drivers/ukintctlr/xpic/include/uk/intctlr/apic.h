@@ -37,125 +37,69 @@
 #ifndef __PLAT_CMN_X86_APIC_H__
 #define __PLAT_CMN_X86_APIC_H__
 
-#include <uk/assert.h>
-#include <uk/arch/limits.h>
+#include <uk/config.h>
+#include <uk/arch/types.h>
+#include <uk/essentials.h>
 #include <x86/cpu.h>
 #include <uk/asm/arch.h>
 
-#include <errno.h>
-
-static inline int x2apic_enable(void)
-{
-	__u32 eax, ebx, ecx, edx;
-
-	/* Check for x2APIC support */
-	cpuid(1, 0, &eax, &ebx, &ecx, &edx);
-	if (unlikely(!(ecx & X86_CPUID1_ECX_x2APIC)))
-		return -ENOTSUP;
-
-	/* Check if APIC is active */
-	rdmsr(APIC_MSR_BASE, &eax, &edx);
-	if (unlikely(!(eax & APIC_BASE_EN)))
-		return -ENOTSUP;
-
-	/* Switch to x2APIC mode */
-	eax |= APIC_BASE_EXTD;
-	wrmsr(APIC_MSR_BASE, eax, edx);
-
-	/* Set APIC software enable flag if necessary */
-	rdmsr(APIC_MSR_SVR, &eax, &edx);
-	if ((eax & APIC_SVR_EN) == 0) {
-		eax |= APIC_SVR_EN;
-		wrmsr(APIC_MSR_SVR, eax, edx);
-	}
-
-	/*
-	 * TODO: Configure spurious interrupt vector number
-	 * After power-up or reset this is 0xff, which might not be
-	 * configured in the trap table
-	 */
-
-	return 0;
-}
-
-static inline void x2apic_send_ipi(int irqno, int dest)
-{
-	__u32 eax;
-
-	UK_ASSERT(((32 + irqno) & 0xff) == (32 + irqno));
-
-	eax = APIC_ICR_TRIGGER_LEVEL | APIC_ICR_LEVEL_ASSERT
-	      | APIC_ICR_DESTMODE_PHYSICAL | APIC_ICR_DMODE_FIXED
-	      | (32 + irqno);
-
-	wrmsr(APIC_MSR_ICR, eax, dest);
-}
-
-static inline void x2apic_send_self_ipi(int irqno)
-{
-	__u32 eax;
-
-	UK_ASSERT(((32 + irqno) & 0xff) == (32 + irqno));
+/*
+ * The local APIC is used in x2APIC mode, where its registers are MSRs, if the
+ * CPU supports it. Otherwise, it is used in xAPIC mode, where the registers
+ * are memory-mapped and register n of the x2APIC MSR range is found at offset
+ * (n - 0x800) * 16 of the MMIO page. Registers are therefore named by their
+ * x2APIC MSR numbers (APIC_MSR_*) in both modes.
+ */
 
-	eax = (32 + irqno);
+/* Virtual address of the MMIO page in xAPIC mode, 0 in x2APIC mode */
+extern __vaddr_t apic_mmio_base;
 
-	wrmsr(APIC_MSR_SELF_IPI, eax, 0);
-}
+#define APIC_MMIO_OFFSET(reg)	(((reg) - 0x800) << 4)
 
-static inline void x2apic_send_nmi(int dest)
+static inline __u32 apic_read(__u32 reg)
 {
-	__u32 eax;
-
-	eax = APIC_ICR_TRIGGER_LEVEL | APIC_ICR_LEVEL_ASSERT
-	      | APIC_ICR_DESTMODE_PHYSICAL | APIC_ICR_DMODE_NMI;
+	__u32 eax, edx;
 
-	wrmsr(APIC_MSR_ICR, eax, dest);
+	if (likely(!apic_mmio_base)) {
+		rdmsr(reg, &eax, &edx);
+		return eax;
+	}
+	return *(volatile __u32 *)(apic_mmio_base + APIC_MMIO_OFFSET(reg));
 }
 
-static inline void x2apic_send_sipi(__vaddr_t addr, int dest)
+static inline void apic_write(__u32 reg, __u32 val)
 {
-	__u32 eax;
-
-	UK_ASSERT((addr & (APIC_ICR_VECTOR_MASK << __PAGE_SHIFT)) == addr);
-
-	eax = APIC_ICR_TRIGGER_LEVEL | APIC_ICR_LEVEL_ASSERT
-	      | APIC_ICR_DESTMODE_PHYSICAL | APIC_ICR_DMODE_SUP
-	      | (addr >> __PAGE_SHIFT);
-
-	wrmsr(APIC_MSR_ICR, eax, dest);
+	if (likely(!apic_mmio_base)) {
+		wrmsr(reg, val, 0);
+		return;
+	}
+	*(volatile __u32 *)(apic_mmio_base + APIC_MMIO_OFFSET(reg)) = val;
 }
 
-static inline void x2apic_send_iipi(int dest)
-{
-	__u32 eax;
-
-	eax = APIC_ICR_TRIGGER_LEVEL | APIC_ICR_LEVEL_ASSERT
-	      | APIC_ICR_DESTMODE_PHYSICAL | APIC_ICR_DMODE_INIT;
+/**
+ * Enables the local APIC of the current CPU. The first call selects the
+ * APIC mode for all CPUs. Must be called after the lcpu of the CPU is set
+ * up, so that per-CPU state can be registered with the hypervisor.
+ *
+ * @return 0 on success, -ENOTSUP if the local APIC is not usable
+ */
+int apic_enable(void);
 
-	wrmsr(APIC_MSR_ICR, eax, dest);
-}
+void apic_send_ipi(int irqno, int dest);
+void apic_send_self_ipi(int irqno);
+void apic_send_nmi(int dest);
+void apic_send_sipi(__vaddr_t addr, int dest);
+void apic_send_iipi(int dest);
 
 /* Deassert only supported on Pentium and P6 familiy processors */
-#define x2apic_send_iipi_deassert() {}
+#define apic_send_iipi_deassert() {}
 
-static inline void x2apic_clear_errors(void)
-{
-	wrmsr(APIC_MSR_ESR, 0, 0);
-}
+void apic_clear_errors(void);
 
-static inline void x2apic_ack_interrupt(void)
-{
-	wrmsr(APIC_MSR_EOI, 0, 0);
-}
-
-/* We only support x2APIC at the moment */
-#define apic_enable		x2apic_enable
-#define apic_send_ipi		x2apic_send_ipi
-#define apic_send_nmi		x2apic_send_nmi
-#define apic_send_sipi		x2apic_send_sipi
-#define apic_send_iipi		x2apic_send_iipi
-#define apic_send_iipi_deassert x2apic_send_iipi_deassert
-#define apic_clear_errors	x2apic_clear_errors
-#define apic_ack_interrupt	x2apic_ack_interrupt
+/**
+ * Signals the end of the interrupt being handled to the local APIC. With
+ * KVM PV-EOI, the write is skipped if the hypervisor does not need it.
+ */
+void apic_ack_interrupt(void);
 
 #endif /* __PLAT_CMN_X86_APIC_H__ */
@@ -9,6 +9,7 @@
 
 #if CONFIG_LIBUKINTCTLR_APIC
 #include <uk/intctlr/apic.h>
+#include <uk/plat/common/lcpu.h>
 #endif /* CONFIG_LIBUKINTCTLR_APIC */
 
 #include "pic.h"
@@ -20,6 +21,37 @@ static int configure_irq(struct uk_intctlr_irq *irq __unused)
 	return 0;
 }
 
+#if CONFIG_LIBUKINTCTLR_APIC
+/* MSIs are writes to the local APIC of the destination, which delivers
+ * them as edge-triggered fixed interrupts in physical destination mode
+ */
+#define MSI_ADDR_BASE		0xfee00000UL
+#define MSI_ADDR_DEST_SHIFT	12
+#define MSI_ADDR_DEST_MAX	0xff
+
+/* IRQ n is delivered through interrupt vector 32 + n */
+#define MSI_DATA_VECTOR(irq)	(32 + (irq))
+
+static int msi_compose(unsigned int irq, __lcpuidx lcpu, __u32 devid __unused,
+		       __u64 *addr, __u32 *data)
+{
+	__lcpuid id;
+
+	if (unlikely(MSI_DATA_VECTOR(irq) > 0xff ||
+		     lcpu >= ukplat_lcpu_count()))
+		return -EINVAL;
+
+	id = lcpu_get(lcpu)->id;
+	if (unlikely(id > MSI_ADDR_DEST_MAX))
+		return -ENOTSUP;
+
+	*addr = MSI_ADDR_BASE | (id << MSI_ADDR_DEST_SHIFT);
+	*data = MSI_DATA_VECTOR(irq);
+
+	return 0;
+}
+#endif /* CONFIG_LIBUKINTCTLR_APIC */
+
 void uk_intctlr_xpic_handle_irq(struct __regs *regs, unsigned int irq)
 {
 	uk_intctlr_irq_handle(regs, irq);
@@ -57,6 +89,9 @@ int uk_intctlr_probe(void)
 
 	intctlr.ops = ops;
 	intctlr.ops->configure_irq = configure_irq;
+#if CONFIG_LIBUKINTCTLR_APIC
+	intctlr.ops->msi_compose = msi_compose;
+#endif /* CONFIG_LIBUKINTCTLR_APIC */
 
 	return uk_intctlr_register(&intctlr);
 }
@@ -0,0 +1,112 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * ivshmem metrics export
+ *
+ * The shared memory of an ivshmem device (BAR 2) is backed by a memory
+ * backend on the host, e.g., a file in /dev/shm with QEMU's
+ *   -object memory-backend-file,id=m,share=on,mem-path=/dev/shm/uk,size=1M
+ *   -device ivshmem-plain,memdev=m
+ * A thread periodically serializes the uk_store entries into the region,
+ * see uk/store_shm.h. The host reads the values from the backend without
+ * interrupting the guest. Only the first device is used.
+ */
+#include <errno.h>
+#include <uk/arch/time.h>
+#include <uk/assert.h>
+#include <uk/bus/pci.h>
+#include <uk/errptr.h>
+#include <uk/essentials.h>
+#include <uk/print.h>
+#include <uk/sched.h>
+#include <uk/store_shm.h>
+#include <uk/thread.h>
+
+#define DRIVER_NAME		"ivshmem"
+
+/* BAR of the shared memory */
+#define IVSHMEM_SHM_BAR		2
+
+#define IVSHMEM_INTERVAL	\
+	ukarch_time_msec_to_nsec((__nsec)CONFIG_LIBIVSHMEM_INTERVAL)
+
+static void *ivshmem_base;
+
+static __noreturn void ivshmem_thread(void *arg __unused)
+{
+	for (;;) {
+		uk_store_shm_update(ivshmem_base);
+		uk_sched_thread_sleep(IVSHMEM_INTERVAL);
+	}
+}
+
+static int ivshmem_add_dev(struct pci_device *pdev)
+{
+	struct uk_thread *t;
+	void *base;
+	__u32 cmd;
+	__sz len;
+	int rc;
+
+	UK_ASSERT(pdev != NULL);
+
+	if (ivshmem_base) {
+		uk_pr_info(DRIVER_NAME": Ignoring additional device\n");
+		return -EEXIST;
+	}
+
+	len = pci_bar_size(pdev, IVSHMEM_SHM_BAR);
+	if (unlikely(!len)) {
+		uk_pr_err(DRIVER_NAME": No shared memory\n");
+		return -ENODEV;
+	}
+
+	base = pci_bar_map(pdev, IVSHMEM_SHM_BAR, 0, len);
+	if (unlikely(PTRISERR(base))) {
+		uk_pr_err(DRIVER_NAME": Failed to map shared memory: %d\n",
+			  PTR2ERR(base));
+		return PTR2ERR(base);
+	}
+
+	/* The upper half is the status, whose bits are cleared by writing
+	 * ones
+	 */
+	cmd = pci_config_read32(pdev, PCI_COMMAND) & 0xffff;
+	pci_config_write32(pdev, PCI_COMMAND, cmd | PCI_COMMAND_MEMORY);
+
+	rc = uk_store_shm_init(base, len);
+	if (unlikely(rc)) {
+		uk_pr_err(DRIVER_NAME": Shared memory too small: %"__PRIsz
+			  " bytes\n", len);
+		return rc;
+	}
+	ivshmem_base = base;
+
+	t = uk_sched_thread_create(uk_sched_current(), ivshmem_thread,
+				   __NULL, DRIVER_NAME);
+	if (unlikely(!t || PTRISERR(t))) {
+		uk_pr_err(DRIVER_NAME": Failed to start update thread\n");
+		ivshmem_base = __NULL;
+		return t ? PTR2ERR(t) : -ENOMEM;
+	}
+
+	uk_pr_info(DRIVER_NAME": Exporting uk_store entries to %"__PRIsz
+		   " bytes of shared memory at %p\n", len, base);
+	return 0;
+}
+
+static const struct pci_device_id ivshmem_pci_ids[] = {
+	{PCI_DEVICE_ID(0x1af4, 0x1110)},
+	/* End of Driver List */
+	{PCI_ANY_DEVICE_ID},
+};
+
+static struct pci_driver ivshmem_pci_drv = {
+	.device_ids = ivshmem_pci_ids,
+	.add_dev = ivshmem_add_dev
+};
+PCI_REGISTER_DRIVER(&ivshmem_pci_drv);
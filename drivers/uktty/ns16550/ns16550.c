@@ -31,6 +31,13 @@
 #include <uk/config.h>
 #include <uk/plat/console.h>
 #include <uk/assert.h>
+#if CONFIG_LIBUKTTY_NS16550_TX_IRQ
+#include <uk/init.h>
+#include <uk/intctlr.h>
+#include <uk/plat/common/bootinfo.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/spinlock.h>
+#endif /* CONFIG_LIBUKTTY_NS16550_TX_IRQ */
 
 #define NS16550_THR_OFFSET	0x00U
 #define NS16550_RBR_OFFSET	0x00U
@@ -43,11 +50,18 @@
 #define NS16550_MSR_OFFSET	0x06U
 
 #define NS16550_LCR_DLAB	0x80U
+#define NS16550_IER_THRI	0x02U
 #define NS16550_IIR_NO_INT	0x01U
 #define NS16550_FCR_FIFO_EN	0x01U
+#define NS16550_FCR_CLEAR_RX	0x02U
+#define NS16550_FCR_CLEAR_TX	0x04U
 #define NS16550_LSR_RX_EMPTY	0x01U
+#define NS16550_LSR_THR_EMPTY	0x20U
 #define NS16550_LSR_TX_EMPTY	0x40U
 
+/* Size of the transmit FIFO of a 16550 */
+#define NS16550_TX_FIFO_SIZE	16
+
 /*
  * NS16550 UART base address
  * As we are using the PA = VA mapping, some SoC would set PA 0
@@ -112,6 +126,24 @@ static void ns16550_reg_write(__u32 reg, __u32 value)
 	}
 }
 
+#if CONFIG_LIBUKTTY_NS16550_TX_IRQ
+#define NS16550_TX_BUFFER_SIZE	CONFIG_LIBUKTTY_NS16550_TX_BUFFER_SIZE
+
+/* Device tree node of the UART, to look up its interrupt */
+static int ns16550_fdt_offset = -1;
+
+/*
+ * Once the interrupt is set up, output is queued in a ring and the UART is
+ * fed from the THR-empty interrupt. Head and tail count the characters ever
+ * queued and sent.
+ */
+static int ns16550_tx_irq;
+static char ns16550_tx_buf[NS16550_TX_BUFFER_SIZE];
+static __sz ns16550_tx_head;
+static __sz ns16550_tx_tail;
+static __spinlock ns16550_tx_lock = UKARCH_SPINLOCK_INITIALIZER();
+#endif /* CONFIG_LIBUKTTY_NS16550_TX_IRQ */
+
 static void init_ns16550(__u64 base)
 {
 	ns16550_uart_base = base;
@@ -155,6 +187,9 @@ void ns16550_console_init(const void *dtb)
 
 	reg_uart_base = fdt64_to_cpu(regs[0]);
 	uk_pr_info("Found NS16550 UART on: 0x%lx\n", reg_uart_base);
+#if CONFIG_LIBUKTTY_NS16550_TX_IRQ
+	ns16550_fdt_offset = offset;
+#endif /* CONFIG_LIBUKTTY_NS16550_TX_IRQ */
 
 	regs = fdt_getprop(dtb, offset, "reg-shift", &len);
 	if (regs)
@@ -222,8 +257,154 @@ static int ns16550_getc(void)
 	return (int)(ns16550_reg_read(NS16550_RBR_OFFSET) & 0xff);
 }
 
+#if CONFIG_LIBUKTTY_NS16550_TX_IRQ
+/* Moves queued characters into the transmit FIFO, which must be empty */
+static void ns16550_tx_fill(void)
+{
+	unsigned int i;
+
+	ns16550_reg_write(NS16550_LCR_OFFSET,
+			  ns16550_reg_read(NS16550_LCR_OFFSET) &
+			  ~(NS16550_LCR_DLAB));
+	for (i = 0; i < NS16550_TX_FIFO_SIZE &&
+		    ns16550_tx_tail != ns16550_tx_head; i++)
+		ns16550_reg_write(NS16550_THR_OFFSET,
+				  ns16550_tx_buf[ns16550_tx_tail++ %
+						 NS16550_TX_BUFFER_SIZE]);
+}
+
+/* Fills the FIFO if it is empty and requests the THR-empty interrupt as
+ * long as characters are queued. Called with the lock held.
+ */
+static void ns16550_tx_kick(void)
+{
+	if (ns16550_reg_read(NS16550_LSR_OFFSET) & NS16550_LSR_THR_EMPTY)
+		ns16550_tx_fill();
+
+	ns16550_reg_write(NS16550_IER_OFFSET,
+			  ns16550_tx_tail != ns16550_tx_head ?
+			  NS16550_IER_THRI : 0);
+}
+
+/* Waits for the FIFO to be empty and refills it */
+static void ns16550_tx_poll(void)
+{
+	while (!(ns16550_reg_read(NS16550_LSR_OFFSET) &
+		 NS16550_LSR_THR_EMPTY))
+		;
+	ns16550_tx_fill();
+}
+
+static void ns16550_tx_put(char a)
+{
+	/* The ring is full, make room by waiting for the UART */
+	while (ns16550_tx_head - ns16550_tx_tail == NS16550_TX_BUFFER_SIZE)
+		ns16550_tx_poll();
+
+	ns16550_tx_buf[ns16550_tx_head++ % NS16550_TX_BUFFER_SIZE] = a;
+}
+
+static int ns16550_tx_queue(const char *buf, unsigned int len)
+{
+	unsigned long flags;
+	int sync;
+
+	/* Output with interrupts disabled, e.g., of a crash, may never be
+	 * followed by an interrupt, so it is written out right away
+	 */
+	sync = ukplat_lcpu_irqs_disabled();
+
+	ukplat_spin_lock_irqsave(&ns16550_tx_lock, flags);
+	for (unsigned int i = 0; i < len; i++) {
+		if (buf[i] == '\n')
+			ns16550_tx_put('\r');
+		ns16550_tx_put(buf[i]);
+	}
+
+	if (sync) {
+		while (ns16550_tx_tail != ns16550_tx_head)
+			ns16550_tx_poll();
+	}
+	ns16550_tx_kick();
+	ukplat_spin_unlock_irqrestore(&ns16550_tx_lock, flags);
+	return len;
+}
+
+static int ns16550_tx_irq_handler(void *arg __unused)
+{
+	/* Reading the IIR acknowledges the THR-empty interrupt */
+	if (ns16550_reg_read(NS16550_IIR_OFFSET) & NS16550_IIR_NO_INT)
+		return 0;
+
+	ukarch_spin_lock(&ns16550_tx_lock);
+	ns16550_tx_kick();
+	ukarch_spin_unlock(&ns16550_tx_lock);
+	return 1;
+}
+
+static int ns16550_tx_irq_init(struct uk_init_ctx *ictx __unused)
+{
+	const void *dtb = (const void *)ukplat_bootinfo_get()->dtb;
+	struct uk_intctlr_irq irq;
+	unsigned long flags;
+	int rc;
+
+	/* Only the early console is available */
+	if (ns16550_fdt_offset < 0)
+		return 0;
+
+	rc = uk_intctlr_irq_fdt_xlat(dtb, ns16550_fdt_offset, 0, &irq);
+	if (unlikely(rc < 0)) {
+		uk_pr_warn("NS16550 UART has no interrupt, output is polled\n");
+		return 0;
+	}
+	uk_intctlr_irq_configure(&irq);
+
+	rc = uk_intctlr_irq_register(irq.id, ns16550_tx_irq_handler, __NULL);
+	if (unlikely(rc)) {
+		uk_pr_warn("Could not register NS16550 UART interrupt: %d\n",
+			   rc);
+		return 0;
+	}
+
+	ukplat_spin_lock_irqsave(&ns16550_tx_lock, flags);
+	ns16550_reg_write(NS16550_FCR_OFFSET,
+			  NS16550_FCR_FIFO_EN | NS16550_FCR_CLEAR_RX |
+			  NS16550_FCR_CLEAR_TX);
+	ns16550_tx_irq = 1;
+	ukplat_spin_unlock_irqrestore(&ns16550_tx_lock, flags);
+
+	uk_pr_info("NS16550 UART output is interrupt-driven (irq %u)\n",
+		   irq.id);
+	return 0;
+}
+
+/* Writes out the queued output and returns to polling for the shutdown */
+static void ns16550_tx_irq_term(const struct uk_term_ctx *tctx __unused)
+{
+	unsigned long flags;
+
+	if (!ns16550_tx_irq)
+		return;
+
+	ukplat_spin_lock_irqsave(&ns16550_tx_lock, flags);
+	while (ns16550_tx_tail != ns16550_tx_head)
+		ns16550_tx_poll();
+	ns16550_reg_write(NS16550_IER_OFFSET, 0);
+	ns16550_tx_irq = 0;
+	ukplat_spin_unlock_irqrestore(&ns16550_tx_lock, flags);
+}
+
+uk_plat_initcall(ns16550_tx_irq_init, ns16550_tx_irq_term);
+#endif /* CONFIG_LIBUKTTY_NS16550_TX_IRQ */
+
 int ukplat_coutk(const char *buf, unsigned int len)
 {
+#if CONFIG_LIBUKTTY_NS16550_TX_IRQ
+	if (ns16550_tx_irq)
+		return ns16550_tx_queue(buf, len);
+#endif /* CONFIG_LIBUKTTY_NS16550_TX_IRQ */
+
 	for (unsigned int i = 0; i < len; i++)
 		ns16550_putc(buf[i]);
 	return len;
@@ -22,6 +22,13 @@
 #include <uk/bitops.h>
 #include <uk/plat/console.h>
 #include <uk/assert.h>
+#if CONFIG_LIBUKTTY_PL011_TX_IRQ
+#include <uk/init.h>
+#include <uk/intctlr.h>
+#include <uk/plat/common/bootinfo.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/spinlock.h>
+#endif /* CONFIG_LIBUKTTY_PL011_TX_IRQ */
 
 /* PL011 UART registers and masks*/
 /* Data register */
@@ -35,6 +42,7 @@
 #define REG_UARTFR_OFFSET	0x18
 #define FR_TXFF			UK_BIT(5)    /* Transmit FIFO/reg full */
 #define FR_RXFE			UK_BIT(4)    /* Receive FIFO/reg empty */
+#define FR_BUSY			UK_BIT(3)    /* Transmitting data */
 
 /* Integer baud rate register */
 #define REG_UARTIBRD_OFFSET	0x24
@@ -44,6 +52,7 @@
 /* Line control register */
 #define REG_UARTLCR_H_OFFSET	0x2C
 #define LCR_H_WLEN8		(0x3 << 5)  /* Data width is 8-bits */
+#define LCR_H_FEN		UK_BIT(4)    /* Enable FIFOs */
 
 /* Control register */
 #define REG_UARTCR_OFFSET	0x30
@@ -61,6 +70,7 @@
 #define REG_UARTMIS_OFFSET	0x40
 /* Interrupt clear register */
 #define REG_UARTICR_OFFSET	0x44
+#define INT_TX			UK_BIT(5)    /* Transmit interrupt */
 
 /*
  * PL011 UART base address
@@ -84,6 +94,24 @@ static __u64 pl011_uart_bas;
 #define PL011_REG_READ(r)	ioreg_read16(PL011_REG(r))
 #define PL011_REG_WRITE(r, v)	ioreg_write16(PL011_REG(r), v)
 
+#if CONFIG_LIBUKTTY_PL011_TX_IRQ
+#define PL011_TX_BUFFER_SIZE	CONFIG_LIBUKTTY_PL011_TX_BUFFER_SIZE
+
+/* Device tree node of the UART, to look up its interrupt */
+static int pl011_fdt_offset = -1;
+
+/*
+ * Once the interrupt is set up, output is queued in a ring and the UART is
+ * fed from the transmit interrupt. Head and tail count the characters ever
+ * queued and sent.
+ */
+static int pl011_tx_irq;
+static char pl011_tx_buf[PL011_TX_BUFFER_SIZE];
+static __sz pl011_tx_head;
+static __sz pl011_tx_tail;
+static __spinlock pl011_tx_lock = UKARCH_SPINLOCK_INITIALIZER();
+#endif /* CONFIG_LIBUKTTY_PL011_TX_IRQ */
+
 static void init_pl011(__u64 bas)
 {
 	pl011_uart_bas = bas;
@@ -138,6 +166,9 @@ void pl011_console_init(const void *dtb)
 
 	uk_pr_info("PL011 UART initialized\n");
 	pl011_uart_initialized = 1;
+#if CONFIG_LIBUKTTY_PL011_TX_IRQ
+	pl011_fdt_offset = offset;
+#endif /* CONFIG_LIBUKTTY_PL011_TX_IRQ */
 }
 
 int ukplat_coutd(const char *str, __u32 len)
@@ -185,8 +216,152 @@ static int pl011_getc(void)
 	return (int)(PL011_REG_READ(REG_UARTDR_OFFSET) & 0xff);
 }
 
+#if CONFIG_LIBUKTTY_PL011_TX_IRQ
+/* Moves queued characters into the transmit FIFO until it is full */
+static void pl011_tx_fill(void)
+{
+	while (pl011_tx_tail != pl011_tx_head &&
+	       !(PL011_REG_READ(REG_UARTFR_OFFSET) & FR_TXFF))
+		PL011_REG_WRITE(REG_UARTDR_OFFSET,
+				pl011_tx_buf[pl011_tx_tail++ %
+					     PL011_TX_BUFFER_SIZE] & 0xff);
+}
+
+/* Fills the FIFO and requests the transmit interrupt as long as characters
+ * are queued. Called with the lock held.
+ */
+static void pl011_tx_kick(void)
+{
+	__u16 imsc;
+
+	pl011_tx_fill();
+
+	imsc = PL011_REG_READ(REG_UARTIMSC_OFFSET);
+	if (pl011_tx_tail != pl011_tx_head)
+		imsc |= INT_TX;
+	else
+		imsc &= ~INT_TX;
+	PL011_REG_WRITE(REG_UARTIMSC_OFFSET, imsc);
+}
+
+static void pl011_tx_put(char a)
+{
+	/* The ring is full, make room by waiting for the UART */
+	while (pl011_tx_head - pl011_tx_tail == PL011_TX_BUFFER_SIZE)
+		pl011_tx_fill();
+
+	pl011_tx_buf[pl011_tx_head++ % PL011_TX_BUFFER_SIZE] = a;
+}
+
+static int pl011_tx_queue(const char *buf, unsigned int len)
+{
+	unsigned long flags;
+	int sync;
+
+	/* Output with interrupts disabled, e.g., of a crash, may never be
+	 * followed by an interrupt, so it is written out right away
+	 */
+	sync = ukplat_lcpu_irqs_disabled();
+
+	ukplat_spin_lock_irqsave(&pl011_tx_lock, flags);
+	for (unsigned int i = 0; i < len; i++) {
+		if (buf[i] == '\n')
+			pl011_tx_put('\r');
+		pl011_tx_put(buf[i]);
+	}
+
+	if (sync) {
+		while (pl011_tx_tail != pl011_tx_head)
+			pl011_tx_fill();
+	}
+	pl011_tx_kick();
+	ukplat_spin_unlock_irqrestore(&pl011_tx_lock, flags);
+	return len;
+}
+
+static int pl011_tx_irq_handler(void *arg __unused)
+{
+	if (!(PL011_REG_READ(REG_UARTMIS_OFFSET) & INT_TX))
+		return 0;
+
+	PL011_REG_WRITE(REG_UARTICR_OFFSET, INT_TX);
+
+	ukarch_spin_lock(&pl011_tx_lock);
+	pl011_tx_kick();
+	ukarch_spin_unlock(&pl011_tx_lock);
+	return 1;
+}
+
+static int pl011_tx_irq_init(struct uk_init_ctx *ictx __unused)
+{
+	const void *dtb = (const void *)ukplat_bootinfo_get()->dtb;
+	struct uk_intctlr_irq irq;
+	unsigned long flags;
+	__u16 cr;
+	int rc;
+
+	/* Only the early console is available */
+	if (pl011_fdt_offset < 0)
+		return 0;
+
+	rc = uk_intctlr_irq_fdt_xlat(dtb, pl011_fdt_offset, 0, &irq);
+	if (unlikely(rc < 0)) {
+		uk_pr_warn("PL011 UART has no interrupt, output is polled\n");
+		return 0;
+	}
+	uk_intctlr_irq_configure(&irq);
+
+	rc = uk_intctlr_irq_register(irq.id, pl011_tx_irq_handler, __NULL);
+	if (unlikely(rc)) {
+		uk_pr_warn("Could not register PL011 UART interrupt: %d\n",
+			   rc);
+		return 0;
+	}
+
+	/* The line control may only be changed while the UART is disabled */
+	ukplat_spin_lock_irqsave(&pl011_tx_lock, flags);
+	cr = PL011_REG_READ(REG_UARTCR_OFFSET);
+	while (PL011_REG_READ(REG_UARTFR_OFFSET) & FR_BUSY)
+		;
+	PL011_REG_WRITE(REG_UARTCR_OFFSET, 0);
+	PL011_REG_WRITE(REG_UARTLCR_H_OFFSET,
+			PL011_REG_READ(REG_UARTLCR_H_OFFSET) | LCR_H_FEN);
+	PL011_REG_WRITE(REG_UARTCR_OFFSET, cr);
+	pl011_tx_irq = 1;
+	ukplat_spin_unlock_irqrestore(&pl011_tx_lock, flags);
+
+	uk_pr_info("PL011 UART output is interrupt-driven (irq %u)\n",
+		   irq.id);
+	return 0;
+}
+
+/* Writes out the queued output and returns to polling for the shutdown */
+static void pl011_tx_irq_term(const struct uk_term_ctx *tctx __unused)
+{
+	unsigned long flags;
+
+	if (!pl011_tx_irq)
+		return;
+
+	ukplat_spin_lock_irqsave(&pl011_tx_lock, flags);
+	while (pl011_tx_tail != pl011_tx_head)
+		pl011_tx_fill();
+	PL011_REG_WRITE(REG_UARTIMSC_OFFSET,
+			PL011_REG_READ(REG_UARTIMSC_OFFSET) & ~INT_TX);
+	pl011_tx_irq = 0;
+	ukplat_spin_unlock_irqrestore(&pl011_tx_lock, flags);
+}
+
+uk_plat_initcall(pl011_tx_irq_init, pl011_tx_irq_term);
+#endif /* CONFIG_LIBUKTTY_PL011_TX_IRQ */
+
 int ukplat_coutk(const char *buf, unsigned int len)
 {
+#if CONFIG_LIBUKTTY_PL011_TX_IRQ
+	if (pl011_tx_irq)
+		return pl011_tx_queue(buf, len);
+#endif /* CONFIG_LIBUKTTY_PL011_TX_IRQ */
+
 	for (unsigned int i = 0; i < len; i++)
 		pl011_putc(buf[i]);
 	return len;
@@ -40,16 +40,42 @@
 #include <uk/9pdev_trans.h>
 #include <virtio/virtio_bus.h>
 #include <virtio/virtio_9p.h>
+#include <uk/plat/lcpu.h>
 #include <uk/plat/spinlock.h>
 
 #define DRIVER_NAME	"virtio-9p"
 #define NUM_SEGMENTS	128 /** The number of virtqueue descriptors. */
+#define MAX_MSIZE	((__u32)CONFIG_LIBVIRTIO_9P_MAX_MSIZE * 1024)
+/*
+ * Segments needed besides the payload pages of a message: the fixed-size
+ * xmit and recv buffers of a request may each cross a page boundary, a
+ * zero-copy buffer that is not page-aligned spans one more page, and reads
+ * may need room for an Rerror reply.
+ */
+#define EXTRA_SEGMENTS	6
+#define MAX_QUEUES	CONFIG_LIBVIRTIO_9P_NUM_QUEUES
 static struct uk_alloc *a;
 
 /* List of initialized virtio 9p devices. */
 static UK_LIST_HEAD(virtio_9p_device_list);
 static __spinlock virtio_9p_device_list_lock;
 
+struct virtio_9p_device;
+
+/* Request queue, used by the logical CPUs with index (lcpu % nr_queues) */
+struct virtio_9p_queue {
+	/* Virtqueue reference. */
+	struct virtqueue *vq;
+	/* Hw queue identifier. */
+	__u16 hwvq_id;
+	/* Scatter-gather list. */
+	struct uk_sglist sg;
+	struct uk_sglist_seg *sgsegs;
+	/* Spinlock protecting the sg list and the vq. */
+	__spinlock spinlock;
+	struct virtio_9p_device *dev;
+} __align(CACHE_LINE_SIZE);
+
 struct virtio_9p_device {
 	/* Virtio device. */
 	struct virtio_dev *vdev;
@@ -57,17 +83,13 @@ struct virtio_9p_device {
 	char *tag;
 	/* Entry within the virtio devices' list. */
 	struct uk_list_head _list;
-	/* Virtqueue reference. */
-	struct virtqueue *vq;
-	/* Hw queue identifier. */
-	__u16 hwvq_id;
 	/* libuk9p associated device (NULL if the device is not in use). */
 	struct uk_9pdev *p9dev;
-	/* Scatter-gather list. */
-	struct uk_sglist sg;
-	struct uk_sglist_seg sgsegs[NUM_SEGMENTS];
-	/* Spinlock protecting the sg list and the vq. */
-	__spinlock spinlock;
+	/* Maximum number of segments of a single request. */
+	__u32 max_segs;
+	/* Request queues. */
+	__u16 nr_queues;
+	struct virtio_9p_queue *queues;
 };
 
 static int virtio_9p_connect(struct uk_9pdev *p9dev,
@@ -103,7 +125,8 @@ static int virtio_9p_connect(struct uk_9pdev *p9dev,
 	 * Similarly for write requests, but in reverse. Other requests should
 	 * not exceed one page for both recv and xmit fcalls.
 	 */
-	p9dev->max_msize = (NUM_SEGMENTS - 1) * __PAGE_SIZE;
+	p9dev->max_msize = MIN(MAX_MSIZE,
+			       (dev->max_segs - EXTRA_SEGMENTS) * __PAGE_SIZE);
 
 	dev->p9dev = p9dev;
 	p9dev->priv = dev;
@@ -131,6 +154,7 @@ static int virtio_9p_request(struct uk_9pdev *p9dev,
 			     struct uk_9preq *req)
 {
 	struct virtio_9p_device *dev;
+	struct virtio_9p_queue *q;
 	int rc, host_notified = 0;
 	unsigned long flags;
 	__sz read_segs, write_segs;
@@ -146,17 +170,18 @@ static int virtio_9p_request(struct uk_9pdev *p9dev,
 	 */
 	uk_9preq_get(req);
 	dev = p9dev->priv;
-	ukplat_spin_lock_irqsave(&dev->spinlock, flags);
-	uk_sglist_reset(&dev->sg);
+	q = &dev->queues[ukplat_lcpu_idx() % dev->nr_queues];
+	ukplat_spin_lock_irqsave(&q->spinlock, flags);
+	uk_sglist_reset(&q->sg);
 
-	rc = uk_sglist_append(&dev->sg, req->xmit.buf, req->xmit.size);
+	rc = uk_sglist_append(&q->sg, req->xmit.buf, req->xmit.size);
 	if (rc < 0) {
 		failed = true;
 		goto out_unlock;
 	}
 
 	if (req->xmit.zc_buf) {
-		rc = uk_sglist_append(&dev->sg, req->xmit.zc_buf,
+		rc = uk_sglist_append(&q->sg, req->xmit.zc_buf,
 				req->xmit.zc_size);
 		if (rc < 0) {
 			failed = true;
@@ -164,9 +189,9 @@ static int virtio_9p_request(struct uk_9pdev *p9dev,
 		}
 	}
 
-	read_segs = dev->sg.sg_nseg;
+	read_segs = q->sg.sg_nseg;
 
-	rc = uk_sglist_append(&dev->sg, req->recv.buf, req->recv.size);
+	rc = uk_sglist_append(&q->sg, req->recv.buf, req->recv.size);
 	if (rc < 0) {
 		failed = true;
 		goto out_unlock;
@@ -175,7 +200,7 @@ static int virtio_9p_request(struct uk_9pdev *p9dev,
 	if (req->recv.zc_buf) {
 		__u32 recv_size = req->recv.size + req->recv.zc_size;
 
-		rc = uk_sglist_append(&dev->sg, req->recv.zc_buf,
+		rc = uk_sglist_append(&q->sg, req->recv.zc_buf,
 				req->recv.zc_size);
 		if (rc < 0) {
 			failed = true;
@@ -186,7 +211,7 @@ static int virtio_9p_request(struct uk_9pdev *p9dev,
 		if (recv_size < UK_9P_RERROR_MAXSIZE) {
 			__u32 leftover = UK_9P_RERROR_MAXSIZE - recv_size;
 
-			rc = uk_sglist_append(&dev->sg,
+			rc = uk_sglist_append(&q->sg,
 					req->recv.buf + recv_size, leftover);
 			if (rc < 0) {
 				failed = true;
@@ -195,13 +220,13 @@ static int virtio_9p_request(struct uk_9pdev *p9dev,
 		}
 	}
 
-	write_segs = dev->sg.sg_nseg - read_segs;
+	write_segs = q->sg.sg_nseg - read_segs;
 
-	rc = virtqueue_buffer_enqueue(dev->vq, req, &dev->sg,
+	rc = virtqueue_buffer_enqueue(q->vq, req, &q->sg,
 				      read_segs, write_segs);
 	if (likely(rc >= 0)) {
 		UK_WRITE_ONCE(req->state, UK_9PREQ_SENT);
-		virtqueue_host_notify(dev->vq);
+		virtqueue_host_notify(q->vq);
 		host_notified = 1;
 		rc = 0;
 	}
@@ -209,7 +234,7 @@ static int virtio_9p_request(struct uk_9pdev *p9dev,
 out_unlock:
 	if (failed)
 		uk_pr_err(DRIVER_NAME": Failed to append to the sg list.\n");
-	ukplat_spin_unlock_irqrestore(&dev->spinlock, flags);
+	ukplat_spin_unlock_irqrestore(&q->spinlock, flags);
 	/*
 	 * Release the reference to the 9P request if it was not successfully
 	 * sent.
@@ -233,7 +258,7 @@ static struct uk_9pdev_trans v9p_trans = {
 
 static int virtio_9p_recv(struct virtqueue *vq, void *priv)
 {
-	struct virtio_9p_device *dev;
+	struct virtio_9p_queue *q;
 	struct uk_9preq *req = NULL;
 	__u32 len;
 	int rc = 0;
@@ -242,17 +267,17 @@ static int virtio_9p_recv(struct virtqueue *vq, void *priv)
 	UK_ASSERT(vq);
 	UK_ASSERT(priv);
 
-	dev = priv;
-	UK_ASSERT(vq == dev->vq);
+	q = priv;
+	UK_ASSERT(vq == q->vq);
 
 	while (1) {
 		/*
 		 * Protect against data races with virtio_9p_request() calls
 		 * which are trying to enqueue to the same vq.
 		 */
-		ukarch_spin_lock(&dev->spinlock);
+		ukarch_spin_lock(&q->spinlock);
 		rc = virtqueue_buffer_dequeue(vq, (void **)&req, &len);
-		ukarch_spin_unlock(&dev->spinlock);
+		ukarch_spin_unlock(&q->spinlock);
 		if (rc < 0)
 			break;
 
@@ -285,47 +310,118 @@ static int virtio_9p_recv(struct virtqueue *vq, void *priv)
 	 * blocked on ENOSPC errors.
 	 */
 	if (handled)
-		uk_9pdev_xmit_notify(dev->p9dev);
+		uk_9pdev_xmit_notify(q->dev->p9dev);
 
 	return handled;
 }
 
+static void virtio_9p_vq_release(struct virtio_9p_device *d)
+{
+	struct virtio_9p_queue *q;
+	__u16 i;
+
+	for (i = 0; i < d->nr_queues; i++) {
+		q = &d->queues[i];
+		if (q->sgsegs)
+			uk_free(a, q->sgsegs);
+		if (q->vq && !PTRISERR(q->vq))
+			virtio_vqueue_release(d->vdev, q->vq, a);
+	}
+	uk_free(a, d->queues);
+	d->queues = NULL;
+	d->nr_queues = 0;
+}
+
 static int virtio_9p_vq_alloc(struct virtio_9p_device *d)
 {
+	__u16 qdesc_size[MAX_QUEUES];
+	struct virtio_9p_queue *q;
 	int vq_avail = 0;
 	int rc = 0;
-	__u16 qdesc_size;
+	__u16 i;
 
-	vq_avail = virtio_find_vqs(d->vdev, 1, &qdesc_size);
-	if (unlikely(vq_avail != 1)) {
+	vq_avail = virtio_find_vqs(d->vdev, MAX_QUEUES, qdesc_size);
+	if (unlikely(vq_avail < 1)) {
 		uk_pr_err(DRIVER_NAME": Expected: %d queues, found %d\n",
-			  1, vq_avail);
-		rc = -ENOMEM;
-		goto exit;
+			  MAX_QUEUES, vq_avail);
+		return -ENOMEM;
 	}
 
-	d->hwvq_id = 0;
-	if (unlikely(qdesc_size != NUM_SEGMENTS)) {
-		uk_pr_info(DRIVER_NAME": Expected %d descriptors, found %d (virtqueue %"
-			  PRIu16")\n", NUM_SEGMENTS, qdesc_size, d->hwvq_id);
+	/* Use the request queues up to the first missing one */
+	for (i = 0; i < MAX_QUEUES && qdesc_size[i]; i++)
+		;
+	if (unlikely(i == 0)) {
+		uk_pr_err(DRIVER_NAME": Request queue 0 is not available\n");
+		return -ENOMEM;
 	}
 
-	uk_sglist_init(&d->sg, ARRAY_SIZE(d->sgsegs), &d->sgsegs[0]);
-
-	d->vq = virtio_vqueue_setup(d->vdev,
-				    d->hwvq_id,
-				    NUM_SEGMENTS,
-				    virtio_9p_recv,
-				    a);
-	if (unlikely(PTRISERR(d->vq))) {
-		uk_pr_err(DRIVER_NAME": Failed to set up virtqueue %"PRIu16"\n",
-			  d->hwvq_id);
-		rc = PTR2ERR(d->vq);
+	d->queues = uk_memalign(a, CACHE_LINE_SIZE, i * sizeof(*d->queues));
+	if (unlikely(!d->queues))
+		return -ENOMEM;
+	memset(d->queues, 0, i * sizeof(*d->queues));
+	d->nr_queues = i;
+
+	/*
+	 * A request is either put directly into the ring or, if it has more
+	 * segments and the device supports it, into an indirect table.
+	 */
+	d->max_segs = UINT32_MAX;
+	for (i = 0; i < d->nr_queues; i++) {
+		q = &d->queues[i];
+		ukarch_spin_init(&q->spinlock);
+		q->dev = d;
+		q->hwvq_id = i;
+		if (unlikely(qdesc_size[i] != NUM_SEGMENTS)) {
+			uk_pr_info(DRIVER_NAME": Expected %d descriptors, found %d (virtqueue %"
+				   PRIu16")\n", NUM_SEGMENTS, qdesc_size[i],
+				   q->hwvq_id);
+		}
+
+		q->vq = virtio_vqueue_setup(d->vdev,
+					    q->hwvq_id,
+					    NUM_SEGMENTS,
+					    virtio_9p_recv,
+					    a);
+		if (unlikely(PTRISERR(q->vq))) {
+			uk_pr_err(DRIVER_NAME": Failed to set up virtqueue %"PRIu16"\n",
+				  q->hwvq_id);
+			rc = PTR2ERR(q->vq);
+			goto err_release;
+		}
+		q->vq->priv = q;
+
+		/* Completions are handled by a CPU that uses the queue */
+		if (d->nr_queues > 1)
+			virtio_vqueue_set_affinity(d->vdev, q->vq,
+						   i % ukplat_lcpu_count());
+
+		d->max_segs = MIN(d->max_segs, virtqueue_vring_get_num(q->vq));
+	}
+#if CONFIG_LIBVIRTIO_RING_INDIRECT
+	if (VIRTIO_FEATURE_HAS(d->vdev->features, VIRTIO_F_INDIRECT_DESC))
+		d->max_segs = MAX(d->max_segs,
+				  (__u32)CONFIG_LIBVIRTIO_RING_INDIRECT_MAX);
+#endif /* CONFIG_LIBVIRTIO_RING_INDIRECT */
+	UK_ASSERT(d->max_segs > EXTRA_SEGMENTS);
+
+	for (i = 0; i < d->nr_queues; i++) {
+		q = &d->queues[i];
+		q->sgsegs = uk_calloc(a, d->max_segs, sizeof(*q->sgsegs));
+		if (unlikely(!q->sgsegs)) {
+			uk_pr_err(DRIVER_NAME": Failed to allocate the sg list\n");
+			rc = -ENOMEM;
+			goto err_release;
+		}
+		uk_sglist_init(&q->sg, d->max_segs, q->sgsegs);
 	}
 
-	d->vq->priv = d;
+	if (d->nr_queues > 1)
+		uk_pr_info(DRIVER_NAME": Using %"PRIu16" request queues\n",
+			   d->nr_queues);
+	return 0;
 
-exit:
+err_release:
+	virtio_9p_vq_release(d);
 	return rc;
 }
 
@@ -385,6 +481,9 @@ static inline void virtio_9p_feature_set(struct virtio_9p_device *d)
 {
 	d->vdev->features = 0;
 	VIRTIO_FEATURE_SET(d->vdev->features, VIRTIO_9P_F_MOUNT_TAG);
+	VIRTIO_FEATURE_SET(d->vdev->features, VIRTIO_F_EVENT_IDX);
+	VIRTIO_FEATURE_SET(d->vdev->features, VIRTIO_F_RING_PACKED);
+	VIRTIO_FEATURE_SET(d->vdev->features, VIRTIO_F_INDIRECT_DESC);
 }
 
 static int virtio_9p_configure(struct virtio_9p_device *d)
@@ -417,7 +516,10 @@ out_status_fail:
 
 static int virtio_9p_start(struct virtio_9p_device *d)
 {
-	virtqueue_intr_enable(d->vq);
+	__u16 i;
+
+	for (i = 0; i < d->nr_queues; i++)
+		virtqueue_intr_enable(d->queues[i].vq);
 	virtio_dev_drv_up(d->vdev);
 	uk_pr_info(DRIVER_NAME": %s started\n", d->tag);
 
@@ -436,7 +538,6 @@ static int virtio_9p_add_dev(struct virtio_dev *vdev)
 		rc = -ENOMEM;
 		goto out;
 	}
-	ukarch_spin_init(&d->spinlock);
 	d->vdev = vdev;
 	virtio_9p_feature_set(d);
 	rc = virtio_9p_configure(d);
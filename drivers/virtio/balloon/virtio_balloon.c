@@ -0,0 +1,450 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+/*
+ * Virtio balloon
+ *
+ * The balloon is inflated and deflated in aligned blocks of 2 MiB to follow
+ * the target size set by the host. Since configuration change interrupts are
+ * not delivered to drivers, a background thread polls the target size
+ * periodically. The same thread implements free page reporting: It takes
+ * large free blocks that were not reported yet out of the free lists of the
+ * buddy frame allocator, reports them to the host, which may then discard
+ * their backing, and puts them back as reported.
+ */
+#include <inttypes.h>
+#include <uk/alloc.h>
+#include <uk/atomic.h>
+#include <uk/essentials.h>
+#include <uk/falloc.h>
+#include <uk/fallocbuddy.h>
+#include <uk/print.h>
+#include <uk/sched.h>
+#include <uk/sglist.h>
+#include <uk/wait.h>
+#include <uk/plat/paging.h>
+#include <uk/arch/time.h>
+#include <virtio/virtio_bus.h>
+#include <virtio/virtio_ids.h>
+#include <virtio/virtio_config.h>
+
+#define DRIVER_NAME	"virtio-balloon"
+
+#define VIRTIO_BALLOON_F_MUST_TELL_HOST	0
+#define VIRTIO_BALLOON_F_REPORTING	5
+
+/* Page frame numbers always refer to 4 KiB pages */
+#define VIRTIO_BALLOON_PFN_SHIFT	12
+
+#define VIRTIO_BALLOON_VQ_INFLATE	0
+#define VIRTIO_BALLOON_VQ_DEFLATE	1
+/* Only present with VIRTIO_BALLOON_F_REPORTING as we do not use stats */
+#define VIRTIO_BALLOON_VQ_REPORTING	2
+#define VIRTIO_BALLOON_VQ_MAX		3
+
+struct virtio_balloon_config {
+	/* Number of pages the host wants in the balloon */
+	__u32 num_pages;
+	/* Number of pages in the balloon */
+	__u32 actual;
+};
+
+/* The balloon is resized in aligned blocks so that the host can drop whole
+ * huge pages
+ */
+#define BALLOON_BLOCK_SHIFT	21
+#define BALLOON_BLOCK_PAGES	(1UL << (BALLOON_BLOCK_SHIFT - PAGE_SHIFT))
+#define BALLOON_BLOCK_PFNS	\
+	(1UL << (BALLOON_BLOCK_SHIFT - VIRTIO_BALLOON_PFN_SHIFT))
+
+/* Free blocks of at least this order are reported */
+#define REPORT_ORDER		21
+/* Blocks reported with a single request */
+#define REPORT_SEGS		32
+#define REPORT_RESERVE		((__sz)CONFIG_LIBVIRTIO_BALLOON_RESERVE << 20)
+
+/* Descriptors carry 32-bit lengths */
+#if CONFIG_LIBUKFALLOCBUDDY_MAX_ALLOC_ORDER > 31
+#error The maximum frame allocation order exceeds the virtio buffer length
+#endif
+
+static struct uk_alloc *a;
+
+struct virtio_balloon_device {
+	/* Virtio device. */
+	struct virtio_dev *vdev;
+	/* Virtqueues. Reporting queue is NULL if not negotiated. */
+	struct virtqueue *vq[VIRTIO_BALLOON_VQ_MAX];
+	/* Scatter-gather list. */
+	struct uk_sglist sg;
+	struct uk_sglist_seg sgsegs[REPORT_SEGS];
+	/* Set while the host did not process the request yet. */
+	int pending;
+	/* Wait queue of the balloon thread. */
+	struct uk_waitq wq;
+	/* Frame allocator the balloon takes memory from. */
+	struct uk_falloc *fa;
+	/* Blocks in the balloon. */
+	__paddr_t *blocks;
+	unsigned long nr_blocks;
+	unsigned long max_blocks;
+	/* Page frame numbers of a block to inflate or deflate. */
+	__u32 pfns[BALLOON_BLOCK_PFNS];
+	/* Blocks of the current free page report. */
+	__paddr_t report_paddrs[REPORT_SEGS];
+	unsigned int report_orders[REPORT_SEGS];
+};
+
+static int virtio_balloon_recv(struct virtqueue *vq, void *priv)
+{
+	struct virtio_balloon_device *d = priv;
+	void *cookie;
+	__u32 len;
+	int rc, handled = 0;
+
+	for (;;) {
+		rc = virtqueue_buffer_dequeue(vq, &cookie, &len);
+		if (rc < 0)
+			break;
+
+		handled = 1;
+		if (rc == 0)
+			break;
+	}
+
+	if (handled) {
+		UK_WRITE_ONCE(d->pending, 0);
+		uk_waitq_wake_up(&d->wq);
+	}
+
+	return handled;
+}
+
+/* Hands the sg list to the host and waits for the host to process it. There
+ * is only a single request in flight at any time.
+ */
+static int virtio_balloon_send(struct virtio_balloon_device *d,
+			       struct virtqueue *vq, __u16 read_bufs,
+			       __u16 write_bufs)
+{
+	int rc;
+
+	UK_WRITE_ONCE(d->pending, 1);
+	rc = virtqueue_buffer_enqueue(vq, d, &d->sg, read_bufs, write_bufs);
+	if (unlikely(rc < 0)) {
+		UK_WRITE_ONCE(d->pending, 0);
+		return rc;
+	}
+	virtqueue_host_notify(vq);
+
+	uk_waitq_wait_event(&d->wq, !UK_READ_ONCE(d->pending));
+	return 0;
+}
+
+static int virtio_balloon_send_pfns(struct virtio_balloon_device *d,
+				    struct virtqueue *vq, __paddr_t paddr)
+{
+	unsigned long i;
+	int rc;
+
+	for (i = 0; i < BALLOON_BLOCK_PFNS; i++)
+		d->pfns[i] = (paddr >> VIRTIO_BALLOON_PFN_SHIFT) + i;
+
+	uk_sglist_reset(&d->sg);
+	rc = uk_sglist_append(&d->sg, d->pfns, sizeof(d->pfns));
+	if (unlikely(rc < 0))
+		return rc;
+
+	return virtio_balloon_send(d, vq, d->sg.sg_nseg, 0);
+}
+
+static int virtio_balloon_inflate(struct virtio_balloon_device *d)
+{
+	unsigned long max;
+	__paddr_t *blocks;
+	__paddr_t paddr;
+	int rc;
+
+	if (d->nr_blocks == d->max_blocks) {
+		max = MAX(d->max_blocks * 2, 64UL);
+		blocks = uk_realloc(a, d->blocks, max * sizeof(*blocks));
+		if (unlikely(!blocks))
+			return -ENOMEM;
+
+		d->blocks = blocks;
+		d->max_blocks = max;
+	}
+
+	paddr = __PADDR_ANY;
+	rc = d->fa->falloc(d->fa, &paddr, BALLOON_BLOCK_PAGES,
+			   FALLOC_FLAG_ALIGNED);
+	if (unlikely(rc))
+		return -ENOMEM;
+
+	rc = virtio_balloon_send_pfns(d, d->vq[VIRTIO_BALLOON_VQ_INFLATE],
+				      paddr);
+	if (unlikely(rc)) {
+		d->fa->ffree(d->fa, paddr, BALLOON_BLOCK_PAGES);
+		return rc;
+	}
+
+	d->blocks[d->nr_blocks++] = paddr;
+	return 0;
+}
+
+static int virtio_balloon_deflate(struct virtio_balloon_device *d)
+{
+	__paddr_t paddr;
+	int rc;
+
+	UK_ASSERT(d->nr_blocks > 0);
+	paddr = d->blocks[d->nr_blocks - 1];
+
+	/* The host must know before we touch the memory again */
+	rc = virtio_balloon_send_pfns(d, d->vq[VIRTIO_BALLOON_VQ_DEFLATE],
+				      paddr);
+	if (unlikely(rc))
+		return rc;
+
+	d->nr_blocks--;
+	d->fa->ffree(d->fa, paddr, BALLOON_BLOCK_PAGES);
+	return 0;
+}
+
+/* Resizes the balloon to the target size set by the host */
+static void virtio_balloon_resize(struct virtio_balloon_device *d)
+{
+	unsigned long target;
+	__u32 num_pages, actual;
+	__u16 offset;
+	int rc;
+
+	rc = virtio_config_get(d->vdev,
+			       __offsetof(struct virtio_balloon_config,
+					  num_pages),
+			       &num_pages, sizeof(num_pages), 1);
+	if (unlikely(rc))
+		return;
+
+	target = num_pages / BALLOON_BLOCK_PFNS;
+	if (target == d->nr_blocks)
+		return;
+
+	while (d->nr_blocks < target)
+		if (virtio_balloon_inflate(d))
+			break;
+
+	while (d->nr_blocks > target)
+		if (virtio_balloon_deflate(d))
+			break;
+
+	uk_pr_debug(DRIVER_NAME": Balloon has %lu of %lu blocks\n",
+		    d->nr_blocks, target);
+
+	actual = d->nr_blocks * BALLOON_BLOCK_PFNS;
+	offset = __offsetof(struct virtio_balloon_config, actual);
+	if (likely(d->vdev->cops->config_set))
+		d->vdev->cops->config_set(d->vdev, offset, &actual,
+					  sizeof(actual));
+}
+
+/* Reports free blocks that were not reported yet. Returns the number of bytes
+ * reported.
+ */
+static __sz virtio_balloon_report(struct virtio_balloon_device *d)
+{
+	unsigned long n, i;
+	__sz reported = 0;
+	int rc;
+
+	do {
+		n = uk_fallocbuddy_isolate_unreported(d->fa, REPORT_ORDER,
+						      d->report_paddrs,
+						      d->report_orders,
+						      REPORT_SEGS,
+						      REPORT_RESERVE);
+		if (!n)
+			break;
+
+		uk_sglist_reset(&d->sg);
+		for (i = 0; i < n; i++) {
+			d->sgsegs[i].ss_paddr = d->report_paddrs[i];
+			d->sgsegs[i].ss_len = 1UL << d->report_orders[i];
+		}
+		d->sg.sg_nseg = n;
+
+		rc = virtio_balloon_send(d, d->vq[VIRTIO_BALLOON_VQ_REPORTING],
+					 0, n);
+		if (unlikely(rc)) {
+			uk_pr_err(DRIVER_NAME": Failed to enqueue report: %d\n",
+				  rc);
+
+			for (i = 0; i < n; i++)
+				d->fa->ffree(d->fa, d->report_paddrs[i],
+					     1UL << (d->report_orders[i] -
+						     PAGE_SHIFT));
+			break;
+		}
+
+		uk_fallocbuddy_putback_reported(d->fa, d->report_paddrs,
+						d->report_orders, n);
+
+		for (i = 0; i < n; i++)
+			reported += 1UL << d->report_orders[i];
+	} while (n == REPORT_SEGS);
+
+	return reported;
+}
+
+static __noreturn void virtio_balloon_thread(void *arg)
+{
+	struct virtio_balloon_device *d = arg;
+	__sz reported;
+
+	for (;;) {
+		virtio_balloon_resize(d);
+
+		if (d->vq[VIRTIO_BALLOON_VQ_REPORTING]) {
+			reported = virtio_balloon_report(d);
+			if (reported)
+				uk_pr_debug(DRIVER_NAME": Reported %"__PRIsz
+					    " bytes\n", reported);
+		}
+
+		uk_sched_thread_sleep(ukarch_time_msec_to_nsec(
+			CONFIG_LIBVIRTIO_BALLOON_INTERVAL));
+	}
+}
+
+static void virtio_balloon_vq_release(struct virtio_balloon_device *d)
+{
+	int i;
+
+	for (i = 0; i < VIRTIO_BALLOON_VQ_MAX; i++)
+		if (d->vq[i] && !PTRISERR(d->vq[i]))
+			virtio_vqueue_release(d->vdev, d->vq[i], a);
+}
+
+static int virtio_balloon_vq_alloc(struct virtio_balloon_device *d,
+				   int vq_count)
+{
+	__u16 qdesc_size[VIRTIO_BALLOON_VQ_MAX];
+	int vq_avail, i;
+
+	UK_ASSERT(vq_count <= VIRTIO_BALLOON_VQ_MAX);
+
+	vq_avail = virtio_find_vqs(d->vdev, vq_count, qdesc_size);
+	if (unlikely(vq_avail != vq_count)) {
+		uk_pr_err(DRIVER_NAME": Expected: %d queues, found %d\n",
+			  vq_count, vq_avail);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < vq_count; i++) {
+		d->vq[i] = virtio_vqueue_setup(d->vdev, i, qdesc_size[i],
+					       virtio_balloon_recv, a);
+		if (unlikely(PTRISERR(d->vq[i]))) {
+			uk_pr_err(DRIVER_NAME": Failed to set up virtqueue %d\n",
+				  i);
+			return PTR2ERR(d->vq[i]);
+		}
+		d->vq[i]->priv = d;
+	}
+	return 0;
+}
+
+static int virtio_balloon_add_dev(struct virtio_dev *vdev)
+{
+	static struct virtio_balloon_device *balloon_dev;
+	struct virtio_balloon_device *d;
+	struct uk_thread *t;
+	__u64 host_features;
+	int vq_count, i;
+	int rc;
+
+	UK_ASSERT(vdev != NULL);
+
+	/* A second balloon would compete for the same memory */
+	if (balloon_dev) {
+		uk_pr_info(DRIVER_NAME": Ignoring additional device\n");
+		return 0;
+	}
+
+	d = uk_calloc(a, 1, sizeof(*d));
+	if (!d)
+		return -ENOMEM;
+	uk_sglist_init(&d->sg, ARRAY_SIZE(d->sgsegs), d->sgsegs);
+	uk_waitq_init(&d->wq);
+	d->fa = ukplat_pt_get_active()->fa;
+	d->vdev = vdev;
+
+	/* We always tell the host before reusing memory of the balloon */
+	host_features = virtio_feature_get(d->vdev);
+	d->vdev->features = 0;
+	if (VIRTIO_FEATURE_HAS(host_features, VIRTIO_BALLOON_F_MUST_TELL_HOST))
+		VIRTIO_FEATURE_SET(d->vdev->features,
+				   VIRTIO_BALLOON_F_MUST_TELL_HOST);
+	if (VIRTIO_FEATURE_HAS(host_features, VIRTIO_BALLOON_F_REPORTING))
+		VIRTIO_FEATURE_SET(d->vdev->features,
+				   VIRTIO_BALLOON_F_REPORTING);
+	if (VIRTIO_FEATURE_HAS(host_features, VIRTIO_F_VERSION_1))
+		VIRTIO_FEATURE_SET(d->vdev->features, VIRTIO_F_VERSION_1);
+	virtio_feature_set(d->vdev);
+
+	vq_count = VIRTIO_BALLOON_VQ_DEFLATE + 1;
+	if (VIRTIO_FEATURE_HAS(d->vdev->features, VIRTIO_BALLOON_F_REPORTING))
+		vq_count = VIRTIO_BALLOON_VQ_REPORTING + 1;
+
+	rc = virtio_balloon_vq_alloc(d, vq_count);
+	if (rc) {
+		uk_pr_err(DRIVER_NAME": Could not allocate virtqueues\n");
+		goto out_release_vq;
+	}
+
+	for (i = 0; i < vq_count; i++)
+		virtqueue_intr_enable(d->vq[i]);
+	virtio_dev_drv_up(d->vdev);
+
+	t = uk_sched_thread_create(uk_sched_current(), virtio_balloon_thread,
+				   d, DRIVER_NAME);
+	if (unlikely(!t || PTRISERR(t))) {
+		uk_pr_err(DRIVER_NAME": Failed to create balloon thread\n");
+		rc = -ENOMEM;
+		goto out_release_vq;
+	}
+	balloon_dev = d;
+
+	uk_pr_info(DRIVER_NAME": Registered balloon%s\n",
+		   d->vq[VIRTIO_BALLOON_VQ_REPORTING] ?
+		   " with free page reporting" : "");
+	return 0;
+
+out_release_vq:
+	virtio_balloon_vq_release(d);
+	virtio_dev_status_update(d->vdev, VIRTIO_CONFIG_STATUS_FAIL);
+	uk_free(a, d);
+	return rc;
+}
+
+static int virtio_balloon_drv_init(struct uk_alloc *drv_allocator)
+{
+	if (!drv_allocator)
+		return -EINVAL;
+
+	a = drv_allocator;
+	return 0;
+}
+
+static const struct virtio_dev_id vballoon_dev_id[] = {
+	{VIRTIO_ID_BALLOON},
+	{VIRTIO_ID_INVALID} /* List Terminator */
+};
+
+static struct virtio_driver vballoon_drv = {
+	.dev_ids = vballoon_dev_id,
+	.init    = virtio_balloon_drv_init,
+	.add_dev = virtio_balloon_add_dev
+};
+VIRTIO_BUS_REGISTER_DRIVER(&vballoon_drv);
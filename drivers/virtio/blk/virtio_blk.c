@@ -32,6 +32,7 @@
 #include <uk/sglist.h>
 #include <uk/blkdev_driver.h>
 #include <uk/plat/lcpu.h>
+#include <uk/trace.h>
 
 #define DRIVER_NAME		"virtio-blk"
 #define DEFAULT_SECTOR_SIZE	512
@@ -41,6 +42,13 @@
 #define	VTBLK_INTR_USR_EN	(1 << 1)
 #define	VTBLK_INTR_USR_EN_MASK	(2)
 
+UK_TRACEPOINT(trace_virtio_blk_intr, "queue=%u", unsigned int);
+UK_TRACEPOINT(trace_virtio_blk_submit, "queue=%u op=%d sector=%lu count=%lu",
+	      unsigned int, int, unsigned long, unsigned long);
+UK_TRACEPOINT(trace_virtio_blk_full, "queue=%u", unsigned int);
+UK_TRACEPOINT(trace_virtio_blk_complete, "queue=%u reqs=%u", unsigned int,
+	      unsigned int);
+
 #define to_virtioblkdev(bdev) \
 	__containerof(bdev, struct virtio_blk_device, blkdev)
 
@@ -50,7 +58,12 @@
  *	Multi-queue,
  *	Maximum size of a segment for requests,
  *	Maximum number of segments per request,
- *	Flush
+ *	Flush,
+ *	Discard,
+ *	Write zeroes,
+ *	Event index based notification suppression,
+ *	Packed virtqueue layout,
+ *	Indirect descriptors
  **/
 #define VIRTIO_BLK_DRV_FEATURES(features)				\
 	do {								\
@@ -61,7 +74,12 @@
 		VIRTIO_FEATURE_SET(features, VIRTIO_BLK_F_MQ);		\
 		VIRTIO_FEATURE_SET(features, VIRTIO_BLK_F_SIZE_MAX);	\
 		VIRTIO_FEATURE_SET(features, VIRTIO_BLK_F_FLUSH);	\
+		VIRTIO_FEATURE_SET(features, VIRTIO_BLK_F_DISCARD);	\
+		VIRTIO_FEATURE_SET(features, VIRTIO_BLK_F_WRITE_ZEROES);\
 		VIRTIO_FEATURE_SET(features, VIRTIO_F_VERSION_1);	\
+		VIRTIO_FEATURE_SET(features, VIRTIO_F_EVENT_IDX);	\
+		VIRTIO_FEATURE_SET(features, VIRTIO_F_RING_PACKED);	\
+		VIRTIO_FEATURE_SET(features, VIRTIO_F_INDIRECT_DESC);	\
 	} while (0)
 
 static struct uk_alloc *a;
@@ -118,6 +136,11 @@ struct uk_blkdev_queue {
 
 struct virtio_blkdev_request {
 	struct virtio_blk_outhdr virtio_blk_outhdr;
+	/* Range of discard and write zeroes requests. Placed right after the
+	 * header so that it is aligned to its size as well (see
+	 * virtio_blkdev_queue_enqueue()).
+	 */
+	struct virtio_blk_discard_write_zeroes dwz;
 	struct uk_blkreq *req;
 	struct uk_list_head free_list_head;
 	__u8 status;
@@ -128,12 +151,8 @@ static int virtio_blkdev_request_set_sglist(struct uk_blkdev_queue *queue,
 		__sector sector_size,
 		bool have_data)
 {
-	struct virtio_blk_device *vbdev;
 	struct uk_blkreq *req;
 	__sz data_size = 0;
-	__sz segment_size;
-	__sz segment_max_size;
-	__sz idx;
 	__uptr start_data;
 	int rc = 0;
 
@@ -141,10 +160,8 @@ static int virtio_blkdev_request_set_sglist(struct uk_blkdev_queue *queue,
 	UK_ASSERT(virtio_blk_req);
 
 	req = virtio_blk_req->req;
-	vbdev = queue->vbd;
 	start_data = (__uptr)req->aio_buf;
 	data_size = req->nb_sectors * sector_size;
-	segment_max_size = vbdev->max_size_segment;
 
 	/* Prepare the sglist */
 	uk_sglist_reset(&queue->sg);
@@ -155,23 +172,17 @@ static int virtio_blkdev_request_set_sglist(struct uk_blkdev_queue *queue,
 		goto out;
 	}
 
-	/* Append to sglist chunks of `segment_max_size` size
-	 * Only for read / write operations
-	 **/
-	if (have_data)
-		for (idx = 0; idx < data_size; idx += segment_max_size) {
-			segment_size = data_size - idx;
-			segment_size = (segment_size > segment_max_size) ?
-					segment_max_size : segment_size;
-			rc = uk_sglist_append(&queue->sg,
-					(void *)(start_data + idx),
-					segment_size);
-			if (unlikely(rc != 0)) {
-				uk_pr_err("Failed to append to sg list %d\n",
-						rc);
-				goto out;
-			}
+	/* Only for read / write operations. The sglist merges physically
+	 * contiguous pages and splits them at `max_size_segment`.
+	 */
+	if (have_data) {
+		rc = uk_sglist_append(&queue->sg, (void *)start_data,
+				      data_size);
+		if (unlikely(rc != 0)) {
+			uk_pr_err("Failed to append to sg list %d\n", rc);
+			goto out;
 		}
+	}
 
 	rc = uk_sglist_append(&queue->sg, &virtio_blk_req->status,
 			sizeof(__u8));
@@ -203,6 +214,13 @@ static int virtio_blkdev_request_write(struct uk_blkdev_queue *queue,
 			cap->mode == O_RDONLY))
 		return -EPERM;
 
+	if (unlikely(req->flags & ~UK_BLKREQ_F_FUA))
+		return -EINVAL;
+
+	if (unlikely((req->flags & UK_BLKREQ_F_FUA) &&
+			req->operation != UK_BLKREQ_WRITE))
+		return -EINVAL;
+
 	if (unlikely(req->aio_buf == NULL))
 		return -EINVAL;
 
@@ -269,6 +287,107 @@ out:
 	return rc;
 }
 
+static int virtio_blkdev_request_dwz(struct uk_blkdev_queue *queue,
+		struct virtio_blkdev_request *virtio_blk_req,
+		__u16 *read_segs, __u16 *write_segs)
+{
+	struct uk_blkdev_cap *cap;
+	struct uk_blkreq *req;
+	__sector max_sectors;
+	int rc = 0;
+
+	UK_ASSERT(queue);
+	UK_ASSERT(virtio_blk_req);
+
+	cap = &queue->vbd->blkdev.capabilities;
+	req = virtio_blk_req->req;
+	if (req->operation == UK_BLKREQ_DISCARD) {
+		if (unlikely(!(cap->features & UK_BLKDEV_CAP_DISCARD)))
+			return -ENOTSUP;
+		if (unlikely(req->flags))
+			return -EINVAL;
+		if (unlikely(req->start_sector % cap->discard_align))
+			return -EINVAL;
+		max_sectors = cap->max_discard_sectors;
+		virtio_blk_req->virtio_blk_outhdr.type = VIRTIO_BLK_T_DISCARD;
+	} else {
+		if (unlikely(!(cap->features & UK_BLKDEV_CAP_WRITE_ZEROES)))
+			return -ENOTSUP;
+		if (unlikely(req->flags & ~UK_BLKREQ_F_UNMAP))
+			return -EINVAL;
+		max_sectors = cap->max_write_zeroes_sectors;
+		virtio_blk_req->virtio_blk_outhdr.type =
+				VIRTIO_BLK_T_WRITE_ZEROES;
+	}
+
+	if (unlikely(cap->mode == O_RDONLY))
+		return -EPERM;
+
+	if (unlikely(req->nb_sectors == 0 || req->nb_sectors > max_sectors))
+		return -EINVAL;
+
+	if (unlikely(req->start_sector + req->nb_sectors > cap->sectors))
+		return -EINVAL;
+
+	/* The range replaces the data buffer and the header sector is
+	 * reserved for these requests
+	 */
+	virtio_blk_req->virtio_blk_outhdr.sector = 0;
+	virtio_blk_req->dwz.sector = req->start_sector;
+	virtio_blk_req->dwz.num_sectors = req->nb_sectors;
+	virtio_blk_req->dwz.flags = (req->flags & UK_BLKREQ_F_UNMAP) ?
+			VIRTIO_BLK_WRITE_ZEROES_FLAG_UNMAP : 0;
+
+	uk_sglist_reset(&queue->sg);
+	rc = uk_sglist_append(&queue->sg, &virtio_blk_req->virtio_blk_outhdr,
+			sizeof(struct virtio_blk_outhdr));
+	if (unlikely(rc != 0))
+		goto err;
+	rc = uk_sglist_append(&queue->sg, &virtio_blk_req->dwz,
+			sizeof(struct virtio_blk_discard_write_zeroes));
+	if (unlikely(rc != 0))
+		goto err;
+	rc = uk_sglist_append(&queue->sg, &virtio_blk_req->status,
+			sizeof(__u8));
+	if (unlikely(rc != 0))
+		goto err;
+
+	*read_segs = queue->sg.sg_nseg - 1;
+	*write_segs = 1;
+	return 0;
+
+err:
+	uk_pr_err("Failed to append to sg list %d\n", rc);
+	return rc;
+}
+
+/* Issue the flush that completes a FUA write. We cannot use the sglist of
+ * the queue here because this is called while processing responses.
+ */
+static int virtio_blkdev_request_fua_flush(struct uk_blkdev_queue *queue,
+		struct virtio_blkdev_request *virtio_blk_req)
+{
+	UK_SGLIST_DEFINE(sg, 2);
+	int rc;
+
+	rc = uk_sglist_append(&sg, &virtio_blk_req->virtio_blk_outhdr,
+			sizeof(struct virtio_blk_outhdr));
+	if (unlikely(rc != 0))
+		return rc;
+	rc = uk_sglist_append(&sg, &virtio_blk_req->status, sizeof(__u8));
+	if (unlikely(rc != 0))
+		return rc;
+
+	virtio_blk_req->virtio_blk_outhdr.type = VIRTIO_BLK_T_FLUSH;
+	virtio_blk_req->virtio_blk_outhdr.sector = 0;
+	rc = virtqueue_buffer_enqueue(queue->vq, virtio_blk_req, &sg, 1, 1);
+	if (unlikely(rc < 0))
+		return rc;
+
+	virtqueue_host_notify(queue->vq);
+	return 0;
+}
+
 static void virtio_blkdev_queue_cleanup_requests(struct uk_blkdev_queue *queue)
 {
 	struct virtio_blkdev_request *request, *request_tmp;
@@ -303,6 +422,7 @@ static int virtio_blkdev_queue_enqueue(struct uk_blkdev_queue *queue,
 
 	if (unlikely(virtqueue_is_full(queue->vq))) {
 		uk_pr_debug("The virtqueue is full\n");
+		trace_virtio_blk_full(queue->lqueue_id);
 		return -ENOSPC;
 	}
 
@@ -336,16 +456,30 @@ static int virtio_blkdev_queue_enqueue(struct uk_blkdev_queue *queue,
 	else if (req->operation == UK_BLKREQ_FFLUSH)
 		rc = virtio_blkdev_request_flush(queue, virtio_blk_req,
 				&read_segs, &write_segs);
+	else if (req->operation == UK_BLKREQ_DISCARD ||
+			req->operation == UK_BLKREQ_WRITE_ZEROES)
+		rc = virtio_blkdev_request_dwz(queue, virtio_blk_req,
+				&read_segs, &write_segs);
 	else
-		return -EINVAL;
+		rc = -EINVAL;
 
 	if (rc)
-		goto out;
+		goto err_free;
 
 	rc = virtqueue_buffer_enqueue(queue->vq, virtio_blk_req, &queue->sg,
 				      read_segs, write_segs);
+	if (unlikely(rc < 0)) {
+		if (rc == -ENOSPC)
+			trace_virtio_blk_full(queue->lqueue_id);
+		goto err_free;
+	}
 
-out:
+	trace_virtio_blk_submit(queue->lqueue_id, req->operation,
+				req->start_sector, req->nb_sectors);
+	return rc;
+
+err_free:
+	uk_free(a, virtio_blk_req);
 	return rc;
 }
 
@@ -387,16 +521,53 @@ err:
 	return rc;
 }
 
+static int virtio_blkdev_submit_burst(struct uk_blkdev *dev __unused,
+				      struct uk_blkdev_queue *queue,
+				      struct uk_blkreq *reqs[], __u16 cnt)
+{
+	__u16 i;
+	int rc = 0;
+
+	UK_ASSERT(queue);
+	UK_ASSERT(reqs || cnt == 0);
+
+	for (i = 0; i < cnt; i++) {
+		rc = virtio_blkdev_queue_enqueue(queue, reqs[i]);
+		if (unlikely(rc < 0)) {
+			if (rc != -ENOSPC)
+				uk_pr_err("Failed to enqueue descriptors into the ring: %d\n",
+					  rc);
+			break;
+		}
+		if (rc == 0) {
+			/* The ring is full after this request */
+			i++;
+			break;
+		}
+	}
+
+	if (i == 0)
+		return (rc == -ENOSPC) ? 0 : rc;
+
+	/**
+	 * Notify the host once for all new buffers.
+	 */
+	virtqueue_host_notify(queue->vq);
+	return (int) i;
+}
+
 static int virtio_blkdev_queue_dequeue(struct uk_blkdev_queue *queue,
 		struct uk_blkreq **req)
 {
 	int ret = 0;
+	int rc;
 	__u32 len;
 	struct virtio_blkdev_request *response_req;
 
 	UK_ASSERT(req);
 	*req = NULL;
 
+again:
 	ret = virtqueue_buffer_dequeue(queue->vq, (void **) &response_req,
 			&len);
 	if (ret < 0) {
@@ -414,6 +585,24 @@ static int virtio_blkdev_queue_dequeue(struct uk_blkdev_queue *queue,
 	*req = response_req->req;
 	(*req)->result = -response_req->status;
 
+	/* A FUA write is finished only after the written data was flushed
+	 * from the write cache of the device. Without a write cache, every
+	 * completed write is already on stable storage.
+	 */
+	if (((*req)->flags & UK_BLKREQ_F_FUA) &&
+	    response_req->virtio_blk_outhdr.type == VIRTIO_BLK_T_OUT &&
+	    response_req->status == VIRTIO_BLK_S_OK &&
+	    queue->vbd->writeback) {
+		rc = virtio_blkdev_request_fua_flush(queue, response_req);
+		if (likely(rc == 0)) {
+			*req = NULL;
+			goto again;
+		}
+
+		uk_pr_err("Failed to flush FUA write: %d\n", rc);
+		(*req)->result = rc;
+	}
+
 out:
 	uk_list_add(&response_req->free_list_head, &queue->free_list);
 	return ret;
@@ -423,6 +612,7 @@ static int virtio_blkdev_complete_reqs(struct uk_blkdev *dev __unused,
 				       struct uk_blkdev_queue *queue)
 {
 	struct uk_blkreq *req;
+	unsigned int cnt = 0;
 	int rc = 0;
 
 	/* Queue interrupts have to be off when calling receive */
@@ -442,6 +632,7 @@ moretodo:
 		uk_blkreq_finished(req);
 		if (req->cb)
 			req->cb(req, req->cb_cookie);
+		cnt++;
 	}
 
 	/* Enable interrupt only when user had previously enabled it */
@@ -451,7 +642,8 @@ moretodo:
 			goto moretodo;
 	}
 
-	return 0;
+	trace_virtio_blk_complete(queue->lqueue_id, cnt);
+	return cnt;
 
 err_exit:
 	return rc;
@@ -464,6 +656,7 @@ static int virtio_blkdev_recv_done(struct virtqueue *vq, void *priv)
 	UK_ASSERT(vq && priv);
 
 	queue = (struct uk_blkdev_queue *) priv;
+	trace_virtio_blk_intr(queue->lqueue_id);
 
 	/* Disable the interrupt for the ring */
 	virtqueue_intr_disable(vq);
@@ -579,6 +772,7 @@ static struct uk_blkdev_queue *virtio_blkdev_queue_setup(struct uk_blkdev *dev,
 
 	uk_sglist_init(&queue->sg, vbdev->max_segments,
 			queue->sgsegs);
+	uk_sglist_set_maxsegsz(&queue->sg, vbdev->max_size_segment);
 	queue->vbd = vbdev;
 	queue->nb_desc = nb_desc;
 	queue->lqueue_id = queue_id;
@@ -787,6 +981,9 @@ static int virtio_blkdev_feature_negotiate(struct virtio_blk_device *vbdev)
 	__u16 num_queues;
 	__u32 max_segments;
 	__u32 max_size_segment;
+	__u32 max_discard_sectors = 0;
+	__u32 discard_align = 1;
+	__u32 max_write_zeroes_sectors = 0;
 	int rc = 0;
 
 	UK_ASSERT(vbdev);
@@ -833,6 +1030,8 @@ static int virtio_blkdev_feature_negotiate(struct virtio_blk_device *vbdev)
 			uk_pr_err("Failed to read max-queues\n");
 			goto exit;
 		}
+		if (unlikely(num_queues == 0))
+			num_queues = 1;
 	} else
 		num_queues = 1;
 
@@ -866,6 +1065,46 @@ static int virtio_blkdev_feature_negotiate(struct virtio_blk_device *vbdev)
 	} else
 		max_size_segment = __PAGE_SIZE;
 
+	if (VIRTIO_FEATURE_HAS(host_features, VIRTIO_BLK_F_DISCARD)) {
+		rc = virtio_config_get(vbdev->vdev,
+			__offsetof(struct virtio_blk_config,
+				   max_discard_sectors),
+			&max_discard_sectors,
+			sizeof(max_discard_sectors),
+			1);
+		if (unlikely(rc)) {
+			uk_pr_err("Failed to get max discard sectors %d\n",
+					rc);
+			goto exit;
+		}
+		rc = virtio_config_get(vbdev->vdev,
+			__offsetof(struct virtio_blk_config,
+				   discard_sector_alignment),
+			&discard_align,
+			sizeof(discard_align),
+			1);
+		if (unlikely(rc)) {
+			uk_pr_err("Failed to get discard alignment %d\n", rc);
+			goto exit;
+		}
+		if (!discard_align)
+			discard_align = 1;
+	}
+
+	if (VIRTIO_FEATURE_HAS(host_features, VIRTIO_BLK_F_WRITE_ZEROES)) {
+		rc = virtio_config_get(vbdev->vdev,
+			__offsetof(struct virtio_blk_config,
+				   max_write_zeroes_sectors),
+			&max_write_zeroes_sectors,
+			sizeof(max_write_zeroes_sectors),
+			1);
+		if (unlikely(rc)) {
+			uk_pr_err("Failed to get max write zeroes sectors %d\n",
+					rc);
+			goto exit;
+		}
+	}
+
 	cap->ssize = ssize;
 	cap->sectors = sectors;
 	cap->ioalign = sizeof(void *);
@@ -874,6 +1113,20 @@ static int virtio_blkdev_feature_negotiate(struct virtio_blk_device *vbdev)
 	cap->max_sectors_per_req =
 			max_size_segment / ssize * (max_segments - 2);
 
+	/* FUA is emulated with a flush after the write if the device has a
+	 * write cache
+	 */
+	cap->features = UK_BLKDEV_CAP_FUA;
+	if (max_discard_sectors) {
+		cap->features |= UK_BLKDEV_CAP_DISCARD;
+		cap->max_discard_sectors = max_discard_sectors;
+		cap->discard_align = discard_align;
+	}
+	if (max_write_zeroes_sectors) {
+		cap->features |= UK_BLKDEV_CAP_WRITE_ZEROES;
+		cap->max_write_zeroes_sectors = max_write_zeroes_sectors;
+	}
+
 	vbdev->max_vqueue_pairs = num_queues;
 	vbdev->max_segments = max_segments;
 	vbdev->max_size_segment = max_size_segment;
@@ -929,6 +1182,7 @@ static int virtio_blk_add_dev(struct virtio_dev *vdev)
 	vbdev->vdev = vdev;
 	vbdev->blkdev.finish_reqs = virtio_blkdev_complete_reqs;
 	vbdev->blkdev.submit_one = virtio_blkdev_submit_request;
+	vbdev->blkdev.submit_burst = virtio_blkdev_submit_burst;
 	vbdev->blkdev.dev_ops = &virtio_blkdev_ops;
 
 	rc = uk_blkdev_drv_register(&vbdev->blkdev, a, drv_name);
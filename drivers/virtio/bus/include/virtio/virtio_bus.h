@@ -38,6 +38,7 @@
 #include <uk/errptr.h>
 #include <uk/arch/types.h>
 #include <uk/arch/lcpu.h>
+#include <uk/plat/lcpu.h>
 #include <uk/alloc.h>
 #include <uk/bus.h>
 #include <virtio/virtio_config.h>
@@ -64,6 +65,8 @@ extern "C" {
 struct virtio_dev;
 typedef int (*virtio_driver_init_func_t)(struct uk_alloc *);
 typedef int (*virtio_driver_add_func_t)(struct virtio_dev *);
+typedef int (*virtio_driver_suspend_func_t)(struct virtio_dev *);
+typedef int (*virtio_driver_resume_func_t)(struct virtio_dev *);
 
 enum virtio_dev_status {
 	/** Device reset */
@@ -114,6 +117,12 @@ struct virtio_config_ops {
 				      struct uk_alloc *a);
 	void (*vq_release)(struct virtio_dev *vdev, struct virtqueue *vq,
 				struct uk_alloc *a);
+	/** Route the interrupt of a virtqueue to a logical CPU (optional) */
+	int (*vq_set_affinity)(struct virtio_dev *vdev, struct virtqueue *vq,
+			       __lcpuidx lcpu);
+	/** Look up a shared memory region of the device (optional) */
+	int (*shm_get)(struct virtio_dev *vdev, __u8 shm_id,
+		       __paddr_t *paddr, __u64 *len);
 };
 
 /**
@@ -128,6 +137,10 @@ struct virtio_driver {
 	virtio_driver_init_func_t init;
 	/** Adding the virtio device */
 	virtio_driver_add_func_t add_dev;
+	/** Quiesce a device, e.g., before a VM snapshot (optional) */
+	virtio_driver_suspend_func_t suspend;
+	/** Resume a device after suspend or after a VM restore (optional) */
+	virtio_driver_resume_func_t resume;
 };
 
 /**
@@ -148,6 +161,8 @@ struct virtio_dev {
 	struct virtio_driver *vdrv;
 	/* Status of the device */
 	enum virtio_dev_status status;
+	/* Entry in the device list of the virtio bus */
+	UK_TAILQ_ENTRY(struct virtio_dev) next;
 };
 
 /**
@@ -343,6 +358,67 @@ static inline void virtio_vqueue_release(struct virtio_dev *vdev,
 		vdev->cops->vq_release(vdev, vq, a);
 }
 
+/**
+ * A helper function to route the interrupt of a virtqueue to a logical CPU.
+ * Only transports with a dedicated interrupt per virtqueue support this.
+ * @param vdev
+ *	Reference to the virtio device.
+ * @param vq
+ *	Reference to the virtqueue.
+ * @param lcpu
+ *	Index of the logical CPU that should handle the interrupts.
+ *
+ * @return int
+ *	0 on success,
+ *	-ENOTSUP if the transport cannot route the virtqueue's interrupt.
+ */
+static inline int virtio_vqueue_set_affinity(struct virtio_dev *vdev,
+					     struct virtqueue *vq,
+					     __lcpuidx lcpu)
+{
+	int rc = -ENOTSUP;
+
+	UK_ASSERT(vdev);
+	UK_ASSERT(vq);
+
+	if (vdev->cops->vq_set_affinity)
+		rc = vdev->cops->vq_set_affinity(vdev, vq, lcpu);
+
+	return rc;
+}
+
+/**
+ * A helper function to look up a shared memory region of the device. The
+ * region is device memory that the driver maps itself.
+ * @param vdev
+ *	Reference to the virtio device.
+ * @param shm_id
+ *	Device specific identifier of the region.
+ * @param paddr
+ *	Set to the physical base address of the region.
+ * @param len
+ *	Set to the length of the region in bytes.
+ *
+ * @return int
+ *	0 on success,
+ *	-ENOENT if the device does not have a region with that identifier,
+ *	-ENOTSUP if the transport does not support shared memory regions.
+ */
+static inline int virtio_shm_get(struct virtio_dev *vdev, __u8 shm_id,
+				 __paddr_t *paddr, __u64 *len)
+{
+	int rc = -ENOTSUP;
+
+	UK_ASSERT(vdev);
+	UK_ASSERT(paddr);
+	UK_ASSERT(len);
+
+	if (vdev->cops->shm_get)
+		rc = vdev->cops->shm_get(vdev, shm_id, paddr, len);
+
+	return rc;
+}
+
 static inline void virtio_dev_drv_up(struct virtio_dev *vdev)
 {
 	__u8 status = VIRTIO_CONFIG_STATUS_ACK |
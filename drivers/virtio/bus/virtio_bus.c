@@ -45,6 +45,9 @@ UK_TAILQ_HEAD(virtio_driver_list, struct virtio_driver);
  */
 static struct virtio_driver_list virtio_drvs =
 			UK_TAILQ_HEAD_INITIALIZER(virtio_drvs);
+UK_TAILQ_HEAD(virtio_dev_list, struct virtio_dev);
+static struct virtio_dev_list virtio_devs =
+			UK_TAILQ_HEAD_INITIALIZER(virtio_devs);
 static struct uk_alloc *a;
 
 /**
@@ -161,6 +164,7 @@ int virtio_bus_register_device(struct virtio_dev *vdev)
 		uk_pr_err("Failed to add the virtio device %p: %d\n", vdev, rc);
 		goto virtio_dev_fail_set;
 	}
+	UK_TAILQ_INSERT_TAIL(&virtio_devs, vdev, next);
 exit:
 	return rc;
 
@@ -181,6 +185,52 @@ static int virtio_bus_probe(void)
 	return 0;
 }
 
+/**
+ * Quiesce the devices whose driver supports it.
+ */
+static int virtio_bus_suspend(void)
+{
+	struct virtio_dev *vdev;
+	int rc, ret = 0;
+
+	UK_TAILQ_FOREACH(vdev, &virtio_devs, next) {
+		if (!vdev->vdrv->suspend)
+			continue;
+
+		rc = vdev->vdrv->suspend(vdev);
+		if (unlikely(rc)) {
+			uk_pr_err("Failed to suspend the virtio device %p: %d\n",
+				  vdev, rc);
+			if (!ret)
+				ret = rc;
+		}
+	}
+	return ret;
+}
+
+/**
+ * Resume the devices whose driver supports it.
+ */
+static int virtio_bus_resume(void)
+{
+	struct virtio_dev *vdev;
+	int rc, ret = 0;
+
+	UK_TAILQ_FOREACH(vdev, &virtio_devs, next) {
+		if (!vdev->vdrv->resume)
+			continue;
+
+		rc = vdev->vdrv->resume(vdev);
+		if (unlikely(rc)) {
+			uk_pr_err("Failed to resume the virtio device %p: %d\n",
+				  vdev, rc);
+			if (!ret)
+				ret = rc;
+		}
+	}
+	return ret;
+}
+
 /**
  * Initialize the virtio bus driver(s).
  * @param mem_alloc
@@ -223,5 +273,7 @@ void _virtio_bus_register_driver(struct virtio_driver *vdrv)
 static struct uk_bus virtio_bus = {
 	.init = virtio_bus_init,
 	.probe = virtio_bus_probe,
+	.suspend = virtio_bus_suspend,
+	.resume = virtio_bus_resume,
 };
 UK_BUS_REGISTER(&virtio_bus);
@@ -0,0 +1,60 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __VIRTIO_CONSOLE_H__
+#define __VIRTIO_CONSOLE_H__
+
+#include <uk/config.h>
+#include <uk/arch/types.h>
+
+#include <virtio/virtio_ids.h>
+#include <virtio/virtio_config.h>
+#include <virtio/virtio_types.h>
+
+/* Feature bitmap for virtio console. */
+#define VIRTIO_CONSOLE_F_SIZE		0
+#define VIRTIO_CONSOLE_F_MULTIPORT	1
+#define VIRTIO_CONSOLE_F_EMERG_WRITE	2
+
+/* Virtqueues of port 0 */
+#define VIRTIO_CONSOLE_RX_VQ		0
+#define VIRTIO_CONSOLE_TX_VQ		1
+/* Control virtqueues, only with VIRTIO_CONSOLE_F_MULTIPORT */
+#define VIRTIO_CONSOLE_CTRL_RX_VQ	2
+#define VIRTIO_CONSOLE_CTRL_TX_VQ	3
+
+/* Virtqueues of a port. Ports other than 0 follow the control queues. */
+#define VIRTIO_CONSOLE_PORT_RX_VQ(id)	((id) ? 2 * (id) + 2 : 0)
+#define VIRTIO_CONSOLE_PORT_TX_VQ(id)	(VIRTIO_CONSOLE_PORT_RX_VQ(id) + 1)
+
+/* Virtio console PCI configuration space layout. */
+struct virtio_console_config {
+	__u16 cols;
+	__u16 rows;
+	__u32 max_nr_ports;
+	__u32 emerg_wr;
+} __packed;
+
+/* Control message events */
+#define VIRTIO_CONSOLE_DEVICE_READY	0
+#define VIRTIO_CONSOLE_DEVICE_ADD	1
+#define VIRTIO_CONSOLE_DEVICE_REMOVE	2
+#define VIRTIO_CONSOLE_PORT_READY	3
+#define VIRTIO_CONSOLE_CONSOLE_PORT	4
+#define VIRTIO_CONSOLE_RESIZE		5
+#define VIRTIO_CONSOLE_PORT_OPEN	6
+#define VIRTIO_CONSOLE_PORT_NAME	7
+
+/* Control message, exchanged over the control virtqueues. The name of a
+ * port follows a VIRTIO_CONSOLE_PORT_NAME message.
+ */
+struct virtio_console_control {
+	__u32 id;
+	__u16 event;
+	__u16 value;
+} __packed;
+
+#endif /* __VIRTIO_CONSOLE_H__ */
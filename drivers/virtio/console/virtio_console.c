@@ -0,0 +1,610 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+/*
+ * Virtio console
+ *
+ * Only the transmit direction of the ports is used. Without
+ * VIRTIO_CONSOLE_F_MULTIPORT, the device has a single port. With it, the
+ * host announces its ports over the control queues, which a per-device
+ * thread serves. Ports are bound to their users as the host opens them:
+ * the console port carries stdout and stderr, the port named
+ * TRACE_PORT_NAME carries the trace stream. Writes are synchronous, they
+ * wait for the host to consume the buffer.
+ */
+#include <inttypes.h>
+#include <string.h>
+#include <uk/alloc.h>
+#include <uk/essentials.h>
+#include <uk/print.h>
+#include <uk/sched.h>
+#include <uk/sglist.h>
+#include <uk/wait.h>
+#include <virtio/virtio_bus.h>
+#include <virtio/virtio_console.h>
+#include <uk/plat/spinlock.h>
+#if CONFIG_LIBUKDEBUG_TRACE_STREAM
+#include <uk/trace.h>
+#endif /* CONFIG_LIBUKDEBUG_TRACE_STREAM */
+#if CONFIG_LIBVIRTIO_CONSOLE_STDIO
+#include <vfscore/stdio.h>
+#endif /* CONFIG_LIBVIRTIO_CONSOLE_STDIO */
+
+#define DRIVER_NAME	"virtio-console"
+/* Maximum number of segments of a single write */
+#define NUM_SEGMENTS	16
+#define MAX_WRITE	((NUM_SEGMENTS - 1) * __PAGE_SIZE)
+#define MAX_PORTS	CONFIG_LIBVIRTIO_CONSOLE_MAX_PORTS
+#define MAX_VQS		(2 * MAX_PORTS + 2)
+/* Receive buffers of the control queue */
+#define CTRL_RX_BUFS	8
+#define CTRL_NAME_MAX	64
+
+#define TRACE_PORT_NAME	"org.unikraft.trace"
+
+/* Without stdio support, the console port carries the trace stream, so
+ * that it works with devices that have a single port
+ */
+#if CONFIG_LIBVIRTIO_CONSOLE_STDIO
+#define TRACE_ON_CONSOLE	0
+#else /* !CONFIG_LIBVIRTIO_CONSOLE_STDIO */
+#define TRACE_ON_CONSOLE	1
+#endif /* !CONFIG_LIBVIRTIO_CONSOLE_STDIO */
+
+static struct uk_alloc *a;
+
+struct virtio_console_device;
+
+struct virtio_console_port {
+	struct virtio_console_device *dev;
+	__u32 id;
+	/* Transmit virtqueue of the port. */
+	struct virtqueue *txq;
+	/* Scatter-gather list. */
+	struct uk_sglist sg;
+	struct uk_sglist_seg sgsegs[NUM_SEGMENTS];
+	/* Set while the host has the port. */
+	int added;
+	/* Set while the host did not consume a write yet. */
+	int pending;
+	/* Waiting for the host to consume a write. */
+	struct uk_waitq wq;
+	/* Spinlock protecting the sg list and the vq. */
+	__spinlock spinlock;
+};
+
+struct virtio_console_ctrl_buf {
+	struct virtio_console_control msg;
+	char name[CTRL_NAME_MAX];
+};
+
+struct virtio_console_device {
+	/* Virtio device. */
+	struct virtio_dev *vdev;
+	/* Ports for which virtqueues are set up. */
+	__u32 nr_ports;
+	struct virtio_console_port *ports;
+	/* Control virtqueues, only with multiport. */
+	struct virtqueue *ctrl_rxq;
+	struct virtqueue *ctrl_txq;
+	struct virtio_console_ctrl_buf ctrl_rx[CTRL_RX_BUFS];
+	struct virtio_console_control ctrl_tx;
+	struct uk_sglist sg;
+	struct uk_sglist_seg sgsegs[2];
+	/* Set while the host did not consume a control message yet. */
+	int ctrl_pending;
+	/* Set when control messages arrived. */
+	int kick;
+	/* The control thread waits for kick and ctrl_pending. */
+	struct uk_waitq wq;
+	/* Spinlock protecting the sg list and the control vqs. */
+	__spinlock spinlock;
+};
+
+/* Ports that are bound to the stdio output and the trace stream */
+static struct virtio_console_port *stdio_port __maybe_unused;
+static struct virtio_console_port *trace_port __maybe_unused;
+
+static int virtio_console_xmit(struct virtio_console_port *p,
+			       const void *buf, __sz len)
+{
+	unsigned long flags;
+	int rc;
+
+	ukplat_spin_lock_irqsave(&p->spinlock, flags);
+	uk_sglist_reset(&p->sg);
+	rc = uk_sglist_append(&p->sg, (void *)buf, len);
+	if (unlikely(rc < 0)) {
+		uk_pr_err(DRIVER_NAME": Failed to append to the sg list\n");
+		goto out_unlock;
+	}
+
+	UK_WRITE_ONCE(p->pending, 1);
+	rc = virtqueue_buffer_enqueue(p->txq, p, &p->sg, p->sg.sg_nseg, 0);
+	if (unlikely(rc < 0)) {
+		UK_WRITE_ONCE(p->pending, 0);
+		goto out_unlock;
+	}
+	virtqueue_host_notify(p->txq);
+	rc = 0;
+
+out_unlock:
+	ukplat_spin_unlock_irqrestore(&p->spinlock, flags);
+	if (unlikely(rc))
+		return rc;
+
+	uk_waitq_wait_event(&p->wq, !UK_READ_ONCE(p->pending));
+	return 0;
+}
+
+/* Writes synchronously to a port. Used for the trace stream and stdio. */
+static int virtio_console_write(const void *buf, __sz len, void *arg)
+{
+	struct virtio_console_port *p = arg;
+	__sz count;
+	int rc;
+
+	while (len) {
+		if (unlikely(!UK_READ_ONCE(p->added)))
+			return -ENODEV;
+
+		count = MIN(len, MAX_WRITE);
+		rc = virtio_console_xmit(p, buf, count);
+		if (unlikely(rc))
+			return rc;
+		buf = (const char *)buf + count;
+		len -= count;
+	}
+	return 0;
+}
+
+static int virtio_console_recv(struct virtqueue *vq, void *priv)
+{
+	struct virtio_console_port *p = priv;
+	void *cookie;
+	__u32 len;
+	int rc, handled = 0;
+
+	UK_ASSERT(vq == p->txq);
+
+	for (;;) {
+		ukarch_spin_lock(&p->spinlock);
+		rc = virtqueue_buffer_dequeue(vq, &cookie, &len);
+		ukarch_spin_unlock(&p->spinlock);
+		if (rc < 0)
+			break;
+
+		UK_WRITE_ONCE(p->pending, 0);
+		handled = 1;
+		if (rc == 0)
+			break;
+	}
+
+	if (handled)
+		uk_waitq_wake_up(&p->wq);
+	return handled;
+}
+
+/* Connects a port that the host opened to its user. `name` is NULL for the
+ * console port.
+ */
+static void virtio_console_bind(struct virtio_console_port *p,
+				const char *name)
+{
+	int rc __maybe_unused;
+
+#if CONFIG_LIBUKDEBUG_TRACE_STREAM
+	if (!trace_port &&
+	    (name ? !strcmp(name, TRACE_PORT_NAME) : TRACE_ON_CONSOLE)) {
+		rc = uk_trace_stream_start(virtio_console_write, p);
+		if (unlikely(rc)) {
+			uk_pr_err(DRIVER_NAME": Failed to start trace stream: "
+				  "%d\n", rc);
+			return;
+		}
+		trace_port = p;
+		uk_pr_info(DRIVER_NAME": Started trace stream on port %"
+			   PRIu32"\n", p->id);
+		return;
+	}
+#endif /* CONFIG_LIBUKDEBUG_TRACE_STREAM */
+
+#if CONFIG_LIBVIRTIO_CONSOLE_STDIO
+	if (!stdio_port && !name) {
+		vfscore_stdio_output_set(virtio_console_write, p);
+		stdio_port = p;
+		uk_pr_info(DRIVER_NAME": Writing stdout and stderr to port %"
+			   PRIu32"\n", p->id);
+		return;
+	}
+#endif /* CONFIG_LIBVIRTIO_CONSOLE_STDIO */
+}
+
+static void virtio_console_ctrl_post(struct virtio_console_device *d,
+				     struct virtio_console_ctrl_buf *buf)
+{
+	unsigned long flags;
+	int rc;
+
+	ukplat_spin_lock_irqsave(&d->spinlock, flags);
+	uk_sglist_reset(&d->sg);
+	rc = uk_sglist_append(&d->sg, buf, sizeof(*buf));
+	if (likely(rc >= 0))
+		rc = virtqueue_buffer_enqueue(d->ctrl_rxq, buf, &d->sg,
+					      0, d->sg.sg_nseg);
+	if (likely(rc >= 0))
+		virtqueue_host_notify(d->ctrl_rxq);
+	ukplat_spin_unlock_irqrestore(&d->spinlock, flags);
+
+	if (unlikely(rc < 0))
+		uk_pr_err(DRIVER_NAME": Failed to post control buffer: %d\n",
+			  rc);
+}
+
+/* Sends a control message and waits until the host consumed it. Only
+ * called from the control thread.
+ */
+static int virtio_console_ctrl_send(struct virtio_console_device *d,
+				    __u32 id, __u16 event, __u16 value)
+{
+	unsigned long flags;
+	int rc;
+
+	ukplat_spin_lock_irqsave(&d->spinlock, flags);
+	d->ctrl_tx.id = id;
+	d->ctrl_tx.event = event;
+	d->ctrl_tx.value = value;
+	uk_sglist_reset(&d->sg);
+	rc = uk_sglist_append(&d->sg, &d->ctrl_tx, sizeof(d->ctrl_tx));
+	if (unlikely(rc < 0))
+		goto out_unlock;
+
+	UK_WRITE_ONCE(d->ctrl_pending, 1);
+	rc = virtqueue_buffer_enqueue(d->ctrl_txq, d, &d->sg,
+				      d->sg.sg_nseg, 0);
+	if (unlikely(rc < 0)) {
+		UK_WRITE_ONCE(d->ctrl_pending, 0);
+		goto out_unlock;
+	}
+	virtqueue_host_notify(d->ctrl_txq);
+	rc = 0;
+
+out_unlock:
+	ukplat_spin_unlock_irqrestore(&d->spinlock, flags);
+	if (unlikely(rc)) {
+		uk_pr_err(DRIVER_NAME": Failed to send control message: %d\n",
+			  rc);
+		return rc;
+	}
+
+	uk_waitq_wait_event(&d->wq, !UK_READ_ONCE(d->ctrl_pending));
+	return 0;
+}
+
+static void virtio_console_ctrl_msg(struct virtio_console_device *d,
+				    struct virtio_console_ctrl_buf *buf,
+				    __u32 len)
+{
+	struct virtio_console_control *msg = &buf->msg;
+	struct virtio_console_port *p;
+	__sz name_len;
+
+	/* We did not set up virtqueues for ports beyond nr_ports */
+	if (unlikely(msg->id >= d->nr_ports)) {
+		if (msg->event == VIRTIO_CONSOLE_DEVICE_ADD) {
+			uk_pr_warn(DRIVER_NAME": Ignoring port %"PRIu32"\n",
+				   msg->id);
+			virtio_console_ctrl_send(d, msg->id,
+						 VIRTIO_CONSOLE_PORT_READY, 0);
+		}
+		return;
+	}
+
+	p = &d->ports[msg->id];
+	switch (msg->event) {
+	case VIRTIO_CONSOLE_DEVICE_ADD:
+		UK_WRITE_ONCE(p->added, 1);
+		virtio_console_ctrl_send(d, p->id,
+					 VIRTIO_CONSOLE_PORT_READY, 1);
+		break;
+	case VIRTIO_CONSOLE_DEVICE_REMOVE:
+		/* Writes to the port fail from now on */
+		UK_WRITE_ONCE(p->added, 0);
+		uk_pr_warn(DRIVER_NAME": Port %"PRIu32" removed\n", p->id);
+		break;
+	case VIRTIO_CONSOLE_CONSOLE_PORT:
+		virtio_console_ctrl_send(d, p->id,
+					 VIRTIO_CONSOLE_PORT_OPEN, 1);
+		virtio_console_bind(p, __NULL);
+		break;
+	case VIRTIO_CONSOLE_PORT_NAME:
+		name_len = MIN(len - sizeof(*msg), sizeof(buf->name) - 1);
+		buf->name[name_len] = '\0';
+		if (strcmp(buf->name, TRACE_PORT_NAME))
+			break;
+
+		virtio_console_ctrl_send(d, p->id,
+					 VIRTIO_CONSOLE_PORT_OPEN, 1);
+		virtio_console_bind(p, buf->name);
+		break;
+	default:
+		/* Resizes and the host opening or closing a port do not
+		 * concern the transmit direction
+		 */
+		break;
+	}
+}
+
+static void virtio_console_ctrl_process(struct virtio_console_device *d)
+{
+	struct virtio_console_ctrl_buf *buf;
+	unsigned long flags;
+	__u32 len;
+	int rc;
+
+	for (;;) {
+		ukplat_spin_lock_irqsave(&d->spinlock, flags);
+		rc = virtqueue_buffer_dequeue(d->ctrl_rxq, (void **)&buf,
+					      &len);
+		ukplat_spin_unlock_irqrestore(&d->spinlock, flags);
+		if (rc < 0)
+			break;
+
+		if (likely(len >= sizeof(buf->msg)))
+			virtio_console_ctrl_msg(d, buf, len);
+		else
+			uk_pr_warn(DRIVER_NAME": Dropping malformed control "
+				   "message\n");
+		virtio_console_ctrl_post(d, buf);
+	}
+}
+
+static int virtio_console_ctrl_rx_intr(struct virtqueue *vq, void *priv)
+{
+	struct virtio_console_device *d = priv;
+
+	virtqueue_intr_disable(vq);
+	UK_WRITE_ONCE(d->kick, 1);
+	uk_waitq_wake_up(&d->wq);
+	return 1;
+}
+
+static int virtio_console_ctrl_tx_intr(struct virtqueue *vq, void *priv)
+{
+	struct virtio_console_device *d = priv;
+	void *cookie;
+	__u32 len;
+	int handled = 0;
+
+	ukarch_spin_lock(&d->spinlock);
+	while (virtqueue_buffer_dequeue(vq, &cookie, &len) >= 0)
+		handled = 1;
+	ukarch_spin_unlock(&d->spinlock);
+
+	if (handled) {
+		UK_WRITE_ONCE(d->ctrl_pending, 0);
+		uk_waitq_wake_up(&d->wq);
+	}
+	return handled;
+}
+
+static __noreturn void virtio_console_ctrl_thread(void *arg)
+{
+	struct virtio_console_device *d = arg;
+
+	/* The host announces its ports in response */
+	virtio_console_ctrl_send(d, 0, VIRTIO_CONSOLE_DEVICE_READY, 1);
+
+	for (;;) {
+		uk_waitq_wait_event(&d->wq, UK_READ_ONCE(d->kick));
+		UK_WRITE_ONCE(d->kick, 0);
+
+		virtio_console_ctrl_process(d);
+		if (virtqueue_intr_enable(d->ctrl_rxq))
+			UK_WRITE_ONCE(d->kick, 1);
+	}
+}
+
+static void virtio_console_vq_release(struct virtio_console_device *d)
+{
+	__u32 i;
+
+	for (i = 0; i < d->nr_ports; i++)
+		if (d->ports[i].txq && !PTRISERR(d->ports[i].txq))
+			virtio_vqueue_release(d->vdev, d->ports[i].txq, a);
+	if (d->ctrl_rxq && !PTRISERR(d->ctrl_rxq))
+		virtio_vqueue_release(d->vdev, d->ctrl_rxq, a);
+	if (d->ctrl_txq && !PTRISERR(d->ctrl_txq))
+		virtio_vqueue_release(d->vdev, d->ctrl_txq, a);
+}
+
+static struct virtqueue *
+virtio_console_vq_setup(struct virtio_console_device *d, __u16 idx,
+			__u16 size, virtqueue_callback_t cb, void *priv)
+{
+	struct virtqueue *vq;
+
+	if (unlikely(size < NUM_SEGMENTS)) {
+		uk_pr_err(DRIVER_NAME": Virtqueue %"PRIu16" too small: %"
+			  PRIu16"\n", idx, size);
+		return ERR2PTR(-ENOSPC);
+	}
+
+	vq = virtio_vqueue_setup(d->vdev, idx, size, cb, a);
+	if (unlikely(PTRISERR(vq))) {
+		uk_pr_err(DRIVER_NAME": Failed to set up virtqueue %"PRIu16"\n",
+			  idx);
+		return vq;
+	}
+	vq->priv = priv;
+	return vq;
+}
+
+static int virtio_console_vq_alloc(struct virtio_console_device *d,
+				   int multiport)
+{
+	__u16 qdesc_size[MAX_VQS];
+	struct virtio_console_port *p;
+	int vq_count, vq_avail;
+	__u16 idx;
+	__u32 i;
+
+	/* The receive queues of the ports exist, but are not used */
+	vq_count = multiport ? 2 * (int)d->nr_ports + 2 : 2;
+	vq_avail = virtio_find_vqs(d->vdev, vq_count, qdesc_size);
+	if (unlikely(vq_avail != vq_count)) {
+		uk_pr_err(DRIVER_NAME": Expected: %d queues, found %d\n",
+			  vq_count, vq_avail);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < d->nr_ports; i++) {
+		p = &d->ports[i];
+		idx = VIRTIO_CONSOLE_PORT_TX_VQ(i);
+		p->txq = virtio_console_vq_setup(d, idx, qdesc_size[idx],
+						 virtio_console_recv, p);
+		if (unlikely(PTRISERR(p->txq)))
+			return PTR2ERR(p->txq);
+	}
+
+	if (!multiport)
+		return 0;
+
+	d->ctrl_rxq = virtio_console_vq_setup(d, VIRTIO_CONSOLE_CTRL_RX_VQ,
+				qdesc_size[VIRTIO_CONSOLE_CTRL_RX_VQ],
+				virtio_console_ctrl_rx_intr, d);
+	if (unlikely(PTRISERR(d->ctrl_rxq)))
+		return PTR2ERR(d->ctrl_rxq);
+
+	d->ctrl_txq = virtio_console_vq_setup(d, VIRTIO_CONSOLE_CTRL_TX_VQ,
+				qdesc_size[VIRTIO_CONSOLE_CTRL_TX_VQ],
+				virtio_console_ctrl_tx_intr, d);
+	if (unlikely(PTRISERR(d->ctrl_txq)))
+		return PTR2ERR(d->ctrl_txq);
+	return 0;
+}
+
+static int virtio_console_add_dev(struct virtio_dev *vdev)
+{
+	struct virtio_console_device *d;
+	struct uk_thread *t;
+	__u64 host_features;
+	__u32 max_nr_ports = 1;
+	int multiport;
+	__u32 i;
+	int rc;
+
+	UK_ASSERT(vdev != NULL);
+
+	d = uk_calloc(a, 1, sizeof(*d));
+	if (!d)
+		return -ENOMEM;
+	ukarch_spin_init(&d->spinlock);
+	uk_waitq_init(&d->wq);
+	uk_sglist_init(&d->sg, ARRAY_SIZE(d->sgsegs), d->sgsegs);
+	d->vdev = vdev;
+
+	host_features = virtio_feature_get(d->vdev);
+	d->vdev->features = 0;
+	if (VIRTIO_FEATURE_HAS(host_features, VIRTIO_CONSOLE_F_MULTIPORT))
+		VIRTIO_FEATURE_SET(d->vdev->features,
+				   VIRTIO_CONSOLE_F_MULTIPORT);
+	if (VIRTIO_FEATURE_HAS(host_features, VIRTIO_F_VERSION_1))
+		VIRTIO_FEATURE_SET(d->vdev->features, VIRTIO_F_VERSION_1);
+	virtio_feature_set(d->vdev);
+	multiport = VIRTIO_FEATURE_HAS(d->vdev->features,
+				       VIRTIO_CONSOLE_F_MULTIPORT);
+
+	if (multiport) {
+		rc = virtio_config_get(d->vdev,
+				       __offsetof(struct virtio_console_config,
+						  max_nr_ports),
+				       &max_nr_ports, sizeof(max_nr_ports), 1);
+		if (unlikely(rc || !max_nr_ports)) {
+			uk_pr_err(DRIVER_NAME": Failed to read number of "
+				  "ports\n");
+			rc = -EINVAL;
+			goto out_status_fail;
+		}
+	}
+	d->nr_ports = MIN(max_nr_ports, (__u32)MAX_PORTS);
+
+	d->ports = uk_calloc(a, d->nr_ports, sizeof(*d->ports));
+	if (unlikely(!d->ports)) {
+		rc = -ENOMEM;
+		goto out_status_fail;
+	}
+	for (i = 0; i < d->nr_ports; i++) {
+		d->ports[i].dev = d;
+		d->ports[i].id = i;
+		ukarch_spin_init(&d->ports[i].spinlock);
+		uk_waitq_init(&d->ports[i].wq);
+		uk_sglist_init(&d->ports[i].sg, NUM_SEGMENTS,
+			       d->ports[i].sgsegs);
+	}
+
+	rc = virtio_console_vq_alloc(d, multiport);
+	if (rc) {
+		uk_pr_err(DRIVER_NAME": Could not allocate virtqueues\n");
+		goto out_release_vq;
+	}
+
+	for (i = 0; i < d->nr_ports; i++)
+		virtqueue_intr_enable(d->ports[i].txq);
+
+	if (!multiport) {
+		virtio_dev_drv_up(d->vdev);
+		d->ports[0].added = 1;
+		virtio_console_bind(&d->ports[0], __NULL);
+		return 0;
+	}
+
+	for (i = 0; i < CTRL_RX_BUFS; i++)
+		virtio_console_ctrl_post(d, &d->ctrl_rx[i]);
+	virtqueue_intr_enable(d->ctrl_rxq);
+	virtqueue_intr_enable(d->ctrl_txq);
+
+	t = uk_sched_thread_create(uk_sched_current(),
+				   virtio_console_ctrl_thread, d, DRIVER_NAME);
+	if (unlikely(!t || PTRISERR(t))) {
+		uk_pr_err(DRIVER_NAME": Failed to create control thread\n");
+		rc = -ENOMEM;
+		goto out_release_vq;
+	}
+	virtio_dev_drv_up(d->vdev);
+
+	uk_pr_info(DRIVER_NAME": Registered with %"PRIu32" of %"PRIu32
+		   " ports\n", d->nr_ports, max_nr_ports);
+	return 0;
+
+out_release_vq:
+	virtio_console_vq_release(d);
+	uk_free(a, d->ports);
+out_status_fail:
+	virtio_dev_status_update(d->vdev, VIRTIO_CONFIG_STATUS_FAIL);
+	uk_free(a, d);
+	return rc;
+}
+
+static int virtio_console_drv_init(struct uk_alloc *drv_allocator)
+{
+	if (!drv_allocator)
+		return -EINVAL;
+
+	a = drv_allocator;
+	return 0;
+}
+
+static const struct virtio_dev_id vcon_dev_id[] = {
+	{VIRTIO_ID_CONSOLE},
+	{VIRTIO_ID_INVALID} /* List Terminator */
+};
+
+static struct virtio_driver vcon_drv = {
+	.dev_ids = vcon_dev_id,
+	.init    = virtio_console_drv_init,
+	.add_dev = virtio_console_add_dev
+};
+VIRTIO_BUS_REGISTER_DRIVER(&vcon_drv);
@@ -0,0 +1,85 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * Transport of virtio-fs devices. Requests are FUSE messages: a buffer that
+ * the device reads, followed by a buffer that it writes the reply to. The
+ * device does not interpret them, this is left to the filesystem.
+ */
+
+#ifndef __UK_VIRTIO_FS_H__
+#define __UK_VIRTIO_FS_H__
+
+#include <sys/uio.h>
+#include <uk/arch/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+struct uk_virtio_fs_dev {
+	/* Mount tag of the device */
+	const char *tag;
+	/* Largest number of bytes that a request and its reply may span */
+	__sz max_msg;
+	/* DAX window mapped into the address space, NULL if the device has
+	 * none or it could not be mapped
+	 */
+	void *dax_base;
+	__sz dax_len;
+};
+
+/**
+ * Claims the device with the given mount tag for exclusive use
+ *
+ * @param tag
+ *   Mount tag of the device
+ * @return
+ *   The device, or an error pointer: -ENOENT if there is no such device,
+ *   -EBUSY if the device is already in use
+ */
+struct uk_virtio_fs_dev *uk_virtio_fs_get(const char *tag);
+
+/**
+ * Releases a device claimed with uk_virtio_fs_get()
+ */
+void uk_virtio_fs_put(struct uk_virtio_fs_dev *dev);
+
+/**
+ * Sends a request and waits for the reply. Blocks while the queue is full.
+ *
+ * @param dev
+ *   The device
+ * @param iov
+ *   Buffers that the device reads, followed by buffers it writes to
+ * @param out_cnt
+ *   Number of buffers that the device reads
+ * @param in_cnt
+ *   Number of buffers that the device writes to
+ * @param len
+ *   Set to the number of bytes that the device wrote
+ * @return
+ *   0 on success, or a negative error code if the request could not be sent
+ */
+int uk_virtio_fs_request(struct uk_virtio_fs_dev *dev,
+			 const struct iovec *iov, unsigned int out_cnt,
+			 unsigned int in_cnt, __sz *len);
+
+/**
+ * Sends a request without a reply on the high priority queue (e.g.,
+ * FUSE_FORGET) and waits until the device consumed it
+ *
+ * @return
+ *   0 on success, or a negative error code if the request could not be sent
+ */
+int uk_virtio_fs_request_hiprio(struct uk_virtio_fs_dev *dev,
+				const struct iovec *iov, unsigned int cnt);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __UK_VIRTIO_FS_H__ */
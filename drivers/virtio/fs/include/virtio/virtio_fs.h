@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __VIRTIO_FS_H__
+#define __VIRTIO_FS_H__
+
+#include <uk/config.h>
+#include <uk/arch/types.h>
+
+#include <virtio/virtio_ids.h>
+#include <virtio/virtio_config.h>
+#include <virtio/virtio_types.h>
+
+/* Feature bitmap for virtio fs. */
+#define VIRTIO_FS_F_NOTIFICATION	0
+
+#define VIRTIO_FS_HIPRIO_VQ		0
+/* Followed by the notification queue if VIRTIO_FS_F_NOTIFICATION was
+ * negotiated, then by the request queues.
+ */
+
+#define VIRTIO_FS_TAG_LEN		36
+
+/* Virtio fs configuration space layout. */
+struct virtio_fs_config {
+	/* Mount tag, not NUL-terminated if it has the full length */
+	char tag[VIRTIO_FS_TAG_LEN];
+	__u32 num_request_queues;
+	__u32 notify_buf_size;
+} __packed;
+
+/* Shared memory region of the DAX window */
+#define VIRTIO_FS_SHMCAP_ID_CACHE	0
+
+#endif /* __VIRTIO_FS_H__ */
@@ -0,0 +1,438 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+/*
+ * Virtio fs
+ *
+ * Requests are synchronous: the sender enqueues its buffers and sleeps until
+ * the interrupt handler returns them. Only the first request queue is used;
+ * the high priority queue carries requests without a reply.
+ *
+ * If the device has a DAX window, it is mapped into the address space once.
+ * The filesystem asks the host to map file ranges into it and then accesses
+ * file contents with plain loads and stores.
+ */
+#include <string.h>
+#include <uk/alloc.h>
+#include <uk/arch/limits.h>
+#include <uk/essentials.h>
+#include <uk/list.h>
+#include <uk/print.h>
+#include <uk/sglist.h>
+#include <uk/virtio_fs.h>
+#include <uk/wait.h>
+#include <uk/plat/spinlock.h>
+#include <virtio/virtio_bus.h>
+#include <virtio/virtio_fs.h>
+#if CONFIG_LIBVIRTIO_FS_DAX
+#include <uk/arch/paging.h>
+#include <uk/vma_types.h>
+#endif /* CONFIG_LIBVIRTIO_FS_DAX */
+
+#define DRIVER_NAME	"virtio-fs"
+
+/* Upper bound for the size of a request and its reply */
+#define VIRTIO_FS_MSG_MAX	(1UL << 20)
+/*
+ * Segments needed besides the payload pages: headers of a request and its
+ * reply that may each cross a page boundary, and a payload that is not
+ * page-aligned.
+ */
+#define EXTRA_SEGMENTS		6
+
+#define VIRTIO_FS_VQ_MAX	2
+
+static struct uk_alloc *a;
+
+/* List of initialized virtio fs devices. */
+static UK_LIST_HEAD(virtio_fs_device_list);
+static __spinlock virtio_fs_device_list_lock;
+
+struct virtio_fs_device {
+	/* Part shared with the filesystem */
+	struct uk_virtio_fs_dev fsdev;
+	/* Virtio device. */
+	struct virtio_dev *vdev;
+	/* Entry within the virtio devices' list. */
+	struct uk_list_head _list;
+	/* High priority queue and first request queue */
+	struct virtqueue *vq[VIRTIO_FS_VQ_MAX];
+	/* Set while the device is claimed by a filesystem */
+	int busy;
+	char tag[VIRTIO_FS_TAG_LEN + 1];
+	/* Scatter-gather list. */
+	struct uk_sglist sg;
+	struct uk_sglist_seg *sgsegs;
+	/* Maximum number of segments of a single request. */
+	__u32 max_segs;
+	/* Spinlock protecting the sg list and the vqs. */
+	__spinlock spinlock;
+	/* Senders waiting for their reply or for queue space */
+	struct uk_waitq wq;
+};
+
+#define to_virtio_fs_device(dev) \
+	__containerof(dev, struct virtio_fs_device, fsdev)
+
+/* Cookie of an enqueued request, lives on the stack of its sender */
+struct virtio_fs_req {
+	int done;
+	__u32 len;
+};
+
+struct uk_virtio_fs_dev *uk_virtio_fs_get(const char *tag)
+{
+	struct virtio_fs_device *d;
+	int rc = -ENOENT;
+
+	UK_ASSERT(tag);
+
+	ukarch_spin_lock(&virtio_fs_device_list_lock);
+	uk_list_for_each_entry(d, &virtio_fs_device_list, _list) {
+		if (strcmp(d->tag, tag))
+			continue;
+		if (d->busy) {
+			rc = -EBUSY;
+			break;
+		}
+		d->busy = 1;
+		ukarch_spin_unlock(&virtio_fs_device_list_lock);
+		return &d->fsdev;
+	}
+	ukarch_spin_unlock(&virtio_fs_device_list_lock);
+	return ERR2PTR(rc);
+}
+
+void uk_virtio_fs_put(struct uk_virtio_fs_dev *dev)
+{
+	struct virtio_fs_device *d = to_virtio_fs_device(dev);
+
+	ukarch_spin_lock(&virtio_fs_device_list_lock);
+	d->busy = 0;
+	ukarch_spin_unlock(&virtio_fs_device_list_lock);
+}
+
+static int virtio_fs_sg_fill(struct virtio_fs_device *d,
+			     const struct iovec *iov, unsigned int cnt)
+{
+	unsigned int i;
+	int rc;
+
+	for (i = 0; i < cnt; i++) {
+		if (!iov[i].iov_len)
+			continue;
+		rc = uk_sglist_append(&d->sg, iov[i].iov_base, iov[i].iov_len);
+		if (unlikely(rc < 0))
+			return rc;
+	}
+	return 0;
+}
+
+static int virtio_fs_enqueue(struct virtio_fs_device *d, struct virtqueue *vq,
+			     struct virtio_fs_req *req,
+			     const struct iovec *iov, unsigned int out_cnt,
+			     unsigned int in_cnt)
+{
+	unsigned long flags;
+	__sz read_segs;
+	int rc;
+
+	ukplat_spin_lock_irqsave(&d->spinlock, flags);
+	uk_sglist_reset(&d->sg);
+
+	rc = virtio_fs_sg_fill(d, iov, out_cnt);
+	if (unlikely(rc < 0))
+		goto out_err;
+	read_segs = d->sg.sg_nseg;
+	rc = virtio_fs_sg_fill(d, iov + out_cnt, in_cnt);
+	if (unlikely(rc < 0))
+		goto out_err;
+
+	rc = virtqueue_buffer_enqueue(vq, req, &d->sg, read_segs,
+				      d->sg.sg_nseg - read_segs);
+	if (likely(rc >= 0)) {
+		virtqueue_host_notify(vq);
+		rc = 0;
+	}
+	ukplat_spin_unlock_irqrestore(&d->spinlock, flags);
+	return rc;
+
+out_err:
+	ukplat_spin_unlock_irqrestore(&d->spinlock, flags);
+	uk_pr_err(DRIVER_NAME": Failed to append to the sg list: %d\n", rc);
+	return rc;
+}
+
+static int virtio_fs_submit(struct virtio_fs_device *d, struct virtqueue *vq,
+			    const struct iovec *iov, unsigned int out_cnt,
+			    unsigned int in_cnt, __sz *len)
+{
+	struct virtio_fs_req req = { .done = 0, .len = 0 };
+	int rc;
+
+	/* Every returned buffer wakes the waiters, so that senders blocked on
+	 * a full queue retry.
+	 */
+	for (;;) {
+		rc = virtio_fs_enqueue(d, vq, &req, iov, out_cnt, in_cnt);
+		if (rc != -ENOSPC)
+			break;
+		uk_waitq_wait_event(&d->wq, !virtqueue_is_full(vq));
+	}
+	if (unlikely(rc))
+		return rc;
+
+	uk_waitq_wait_event(&d->wq, UK_READ_ONCE(req.done));
+	if (len)
+		*len = req.len;
+	return 0;
+}
+
+int uk_virtio_fs_request(struct uk_virtio_fs_dev *dev,
+			 const struct iovec *iov, unsigned int out_cnt,
+			 unsigned int in_cnt, __sz *len)
+{
+	struct virtio_fs_device *d = to_virtio_fs_device(dev);
+
+	UK_ASSERT(iov);
+	UK_ASSERT(len);
+
+	return virtio_fs_submit(d, d->vq[1], iov, out_cnt, in_cnt, len);
+}
+
+int uk_virtio_fs_request_hiprio(struct uk_virtio_fs_dev *dev,
+				const struct iovec *iov, unsigned int cnt)
+{
+	struct virtio_fs_device *d = to_virtio_fs_device(dev);
+
+	UK_ASSERT(iov);
+
+	return virtio_fs_submit(d, d->vq[VIRTIO_FS_HIPRIO_VQ], iov, cnt, 0,
+				NULL);
+}
+
+static int virtio_fs_recv(struct virtqueue *vq, void *priv)
+{
+	struct virtio_fs_device *d = priv;
+	struct virtio_fs_req *req;
+	int handled = 0;
+	__u32 len;
+	int rc;
+
+	for (;;) {
+		/*
+		 * Protect against data races with senders which are trying to
+		 * enqueue to the same vq.
+		 */
+		ukarch_spin_lock(&d->spinlock);
+		rc = virtqueue_buffer_dequeue(vq, (void **)&req, &len);
+		ukarch_spin_unlock(&d->spinlock);
+		if (rc < 0)
+			break;
+
+		req->len = len;
+		UK_WRITE_ONCE(req->done, 1);
+		handled = 1;
+
+		/* Break if there are no more buffers on the virtqueue. */
+		if (rc == 0)
+			break;
+	}
+
+	if (handled)
+		uk_waitq_wake_up(&d->wq);
+	return handled;
+}
+
+static void virtio_fs_vq_release(struct virtio_fs_device *d)
+{
+	int i;
+
+	for (i = 0; i < VIRTIO_FS_VQ_MAX; i++)
+		if (d->vq[i] && !PTRISERR(d->vq[i]))
+			virtio_vqueue_release(d->vdev, d->vq[i], a);
+}
+
+static int virtio_fs_vq_alloc(struct virtio_fs_device *d)
+{
+	__u16 qdesc_size[VIRTIO_FS_VQ_MAX];
+	int vq_avail, i;
+
+	vq_avail = virtio_find_vqs(d->vdev, VIRTIO_FS_VQ_MAX, qdesc_size);
+	if (unlikely(vq_avail != VIRTIO_FS_VQ_MAX)) {
+		uk_pr_err(DRIVER_NAME": Expected: %d queues, found %d\n",
+			  VIRTIO_FS_VQ_MAX, vq_avail);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < VIRTIO_FS_VQ_MAX; i++) {
+		d->vq[i] = virtio_vqueue_setup(d->vdev, i, qdesc_size[i],
+					       virtio_fs_recv, a);
+		if (unlikely(PTRISERR(d->vq[i]))) {
+			uk_pr_err(DRIVER_NAME": Failed to set up queue %d\n",
+				  i);
+			return PTR2ERR(d->vq[i]);
+		}
+		d->vq[i]->priv = d;
+	}
+
+	/*
+	 * A request is either put directly into the ring or, if it has more
+	 * segments and the device supports it, into an indirect table.
+	 */
+	d->max_segs = virtqueue_vring_get_num(d->vq[1]);
+#if CONFIG_LIBVIRTIO_RING_INDIRECT
+	if (VIRTIO_FEATURE_HAS(d->vdev->features, VIRTIO_F_INDIRECT_DESC))
+		d->max_segs = MAX(d->max_segs,
+				  (__u32)CONFIG_LIBVIRTIO_RING_INDIRECT_MAX);
+#endif /* CONFIG_LIBVIRTIO_RING_INDIRECT */
+	if (unlikely(d->max_segs <= EXTRA_SEGMENTS)) {
+		uk_pr_err(DRIVER_NAME": Request queue too small\n");
+		return -ENOSPC;
+	}
+
+	d->sgsegs = uk_calloc(a, d->max_segs, sizeof(*d->sgsegs));
+	if (unlikely(!d->sgsegs))
+		return -ENOMEM;
+	uk_sglist_init(&d->sg, d->max_segs, d->sgsegs);
+
+	d->fsdev.max_msg = MIN(VIRTIO_FS_MSG_MAX,
+			       (__sz)(d->max_segs - EXTRA_SEGMENTS) *
+			       __PAGE_SIZE);
+	return 0;
+}
+
+#if CONFIG_LIBVIRTIO_FS_DAX
+/*
+ * The window is device memory whose pages the host only backs where it mapped
+ * file ranges. It is mapped on demand, so that only touched parts need page
+ * tables.
+ */
+static void virtio_fs_dax_map(struct virtio_fs_device *d)
+{
+	__vaddr_t vaddr = __VADDR_ANY;
+	unsigned long flags = 0;
+	__paddr_t paddr;
+	__u64 len;
+	int rc;
+
+	rc = virtio_shm_get(d->vdev, VIRTIO_FS_SHMCAP_ID_CACHE, &paddr, &len);
+	if (rc) {
+		uk_pr_info(DRIVER_NAME": %s: No DAX window\n", d->tag);
+		return;
+	}
+
+	if (unlikely(!PAGE_ALIGNED(paddr) || !len ||
+		     len > (__u64)__SZ_MAX)) {
+		uk_pr_warn(DRIVER_NAME": %s: Ignoring unusable DAX window\n",
+			   d->tag);
+		return;
+	}
+	len = PAGE_ALIGN_DOWN(len);
+
+	if (PAGE_Lx_ALIGNED(paddr, PAGE_LEVEL + 1) &&
+	    PAGE_Lx_ALIGNED(len, PAGE_LEVEL + 1))
+		flags |= UK_VMA_MAP_SIZE(PAGE_Lx_SHIFT(PAGE_LEVEL + 1));
+
+	rc = uk_vma_map_dma(uk_vas_get_active(), &vaddr, (__sz)len,
+			    PAGE_ATTR_PROT_RW, flags, DRIVER_NAME, paddr);
+	if (unlikely(rc)) {
+		uk_pr_warn(DRIVER_NAME": %s: Failed to map DAX window: %d\n",
+			   d->tag, rc);
+		return;
+	}
+
+	d->fsdev.dax_base = (void *)vaddr;
+	d->fsdev.dax_len = (__sz)len;
+	uk_pr_info(DRIVER_NAME": %s: DAX window of %"__PRIu64" MiB\n",
+		   d->tag, len >> 20);
+}
+#endif /* CONFIG_LIBVIRTIO_FS_DAX */
+
+static int virtio_fs_add_dev(struct virtio_dev *vdev)
+{
+	struct virtio_fs_device *d;
+	__u64 host_features;
+	int i;
+	int rc;
+
+	UK_ASSERT(vdev != NULL);
+
+	d = uk_calloc(a, 1, sizeof(*d));
+	if (!d)
+		return -ENOMEM;
+	ukarch_spin_init(&d->spinlock);
+	uk_waitq_init(&d->wq);
+	d->vdev = vdev;
+	d->fsdev.tag = d->tag;
+
+	/* The notification queue is not used, so it is not negotiated */
+	host_features = virtio_feature_get(d->vdev);
+	d->vdev->features = 0;
+	VIRTIO_FEATURE_SET(d->vdev->features, VIRTIO_F_VERSION_1);
+	VIRTIO_FEATURE_SET(d->vdev->features, VIRTIO_F_EVENT_IDX);
+	VIRTIO_FEATURE_SET(d->vdev->features, VIRTIO_F_INDIRECT_DESC);
+	d->vdev->features &= host_features;
+	virtio_feature_set(d->vdev);
+
+	rc = virtio_config_get(d->vdev,
+			       __offsetof(struct virtio_fs_config, tag),
+			       d->tag, VIRTIO_FS_TAG_LEN, 1);
+	if (unlikely(rc)) {
+		uk_pr_err(DRIVER_NAME": Failed to read the tag: %d\n", rc);
+		goto out_free;
+	}
+	d->tag[VIRTIO_FS_TAG_LEN] = '\0';
+
+	rc = virtio_fs_vq_alloc(d);
+	if (rc) {
+		uk_pr_err(DRIVER_NAME": Could not allocate virtqueues\n");
+		goto out_release_vq;
+	}
+
+#if CONFIG_LIBVIRTIO_FS_DAX
+	virtio_fs_dax_map(d);
+#endif /* CONFIG_LIBVIRTIO_FS_DAX */
+
+	for (i = 0; i < VIRTIO_FS_VQ_MAX; i++)
+		virtqueue_intr_enable(d->vq[i]);
+	virtio_dev_drv_up(d->vdev);
+
+	ukarch_spin_lock(&virtio_fs_device_list_lock);
+	uk_list_add(&d->_list, &virtio_fs_device_list);
+	ukarch_spin_unlock(&virtio_fs_device_list_lock);
+
+	uk_pr_info(DRIVER_NAME": %s started\n", d->tag);
+	return 0;
+
+out_release_vq:
+	virtio_fs_vq_release(d);
+	uk_free(a, d->sgsegs);
+out_free:
+	virtio_dev_status_update(d->vdev, VIRTIO_CONFIG_STATUS_FAIL);
+	uk_free(a, d);
+	return rc;
+}
+
+static int virtio_fs_drv_init(struct uk_alloc *drv_allocator)
+{
+	if (!drv_allocator)
+		return -EINVAL;
+
+	a = drv_allocator;
+	return 0;
+}
+
+static const struct virtio_dev_id vfs_dev_id[] = {
+	{VIRTIO_ID_FS},
+	{VIRTIO_ID_INVALID} /* List Terminator */
+};
+
+static struct virtio_driver vfs_drv = {
+	.dev_ids = vfs_dev_id,
+	.init    = virtio_fs_drv_init,
+	.add_dev = virtio_fs_add_dev
+};
+VIRTIO_BUS_REGISTER_DRIVER(&vfs_drv);
@@ -57,6 +57,9 @@ extern "C" {
 /* v1.0 compliant. */
 #define VIRTIO_F_VERSION_1			32
 
+/* Driver notifications carry the position of the next available buffer */
+#define VIRTIO_F_NOTIFICATION_DATA		38
+
 #if CONFIG_ARCH_X86_64
 static inline void virtio_cwrite_bytes(const void *addr, const __u8 offset,
 				       const void *buf, int len, int type_len)
@@ -64,12 +64,14 @@ struct virtqueue {
 	virtqueue_notify_host_t vq_notify_host;
 	/* Callback from the virtqueue */
 	virtqueue_callback_t vq_callback;
-	/* Next entry of the queue */
-	UK_TAILQ_ENTRY(struct virtqueue) next;
 	/* EVENT_IDX notification suppression is used */
 	__u8 uses_event_idx;
+	/* The packed virtqueue layout is used (VIRTIO_F_RING_PACKED) */
+	__u8 uses_packed_ring;
 	/* Private data structure used by the driver of the queue */
 	void *priv;
+	/* Next entry of the queue, not used on the data path */
+	UK_TAILQ_ENTRY(struct virtqueue) next;
 };
 
 /**
@@ -149,6 +151,17 @@ __u64 virtqueue_feature_negotiate(__u64 feature_set);
  */
 int virtqueue_notify_enabled(struct virtqueue *vq);
 
+/**
+ * Returns the value that a driver notification carries with
+ * VIRTIO_F_NOTIFICATION_DATA: The queue index in the lower 16 bits and the
+ * position of the next available descriptor in the upper 16 bits (split
+ * ring: available index; packed ring: offset and wrap counter in bit 31).
+ *
+ * @param vq
+ *	Reference to the virtqueue.
+ */
+__u32 virtqueue_notification_data(struct virtqueue *vq);
+
 /**
  * Remove the user buffer from the virtqueue.
  *
@@ -267,6 +280,22 @@ void virtqueue_intr_disable(struct virtqueue *vq);
  */
 int virtqueue_intr_enable(struct virtqueue *vq);
 
+/**
+ * Enable interrupts on the virtqueue, but delay them until the host returned
+ * `nr_used` further buffers. This allows batching of completions (e.g., for
+ * transmit queues). Delaying requires VIRTIO_F_EVENT_IDX, without it the
+ * interrupt is raised with the next returned buffer.
+ * @param vq
+ *      Reference to the virtqueue
+ * @param nr_used
+ *	Number of returned buffers after which an interrupt is requested.
+ *	Must be in the range [1, ring size].
+ * @return
+ *	0, On successful enabling of interrupt.
+ *	1, At least `nr_used` buffers in the ring to be processed.
+ */
+int virtqueue_intr_enable_delayed(struct virtqueue *vq, __u16 nr_used);
+
 /**
  * Notify the host of an event.
  * @param vq
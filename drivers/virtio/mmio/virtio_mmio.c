@@ -74,6 +74,11 @@ struct virtio_mmio_device {
 	unsigned long irq;
 	void *base;
 	struct pf_device *pfdev;
+	/* Set up virtqueues, indexed by queue number */
+	struct virtqueue **vqs;
+	__u16 nr_vqs;
+	/* VIRTIO_F_NOTIFICATION_DATA was negotiated */
+	__u8 notify_data;
 };
 
 #define to_virtio_mmio_device(_dev) \
@@ -107,6 +112,7 @@ static __u64 vm_get_features(struct virtio_dev *vdev)
 static void vm_set_features(struct virtio_dev *vdev)
 {
 	struct virtio_mmio_device *vm_dev;
+	__u64 host_features;
 
 	UK_ASSERT(vdev);
 
@@ -115,6 +121,20 @@ static void vm_set_features(struct virtio_dev *vdev)
 	/* Give virtio_ring a chance to accept features. */
 	vdev->features = virtqueue_feature_negotiate(vdev->features);
 
+	/* Transport feature, which the device drivers do not request. The
+	 * notification tells the device where the new buffers end, so it can
+	 * start processing them without reading the available ring first.
+	 */
+	if (vm_dev->version == 2) {
+		host_features = vm_get_features(vdev);
+		if (VIRTIO_FEATURE_HAS(host_features,
+				       VIRTIO_F_NOTIFICATION_DATA))
+			VIRTIO_FEATURE_SET(vdev->features,
+					   VIRTIO_F_NOTIFICATION_DATA);
+	}
+	vm_dev->notify_data = VIRTIO_FEATURE_HAS(vdev->features,
+						 VIRTIO_F_NOTIFICATION_DATA);
+
 	/* Make sure there are no mixed devices */
 	if (vm_dev->version == 2 &&
 	    !uk_test_bit(VIRTIO_F_VERSION_1, &vdev->features)) {
@@ -255,9 +275,17 @@ static int vm_notify(struct virtio_dev *vdev, __u16 queue_id)
 
 	/*
 	 * We write the queue's selector into the notification register to
-	 * signal the other end
+	 * signal the other end. With notification data, the selector is
+	 * extended by the position of the next available descriptor.
 	 */
-	virtio_mmio_cwrite32(vm_dev->base, VIRTIO_MMIO_QUEUE_NOTIFY, queue_id);
+	if (vm_dev->notify_data) {
+		UK_ASSERT(queue_id < vm_dev->nr_vqs && vm_dev->vqs[queue_id]);
+		virtio_mmio_cwrite32(vm_dev->base, VIRTIO_MMIO_QUEUE_NOTIFY,
+			virtqueue_notification_data(vm_dev->vqs[queue_id]));
+	} else {
+		virtio_mmio_cwrite32(vm_dev->base, VIRTIO_MMIO_QUEUE_NOTIFY,
+				     queue_id);
+	}
 	return 1;
 }
 
@@ -360,6 +388,9 @@ static struct virtqueue *vm_setup_vq(struct virtio_dev *vdev,
 		virtio_mmio_cwrite32(vm_dev->base, VIRTIO_MMIO_QUEUE_READY, 1);
 	}
 
+	if (queue_id < vm_dev->nr_vqs)
+		vm_dev->vqs[queue_id] = vq;
+
 	flags = ukplat_lcpu_save_irqf();
 	UK_TAILQ_INSERT_TAIL(&vm_dev->vdev.vqs, vq, next);
 	ukplat_lcpu_restore_irqf(flags);
@@ -372,9 +403,19 @@ static int vm_find_vqs(struct virtio_dev *vdev, __u16 num_vqs, __u16 *qdesc_size
 {
 	struct virtio_mmio_device *vm_dev = to_virtio_mmio_device(vdev);
 	unsigned int irq = vm_dev->pfdev->irq;
+	struct virtqueue **vqs;
 	int i, err;
 	int vq_cnt = 0;
 
+	if (num_vqs > vm_dev->nr_vqs) {
+		vqs = uk_calloc(a, num_vqs, sizeof(*vqs));
+		if (unlikely(!vqs))
+			return -ENOMEM;
+		uk_free(a, vm_dev->vqs);
+		vm_dev->vqs = vqs;
+		vm_dev->nr_vqs = num_vqs;
+	}
+
 	err = uk_intctlr_irq_register(irq, vm_interrupt, vm_dev);
 	if (err)
 		return err;
@@ -407,6 +448,30 @@ error_exit:
 	return err;
 }
 
+static int vm_shm_get(struct virtio_dev *vdev, __u8 shm_id,
+		      __paddr_t *paddr, __u64 *len)
+{
+	struct virtio_mmio_device *vm_dev = to_virtio_mmio_device(vdev);
+	__u64 base;
+
+	if (vm_dev->version == 1)
+		return -ENOTSUP;
+
+	virtio_mmio_cwrite32(vm_dev->base, VIRTIO_MMIO_SHM_SEL, shm_id);
+
+	*len = virtio_mmio_cread32(vm_dev->base, VIRTIO_MMIO_SHM_LEN_LOW);
+	*len |= (__u64)virtio_mmio_cread32(vm_dev->base,
+					   VIRTIO_MMIO_SHM_LEN_HIGH) << 32;
+	if (*len == ~(__u64)0)
+		return -ENOENT;
+
+	base = virtio_mmio_cread32(vm_dev->base, VIRTIO_MMIO_SHM_BASE_LOW);
+	base |= (__u64)virtio_mmio_cread32(vm_dev->base,
+					   VIRTIO_MMIO_SHM_BASE_HIGH) << 32;
+	*paddr = (__paddr_t)base;
+	return 0;
+}
+
 static struct virtio_config_ops virtio_mmio_config_ops = {
 	.config_get	= vm_get,
 	.config_set	= vm_set,
@@ -417,6 +482,7 @@ static struct virtio_config_ops virtio_mmio_config_ops = {
 	.features_set	= vm_set_features,
 	.vqs_find	= vm_find_vqs,
 	.vq_setup	= vm_setup_vq,
+	.shm_get	= vm_shm_get,
 };
 
 #if CONFIG_LIBVIRTIO_MMIO_FDT
@@ -498,6 +564,9 @@ int virtio_mmio_add_dev(struct pf_device *pfdev)
 	vm_dev->base = (void *)pfdev->base;
 	vm_dev->vdev.cops = &virtio_mmio_config_ops;
 	vm_dev->name = "virtio_mmio";
+	vm_dev->vqs = NULL;
+	vm_dev->nr_vqs = 0;
+	vm_dev->notify_data = 0;
 
 	if (vm_dev->base == NULL) {
 		rc = -EFAULT;
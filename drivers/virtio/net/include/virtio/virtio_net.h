@@ -73,10 +73,16 @@
 					 */
 #define VIRTIO_NET_F_CTRL_MAC_ADDR 23	/* Set MAC address */
 
+#define VIRTIO_NET_F_NOTF_COAL	  53	/* Device supports notification
+					 * coalescing
+					 */
 #define VIRTIO_NET_F_SPEED_DUPLEX 63	/* Device set linkspeed and duplex */
 #define VIRTIO_NET_F_HASH_REPORT  57	/* Device can provide per-packet hash
 					 * value
 					 */
+#define VIRTIO_NET_F_RSS	  60	/* Device supports receive-side
+					 * scaling
+					 */
 
 #ifndef VIRTIO_NET_NO_LEGACY
 #define VIRTIO_NET_F_GSO	6	/* Host handles pkts w/ any GSO type */
@@ -108,6 +114,12 @@ struct virtio_net_config {
 	 * Any other value stands for unknown.
 	 */
 	__u8 duplex;
+	/* Maximum key length (VIRTIO_NET_F_RSS, VIRTIO_NET_F_HASH_REPORT) */
+	__u8 rss_max_key_size;
+	/* Maximum indirection table length (if VIRTIO_NET_F_RSS) */
+	__u16 rss_max_indirection_table_length;
+	/* See VIRTIO_NET_HASH_TYPE_* below */
+	__u32 supported_hash_types;
 } __packed;
 
 /* This header comes first in the scatter-gather list.
@@ -138,6 +150,29 @@ struct virtio_net_hdr {
 	__virtio_le16 padding_reserved; /* VIRTIO_NET_F_HASH_REPORT */
 };
 
+/* Values of `hash_report` in struct virtio_net_hdr */
+#define VIRTIO_NET_HASH_REPORT_NONE      0
+#define VIRTIO_NET_HASH_REPORT_IPv4      1
+#define VIRTIO_NET_HASH_REPORT_TCPv4     2
+#define VIRTIO_NET_HASH_REPORT_UDPv4     3
+#define VIRTIO_NET_HASH_REPORT_IPv6      4
+#define VIRTIO_NET_HASH_REPORT_TCPv6     5
+#define VIRTIO_NET_HASH_REPORT_UDPv6     6
+#define VIRTIO_NET_HASH_REPORT_IPv6_EX   7
+#define VIRTIO_NET_HASH_REPORT_TCPv6_EX  8
+#define VIRTIO_NET_HASH_REPORT_UDPv6_EX  9
+
+/* Header fields the device may hash over, see `supported_hash_types` */
+#define VIRTIO_NET_HASH_TYPE_IPv4        (1 << 0)
+#define VIRTIO_NET_HASH_TYPE_TCPv4       (1 << 1)
+#define VIRTIO_NET_HASH_TYPE_UDPv4       (1 << 2)
+#define VIRTIO_NET_HASH_TYPE_IPv6        (1 << 3)
+#define VIRTIO_NET_HASH_TYPE_TCPv6       (1 << 4)
+#define VIRTIO_NET_HASH_TYPE_UDPv6       (1 << 5)
+#define VIRTIO_NET_HASH_TYPE_IP_EX       (1 << 6)
+#define VIRTIO_NET_HASH_TYPE_TCP_EX      (1 << 7)
+#define VIRTIO_NET_HASH_TYPE_UDP_EX      (1 << 8)
+
 /*
  * Control virtqueue data structures
  *
@@ -241,6 +276,69 @@ struct virtio_net_ctrl_mq {
  #define VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET        0
  #define VIRTIO_NET_CTRL_MQ_VQ_PAIRS_MIN        1
  #define VIRTIO_NET_CTRL_MQ_VQ_PAIRS_MAX        0x8000
+ #define VIRTIO_NET_CTRL_MQ_RSS_CONFIG          1
+ #define VIRTIO_NET_CTRL_MQ_HASH_CONFIG         2
+
+/*
+ * The command VIRTIO_NET_CTRL_MQ_HASH_CONFIG selects the header fields the
+ * device hashes over and the key of the Toeplitz hash. The device reports
+ * the result in the virtio-net header of every received packet. Available
+ * with the VIRTIO_NET_F_HASH_REPORT feature bit. The key is limited to
+ * `rss_max_key_size` bytes.
+ */
+#define VIRTIO_NET_RSS_MAX_KEY_SIZE     40
+
+struct virtio_net_hash_config {
+	__virtio_le32 hash_types;
+	__virtio_le16 reserved[4];
+	__u8 hash_key_length;
+	__u8 hash_key_data[VIRTIO_NET_RSS_MAX_KEY_SIZE];
+} __packed;
+
+/*
+ * The command VIRTIO_NET_CTRL_MQ_RSS_CONFIG additionally steers received
+ * packets to the receive queue given by the indirection table at the index
+ * of the lower bits of their hash. Available with the VIRTIO_NET_F_RSS
+ * feature bit. The table has a variable length of up to
+ * `rss_max_indirection_table_length` entries, so the command data consists
+ * of the head, the table, the tail and the key.
+ */
+#define VIRTIO_NET_RSS_MAX_TABLE_LEN    128
+
+struct virtio_net_rss_config_head {
+	__virtio_le32 hash_types;
+	__virtio_le16 indirection_table_mask;
+	__virtio_le16 unclassified_queue;
+} __packed;
+
+struct virtio_net_rss_config_tail {
+	__virtio_le16 max_tx_vq;
+	__u8 hash_key_length;
+} __packed;
+
+#define VIRTIO_NET_RSS_CONFIG_MAXLEN				\
+	(sizeof(struct virtio_net_rss_config_head) +		\
+	 VIRTIO_NET_RSS_MAX_TABLE_LEN * sizeof(__virtio_le16) +	\
+	 sizeof(struct virtio_net_rss_config_tail) +		\
+	 VIRTIO_NET_RSS_MAX_KEY_SIZE)
+
+/*
+ * Control notification coalescing
+ *
+ * The command VIRTIO_NET_CTRL_NOTF_COAL_RX_SET makes the device delay used
+ * buffer notifications of all receive virtqueues by up to `rx_usecs`
+ * microseconds or until `rx_max_packets` packets were received. Zero in
+ * both fields disables coalescing. Available with the
+ * VIRTIO_NET_F_NOTF_COAL feature bit.
+ */
+struct virtio_net_ctrl_coal_rx {
+	__virtio_le32 rx_max_packets;
+	__virtio_le32 rx_usecs;
+} __packed;
+
+#define VIRTIO_NET_CTRL_NOTF_COAL   6
+ #define VIRTIO_NET_CTRL_NOTF_COAL_TX_SET      0
+ #define VIRTIO_NET_CTRL_NOTF_COAL_RX_SET      1
 
 /*
  * Control network offloads
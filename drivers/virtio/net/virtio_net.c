@@ -34,16 +34,29 @@
 #include <uk/sglist.h>
 #include <uk/arch/types.h>
 #include <uk/arch/limits.h>
+#include <uk/arch/lcpu.h>
 #include <uk/netbuf.h>
 #include <uk/netdev.h>
 #include <uk/netdev_core.h>
 #include <uk/netdev_driver.h>
+#include <uk/trace.h>
+#include <uk/arch/time.h>
+#include <uk/plat/time.h>
 #include <virtio/virtio_bus.h>
 #include <virtio/virtqueue.h>
 #include <virtio/virtio_net.h>
 
 #define DRIVER_NAME	"virtio-net"
 
+UK_TRACEPOINT(trace_virtio_net_rx_intr, "rxq=%u", unsigned int);
+UK_TRACEPOINT(trace_virtio_net_recv, "rxq=%u pkts=%u", unsigned int,
+	      unsigned int);
+UK_TRACEPOINT(trace_virtio_net_xmit, "txq=%u pkts=%u", unsigned int,
+	      unsigned int);
+UK_TRACEPOINT(trace_virtio_net_xmit_free, "txq=%u pkts=%d", unsigned int,
+	      int);
+UK_TRACEPOINT(trace_virtio_net_xmit_full, "txq=%u", unsigned int);
+
 /* VIRTIO_PKT_BUFFER_LEN = VIRTIO_NET_HDR + ETH_HDR + ETH_PKT_PAYLOAD_LEN */
 #define VIRTIO_PKT_BUFFER_LEN(_vndev)				\
 	((UK_ETH_PAYLOAD_MAXLEN) + (UK_ETH_HDR_UNTAGGED_LEN) +	\
@@ -73,6 +86,18 @@
 #define VTNET_HDR_SIZE_PADDED(_vndev)			\
 	(ALIGN_UP((__sz)virtio_net_hdr_size(_vndev), 4) + 4)
 
+/**
+ * With mergeable receive buffers (VIRTIO_NET_F_MRG_RXBUF), each receive
+ * buffer is posted as a single descriptor. The device writes the header and
+ * the frame back to back and may spread one frame over multiple buffers.
+ */
+#define VTNET_RX_MRG(_vndev)					\
+	VIRTIO_FEATURE_HAS((_vndev)->vdev->features, VIRTIO_NET_F_MRG_RXBUF)
+
+/* Number of descriptors that a single receive netbuf occupies */
+#define VTNET_RX_DESC_PER_BUF(_vndev)				\
+	(VTNET_RX_MRG(_vndev) ? 1 : 2)
+
 #define  VTNET_INTR_EN				UK_BIT(0)
 #define  VTNET_INTR_EN_MASK			0x01
 #define  VTNET_INTR_USR_EN			UK_BIT(1)
@@ -94,7 +119,7 @@ typedef enum {
 /**
  * @internal structure to represent the transmit queue.
  */
-struct uk_netdev_tx_queue {
+struct __align(CACHE_LINE_SIZE) uk_netdev_tx_queue {
 	/* The virtqueue reference */
 	struct virtqueue *vq;
 	/* The hw queue identifier */
@@ -117,7 +142,7 @@ struct uk_netdev_tx_queue {
 /**
  * @internal structure to represent the receive queue.
  */
-struct uk_netdev_rx_queue {
+struct __align(CACHE_LINE_SIZE) uk_netdev_rx_queue {
 	/* The virtqueue reference */
 	struct virtqueue *vq;
 	/* The virtqueue hw identifier */
@@ -133,6 +158,13 @@ struct uk_netdev_rx_queue {
 	/* User-provided receive buffer allocation function */
 	uk_netdev_alloc_rxpkts alloc_rxpkts;
 	void *alloc_rxpkts_argp;
+	/* Guest-side interrupt moderation, if the device does not coalesce */
+	__u32 coal_usecs;
+	__u32 coal_max_pkts;
+	/* Packets received since the last interrupt */
+	__u32 coal_cnt;
+	/* Set while the queue is polled with the interrupt disabled */
+	__u8 coal_poll;
 	/* Reference to the uk_netdev */
 	struct uk_netdev *ndev;
 	/* The scatter list and its associated fragements */
@@ -148,6 +180,25 @@ struct virtio_net_device {
 	struct uk_netdev netdev;
 	/* Count of the number of the virtqueues */
 	__u16 max_vqueue_pairs;
+	/* Number of queue pairs provided by the device, which locates the
+	 * control virtqueue
+	 */
+	__u16 dev_max_vqueue_pairs;
+	/* Number of queue pairs configured by the user */
+	__u16 vqueue_pairs;
+	/* Control virtqueue, if VIRTIO_NET_F_CTRL_VQ is negotiated */
+	struct virtqueue *ctrlq;
+	/* Control command buffers and their scatter list */
+	struct virtio_net_ctrl_hdr ctrl_hdr;
+	struct virtio_net_ctrl_mq ctrl_mq;
+	struct virtio_net_hash_config ctrl_hash;
+	struct virtio_net_ctrl_coal_rx ctrl_coal;
+	/* RSS_CONFIG command data prepared on configure, sent on start */
+	__u8 ctrl_rss[VIRTIO_NET_RSS_CONFIG_MAXLEN];
+	__u16 ctrl_rss_len;
+	virtio_net_ctrl_ack ctrl_ack;
+	struct uk_sglist ctrl_sg;
+	struct uk_sglist_seg ctrl_sgsegs[3];
 	/* List of the Rx/Tx queue */
 	__u16    rx_vqueue_cnt;
 	struct   uk_netdev_rx_queue *rxqs;
@@ -196,12 +247,18 @@ static int virtio_net_rx_intr_disable(struct uk_netdev *n,
 static int virtio_net_rx_intr_enable(struct uk_netdev *n,
 				     struct uk_netdev_rx_queue *queue);
 static void virtio_netdev_xmit_free(struct uk_netdev_tx_queue *txq);
-static int virtio_netdev_xmit(struct uk_netdev *dev,
-			      struct uk_netdev_tx_queue *queue,
-			      struct uk_netbuf *pkt);
-static int virtio_netdev_recv(struct uk_netdev *dev,
-			      struct uk_netdev_rx_queue *queue,
-			      struct uk_netbuf **pkt);
+int virtio_netdev_xmit(struct uk_netdev *dev,
+		       struct uk_netdev_tx_queue *queue,
+		       struct uk_netbuf *pkt);
+int virtio_netdev_recv(struct uk_netdev *dev,
+		       struct uk_netdev_rx_queue *queue,
+		       struct uk_netbuf **pkt);
+int virtio_netdev_xmit_burst(struct uk_netdev *dev,
+			     struct uk_netdev_tx_queue *queue,
+			     struct uk_netbuf *pkts[], __u16 cnt);
+int virtio_netdev_recv_burst(struct uk_netdev *dev,
+			     struct uk_netdev_rx_queue *queue,
+			     struct uk_netbuf *pkts[], __u16 cnt);
 static const struct uk_hwaddr *virtio_net_mac_get(struct uk_netdev *n);
 static __u16 virtio_net_mtu_get(struct uk_netdev *n);
 static unsigned virtio_net_promisc_get(struct uk_netdev *n);
@@ -266,10 +323,12 @@ static int virtio_netdev_recv_done(struct virtqueue *vq, void *priv)
 	UK_ASSERT(vq && priv);
 
 	rxq = (struct uk_netdev_rx_queue *) priv;
+	trace_virtio_net_rx_intr(rxq->lqueue_id);
 
 	/* Disable the interrupt for the ring */
 	virtqueue_intr_disable(vq);
 	rxq->intr_enabled &= ~(VTNET_INTR_EN);
+	rxq->coal_cnt = 0;
 
 	/* Indicate to the network stack about an event */
 	uk_netdev_drv_rx_event(rxq->ndev, rxq->lqueue_id);
@@ -298,6 +357,8 @@ static void virtio_netdev_xmit_free(struct uk_netdev_tx_queue *txq)
 		cnt++;
 	}
 	uk_pr_debug("Free %"__PRIu16" descriptors\n", cnt);
+	if (cnt)
+		trace_virtio_net_xmit_free(txq->lqueue_id, cnt);
 }
 
 #define RX_FILLUP_BATCHLEN 64
@@ -314,17 +375,18 @@ static int virtio_netdev_rx_fillup(struct virtio_net_device *vndev,
 	__u16 cnt = 0;
 	__u16 filled = 0;
 
+	__u16 per_buf = VTNET_RX_DESC_PER_BUF(vndev);
+
 	/**
-	 * Fixed amount of memory is allocated to each received buffer. In
-	 * our case since we don't support jumbo frame or LRO yet we require
-	 * that the buffer feed to the ring descriptor is atleast
-	 * ethernet MTU + virtio net header.
+	 * Fixed amount of memory is allocated to each received buffer.
+	 * Without mergeable buffers we require that the buffer feed to the
+	 * ring descriptor is atleast ethernet MTU + virtio net header.
 	 * Because we using 2 descriptor for a single netbuf, our effective
-	 * queue size is just the half.
+	 * queue size is just the half in this case.
 	 */
-	nb_desc = ALIGN_DOWN(nb_desc, 2);
+	nb_desc = ALIGN_DOWN(nb_desc, per_buf);
 	while (filled < nb_desc) {
-		req = MIN(nb_desc / 2, RX_FILLUP_BATCHLEN);
+		req = MIN((nb_desc - filled) / per_buf, RX_FILLUP_BATCHLEN);
 		cnt = rxq->alloc_rxpkts(rxq->alloc_rxpkts_argp, netbuf, req);
 		for (i = 0; i < cnt; i++) {
 			uk_pr_debug("Enqueue netbuf %"PRIu16"/%"PRIu16" (%p) to virtqueue %p...\n",
@@ -343,7 +405,7 @@ static int virtio_netdev_rx_fillup(struct virtio_net_device *vndev,
 				status |= UK_NETDEV_STATUS_UNDERRUN;
 				goto out;
 			}
-			filled += 2;
+			filled += per_buf;
 		}
 
 		if (unlikely(cnt < req)) {
@@ -356,41 +418,42 @@ static int virtio_netdev_rx_fillup(struct virtio_net_device *vndev,
 
 out:
 	uk_pr_debug("Programmed %"PRIu16" receive netbufs to receive virtqueue %p (status %x)\n",
-		    filled / 2, rxq, status);
+		    filled / per_buf, rxq, status);
 
 	/**
 	 * Notify the host, when we submit new descriptor(s).
 	 */
-	if (notify && filled)
+	if (notify && filled) {
 		virtqueue_host_notify(rxq->vq);
+		uk_netdev_drv_rxq_stats_inc(rxq->ndev, rxq->lqueue_id, kicks);
+	}
+	if (unlikely(status & UK_NETDEV_STATUS_UNDERRUN))
+		uk_netdev_drv_rxq_stats_inc(rxq->ndev, rxq->lqueue_id,
+					    ring_full);
 
 	return status;
 }
 
-static int virtio_netdev_xmit(struct uk_netdev *dev,
-			      struct uk_netdev_tx_queue *queue,
-			      struct uk_netbuf *pkt)
+/**
+ * Prepends the virtio header to `pkt` and adds it to the transmit virtqueue
+ * without notifying the host.
+ *
+ * @return
+ *	>= 0 The packet was enqueued, the value is the number of available
+ *	     descriptors.
+ *	-ENOSPC The ring is full, the packet is left untouched.
+ *	< 0 Any other error, the packet is left untouched.
+ */
+static int virtio_netdev_xmit_enqueue(struct virtio_net_device *vndev,
+				      struct uk_netdev_tx_queue *queue,
+				      struct uk_netbuf *pkt)
 {
-	struct virtio_net_device *vndev;
 	struct virtio_net_hdr *vhdr;
 	int rc = 0;
-	int status = 0x0;
 	__sz total_len = 0;
 	__u8  *buf_start;
 	__sz buf_len;
 
-	UK_ASSERT(dev);
-	UK_ASSERT(pkt && queue);
-
-	vndev = to_virtionetdev(dev);
-
-	/**
-	 * We are reclaiming the free descriptors from buffers. The function is
-	 * not protected by means of locks. We need to be careful if there are
-	 * multiple context through which we free the tx descriptors.
-	 */
-	virtio_netdev_xmit_free(queue);
-
 	buf_start = pkt->data;
 	buf_len = pkt->len;
 
@@ -400,8 +463,7 @@ static int virtio_netdev_xmit(struct uk_netdev *dev,
 	rc = uk_netbuf_header(pkt, VTNET_HDR_SIZE_PADDED(vndev));
 	if (unlikely(rc != 1)) {
 		uk_pr_err("Failed to prepend virtio header\n");
-		rc = -ENOSPC;
-		goto err_exit;
+		return -EINVAL;
 	}
 	vhdr = pkt->data;
 
@@ -425,8 +487,10 @@ static int virtio_netdev_xmit(struct uk_netdev *dev,
 		vhdr->csum_start   = pkt->csum_start - VTNET_HDR_SIZE_PADDED(vndev);
 		vhdr->csum_offset  = pkt->csum_offset;
 	}
-	if (pkt->flags & UK_NETBUF_F_GSO_TCPV4) {
-		vhdr->gso_type     = VIRTIO_NET_HDR_GSO_TCPV4;
+	if (pkt->flags & (UK_NETBUF_F_GSO_TCPV4 | UK_NETBUF_F_GSO_TCPV6)) {
+		vhdr->gso_type     = (pkt->flags & UK_NETBUF_F_GSO_TCPV4)
+				     ? VIRTIO_NET_HDR_GSO_TCPV4
+				     : VIRTIO_NET_HDR_GSO_TCPV6;
 		vhdr->hdr_len      = pkt->header_len;
 		vhdr->gso_size     = pkt->gso_size;
 	}
@@ -462,7 +526,7 @@ static int virtio_netdev_xmit(struct uk_netdev *dev,
 		}
 	}
 
-	if (!(pkt->flags & UK_NETBUF_F_GSO_TCPV4)) {
+	if (!(pkt->flags & (UK_NETBUF_F_GSO_TCPV4 | UK_NETBUF_F_GSO_TCPV6))) {
 		total_len = uk_sglist_length(&queue->sg);
 		if (unlikely(total_len > VIRTIO_PKT_BUFFER_LEN(vndev))) {
 			uk_pr_err("Packet size too big: %lu, max:%lu\n",
@@ -477,35 +541,115 @@ static int virtio_netdev_xmit(struct uk_netdev *dev,
 	 */
 	rc = virtqueue_buffer_enqueue(queue->vq, pkt, &queue->sg,
 				      queue->sg.sg_nseg, 0);
+	if (likely(rc >= 0))
+		return rc;
+
+	if (rc == -ENOSPC)
+		uk_pr_debug("No more descriptor available\n");
+	else
+		uk_pr_err("Failed to enqueue descriptors into the ring: %d\n",
+			  rc);
+
+err_remove_vhdr:
+	/**
+	 * Remove header before exiting because we could not send
+	 */
+	uk_netbuf_header(pkt, -((__s16)VTNET_HDR_SIZE_PADDED(vndev)));
+	UK_ASSERT(rc < 0);
+	return rc;
+}
+
+int virtio_netdev_xmit(struct uk_netdev *dev,
+		       struct uk_netdev_tx_queue *queue,
+		       struct uk_netbuf *pkt)
+{
+	struct virtio_net_device *vndev;
+	int status = 0x0;
+	int rc;
+
+	UK_ASSERT(dev);
+	UK_ASSERT(pkt && queue);
+
+	vndev = to_virtionetdev(dev);
+
+	/**
+	 * We are reclaiming the free descriptors from buffers. The function is
+	 * not protected by means of locks. We need to be careful if there are
+	 * multiple context through which we free the tx descriptors.
+	 */
+	virtio_netdev_xmit_free(queue);
+
+	rc = virtio_netdev_xmit_enqueue(vndev, queue, pkt);
 	if (likely(rc >= 0)) {
+		trace_virtio_net_xmit(queue->lqueue_id, 1);
 		status |= UK_NETDEV_STATUS_SUCCESS;
 		/**
 		 * Notify the host the new buffer.
 		 */
 		virtqueue_host_notify(queue->vq);
+		uk_netdev_drv_txq_stats_inc(dev, queue->lqueue_id, kicks);
 		/**
 		 * When there is further space available in the ring
 		 * return UK_NETDEV_STATUS_MORE.
 		 */
 		status |= likely(rc > 0) ? UK_NETDEV_STATUS_MORE : 0x0;
-	} else if (rc == -ENOSPC) {
-		uk_pr_debug("No more descriptor available\n");
-		/**
-		 * Remove header before exiting because we could not send
-		 */
-		uk_netbuf_header(pkt, -((__s16)VTNET_HDR_SIZE_PADDED(vndev)));
+	} else if (rc != -ENOSPC) {
+		return rc;
 	} else {
-		uk_pr_err("Failed to enqueue descriptors into the ring: %d\n",
-			  rc);
-		goto err_remove_vhdr;
+		trace_virtio_net_xmit_full(queue->lqueue_id);
+		uk_netdev_drv_txq_stats_inc(dev, queue->lqueue_id, ring_full);
 	}
 	return status;
+}
 
-err_remove_vhdr:
-	uk_netbuf_header(pkt, -((__s16)VTNET_HDR_SIZE_PADDED(vndev)));
-err_exit:
-	UK_ASSERT(rc < 0);
-	return rc;
+int virtio_netdev_xmit_burst(struct uk_netdev *dev,
+			     struct uk_netdev_tx_queue *queue,
+			     struct uk_netbuf *pkts[], __u16 cnt)
+{
+	struct virtio_net_device *vndev;
+	__u16 i;
+	int rc = 0;
+
+	UK_ASSERT(dev);
+	UK_ASSERT(queue);
+	UK_ASSERT(pkts || cnt == 0);
+
+	vndev = to_virtionetdev(dev);
+
+	/* Same as for single packets: reclaim the descriptors of completed
+	 * transmissions first.
+	 */
+	virtio_netdev_xmit_free(queue);
+
+	for (i = 0; i < cnt; i++) {
+		UK_ASSERT(pkts[i]);
+
+		rc = virtio_netdev_xmit_enqueue(vndev, queue, pkts[i]);
+		if (unlikely(rc < 0))
+			break;
+		if (unlikely(rc == 0)) {
+			/* Ring is full now */
+			i++;
+			break;
+		}
+	}
+
+	trace_virtio_net_xmit(queue->lqueue_id, i);
+	if (unlikely(rc == -ENOSPC || (rc == 0 && i > 0))) {
+		trace_virtio_net_xmit_full(queue->lqueue_id);
+		uk_netdev_drv_txq_stats_inc(dev, queue->lqueue_id, ring_full);
+	}
+
+	/**
+	 * A single notification for the whole batch of descriptors.
+	 */
+	if (likely(i > 0)) {
+		virtqueue_host_notify(queue->vq);
+		uk_netdev_drv_txq_stats_inc(dev, queue->lqueue_id, kicks);
+	} else if (rc < 0 && rc != -ENOSPC)
+		return rc;
+
+	return i;
 }
 
 static int virtio_netdev_rxq_enqueue(struct virtio_net_device *vndev,
@@ -529,6 +673,26 @@ static int virtio_netdev_rxq_enqueue(struct virtio_net_device *vndev,
 	buf_start = netbuf->data;
 	buf_len = netbuf->len;
 
+	sg = &rxq->sg;
+	uk_sglist_reset(sg);
+
+	if (VTNET_RX_MRG(vndev)) {
+		/**
+		 * The header directly precedes the frame in a single
+		 * segment. Buffers that continue a frame are filled from the
+		 * start of the segment, so this layout is kept for all of
+		 * them.
+		 */
+		rc = uk_netbuf_header(netbuf, virtio_net_hdr_size(vndev));
+		if (unlikely(rc != 1)) {
+			uk_pr_err("Failed to allocate space to prepend virtio header\n");
+			return -EINVAL;
+		}
+		uk_sglist_append(sg, netbuf->data, netbuf->len);
+		return virtqueue_buffer_enqueue(rxq->vq, netbuf, sg, 0,
+						sg->sg_nseg);
+	}
+
 	/**
 	 * Retrieve the buffer header length.
 	 */
@@ -539,9 +703,6 @@ static int virtio_netdev_rxq_enqueue(struct virtio_net_device *vndev,
 	}
 	rxhdr = netbuf->data;
 
-	sg = &rxq->sg;
-	uk_sglist_reset(sg);
-
 	/* Appending the header buffer to the sglist */
 	uk_sglist_append(sg, rxhdr, virtio_net_hdr_size(vndev));
 
@@ -553,6 +714,134 @@ static int virtio_netdev_rxq_enqueue(struct virtio_net_device *vndev,
 	return rc;
 }
 
+/* Maps VIRTIO_NET_HASH_REPORT_* to UK_NETBUF_HASH_* */
+static const __u8 virtio_net_hash_report_map[] = {
+	[VIRTIO_NET_HASH_REPORT_NONE]     = UK_NETBUF_HASH_NONE,
+	[VIRTIO_NET_HASH_REPORT_IPv4]     = UK_NETBUF_HASH_IPV4,
+	[VIRTIO_NET_HASH_REPORT_TCPv4]    = UK_NETBUF_HASH_TCPV4,
+	[VIRTIO_NET_HASH_REPORT_UDPv4]    = UK_NETBUF_HASH_UDPV4,
+	[VIRTIO_NET_HASH_REPORT_IPv6]     = UK_NETBUF_HASH_IPV6,
+	[VIRTIO_NET_HASH_REPORT_TCPv6]    = UK_NETBUF_HASH_TCPV6,
+	[VIRTIO_NET_HASH_REPORT_UDPv6]    = UK_NETBUF_HASH_UDPV6,
+	[VIRTIO_NET_HASH_REPORT_IPv6_EX]  = UK_NETBUF_HASH_IPV6,
+	[VIRTIO_NET_HASH_REPORT_TCPv6_EX] = UK_NETBUF_HASH_TCPV6,
+	[VIRTIO_NET_HASH_REPORT_UDPv6_EX] = UK_NETBUF_HASH_UDPV6,
+};
+
+/**
+ * Copy the virtio header information to the netbuf.
+ * @param vndev
+ *	Reference to the virtio net device.
+ * @param buf
+ *	The netbuf that starts with the header.
+ * @param hdr_len
+ *	Number of bytes at the beginning of the netbuf that are going to be
+ *	removed together with the header.
+ */
+static void virtio_netdev_rxhdr_parse(struct virtio_net_device *vndev,
+				      struct uk_netbuf *buf, __u16 hdr_len)
+{
+	struct virtio_net_hdr *vhdr;
+
+	vhdr = (struct virtio_net_hdr *) buf->data;
+	buf->flags  = ((vhdr->flags & VIRTIO_NET_HDR_F_DATA_VALID)
+		       ? UK_NETBUF_F_DATA_VALID   : 0x0);
+
+	if (VIRTIO_FEATURE_HAS(vndev->vdev->features,
+			       VIRTIO_NET_F_HASH_REPORT) &&
+	    vhdr->hash_report != VIRTIO_NET_HASH_REPORT_NONE &&
+	    vhdr->hash_report < ARRAY_SIZE(virtio_net_hash_report_map)) {
+		buf->flags |= UK_NETBUF_F_HASH;
+		buf->hash = vhdr->hash_value;
+		buf->hash_type = virtio_net_hash_report_map[vhdr->hash_report];
+	}
+	if (vhdr->flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) {
+		buf->flags |= UK_NETBUF_F_PARTIAL_CSUM;
+		buf->csum_offset = vhdr->csum_offset;
+		/* NOTE: csum_start is without virtio header
+		 *       (uk_netbuf_header() will remove it again)
+		 */
+		buf->csum_start  = vhdr->csum_start + hdr_len;
+	}
+
+	/* Coalesced segments (VIRTIO_NET_F_GUEST_TSO4/6) */
+	switch (vhdr->gso_type & ~VIRTIO_NET_HDR_GSO_ECN) {
+	case VIRTIO_NET_HDR_GSO_TCPV4:
+		buf->flags |= UK_NETBUF_F_GSO_TCPV4;
+		break;
+	case VIRTIO_NET_HDR_GSO_TCPV6:
+		buf->flags |= UK_NETBUF_F_GSO_TCPV6;
+		break;
+	default:
+		return;
+	}
+	buf->header_len = vhdr->hdr_len;
+	buf->gso_size = vhdr->gso_size;
+}
+
+/**
+ * Reassemble a frame that the device spread over `num_buffers` mergeable
+ * receive buffers. `buf` is the first buffer that was already dequeued.
+ */
+static int virtio_netdev_rxq_dequeue_mrg(struct virtio_net_device *vndev,
+					 struct uk_netdev_rx_queue *rxq,
+					 struct uk_netbuf *buf, __u32 len,
+					 int ret)
+{
+	struct virtio_net_hdr *vhdr;
+	struct uk_netbuf *seg;
+	__u16 hdr_size = virtio_net_hdr_size(vndev);
+	__u16 num_buffers;
+	int rc __maybe_unused = 0;
+
+	if (unlikely(len < (__u32)hdr_size + UK_ETH_HDR_UNTAGGED_LEN ||
+		     len > buf->len)) {
+		uk_pr_err("Received invalid packet size: %"__PRIu32"\n", len);
+		uk_netbuf_free(buf);
+		return -EINVAL;
+	}
+
+	vhdr = (struct virtio_net_hdr *) buf->data;
+	num_buffers = vhdr->num_buffers;
+	if (unlikely(num_buffers == 0)) {
+		uk_pr_err("Received packet without buffers\n");
+		uk_netbuf_free(buf);
+		return -EINVAL;
+	}
+	virtio_netdev_rxhdr_parse(vndev, buf, hdr_size);
+
+	/* Removing the virtio header from the buffer and adjusting length. */
+	buf->len = len;
+	rc = uk_netbuf_header(buf, -((__s16)hdr_size));
+	UK_ASSERT(rc == 1);
+
+	/**
+	 * The device publishes all buffers of a frame at once. Continuation
+	 * buffers contain frame data only, starting at the position where we
+	 * reserved the header.
+	 */
+	while (--num_buffers > 0) {
+		ret = virtqueue_buffer_dequeue(rxq->vq, (void **) &seg, &len);
+		if (unlikely(ret < 0)) {
+			uk_pr_err("Received incomplete merged packet\n");
+			uk_netbuf_free(buf);
+			return -EINVAL;
+		}
+		if (unlikely(len > seg->len)) {
+			uk_pr_err("Received invalid packet size: %"__PRIu32"\n",
+				  len);
+			uk_netbuf_free(seg);
+			uk_netbuf_free(buf);
+			return -EINVAL;
+		}
+		seg->flags = 0x0;
+		seg->len = len;
+		uk_netbuf_append(buf, seg);
+	}
+
+	return ret;
+}
+
 static int virtio_netdev_rxq_dequeue(struct virtio_net_device *vndev,
 				     struct uk_netdev_rx_queue *rxq,
 				     struct uk_netbuf **netbuf)
@@ -560,7 +849,6 @@ static int virtio_netdev_rxq_dequeue(struct virtio_net_device *vndev,
 	int ret;
 	int rc __maybe_unused = 0;
 	struct uk_netbuf *buf = NULL;
-	struct virtio_net_hdr *vhdr;
 	__u32 len;
 
 	UK_ASSERT(netbuf);
@@ -571,34 +859,34 @@ static int virtio_netdev_rxq_dequeue(struct virtio_net_device *vndev,
 		*netbuf = NULL;
 		return rxq->nb_desc;
 	}
+
+	if (VTNET_RX_MRG(vndev)) {
+		ret = virtio_netdev_rxq_dequeue_mrg(vndev, rxq, buf, len, ret);
+		*netbuf = (ret >= 0) ? buf : NULL;
+		return ret;
+	}
+
 	if (unlikely((len < (__u32)virtio_net_hdr_size(vndev) + UK_ETH_HDR_UNTAGGED_LEN) ||
 		     len > VIRTIO_PKT_BUFFER_LEN(vndev))) {
 		uk_pr_err("Received invalid packet size: %"__PRIu32"\n", len);
+		uk_netbuf_free(buf);
 		return -EINVAL;
 	}
 
 	/**
 	 * Copy virtio header flags to netbuf
 	 */
-	vhdr = (struct virtio_net_hdr *) buf->data;
-	buf->flags  = ((vhdr->flags & VIRTIO_NET_HDR_F_DATA_VALID)
-		       ? UK_NETBUF_F_DATA_VALID   : 0x0);
-	if (vhdr->flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) {
-		buf->flags |= UK_NETBUF_F_PARTIAL_CSUM;
-		buf->csum_offset = vhdr->csum_offset;
-		/* NOTE: csum_start is without virtio header
-		 *       (uk_netbuf_header() will remove it again)
-		 */
-		buf->csum_start  = vhdr->csum_start + VTNET_HDR_SIZE_PADDED(vndev);
-	}
+	virtio_netdev_rxhdr_parse(vndev, buf, VTNET_HDR_SIZE_PADDED(vndev));
 
 	/**
 	 * Removing the virtio header from the buffer and adjusting length.
 	 * We pad the rx buffer while enqueuing for alignment of the packet
 	 * data. We compensate for this by subtracting the padding to the
-	 * length on dequeue.
+	 * length on dequeue. The used length reported by the device
+	 * includes the header.
 	 */
-	buf->len = len + VTNET_HDR_SIZE_PADDED(vndev);
+	buf->len = len - virtio_net_hdr_size(vndev) +
+		   VTNET_HDR_SIZE_PADDED(vndev);
 	rc = uk_netbuf_header(buf, -((__s16)VTNET_HDR_SIZE_PADDED(vndev)));
 	UK_ASSERT(rc == 1);
 	*netbuf = buf;
@@ -606,9 +894,46 @@ static int virtio_netdev_rxq_dequeue(struct virtio_net_device *vndev,
 	return ret;
 }
 
-static int virtio_netdev_recv(struct uk_netdev *dev,
-			      struct uk_netdev_rx_queue *queue,
-			      struct uk_netbuf **pkt)
+/**
+ * Guest-side interrupt moderation, called when the queue is drained and the
+ * interrupt would be re-armed. A queue that received at least
+ * `coal_max_pkts` packets since the last interrupt is switched to polling:
+ * the queue is polled for up to `coal_usecs` for further packets. Only
+ * when this window passes without a packet, the queue returns to interrupt
+ * mode.
+ *
+ * @return
+ *	1 if packets arrived within the window, 0 if the interrupt has to be
+ *	re-armed
+ */
+static int virtio_netdev_rxq_coalesce(struct uk_netdev_rx_queue *rxq)
+{
+	__nsec deadline;
+
+	if (!rxq->coal_usecs)
+		return 0;
+
+	if (!rxq->coal_poll) {
+		if (rxq->coal_cnt < rxq->coal_max_pkts)
+			return 0;
+		rxq->coal_poll = 1;
+	}
+
+	deadline = ukplat_monotonic_clock() +
+		   ukarch_time_usec_to_nsec((__nsec)rxq->coal_usecs);
+	do {
+		if (virtqueue_hasdata(rxq->vq))
+			return 1;
+		ukarch_spinwait();
+	} while (ukplat_monotonic_clock() < deadline);
+
+	rxq->coal_poll = 0;
+	return 0;
+}
+
+int virtio_netdev_recv(struct uk_netdev *dev,
+		       struct uk_netdev_rx_queue *queue,
+		       struct uk_netbuf **pkt)
 {
 	struct virtio_net_device *vndev;
 	int status = 0x0;
@@ -627,14 +952,28 @@ static int virtio_netdev_recv(struct uk_netdev *dev,
 		uk_pr_err("Failed to dequeue the packet: %d\n", rc);
 		goto err_exit;
 	}
+	if (*pkt) {
+		trace_virtio_net_recv(queue->lqueue_id, 1);
+		queue->coal_cnt++;
+	}
 	status |= (*pkt) ? UK_NETDEV_STATUS_SUCCESS : 0x0;
 	status |= virtio_netdev_rx_fillup(vndev, queue, (queue->nb_desc - rc),
 					  1);
 
 	/* Enable interrupt only when user had previously enabled it */
 	if (queue->intr_enabled & VTNET_INTR_USR_EN_MASK) {
-		/* Need to enable the interrupt on the last packet */
-		rc = virtqueue_intr_enable(queue->vq);
+		/* The interrupt stays disabled while the queue is polled */
+		if (*pkt && queue->coal_poll)
+			return status | UK_NETDEV_STATUS_MORE;
+
+		/**
+		 * Need to enable the interrupt on the last packet, unless
+		 * another one arrives within the moderation window
+		 */
+		if (!(*pkt) && virtio_netdev_rxq_coalesce(queue))
+			rc = 1;
+		else
+			rc = virtqueue_intr_enable(queue->vq);
 		if (rc == 1 && !(*pkt)) {
 			/**
 			 * Packet arrive after reading the queue and before
@@ -647,6 +986,7 @@ static int virtio_netdev_recv(struct uk_netdev *dev,
 				goto err_exit;
 			}
 			status |= UK_NETDEV_STATUS_SUCCESS;
+			queue->coal_cnt++;
 
 			/*
 			 * Since we received something, we need to fillup
@@ -657,7 +997,8 @@ static int virtio_netdev_recv(struct uk_netdev *dev,
 							  1);
 
 			/* Need to enable the interrupt on the last packet */
-			rc = virtqueue_intr_enable(queue->vq);
+			rc = queue->coal_poll ? 1
+					      : virtqueue_intr_enable(queue->vq);
 			status |= (rc == 1) ? UK_NETDEV_STATUS_MORE : 0x0;
 		} else if (*pkt) {
 			/* When we originally got a packet and there is more */
@@ -677,6 +1018,79 @@ err_exit:
 	return rc;
 }
 
+int virtio_netdev_recv_burst(struct uk_netdev *dev,
+			     struct uk_netdev_rx_queue *queue,
+			     struct uk_netbuf *pkts[], __u16 cnt)
+{
+	struct virtio_net_device *vndev;
+	__u16 nb_rx = 0;
+	int used = -1;
+	int rc;
+
+	UK_ASSERT(dev && queue);
+	UK_ASSERT(pkts || cnt == 0);
+
+	vndev = to_virtionetdev(dev);
+
+	/* Queue interrupts have to be off when calling receive */
+	UK_ASSERT(!(queue->intr_enabled & VTNET_INTR_EN));
+
+	for (;;) {
+		while (nb_rx < cnt) {
+			rc = virtio_netdev_rxq_dequeue(vndev, queue,
+						       &pkts[nb_rx]);
+			if (unlikely(rc < 0)) {
+				uk_pr_err("Failed to dequeue the packet: %d\n",
+					  rc);
+				if (nb_rx == 0)
+					return rc;
+				goto out;
+			}
+			if (!pkts[nb_rx])
+				break;
+			used = rc;
+			nb_rx++;
+			queue->coal_cnt++;
+		}
+
+		/**
+		 * Re-program all consumed descriptors at once. This results
+		 * in a single notification of the host for the whole burst.
+		 */
+		if (used >= 0) {
+			virtio_netdev_rx_fillup(vndev, queue,
+						(queue->nb_desc - used), 1);
+			used = -1;
+		}
+
+		/**
+		 * Interrupts stay disabled when the burst is full. The caller
+		 * has to come back for the remaining packets.
+		 */
+		if (nb_rx == cnt ||
+		    !(queue->intr_enabled & VTNET_INTR_USR_EN_MASK))
+			break;
+
+		/**
+		 * The queue is drained: enable the interrupt. Continue
+		 * receiving if packets arrived within the moderation window,
+		 * or after reading the queue and before enabling the
+		 * interrupt.
+		 */
+		if (virtio_netdev_rxq_coalesce(queue))
+			continue;
+		if (virtqueue_intr_enable(queue->vq) != 1)
+			break;
+	}
+
+out:
+	if (used >= 0)
+		virtio_netdev_rx_fillup(vndev, queue, (queue->nb_desc - used),
+					1);
+	trace_virtio_net_recv(queue->lqueue_id, nb_rx);
+	return nb_rx;
+}
+
 static struct uk_netdev_rx_queue *virtio_netdev_rx_queue_setup(
 				struct uk_netdev *n, __u16 queue_id,
 				__u16 nb_desc,
@@ -691,7 +1105,7 @@ static struct uk_netdev_rx_queue *virtio_netdev_rx_queue_setup(
 	UK_ASSERT(conf->alloc_rxpkts);
 
 	vndev = to_virtionetdev(n);
-	if (queue_id >= vndev->max_vqueue_pairs) {
+	if (queue_id >= vndev->vqueue_pairs) {
 		uk_pr_err("Invalid virtqueue identifier: %"__PRIu16"\n",
 			  queue_id);
 		rc = -EINVAL;
@@ -709,6 +1123,25 @@ static struct uk_netdev_rx_queue *virtio_netdev_rx_queue_setup(
 	rxq->alloc_rxpkts = conf->alloc_rxpkts;
 	rxq->alloc_rxpkts_argp = conf->alloc_rxpkts_argp;
 
+	/**
+	 * The device coalesces the notifications of all queues alike, so
+	 * it gets the most relaxed settings of all queues
+	 */
+	if (VIRTIO_FEATURE_HAS(vndev->vdev->features,
+			       VIRTIO_NET_F_NOTF_COAL)) {
+		vndev->ctrl_coal.rx_usecs = MAX(vndev->ctrl_coal.rx_usecs,
+						conf->coalesce_usecs);
+		vndev->ctrl_coal.rx_max_packets =
+			MAX(vndev->ctrl_coal.rx_max_packets,
+			    conf->coalesce_max_pkts);
+		rxq->coal_usecs = 0;
+	} else {
+		rxq->coal_usecs = conf->coalesce_usecs;
+		rxq->coal_max_pkts = conf->coalesce_max_pkts;
+	}
+	rxq->coal_cnt = 0;
+	rxq->coal_poll = 0;
+
 	/* Allocate receive buffers for this queue */
 	virtio_netdev_rx_fillup(vndev, rxq, rxq->nb_desc, 0);
 
@@ -806,7 +1239,7 @@ static struct uk_netdev_tx_queue *virtio_netdev_tx_queue_setup(
 
 	UK_ASSERT(n);
 	vndev = to_virtionetdev(n);
-	if (queue_id >= vndev->max_vqueue_pairs) {
+	if (queue_id >= vndev->vqueue_pairs) {
 		uk_pr_err("Invalid virtqueue identifier: %"__PRIu16"\n",
 			  queue_id);
 		rc = -EINVAL;
@@ -840,7 +1273,7 @@ static int virtio_netdev_rxq_info_get(struct uk_netdev *dev,
 	UK_ASSERT(dev);
 	UK_ASSERT(qinfo);
 	vndev = to_virtionetdev(dev);
-	if (unlikely(queue_id >= vndev->max_vqueue_pairs)) {
+	if (unlikely(queue_id >= vndev->vqueue_pairs)) {
 		uk_pr_err("Invalid virtqueue id: %"__PRIu16"\n", queue_id);
 		rc = -EINVAL;
 		goto exit;
@@ -867,7 +1300,7 @@ static int virtio_netdev_txq_info_get(struct uk_netdev *dev,
 	UK_ASSERT(qinfo);
 
 	vndev = to_virtionetdev(dev);
-	if (unlikely(queue_id >= vndev->max_vqueue_pairs)) {
+	if (unlikely(queue_id >= vndev->vqueue_pairs)) {
 		uk_pr_err("Invalid queue_id %"__PRIu16"\n", queue_id);
 		rc = -EINVAL;
 		goto exit;
@@ -988,6 +1421,8 @@ static int virtio_netdev_feature_negotiate(struct uk_netdev *n)
 		VIRTIO_FEATURE_SET(drv_features, VIRTIO_NET_F_GSO);
 	if (VIRTIO_FEATURE_HAS(host_features, VIRTIO_NET_F_HOST_TSO4))
 		VIRTIO_FEATURE_SET(drv_features, VIRTIO_NET_F_HOST_TSO4);
+	if (VIRTIO_FEATURE_HAS(host_features, VIRTIO_NET_F_HOST_TSO6))
+		VIRTIO_FEATURE_SET(drv_features, VIRTIO_NET_F_HOST_TSO6);
 
 	/**
 	 * Use index based event supression when it's available.
@@ -998,6 +1433,81 @@ static int virtio_netdev_feature_negotiate(struct uk_netdev *n)
 	if (VIRTIO_FEATURE_HAS(host_features, VIRTIO_F_EVENT_IDX))
 		VIRTIO_FEATURE_SET(drv_features, VIRTIO_F_EVENT_IDX);
 
+	/**
+	 * Use the packed virtqueue layout when it's available. It keeps
+	 * driver and device state in a single descriptor ring.
+	 */
+	if (VIRTIO_FEATURE_HAS(host_features, VIRTIO_F_RING_PACKED))
+		VIRTIO_FEATURE_SET(drv_features, VIRTIO_F_RING_PACKED);
+
+	/**
+	 * Indirect descriptors let a fragmented packet take a single slot
+	 * of the ring.
+	 */
+	if (VIRTIO_FEATURE_HAS(host_features, VIRTIO_F_INDIRECT_DESC))
+		VIRTIO_FEATURE_SET(drv_features, VIRTIO_F_INDIRECT_DESC);
+
+	/**
+	 * Mergeable receive buffers
+	 * NOTE: A frame may span multiple receive buffers, which lets the
+	 *       host hand us coalesced TCP segments of up to 64 KiB without
+	 *       requiring each buffer to be that large.
+	 */
+	if (VIRTIO_FEATURE_HAS(host_features, VIRTIO_NET_F_MRG_RXBUF)) {
+		VIRTIO_FEATURE_SET(drv_features, VIRTIO_NET_F_MRG_RXBUF);
+#if CONFIG_LIBVIRTIO_NET_GUEST_TSO
+		/* Receive offloads depend on checksum offloading */
+		if (VIRTIO_FEATURE_HAS(drv_features,
+				       VIRTIO_NET_F_GUEST_CSUM)) {
+			if (VIRTIO_FEATURE_HAS(host_features,
+					       VIRTIO_NET_F_GUEST_TSO4))
+				VIRTIO_FEATURE_SET(drv_features,
+						   VIRTIO_NET_F_GUEST_TSO4);
+			if (VIRTIO_FEATURE_HAS(host_features,
+					       VIRTIO_NET_F_GUEST_TSO6))
+				VIRTIO_FEATURE_SET(drv_features,
+						   VIRTIO_NET_F_GUEST_TSO6);
+		}
+#endif /* CONFIG_LIBVIRTIO_NET_GUEST_TSO */
+	}
+
+	/**
+	 * Multiqueue
+	 * NOTE: The number of queue pairs can only be changed with a command
+	 *       on the control virtqueue.
+	 */
+	if (VIRTIO_FEATURE_HAS(host_features, VIRTIO_NET_F_CTRL_VQ)) {
+		VIRTIO_FEATURE_SET(drv_features, VIRTIO_NET_F_CTRL_VQ);
+		if (VIRTIO_FEATURE_HAS(host_features, VIRTIO_NET_F_MQ))
+			VIRTIO_FEATURE_SET(drv_features, VIRTIO_NET_F_MQ);
+		/* Receive interrupt moderation by the device */
+		if (VIRTIO_FEATURE_HAS(host_features, VIRTIO_NET_F_NOTF_COAL))
+			VIRTIO_FEATURE_SET(drv_features,
+					   VIRTIO_NET_F_NOTF_COAL);
+		/**
+		 * Receive-side scaling
+		 * NOTE: Steering is configured with a command on the control
+		 *       virtqueue when the device is started.
+		 */
+		if (VIRTIO_FEATURE_HAS(drv_features, VIRTIO_NET_F_MQ) &&
+		    VIRTIO_FEATURE_HAS(drv_features, VIRTIO_F_VERSION_1) &&
+		    VIRTIO_FEATURE_HAS(host_features, VIRTIO_NET_F_RSS))
+			VIRTIO_FEATURE_SET(drv_features, VIRTIO_NET_F_RSS);
+#if CONFIG_LIBVIRTIO_NET_RXHASH
+		/**
+		 * Flow hash reporting
+		 * NOTE: The hash fields are only part of the modern header.
+		 *       Hashing is enabled with a command on the control
+		 *       virtqueue when the device is started.
+		 */
+		if (VIRTIO_FEATURE_HAS(drv_features, VIRTIO_F_VERSION_1) &&
+		    VIRTIO_FEATURE_HAS(host_features,
+				       VIRTIO_NET_F_HASH_REPORT))
+			VIRTIO_FEATURE_SET(drv_features,
+					   VIRTIO_NET_F_HASH_REPORT);
+#endif /* CONFIG_LIBVIRTIO_NET_RXHASH */
+	}
+
 	/**
 	 * Announce our enabled driver features back to the backend device
 	 */
@@ -1032,6 +1542,24 @@ static int virtio_netdev_feature_negotiate(struct uk_netdev *n)
 		vndev->max_mtu = vndev->mtu = UK_ETH_PAYLOAD_MAXLEN;
 	}
 
+	vndev->max_vqueue_pairs = 1;
+	vndev->dev_max_vqueue_pairs = 1;
+	if (VIRTIO_FEATURE_HAS(drv_features, VIRTIO_NET_F_MQ)) {
+		virtio_config_get(vndev->vdev,
+				  __offsetof(struct virtio_net_config,
+					     max_virtqueue_pairs),
+				  &vndev->max_vqueue_pairs,
+				  sizeof(vndev->max_vqueue_pairs), 1);
+		if (unlikely(vndev->max_vqueue_pairs <
+			     VIRTIO_NET_CTRL_MQ_VQ_PAIRS_MIN))
+			vndev->max_vqueue_pairs = 1;
+		vndev->dev_max_vqueue_pairs = vndev->max_vqueue_pairs;
+		vndev->max_vqueue_pairs = MIN(vndev->max_vqueue_pairs,
+					CONFIG_LIBVIRTIO_NET_MAX_QUEUE_PAIRS);
+		uk_pr_debug("%p: Using up to %"__PRIu16" queue pairs\n",
+			    n, vndev->max_vqueue_pairs);
+	}
+
 	virtio_dev_status_update(vndev->vdev,
 				 (VIRTIO_CONFIG_STATUS_ACK |
 				  VIRTIO_CONFIG_STATUS_DRIVER |
@@ -1044,22 +1572,93 @@ err_negotiate_feature:
 	return rc;
 }
 
+/**
+ * Send a command on the control virtqueue and wait for its completion.
+ * @param vndev
+ *	Reference to the virtio net device.
+ * @param class
+ *	Command class (VIRTIO_NET_CTRL_*).
+ * @param cmd
+ *	Command within the class.
+ * @param data
+ *	Command specific data, read by the device.
+ * @param len
+ *	Length of the command specific data.
+ * @return
+ *	0 if the device acknowledged the command, < 0 otherwise.
+ */
+static int virtio_netdev_ctrl_cmd(struct virtio_net_device *vndev,
+				  __u8 class, __u8 cmd, void *data, __u16 len)
+{
+	struct uk_sglist *sg = &vndev->ctrl_sg;
+	void *cookie;
+	int rc;
+
+	UK_ASSERT(vndev->ctrlq);
+
+	vndev->ctrl_hdr.class = class;
+	vndev->ctrl_hdr.cmd = cmd;
+	vndev->ctrl_ack = VIRTIO_NET_ERR;
+
+	uk_sglist_reset(sg);
+	rc = uk_sglist_append(sg, &vndev->ctrl_hdr, sizeof(vndev->ctrl_hdr));
+	if (likely(rc == 0 && len))
+		rc = uk_sglist_append(sg, data, len);
+	if (likely(rc == 0))
+		rc = uk_sglist_append(sg, &vndev->ctrl_ack,
+				      sizeof(vndev->ctrl_ack));
+	if (unlikely(rc != 0))
+		return rc;
+
+	rc = virtqueue_buffer_enqueue(vndev->ctrlq, vndev, sg,
+				      sg->sg_nseg - 1, 1);
+	if (unlikely(rc < 0))
+		return rc;
+	virtqueue_host_notify(vndev->ctrlq);
+
+	/* Commands are rare and complete quickly, so we spin */
+	while (virtqueue_buffer_dequeue(vndev->ctrlq, &cookie, NULL) < 0)
+		ukarch_spinwait();
+	UK_ASSERT(cookie == vndev);
+
+	return (vndev->ctrl_ack == VIRTIO_NET_OK) ? 0 : -EIO;
+}
+
 static int virtio_netdev_rxtx_alloc(struct virtio_net_device *vndev,
 				    const struct uk_netdev_conf *conf)
 {
 	int rc = 0;
 	int i = 0;
 	int vq_avail = 0;
-	int total_vqs = conf->nb_rx_queues + conf->nb_tx_queues;
-	__u16 qdesc_size[total_vqs];
+	int has_ctrlq;
+	int total_vqs;
+	__u16 *qdesc_size = NULL;
 
-	if (unlikely(conf->nb_rx_queues != 1 || conf->nb_tx_queues != 1)) {
+	if (unlikely(conf->nb_rx_queues != conf->nb_tx_queues ||
+		     conf->nb_rx_queues < 1 ||
+		     conf->nb_rx_queues > vndev->max_vqueue_pairs)) {
 		uk_pr_err("Queue combination not supported: %"__PRIu16"/%"__PRIu16" rx/tx\n",
 			  conf->nb_rx_queues, conf->nb_tx_queues);
 
 		return -ENOTSUP;
 	}
 
+	/**
+	 * The control virtqueue follows the last queue pair that the device
+	 * supports, independent of how many of them we are going to use. We
+	 * thus have to query all virtqueues of the device in that case.
+	 */
+	has_ctrlq = VIRTIO_FEATURE_HAS(vndev->vdev->features,
+				       VIRTIO_NET_F_CTRL_VQ);
+	if (has_ctrlq)
+		total_vqs = 2 * vndev->dev_max_vqueue_pairs + 1;
+	else
+		total_vqs = 2 * vndev->max_vqueue_pairs;
+	if (unlikely(total_vqs > (int)__U16_MAX)) {
+		uk_pr_err("Too many virtqueues: %d\n", total_vqs);
+		return -ENOTSUP;
+	}
+
 	/**
 	 * TODO:
 	 * The virtio device management data structure are allocated using the
@@ -1067,9 +1666,15 @@ static int virtio_netdev_rxtx_alloc(struct virtio_net_device *vndev,
 	 * wiser to move it to the allocator of each individual queue. This
 	 * would better considering NUMA support.
 	 */
-	vndev->rxqs = uk_malloc(a, sizeof(*vndev->rxqs) * conf->nb_rx_queues);
-	vndev->txqs = uk_malloc(a, sizeof(*vndev->txqs) * conf->nb_tx_queues);
-	if (unlikely(!vndev->rxqs || !vndev->txqs)) {
+	/* Queues are cache-line aligned so that the queues served by
+	 * different CPUs do not share cache lines
+	 */
+	vndev->rxqs = uk_memalign(a, CACHE_LINE_SIZE,
+				  sizeof(*vndev->rxqs) * conf->nb_rx_queues);
+	vndev->txqs = uk_memalign(a, CACHE_LINE_SIZE,
+				  sizeof(*vndev->txqs) * conf->nb_tx_queues);
+	qdesc_size = uk_malloc(a, sizeof(*qdesc_size) * total_vqs);
+	if (unlikely(!vndev->rxqs || !vndev->txqs || !qdesc_size)) {
 		uk_pr_err("Failed to allocate memory for queue management\n");
 		rc = -ENOMEM;
 		goto err_free_txrx;
@@ -1092,7 +1697,8 @@ static int virtio_netdev_rxtx_alloc(struct virtio_net_device *vndev,
 	 * ...
 	 * Virtqueue-ctrlq
 	 */
-	for (i = 0; i < vndev->max_vqueue_pairs; i++) {
+	vndev->vqueue_pairs = conf->nb_rx_queues;
+	for (i = 0; i < vndev->vqueue_pairs; i++) {
 		/**
 		 * Initialize the received queue with the information received
 		 * from the device.
@@ -1115,17 +1721,111 @@ static int virtio_netdev_rxtx_alloc(struct virtio_net_device *vndev,
 				sizeof(vndev->txqs[i].sgsegs[0])),
 			       &vndev->txqs[i].sgsegs[0]);
 	}
+
+	if (has_ctrlq && !vndev->ctrlq) {
+		vndev->ctrlq = virtio_vqueue_setup(vndev->vdev, total_vqs - 1,
+						   qdesc_size[total_vqs - 1],
+						   NULL, a);
+		if (unlikely(PTRISERR(vndev->ctrlq))) {
+			uk_pr_err("Failed to set up the control virtqueue\n");
+			rc = PTR2ERR(vndev->ctrlq);
+			vndev->ctrlq = NULL;
+			goto err_free_txrx;
+		}
+		/* Command completion is polled */
+		virtqueue_intr_disable(vndev->ctrlq);
+		uk_sglist_init(&vndev->ctrl_sg,
+			       ARRAY_SIZE(vndev->ctrl_sgsegs),
+			       &vndev->ctrl_sgsegs[0]);
+	}
 exit:
+	if (qdesc_size)
+		uk_free(a, qdesc_size);
 	return rc;
 
 err_free_txrx:
-	if (!vndev->rxqs)
+	if (vndev->rxqs)
 		uk_free(a, vndev->rxqs);
-	if (!vndev->txqs)
+	if (vndev->txqs)
 		uk_free(a, vndev->txqs);
+	vndev->rxqs = NULL;
+	vndev->txqs = NULL;
 	goto exit;
 }
 
+/* UK_NETDEV_RSS_HASH_* are passed to the device as they are */
+UK_CTASSERT(UK_NETDEV_RSS_HASH_IPV4 == VIRTIO_NET_HASH_TYPE_IPv4);
+UK_CTASSERT(UK_NETDEV_RSS_HASH_TCPV4 == VIRTIO_NET_HASH_TYPE_TCPv4);
+UK_CTASSERT(UK_NETDEV_RSS_HASH_UDPV4 == VIRTIO_NET_HASH_TYPE_UDPv4);
+UK_CTASSERT(UK_NETDEV_RSS_HASH_IPV6 == VIRTIO_NET_HASH_TYPE_IPv6);
+UK_CTASSERT(UK_NETDEV_RSS_HASH_TCPV6 == VIRTIO_NET_HASH_TYPE_TCPv6);
+UK_CTASSERT(UK_NETDEV_RSS_HASH_UDPV6 == VIRTIO_NET_HASH_TYPE_UDPv6);
+
+/**
+ * Assemble the RSS_CONFIG command from the configuration of the device.
+ * The indirection table of the device has a fixed length; shorter tables
+ * are repeated, which keeps the mapping of the hashes.
+ */
+static int virtio_netdev_rss_prepare(struct virtio_net_device *vndev,
+				     const struct uk_netdev_conf *conf)
+{
+	const struct uk_netdev_rss_conf *rss = conf->rss;
+	struct virtio_net_rss_config_head head;
+	struct virtio_net_rss_config_tail tail;
+	__virtio_le16 table[VIRTIO_NET_RSS_MAX_TABLE_LEN];
+	__u32 hash_types;
+	__u16 table_len;
+	__u8 key_size;
+	__u8 *p;
+	int i;
+
+	if (!VIRTIO_FEATURE_HAS(vndev->vdev->features, VIRTIO_NET_F_RSS))
+		return -ENOTSUP;
+
+	virtio_config_get(vndev->vdev,
+			  __offsetof(struct virtio_net_config,
+				     supported_hash_types),
+			  &hash_types, sizeof(hash_types), 1);
+	virtio_config_get(vndev->vdev,
+			  __offsetof(struct virtio_net_config,
+				     rss_max_key_size),
+			  &key_size, sizeof(key_size), 1);
+	virtio_config_get(vndev->vdev,
+			  __offsetof(struct virtio_net_config,
+				     rss_max_indirection_table_length),
+			  &table_len, sizeof(table_len), 1);
+	if (unlikely(!key_size || !table_len))
+		return -ENOTSUP;
+
+	hash_types &= rss->hash_types ? rss->hash_types
+				      : UK_NETDEV_RSS_HASH_ALL;
+	table_len = MIN(table_len, VIRTIO_NET_RSS_MAX_TABLE_LEN);
+	table_len = 1 << (31 - __builtin_clz(table_len));
+	for (i = 0; i < table_len; i++)
+		table[i] = rss->reta ? rss->reta[i % rss->reta_size]
+				     : i % conf->nb_rx_queues;
+
+	head.hash_types = hash_types;
+	head.indirection_table_mask = table_len - 1;
+	head.unclassified_queue = table[0];
+	tail.max_tx_vq = vndev->vqueue_pairs;
+	tail.hash_key_length = MIN(key_size, UK_NETDEV_RSS_KEY_LEN);
+
+	p = vndev->ctrl_rss;
+	memcpy(p, &head, sizeof(head));
+	p += sizeof(head);
+	memcpy(p, table, table_len * sizeof(table[0]));
+	p += table_len * sizeof(table[0]);
+	memcpy(p, &tail, sizeof(tail));
+	p += sizeof(tail);
+	memcpy(p, rss->key ? rss->key : uk_netdev_rss_default_key,
+	       tail.hash_key_length);
+	p += tail.hash_key_length;
+	vndev->ctrl_rss_len = p - vndev->ctrl_rss;
+
+	return 0;
+}
+
 static int virtio_netdev_configure(struct uk_netdev *n,
 				   const struct uk_netdev_conf *conf)
 {
@@ -1142,9 +1842,17 @@ static int virtio_netdev_configure(struct uk_netdev *n,
 			  n, rc);
 	}
 
+	vndev->ctrl_rss_len = 0;
+	if (rc >= 0 && conf->rss) {
+		rc = virtio_netdev_rss_prepare(vndev, conf);
+		if (rc < 0)
+			uk_pr_err("%p: Failed to prepare RSS: %d\n", n, rc);
+	}
+
 	/* Initialize the count of the virtio-net device */
 	vndev->rx_vqueue_cnt = 0;
 	vndev->tx_vqueue_cnt = 0;
+	memset(&vndev->ctrl_coal, 0, sizeof(vndev->ctrl_coal));
 
 	return rc;
 }
@@ -1208,13 +1916,59 @@ static void virtio_net_info_get(struct uk_netdev *dev,
 				       VIRTIO_NET_F_HOST_TSO4)
 		    || VIRTIO_FEATURE_HAS(vndev->vdev->features,
 					  VIRTIO_NET_F_GSO))
-		   ? UK_NETDEV_F_TSO4 : 0);
+		   ? UK_NETDEV_F_TSO4 : 0)
+		| ((VIRTIO_FEATURE_HAS(vndev->vdev->features,
+				       VIRTIO_NET_F_HOST_TSO6)
+		    || VIRTIO_FEATURE_HAS(vndev->vdev->features,
+					  VIRTIO_NET_F_GSO))
+		   ? UK_NETDEV_F_TSO6 : 0)
+		| (VIRTIO_FEATURE_HAS(vndev->vdev->features,
+				      VIRTIO_NET_F_HASH_REPORT)
+		   ? UK_NETDEV_F_RXHASH : 0)
+		| (VIRTIO_FEATURE_HAS(vndev->vdev->features, VIRTIO_NET_F_RSS)
+		   ? UK_NETDEV_F_RSS : 0);
+}
+
+#if CONFIG_LIBVIRTIO_NET_RXHASH
+/**
+ * Enable flow hash reporting for all header fields the device supports.
+ */
+static int virtio_netdev_hash_config(struct virtio_net_device *vndev)
+{
+	struct virtio_net_hash_config *hc = &vndev->ctrl_hash;
+	__u32 hash_types;
+	__u8 key_size;
+
+	virtio_config_get(vndev->vdev,
+			  __offsetof(struct virtio_net_config,
+				     supported_hash_types),
+			  &hash_types, sizeof(hash_types), 1);
+	virtio_config_get(vndev->vdev,
+			  __offsetof(struct virtio_net_config,
+				     rss_max_key_size),
+			  &key_size, sizeof(key_size), 1);
+	if (unlikely(!hash_types || !key_size))
+		return -ENOTSUP;
+
+	memset(hc, 0, sizeof(*hc));
+	hc->hash_types = hash_types;
+	hc->hash_key_length = MIN(key_size, VIRTIO_NET_RSS_MAX_KEY_SIZE);
+	memcpy(hc->hash_key_data, uk_netdev_rss_default_key,
+	       hc->hash_key_length);
+
+	return virtio_netdev_ctrl_cmd(vndev, VIRTIO_NET_CTRL_MQ,
+				      VIRTIO_NET_CTRL_MQ_HASH_CONFIG, hc,
+				      __offsetof(struct virtio_net_hash_config,
+						 hash_key_data)
+				      + hc->hash_key_length);
 }
+#endif /* CONFIG_LIBVIRTIO_NET_RXHASH */
 
 static int virtio_net_start(struct uk_netdev *n)
 {
 	struct virtio_net_device *d;
 	int i = 0;
+	int rc;
 
 	UK_ASSERT(n != NULL);
 	d = to_virtionetdev(n);
@@ -1238,6 +1992,56 @@ static int virtio_net_start(struct uk_netdev *n)
 	 * Set the DRIVER_OK status bit. At this point the device is "live".
 	 */
 	virtio_dev_drv_up(d->vdev);
+
+	/**
+	 * The device only uses the first queue pair until we tell it
+	 * otherwise.
+	 */
+	if (d->vqueue_pairs > 1) {
+		d->ctrl_mq.virtqueue_pairs = d->vqueue_pairs;
+		rc = virtio_netdev_ctrl_cmd(d, VIRTIO_NET_CTRL_MQ,
+					    VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET,
+					    &d->ctrl_mq, sizeof(d->ctrl_mq));
+		if (unlikely(rc)) {
+			uk_pr_err(DRIVER_NAME": %"__PRIu16": Failed to enable %"__PRIu16" queue pairs: %d\n",
+				  d->uid, d->vqueue_pairs, rc);
+			return rc;
+		}
+	}
+
+	/**
+	 * RSS_CONFIG enables hash reporting as well, if negotiated. It has to
+	 * follow VQ_PAIRS_SET, which disables receive-side scaling.
+	 */
+	if (d->ctrl_rss_len) {
+		rc = virtio_netdev_ctrl_cmd(d, VIRTIO_NET_CTRL_MQ,
+					    VIRTIO_NET_CTRL_MQ_RSS_CONFIG,
+					    d->ctrl_rss, d->ctrl_rss_len);
+		if (unlikely(rc)) {
+			uk_pr_err(DRIVER_NAME": %"__PRIu16": Failed to configure RSS: %d\n",
+				  d->uid, rc);
+			return rc;
+		}
+	}
+#if CONFIG_LIBVIRTIO_NET_RXHASH
+	else if (VIRTIO_FEATURE_HAS(d->vdev->features,
+				    VIRTIO_NET_F_HASH_REPORT)) {
+		rc = virtio_netdev_hash_config(d);
+		if (unlikely(rc))
+			uk_pr_warn(DRIVER_NAME": %"__PRIu16": Failed to enable flow hashes: %d\n",
+				   d->uid, rc);
+	}
+#endif /* CONFIG_LIBVIRTIO_NET_RXHASH */
+
+	if (d->ctrl_coal.rx_usecs || d->ctrl_coal.rx_max_packets) {
+		rc = virtio_netdev_ctrl_cmd(d, VIRTIO_NET_CTRL_NOTF_COAL,
+					    VIRTIO_NET_CTRL_NOTF_COAL_RX_SET,
+					    &d->ctrl_coal,
+					    sizeof(d->ctrl_coal));
+		if (unlikely(rc))
+			uk_pr_warn(DRIVER_NAME": %"__PRIu16": Failed to enable interrupt coalescing: %d\n",
+				   d->uid, rc);
+	}
 	uk_pr_info(DRIVER_NAME": %"__PRIu16" started\n", d->uid);
 
 	for (i = 0; i < d->rx_vqueue_cnt; i++)
@@ -1262,6 +2066,64 @@ static const struct uk_netdev_ops virtio_netdev_ops = {
 	.rxq_info_get = virtio_netdev_rxq_info_get,
 };
 
+static int virtio_net_suspend(struct virtio_dev *vdev)
+{
+	struct virtio_net_device *d = vdev->priv;
+	int i;
+
+	if (uk_netdev_state_get(&d->netdev) != UK_NETDEV_RUNNING)
+		return 0;
+
+	/* Hand completed transmissions back to the stack, so that no buffer
+	 * of the snapshot belongs to a packet that was sent already
+	 */
+	for (i = 0; i < d->tx_vqueue_cnt; i++)
+		virtio_netdev_xmit_free(&d->txqs[i]);
+
+	return 0;
+}
+
+static int virtio_net_resume(struct virtio_dev *vdev)
+{
+	struct virtio_net_device *d = vdev->priv;
+	struct uk_hwaddr hw_addr;
+	__u16 status;
+	int i;
+
+	/* The device of a restored clone may have a different address */
+	virtio_config_get(vdev, __offsetof(struct virtio_net_config, mac),
+			  &hw_addr.addr_bytes[0], UK_NETDEV_HWADDR_LEN, 1);
+	if (memcmp(&hw_addr, &d->hw_addr, sizeof(hw_addr))) {
+		d->hw_addr = hw_addr;
+		uk_pr_info(DRIVER_NAME": %"__PRIu16": MAC address changed to %02x:%02x:%02x:%02x:%02x:%02x\n",
+			   d->uid, hw_addr.addr_bytes[0],
+			   hw_addr.addr_bytes[1], hw_addr.addr_bytes[2],
+			   hw_addr.addr_bytes[3], hw_addr.addr_bytes[4],
+			   hw_addr.addr_bytes[5]);
+	}
+
+	if (VIRTIO_FEATURE_HAS(vdev->features, VIRTIO_NET_F_STATUS)) {
+		virtio_config_get(vdev,
+				  __offsetof(struct virtio_net_config, status),
+				  &status, sizeof(status), 1);
+		uk_pr_info(DRIVER_NAME": %"__PRIu16": Link is %s\n", d->uid,
+			   (status & VIRTIO_NET_S_LINK_UP) ? "up" : "down");
+	}
+
+	if (uk_netdev_state_get(&d->netdev) != UK_NETDEV_RUNNING)
+		return 0;
+
+	/* Notifications that were in flight when the snapshot was taken are
+	 * lost, so tell the device again about the receive buffers
+	 */
+	for (i = 0; i < d->tx_vqueue_cnt; i++)
+		virtio_netdev_xmit_free(&d->txqs[i]);
+	for (i = 0; i < d->rx_vqueue_cnt; i++)
+		virtqueue_host_notify(d->rxqs[i].vq);
+
+	return 0;
+}
+
 static int virtio_net_add_dev(struct virtio_dev *vdev)
 {
 	struct virtio_net_device *vndev;
@@ -1275,9 +2137,12 @@ static int virtio_net_add_dev(struct virtio_dev *vdev)
 		goto err_out;
 	}
 	vndev->vdev = vdev;
+	vdev->priv = vndev;
 	/* register netdev */
 	vndev->netdev.rx_one = virtio_netdev_recv;
 	vndev->netdev.tx_one = virtio_netdev_xmit;
+	vndev->netdev.rx_burst = virtio_netdev_recv_burst;
+	vndev->netdev.tx_burst = virtio_netdev_xmit_burst;
 	vndev->netdev.ops = &virtio_netdev_ops;
 
 	rc = uk_netdev_drv_register(&vndev->netdev, a, drv_name);
@@ -1288,12 +2153,8 @@ static int virtio_net_add_dev(struct virtio_dev *vdev)
 	vndev->uid = rc;
 	rc = 0;
 	vndev->promisc = 0;
-
-	/**
-	 * TODO:
-	 * Adding multiqueue support for the virtio net driver.
-	 */
 	vndev->max_vqueue_pairs = 1;
+	vndev->dev_max_vqueue_pairs = 1;
 	uk_pr_debug("virtio-net device registered with libuknet\n");
 
 exit:
@@ -1322,6 +2183,8 @@ static const struct virtio_dev_id vnet_dev_id[] = {
 static struct virtio_driver vnet_drv = {
 	.dev_ids = vnet_dev_id,
 	.init    = virtio_net_drv_init,
-	.add_dev = virtio_net_add_dev
+	.add_dev = virtio_net_add_dev,
+	.suspend = virtio_net_suspend,
+	.resume  = virtio_net_resume
 };
 VIRTIO_BUS_REGISTER_DRIVER(&vnet_drv);
@@ -34,8 +34,7 @@
 extern "C" {
 #endif /* __cplusplus __ */
 
-/* virtio config space layout */
-/* TODO we currently support only the legacy interface */
+/* virtio config space layout of the legacy interface */
 #define VIRTIO_PCI_HOST_FEATURES        0    /* 32-bit r/o */
 #define VIRTIO_PCI_GUEST_FEATURES       4    /* 32-bit r/w */
 #define VIRTIO_PCI_QUEUE_PFN            8    /* 32-bit r/w */
@@ -63,10 +62,61 @@ extern "C" {
 #define VIRTIO_PCI_ISR_HAS_INTR         0x1  /* interrupt is for this device */
 #define VIRTIO_PCI_ISR_CONFIG           0x2  /* config change bit */
 
-/* TODO Revisit when adding MSI support. */
+/*
+ * The device configuration follows the common registers. With MSI-X
+ * enabled, the vector registers are placed in between and the device
+ * configuration moves accordingly.
+ */
 #define VIRTIO_PCI_CONFIG_OFF           20
+#define VIRTIO_MSI_CONFIG_VECTOR        20   /* 16-bit r/w */
+#define VIRTIO_MSI_QUEUE_VECTOR         22   /* 16-bit r/w */
+#define VIRTIO_PCI_CONFIG_OFF_MSIX      24
+#define VIRTIO_MSI_NO_VECTOR            0xffff
+
 #define VIRTIO_PCI_VRING_ALIGN          4096
 
+/*
+ * Modern interface (virtio 1.0): Vendor specific capabilities point to the
+ * configuration structures within the memory BARs of the device.
+ */
+#define VIRTIO_PCI_CAP_COMMON_CFG       1    /* Common configuration */
+#define VIRTIO_PCI_CAP_NOTIFY_CFG       2    /* Notifications */
+#define VIRTIO_PCI_CAP_ISR_CFG          3    /* ISR status */
+#define VIRTIO_PCI_CAP_DEVICE_CFG       4    /* Device specific config */
+#define VIRTIO_PCI_CAP_PCI_CFG          5    /* PCI config access */
+#define VIRTIO_PCI_CAP_SHARED_MEMORY_CFG 8   /* Shared memory region */
+
+/* Layout of the capabilities (struct virtio_pci_cap) */
+#define VIRTIO_PCI_CAP_CFG_TYPE         3    /* 8-bit, VIRTIO_PCI_CAP_* */
+#define VIRTIO_PCI_CAP_BAR              4    /* 8-bit */
+#define VIRTIO_PCI_CAP_OFFSET           8    /* 32-bit, within the BAR */
+#define VIRTIO_PCI_CAP_LENGTH           12   /* 32-bit */
+#define VIRTIO_PCI_NOTIFY_CAP_MULT      16   /* 32-bit, notify cap only */
+#define VIRTIO_PCI_CAP_ID               5    /* 8-bit, shared memory ID */
+#define VIRTIO_PCI_CAP_OFFSET_HI        16   /* 32-bit, 64-bit caps only */
+#define VIRTIO_PCI_CAP_LENGTH_HI        20   /* 32-bit, 64-bit caps only */
+
+/* Layout of the common configuration (struct virtio_pci_common_cfg) */
+#define VIRTIO_PCI_COMMON_DFSELECT      0    /* 32-bit r/w */
+#define VIRTIO_PCI_COMMON_DF            4    /* 32-bit r/o */
+#define VIRTIO_PCI_COMMON_GFSELECT      8    /* 32-bit r/w */
+#define VIRTIO_PCI_COMMON_GF            12   /* 32-bit r/w */
+#define VIRTIO_PCI_COMMON_MSIX          16   /* 16-bit r/w */
+#define VIRTIO_PCI_COMMON_NUMQ          18   /* 16-bit r/o */
+#define VIRTIO_PCI_COMMON_STATUS        20   /* 8-bit r/w */
+#define VIRTIO_PCI_COMMON_CFGGENERATION 21   /* 8-bit r/o */
+#define VIRTIO_PCI_COMMON_Q_SELECT      22   /* 16-bit r/w */
+#define VIRTIO_PCI_COMMON_Q_SIZE        24   /* 16-bit r/w */
+#define VIRTIO_PCI_COMMON_Q_MSIX        26   /* 16-bit r/w */
+#define VIRTIO_PCI_COMMON_Q_ENABLE      28   /* 16-bit r/w */
+#define VIRTIO_PCI_COMMON_Q_NOFF        30   /* 16-bit r/o */
+#define VIRTIO_PCI_COMMON_Q_DESCLO      32   /* 32-bit r/w */
+#define VIRTIO_PCI_COMMON_Q_DESCHI      36   /* 32-bit r/w */
+#define VIRTIO_PCI_COMMON_Q_AVAILLO     40   /* 32-bit r/w */
+#define VIRTIO_PCI_COMMON_Q_AVAILHI     44   /* 32-bit r/w */
+#define VIRTIO_PCI_COMMON_Q_USEDLO      48   /* 32-bit r/w */
+#define VIRTIO_PCI_COMMON_Q_USEDHI      52   /* 32-bit r/w */
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus __ */
@@ -34,6 +34,7 @@
 #include <uk/arch/types.h>
 #include <errno.h>
 #include <uk/alloc.h>
+#include <uk/errptr.h>
 #include <uk/print.h>
 #include <uk/plat/lcpu.h>
 #include <uk/intctlr.h>
@@ -48,6 +49,15 @@
 
 static struct uk_alloc *a;
 
+/**
+ * Notification state of a queue of the modern interface
+ */
+struct virtio_pci_queue {
+	struct virtqueue *vq;
+	/* Doorbell within the notification structure */
+	void *notify;
+};
+
 /**
  * The structure declares a pci device.
  */
@@ -60,6 +70,26 @@ struct virtio_pci_dev {
 	__u64 pci_isr_addr;
 	/* Pci device information */
 	struct pci_device *pdev;
+	/* Offset of the device configuration */
+	__u16 config_off;
+	/* IRQs of the MSI-X vectors: the configuration vector first, then
+	 * one per virtqueue. NULL if the device uses INTx.
+	 */
+	unsigned int *msix_irqs;
+	__u16 msix_nr;
+	/* Modern interface: Configuration structures that the vendor
+	 * capabilities point to. `common_cfg` is NULL for legacy devices.
+	 */
+	void *common_cfg;
+	void *device_cfg;
+	void *notify_base;
+	__u32 notify_len;
+	__u32 notify_off_mult;
+	/* Modern interface: Queues, indexed by queue ID */
+	struct virtio_pci_queue *queues;
+	__u16 nr_queues;
+	/* Notifications carry the next available position */
+	__u8 notify_data;
 };
 
 /**
@@ -91,10 +121,35 @@ static struct virtqueue *vpci_legacy_vq_setup(struct virtio_dev *vdev,
 					      struct uk_alloc *a);
 static void vpci_legacy_vq_release(struct virtio_dev *vdev,
 		struct virtqueue *vq, struct uk_alloc *a);
+static int vpci_vq_set_affinity(struct virtio_dev *vdev,
+				struct virtqueue *vq, __lcpuidx lcpu);
 static int virtio_pci_handle(void *arg);
 static int vpci_legacy_notify(struct virtio_dev *vdev, __u16 queue_id);
 static int virtio_pci_legacy_add_dev(struct pci_device *pci_dev,
 				     struct virtio_pci_dev *vpci_dev);
+static void vpci_modern_pci_dev_reset(struct virtio_dev *vdev);
+static int vpci_modern_pci_config_set(struct virtio_dev *vdev, __u16 offset,
+				      const void *buf, __u32 len);
+static int vpci_modern_pci_config_get(struct virtio_dev *vdev, __u16 offset,
+				      void *buf, __u32 len, __u8 type_len);
+static __u64 vpci_modern_pci_features_get(struct virtio_dev *vdev);
+static void vpci_modern_pci_features_set(struct virtio_dev *vdev);
+static int vpci_modern_pci_vq_find(struct virtio_dev *vdev, __u16 num_vq,
+				   __u16 *qdesc_size);
+static void vpci_modern_pci_status_set(struct virtio_dev *vdev, __u8 status);
+static __u8 vpci_modern_pci_status_get(struct virtio_dev *vdev);
+static struct virtqueue *vpci_modern_vq_setup(struct virtio_dev *vdev,
+					      __u16 queue_id,
+					      __u16 num_desc,
+					      virtqueue_callback_t callback,
+					      struct uk_alloc *a);
+static void vpci_modern_vq_release(struct virtio_dev *vdev,
+		struct virtqueue *vq, struct uk_alloc *a);
+static int vpci_modern_notify(struct virtio_dev *vdev, __u16 queue_id);
+static int vpci_modern_shm_get(struct virtio_dev *vdev, __u8 shm_id,
+			       __paddr_t *paddr, __u64 *len);
+static int virtio_pci_modern_add_dev(struct pci_device *pci_dev,
+				     struct virtio_pci_dev *vpci_dev);
 
 /**
  * Configuration operations legacy PCI device.
@@ -110,6 +165,25 @@ static struct virtio_config_ops vpci_legacy_ops = {
 	.vqs_find     = vpci_legacy_pci_vq_find,
 	.vq_setup     = vpci_legacy_vq_setup,
 	.vq_release   = vpci_legacy_vq_release,
+	.vq_set_affinity = vpci_vq_set_affinity,
+};
+
+/**
+ * Configuration operations modern (virtio 1.0) PCI device.
+ */
+static struct virtio_config_ops vpci_modern_ops = {
+	.device_reset = vpci_modern_pci_dev_reset,
+	.config_get   = vpci_modern_pci_config_get,
+	.config_set   = vpci_modern_pci_config_set,
+	.features_get = vpci_modern_pci_features_get,
+	.features_set = vpci_modern_pci_features_set,
+	.status_get   = vpci_modern_pci_status_get,
+	.status_set   = vpci_modern_pci_status_set,
+	.vqs_find     = vpci_modern_pci_vq_find,
+	.vq_setup     = vpci_modern_vq_setup,
+	.vq_release   = vpci_modern_vq_release,
+	.vq_set_affinity = vpci_vq_set_affinity,
+	.shm_get      = vpci_modern_shm_get,
 };
 
 static int vpci_legacy_notify(struct virtio_dev *vdev, __u16 queue_id)
@@ -124,6 +198,35 @@ static int vpci_legacy_notify(struct virtio_dev *vdev, __u16 queue_id)
 	return 0;
 }
 
+/* 64-bit registers of the common configuration are written as two halves */
+static inline void vpci_modern_cwrite64(void *common_cfg, __u8 offset,
+					__u64 val)
+{
+	virtio_mmio_cwrite32(common_cfg, offset, (__u32)val);
+	virtio_mmio_cwrite32(common_cfg, offset + 4, (__u32)(val >> 32));
+}
+
+static int vpci_modern_notify(struct virtio_dev *vdev, __u16 queue_id)
+{
+	struct virtio_pci_dev *vpdev;
+	struct virtio_pci_queue *q;
+
+	UK_ASSERT(vdev);
+	vpdev = to_virtiopcidev(vdev);
+	UK_ASSERT(queue_id < vpdev->nr_queues);
+	q = &vpdev->queues[queue_id];
+	UK_ASSERT(q->vq);
+
+	/* The doorbell is a plain memory write, no exit to select the queue */
+	if (vpdev->notify_data)
+		virtio_mmio_cwrite32(q->notify, 0,
+				     virtqueue_notification_data(q->vq));
+	else
+		virtio_mmio_cwrite16(q->notify, 0, queue_id);
+
+	return 0;
+}
+
 static int virtio_pci_handle(void *arg)
 {
 	struct virtio_pci_dev *d = (struct virtio_pci_dev *) arg;
@@ -134,7 +237,10 @@ static int virtio_pci_handle(void *arg)
 	UK_ASSERT(arg);
 
 	/* Reading the isr status is used to acknowledge the interrupt */
-	isr_status = virtio_cread8((void *)d->pci_isr_addr, 0);
+	if (d->common_cfg)
+		isr_status = virtio_mmio_cread8((void *)d->pci_isr_addr, 0);
+	else
+		isr_status = virtio_cread8((void *)d->pci_isr_addr, 0);
 
 	if (isr_status & VIRTIO_PCI_ISR_CONFIG) {
 		/* We don't support configuration interrupt on the device */
@@ -148,6 +254,213 @@ static int virtio_pci_handle(void *arg)
 	return rc;
 }
 
+static int virtio_pci_handle_config(void *arg)
+{
+	/* We don't support configuration interrupt on the device */
+	uk_pr_warn("Unsupported config change interrupt received on virtio-pci device %p\n",
+		   arg);
+	return 1;
+}
+
+static int virtio_pci_handle_vq(void *arg)
+{
+	/* MSI-X vectors are not shared, so the ISR status need not be read */
+	return virtqueue_ring_interrupt((struct virtqueue *)arg);
+}
+
+/* Points an MSI-X table entry to the IRQ of the entry on `lcpu` */
+static int vpci_msix_route(struct virtio_pci_dev *vpdev, __u16 entry,
+			   __lcpuidx lcpu)
+{
+	__u64 addr;
+	__u32 data;
+	int rc;
+
+	UK_ASSERT(entry < vpdev->msix_nr);
+
+	rc = uk_intctlr_irq_msi_compose(vpdev->msix_irqs[entry], lcpu,
+					pci_requester_id(vpdev->pdev),
+					&addr, &data);
+	if (unlikely(rc))
+		return rc;
+
+	pci_msix_set_entry(vpdev->pdev, entry, addr, data);
+	return 0;
+}
+
+/**
+ * Writes the vector of configuration changes (`queue` is 0) or of the
+ * selected queue and checks that the device accepted it
+ */
+static int vpci_msix_vector_set(struct virtio_pci_dev *vpdev, int queue,
+				__u16 vector)
+{
+	void *base;
+	__u8 reg;
+
+	if (vpdev->common_cfg) {
+		reg = queue ? VIRTIO_PCI_COMMON_Q_MSIX : VIRTIO_PCI_COMMON_MSIX;
+		virtio_mmio_cwrite16(vpdev->common_cfg, reg, vector);
+		if (unlikely(virtio_mmio_cread16(vpdev->common_cfg, reg)
+			     != vector))
+			return -EIO;
+		return 0;
+	}
+
+	base = (void *)(unsigned long)vpdev->pci_base_addr;
+	reg = queue ? VIRTIO_MSI_QUEUE_VECTOR : VIRTIO_MSI_CONFIG_VECTOR;
+	virtio_cwrite16(base, reg, vector);
+	if (unlikely(virtio_cread16(base, reg) != vector))
+		return -EIO;
+
+	return 0;
+}
+
+/**
+ * Switches the device to MSI-X with one vector for configuration changes
+ * and one per virtqueue. All vectors are routed to the boot CPU until
+ * `vpci_vq_set_affinity()` moves them.
+ */
+static int vpci_msix_setup(struct virtio_pci_dev *vpdev, __u16 num_vqs)
+{
+	__u16 nr = num_vqs + 1;
+	unsigned int *irqs;
+	int rc;
+
+	if (pci_msix_count(vpdev->pdev) < nr)
+		return -ENOTSUP;
+
+	irqs = uk_malloc(a, nr * sizeof(*irqs));
+	if (unlikely(!irqs))
+		return -ENOMEM;
+
+	rc = uk_intctlr_irq_alloc(irqs, nr);
+	if (unlikely(rc))
+		goto err_free;
+
+	rc = pci_msix_enable(vpdev->pdev);
+	if (unlikely(rc))
+		goto err_irq_free;
+
+	vpdev->msix_irqs = irqs;
+	vpdev->msix_nr = nr;
+
+	rc = vpci_msix_route(vpdev, 0, 0);
+	if (unlikely(rc))
+		goto err_disable;
+
+	rc = uk_intctlr_irq_register(irqs[0], virtio_pci_handle_config,
+				     vpdev);
+	if (unlikely(rc))
+		goto err_disable;
+
+	rc = vpci_msix_vector_set(vpdev, 0, 0);
+	if (unlikely(rc))
+		goto err_unregister;
+
+	if (!vpdev->common_cfg)
+		vpdev->config_off = VIRTIO_PCI_CONFIG_OFF_MSIX;
+	return 0;
+
+err_unregister:
+	uk_intctlr_irq_unregister(irqs[0], virtio_pci_handle_config);
+err_disable:
+	pci_msix_disable(vpdev->pdev);
+	vpdev->msix_irqs = NULL;
+	vpdev->msix_nr = 0;
+err_irq_free:
+	uk_intctlr_irq_free(irqs, nr);
+err_free:
+	uk_free(a, irqs);
+	return rc;
+}
+
+static int vpci_vq_msix_setup(struct virtio_pci_dev *vpdev,
+			      struct virtqueue *vq)
+{
+	__u16 entry = vq->queue_id + 1;
+	int rc;
+
+	if (unlikely(entry >= vpdev->msix_nr))
+		return -EINVAL;
+
+	rc = vpci_msix_route(vpdev, entry, 0);
+	if (unlikely(rc))
+		return rc;
+
+	rc = uk_intctlr_irq_register(vpdev->msix_irqs[entry],
+				     virtio_pci_handle_vq, vq);
+	if (unlikely(rc))
+		return rc;
+
+	/* The queue is selected by the caller */
+	rc = vpci_msix_vector_set(vpdev, 1, entry);
+	if (unlikely(rc)) {
+		uk_intctlr_irq_unregister(vpdev->msix_irqs[entry],
+					  virtio_pci_handle_vq);
+		return rc;
+	}
+
+	return 0;
+}
+
+/* The queue is selected by the caller */
+static void vpci_vq_msix_release(struct virtio_pci_dev *vpdev,
+				 struct virtqueue *vq)
+{
+	__u16 entry = vq->queue_id + 1;
+
+	vpci_msix_vector_set(vpdev, 1, VIRTIO_MSI_NO_VECTOR);
+	pci_msix_mask_entry(vpdev->pdev, entry);
+	uk_intctlr_irq_unregister(vpdev->msix_irqs[entry],
+				  virtio_pci_handle_vq);
+}
+
+/**
+ * Sets up the interrupts of the device: Prefer a dedicated MSI-X vector per
+ * queue, so that interrupts do not have to scan all queues. Fall back to
+ * the shared INTx line.
+ */
+static int vpci_irq_setup(struct virtio_pci_dev *vpdev, __u16 num_vqs)
+{
+	int rc;
+
+	rc = vpci_msix_setup(vpdev, num_vqs);
+	if (rc == 0) {
+		uk_pr_info("virtio-pci device %p uses %"__PRIu16" MSI-X vectors\n",
+			   vpdev, vpdev->msix_nr);
+		return 0;
+	}
+
+	if (rc != -ENOTSUP)
+		uk_pr_warn("Failed to enable MSI-X: %d\n", rc);
+
+	/* Registering the interrupt for the queue */
+	rc = uk_intctlr_irq_register(vpdev->pdev->irq, virtio_pci_handle,
+				     vpdev);
+	if (rc != 0) {
+		uk_pr_err("Failed to register the interrupt\n");
+		return rc;
+	}
+
+	return 0;
+}
+
+static int vpci_vq_set_affinity(struct virtio_dev *vdev,
+				struct virtqueue *vq, __lcpuidx lcpu)
+{
+	struct virtio_pci_dev *vpdev;
+
+	UK_ASSERT(vdev);
+	UK_ASSERT(vq);
+
+	vpdev = to_virtiopcidev(vdev);
+	if (!vpdev->msix_irqs)
+		return -ENOTSUP;
+
+	return vpci_msix_route(vpdev, vq->queue_id + 1, lcpu);
+}
+
 static struct virtqueue *vpci_legacy_vq_setup(struct virtio_dev *vdev,
 					      __u16 queue_id,
 					      __u16 num_desc,
@@ -158,6 +471,7 @@ static struct virtqueue *vpci_legacy_vq_setup(struct virtio_dev *vdev,
 	struct virtqueue *vq;
 	__paddr_t addr;
 	long flags;
+	int rc;
 
 	UK_ASSERT(vdev != NULL);
 
@@ -179,6 +493,20 @@ static struct virtqueue *vpci_legacy_vq_setup(struct virtio_dev *vdev,
 			VIRTIO_PCI_QUEUE_PFN,
 			addr >> VIRTIO_PCI_QUEUE_ADDR_SHIFT);
 
+	if (vpdev->msix_irqs) {
+		rc = vpci_vq_msix_setup(vpdev, vq);
+		if (unlikely(rc)) {
+			uk_pr_err("Failed to set up MSI-X for virtqueue %"
+				  __PRIu16": %d\n", queue_id, rc);
+			virtio_cwrite32((void *)(unsigned long)
+					vpdev->pci_base_addr,
+					VIRTIO_PCI_QUEUE_PFN, 0);
+			virtqueue_destroy(vq, a);
+			vq = ERR2PTR(rc);
+			goto err_exit;
+		}
+	}
+
 	flags = ukplat_lcpu_save_irqf();
 	UK_TAILQ_INSERT_TAIL(&vpdev->vdev.vqs, vq, next);
 	ukplat_lcpu_restore_irqf(flags);
@@ -203,6 +531,9 @@ static void vpci_legacy_vq_release(struct virtio_dev *vdev,
 	virtio_cwrite32((void *)(unsigned long)vpdev->pci_base_addr,
 			VIRTIO_PCI_QUEUE_PFN, 0);
 
+	if (vpdev->msix_irqs)
+		vpci_vq_msix_release(vpdev, vq);
+
 	flags = ukplat_lcpu_save_irqf();
 	UK_TAILQ_REMOVE(&vpdev->vdev.vqs, vq, next);
 	ukplat_lcpu_restore_irqf(flags);
@@ -219,13 +550,9 @@ static int vpci_legacy_pci_vq_find(struct virtio_dev *vdev, __u16 num_vqs,
 	UK_ASSERT(vdev);
 	vpdev = to_virtiopcidev(vdev);
 
-	/* Registering the interrupt for the queue */
-	rc = uk_intctlr_irq_register(vpdev->pdev->irq, virtio_pci_handle,
-				     vpdev);
-	if (rc != 0) {
-		uk_pr_err("Failed to register the interrupt\n");
+	rc = vpci_irq_setup(vpdev, num_vqs);
+	if (unlikely(rc))
 		return rc;
-	}
 
 	for (i = 0; i < num_vqs; i++) {
 		virtio_cwrite16((void *) (unsigned long)vpdev->pci_base_addr,
@@ -251,7 +578,7 @@ static int vpci_legacy_pci_config_set(struct virtio_dev *vdev, __u16 offset,
 	vpdev = to_virtiopcidev(vdev);
 
 	virtio_cwrite_bytes((void *)(unsigned long)vpdev->pci_base_addr,
-			    VIRTIO_PCI_CONFIG_OFF + offset, buf, len, 1);
+			    vpdev->config_off + offset, buf, len, 1);
 
 	return 0;
 }
@@ -269,7 +596,7 @@ static int vpci_legacy_pci_config_get(struct virtio_dev *vdev, __u16 offset,
 	if (type_len == len && type_len <= 4) {
 		virtio_cread_bytes(
 				(void *) (unsigned long)vpdev->pci_base_addr,
-				VIRTIO_PCI_CONFIG_OFF + offset, buf, len,
+				vpdev->config_off + offset, buf, len,
 				type_len);
 	} else {
 		__u32 len_bytes;
@@ -279,7 +606,7 @@ static int vpci_legacy_pci_config_get(struct virtio_dev *vdev, __u16 offset,
 
 		rc = virtio_cread_bytes_many(
 				(void *) (unsigned long)vpdev->pci_base_addr,
-				VIRTIO_PCI_CONFIG_OFF + offset,	buf, len_bytes);
+				vpdev->config_off + offset, buf, len_bytes);
 		if (unlikely(rc != (int) len_bytes))
 			return -EFAULT;
 	}
@@ -392,6 +719,436 @@ static int virtio_pci_legacy_add_dev(struct pci_device *pci_dev,
 	return 0;
 }
 
+static struct virtqueue *vpci_modern_vq_setup(struct virtio_dev *vdev,
+					      __u16 queue_id,
+					      __u16 num_desc,
+					      virtqueue_callback_t callback,
+					      struct uk_alloc *a)
+{
+	struct virtio_pci_dev *vpdev = NULL;
+	struct virtio_pci_queue *q;
+	struct virtqueue *vq;
+	__u32 notify_off;
+	long flags;
+	int rc;
+
+	UK_ASSERT(vdev != NULL);
+
+	vpdev = to_virtiopcidev(vdev);
+	if (unlikely(queue_id >= vpdev->nr_queues))
+		return ERR2PTR(-EINVAL);
+
+	q = &vpdev->queues[queue_id];
+	vq = virtqueue_create(queue_id, num_desc, VIRTIO_PCI_VRING_ALIGN,
+			      callback, vpci_modern_notify, vdev, a);
+	if (PTRISERR(vq)) {
+		uk_pr_err("Failed to create the virtqueue: %d\n",
+			  PTR2ERR(vq));
+		return vq;
+	}
+
+	virtio_mmio_cwrite16(vpdev->common_cfg, VIRTIO_PCI_COMMON_Q_SELECT,
+			     queue_id);
+
+	/* Each queue has its own doorbell, so that notifications of queues
+	 * that are served by different host threads do not contend
+	 */
+	notify_off = virtio_mmio_cread16(vpdev->common_cfg,
+					 VIRTIO_PCI_COMMON_Q_NOFF) *
+		     vpdev->notify_off_mult;
+	if (unlikely(notify_off + (vpdev->notify_data ? 4 : 2) >
+		     vpdev->notify_len)) {
+		uk_pr_err("Doorbell of virtqueue %"__PRIu16" out of range\n",
+			  queue_id);
+		rc = -EINVAL;
+		goto err_destroy;
+	}
+
+	/* The driver may use a smaller queue than the device offers */
+	virtio_mmio_cwrite16(vpdev->common_cfg, VIRTIO_PCI_COMMON_Q_SIZE,
+			     (__u16)virtqueue_vring_get_num(vq));
+	vpci_modern_cwrite64(vpdev->common_cfg, VIRTIO_PCI_COMMON_Q_DESCLO,
+			     virtqueue_physaddr(vq));
+	vpci_modern_cwrite64(vpdev->common_cfg, VIRTIO_PCI_COMMON_Q_AVAILLO,
+			     virtqueue_get_avail_addr(vq));
+	vpci_modern_cwrite64(vpdev->common_cfg, VIRTIO_PCI_COMMON_Q_USEDLO,
+			     virtqueue_get_used_addr(vq));
+
+	if (vpdev->msix_irqs) {
+		rc = vpci_vq_msix_setup(vpdev, vq);
+		if (unlikely(rc)) {
+			uk_pr_err("Failed to set up MSI-X for virtqueue %"
+				  __PRIu16": %d\n", queue_id, rc);
+			goto err_destroy;
+		}
+	}
+
+	q->vq = vq;
+	q->notify = (__u8 *)vpdev->notify_base + notify_off;
+
+	virtio_mmio_cwrite16(vpdev->common_cfg, VIRTIO_PCI_COMMON_Q_ENABLE, 1);
+
+	flags = ukplat_lcpu_save_irqf();
+	UK_TAILQ_INSERT_TAIL(&vpdev->vdev.vqs, vq, next);
+	ukplat_lcpu_restore_irqf(flags);
+
+	return vq;
+
+err_destroy:
+	virtqueue_destroy(vq, a);
+	return ERR2PTR(rc);
+}
+
+static void vpci_modern_vq_release(struct virtio_dev *vdev,
+		struct virtqueue *vq, struct uk_alloc *a)
+{
+	struct virtio_pci_dev *vpdev = NULL;
+	long flags;
+
+	UK_ASSERT(vq != NULL);
+	UK_ASSERT(a != NULL);
+	vpdev = to_virtiopcidev(vdev);
+	UK_ASSERT(vq->queue_id < vpdev->nr_queues);
+
+	/* Queues of virtio 1.0 devices cannot be disabled one by one. The
+	 * device stops using the queue with the next reset.
+	 */
+	virtio_mmio_cwrite16(vpdev->common_cfg, VIRTIO_PCI_COMMON_Q_SELECT,
+			     vq->queue_id);
+	if (vpdev->msix_irqs)
+		vpci_vq_msix_release(vpdev, vq);
+
+	flags = ukplat_lcpu_save_irqf();
+	UK_TAILQ_REMOVE(&vpdev->vdev.vqs, vq, next);
+	ukplat_lcpu_restore_irqf(flags);
+
+	vpdev->queues[vq->queue_id].vq = NULL;
+	virtqueue_destroy(vq, a);
+}
+
+static int vpci_modern_pci_vq_find(struct virtio_dev *vdev, __u16 num_vqs,
+				   __u16 *qdesc_size)
+{
+	struct virtio_pci_dev *vpdev = NULL;
+	int vq_cnt = 0, i = 0, rc = 0;
+	__u16 dev_vqs;
+
+	UK_ASSERT(vdev);
+	vpdev = to_virtiopcidev(vdev);
+
+	if (!vpdev->queues) {
+		vpdev->queues = uk_calloc(a, num_vqs, sizeof(*vpdev->queues));
+		if (unlikely(!vpdev->queues))
+			return -ENOMEM;
+		vpdev->nr_queues = num_vqs;
+	}
+	UK_ASSERT(num_vqs <= vpdev->nr_queues);
+
+	rc = vpci_irq_setup(vpdev, num_vqs);
+	if (unlikely(rc))
+		return rc;
+
+	dev_vqs = virtio_mmio_cread16(vpdev->common_cfg,
+				      VIRTIO_PCI_COMMON_NUMQ);
+	for (i = 0; i < num_vqs; i++) {
+		if (i < dev_vqs) {
+			virtio_mmio_cwrite16(vpdev->common_cfg,
+					     VIRTIO_PCI_COMMON_Q_SELECT, i);
+			qdesc_size[i] = virtio_mmio_cread16(vpdev->common_cfg,
+						VIRTIO_PCI_COMMON_Q_SIZE);
+		} else {
+			qdesc_size[i] = 0;
+		}
+		if (unlikely(!qdesc_size[i])) {
+			uk_pr_err("Virtqueue %d not available\n", i);
+			continue;
+		}
+		vq_cnt++;
+	}
+	return vq_cnt;
+}
+
+static int vpci_modern_pci_config_set(struct virtio_dev *vdev, __u16 offset,
+				      const void *buf, __u32 len)
+{
+	struct virtio_pci_dev *vpdev = NULL;
+
+	UK_ASSERT(vdev);
+	vpdev = to_virtiopcidev(vdev);
+	if (unlikely(!vpdev->device_cfg))
+		return -ENOTSUP;
+
+	virtio_mmio_cwrite_bytes(vpdev->device_cfg, offset, buf, len, 1);
+
+	return 0;
+}
+
+static int vpci_modern_pci_config_get(struct virtio_dev *vdev, __u16 offset,
+				      void *buf, __u32 len, __u8 type_len)
+{
+	struct virtio_pci_dev *vpdev = NULL;
+	__u32 len_bytes;
+	__u8 gen;
+
+	UK_ASSERT(vdev);
+	vpdev = to_virtiopcidev(vdev);
+	if (unlikely(!vpdev->device_cfg))
+		return -ENOTSUP;
+
+	if (type_len == len && type_len <= 4) {
+		len_bytes = len;
+	} else {
+		if (unlikely(__builtin_umul_overflow(len, type_len, &len_bytes)))
+			return -EFAULT;
+		type_len = 1;
+	}
+
+	/* The generation changes if the device updated the configuration
+	 * while we read it
+	 */
+	do {
+		gen = virtio_mmio_cread8(vpdev->common_cfg,
+					 VIRTIO_PCI_COMMON_CFGGENERATION);
+		virtio_mmio_cread_bytes(vpdev->device_cfg, offset, buf,
+					len_bytes, type_len);
+	} while (gen != virtio_mmio_cread8(vpdev->common_cfg,
+					   VIRTIO_PCI_COMMON_CFGGENERATION));
+
+	return 0;
+}
+
+static __u8 vpci_modern_pci_status_get(struct virtio_dev *vdev)
+{
+	struct virtio_pci_dev *vpdev = NULL;
+
+	UK_ASSERT(vdev);
+	vpdev = to_virtiopcidev(vdev);
+	return virtio_mmio_cread8(vpdev->common_cfg, VIRTIO_PCI_COMMON_STATUS);
+}
+
+static void vpci_modern_pci_status_set(struct virtio_dev *vdev, __u8 status)
+{
+	struct virtio_pci_dev *vpdev = NULL;
+
+	/* Reset should be performed using the reset interface */
+	UK_ASSERT(vdev || status != VIRTIO_CONFIG_STATUS_RESET);
+
+	vpdev = to_virtiopcidev(vdev);
+	status |= vpci_modern_pci_status_get(vdev);
+	virtio_mmio_cwrite8(vpdev->common_cfg, VIRTIO_PCI_COMMON_STATUS,
+			    status);
+}
+
+static void vpci_modern_pci_dev_reset(struct virtio_dev *vdev)
+{
+	struct virtio_pci_dev *vpdev = NULL;
+
+	UK_ASSERT(vdev);
+
+	vpdev = to_virtiopcidev(vdev);
+	virtio_mmio_cwrite8(vpdev->common_cfg, VIRTIO_PCI_COMMON_STATUS,
+			    VIRTIO_CONFIG_STATUS_RESET);
+
+	/* The reset is complete once the device reads back 0 (4.1.4.3.2) */
+	while (virtio_mmio_cread8(vpdev->common_cfg, VIRTIO_PCI_COMMON_STATUS)
+	       != VIRTIO_CONFIG_STATUS_RESET)
+		;
+}
+
+static __u64 vpci_modern_pci_features_get(struct virtio_dev *vdev)
+{
+	struct virtio_pci_dev *vpdev = NULL;
+	__u64 features;
+
+	UK_ASSERT(vdev);
+
+	vpdev = to_virtiopcidev(vdev);
+	virtio_mmio_cwrite32(vpdev->common_cfg, VIRTIO_PCI_COMMON_DFSELECT, 1);
+	features = virtio_mmio_cread32(vpdev->common_cfg, VIRTIO_PCI_COMMON_DF);
+	features <<= 32;
+
+	virtio_mmio_cwrite32(vpdev->common_cfg, VIRTIO_PCI_COMMON_DFSELECT, 0);
+	features |= virtio_mmio_cread32(vpdev->common_cfg,
+					VIRTIO_PCI_COMMON_DF);
+
+	return features;
+}
+
+static void vpci_modern_pci_features_set(struct virtio_dev *vdev)
+{
+	struct virtio_pci_dev *vpdev = NULL;
+	__u64 host_features;
+
+	UK_ASSERT(vdev);
+
+	vpdev = to_virtiopcidev(vdev);
+	host_features = vpci_modern_pci_features_get(vdev);
+
+	/* Mask out features not supported by the virtqueue driver */
+	vdev->features = virtqueue_feature_negotiate(vdev->features);
+
+	/* The modern interface implies virtio 1.0 */
+	VIRTIO_FEATURE_SET(vdev->features, VIRTIO_F_VERSION_1);
+
+	/* Transport feature, which the device drivers do not request. With
+	 * it, the device can start processing the new buffers without
+	 * reading the available ring first.
+	 */
+	if (VIRTIO_FEATURE_HAS(host_features, VIRTIO_F_NOTIFICATION_DATA))
+		VIRTIO_FEATURE_SET(vdev->features, VIRTIO_F_NOTIFICATION_DATA);
+	vpdev->notify_data = VIRTIO_FEATURE_HAS(vdev->features,
+						VIRTIO_F_NOTIFICATION_DATA);
+
+	virtio_mmio_cwrite32(vpdev->common_cfg, VIRTIO_PCI_COMMON_GFSELECT, 1);
+	virtio_mmio_cwrite32(vpdev->common_cfg, VIRTIO_PCI_COMMON_GF,
+			     (__u32)(vdev->features >> 32));
+
+	virtio_mmio_cwrite32(vpdev->common_cfg, VIRTIO_PCI_COMMON_GFSELECT, 0);
+	virtio_mmio_cwrite32(vpdev->common_cfg, VIRTIO_PCI_COMMON_GF,
+			     (__u32)vdev->features);
+}
+
+/*
+ * Shared memory regions are described by 64-bit capabilities. They are not
+ * mapped here, as they can be large and the driver decides how to map them.
+ */
+static int vpci_modern_shm_get(struct virtio_dev *vdev, __u8 shm_id,
+			       __paddr_t *paddr, __u64 *len)
+{
+	struct pci_device *pdev = to_virtiopcidev(vdev)->pdev;
+	__paddr_t base;
+	__u64 off;
+	__u8 pos, bar;
+
+	for (pos = pci_find_capability(pdev, PCI_CAP_ID_VNDR); pos;
+	     pos = pci_find_next_capability(pdev, pos, PCI_CAP_ID_VNDR)) {
+		if (pci_config_read8(pdev, pos + VIRTIO_PCI_CAP_CFG_TYPE) !=
+		    VIRTIO_PCI_CAP_SHARED_MEMORY_CFG)
+			continue;
+		if (pci_config_read8(pdev, pos + VIRTIO_PCI_CAP_ID) != shm_id)
+			continue;
+
+		bar = pci_config_read8(pdev, pos + VIRTIO_PCI_CAP_BAR);
+		if (unlikely(bar > 5))
+			return -EINVAL;
+		base = pci_bar_addr(pdev, bar);
+		if (unlikely(!base))
+			return -ENOTSUP;
+
+		off = pci_config_read32(pdev, pos + VIRTIO_PCI_CAP_OFFSET);
+		off |= (__u64)pci_config_read32(pdev,
+				pos + VIRTIO_PCI_CAP_OFFSET_HI) << 32;
+		*len = pci_config_read32(pdev, pos + VIRTIO_PCI_CAP_LENGTH);
+		*len |= (__u64)pci_config_read32(pdev,
+				pos + VIRTIO_PCI_CAP_LENGTH_HI) << 32;
+		*paddr = base + off;
+		return 0;
+	}
+
+	return -ENOENT;
+}
+
+/**
+ * Maps the structure that a vendor capability describes. The first
+ * capability of each type is the preferred one, so later ones are ignored.
+ */
+static void *vpci_modern_cap_map(struct pci_device *pdev, __u8 pos,
+				 __u32 *len)
+{
+	__u32 off;
+	__u8 bar;
+	void *p;
+
+	bar = pci_config_read8(pdev, pos + VIRTIO_PCI_CAP_BAR);
+	off = pci_config_read32(pdev, pos + VIRTIO_PCI_CAP_OFFSET);
+	*len = pci_config_read32(pdev, pos + VIRTIO_PCI_CAP_LENGTH);
+
+	p = pci_bar_map(pdev, bar, off, *len);
+	if (unlikely(PTRISERR(p))) {
+		uk_pr_warn("Failed to map virtio-pci structure at BAR %"__PRIu8
+			   " offset 0x%"__PRIx32": %d\n", bar, off, PTR2ERR(p));
+		return NULL;
+	}
+
+	return p;
+}
+
+static int virtio_pci_modern_add_dev(struct pci_device *pci_dev,
+				     struct virtio_pci_dev *vpci_dev)
+{
+	void *isr_cfg = NULL;
+	__u32 cmd, len;
+	__u8 pos, type;
+
+	for (pos = pci_find_capability(pci_dev, PCI_CAP_ID_VNDR); pos;
+	     pos = pci_find_next_capability(pci_dev, pos, PCI_CAP_ID_VNDR)) {
+		type = pci_config_read8(pci_dev, pos + VIRTIO_PCI_CAP_CFG_TYPE);
+		switch (type) {
+		case VIRTIO_PCI_CAP_COMMON_CFG:
+			if (!vpci_dev->common_cfg)
+				vpci_dev->common_cfg =
+					vpci_modern_cap_map(pci_dev, pos, &len);
+			break;
+		case VIRTIO_PCI_CAP_NOTIFY_CFG:
+			if (vpci_dev->notify_base)
+				break;
+			vpci_dev->notify_base =
+				vpci_modern_cap_map(pci_dev, pos,
+						    &vpci_dev->notify_len);
+			vpci_dev->notify_off_mult = pci_config_read32(pci_dev,
+					pos + VIRTIO_PCI_NOTIFY_CAP_MULT);
+			break;
+		case VIRTIO_PCI_CAP_ISR_CFG:
+			if (!isr_cfg)
+				isr_cfg = vpci_modern_cap_map(pci_dev, pos,
+							      &len);
+			break;
+		case VIRTIO_PCI_CAP_DEVICE_CFG:
+			if (!vpci_dev->device_cfg)
+				vpci_dev->device_cfg =
+					vpci_modern_cap_map(pci_dev, pos, &len);
+			break;
+		default:
+			break;
+		}
+	}
+
+	/* The device configuration is optional for some device types */
+	if (!vpci_dev->common_cfg || !vpci_dev->notify_base || !isr_cfg) {
+		vpci_dev->common_cfg = NULL;
+		vpci_dev->device_cfg = NULL;
+		vpci_dev->notify_base = NULL;
+		return -ENOTSUP;
+	}
+
+	vpci_dev->pci_isr_addr = (__u64)(unsigned long)isr_cfg;
+
+	/* The structures are in memory BARs and the device accesses the
+	 * queues with DMA. The upper half is the status, whose bits are
+	 * cleared by writing ones.
+	 */
+	cmd = pci_config_read32(pci_dev, PCI_COMMAND) & 0xffff;
+	pci_config_write32(pci_dev, PCI_COMMAND,
+			   cmd | PCI_COMMAND_MEMORY | PCI_COMMAND_MASTER);
+
+	/* Setting the configuration operation */
+	vpci_dev->vdev.cops = &vpci_modern_ops;
+
+	uk_pr_info("Added virtio-pci device %04x (modern)\n",
+		   pci_dev->id.device_id);
+
+	/* Mapping the virtio device identifier. Transitional devices use
+	 * legacy device IDs and keep the virtio ID in the subsystem ID.
+	 */
+	if (pci_dev->id.device_id >= VIRTIO_PCI_MODERN_DEVICEID_START)
+		vpci_dev->vdev.id.virtio_device_id =
+			pci_dev->id.device_id - VIRTIO_PCI_MODERN_DEVICEID_START;
+	else
+		vpci_dev->vdev.id.virtio_device_id =
+			pci_dev->id.subsystem_device_id;
+	return 0;
+}
+
 
 static int virtio_pci_add_dev(struct pci_device *pci_dev)
 {
@@ -409,15 +1166,28 @@ static int virtio_pci_add_dev(struct pci_device *pci_dev)
 	/* Fetch PCI Device information */
 	vpci_dev->pdev = pci_dev;
 	vpci_dev->pci_base_addr = pci_dev->base;
+	vpci_dev->config_off = VIRTIO_PCI_CONFIG_OFF;
+	vpci_dev->msix_irqs = NULL;
+	vpci_dev->msix_nr = 0;
+	vpci_dev->common_cfg = NULL;
+	vpci_dev->device_cfg = NULL;
+	vpci_dev->notify_base = NULL;
+	vpci_dev->notify_len = 0;
+	vpci_dev->notify_off_mult = 0;
+	vpci_dev->queues = NULL;
+	vpci_dev->nr_queues = 0;
+	vpci_dev->notify_data = 0;
 
 	/**
-	 * Probing for the legacy virtio device. We separate the legacy probing
-	 * with the possibility of supporting the modern PCI device in the
-	 * future.
+	 * Prefer the modern interface, which transitional devices offer in
+	 * addition to the legacy one. Fall back to the legacy interface if
+	 * the device does not provide the capabilities.
 	 */
-	rc = virtio_pci_legacy_add_dev(pci_dev, vpci_dev);
+	rc = virtio_pci_modern_add_dev(pci_dev, vpci_dev);
+	if (rc == -ENOTSUP)
+		rc = virtio_pci_legacy_add_dev(pci_dev, vpci_dev);
 	if (rc != 0) {
-		uk_pr_err("Failed to probe (legacy) pci device: %d\n", rc);
+		uk_pr_err("Failed to probe pci device: %d\n", rc);
 		goto free_pci_dev;
 	}
 
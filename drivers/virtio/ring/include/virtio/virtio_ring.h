@@ -81,6 +81,9 @@ extern "C" {
 /* Arbitrary descriptor layouts. */
 #define VIRTIO_F_ANY_LAYOUT       27
 
+/* Support for the packed virtqueue layout */
+#define VIRTIO_F_RING_PACKED      34
+
 /**
  * Virtqueue descriptors: 16 bytes.
  * These can chain together via "next".
@@ -193,6 +196,86 @@ static inline int vring_need_event(__u16 event_idx, __u16 new_idx,
 		(__u16)(new_idx - old_idx);
 }
 
+/*
+ * Packed virtqueue layout (VIRTIO v1.1 Sect. 2.7).
+ *
+ * Driver and device share a single descriptor ring. Ownership of a descriptor
+ * is encoded in the AVAIL and USED flag bits relative to a wrap counter that
+ * each side flips whenever it wraps around the ring.
+ */
+/* Marks a descriptor as available (relative to the driver wrap counter) */
+#define VRING_PACKED_DESC_F_AVAIL	(1 << 7)
+/* Marks a descriptor as used (relative to the device wrap counter) */
+#define VRING_PACKED_DESC_F_USED	(1 << 15)
+
+/* Event suppression flags */
+#define VRING_PACKED_EVENT_FLAG_ENABLE	0x0
+#define VRING_PACKED_EVENT_FLAG_DISABLE	0x1
+/* Only valid if VIRTIO_F_EVENT_IDX was negotiated */
+#define VRING_PACKED_EVENT_FLAG_DESC	0x2
+
+/* Bit of the wrap counter in the event off_wrap field */
+#define VRING_PACKED_EVENT_F_WRAP_CTR	15
+
+/* Packed virtqueue descriptors: 16 bytes. */
+struct vring_packed_desc {
+	/* Buffer address (guest-physical). */
+	__virtio_le64 addr;
+	/* Buffer length. */
+	__virtio_le32 len;
+	/* Buffer ID. */
+	__virtio_le16 id;
+	/* The flags depending on descriptor type. */
+	__virtio_le16 flags;
+};
+
+/* Driver and device event suppression structure: 4 bytes. */
+struct vring_packed_desc_event {
+	/* Descriptor ring change event offset and wrap counter */
+	__virtio_le16 off_wrap;
+	/* Descriptor ring change event flags */
+	__virtio_le16 flags;
+};
+
+struct vring_packed {
+	unsigned int num;
+
+	struct vring_packed_desc *desc;
+	/* Written by the driver, tells the device when to send interrupts */
+	struct vring_packed_desc_event *driver;
+	/* Written by the device, tells the driver when to send notifications */
+	struct vring_packed_desc_event *device;
+};
+
+/* The packed layout is a continuous chunk of memory:
+ *
+ * struct vring_packed {
+ *      // The descriptor ring (16 bytes each, 16 byte aligned)
+ *      struct vring_packed_desc desc[num];
+ *
+ *      // Driver event suppression area (4 byte aligned)
+ *      struct vring_packed_desc_event driver;
+ *
+ *      // Device event suppression area (4 byte aligned)
+ *      struct vring_packed_desc_event device;
+ * };
+ */
+static inline void vring_packed_init(struct vring_packed *vr, unsigned int num,
+				     __u8 *p)
+{
+	vr->num = num;
+	vr->desc = (struct vring_packed_desc *) p;
+	vr->driver = (struct vring_packed_desc_event *) (p +
+			num * sizeof(struct vring_packed_desc));
+	vr->device = vr->driver + 1;
+}
+
+static inline unsigned int vring_packed_size(unsigned int num)
+{
+	return num * sizeof(struct vring_packed_desc) +
+		2 * sizeof(struct vring_packed_desc_event);
+}
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus __ */
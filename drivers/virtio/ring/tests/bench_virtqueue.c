@@ -0,0 +1,112 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <string.h>
+
+#include <uk/alloc.h>
+#include <uk/bench.h>
+#include <uk/errptr.h>
+#include <uk/sglist.h>
+#include <virtio/virtio_bus.h>
+#include <virtio/virtio_ring.h>
+#include <virtio/virtqueue.h>
+
+#define BENCH_VQ_DESCS		256
+#define BENCH_VQ_SEGS		4
+#define BENCH_SEG_SIZE		512
+
+static char bench_buf[BENCH_VQ_SEGS][BENCH_SEG_SIZE];
+
+static int bench_vq_notify(struct virtio_dev *vdev __unused,
+			   __u16 queue_nr __unused)
+{
+	return 0;
+}
+
+/*
+ * There is no device that returns buffers, so the queue is created anew
+ * whenever it is full. The time for that is not measured.
+ */
+static struct virtqueue *bench_vq_create(struct virtio_dev *vdev)
+{
+	return virtqueue_create(0, BENCH_VQ_DESCS, __PAGE_SIZE, NULL,
+				bench_vq_notify, vdev, uk_alloc_get_default());
+}
+
+static void bench_vq_enqueue(struct uk_bench_ctx *b, __u64 features,
+			     __u16 nseg)
+{
+	struct uk_sglist_seg segs[BENCH_VQ_SEGS];
+	struct virtio_dev vdev;
+	struct virtqueue *vq;
+	struct uk_sglist sg;
+	__u64 i;
+	__u16 j;
+	int rc;
+
+	uk_bench_timer_stop(b);
+	memset(&vdev, 0, sizeof(vdev));
+	vdev.features = features;
+	uk_sglist_init(&sg, BENCH_VQ_SEGS, segs);
+	for (j = 0; j < nseg; j++)
+		uk_sglist_append(&sg, bench_buf[j], BENCH_SEG_SIZE);
+
+	vq = bench_vq_create(&vdev);
+	if (unlikely(PTRISERR(vq))) {
+		uk_bench_skip(b, "failed to create virtqueue: %d",
+			      PTR2ERR(vq));
+		return;
+	}
+	uk_bench_timer_start(b);
+
+	for (i = 0; i < b->n; i++) {
+		/* The last segment is written by the device */
+		rc = virtqueue_buffer_enqueue(vq, bench_buf, &sg, nseg - 1, 1);
+		if (rc > 0)
+			continue;
+
+		uk_bench_timer_stop(b);
+		virtqueue_destroy(vq, uk_alloc_get_default());
+		vq = bench_vq_create(&vdev);
+		if (unlikely(PTRISERR(vq))) {
+			uk_bench_skip(b, "failed to create virtqueue: %d",
+				      PTR2ERR(vq));
+			return;
+		}
+		uk_bench_timer_start(b);
+	}
+
+	uk_bench_timer_stop(b);
+	virtqueue_destroy(vq, uk_alloc_get_default());
+}
+
+UK_BENCHMARK_DESC(virtqueue_benchsuite, split_enqueue_1,
+		  "split ring, 1 segment")
+{
+	bench_vq_enqueue(b, 0, 1);
+}
+
+UK_BENCHMARK_DESC(virtqueue_benchsuite, split_enqueue_4,
+		  "split ring, 4 segments")
+{
+	bench_vq_enqueue(b, 0, 4);
+}
+
+#if CONFIG_LIBVIRTIO_RING_INDIRECT
+UK_BENCHMARK_DESC(virtqueue_benchsuite, split_enqueue_4_indirect,
+		  "split ring, 4 segments in an indirect table")
+{
+	bench_vq_enqueue(b, 1ULL << VIRTIO_F_INDIRECT_DESC, 4);
+}
+#endif /* CONFIG_LIBVIRTIO_RING_INDIRECT */
+
+UK_BENCHMARK_DESC(virtqueue_benchsuite, packed_enqueue_1,
+		  "packed ring, 1 segment")
+{
+	bench_vq_enqueue(b, 1ULL << VIRTIO_F_RING_PACKED, 1);
+}
+
+uk_benchsuite_register(virtqueue_benchsuite, NULL);
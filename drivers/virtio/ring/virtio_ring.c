@@ -41,6 +41,7 @@
 #include <uk/sglist.h>
 #include <uk/atomic.h>
 #include <uk/plat/io.h>
+#include <uk/trace.h>
 #include <virtio/virtio_ring.h>
 #include <virtio/virtqueue.h>
 #include <virtio/virtio_bus.h>
@@ -52,30 +53,89 @@
 #endif /* CONFIG_LIBUKVMEM */
 
 #define VIRTQUEUE_MAX_SIZE  32768
+
+UK_TRACEPOINT(trace_virtqueue_intr, "queue=%u hasdata=%d", unsigned int, int);
+UK_TRACEPOINT(trace_virtqueue_notify, "queue=%u kick=%d", unsigned int, int);
+UK_TRACEPOINT(trace_virtqueue_enqueue, "queue=%u desc=%u avail=%u",
+	      unsigned int, unsigned int, unsigned int);
+UK_TRACEPOINT(trace_virtqueue_dequeue, "queue=%u inuse=%d", unsigned int,
+	      int);
+UK_TRACEPOINT(trace_virtqueue_full, "queue=%u desc=%u avail=%u",
+	      unsigned int, unsigned int, unsigned int);
+
+#if CONFIG_LIBVIRTIO_RING_INDIRECT
+#define VIRTQUEUE_INDIRECT_MAX		CONFIG_LIBVIRTIO_RING_INDIRECT_MAX
+#define VIRTQUEUE_INDIRECT_THRESHOLD	CONFIG_LIBVIRTIO_RING_INDIRECT_THRESHOLD
+/* Split and packed descriptors share the same size */
+#define VIRTQUEUE_INDIRECT_TABLE_SIZE				\
+	(VIRTQUEUE_INDIRECT_MAX * sizeof(struct vring_desc))
+#endif /* CONFIG_LIBVIRTIO_RING_INDIRECT */
 #define to_virtqueue_vring(vq)			\
 	__containerof(vq, struct virtqueue_vring, vq)
 
 struct virtqueue_desc_info {
 	void *cookie;
 	__u16 desc_count;
+	/* Next free buffer ID (packed ring only) */
+	__u16 next_id;
 };
 
+/*
+ * The fields are grouped by the side that writes them, so that the thread
+ * making buffers available and the one reaping used buffers (e.g., TX submit
+ * and TX completion on different CPUs) do not write to the same cache line:
+ * - read-mostly fields, set up when the queue is created
+ * - driver (producer) side: making buffers available, notifying the host
+ * - device (consumer) side: reaping used buffers, interrupt suppression
+ * The free descriptors are taken by the producer and returned by the
+ * consumer, so they are kept with the producer, which touches them first.
+ */
 struct virtqueue_vring {
 	struct virtqueue vq;
 	/* Descriptor Ring */
 	struct vring vring;
+	/* Descriptor Ring, used instead of `vring` for the packed layout */
+	struct vring_packed vring_packed;
 	/* Reference to the vring */
 	void   *vring_mem;
+#if CONFIG_LIBVIRTIO_RING_INDIRECT
+	/* Pool of indirect descriptor tables, one per ring slot (split) or
+	 * buffer ID (packed); NULL if indirect descriptors are not used
+	 */
+	void   *indirect_mem;
+#endif /* CONFIG_LIBVIRTIO_RING_INDIRECT */
+
 	/* Keep track of available descriptors */
-	__u16 desc_avail;
+	__u16 desc_avail __align(CACHE_LINE_SIZE);
 	/* Index of the next available slot */
 	__u16 head_free_desc;
+	/* Available index when the host notification was last checked */
+	__u16 last_notify_avail_idx;
+	/* Packed ring: Index of the next descriptor to make available */
+	__u16 next_avail_idx;
+	/* Packed ring: Descriptors made available since the last
+	 * notification check
+	 */
+	__u16 num_added;
+	/* Packed ring: Driver (avail) wrap counter */
+	__u8 avail_wrap_counter;
+
 	/* Index of the last used descriptor by the host */
-	__u16 last_used_desc_idx;
+	__u16 last_used_desc_idx __align(CACHE_LINE_SIZE);
+	/* Packed ring: Device (used) wrap counter */
+	__u8 used_wrap_counter;
+	/* Interrupts are suppressed by the driver */
+	__u8 intr_suppressed;
+	/* Packed ring: Shadow of the driver event suppression flags */
+	__u16 event_flags_shadow;
+
 	/* Cookie to identify driver buffer */
-	struct virtqueue_desc_info vq_info[];
+	struct virtqueue_desc_info vq_info[] __align(CACHE_LINE_SIZE);
 };
 
+UK_CTASSERT(__offsetof(struct virtqueue_vring, last_used_desc_idx) -
+	    __offsetof(struct virtqueue_vring, desc_avail) >= CACHE_LINE_SIZE);
+
 /**
  * Static function Declaration(s).
  */
@@ -92,6 +152,322 @@ static inline int virtqueue_buffer_enqueue_segments(
 static void virtqueue_vring_init(struct virtqueue_vring *vrq, __u16 nr_desc,
 				 __u16 align);
 
+/**
+ * Number of buffers that the host returned but that were not dequeued yet.
+ */
+static inline __u16 virtqueue_nr_used(struct virtqueue_vring *vrq)
+{
+	return (__u16)(vrq->vring.used->idx - vrq->last_used_desc_idx);
+}
+
+/**
+ * With EVENT_IDX, interrupts are suppressed by moving used_event out of
+ * reach of the host's used index. Since the dequeue position advances, this
+ * is refreshed on every dequeue, otherwise the host would eventually pass the
+ * stale index after wrap-around and inject a spurious interrupt.
+ */
+static inline void virtqueue_used_event_suppress(struct virtqueue_vring *vrq)
+{
+	vring_used_event(&vrq->vring) =
+		vrq->last_used_desc_idx - vrq->vring.num - 1;
+}
+
+#if CONFIG_LIBVIRTIO_RING_INDIRECT
+static inline int virtqueue_use_indirect(struct virtqueue_vring *vrq,
+					 __u32 total_desc)
+{
+	return vrq->indirect_mem &&
+		total_desc >= VIRTQUEUE_INDIRECT_THRESHOLD &&
+		total_desc <= VIRTQUEUE_INDIRECT_MAX;
+}
+
+static inline void *virtqueue_indirect_table(struct virtqueue_vring *vrq,
+					     __u16 idx)
+{
+	return (__u8 *)vrq->indirect_mem + idx * VIRTQUEUE_INDIRECT_TABLE_SIZE;
+}
+#else /* !CONFIG_LIBVIRTIO_RING_INDIRECT */
+#define virtqueue_use_indirect(vrq, total_desc) (0)
+#endif /* !CONFIG_LIBVIRTIO_RING_INDIRECT */
+
+/**
+ * Packed ring implementation
+ *
+ * For the packed layout, `desc_avail` counts the free descriptors,
+ * `head_free_desc` is the head of the free buffer ID list, and
+ * `last_used_desc_idx` is the ring position where the next used descriptor
+ * is expected. `vq_info` is indexed by buffer ID.
+ */
+static inline __u16 virtqueue_packed_avail_flags(__u8 wrap_counter)
+{
+	return wrap_counter ? VRING_PACKED_DESC_F_AVAIL
+			    : VRING_PACKED_DESC_F_USED;
+}
+
+static inline int virtqueue_packed_desc_is_used(struct virtqueue_vring *vrq,
+						__u16 idx, __u8 wrap_counter)
+{
+	__u16 flags;
+	__u8 avail, used;
+
+	flags = UK_READ_ONCE(vrq->vring_packed.desc[idx].flags);
+	avail = !!(flags & VRING_PACKED_DESC_F_AVAIL);
+	used = !!(flags & VRING_PACKED_DESC_F_USED);
+	return (avail == used) && (used == wrap_counter);
+}
+
+static inline int virtqueue_packed_hasdata(struct virtqueue_vring *vrq)
+{
+	return virtqueue_packed_desc_is_used(vrq, vrq->last_used_desc_idx,
+					     vrq->used_wrap_counter);
+}
+
+static inline void virtqueue_packed_intr_disable(struct virtqueue_vring *vrq)
+{
+	if (vrq->event_flags_shadow == VRING_PACKED_EVENT_FLAG_DISABLE)
+		return;
+
+	vrq->event_flags_shadow = VRING_PACKED_EVENT_FLAG_DISABLE;
+	vrq->vring_packed.driver->flags = vrq->event_flags_shadow;
+}
+
+static int virtqueue_packed_intr_enable_delayed(struct virtqueue_vring *vrq,
+						__u16 nr_used)
+{
+	__u16 idx = vrq->last_used_desc_idx;
+	__u8 wrap_counter = vrq->used_wrap_counter;
+
+	/* The event offset counts descriptors instead of buffers. A buffer
+	 * can span multiple descriptors, so the interrupt may arrive earlier
+	 * than requested, but never later.
+	 */
+	if (vrq->vq.uses_event_idx) {
+		idx += nr_used - 1;
+		if (idx >= vrq->vring_packed.num) {
+			idx -= vrq->vring_packed.num;
+			wrap_counter ^= 1;
+		}
+	}
+
+	/* Check if enough buffers are already returned */
+	if (virtqueue_packed_desc_is_used(vrq, idx, wrap_counter))
+		return 1;
+
+	if (vrq->vq.uses_event_idx) {
+		vrq->vring_packed.driver->off_wrap = idx |
+			(wrap_counter << VRING_PACKED_EVENT_F_WRAP_CTR);
+		/* Publish the event offset before the flags */
+		wmb();
+		vrq->event_flags_shadow = VRING_PACKED_EVENT_FLAG_DESC;
+	} else {
+		vrq->event_flags_shadow = VRING_PACKED_EVENT_FLAG_ENABLE;
+	}
+	vrq->vring_packed.driver->flags = vrq->event_flags_shadow;
+
+	/* Same as for the split ring: check again after enabling, see
+	 * virtio specification section 3.2.2
+	 */
+	mb();
+	if (virtqueue_packed_desc_is_used(vrq, idx, wrap_counter)) {
+		virtqueue_packed_intr_disable(vrq);
+		return 1;
+	}
+	return 0;
+}
+
+static int virtqueue_packed_notify_enabled(struct virtqueue_vring *vrq)
+{
+	__u16 off_wrap, flags, event_idx, old, new;
+
+	off_wrap = UK_READ_ONCE(vrq->vring_packed.device->off_wrap);
+	flags = UK_READ_ONCE(vrq->vring_packed.device->flags);
+
+	new = vrq->next_avail_idx;
+	old = new - vrq->num_added;
+	vrq->num_added = 0;
+
+	if (flags != VRING_PACKED_EVENT_FLAG_DESC)
+		return (flags != VRING_PACKED_EVENT_FLAG_DISABLE);
+
+	event_idx = off_wrap & ~(1 << VRING_PACKED_EVENT_F_WRAP_CTR);
+	if ((off_wrap >> VRING_PACKED_EVENT_F_WRAP_CTR) !=
+	    vrq->avail_wrap_counter)
+		event_idx -= vrq->vring_packed.num;
+
+	return vring_need_event(event_idx, new, old);
+}
+
+static int virtqueue_packed_buffer_enqueue(struct virtqueue_vring *vrq,
+					   void *cookie, struct uk_sglist *sg,
+					   __u16 read_bufs, __u16 write_bufs)
+{
+	struct vring_packed_desc *desc;
+	struct uk_sglist_seg *segs;
+	__u16 total_desc = read_bufs + write_bufs;
+	__u16 head_idx, idx, id;
+	__u16 avail_flags, flags, head_flags = 0;
+	int i;
+
+	/* Take a free buffer ID */
+	id = vrq->head_free_desc;
+	UK_ASSERT(id < vrq->vring_packed.num);
+	vrq->head_free_desc = vrq->vq_info[id].next_id;
+	vrq->vq_info[id].cookie = cookie;
+	vrq->vq_info[id].desc_count = total_desc;
+
+	head_idx = idx = vrq->next_avail_idx;
+	avail_flags = virtqueue_packed_avail_flags(vrq->avail_wrap_counter);
+
+#if CONFIG_LIBVIRTIO_RING_INDIRECT
+	if (virtqueue_use_indirect(vrq, total_desc)) {
+		struct vring_packed_desc *table;
+
+		/* Only the WRITE flag is valid within an indirect table,
+		 * entries follow each other without NEXT chaining.
+		 */
+		table = virtqueue_indirect_table(vrq, id);
+		for (i = 0; i < total_desc; i++) {
+			segs = &sg->sg_segs[i];
+			table[i].addr = segs->ss_paddr;
+			table[i].len = segs->ss_len;
+			table[i].id = 0;
+			table[i].flags = (i >= read_bufs) ? VRING_DESC_F_WRITE
+							  : 0;
+		}
+
+		desc = &vrq->vring_packed.desc[idx];
+		desc->addr = ukplat_virt_to_phys(table);
+		desc->len = total_desc * sizeof(*table);
+		desc->id = id;
+		head_flags = avail_flags | VRING_DESC_F_INDIRECT;
+
+		total_desc = 1;
+		vrq->vq_info[id].desc_count = total_desc;
+		if (++idx >= vrq->vring_packed.num) {
+			idx = 0;
+			vrq->avail_wrap_counter ^= 1;
+		}
+		goto publish;
+	}
+#endif /* CONFIG_LIBVIRTIO_RING_INDIRECT */
+
+	for (i = 0; i < total_desc; i++) {
+		segs = &sg->sg_segs[i];
+		desc = &vrq->vring_packed.desc[idx];
+		desc->addr = segs->ss_paddr;
+		desc->len = segs->ss_len;
+		desc->id = id;
+
+		flags = avail_flags;
+		if (i >= read_bufs)
+			flags |= VRING_DESC_F_WRITE;
+		if (i < total_desc - 1)
+			flags |= VRING_DESC_F_NEXT;
+
+		/* The head is handed over to the device last */
+		if (i == 0)
+			head_flags = flags;
+		else
+			desc->flags = flags;
+
+		if (++idx >= vrq->vring_packed.num) {
+			idx = 0;
+			vrq->avail_wrap_counter ^= 1;
+			avail_flags = virtqueue_packed_avail_flags(
+						vrq->avail_wrap_counter);
+		}
+	}
+
+#if CONFIG_LIBVIRTIO_RING_INDIRECT
+publish:
+#endif /* CONFIG_LIBVIRTIO_RING_INDIRECT */
+	vrq->next_avail_idx = idx;
+	vrq->desc_avail -= total_desc;
+	vrq->num_added += total_desc;
+
+	uk_pr_debug("Old head:%d, new head:%d, total_desc:%d\n",
+		    head_idx, idx, total_desc);
+
+	/**
+	 * Write barrier to make sure that the whole chain is visible before
+	 * the head descriptor is marked as available.
+	 */
+	wmb();
+	UK_WRITE_ONCE(vrq->vring_packed.desc[head_idx].flags, head_flags);
+	return vrq->desc_avail;
+}
+
+static int virtqueue_packed_buffer_dequeue(struct virtqueue_vring *vrq,
+					   void **cookie, __u32 *len)
+{
+	struct vring_packed_desc *desc;
+	__u16 idx, id;
+
+	idx = vrq->last_used_desc_idx;
+	if (unlikely(!virtqueue_packed_desc_is_used(vrq, idx,
+						    vrq->used_wrap_counter)))
+		return -ENOMSG;
+
+	/**
+	 * We are reading from the used descriptor information updated by the
+	 * host.
+	 */
+	rmb();
+	desc = &vrq->vring_packed.desc[idx];
+	id = desc->id;
+	UK_ASSERT(id < vrq->vring_packed.num);
+	if (len)
+		*len = desc->len;
+	*cookie = vrq->vq_info[id].cookie;
+	vrq->vq_info[id].cookie = NULL;
+
+	/* The device writes a single used descriptor per buffer and skips
+	 * the remaining descriptors of the chain.
+	 */
+	vrq->desc_avail += vrq->vq_info[id].desc_count;
+	idx += vrq->vq_info[id].desc_count;
+	if (idx >= vrq->vring_packed.num) {
+		idx -= vrq->vring_packed.num;
+		vrq->used_wrap_counter ^= 1;
+	}
+	vrq->last_used_desc_idx = idx;
+
+	/* Return the buffer ID to the free list */
+	vrq->vq_info[id].next_id = vrq->head_free_desc;
+	vrq->head_free_desc = id;
+
+	if (vrq->event_flags_shadow == VRING_PACKED_EVENT_FLAG_DESC) {
+		/* Request an interrupt for the next used descriptor. The
+		 * barrier orders the update before the next check for
+		 * returned buffers.
+		 */
+		vrq->vring_packed.driver->off_wrap = idx |
+			(vrq->used_wrap_counter << VRING_PACKED_EVENT_F_WRAP_CTR);
+		mb();
+	}
+	trace_virtqueue_dequeue(vrq->vq.queue_id,
+				vrq->vring_packed.num - vrq->desc_avail);
+	return (vrq->vring_packed.num - vrq->desc_avail);
+}
+
+static void virtqueue_packed_init(struct virtqueue_vring *vrq, __u16 nr_desc)
+{
+	int i = 0;
+
+	vring_packed_init(&vrq->vring_packed, nr_desc, vrq->vring_mem);
+
+	vrq->desc_avail = nr_desc;
+	vrq->head_free_desc = 0;
+	vrq->last_used_desc_idx = 0;
+	vrq->next_avail_idx = 0;
+	vrq->num_added = 0;
+	vrq->avail_wrap_counter = 1;
+	vrq->used_wrap_counter = 1;
+	vrq->event_flags_shadow = VRING_PACKED_EVENT_FLAG_ENABLE;
+	for (i = 0; i < nr_desc; i++)
+		vrq->vq_info[i].next_id = i + 1;
+}
+
 /**
  * Driver implementation
  */
@@ -102,34 +478,48 @@ void virtqueue_intr_disable(struct virtqueue *vq)
 	UK_ASSERT(vq);
 
 	vrq = to_virtqueue_vring(vq);
+	if (vq->uses_packed_ring) {
+		virtqueue_packed_intr_disable(vrq);
+		return;
+	}
 
+	vrq->intr_suppressed = 1;
 	if (vq->uses_event_idx) {
-		vring_used_event(&vrq->vring) =
-			vrq->last_used_desc_idx - vrq->vring.num - 1;
+		virtqueue_used_event_suppress(vrq);
 		return;
 	}
 	vrq->vring.avail->flags |= (VRING_AVAIL_F_NO_INTERRUPT);
 }
 
-int virtqueue_intr_enable(struct virtqueue *vq)
+int virtqueue_intr_enable_delayed(struct virtqueue *vq, __u16 nr_used)
 {
 	struct virtqueue_vring *vrq;
 	int rc = 0;
 
 	UK_ASSERT(vq);
+	UK_ASSERT(nr_used > 0);
 
 	vrq = to_virtqueue_vring(vq);
-	/* Check if there are no more packets enabled */
-	if (!virtqueue_hasdata(vq)) {
+	if (vq->uses_packed_ring) {
+		UK_ASSERT(nr_used <= vrq->vring_packed.num);
+		return virtqueue_packed_intr_enable_delayed(vrq, nr_used);
+	}
+	UK_ASSERT(nr_used <= vrq->vring.num);
+
+	/* Check if enough buffers are already returned */
+	if (virtqueue_nr_used(vrq) < nr_used) {
+		vrq->intr_suppressed = 0;
 		if (vq->uses_event_idx) {
-			/* TODO: This allows delaying the interrupts by a
-			 *       adjustable count of descriptors. This is could
-			 *       be useful for TXQ interrupts, which can be
-			 *       handled in a batched fashion.
+			/* The host interrupts as soon as its used index
+			 * moves past used_event, which happens with the
+			 * `nr_used`-th buffer from now.
 			 */
 			vring_used_event(&vrq->vring) =
-			    vrq->last_used_desc_idx + 0;
+			    vrq->last_used_desc_idx + nr_used - 1;
 		} else {
+			/* Without EVENT_IDX, the host interrupts on the
+			 * next returned buffer.
+			 */
 			vrq->vring.avail->flags &=
 				(~VRING_AVAIL_F_NO_INTERRUPT);
 		}
@@ -145,7 +535,7 @@ int virtqueue_intr_enable(struct virtqueue *vq)
 		 */
 		mb();
 		/* Check if there are further descriptors */
-		if (virtqueue_hasdata(vq)) {
+		if (virtqueue_nr_used(vrq) >= nr_used) {
 			virtqueue_intr_disable(vq);
 			rc = 1;
 		}
@@ -159,6 +549,11 @@ int virtqueue_intr_enable(struct virtqueue *vq)
 	return rc;
 }
 
+int virtqueue_intr_enable(struct virtqueue *vq)
+{
+	return virtqueue_intr_enable_delayed(vq, 1);
+}
+
 static inline void virtqueue_ring_update_avail(struct virtqueue_vring *vrq,
 					__u16 idx)
 {
@@ -203,22 +598,45 @@ int virtqueue_notify_enabled(struct virtqueue *vq)
 {
 	struct virtqueue_vring *vrq;
 	__u16 old, new;
+	int rc;
 
 	UK_ASSERT(vq);
 	vrq = to_virtqueue_vring(vq);
-	if (vq->uses_event_idx) {
-		new = vrq->vring.avail->idx;
-		/* TODO: Use the actually submitted count instead of assuming
-		 *       that a single descriptor was submitted. This would be
-		 *       more efficient when we would have batching implemented.
+	if (vq->uses_packed_ring) {
+		rc = virtqueue_packed_notify_enabled(vrq);
+	} else if (vq->uses_event_idx) {
+		/* Consider all descriptors that were submitted since the
+		 * last check, so that a batch of buffers is covered by a
+		 * single notification.
 		 */
-		old = new - 1;
+		new = vrq->vring.avail->idx;
+		old = vrq->last_notify_avail_idx;
+		vrq->last_notify_avail_idx = new;
 
-		return vring_need_event(vring_avail_event(&vrq->vring),
-					new, old);
+		rc = vring_need_event(vring_avail_event(&vrq->vring),
+				      new, old);
+	} else {
+		rc = ((vrq->vring.used->flags & VRING_USED_F_NO_NOTIFY) == 0);
 	}
 
-	return ((vrq->vring.used->flags & VRING_USED_F_NO_NOTIFY) == 0);
+	trace_virtqueue_notify(vq->queue_id, rc);
+	return rc;
+}
+
+__u32 virtqueue_notification_data(struct virtqueue *vq)
+{
+	struct virtqueue_vring *vrq;
+	__u16 next;
+
+	UK_ASSERT(vq);
+	vrq = to_virtqueue_vring(vq);
+	if (vq->uses_packed_ring)
+		next = (vrq->next_avail_idx & 0x7fff) |
+		       ((__u16)vrq->avail_wrap_counter << 15);
+	else
+		next = vrq->vring.avail->idx;
+
+	return (__u32)vq->queue_id | ((__u32)next << 16);
 }
 
 static inline int virtqueue_buffer_enqueue_segments(
@@ -247,6 +665,41 @@ static inline int virtqueue_buffer_enqueue_segments(
 	return idx;
 }
 
+#if CONFIG_LIBVIRTIO_RING_INDIRECT
+static inline int virtqueue_buffer_enqueue_indirect(
+		struct virtqueue_vring *vrq,
+		__u16 head, struct uk_sglist *sg, __u16 read_bufs,
+		__u16 write_bufs)
+{
+	int i = 0, total_desc = 0;
+	struct uk_sglist_seg *segs;
+	struct vring_desc *table;
+
+	total_desc = read_bufs + write_bufs;
+
+	/* The table of a ring slot is reused each time the slot is */
+	table = virtqueue_indirect_table(vrq, head);
+	for (i = 0; i < total_desc; i++) {
+		segs = &sg->sg_segs[i];
+		table[i].addr = segs->ss_paddr;
+		table[i].len = segs->ss_len;
+		table[i].flags = 0;
+		if (i >= read_bufs)
+			table[i].flags |= VRING_DESC_F_WRITE;
+
+		if (i < total_desc - 1) {
+			table[i].flags |= VRING_DESC_F_NEXT;
+			table[i].next = i + 1;
+		}
+	}
+
+	vrq->vring.desc[head].addr = ukplat_virt_to_phys(table);
+	vrq->vring.desc[head].len = total_desc * sizeof(*table);
+	vrq->vring.desc[head].flags = VRING_DESC_F_INDIRECT;
+	return vrq->vring.desc[head].next;
+}
+#endif /* CONFIG_LIBVIRTIO_RING_INDIRECT */
+
 int virtqueue_hasdata(struct virtqueue *vq)
 {
 	struct virtqueue_vring *vring;
@@ -254,6 +707,9 @@ int virtqueue_hasdata(struct virtqueue *vq)
 	UK_ASSERT(vq);
 
 	vring = to_virtqueue_vring(vq);
+	if (vq->uses_packed_ring)
+		return virtqueue_packed_hasdata(vring);
+
 	return (vring->last_used_desc_idx != vring->vring.used->idx);
 }
 
@@ -265,6 +721,12 @@ __u64 virtqueue_feature_negotiate(__u64 feature_set)
 	feature |= 1ULL << VIRTIO_F_VERSION_1;
 	/* Allow event index feature */
 	feature |= 1ULL << VIRTIO_F_EVENT_IDX;
+	/* Allow packed virtqueue layout */
+	feature |= 1ULL << VIRTIO_F_RING_PACKED;
+#if CONFIG_LIBVIRTIO_RING_INDIRECT
+	/* Allow indirect descriptor tables */
+	feature |= 1ULL << VIRTIO_F_INDIRECT_DESC;
+#endif /* CONFIG_LIBVIRTIO_RING_INDIRECT */
 
 	feature &= feature_set;
 	return feature;
@@ -281,8 +743,11 @@ int virtqueue_ring_interrupt(void *obj)
 	 * by the device. In that case there's not much we
 	 * can do now but defer handling to the next irq.
 	 */
-	if (!virtqueue_hasdata(vq))
+	if (!virtqueue_hasdata(vq)) {
+		trace_virtqueue_intr(vq->queue_id, 0);
 		return 1;
+	}
+	trace_virtqueue_intr(vq->queue_id, 1);
 
 	return (likely(vq->vq_callback)) ? vq->vq_callback(vq, vq->priv) : 1;
 }
@@ -304,6 +769,12 @@ __paddr_t virtqueue_get_avail_addr(struct virtqueue *vq)
 	UK_ASSERT(vq);
 
 	vrq = to_virtqueue_vring(vq);
+	/* With the packed layout, this is the driver event area */
+	if (vq->uses_packed_ring)
+		return virtqueue_physaddr(vq) +
+			((char *)vrq->vring_packed.driver -
+			 (char *)vrq->vring_packed.desc);
+
 	return virtqueue_physaddr(vq) +
 		((char *)vrq->vring.avail - (char *)vrq->vring.desc);
 }
@@ -315,6 +786,12 @@ __paddr_t virtqueue_get_used_addr(struct virtqueue *vq)
 	UK_ASSERT(vq);
 
 	vrq = to_virtqueue_vring(vq);
+	/* With the packed layout, this is the device event area */
+	if (vq->uses_packed_ring)
+		return virtqueue_physaddr(vq) +
+			((char *)vrq->vring_packed.device -
+			 (char *)vrq->vring_packed.desc);
+
 	return virtqueue_physaddr(vq) +
 		((char *)vrq->vring.used - (char *)vrq->vring.desc);
 }
@@ -326,6 +803,9 @@ unsigned int virtqueue_vring_get_num(struct virtqueue *vq)
 	UK_ASSERT(vq);
 
 	vrq = to_virtqueue_vring(vq);
+	if (vq->uses_packed_ring)
+		return vrq->vring_packed.num;
+
 	return vrq->vring.num;
 }
 
@@ -339,6 +819,9 @@ int virtqueue_buffer_dequeue(struct virtqueue *vq, void **cookie, __u32 *len)
 	UK_ASSERT(cookie);
 	vrq = to_virtqueue_vring(vq);
 
+	if (vq->uses_packed_ring)
+		return virtqueue_packed_buffer_dequeue(vrq, cookie, len);
+
 	/* No new descriptor since last dequeue operation */
 	if (unlikely(!virtqueue_hasdata(vq)))
 		return -ENOMSG;
@@ -355,6 +838,24 @@ int virtqueue_buffer_dequeue(struct virtqueue *vq, void **cookie, __u32 *len)
 	*cookie = vrq->vq_info[head_idx].cookie;
 	virtqueue_detach_desc(vrq, head_idx);
 	vrq->vq_info[head_idx].cookie = NULL;
+
+	if (vq->uses_event_idx) {
+		if (vrq->intr_suppressed) {
+			virtqueue_used_event_suppress(vrq);
+		} else if ((__s16)(vring_used_event(&vrq->vring) -
+				   vrq->last_used_desc_idx) < 0) {
+			/* Interrupts are enabled but used_event fell behind
+			 * the dequeue position: request an interrupt for the
+			 * next returned buffer. The barrier orders the update
+			 * before the next check for returned buffers.
+			 */
+			vring_used_event(&vrq->vring) =
+				vrq->last_used_desc_idx;
+			mb();
+		}
+	}
+	trace_virtqueue_dequeue(vq->queue_id,
+				vrq->vring.num - vrq->desc_avail);
 	return (vrq->vring.num - vrq->desc_avail);
 }
 
@@ -362,41 +863,60 @@ int virtqueue_buffer_enqueue(struct virtqueue *vq, void *cookie,
 			     struct uk_sglist *sg, __u16 read_bufs,
 			     __u16 write_bufs)
 {
-	__u32 total_desc = 0;
+	__u32 total_desc = 0, ring_desc = 0;
 	__u16 head_idx = 0, idx = 0;
 	struct virtqueue_vring *vrq = NULL;
+	int indirect;
 
 	UK_ASSERT(vq);
 
 	vrq = to_virtqueue_vring(vq);
 	total_desc = read_bufs + write_bufs;
-	if (unlikely(total_desc < 1 || total_desc > vrq->vring.num)) {
+	indirect = virtqueue_use_indirect(vrq, total_desc);
+	/* An indirect table occupies a single descriptor of the ring */
+	ring_desc = indirect ? 1 : total_desc;
+	if (unlikely(total_desc < 1 ||
+		     ring_desc > virtqueue_vring_get_num(vq))) {
 		uk_pr_err("%"__PRIu32" invalid number of descriptor\n",
 			  total_desc);
 		return -EINVAL;
-	} else if (unlikely(vrq->desc_avail < total_desc)) {
+	} else if (unlikely(vrq->desc_avail < ring_desc)) {
 		uk_pr_debug("Available descriptor:%"__PRIu16", Requested descriptor:%"__PRIu32"\n",
-			  vrq->desc_avail, total_desc);
+			  vrq->desc_avail, ring_desc);
+		trace_virtqueue_full(vq->queue_id, ring_desc, vrq->desc_avail);
 		return -ENOSPC;
 	}
+	UK_ASSERT(cookie);
+	trace_virtqueue_enqueue(vq->queue_id, ring_desc,
+				vrq->desc_avail - ring_desc);
+
+	if (vq->uses_packed_ring)
+		return virtqueue_packed_buffer_enqueue(vrq, cookie, sg,
+						       read_bufs, write_bufs);
+
 	/* Get the head of free descriptor */
 	head_idx = vrq->head_free_desc;
-	UK_ASSERT(cookie);
 	/* Additional information to reconstruct the data buffer */
 	vrq->vq_info[head_idx].cookie = cookie;
-	vrq->vq_info[head_idx].desc_count = total_desc;
+	vrq->vq_info[head_idx].desc_count = ring_desc;
 
 	/**
 	 * We separate the descriptor management to enqueue segment(s).
 	 */
-	idx = virtqueue_buffer_enqueue_segments(vrq, head_idx, sg,
-			read_bufs, write_bufs);
+#if CONFIG_LIBVIRTIO_RING_INDIRECT
+	if (indirect)
+		idx = virtqueue_buffer_enqueue_indirect(vrq, head_idx, sg,
+							read_bufs, write_bufs);
+	else
+#endif /* CONFIG_LIBVIRTIO_RING_INDIRECT */
+		idx = virtqueue_buffer_enqueue_segments(vrq, head_idx, sg,
+							read_bufs, write_bufs);
 	/* Metadata maintenance for the virtqueue */
 	vrq->head_free_desc = idx;
-	vrq->desc_avail -= total_desc;
+	vrq->desc_avail -= ring_desc;
 
 	uk_pr_debug("Old head:%d, new head:%d, total_desc:%d\n",
-		    head_idx, idx, total_desc);
+		    head_idx, idx, ring_desc);
 
 	virtqueue_ring_update_avail(vrq, head_idx);
 	return vrq->desc_avail;
@@ -412,6 +932,8 @@ static void virtqueue_vring_init(struct virtqueue_vring *vrq, __u16 nr_desc,
 	vrq->desc_avail = vrq->vring.num;
 	vrq->head_free_desc = 0;
 	vrq->last_used_desc_idx = 0;
+	vrq->last_notify_avail_idx = 0;
+	vrq->intr_suppressed = 0;
 	for (i = 0; i < nr_desc - 1; i++)
 		vrq->vring.desc[i].next = i + 1;
 	/**
@@ -430,11 +952,14 @@ struct virtqueue *virtqueue_create(__u16 queue_id, __u16 nr_descs, __u16 align,
 	struct virtqueue *vq;
 	int rc;
 	__sz ring_size = 0;
+#if CONFIG_LIBVIRTIO_RING_INDIRECT
+	__sz indirect_off = 0;
+#endif /* CONFIG_LIBVIRTIO_RING_INDIRECT */
 
 	UK_ASSERT(a);
 
-	vrq = uk_malloc(a, sizeof(*vrq) +
-			nr_descs * sizeof(struct virtqueue_desc_info));
+	vrq = uk_memalign(a, CACHE_LINE_SIZE, sizeof(*vrq) +
+			  nr_descs * sizeof(struct virtqueue_desc_info));
 	if (!vrq) {
 		uk_pr_err("Allocation of virtqueue failed\n");
 		rc = -ENOMEM;
@@ -446,8 +971,25 @@ struct virtqueue *virtqueue_create(__u16 queue_id, __u16 nr_descs, __u16 align,
 	 * allocation.
 	 */
 	vrq->vring_mem = NULL;
+#if CONFIG_LIBVIRTIO_RING_INDIRECT
+	vrq->indirect_mem = NULL;
+#endif /* CONFIG_LIBVIRTIO_RING_INDIRECT */
 
-	ring_size = vring_size(nr_descs, align);
+	vq = &vrq->vq;
+	vq->uses_packed_ring =
+	    VIRTIO_FEATURE_HAS(vdev->features, VIRTIO_F_RING_PACKED);
+	if (vq->uses_packed_ring)
+		ring_size = vring_packed_size(nr_descs);
+	else
+		ring_size = vring_size(nr_descs, align);
+#if CONFIG_LIBVIRTIO_RING_INDIRECT
+	/* The indirect tables are placed right after the ring */
+	if (VIRTIO_FEATURE_HAS(vdev->features, VIRTIO_F_INDIRECT_DESC)) {
+		indirect_off = ALIGN_UP(ring_size, sizeof(struct vring_desc));
+		ring_size = indirect_off +
+			    nr_descs * VIRTQUEUE_INDIRECT_TABLE_SIZE;
+	}
+#endif /* CONFIG_LIBVIRTIO_RING_INDIRECT */
 #ifdef CONFIG_LIBUKVMEM
 	struct uk_pagetable *pt = ukplat_pt_get_active();
 	__paddr_t paddr = __PADDR_ANY;
@@ -474,9 +1016,15 @@ struct virtqueue *virtqueue_create(__u16 queue_id, __u16 nr_descs, __u16 align,
 	}
 #endif /* !CONFIG_LIBUKVMEM */
 	memset(vrq->vring_mem, 0, ring_size);
-	virtqueue_vring_init(vrq, nr_descs, align);
+#if CONFIG_LIBVIRTIO_RING_INDIRECT
+	if (indirect_off)
+		vrq->indirect_mem = (__u8 *)vrq->vring_mem + indirect_off;
+#endif /* CONFIG_LIBVIRTIO_RING_INDIRECT */
+	if (vq->uses_packed_ring)
+		virtqueue_packed_init(vrq, nr_descs);
+	else
+		virtqueue_vring_init(vrq, nr_descs, align);
 
-	vq = &vrq->vq;
 	vq->queue_id = queue_id;
 	vq->vdev = vdev;
 	vq->vq_callback = callback;
@@ -0,0 +1,199 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <inttypes.h>
+#include <uk/alloc.h>
+#include <uk/essentials.h>
+#include <uk/print.h>
+#include <uk/sglist.h>
+#include <uk/swrand.h>
+#include <virtio/virtio_bus.h>
+#include <virtio/virtio_ids.h>
+#include <virtio/virtio_config.h>
+#include <uk/plat/spinlock.h>
+
+#define DRIVER_NAME	"virtio-rng"
+/* The device has a single request queue */
+#define VIRTIO_RNG_VQ	0
+/* Entropy requested at a time */
+#define RNG_BUFSIZE	(UK_SWRAND_ENTROPY_WORDS * sizeof(__u32))
+
+static struct uk_alloc *a;
+
+struct virtio_rng_device {
+	/* Virtio device. */
+	struct virtio_dev *vdev;
+	/* Request virtqueue. */
+	struct virtqueue *vq;
+	/* Scatter-gather list. */
+	struct uk_sglist sg;
+	struct uk_sglist_seg sgsegs[1];
+	/* Set while the host did not fill the buffer yet. */
+	int pending;
+	/* Spinlock protecting the sg list, the buffer, and the vq. */
+	__spinlock spinlock;
+	/* Buffer filled by the host. */
+	__u8 buf[RNG_BUFSIZE];
+};
+
+/* Hands the buffer to the host. Called by ukswrand whenever it consumed the
+ * entropy of the last request, possibly with interrupts disabled.
+ */
+static void virtio_rng_refill(void *arg)
+{
+	struct virtio_rng_device *d = arg;
+	unsigned long flags;
+	int rc;
+
+	ukplat_spin_lock_irqsave(&d->spinlock, flags);
+	if (d->pending)
+		goto out_unlock;
+
+	uk_sglist_reset(&d->sg);
+	rc = uk_sglist_append(&d->sg, d->buf, sizeof(d->buf));
+	if (unlikely(rc < 0)) {
+		uk_pr_err(DRIVER_NAME": Failed to append to the sg list\n");
+		goto out_unlock;
+	}
+
+	rc = virtqueue_buffer_enqueue(d->vq, d, &d->sg, 0, d->sg.sg_nseg);
+	if (unlikely(rc < 0)) {
+		uk_pr_err(DRIVER_NAME": Failed to enqueue request: %d\n", rc);
+		goto out_unlock;
+	}
+	d->pending = 1;
+	virtqueue_host_notify(d->vq);
+
+out_unlock:
+	ukplat_spin_unlock_irqrestore(&d->spinlock, flags);
+}
+
+static int virtio_rng_recv(struct virtqueue *vq, void *priv)
+{
+	struct virtio_rng_device *d = priv;
+	void *cookie;
+	__u32 len;
+	int rc, handled = 0;
+
+	UK_ASSERT(vq == d->vq);
+
+	ukarch_spin_lock(&d->spinlock);
+	for (;;) {
+		rc = virtqueue_buffer_dequeue(vq, &cookie, &len);
+		if (rc < 0)
+			break;
+
+		uk_swrand_add_entropy(d->buf, MIN(len, sizeof(d->buf)));
+		d->pending = 0;
+		handled = 1;
+		if (rc == 0)
+			break;
+	}
+	ukarch_spin_unlock(&d->spinlock);
+
+	return handled;
+}
+
+static int virtio_rng_vq_alloc(struct virtio_rng_device *d)
+{
+	__u16 qdesc_size;
+	int vq_avail;
+
+	vq_avail = virtio_find_vqs(d->vdev, 1, &qdesc_size);
+	if (unlikely(vq_avail != 1)) {
+		uk_pr_err(DRIVER_NAME": Expected: %d queues, found %d\n",
+			  1, vq_avail);
+		return -ENOMEM;
+	}
+
+	d->vq = virtio_vqueue_setup(d->vdev, VIRTIO_RNG_VQ, qdesc_size,
+				    virtio_rng_recv, a);
+	if (unlikely(PTRISERR(d->vq))) {
+		uk_pr_err(DRIVER_NAME": Failed to set up virtqueue %d\n",
+			  VIRTIO_RNG_VQ);
+		return PTR2ERR(d->vq);
+	}
+	d->vq->priv = d;
+	return 0;
+}
+
+static int virtio_rng_add_dev(struct virtio_dev *vdev)
+{
+	static struct virtio_rng_device *source_dev;
+	struct virtio_rng_device *d;
+	int rc;
+
+	UK_ASSERT(vdev != NULL);
+
+	/* ukswrand takes a single entropy source */
+	if (source_dev) {
+		uk_pr_info(DRIVER_NAME": Ignoring additional device\n");
+		return 0;
+	}
+
+	d = uk_calloc(a, 1, sizeof(*d));
+	if (!d)
+		return -ENOMEM;
+	ukarch_spin_init(&d->spinlock);
+	uk_sglist_init(&d->sg, ARRAY_SIZE(d->sgsegs), d->sgsegs);
+	d->vdev = vdev;
+
+	/* The device has no features of its own */
+	d->vdev->features = 0;
+	if (VIRTIO_FEATURE_HAS(virtio_feature_get(d->vdev),
+			       VIRTIO_F_VERSION_1))
+		VIRTIO_FEATURE_SET(d->vdev->features, VIRTIO_F_VERSION_1);
+	virtio_feature_set(d->vdev);
+
+	rc = virtio_rng_vq_alloc(d);
+	if (rc) {
+		uk_pr_err(DRIVER_NAME": Could not allocate virtqueue\n");
+		goto out_status_fail;
+	}
+
+	virtqueue_intr_enable(d->vq);
+	virtio_dev_drv_up(d->vdev);
+
+	/* Issues the first request */
+	rc = uk_swrand_entropy_source_register(virtio_rng_refill, d);
+	if (unlikely(rc)) {
+		uk_pr_err(DRIVER_NAME": Failed to register entropy source: %d\n",
+			  rc);
+		goto out_release_vq;
+	}
+	source_dev = d;
+
+	uk_pr_info(DRIVER_NAME": Registered entropy source\n");
+	return 0;
+
+out_release_vq:
+	virtio_vqueue_release(d->vdev, d->vq, a);
+out_status_fail:
+	virtio_dev_status_update(d->vdev, VIRTIO_CONFIG_STATUS_FAIL);
+	uk_free(a, d);
+	return rc;
+}
+
+static int virtio_rng_drv_init(struct uk_alloc *drv_allocator)
+{
+	if (!drv_allocator)
+		return -EINVAL;
+
+	a = drv_allocator;
+	return 0;
+}
+
+static const struct virtio_dev_id vrng_dev_id[] = {
+	{VIRTIO_ID_RNG},
+	{VIRTIO_ID_INVALID} /* List Terminator */
+};
+
+static struct virtio_driver vrng_drv = {
+	.dev_ids = vrng_dev_id,
+	.init    = virtio_rng_drv_init,
+	.add_dev = virtio_rng_add_dev
+};
+VIRTIO_BUS_REGISTER_DRIVER(&vrng_drv);
@@ -0,0 +1,46 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * Addresses of AF_VSOCK sockets, compatible with <linux/vm_sockets.h>.
+ * Applications that bring their own copy of that header can keep using it.
+ */
+
+#ifndef __UK_VSOCK_H__
+#define __UK_VSOCK_H__
+
+#include <sys/socket.h>
+
+#ifndef AF_VSOCK
+#define AF_VSOCK	40
+#endif /* !AF_VSOCK */
+
+#ifndef VMADDR_CID_ANY
+#define VMADDR_CID_ANY		((unsigned int)-1)
+#define VMADDR_PORT_ANY		((unsigned int)-1)
+#define VMADDR_CID_HYPERVISOR	0
+#define VMADDR_CID_LOCAL	1
+#define VMADDR_CID_HOST		2
+
+/* Options at socket level AF_VSOCK */
+#define SO_VM_SOCKETS_BUFFER_SIZE	0
+
+struct sockaddr_vm {
+	sa_family_t svm_family;
+	unsigned short svm_reserved1;
+	unsigned int svm_port;
+	unsigned int svm_cid;
+	unsigned char svm_flags;
+	unsigned char svm_zero[sizeof(struct sockaddr) -
+			       sizeof(sa_family_t) -
+			       sizeof(unsigned short) -
+			       sizeof(unsigned int) -
+			       sizeof(unsigned int) -
+			       sizeof(unsigned char)];
+};
+#endif /* !VMADDR_CID_ANY */
+
+#endif /* __UK_VSOCK_H__ */
@@ -0,0 +1,75 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __VIRTIO_VSOCK_H__
+#define __VIRTIO_VSOCK_H__
+
+#include <uk/config.h>
+#include <uk/arch/types.h>
+
+#include <virtio/virtio_ids.h>
+#include <virtio/virtio_config.h>
+#include <virtio/virtio_types.h>
+
+/* Feature bitmap for virtio vsock. */
+#define VIRTIO_VSOCK_F_STREAM		0
+#define VIRTIO_VSOCK_F_SEQPACKET	1
+
+#define VIRTIO_VSOCK_RX_VQ		0
+#define VIRTIO_VSOCK_TX_VQ		1
+#define VIRTIO_VSOCK_EVENT_VQ		2
+#define VIRTIO_VSOCK_VQ_MAX		3
+
+/* Virtio vsock configuration space layout. */
+struct virtio_vsock_config {
+	__u64 guest_cid;
+} __packed;
+
+/* Header of every packet on the rx and tx queues */
+struct virtio_vsock_hdr {
+	__u64 src_cid;
+	__u64 dst_cid;
+	__u32 src_port;
+	__u32 dst_port;
+	/* Length of the payload following the header */
+	__u32 len;
+	__u16 type;
+	__u16 op;
+	__u32 flags;
+	/* Receive buffer space of the sender */
+	__u32 buf_alloc;
+	/* Bytes the sender consumed from its receive buffer so far */
+	__u32 fwd_cnt;
+} __packed;
+
+#define VIRTIO_VSOCK_TYPE_STREAM	1
+#define VIRTIO_VSOCK_TYPE_SEQPACKET	2
+
+#define VIRTIO_VSOCK_OP_INVALID		0
+#define VIRTIO_VSOCK_OP_REQUEST		1
+#define VIRTIO_VSOCK_OP_RESPONSE	2
+#define VIRTIO_VSOCK_OP_RST		3
+#define VIRTIO_VSOCK_OP_SHUTDOWN	4
+#define VIRTIO_VSOCK_OP_RW		5
+#define VIRTIO_VSOCK_OP_CREDIT_UPDATE	6
+#define VIRTIO_VSOCK_OP_CREDIT_REQUEST	7
+
+/* Flags of VIRTIO_VSOCK_OP_SHUTDOWN */
+#define VIRTIO_VSOCK_SHUTDOWN_RCV	1
+#define VIRTIO_VSOCK_SHUTDOWN_SEND	2
+
+/* Flags of VIRTIO_VSOCK_OP_RW on seqpacket connections */
+#define VIRTIO_VSOCK_SEQ_EOM		1
+#define VIRTIO_VSOCK_SEQ_EOR		2
+
+/* Buffers on the event queue */
+struct virtio_vsock_event {
+	__u32 id;
+} __packed;
+
+#define VIRTIO_VSOCK_EVENT_TRANSPORT_RESET	0
+
+#endif /* __VIRTIO_VSOCK_H__ */
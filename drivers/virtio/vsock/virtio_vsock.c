@@ -0,0 +1,1676 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+/*
+ * Virtio vsock
+ *
+ * The device multiplexes all connections over a single rx and tx queue. Every
+ * packet tells the other side how much receive buffer space its sender has and
+ * how many bytes of it were consumed so far, from which the other side derives
+ * how much it may still send (credit). Incoming data is copied out of the
+ * device buffers into per-connection queues, so that the buffers go back to
+ * the device right away.
+ *
+ * Interrupts only wake the vsock thread, which processes the queues. A single
+ * mutex protects the connection state, so that socket events can be raised
+ * while holding it.
+ */
+#include <string.h>
+#include <uk/alloc.h>
+#include <uk/arch/limits.h>
+#include <uk/essentials.h>
+#include <uk/list.h>
+#include <uk/mutex.h>
+#include <uk/print.h>
+#include <uk/sched.h>
+#include <uk/sglist.h>
+#include <uk/socket_driver.h>
+#include <uk/vsock.h>
+#include <uk/wait.h>
+#include <virtio/virtio_bus.h>
+#include <virtio/virtio_vsock.h>
+
+#define DRIVER_NAME	"virtio-vsock"
+
+/* Payload capacity of the buffers on the rx queue */
+#define VSOCK_RX_BUF_SIZE	4096
+/* Maximum payload of a packet that we send */
+#define VSOCK_PKT_MAX		0x10000
+#define VSOCK_SG_SEGS		((VSOCK_PKT_MAX >> 12) + 2)
+#define VSOCK_EVENT_BUFS	4
+
+#define VSOCK_BUF_ALLOC		((__u32)CONFIG_LIBVIRTIO_VSOCK_BUF_SIZE << 10)
+#define VSOCK_BUF_ALLOC_MIN	4096
+#define VSOCK_BUF_ALLOC_MAX	(16U << 20)
+
+/* First port handed out to sockets that are not explicitly bound */
+#define VSOCK_PORT_EPHEMERAL	1024
+
+#define VSOCK_SHUTDOWN_BOTH \
+	(VIRTIO_VSOCK_SHUTDOWN_RCV | VIRTIO_VSOCK_SHUTDOWN_SEND)
+
+static struct uk_alloc *a;
+
+struct vsock_rxbuf {
+	struct virtio_vsock_hdr hdr;
+	__u8 data[VSOCK_RX_BUF_SIZE];
+};
+
+struct vsock_txpkt {
+	/* Entry in the list of packets waiting for the tx queue */
+	struct uk_list_head list;
+	struct virtio_vsock_hdr hdr;
+	__u8 data[];
+};
+
+struct vsock_dev {
+	/* Virtio device. */
+	struct virtio_dev *vdev;
+	/* Virtqueues. */
+	struct virtqueue *vq[VIRTIO_VSOCK_VQ_MAX];
+	/* Scatter-gather list. */
+	struct uk_sglist sg;
+	struct uk_sglist_seg sgsegs[VSOCK_SG_SEGS];
+	/* Set by interrupts to wake up the vsock thread. */
+	int kick;
+	struct uk_waitq wq;
+	/* Our context ID. */
+	__u64 cid;
+	/* Set if seqpacket sockets were negotiated. */
+	int seqpacket;
+	/* Packets that did not fit into the tx queue yet. */
+	struct uk_list_head txpend;
+	struct virtio_vsock_event events[VSOCK_EVENT_BUFS];
+};
+
+/* Received data of a connection */
+struct vsock_chunk {
+	struct uk_list_head list;
+	__u32 len;
+	__u32 off;
+	/* Flags of the packet (e.g., end of a seqpacket message) */
+	__u32 flags;
+	__u8 data[];
+};
+
+enum vsock_state {
+	VSOCK_SS_UNCONNECTED = 0,
+	VSOCK_SS_LISTEN,
+	VSOCK_SS_CONNECTING,
+	VSOCK_SS_CONNECTED,
+	/* Connection was reset or closed by the peer */
+	VSOCK_SS_CLOSED,
+};
+
+#define VSOCK_F_BOUND	0x1
+
+struct vsock_sock {
+	/* Entry in vsock_socks */
+	struct uk_list_head link;
+	/* Socket file, NULL until the socket layer polls the socket */
+	posix_sock *file;
+	struct uk_alloc *alloc;
+	int type;
+	enum vsock_state state;
+	unsigned int flags;
+	/* Events last assigned to the file */
+	unsigned int events;
+	/* Pending error reported by SO_ERROR */
+	int err;
+	/* VIRTIO_VSOCK_SHUTDOWN_* of this side and the peer */
+	unsigned int shut;
+	unsigned int peer_shut;
+	__u32 port;
+	__u64 peer_cid;
+	__u32 peer_port;
+	/* Received data */
+	struct uk_list_head rxq;
+	__u32 rx_bytes;
+	/* Complete seqpacket messages in rxq */
+	unsigned int rx_msgs;
+	/* Credit we grant the peer */
+	__u32 buf_alloc;
+	__u32 fwd_cnt;
+	__u32 fwd_cnt_sent;
+	/* Credit the peer grants us */
+	__u32 peer_buf_alloc;
+	__u32 peer_fwd_cnt;
+	__u32 tx_cnt;
+	/* Listening sockets: connections not yet accepted */
+	struct uk_list_head acceptq;
+	int backlog;
+	int nacc;
+	/* Entry in the acceptq of the listener, until accepted */
+	struct uk_list_head acc_link;
+	struct vsock_sock *listener;
+};
+
+static struct vsock_dev *vsock_dev;
+/* Protects all sockets and the tx queue */
+static struct uk_mutex vsock_lock = UK_MUTEX_INITIALIZER(vsock_lock);
+static UK_LIST_HEAD(vsock_socks);
+static __u32 vsock_next_port = VSOCK_PORT_EPHEMERAL;
+
+/* Cursor into an iovec */
+struct vsock_iter {
+	const struct iovec *iov;
+	int iovcnt;
+	size_t off;
+};
+
+/* Copies up to `len` bytes between `buf` and the iovec, advancing the cursor.
+ * Copies into the iovec if `out` is set.
+ */
+static size_t vsock_iter_copy(struct vsock_iter *it, void *buf, size_t len,
+			      int out)
+{
+	size_t done = 0;
+	size_t n;
+	char *p;
+
+	while (len && it->iovcnt) {
+		n = MIN(len, it->iov->iov_len - it->off);
+		p = (char *)it->iov->iov_base + it->off;
+		if (out)
+			memcpy(p, (char *)buf + done, n);
+		else
+			memcpy((char *)buf + done, p, n);
+
+		done += n;
+		len -= n;
+		it->off += n;
+		if (it->off == it->iov->iov_len) {
+			it->iov++;
+			it->iovcnt--;
+			it->off = 0;
+		}
+	}
+	return done;
+}
+
+static ssize_t vsock_iov_len(const struct iovec *iov, int iovcnt)
+{
+	size_t len = 0;
+
+	for (int i = 0; i < iovcnt; i++) {
+		if (unlikely(iov[i].iov_len > (size_t)__SSZ_MAX - len))
+			return -EINVAL;
+		len += iov[i].iov_len;
+	}
+	return len;
+}
+
+/* Transmit path, called with vsock_lock held */
+
+static void vsock_tx_reclaim(struct vsock_dev *d)
+{
+	void *cookie;
+	__u32 len;
+
+	while (virtqueue_buffer_dequeue(d->vq[VIRTIO_VSOCK_TX_VQ],
+					&cookie, &len) >= 0)
+		uk_free(a, cookie);
+}
+
+/* Moves pending packets into the tx queue as long as there is space */
+static void vsock_tx_flush(struct vsock_dev *d)
+{
+	struct virtqueue *vq = d->vq[VIRTIO_VSOCK_TX_VQ];
+	struct vsock_txpkt *p, *tmp;
+	int queued = 0;
+	int rc;
+
+	uk_list_for_each_entry_safe(p, tmp, &d->txpend, list) {
+		uk_sglist_reset(&d->sg);
+		rc = uk_sglist_append(&d->sg, &p->hdr,
+				      sizeof(p->hdr) + p->hdr.len);
+		if (unlikely(rc < 0)) {
+			uk_pr_err(DRIVER_NAME": Failed to map packet: %d\n",
+				  rc);
+			uk_list_del(&p->list);
+			uk_free(a, p);
+			continue;
+		}
+
+		rc = virtqueue_buffer_enqueue(vq, p, &d->sg,
+					      d->sg.sg_nseg, 0);
+		if (rc < 0)
+			break;
+
+		uk_list_del(&p->list);
+		queued++;
+	}
+
+	if (queued)
+		virtqueue_host_notify(vq);
+}
+
+static void vsock_tx_queue(struct vsock_dev *d, struct vsock_txpkt *p)
+{
+	uk_list_add_tail(&p->list, &d->txpend);
+}
+
+static struct vsock_txpkt *vsock_pkt_alloc(__u32 len)
+{
+	struct vsock_txpkt *p;
+
+	p = uk_malloc(a, sizeof(*p) + len);
+	if (unlikely(!p))
+		return NULL;
+
+	memset(&p->hdr, 0, sizeof(p->hdr));
+	p->hdr.len = len;
+	return p;
+}
+
+/* Fills in the header of a packet of a connection. Every packet carries our
+ * current credit.
+ */
+static void vsock_pkt_hdr(struct vsock_txpkt *p, struct vsock_sock *s,
+			  __u16 op, __u32 flags)
+{
+	p->hdr.src_cid = vsock_dev->cid;
+	p->hdr.dst_cid = s->peer_cid;
+	p->hdr.src_port = s->port;
+	p->hdr.dst_port = s->peer_port;
+	p->hdr.type = (s->type == SOCK_SEQPACKET) ?
+		      VIRTIO_VSOCK_TYPE_SEQPACKET : VIRTIO_VSOCK_TYPE_STREAM;
+	p->hdr.op = op;
+	p->hdr.flags = flags;
+	p->hdr.buf_alloc = s->buf_alloc;
+	p->hdr.fwd_cnt = s->fwd_cnt;
+	s->fwd_cnt_sent = s->fwd_cnt;
+}
+
+static int vsock_send_ctrl(struct vsock_sock *s, __u16 op, __u32 flags)
+{
+	struct vsock_txpkt *p;
+
+	p = vsock_pkt_alloc(0);
+	if (unlikely(!p))
+		return -ENOMEM;
+
+	vsock_pkt_hdr(p, s, op, flags);
+	vsock_tx_queue(vsock_dev, p);
+	vsock_tx_flush(vsock_dev);
+	return 0;
+}
+
+/* Answers a packet that does not belong to any connection */
+static void vsock_send_rst(struct vsock_dev *d,
+			   const struct virtio_vsock_hdr *hdr)
+{
+	struct vsock_txpkt *p;
+
+	p = vsock_pkt_alloc(0);
+	if (unlikely(!p))
+		return;
+
+	p->hdr.src_cid = d->cid;
+	p->hdr.dst_cid = hdr->src_cid;
+	p->hdr.src_port = hdr->dst_port;
+	p->hdr.dst_port = hdr->src_port;
+	p->hdr.type = hdr->type;
+	p->hdr.op = VIRTIO_VSOCK_OP_RST;
+	vsock_tx_queue(d, p);
+	vsock_tx_flush(d);
+}
+
+/* Sends `len` bytes from the iovec. Seqpacket messages are sent as a whole,
+ * with `eom` on the last packet.
+ */
+static int vsock_send_data(struct vsock_sock *s, struct vsock_iter *it,
+			   size_t len, __u32 eom)
+{
+	UK_LIST_HEAD(pkts);
+	struct vsock_txpkt *p, *tmp;
+	size_t left = len;
+	__u32 n;
+
+	do {
+		n = MIN(left, (size_t)VSOCK_PKT_MAX);
+		p = vsock_pkt_alloc(n);
+		if (unlikely(!p)) {
+			uk_list_for_each_entry_safe(p, tmp, &pkts, list)
+				uk_free(a, p);
+			return -ENOMEM;
+		}
+		vsock_iter_copy(it, p->data, n, 0);
+		left -= n;
+		vsock_pkt_hdr(p, s, VIRTIO_VSOCK_OP_RW, left ? 0 : eom);
+		uk_list_add_tail(&p->list, &pkts);
+	} while (left);
+
+	s->tx_cnt += len;
+	uk_list_for_each_entry_safe(p, tmp, &pkts, list)
+		vsock_tx_queue(vsock_dev, p);
+	vsock_tx_reclaim(vsock_dev);
+	vsock_tx_flush(vsock_dev);
+	return 0;
+}
+
+/* Socket state, called with vsock_lock held */
+
+static __u32 vsock_credit(const struct vsock_sock *s)
+{
+	__u32 used = s->tx_cnt - s->peer_fwd_cnt;
+
+	return (used < s->peer_buf_alloc) ? s->peer_buf_alloc - used : 0;
+}
+
+static int vsock_readable(const struct vsock_sock *s)
+{
+	return (s->type == SOCK_SEQPACKET) ? s->rx_msgs > 0 : s->rx_bytes > 0;
+}
+
+static int vsock_eof(const struct vsock_sock *s)
+{
+	return (s->shut & VIRTIO_VSOCK_SHUTDOWN_RCV) ||
+	       (s->peer_shut & VIRTIO_VSOCK_SHUTDOWN_SEND) ||
+	       s->state == VSOCK_SS_CLOSED;
+}
+
+static unsigned int vsock_sock_events(const struct vsock_sock *s)
+{
+	unsigned int ev = 0;
+
+	switch (s->state) {
+	case VSOCK_SS_LISTEN:
+		if (!uk_list_empty(&s->acceptq))
+			ev |= UKFD_POLLIN;
+		break;
+	case VSOCK_SS_CONNECTED:
+		if ((s->shut & VIRTIO_VSOCK_SHUTDOWN_SEND) ||
+		    (s->peer_shut & VIRTIO_VSOCK_SHUTDOWN_RCV) ||
+		    vsock_credit(s))
+			/* Writes either proceed or fail right away */
+			ev |= UKFD_POLLOUT;
+		if (s->peer_shut & VIRTIO_VSOCK_SHUTDOWN_SEND)
+			ev |= UKFD_POLLIN | EPOLLRDHUP;
+		if (s->peer_shut == VSOCK_SHUTDOWN_BOTH)
+			ev |= EPOLLHUP;
+		break;
+	case VSOCK_SS_CLOSED:
+		ev |= UKFD_POLLIN | UKFD_POLLOUT | EPOLLRDHUP | EPOLLHUP;
+		break;
+	default:
+		break;
+	}
+	if (vsock_readable(s))
+		ev |= UKFD_POLLIN;
+	if (s->err)
+		ev |= EPOLLERR | UKFD_POLLOUT;
+	return ev;
+}
+
+/* Raises or clears the events of the socket according to its state */
+static void vsock_sock_update(struct vsock_sock *s)
+{
+	unsigned int ev;
+
+	if (!s->file)
+		return;
+
+	ev = vsock_sock_events(s);
+	if (ev != s->events) {
+		s->events = ev;
+		posix_sock_event_assign(s->file, ev);
+	}
+}
+
+static struct vsock_sock *vsock_sock_alloc(struct uk_alloc *alloc, int type)
+{
+	struct vsock_sock *s;
+
+	s = uk_calloc(alloc, 1, sizeof(*s));
+	if (unlikely(!s))
+		return NULL;
+
+	s->alloc = alloc;
+	s->type = type;
+	s->state = VSOCK_SS_UNCONNECTED;
+	s->port = VMADDR_PORT_ANY;
+	s->peer_cid = VMADDR_CID_ANY;
+	s->peer_port = VMADDR_PORT_ANY;
+	s->buf_alloc = VSOCK_BUF_ALLOC;
+	UK_INIT_LIST_HEAD(&s->rxq);
+	UK_INIT_LIST_HEAD(&s->acceptq);
+	UK_INIT_LIST_HEAD(&s->acc_link);
+	uk_list_add_tail(&s->link, &vsock_socks);
+	return s;
+}
+
+static void vsock_sock_free(struct vsock_sock *s)
+{
+	struct vsock_chunk *c, *tmp;
+
+	uk_list_del(&s->link);
+	uk_list_for_each_entry_safe(c, tmp, &s->rxq, list)
+		uk_free(s->alloc, c);
+	uk_free(s->alloc, s);
+}
+
+static int vsock_port_used(__u32 port)
+{
+	struct vsock_sock *s;
+
+	uk_list_for_each_entry(s, &vsock_socks, link)
+		if ((s->flags & VSOCK_F_BOUND) && s->port == port)
+			return 1;
+	return 0;
+}
+
+static int vsock_bind_port(struct vsock_sock *s, __u32 port)
+{
+	struct vsock_sock *it;
+	unsigned long tries = 1;
+
+	if (port != VMADDR_PORT_ANY) {
+		if (vsock_port_used(port))
+			return -EADDRINUSE;
+		goto out;
+	}
+
+	/* Every socket uses at most one port, so this finds a free one */
+	uk_list_for_each_entry(it, &vsock_socks, link)
+		tries++;
+	do {
+		port = vsock_next_port++;
+		if (vsock_next_port == VMADDR_PORT_ANY)
+			vsock_next_port = VSOCK_PORT_EPHEMERAL;
+	} while (vsock_port_used(port) && --tries);
+	if (unlikely(!tries))
+		return -EADDRNOTAVAIL;
+
+out:
+	s->port = port;
+	s->flags |= VSOCK_F_BOUND;
+	return 0;
+}
+
+/* Drops the connection. A reset by the peer after connecting is a regular
+ * close (`err` 0), received data stays readable.
+ */
+static void vsock_sock_reset(struct vsock_sock *s, int err)
+{
+	if (s->state == VSOCK_SS_CONNECTING) {
+		s->state = VSOCK_SS_UNCONNECTED;
+	} else {
+		s->state = VSOCK_SS_CLOSED;
+		s->peer_shut = VSOCK_SHUTDOWN_BOTH;
+	}
+	s->err = err;
+}
+
+/* Discards received data and gives the credit back */
+static void vsock_rx_drop(struct vsock_sock *s)
+{
+	struct vsock_chunk *c, *tmp;
+
+	uk_list_for_each_entry_safe(c, tmp, &s->rxq, list) {
+		uk_list_del(&c->list);
+		uk_free(s->alloc, c);
+	}
+	s->fwd_cnt += s->rx_bytes;
+	s->rx_bytes = 0;
+	s->rx_msgs = 0;
+}
+
+/* Receive path, called by the vsock thread with vsock_lock held */
+
+static struct vsock_sock *vsock_lookup(const struct virtio_vsock_hdr *hdr,
+				       int type)
+{
+	struct vsock_sock *s, *listener = NULL;
+
+	uk_list_for_each_entry(s, &vsock_socks, link) {
+		if (s->type != type || s->port != hdr->dst_port)
+			continue;
+
+		if ((s->state == VSOCK_SS_CONNECTED ||
+		     s->state == VSOCK_SS_CONNECTING) &&
+		    s->peer_cid == hdr->src_cid &&
+		    s->peer_port == hdr->src_port)
+			return s;
+
+		if (s->state == VSOCK_SS_LISTEN)
+			listener = s;
+	}
+	return listener;
+}
+
+static void vsock_rx_request(struct vsock_dev *d, struct vsock_sock *l,
+			     const struct virtio_vsock_hdr *hdr)
+{
+	struct vsock_sock *s;
+
+	if (l->nacc >= l->backlog) {
+		vsock_send_rst(d, hdr);
+		return;
+	}
+
+	s = vsock_sock_alloc(l->alloc, l->type);
+	if (unlikely(!s)) {
+		vsock_send_rst(d, hdr);
+		return;
+	}
+
+	s->state = VSOCK_SS_CONNECTED;
+	s->port = l->port;
+	s->peer_cid = hdr->src_cid;
+	s->peer_port = hdr->src_port;
+	s->buf_alloc = l->buf_alloc;
+	s->peer_buf_alloc = hdr->buf_alloc;
+	s->peer_fwd_cnt = hdr->fwd_cnt;
+	if (unlikely(vsock_send_ctrl(s, VIRTIO_VSOCK_OP_RESPONSE, 0))) {
+		vsock_sock_free(s);
+		vsock_send_rst(d, hdr);
+		return;
+	}
+
+	s->listener = l;
+	uk_list_add_tail(&s->acc_link, &l->acceptq);
+	l->nacc++;
+	vsock_sock_update(l);
+}
+
+static void vsock_rx_data(struct vsock_sock *s,
+			  const struct virtio_vsock_hdr *hdr, const void *data)
+{
+	struct vsock_chunk *c;
+
+	if (s->shut & VIRTIO_VSOCK_SHUTDOWN_RCV) {
+		/* Nobody reads this anymore, give the credit back */
+		s->fwd_cnt += hdr->len;
+		return;
+	}
+	if (unlikely(s->rx_bytes + hdr->len > s->buf_alloc)) {
+		uk_pr_warn(DRIVER_NAME": Peer %"__PRIu64":%"__PRIu32
+			   " exceeded its credit, dropping data\n",
+			   s->peer_cid, s->peer_port);
+		return;
+	}
+	if (s->type != SOCK_SEQPACKET && !hdr->len)
+		return;
+
+	c = uk_malloc(s->alloc, sizeof(*c) + hdr->len);
+	if (unlikely(!c)) {
+		/* The data is lost, so is the consistency of the stream */
+		vsock_send_ctrl(s, VIRTIO_VSOCK_OP_RST, 0);
+		vsock_sock_reset(s, ENOMEM);
+		return;
+	}
+	c->len = hdr->len;
+	c->off = 0;
+	c->flags = (s->type == SOCK_SEQPACKET) ? hdr->flags : 0;
+	memcpy(c->data, data, hdr->len);
+
+	uk_list_add_tail(&c->list, &s->rxq);
+	s->rx_bytes += hdr->len;
+	if (c->flags & VIRTIO_VSOCK_SEQ_EOM)
+		s->rx_msgs++;
+}
+
+static void vsock_rx_pkt(struct vsock_dev *d,
+			 const struct virtio_vsock_hdr *hdr, const void *data)
+{
+	struct vsock_sock *s;
+	int type;
+
+	if (unlikely(hdr->dst_cid != d->cid))
+		return;
+
+	switch (hdr->type) {
+	case VIRTIO_VSOCK_TYPE_STREAM:
+		type = SOCK_STREAM;
+		break;
+	case VIRTIO_VSOCK_TYPE_SEQPACKET:
+		type = SOCK_SEQPACKET;
+		break;
+	default:
+		type = -1;
+		break;
+	}
+
+	s = (type < 0) ? NULL : vsock_lookup(hdr, type);
+	if (!s) {
+		if (hdr->op != VIRTIO_VSOCK_OP_RST)
+			vsock_send_rst(d, hdr);
+		return;
+	}
+
+	if (s->state == VSOCK_SS_LISTEN) {
+		if (hdr->op == VIRTIO_VSOCK_OP_REQUEST)
+			vsock_rx_request(d, s, hdr);
+		else if (hdr->op != VIRTIO_VSOCK_OP_RST)
+			vsock_send_rst(d, hdr);
+		return;
+	}
+
+	s->peer_buf_alloc = hdr->buf_alloc;
+	s->peer_fwd_cnt = hdr->fwd_cnt;
+
+	switch (hdr->op) {
+	case VIRTIO_VSOCK_OP_RESPONSE:
+		if (s->state == VSOCK_SS_CONNECTING) {
+			s->state = VSOCK_SS_CONNECTED;
+			break;
+		}
+		goto err_proto;
+	case VIRTIO_VSOCK_OP_RST:
+		vsock_sock_reset(s, (s->state == VSOCK_SS_CONNECTING) ?
+				    ECONNREFUSED : 0);
+		break;
+	case VIRTIO_VSOCK_OP_RW:
+		if (s->state != VSOCK_SS_CONNECTED)
+			goto err_proto;
+		vsock_rx_data(s, hdr, data);
+		break;
+	case VIRTIO_VSOCK_OP_CREDIT_UPDATE:
+		break;
+	case VIRTIO_VSOCK_OP_CREDIT_REQUEST:
+		if (s->state == VSOCK_SS_CONNECTED)
+			vsock_send_ctrl(s, VIRTIO_VSOCK_OP_CREDIT_UPDATE, 0);
+		break;
+	case VIRTIO_VSOCK_OP_SHUTDOWN:
+		if (s->state != VSOCK_SS_CONNECTED)
+			goto err_proto;
+		s->peer_shut |= hdr->flags & VSOCK_SHUTDOWN_BOTH;
+		/* Confirm a full shutdown once everything was read */
+		if (s->peer_shut == VSOCK_SHUTDOWN_BOTH && !s->rx_bytes) {
+			vsock_send_ctrl(s, VIRTIO_VSOCK_OP_RST, 0);
+			vsock_sock_reset(s, 0);
+		}
+		break;
+	default:
+		goto err_proto;
+	}
+	vsock_sock_update(s);
+	return;
+
+err_proto:
+	vsock_send_ctrl(s, VIRTIO_VSOCK_OP_RST, 0);
+	vsock_sock_reset(s, ECONNRESET);
+	vsock_sock_update(s);
+}
+
+static void vsock_rx_post(struct vsock_dev *d, struct vsock_rxbuf *buf)
+{
+	int rc;
+
+	uk_sglist_reset(&d->sg);
+	rc = uk_sglist_append(&d->sg, buf, sizeof(*buf));
+	if (likely(rc >= 0))
+		rc = virtqueue_buffer_enqueue(d->vq[VIRTIO_VSOCK_RX_VQ], buf,
+					      &d->sg, 0, d->sg.sg_nseg);
+	if (unlikely(rc < 0)) {
+		uk_pr_err(DRIVER_NAME": Failed to post receive buffer: %d\n",
+			  rc);
+		uk_free(a, buf);
+	}
+}
+
+static void vsock_rx_process(struct vsock_dev *d)
+{
+	struct virtqueue *vq = d->vq[VIRTIO_VSOCK_RX_VQ];
+	struct vsock_rxbuf *buf;
+	int posted = 0;
+	__u32 len;
+
+	while (virtqueue_buffer_dequeue(vq, (void **)&buf, &len) >= 0) {
+		if (likely(len >= sizeof(buf->hdr) &&
+			   buf->hdr.len <= len - sizeof(buf->hdr)))
+			vsock_rx_pkt(d, &buf->hdr, buf->data);
+		else
+			uk_pr_warn(DRIVER_NAME": Dropping malformed packet\n");
+
+		vsock_rx_post(d, buf);
+		posted++;
+	}
+
+	if (posted)
+		virtqueue_host_notify(vq);
+}
+
+static void vsock_event_post(struct vsock_dev *d,
+			     struct virtio_vsock_event *ev)
+{
+	int rc;
+
+	uk_sglist_reset(&d->sg);
+	rc = uk_sglist_append(&d->sg, ev, sizeof(*ev));
+	if (likely(rc >= 0))
+		rc = virtqueue_buffer_enqueue(d->vq[VIRTIO_VSOCK_EVENT_VQ], ev,
+					      &d->sg, 0, d->sg.sg_nseg);
+	if (unlikely(rc < 0))
+		uk_pr_err(DRIVER_NAME": Failed to post event buffer: %d\n",
+			  rc);
+}
+
+/* After a transport reset (e.g., live migration), all connections are gone
+ * and our context ID may have changed
+ */
+static void vsock_transport_reset(struct vsock_dev *d)
+{
+	struct vsock_sock *s;
+	__u64 cid;
+
+	if (likely(!virtio_config_get(d->vdev,
+				      __offsetof(struct virtio_vsock_config,
+						 guest_cid),
+				      &cid, sizeof(cid), 1)))
+		d->cid = cid;
+	uk_pr_info(DRIVER_NAME": Transport reset, guest CID %"__PRIu64"\n",
+		   d->cid);
+
+	uk_list_for_each_entry(s, &vsock_socks, link) {
+		if (s->state != VSOCK_SS_CONNECTED &&
+		    s->state != VSOCK_SS_CONNECTING)
+			continue;
+
+		vsock_sock_reset(s, ECONNRESET);
+		vsock_sock_update(s);
+	}
+}
+
+static void vsock_event_process(struct vsock_dev *d)
+{
+	struct virtqueue *vq = d->vq[VIRTIO_VSOCK_EVENT_VQ];
+	struct virtio_vsock_event *ev;
+	int posted = 0;
+	__u32 len;
+
+	while (virtqueue_buffer_dequeue(vq, (void **)&ev, &len) >= 0) {
+		if (len >= sizeof(*ev) &&
+		    ev->id == VIRTIO_VSOCK_EVENT_TRANSPORT_RESET)
+			vsock_transport_reset(d);
+
+		vsock_event_post(d, ev);
+		posted++;
+	}
+
+	if (posted)
+		virtqueue_host_notify(vq);
+}
+
+static int vsock_vq_intr(struct virtqueue *vq, void *priv)
+{
+	struct vsock_dev *d = priv;
+
+	virtqueue_intr_disable(vq);
+	UK_WRITE_ONCE(d->kick, 1);
+	uk_waitq_wake_up(&d->wq);
+	return 1;
+}
+
+static __noreturn void vsock_thread(void *arg)
+{
+	struct vsock_dev *d = arg;
+	int i;
+
+	for (;;) {
+		uk_waitq_wait_event(&d->wq, UK_READ_ONCE(d->kick));
+		UK_WRITE_ONCE(d->kick, 0);
+
+		uk_mutex_lock(&vsock_lock);
+		vsock_tx_reclaim(d);
+		vsock_rx_process(d);
+		vsock_event_process(d);
+		vsock_tx_flush(d);
+		uk_mutex_unlock(&vsock_lock);
+
+		for (i = 0; i < VIRTIO_VSOCK_VQ_MAX; i++)
+			if (virtqueue_intr_enable(d->vq[i]))
+				UK_WRITE_ONCE(d->kick, 1);
+	}
+}
+
+/* Socket interface */
+
+static void vsock_sockaddr(struct sockaddr *restrict addr,
+			   socklen_t *restrict addr_len, __u64 cid, __u32 port)
+{
+	struct sockaddr_vm svm = {
+		.svm_family = AF_VSOCK,
+		.svm_port = port,
+		.svm_cid = cid,
+	};
+
+	memcpy(addr, &svm, MIN(*addr_len, (socklen_t)sizeof(svm)));
+	*addr_len = sizeof(svm);
+}
+
+static int vsock_addr_check(const struct sockaddr *addr, socklen_t addr_len)
+{
+	if (unlikely(!addr || addr_len < sizeof(struct sockaddr_vm)))
+		return -EINVAL;
+	if (unlikely(addr->sa_family != AF_VSOCK))
+		return -EAFNOSUPPORT;
+	return 0;
+}
+
+static
+void *vsock_socket_create(struct posix_socket_driver *d,
+			  int family, int type, int proto)
+{
+	struct vsock_sock *s;
+
+	if (unlikely(family != AF_VSOCK))
+		return ERR2PTR(-EAFNOSUPPORT);
+	if (unlikely(proto != PF_UNSPEC && proto != PF_VSOCK))
+		return ERR2PTR(-EPROTONOSUPPORT);
+	if (unlikely(!vsock_dev))
+		return ERR2PTR(-EAFNOSUPPORT);
+
+	type &= ~SOCK_FLAGS; /* Flags are handled by other levels */
+	if (unlikely(type != SOCK_STREAM &&
+		     (type != SOCK_SEQPACKET || !vsock_dev->seqpacket)))
+		return ERR2PTR(-ESOCKTNOSUPPORT);
+
+	uk_mutex_lock(&vsock_lock);
+	s = vsock_sock_alloc(d->allocator, type);
+	uk_mutex_unlock(&vsock_lock);
+	if (unlikely(!s))
+		return ERR2PTR(-ENOMEM);
+	return s;
+}
+
+static
+void vsock_socket_poll(posix_sock *file)
+{
+	struct vsock_sock *s = posix_sock_get_data(file);
+
+	uk_mutex_lock(&vsock_lock);
+	s->file = file;
+	s->events = 0;
+	vsock_sock_update(s);
+	uk_mutex_unlock(&vsock_lock);
+}
+
+static
+void *vsock_socket_accept4(posix_sock *file,
+			   struct sockaddr *restrict addr,
+			   socklen_t *restrict addr_len, int flags __unused)
+{
+	struct vsock_sock *l = posix_sock_get_data(file);
+	struct vsock_sock *s;
+
+	uk_mutex_lock(&vsock_lock);
+	if (unlikely(l->state != VSOCK_SS_LISTEN)) {
+		s = ERR2PTR(-EINVAL);
+		goto out;
+	}
+	if (uk_list_empty(&l->acceptq)) {
+		s = ERR2PTR(-EAGAIN);
+		goto out_update;
+	}
+
+	s = uk_list_first_entry(&l->acceptq, struct vsock_sock, acc_link);
+	uk_list_del_init(&s->acc_link);
+	s->listener = NULL;
+	l->nacc--;
+
+	if (addr && addr_len)
+		vsock_sockaddr(addr, addr_len, s->peer_cid, s->peer_port);
+out_update:
+	vsock_sock_update(l);
+out:
+	uk_mutex_unlock(&vsock_lock);
+	return s;
+}
+
+static
+int vsock_socket_bind(posix_sock *file,
+		      const struct sockaddr *addr, socklen_t addr_len)
+{
+	struct vsock_sock *s = posix_sock_get_data(file);
+	const struct sockaddr_vm *svm = (const struct sockaddr_vm *)addr;
+	int rc;
+
+	rc = vsock_addr_check(addr, addr_len);
+	if (unlikely(rc))
+		return rc;
+	if (unlikely(svm->svm_cid != VMADDR_CID_ANY &&
+		     svm->svm_cid != vsock_dev->cid))
+		return -EADDRNOTAVAIL;
+
+	uk_mutex_lock(&vsock_lock);
+	if (unlikely(s->flags & VSOCK_F_BOUND))
+		rc = -EINVAL;
+	else
+		rc = vsock_bind_port(s, svm->svm_port);
+	uk_mutex_unlock(&vsock_lock);
+	return rc;
+}
+
+static
+int vsock_socket_getpeername(posix_sock *file,
+			     struct sockaddr *restrict addr,
+			     socklen_t *restrict addr_len)
+{
+	struct vsock_sock *s = posix_sock_get_data(file);
+	int rc = 0;
+
+	uk_mutex_lock(&vsock_lock);
+	if (s->state == VSOCK_SS_CONNECTED || s->state == VSOCK_SS_CLOSED)
+		vsock_sockaddr(addr, addr_len, s->peer_cid, s->peer_port);
+	else
+		rc = -ENOTCONN;
+	uk_mutex_unlock(&vsock_lock);
+	return rc;
+}
+
+static
+int vsock_socket_getsockname(posix_sock *file,
+			     struct sockaddr *restrict addr,
+			     socklen_t *restrict addr_len)
+{
+	struct vsock_sock *s = posix_sock_get_data(file);
+
+	uk_mutex_lock(&vsock_lock);
+	vsock_sockaddr(addr, addr_len,
+		       (s->flags & VSOCK_F_BOUND) ?
+		       vsock_dev->cid : VMADDR_CID_ANY, s->port);
+	uk_mutex_unlock(&vsock_lock);
+	return 0;
+}
+
+static
+int vsock_socket_getsockopt(posix_sock *file, int level, int optname,
+			    void *restrict optval, socklen_t *restrict optlen)
+{
+	struct vsock_sock *s = posix_sock_get_data(file);
+	__u64 val64;
+	int val;
+
+	if (unlikely(!optval || !optlen))
+		return -EFAULT;
+
+	if (level == AF_VSOCK && optname == SO_VM_SOCKETS_BUFFER_SIZE) {
+		if (unlikely(*optlen < sizeof(val64)))
+			return -EINVAL;
+		val64 = UK_READ_ONCE(s->buf_alloc);
+		memcpy(optval, &val64, sizeof(val64));
+		*optlen = sizeof(val64);
+		return 0;
+	}
+	if (unlikely(level != SOL_SOCKET))
+		return -ENOPROTOOPT;
+	if (unlikely(*optlen < sizeof(val)))
+		return -EINVAL;
+
+	switch (optname) {
+	case SO_ERROR:
+		uk_mutex_lock(&vsock_lock);
+		val = s->err;
+		s->err = 0;
+		vsock_sock_update(s);
+		uk_mutex_unlock(&vsock_lock);
+		break;
+	case SO_TYPE:
+		val = s->type;
+		break;
+	default:
+		return -ENOPROTOOPT;
+	}
+	memcpy(optval, &val, sizeof(val));
+	*optlen = sizeof(val);
+	return 0;
+}
+
+static
+int vsock_socket_setsockopt(posix_sock *file, int level, int optname,
+			    const void *optval, socklen_t optlen)
+{
+	struct vsock_sock *s = posix_sock_get_data(file);
+	__u64 val64;
+
+	if (unlikely(level != AF_VSOCK ||
+		     optname != SO_VM_SOCKETS_BUFFER_SIZE))
+		return -ENOPROTOOPT;
+	if (unlikely(!optval || optlen < sizeof(val64)))
+		return -EINVAL;
+
+	memcpy(&val64, optval, sizeof(val64));
+	val64 = MAX(val64, (__u64)VSOCK_BUF_ALLOC_MIN);
+	val64 = MIN(val64, (__u64)VSOCK_BUF_ALLOC_MAX);
+
+	uk_mutex_lock(&vsock_lock);
+	s->buf_alloc = val64;
+	if (s->state == VSOCK_SS_CONNECTED)
+		vsock_send_ctrl(s, VIRTIO_VSOCK_OP_CREDIT_UPDATE, 0);
+	uk_mutex_unlock(&vsock_lock);
+	return 0;
+}
+
+static
+int vsock_socket_connect(posix_sock *file,
+			 const struct sockaddr *addr, socklen_t addr_len)
+{
+	struct vsock_sock *s = posix_sock_get_data(file);
+	const struct sockaddr_vm *svm = (const struct sockaddr_vm *)addr;
+	int rc;
+
+	rc = vsock_addr_check(addr, addr_len);
+	if (unlikely(rc))
+		return rc;
+	/* There is no loopback transport */
+	if (unlikely(svm->svm_cid == VMADDR_CID_ANY ||
+		     svm->svm_cid == VMADDR_CID_LOCAL ||
+		     svm->svm_cid == vsock_dev->cid))
+		return -ENETUNREACH;
+
+	uk_mutex_lock(&vsock_lock);
+	switch (s->state) {
+	case VSOCK_SS_UNCONNECTED:
+		break;
+	case VSOCK_SS_CONNECTING:
+		rc = -EALREADY;
+		goto out;
+	case VSOCK_SS_LISTEN:
+		rc = -EINVAL;
+		goto out;
+	default:
+		rc = -EISCONN;
+		goto out;
+	}
+
+	if (!(s->flags & VSOCK_F_BOUND)) {
+		rc = vsock_bind_port(s, VMADDR_PORT_ANY);
+		if (unlikely(rc))
+			goto out;
+	}
+
+	s->peer_cid = svm->svm_cid;
+	s->peer_port = svm->svm_port;
+	s->peer_buf_alloc = 0;
+	s->peer_fwd_cnt = 0;
+	s->tx_cnt = 0;
+	s->err = 0;
+	rc = vsock_send_ctrl(s, VIRTIO_VSOCK_OP_REQUEST, 0);
+	if (unlikely(rc))
+		goto out;
+
+	s->state = VSOCK_SS_CONNECTING;
+	rc = -EINPROGRESS;
+	vsock_sock_update(s);
+out:
+	uk_mutex_unlock(&vsock_lock);
+	return rc;
+}
+
+static
+int vsock_socket_listen(posix_sock *file, int backlog)
+{
+	struct vsock_sock *s = posix_sock_get_data(file);
+	int rc = 0;
+
+	uk_mutex_lock(&vsock_lock);
+	if (unlikely(!(s->flags & VSOCK_F_BOUND) ||
+		     (s->state != VSOCK_SS_UNCONNECTED &&
+		      s->state != VSOCK_SS_LISTEN))) {
+		rc = -EINVAL;
+		goto out;
+	}
+
+	s->backlog = MAX(backlog, 1);
+	s->state = VSOCK_SS_LISTEN;
+	vsock_sock_update(s);
+out:
+	uk_mutex_unlock(&vsock_lock);
+	return rc;
+}
+
+/* Returns credit to the peer once a good part of the buffer was read */
+static void vsock_credit_update(struct vsock_sock *s)
+{
+	if (s->state == VSOCK_SS_CONNECTED &&
+	    s->fwd_cnt - s->fwd_cnt_sent >= s->buf_alloc / 2)
+		vsock_send_ctrl(s, VIRTIO_VSOCK_OP_CREDIT_UPDATE, 0);
+}
+
+static ssize_t vsock_recv_stream(struct vsock_sock *s, struct vsock_iter *it,
+				 int peek)
+{
+	struct vsock_chunk *c, *tmp;
+	size_t copied = 0;
+	size_t left, n;
+
+	uk_list_for_each_entry_safe(c, tmp, &s->rxq, list) {
+		left = c->len - c->off;
+		n = vsock_iter_copy(it, c->data + c->off, left, 1);
+		copied += n;
+		if (n < left) {
+			if (!peek)
+				c->off += n;
+			break;
+		}
+		if (!peek) {
+			uk_list_del(&c->list);
+			uk_free(s->alloc, c);
+		}
+	}
+
+	if (!peek) {
+		s->rx_bytes -= copied;
+		s->fwd_cnt += copied;
+	}
+	return copied;
+}
+
+static ssize_t vsock_recv_seqpacket(struct vsock_sock *s,
+				    struct vsock_iter *it, int flags,
+				    int *msg_flags)
+{
+	struct vsock_chunk *c, *tmp;
+	size_t copied = 0, len = 0;
+	__u32 eom = 0;
+
+	uk_list_for_each_entry_safe(c, tmp, &s->rxq, list) {
+		copied += vsock_iter_copy(it, c->data, c->len, 1);
+		len += c->len;
+		eom = c->flags;
+		if (!(flags & MSG_PEEK)) {
+			uk_list_del(&c->list);
+			uk_free(s->alloc, c);
+		}
+		if (eom & VIRTIO_VSOCK_SEQ_EOM)
+			break;
+	}
+
+	if (!(flags & MSG_PEEK)) {
+		s->rx_msgs--;
+		s->rx_bytes -= len;
+		s->fwd_cnt += len;
+	}
+	if (eom & VIRTIO_VSOCK_SEQ_EOR)
+		*msg_flags |= MSG_EOR;
+	if (copied < len)
+		*msg_flags |= MSG_TRUNC;
+	return (flags & MSG_TRUNC) ? len : copied;
+}
+
+static
+ssize_t vsock_socket_recvmsg(posix_sock *file, struct msghdr *msg, int flags)
+{
+	struct vsock_sock *s = posix_sock_get_data(file);
+	struct vsock_iter it = {
+		.iov = msg->msg_iov,
+		.iovcnt = msg->msg_iovlen,
+		.off = 0
+	};
+	ssize_t ret;
+
+	if (unlikely(flags & ~(MSG_DONTWAIT | MSG_PEEK | MSG_TRUNC |
+			       MSG_WAITALL))) {
+		uk_pr_warn("Unsupported recv flags: %x\n", flags);
+		return -EOPNOTSUPP;
+	}
+
+	uk_mutex_lock(&vsock_lock);
+	if (unlikely(s->state != VSOCK_SS_CONNECTED &&
+		     s->state != VSOCK_SS_CLOSED)) {
+		ret = -ENOTCONN;
+		goto out;
+	}
+
+	msg->msg_flags = 0;
+	if ((s->shut & VIRTIO_VSOCK_SHUTDOWN_RCV) || !vsock_readable(s)) {
+		ret = vsock_eof(s) ? 0 : -EAGAIN;
+		goto out_update;
+	}
+
+	if (s->type == SOCK_SEQPACKET)
+		ret = vsock_recv_seqpacket(s, &it, flags, &msg->msg_flags);
+	else
+		ret = vsock_recv_stream(s, &it, flags & MSG_PEEK);
+	vsock_credit_update(s);
+
+	if (msg->msg_name)
+		vsock_sockaddr(msg->msg_name, &msg->msg_namelen,
+			       s->peer_cid, s->peer_port);
+
+	/* A full shutdown of the peer waits for us to read everything */
+	if (s->state == VSOCK_SS_CONNECTED &&
+	    s->peer_shut == VSOCK_SHUTDOWN_BOTH && !s->rx_bytes) {
+		vsock_send_ctrl(s, VIRTIO_VSOCK_OP_RST, 0);
+		vsock_sock_reset(s, 0);
+	}
+out_update:
+	vsock_sock_update(s);
+out:
+	uk_mutex_unlock(&vsock_lock);
+	return ret;
+}
+
+static
+ssize_t vsock_socket_recvfrom(posix_sock *file, void *restrict buf,
+			      size_t len, int flags, struct sockaddr *from,
+			      socklen_t *restrict fromlen)
+{
+	struct iovec iov = {
+		.iov_base = buf,
+		.iov_len = len
+	};
+	struct msghdr msg = {
+		.msg_name = from,
+		.msg_namelen = fromlen ? *fromlen : 0,
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = NULL,
+		.msg_controllen = 0,
+		.msg_flags = 0
+	};
+	ssize_t ret = vsock_socket_recvmsg(file, &msg, flags);
+
+	if (fromlen && ret >= 0)
+		*fromlen = msg.msg_namelen;
+	return ret;
+}
+
+static
+ssize_t vsock_socket_sendmsg(posix_sock *file,
+			     const struct msghdr *msg, int flags)
+{
+	struct vsock_sock *s = posix_sock_get_data(file);
+	struct vsock_iter it = {
+		.iov = msg->msg_iov,
+		.iovcnt = msg->msg_iovlen,
+		.off = 0
+	};
+	__u32 credit, eom = 0;
+	ssize_t len;
+	int rc;
+
+	if (unlikely(flags & ~(MSG_DONTWAIT | MSG_NOSIGNAL | MSG_EOR))) {
+		uk_pr_warn("Unsupported send flags: %x\n", flags);
+		return -EOPNOTSUPP;
+	}
+
+	len = vsock_iov_len(msg->msg_iov, msg->msg_iovlen);
+	if (unlikely(len < 0))
+		return len;
+
+	uk_mutex_lock(&vsock_lock);
+	if (unlikely(s->state != VSOCK_SS_CONNECTED)) {
+		if (msg->msg_name)
+			len = -EOPNOTSUPP;
+		else
+			len = (s->state == VSOCK_SS_CLOSED) ?
+			      -EPIPE : -ENOTCONN;
+		goto out;
+	}
+	if (unlikely(msg->msg_name)) {
+		len = -EISCONN;
+		goto out;
+	}
+	if (unlikely((s->shut & VIRTIO_VSOCK_SHUTDOWN_SEND) ||
+		     (s->peer_shut & VIRTIO_VSOCK_SHUTDOWN_RCV))) {
+		len = -EPIPE;
+		goto out;
+	}
+
+	credit = vsock_credit(s);
+	if (s->type == SOCK_SEQPACKET) {
+		/* Messages are only sent as a whole */
+		if (unlikely((size_t)len > s->peer_buf_alloc)) {
+			len = -EMSGSIZE;
+			goto out;
+		}
+		if ((size_t)len > credit) {
+			len = -EAGAIN;
+			goto out_update;
+		}
+		eom = VIRTIO_VSOCK_SEQ_EOM;
+		if (flags & MSG_EOR)
+			eom |= VIRTIO_VSOCK_SEQ_EOR;
+	} else {
+		if (!len)
+			goto out;
+		if (!credit) {
+			len = -EAGAIN;
+			goto out_update;
+		}
+		len = MIN((size_t)len, (size_t)credit);
+	}
+
+	rc = vsock_send_data(s, &it, len, eom);
+	if (unlikely(rc))
+		len = rc;
+out_update:
+	vsock_sock_update(s);
+out:
+	uk_mutex_unlock(&vsock_lock);
+	return len;
+}
+
+static
+ssize_t vsock_socket_sendto(posix_sock *file, const void *buf,
+			    size_t len, int flags,
+			    const struct sockaddr *dest_addr, socklen_t addrlen)
+{
+	struct iovec iov = {
+		.iov_base = (void *)buf,
+		.iov_len = len
+	};
+	struct msghdr msg = {
+		.msg_name = (struct sockaddr *)dest_addr,
+		.msg_namelen = addrlen,
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = NULL,
+		.msg_controllen = 0,
+		.msg_flags = 0
+	};
+
+	return vsock_socket_sendmsg(file, &msg, flags);
+}
+
+static
+ssize_t vsock_socket_read(posix_sock *file,
+			  const struct iovec *iov, int iovcnt)
+{
+	struct msghdr msg = {
+		.msg_name = NULL,
+		.msg_namelen = 0,
+		.msg_iov = (struct iovec *)iov,
+		.msg_iovlen = iovcnt,
+		.msg_control = NULL,
+		.msg_controllen = 0,
+		.msg_flags = 0
+	};
+	return vsock_socket_recvmsg(file, &msg, 0);
+}
+
+static
+ssize_t vsock_socket_write(posix_sock *file,
+			   const struct iovec *iov, int iovcnt)
+{
+	struct msghdr msg = {
+		.msg_name = NULL,
+		.msg_namelen = 0,
+		.msg_iov = (struct iovec *)iov,
+		.msg_iovlen = iovcnt,
+		.msg_control = NULL,
+		.msg_controllen = 0,
+		.msg_flags = 0
+	};
+	return vsock_socket_sendmsg(file, &msg, 0);
+}
+
+static
+int vsock_socket_shutdown(posix_sock *file, int how)
+{
+	struct vsock_sock *s = posix_sock_get_data(file);
+	unsigned int shut;
+	int rc = 0;
+
+	switch (how) {
+	case SHUT_RD:
+		shut = VIRTIO_VSOCK_SHUTDOWN_RCV;
+		break;
+	case SHUT_WR:
+		shut = VIRTIO_VSOCK_SHUTDOWN_SEND;
+		break;
+	case SHUT_RDWR:
+		shut = VSOCK_SHUTDOWN_BOTH;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	uk_mutex_lock(&vsock_lock);
+	if (unlikely(s->state != VSOCK_SS_CONNECTED &&
+		     s->state != VSOCK_SS_CLOSED)) {
+		rc = -ENOTCONN;
+		goto out;
+	}
+
+	if (s->state == VSOCK_SS_CONNECTED && (shut & ~s->shut))
+		rc = vsock_send_ctrl(s, VIRTIO_VSOCK_OP_SHUTDOWN, shut);
+	s->shut |= shut;
+	if (shut & VIRTIO_VSOCK_SHUTDOWN_RCV) {
+		vsock_rx_drop(s);
+		vsock_credit_update(s);
+	}
+	vsock_sock_update(s);
+out:
+	uk_mutex_unlock(&vsock_lock);
+	return rc;
+}
+
+static void vsock_sock_disconnect(struct vsock_sock *s)
+{
+	if (s->state == VSOCK_SS_CONNECTED)
+		vsock_send_ctrl(s, VIRTIO_VSOCK_OP_SHUTDOWN,
+				VSOCK_SHUTDOWN_BOTH);
+	if (s->state == VSOCK_SS_CONNECTED || s->state == VSOCK_SS_CONNECTING)
+		vsock_send_ctrl(s, VIRTIO_VSOCK_OP_RST, 0);
+}
+
+static
+int vsock_socket_close(posix_sock *file)
+{
+	struct vsock_sock *s = posix_sock_get_data(file);
+	struct vsock_sock *c, *tmp;
+
+	uk_mutex_lock(&vsock_lock);
+	/* Connections that were never accepted go down with the listener */
+	uk_list_for_each_entry_safe(c, tmp, &s->acceptq, acc_link) {
+		vsock_sock_disconnect(c);
+		vsock_sock_free(c);
+	}
+	vsock_sock_disconnect(s);
+	vsock_sock_free(s);
+	uk_mutex_unlock(&vsock_lock);
+
+	posix_sock_set_data(file, NULL);
+	return 0;
+}
+
+static
+int vsock_socket_ioctl(posix_sock *file __unused, int request __unused,
+		       void *argp __unused)
+{
+	return -ENOSYS;
+}
+
+static
+int vsock_socket_socketpair(struct posix_socket_driver *d __unused,
+			    int family __unused, int type __unused,
+			    int protocol __unused, void *sockvec[2] __unused)
+{
+	return -EOPNOTSUPP;
+}
+
+static struct posix_socket_ops vsock_posix_socket_ops = {
+	/* POSIX interfaces */
+	.create      = vsock_socket_create,
+	.accept4     = vsock_socket_accept4,
+	.bind        = vsock_socket_bind,
+	.shutdown    = vsock_socket_shutdown,
+	.getpeername = vsock_socket_getpeername,
+	.getsockname = vsock_socket_getsockname,
+	.getsockopt  = vsock_socket_getsockopt,
+	.setsockopt  = vsock_socket_setsockopt,
+	.connect     = vsock_socket_connect,
+	.listen      = vsock_socket_listen,
+	.recvfrom    = vsock_socket_recvfrom,
+	.recvmsg     = vsock_socket_recvmsg,
+	.sendmsg     = vsock_socket_sendmsg,
+	.sendto      = vsock_socket_sendto,
+	.socketpair  = vsock_socket_socketpair,
+	/* vfscore ops */
+	.read		= vsock_socket_read,
+	.write		= vsock_socket_write,
+	.close		= vsock_socket_close,
+	.ioctl		= vsock_socket_ioctl,
+	.poll		= vsock_socket_poll,
+};
+
+POSIX_SOCKET_FAMILY_REGISTER(AF_VSOCK, &vsock_posix_socket_ops);
+
+/* Device setup */
+
+static void vsock_vq_release(struct vsock_dev *d)
+{
+	int i;
+
+	for (i = 0; i < VIRTIO_VSOCK_VQ_MAX; i++)
+		if (d->vq[i] && !PTRISERR(d->vq[i]))
+			virtio_vqueue_release(d->vdev, d->vq[i], a);
+}
+
+static int vsock_vq_alloc(struct vsock_dev *d, __u16 *rx_size)
+{
+	__u16 qdesc_size[VIRTIO_VSOCK_VQ_MAX];
+	int vq_avail, i;
+
+	vq_avail = virtio_find_vqs(d->vdev, VIRTIO_VSOCK_VQ_MAX, qdesc_size);
+	if (unlikely(vq_avail != VIRTIO_VSOCK_VQ_MAX)) {
+		uk_pr_err(DRIVER_NAME": Expected: %d queues, found %d\n",
+			  VIRTIO_VSOCK_VQ_MAX, vq_avail);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < VIRTIO_VSOCK_VQ_MAX; i++) {
+		d->vq[i] = virtio_vqueue_setup(d->vdev, i, qdesc_size[i],
+					       vsock_vq_intr, a);
+		if (unlikely(PTRISERR(d->vq[i]))) {
+			uk_pr_err(DRIVER_NAME": Failed to set up virtqueue %d\n",
+				  i);
+			return PTR2ERR(d->vq[i]);
+		}
+		d->vq[i]->priv = d;
+	}
+	*rx_size = qdesc_size[VIRTIO_VSOCK_RX_VQ];
+	return 0;
+}
+
+/* Buffers are only handed to the device before it is up, no locking needed */
+static int vsock_fill(struct vsock_dev *d, __u16 rx_size)
+{
+	struct vsock_rxbuf *buf;
+	unsigned int i, n;
+
+	n = MIN((unsigned int)CONFIG_LIBVIRTIO_VSOCK_RX_BUFS,
+		(unsigned int)rx_size);
+	for (i = 0; i < n; i++) {
+		buf = uk_malloc(a, sizeof(*buf));
+		if (unlikely(!buf))
+			break;
+		vsock_rx_post(d, buf);
+	}
+	if (unlikely(!i))
+		return -ENOMEM;
+
+	for (i = 0; i < VSOCK_EVENT_BUFS; i++)
+		vsock_event_post(d, &d->events[i]);
+	return 0;
+}
+
+static int virtio_vsock_add_dev(struct virtio_dev *vdev)
+{
+	struct vsock_dev *d;
+	struct uk_thread *t;
+	__u64 host_features;
+	__u16 rx_size;
+	int i;
+	int rc;
+
+	UK_ASSERT(vdev != NULL);
+
+	/* All sockets share the address space of a single device */
+	if (vsock_dev) {
+		uk_pr_info(DRIVER_NAME": Ignoring additional device\n");
+		return 0;
+	}
+
+	d = uk_calloc(a, 1, sizeof(*d));
+	if (!d)
+		return -ENOMEM;
+	uk_sglist_init(&d->sg, ARRAY_SIZE(d->sgsegs), d->sgsegs);
+	uk_waitq_init(&d->wq);
+	UK_INIT_LIST_HEAD(&d->txpend);
+	d->vdev = vdev;
+
+	host_features = virtio_feature_get(d->vdev);
+	d->vdev->features = 0;
+	if (VIRTIO_FEATURE_HAS(host_features, VIRTIO_VSOCK_F_SEQPACKET))
+		VIRTIO_FEATURE_SET(d->vdev->features,
+				   VIRTIO_VSOCK_F_SEQPACKET);
+	if (VIRTIO_FEATURE_HAS(host_features, VIRTIO_F_VERSION_1))
+		VIRTIO_FEATURE_SET(d->vdev->features, VIRTIO_F_VERSION_1);
+	virtio_feature_set(d->vdev);
+	d->seqpacket = VIRTIO_FEATURE_HAS(d->vdev->features,
+					  VIRTIO_VSOCK_F_SEQPACKET);
+
+	rc = virtio_config_get(d->vdev,
+			       __offsetof(struct virtio_vsock_config,
+					  guest_cid),
+			       &d->cid, sizeof(d->cid), 1);
+	if (unlikely(rc)) {
+		uk_pr_err(DRIVER_NAME": Failed to read guest CID: %d\n", rc);
+		goto out_free;
+	}
+
+	rc = vsock_vq_alloc(d, &rx_size);
+	if (rc) {
+		uk_pr_err(DRIVER_NAME": Could not allocate virtqueues\n");
+		goto out_release_vq;
+	}
+
+	rc = vsock_fill(d, rx_size);
+	if (unlikely(rc)) {
+		uk_pr_err(DRIVER_NAME": Could not allocate receive buffers\n");
+		goto out_release_vq;
+	}
+
+	t = uk_sched_thread_create(uk_sched_current(), vsock_thread,
+				   d, DRIVER_NAME);
+	if (unlikely(!t || PTRISERR(t))) {
+		uk_pr_err(DRIVER_NAME": Failed to create vsock thread\n");
+		rc = -ENOMEM;
+		goto out_release_vq;
+	}
+
+	vsock_dev = d;
+	for (i = 0; i < VIRTIO_VSOCK_VQ_MAX; i++)
+		virtqueue_intr_enable(d->vq[i]);
+	virtio_dev_drv_up(d->vdev);
+
+	uk_pr_info(DRIVER_NAME": Registered with guest CID %"__PRIu64"%s\n",
+		   d->cid, d->seqpacket ? ", seqpacket" : "");
+	return 0;
+
+out_release_vq:
+	/* The receive buffers go with the device, we do not reclaim them */
+	vsock_vq_release(d);
+out_free:
+	virtio_dev_status_update(d->vdev, VIRTIO_CONFIG_STATUS_FAIL);
+	uk_free(a, d);
+	return rc;
+}
+
+static int virtio_vsock_drv_init(struct uk_alloc *drv_allocator)
+{
+	if (!drv_allocator)
+		return -EINVAL;
+
+	a = drv_allocator;
+	return 0;
+}
+
+static const struct virtio_dev_id vvsock_dev_id[] = {
+	{VIRTIO_ID_VSOCK},
+	{VIRTIO_ID_INVALID} /* List Terminator */
+};
+
+static struct virtio_driver vvsock_drv = {
+	.dev_ids = vvsock_dev_id,
+	.init    = virtio_vsock_drv_init,
+	.add_dev = virtio_vsock_add_dev
+};
+VIRTIO_BUS_REGISTER_DRIVER(&vvsock_drv);
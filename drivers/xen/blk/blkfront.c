@@ -40,6 +40,7 @@
 #include <uk/arch/limits.h>
 #include <uk/page.h>
 #include <uk/blkdev_driver.h>
+#include <uk/plat/lcpu.h>
 #if defined(__i386__) || defined(__x86_64__)
 #include <xen-x86/mm.h>
 #include <xen-x86/mm_pv.h>
@@ -63,35 +64,77 @@
 #define BLKFRONT_INTR_USR_EN         (1 << 1)
 #define BLKFRONT_INTR_USR_EN_MASK    (2)
 
+/* Data segments that are granted at once when mapping a request */
+#define BLKFRONT_GRANT_BATCH         32
+
 /* Get blkfront_dev* which contains blkdev */
 #define to_blkfront(blkdev) \
 	__containerof(blkdev, struct blkfront_dev, blkdev)
 
 static struct uk_alloc *drv_allocator;
 
+/* Gives back gref elements to the pool of the queue. The elements that were
+ * allocated only for a request, which follow the reusable ones, are freed.
+ **/
+static void blkfront_grefs_put(struct uk_blkdev_queue *queue,
+		struct blkfront_gref **grefs, uint16_t nb_grefs)
+{
+	struct blkfront_gref *gref_elem;
+	uint16_t gref_id = 0;
+	int rc;
+#if CONFIG_LIBXEN_BLKFRONT_GREFPOOL
+	struct blkfront_grefs_pool *grefs_pool;
+
+	grefs_pool = &queue->ref_pool;
+	uk_semaphore_down(&grefs_pool->sem);
+	for (; gref_id < nb_grefs; ++gref_id) {
+		gref_elem = grefs[gref_id];
+		if (!gref_elem->reusable_gref)
+			break;
+
+		/* LIFO keeps the set of grants the backend uses small */
+		UK_STAILQ_INSERT_HEAD(&grefs_pool->grefs_list,
+			gref_elem,
+			_list);
+	}
+
+	uk_semaphore_up(&grefs_pool->sem);
+#endif
+	for (; gref_id < nb_grefs; ++gref_id) {
+		gref_elem = grefs[gref_id];
+		if (gref_elem->ref != GRANT_INVALID_REF) {
+			rc = gnttab_end_access(gref_elem->ref);
+			UK_ASSERT(rc);
+		}
+
+		if (gref_elem->page)
+			uk_pfree(queue->a, gref_elem->page, 1);
+		uk_free(queue->a, gref_elem);
+	}
+}
+
 /* This function gets from pool gref_elems or allocates new ones
  */
 static int blkfront_request_set_grefs(struct blkfront_request *blkfront_req)
 {
 	struct blkfront_gref *ref_elem;
-	uint16_t nb_segments;
-	int grefi = 0, grefj;
+	struct uk_blkdev_queue *queue;
+	uint16_t nb_grefs;
+	int grefi = 0;
 	int err = 0;
 
 #if CONFIG_LIBXEN_BLKFRONT_GREFPOOL
-	struct uk_blkdev_queue *queue;
 	struct blkfront_grefs_pool *grefs_pool;
-	int rc = 0;
 #endif
 
 	UK_ASSERT(blkfront_req != NULL);
-	nb_segments = blkfront_req->nb_segments;
+	queue = blkfront_req->queue;
+	nb_grefs = blkfront_req->nb_segments + blkfront_req->nb_indirect;
 
 #if CONFIG_LIBXEN_BLKFRONT_GREFPOOL
-	queue = blkfront_req->queue;
 	grefs_pool = &queue->ref_pool;
 	uk_semaphore_down(&grefs_pool->sem);
-	for (grefi = 0; grefi < nb_segments &&
+	for (grefi = 0; grefi < nb_grefs &&
 		!UK_STAILQ_EMPTY(&grefs_pool->grefs_list); ++grefi) {
 		ref_elem = UK_STAILQ_FIRST(&grefs_pool->grefs_list);
 		UK_STAILQ_REMOVE_HEAD(&grefs_pool->grefs_list, _list);
@@ -101,15 +144,18 @@ static int blkfront_request_set_grefs(struct blkfront_request *blkfront_req)
 	uk_semaphore_up(&grefs_pool->sem);
 #endif
 	/* we allocate new ones */
-	for (; grefi < nb_segments; ++grefi) {
-		ref_elem = uk_malloc(drv_allocator, sizeof(*ref_elem));
+	for (; grefi < nb_grefs; ++grefi) {
+		ref_elem = uk_malloc(queue->a, sizeof(*ref_elem));
 		if (!ref_elem) {
 			err = -ENOMEM;
 			goto err;
 		}
 
+		ref_elem->ref = GRANT_INVALID_REF;
+		ref_elem->page = NULL;
 #if CONFIG_LIBXEN_BLKFRONT_GREFPOOL
-		ref_elem->reusable_gref = false;
+		/* Persistently granted pages are kept for later requests */
+		ref_elem->reusable_gref = queue->dev->persistent;
 #endif
 		blkfront_req->gref[grefi] = ref_elem;
 	}
@@ -117,17 +163,8 @@ static int blkfront_request_set_grefs(struct blkfront_request *blkfront_req)
 out:
 	return err;
 err:
-	/* Free all the elements from 0 index to where the error happens */
-	for (grefj = 0; grefj < grefi; ++grefj) {
-		ref_elem = blkfront_req->gref[grefj];
-#if CONFIG_LIBXEN_BLKFRONT_GREFPOOL
-		if (ref_elem->reusable_gref) {
-			rc = gnttab_end_access(ref_elem->ref);
-			UK_ASSERT(rc);
-		}
-#endif
-		uk_free(drv_allocator, ref_elem);
-	}
+	/* Give back all the elements from 0 index to where the error happens */
+	blkfront_grefs_put(queue, blkfront_req->gref, grefi);
 	goto out;
 }
 
@@ -138,137 +175,222 @@ err:
  **/
 static void blkfront_request_reset_grefs(struct blkfront_request *req)
 {
-	uint16_t gref_id = 0;
-	struct blkfront_gref *gref_elem;
-	uint16_t nb_segments;
-	int rc;
-#if CONFIG_LIBXEN_BLKFRONT_GREFPOOL
-	struct uk_blkdev_queue *queue;
-	struct blkfront_grefs_pool *grefs_pool;
-#endif
-
 	UK_ASSERT(req);
-	nb_segments = req->nb_segments;
 
-#if CONFIG_LIBXEN_BLKFRONT_GREFPOOL
-	queue = req->queue;
-	grefs_pool = &queue->ref_pool;
-	uk_semaphore_down(&grefs_pool->sem);
-	for (; gref_id < nb_segments; ++gref_id) {
-		gref_elem = req->gref[gref_id];
-		if (!gref_elem->reusable_gref)
-			break;
+	blkfront_grefs_put(req->queue, req->gref,
+			req->nb_segments + req->nb_indirect);
+}
 
-		UK_STAILQ_INSERT_TAIL(&grefs_pool->grefs_list,
-			gref_elem,
-			_list);
+/* Grants the backend access to the page owned by a gref element. The page
+ * is allocated on first use. With persistent grants the page stays granted,
+ * writable for both directions.
+ **/
+static int blkfront_gref_map_page(struct uk_blkdev_queue *queue,
+		struct blkfront_gref *ref_elem, int readonly)
+{
+	domid_t otherend_id;
+	int rc __maybe_unused;
+
+	otherend_id = queue->dev->xendev->otherend_id;
+	if (!ref_elem->page) {
+		ref_elem->page = uk_palloc(queue->a, 1);
+		if (unlikely(!ref_elem->page))
+			return -ENOMEM;
+	} else if (queue->dev->persistent) {
+		return 0;
 	}
 
-	uk_semaphore_up(&grefs_pool->sem);
-#endif
-	for (; gref_id < nb_segments; ++gref_id) {
-		gref_elem = req->gref[gref_id];
-		if (gref_elem->ref != GRANT_INVALID_REF) {
-			rc = gnttab_end_access(gref_elem->ref);
-			UK_ASSERT(rc);
-		}
+	if (queue->dev->persistent)
+		readonly = 0;
 
-		uk_free(drv_allocator, gref_elem);
+	if (ref_elem->ref != GRANT_INVALID_REF) {
+		rc = gnttab_update_grant(ref_elem->ref, otherend_id,
+				virt_to_mfn(ref_elem->page), readonly);
+		UK_ASSERT(rc);
+	} else {
+		ref_elem->ref = gnttab_grant_access(otherend_id,
+				virt_to_mfn(ref_elem->page), readonly);
 	}
+
+	UK_ASSERT(ref_elem->ref != GRANT_INVALID_REF);
+	return 0;
 }
 
-/* This function sets the grant references from pool to point to
- * data set at request.
- * Otherwise, new blkfront_gref elems are allocated and new grant refs
- * as well.
+/* This function sets the grant references of the data segments to point
+ * to the pages of the request buffer. Grant refs from the pool are updated,
+ * new grant refs are allocated for the other blkfront_gref elems.
+ * With persistent grants, the segments use the pages of the elems instead.
  **/
-static void blkfront_request_map_grefs(struct blkif_request *ring_req,
-		domid_t otherend_id)
+static int blkfront_request_map_grefs(struct blkfront_request *blkfront_req,
+		int readonly)
 {
-	uint16_t gref_index;
-	struct blkfront_request *blkfront_req;
-	struct uk_blkreq *req;
-	uint16_t nb_segments;
+	unsigned long mfn[BLKFRONT_GRANT_BATCH];
+	grant_ref_t ref[BLKFRONT_GRANT_BATCH];
+	uint16_t gref_index, batch, i;
+	struct uk_blkdev_queue *queue;
+	domid_t otherend_id;
 	uintptr_t data;
 	uintptr_t start_sector;
 	struct blkfront_gref *ref_elem;
-#if CONFIG_LIBXEN_BLKFRONT_GREFPOOL
 	int rc;
-#endif
 
-	UK_ASSERT(ring_req);
+	UK_ASSERT(blkfront_req);
 
-	blkfront_req = (struct blkfront_request *)ring_req->id;
-	req = blkfront_req->req;
-	start_sector = round_pgdown((uintptr_t)req->aio_buf);
-	nb_segments = blkfront_req->nb_segments;
+	queue = blkfront_req->queue;
+	otherend_id = queue->dev->xendev->otherend_id;
+	start_sector = round_pgdown((uintptr_t)blkfront_req->req->aio_buf);
+
+	if (queue->dev->persistent) {
+		for (gref_index = 0; gref_index < blkfront_req->nb_segments;
+				++gref_index) {
+			ref_elem = blkfront_req->gref[gref_index];
+			rc = blkfront_gref_map_page(queue, ref_elem, readonly);
+			if (unlikely(rc))
+				return rc;
+		}
+		return 0;
+	}
 
-	for (gref_index = 0; gref_index < nb_segments; ++gref_index) {
-		data = start_sector + gref_index * PAGE_SIZE;
-		ref_elem = blkfront_req->gref[gref_index];
+	/* Grant the pages of the buffer in batches. Grant refs from the pool
+	 * are updated, the others are allocated.
+	 */
+	for (gref_index = 0; gref_index < blkfront_req->nb_segments;
+			gref_index += batch) {
+		batch = MIN(blkfront_req->nb_segments - gref_index,
+			    BLKFRONT_GRANT_BATCH);
+		for (i = 0; i < batch; ++i) {
+			data = start_sector + (gref_index + i) * PAGE_SIZE;
+			mfn[i] = virtual_to_mfn(data);
+			ref[i] = blkfront_req->gref[gref_index + i]->ref;
+		}
 
-#if CONFIG_LIBXEN_BLKFRONT_GREFPOOL
-		if (ref_elem->reusable_gref) {
-			rc = gnttab_update_grant(ref_elem->ref, otherend_id,
-				virtual_to_mfn(data), ring_req->operation);
-			UK_ASSERT(rc);
-		} else
-#endif
-		ref_elem->ref = gnttab_grant_access(otherend_id,
-				virtual_to_mfn(data), ring_req->operation);
+		rc = gnttab_grant_access_batch(otherend_id, mfn, ref, batch,
+				readonly);
+		UK_ASSERT(rc);
 
-		UK_ASSERT(ref_elem->ref != GRANT_INVALID_REF);
-		ring_req->seg[gref_index].gref = ref_elem->ref;
+		for (i = 0; i < batch; ++i) {
+			UK_ASSERT(ref[i] != GRANT_INVALID_REF);
+			blkfront_req->gref[gref_index + i]->ref = ref[i];
+		}
 	}
+
+	return 0;
 }
 
-static void blkif_request_init(struct blkif_request *ring_req,
-		__sector sector_size)
+/* Copies the data of a request between its buffer and the persistently
+ * granted pages of its segments. The data keeps its offset within the page.
+ **/
+static void blkfront_request_copy(struct blkfront_request *blkfront_req,
+		__sector sector_size, int to_grants)
 {
-	uintptr_t start_sector, end_sector;
-	uint16_t nb_segments;
-	struct blkfront_request *blkfront_req;
 	struct uk_blkreq *req;
 	uintptr_t start_data, end_data;
+	uintptr_t seg_start, seg_end;
 	uint16_t seg;
+	char *page;
 
-	UK_ASSERT(ring_req);
-	blkfront_req = (struct blkfront_request *)ring_req->id;
 	req = blkfront_req->req;
+	start_data = (uintptr_t)req->aio_buf;
+	end_data = start_data + req->nb_sectors * sector_size;
+
+	for (seg = 0; seg < blkfront_req->nb_segments; ++seg) {
+		seg_start = MAX(start_data,
+				round_pgdown(start_data) + seg * PAGE_SIZE);
+		seg_end = MIN(end_data, round_pgdown(seg_start) + PAGE_SIZE);
+		page = (char *)blkfront_req->gref[seg]->page +
+				(seg_start & ~PAGE_MASK);
+
+		if (to_grants)
+			memcpy(page, (void *)seg_start, seg_end - seg_start);
+		else
+			memcpy((void *)seg_start, page, seg_end - seg_start);
+	}
+}
+
+/*
+ * Find number of segments (pages)
+ * Being sector-size aligned buffer, it may not be aligned
+ * to page_size. If so, it is necessary to find the start and end
+ * of the pages the buffer is allocated, in order to calculate the
+ * number of pages the request has.
+ **/
+static uint16_t blkfront_request_nb_segments(struct uk_blkreq *req,
+		__sector sector_size)
+{
+	uintptr_t start_data, end_data;
+
 	start_data = (uintptr_t)req->aio_buf;
 	end_data = (uintptr_t)req->aio_buf + req->nb_sectors * sector_size;
 
 	/* Can't io non-sector-aligned buffer */
 	UK_ASSERT(!(start_data & (sector_size - 1)));
 
-	/*
-	 * Find number of segments (pages)
-	 * Being sector-size aligned buffer, it may not be aligned
-	 * to page_size. If so, it is necessary to find the start and end
-	 * of the pages the buffer is allocated, in order to calculate the
-	 * number of pages the request has.
-	 **/
-	start_sector = round_pgdown(start_data);
-	end_sector = round_pgup(end_data);
-	nb_segments = (end_sector - start_sector) / PAGE_SIZE;
-	UK_ASSERT(nb_segments <= BLKIF_MAX_SEGMENTS_PER_REQUEST);
+	return (round_pgup(end_data) - round_pgdown(start_data)) / PAGE_SIZE;
+}
 
-	/* Set ring request */
-	ring_req->operation = (req->operation == UK_BLKREQ_WRITE) ?
-			BLKIF_OP_WRITE : BLKIF_OP_READ;
+/* Set for a page the offset of sectors used for request */
+static void blkfront_request_seg_init(struct blkfront_request *blkfront_req,
+		uint16_t seg, __sector sector_size,
+		struct blkif_request_segment *ring_seg)
+{
+	struct uk_blkreq *req;
+	uintptr_t start_data, end_data;
+
+	req = blkfront_req->req;
+	start_data = (uintptr_t)req->aio_buf;
+	end_data = (uintptr_t)req->aio_buf + req->nb_sectors * sector_size;
+
+	ring_seg->gref = blkfront_req->gref[seg]->ref;
+	ring_seg->first_sect = (seg == 0) ?
+			SECTOR_INDEX_IN_PAGE(start_data, sector_size) : 0;
+	ring_seg->last_sect = (seg == blkfront_req->nb_segments - 1) ?
+			SECTOR_INDEX_IN_PAGE(end_data - 1, sector_size) :
+			PAGE_SIZE / sector_size - 1;
+}
+
+/* Requests with more segments than fit into the ring request carry their
+ * segment descriptors in indirect pages
+ **/
+static int blkif_request_indirect_init(struct blkfront_request *blkfront_req,
+		struct blkif_request_indirect *ring_req, uint8_t operation,
+		__sector sector_size)
+{
+	struct blkif_request_segment *ring_segs;
+	struct blkfront_gref *ref_elem;
+	struct blkfront_dev *dev;
+	uint16_t nb_segments;
+	uint16_t i, seg;
+	int rc;
+
+	dev = blkfront_req->queue->dev;
+	nb_segments = blkfront_req->nb_segments;
+
+	ring_req->operation = BLKIF_OP_INDIRECT;
+	ring_req->indirect_op = operation;
 	ring_req->nr_segments = nb_segments;
-	ring_req->sector_number = req->start_sector;
+	ring_req->id = (uintptr_t)blkfront_req;
+	ring_req->sector_number = blkfront_req->req->start_sector;
+	ring_req->handle = dev->handle;
+
+	for (i = 0; i < blkfront_req->nb_indirect; ++i) {
+		ref_elem = blkfront_req->gref[nb_segments + i];
+		rc = blkfront_gref_map_page(blkfront_req->queue, ref_elem, 1);
+		if (unlikely(rc))
+			return rc;
+
+		ring_req->indirect_grefs[i] = ref_elem->ref;
+	}
 
-	/* Set for each page the offset of sectors used for request */
 	for (seg = 0; seg < nb_segments; ++seg) {
-		ring_req->seg[seg].first_sect = 0;
-		ring_req->seg[seg].last_sect = PAGE_SIZE / sector_size - 1;
+		ref_elem = blkfront_req->gref[nb_segments +
+				seg / BLKFRONT_SEGS_PER_INDIRECT_FRAME];
+		ring_segs = ref_elem->page;
+		i = seg % BLKFRONT_SEGS_PER_INDIRECT_FRAME;
+		blkfront_request_seg_init(blkfront_req, seg, sector_size,
+				&ring_segs[i]);
 	}
 
-	ring_req->seg[0].first_sect =
-			SECTOR_INDEX_IN_PAGE(start_data, sector_size);
-	ring_req->seg[nb_segments - 1].last_sect =
-			SECTOR_INDEX_IN_PAGE(end_data - 1, sector_size);
+	return 0;
 }
 
 static int blkfront_request_write(struct blkfront_request *blkfront_req,
@@ -278,6 +400,9 @@ static int blkfront_request_write(struct blkfront_request *blkfront_req,
 	struct uk_blkreq *req;
 	struct uk_blkdev_cap *cap;
 	__sector sector_size;
+	uint16_t nb_segments;
+	uint16_t seg;
+	uint8_t operation;
 	int rc = 0;
 
 	UK_ASSERT(blkfront_req);
@@ -288,6 +413,10 @@ static int blkfront_request_write(struct blkfront_request *blkfront_req,
 	if (unlikely(req->operation == UK_BLKREQ_WRITE && cap->mode == O_RDONLY))
 		return -EPERM;
 
+	/* FUA writes are not supported (see capabilities) */
+	if (unlikely(req->flags))
+		return -ENOTSUP;
+
 	if (unlikely(req->aio_buf == NULL))
 		return -EINVAL;
 
@@ -300,19 +429,52 @@ static int blkfront_request_write(struct blkfront_request *blkfront_req,
 	if (unlikely(req->nb_sectors > cap->max_sectors_per_req))
 		return -EINVAL;
 
-	blkif_request_init(ring_req, sector_size);
-	blkfront_req->nb_segments = ring_req->nr_segments;
+	nb_segments = blkfront_request_nb_segments(req, sector_size);
+	UK_ASSERT(nb_segments <= dev->max_segments);
+	blkfront_req->nb_segments = nb_segments;
+	blkfront_req->nb_indirect =
+			(nb_segments > BLKIF_MAX_SEGMENTS_PER_REQUEST) ?
+			DIV_ROUND_UP(nb_segments,
+				     BLKFRONT_SEGS_PER_INDIRECT_FRAME) : 0;
+	operation = (req->operation == UK_BLKREQ_WRITE) ?
+			BLKIF_OP_WRITE : BLKIF_OP_READ;
 
 	/* Get blkfront_grefs from pool or allocate new ones */
 	rc = blkfront_request_set_grefs(blkfront_req);
 	if (rc)
 		goto out;
 
-	/* Map grant references to ring_req */
-	blkfront_request_map_grefs(ring_req, dev->xendev->otherend_id);
+	/* Map grant references of the data, read-only for writes */
+	rc = blkfront_request_map_grefs(blkfront_req,
+			operation == BLKIF_OP_WRITE);
+	if (unlikely(rc))
+		goto err_reset;
+
+	if (dev->persistent && operation == BLKIF_OP_WRITE)
+		blkfront_request_copy(blkfront_req, sector_size, 1);
+
+	if (blkfront_req->nb_indirect) {
+		rc = blkif_request_indirect_init(blkfront_req,
+				(struct blkif_request_indirect *)ring_req,
+				operation, sector_size);
+		if (unlikely(rc))
+			goto err_reset;
+		goto out;
+	}
+
+	/* Set ring request */
+	ring_req->operation = operation;
+	ring_req->nr_segments = nb_segments;
+	ring_req->sector_number = req->start_sector;
+	for (seg = 0; seg < nb_segments; ++seg)
+		blkfront_request_seg_init(blkfront_req, seg, sector_size,
+				&ring_req->seg[seg]);
 
 out:
 	return rc;
+err_reset:
+	blkfront_request_reset_grefs(blkfront_req);
+	goto out;
 }
 
 static int blkfront_request_flush(struct blkfront_request *blkfront_req,
@@ -482,11 +644,17 @@ static int blkfront_queue_dequeue(struct uk_blkdev_queue *queue,
 	status = rsp->status;
 	switch (rsp->operation) {
 	case BLKIF_OP_READ:
-		CHECK_STATUS(req_from_q, status, "read");
-		blkfront_request_reset_grefs(blkfront_req);
-		break;
 	case BLKIF_OP_WRITE:
-		CHECK_STATUS(req_from_q, status, "write");
+	case BLKIF_OP_INDIRECT:
+		if (req_from_q->operation == UK_BLKREQ_WRITE) {
+			CHECK_STATUS(req_from_q, status, "write");
+		} else {
+			CHECK_STATUS(req_from_q, status, "read");
+			if (queue->dev->persistent && status == BLKIF_RSP_OKAY)
+				blkfront_request_copy(blkfront_req,
+					queue->dev->blkdev.capabilities.ssize,
+					0);
+		}
 		blkfront_request_reset_grefs(blkfront_req);
 		break;
 	case BLKIF_OP_WRITE_BARRIER:
@@ -516,6 +684,7 @@ static int blkfront_complete_reqs(struct uk_blkdev *blkdev,
 		struct uk_blkdev_queue *queue)
 {
 	struct uk_blkreq *req;
+	int cnt = 0;
 	int rc;
 	int more;
 
@@ -538,6 +707,7 @@ moretodo:
 		uk_blkreq_finished(req);
 		if (req->cb)
 			req->cb(req, req->cb_cookie);
+		cnt++;
 	}
 
 	/* Enable interrupt only when user had previously enabled it */
@@ -552,7 +722,7 @@ moretodo:
 			goto moretodo;
 	}
 
-	return 0;
+	return cnt;
 
 err_exit:
 	return rc;
@@ -611,8 +781,10 @@ static void blkfront_queue_gref_pool_release(struct uk_blkdev_queue *queue)
 			UK_ASSERT(rc);
 		}
 
-		uk_free(queue->a, ref_elem);
 		UK_STAILQ_REMOVE_HEAD(&grefs_pool->grefs_list, _list);
+		if (ref_elem->page)
+			uk_pfree(queue->a, ref_elem->page, 1);
+		uk_free(queue->a, ref_elem);
 	}
 }
 
@@ -638,6 +810,7 @@ static int blkfront_queue_gref_pool_setup(struct uk_blkdev_queue *queue)
 		gref_elem->ref = gnttab_grant_access(dev->xendev->otherend_id,
 				0, 1);
 		UK_ASSERT(gref_elem->ref != GRANT_INVALID_REF);
+		gref_elem->page = NULL;
 		gref_elem->reusable_gref = true;
 		UK_STAILQ_INSERT_TAIL(&queue->ref_pool.grefs_list, gref_elem,
 				_list);
@@ -704,6 +877,11 @@ static struct uk_blkdev_queue *blkfront_queue_setup(struct uk_blkdev *blkdev,
 		goto err_out;
 	}
 
+	/* Spread the interrupts of the queues over the vCPUs */
+	err = evtchn_bind_vcpu(queue->evtchn, queue_id % ukplat_lcpu_count());
+	if (err)
+		uk_pr_warn("Failed to bind event-channel to vCPU: %d.\n", err);
+
 #if CONFIG_LIBXEN_BLKFRONT_GREFPOOL
 	err = blkfront_queue_gref_pool_setup(queue);
 	if (err)
@@ -888,7 +1066,7 @@ static void blkfront_get_info(struct uk_blkdev *blkdev,
 	UK_ASSERT(dev_info);
 
 	dev = to_blkfront(blkdev);
-	dev_info->max_queues = dev->nb_queues;
+	dev_info->max_queues = dev->max_queues;
 }
 
 static const struct uk_blkdev_ops blkfront_ops = {
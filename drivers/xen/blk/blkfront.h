@@ -52,6 +52,24 @@
 
 #define BLK_RING_PAGES_NUM 1
 
+/* Segment descriptors that fit into one indirect page */
+#define BLKFRONT_SEGS_PER_INDIRECT_FRAME \
+	(PAGE_SIZE / sizeof(struct blkif_request_segment))
+
+/* Maximum number of segments of a request. Requests with more than
+ * BLKIF_MAX_SEGMENTS_PER_REQUEST segments use indirect descriptors.
+ */
+#if CONFIG_LIBXEN_BLKFRONT_MAX_INDIRECT_SEGMENTS > \
+	BLKIF_MAX_SEGMENTS_PER_REQUEST
+#define BLKFRONT_MAX_SEGMENTS CONFIG_LIBXEN_BLKFRONT_MAX_INDIRECT_SEGMENTS
+#else
+#define BLKFRONT_MAX_SEGMENTS BLKIF_MAX_SEGMENTS_PER_REQUEST
+#endif
+
+/* Maximum number of indirect pages of a request */
+#define BLKFRONT_MAX_INDIRECT_PAGES \
+	DIV_ROUND_UP(BLKFRONT_MAX_SEGMENTS, BLKFRONT_SEGS_PER_INDIRECT_FRAME)
+
 #if CONFIG_LIBXEN_BLKFRONT_GREFPOOL
 /**
  * Structure used to describe a list of blkfront_gref elements.
@@ -60,7 +78,8 @@ UK_STAILQ_HEAD(blkfront_gref_list, struct blkfront_gref);
 
 /*
  * Structure used to describe a pool of grant refs for each queue.
- * It contains max BLKIF_MAX_SEGMENTS_PER_REQUEST elems.
+ * It starts with BLKIF_MAX_SEGMENTS_PER_REQUEST elems. With persistent
+ * grants, the elements allocated for requests are kept as well.
  **/
 struct blkfront_grefs_pool {
 	/* List of grefs. */
@@ -76,6 +95,10 @@ struct blkfront_grefs_pool {
 struct blkfront_gref {
 	/* Grant ref number. */
 	grant_ref_t ref;
+	/* Page owned by this element, used for indirect segments and
+	 * persistent grants. NULL until first needed.
+	 **/
+	void *page;
 #if CONFIG_LIBXEN_BLKFRONT_GREFPOOL
 	/* Entry for pool. */
 	UK_STAILQ_ENTRY(struct blkfront_gref) _list;
@@ -92,10 +115,16 @@ struct blkfront_gref {
 struct blkfront_request {
 	/* Request from the API. */
 	struct uk_blkreq *req;
-	/* List with maximum number of blkfront_grefs for a request. */
-	struct blkfront_gref *gref[BLKIF_MAX_SEGMENTS_PER_REQUEST];
+	/* List with maximum number of blkfront_grefs for a request.
+	 * The grefs of the data segments are followed by the ones of the
+	 * indirect pages.
+	 **/
+	struct blkfront_gref *gref[BLKFRONT_MAX_SEGMENTS +
+				   BLKFRONT_MAX_INDIRECT_PAGES];
 	/* Number of segments. */
 	uint16_t nb_segments;
+	/* Number of indirect pages, 0 for direct requests. */
+	uint16_t nb_indirect;
 	/* Queue in which the request will be stored */
 	struct uk_blkdev_queue *queue;
 };
@@ -142,6 +171,16 @@ struct blkfront_dev {
 	 * BLKIF_OP_WRITE_FLUSH_DISKCACHE request opcode.
 	 */
 	int flush;
+	/* Value which indicates that both ends use persistent grants: data is
+	 * copied to and from the pages of the grant reference pool.
+	 */
+	int persistent;
+	/* Maximum number of segments per request, larger than
+	 * BLKIF_MAX_SEGMENTS_PER_REQUEST if indirect descriptors are used.
+	 */
+	uint16_t max_segments;
+	/* Maximum number of queues supported by the backend */
+	uint16_t max_queues;
 	/* Number of configured queues used for requests */
 	uint16_t nb_queues;
 	/* Vector of queues used for communication with backend */
@@ -39,6 +39,7 @@
 #include <uk/errptr.h>
 #include <uk/print.h>
 #include <uk/assert.h>
+#include <uk/essentials.h>
 #include <uk/xenbus/client.h>
 #include <uk/xenbus/xs.h>
 #if defined(__aarch64__)
@@ -68,23 +69,23 @@ out:
 	return err;
 }
 
-static int blkfront_xb_get_nb_max_queues(struct blkfront_dev *dev)
+static void blkfront_xb_get_nb_max_queues(struct blkfront_dev *dev)
 {
 	int err = 0;
 	struct xenbus_device *xendev;
+	uint16_t max_queues;
 
 	UK_ASSERT(dev != NULL);
 	xendev = dev->xendev;
 
 	err = xs_scanf(XBT_NIL, xendev->otherend, "multi-queue-max-queues",
 				"%"SCNu16,
-				&dev->nb_queues);
-	if (err < 0) {
-		uk_pr_err("Failed to read multi-queue-max-queues: %d\n", err);
-		return err;
-	}
+				&max_queues);
+	/* Backends without multi-queue support serve a single ring */
+	if (err < 0 || max_queues == 0)
+		max_queues = 1;
 
-	return 0;
+	dev->max_queues = MIN(max_queues, CONFIG_LIBXEN_BLKFRONT_MAX_QUEUES);
 }
 
 int blkfront_xb_init(struct blkfront_dev *dev)
@@ -122,11 +123,7 @@ int blkfront_xb_init(struct blkfront_dev *dev)
 		goto out;
 	}
 
-	err = blkfront_xb_get_nb_max_queues(dev);
-	if (err) {
-		uk_pr_err("Failed to read multi-queue-max-queues: %d\n", err);
-		goto out;
-	}
+	blkfront_xb_get_nb_max_queues(dev);
 out:
 	return err;
 }
@@ -176,6 +173,9 @@ static int blkfront_xb_get_capabilities(struct blkfront_dev *blkdev)
 	struct xenbus_device *xendev;
 	char *mode;
 	int err = 0;
+#if BLKFRONT_MAX_SEGMENTS > BLKIF_MAX_SEGMENTS_PER_REQUEST
+	unsigned int max_indirect_segs;
+#endif
 
 	UK_ASSERT(blkdev != NULL);
 	xendev = blkdev->xendev;
@@ -214,9 +214,28 @@ static int blkfront_xb_get_capabilities(struct blkfront_dev *blkdev)
 		return PTR2ERR(mode);
 	}
 
+	/* Optional features, the backend may not advertise them */
+	blkdev->persistent = 0;
+#if CONFIG_LIBXEN_BLKFRONT_PERSISTENT_GRANTS
+	err = xs_scanf(XBT_NIL, xendev->otherend, "feature-persistent",
+					"%d", &blkdev->persistent);
+	if (err < 0)
+		blkdev->persistent = 0;
+#endif
+
+	blkdev->max_segments = BLKIF_MAX_SEGMENTS_PER_REQUEST;
+#if BLKFRONT_MAX_SEGMENTS > BLKIF_MAX_SEGMENTS_PER_REQUEST
+	err = xs_scanf(XBT_NIL, xendev->otherend,
+			"feature-max-indirect-segments",
+			"%u", &max_indirect_segs);
+	if (err > 0 && max_indirect_segs > BLKIF_MAX_SEGMENTS_PER_REQUEST)
+		blkdev->max_segments = MIN(max_indirect_segs,
+				(unsigned int)BLKFRONT_MAX_SEGMENTS);
+#endif
+
 	blkdev->blkdev.capabilities.mode = (*mode == 'r') ? O_RDONLY : O_RDWR;
 	blkdev->blkdev.capabilities.max_sectors_per_req =
-			(BLKIF_MAX_SEGMENTS_PER_REQUEST - 1) *
+			(blkdev->max_segments - 1) *
 			(PAGE_SIZE / blkdev->blkdev.capabilities.ssize) + 1;
 	blkdev->blkdev.capabilities.ioalign = blkdev->blkdev.capabilities.ssize;
 
@@ -506,6 +525,15 @@ int blkfront_xb_connect(struct blkfront_dev *blkdev)
 		return err;
 	}
 
+#if CONFIG_LIBXEN_BLKFRONT_PERSISTENT_GRANTS
+	err = xs_printf(XBT_NIL, xendev->nodename, "feature-persistent",
+			"%u", 1);
+	if (err < 0) {
+		uk_pr_err("Failed to write feature-persistent: %d\n", err);
+		return err;
+	}
+#endif
+
 	err = uk_xenbus_switch_state(XBT_NIL, xendev, XenbusStateConnected);
 	if (err) {
 		uk_pr_err("Failed to switch state to XenbusStateConnected: %d.\n",
@@ -39,6 +39,7 @@
 #include <uk/print.h>
 #include <uk/alloc.h>
 #include <uk/netdev_driver.h>
+#include <uk/plat/lcpu.h>
 #if defined(__i386__) || defined(__x86_64__)
 #include <xen-x86/mm.h>
 #include <xen-x86/irq.h>
@@ -88,6 +89,59 @@ static uint16_t get_id_from_freelist(uint16_t *freelist)
 	return id;
 }
 
+#if CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS
+/*
+ * Allocates pages for the slots of a queue and grants them to the backend
+ * for the lifetime of the queue. `per_page` consecutive slots share a page
+ * and its grant.
+ */
+static int netfront_gbufs_alloc(struct netfront_dev *nfdev, void **gbuf,
+		grant_ref_t *gref, uint16_t nb_slots, uint16_t per_page,
+		int readonly, struct uk_alloc *a)
+{
+	uint16_t i, j;
+	void *page;
+
+	for (i = 0; i < nb_slots; i += per_page) {
+		page = uk_palloc(a, 1);
+		if (unlikely(!page))
+			goto err_free;
+
+		gref[i] = gnttab_grant_access(nfdev->xendev->otherend_id,
+					      virt_to_mfn(page), readonly);
+		UK_ASSERT(gref[i] != GRANT_INVALID_REF);
+		for (j = 0; j < per_page; j++) {
+			gbuf[i + j] = (char *) page + j * (PAGE_SIZE / per_page);
+			gref[i + j] = gref[i];
+		}
+	}
+	return 0;
+
+err_free:
+	while (i > 0) {
+		i -= per_page;
+		gnttab_end_access(gref[i]);
+		uk_pfree(a, gbuf[i], 1);
+	}
+	return -ENOMEM;
+}
+
+/* Copies a netbuf chain to a transmit buffer, returns the frame length */
+static int netfront_txbuf_copy(void *gbuf, struct uk_netbuf *pkt)
+{
+	struct uk_netbuf *nb;
+	size_t len = 0;
+
+	UK_NETBUF_CHAIN_FOREACH(nb, pkt) {
+		if (unlikely(len + nb->len > NETFRONT_TX_GBUF_SIZE))
+			return -EMSGSIZE;
+		memcpy((char *) gbuf + len, nb->data, nb->len);
+		len += nb->len;
+	}
+	return (int) len;
+}
+#endif /* CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS */
+
 static int network_tx_buf_gc(struct uk_netdev_tx_queue *txq)
 {
 	RING_IDX prod, cons;
@@ -113,7 +167,9 @@ static int network_tx_buf_gc(struct uk_netdev_tx_queue *txq)
 		id  = tx_rsp->id;
 		UK_ASSERT(id < NET_TX_RING_SIZE);
 
+#if !CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS
 		uk_netbuf_free_single(txq->nbuf[id]);
+#endif /* !CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS */
 
 		add_id_to_freelist(id, txq->freelist);
 
@@ -128,7 +184,7 @@ static int netfront_xmit(struct uk_netdev *n,
 		struct uk_netdev_tx_queue *txq,
 		struct uk_netbuf *pkt)
 {
-	struct netfront_dev *nfdev;
+	struct netfront_dev *nfdev __maybe_unused;
 	unsigned long flags;
 	uint16_t id;
 	RING_IDX req_prod;
@@ -136,13 +192,18 @@ static int netfront_xmit(struct uk_netdev *n,
 	bool more_to_do;
 	int notify;
 	int status;
+#if CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS
+	int len;
+#endif /* CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS */
 
 	UK_ASSERT(n != NULL);
 	UK_ASSERT(txq != NULL);
 	UK_ASSERT(pkt != NULL);
+#if !CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS
 	UK_ASSERT(pkt->len < PAGE_SIZE);
 	UK_ASSERT(!pkt->next); /* TODO: Support for netbuf chains missing */
 	UK_ASSERT(((unsigned long) pkt->buf & ~PAGE_MASK) == 0);
+#endif /* !CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS */
 
 	nfdev = to_netfront_dev(n);
 
@@ -152,6 +213,8 @@ static int netfront_xmit(struct uk_netdev *n,
 		network_tx_buf_gc(txq);
 		if (unlikely(RING_FULL(&txq->ring))) {
 			uk_pr_debug("tx queue is full\n");
+			uk_netdev_drv_txq_stats_inc(n, txq->lqueue_id,
+						    ring_full);
 			local_irq_restore(flags);
 			return 0x0;
 		}
@@ -164,6 +227,18 @@ static int netfront_xmit(struct uk_netdev *n,
 	req_prod = txq->ring.req_prod_pvt;
 	tx_req = RING_GET_REQUEST(&txq->ring, req_prod);
 
+#if CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS
+	/* copy the frame to the granted buffer, the netbuf is not kept */
+	len = netfront_txbuf_copy(txq->gbuf[id], pkt);
+	if (unlikely(len < 0)) {
+		add_id_to_freelist(id, txq->freelist);
+		local_irq_restore(flags);
+		return len;
+	}
+	txq->nbuf[id] = NULL;
+	tx_req->offset = (uint16_t) ((unsigned long) txq->gbuf[id] & ~PAGE_MASK);
+	tx_req->size = (uint16_t) len;
+#else /* !CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS */
 	/* setup grant for buffer data */
 	if (unlikely(txq->gref[id] == GRANT_INVALID_REF)) {
 		/* allocating of a new grant needed */
@@ -181,9 +256,10 @@ static int netfront_xmit(struct uk_netdev *n,
 
 	/* remember netbuf reference for free'ing it later */
 	txq->nbuf[id] = pkt;
-	tx_req->gref = txq->gref[id];
 	tx_req->offset = (uint16_t) uk_netbuf_headroom(pkt);
 	tx_req->size = (uint16_t) pkt->len;
+#endif /* !CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS */
+	tx_req->gref = txq->gref[id];
 	tx_req->flags  = (pkt->flags & UK_NETBUF_F_PARTIAL_CSUM)
 			 ? NETTXF_csum_blank : 0x0;
 	tx_req->flags |= (pkt->flags & UK_NETBUF_F_DATA_VALID)
@@ -195,8 +271,10 @@ static int netfront_xmit(struct uk_netdev *n,
 	wmb(); /* Ensure backend sees requests */
 
 	RING_PUSH_REQUESTS_AND_CHECK_NOTIFY(&txq->ring, notify);
-	if (notify)
+	if (notify) {
 		notify_remote_via_evtchn(txq->evtchn);
+		uk_netdev_drv_txq_stats_inc(n, txq->lqueue_id, kicks);
+	}
 
 
 	/* some cleanup */
@@ -208,25 +286,28 @@ static int netfront_xmit(struct uk_netdev *n,
 	status |= (RING_FULL(&txq->ring)) ? 0x0 : UK_NETDEV_STATUS_MORE;
 	local_irq_restore(flags);
 
+#if CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS
+	uk_netbuf_free(pkt);
+#endif /* CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS */
 	return status;
 }
 
-static int netfront_rxq_enqueue(struct uk_netdev_rx_queue *rxq,
+/* Posts a receive request for the next slot. The grant of the slot must be
+ * set up already and the ring must have room. The caller pushes the
+ * requests to the backend with netfront_rxq_push().
+ */
+static void netfront_rxq_post(struct uk_netdev_rx_queue *rxq,
 		struct uk_netbuf *netbuf)
 {
 	RING_IDX req_prod;
 	uint16_t id;
 	netif_rx_request_t *rx_req;
-	struct netfront_dev *nfdev;
-	int notify;
 
-	/* buffer must be page aligned */
-	UK_ASSERT(((unsigned long) netbuf->buf & ~PAGE_MASK) == 0);
-
-	if (unlikely(RING_FULL(&rxq->ring))) {
-		uk_pr_debug("rx queue is full\n");
-		return -ENOSPC;
-	}
+#if CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS
+	/* the granted page of the slot is posted instead */
+	UK_ASSERT(!netbuf);
+#endif /* CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS */
+	UK_ASSERT(!RING_FULL(&rxq->ring));
 
 	/* get request */
 	req_prod = rxq->ring.req_prod_pvt;
@@ -234,41 +315,88 @@ static int netfront_rxq_enqueue(struct uk_netdev_rx_queue *rxq,
 	rx_req = RING_GET_REQUEST(&rxq->ring, req_prod);
 	rx_req->id = id;
 
+#if !CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS
 	/* save buffer */
 	rxq->netbuf[id] = netbuf;
-	/* setup grant for buffer data */
-	nfdev = rxq->netfront_dev;
-	if (unlikely(rxq->gref[id] == GRANT_INVALID_REF)) {
-		/* allocating of a new grant needed */
-		rxq->gref[id] = gnttab_grant_access(nfdev->xendev->otherend_id,
-						    virt_to_mfn(netbuf->buf),
-						    0);
-	} else {
-		/* re-use grant (update it) */
-		gnttab_update_grant(rxq->gref[id],
-				    nfdev->xendev->otherend_id,
-				    virt_to_mfn(netbuf->buf),
-				    0);
-	}
+#endif /* !CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS */
 	UK_ASSERT(rxq->gref[id] != GRANT_INVALID_REF);
 
 	rx_req->gref = rxq->gref[id];
-	wmb(); /* Ensure backend sees requests */
 	rxq->ring.req_prod_pvt = req_prod + 1;
+}
 
+/* Makes posted requests visible to the backend, notifies it once per batch */
+static void netfront_rxq_push(struct uk_netdev_rx_queue *rxq)
+{
+	int notify;
+
+	/* Ensures that the backend sees the requests */
 	RING_PUSH_REQUESTS_AND_CHECK_NOTIFY(&rxq->ring, notify);
-	if (notify)
+	if (notify) {
 		notify_remote_via_evtchn(rxq->evtchn);
+		uk_netdev_drv_rxq_stats_inc(&rxq->netfront_dev->netdev,
+					    rxq->lqueue_id, kicks);
+	}
+}
 
-	return 0;
+static void netfront_rxbuf_flags(struct uk_netbuf *buf,
+		const netif_rx_response_t *rx_rsp)
+{
+	buf->flags  = (rx_rsp->flags & NETRXF_csum_blank)
+		      ? UK_NETBUF_F_PARTIAL_CSUM : 0x0;
+	buf->flags |= (rx_rsp->flags & NETRXF_data_validated)
+		      ? UK_NETBUF_F_DATA_VALID : 0x0;
+
+	/* netfront does not tell us where the checksum is located */
+	buf->csum_start  = 0;
+	buf->csum_offset = 0;
+}
+
+#if CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS
+/*
+ * Copies a received packet from the granted page of its slot to a netbuf of
+ * the user. Returns NULL if the packet has to be dropped.
+ */
+static struct uk_netbuf *netfront_rxbuf_copy(struct uk_netdev_rx_queue *rxq,
+		const netif_rx_response_t *rx_rsp, uint16_t id)
+{
+	struct uk_netbuf *buf;
+	uint16_t len;
+
+	if (unlikely(rx_rsp->status < 0)) {
+		uk_pr_err("rxq %p: Receive error %d!\n", rxq, rx_rsp->status);
+		return NULL;
+	}
+
+	if (unlikely(rxq->alloc_rxpkts(rxq->alloc_rxpkts_argp, &buf, 1)
+		     != 1)) {
+		uk_netdev_drv_rxq_stats_inc(&rxq->netfront_dev->netdev,
+					    rxq->lqueue_id, ring_full);
+		return NULL;
+	}
+
+	len = (uint16_t) rx_rsp->status;
+	if (len > UK_ETH_FRAME_MAXLEN)
+		len = UK_ETH_FRAME_MAXLEN;
+	if (unlikely(uk_netbuf_tailroom(buf) < len)) {
+		uk_pr_err("rxq %p: Receive buffer too small\n", rxq);
+		uk_netbuf_free(buf);
+		return NULL;
+	}
+
+	memcpy(buf->data, (char *) rxq->gbuf[id] + rx_rsp->offset, len);
+	buf->len = len;
+	netfront_rxbuf_flags(buf, rx_rsp);
+	return buf;
 }
+#endif /* CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS */
 
 static int netfront_rxq_dequeue(struct uk_netdev_rx_queue *rxq,
 		struct uk_netbuf **netbuf)
 {
 	RING_IDX prod, cons;
 	netif_rx_response_t *rx_rsp;
-	uint16_t len, id;
+	uint16_t len __maybe_unused, id;
 	struct uk_netbuf *buf = NULL;
 	int count = 0;
 
@@ -292,6 +420,9 @@ static int netfront_rxq_dequeue(struct uk_netdev_rx_queue *rxq,
 
 	/* NOTE: we keep the last grant for re-use */
 
+#if CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS
+	buf = netfront_rxbuf_copy(rxq, rx_rsp, id);
+#else /* !CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS */
 	buf = rxq->netbuf[id];
 	if (unlikely(rx_rsp->status < 0)) {
 		uk_pr_err("rxq %p: Receive error %d!\n", rxq, rx_rsp->status);
@@ -305,15 +436,9 @@ static int netfront_rxq_dequeue(struct uk_netdev_rx_queue *rxq,
 		buf->len = len;
 		UK_ASSERT(IN_RANGE(buf->data, buf->buf, buf->buflen));
 
-		buf->flags |= (rx_rsp->flags & NETTXF_csum_blank)
-			      ? UK_NETBUF_F_PARTIAL_CSUM : 0x0;
-		buf->flags |= (rx_rsp->flags & NETTXF_data_validated)
-			      ? UK_NETBUF_F_DATA_VALID : 0x0;
-
-		/* netfront does not tell us where the checksum is located */
-		buf->csum_start  = 0;
-		buf->csum_offset = 0;
+		netfront_rxbuf_flags(buf, rx_rsp);
 	}
+#endif /* !CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS */
 
 	*netbuf = buf;
 
@@ -326,36 +451,67 @@ out:
 
 static int netfront_rx_fillup(struct uk_netdev_rx_queue *rxq, uint16_t nb_desc)
 {
+#if CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS
+	/* The slots are re-posted with their granted pages */
+	uint16_t n = MIN(nb_desc, RING_FREE_REQUESTS(&rxq->ring));
+
+	for (uint16_t i = 0; i < n; i++)
+		netfront_rxq_post(rxq, NULL);
+	if (n)
+		netfront_rxq_push(rxq);
+	return 0;
+#else /* !CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS */
 	struct uk_netbuf *netbuf[nb_desc];
-	int rc, status = 0;
-	uint16_t cnt;
+	unsigned long mfn[nb_desc];
+	grant_ref_t gref[nb_desc];
+	RING_IDX req_prod;
+	uint16_t cnt, n, i;
+	int rc __maybe_unused;
+	int status = 0;
 
 	cnt = rxq->alloc_rxpkts(rxq->alloc_rxpkts_argp, netbuf, nb_desc);
 
-	for (uint16_t i = 0; i < cnt; i++) {
-		rc = netfront_rxq_enqueue(rxq, netbuf[i]);
-		if (unlikely(rc < 0)) {
-			uk_pr_err("Failed to add a buffer to rx queue %p: %d\n",
-				rxq, rc);
+	n = MIN(cnt, RING_FREE_REQUESTS(&rxq->ring));
+	if (unlikely(n < cnt)) {
+		uk_pr_err("Failed to add %u buffers to rx queue %p: %d\n",
+			  cnt - n, rxq, -ENOSPC);
 
-			/*
-			 * Release netbufs that we are not going
-			 * to use anymore
-			 */
-			for (uint16_t j = i; j < cnt; j++)
-				uk_netbuf_free(netbuf[j]);
+		/* Release netbufs that we are not going to use anymore */
+		for (i = n; i < cnt; i++)
+			uk_netbuf_free(netbuf[i]);
 
-			status |= UK_NETDEV_STATUS_UNDERRUN;
+		status |= UK_NETDEV_STATUS_UNDERRUN;
+	}
 
-			goto out;
-		}
+	/* Grant all buffers at once. The slots keep their grant references
+	 * and a reference is only allocated for a slot without one.
+	 */
+	req_prod = rxq->ring.req_prod_pvt;
+	for (i = 0; i < n; i++) {
+		/* buffer must be page aligned */
+		UK_ASSERT(((unsigned long) netbuf[i]->buf & ~PAGE_MASK) == 0);
+		mfn[i] = virt_to_mfn(netbuf[i]->buf);
+		gref[i] = rxq->gref[xennet_rxidx(req_prod + i)];
 	}
+	rc = gnttab_grant_access_batch(rxq->netfront_dev->xendev->otherend_id,
+				       mfn, gref, n, 0);
+	UK_ASSERT(rc);
+
+	for (i = 0; i < n; i++) {
+		rxq->gref[xennet_rxidx(req_prod + i)] = gref[i];
+		netfront_rxq_post(rxq, netbuf[i]);
+	}
+	if (n)
+		netfront_rxq_push(rxq);
 
 	if (unlikely(cnt < nb_desc))
 		status |= UK_NETDEV_STATUS_UNDERRUN;
 
-out:
+	if (unlikely(status & UK_NETDEV_STATUS_UNDERRUN))
+		uk_netdev_drv_rxq_stats_inc(&rxq->netfront_dev->netdev,
+					    rxq->lqueue_id, ring_full);
 	return status;
+#endif /* !CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS */
 }
 
 /* Returns 1 if more packets available */
@@ -445,7 +601,7 @@ static struct uk_netdev_tx_queue *netfront_txq_setup(struct uk_netdev *n,
 	UK_ASSERT(n != NULL);
 
 	nfdev = to_netfront_dev(n);
-	if (queue_id >= nfdev->max_queue_pairs) {
+	if (queue_id >= nfdev->nb_queue_pairs) {
 		uk_pr_err("Invalid queue identifier: %"__PRIu16"\n", queue_id);
 		return ERR2PTR(-EINVAL);
 	}
@@ -467,6 +623,18 @@ static struct uk_netdev_tx_queue *netfront_txq_setup(struct uk_netdev *n,
 		virt_to_mfn(sring), 0);
 	UK_ASSERT(txq->ring_ref != GRANT_INVALID_REF);
 
+#if CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS
+	rc = netfront_gbufs_alloc(nfdev, txq->gbuf, txq->gref,
+				  NET_TX_RING_SIZE, NETFRONT_TX_GBUFS_PER_PAGE,
+				  1, conf->a);
+	if (rc) {
+		uk_pr_err("Error granting transmit buffers: %d\n", rc);
+		gnttab_end_access(txq->ring_ref);
+		uk_pfree(conf->a, sring, 1);
+		return ERR2PTR(rc);
+	}
+#endif /* CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS */
+
 	/* Setup event channel */
 	if (nfdev->split_evtchn || !nfdev->rxqs[queue_id].initialized) {
 		rc = evtchn_alloc_unbound(nfdev->xendev->otherend_id,
@@ -487,7 +655,9 @@ static struct uk_netdev_tx_queue *netfront_txq_setup(struct uk_netdev *n,
 	/* Initialize list of request ids */
 	for (uint16_t i = 0; i < NET_TX_RING_SIZE; i++) {
 		add_id_to_freelist(i, txq->freelist);
+#if !CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS
 		txq->gref[i] = GRANT_INVALID_REF;
+#endif /* !CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS */
 		txq->netbuf[i] = NULL;
 	}
 
@@ -524,7 +694,7 @@ static struct uk_netdev_rx_queue *netfront_rxq_setup(struct uk_netdev *n,
 	UK_ASSERT(conf != NULL);
 
 	nfdev = to_netfront_dev(n);
-	if (queue_id >= nfdev->max_queue_pairs) {
+	if (queue_id >= nfdev->nb_queue_pairs) {
 		uk_pr_err("Invalid queue identifier: %"__PRIu16"\n", queue_id);
 		return ERR2PTR(-EINVAL);
 	}
@@ -546,6 +716,17 @@ static struct uk_netdev_rx_queue *netfront_rxq_setup(struct uk_netdev *n,
 		virt_to_mfn(sring), 0);
 	UK_ASSERT(rxq->ring_ref != GRANT_INVALID_REF);
 
+#if CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS
+	rc = netfront_gbufs_alloc(nfdev, rxq->gbuf, rxq->gref,
+				  NET_RX_RING_SIZE, 1, 0, conf->a);
+	if (rc) {
+		uk_pr_err("Error granting receive buffers: %d\n", rc);
+		gnttab_end_access(rxq->ring_ref);
+		uk_pfree(conf->a, sring, 1);
+		return ERR2PTR(rc);
+	}
+#endif /* CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS */
+
 	/* Setup event channel */
 	if (nfdev->split_evtchn || !nfdev->txqs[queue_id].initialized) {
 		rc = evtchn_alloc_unbound(nfdev->xendev->otherend_id,
@@ -562,6 +743,11 @@ static struct uk_netdev_rx_queue *netfront_rxq_setup(struct uk_netdev *n,
 		/* overwriting event handler */
 		bind_evtchn(rxq->evtchn, netfront_rxq_handler, rxq);
 	}
+
+	/* Spread the receive interrupts of the queues over the vCPUs */
+	rc = evtchn_bind_vcpu(rxq->evtchn, queue_id % ukplat_lcpu_count());
+	if (rc)
+		uk_pr_warn("Failed to bind event channel to vCPU: %d\n", rc);
 	/*
 	 * By default, events are disabled and it is up to the user or
 	 * network stack to explicitly enable them.
@@ -572,8 +758,10 @@ static struct uk_netdev_rx_queue *netfront_rxq_setup(struct uk_netdev *n,
 	rxq->alloc_rxpkts = conf->alloc_rxpkts;
 	rxq->alloc_rxpkts_argp = conf->alloc_rxpkts_argp;
 
+#if !CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS
 	for (uint16_t i = 0; i < NET_RX_RING_SIZE; i++)
 		rxq->gref[i] = GRANT_INVALID_REF;
+#endif /* !CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS */
 
 	/* Allocate receive buffers for this queue */
 	netfront_rx_fillup(rxq, rxq->ring_size);
@@ -595,36 +783,44 @@ static int netfront_rxtx_alloc(struct netfront_dev *nfdev,
 		goto err_free_txrx;
 	}
 
-	nfdev->max_queue_pairs =
-		MIN(nfdev->max_queue_pairs, conf->nb_tx_queues);
+	if (conf->nb_tx_queues > nfdev->max_queue_pairs) {
+		uk_pr_err("Backend supports up to %"__PRIu16" queue pairs\n",
+			  nfdev->max_queue_pairs);
+		rc = -ENOTSUP;
+		goto err_free_txrx;
+	}
+	nfdev->nb_queue_pairs = conf->nb_tx_queues;
 
 	nfdev->txqs = uk_calloc(drv_allocator,
-		nfdev->max_queue_pairs, sizeof(*nfdev->txqs));
+		nfdev->nb_queue_pairs, sizeof(*nfdev->txqs));
 	if (unlikely(!nfdev->txqs)) {
 		uk_pr_err("Failed to allocate memory for tx queues\n");
 		rc = -ENOMEM;
 		goto err_free_txrx;
 	}
-	for (i = 0; i < nfdev->max_queue_pairs; i++)
+	for (i = 0; i < nfdev->nb_queue_pairs; i++)
 		nfdev->txqs[i].ring_size = NET_TX_RING_SIZE;
 
 	nfdev->rxqs = uk_calloc(drv_allocator,
-		nfdev->max_queue_pairs, sizeof(*nfdev->rxqs));
+		nfdev->nb_queue_pairs, sizeof(*nfdev->rxqs));
 	if (unlikely(!nfdev->rxqs)) {
 		uk_pr_err("Failed to allocate memory for rx queues\n");
 		rc = -ENOMEM;
 		goto err_free_txrx;
 	}
-	for (i = 0; i < nfdev->max_queue_pairs; i++)
+	for (i = 0; i < nfdev->nb_queue_pairs; i++)
 		nfdev->rxqs[i].ring_size = NET_RX_RING_SIZE;
 
 	return rc;
 
 err_free_txrx:
-	if (!nfdev->rxqs)
+	if (nfdev->rxqs)
 		uk_free(drv_allocator, nfdev->rxqs);
-	if (!nfdev->txqs)
+	if (nfdev->txqs)
 		uk_free(drv_allocator, nfdev->txqs);
+	nfdev->rxqs = NULL;
+	nfdev->txqs = NULL;
+	nfdev->nb_queue_pairs = 0;
 
 	return rc;
 }
@@ -680,7 +876,7 @@ static int netfront_txq_info_get(struct uk_netdev *n,
 	UK_ASSERT(qinfo != NULL);
 
 	nfdev = to_netfront_dev(n);
-	if (unlikely(queue_id >= nfdev->max_queue_pairs)) {
+	if (unlikely(queue_id >= nfdev->nb_queue_pairs)) {
 		uk_pr_err("Invalid queue_id %"__PRIu16"\n", queue_id);
 		rc = -EINVAL;
 		goto exit;
@@ -707,7 +903,7 @@ static int netfront_rxq_info_get(struct uk_netdev *n,
 	UK_ASSERT(qinfo != NULL);
 
 	nfdev = to_netfront_dev(n);
-	if (unlikely(queue_id >= nfdev->max_queue_pairs)) {
+	if (unlikely(queue_id >= nfdev->nb_queue_pairs)) {
 		uk_pr_err("Invalid queue id: %"__PRIu16"\n", queue_id);
 		rc = -EINVAL;
 		goto exit;
@@ -774,7 +970,12 @@ static void netfront_info_get(struct uk_netdev *n,
 	dev_info->max_mtu = nfdev->mtu;
 	dev_info->nb_encap_tx = 0;
 	dev_info->nb_encap_rx = 0;
+#if CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS
+	/* Packets are copied from and to the granted pages */
+	dev_info->ioalign = sizeof(void *);
+#else /* !CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS */
 	dev_info->ioalign = PAGE_SIZE;
+#endif /* !CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS */
 	dev_info->features = UK_NETDEV_F_RXQ_INTR | UK_NETDEV_F_PARTIAL_CSUM;
 }
 
@@ -48,6 +48,16 @@
 #define NET_TX_RING_SIZE __CONST_RING_SIZE(netif_tx, PAGE_SIZE)
 #define NET_RX_RING_SIZE __CONST_RING_SIZE(netif_rx, PAGE_SIZE)
 
+#if CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS
+/*
+ * Transmit requests carry an offset, so two transmit buffers share a page.
+ * The backend copies received packets to the start of the granted page, so
+ * receive buffers occupy a full page each.
+ */
+#define NETFRONT_TX_GBUF_SIZE		(PAGE_SIZE / 2)
+#define NETFRONT_TX_GBUFS_PER_PAGE	(PAGE_SIZE / NETFRONT_TX_GBUF_SIZE)
+#endif /* CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS */
+
 /**
  * internal structure to represent the transmit queue.
  */
@@ -76,6 +86,10 @@ struct uk_netdev_tx_queue {
 	grant_ref_t gref[NET_TX_RING_SIZE];
 	/* Transmit packets addresses */
 	struct uk_netbuf *netbuf[NET_TX_RING_SIZE];
+#if CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS
+	/* Persistently granted buffers that packets are copied to */
+	void *gbuf[NET_TX_RING_SIZE];
+#endif /* CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS */
 };
 
 /**
@@ -109,6 +123,10 @@ struct uk_netdev_rx_queue {
 	struct uk_netbuf *netbuf[NET_RX_RING_SIZE];
 	/* Grants for receive buffers */
 	grant_ref_t gref[NET_RX_RING_SIZE];
+#if CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS
+	/* Persistently granted pages that packets are copied from */
+	void *gbuf[NET_RX_RING_SIZE];
+#endif /* CONFIG_LIBXEN_NETFRONT_PERSISTENT_GRANTS */
 };
 
 struct xs_econf {
@@ -130,6 +148,8 @@ struct netfront_dev {
 	struct uk_netdev_rx_queue *rxqs;
 	/* Maximum number of queue pairs */
 	uint16_t  max_queue_pairs;
+	/* Number of queue pairs configured by the user */
+	uint16_t  nb_queue_pairs;
 	/* True if using split event channels */
 	bool split_evtchn;
 
@@ -37,6 +37,7 @@
 #include <uk/errptr.h>
 #include <uk/print.h>
 #include <uk/assert.h>
+#include <uk/essentials.h>
 #include <uk/xenbus/xs.h>
 #include <uk/xenbus/client.h>
 #include "netfront_xb.h"
@@ -185,6 +186,9 @@ int netfront_xb_init(struct netfront_dev *nfdev, struct uk_alloc *a)
 		nfdev->max_queue_pairs = (uint16_t) strtoul(int_str, NULL, 10);
 		free(int_str);
 	}
+	nfdev->max_queue_pairs = MAX(nfdev->max_queue_pairs, 1);
+	nfdev->max_queue_pairs = MIN(nfdev->max_queue_pairs,
+				     CONFIG_LIBXEN_NETFRONT_MAX_QUEUE_PAIRS);
 
 	/* spit event channels */
 	int_str = xs_read(XBT_NIL, xendev->otherend,
@@ -54,6 +54,21 @@
  */
 char *xs_read(xenbus_transaction_t xbt, const char *path, const char *node);
 
+/*
+ * Read the values of several paths. The requests are sent back to back, so
+ * that the batch costs about one round trip to Xenstore.
+ *
+ * @param xbt Xenbus transaction id
+ * @param paths Xenstore paths
+ * @param values Returned values; each is a malloc'd copy of the value or a
+ * negative error number which should be checked using PTRISERR.
+ * @param num Number of paths
+ * @return 0 on success, a negative errno value on invalid arguments.
+ * May block.
+ */
+int xs_read_batch(xenbus_transaction_t xbt, const char * const *paths,
+	char **values, int num);
+
 /*
  * Associates a value with a path.
  *
@@ -79,6 +94,17 @@ int xs_write(xenbus_transaction_t xbt, const char *path, const char *node,
  */
 char **xs_ls(xenbus_transaction_t xbt, const char *path);
 
+/*
+ * Read the nodes of device directories into the read cache, with pipelined
+ * requests. Later reads of these nodes are served without a round trip to
+ * Xenstore. Does nothing if the read cache is disabled.
+ *
+ * @param dirs Xenstore paths of frontend device directories
+ * @param num Number of directories
+ * May block.
+ */
+void xs_cache_prefetch(const char * const *dirs, int num);
+
 /*
  * Removes the value associated with a path.
  *
@@ -132,6 +132,30 @@ out:
 	return err;
 }
 
+static void xenbus_prefetch_devices(const char *dirname, char **devices)
+{
+	char **dirs;
+	int num, i;
+
+	for (num = 0; devices[num] != NULL; num++)
+		;
+
+	dirs = calloc(num, sizeof(*dirs));
+	if (!dirs)
+		return;
+
+	for (i = 0; i < num; i++) {
+		if (asprintf(&dirs[i], "%s/%s", dirname, devices[i]) < 0)
+			break;
+	}
+
+	xs_cache_prefetch((const char * const *) dirs, i);
+
+	while (i-- > 0)
+		free(dirs[i]);
+	free(dirs);
+}
+
 static int xenbus_probe_device_type(const char *devtype_str)
 {
 	struct xenbus_driver *drv;
@@ -162,6 +186,9 @@ static int xenbus_probe_device_type(const char *devtype_str)
 		goto out;
 	}
 
+	/* Read the nodes of all devices of this type at once */
+	xenbus_prefetch_devices(dirname, devices);
+
 	for (int i = 0; devices[i] != NULL; i++) {
 		/* Probe only if no prior error */
 		if (err == 0)
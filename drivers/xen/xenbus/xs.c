@@ -43,7 +43,9 @@
 #include <string.h>
 #include <stdint.h>
 #include <stdarg.h>
+#include <uk/config.h>
 #include <uk/errptr.h>
+#include <uk/arch/spinlock.h>
 #include <xen/io/xs_wire.h>
 #include <uk/xenbus/xs.h>
 #include "xs_watch.h"
@@ -57,6 +59,116 @@
 	((struct xs_iovec) { str, strlen(str) })
 
 
+#if CONFIG_LIBXEN_XENBUS_READ_CACHE
+/*
+ * Cache for reads of frontend device nodes. The toolstack writes them when
+ * it creates the device and they do not change afterwards, except for the
+ * state of the device, which is never cached. Writes and removals through
+ * this library invalidate the cached nodes of the subtree.
+ */
+#define XS_CACHE_PREFIX "device/"
+
+struct xs_cache_entry {
+	/* One allocation for the path and the value behind it */
+	char *path;
+	const char *value;
+};
+
+static struct xs_cache_entry xs_cache[CONFIG_LIBXEN_XENBUS_READ_CACHE];
+static unsigned int xs_cache_next;
+static __spinlock xs_cache_lock = UKARCH_SPINLOCK_INITIALIZER();
+
+static int xs_cacheable(xenbus_transaction_t xbt, const char *path)
+{
+	const char *leaf;
+
+	if (xbt != XBT_NIL ||
+	    strncmp(path, XS_CACHE_PREFIX, sizeof(XS_CACHE_PREFIX) - 1))
+		return 0;
+
+	leaf = strrchr(path, '/');
+	return strcmp(leaf + 1, "state") != 0;
+}
+
+/* Returns a malloc'd copy of the cached value, NULL on a miss */
+static char *xs_cache_get(xenbus_transaction_t xbt, const char *path)
+{
+	char *value = NULL;
+
+	if (!xs_cacheable(xbt, path))
+		return NULL;
+
+	ukarch_spin_lock(&xs_cache_lock);
+	for (unsigned int i = 0; i < ARRAY_SIZE(xs_cache); i++) {
+		if (xs_cache[i].path && !strcmp(xs_cache[i].path, path)) {
+			value = strdup(xs_cache[i].value);
+			break;
+		}
+	}
+	ukarch_spin_unlock(&xs_cache_lock);
+
+	return value;
+}
+
+static void xs_cache_put(xenbus_transaction_t xbt, const char *path,
+		const char *value)
+{
+	size_t path_len = strlen(path) + 1;
+	char *buf, *old = NULL;
+
+	if (!xs_cacheable(xbt, path))
+		return;
+
+	buf = malloc(path_len + strlen(value) + 1);
+	if (!buf)
+		return;
+	memcpy(buf, path, path_len);
+	strcpy(buf + path_len, value);
+
+	ukarch_spin_lock(&xs_cache_lock);
+	for (unsigned int i = 0; i < ARRAY_SIZE(xs_cache); i++) {
+		if (xs_cache[i].path && !strcmp(xs_cache[i].path, path)) {
+			/* Another reader was faster */
+			old = buf;
+			goto out;
+		}
+	}
+
+	old = xs_cache[xs_cache_next].path;
+	xs_cache[xs_cache_next].path = buf;
+	xs_cache[xs_cache_next].value = buf + path_len;
+	xs_cache_next = (xs_cache_next + 1) % ARRAY_SIZE(xs_cache);
+out:
+	ukarch_spin_unlock(&xs_cache_lock);
+
+	free(old);
+}
+
+/* Drops the cached nodes of the subtree at `path` */
+static void xs_cache_invalidate(const char *path)
+{
+	size_t len = strlen(path);
+	char *cpath;
+
+	ukarch_spin_lock(&xs_cache_lock);
+	for (unsigned int i = 0; i < ARRAY_SIZE(xs_cache); i++) {
+		cpath = xs_cache[i].path;
+		if (cpath && !strncmp(cpath, path, len) &&
+		    (cpath[len] == '\0' || cpath[len] == '/')) {
+			free(cpath);
+			xs_cache[i].path = NULL;
+			xs_cache[i].value = NULL;
+		}
+	}
+	ukarch_spin_unlock(&xs_cache_lock);
+}
+#else /* !CONFIG_LIBXEN_XENBUS_READ_CACHE */
+#define xs_cacheable(xbt, path)			0
+#define xs_cache_get(xbt, path)			NULL
+#define xs_cache_put(xbt, path, value)		do {} while (0)
+#define xs_cache_invalidate(path)		do {} while (0)
+#endif /* !CONFIG_LIBXEN_XENBUS_READ_CACHE */
+
 /* Common function used for sending requests when replies aren't handled */
 static inline int xs_msg(enum xsd_sockmsg_type type, xenbus_transaction_t xbt,
 		struct xs_iovec *reqs, int reqs_num)
@@ -82,19 +194,66 @@ char *xs_read(xenbus_transaction_t xbt, const char *path, const char *node)
 	} else
 		fullpath = (char *) path;
 
+	value = xs_cache_get(xbt, fullpath);
+	if (value)
+		goto out_free;
+
 	req = XS_IOVEC_STR_NULL(fullpath);
 	err = xs_msg_reply(XS_READ, xbt, &req, 1, &rep);
-	if (err == 0)
+	if (err == 0) {
 		value = rep.data;
-	else
+		xs_cache_put(xbt, fullpath, value);
+	} else
 		value = ERR2PTR(err);
 
+out_free:
 	if (node != NULL)
 		free(fullpath);
 out:
 	return value;
 }
 
+int xs_read_batch(xenbus_transaction_t xbt, const char * const *paths,
+	char **values, int num)
+{
+	struct xs_batch_msg msgs[XS_BATCH_MAX];
+	struct xs_iovec reqs[XS_BATCH_MAX];
+	int idx[XS_BATCH_MAX];
+	int i, j, cnt;
+
+	if (unlikely((paths == NULL || values == NULL) && num))
+		return -EINVAL;
+
+	for (i = 0; i < num; ) {
+		/* Collect the next batch of nodes that are not cached */
+		for (cnt = 0; i < num && cnt < XS_BATCH_MAX; i++) {
+			values[i] = xs_cache_get(xbt, paths[i]);
+			if (values[i])
+				continue;
+
+			reqs[cnt] = XS_IOVEC_STR_NULL((char *) paths[i]);
+			msgs[cnt].type = XS_READ;
+			msgs[cnt].req_iovecs = &reqs[cnt];
+			msgs[cnt].req_iovecs_num = 1;
+			idx[cnt++] = i;
+		}
+
+		xs_msg_reply_batch(xbt, msgs, cnt);
+
+		for (j = 0; j < cnt; j++) {
+			if (msgs[j].err) {
+				values[idx[j]] = ERR2PTR(msgs[j].err);
+				continue;
+			}
+
+			values[idx[j]] = msgs[j].reply.data;
+			xs_cache_put(xbt, paths[idx[j]], values[idx[j]]);
+		}
+	}
+
+	return 0;
+}
+
 int xs_write(xenbus_transaction_t xbt, const char *path, const char *node,
 	const char *value)
 {
@@ -117,6 +276,7 @@ int xs_write(xenbus_transaction_t xbt, const char *path, const char *node,
 	req[0] = XS_IOVEC_STR_NULL(fullpath);
 	req[1] = XS_IOVEC_STR((char *) value);
 
+	xs_cache_invalidate(fullpath);
 	err = xs_msg(XS_WRITE, xbt, req, ARRAY_SIZE(req));
 
 	if (node != NULL)
@@ -192,9 +352,74 @@ int xs_rm(xenbus_transaction_t xbt, const char *path)
 
 	req = XS_IOVEC_STR_NULL((char *) path);
 
+	xs_cache_invalidate(path);
 	return xs_msg(XS_RM, xbt, &req, 1);
 }
 
+void xs_cache_prefetch(const char * const *dirs, int num)
+{
+#if CONFIG_LIBXEN_XENBUS_READ_CACHE
+	struct xs_batch_msg msgs[XS_BATCH_MAX];
+	struct xs_iovec reqs[XS_BATCH_MAX];
+	char *paths[XS_BATCH_MAX], *values[XS_BATCH_MAX];
+	char **nodes;
+	int i, j, k, cnt, npaths;
+
+	for (i = 0; i < num; i += cnt) {
+		cnt = MIN(num - i, XS_BATCH_MAX);
+
+		/* List the directories with one batch */
+		for (j = 0; j < cnt; j++) {
+			reqs[j] = XS_IOVEC_STR_NULL((char *) dirs[i + j]);
+			msgs[j].type = XS_DIRECTORY;
+			msgs[j].req_iovecs = &reqs[j];
+			msgs[j].req_iovecs_num = 1;
+		}
+		xs_msg_reply_batch(XBT_NIL, msgs, cnt);
+
+		for (j = 0; j < cnt; j++) {
+			if (msgs[j].err)
+				continue;
+
+			nodes = reply_to_string_array(&msgs[j].reply, NULL);
+			free(msgs[j].reply.data);
+			if (PTRISERR(nodes))
+				continue;
+
+			/* Read the nodes of a directory with one batch */
+			for (k = 0; nodes[k] != NULL; ) {
+				for (npaths = 0; nodes[k] != NULL &&
+				     npaths < XS_BATCH_MAX; k++) {
+					if (asprintf(&paths[npaths], "%s/%s",
+						     dirs[i + j], nodes[k]) < 0)
+						continue;
+					if (!xs_cacheable(XBT_NIL,
+							  paths[npaths])) {
+						free(paths[npaths]);
+						continue;
+					}
+					npaths++;
+				}
+
+				xs_read_batch(XBT_NIL,
+					      (const char * const *) paths,
+					      values, npaths);
+				while (npaths-- > 0) {
+					if (!PTRISERR(values[npaths]))
+						free(values[npaths]);
+					free(paths[npaths]);
+				}
+			}
+
+			free(nodes);
+		}
+	}
+#else /* !CONFIG_LIBXEN_XENBUS_READ_CACHE */
+	(void) dirs;
+	(void) num;
+#endif /* !CONFIG_LIBXEN_XENBUS_READ_CACHE */
+}
+
 /*
  * Permissions
  */
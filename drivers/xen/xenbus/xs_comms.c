@@ -148,42 +148,58 @@ static void xs_request_pool_init(struct xs_request_pool *pool)
 }
 
 /*
- * Allocate an identifier for a Xenstore request.
- * Blocks if none are available.
+ * Allocate identifiers for `n` Xenstore requests.
+ * Blocks until all of them are available, so that a batch never holds a
+ * part of the pool while waiting for the rest.
  */
-static struct xs_request *xs_request_get(void)
+static void xs_request_get_n(struct xs_request **xs_reqs, int n)
 {
 	unsigned long entry_idx;
 
-	/* wait for an available entry */
+	UK_ASSERT(n > 0 && n <= XS_REQ_POOL_SIZE);
+
+	/* wait for available entries */
 	while (1) {
 		ukarch_spin_lock(&xs_req_pool.lock);
 
-		if (xs_req_pool.num_live < XS_REQ_POOL_SIZE)
+		if (xs_req_pool.num_live + n <= XS_REQ_POOL_SIZE)
 			break;
 
 		ukarch_spin_unlock(&xs_req_pool.lock);
 
 		uk_waitq_wait_event(&xs_req_pool.waitq,
-			(xs_req_pool.num_live < XS_REQ_POOL_SIZE));
+			(xs_req_pool.num_live + n <= XS_REQ_POOL_SIZE));
 	}
 
-	/* find an available entry */
-	entry_idx =
-		uk_find_next_zero_bit(xs_req_pool.entries_bm, XS_REQ_POOL_SIZE,
+	for (int i = 0; i < n; i++) {
+		/* find an available entry */
+		entry_idx = uk_find_next_zero_bit(xs_req_pool.entries_bm,
+			XS_REQ_POOL_SIZE,
 			(xs_req_pool.last_probed + 1) & XS_REQ_POOL_MASK);
 
-	if (entry_idx == XS_REQ_POOL_SIZE)
-		entry_idx = uk_find_next_zero_bit(xs_req_pool.entries_bm,
-			XS_REQ_POOL_SIZE, 0);
+		if (entry_idx == XS_REQ_POOL_SIZE)
+			entry_idx = uk_find_next_zero_bit(
+				xs_req_pool.entries_bm, XS_REQ_POOL_SIZE, 0);
 
-	uk_set_bit(entry_idx, xs_req_pool.entries_bm);
-	xs_req_pool.last_probed = entry_idx;
-	xs_req_pool.num_live++;
+		uk_set_bit(entry_idx, xs_req_pool.entries_bm);
+		xs_req_pool.last_probed = entry_idx;
+		xs_req_pool.num_live++;
+		xs_reqs[i] = &xs_req_pool.entries[entry_idx];
+	}
 
 	ukarch_spin_unlock(&xs_req_pool.lock);
+}
 
-	return &xs_req_pool.entries[entry_idx];
+/*
+ * Allocate an identifier for a Xenstore request.
+ * Blocks if none are available.
+ */
+static struct xs_request *xs_request_get(void)
+{
+	struct xs_request *xs_req;
+
+	xs_request_get_n(&xs_req, 1);
+	return xs_req;
 }
 
 /* Release a request identifier */
@@ -198,8 +214,8 @@ static void xs_request_put(struct xs_request *xs_req)
 	uk_clear_bit(reqid, xs_req_pool.entries_bm);
 	xs_req_pool.num_live--;
 
-	if (xs_req_pool.num_live == XS_REQ_POOL_SIZE - 1)
-		uk_waitq_wake_up(&xs_req_pool.waitq);
+	/* Batches may wait for more than one entry */
+	uk_waitq_wake_up(&xs_req_pool.waitq);
 
 	ukarch_spin_unlock(&xs_req_pool.lock);
 }
@@ -342,17 +358,11 @@ static int xs_msg_write(struct xsd_sockmsg *xsd_req,
 	return 0;
 }
 
-int xs_msg_reply(enum xsd_sockmsg_type msg_type, xenbus_transaction_t xbt,
-	const struct xs_iovec *req_iovecs, int req_iovecs_num,
-	struct xs_iovec *rep_iovec)
+/* Fills in and enqueues a request, the caller wakes the xenstore thread */
+static void xs_request_submit(struct xs_request *xs_req,
+	enum xsd_sockmsg_type msg_type, xenbus_transaction_t xbt,
+	const struct xs_iovec *req_iovecs, int req_iovecs_num)
 {
-	struct xs_request *xs_req;
-	int err;
-
-	if (unlikely(req_iovecs == NULL))
-		return -EINVAL;
-
-	xs_req = xs_request_get();
 	xs_req->hdr.type = msg_type;
 	/* req_id was set on pool init  */
 	xs_req->hdr.tx_id = xbt;
@@ -365,8 +375,13 @@ int xs_msg_reply(enum xsd_sockmsg_type msg_type, xenbus_transaction_t xbt,
 
 	/* enqueue the request */
 	xs_request_enqueue(xs_req);
-	/* wake xenstore thread to send it */
-	uk_waitq_wake_up(&xsh.waitq);
+}
+
+/* Waits for the reply to a request and releases the request */
+static int xs_request_complete(struct xs_request *xs_req,
+	struct xs_iovec *rep_iovec)
+{
+	int err;
 
 	/* wait reply */
 	uk_waitq_wait_event(&xs_req->waitq,
@@ -385,6 +400,48 @@ int xs_msg_reply(enum xsd_sockmsg_type msg_type, xenbus_transaction_t xbt,
 	return err;
 }
 
+int xs_msg_reply(enum xsd_sockmsg_type msg_type, xenbus_transaction_t xbt,
+	const struct xs_iovec *req_iovecs, int req_iovecs_num,
+	struct xs_iovec *rep_iovec)
+{
+	struct xs_request *xs_req;
+
+	if (unlikely(req_iovecs == NULL))
+		return -EINVAL;
+
+	xs_req = xs_request_get();
+	xs_request_submit(xs_req, msg_type, xbt, req_iovecs, req_iovecs_num);
+	/* wake xenstore thread to send it */
+	uk_waitq_wake_up(&xsh.waitq);
+
+	return xs_request_complete(xs_req, rep_iovec);
+}
+
+void xs_msg_reply_batch(xenbus_transaction_t xbt, struct xs_batch_msg *msgs,
+	int msgs_num)
+{
+	struct xs_request *xs_reqs[XS_BATCH_MAX];
+	int done, cnt, i;
+
+	UK_ASSERT(msgs || !msgs_num);
+
+	for (done = 0; done < msgs_num; done += cnt) {
+		cnt = MIN(msgs_num - done, XS_BATCH_MAX);
+
+		xs_request_get_n(xs_reqs, cnt);
+		for (i = 0; i < cnt; i++)
+			xs_request_submit(xs_reqs[i], msgs[done + i].type, xbt,
+				msgs[done + i].req_iovecs,
+				msgs[done + i].req_iovecs_num);
+		/* wake xenstore thread to send them all at once */
+		uk_waitq_wake_up(&xsh.waitq);
+
+		for (i = 0; i < cnt; i++)
+			msgs[done + i].err = xs_request_complete(xs_reqs[i],
+				&msgs[done + i].reply);
+	}
+}
+
 void xs_send(void)
 {
 	struct xs_request *xs_req;
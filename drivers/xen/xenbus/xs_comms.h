@@ -59,4 +59,33 @@ int xs_msg_reply(enum xsd_sockmsg_type msg_type, xenbus_transaction_t xbt,
 	const struct xs_iovec *req_iovecs, int req_iovecs_num,
 	struct xs_iovec *rep_iovec);
 
+/* Maximum number of requests of a batch that are in flight at once */
+#define XS_BATCH_MAX 8
+
+struct xs_batch_msg {
+	/**< Xenstore message type */
+	enum xsd_sockmsg_type type;
+	/**< Array of request strings buffers */
+	const struct xs_iovec *req_iovecs;
+	/**< Request strings buffers number */
+	int req_iovecs_num;
+	/**< Malloc'ed reply, set if `err` is 0 */
+	struct xs_iovec reply;
+	/**< 0 on success, a negative errno value on error */
+	int err;
+};
+
+/*
+ * Sends several messages to Xenstore and blocks until all replies arrived.
+ * Up to XS_BATCH_MAX requests are sent back to back before waiting for the
+ * first reply, so that a batch costs about one round trip to Xenstore
+ * instead of one per message.
+ *
+ * @param xbt Xenbus transaction id
+ * @param msgs Messages, the replies and errors are stored in them
+ * @param msgs_num Number of messages
+ */
+void xs_msg_reply_batch(xenbus_transaction_t xbt, struct xs_batch_msg *msgs,
+	int msgs_num);
+
 #endif /* __XS_COMMS_H__ */
@@ -64,8 +64,27 @@ typedef void (*uk_term_func_t)(const struct uk_term_ctx *);
 struct uk_inittab_entry {
 	uk_init_func_t init;
 	uk_term_func_t term;
+#if CONFIG_LIBUKBOOT_PROFILE
+	/* Library and function name, for the boot profile */
+	const char *libname;
+	const char *name;
+#endif /* CONFIG_LIBUKBOOT_PROFILE */
 };
 
+#if CONFIG_LIBUKBOOT_PROFILE
+#ifdef __LIBNAME__
+#define __UK_INITTAB_LIBNAME	STRINGIFY(__LIBNAME__)
+#else /* !__LIBNAME__ */
+#define __UK_INITTAB_LIBNAME	"unknown"
+#endif /* !__LIBNAME__ */
+
+#define __UK_INITTAB_NAMES(init_fn)					\
+		.libname = __UK_INITTAB_LIBNAME,			\
+		.name = #init_fn,
+#else /* !CONFIG_LIBUKBOOT_PROFILE */
+#define __UK_INITTAB_NAMES(init_fn)
+#endif /* !CONFIG_LIBUKBOOT_PROFILE */
+
 /**
  * Register a Unikraft init function that is
  * called during bootstrap (uk_inittab)
@@ -84,7 +103,8 @@ struct uk_inittab_entry {
 	__used __section(".uk_inittab" #base #prio) __align(8)		\
 		__uk_inittab ## base ## prio ## _ ## init_fn ## _ ## term_fn = {\
 		.init = (init_fn),					\
-		.term = (term_fn)					\
+		.term = (term_fn),					\
+		__UK_INITTAB_NAMES(init_fn)				\
 	}
 
 #define _UK_INITTAB(init_fn, term_fn, base, prio)		\
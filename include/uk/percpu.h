@@ -0,0 +1,71 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __UK_PERCPU_H__
+#define __UK_PERCPU_H__
+
+#include <uk/config.h>
+#include <uk/essentials.h>
+#include <uk/arch/lcpu.h>
+#include <uk/plat/lcpu.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Per-LCPU variables
+ *
+ * A per-LCPU variable has one instance per logical CPU. Unlike the arrays of
+ * UKPLAT_PER_LCPU_DEFINE(), every instance occupies its own cache lines, so
+ * that updates on one LCPU never invalidate the cache line that another LCPU
+ * is working on. The instance of the current LCPU is found with the index
+ * that the platform keeps in %gs (x86_64) or TPIDR_EL1 (arm64), which is a
+ * single load without a function call.
+ *
+ * Accessing the instance of the current LCPU is only stable as long as the
+ * thread cannot migrate to another LCPU, e.g., with interrupts or preemption
+ * disabled, or if the variable is only used by the LCPU itself.
+ *
+ * Usage:
+ *   header: UK_PERCPU_DECLARE(struct foo_stats, foo_stats);
+ *   source: UK_PERCPU_DEFINE(foo_stats);
+ *   file-local: UK_PERCPU(struct foo_stats, foo_stats);
+ *   access: uk_percpu_current(foo_stats).allocs++;
+ */
+
+#define UK_PERCPU_TYPE(name)	struct __uk_percpu_##name
+
+#define __UK_PERCPU_STRUCT(type, name)					\
+	UK_PERCPU_TYPE(name) {						\
+		type val;						\
+	} __align(CACHE_LINE_SIZE)
+
+/* Declares a per-LCPU variable that is defined with UK_PERCPU_DEFINE() */
+#define UK_PERCPU_DECLARE(type, name)					\
+	__UK_PERCPU_STRUCT(type, name);					\
+	extern UK_PERCPU_TYPE(name) name[CONFIG_UKPLAT_LCPU_MAXCOUNT]
+
+/* Defines a per-LCPU variable declared with UK_PERCPU_DECLARE() */
+#define UK_PERCPU_DEFINE(name)						\
+	UK_PERCPU_TYPE(name) name[CONFIG_UKPLAT_LCPU_MAXCOUNT]
+
+/* Defines a per-LCPU variable that is local to a file */
+#define UK_PERCPU(type, name)						\
+	__UK_PERCPU_STRUCT(type, name);					\
+	static UK_PERCPU_TYPE(name) name[CONFIG_UKPLAT_LCPU_MAXCOUNT]
+
+/* Instance of the LCPU with the given index, as an lvalue */
+#define uk_percpu(name, lcpu_idx)	((name)[lcpu_idx].val)
+
+/* Instance of the current LCPU, as an lvalue */
+#define uk_percpu_current(name)		uk_percpu(name, ukplat_lcpu_idx())
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __UK_PERCPU_H__ */
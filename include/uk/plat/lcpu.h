@@ -102,6 +102,29 @@ void ukplat_lcpu_halt_irq_until(__nsec until);
  */
 void ukplat_lcpu_halt_irq(void);
 
+/**
+ * Called on the return from every interrupt handler, just before the
+ * interrupted context is resumed. IRQs are disabled and the function runs
+ * in interrupt context, so it must be compiled with the ISR flags. The
+ * platform provides an empty weak definition; a scheduler may override it,
+ * e.g., to mark the interrupted thread for preemption.
+ *
+ * @param regs registers of the interrupted context
+ */
+void ukplat_lcpu_irq_return(struct __regs *regs);
+
+#ifdef CONFIG_HAVE_LCPU_HALT_POLL_HINT
+/**
+ * Tells the hypervisor whether it should poll for events of the current
+ * logical CPU for a while before it deschedules the halted CPU. Guests that
+ * poll before halting turn this off so that idle CPUs do not poll twice.
+ * Does nothing if the hypervisor does not support the hint.
+ *
+ * @param host_poll zero to disable polling by the hypervisor
+ */
+void ukplat_lcpu_halt_poll_hint(int host_poll);
+#endif /* CONFIG_HAVE_LCPU_HALT_POLL_HINT */
+
 /* Non-prototyped logical CPU entry function */
 typedef void __noreturn (*ukplat_lcpu_entry_t)();
 
@@ -118,6 +141,12 @@ __uptr ukplat_lcpu_get_auxsp(void);
  */
 void ukplat_lcpu_set_auxsp(__uptr auxsp);
 
+/*
+ * The platform keeps a pointer to a per-LCPU block in %gs (x86_64) or
+ * TPIDR_EL1 (arm64) with the index of the LCPU at this offset
+ */
+#define UKPLAT_LCPU_IDX_OFFSET	0x04
+
 #ifdef CONFIG_HAVE_SMP
 
 struct ukplat_lcpu_func {
@@ -144,7 +173,22 @@ __lcpuid ukplat_lcpu_id(void);
 /**
  * Returns the index of the current logical CPU
  */
-__lcpuidx ukplat_lcpu_idx(void);
+static inline __lcpuidx ukplat_lcpu_idx(void)
+{
+#if defined(__X86_64__)
+	__lcpuidx idx;
+
+	__asm__ __volatile__("movl %%gs:%c1, %0"
+			     : "=r" (idx)
+			     : "i" (UKPLAT_LCPU_IDX_OFFSET));
+	return idx;
+#elif defined(__ARM_64__)
+	return *(const __lcpuidx *)(SYSREG_READ64(tpidr_el1) +
+				    UKPLAT_LCPU_IDX_OFFSET);
+#else
+#error "Unsupported architecture"
+#endif
+}
 
 /**
  * Returns the number of logical CPUs present in the system
@@ -226,6 +270,60 @@ int ukplat_lcpu_run(const __lcpuidx lcpuidx[], unsigned int *num,
 /* Do not block while trying to queue the function to the remote core */
 #define UKPLAT_LCPU_RFLG_DONOTBLOCK	0x1
 
+struct ukplat_lcpu_call {
+	/* Function to execute, see struct ukplat_lcpu_func */
+	struct ukplat_lcpu_func func;
+
+	/**
+	 * Optional completion callback. Executed on the remote logical CPU
+	 * right after the function. The call object is not accessed by the
+	 * platform anymore once the callback is invoked, so it may be freed or
+	 * reused from there.
+	 *
+	 * @param call the completed call
+	 */
+	void (*done)(struct ukplat_lcpu_call *call);
+
+	/* Used by the platform for queuing. Do not touch */
+	struct ukplat_lcpu_call *next;
+};
+
+/**
+ * Queues a function call to the specified logical CPU without waiting for its
+ * execution. In contrast to ukplat_lcpu_run(), any number of calls can be
+ * queued to the same CPU at the same time. Calls are executed in the order
+ * they have been queued from the same CPU. A run IRQ is only sent if the
+ * target CPU has no IRQ pending for calls yet, so bursts of calls to the same
+ * CPU are executed in a single IRQ. If the target is the current logical CPU,
+ * the call is executed immediately with IRQs disabled.
+ *
+ * @param lcpuidx the index of the logical CPU that should execute the call
+ * @param call the call to queue. Owned by the caller and must remain valid
+ *   until its execution has been signaled (e.g., via the completion callback)
+ * @param flags flags that specify how the call should be queued (see
+ *   UKPLAT_LCPU_CFLG_* flags)
+ *
+ * @return 0 on success, an errno-type error value otherwise (e.g., if the
+ *   target CPU is not online)
+ */
+int ukplat_lcpu_call(__lcpuidx lcpuidx, struct ukplat_lcpu_call *call,
+		     unsigned long flags);
+
+/* Only queue the call, do not send a run IRQ. Use ukplat_lcpu_call_kick() to
+ * trigger the execution after a batch of calls has been queued
+ */
+#define UKPLAT_LCPU_CFLG_NOKICK		0x1
+
+/**
+ * Triggers the execution of the calls queued to the specified logical CPU
+ * with UKPLAT_LCPU_CFLG_NOKICK
+ *
+ * @param lcpuidx the index of the logical CPU
+ *
+ * @return 0 on success, an errno-type error value otherwise
+ */
+int ukplat_lcpu_call_kick(__lcpuidx lcpuidx);
+
 /**
  * Wakes up the specified logical CPUs from a halt or low-power sleep state.
  *
@@ -0,0 +1,98 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __UKPLAT_NUMA_H__
+#define __UKPLAT_NUMA_H__
+
+#include <uk/config.h>
+#include <uk/arch/types.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/memory.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Relative distances between nodes as in the ACPI SLIT */
+#define UKPLAT_NUMA_DISTANCE_LOCAL	10
+#define UKPLAT_NUMA_DISTANCE_REMOTE	20
+
+#if CONFIG_UKPLAT_NUMA
+/**
+ * Returns the number of NUMA nodes. Nodes are numbered from 0 to
+ * ukplat_numa_node_count() - 1. Without topology information, all lcpus
+ * and memory belong to node 0.
+ */
+unsigned int ukplat_numa_node_count(void);
+
+/**
+ * Returns the NUMA node of a logical CPU
+ *
+ * @param idx
+ *   Index of the logical CPU
+ */
+unsigned int ukplat_numa_lcpu_node(__lcpuidx idx);
+
+/**
+ * Returns the NUMA node of physical memory. Memory that is not described
+ * by the topology belongs to node 0.
+ *
+ * @param paddr
+ *   Physical address
+ */
+unsigned int ukplat_numa_paddr_node(__paddr_t paddr);
+
+/**
+ * Returns the relative distance between two NUMA nodes, which is
+ * UKPLAT_NUMA_DISTANCE_LOCAL for a node to itself
+ */
+unsigned int ukplat_numa_distance(unsigned int from, unsigned int to);
+#else /* !CONFIG_UKPLAT_NUMA */
+static inline unsigned int ukplat_numa_node_count(void)
+{
+	return 1;
+}
+
+static inline unsigned int ukplat_numa_lcpu_node(__lcpuidx idx __unused)
+{
+	return 0;
+}
+
+static inline unsigned int ukplat_numa_paddr_node(__paddr_t paddr __unused)
+{
+	return 0;
+}
+
+static inline unsigned int ukplat_numa_distance(unsigned int from,
+						unsigned int to)
+{
+	return (from == to) ? UKPLAT_NUMA_DISTANCE_LOCAL :
+			      UKPLAT_NUMA_DISTANCE_REMOTE;
+}
+#endif /* !CONFIG_UKPLAT_NUMA */
+
+/**
+ * Returns the NUMA node of the current logical CPU
+ */
+static inline unsigned int ukplat_numa_node(void)
+{
+	return ukplat_numa_lcpu_node(ukplat_lcpu_idx());
+}
+
+/**
+ * Returns the NUMA node of a memory region, i.e., of its first byte
+ */
+static inline unsigned int
+ukplat_memregion_node(const struct ukplat_memregion_desc *mrd)
+{
+	return ukplat_numa_paddr_node(mrd->pbase);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UKPLAT_NUMA_H__ */
@@ -212,6 +212,19 @@ int ukplat_pt_free(struct uk_pagetable *pt, unsigned long flags);
 int ukplat_pt_walk(struct uk_pagetable *pt, __vaddr_t vaddr,
 		   unsigned int *level, __vaddr_t *pt_vaddr, __pte_t *pte);
 
+/**
+ * Returns the page attributes of a PTE that maps a page
+ *
+ * @param pte
+ *   The PTE, for instance, as returned by ukplat_pt_walk()
+ * @param level
+ *   The level of the PTE in the page table
+ *
+ * @return
+ *   The page attributes (PAGE_ATTR_* flags)
+ */
+unsigned long ukplat_pte_attr(__pte_t pte, unsigned int level);
+
 /* Forward declaration */
 struct ukplat_page_mapx;
 
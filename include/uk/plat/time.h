@@ -49,6 +49,102 @@ __nsec ukplat_time_get_ticks(void);
 __nsec ukplat_monotonic_clock(void);
 __nsec ukplat_wall_clock(void);
 
+/**
+ * Programs the timer interrupt of the current logical CPU to fire at
+ * monotonic time `until` without halting the CPU, e.g., to end a time slice.
+ * A later `ukplat_lcpu_halt_irq_until()` replaces the programmed time.
+ * Only provided by platforms that support preemptive scheduling (KVM x86).
+ *
+ * @param until deadline in nanoseconds
+ */
+void ukplat_time_arm(__nsec until);
+
+/**
+ * Resynchronizes the wall clock with the time of the host, e.g., after the
+ * VM was restored from a snapshot. The monotonic clock is not affected.
+ * Only provided by KVM x86.
+ */
+void ukplat_time_resync(void);
+
+/**
+ * Parameters of the free-running cycle counter that backs the platform
+ * clocks. They allow to compute the clocks without calling into the
+ * platform, e.g., from a vDSO:
+ *   delta     = (counter - cnt_base) << cnt_shift   (>> for a negative shift)
+ *   monotonic = ns_base + ((delta * cnt_mult) >> 32)
+ *   wall      = monotonic + epoch_offset
+ * A counter value before `cnt_base` yields a monotonic time of `ns_base`.
+ *
+ * The parameters may change at any time, e.g., after a live migration.
+ * Writers make `seq` odd while they update the other fields, so readers
+ * take a consistent snapshot with ukplat_clock_params_read_begin() and
+ * ukplat_clock_params_read_retry(). The first 32 bytes have the layout of
+ * the pvclock structure of KVM and Xen, so a hypervisor can update them in
+ * place.
+ */
+struct ukplat_clock_params {
+	__u32 seq;
+	__u32 __pad0;
+	__u64 cnt_base;
+	__u64 ns_base;
+	__u32 cnt_mult;
+	__s8 cnt_shift;
+	__u8 flags;
+	__u8 __pad1[2];
+	__u64 epoch_offset;
+};
+
+static inline __u32
+ukplat_clock_params_read_begin(const struct ukplat_clock_params *cp)
+{
+	__u32 seq;
+
+	do
+		seq = __atomic_load_n(&cp->seq, __ATOMIC_ACQUIRE);
+	while (seq & 1);
+
+	return seq;
+}
+
+static inline int
+ukplat_clock_params_read_retry(const struct ukplat_clock_params *cp,
+			       __u32 seq)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&cp->seq, __ATOMIC_RELAXED) != seq;
+}
+
+/**
+ * Converts a counter value to monotonic time. Must be called between
+ * ukplat_clock_params_read_begin() and ukplat_clock_params_read_retry().
+ */
+static inline __nsec
+ukplat_clock_params_monotonic(const struct ukplat_clock_params *cp,
+			      __u64 cnt)
+{
+	__u64 delta = cnt - cp->cnt_base;
+
+	if (delta >= UINT64_MAX / 2)
+		delta = 0;
+	if (cp->cnt_shift < 0)
+		delta >>= -cp->cnt_shift;
+	else
+		delta <<= cp->cnt_shift;
+
+	return cp->ns_base +
+	       (__u64)(((unsigned __int128)delta * cp->cnt_mult) >> 32);
+}
+
+/**
+ * Returns the counter parameters of the platform clocks. The pointer does
+ * not change after ukplat_time_init().
+ *
+ * @return
+ *   Pointer to the parameters, or NULL if the clocks cannot be derived from
+ *   a counter that is readable by the caller
+ */
+const struct ukplat_clock_params *ukplat_clock_params(void);
+
 /* Time tick length */
 #define UKPLAT_TIME_TICK_NSEC  (UKARCH_NSEC_PER_SEC / CONFIG_HZ)
 #define UKPLAT_TIME_TICK_MSEC  ukarch_time_nsec_to_msec(UKPLAT_TIME_TICK_NSEC)
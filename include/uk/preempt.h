@@ -34,7 +34,47 @@
 #ifndef __UK_PREEMPT_H__
 #define __UK_PREEMPT_H__
 
+#include <uk/config.h>
+
+#if CONFIG_LIBUKSCHEDCOOP_PREEMPT
+#include <uk/essentials.h>
+#include <uk/percpu.h>
+
+/* Nesting depth of sections that must not be preempted. The scheduler
+ * sets `uk_preempt_pending` when a time slice expires and preempts the
+ * thread at the next safe point outside of such a section.
+ */
+UK_PERCPU_DECLARE(unsigned int, uk_preempt_count);
+UK_PERCPU_DECLARE(int, uk_preempt_pending);
+
+/* Yields the CPU if a preemption is pending, implemented by the scheduler */
+void uk_preempt_schedule(void);
+
+#define uk_preempt_disable()						\
+	do {								\
+		uk_percpu_current(uk_preempt_count)++;			\
+		barrier();						\
+	} while (0)
+
+#define uk_preempt_enable()						\
+	do {								\
+		barrier();						\
+		if (--uk_percpu_current(uk_preempt_count) == 0 &&	\
+		    unlikely(uk_percpu_current(uk_preempt_pending)))	\
+			uk_preempt_schedule();				\
+	} while (0)
+
+/* Safe point, e.g., the return from a system call */
+#define uk_preempt_point()						\
+	do {								\
+		if (uk_percpu_current(uk_preempt_count) == 0 &&		\
+		    unlikely(uk_percpu_current(uk_preempt_pending)))	\
+			uk_preempt_schedule();				\
+	} while (0)
+#else /* !CONFIG_LIBUKSCHEDCOOP_PREEMPT */
 #define uk_preempt_disable()  barrier()
 #define uk_preempt_enable()   barrier()
+#define uk_preempt_point()    do {} while (0)
+#endif /* !CONFIG_LIBUKSCHEDCOOP_PREEMPT */
 
 #endif /* __UK_PREEMPT_H__ */
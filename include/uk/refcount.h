@@ -88,7 +88,10 @@ static inline void uk_refcount_acquire(__atomic *ref)
 {
 	__refcnt_assert((ref != __NULL) && (ref->counter < __U32_MAX));
 
-	uk_inc(&ref->counter);
+	/* A new reference is always derived from an existing one, so there
+	 * is nothing to order
+	 */
+	uk_inc_relaxed(&ref->counter);
 }
 
 /**
@@ -105,10 +108,8 @@ static inline int uk_refcount_release(__atomic *ref)
 
 	__refcnt_assert(ref != __NULL);
 
-	/* Compiler Fence */
-	barrier();
-
-	old = uk_fetch_add(&ref->counter, -1);
+	/* Release our accesses to the object */
+	old = uk_dec_release(&ref->counter);
 	__refcnt_assert(old > 0);
 	if (old > 1)
 		return 0;
@@ -116,10 +117,10 @@ static inline int uk_refcount_release(__atomic *ref)
 	/*
 	 * Last reference.  Signal the user to call the destructor.
 	 *
-	 * Ensure that the destructor sees all updates.  The fence_rel
-	 * at the start of the function synchronized with this fence.
+	 * Ensure that the destructor sees all updates.  The release
+	 * of the other references synchronizes with this fence.
 	 */
-	barrier();
+	uk_fence_acquire();
 	return 1;
 }
 
@@ -137,12 +138,12 @@ static inline int uk_refcount_acquire_if_not_zero(__atomic *ref)
 
 	__refcnt_assert(ref != __NULL && ref->counter < __U32_MAX);
 
-	old = ref->counter;
+	old = uk_load_n_relaxed(&ref->counter);
 	for (;;) {
 		if (old == 0)
 			return 0;
-		if (uk_compare_exchange_sync(&ref->counter, old, (old + 1))
-				== (old + 1))
+		/* Reloads `old` on failure */
+		if (uk_compare_exchange_n_acquire(&ref->counter, &old, old + 1))
 			return 1;
 	}
 }
@@ -175,12 +176,12 @@ static inline int uk_refcount_release_if_not_last(__atomic *ref)
 
 	__refcnt_assert(ref != __NULL);
 
-	old = ref->counter;
+	old = uk_load_n_relaxed(&ref->counter);
 	for (;;) {
 		if (old == 1)
 			return 0;
-		if (uk_compare_exchange_sync(&ref->counter, old, (old - 1))
-				== (old - 1))
+		/* Reloads `old` on failure */
+		if (uk_compare_exchange_n_release(&ref->counter, &old, old - 1))
 			return 1;
 	}
 }
@@ -36,8 +36,11 @@
 #include <stdbool.h>
 #include <uk/9pdev.h>
 #include <uk/9pfid.h>
+#include <uk/arch/time.h>
+#include <uk/list.h>
 
 #include <vfscore/prex.h>
+#include <vfscore/vnode.h>
 
 /**
  * Protocol version; the default version is `9P2000.L`,
@@ -62,6 +65,34 @@ enum uk_9pfs_proto {
 	UK_9P_PROTO_MAX
 };
 
+/**
+ * Caching mode, selected with the `cache=` mount option
+ */
+enum uk_9pfs_cache {
+	/* Every lookup and getattr is sent to the server */
+	UK_9PFS_CACHE_NONE,
+	/*
+	 * Attributes and failed lookups are cached for `actimeo` seconds;
+	 * changes made on the host may not be visible until then
+	 */
+	UK_9PFS_CACHE_LOOSE
+};
+
+/**
+ * Default attribute cache timeout (in seconds) for `cache=loose`
+ */
+#define UK_9PFS_ACTIMEO_DEFAULT	60
+
+/**
+ * Maximum number of cached failed lookups per directory
+ */
+#define UK_9PFS_NEGENT_MAX	64
+
+/**
+ * Smallest message size accepted with the `msize=` mount option
+ */
+#define UK_9PFS_MSIZE_MIN	4096
+
 /**
  * An entry containing the necessary data for mounting the filesystem
  */
@@ -82,6 +113,14 @@ struct uk_9pfs_mount_data {
 	 * offering several exported file systems.
 	 */
 	char			*aname;
+	/* Caching mode */
+	enum uk_9pfs_cache	cache;
+	/* Lifetime of cached attributes and failed lookups */
+	__nsec			actimeo;
+	/* Requested message size, 0 for the transport's maximum */
+	uint32_t		msize;
+	/* Buffer small sequential writes, set with the `writeback` option */
+	bool			writeback;
 };
 
 /**
@@ -114,6 +153,31 @@ struct uk_9pfs_node_data {
 	int                    nb_open_files;
 	/* Is a 9P remove call required when `nb_open_files` reaches 0? */
 	bool                   removed;
+	/* Cached attributes, valid until `attr_expiry` if `attr_valid` */
+	struct vattr           attr;
+	__nsec                 attr_expiry;
+	bool                   attr_valid;
+	/* Names that recently failed to resolve in this directory */
+	struct uk_list_head    negents;
+	unsigned int           nb_negents;
+	/*
+	 * Write-back buffer with `wb_len` bytes of data that are not sent
+	 * to the server yet and belong at file offset `wb_off`
+	 */
+	char                   *wb_buf;
+	uint32_t               wb_size;
+	uint32_t               wb_len;
+	off_t                  wb_off;
+};
+
+/**
+ * A cached failed lookup
+ */
+struct uk_9pfs_negent {
+	struct uk_list_head    link;
+	/* Time after which the entry is ignored */
+	__nsec                 expiry;
+	char                   name[];
 };
 
 /**
@@ -38,6 +38,7 @@
 #include <uk/9pdev_trans.h>
 #include <vfscore/mount.h>
 #include <vfscore/dentry.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -100,6 +101,32 @@ static int uk_9pfs_parse_option(struct uk_9pfs_mount_data *md,
 		md->aname = strdup(option + 6);
 		if (unlikely(!md->aname))
 			return -ENOMEM;
+	} else if (strncmp(option, "cache=", 6) == 0) {
+		if (strcmp(option + 6, "none") == 0)
+			md->cache = UK_9PFS_CACHE_NONE;
+		else if (strcmp(option + 6, "loose") == 0)
+			md->cache = UK_9PFS_CACHE_LOOSE;
+		else
+			return -EINVAL;
+	} else if (strncmp(option, "actimeo=", 8) == 0) {
+		unsigned long sec;
+		char *end;
+
+		sec = strtoul(option + 8, &end, 10);
+		if (end == option + 8 || *end != '\0' || sec > UINT32_MAX)
+			return -EINVAL;
+		md->actimeo = ukarch_time_sec_to_nsec((__nsec)sec);
+	} else if (strncmp(option, "msize=", 6) == 0) {
+		unsigned long msize;
+		char *end;
+
+		msize = strtoul(option + 6, &end, 0);
+		if (end == option + 6 || *end != '\0' ||
+		    msize < UK_9PFS_MSIZE_MIN || msize > UINT32_MAX)
+			return -EINVAL;
+		md->msize = msize;
+	} else if (strcmp(option, "writeback") == 0) {
+		md->writeback = true;
 	}
 
 	return 0;
@@ -121,6 +148,10 @@ static int uk_9pfs_parse_options(struct uk_9pfs_mount_data *md,
 	md->proto = UK_9P_PROTO_2000L;
 	md->uname = strdup("");
 	md->aname = strdup("");
+	md->cache = UK_9PFS_CACHE_NONE;
+	md->actimeo = ukarch_time_sec_to_nsec(UK_9PFS_ACTIMEO_DEFAULT);
+	md->msize = 0;
+	md->writeback = false;
 
 	/*
 	 * musl/nolibc strtok_r resets saveptr at the end, so we need to feed
@@ -179,6 +210,8 @@ static int uk_9pfs_mount(struct mount *mp, const char *dev,
 		goto out_free_mdata;
 
 	mp->m_data = md;
+	/* Let vfscore cache file contents to save round trips to the host */
+	mp->m_flags |= MNT_PAGECACHE;
 
 	/* Establish connection with the given 9P endpoint. */
 	md->dev = uk_9pdev_connect(md->trans, dev, data, NULL);
@@ -187,6 +220,14 @@ static int uk_9pfs_mount(struct mount *mp, const char *dev,
 		goto out_free_mdata;
 	}
 
+	/*
+	 * Ask for the requested message size; by default the transport's
+	 * maximum is offered and the server may lower it in its reply.
+	 */
+	if (md->msize && !uk_9pdev_set_msize(md->dev, md->msize))
+		uk_pr_warn("msize %"PRIu32" exceeds the transport maximum, using %"PRIu32"\n",
+			   md->msize, uk_9pdev_get_msize(md->dev));
+
 	/* Create a new 9pfs session via a VERSION message. */
 	version_req = uk_9p_version(md->dev, uk_9pfs_proto_str[md->proto],
 			&rcvd_version);
@@ -39,6 +39,7 @@
 #include <uk/config.h>
 #include <uk/9p.h>
 #include <uk/errptr.h>
+#include <uk/plat/time.h>
 #include <vfscore/mount.h>
 #include <vfscore/dentry.h>
 #include <vfscore/vnode.h>
@@ -154,6 +155,175 @@ static uint64_t uk_9pfs_ino(struct uk_9p_stat *stat)
 	return stat->qid.path;
 }
 
+static inline bool uk_9pfs_caching(struct mount *mp)
+{
+	struct uk_9pfs_mount_data *md = UK_9PFS_MD(mp);
+
+	return md->cache == UK_9PFS_CACHE_LOOSE && md->actimeo;
+}
+
+static __nsec uk_9pfs_cache_expiry(struct mount *mp)
+{
+	return ukplat_monotonic_clock() + UK_9PFS_MD(mp)->actimeo;
+}
+
+static bool uk_9pfs_attr_cached(struct vnode *vp, struct vattr *attr)
+{
+	struct uk_9pfs_node_data *nd = UK_9PFS_ND(vp);
+	unsigned int mask = attr->va_mask;
+
+	if (!nd->attr_valid)
+		return false;
+	if (ukplat_monotonic_clock() >= nd->attr_expiry) {
+		nd->attr_valid = false;
+		return false;
+	}
+
+	*attr = nd->attr;
+	attr->va_mask = mask;
+	return true;
+}
+
+static void uk_9pfs_attr_store(struct vnode *vp, const struct vattr *attr)
+{
+	struct uk_9pfs_node_data *nd = UK_9PFS_ND(vp);
+
+	if (!uk_9pfs_caching(vp->v_mount))
+		return;
+
+	nd->attr = *attr;
+	nd->attr_expiry = uk_9pfs_cache_expiry(vp->v_mount);
+	nd->attr_valid = true;
+}
+
+static inline void uk_9pfs_attr_invalidate(struct vnode *vp)
+{
+	if (vp && vp->v_data)
+		UK_9PFS_ND(vp)->attr_valid = false;
+}
+
+static void uk_9pfs_negent_free(struct uk_9pfs_node_data *nd,
+				struct uk_9pfs_negent *ne)
+{
+	uk_list_del(&ne->link);
+	nd->nb_negents--;
+	free(ne);
+}
+
+static void uk_9pfs_negent_flush(struct uk_9pfs_node_data *nd)
+{
+	struct uk_9pfs_negent *ne, *tmp;
+
+	uk_list_for_each_entry_safe(ne, tmp, &nd->negents, link)
+		uk_9pfs_negent_free(nd, ne);
+}
+
+/* Returns true if `name` recently failed to resolve in `dvp` */
+static bool uk_9pfs_negent_lookup(struct vnode *dvp, const char *name)
+{
+	struct uk_9pfs_node_data *nd = UK_9PFS_ND(dvp);
+	struct uk_9pfs_negent *ne, *tmp;
+	__nsec now;
+
+	if (!nd->nb_negents)
+		return false;
+
+	now = ukplat_monotonic_clock();
+	uk_list_for_each_entry_safe(ne, tmp, &nd->negents, link) {
+		if (now >= ne->expiry) {
+			uk_9pfs_negent_free(nd, ne);
+			continue;
+		}
+		if (strcmp(ne->name, name) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+static void uk_9pfs_negent_add(struct vnode *dvp, const char *name)
+{
+	struct uk_9pfs_node_data *nd = UK_9PFS_ND(dvp);
+	struct uk_9pfs_negent *ne;
+	size_t len;
+
+	if (!uk_9pfs_caching(dvp->v_mount))
+		return;
+
+	/* Entries are kept in insertion order, the first one is the oldest */
+	if (nd->nb_negents == UK_9PFS_NEGENT_MAX) {
+		ne = uk_list_first_entry(&nd->negents, struct uk_9pfs_negent,
+					 link);
+		uk_9pfs_negent_free(nd, ne);
+	}
+
+	len = strlen(name);
+	ne = malloc(sizeof(*ne) + len + 1);
+	if (unlikely(!ne))
+		return;
+
+	memcpy(ne->name, name, len + 1);
+	ne->expiry = uk_9pfs_cache_expiry(dvp->v_mount);
+	uk_list_add_tail(&ne->link, &nd->negents);
+	nd->nb_negents++;
+}
+
+/*
+ * Called when an entry is added to `dvp`: forgets a failed lookup of `name`
+ * and the attributes of `dvp`, whose mtime changes
+ */
+static void uk_9pfs_dir_changed(struct vnode *dvp, const char *name)
+{
+	struct uk_9pfs_node_data *nd = UK_9PFS_ND(dvp);
+	struct uk_9pfs_negent *ne;
+
+	nd->attr_valid = false;
+	uk_list_for_each_entry(ne, &nd->negents, link) {
+		if (strcmp(ne->name, name) == 0) {
+			uk_9pfs_negent_free(nd, ne);
+			break;
+		}
+	}
+}
+
+static void uk_9pfs_vattr_from_attr(struct vnode *vp,
+				    const struct uk_9p_attr *stat,
+				    struct vattr *attr)
+{
+	attr->va_type = stat->mode & S_IFMT;
+	attr->va_mode = stat->mode & UK_ALLPERMS;
+	attr->va_nlink = stat->nlink;
+	attr->va_uid = stat->uid;
+	attr->va_gid = stat->gid;
+	attr->va_nodeid = vp->v_ino;
+	attr->va_atime.tv_sec = stat->atime_sec;
+	attr->va_atime.tv_nsec = stat->atime_nsec;
+	attr->va_mtime.tv_sec = stat->mtime_sec;
+	attr->va_mtime.tv_nsec = stat->mtime_nsec;
+	attr->va_ctime.tv_sec = stat->ctime_sec;
+	attr->va_ctime.tv_nsec = stat->ctime_nsec;
+	attr->va_rdev = stat->rdev;
+	attr->va_nblocks = stat->blocks;
+	attr->va_size = stat->size;
+}
+
+static void uk_9pfs_vattr_from_stat(struct vnode *vp,
+				    const struct uk_9p_stat *stat,
+				    struct vattr *attr)
+{
+	attr->va_type = uk_9pfs_vtype_from_mode(stat->mode);
+	attr->va_mode = uk_9pfs_posix_mode_from_mode(stat->mode);
+	attr->va_nodeid = vp->v_ino;
+	attr->va_size = stat->length;
+
+	attr->va_atime.tv_sec = stat->atime;
+	attr->va_atime.tv_nsec = 0;
+	attr->va_mtime.tv_sec = stat->mtime;
+	attr->va_mtime.tv_nsec = 0;
+	attr->va_ctime.tv_sec = 0;
+	attr->va_ctime.tv_nsec = 0;
+}
+
 int uk_9pfs_allocate_vnode_data(struct vnode *vp, struct uk_9pfid *fid)
 {
 	struct uk_9pfs_node_data *nd;
@@ -165,22 +335,40 @@ int uk_9pfs_allocate_vnode_data(struct vnode *vp, struct uk_9pfid *fid)
 	nd->fid = fid;
 	nd->nb_open_files = 0;
 	nd->removed = false;
+	nd->attr_valid = false;
+	UK_INIT_LIST_HEAD(&nd->negents);
+	nd->nb_negents = 0;
+	nd->wb_buf = NULL;
+	nd->wb_size = 0;
+	nd->wb_len = 0;
+	nd->wb_off = 0;
 	vp->v_data = nd;
 
 	return 0;
 }
 
+static int uk_9pfs_wb_flush(struct vnode *vp);
+
 void uk_9pfs_free_vnode_data(struct vnode *vp)
 {
 	struct uk_9pdev *dev = UK_9PFS_MD(vp->v_mount)->dev;
 	struct uk_9pfs_node_data *nd = UK_9PFS_ND(vp);
+	int rc;
 
 	if (!vp->v_data)
 		return;
 
-	if (nd->removed)
+	if (nd->removed) {
 		uk_9p_remove(dev, nd->fid);
+	} else {
+		rc = uk_9pfs_wb_flush(vp);
+		if (unlikely(rc))
+			uk_pr_err("Failed to write back buffered data: %d\n",
+				  rc);
+	}
 
+	uk_9pfs_negent_flush(nd);
+	free(nd->wb_buf);
 	uk_9pfid_put(nd->fid);
 	free(nd);
 	vp->v_data = NULL;
@@ -233,9 +421,12 @@ out:
 	return -rc;
 }
 
-static int uk_9pfs_close(struct vnode *vn __unused, struct vfscore_file *file)
+static int uk_9pfs_close(struct vnode *vn, struct vfscore_file *file)
 {
 	struct uk_9pfs_file_data *fd = UK_9PFS_FD(file);
+	int rc;
+
+	rc = uk_9pfs_wb_flush(vn);
 
 	if (fd->readdir_buf)
 		free(fd->readdir_buf);
@@ -244,7 +435,7 @@ static int uk_9pfs_close(struct vnode *vn __unused, struct vfscore_file *file)
 	free(fd);
 	UK_9PFS_ND(file->f_dentry->d_vnode)->nb_open_files--;
 
-	return 0;
+	return rc;
 }
 
 static int uk_9pfs_lookup(struct vnode *dvp, const char *name,
@@ -255,21 +446,32 @@ static int uk_9pfs_lookup(struct vnode *dvp, const char *name,
 	struct uk_9pfid *dfid = UK_9PFS_VFID(dvp);
 	struct uk_9pfid *fid;
 	struct vnode *vp;
+	struct vattr attr;
+	bool have_attr = false;
 	int rc;
 
 	if (strlen(name) > NAME_MAX)
 		return ENAMETOOLONG;
 
+	if (uk_9pfs_negent_lookup(dvp, name))
+		return ENOENT;
+
 	fid = uk_9p_walk(dev, dfid, name);
 	if (PTRISERR(fid)) {
 		rc = PTR2ERR(fid);
+		if (rc == -ENOENT)
+			uk_9pfs_negent_add(dvp, name);
 		goto out;
 	}
 
 	if (md->proto == UK_9P_PROTO_2000L) {
 		struct uk_9p_attr stat;
+		/*
+		 * Ask for all basic attributes, they are kept for getattr if
+		 * caching is enabled.
+		 */
 		struct uk_9preq *stat_req = uk_9p_getattr(
-		    dev, fid, UK_9P_GETATTR_MODE | UK_9P_GETATTR_SIZE, &stat);
+		    dev, fid, UK_9P_GETATTR_BASIC, &stat);
 		if (PTRISERR(stat_req)) {
 			rc = PTR2ERR(stat_req);
 			goto out_fid;
@@ -304,6 +506,11 @@ static int uk_9pfs_lookup(struct vnode *dvp, const char *name,
 		vp->v_type = uk_9pfs_vtype_from_mode_l(stat.mode);
 		vp->v_size = stat.size;
 
+		if ((stat.valid & UK_9P_GETATTR_BASIC) == UK_9P_GETATTR_BASIC) {
+			uk_9pfs_vattr_from_attr(vp, &stat, &attr);
+			have_attr = true;
+		}
+
 	} else if (md->proto == UK_9P_PROTO_2000U) {
 		struct uk_9p_stat stat;
 		struct uk_9preq *stat_req = uk_9p_stat(dev, fid, &stat);
@@ -338,6 +545,9 @@ static int uk_9pfs_lookup(struct vnode *dvp, const char *name,
 		vp->v_type = uk_9pfs_vtype_from_mode(stat.mode);
 		vp->v_size = stat.length;
 
+		uk_9pfs_vattr_from_stat(vp, &stat, &attr);
+		have_attr = true;
+
 	} else {
 		rc = -EOPNOTSUPP;
 		goto out_fid;
@@ -347,6 +557,11 @@ static int uk_9pfs_lookup(struct vnode *dvp, const char *name,
 	if (rc != 0)
 		goto out_fid;
 
+	if (have_attr) {
+		attr.va_mask = 0;
+		uk_9pfs_attr_store(vp, &attr);
+	}
+
 	*vpp = vp;
 
 	return 0;
@@ -375,6 +590,8 @@ static int uk_9pfs_create_generic(struct vnode *dvp, const char *name,
 	if (strlen(name) > NAME_MAX)
 		return ENAMETOOLONG;
 
+	uk_9pfs_dir_changed(dvp, name);
+
 	/* Clone parent fid. */
 	fid = uk_9p_walk(dev, UK_9PFS_VFID(dvp), NULL);
 
@@ -393,8 +610,10 @@ static int uk_9pfs_create(struct vnode *dvp, const char *name, mode_t mode)
 		return EINVAL;
 
 	if (md->proto == UK_9P_PROTO_2000L) {
-		struct uk_9pfid *fid =
-		    uk_9p_walk(md->dev, UK_9PFS_VFID(dvp), NULL);
+		struct uk_9pfid *fid;
+
+		uk_9pfs_dir_changed(dvp, name);
+		fid = uk_9p_walk(md->dev, UK_9PFS_VFID(dvp), NULL);
 		return -uk_9p_lcreate(md->dev, fid, name,
 				UK_9P_DOTL_WRONLY | UK_9P_DOTL_APPEND, mode, 0);
 
@@ -411,6 +630,8 @@ static int uk_9pfs_remove_generic(struct vnode *dvp, struct vnode *vp)
 	struct uk_9pdev *dev = UK_9PFS_MD(dvp->v_mount)->dev;
 	struct uk_9pfs_node_data *nd = UK_9PFS_ND(vp);
 
+	uk_9pfs_attr_invalidate(dvp);
+	uk_9pfs_attr_invalidate(vp);
 	return -uk_9p_remove(dev, nd->fid);
 }
 
@@ -420,10 +641,12 @@ static int uk_9pfs_remove(struct vnode *dvp, struct vnode *vp,
 	struct uk_9pfs_node_data *nd = UK_9PFS_ND(vp);
 	int rc = 0;
 
-	if (!nd->nb_open_files)
+	if (!nd->nb_open_files) {
 		rc = uk_9pfs_remove_generic(dvp, vp);
-	else
+	} else {
 		nd->removed = true;
+		uk_9pfs_attr_invalidate(dvp);
+	}
 
 	return rc;
 }
@@ -573,14 +796,136 @@ out:
 	return -rc;
 }
 
+static void uk_9pfs_uio_advance(struct uio *uio, int64_t bytes)
+{
+	struct iovec *iov = uio->uio_iov;
+	size_t len;
+
+	UK_ASSERT(uio->uio_offset <= __OFF_MAX - bytes);
+	UK_ASSERT(uio->uio_resid >= bytes);
+
+	uio->uio_offset += bytes;
+	uio->uio_resid -= bytes;
+	while (bytes > 0) {
+		len = MIN((size_t)bytes, iov->iov_len);
+		iov->iov_base = (char *)iov->iov_base + len;
+		iov->iov_len -= len;
+		bytes -= len;
+		iov++;
+	}
+}
+
+/*
+ * Transfers the data described by the uio with Tread/Twrite requests of at
+ * most one message each, keeping up to CONFIG_LIB9PFS_MAX_INFLIGHT of them
+ * in flight. Replies are consumed in order. After a short transfer, the
+ * results of the requests behind it are dropped and the pipeline restarts
+ * at the end of the data transferred so far; a transfer of 0 bytes ends
+ * the operation.
+ */
+static int uk_9pfs_rw(struct uk_9pdev *dev, struct uk_9pfid *fid,
+		      struct uio *uio, int write)
+{
+	struct {
+		struct uk_9preq *req;
+		uint32_t len;
+	} io[CONFIG_LIB9PFS_MAX_INFLIGHT];
+	uint32_t iosize, len;
+	unsigned int head, n;
+	struct uk_9preq *req;
+	struct iovec *iov;
+	int64_t bytes, done;
+	uint64_t off;
+	size_t iov_off;
+	int issue, account, eof = 0;
+	int i, rc = 0;
+	char *buf;
+
+	iosize = write ? uk_9p_write_iosize(dev, fid)
+		       : uk_9p_read_iosize(dev, fid);
+
+	while (uio->uio_resid > 0 && !rc && !eof) {
+		off = uio->uio_offset;
+		i = 0;
+		iov_off = 0;
+		head = n = 0;
+		issue = account = 1;
+		done = 0;
+
+		do {
+			/* Keep the pipeline filled */
+			while (issue && n < CONFIG_LIB9PFS_MAX_INFLIGHT) {
+				while (i < uio->uio_iovcnt &&
+				       iov_off == uio->uio_iov[i].iov_len) {
+					i++;
+					iov_off = 0;
+				}
+				if (i == uio->uio_iovcnt) {
+					issue = 0;
+					break;
+				}
+
+				iov = &uio->uio_iov[i];
+				len = MIN(iosize, iov->iov_len - iov_off);
+				buf = (char *)iov->iov_base + iov_off;
+				if (write)
+					req = uk_9p_write_start(dev, fid, off,
+								len, buf);
+				else
+					req = uk_9p_read_start(dev, fid, off,
+							       len, buf);
+				if (PTRISERR(req)) {
+					rc = PTR2ERR(req);
+					issue = 0;
+					break;
+				}
+
+				io[(head + n) % CONFIG_LIB9PFS_MAX_INFLIGHT].req
+					= req;
+				io[(head + n) % CONFIG_LIB9PFS_MAX_INFLIGHT].len
+					= len;
+				n++;
+				off += len;
+				iov_off += len;
+			}
+			if (!n)
+				break;
+
+			/* Complete the oldest request */
+			if (write)
+				bytes = uk_9p_write_finish(dev, io[head].req);
+			else
+				bytes = uk_9p_read_finish(dev, io[head].req);
+			len = io[head].len;
+			head = (head + 1) % CONFIG_LIB9PFS_MAX_INFLIGHT;
+			n--;
+
+			if (!account)
+				continue;
+			if (unlikely(bytes < 0)) {
+				rc = (int)bytes;
+				issue = account = 0;
+				continue;
+			}
+			done += bytes;
+			if ((uint64_t)bytes < len) {
+				eof = !bytes;
+				issue = account = 0;
+			}
+		} while (n > 0 || issue);
+
+		uk_9pfs_uio_advance(uio, done);
+	}
+
+	return rc;
+}
+
 static int uk_9pfs_read(struct vnode *vp, struct vfscore_file *fp,
 			struct uio *uio, int ioflag __unused)
 {
 	struct uk_9pdev *dev = UK_9PFS_MD(vp->v_mount)->dev;
 	struct uk_9pfid *fid = UK_9PFS_FD(fp)->fid;
-	struct iovec *iov;
-	int64_t bytes;
-	int i = 0;
+	int rc;
 
 	if (vp->v_type == VDIR)
 		return EISDIR;
@@ -593,55 +938,23 @@ static int uk_9pfs_read(struct vnode *vp, struct vfscore_file *fp,
 	if (!uio->uio_resid)
 		return 0;
 
-	while (i < uio->uio_iovcnt) {
-		iov = &uio->uio_iov[i];
-		if (!iov->iov_len) {
-			i++;
-			continue;
-		}
+	rc = uk_9pfs_wb_flush(vp);
+	if (unlikely(rc))
+		return rc;
 
-		bytes = uk_9p_read(dev, fid, uio->uio_offset,
-				   iov->iov_len, iov->iov_base);
-		if (unlikely(bytes < 0))
-			return -(int)bytes;
-		if (!bytes)
-			break;
-
-		UK_ASSERT(uio->uio_offset <= __OFF_MAX - bytes);
-		UK_ASSERT(uio->uio_resid >= bytes);
-		UK_ASSERT(iov->iov_len >= (uint64_t)bytes);
-
-		iov->iov_base = (char *)iov->iov_base + bytes;
-		iov->iov_len -= bytes;
-		uio->uio_offset += bytes;
-		uio->uio_resid -= bytes;
-	}
-
-	return 0;
+	return -uk_9pfs_rw(dev, fid, uio, 0);
 }
 
-static int uk_9pfs_write(struct vnode *vp, struct uio *uio, int ioflag)
+/*
+ * Sends the data described by the uio to the server through a new fid.
+ * Returns a negative errno.
+ */
+static int uk_9pfs_write_uio(struct vnode *vp, struct uio *uio)
 {
 	struct uk_9pfs_mount_data *md = UK_9PFS_MD(vp->v_mount);
 	struct uk_9pdev *dev = md->dev;
 	struct uk_9pfid *fid;
-	struct iovec *iov;
-	int64_t bytes;
-	int rc, i = 0;
-
-	if (vp->v_type == VDIR)
-		return EISDIR;
-	if (vp->v_type != VREG)
-		return EINVAL;
-	if (uio->uio_offset < 0)
-		return EINVAL;
-	if (uio->uio_offset >= LONG_MAX)
-		return EFBIG;
-	if (!uio->uio_resid)
-		return 0;
-
-	if (ioflag & IO_APPEND)
-		uio->uio_offset = vp->v_size;
+	int rc;
 
 	/* Clone vnode fid. */
 	fid = uk_9p_walk(dev, UK_9PFS_VFID(vp), NULL);
@@ -658,31 +971,8 @@ static int uk_9pfs_write(struct vnode *vp, struct uio *uio, int ioflag)
 	if (rc < 0)
 		goto out;
 
-	while (i < uio->uio_iovcnt) {
-		iov = &uio->uio_iov[i];
-		if (!iov->iov_len) {
-			i++;
-			continue;
-		}
-
-		bytes = uk_9p_write(dev, fid, uio->uio_offset,
-				    iov->iov_len, iov->iov_base);
-		if (unlikely(bytes < 0)) {
-			rc = (int)bytes;
-			break;
-		}
-		if (!bytes)
-			break;
-
-		UK_ASSERT(uio->uio_offset <= __OFF_MAX - bytes);
-		UK_ASSERT(uio->uio_resid >= bytes);
-		UK_ASSERT(iov->iov_len >= (uint64_t)bytes);
-
-		iov->iov_base = (char *)iov->iov_base + bytes;
-		iov->iov_len -= bytes;
-		uio->uio_offset += bytes;
-		uio->uio_resid -= bytes;
-	}
+	rc = uk_9pfs_rw(dev, fid, uio, 1);
+	uk_9pfs_attr_invalidate(vp);
 
 	/*
 	 * If the uio offset after completion of the write requests is bigger
@@ -694,9 +984,106 @@ static int uk_9pfs_write(struct vnode *vp, struct uio *uio, int ioflag)
 
 out:
 	uk_9pfid_put(fid);
+	return rc;
+}
+
+/*
+ * Sends the data in the write-back buffer of a vnode to the server. The
+ * buffer is emptied even if this fails, the error is returned instead.
+ */
+static int uk_9pfs_wb_flush(struct vnode *vp)
+{
+	struct uk_9pfs_node_data *nd = UK_9PFS_ND(vp);
+	struct iovec iov;
+	struct uio uio;
+	int rc;
+
+	if (!nd || !nd->wb_len)
+		return 0;
+
+	iov.iov_base = nd->wb_buf;
+	iov.iov_len = nd->wb_len;
+	uio.uio_iov = &iov;
+	uio.uio_iovcnt = 1;
+	uio.uio_offset = nd->wb_off;
+	uio.uio_resid = nd->wb_len;
+	uio.uio_rw = UIO_WRITE;
+	nd->wb_len = 0;
+
+	rc = uk_9pfs_write_uio(vp, &uio);
+	if (!rc && uio.uio_resid)
+		rc = -EIO;
 	return -rc;
 }
 
+/*
+ * Appends the data described by the uio to the write-back buffer if it
+ * continues the buffered data and fits. Returns 1 if the data was buffered
+ * and 0 if it must be written directly.
+ */
+static int uk_9pfs_wb_add(struct vnode *vp, struct uio *uio)
+{
+	struct uk_9pfs_node_data *nd = UK_9PFS_ND(vp);
+	struct uk_9pdev *dev = UK_9PFS_MD(vp->v_mount)->dev;
+	off_t off = uio->uio_offset;
+	size_t len = uio->uio_resid;
+
+	if (!nd->wb_buf) {
+		nd->wb_size = uk_9p_write_iosize(dev, nd->fid);
+		nd->wb_buf = malloc(nd->wb_size);
+		if (unlikely(!nd->wb_buf))
+			return 0;
+	}
+
+	/* Full messages gain nothing from buffering */
+	if (len >= nd->wb_size)
+		return 0;
+	if (nd->wb_len && (off != nd->wb_off + nd->wb_len ||
+			   len > nd->wb_size - nd->wb_len))
+		return 0;
+
+	if (!nd->wb_len)
+		nd->wb_off = off;
+	vfscore_uiomove(nd->wb_buf + nd->wb_len, (int)len, uio);
+	nd->wb_len += len;
+
+	if (uio->uio_offset > vp->v_size)
+		vp->v_size = uio->uio_offset;
+	uk_9pfs_attr_invalidate(vp);
+	return 1;
+}
+
+static int uk_9pfs_write(struct vnode *vp, struct uio *uio, int ioflag)
+{
+	struct uk_9pfs_mount_data *md = UK_9PFS_MD(vp->v_mount);
+	int rc;
+
+	if (vp->v_type == VDIR)
+		return EISDIR;
+	if (vp->v_type != VREG)
+		return EINVAL;
+	if (uio->uio_offset < 0)
+		return EINVAL;
+	if (uio->uio_offset >= LONG_MAX)
+		return EFBIG;
+	if (!uio->uio_resid)
+		return 0;
+
+	if (ioflag & IO_APPEND)
+		uio->uio_offset = vp->v_size;
+
+	if (md->writeback && !(ioflag & IO_SYNC) &&
+	    uk_9pfs_wb_add(vp, uio))
+		return 0;
+
+	/* Keep the order of writes that may overlap the buffered data */
+	rc = uk_9pfs_wb_flush(vp);
+	if (unlikely(rc))
+		return rc;
+
+	return -uk_9pfs_write_uio(vp, uio);
+}
+
 static int uk_9pfs_getattr(struct vnode *vp, struct vattr *attr)
 {
 	struct uk_9pfs_mount_data *md = UK_9PFS_MD(vp->v_mount);
@@ -705,6 +1092,14 @@ static int uk_9pfs_getattr(struct vnode *vp, struct vattr *attr)
 	struct uk_9preq *stat_req;
 	int rc = 0;
 
+	if (uk_9pfs_attr_cached(vp, attr))
+		return 0;
+
+	/* Let the server account for the buffered data */
+	rc = -uk_9pfs_wb_flush(vp);
+	if (unlikely(rc))
+		goto out;
+
 	if (md->proto == UK_9P_PROTO_2000L) {
 		struct uk_9p_attr stat;
 
@@ -721,21 +1116,7 @@ static int uk_9pfs_getattr(struct vnode *vp, struct vattr *attr)
 			goto out;
 		}
 
-		attr->va_type = stat.mode & S_IFMT;
-		attr->va_mode = stat.mode & UK_ALLPERMS;
-		attr->va_nlink = stat.nlink;
-		attr->va_uid = stat.uid;
-		attr->va_gid = stat.gid;
-		attr->va_nodeid = vp->v_ino;
-		attr->va_atime.tv_sec = stat.atime_sec;
-		attr->va_atime.tv_nsec = stat.atime_nsec;
-		attr->va_mtime.tv_sec = stat.mtime_sec;
-		attr->va_mtime.tv_nsec = stat.mtime_nsec;
-		attr->va_ctime.tv_sec = stat.ctime_sec;
-		attr->va_ctime.tv_nsec = stat.ctime_nsec;
-		attr->va_rdev = stat.rdev;
-		attr->va_nblocks = stat.blocks;
-		attr->va_size = stat.size;
+		uk_9pfs_vattr_from_attr(vp, &stat, attr);
 
 	} else if (md->proto == UK_9P_PROTO_2000U) {
 		struct uk_9p_stat stat;
@@ -749,21 +1130,14 @@ static int uk_9pfs_getattr(struct vnode *vp, struct vattr *attr)
 		/* No stat string fields are used below. */
 		uk_9pdev_req_remove(dev, stat_req);
 
-		attr->va_type = uk_9pfs_vtype_from_mode(stat.mode);
-		attr->va_mode = uk_9pfs_posix_mode_from_mode(stat.mode);
-		attr->va_nodeid = vp->v_ino;
-		attr->va_size = stat.length;
-
-		attr->va_atime.tv_sec = stat.atime;
-		attr->va_atime.tv_nsec = 0;
-		attr->va_mtime.tv_sec = stat.mtime;
-		attr->va_mtime.tv_nsec = 0;
-		attr->va_ctime.tv_sec = 0;
-		attr->va_ctime.tv_nsec = 0;
+		uk_9pfs_vattr_from_stat(vp, &stat, attr);
 	} else {
 		rc = -EOPNOTSUPP;
+		goto out;
 	}
 
+	uk_9pfs_attr_store(vp, attr);
+
 out:
 	return -rc;
 }
@@ -773,6 +1147,13 @@ static int uk_9pfs_do_setattr(struct vnode *vp, struct uk_9pfid *fid,
 {
 	struct uk_9pfs_mount_data *md = UK_9PFS_MD(vp->v_mount);
 	struct uk_9pdev *dev = md->dev;
+	int rc;
+
+	rc = uk_9pfs_wb_flush(vp);
+	if (unlikely(rc))
+		return rc;
+
+	uk_9pfs_attr_invalidate(vp);
 
 	if (md->proto == UK_9P_PROTO_2000L) {
 		uint32_t valid = 0;
@@ -835,7 +1216,6 @@ static int uk_9pfs_do_setattr(struct vnode *vp, struct uk_9pfid *fid,
 			.n_muid = (uint32_t)-1,
 		};
 		struct uk_9p_stat stat = donttouch_stat;
-		int rc;
 
 		/* Sending an unmodified donttouch stat will fsync() the file.
 		 * Otherwise, the fields which differ from the donttouch stat
@@ -892,6 +1272,11 @@ static int uk_9pfs_fsync(struct vnode *vp, struct vfscore_file *fp)
 {
 	struct uk_9pfs_mount_data *md = UK_9PFS_MD(vp->v_mount);
 	struct uk_9pfid *fid = UK_9PFS_FD(fp)->fid;
+	int rc;
+
+	rc = uk_9pfs_wb_flush(vp);
+	if (unlikely(rc))
+		return rc;
 
 	if (md->proto == UK_9P_PROTO_2000L) {
 		return -uk_9p_fsync(md->dev, fid);
@@ -914,7 +1299,7 @@ static int uk_9pfs_truncate(struct vnode *vp, off_t off)
 
 static int uk_9pfs_rename(struct vnode *dvp1, struct vnode *vp1,
 			  const char *name1,
-			  struct vnode *dvp2, struct vnode *vp2 __unused,
+			  struct vnode *dvp2, struct vnode *vp2,
 			  const char *name2)
 {
 	struct uk_9pfs_mount_data *dmd1 = UK_9PFS_MD(dvp1->v_mount);
@@ -927,6 +1312,11 @@ static int uk_9pfs_rename(struct vnode *dvp1, struct vnode *vp1,
 	if (dmd1->dev != dmd2->dev)
 		return EXDEV;
 
+	uk_9pfs_attr_invalidate(dvp1);
+	uk_9pfs_attr_invalidate(vp1);
+	uk_9pfs_dir_changed(dvp2, name2);
+	uk_9pfs_attr_invalidate(vp2);
+
 	if (dmd1->proto == UK_9P_PROTO_2000L) {
 		rc = uk_9p_renameat(dmd1->dev, dfid1, name1, dfid2, name2);
 		if (rc == -EOPNOTSUPP)
@@ -948,6 +1338,9 @@ static int uk_9pfs_link(struct vnode *dvp, struct vnode *svp, const char *name)
 	if (dmd->dev != smd->dev)
 		return EXDEV;
 
+	uk_9pfs_dir_changed(dvp, name);
+	uk_9pfs_attr_invalidate(svp);
+
 	if (dmd->proto == UK_9P_PROTO_2000L)
 		return -uk_9p_link(dmd->dev, dfid, sfid, name);
 	else
@@ -1004,6 +1397,7 @@ static int uk_9pfs_symlink(struct vnode *dvp, const char *op, const char *np)
 	struct uk_9pfid *dfid = UK_9PFS_VFID(dvp);
 	struct uk_9pfid *fid;
 
+	uk_9pfs_dir_changed(dvp, op);
 	fid = uk_9p_symlink(md->dev, dfid, op, np, 0);
 	if (PTRISERR(fid))
 		return -PTR2ERR(fid);
@@ -0,0 +1,110 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __CPIOFS_H__
+#define __CPIOFS_H__
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <time.h>
+#include <uk/essentials.h>
+#include <vfscore/mount.h>
+#include <vfscore/vnode.h>
+
+/*
+ * Archive format: "new ASCII" (newc) CPIO, optionally with CRC
+ */
+#define CPIO_MAGIC_NEWC		"070701"
+#define CPIO_MAGIC_CRC		"070702"
+#define CPIO_TRAILER		"TRAILER!!!"
+
+struct cpio_header {
+	char magic[6];
+	char inode_num[8];
+	char mode[8];
+	char uid[8];
+	char gid[8];
+	char nlink[8];
+	char mtime[8];
+	char filesize[8];
+	char major[8];
+	char minor[8];
+	char ref_major[8];
+	char ref_minor[8];
+	char namesize[8];
+	char chksum[8];
+};
+
+/*
+ * A file, directory, or symbolic link of a mounted archive. Names and
+ * contents are not copied but point into the archive, which stays in memory
+ * for as long as the file system is mounted. The tree is built at mount time
+ * and never changes afterwards, so it needs no locking.
+ */
+struct cpiofs_node {
+	struct cpiofs_node *parent;
+	/* Next node in the same directory */
+	struct cpiofs_node *next;
+	/* First and last child if the node is a directory, else NULL */
+	struct cpiofs_node *child;
+	struct cpiofs_node *last;
+	/* Next node in the same bucket of the lookup hash table */
+	struct cpiofs_node *hnext;
+	/* Directory offset of the node in its parent */
+	off_t pos;
+	/* Name of the node, not necessarily NUL-terminated */
+	const char *name;
+	size_t namelen;
+	/* File contents or link target (without terminating NUL) */
+	const char *data;
+	size_t size;
+	uint64_t ino;
+	/* Entry type: VREG, VDIR, or VLNK */
+	int type;
+	/* Permission bits */
+	mode_t mode;
+	struct timespec mtime;
+};
+
+struct cpiofs_mount {
+	struct cpiofs_node *root;
+	/* The archive */
+	const char *base;
+	size_t len;
+	/* Number of nodes, including the root */
+	uint64_t nnodes;
+	/* Hash table of all nodes by parent and name */
+	struct cpiofs_node **htab;
+	size_t hmask;
+};
+
+#define CPIOFS_MOUNT(mp)	((struct cpiofs_mount *)(mp)->m_data)
+#define CPIOFS_NODE(vp)		((struct cpiofs_node *)(vp)->v_data)
+
+/**
+ * Builds the node tree of the archive of a mount.
+ *
+ * @return
+ *   0 on success, an errno value otherwise
+ */
+int cpiofs_scan(struct cpiofs_mount *cm);
+
+/**
+ * Looks up the node `name` of length `len` in the directory `dnp`.
+ *
+ * @return
+ *   The node, or NULL if there is no such node
+ */
+struct cpiofs_node *cpiofs_lookup_node(struct cpiofs_mount *cm,
+				       struct cpiofs_node *dnp,
+				       const char *name, size_t len);
+
+/**
+ * Frees the node tree of a mount.
+ */
+void cpiofs_free(struct cpiofs_mount *cm);
+
+#endif /* __CPIOFS_H__ */
@@ -0,0 +1,333 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <uk/assert.h>
+#include <uk/essentials.h>
+#include <uk/print.h>
+
+#include "cpiofs.h"
+
+/* A parsed archive entry */
+struct cpio_entry {
+	const char *name;
+	const char *data;
+	__u32 mode;
+	__u32 size;
+	__u32 mtime;
+	/* Offset of the next header */
+	size_t next;
+};
+
+static int cpio_field(const char *buf, __u32 *val)
+{
+	unsigned int i;
+
+	*val = 0;
+	for (i = 0; i < 8; i++) {
+		*val <<= 4;
+		if (buf[i] >= '0' && buf[i] <= '9')
+			*val |= buf[i] - '0';
+		else if (buf[i] >= 'A' && buf[i] <= 'F')
+			*val |= buf[i] - 'A' + 10;
+		else if (buf[i] >= 'a' && buf[i] <= 'f')
+			*val |= buf[i] - 'a' + 10;
+		else
+			return EINVAL;
+	}
+	return 0;
+}
+
+/*
+ * Parses the header at offset `off` of the archive. Data and headers are
+ * aligned to 4 bytes relative to the start of the archive.
+ */
+static int cpio_parse(struct cpiofs_mount *cm, size_t off,
+		      struct cpio_entry *ent)
+{
+	const struct cpio_header *hdr;
+	__u32 namesize;
+	size_t doff;
+
+	if (cm->len - off < sizeof(*hdr))
+		goto err_trunc;
+	hdr = (const struct cpio_header *)(cm->base + off);
+	if (memcmp(hdr->magic, CPIO_MAGIC_NEWC, sizeof(hdr->magic)) &&
+	    memcmp(hdr->magic, CPIO_MAGIC_CRC, sizeof(hdr->magic))) {
+		uk_pr_err("Bad magic number in header at offset %"__PRIsz"\n",
+			  off);
+		return EINVAL;
+	}
+	if (cpio_field(hdr->mode, &ent->mode) ||
+	    cpio_field(hdr->filesize, &ent->size) ||
+	    cpio_field(hdr->mtime, &ent->mtime) ||
+	    cpio_field(hdr->namesize, &namesize)) {
+		uk_pr_err("Malformed header at offset %"__PRIsz"\n", off);
+		return EINVAL;
+	}
+
+	off += sizeof(*hdr);
+	/* The name size includes the terminating NUL */
+	if (namesize == 0 || cm->len - off < namesize)
+		goto err_trunc;
+	ent->name = cm->base + off;
+	if (ent->name[namesize - 1] != '\0') {
+		uk_pr_err("Malformed name at offset %"__PRIsz"\n", off);
+		return EINVAL;
+	}
+
+	doff = ALIGN_UP(off + namesize, 4);
+	if (doff > cm->len || cm->len - doff < ent->size)
+		goto err_trunc;
+	ent->data = cm->base + doff;
+	ent->next = ALIGN_UP(doff + ent->size, 4);
+	return 0;
+
+err_trunc:
+	uk_pr_err("Archive truncated at offset %"__PRIsz"\n", off);
+	return EINVAL;
+}
+
+static size_t cpiofs_hash(const struct cpiofs_node *dnp, const char *name,
+			  size_t len)
+{
+	__u64 h = 0xcbf29ce484222325ULL ^ (__u64)(__uptr)dnp;
+
+	/* FNV-1a */
+	while (len--) {
+		h ^= (unsigned char)*name++;
+		h *= 0x100000001b3ULL;
+	}
+	return (size_t)h;
+}
+
+struct cpiofs_node *cpiofs_lookup_node(struct cpiofs_mount *cm,
+				       struct cpiofs_node *dnp,
+				       const char *name, size_t len)
+{
+	struct cpiofs_node *np;
+
+	np = cm->htab[cpiofs_hash(dnp, name, len) & cm->hmask];
+	for (; np; np = np->hnext) {
+		if (np->parent == dnp && np->namelen == len &&
+		    !memcmp(np->name, name, len))
+			return np;
+	}
+	return NULL;
+}
+
+static struct cpiofs_node *cpiofs_new_node(struct cpiofs_mount *cm,
+					   struct cpiofs_node *dnp,
+					   const char *name, size_t len)
+{
+	struct cpiofs_node *np;
+	size_t h;
+
+	np = calloc(1, sizeof(*np));
+	if (unlikely(!np))
+		return NULL;
+	np->parent = dnp;
+	np->name = name;
+	np->namelen = len;
+	np->ino = cm->nnodes++;
+	np->type = VDIR;
+	np->mode = 0755;
+
+	/* Keep the order of the archive in directory listings, after "."
+	 * and ".."
+	 */
+	if (dnp->last) {
+		np->pos = dnp->last->pos + 1;
+		dnp->last->next = np;
+	} else {
+		np->pos = 2;
+		dnp->child = np;
+	}
+	dnp->last = np;
+
+	h = cpiofs_hash(dnp, name, len) & cm->hmask;
+	np->hnext = cm->htab[h];
+	cm->htab[h] = np;
+	return np;
+}
+
+static void cpiofs_set_node(struct cpiofs_node *np, int type,
+			    const struct cpio_entry *ent)
+{
+	np->type = type;
+	np->mode = ent->mode & 07777;
+	np->mtime.tv_sec = ent->mtime;
+	np->mtime.tv_nsec = 0;
+	if (type == VDIR) {
+		np->data = NULL;
+		np->size = 0;
+	} else {
+		np->data = ent->data;
+		np->size = ent->size;
+	}
+}
+
+/*
+ * Adds an archive entry to the tree. Parent directories that have no entry
+ * of their own are created implicitly. Entries that cannot be represented
+ * are skipped with a warning, like ukcpio does when extracting.
+ */
+static int cpiofs_add(struct cpiofs_mount *cm, const struct cpio_entry *ent)
+{
+	struct cpiofs_node *np, *dnp = cm->root;
+	const char *path = ent->name;
+	const char *next;
+	size_t len;
+	int type;
+
+	switch (ent->mode & S_IFMT) {
+	case S_IFREG:
+		type = VREG;
+		break;
+	case S_IFDIR:
+		type = VDIR;
+		break;
+	case S_IFLNK:
+		type = VLNK;
+		break;
+	default:
+		uk_pr_warn("Skipping %s: unsupported mode %o\n",
+			   ent->name, ent->mode);
+		return 0;
+	}
+
+	for (;;) {
+		while (*path == '/')
+			path++;
+		if (*path == '\0') {
+			/* The entry is the root directory, e.g., "." */
+			if (type == VDIR)
+				cpiofs_set_node(dnp, VDIR, ent);
+			return 0;
+		}
+
+		len = strcspn(path, "/");
+		next = path + len;
+		while (*next == '/')
+			next++;
+
+		if (len == 1 && path[0] == '.') {
+			path = next;
+			continue;
+		}
+		if (len == 2 && path[0] == '.' && path[1] == '.') {
+			uk_pr_warn("Skipping %s: path contains \"..\"\n",
+				   ent->name);
+			return 0;
+		}
+		if (len > NAME_MAX) {
+			uk_pr_warn("Skipping %s: name too long\n", ent->name);
+			return 0;
+		}
+
+		np = cpiofs_lookup_node(cm, dnp, path, len);
+		if (*next != '\0') {
+			if (!np) {
+				np = cpiofs_new_node(cm, dnp, path, len);
+				if (unlikely(!np))
+					return ENOMEM;
+			} else if (np->type != VDIR) {
+				uk_pr_warn("Skipping %s: not a directory\n",
+					   ent->name);
+				return 0;
+			}
+			dnp = np;
+			path = next;
+			continue;
+		}
+
+		if (!np) {
+			np = cpiofs_new_node(cm, dnp, path, len);
+			if (unlikely(!np))
+				return ENOMEM;
+		} else if ((np->type == VDIR) != (type == VDIR)) {
+			uk_pr_warn("Skipping %s: type conflict\n", ent->name);
+			return 0;
+		}
+		/* Later entries replace earlier ones, as with extraction */
+		cpiofs_set_node(np, type, ent);
+		return 0;
+	}
+}
+
+int cpiofs_scan(struct cpiofs_mount *cm)
+{
+	struct cpio_entry ent;
+	size_t off, nent = 0, nbuckets;
+	int rc;
+
+	/* Validate the archive and count its entries first, to size the
+	 * hash table
+	 */
+	for (off = 0; ; off = ent.next) {
+		if (off >= cm->len) {
+			if (off == 0)
+				break; /* empty archive */
+			uk_pr_err("Archive has no trailer\n");
+			return EINVAL;
+		}
+		rc = cpio_parse(cm, off, &ent);
+		if (unlikely(rc))
+			return rc;
+		if (!strcmp(ent.name, CPIO_TRAILER))
+			break;
+		nent++;
+	}
+
+	/* Implicit directories may add some more nodes */
+	nbuckets = 16;
+	while (nbuckets < nent)
+		nbuckets <<= 1;
+	cm->htab = calloc(nbuckets, sizeof(*cm->htab));
+	if (unlikely(!cm->htab))
+		return ENOMEM;
+	cm->hmask = nbuckets - 1;
+
+	cm->root = calloc(1, sizeof(*cm->root));
+	if (unlikely(!cm->root))
+		return ENOMEM;
+	cm->root->type = VDIR;
+	cm->root->mode = 0755;
+	cm->root->ino = 0;
+	cm->nnodes = 1;
+
+	for (off = 0; nent; off = ent.next, nent--) {
+		rc = cpio_parse(cm, off, &ent);
+		UK_ASSERT(!rc);
+		rc = cpiofs_add(cm, &ent);
+		if (unlikely(rc))
+			return rc;
+	}
+	return 0;
+}
+
+void cpiofs_free(struct cpiofs_mount *cm)
+{
+	struct cpiofs_node *np, *next;
+	size_t i;
+
+	if (cm->htab) {
+		for (i = 0; i <= cm->hmask; i++) {
+			for (np = cm->htab[i]; np; np = next) {
+				next = np->hnext;
+				free(np);
+			}
+		}
+		free(cm->htab);
+		cm->htab = NULL;
+	}
+	free(cm->root);
+	cm->root = NULL;
+}
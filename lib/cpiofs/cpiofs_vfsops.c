@@ -0,0 +1,135 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <uk/config.h>
+#include <uk/plat/memory.h>
+#include <uk/print.h>
+#include <vfscore/dentry.h>
+#include <vfscore/mount.h>
+#include <vfscore/vnode.h>
+
+#include "cpiofs.h"
+
+#if CONFIG_LIBVFSCORE_AUTOMOUNT_EINITRD
+extern const char vfscore_einitrd_start[];
+extern const char vfscore_einitrd_end;
+#endif /* CONFIG_LIBVFSCORE_AUTOMOUNT_EINITRD */
+
+extern struct vnops cpiofs_vnops;
+
+static int cpiofs_mount(struct mount *mp, const char *dev, int flags,
+			const void *data);
+static int cpiofs_unmount(struct mount *mp, int flags);
+
+#define cpiofs_sync	((vfsop_sync_t)vfscore_nullop)
+#define cpiofs_vget	((vfsop_vget_t)vfscore_nullop)
+#define cpiofs_statfs	((vfsop_statfs_t)vfscore_nullop)
+
+struct vfsops cpiofs_vfsops = {
+	.vfs_mount	= cpiofs_mount,
+	.vfs_unmount	= cpiofs_unmount,
+	.vfs_sync	= cpiofs_sync,
+	.vfs_vget	= cpiofs_vget,
+	.vfs_statfs	= cpiofs_statfs,
+	.vfs_vnops	= &cpiofs_vnops
+};
+
+static struct vfscore_fs_type cpiofs_fs = {
+	.vs_name	= "cpiofs",
+	.vs_init	= NULL,
+	.vs_op		= &cpiofs_vfsops
+};
+
+UK_FS_REGISTER(cpiofs_fs);
+
+/*
+ * Resolves the device of a mount: "initrd0" is the first initrd passed by
+ * the boot loader, "embedded" the initrd embedded by vfscore.
+ */
+static int cpiofs_image_lookup(const char *dev, const char **base,
+			       size_t *len)
+{
+	struct ukplat_memregion_desc *mrd;
+
+	if (!dev)
+		return ENODEV;
+
+	if (!strcmp(dev, "initrd0")) {
+		if (ukplat_memregion_find_initrd0(&mrd) < 0)
+			return ENODEV;
+		*base = (const char *)mrd->vbase;
+		*len = mrd->len;
+		return 0;
+	}
+#if CONFIG_LIBVFSCORE_AUTOMOUNT_EINITRD
+	if (!strcmp(dev, "embedded")) {
+		*base = vfscore_einitrd_start;
+		*len = (size_t)(&vfscore_einitrd_end - vfscore_einitrd_start);
+		return 0;
+	}
+#endif /* CONFIG_LIBVFSCORE_AUTOMOUNT_EINITRD */
+	return ENODEV;
+}
+
+static int
+cpiofs_mount(struct mount *mp, const char *dev, int flags __unused,
+	     const void *data __unused)
+{
+	struct cpiofs_mount *cm;
+	int rc;
+
+	uk_pr_debug("%s: dev=%s\n", __func__, dev);
+
+	cm = calloc(1, sizeof(*cm));
+	if (unlikely(!cm))
+		return ENOMEM;
+
+	rc = cpiofs_image_lookup(dev, &cm->base, &cm->len);
+	if (rc) {
+		uk_pr_err("No initrd \"%s\"\n", dev ? dev : "");
+		goto err_free_cm;
+	}
+
+	rc = cpiofs_scan(cm);
+	if (unlikely(rc))
+		goto err_free_nodes;
+
+	/* Files are served from the archive, which is already in memory:
+	 * caching pages of it would only duplicate it. Reads do not modify
+	 * anything, so they can run concurrently.
+	 */
+	mp->m_flags |= MNT_RDONLY | MNT_SHAREDREAD;
+	mp->m_flags &= ~MNT_PAGECACHE;
+
+	mp->m_data = cm;
+	mp->m_root->d_vnode->v_data = cm->root;
+
+	uk_pr_info("cpiofs: mounted %s @ %p (%"__PRIsz" bytes, %"__PRIu64
+		   " nodes)\n", dev, cm->base, cm->len, cm->nnodes);
+	return 0;
+
+err_free_nodes:
+	cpiofs_free(cm);
+err_free_cm:
+	free(cm);
+	return rc;
+}
+
+static int
+cpiofs_unmount(struct mount *mp, int flags __unused)
+{
+	struct cpiofs_mount *cm = CPIOFS_MOUNT(mp);
+
+	vfscore_release_mp_dentries(mp);
+
+	cpiofs_free(cm);
+	free(cm);
+	mp->m_data = NULL;
+	return 0;
+}
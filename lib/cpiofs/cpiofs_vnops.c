@@ -0,0 +1,204 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <uk/essentials.h>
+#include <vfscore/file.h>
+#include <vfscore/mount.h>
+#include <vfscore/uio.h>
+#include <vfscore/vnode.h>
+
+#include "cpiofs.h"
+
+static int cpiofs_lookup(struct vnode *dvp, const char *name,
+			 struct vnode **vpp)
+{
+	struct cpiofs_mount *cm = CPIOFS_MOUNT(dvp->v_mount);
+	struct cpiofs_node *np;
+	struct vnode *vp;
+
+	*vpp = NULL;
+
+	if (*name == '\0')
+		return ENOENT;
+
+	np = cpiofs_lookup_node(cm, CPIOFS_NODE(dvp), name, strlen(name));
+	if (!np)
+		return ENOENT;
+
+	if (vfscore_vget(dvp->v_mount, np->ino, &vp)) {
+		/* found in cache */
+		*vpp = vp;
+		return 0;
+	}
+	if (!vp)
+		return ENOMEM;
+	vp->v_data = np;
+	vp->v_type = np->type;
+	vp->v_mode = np->mode;
+	vp->v_size = np->size;
+	*vpp = vp;
+	return 0;
+}
+
+/*
+ * Copies `uio->uio_resid` bytes at the offset of `uio` out of `np`. This is
+ * the only copy there is: the data is read straight from the archive.
+ */
+static int cpiofs_uiomove(struct cpiofs_node *np, struct uio *uio)
+{
+	size_t len;
+
+	if (uio->uio_offset < 0)
+		return EINVAL;
+	if (uio->uio_resid == 0)
+		return 0;
+	if (uio->uio_offset >= (off_t)np->size)
+		return 0;
+
+	len = MIN((size_t)uio->uio_resid, np->size - (size_t)uio->uio_offset);
+	return vfscore_uiomove((void *)(np->data + uio->uio_offset), len, uio);
+}
+
+static int cpiofs_read(struct vnode *vp, struct vfscore_file *fp __unused,
+		       struct uio *uio, int ioflag __unused)
+{
+	if (vp->v_type == VDIR)
+		return EISDIR;
+	if (vp->v_type != VREG)
+		return EINVAL;
+	return cpiofs_uiomove(CPIOFS_NODE(vp), uio);
+}
+
+static int cpiofs_readlink(struct vnode *vp, struct uio *uio)
+{
+	if (vp->v_type != VLNK)
+		return EINVAL;
+	return cpiofs_uiomove(CPIOFS_NODE(vp), uio);
+}
+
+/*
+ * The offset of a directory is the position of the next entry: "." and ".."
+ * are at 0 and 1, the nodes of the directory follow from 2 on. The node to
+ * return next is remembered with the file, so that listing a directory does
+ * not rescan it for every entry.
+ */
+static int cpiofs_readdir(struct vnode *vp, struct vfscore_file *fp,
+			  struct dirent64 *dir)
+{
+	struct cpiofs_node *np, *dnp = CPIOFS_NODE(vp);
+	size_t len;
+
+	if (fp->f_offset < 2) {
+		dir->d_type = DT_DIR;
+		strlcpy((char *)&dir->d_name, fp->f_offset ? ".." : ".",
+			sizeof(dir->d_name));
+		dir->d_fileno = fp->f_offset;
+		fp->f_offset++;
+		return 0;
+	}
+
+	np = fp->f_data;
+	if (!np || np->parent != dnp || np->pos != fp->f_offset) {
+		for (np = dnp->child; np && np->pos != fp->f_offset;
+		     np = np->next)
+			;
+	}
+	if (!np)
+		return ENOENT;
+
+	if (np->type == VDIR)
+		dir->d_type = DT_DIR;
+	else if (np->type == VLNK)
+		dir->d_type = DT_LNK;
+	else
+		dir->d_type = DT_REG;
+	len = MIN(np->namelen, sizeof(dir->d_name) - 1);
+	memcpy(dir->d_name, np->name, len);
+	dir->d_name[len] = '\0';
+	dir->d_fileno = np->ino;
+
+	fp->f_offset++;
+	fp->f_data = np->next;
+	return 0;
+}
+
+static int cpiofs_getattr(struct vnode *vp, struct vattr *attr)
+{
+	struct cpiofs_node *np = CPIOFS_NODE(vp);
+
+	attr->va_nodeid = vp->v_ino;
+	attr->va_type = np->type;
+	attr->va_mode = np->mode;
+	attr->va_nlink = 1;
+	attr->va_size = np->size;
+	attr->va_nblocks = DIV_ROUND_UP(np->size, 512);
+	attr->va_atime = np->mtime;
+	attr->va_ctime = np->mtime;
+	attr->va_mtime = np->mtime;
+	return 0;
+}
+
+static int cpiofs_ioctl(struct vnode *vp __unused,
+			struct vfscore_file *fp __unused,
+			unsigned long com, void *data __unused)
+{
+	if (com == FIONBIO)
+		return 0;
+	return ENOTTY;
+}
+
+#define cpiofs_open	((vnop_open_t)vfscore_vop_nullop)
+#define cpiofs_close	((vnop_close_t)vfscore_vop_nullop)
+#define cpiofs_write	((vnop_write_t)vfscore_vop_erofs)
+#define cpiofs_seek	((vnop_seek_t)vfscore_vop_nullop)
+#define cpiofs_fsync	((vnop_fsync_t)vfscore_vop_nullop)
+#define cpiofs_create	((vnop_create_t)vfscore_vop_erofs)
+#define cpiofs_remove	((vnop_remove_t)vfscore_vop_erofs)
+#define cpiofs_rename	((vnop_rename_t)vfscore_vop_erofs)
+#define cpiofs_mkdir	((vnop_mkdir_t)vfscore_vop_erofs)
+#define cpiofs_rmdir	((vnop_rmdir_t)vfscore_vop_erofs)
+#define cpiofs_setattr	((vnop_setattr_t)vfscore_vop_erofs)
+#define cpiofs_inactive	((vnop_inactive_t)vfscore_vop_nullop)
+#define cpiofs_truncate	((vnop_truncate_t)vfscore_vop_erofs)
+#define cpiofs_link	((vnop_link_t)vfscore_vop_erofs)
+#define cpiofs_cache	((vnop_cache_t)NULL)
+#define cpiofs_fallocate ((vnop_fallocate_t)vfscore_vop_erofs)
+#define cpiofs_symlink	((vnop_symlink_t)vfscore_vop_erofs)
+#define cpiofs_poll	((vnop_poll_t)vfscore_vop_einval)
+
+struct vnops cpiofs_vnops = {
+	.vop_open	= cpiofs_open,
+	.vop_close	= cpiofs_close,
+	.vop_read	= cpiofs_read,
+	.vop_write	= cpiofs_write,
+	.vop_seek	= cpiofs_seek,
+	.vop_ioctl	= cpiofs_ioctl,
+	.vop_fsync	= cpiofs_fsync,
+	.vop_readdir	= cpiofs_readdir,
+	.vop_lookup	= cpiofs_lookup,
+	.vop_create	= cpiofs_create,
+	.vop_remove	= cpiofs_remove,
+	.vop_rename	= cpiofs_rename,
+	.vop_mkdir	= cpiofs_mkdir,
+	.vop_rmdir	= cpiofs_rmdir,
+	.vop_getattr	= cpiofs_getattr,
+	.vop_setattr	= cpiofs_setattr,
+	.vop_inactive	= cpiofs_inactive,
+	.vop_truncate	= cpiofs_truncate,
+	.vop_link	= cpiofs_link,
+	.vop_cache	= cpiofs_cache,
+	.vop_fallocate	= cpiofs_fallocate,
+	.vop_readlink	= cpiofs_readlink,
+	.vop_symlink	= cpiofs_symlink,
+	.vop_poll	= cpiofs_poll,
+};
@@ -169,6 +169,8 @@ devfs_lookup(struct vnode *dvp, const char *name, struct vnode **vpp)
 	vp->v_flags = 0;
 	if (info.flags & D_TTY)
 		vp->v_flags |= VISTTY;
+	if (info.flags & D_ZERO)
+		vp->v_flags |= VZERO;
 
 	vp->v_mode = (mode_t)(S_IRUSR | S_IWUSR);
 
@@ -69,6 +69,8 @@ struct devinfo {
 #define D_REM		0x00000004
 /* tty device */
 #define D_TTY		0x00000010
+/* Reads return zeros, mappings are anonymous memory */
+#define D_ZERO		0x00000020
 
 typedef int (*devop_open_t)(struct device *, int);
 typedef int (*devop_close_t)(struct device *);
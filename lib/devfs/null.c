@@ -35,10 +35,12 @@
 
 #include <uk/config.h>
 #include <uk/ctors.h>
+#include <uk/essentials.h>
 #include <uk/print.h>
 #include <vfscore/uio.h>
 #include <devfs/device.h>
 
+/* The data is discarded without being looked at */
 static int dev_null_write(struct device *dev __unused, struct uio *uio,
 			  int flags __unused)
 {
@@ -77,14 +79,16 @@ static struct driver drv_null = {
 static int dev_zero_read(struct device *dev __unused, struct uio *uio,
 			 int flags __unused)
 {
+	struct iovec *iov = uio->uio_iov;
 	size_t count;
-	char *buf;
+	int i;
 
-	buf = uio->uio_iov->iov_base;
-	count = uio->uio_iov->iov_len;
-
-	memset(buf, 0, count);
-	uio->uio_resid = 0;
+	/* Clear the buffers in place instead of copying from a zero page */
+	for (i = 0; i < uio->uio_iovcnt && uio->uio_resid > 0; i++) {
+		count = MIN(iov[i].iov_len, (size_t)uio->uio_resid);
+		memset(iov[i].iov_base, 0, count);
+		uio->uio_resid -= count;
+	}
 	return 0;
 }
 
@@ -123,7 +127,7 @@ static int devfs_register_null(struct uk_init_ctx *ictx __unused)
 	uk_pr_debug("Register '%s' to devfs\n", DEV_ZERO_NAME);
 
 	/* register /dev/zero */
-	rc = device_create(&drv_zero, DEV_ZERO_NAME, D_CHR, NULL);
+	rc = device_create(&drv_zero, DEV_ZERO_NAME, D_CHR | D_ZERO, NULL);
 	if (unlikely(rc)) {
 		uk_pr_err("Failed to register '%s' to devfs: %d\n",
 			  DEV_ZERO_NAME, rc);
@@ -0,0 +1,252 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __FATFS_H__
+#define __FATFS_H__
+
+#include <stdint.h>
+#include <time.h>
+#include <uk/bcache.h>
+#include <uk/essentials.h>
+#include <uk/list.h>
+#include <uk/mutex.h>
+#include <vfscore/mount.h>
+#include <vfscore/vnode.h>
+
+/*
+ * On-disk structures (all little-endian)
+ */
+
+/* BIOS parameter block of FAT32 volumes */
+struct fat_bpb {
+	__u8 jmp[3];
+	char oem[8];
+	__u16 bytes_per_sec;
+	__u8 sec_per_clus;
+	__u16 rsvd_sec_cnt;
+	__u8 num_fats;
+	__u16 root_ent_cnt;
+	__u16 tot_sec16;
+	__u8 media;
+	__u16 fat_sz16;
+	__u16 sec_per_trk;
+	__u16 num_heads;
+	__u32 hidd_sec;
+	__u32 tot_sec32;
+	/* FAT32 extension */
+	__u32 fat_sz32;
+	__u16 ext_flags;
+	__u16 fs_ver;
+	__u32 root_clus;
+	__u16 fs_info;
+	__u16 bk_boot_sec;
+	__u8 reserved[12];
+	__u8 drv_num;
+	__u8 reserved1;
+	__u8 boot_sig;
+	__u32 vol_id;
+	char vol_lab[11];
+	char fil_sys_type[8];
+} __packed;
+
+#define FAT_FSI_LEAD_SIG	0x41615252
+#define FAT_FSI_STRUC_SIG	0x61417272
+#define FAT_FSI_TRAIL_SIG	0xaa550000
+#define FAT_FSI_UNKNOWN		0xffffffff
+
+struct fat_fsinfo {
+	__u32 lead_sig;
+	__u8 reserved1[480];
+	__u32 struc_sig;
+	__u32 free_count;
+	__u32 nxt_free;
+	__u8 reserved2[12];
+	__u32 trail_sig;
+} __packed;
+
+#define FAT_ATTR_READ_ONLY	0x01
+#define FAT_ATTR_HIDDEN		0x02
+#define FAT_ATTR_SYSTEM		0x04
+#define FAT_ATTR_VOLUME_ID	0x08
+#define FAT_ATTR_DIRECTORY	0x10
+#define FAT_ATTR_ARCHIVE	0x20
+#define FAT_ATTR_LONG_NAME	0x0f
+#define FAT_ATTR_LONG_NAME_MASK	0x3f
+
+/* Flags in ntres: base name and extension are stored in lower case */
+#define FAT_NTRES_LOWER_BASE	0x08
+#define FAT_NTRES_LOWER_EXT	0x10
+
+#define FAT_DIRENT_FREE		0xe5
+#define FAT_DIRENT_END		0x00
+#define FAT_DIRENT_SIZE		32
+
+struct fat_dirent {
+	__u8 name[11];
+	__u8 attr;
+	__u8 ntres;
+	__u8 crt_time_tenth;
+	__u16 crt_time;
+	__u16 crt_date;
+	__u16 lst_acc_date;
+	__u16 fst_clus_hi;
+	__u16 wrt_time;
+	__u16 wrt_date;
+	__u16 fst_clus_lo;
+	__u32 file_size;
+} __packed;
+
+#define FAT_LFN_LAST		0x40
+#define FAT_LFN_ORD_MASK	0x3f
+#define FAT_LFN_CHARS		13
+#define FAT_LFN_MAX		255
+
+struct fat_lfn {
+	__u8 ord;
+	__u16 name1[5];
+	__u8 attr;
+	__u8 type;
+	__u8 chksum;
+	__u16 name2[6];
+	__u16 fst_clus_lo;
+	__u16 name3[2];
+} __packed;
+
+#define FAT_CLUS_FREE		0x00000000
+#define FAT_CLUS_BAD		0x0ffffff7
+#define FAT_CLUS_EOC		0x0fffffff
+#define FAT_CLUS_MASK		0x0fffffff
+#define FAT_CLUS_IS_EOC(c)	(((c) & FAT_CLUS_MASK) >= 0x0ffffff8)
+#define FAT_FILE_SIZE_MAX	0xffffffffULL
+
+/*
+ * In-memory structures
+ */
+
+struct fat_mount {
+	struct uk_blkdev *dev;
+	struct uk_bcache *bc;
+	/* Geometry, the block size of the cache is one FAT sector */
+	__u32 bytes_per_sec;
+	__u32 sec_per_clus;
+	__u32 clus_size;
+	__u32 fat_start;	/* First sector of the first FAT */
+	__u32 fat_sectors;	/* Sectors per FAT */
+	__u32 num_fats;
+	__u32 data_start;	/* First sector of cluster 2 */
+	__u32 nclusters;	/* Number of data clusters */
+	__u32 root_clus;
+	__u32 fsinfo_sec;	/* 0 if there is no FSInfo sector */
+	/* Allocation state */
+	__u32 free_count;
+	__u32 next_free;
+	int fsinfo_dirty;
+	int rdonly;
+	uint64_t next_ino;
+	/* Serializes all operations on the volume */
+	struct uk_mutex lock;
+	/* Nodes with a vnode, looked up by the position of their entry */
+	struct uk_list_head nodes;
+	struct fat_node *root;
+};
+
+struct fat_node {
+	struct uk_list_head link;
+	uint64_t ino;
+	/* Position of the short entry: first cluster of the parent directory
+	 * and byte offset in it. Unused for the root directory.
+	 */
+	__u32 dir_clus;
+	__u32 dirent_off;
+	/* Byte offset of the first long name entry (== dirent_off if none) */
+	__u32 lfn_off;
+	/* Copy of the short entry */
+	struct fat_dirent de;
+	int is_root;
+	int deleted;
+	/* The vnode that currently owns the node, see fatfs_inactive() */
+	struct vnode *vp;
+	/* Last cluster looked up, speeds up sequential access */
+	__u32 hint_lclus;
+	__u32 hint_pclus;
+};
+
+#define FAT_MOUNT(mp)	((struct fat_mount *)(mp)->m_data)
+#define FAT_NODE(vp)	((struct fat_node *)(vp)->v_data)
+
+static inline __u32 fat_node_clus(const struct fat_node *np)
+{
+	return ((__u32)np->de.fst_clus_hi << 16) | np->de.fst_clus_lo;
+}
+
+static inline void fat_node_set_clus(struct fat_node *np, __u32 clus)
+{
+	np->de.fst_clus_hi = (__u16)(clus >> 16);
+	np->de.fst_clus_lo = (__u16)clus;
+	np->hint_lclus = 0;
+	np->hint_pclus = 0;
+}
+
+static inline int fat_node_isdir(const struct fat_node *np)
+{
+	return np->is_root || (np->de.attr & FAT_ATTR_DIRECTORY);
+}
+
+/* Result of a directory scan */
+struct fat_direntry {
+	struct fat_dirent de;
+	/* Byte offsets of the short entry and of the first long entry */
+	__u32 off;
+	__u32 lfn_off;
+	/* Name (long name if there is a valid one), NUL-terminated UTF-8 */
+	char name[FAT_LFN_MAX * 3 + 1];
+	/* Short name in 8.3 notation */
+	char sname[13];
+};
+
+/*
+ * fatfs_subr.c
+ * Functions return 0 or a positive errno, like the vnode operations, and
+ * must be called with fm->lock held.
+ */
+int fat_get(struct fat_mount *fm, __u32 clus, __u32 *val);
+int fat_set(struct fat_mount *fm, __u32 clus, __u32 val);
+int fat_alloc_clus(struct fat_mount *fm, __u32 prev, int zero, __u32 *clus);
+int fat_free_chain(struct fat_mount *fm, __u32 clus);
+int fat_bmap(struct fat_mount *fm, struct fat_node *np, __u32 lclus,
+	     int alloc, __u32 *pclus);
+int fat_node_rw(struct fat_mount *fm, struct fat_node *np, __u32 off,
+		void *buf, struct uio *uio, __u32 len, int write);
+int fat_node_rw_direct(struct fat_mount *fm, struct fat_node *np,
+		       struct uio *uio, __u32 len, int write);
+int fat_node_resize(struct fat_mount *fm, struct fat_node *np, __u32 size);
+
+int fat_dirent_map(struct fat_mount *fm, __u32 dir_clus, __u32 off,
+		   struct uk_bbuf **b, struct fat_dirent **de);
+int fat_dir_next(struct fat_mount *fm, struct fat_node *dnp, __u32 *off,
+		 struct fat_direntry *ent);
+int fat_dir_lookup(struct fat_mount *fm, struct fat_node *dnp,
+		   const char *name, struct fat_direntry *ent);
+int fat_dir_add(struct fat_mount *fm, struct fat_node *dnp, const char *name,
+		struct fat_dirent *de, __u32 *off, __u32 *lfn_off);
+int fat_dir_del(struct fat_mount *fm, struct fat_node *dnp, __u32 lfn_off,
+		__u32 off);
+int fat_dir_empty(struct fat_mount *fm, struct fat_node *dnp);
+int fat_node_sync(struct fat_mount *fm, struct fat_node *np);
+int fat_fsinfo_sync(struct fat_mount *fm);
+
+struct fat_node *fat_node_get(struct fat_mount *fm, __u32 dir_clus,
+			      __u32 off);
+struct fat_node *fat_node_new(struct fat_mount *fm, __u32 dir_clus,
+			      const struct fat_direntry *ent);
+void fat_node_free(struct fat_mount *fm, struct fat_node *np);
+
+void fat_time_to_timespec(__u16 date, __u16 time, struct timespec *ts);
+void fat_timespec_to_time(const struct timespec *ts, __u16 *date,
+			  __u16 *time);
+void fat_touch(struct fat_dirent *de, int create);
+
+#endif /* __FATFS_H__ */
@@ -0,0 +1,1120 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <uk/assert.h>
+#include <uk/errptr.h>
+#include <uk/print.h>
+#include <vfscore/uio.h>
+
+#include "fatfs.h"
+
+/*
+ * Sector access
+ */
+
+static inline int fat_sec_get(struct fat_mount *fm, __u32 sec, int flags,
+			      struct uk_bbuf **b)
+{
+	*b = uk_bcache_get(fm->bc, sec, flags);
+	if (unlikely(PTRISERR(*b)))
+		return -PTR2ERR(*b);
+	return 0;
+}
+
+static inline __u32 fat_clus_sec(struct fat_mount *fm, __u32 clus)
+{
+	return fm->data_start + (clus - 2) * fm->sec_per_clus;
+}
+
+static inline int fat_clus_valid(struct fat_mount *fm, __u32 clus)
+{
+	return clus >= 2 && clus < fm->nclusters + 2;
+}
+
+/*
+ * File allocation table
+ */
+
+int fat_get(struct fat_mount *fm, __u32 clus, __u32 *val)
+{
+	struct uk_bbuf *b;
+	__u32 off;
+	int rc;
+
+	if (unlikely(!fat_clus_valid(fm, clus)))
+		return EIO;
+
+	off = clus * 4;
+	rc = fat_sec_get(fm, fm->fat_start + off / fm->bytes_per_sec, 0, &b);
+	if (unlikely(rc))
+		return rc;
+	*val = *(__u32 *)((char *)b->data + off % fm->bytes_per_sec)
+		& FAT_CLUS_MASK;
+	uk_bcache_put(fm->bc, b);
+	return 0;
+}
+
+int fat_set(struct fat_mount *fm, __u32 clus, __u32 val)
+{
+	struct uk_bbuf *b;
+	__u32 off, i;
+	__u32 *ent;
+	int rc;
+
+	UK_ASSERT(!fm->rdonly);
+
+	if (unlikely(!fat_clus_valid(fm, clus)))
+		return EIO;
+
+	/* Keep all copies of the FAT in sync */
+	off = clus * 4;
+	for (i = 0; i < fm->num_fats; i++) {
+		rc = fat_sec_get(fm, fm->fat_start + i * fm->fat_sectors +
+				 off / fm->bytes_per_sec, 0, &b);
+		if (unlikely(rc))
+			return rc;
+		ent = (__u32 *)((char *)b->data + off % fm->bytes_per_sec);
+		/* The upper four bits are reserved and must be preserved */
+		*ent = (*ent & ~FAT_CLUS_MASK) | (val & FAT_CLUS_MASK);
+		uk_bcache_dirty(fm->bc, b);
+		uk_bcache_put(fm->bc, b);
+	}
+	return 0;
+}
+
+static int fat_zero_clus(struct fat_mount *fm, __u32 clus)
+{
+	struct uk_bbuf *b;
+	__u32 i;
+	int rc;
+
+	for (i = 0; i < fm->sec_per_clus; i++) {
+		rc = fat_sec_get(fm, fat_clus_sec(fm, clus) + i,
+				 UK_BCACHE_NOREAD, &b);
+		if (unlikely(rc))
+			return rc;
+		memset(b->data, 0, fm->bytes_per_sec);
+		uk_bcache_dirty(fm->bc, b);
+		uk_bcache_put(fm->bc, b);
+	}
+	return 0;
+}
+
+/*
+ * Allocates a free cluster, marks it as end of chain, and appends it to the
+ * chain ending at @prev (if not 0). Directory clusters must be zeroed.
+ */
+int fat_alloc_clus(struct fat_mount *fm, __u32 prev, int zero, __u32 *clus)
+{
+	__u32 per_sec = fm->bytes_per_sec / 4;
+	__u32 end = fm->nclusters + 2;
+	__u32 c, left, *ent;
+	struct uk_bbuf *b;
+	int found = 0;
+	int rc;
+
+	if (fm->free_count == 0)
+		return ENOSPC;
+
+	c = fm->next_free;
+	if (!fat_clus_valid(fm, c))
+		c = 2;
+
+	/* Scan the FAT one sector at a time, starting at the hint */
+	for (left = fm->nclusters; left > 0 && !found; ) {
+		rc = fat_sec_get(fm, fm->fat_start + c / per_sec, 0, &b);
+		if (unlikely(rc))
+			return rc;
+		ent = b->data;
+		do {
+			if (!(ent[c % per_sec] & FAT_CLUS_MASK)) {
+				found = 1;
+				break;
+			}
+			left--;
+			if (++c == end)
+				c = 2;
+		} while (left > 0 && c % per_sec != 0 && c != 2);
+		uk_bcache_put(fm->bc, b);
+	}
+	if (!found) {
+		fm->free_count = 0;
+		return ENOSPC;
+	}
+
+	rc = fat_set(fm, c, FAT_CLUS_EOC);
+	if (unlikely(rc))
+		return rc;
+	if (prev) {
+		rc = fat_set(fm, prev, c);
+		if (unlikely(rc)) {
+			fat_set(fm, c, FAT_CLUS_FREE);
+			return rc;
+		}
+	}
+
+	if (fm->free_count != FAT_FSI_UNKNOWN)
+		fm->free_count--;
+	fm->next_free = c + 1;
+	fm->fsinfo_dirty = 1;
+
+	if (zero) {
+		rc = fat_zero_clus(fm, c);
+		if (unlikely(rc))
+			return rc;
+	}
+	*clus = c;
+	return 0;
+}
+
+int fat_free_chain(struct fat_mount *fm, __u32 clus)
+{
+	__u32 next;
+	int rc;
+
+	while (fat_clus_valid(fm, clus)) {
+		rc = fat_get(fm, clus, &next);
+		if (unlikely(rc))
+			return rc;
+		rc = fat_set(fm, clus, FAT_CLUS_FREE);
+		if (unlikely(rc))
+			return rc;
+
+		if (fm->free_count != FAT_FSI_UNKNOWN)
+			fm->free_count++;
+		if (clus < fm->next_free)
+			fm->next_free = clus;
+		fm->fsinfo_dirty = 1;
+
+		if (FAT_CLUS_IS_EOC(next))
+			break;
+		clus = next;
+	}
+	return 0;
+}
+
+/*
+ * Follows a cluster chain from cluster @clus, which is the @lclus-th cluster
+ * of the chain, to the @target-th cluster.
+ */
+static int fat_chain_seek(struct fat_mount *fm, __u32 clus, __u32 lclus,
+			  __u32 target, int alloc, int zero, __u32 *pclus)
+{
+	__u32 next;
+	int rc;
+
+	while (lclus < target) {
+		rc = fat_get(fm, clus, &next);
+		if (unlikely(rc))
+			return rc;
+		if (FAT_CLUS_IS_EOC(next)) {
+			if (!alloc)
+				return ENOENT;
+			rc = fat_alloc_clus(fm, clus, zero, &next);
+			if (unlikely(rc))
+				return rc;
+		} else if (unlikely(!fat_clus_valid(fm, next))) {
+			uk_pr_err("Corrupted cluster chain at %"__PRIu32"\n",
+				  clus);
+			return EIO;
+		}
+		clus = next;
+		lclus++;
+	}
+	*pclus = clus;
+	return 0;
+}
+
+/*
+ * Maps the logical cluster @lclus of a node to a cluster on the volume. If
+ * @alloc is set, missing clusters are allocated, otherwise ENOENT is
+ * returned for clusters beyond the end of the chain.
+ */
+int fat_bmap(struct fat_mount *fm, struct fat_node *np, __u32 lclus,
+	     int alloc, __u32 *pclus)
+{
+	__u32 clus, l = 0;
+	int rc;
+
+	clus = fat_node_clus(np);
+	if (clus == 0) {
+		if (!alloc)
+			return ENOENT;
+		rc = fat_alloc_clus(fm, 0, fat_node_isdir(np), &clus);
+		if (unlikely(rc))
+			return rc;
+		fat_node_set_clus(np, clus);
+	}
+
+	if (np->hint_pclus && np->hint_lclus <= lclus) {
+		clus = np->hint_pclus;
+		l = np->hint_lclus;
+	}
+
+	rc = fat_chain_seek(fm, clus, l, lclus, alloc, fat_node_isdir(np),
+			    &clus);
+	if (unlikely(rc))
+		return rc;
+
+	np->hint_lclus = lclus;
+	np->hint_pclus = clus;
+	*pclus = clus;
+	return 0;
+}
+
+/*
+ * Transfers @len bytes at offset @off of a node from or to @uio, or @buf if
+ * @uio is NULL. Writing with neither @uio nor @buf writes zeros. Clusters
+ * are allocated as needed by writes; the size of the node is not changed.
+ */
+int fat_node_rw(struct fat_mount *fm, struct fat_node *np, __u32 off,
+		void *buf, struct uio *uio, __u32 len, int write)
+{
+	__u32 clus, soff, n;
+	struct uk_bbuf *b;
+	char *p;
+	int rc;
+
+	while (len > 0) {
+		rc = fat_bmap(fm, np, off / fm->clus_size, write, &clus);
+		if (unlikely(rc))
+			return rc;
+
+		soff = off % fm->bytes_per_sec;
+		n = MIN(len, fm->bytes_per_sec - soff);
+		rc = fat_sec_get(fm, fat_clus_sec(fm, clus) +
+				 (off % fm->clus_size) / fm->bytes_per_sec,
+				 (write && n == fm->bytes_per_sec)
+				 ? UK_BCACHE_NOREAD : 0, &b);
+		if (unlikely(rc))
+			return rc;
+
+		p = (char *)b->data + soff;
+		if (uio) {
+			rc = vfscore_uiomove(p, n, uio);
+		} else if (buf) {
+			if (write)
+				memcpy(p, buf, n);
+			else
+				memcpy(buf, p, n);
+			buf = (char *)buf + n;
+		} else {
+			UK_ASSERT(write);
+			memset(p, 0, n);
+		}
+		if (write)
+			uk_bcache_dirty(fm->bc, b);
+		uk_bcache_put(fm->bc, b);
+		if (unlikely(rc))
+			return rc;
+
+		off += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/*
+ * Transfers up to @len bytes at the offset of @uio directly between the
+ * device and the buffers of @uio, bypassing the block cache. Runs of
+ * contiguous clusters are transferred with one request. Stops early at a
+ * buffer that does not cover whole sectors or is not aligned for the device,
+ * and at the last partial sector; the caller transfers the rest through the
+ * cache.
+ */
+int fat_node_rw_direct(struct fat_mount *fm, struct fat_node *np,
+		       struct uio *uio, __u32 len, int write)
+{
+	__sz ioalign = uk_blkdev_ioalign(fm->dev);
+	__u32 off = uio->uio_offset;
+	__u32 clus, last, next, lclus, n, want;
+	struct iovec *iov;
+	int rc;
+
+	if (off % fm->bytes_per_sec)
+		return 0;
+
+	while (len >= fm->bytes_per_sec && uio->uio_resid > 0) {
+		iov = uio->uio_iov;
+		if (!iov->iov_len) {
+			uio->uio_iov++;
+			uio->uio_iovcnt--;
+			continue;
+		}
+		if ((__uptr)iov->iov_base % ioalign ||
+		    iov->iov_len < fm->bytes_per_sec)
+			break;
+
+		want = MIN(len, iov->iov_len);
+		want -= want % fm->bytes_per_sec;
+
+		lclus = off / fm->clus_size;
+		rc = fat_bmap(fm, np, lclus, write, &clus);
+		if (unlikely(rc))
+			return rc;
+		n = fm->clus_size - off % fm->clus_size;
+		for (last = clus; n < want; last = next, n += fm->clus_size) {
+			rc = fat_bmap(fm, np, ++lclus, write, &next);
+			if (rc == ENOENT)
+				break;
+			if (unlikely(rc))
+				return rc;
+			if (next != last + 1)
+				break;
+		}
+		n = MIN(n, want);
+
+		rc = uk_bcache_direct(fm->bc, fat_clus_sec(fm, clus) +
+				      (off % fm->clus_size) /
+				      fm->bytes_per_sec,
+				      n / fm->bytes_per_sec, iov->iov_base,
+				      write);
+		if (rc == -EBUSY)
+			break;
+		if (unlikely(rc))
+			return (rc == -EINVAL) ? EIO : -rc;
+
+		iov->iov_base = (char *)iov->iov_base + n;
+		iov->iov_len -= n;
+		uio->uio_resid -= n;
+		uio->uio_offset += n;
+		off += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/*
+ * Changes the size of a regular file. Clusters beyond the new size are
+ * released, growing fills the new range with zeros.
+ */
+int fat_node_resize(struct fat_mount *fm, struct fat_node *np, __u32 size)
+{
+	__u32 nclus, last, next;
+	int rc;
+
+	UK_ASSERT(!fat_node_isdir(np));
+
+	if (size > np->de.file_size) {
+		rc = fat_node_rw(fm, np, np->de.file_size, NULL, NULL,
+				 size - np->de.file_size, 1);
+		if (unlikely(rc))
+			return rc;
+	} else if (size < np->de.file_size && fat_node_clus(np)) {
+		nclus = DIV_ROUND_UP(size, fm->clus_size);
+		if (nclus == 0) {
+			rc = fat_free_chain(fm, fat_node_clus(np));
+			if (unlikely(rc))
+				return rc;
+			fat_node_set_clus(np, 0);
+		} else {
+			rc = fat_bmap(fm, np, nclus - 1, 0, &last);
+			if (unlikely(rc))
+				return rc;
+			rc = fat_get(fm, last, &next);
+			if (unlikely(rc))
+				return rc;
+			if (!FAT_CLUS_IS_EOC(next)) {
+				rc = fat_set(fm, last, FAT_CLUS_EOC);
+				if (unlikely(rc))
+					return rc;
+				rc = fat_free_chain(fm, next);
+				if (unlikely(rc))
+					return rc;
+			}
+		}
+	}
+	np->de.file_size = size;
+	return 0;
+}
+
+/*
+ * Directory entries
+ */
+
+static int fat_dir_map(struct fat_mount *fm, struct fat_node *dnp, __u32 off,
+		       int alloc, struct uk_bbuf **b, struct fat_dirent **de)
+{
+	__u32 clus;
+	int rc;
+
+	rc = fat_bmap(fm, dnp, off / fm->clus_size, alloc, &clus);
+	if (unlikely(rc))
+		return rc;
+	rc = fat_sec_get(fm, fat_clus_sec(fm, clus) +
+			 (off % fm->clus_size) / fm->bytes_per_sec, 0, b);
+	if (unlikely(rc))
+		return rc;
+	*de = (struct fat_dirent *)((char *)(*b)->data +
+				    off % fm->bytes_per_sec);
+	return 0;
+}
+
+/*
+ * Maps the entry at @off in the directory starting at cluster @dir_clus
+ * without a node for the directory.
+ */
+int fat_dirent_map(struct fat_mount *fm, __u32 dir_clus, __u32 off,
+		   struct uk_bbuf **b, struct fat_dirent **de)
+{
+	__u32 clus;
+	int rc;
+
+	rc = fat_chain_seek(fm, dir_clus, 0, off / fm->clus_size, 0, 0, &clus);
+	if (unlikely(rc))
+		return rc;
+	rc = fat_sec_get(fm, fat_clus_sec(fm, clus) +
+			 (off % fm->clus_size) / fm->bytes_per_sec, 0, b);
+	if (unlikely(rc))
+		return rc;
+	*de = (struct fat_dirent *)((char *)(*b)->data +
+				    off % fm->bytes_per_sec);
+	return 0;
+}
+
+static __u8 fat_chksum(const __u8 *name)
+{
+	__u8 sum = 0;
+	int i;
+
+	for (i = 0; i < 11; i++)
+		sum = ((sum & 1) << 7) + (sum >> 1) + name[i];
+	return sum;
+}
+
+static inline int fat_tolower(int c)
+{
+	return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static inline int fat_toupper(int c)
+{
+	return (c >= 'a' && c <= 'z') ? c - ('a' - 'A') : c;
+}
+
+/* Case-insensitive comparison, only ASCII letters are folded */
+static int fat_namecmp(const char *a, const char *b)
+{
+	while (*a && fat_tolower(*a) == fat_tolower(*b)) {
+		a++;
+		b++;
+	}
+	return fat_tolower(*a) - fat_tolower(*b);
+}
+
+static void fat_sname_format(const struct fat_dirent *de, char *buf)
+{
+	int i, n = 0;
+
+	for (i = 0; i < 8 && de->name[i] != ' '; i++) {
+		buf[n] = (i == 0 && de->name[0] == 0x05) ? (char)0xe5
+			 : (char)de->name[i];
+		if (de->ntres & FAT_NTRES_LOWER_BASE)
+			buf[n] = fat_tolower(buf[n]);
+		n++;
+	}
+	if (de->name[8] != ' ') {
+		buf[n++] = '.';
+		for (i = 8; i < 11 && de->name[i] != ' '; i++) {
+			buf[n] = de->name[i];
+			if (de->ntres & FAT_NTRES_LOWER_EXT)
+				buf[n] = fat_tolower(buf[n]);
+			n++;
+		}
+	}
+	buf[n] = '\0';
+}
+
+/* Converts a UCS-2 string to UTF-8. @buf must hold 3 bytes per character. */
+static void fat_ucs2_to_utf8(const __u16 *s, int len, char *buf)
+{
+	int i;
+
+	for (i = 0; i < len && s[i]; i++) {
+		if (s[i] < 0x80) {
+			*buf++ = s[i];
+		} else if (s[i] < 0x800) {
+			*buf++ = 0xc0 | (s[i] >> 6);
+			*buf++ = 0x80 | (s[i] & 0x3f);
+		} else {
+			*buf++ = 0xe0 | (s[i] >> 12);
+			*buf++ = 0x80 | ((s[i] >> 6) & 0x3f);
+			*buf++ = 0x80 | (s[i] & 0x3f);
+		}
+	}
+	*buf = '\0';
+}
+
+/*
+ * Converts a UTF-8 name to UCS-2. Only characters of the basic multilingual
+ * plane can be stored in long names.
+ */
+static int fat_utf8_to_ucs2(const char *name, __u16 *s, int *len)
+{
+	const unsigned char *p = (const unsigned char *)name;
+	__u32 c;
+	int n = 0;
+
+	while (*p) {
+		if (n == FAT_LFN_MAX)
+			return ENAMETOOLONG;
+		if (p[0] < 0x80) {
+			c = *p++;
+		} else if ((p[0] & 0xe0) == 0xc0 && (p[1] & 0xc0) == 0x80) {
+			c = ((p[0] & 0x1f) << 6) | (p[1] & 0x3f);
+			p += 2;
+		} else if ((p[0] & 0xf0) == 0xe0 && (p[1] & 0xc0) == 0x80 &&
+			   (p[2] & 0xc0) == 0x80) {
+			c = ((p[0] & 0x0f) << 12) | ((p[1] & 0x3f) << 6) |
+			    (p[2] & 0x3f);
+			p += 3;
+		} else {
+			return EINVAL;
+		}
+		if (c < 0x20 || (c < 0x80 && strchr("\"*/:<>?\\|", (int)c)))
+			return EINVAL;
+		s[n++] = (__u16)c;
+	}
+	*len = n;
+	return 0;
+}
+
+/*
+ * Returns the next used entry at or after @off and advances @off past it.
+ * Long name entries are merged into the returned entry. Returns ENOENT at
+ * the end of the directory.
+ */
+int fat_dir_next(struct fat_mount *fm, struct fat_node *dnp, __u32 *off,
+		 struct fat_direntry *ent)
+{
+	__u16 lname[FAT_LFN_MAX + FAT_LFN_CHARS];
+	struct fat_dirent *dp, de;
+	struct fat_lfn lfn;
+	struct uk_bbuf *b;
+	__u32 cur, lfn_start = 0;
+	int ord = 0, nslots = 0;
+	__u8 sum = 0;
+	int i, base, rc;
+
+	for (;;) {
+		rc = fat_dir_map(fm, dnp, *off, 0, &b, &dp);
+		if (rc)
+			return rc;
+		memcpy(&de, dp, sizeof(de));
+		uk_bcache_put(fm->bc, b);
+
+		if (de.name[0] == FAT_DIRENT_END)
+			return ENOENT;
+		cur = *off;
+		*off += FAT_DIRENT_SIZE;
+
+		if (de.name[0] == FAT_DIRENT_FREE) {
+			ord = 0;
+			continue;
+		}
+
+		if ((de.attr & FAT_ATTR_LONG_NAME_MASK) == FAT_ATTR_LONG_NAME) {
+			memcpy(&lfn, &de, sizeof(lfn));
+			i = lfn.ord & FAT_LFN_ORD_MASK;
+			if (lfn.ord & FAT_LFN_LAST) {
+				if (i == 0 || i * FAT_LFN_CHARS >
+					      FAT_LFN_MAX + FAT_LFN_CHARS - 1) {
+					ord = 0;
+					continue;
+				}
+				nslots = i;
+				sum = lfn.chksum;
+				lfn_start = cur;
+				memset(lname, 0, sizeof(lname));
+			} else if (ord == 0 || i != ord - 1 ||
+				   lfn.chksum != sum) {
+				ord = 0;
+				continue;
+			}
+			ord = i;
+			base = (i - 1) * FAT_LFN_CHARS;
+			for (i = 0; i < 5; i++)
+				lname[base + i] = lfn.name1[i];
+			for (i = 0; i < 6; i++)
+				lname[base + 5 + i] = lfn.name2[i];
+			for (i = 0; i < 2; i++)
+				lname[base + 11 + i] = lfn.name3[i];
+			continue;
+		}
+
+		if (de.attr & FAT_ATTR_VOLUME_ID) {
+			ord = 0;
+			continue;
+		}
+
+		memcpy(&ent->de, &de, sizeof(de));
+		ent->off = cur;
+		fat_sname_format(&de, ent->sname);
+		if (ord == 1 && sum == fat_chksum(de.name)) {
+			fat_ucs2_to_utf8(lname,
+					 MIN(nslots * FAT_LFN_CHARS,
+					     FAT_LFN_MAX), ent->name);
+			ent->lfn_off = lfn_start;
+		} else {
+			strcpy(ent->name, ent->sname);
+			ent->lfn_off = cur;
+		}
+		return 0;
+	}
+}
+
+int fat_dir_lookup(struct fat_mount *fm, struct fat_node *dnp,
+		   const char *name, struct fat_direntry *ent)
+{
+	__u32 off = 0;
+	int rc;
+
+	while ((rc = fat_dir_next(fm, dnp, &off, ent)) == 0) {
+		/* "." and ".." are resolved by vfscore */
+		if (ent->de.name[0] == '.')
+			continue;
+		if (fat_namecmp(name, ent->name) == 0 ||
+		    fat_namecmp(name, ent->sname) == 0)
+			return 0;
+	}
+	return rc;
+}
+
+/* Returns whether there is an entry with the given short name */
+static int fat_dir_has_sname(struct fat_mount *fm, struct fat_node *dnp,
+			     const __u8 *sname, int *found)
+{
+	struct fat_dirent *dp;
+	struct uk_bbuf *b;
+	__u32 off;
+	int rc, end = 0;
+
+	*found = 0;
+	for (off = 0; !end && !*found; off += FAT_DIRENT_SIZE) {
+		rc = fat_dir_map(fm, dnp, off, 0, &b, &dp);
+		if (rc == ENOENT)
+			break;
+		if (unlikely(rc))
+			return rc;
+		end = (dp->name[0] == FAT_DIRENT_END);
+		if (!end && dp->name[0] != FAT_DIRENT_FREE &&
+		    (dp->attr & FAT_ATTR_LONG_NAME_MASK) !=
+		    FAT_ATTR_LONG_NAME && memcmp(dp->name, sname, 11) == 0)
+			*found = 1;
+		uk_bcache_put(fm->bc, b);
+	}
+	return 0;
+}
+
+/* Characters that are valid in short names, restricted to ASCII */
+static inline int fat_sname_char(char c)
+{
+	return (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+	       (c >= 'a' && c <= 'z') ||
+	       (c > 0 && strchr("!#$%&'()-@^_`{}~", c));
+}
+
+/*
+ * Stores @name in @de if it is a valid short name, possibly in all
+ * lower-case base name and/or extension. Returns 0 if a long name is needed.
+ */
+static int fat_sname_fit(const char *name, struct fat_dirent *de)
+{
+	int lower = 0, upper = 0, n = 0, i, ext = 0;
+	const char *dot = strrchr(name, '.');
+	const char *p;
+
+	memset(de->name, ' ', 11);
+	de->ntres = 0;
+
+	if (dot == name || (dot && (dot - name > 8 || strlen(dot + 1) > 3 ||
+				    dot[1] == '\0')))
+		return 0;
+	if (!dot && strlen(name) > 8)
+		return 0;
+
+	for (p = name, i = 0; *p; p++) {
+		if (p == dot) {
+			if (lower)
+				de->ntres |= FAT_NTRES_LOWER_BASE;
+			if (lower && upper)
+				return 0;
+			lower = upper = 0;
+			ext = 1;
+			i = 8;
+			continue;
+		}
+		if (!fat_sname_char(*p))
+			return 0;
+		lower |= (*p >= 'a' && *p <= 'z');
+		upper |= (*p >= 'A' && *p <= 'Z');
+		de->name[i++] = fat_toupper(*p);
+		n++;
+	}
+	if (lower && upper)
+		return 0;
+	if (lower)
+		de->ntres |= ext ? FAT_NTRES_LOWER_EXT : FAT_NTRES_LOWER_BASE;
+	return n > 0;
+}
+
+/* Generates a unique short alias ("BASIS~N.EXT") for a long name */
+static int fat_sname_alias(struct fat_mount *fm, struct fat_node *dnp,
+			   const char *name, struct fat_dirent *de)
+{
+	const char *dot = strrchr(name, '.');
+	__u8 basis[8], ext[3];
+	int blen = 0, elen = 0;
+	char num[8];
+	int i, nlen, found, rc;
+	__u32 seq;
+	const char *p;
+
+	if (dot == name)
+		dot = NULL;
+	memset(ext, ' ', sizeof(ext));
+	for (p = name; *p && (!dot || p < dot) && blen < 6; p++) {
+		if (*p == ' ' || *p == '.')
+			continue;
+		basis[blen++] = fat_sname_char(*p) ? fat_toupper(*p) : '_';
+	}
+	if (blen == 0)
+		basis[blen++] = '_';
+	if (dot) {
+		for (p = dot + 1; *p && elen < 3; p++) {
+			if (*p == ' ')
+				continue;
+			ext[elen++] = fat_sname_char(*p) ? fat_toupper(*p)
+							 : '_';
+		}
+	}
+
+	de->ntres = 0;
+	for (seq = 1; seq < 1000000; seq++) {
+		nlen = snprintf(num, sizeof(num), "~%"__PRIu32, seq);
+		memset(de->name, ' ', 11);
+		i = MIN(blen, 8 - nlen);
+		memcpy(de->name, basis, i);
+		memcpy(de->name + i, num, nlen);
+		memcpy(de->name + 8, ext, 3);
+
+		rc = fat_dir_has_sname(fm, dnp, de->name, &found);
+		if (unlikely(rc))
+			return rc;
+		if (!found)
+			return 0;
+	}
+	return EEXIST;
+}
+
+/*
+ * Adds an entry for @name to a directory. The short name and the case flags
+ * of @de are filled in, all other fields are stored as given.
+ */
+int fat_dir_add(struct fat_mount *fm, struct fat_node *dnp, const char *name,
+		struct fat_dirent *de, __u32 *off, __u32 *lfn_off)
+{
+	__u16 lname[FAT_LFN_MAX];
+	struct fat_dirent *dp;
+	struct fat_lfn lfn;
+	struct uk_bbuf *b;
+	__u32 pos, start = 0;
+	int nslots, nfree = 0;
+	int len, i, j, k, rc;
+	__u16 c;
+	__u8 sum;
+
+	rc = fat_utf8_to_ucs2(name, lname, &len);
+	if (unlikely(rc))
+		return rc;
+	if (len == 0)
+		return ENOENT;
+
+	if (fat_sname_fit(name, de)) {
+		nslots = 1;
+	} else {
+		rc = fat_sname_alias(fm, dnp, name, de);
+		if (unlikely(rc))
+			return rc;
+		nslots = DIV_ROUND_UP(len, FAT_LFN_CHARS) + 1;
+	}
+
+	/* Find enough consecutive free entries, extending the directory */
+	for (pos = 0; nfree < nslots; pos += FAT_DIRENT_SIZE) {
+		/* FAT directories are limited to 65536 entries */
+		if (pos >= 65536 * FAT_DIRENT_SIZE)
+			return ENOSPC;
+		rc = fat_dir_map(fm, dnp, pos, 1, &b, &dp);
+		if (unlikely(rc))
+			return rc;
+		if (dp->name[0] == FAT_DIRENT_END ||
+		    dp->name[0] == FAT_DIRENT_FREE) {
+			if (nfree++ == 0)
+				start = pos;
+		} else {
+			nfree = 0;
+		}
+		uk_bcache_put(fm->bc, b);
+	}
+
+	/* Long name entries are stored in reverse order before the short
+	 * entry. Characters after the terminating NUL are padded with 0xffff.
+	 */
+	sum = fat_chksum(de->name);
+	pos = start;
+	for (i = nslots - 1; i > 0; i--) {
+		memset(&lfn, 0, sizeof(lfn));
+		lfn.ord = i | ((i == nslots - 1) ? FAT_LFN_LAST : 0);
+		lfn.attr = FAT_ATTR_LONG_NAME;
+		lfn.chksum = sum;
+		for (j = 0; j < FAT_LFN_CHARS; j++) {
+			k = (i - 1) * FAT_LFN_CHARS + j;
+			c = (k < len) ? lname[k] : (k == len) ? 0 : 0xffff;
+			if (j < 5)
+				lfn.name1[j] = c;
+			else if (j < 11)
+				lfn.name2[j - 5] = c;
+			else
+				lfn.name3[j - 11] = c;
+		}
+
+		rc = fat_dir_map(fm, dnp, pos, 0, &b, &dp);
+		if (unlikely(rc))
+			return rc;
+		memcpy(dp, &lfn, sizeof(lfn));
+		uk_bcache_dirty(fm->bc, b);
+		uk_bcache_put(fm->bc, b);
+		pos += FAT_DIRENT_SIZE;
+	}
+
+	rc = fat_dir_map(fm, dnp, pos, 0, &b, &dp);
+	if (unlikely(rc))
+		return rc;
+	memcpy(dp, de, sizeof(*de));
+	uk_bcache_dirty(fm->bc, b);
+	uk_bcache_put(fm->bc, b);
+
+	*lfn_off = start;
+	*off = pos;
+	return 0;
+}
+
+/* Marks the entries from @lfn_off up to the short entry at @off as free */
+int fat_dir_del(struct fat_mount *fm, struct fat_node *dnp, __u32 lfn_off,
+		__u32 off)
+{
+	struct fat_dirent *dp;
+	struct uk_bbuf *b;
+	int rc;
+
+	for (; lfn_off <= off; lfn_off += FAT_DIRENT_SIZE) {
+		rc = fat_dir_map(fm, dnp, lfn_off, 0, &b, &dp);
+		if (unlikely(rc))
+			return rc;
+		dp->name[0] = FAT_DIRENT_FREE;
+		uk_bcache_dirty(fm->bc, b);
+		uk_bcache_put(fm->bc, b);
+	}
+	return 0;
+}
+
+/* Returns 0 if a directory has no entries besides "." and "..", ENOTEMPTY
+ * otherwise.
+ */
+int fat_dir_empty(struct fat_mount *fm, struct fat_node *dnp)
+{
+	struct fat_direntry *ent;
+	__u32 off = 0;
+	int rc;
+
+	ent = malloc(sizeof(*ent));
+	if (unlikely(!ent))
+		return ENOMEM;
+
+	while ((rc = fat_dir_next(fm, dnp, &off, ent)) == 0) {
+		if (strcmp(ent->sname, ".") && strcmp(ent->sname, "..")) {
+			rc = ENOTEMPTY;
+			break;
+		}
+	}
+	free(ent);
+	return (rc == ENOENT) ? 0 : rc;
+}
+
+/* Writes the cached copy of the short entry of a node back */
+int fat_node_sync(struct fat_mount *fm, struct fat_node *np)
+{
+	struct fat_dirent *dp;
+	struct uk_bbuf *b;
+	int rc;
+
+	if (np->is_root || np->deleted)
+		return 0;
+
+	rc = fat_dirent_map(fm, np->dir_clus, np->dirent_off, &b, &dp);
+	if (unlikely(rc))
+		return rc;
+	memcpy(dp, &np->de, sizeof(*dp));
+	uk_bcache_dirty(fm->bc, b);
+	uk_bcache_put(fm->bc, b);
+	return 0;
+}
+
+int fat_fsinfo_sync(struct fat_mount *fm)
+{
+	struct fat_fsinfo *fsi;
+	struct uk_bbuf *b;
+	int rc;
+
+	if (!fm->fsinfo_sec || !fm->fsinfo_dirty)
+		return 0;
+
+	rc = fat_sec_get(fm, fm->fsinfo_sec, 0, &b);
+	if (unlikely(rc))
+		return rc;
+	fsi = b->data;
+	fsi->free_count = fm->free_count;
+	fsi->nxt_free = fm->next_free;
+	uk_bcache_dirty(fm->bc, b);
+	uk_bcache_put(fm->bc, b);
+	fm->fsinfo_dirty = 0;
+	return 0;
+}
+
+/*
+ * Nodes
+ */
+
+struct fat_node *fat_node_get(struct fat_mount *fm, __u32 dir_clus,
+			      __u32 off)
+{
+	struct fat_node *np;
+
+	uk_list_for_each_entry(np, &fm->nodes, link) {
+		if (np->dir_clus == dir_clus && np->dirent_off == off)
+			return np;
+	}
+	return NULL;
+}
+
+struct fat_node *fat_node_new(struct fat_mount *fm, __u32 dir_clus,
+			      const struct fat_direntry *ent)
+{
+	struct fat_node *np;
+
+	np = calloc(1, sizeof(*np));
+	if (unlikely(!np))
+		return NULL;
+
+	np->ino = ++fm->next_ino;
+	np->dir_clus = dir_clus;
+	np->dirent_off = ent->off;
+	np->lfn_off = ent->lfn_off;
+	memcpy(&np->de, &ent->de, sizeof(np->de));
+	uk_list_add(&np->link, &fm->nodes);
+	return np;
+}
+
+void fat_node_free(struct fat_mount *fm __unused, struct fat_node *np)
+{
+	uk_list_del_init(&np->link);
+	free(np);
+}
+
+/*
+ * Time stamps. FAT stores local time; we treat it as UTC.
+ */
+
+#define FAT_EPOCH	315532800 /* 1980-01-01T00:00:00Z */
+
+static long fat_days_from_civil(int y, unsigned int m, unsigned int d)
+{
+	unsigned int yoe, doy, doe;
+	int era;
+
+	y -= m <= 2;
+	era = y / 400;
+	yoe = (unsigned int)(y - era * 400);
+	doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return (long)era * 146097 + (long)doe - 719468;
+}
+
+static void fat_civil_from_days(long z, int *y, unsigned int *m,
+				unsigned int *d)
+{
+	unsigned int doe, yoe, doy, mp;
+	long era;
+
+	z += 719468;
+	era = z / 146097;
+	doe = (unsigned int)(z - era * 146097);
+	yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	mp = (5 * doy + 2) / 153;
+	*d = doy - (153 * mp + 2) / 5 + 1;
+	*m = mp < 10 ? mp + 3 : mp - 9;
+	*y = (int)(yoe + era * 400) + (*m <= 2);
+}
+
+void fat_time_to_timespec(__u16 date, __u16 time, struct timespec *ts)
+{
+	unsigned int m, d;
+
+	ts->tv_nsec = 0;
+	if (date == 0) {
+		ts->tv_sec = FAT_EPOCH;
+		return;
+	}
+
+	m = MIN(MAX((date >> 5) & 0xf, 1), 12);
+	d = MAX(date & 0x1f, 1);
+	ts->tv_sec = fat_days_from_civil(1980 + (date >> 9), m, d) * 86400 +
+		     (time >> 11) * 3600 + ((time >> 5) & 0x3f) * 60 +
+		     (time & 0x1f) * 2;
+}
+
+void fat_timespec_to_time(const struct timespec *ts, __u16 *date,
+			  __u16 *time)
+{
+	time_t sec = MAX(ts->tv_sec, (time_t)FAT_EPOCH);
+	unsigned int m, d, rem;
+	int y;
+
+	fat_civil_from_days(sec / 86400, &y, &m, &d);
+	if (y > 1980 + 127) {
+		*date = (127 << 9) | (12 << 5) | 31;
+		*time = (23 << 11) | (59 << 5) | 29;
+		return;
+	}
+	rem = sec % 86400;
+	*date = ((y - 1980) << 9) | (m << 5) | d;
+	*time = ((rem / 3600) << 11) | (((rem / 60) % 60) << 5) |
+		((rem % 60) / 2);
+}
+
+void fat_touch(struct fat_dirent *de, int create)
+{
+	struct timespec now;
+	__u16 date, time;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	fat_timespec_to_time(&now, &date, &time);
+	de->wrt_date = date;
+	de->wrt_time = time;
+	de->lst_acc_date = date;
+	if (create) {
+		de->crt_date = de->wrt_date;
+		de->crt_time = de->wrt_time;
+		de->crt_time_tenth = (now.tv_sec % 2) * 100 +
+				     now.tv_nsec / 10000000;
+	}
+}
@@ -0,0 +1,404 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/statfs.h>
+#include <uk/alloc.h>
+#include <uk/blkdev.h>
+#include <uk/errptr.h>
+#include <uk/print.h>
+#if CONFIG_LIBUKBLKDEV_DISPATCHERTHREADS
+#include <uk/sched.h>
+#endif
+#include <vfscore/dentry.h>
+#include <vfscore/mount.h>
+#include <vfscore/vnode.h>
+
+#include "fatfs.h"
+
+#define FATFS_MAGIC	0x4d44	/* MSDOS_SUPER_MAGIC */
+
+extern struct vnops fatfs_vnops;
+
+static int fatfs_mount(struct mount *mp, const char *dev, int flags,
+		       const void *data);
+static int fatfs_unmount(struct mount *mp, int flags);
+static int fatfs_sync(struct mount *mp);
+static int fatfs_statfs(struct mount *mp, struct statfs *statp);
+
+#define fatfs_vget	((vfsop_vget_t)vfscore_nullop)
+
+struct vfsops fatfs_vfsops = {
+	.vfs_mount	= fatfs_mount,
+	.vfs_unmount	= fatfs_unmount,
+	.vfs_sync	= fatfs_sync,
+	.vfs_vget	= fatfs_vget,
+	.vfs_statfs	= fatfs_statfs,
+	.vfs_vnops	= &fatfs_vnops
+};
+
+static struct vfscore_fs_type fatfs_fs = {
+	.vs_name	= "fatfs",
+	.vs_init	= NULL,
+	.vs_op		= &fatfs_vfsops
+};
+
+UK_FS_REGISTER(fatfs_fs);
+
+/*
+ * Resolves the device of a mount: "blkdev<N>" or "<N>", optionally with a
+ * "/dev/" prefix, selects the Unikraft block device with ID N.
+ */
+static struct uk_blkdev *fatfs_blkdev_lookup(const char *dev)
+{
+	unsigned long id;
+	char *end;
+
+	if (!dev)
+		return NULL;
+	if (strncmp(dev, "/dev/", 5) == 0)
+		dev += 5;
+	if (strncmp(dev, "blkdev", 6) == 0)
+		dev += 6;
+	if (*dev == '\0')
+		return NULL;
+
+	id = strtoul(dev, &end, 10);
+	if (*end != '\0')
+		return NULL;
+	return uk_blkdev_get(id);
+}
+
+/*
+ * Brings an unconfigured device up with a single queue whose completions
+ * are processed by the block cache.
+ */
+static int fatfs_blkdev_start(struct uk_blkdev *dev)
+{
+	struct uk_blkdev_queue_info qinfo;
+	struct uk_blkdev_queue_conf qconf;
+	struct uk_blkdev_conf conf;
+	int rc;
+
+	if (uk_blkdev_state_get(dev) == UK_BLKDEV_RUNNING)
+		return 0;
+	if (uk_blkdev_state_get(dev) != UK_BLKDEV_UNCONFIGURED)
+		return EBUSY;
+
+	conf.nb_queues = 1;
+	rc = uk_blkdev_configure(dev, &conf);
+	if (unlikely(rc))
+		return -rc;
+
+	rc = uk_blkdev_queue_get_info(dev, 0, &qinfo);
+	if (unlikely(rc))
+		return -rc;
+
+	memset(&qconf, 0, sizeof(qconf));
+	qconf.a = uk_alloc_get_default();
+	qconf.callback = uk_bcache_queue_event;
+	qconf.callback_cookie = NULL;
+#if CONFIG_LIBUKBLKDEV_DISPATCHERTHREADS
+	qconf.s = uk_sched_current();
+#endif
+	rc = uk_blkdev_queue_configure(dev, 0, qinfo.nb_max, &qconf);
+	if (unlikely(rc))
+		return -rc;
+
+	rc = uk_blkdev_start(dev);
+	if (unlikely(rc))
+		return -rc;
+
+	rc = uk_blkdev_queue_intr_enable(dev, 0);
+	if (unlikely(rc < 0 && rc != -ENOTSUP))
+		return -rc;
+	return 0;
+}
+
+static int fatfs_bcache_create(struct fat_mount *fm, __sz bsize)
+{
+	fm->bc = uk_bcache_create(uk_alloc_get_default(), fm->dev, 0, bsize,
+				  CONFIG_LIBFATFS_CACHE_SIZE * 1024UL);
+	if (unlikely(PTRISERR(fm->bc))) {
+		int rc = -PTR2ERR(fm->bc);
+
+		fm->bc = NULL;
+		return rc;
+	}
+	return 0;
+}
+
+static int fatfs_read_bpb(struct fat_mount *fm)
+{
+	struct fat_bpb bpb;
+	struct uk_bbuf *b;
+	__u32 tot_sec, rsvd, fat_sz;
+	int rc;
+
+	/* The cache starts with the sector size of the device until the
+	 * sector size of the volume is known.
+	 */
+	b = uk_bcache_get(fm->bc, 0, 0);
+	if (unlikely(PTRISERR(b)))
+		return -PTR2ERR(b);
+	memcpy(&bpb, b->data, sizeof(bpb));
+	rc = (((__u8 *)b->data)[510] != 0x55 || ((__u8 *)b->data)[511] != 0xaa);
+	uk_bcache_put(fm->bc, b);
+	if (rc) {
+		uk_pr_err("No boot sector signature\n");
+		return EINVAL;
+	}
+
+	if (bpb.bytes_per_sec < 512 || bpb.bytes_per_sec > 4096 ||
+	    (bpb.bytes_per_sec & (bpb.bytes_per_sec - 1)) ||
+	    bpb.sec_per_clus == 0 ||
+	    (bpb.sec_per_clus & (bpb.sec_per_clus - 1)) ||
+	    bpb.rsvd_sec_cnt == 0 || bpb.num_fats == 0) {
+		uk_pr_err("Invalid BIOS parameter block\n");
+		return EINVAL;
+	}
+	/* Only FAT32 volumes have no fixed root directory and a 32-bit FAT
+	 * size field.
+	 */
+	if (bpb.root_ent_cnt != 0 || bpb.fat_sz16 != 0 || bpb.fat_sz32 == 0) {
+		uk_pr_err("Not a FAT32 volume\n");
+		return EINVAL;
+	}
+	if (bpb.bytes_per_sec % uk_blkdev_ssize(fm->dev)) {
+		uk_pr_err("Sector size %"__PRIu16" not supported by device\n",
+			  bpb.bytes_per_sec);
+		return EINVAL;
+	}
+
+	tot_sec = bpb.tot_sec16 ? bpb.tot_sec16 : bpb.tot_sec32;
+	rsvd = bpb.rsvd_sec_cnt;
+	fat_sz = bpb.fat_sz32;
+
+	fm->bytes_per_sec = bpb.bytes_per_sec;
+	fm->sec_per_clus = bpb.sec_per_clus;
+	fm->clus_size = fm->bytes_per_sec * fm->sec_per_clus;
+	fm->fat_start = rsvd;
+	fm->fat_sectors = fat_sz;
+	fm->num_fats = bpb.num_fats;
+	fm->data_start = rsvd + bpb.num_fats * fat_sz;
+	if (fm->data_start >= tot_sec) {
+		uk_pr_err("Invalid BIOS parameter block\n");
+		return EINVAL;
+	}
+	fm->nclusters = (tot_sec - fm->data_start) / fm->sec_per_clus;
+	/* The FAT must be large enough to describe all clusters */
+	fm->nclusters = MIN(fm->nclusters,
+			    fat_sz * (fm->bytes_per_sec / 4) - 2);
+	if (fm->nclusters < 65525)
+		uk_pr_warn("Volume has few clusters for FAT32\n");
+	fm->root_clus = bpb.root_clus;
+	if (fm->root_clus < 2 || fm->root_clus >= fm->nclusters + 2) {
+		uk_pr_err("Invalid root directory cluster\n");
+		return EINVAL;
+	}
+
+	/* With mirroring disabled only the active FAT is used */
+	if (bpb.ext_flags & 0x80) {
+		fm->fat_start += (bpb.ext_flags & 0xf) * fat_sz;
+		fm->num_fats = 1;
+	}
+
+	fm->fsinfo_sec = (bpb.fs_info && bpb.fs_info < rsvd) ? bpb.fs_info
+							       : 0;
+	return 0;
+}
+
+static int fatfs_read_fsinfo(struct fat_mount *fm)
+{
+	struct fat_fsinfo *fsi;
+	struct uk_bbuf *b;
+
+	fm->free_count = FAT_FSI_UNKNOWN;
+	fm->next_free = 2;
+	if (!fm->fsinfo_sec)
+		return 0;
+
+	b = uk_bcache_get(fm->bc, fm->fsinfo_sec, 0);
+	if (unlikely(PTRISERR(b)))
+		return -PTR2ERR(b);
+	fsi = b->data;
+	if (fsi->lead_sig == FAT_FSI_LEAD_SIG &&
+	    fsi->struc_sig == FAT_FSI_STRUC_SIG &&
+	    fsi->trail_sig == FAT_FSI_TRAIL_SIG) {
+		if (fsi->free_count <= fm->nclusters)
+			fm->free_count = fsi->free_count;
+		if (fsi->nxt_free >= 2 && fsi->nxt_free < fm->nclusters + 2)
+			fm->next_free = fsi->nxt_free;
+	} else {
+		fm->fsinfo_sec = 0;
+	}
+	uk_bcache_put(fm->bc, b);
+	return 0;
+}
+
+static int
+fatfs_mount(struct mount *mp, const char *dev, int flags,
+	    const void *data __unused)
+{
+	struct fat_mount *fm;
+	struct fat_node *root;
+	int rc;
+
+	uk_pr_debug("%s: dev=%s\n", __func__, dev);
+
+	fm = calloc(1, sizeof(*fm));
+	if (unlikely(!fm))
+		return ENOMEM;
+	uk_mutex_init(&fm->lock);
+	UK_INIT_LIST_HEAD(&fm->nodes);
+
+	fm->dev = fatfs_blkdev_lookup(dev);
+	if (!fm->dev) {
+		uk_pr_err("No block device \"%s\"\n", dev ? dev : "");
+		rc = ENODEV;
+		goto err_free_fm;
+	}
+
+	rc = fatfs_blkdev_start(fm->dev);
+	if (unlikely(rc)) {
+		uk_pr_err("Failed to start block device %s: %d\n", dev, rc);
+		goto err_free_fm;
+	}
+
+	fm->rdonly = (flags & MNT_RDONLY) ||
+		     uk_blkdev_mode(fm->dev) == O_RDONLY;
+	if (fm->rdonly)
+		mp->m_flags |= MNT_RDONLY;
+	/* fatfs_read() serializes on fm->lock by itself */
+	mp->m_flags |= MNT_SHAREDREAD;
+	/* fatfs_fsync() writes back the whole block cache */
+	mp->m_flags |= MNT_SYNCALL;
+
+	rc = fatfs_bcache_create(fm, uk_blkdev_ssize(fm->dev));
+	if (unlikely(rc))
+		goto err_free_fm;
+	rc = fatfs_read_bpb(fm);
+	if (unlikely(rc))
+		goto err_destroy_bc;
+	if (fm->bytes_per_sec != uk_blkdev_ssize(fm->dev)) {
+		uk_bcache_destroy(fm->bc);
+		rc = fatfs_bcache_create(fm, fm->bytes_per_sec);
+		if (unlikely(rc))
+			goto err_free_fm;
+	}
+	rc = fatfs_read_fsinfo(fm);
+	if (unlikely(rc))
+		goto err_destroy_bc;
+
+	root = calloc(1, sizeof(*root));
+	if (unlikely(!root)) {
+		rc = ENOMEM;
+		goto err_destroy_bc;
+	}
+	UK_INIT_LIST_HEAD(&root->link);
+	root->is_root = 1;
+	root->de.attr = FAT_ATTR_DIRECTORY;
+	fat_node_set_clus(root, fm->root_clus);
+	root->vp = mp->m_root->d_vnode;
+	fm->root = root;
+
+	mp->m_data = fm;
+	mp->m_root->d_vnode->v_data = root;
+
+	uk_pr_info("fatfs: mounted %s (%"__PRIu32" clusters of %"__PRIu32
+		   " bytes%s)\n", dev, fm->nclusters, fm->clus_size,
+		   fm->rdonly ? ", read-only" : "");
+	return 0;
+
+err_destroy_bc:
+	uk_bcache_destroy(fm->bc);
+err_free_fm:
+	free(fm);
+	return rc;
+}
+
+static int
+fatfs_sync(struct mount *mp)
+{
+	struct fat_mount *fm = FAT_MOUNT(mp);
+	int rc;
+
+	if (fm->rdonly)
+		return 0;
+
+	uk_mutex_lock(&fm->lock);
+	rc = fat_fsinfo_sync(fm);
+	if (!rc)
+		rc = -uk_bcache_sync(fm->bc);
+	uk_mutex_unlock(&fm->lock);
+	return rc;
+}
+
+static int
+fatfs_unmount(struct mount *mp, int flags __unused)
+{
+	struct fat_mount *fm = FAT_MOUNT(mp);
+	struct fat_node *np, *tmp;
+	int rc;
+
+	/* Releasing the dentries drops the vnodes and their nodes */
+	vfscore_release_mp_dentries(mp);
+
+	uk_mutex_lock(&fm->lock);
+	if (!fm->rdonly)
+		fat_fsinfo_sync(fm);
+	uk_list_for_each_entry_safe(np, tmp, &fm->nodes, link)
+		fat_node_free(fm, np);
+	uk_mutex_unlock(&fm->lock);
+
+	rc = uk_bcache_destroy(fm->bc);
+	if (unlikely(rc))
+		uk_pr_err("Failed to write back cached data: %d\n", rc);
+	free(fm->root);
+	free(fm);
+	mp->m_data = NULL;
+	return 0;
+}
+
+static int
+fatfs_statfs(struct mount *mp, struct statfs *statp)
+{
+	struct fat_mount *fm = FAT_MOUNT(mp);
+	__u32 c, val, nfree = 0;
+	int rc = 0;
+
+	uk_mutex_lock(&fm->lock);
+	if (fm->free_count == FAT_FSI_UNKNOWN) {
+		/* Count once, the value is maintained from now on */
+		for (c = 2; c < fm->nclusters + 2; c++) {
+			rc = fat_get(fm, c, &val);
+			if (unlikely(rc))
+				break;
+			if (val == FAT_CLUS_FREE)
+				nfree++;
+		}
+		if (!rc) {
+			fm->free_count = nfree;
+			fm->fsinfo_dirty = 1;
+		}
+	}
+	if (!rc) {
+		statp->f_type = FATFS_MAGIC;
+		statp->f_bsize = fm->clus_size;
+		statp->f_frsize = fm->clus_size;
+		statp->f_blocks = fm->nclusters;
+		statp->f_bfree = fm->free_count;
+		statp->f_bavail = fm->free_count;
+		statp->f_files = 0;
+		statp->f_ffree = 0;
+		statp->f_namelen = FAT_LFN_MAX;
+	}
+	uk_mutex_unlock(&fm->lock);
+	return rc;
+}
@@ -0,0 +1,592 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <uk/essentials.h>
+#include <uk/print.h>
+#include <vfscore/file.h>
+#include <vfscore/mount.h>
+#include <vfscore/uio.h>
+#include <vfscore/vnode.h>
+
+#include "fatfs.h"
+
+#define FATFS_MODE	(S_IRWXU | S_IRWXG | S_IRWXO)
+
+static mode_t fatfs_mode(const struct fat_node *np)
+{
+	if (np->de.attr & FAT_ATTR_READ_ONLY)
+		return FATFS_MODE & ~(S_IWUSR | S_IWGRP | S_IWOTH);
+	return FATFS_MODE;
+}
+
+static int fatfs_lookup(struct vnode *dvp, const char *name,
+			struct vnode **vpp)
+{
+	struct fat_mount *fm = FAT_MOUNT(dvp->v_mount);
+	struct fat_node *np, *dnp = FAT_NODE(dvp);
+	struct fat_direntry *ent;
+	struct vnode *vp;
+	int rc, created = 0;
+
+	*vpp = NULL;
+
+	if (*name == '\0')
+		return ENOENT;
+
+	ent = malloc(sizeof(*ent));
+	if (unlikely(!ent))
+		return ENOMEM;
+
+	uk_mutex_lock(&fm->lock);
+
+	rc = fat_dir_lookup(fm, dnp, name, ent);
+	if (rc)
+		goto out;
+
+	np = fat_node_get(fm, fat_node_clus(dnp), ent->off);
+	if (!np) {
+		np = fat_node_new(fm, fat_node_clus(dnp), ent);
+		if (unlikely(!np)) {
+			rc = ENOMEM;
+			goto out;
+		}
+		created = 1;
+	}
+
+	if (vfscore_vget(dvp->v_mount, np->ino, &vp)) {
+		/* found in cache */
+		*vpp = vp;
+		goto out;
+	}
+	if (!vp) {
+		if (created)
+			fat_node_free(fm, np);
+		rc = ENOMEM;
+		goto out;
+	}
+	vp->v_data = np;
+	vp->v_type = fat_node_isdir(np) ? VDIR : VREG;
+	vp->v_mode = fatfs_mode(np);
+	vp->v_size = fat_node_isdir(np) ? 0 : np->de.file_size;
+	np->vp = vp;
+	*vpp = vp;
+
+out:
+	uk_mutex_unlock(&fm->lock);
+	free(ent);
+	return rc;
+}
+
+static int fatfs_inactive(struct vnode *vp)
+{
+	struct fat_mount *fm = FAT_MOUNT(vp->v_mount);
+	struct fat_node *np = FAT_NODE(vp);
+	int rc = 0;
+
+	if (!np || np->is_root)
+		return 0;
+
+	uk_mutex_lock(&fm->lock);
+	/* A lookup may have attached the node to a new vnode while this one
+	 * was on its way out. The node then stays with the new vnode.
+	 */
+	if (np->vp == vp) {
+		if (np->deleted && !fm->rdonly)
+			rc = fat_free_chain(fm, fat_node_clus(np));
+		fat_node_free(fm, np);
+	}
+	uk_mutex_unlock(&fm->lock);
+	return rc;
+}
+
+static int fatfs_read(struct vnode *vp, struct vfscore_file *fp __unused,
+		      struct uio *uio, int ioflag)
+{
+	struct fat_mount *fm = FAT_MOUNT(vp->v_mount);
+	struct fat_node *np = FAT_NODE(vp);
+	__u32 len, off;
+	int rc;
+
+	if (vp->v_type == VDIR)
+		return EISDIR;
+	if (vp->v_type != VREG)
+		return EINVAL;
+	if (uio->uio_offset < 0)
+		return EINVAL;
+	if (uio->uio_resid == 0)
+		return 0;
+
+	uk_mutex_lock(&fm->lock);
+	if (uio->uio_offset >= (off_t)np->de.file_size) {
+		uk_mutex_unlock(&fm->lock);
+		return 0;
+	}
+	len = MIN((__u64)uio->uio_resid,
+		  np->de.file_size - (__u64)uio->uio_offset);
+	if (ioflag & IO_DIRECT) {
+		off = uio->uio_offset;
+		rc = fat_node_rw_direct(fm, np, uio, len, 0);
+		len -= uio->uio_offset - off;
+		if (unlikely(rc))
+			goto out;
+	}
+	rc = fat_node_rw(fm, np, uio->uio_offset, NULL, uio, len, 0);
+out:
+	uk_mutex_unlock(&fm->lock);
+	return rc;
+}
+
+static int fatfs_write(struct vnode *vp, struct uio *uio, int ioflag)
+{
+	struct fat_mount *fm = FAT_MOUNT(vp->v_mount);
+	struct fat_node *np = FAT_NODE(vp);
+	__u32 size;
+	int rc;
+
+	if (vp->v_type == VDIR)
+		return EISDIR;
+	if (vp->v_type != VREG)
+		return EINVAL;
+	if (fm->rdonly)
+		return EROFS;
+	if (uio->uio_offset < 0)
+		return EINVAL;
+	if (uio->uio_resid == 0)
+		return 0;
+
+	uk_mutex_lock(&fm->lock);
+
+	size = np->de.file_size;
+	if (ioflag & IO_APPEND)
+		uio->uio_offset = size;
+	if ((__u64)uio->uio_offset + uio->uio_resid > FAT_FILE_SIZE_MAX) {
+		rc = EFBIG;
+		goto out;
+	}
+
+	/* Clusters are not zeroed on allocation, fill the hole explicitly */
+	if (uio->uio_offset > (off_t)size) {
+		rc = fat_node_rw(fm, np, size, NULL, NULL,
+				 uio->uio_offset - size, 1);
+		if (unlikely(rc))
+			goto out;
+	}
+
+	rc = (ioflag & IO_DIRECT)
+	     ? fat_node_rw_direct(fm, np, uio, uio->uio_resid, 1) : 0;
+	if (!rc)
+		rc = fat_node_rw(fm, np, uio->uio_offset, NULL, uio,
+				 uio->uio_resid, 1);
+
+	/* Account for the data written before a possible failure */
+	if (uio->uio_offset > (off_t)size)
+		np->de.file_size = uio->uio_offset;
+	vp->v_size = np->de.file_size;
+	np->de.attr |= FAT_ATTR_ARCHIVE;
+	fat_touch(&np->de, 0);
+	if (!rc)
+		rc = fat_node_sync(fm, np);
+	else
+		fat_node_sync(fm, np);
+
+out:
+	uk_mutex_unlock(&fm->lock);
+	return rc;
+}
+
+static int fatfs_truncate(struct vnode *vp, off_t length)
+{
+	struct fat_mount *fm = FAT_MOUNT(vp->v_mount);
+	struct fat_node *np = FAT_NODE(vp);
+	int rc;
+
+	if (vp->v_type == VDIR)
+		return EISDIR;
+	if (fm->rdonly)
+		return EROFS;
+	if (length < 0)
+		return EINVAL;
+	if ((__u64)length > FAT_FILE_SIZE_MAX)
+		return EFBIG;
+
+	uk_mutex_lock(&fm->lock);
+	rc = fat_node_resize(fm, np, length);
+	vp->v_size = np->de.file_size;
+	np->de.attr |= FAT_ATTR_ARCHIVE;
+	fat_touch(&np->de, 0);
+	if (!rc)
+		rc = fat_node_sync(fm, np);
+	uk_mutex_unlock(&fm->lock);
+	return rc;
+}
+
+static int fatfs_fsync(struct vnode *vp, struct vfscore_file *fp __unused)
+{
+	struct fat_mount *fm = FAT_MOUNT(vp->v_mount);
+	int rc;
+
+	if (fm->rdonly)
+		return 0;
+
+	uk_mutex_lock(&fm->lock);
+	rc = fat_fsinfo_sync(fm);
+	if (!rc)
+		rc = -uk_bcache_sync(fm->bc);
+	uk_mutex_unlock(&fm->lock);
+	return rc;
+}
+
+/*
+ * The offset of a directory is the byte offset of the next entry. The root
+ * directory has no "." and ".." entries on disk; they are reported at
+ * offsets 0 and 1, and the entries on disk follow at offset 2.
+ */
+static int fatfs_readdir(struct vnode *vp, struct vfscore_file *fp,
+			 struct dirent64 *dir)
+{
+	struct fat_mount *fm = FAT_MOUNT(vp->v_mount);
+	struct fat_node *dnp = FAT_NODE(vp);
+	struct fat_direntry *ent;
+	__u32 off;
+	int rc;
+
+	if (dnp->is_root && fp->f_offset < 2) {
+		dir->d_type = DT_DIR;
+		strlcpy((char *)&dir->d_name, fp->f_offset ? ".." : ".",
+			sizeof(dir->d_name));
+		dir->d_fileno = fp->f_offset;
+		fp->f_offset++;
+		return 0;
+	}
+
+	ent = malloc(sizeof(*ent));
+	if (unlikely(!ent))
+		return ENOMEM;
+
+	off = fp->f_offset - (dnp->is_root ? 2 : 0);
+
+	uk_mutex_lock(&fm->lock);
+	rc = fat_dir_next(fm, dnp, &off, ent);
+	uk_mutex_unlock(&fm->lock);
+	if (rc)
+		goto out;
+
+	dir->d_type = (ent->de.attr & FAT_ATTR_DIRECTORY) ? DT_DIR : DT_REG;
+	strlcpy((char *)&dir->d_name, ent->name, sizeof(dir->d_name));
+	dir->d_fileno = fp->f_offset;
+	fp->f_offset = off + (dnp->is_root ? 2 : 0);
+
+out:
+	free(ent);
+	return rc;
+}
+
+static int fatfs_create(struct vnode *dvp, const char *name, mode_t mode)
+{
+	struct fat_mount *fm = FAT_MOUNT(dvp->v_mount);
+	struct fat_dirent de;
+	__u32 off, lfn_off;
+	int rc;
+
+	if (fm->rdonly)
+		return EROFS;
+	if (!S_ISREG(mode))
+		return EINVAL;
+
+	memset(&de, 0, sizeof(de));
+	de.attr = FAT_ATTR_ARCHIVE;
+	if (!(mode & S_IWUSR))
+		de.attr |= FAT_ATTR_READ_ONLY;
+	fat_touch(&de, 1);
+
+	uk_mutex_lock(&fm->lock);
+	rc = fat_dir_add(fm, FAT_NODE(dvp), name, &de, &off, &lfn_off);
+	uk_mutex_unlock(&fm->lock);
+	return rc;
+}
+
+static int fatfs_mkdir(struct vnode *dvp, const char *name,
+		       mode_t mode __unused)
+{
+	struct fat_mount *fm = FAT_MOUNT(dvp->v_mount);
+	struct fat_node *dnp = FAT_NODE(dvp);
+	struct fat_dirent de, *dp;
+	struct uk_bbuf *b;
+	__u32 clus, parent, off, lfn_off;
+	int rc;
+
+	if (fm->rdonly)
+		return EROFS;
+
+	memset(&de, 0, sizeof(de));
+	de.attr = FAT_ATTR_DIRECTORY;
+	fat_touch(&de, 1);
+
+	uk_mutex_lock(&fm->lock);
+
+	rc = fat_alloc_clus(fm, 0, 1, &clus);
+	if (unlikely(rc))
+		goto out;
+
+	/* "." refers to the new directory, ".." to the parent, which is
+	 * cluster 0 for the root directory.
+	 */
+	rc = fat_dirent_map(fm, clus, 0, &b, &dp);
+	if (unlikely(rc))
+		goto err_free;
+	memcpy(&dp[0], &de, sizeof(de));
+	memset(dp[0].name, ' ', 11);
+	dp[0].name[0] = '.';
+	dp[0].fst_clus_hi = clus >> 16;
+	dp[0].fst_clus_lo = clus;
+	memcpy(&dp[1], &dp[0], sizeof(de));
+	dp[1].name[1] = '.';
+	parent = dnp->is_root ? 0 : fat_node_clus(dnp);
+	dp[1].fst_clus_hi = parent >> 16;
+	dp[1].fst_clus_lo = parent;
+	uk_bcache_dirty(fm->bc, b);
+	uk_bcache_put(fm->bc, b);
+
+	de.fst_clus_hi = clus >> 16;
+	de.fst_clus_lo = clus;
+	rc = fat_dir_add(fm, dnp, name, &de, &off, &lfn_off);
+	if (unlikely(rc))
+		goto err_free;
+
+out:
+	uk_mutex_unlock(&fm->lock);
+	return rc;
+
+err_free:
+	fat_free_chain(fm, clus);
+	goto out;
+}
+
+/* Removes the entry of a node; its clusters are released in inactive */
+static int fatfs_unlink_node(struct fat_mount *fm, struct fat_node *dnp,
+			     struct fat_node *np)
+{
+	int rc;
+
+	rc = fat_dir_del(fm, dnp, np->lfn_off, np->dirent_off);
+	if (unlikely(rc))
+		return rc;
+	np->deleted = 1;
+	uk_list_del_init(&np->link);
+	return 0;
+}
+
+static int fatfs_remove(struct vnode *dvp, struct vnode *vp,
+			const char *name __unused)
+{
+	struct fat_mount *fm = FAT_MOUNT(dvp->v_mount);
+	int rc;
+
+	if (fm->rdonly)
+		return EROFS;
+	if (vp->v_type == VDIR)
+		return EISDIR;
+
+	uk_mutex_lock(&fm->lock);
+	rc = fatfs_unlink_node(fm, FAT_NODE(dvp), FAT_NODE(vp));
+	uk_mutex_unlock(&fm->lock);
+	return rc;
+}
+
+static int fatfs_rmdir(struct vnode *dvp, struct vnode *vp,
+		       const char *name __unused)
+{
+	struct fat_mount *fm = FAT_MOUNT(dvp->v_mount);
+	int rc;
+
+	if (fm->rdonly)
+		return EROFS;
+	if (vp->v_type != VDIR)
+		return ENOTDIR;
+
+	uk_mutex_lock(&fm->lock);
+	rc = fat_dir_empty(fm, FAT_NODE(vp));
+	if (!rc)
+		rc = fatfs_unlink_node(fm, FAT_NODE(dvp), FAT_NODE(vp));
+	uk_mutex_unlock(&fm->lock);
+	return rc;
+}
+
+static int fatfs_rename(struct vnode *dvp1, struct vnode *vp1,
+			const char *name1 __unused,
+			struct vnode *dvp2, struct vnode *vp2,
+			const char *name2)
+{
+	struct fat_mount *fm = FAT_MOUNT(dvp1->v_mount);
+	struct fat_node *dnp1 = FAT_NODE(dvp1);
+	struct fat_node *dnp2 = FAT_NODE(dvp2);
+	struct fat_node *np = FAT_NODE(vp1);
+	struct fat_dirent de, *dp;
+	struct uk_bbuf *b;
+	__u32 off, lfn_off, clus;
+	int rc;
+
+	if (fm->rdonly)
+		return EROFS;
+
+	uk_mutex_lock(&fm->lock);
+
+	/* With case-insensitive names, the target may be the source itself */
+	if (vp2 && vp2 != vp1) {
+		if (vp2->v_type == VDIR) {
+			rc = fat_dir_empty(fm, FAT_NODE(vp2));
+			if (rc)
+				goto out;
+		}
+		rc = fatfs_unlink_node(fm, dnp2, FAT_NODE(vp2));
+		if (unlikely(rc))
+			goto out;
+	}
+
+	memcpy(&de, &np->de, sizeof(de));
+	rc = fat_dir_add(fm, dnp2, name2, &de, &off, &lfn_off);
+	if (unlikely(rc))
+		goto out;
+	rc = fat_dir_del(fm, dnp1, np->lfn_off, np->dirent_off);
+	if (unlikely(rc))
+		goto out;
+
+	np->dir_clus = fat_node_clus(dnp2);
+	np->dirent_off = off;
+	np->lfn_off = lfn_off;
+	memcpy(np->de.name, de.name, sizeof(de.name));
+	np->de.ntres = de.ntres;
+
+	/* A directory that moves to another parent has to point its ".."
+	 * entry to it.
+	 */
+	if (fat_node_isdir(np) && dnp1 != dnp2) {
+		rc = fat_dirent_map(fm, fat_node_clus(np), FAT_DIRENT_SIZE,
+				    &b, &dp);
+		if (unlikely(rc))
+			goto out;
+		if (dp->name[0] == '.' && dp->name[1] == '.') {
+			clus = dnp2->is_root ? 0 : fat_node_clus(dnp2);
+			dp->fst_clus_hi = clus >> 16;
+			dp->fst_clus_lo = clus;
+			uk_bcache_dirty(fm->bc, b);
+		}
+		uk_bcache_put(fm->bc, b);
+	}
+
+out:
+	uk_mutex_unlock(&fm->lock);
+	return rc;
+}
+
+static int fatfs_getattr(struct vnode *vp, struct vattr *attr)
+{
+	struct fat_mount *fm = FAT_MOUNT(vp->v_mount);
+	struct fat_node *np = FAT_NODE(vp);
+
+	uk_mutex_lock(&fm->lock);
+	attr->va_nodeid = vp->v_ino;
+	attr->va_type = vp->v_type;
+	attr->va_mode = fatfs_mode(np);
+	attr->va_nlink = 1;
+	attr->va_size = fat_node_isdir(np) ? 0 : np->de.file_size;
+	attr->va_nblocks = DIV_ROUND_UP((__u64)np->de.file_size,
+					fm->clus_size) * (fm->clus_size / 512);
+	fat_time_to_timespec(np->de.wrt_date, np->de.wrt_time,
+			     &attr->va_mtime);
+	fat_time_to_timespec(np->de.lst_acc_date, 0, &attr->va_atime);
+	attr->va_ctime = attr->va_mtime;
+	uk_mutex_unlock(&fm->lock);
+	return 0;
+}
+
+static int fatfs_setattr(struct vnode *vp, struct vattr *attr)
+{
+	struct fat_mount *fm = FAT_MOUNT(vp->v_mount);
+	struct fat_node *np = FAT_NODE(vp);
+	__u16 date, time;
+	int rc;
+
+	if (fm->rdonly)
+		return EROFS;
+	if (np->is_root)
+		return 0;
+
+	uk_mutex_lock(&fm->lock);
+	if (attr->va_mask & AT_MTIME) {
+		fat_timespec_to_time(&attr->va_mtime, &date, &time);
+		np->de.wrt_date = date;
+		np->de.wrt_time = time;
+	}
+	if (attr->va_mask & AT_ATIME) {
+		fat_timespec_to_time(&attr->va_atime, &date, &time);
+		np->de.lst_acc_date = date;
+	}
+	if (attr->va_mask & AT_MODE) {
+		if (attr->va_mode & S_IWUSR)
+			np->de.attr &= ~FAT_ATTR_READ_ONLY;
+		else
+			np->de.attr |= FAT_ATTR_READ_ONLY;
+		vp->v_mode = fatfs_mode(np);
+	}
+	rc = fat_node_sync(fm, np);
+	uk_mutex_unlock(&fm->lock);
+	return rc;
+}
+
+static int fatfs_ioctl(struct vnode *vp __unused,
+		       struct vfscore_file *fp __unused,
+		       unsigned long com, void *data __unused)
+{
+	if (com == FIONBIO)
+		return 0;
+	return ENOTTY;
+}
+
+#define fatfs_open	((vnop_open_t)vfscore_vop_nullop)
+#define fatfs_close	((vnop_close_t)vfscore_vop_nullop)
+#define fatfs_seek	((vnop_seek_t)vfscore_vop_nullop)
+#define fatfs_link	((vnop_link_t)vfscore_vop_eperm)
+#define fatfs_cache	((vnop_cache_t)NULL)
+#define fatfs_fallocate	((vnop_fallocate_t)vfscore_vop_einval)
+#define fatfs_readlink	((vnop_readlink_t)vfscore_vop_einval)
+#define fatfs_symlink	((vnop_symlink_t)vfscore_vop_eperm)
+#define fatfs_poll	((vnop_poll_t)vfscore_vop_einval)
+
+struct vnops fatfs_vnops = {
+	.vop_open	= fatfs_open,
+	.vop_close	= fatfs_close,
+	.vop_read	= fatfs_read,
+	.vop_write	= fatfs_write,
+	.vop_seek	= fatfs_seek,
+	.vop_ioctl	= fatfs_ioctl,
+	.vop_fsync	= fatfs_fsync,
+	.vop_readdir	= fatfs_readdir,
+	.vop_lookup	= fatfs_lookup,
+	.vop_create	= fatfs_create,
+	.vop_remove	= fatfs_remove,
+	.vop_rename	= fatfs_rename,
+	.vop_mkdir	= fatfs_mkdir,
+	.vop_rmdir	= fatfs_rmdir,
+	.vop_getattr	= fatfs_getattr,
+	.vop_setattr	= fatfs_setattr,
+	.vop_inactive	= fatfs_inactive,
+	.vop_truncate	= fatfs_truncate,
+	.vop_link	= fatfs_link,
+	.vop_cache	= fatfs_cache,
+	.vop_fallocate	= fatfs_fallocate,
+	.vop_readlink	= fatfs_readlink,
+	.vop_symlink	= fatfs_symlink,
+	.vop_poll	= fatfs_poll,
+};
@@ -60,25 +60,83 @@
 
 #include <uk/isr/string.h>
 #include <uk/arch/types.h>
+#include <uk/essentials.h>
 #include <stdint.h>
 #include <limits.h>
 
-void *memcpy_isr(void *dst, const void *src, size_t len)
+/*
+ * The routines below may neither use floating point nor vector registers.
+ * Instead of byte loops, they move general-purpose register sized words
+ * when source and destination are equally aligned. On x86_64, copies and
+ * fills use `rep movsb` and `rep stosb`, which run at memory bandwidth on
+ * CPUs with fast string operations.
+ */
+typedef unsigned long __may_alias isr_word_t;
+
+#define ISR_WSIZE		sizeof(isr_word_t)
+#define ISR_WMASK		(ISR_WSIZE - 1)
+
+/* Words with all bytes set to the lowest byte of c */
+#define ISR_WFILL(c)		(((isr_word_t)-1 / 0xff) * (__u8)(c))
+
+static inline int isr_coaligned(const void *a, const void *b)
 {
-	size_t p;
+	return (((__uptr)a ^ (__uptr)b) & ISR_WMASK) == 0;
+}
 
-	for (p = 0; p < len; ++p)
-		*((__u8 *)(((__uptr)dst) + p)) = *((__u8 *)(((__uptr)src) + p));
+static inline void isr_copy_fwd(__u8 *d, const __u8 *s, size_t len)
+{
+#if defined(__X86_64__)
+	__asm__ __volatile__ ("rep movsb"
+			      : "+D"(d), "+S"(s), "+c"(len)
+			      :
+			      : "memory");
+#else /* !__X86_64__ */
+	if (len >= 2 * ISR_WSIZE && isr_coaligned(d, s)) {
+		for (; (__uptr)d & ISR_WMASK; len--)
+			*d++ = *s++;
+		for (; len >= 2 * ISR_WSIZE; len -= 2 * ISR_WSIZE) {
+			((isr_word_t *)d)[0] = ((const isr_word_t *)s)[0];
+			((isr_word_t *)d)[1] = ((const isr_word_t *)s)[1];
+			d += 2 * ISR_WSIZE;
+			s += 2 * ISR_WSIZE;
+		}
+	}
+	for (; len > 0; len--)
+		*d++ = *s++;
+#endif /* !__X86_64__ */
+}
 
+void *memcpy_isr(void *dst, const void *src, size_t len)
+{
+	isr_copy_fwd(dst, src, len);
 	return dst;
 }
 
 void *memset_isr(void *ptr, int val, size_t len)
 {
-	__u8 *p = (__u8 *) ptr;
-
-	for (; len > 0; --len)
-		*(p++) = (__u8)val;
+	__u8 *p = (__u8 *)ptr;
+
+#if defined(__X86_64__)
+	__asm__ __volatile__ ("rep stosb"
+			      : "+D"(p), "+c"(len)
+			      : "a"(val)
+			      : "memory");
+#else /* !__X86_64__ */
+	isr_word_t w = ISR_WFILL(val);
+
+	if (len >= 2 * ISR_WSIZE) {
+		for (; (__uptr)p & ISR_WMASK; len--)
+			*p++ = (__u8)val;
+		for (; len >= 2 * ISR_WSIZE; len -= 2 * ISR_WSIZE) {
+			((isr_word_t *)p)[0] = w;
+			((isr_word_t *)p)[1] = w;
+			p += 2 * ISR_WSIZE;
+		}
+	}
+	for (; len > 0; len--)
+		*p++ = (__u8)val;
+#endif /* !__X86_64__ */
 
 	return ptr;
 }
@@ -107,22 +165,31 @@ void *memrchr_isr(const void *m, int c, size_t n)
 
 void *memmove_isr(void *dst, const void *src, size_t len)
 {
-	uint8_t *d = dst;
-	const uint8_t *s = src;
-
-	if ((intptr_t)src == (intptr_t)dst) {
+	__u8 *d = dst;
+	const __u8 *s = src;
+
+	/* Copying forward is safe unless the destination starts inside the
+	 * source
+	 */
+	if ((__uptr)d - (__uptr)s >= len) {
+		isr_copy_fwd(d, s, len);
 		return dst;
-	} else if ((intptr_t)src > (intptr_t)dst) {
-		for (; len > 0; --len)
-			*(d++) = *(s++);
-	} else {
-		s += len;
-		d += len;
-
-		for (; len > 0; --len)
-			*(d--) = *(s--);
 	}
 
+	s += len;
+	d += len;
+	if (len >= ISR_WSIZE && isr_coaligned(d, s)) {
+		for (; (__uptr)d & ISR_WMASK; len--)
+			*--d = *--s;
+		for (; len >= ISR_WSIZE; len -= ISR_WSIZE) {
+			d -= ISR_WSIZE;
+			s -= ISR_WSIZE;
+			*(isr_word_t *)d = *(const isr_word_t *)s;
+		}
+	}
+	for (; len > 0; len--)
+		*--d = *--s;
+
 	return dst;
 }
 
@@ -131,6 +198,17 @@ int memcmp_isr(const void *ptr1, const void *ptr2, size_t len)
 	const unsigned char *c1 = (const unsigned char *)ptr1;
 	const unsigned char *c2 = (const unsigned char *)ptr2;
 
+	/* Skip equal words, the differing byte is found below */
+	if (len >= ISR_WSIZE && isr_coaligned(c1, c2)) {
+		for (; ((__uptr)c1 & ISR_WMASK) && len > 0; len--, c1++, c2++)
+			if (*c1 != *c2)
+				return *c1 - *c2;
+		for (; len >= ISR_WSIZE &&
+		       *(const isr_word_t *)c1 == *(const isr_word_t *)c2;
+		     len -= ISR_WSIZE, c1 += ISR_WSIZE, c2 += ISR_WSIZE)
+			;
+	}
+
 	for (; len > 0; --len, ++c1, ++c2) {
 		if ((*c1) != (*c2))
 			return ((*c1) - (*c2));
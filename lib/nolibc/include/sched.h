@@ -35,6 +35,18 @@
 extern "C" {
 #endif
 
+#define SCHED_OTHER		0
+#define SCHED_FIFO		1
+#define SCHED_RR		2
+#define SCHED_BATCH		3
+#define SCHED_IDLE		5
+#define SCHED_DEADLINE		6
+#define SCHED_RESET_ON_FORK	0x40000000
+
+struct sched_param {
+	int sched_priority;
+};
+
 #if CONFIG_LIBPOSIX_PROCESS_CLONE
 #ifdef _GNU_SOURCE
 #define CLONE_NEWTIME		0x00000080
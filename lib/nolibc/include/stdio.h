@@ -57,6 +57,12 @@ extern FILE *stderr;
 
 #define EOF (-1)
 
+#define BUFSIZ 1024
+
+#define _IOFBF 0
+#define _IOLBF 1
+#define _IONBF 2
+
 /* stdio.h shall not define va_list if it is included, but it shall
  * declare functions that use va_list.
  */
@@ -74,6 +80,8 @@ int  sprintf(char *str, const char *fmt, ...)               __printf(2, 3);
 int vfprintf(FILE *fp, const char *fmt, va_list ap);
 int  fprintf(FILE *fp, const char *fmt, ...)                __printf(2, 3);
 int   fflush(FILE *fp);
+int  setvbuf(FILE *restrict fp, char *restrict buf, int mode, size_t size);
+void  setbuf(FILE *restrict fp, char *restrict buf);
 
 int vprintf(const char *fmt, va_list ap);
 int  printf(const char *fmt, ...)                           __printf(1, 2);
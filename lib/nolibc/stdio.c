@@ -67,17 +67,160 @@
 
 #include <uk/essentials.h>
 #include <uk/arch/lcpu.h>
+#include <uk/arch/spinlock.h>
+#include <uk/init.h>
 #include <uk/plat/console.h>
 
 /* 64 bits + 0-Byte at end */
 #define MAXNBUF 65
 
-/* basic support, gives the notion of having standard files but they do not have
- * any meaning
+struct _nolibc_file {
+	int fd;
+	int errno;
+	bool eof;
+	off_t offset;
+
+	/* Console output of stdout and stderr, NULL for files */
+	int (*cout)(const char *buf, unsigned int len);
+	/* Only taken for console streams, file I/O may block */
+	__spinlock lock;
+
+	/* Write buffer, allocated on the first write unless provided */
+	int bufmode;
+	char *buf;
+	size_t bufsize;
+	size_t buflen;
+	bool bufown;
+
+	/* List of open files for fflush(NULL) */
+	struct _nolibc_file *next;
+};
+
+static char stdout_buf[BUFSIZ];
+
+static FILE stdin_file = {
+	.fd = 0,
+	.bufmode = _IONBF,
+};
+
+/* stdout goes to the console, so it is line buffered like a tty */
+static FILE stdout_file = {
+	.fd = 1,
+	.cout = ukplat_coutk,
+	.lock = UKARCH_SPINLOCK_INITIALIZER(),
+	.bufmode = _IOLBF,
+	.buf = stdout_buf,
+	.bufsize = sizeof(stdout_buf),
+};
+
+static FILE stderr_file = {
+	.fd = 2,
+	.cout = ukplat_coutd,
+	.lock = UKARCH_SPINLOCK_INITIALIZER(),
+	.bufmode = _IONBF,
+};
+
+FILE *stdin = &stdin_file;
+FILE *stdout = &stdout_file;
+FILE *stderr = &stderr_file;
+
+#if CONFIG_LIBVFSCORE
+static FILE *stdio_files;
+static __spinlock stdio_files_lock = UKARCH_SPINLOCK_INITIALIZER();
+#endif /* CONFIG_LIBVFSCORE */
+
+static inline void stdio_lock(FILE *fp)
+{
+	if (fp->cout)
+		ukarch_spin_lock(&fp->lock);
+}
+
+static inline void stdio_unlock(FILE *fp)
+{
+	if (fp->cout)
+		ukarch_spin_unlock(&fp->lock);
+}
+
+/* Writes out data, bypassing the buffer */
+static int stdio_out(FILE *fp, const char *buf, size_t len)
+{
+	ssize_t ret;
+
+	if (fp->cout) {
+		ret = fp->cout(buf, len);
+
+		/* If ukplat_cout{d,k} weren't able to write all characters,
+		 * assume that an error happened and there is no point in
+		 * retrying.
+		 */
+		if (unlikely(ret < 0 || (size_t)ret != len)) {
+			fp->errno = EIO;
+			return -1;
+		}
+		return 0;
+	}
+
+#if CONFIG_LIBVFSCORE
+	while (len > 0) {
+		ret = pwrite(fp->fd, buf, len, fp->offset);
+		if (unlikely(ret <= 0)) {
+			fp->errno = (ret < 0) ? errno : EIO;
+			return -1;
+		}
+		fp->offset += ret;
+		buf += ret;
+		len -= ret;
+	}
+	return 0;
+#else /* !CONFIG_LIBVFSCORE */
+	fp->errno = EBADF;
+	return -1;
+#endif /* !CONFIG_LIBVFSCORE */
+}
+
+static int stdio_flush(FILE *fp)
+{
+	int ret = 0;
+
+	if (fp->buflen) {
+		ret = stdio_out(fp, fp->buf, fp->buflen);
+		fp->buflen = 0;
+	}
+	return ret;
+}
+
+/* Writes data through the buffer of the stream. Must be called with the
+ * stream locked.
  */
-FILE *stdin = (FILE *)&stdin;
-FILE *stdout = (FILE *)&stdout;
-FILE *stderr = (FILE *)&stderr;
+static int stdio_write(FILE *fp, const char *s, size_t len)
+{
+	if (fp->bufmode != _IONBF && !fp->buf) {
+		fp->buf = malloc(BUFSIZ);
+		if (unlikely(!fp->buf)) {
+			fp->bufmode = _IONBF;
+		} else {
+			fp->bufsize = BUFSIZ;
+			fp->bufown = 1;
+		}
+	}
+	if (fp->bufmode == _IONBF)
+		return stdio_out(fp, s, len);
+
+	if (fp->buflen + len > fp->bufsize) {
+		if (unlikely(stdio_flush(fp)))
+			return -1;
+		/* Large writes skip the buffer */
+		if (len >= fp->bufsize)
+			return stdio_out(fp, s, len);
+	}
+
+	memcpy(fp->buf + fp->buflen, s, len);
+	fp->buflen += len;
+
+	if (fp->bufmode == _IOLBF && memchr(s, '\n', len))
+		return stdio_flush(fp);
+	return 0;
+}
 
 static char const hex2ascii_data[] = "0123456789abcdefghijklmnopqrstuvwxyz";
 /*
@@ -436,24 +579,32 @@ int sprintf(char *str, const char *fmt, ...)
 
 int vfprintf(FILE *fp, const char *fmt, va_list ap)
 {
-	int ret;
-	char buf[1024];
-
-	ret = vsnprintf(buf, sizeof(buf), fmt, ap);
+	char sbuf[1024], *buf = sbuf;
+	va_list ap2;
+	int ret, rc;
+
+	va_copy(ap2, ap);
+	ret = vsnprintf(sbuf, sizeof(sbuf), fmt, ap);
+	if (ret >= (int)sizeof(sbuf)) {
+		buf = malloc(ret + 1);
+		if (buf) {
+			vsnprintf(buf, ret + 1, fmt, ap2);
+		} else {
+			buf = sbuf;
+			ret = sizeof(sbuf) - 1;
+		}
+	}
+	va_end(ap2);
 	if (ret < 0)
 		return ret;
 
-	/* we do not support device handling for now, we
-	 * just send the buffer content to the kernel console
-	 */
-	if (fp == stdout)
-		ret = ukplat_coutk(buf, ret);
-	else if (fp == stderr)
-		ret = ukplat_coutd(buf, ret);
-	else
-		return 0;
+	stdio_lock(fp);
+	rc = stdio_write(fp, buf, ret);
+	stdio_unlock(fp);
 
-	return ret;
+	if (buf != sbuf)
+		free(buf);
+	return rc ? EOF : ret;
 }
 
 int fprintf(FILE *fp, const char *fmt, ...)
@@ -485,26 +636,69 @@ int printf(const char *fmt, ...)
 	return ret;
 }
 
-int fflush(FILE *fp __unused)
+int fflush(FILE *fp)
 {
-	/* nolibc is not working with buffers */
+	int ret = 0;
+#if CONFIG_LIBVFSCORE
+	FILE *f;
+#endif /* CONFIG_LIBVFSCORE */
+
+	if (fp) {
+		stdio_lock(fp);
+		ret = stdio_flush(fp);
+		stdio_unlock(fp);
+		return ret ? EOF : 0;
+	}
+
+	ret |= fflush(stdout);
+	ret |= fflush(stderr);
+#if CONFIG_LIBVFSCORE
+	ukarch_spin_lock(&stdio_files_lock);
+	for (f = stdio_files; f; f = f->next)
+		ret |= stdio_flush(f);
+	ukarch_spin_unlock(&stdio_files_lock);
+#endif /* CONFIG_LIBVFSCORE */
+	return ret ? EOF : 0;
+}
+
+int setvbuf(FILE *restrict fp, char *restrict buf, int mode, size_t size)
+{
+	if (unlikely(mode != _IONBF && mode != _IOLBF && mode != _IOFBF)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	stdio_lock(fp);
+	stdio_flush(fp);
+	if (fp->bufown)
+		free(fp->buf);
+	fp->buf = NULL;
+	fp->bufsize = 0;
+	fp->bufown = 0;
+	if (mode != _IONBF && buf && size) {
+		fp->buf = buf;
+		fp->bufsize = size;
+	}
+	fp->bufmode = mode;
+	stdio_unlock(fp);
 	return 0;
 }
 
+void setbuf(FILE *restrict fp, char *restrict buf)
+{
+	setvbuf(fp, buf, buf ? _IOFBF : _IONBF, BUFSIZ);
+}
+
 int fputc(int _c, FILE *fp)
 {
-	int ret = 0;
 	unsigned char c = _c;
+	int ret;
 
-	if (fp == stdout)
-		ret = ukplat_coutk((char *)&c, 1);
-	else if (fp == stderr)
-		ret = ukplat_coutd((char *)&c, 1);
-
-	if (ret == 1)
-		return _c;
+	stdio_lock(fp);
+	ret = stdio_write(fp, (const char *)&c, 1);
+	stdio_unlock(fp);
 
-	return EOF;
+	return ret ? EOF : c;
 }
 
 int putchar(int c)
@@ -516,27 +710,14 @@ static int
 fputs_internal(const char *restrict s, FILE *restrict stream, int newline)
 {
 	int ret;
-	size_t len;
-
-	len = strlen(s);
-
-	if (stream == stdout)
-		ret = ukplat_coutk(s, len);
-	else if (stream == stderr)
-		ret = ukplat_coutd(s, len);
-	else
-		return EOF;
 
-	/* If ukplat_cout{d,k} weren't able to write all characters, assume that
-	 * an error happened and there is no point in retrying.
-	 */
-	if ((size_t)ret != len)
-		return EOF;
+	stdio_lock(stream);
+	ret = stdio_write(stream, s, strlen(s));
+	if (!ret && newline)
+		ret = stdio_write(stream, "\n", 1);
+	stdio_unlock(stream);
 
-	if (newline)
-		return fputc('\n', stream);
-	else
-		return 1;
+	return ret ? EOF : 1;
 }
 
 int fputs(const char *restrict s, FILE *restrict stream)
@@ -549,14 +730,14 @@ int puts(const char *s)
 	return fputs_internal(s, stdout, 1);
 }
 
-#if CONFIG_LIBVFSCORE
-struct _nolibc_file {
-	int fd;
-	int errno;
-	bool eof;
-	off_t offset;
-};
+static void stdio_term(const struct uk_term_ctx *tctx __unused)
+{
+	fflush(NULL);
+}
 
+uk_late_initcall(0x0, stdio_term);
+
+#if CONFIG_LIBVFSCORE
 void clearerr(FILE *stream)
 {
 	stream->eof = 0;
@@ -621,22 +802,45 @@ int ferror(FILE *stream)
 
 int fclose(FILE *stream)
 {
-	int ret = close(stream->fd);
+	FILE **pf;
+	int ret;
+
+	/* The console streams are never closed */
+	if (stream->cout)
+		return fflush(stream);
+
+	ukarch_spin_lock(&stdio_files_lock);
+	for (pf = &stdio_files; *pf; pf = &(*pf)->next) {
+		if (*pf == stream) {
+			*pf = stream->next;
+			break;
+		}
+	}
+	ukarch_spin_unlock(&stdio_files_lock);
 
+	ret = stdio_flush(stream);
+	if (close(stream->fd))
+		ret = -1;
+
+	if (stream->bufown)
+		free(stream->buf);
 	free(stream);
-	return ret;
+	return ret ? EOF : 0;
 }
 
 FILE *fdopen(int fd, const char *mode __unused)
 {
-	FILE *f = (FILE *)malloc(sizeof(FILE));
+	FILE *f = (FILE *)calloc(1, sizeof(FILE));
 
 	if (!f)
 		return NULL;
 	f->fd = fd;
-	f->errno = 0;
-	f->eof = 0;
-	f->offset = 0;
+	f->bufmode = _IOFBF;
+
+	ukarch_spin_lock(&stdio_files_lock);
+	f->next = stdio_files;
+	stdio_files = f;
+	ukarch_spin_unlock(&stdio_files_lock);
 	return f;
 }
 
@@ -644,6 +848,9 @@ int fseek(FILE *stream, long offset, int whence)
 {
 	off_t new_offset;
 
+	if (unlikely(stdio_flush(stream)))
+		return -1;
+
 	switch (whence) {
 	case SEEK_SET:
 	{
@@ -717,6 +924,10 @@ size_t fread(void *ptr, size_t size, size_t nmemb, FILE *stream)
 		return 0;
 	}
 
+	/* Pending writes must be visible to the read */
+	if (unlikely(stdio_flush(stream)))
+		return 0;
+
 	size_t total = 0;
 
 	while (total < size * nmemb) {
@@ -740,6 +951,8 @@ size_t fread(void *ptr, size_t size, size_t nmemb, FILE *stream)
 
 size_t fwrite(const void *ptr, size_t size, size_t nmemb, FILE *stream)
 {
+	int ret;
+
 	if (unlikely(!stream))
 		return 0;
 
@@ -758,20 +971,10 @@ size_t fwrite(const void *ptr, size_t size, size_t nmemb, FILE *stream)
 		return 0;
 	}
 
-	size_t total = 0;
-
-	while (total < size * nmemb) {
-		ssize_t ret = pwrite(stream->fd,
-				((char *) ptr) + total,
-				size * nmemb - total, stream->offset);
-		if (ret > 0)
-			stream->offset += ret;  // Update the offset
-
-		if (ret < 0)
-			return total / size;
-		total += ret;
-	}
+	stdio_lock(stream);
+	ret = stdio_write(stream, ptr, size * nmemb);
+	stdio_unlock(stream);
 
-	return total / size;
+	return ret ? 0 : nmemb;
 }
 #endif /* CONFIG_LIBVFSCORE */
@@ -54,6 +54,7 @@
 #include <errno.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <stdio.h>
 #include <limits.h>
 #include <ctype.h>
 #include <uk/print.h>
@@ -490,6 +491,7 @@ void abort(void)
 void exit(int status)
 {
 	uk_pr_info("exit called with status %d, halting system\n", status);
+	fflush(NULL);
 	ukplat_terminate(status);
 }
 #endif /* !CONFIG_LIBPOSIX_PROCESS */
@@ -63,12 +63,129 @@
 #include <stdio.h>
 #include <ctype.h>
 
+/*
+ * Word-wise helpers for the memory and string functions. Only the integer
+ * register file is used: these functions are called from interrupt context,
+ * where the extended (FPU/SIMD) register state is not saved.
+ */
+typedef __uptr __attribute__((__may_alias__)) nolibc_word_t;
+
+#define WSIZE		sizeof(nolibc_word_t)
+#define WMASK		(WSIZE - 1)
+#define WONES		((nolibc_word_t)-1 / 0xff)
+#define WHIGHS		(WONES * 0x80)
+/* Non-zero if one of the bytes of `x` is zero */
+#define WHASZERO(x)	(((x) - WONES) & ~(x) & WHIGHS)
+
+#if defined(__X86_64__)
+#include <uk/arch/lcpu.h>
+#include <uk/init.h>
+
+/* Enhanced REP MOVSB/STOSB: byte-granular string instructions are at least
+ * as fast as their quadword counterparts and handle the tail, too.
+ * Detected during early boot; until then, the quadword variant is used.
+ */
+static int nolibc_have_erms;
+
+static int nolibc_string_init(struct uk_init_ctx *ictx __unused)
+{
+	__u32 eax, ebx, ecx, edx;
+
+	ukarch_x86_cpuid(0, 0, &eax, &ebx, &ecx, &edx);
+	if (eax < 7)
+		return 0;
+
+	ukarch_x86_cpuid(7, 0, &eax, &ebx, &ecx, &edx);
+	nolibc_have_erms = !!(ebx & X86_CPUID7_EBX_ERMS);
+	return 0;
+}
+
+uk_early_initcall_prio(nolibc_string_init, 0x0, UK_PRIO_EARLIEST);
+
+void *memcpy(void *dst, const void *src, size_t len)
+{
+	void *ret = dst;
+	size_t q;
+
+	if (!nolibc_have_erms) {
+		q = len >> 3;
+		len &= 7;
+		__asm__ __volatile__("rep movsq"
+				     : "+D"(dst), "+S"(src), "+c"(q)
+				     :
+				     : "memory");
+	}
+	__asm__ __volatile__("rep movsb"
+			     : "+D"(dst), "+S"(src), "+c"(len)
+			     :
+			     : "memory");
+	return ret;
+}
+
+void *memset(void *ptr, int val, size_t len)
+{
+	void *dst = ptr;
+	__u64 v = (__u8)val;
+	size_t q;
+
+	if (!nolibc_have_erms) {
+		q = len >> 3;
+		len &= 7;
+		v *= WONES;
+		__asm__ __volatile__("rep stosq"
+				     : "+D"(dst), "+c"(q)
+				     : "a"(v)
+				     : "memory");
+	}
+	__asm__ __volatile__("rep stosb"
+			     : "+D"(dst), "+c"(len)
+			     : "a"(v)
+			     : "memory");
+	return ptr;
+}
+#else /* !__X86_64__ */
 void *memcpy(void *dst, const void *src, size_t len)
 {
-	size_t p;
+	__u8 *d = (__u8 *)dst;
+	const __u8 *s = (const __u8 *)src;
 
-	for (p = 0; p < len; ++p)
-		*((__u8 *)(((__uptr)dst) + p)) = *((__u8 *)(((__uptr)src) + p));
+	/* Word accesses are only possible if both pointers can be aligned */
+	if (len >= 4 * WSIZE && !(((__uptr)d ^ (__uptr)s) & WMASK)) {
+		for (; (__uptr)d & WMASK; --len)
+			*(d++) = *(s++);
+
+#if defined(__ARM_64__)
+		for (; len >= 64; len -= 64, d += 64, s += 64) {
+			__u64 a, b, c, e;
+
+			__asm__ __volatile__(
+				"ldp	%0, %1, [%4]\n"
+				"ldp	%2, %3, [%4, #16]\n"
+				"stp	%0, %1, [%5]\n"
+				"stp	%2, %3, [%5, #16]\n"
+				"ldp	%0, %1, [%4, #32]\n"
+				"ldp	%2, %3, [%4, #48]\n"
+				"stp	%0, %1, [%5, #32]\n"
+				"stp	%2, %3, [%5, #48]\n"
+				: "=&r"(a), "=&r"(b), "=&r"(c), "=&r"(e)
+				: "r"(s), "r"(d)
+				: "memory");
+		}
+#endif /* __ARM_64__ */
+		for (; len >= 4 * WSIZE; len -= 4 * WSIZE) {
+			((nolibc_word_t *)d)[0] = ((const nolibc_word_t *)s)[0];
+			((nolibc_word_t *)d)[1] = ((const nolibc_word_t *)s)[1];
+			((nolibc_word_t *)d)[2] = ((const nolibc_word_t *)s)[2];
+			((nolibc_word_t *)d)[3] = ((const nolibc_word_t *)s)[3];
+			d += 4 * WSIZE;
+			s += 4 * WSIZE;
+		}
+		for (; len >= WSIZE; len -= WSIZE, d += WSIZE, s += WSIZE)
+			*((nolibc_word_t *)d) = *((const nolibc_word_t *)s);
+	}
+
+	for (; len > 0; --len)
+		*(d++) = *(s++);
 
 	return dst;
 }
@@ -76,20 +193,60 @@ void *memcpy(void *dst, const void *src, size_t len)
 void *memset(void *ptr, int val, size_t len)
 {
 	__u8 *p = (__u8 *) ptr;
+	nolibc_word_t w;
+
+	if (len >= 4 * WSIZE) {
+		w = (nolibc_word_t)(__u8)val * WONES;
+
+		for (; (__uptr)p & WMASK; --len)
+			*(p++) = (__u8)val;
+
+#if defined(__ARM_64__)
+		for (; len >= 64; len -= 64, p += 64)
+			__asm__ __volatile__(
+				"stp	%0, %0, [%1]\n"
+				"stp	%0, %0, [%1, #16]\n"
+				"stp	%0, %0, [%1, #32]\n"
+				"stp	%0, %0, [%1, #48]\n"
+				:
+				: "r"(w), "r"(p)
+				: "memory");
+#endif /* __ARM_64__ */
+		for (; len >= WSIZE; len -= WSIZE, p += WSIZE)
+			*((nolibc_word_t *)p) = w;
+	}
 
 	for (; len > 0; --len)
 		*(p++) = (__u8)val;
 
 	return ptr;
 }
+#endif /* !__X86_64__ */
 
+/*
+ * The search functions below read whole aligned words. An aligned word
+ * never crosses a page boundary, so the bytes that are read behind the end
+ * of a string or buffer are on a page that is mapped.
+ */
 void *memchr(const void *ptr, int val, size_t len)
 {
-	uintptr_t o = 0;
+	const unsigned char *s = (const unsigned char *)ptr;
+	const nolibc_word_t *w;
+	nolibc_word_t k;
+
+	val = (unsigned char)val;
+	for (; ((__uptr)s & WMASK) && len > 0; ++s, --len)
+		if (*s == val)
+			return (void *)s;
+
+	k = WONES * val;
+	for (w = (const nolibc_word_t *)s;
+	     len >= WSIZE && !WHASZERO(*w ^ k); ++w, len -= WSIZE)
+		;
 
-	for (o = 0; o < (uintptr_t)len; ++o)
-		if (*((const uint8_t *)(((uintptr_t)ptr) + o)) == (uint8_t)val)
-			return (void *)((uintptr_t)ptr + o);
+	for (s = (const unsigned char *)w; len > 0; ++s, --len)
+		if (*s == val)
+			return (void *)s;
 
 	return NULL; /* did not find val */
 }
@@ -131,6 +288,19 @@ int memcmp(const void *ptr1, const void *ptr2, size_t len)
 	const unsigned char *c1 = (const unsigned char *)ptr1;
 	const unsigned char *c2 = (const unsigned char *)ptr2;
 
+	/* Skip over equal words, the byte loop below finds the difference */
+	if (len >= WSIZE && !(((__uptr)c1 ^ (__uptr)c2) & WMASK)) {
+		for (; (__uptr)c1 & WMASK; --len, ++c1, ++c2) {
+			if ((*c1) != (*c2))
+				return ((*c1) - (*c2));
+		}
+		for (; len >= WSIZE; len -= WSIZE, c1 += WSIZE, c2 += WSIZE) {
+			if (*((const nolibc_word_t *)c1) !=
+			    *((const nolibc_word_t *)c2))
+				break;
+		}
+	}
+
 	for (; len > 0; --len, ++c1, ++c2) {
 		if ((*c1) != (*c2))
 			return ((*c1) - (*c2));
@@ -141,7 +311,19 @@ int memcmp(const void *ptr1, const void *ptr2, size_t len)
 
 size_t strlen(const char *str)
 {
-	return strnlen(str, SIZE_MAX);
+	const char *s = str;
+	const nolibc_word_t *w;
+
+	for (; (__uptr)s & WMASK; ++s)
+		if (*s == '\0')
+			return s - str;
+
+	for (w = (const nolibc_word_t *)s; !WHASZERO(*w); ++w)
+		;
+
+	for (s = (const char *)w; *s != '\0'; ++s)
+		;
+	return s - str;
 }
 
 size_t strnlen(const char *str, size_t len)
@@ -194,12 +376,30 @@ int strncmp(const char *str1, const char *str2, size_t len)
 
 int strcmp(const char *str1, const char *str2)
 {
-	register signed char __res;
+	const unsigned char *c1 = (const unsigned char *)str1;
+	const unsigned char *c2 = (const unsigned char *)str2;
+	const nolibc_word_t *w1, *w2;
 
-	while ((__res = *str1 - *str2++) == 0 && *str1++)
-		;
+	/* Skip over equal words without a NUL if both strings can be aligned,
+	 * the byte loop below finds the difference or the end
+	 */
+	if (!(((__uptr)c1 ^ (__uptr)c2) & WMASK)) {
+		for (; (__uptr)c1 & WMASK; ++c1, ++c2) {
+			if (*c1 != *c2 || *c1 == '\0')
+				return *c1 - *c2;
+		}
 
-	return __res;
+		w1 = (const nolibc_word_t *)c1;
+		w2 = (const nolibc_word_t *)c2;
+		for (; *w1 == *w2 && !WHASZERO(*w1); ++w1, ++w2)
+			;
+		c1 = (const unsigned char *)w1;
+		c2 = (const unsigned char *)w2;
+	}
+
+	for (; *c1 == *c2 && *c1 != '\0'; ++c1, ++c2)
+		;
+	return *c1 - *c2;
 }
 
 /* The following code is taken from musl libc */
@@ -31,6 +31,45 @@ struct evfd_alloc {
 };
 
 
+/*
+ * Fast paths for event updates
+ *
+ * Taking the pollqueue locks on every signal dominates the cost of an eventfd
+ * that is used for cross-thread wake-ups. An update only needs the slow path
+ * if it changes the event level, or if someone needs to hear about it:
+ * Blocked threads, or chained registrations like epoll, which expect an
+ * event on every write. Threads check the level before they block and setting
+ * a new level goes through the wait list lock, so skipping the update of an
+ * unchanged level cannot lose a wake-up.
+ */
+static inline uk_pollevent evfd_listeners(struct uk_pollq *q)
+{
+#if CONFIG_LIBUKFILE_CHAINUPDATE
+	return uk_load_n(&q->waitmask) | uk_load_n(&q->propmask);
+#else /* !CONFIG_LIBUKFILE_CHAINUPDATE */
+	return uk_load_n(&q->waitmask);
+#endif /* !CONFIG_LIBUKFILE_CHAINUPDATE */
+}
+
+static inline void evfd_event_set(const struct uk_file *f, uk_pollevent ev)
+{
+	struct uk_pollq *q = &f->state->pollq;
+
+	if (uk_pollq_poll_immediate(q, ev) == ev &&
+	    !(evfd_listeners(q) & ev))
+		return;
+	uk_pollq_set(q, ev);
+}
+
+static inline void evfd_event_clear(const struct uk_file *f, uk_pollevent ev)
+{
+	struct uk_pollq *q = &f->state->pollq;
+
+	if (!uk_pollq_poll_immediate(q, ev) && !(evfd_listeners(q) & ev))
+		return;
+	uk_pollq_clear(q, ev);
+}
+
 static ssize_t evfd_read(const struct uk_file *f,
 			 const struct iovec *iov, int iovcnt,
 			 off_t off, long flags __unused)
@@ -49,7 +88,7 @@ static ssize_t evfd_read(const struct uk_file *f,
 
 	semaphore = f->vol == EVENTFD_SEM_VOLID;
 	n = (evfd_node)f->node;
-	val = *n;
+	val = uk_load_n(n);
 	do {
 		if (unlikely(!val))
 			return -EAGAIN;
@@ -62,45 +101,62 @@ static ssize_t evfd_read(const struct uk_file *f,
 		}
 	} while (!uk_compare_exchange_n(n, &val, next));
 
-	if (!next)
-		uk_file_event_clear(f, UKFD_POLLIN);
-	uk_file_event_set(f, UKFD_POLLOUT);
+	if (!next) {
+		evfd_event_clear(f, UKFD_POLLIN);
+		/* A writer may have raised the counter before we cleared */
+		if (uk_load_n(n))
+			evfd_event_set(f, UKFD_POLLIN);
+	}
+	evfd_event_set(f, UKFD_POLLOUT);
 
 	*(uint64_t *)iov[0].iov_base = ret;
 	return sizeof(ret);
 }
 
-
-static ssize_t evfd_write(const struct uk_file *f,
-			  const struct iovec *iov, int iovcnt,
-			  off_t off, long flags __unused)
+/* Adds `add` to the counter of `f` and signals readers */
+static int evfd_add(const struct uk_file *f, uint64_t add)
 {
-	uint64_t add;
 	evfd_node n;
 	uint64_t val;
 
-	UK_ASSERT(_IS_EVFVOL(f->vol));
-	if (unlikely(off))
-		return -ESPIPE;
-	if (unlikely(!iovcnt || iov[0].iov_len < sizeof(uint64_t)))
-		return -EINVAL;
-
-	add = *(uint64_t *)iov[0].iov_base;
 	if (unlikely(add == UINT64_MAX))
 		return -EINVAL;
 
 	n = (evfd_node)f->node;
-	val = *n;
+	val = uk_load_n(n);
 	do {
 		if (add > UINT64_MAX - 1 - val)
 			return -EAGAIN;
 	} while (!uk_compare_exchange_n(n, &val, val + add));
 
-	if (val + add == UINT64_MAX - 1)
-		uk_file_event_clear(f, UKFD_POLLOUT);
-	uk_file_event_set(f, UKFD_POLLIN);
+	if (val + add == UINT64_MAX - 1) {
+		evfd_event_clear(f, UKFD_POLLOUT);
+		/* A reader may have drained the counter before we cleared */
+		if (uk_load_n(n) != UINT64_MAX - 1)
+			evfd_event_set(f, UKFD_POLLOUT);
+	}
+	evfd_event_set(f, UKFD_POLLIN);
+
+	return 0;
+}
+
+static ssize_t evfd_write(const struct uk_file *f,
+			  const struct iovec *iov, int iovcnt,
+			  off_t off, long flags __unused)
+{
+	int rc;
+
+	UK_ASSERT(_IS_EVFVOL(f->vol));
+	if (unlikely(off))
+		return -ESPIPE;
+	if (unlikely(!iovcnt || iov[0].iov_len < sizeof(uint64_t)))
+		return -EINVAL;
+
+	rc = evfd_add(f, *(uint64_t *)iov[0].iov_base);
+	if (unlikely(rc))
+		return rc;
 
-	return sizeof(val);
+	return sizeof(uint64_t);
 }
 
 static const struct uk_file_ops evfd_ops = {
@@ -153,6 +209,16 @@ struct uk_file *uk_eventfile_create(unsigned int count, int flags)
 	return &al->f;
 }
 
+int uk_eventfd_signal(const struct uk_file *f, uint64_t add)
+{
+	UK_ASSERT(f);
+
+	if (unlikely(!_IS_EVFVOL(f->vol)))
+		return -EINVAL;
+
+	return evfd_add(f, add);
+}
+
 int uk_sys_eventfd(unsigned int count, int flags)
 {
 	int ret;
@@ -13,6 +13,21 @@
 
 struct uk_file *uk_eventfile_create(unsigned int count, int flags);
 
+/**
+ * Add `add` to the counter of the eventfd `f` and wake up its readers, like
+ * a write(2) to the file would. This allows drivers and kernel threads to
+ * signal event loops of the application without going through the syscall
+ * layer. Must not be called from interrupt context.
+ *
+ * @param f Eventfd file, e.g., from `uk_eventfile_create()`.
+ * @param add Value to add to the counter.
+ *
+ * @return
+ *   0 on success, -EINVAL if `f` is not an eventfd or `add` is UINT64_MAX,
+ *   -EAGAIN if the counter would overflow
+ */
+int uk_eventfd_signal(const struct uk_file *f, uint64_t add);
+
 int uk_sys_eventfd(unsigned int count, int flags);
 
 #endif /* __UK_POSIX_EVENTFD_H__ */
@@ -16,6 +16,8 @@
 #include <uk/posix-fdtab.h>
 #include <uk/syscall.h>
 
+#include "fdio-impl.h"
+
 
 /* I/O */
 
@@ -106,7 +108,7 @@ UK_SYSCALL_R_DEFINE(ssize_t, readv, int, fd,
 
 	switch (uk_fdtab_shim_get(fd, &sf)) {
 	case UK_SHIM_OFILE:
-		r = uk_sys_readv(sf.ofile, iov, iovcnt);
+		r = _fdio_readv_fast(sf.ofile, iov, iovcnt);
 		uk_fdtab_ret(sf.ofile);
 		break;
 #if CONFIG_LIBVFSCORE
@@ -128,7 +130,7 @@ UK_SYSCALL_R_DEFINE(ssize_t, read, int, fd,
 
 	switch (uk_fdtab_shim_get(fd, &sf)) {
 	case UK_SHIM_OFILE:
-		r = uk_sys_read(sf.ofile, buf, count);
+		r = _fdio_readv_fast(sf.ofile, &_buf2iov(buf, count), 1);
 		uk_fdtab_ret(sf.ofile);
 		break;
 #if CONFIG_LIBVFSCORE
@@ -224,7 +226,7 @@ UK_SYSCALL_R_DEFINE(ssize_t, writev, int, fd, const struct iovec *, iov,
 
 	switch (uk_fdtab_shim_get(fd, &sf)) {
 	case UK_SHIM_OFILE:
-		r = uk_sys_writev(sf.ofile, iov, iovcnt);
+		r = _fdio_writev_fast(sf.ofile, iov, iovcnt);
 		uk_fdtab_ret(sf.ofile);
 		break;
 #if CONFIG_LIBVFSCORE
@@ -245,7 +247,8 @@ UK_SYSCALL_R_DEFINE(ssize_t, write, int, fd, const void *, buf, size_t, count)
 
 	switch (uk_fdtab_shim_get(fd, &sf)) {
 	case UK_SHIM_OFILE:
-		r = uk_sys_write(sf.ofile, buf, count);
+		r = _fdio_writev_fast(sf.ofile,
+				      &_buf2iov((void *)buf, count), 1);
 		uk_fdtab_ret(sf.ofile);
 		break;
 #if CONFIG_LIBVFSCORE
@@ -6,6 +6,8 @@
 
 /* Internal syscalls for file control operations */
 
+#define _GNU_SOURCE /* F_{GET,SET}PIPE_SZ */
+
 #include <sys/ioctl.h>
 
 #include <uk/atomic.h>
@@ -54,6 +56,8 @@ int uk_sys_ioctl(struct uk_ofile *of, int cmd, void *arg)
 
 int uk_sys_fcntl(struct uk_ofile *of, int cmd, unsigned long arg)
 {
+	int r;
+
 	switch (cmd) {
 	case F_GETFL:
 		return of->mode & UKFD_MODE_MASK;
@@ -68,6 +72,24 @@ int uk_sys_fcntl(struct uk_ofile *of, int cmd, unsigned long arg)
 		} while (!uk_compare_exchange_n(&of->mode, &mode, newmode));
 		return 0;
 	}
+	case F_GETPIPE_SZ:
+		r = uk_file_ctl(of->file, UKFILE_CTL_FILE,
+				UKFILE_CTL_FILE_PIPE_SZ, 0, 0, 0);
+		return r == -ENOSYS ? -EBADF : r;
+	case F_SETPIPE_SZ:
+	{
+		const int iolock = _SHOULD_LOCK(of->mode);
+
+		if (unlikely((int)arg < 0))
+			return -EINVAL;
+		if (iolock)
+			uk_file_wlock(of->file);
+		r = uk_file_ctl(of->file, UKFILE_CTL_FILE,
+				UKFILE_CTL_FILE_PIPE_SZ, MAX(arg, 1UL), 0, 0);
+		if (iolock)
+			uk_file_wunlock(of->file);
+		return r == -ENOSYS ? -EBADF : r;
+	}
 	default:
 		uk_pr_warn("STUB: fcntl(%d)\n", cmd);
 		return -EINVAL;
@@ -10,6 +10,7 @@
 #include <fcntl.h>
 
 #include <uk/posix-fd.h>
+#include <uk/posix-fdio.h>
 #include <uk/mutex.h>
 
 /* Open file helpers */
@@ -25,7 +26,76 @@
 #define _IS_BLOCKING(m) (!((m) & O_NONBLOCK))
 #define _IS_APPEND(m)  (!!((m) & O_APPEND))
 
+#define _SHOULD_BLOCK(r, m) ((r) == -EAGAIN && _IS_BLOCKING((m)))
+
+/* Stable mode bits to pass onto the read/write implementations */
+#define _READ_MODEMASK 0
+#define _WRITE_MODEMASK (O_SYNC|O_DSYNC)
+
 #define _of_lock(of) uk_mutex_lock(&(of)->lock)
 #define _of_unlock(of) uk_mutex_unlock(&(of)->lock)
 
+#define _buf2iov(buf, count) \
+	((struct iovec){ .iov_base = (buf), .iov_len = (count) })
+
+/* I/O fast paths
+ *
+ * Streams (pipes, sockets, eventfds, ...) have no file position to maintain,
+ * so a read or write that does not block is a single call into the driver.
+ * These go there directly through the cached ops and only fall back to the
+ * generic path for other files and for blocking.
+ */
+
+static inline
+ssize_t _fdio_readv_fast(struct uk_ofile *of, const struct iovec *iov,
+			 int iovcnt)
+{
+	unsigned int mode = of->mode;
+	int iolock;
+	ssize_t r;
+
+	if (unlikely(_IS_SEEKABLE(mode) || !_CAN_READ(mode)))
+		return uk_sys_readv(of, iov, iovcnt);
+	if (unlikely(iovcnt < 0))
+		return -EINVAL;
+	if (unlikely(!iov && iovcnt))
+		return -EFAULT;
+
+	iolock = _SHOULD_LOCK(mode);
+	if (iolock)
+		uk_file_rlock(of->file);
+	r = of->ops->read(of->file, iov, iovcnt, 0, mode & _READ_MODEMASK);
+	if (iolock)
+		uk_file_runlock(of->file);
+	if (unlikely(_SHOULD_BLOCK(r, mode)))
+		return uk_sys_readv(of, iov, iovcnt);
+	return r;
+}
+
+static inline
+ssize_t _fdio_writev_fast(struct uk_ofile *of, const struct iovec *iov,
+			  int iovcnt)
+{
+	unsigned int mode = of->mode;
+	int iolock;
+	ssize_t r;
+
+	if (unlikely(_IS_SEEKABLE(mode) || !_CAN_WRITE(mode)))
+		return uk_sys_writev(of, iov, iovcnt);
+	if (unlikely(iovcnt < 0))
+		return -EINVAL;
+	if (unlikely(!iov && iovcnt))
+		return -EFAULT;
+
+	iolock = _SHOULD_LOCK(mode);
+	if (iolock)
+		uk_file_wlock(of->file);
+	r = of->ops->write(of->file, iov, iovcnt, 0, mode & _WRITE_MODEMASK);
+	if (iolock)
+		uk_file_wunlock(of->file);
+	if (unlikely(_SHOULD_BLOCK(r, mode)))
+		return uk_sys_writev(of, iov, iovcnt);
+	return r;
+}
+
 #endif /* __UK_POSIX_FDIO_IMPL_H__ */
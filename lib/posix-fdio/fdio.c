@@ -12,16 +12,6 @@
 
 #include "fdio-impl.h"
 
-/* Stable mode bits to pass onto the read/write implementations */
-#define _READ_MODEMASK 0
-#define _WRITE_MODEMASK (O_SYNC|O_DSYNC)
-
-
-#define _buf2iov(buf, count) \
-	((struct iovec){ .iov_base = (buf), .iov_len = (count) })
-
-#define _SHOULD_BLOCK(r, m) ((r) == -EAGAIN && _IS_BLOCKING((m)))
-
 
 static inline
 ssize_t fdio_get_eof(const struct uk_file *f)
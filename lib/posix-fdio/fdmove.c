@@ -0,0 +1,383 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * In-kernel data movers: sendfile, splice and copy_file_range
+ *
+ * Data is moved between any two open files, regardless of whether they are
+ * backed by posix-fdio (pipes, sockets, ...) or by vfscore, through a
+ * bounded staging buffer, without a round trip through user buffers.
+ */
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <uk/alloc.h>
+#include <uk/posix-fdio.h>
+#if CONFIG_LIBVFSCORE
+#include <vfscore/dentry.h>
+#include <vfscore/file.h>
+#include <vfscore/fs.h>
+#include <vfscore/syscalls.h>
+#include <vfscore/vnode.h>
+#endif /* CONFIG_LIBVFSCORE */
+#include <uk/posix-fdtab.h>
+#include <uk/syscall.h>
+
+#include "fdio-impl.h"
+
+/* Largest amount of data staged per read/write round */
+#define FDMOVE_CHUNK (64 * 1024)
+
+/* One end of a transfer */
+struct fdmove_end {
+	int type; /* UK_SHIM_OFILE or UK_SHIM_LEGACY */
+	union uk_shim_file sf;
+};
+
+static int fdm_get(int fd, struct fdmove_end *e, int write)
+{
+	e->type = uk_fdtab_shim_get(fd, &e->sf);
+	switch (e->type) {
+	case UK_SHIM_OFILE:
+		if (write ? _CAN_WRITE(e->sf.ofile->mode)
+			  : _CAN_READ(e->sf.ofile->mode))
+			return 0;
+		uk_fdtab_ret(e->sf.ofile);
+		return -EBADF;
+#if CONFIG_LIBVFSCORE
+	case UK_SHIM_LEGACY:
+		if (e->sf.vfile->f_flags & (write ? UK_FWRITE : UK_FREAD))
+			return 0;
+		fdrop(e->sf.vfile);
+		return -EBADF;
+#endif /* CONFIG_LIBVFSCORE */
+	default:
+		return -EBADF;
+	}
+}
+
+static void fdm_put(struct fdmove_end *e)
+{
+	switch (e->type) {
+	case UK_SHIM_OFILE:
+		uk_fdtab_ret(e->sf.ofile);
+		break;
+#if CONFIG_LIBVFSCORE
+	case UK_SHIM_LEGACY:
+		fdrop(e->sf.vfile);
+		break;
+#endif /* CONFIG_LIBVFSCORE */
+	}
+}
+
+/* Identity of the underlying file, to detect moves within one file */
+static const void *fdm_file(const struct fdmove_end *e)
+{
+#if CONFIG_LIBVFSCORE
+	if (e->type == UK_SHIM_LEGACY)
+		return e->sf.vfile->f_dentry ?
+		       (const void *)e->sf.vfile->f_dentry->d_vnode :
+		       (const void *)e->sf.vfile;
+#endif /* CONFIG_LIBVFSCORE */
+	return e->sf.ofile->file;
+}
+
+static int fdm_seekable(const struct fdmove_end *e)
+{
+#if CONFIG_LIBVFSCORE
+	if (e->type == UK_SHIM_LEGACY)
+		return !(e->sf.vfile->f_vfs_flags & UK_VFSCORE_NOPOS);
+#endif /* CONFIG_LIBVFSCORE */
+	return _IS_SEEKABLE(e->sf.ofile->mode);
+}
+
+static int fdm_isfifo(const struct fdmove_end *e)
+{
+	struct uk_statx statx;
+
+#if CONFIG_LIBVFSCORE
+	if (e->type == UK_SHIM_LEGACY)
+		return e->sf.vfile->f_dentry &&
+		       e->sf.vfile->f_dentry->d_vnode->v_type == VFIFO;
+#endif /* CONFIG_LIBVFSCORE */
+	if (uk_sys_fstatx(e->sf.ofile, UK_STATX_TYPE, &statx))
+		return 0;
+	return (statx.stx_mask & UK_STATX_TYPE) && S_ISFIFO(statx.stx_mode);
+}
+
+static off_t fdm_getpos(struct fdmove_end *e)
+{
+	off_t pos;
+
+#if CONFIG_LIBVFSCORE
+	if (e->type == UK_SHIM_LEGACY)
+		return e->sf.vfile->f_offset;
+#endif /* CONFIG_LIBVFSCORE */
+	_of_lock(e->sf.ofile);
+	pos = e->sf.ofile->pos;
+	_of_unlock(e->sf.ofile);
+	return pos;
+}
+
+static void fdm_setpos(struct fdmove_end *e, off_t pos)
+{
+#if CONFIG_LIBVFSCORE
+	if (e->type == UK_SHIM_LEGACY) {
+		off_t r;
+
+		vfscore_lseek(e->sf.vfile, pos, SEEK_SET, &r);
+		return;
+	}
+#endif /* CONFIG_LIBVFSCORE */
+	_of_lock(e->sf.ofile);
+	e->sf.ofile->pos = pos;
+	_of_unlock(e->sf.ofile);
+}
+
+/* Read at `off`, or at the file position if `off` is -1 */
+static ssize_t fdm_read(struct fdmove_end *e, void *buf, size_t len, off_t off)
+{
+#if CONFIG_LIBVFSCORE
+	if (e->type == UK_SHIM_LEGACY) {
+		/* The vfscore I/O calls consume a reference */
+		fhold(e->sf.vfile);
+		if (off == -1)
+			return vfscore_read(e->sf.vfile, buf, len);
+		return vfscore_pread64(e->sf.vfile, buf, len, off);
+	}
+#endif /* CONFIG_LIBVFSCORE */
+	if (off == -1)
+		return uk_sys_read(e->sf.ofile, buf, len);
+	return uk_sys_pread(e->sf.ofile, buf, len, off);
+}
+
+/* Write at `off`, or at the file position if `off` is -1 */
+static ssize_t fdm_write(struct fdmove_end *e, const void *buf, size_t len,
+			 off_t off)
+{
+#if CONFIG_LIBVFSCORE
+	if (e->type == UK_SHIM_LEGACY) {
+		fhold(e->sf.vfile);
+		if (off == -1)
+			return vfscore_write(e->sf.vfile, buf, len);
+		return vfscore_pwrite64(e->sf.vfile, buf, len, off);
+	}
+#endif /* CONFIG_LIBVFSCORE */
+	if (off == -1)
+		return uk_sys_write(e->sf.ofile, buf, len);
+	return uk_sys_pwrite(e->sf.ofile, buf, len, off);
+}
+
+/*
+ * Move up to `len` bytes from `in` to `out`. A NULL offset pointer means
+ * the file position is used, otherwise the offset is advanced by the amount
+ * of data moved.
+ *
+ * Only data that made it to `out` is consumed from a seekable `in`. Data
+ * read from a non-seekable `in` (e.g., a pipe) cannot be put back, so it is
+ * lost if `out` fails, like with a read/write loop in user space.
+ */
+static ssize_t fdm_move(struct fdmove_end *in, off_t *inoff,
+			struct fdmove_end *out, off_t *outoff, size_t len)
+{
+	struct uk_alloc *a;
+	size_t total = 0;
+	ssize_t r = 0;
+	char *buf;
+
+	if (!len)
+		return 0;
+
+	a = uk_alloc_get_default();
+	buf = uk_malloc(a, MIN(len, (size_t)FDMOVE_CHUNK));
+	if (unlikely(!buf))
+		return -ENOMEM;
+
+	while (total < len) {
+		size_t chunk = MIN(len - total, (size_t)FDMOVE_CHUNK);
+		size_t got, done;
+
+		r = fdm_read(in, buf, chunk, inoff ? *inoff : -1);
+		if (r <= 0)
+			break;
+
+		got = r;
+		for (done = 0; done < got; done += r) {
+			r = fdm_write(out, buf + done, got - done,
+				      outoff ? *outoff : -1);
+			if (r <= 0)
+				break;
+			if (outoff)
+				*outoff += r;
+		}
+		total += done;
+		if (inoff)
+			*inoff += done;
+		if (done < got || got < chunk)
+			break; /* Error on out, end of file or drained in */
+	}
+
+	uk_free(a, buf);
+	if (total)
+		return total;
+	return r;
+}
+
+UK_SYSCALL_R_DEFINE(ssize_t, sendfile, int, out_fd, int, in_fd,
+		    off_t *, offset, size_t, count)
+{
+	struct fdmove_end in, out;
+	ssize_t r;
+	off_t pos;
+
+	r = fdm_get(in_fd, &in, 0);
+	if (unlikely(r))
+		return r;
+	r = fdm_get(out_fd, &out, 1);
+	if (unlikely(r))
+		goto out_in;
+
+	/* Like Linux, only allow sources that can be read at an offset */
+	if (unlikely(!fdm_seekable(&in))) {
+		r = -EINVAL;
+		goto out_out;
+	}
+
+	if (offset) {
+		if (unlikely(*offset < 0)) {
+			r = -EINVAL;
+			goto out_out;
+		}
+		r = fdm_move(&in, offset, &out, NULL, count);
+	} else {
+		pos = fdm_getpos(&in);
+		r = fdm_move(&in, &pos, &out, NULL, count);
+		fdm_setpos(&in, pos);
+	}
+
+out_out:
+	fdm_put(&out);
+out_in:
+	fdm_put(&in);
+	return r;
+}
+
+UK_SYSCALL_R_DEFINE(ssize_t, splice, int, fd_in, off_t *, off_in,
+		    int, fd_out, off_t *, off_out, size_t, len,
+		    unsigned int, flags)
+{
+	struct fdmove_end in, out;
+	int in_fifo, out_fifo;
+	off_t inpos, outpos;
+	off_t *inoff, *outoff;
+	ssize_t r;
+
+	r = fdm_get(fd_in, &in, 0);
+	if (unlikely(r))
+		return r;
+	r = fdm_get(fd_out, &out, 1);
+	if (unlikely(r))
+		goto out_in;
+
+	in_fifo = fdm_isfifo(&in);
+	out_fifo = fdm_isfifo(&out);
+	if (unlikely(!in_fifo && !out_fifo)) {
+		r = -EINVAL;
+		goto out_out;
+	}
+	if (unlikely((in_fifo && off_in) || (out_fifo && off_out))) {
+		r = -ESPIPE;
+		goto out_out;
+	}
+
+	/* Offsets of seekable ends are handled like for pread/pwrite */
+	inoff = off_in;
+	if (!inoff && !in_fifo && fdm_seekable(&in)) {
+		inpos = fdm_getpos(&in);
+		inoff = &inpos;
+	}
+	outoff = off_out;
+	if (!outoff && !out_fifo && fdm_seekable(&out)) {
+		outpos = fdm_getpos(&out);
+		outoff = &outpos;
+	}
+
+	if (unlikely((inoff && *inoff < 0) || (outoff && *outoff < 0))) {
+		r = -EINVAL;
+		goto out_out;
+	}
+
+	/* SPLICE_F_* flags are hints only */
+	r = fdm_move(&in, inoff, &out, outoff, len);
+
+	if (inoff == &inpos)
+		fdm_setpos(&in, inpos);
+	if (outoff == &outpos)
+		fdm_setpos(&out, outpos);
+
+out_out:
+	fdm_put(&out);
+out_in:
+	fdm_put(&in);
+	return r;
+}
+
+UK_SYSCALL_R_DEFINE(ssize_t, copy_file_range, int, fd_in, off_t *, off_in,
+		    int, fd_out, off_t *, off_out, size_t, len,
+		    unsigned int, flags)
+{
+	struct fdmove_end in, out;
+	off_t inpos, outpos;
+	ssize_t r;
+
+	if (unlikely(flags))
+		return -EINVAL;
+
+	r = fdm_get(fd_in, &in, 0);
+	if (unlikely(r))
+		return r;
+	r = fdm_get(fd_out, &out, 1);
+	if (unlikely(r))
+		goto out_in;
+
+	if (unlikely(!fdm_seekable(&in) || !fdm_seekable(&out))) {
+		r = -EINVAL;
+		goto out_out;
+	}
+
+	inpos = off_in ? *off_in : fdm_getpos(&in);
+	outpos = off_out ? *off_out : fdm_getpos(&out);
+	if (unlikely(inpos < 0 || outpos < 0)) {
+		r = -EINVAL;
+		goto out_out;
+	}
+
+	/* Overlapping ranges within the same file are not allowed */
+	if (unlikely(fdm_file(&in) == fdm_file(&out) &&
+		     inpos < outpos + (off_t)len &&
+		     outpos < inpos + (off_t)len)) {
+		r = -EINVAL;
+		goto out_out;
+	}
+
+	r = fdm_move(&in, &inpos, &out, &outpos, len);
+
+	if (off_in)
+		*off_in = inpos;
+	else
+		fdm_setpos(&in, inpos);
+	if (off_out)
+		*off_out = outpos;
+	else
+		fdm_setpos(&out, outpos);
+
+out_out:
+	fdm_put(&out);
+out_in:
+	fdm_put(&in);
+	return r;
+}
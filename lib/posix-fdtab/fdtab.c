@@ -11,6 +11,7 @@
 #include <uk/assert.h>
 #include <uk/config.h>
 #include <uk/init.h>
+#include <uk/spinlock.h>
 #include <uk/syscall.h>
 
 #include <uk/posix-fdtab.h>
@@ -23,31 +24,43 @@
 
 #define UK_FDTAB_SIZE CONFIG_LIBPOSIX_FDTAB_MAXFDS
 UK_CTASSERT(UK_FDTAB_SIZE <= UK_FD_MAX);
+UK_CTASSERT(CONFIG_LIBPOSIX_FDTAB_NOFILE <= UK_FDTAB_SIZE);
+
+/* Open file descriptions are type-stable: Released ones are kept for reuse
+ * instead of being returned to the allocator. Lookups can thus take a
+ * reference without locking the table entry (see `_fdtab_get()`).
+ */
+struct fdtab_ofile {
+	struct uk_ofile of;
+	struct fdtab_ofile *next_free;
+};
 
 /* Static init fdtab */
 
-static char init_bmap[UK_BMAP_SZ(UK_FDTAB_SIZE)];
-static void *init_fdmap[UK_FDTAB_SIZE];
+static struct uk_fmap_seg *init_fdsegs[UK_FMAP_SEGS(UK_FDTAB_SIZE)];
 
 struct uk_fdtab {
 	struct uk_alloc *alloc;
 	struct uk_fmap fmap;
+	/* Released open file descriptions */
+	uk_spinlock ofile_lock;
+	struct fdtab_ofile *ofile_free;
 };
 
 static struct uk_fdtab init_fdtab = {
 	.fmap = {
-		.bmap = {
-			.size = UK_FDTAB_SIZE,
-			.bitmap = (unsigned long *)init_bmap
-		},
-		.map = init_fdmap
-	}
+		.segs = init_fdsegs,
+		.size = UK_FMAP_SEGS(UK_FDTAB_SIZE) * UK_FMAP_SEG_SIZE,
+		.limit = CONFIG_LIBPOSIX_FDTAB_NOFILE
+	},
+	.ofile_lock = UK_SPINLOCK_INITIALIZER(),
 };
 
 static int init_posix_fdtab(struct uk_init_ctx *ictx __unused)
 {
 	init_fdtab.alloc = uk_alloc_get_default();
-	/* Consider skipping init for .map (static vars are inited to 0) */
+	init_fdtab.fmap.a = init_fdtab.alloc;
+	/* Consider skipping init for .segs (static vars are inited to 0) */
 	uk_fmap_init(&init_fdtab.fmap);
 	return 0;
 }
@@ -100,15 +113,34 @@ static inline struct fdval fdtab_decode(void *p)
 /* struct uk_ofile allocation & refcounting */
 static inline struct uk_ofile *ofile_new(struct uk_fdtab *tab)
 {
-	struct uk_ofile *of = uk_malloc(tab->alloc, sizeof(*of));
+	struct fdtab_ofile *fof;
+
+	uk_spin_lock(&tab->ofile_lock);
+	fof = tab->ofile_free;
+	if (fof)
+		tab->ofile_free = fof->next_free;
+	uk_spin_unlock(&tab->ofile_lock);
+
+	if (!fof) {
+		fof = uk_malloc(tab->alloc, sizeof(*fof));
+		if (unlikely(!fof))
+			return NULL;
+	}
 
-	if (of)
-		uk_ofile_init(of);
-	return of;
+	/* Lookups do not take references on a count of 0, so the count is
+	 * not touched concurrently here
+	 */
+	uk_ofile_init(&fof->of);
+	return &fof->of;
 }
 static inline void ofile_del(struct uk_fdtab *tab, struct uk_ofile *of)
 {
-	uk_free(tab->alloc, of);
+	struct fdtab_ofile *fof = __containerof(of, struct fdtab_ofile, of);
+
+	uk_spin_lock(&tab->ofile_lock);
+	fof->next_free = tab->ofile_free;
+	tab->ofile_free = fof;
+	uk_spin_unlock(&tab->ofile_lock);
 }
 
 static inline void ofile_acq(struct uk_ofile *of)
@@ -174,19 +206,20 @@ int uk_fdtab_open(const struct uk_file *f, unsigned int mode)
 	ofile_acq(of);
 	/* Prepare open file */
 	of->file = f;
+	of->ops = f->ops;
 	of->pos = 0;
 	of->mode = mode & ~O_CLOEXEC;
 	/* Place the file in fdtab */
 	flags = (mode & O_CLOEXEC) ? UK_FDTAB_CLOEXEC : 0;
 	entry = fdtab_encode(of, flags);
 	fd = uk_fmap_put(&tab->fmap, entry, 0);
-	if (fd >= UK_FDTAB_SIZE)
+	if (unlikely(fd < 0))
 		goto err_out;
 	return fd;
 err_out:
 	/* Release open file & file ref */
 	ofile_rel(tab, of);
-	return -ENFILE;
+	return fd;
 }
 
 int uk_fdtab_setflags(int fd, int flags)
@@ -243,13 +276,13 @@ int uk_fdtab_legacy_open(struct vfscore_file *vf)
 	fhold(vf);
 	entry = fdtab_encode(vf, UK_FDTAB_VFSCORE);
 	fd = uk_fmap_put(&tab->fmap, entry, 0);
-	if (fd >= UK_FDTAB_SIZE)
+	if (unlikely(fd < 0))
 		goto err_out;
 	vf->fd = fd;
 	return fd;
 err_out:
 	fdrop(vf);
-	return -ENFILE;
+	return fd;
 }
 
 struct vfscore_file *uk_fdtab_legacy_get(int fd)
@@ -272,62 +305,80 @@ struct vfscore_file *uk_fdtab_legacy_get(int fd)
 }
 #endif /* CONFIG_LIBVFSCORE */
 
-int uk_fdtab_shim_get(int fd, union uk_shim_file *out)
+#endif /* CONFIG_LIBPOSIX_FDTAB_LEGACY_SHIM */
+
+#if CONFIG_LIBPOSIX_FDTAB_LEGACY_SHIM && CONFIG_LIBVFSCORE
+static struct fdval _fdtab_get_legacy(struct uk_fdtab *tab, int fd)
 {
-	struct uk_fdtab *tab;
-	struct uk_fmap *fmap;
-	void *p;
+	struct fdval ret = { NULL, 0 };
+	/* Need to refcount atomically => critical take & put */
+	struct uk_fmap *fmap = &tab->fmap;
+	void *p = uk_fmap_critical_take(fmap, fd);
 
-	if (fd < 0)
-		return -1;
+	if (p) {
+		ret = fdtab_decode(p);
+		file_acq(ret.p, ret.flags);
+		uk_fmap_critical_put(fmap, fd, p);
+	}
+	return ret;
+}
+#endif /* CONFIG_LIBPOSIX_FDTAB_LEGACY_SHIM && CONFIG_LIBVFSCORE */
 
-	tab = _active_tab();
-	fmap = &tab->fmap;
+/* Takes a reference on the file at `fd` without writing to the table. The
+ * open file may be released and reused between the lookup and taking the
+ * reference, which is safe because open files are type-stable. Whether the
+ * reference was taken on the right open file is checked with a second
+ * lookup.
+ */
+static struct fdval _fdtab_get(struct uk_fdtab *tab, int fd)
+{
+	struct fdval ret = { NULL, 0 };
+	struct uk_fmap *fmap = &tab->fmap;
+	struct uk_ofile *of;
+	void *p;
 
-	p = uk_fmap_critical_take(fmap, fd);
-	if (p) {
-		struct fdval v = fdtab_decode(p);
+	if (fd < 0)
+		return ret;
 
-#if CONFIG_LIBVFSCORE
-		if (v.flags & UK_FDTAB_VFSCORE) {
-			struct vfscore_file *vf = (struct vfscore_file *)v.p;
+	for (;;) {
+		p = uk_fmap_lookup(fmap, fd);
+		if (!p)
+			return ret;
 
-			fhold(vf);
-			uk_fmap_critical_put(fmap, fd, p);
-			out->vfile = vf;
-			return UK_SHIM_LEGACY;
-		} else
-#endif /* CONFIG_LIBVFSCORE */
-		{
-			struct uk_ofile *of = (struct uk_ofile *)v.p;
+		ret = fdtab_decode(p);
+#if CONFIG_LIBPOSIX_FDTAB_LEGACY_SHIM && CONFIG_LIBVFSCORE
+		if (ret.flags & UK_FDTAB_VFSCORE)
+			return _fdtab_get_legacy(tab, fd);
+#endif /* CONFIG_LIBPOSIX_FDTAB_LEGACY_SHIM && CONFIG_LIBVFSCORE */
 
-			ofile_acq(of);
-			uk_fmap_critical_put(fmap, fd, p);
-			out->ofile = of;
-			return UK_SHIM_OFILE;
+		of = (struct uk_ofile *)ret.p;
+		if (uk_refcount_acquire_if_not_zero(&of->refcnt)) {
+			if (likely(uk_fmap_lookup(fmap, fd) == p))
+				return ret;
+			ofile_rel(tab, of);
 		}
+		/* The entry changed meanwhile, retry */
 	}
-	return -1;
 }
-#endif /* CONFIG_LIBPOSIX_FDTAB_LEGACY_SHIM */
 
-static struct fdval _fdtab_get(struct uk_fdtab *tab, int fd)
+#if CONFIG_LIBPOSIX_FDTAB_LEGACY_SHIM
+int uk_fdtab_shim_get(int fd, union uk_shim_file *out)
 {
-	struct fdval ret = { NULL, 0 };
+	struct fdval v = _fdtab_get(_active_tab(), fd);
 
-	if (fd >= 0) {
-		/* Need to refcount atomically => critical take & put */
-		struct uk_fmap *fmap = &tab->fmap;
-		void *p = uk_fmap_critical_take(fmap, fd);
+	if (!v.p)
+		return -1;
 
-		if (p) {
-			ret = fdtab_decode(p);
-			file_acq(ret.p, ret.flags);
-			uk_fmap_critical_put(fmap, fd, p);
-		}
+#if CONFIG_LIBVFSCORE
+	if (v.flags & UK_FDTAB_VFSCORE) {
+		out->vfile = (struct vfscore_file *)v.p;
+		return UK_SHIM_LEGACY;
 	}
-	return ret;
+#endif /* CONFIG_LIBVFSCORE */
+	out->ofile = (struct uk_ofile *)v.p;
+	return UK_SHIM_OFILE;
 }
+#endif /* CONFIG_LIBPOSIX_FDTAB_LEGACY_SHIM */
 
 struct uk_ofile *uk_fdtab_get(int fd)
 {
@@ -344,6 +395,21 @@ struct uk_ofile *uk_fdtab_get(int fd)
 	return (struct uk_ofile *)v.p;
 }
 
+unsigned int uk_fdtab_get_limit(void)
+{
+	return _active_tab()->fmap.limit;
+}
+
+int uk_fdtab_set_limit(unsigned int limit)
+{
+	if (unlikely(limit > UK_FDTAB_SIZE))
+		return -EPERM;
+
+	/* Descriptors above a lowered limit stay open */
+	uk_store_n(&_active_tab()->fmap.limit, limit);
+	return 0;
+}
+
 void uk_fdtab_ret(struct uk_ofile *of)
 {
 	UK_ASSERT(of);
@@ -355,8 +421,16 @@ static void fdtab_cleanup(int all)
 	struct uk_fdtab *tab = _active_tab();
 	struct uk_fmap *fmap = &tab->fmap;
 
-	for (int i = 0; i < UK_FDTAB_SIZE; i++) {
-		void *p = uk_fmap_lookup(fmap, i);
+	for (int i = 0; i < (int)fmap->size; i++) {
+		void *p;
+
+		/* Skip segments that were never used */
+		if (!fmap->segs[i / UK_FMAP_SEG_SIZE]) {
+			i += UK_FMAP_SEG_SIZE - 1;
+			continue;
+		}
+
+		p = uk_fmap_lookup(fmap, i);
 
 		if (p) {
 			struct fdval v = fdtab_decode(p);
@@ -407,21 +481,21 @@ int uk_sys_close(int fd)
 
 int uk_sys_dup3(int oldfd, int newfd, int flags)
 {
-	int r __maybe_unused;
 	struct uk_fdtab *tab;
 	struct fdval dup;
 	void *prevp;
+	int r;
 	const void *newent;
 
 	if (unlikely(oldfd == newfd))
 		return -EINVAL;
-	if (unlikely(oldfd < 0 || oldfd >= UK_FDTAB_SIZE ||
-	    newfd < 0 || newfd >= UK_FDTAB_SIZE))
+	tab = _active_tab();
+	if (unlikely(oldfd < 0 || newfd < 0 ||
+		     (unsigned int)newfd >= tab->fmap.limit))
 		return -EBADF;
 	if (unlikely(flags & ~O_CLOEXEC))
 		return -EINVAL;
 
-	tab = _active_tab();
 	dup = _fdtab_get(tab, oldfd);
 	if (unlikely(!dup.p))
 		return -EBADF; /* oldfd not open */
@@ -431,7 +505,11 @@ int uk_sys_dup3(int oldfd, int newfd, int flags)
 	prevp = NULL;
 	newent = fdtab_encode(dup.p, dup.flags);
 	r = uk_fmap_xchg(&tab->fmap, newfd, newent, &prevp);
-	UK_ASSERT(!r); /* newfd should be in range */
+	if (unlikely(r)) {
+		UK_ASSERT(r == -ENOMEM); /* newfd should be in range */
+		file_rel(tab, dup.p, dup.flags);
+		return r;
+	}
 	if (prevp) {
 		struct fdval prevv = fdtab_decode(prevp);
 
@@ -460,10 +538,11 @@ int uk_sys_dup_min(int oldfd, int min, int flags)
 
 	if (unlikely(oldfd < 0))
 		return -EBADF;
-	if (unlikely(flags & ~O_CLOEXEC))
+	tab = _active_tab();
+	if (unlikely(flags & ~O_CLOEXEC ||
+		     min < 0 || (unsigned int)min >= tab->fmap.limit))
 		return -EINVAL;
 
-	tab = _active_tab();
 	dup = _fdtab_get(tab, oldfd);
 	if (unlikely(!dup.p))
 		return -EBADF;
@@ -472,10 +551,8 @@ int uk_sys_dup_min(int oldfd, int min, int flags)
 
 	newent = fdtab_encode(dup.p, dup.flags);
 	fd = uk_fmap_put(&tab->fmap, newent, min);
-	if (unlikely(fd >= UK_FDTAB_SIZE)) {
+	if (unlikely(fd < 0))
 		file_rel(tab, dup.p, dup.flags);
-		return -ENFILE;
-	}
 	return fd;
 }
 
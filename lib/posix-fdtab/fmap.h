@@ -9,8 +9,10 @@
 #ifndef __UK_FDTAB_FMAP_H__
 #define __UK_FDTAB_FMAP_H__
 
+#include <errno.h>
 #include <string.h>
 
+#include <uk/alloc.h>
 #include <uk/atomic.h>
 #include <uk/assert.h>
 #include <uk/bitops.h>
@@ -18,170 +20,244 @@
 #include <uk/essentials.h>
 #include <uk/thread.h>
 
+/*
+ * The map is split into segments of `UK_FMAP_SEG_SIZE` entries, which are
+ * allocated when an index within them is needed for the first time. Only
+ * the directory of segments is sized for the largest index. Segments are
+ * never freed while the map is in use, so readers need not synchronize with
+ * the growth of the map.
+ *
+ * Each segment tracks its free indices in a two-level bitmap: one bit per
+ * entry, and a summary word with one bit per bitmap word that may contain
+ * a free index. Finding the lowest free index in a segment therefore reads
+ * the summary and the first bitmap word that it points to.
+ */
+
+/* Bitmap words per segment, all covered by a single summary word */
+#define UK_FMAP_SEG_WORDS	UK_BITS_PER_LONG
+/* Entries per segment */
+#define UK_FMAP_SEG_SIZE	(UK_FMAP_SEG_WORDS * UK_BITS_PER_LONG)
+
 /**
- * Bitmap telling if a file descriptor is used or not.
+ * Gets the number of segments needed for a number of entries.
+ *
+ * @param s
+ *   Number of elements in the map
+ * @return
+ *   Number of directory entries
  */
-struct uk_bmap {
+#define UK_FMAP_SEGS(s) howmany((s), UK_FMAP_SEG_SIZE)
+
+struct uk_fmap_seg {
+	/* Bit `w` is set if word `w` of `bitmap` may have a free index */
+	volatile unsigned long summary;
 	/* Lock-free bitmap, with ones representing a free index */
-	volatile unsigned long *bitmap;
-	/* Size of the bitmap */
+	volatile unsigned long bitmap[UK_FMAP_SEG_WORDS];
+	/* Map of pointers to open file descriptions */
+	void *volatile map[UK_FMAP_SEG_SIZE];
+};
+
+/**
+ * Data structure mapping between integers and open file descriptions.
+ */
+struct uk_fmap {
+	/* Allocator for the segments */
+	struct uk_alloc *a;
+	/* Directory of segments; NULL for segments not used yet */
+	struct uk_fmap_seg *volatile *segs;
+	/* Number of entries that the directory covers */
 	size_t size;
+	/* New entries are only placed below the limit */
+	volatile size_t limit;
 };
 
 /**
- * Gets the size of the bitmap in bytes.
+ * Checks if the index given is in the range of the map.
  *
- * @param s
- *   Number of elements in the bitmap
+ * @param m
+ *   fmap that gives us the maximum value that the index can have
+ * @param i
+ *   Index that we check if it is in range from 0 to size of the map
  * @return
- *   Size of the bitmap in bytes
+ *   0 if the index is not in the range, 1 otherwise
  */
-#define UK_BMAP_SZ(s) (UK_BITS_TO_LONGS(s) * sizeof(unsigned long))
+#define _FMAP_INRANGE(m, i) ((i >= 0) && IN_RANGE((size_t)i, 0, (m)->size))
 
+#define _FMAP_SEG(i)	((unsigned int)(i) / UK_FMAP_SEG_SIZE)
+#define _FMAP_OFF(i)	((unsigned int)(i) % UK_FMAP_SEG_SIZE)
 
 /**
- * Initializes the bitmap (fills it with ones);
+ * Initializes the memory for a uk_fmap;
  * must not be called concurrently with other functions.
  *
- * @param bm
- *   Bitmap to be initialized
+ * The `a`, `size`, and `limit` fields must be correctly set and the
+ * directory allocated.
+ *
+ * @param m
+ *   fmap to be initialized
  */
-static inline void uk_bmap_init(const struct uk_bmap *bm)
+static inline void uk_fmap_init(const struct uk_fmap *m)
 {
-	uk_bitmap_fill((void *)bm->bitmap, bm->size);
+	UK_ASSERT(m->limit <= m->size);
+
+	memset((void *)m->segs, 0,
+	       UK_FMAP_SEGS(m->size) * sizeof(struct uk_fmap_seg *));
 }
 
-/**
- * Marks `idx` as used, and returns whether we were the ones to do so.
- *
- * @param bm
- *   Bitmap in which to mark
- * @param idx
- *   Index to mark as used
- * @return
- *   0 if we marked `idx` as used, non-zero otherwise
- */
-static inline int uk_bmap_reserve(const struct uk_bmap *bm, int idx)
+/* Returns the segment of `idx`, or NULL if it is not allocated yet */
+static inline struct uk_fmap_seg *_fmap_seg(const struct uk_fmap *m, int idx)
 {
-	unsigned long mask;
-	unsigned long v;
+	return uk_load_n(&m->segs[_FMAP_SEG(idx)]);
+}
 
-	if (!((idx >= 0) && IN_RANGE((size_t)idx, 0, bm->size)))
-		return -1;
-	mask = UK_BIT_MASK(idx);
-	v = uk_and(&bm->bitmap[UK_BIT_WORD(idx)], ~mask);
-	return !(v & mask);
+/* Returns segment `s`, allocating it if needed; NULL if out of memory */
+static inline
+struct uk_fmap_seg *_fmap_seg_get(const struct uk_fmap *m, unsigned int s)
+{
+	struct uk_fmap_seg *seg, *new;
+
+	seg = uk_load_n(&m->segs[s]);
+	if (likely(seg))
+		return seg;
+
+	new = uk_malloc(m->a, sizeof(*new));
+	if (unlikely(!new))
+		return NULL;
+	new->summary = ~0UL;
+	memset((void *)new->bitmap, 0xff, sizeof(new->bitmap));
+	memset((void *)new->map, 0, sizeof(new->map));
+
+	/* If another thread installed the segment first, use that one */
+	if (!uk_compare_exchange_n(&m->segs[s], &seg, new)) {
+		uk_free(m->a, new);
+		return seg;
+	}
+	return new;
 }
 
 /**
- * Marks `idx` as free, and returns whether we were the ones to do so.
+ * Marks `off` as used, and returns whether we were the ones to do so.
  *
- * @param bm
- *   Bitmap in which to mark
- * @param idx
- *   Index to mark as free
  * @return
- *   0 if we freed `idx`, non-zero if it was already free or out of range
+ *   0 if we marked `off` as used, non-zero otherwise
  */
-static inline int uk_bmap_free(const struct uk_bmap *bm, int idx)
+static inline int _fmap_seg_reserve(struct uk_fmap_seg *seg, unsigned int off)
 {
-	unsigned long mask;
+	unsigned long mask = UK_BIT_MASK(off);
+	unsigned int w = UK_BIT_WORD(off);
 	unsigned long v;
 
-	if (!((idx >= 0) && IN_RANGE((size_t)idx, 0, bm->size)))
-		return -1;
-	mask = UK_BIT_MASK(idx);
-	v = uk_or(&bm->bitmap[UK_BIT_WORD(idx)], mask);
-	return !!(v & mask);
+	v = uk_and(&seg->bitmap[w], ~mask);
+	if (!(v & mask))
+		return 1;
+
+	if (v == mask) {
+		/* We took the last free index of the word. Restore the summary
+		 * bit if an index was freed concurrently.
+		 */
+		uk_and(&seg->summary, ~UK_BIT_MASK(w));
+		if (uk_load_n(&seg->bitmap[w]))
+			uk_or(&seg->summary, UK_BIT_MASK(w));
+	}
+	return 0;
 }
 
 /**
- * Checks if `idx` is free or not.
+ * Marks `off` as free, and returns whether we were the ones to do so.
  *
- * @param bm
- *   Bitmap in which to check
- * @param idx
- *   Index to check
  * @return
- *   0 if `idx` is free, non-zero otherwise
+ *   0 if we freed `off`, non-zero if it was already free
  */
-static inline int uk_bmap_isfree(const struct uk_bmap *bm, int idx)
+static inline int _fmap_seg_free(struct uk_fmap_seg *seg, unsigned int off)
 {
-	if (!((idx >= 0) && IN_RANGE((size_t)idx, 0, bm->size)))
-		return -1;
-	return uk_test_bit(idx, bm->bitmap);
+	unsigned long mask = UK_BIT_MASK(off);
+	unsigned int w = UK_BIT_WORD(off);
+	unsigned long v;
+
+	v = uk_or(&seg->bitmap[w], mask);
+	if (v & mask)
+		return 1;
+
+	/* The summary bit is only cleared when the word becomes 0 */
+	if (!v)
+		uk_or(&seg->summary, UK_BIT_MASK(w));
+	return 0;
 }
 
-/**
- * Allocates and returns the smallest free index larger than `min`.
- *
- * @param bm
- *   Bitmap in which to search for the next free index
- * @param min
- *   Starting value from which to search the next free index
- * @return
- *   The allocated index or `>= bm->size` if map full.
- */
-static inline int uk_bmap_request(const struct uk_bmap *bm, int min)
+static inline int _fmap_seg_isfree(const struct uk_fmap_seg *seg,
+				   unsigned int off)
 {
-	size_t pos;
+	return !!(seg->bitmap[UK_BIT_WORD(off)] & UK_BIT_MASK(off));
+}
 
-	do {
-		/* Seems safe to cast away volatility, revisit if problem */
-		pos = uk_find_next_bit((unsigned long *)bm->bitmap,
-				       bm->size, min);
-		if (pos >= bm->size)
-			return bm->size;
-	/* If bit was already cleared, we lost the race, retry */
-	} while (uk_bmap_reserve(bm, pos));
+/* Returns the smallest free offset `>= start` in `seg`, or -1 */
+static inline int _fmap_seg_find(const struct uk_fmap_seg *seg,
+				 unsigned int start)
+{
+	unsigned int w = UK_BIT_WORD(start);
+	unsigned long bits, sum;
 
-	return pos;
-}
+	bits = seg->bitmap[w] & UK_BITMAP_FIRST_WORD_MASK(start);
+	if (bits)
+		return w * UK_BITS_PER_LONG + uk_ffsl(bits);
 
-/**
- * Data structure mapping between integers and open file descriptions.
- */
-struct uk_fmap {
-	/* Bitmap describing which file descriptors are free */
-	struct uk_bmap bmap;
-	/* Map of pointers to open file descriptions */
-	void *volatile *map;
-};
+	if (++w == UK_FMAP_SEG_WORDS)
+		return -1;
 
-/**
- * Gets the size of the map in bytes.
- *
- * @param s
- *   Number of elements in the map
- * @return
- *   Size of the map in bytes
- */
-#define UK_FMAP_SZ(s) ((s) * sizeof(void *))
+	sum = seg->summary & UK_BITMAP_FIRST_WORD_MASK(w);
+	while (sum) {
+		w = uk_ffsl(sum);
+		bits = seg->bitmap[w];
+		if (bits)
+			return w * UK_BITS_PER_LONG + uk_ffsl(bits);
+		/* Word was taken meanwhile, the summary lags behind */
+		sum &= sum - 1;
+	}
+	return -1;
+}
 
 /**
- * Checks if the index given is in the range of the map.
+ * Allocates and returns the smallest free index larger than `min`.
  *
  * @param m
- *   fmap that gives us the maximum value that the index can have
- * @param i
- *   Index that we check if it is in range from 0 to size of the bitmap
+ *   fmap in which to search for the next free index
+ * @param min
+ *   Starting value from which to search the next free index
  * @return
- *   0 if the index is not in the range, 1 otherwise
+ *   The allocated index, -EMFILE if there is no free index below the limit,
+ *   or -ENOMEM if a segment could not be allocated
  */
-#define _FMAP_INRANGE(m, i) ((i >= 0) && IN_RANGE((size_t)i, 0, (m)->bmap.size))
-
-/**
- * Initializes the memory for a uk_fmap.
- *
- * The `size` field must be correctly set and the map buffers allocated.
- *
- * @param m
- *   fmap to be initialized
- */
-static inline void uk_fmap_init(const struct uk_fmap *m)
+static inline int _fmap_request(const struct uk_fmap *m, int min)
 {
-	memset((void *)m->map, 0, m->bmap.size * sizeof(void *));
-	uk_bmap_init(&m->bmap);
+	size_t limit = m->limit;
+	struct uk_fmap_seg *seg;
+	size_t idx = min;
+	unsigned int s;
+	int off;
+
+	UK_ASSERT(min >= 0);
+
+	while (idx < limit) {
+		s = _FMAP_SEG(idx);
+		seg = _fmap_seg_get(m, s);
+		if (unlikely(!seg))
+			return -ENOMEM;
+
+		off = _fmap_seg_find(seg, _FMAP_OFF(idx));
+		if (off < 0) {
+			/* Segment full, continue with the next one */
+			idx = (size_t)(s + 1) * UK_FMAP_SEG_SIZE;
+			continue;
+		}
+
+		idx = (size_t)s * UK_FMAP_SEG_SIZE + off;
+		if (idx >= limit)
+			break;
+		if (!_fmap_seg_reserve(seg, off))
+			return (int)idx;
+		/* If bit was already cleared, we lost the race, retry */
+	}
+	return -EMFILE;
 }
 
 /**
@@ -190,7 +266,8 @@ static inline void uk_fmap_init(const struct uk_fmap *m)
  * WARNING: Use of this function is vulnerable to use-after-free race conditions
  * for entry objects whose lifetime depends on their membership in this data
  * structure (e.g., refcounting on put, take, and after lookups).
- * For that case please use the `uk_fmap_critical_*` functions.
+ * For that case please use the `uk_fmap_critical_*` functions, or make the
+ * entry objects type-stable.
  *
  * @param m
  *   fmap in which to search
@@ -201,15 +278,19 @@ static inline void uk_fmap_init(const struct uk_fmap *m)
  */
 static inline void *uk_fmap_lookup(const struct uk_fmap *m, int idx)
 {
+	struct uk_fmap_seg *seg;
 	void *got;
 
 	if (!_FMAP_INRANGE(m, idx))
 		return NULL;
+	seg = _fmap_seg(m, idx);
+	if (!seg)
+		return NULL;
 
 	do {
-		got = m->map[idx];
+		got = seg->map[_FMAP_OFF(idx)];
 		if (!got) {
-			if (uk_bmap_isfree(&m->bmap, idx))
+			if (_fmap_seg_isfree(seg, _FMAP_OFF(idx)))
 				break; /* Entry is actually free */
 			uk_sched_yield(); /* Lost race, retry */
 		}
@@ -227,19 +308,21 @@ static inline void *uk_fmap_lookup(const struct uk_fmap *m, int idx)
  * @param min
  *   Start value from which we search the next free index
  * @return
- *   newly allocated index, or out of range if map full
+ *   newly allocated index, or < 0 if the map is full (see `_fmap_request`)
  */
 static inline
 int uk_fmap_put(const struct uk_fmap *m, const void *p, int min)
 {
 	void *got __maybe_unused;
+	struct uk_fmap_seg *seg;
 	int pos;
 
-	pos = uk_bmap_request(&m->bmap, min);
-	if (!_FMAP_INRANGE(m, pos))
+	pos = _fmap_request(m, min);
+	if (pos < 0)
 		return pos; /* Map full */
 
-	got = uk_exchange_n(&m->map[pos], (void *)p);
+	seg = _fmap_seg(m, pos);
+	got = uk_exchange_n(&seg->map[_FMAP_OFF(pos)], (void *)p);
 	UK_ASSERT(got == NULL); /* There can't be stuff in there, abort */
 
 	return pos;
@@ -258,24 +341,28 @@ int uk_fmap_put(const struct uk_fmap *m, const void *p, int min)
 static inline void *uk_fmap_take(const struct uk_fmap *m, int idx)
 {
 	int v __maybe_unused;
+	struct uk_fmap_seg *seg;
 	void *got;
 
 	if (!_FMAP_INRANGE(m, idx))
 		return NULL;
+	seg = _fmap_seg(m, idx);
+	if (!seg)
+		return NULL;
 
 	do {
-		if (uk_bmap_isfree(&m->bmap, idx))
+		if (_fmap_seg_isfree(seg, _FMAP_OFF(idx)))
 			return NULL; /* Already free */
 
 		/* At most one take thread gets the previous non-NULL value */
-		got = uk_exchange_n(&m->map[idx], NULL);
+		got = uk_exchange_n(&seg->map[_FMAP_OFF(idx)], NULL);
 		if (!got)
 			/* We lost the race with a (critical) take, retry */
 			uk_sched_yield();
 	} while (!got);
 
 	/* We are that one thread; nobody else can set the bitmap */
-	v = uk_bmap_free(&m->bmap, idx);
+	v = _fmap_seg_free(seg, _FMAP_OFF(idx));
 	UK_ASSERT(!v);
 	return got;
 }
@@ -297,14 +384,19 @@ static inline void *uk_fmap_take(const struct uk_fmap *m, int idx)
 static inline
 void *uk_fmap_critical_take(const struct uk_fmap *m, int idx)
 {
+	struct uk_fmap_seg *seg;
 	void *got;
 
 	if (!_FMAP_INRANGE(m, idx))
 		return NULL;
+	seg = _fmap_seg(m, idx);
+	if (!seg)
+		return NULL;
+
 	do {
-		got = uk_exchange_n(&m->map[idx], NULL);
+		got = uk_exchange_n(&seg->map[_FMAP_OFF(idx)], NULL);
 		if (!got) {
-			if (uk_bmap_isfree(&m->bmap, idx))
+			if (_fmap_seg_isfree(seg, _FMAP_OFF(idx)))
 				/* idx is actually empty */
 				break;
 			/* Lost race with (critical) take, retry */
@@ -333,12 +425,15 @@ static inline
 int uk_fmap_critical_put(const struct uk_fmap *m, int idx, const void *p)
 {
 	void *got __maybe_unused;
+	struct uk_fmap_seg *seg;
 
 	if (!_FMAP_INRANGE(m, idx))
 		return -1;
+	seg = _fmap_seg(m, idx);
+	UK_ASSERT(seg); /* The entry was taken from it */
 
-	(void)uk_bmap_reserve(&m->bmap, idx);
-	got = uk_exchange_n(&m->map[idx], p);
+	(void)_fmap_seg_reserve(seg, _FMAP_OFF(idx));
+	got = uk_exchange_n(&seg->map[_FMAP_OFF(idx)], p);
 	UK_ASSERT(got == NULL);
 	return 0;
 }
@@ -348,6 +443,7 @@ int uk_fmap_critical_put(const struct uk_fmap *m, int idx, const void *p)
  * returning previous in `prev`.
  *
  * If `idx` is free, it is marked as used and `*prev` is set to NULL.
+ * The index may be above the limit of the map.
  *
  * @param m
  *   fmap in which to exchange the entries
@@ -358,20 +454,25 @@ int uk_fmap_critical_put(const struct uk_fmap *m, int idx, const void *p)
  * @param prev
  *   Previous entry that has been replaced
  * @return
- *   0 on success, non-zero if `idx` out of range
+ *   0 on success, -EINVAL if `idx` out of range, -ENOMEM if the segment of
+ *   `idx` could not be allocated
  */
 static inline
 int uk_fmap_xchg(const struct uk_fmap *m, int idx,
 		 const void *p, void **prev)
 {
+	struct uk_fmap_seg *seg;
 	void *got;
 
 	if (!_FMAP_INRANGE(m, idx))
-		return -1;
+		return -EINVAL;
+	seg = _fmap_seg_get(m, _FMAP_SEG(idx));
+	if (unlikely(!seg))
+		return -ENOMEM;
 
 	/* Exchanging entries directly is problematic, must use take & put */
 	for (;;) {
-		int r = uk_bmap_reserve(&m->bmap, idx);
+		int r = _fmap_seg_reserve(seg, _FMAP_OFF(idx));
 
 		if (r) {
 			/* There was already something there */
@@ -385,7 +486,7 @@ int uk_fmap_xchg(const struct uk_fmap *m, int idx,
 			uk_sched_yield();
 		} else {
 			/* idx was free, we're basically a put now */
-			got = uk_exchange_n(&m->map[idx], p);
+			got = uk_exchange_n(&seg->map[_FMAP_OFF(idx)], p);
 			UK_ASSERT(got == NULL);
 			return 0;
 		}
@@ -49,6 +49,24 @@ struct uk_ofile *uk_fdtab_get(int fd);
  */
 void uk_fdtab_ret(struct uk_ofile *of);
 
+/**
+ * Returns the limit of file descriptors (soft RLIMIT_NOFILE). New file
+ * descriptors are always below the limit.
+ */
+unsigned int uk_fdtab_get_limit(void);
+
+/**
+ * Sets the limit of file descriptors (soft RLIMIT_NOFILE). The table grows
+ * on demand, so a high limit does not cost memory until the descriptors are
+ * used.
+ *
+ * @param limit
+ *   New limit, at most CONFIG_LIBPOSIX_FDTAB_MAXFDS
+ * @return
+ *   0 on success, -EPERM if `limit` exceeds the maximum
+ */
+int uk_fdtab_set_limit(unsigned int limit);
+
 /**
  * Sets flags on file descriptor. Currently only supports O_CLOEXEC.
  *
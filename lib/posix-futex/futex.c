@@ -49,13 +49,12 @@
 #include <uk/syscall.h>
 #include <uk/atomic.h>
 #include <uk/thread.h>
-#include <uk/thread.h>
 #include <uk/list.h>
 #if CONFIG_LIBPOSIX_PROCESS_CLONE
 #include <uk/process.h>
 #endif /* CONFIG_LIBPOSIX_PROCESS_CLONE */
 #include <uk/sched.h>
-#include <uk/list.h>
+#include <uk/init.h>
 #include <uk/assert.h>
 #include <uk/print.h>
 #include <uk/spinlock.h>
@@ -68,21 +67,65 @@
 struct uk_futex {
 	uint32_t *uaddr; /** The futex address. */
 	struct uk_thread *thread; /** The thread waiting on the futex. */
-	struct uk_list_head list_node; /** The list containing all the futexes
-					 * on which the threads are waiting.
+	struct uk_list_head list_node; /** The list of the hash bucket that
+					 * uaddr maps to.
 					 */
+	bool queued; /** Cleared by the waker when it takes the futex off
+		       * the bucket list.
+		       */
+};
+
+/** @struct futex_bucket
+ *  @brief Wait list for all futexes that hash to the same bucket.
+ */
+struct futex_bucket {
+	uk_spinlock lock;
+	struct uk_list_head waiters;
 };
 
-static UK_LIST_HEAD(futex_list);
-static uk_spinlock futex_list_lock = UK_SPINLOCK_INITIALIZER();
+#define FUTEX_HASH_SIZE (1UL << CONFIG_LIBPOSIX_FUTEX_HASH_BITS)
+
+static struct futex_bucket futex_table[FUTEX_HASH_SIZE];
+
+/**
+ * Map a futex address to its hash bucket (Fibonacci hashing). Futex words
+ * are at least 4-byte aligned, so the low bits carry no information and are
+ * mixed into the upper bits by the multiplication.
+ */
+static inline struct futex_bucket *futex_hash(const uint32_t *uaddr)
+{
+	__u64 h = (__u64)(__uptr)uaddr * 0x9E3779B97F4A7C15ULL;
+
+	return &futex_table[h >> (64 - CONFIG_LIBPOSIX_FUTEX_HASH_BITS)];
+}
+
+/**
+ * Lock the bucket that the futex `f` is currently queued on. A concurrent
+ * requeue can move `f` to another bucket while we spin on the lock, so the
+ * mapping is re-checked after acquiring it.
+ */
+static struct futex_bucket *futex_lock_waiter(struct uk_futex *f)
+{
+	struct futex_bucket *hb;
+
+	for (;;) {
+		hb = futex_hash(uk_load_n(&f->uaddr));
+		uk_spin_lock(&hb->lock);
+		if (likely(hb == futex_hash(f->uaddr)))
+			return hb;
+		uk_spin_unlock(&hb->lock);
+	}
+}
 
 /**
  * Prepare to wait on a futex.
  *
  * Get the futex value atomically and compare it with the expected value. Add
  * the thread to the wait list and then block it if the value is equal to the
- * expected one. If the futex was not removed from the list when the thread was
- * unblocked, then it means that it timed out.
+ * expected one. The comparison and the blocking happen under the bucket lock,
+ * so a concurrent wake-up cannot get lost in between. If the futex was not
+ * removed from the list when the thread was unblocked, then it means that it
+ * timed out.
  *
  * @param uaddr		The futex userspace address
  * @param val		The expected value
@@ -97,12 +140,17 @@ static uk_spinlock futex_list_lock = UK_SPINLOCK_INITIALIZER();
 static int futex_wait(uint32_t *uaddr, uint32_t val, const __nsec *timeout)
 {
 	unsigned long irqf;
-	struct uk_list_head *itr, *tmp;
-	struct uk_futex *f_tmp;
+	struct futex_bucket *hb = futex_hash(uaddr);
 	struct uk_thread *current = uk_thread_current();
-	struct uk_futex f = {.uaddr = uaddr, .thread = current};
+	struct uk_futex f = {.uaddr = uaddr, .thread = current, .queued = true};
+
+	irqf = ukplat_lcpu_save_irqf();
+	uk_spin_lock(&hb->lock);
 
 	if (unlikely(uk_load_n(uaddr) != val)) {
+		uk_spin_unlock(&hb->lock);
+		ukplat_lcpu_restore_irqf(irqf);
+
 		uk_pr_debug("FUTEX_WAIT: Condition not met (*uaddr != %"PRIu32", uaddr: %p)\n",
 			    val, uaddr);
 		return -EAGAIN;
@@ -113,11 +161,7 @@ static int futex_wait(uint32_t *uaddr, uint32_t val, const __nsec *timeout)
 			val, uaddr);
 
 	/* Enqueue thread to wait list */
-	irqf = ukplat_lcpu_save_irqf();
-	uk_spin_lock(&futex_list_lock);
-	uk_list_add_tail(&f.list_node, &futex_list);
-	uk_spin_unlock(&futex_list_lock);
-	ukplat_lcpu_restore_irqf(irqf);
+	uk_list_add_tail(&f.list_node, &hb->waiters);
 
 	if (timeout) {
 		/* Block at most until `timeout` nanosecs */
@@ -129,27 +173,26 @@ static int futex_wait(uint32_t *uaddr, uint32_t val, const __nsec *timeout)
 		uk_pr_debug("FUTEX_WAIT: Wait indefinitely for wake-up\n");
 		uk_thread_block(current);
 	}
+
+	uk_spin_unlock(&hb->lock);
+	ukplat_lcpu_restore_irqf(irqf);
 	uk_sched_yield();
 
 	uk_pr_debug("FUTEX_WAIT: Woke up (uaddr: %p)\n", uaddr);
 	irqf = ukplat_lcpu_save_irqf();
-	uk_spin_lock(&futex_list_lock);
+	hb = futex_lock_waiter(&f);
 
 	/* If the futex is still in the wait list, then it timed out */
-	uk_list_for_each_safe(itr, tmp, &futex_list) {
-		f_tmp = uk_list_entry(itr, struct uk_futex, list_node);
-
-		if (unlikely(f_tmp->uaddr == uaddr && f_tmp->thread == current)) {
-			/* Remove the thread from the futex list */
-			uk_list_del(&f_tmp->list_node);
-			uk_spin_unlock(&futex_list_lock);
-			ukplat_lcpu_restore_irqf(irqf);
-
-			uk_pr_debug("FUTEX_WAIT: Woke up because of timeout\n");
-			return -ETIMEDOUT;
-		}
+	if (unlikely(f.queued)) {
+		/* Remove the thread from the futex list */
+		uk_list_del(&f.list_node);
+		uk_spin_unlock(&hb->lock);
+		ukplat_lcpu_restore_irqf(irqf);
+
+		uk_pr_debug("FUTEX_WAIT: Woke up because of timeout\n");
+		return -ETIMEDOUT;
 	}
-	uk_spin_unlock(&futex_list_lock);
+	uk_spin_unlock(&hb->lock);
 	ukplat_lcpu_restore_irqf(irqf);
 
 	return 0;
@@ -159,31 +202,22 @@ static int futex_wait(uint32_t *uaddr, uint32_t val, const __nsec *timeout)
  * Wake up threads waiting on a futex.
  *
  * Find val threads in the wait list for the futex, remove the futexes from the
- * list and wake up the threads.
- *
- * @param uaddr	The futex userspace address
- * @param val	The number of threads waiting on the futex to be woken up
- *
- * @return
- *	0: no threads were woken up;
- *	>0: the number of threads woken up
+ * list and wake up the threads. The caller must hold the bucket lock.
  */
-static int futex_wake(uint32_t *uaddr, uint32_t val)
+static uint32_t futex_wake_locked(struct futex_bucket *hb, uint32_t *uaddr,
+				  uint32_t val)
 {
-	unsigned long irqf;
 	struct uk_list_head *itr, *tmp;
 	struct uk_futex *f;
 	uint32_t count = 0;
 
-	irqf = ukplat_lcpu_save_irqf();
-	uk_spin_lock(&futex_list_lock);
-
-	uk_list_for_each_safe(itr, tmp, &futex_list) {
+	uk_list_for_each_safe(itr, tmp, &hb->waiters) {
 		f = uk_list_entry(itr, struct uk_futex, list_node);
 
 		if (f->uaddr == uaddr) {
 			/* Remove the thread from the futex list */
 			uk_list_del(&f->list_node);
+			uk_store_n(&f->queued, false);
 
 			/* TODO: Replace with uk_thread_wakeup when the new
 			 * scheduler API is ready
@@ -196,12 +230,60 @@ static int futex_wake(uint32_t *uaddr, uint32_t val)
 		}
 	}
 
-	uk_spin_unlock(&futex_list_lock);
+	return count;
+}
+
+/**
+ * Wake up threads waiting on a futex.
+ *
+ * @param uaddr	The futex userspace address
+ * @param val	The number of threads waiting on the futex to be woken up
+ *
+ * @return
+ *	0: no threads were woken up;
+ *	>0: the number of threads woken up
+ */
+static int futex_wake(uint32_t *uaddr, uint32_t val)
+{
+	unsigned long irqf;
+	struct futex_bucket *hb = futex_hash(uaddr);
+	uint32_t count;
+
+	irqf = ukplat_lcpu_save_irqf();
+	uk_spin_lock(&hb->lock);
+	count = futex_wake_locked(hb, uaddr, val);
+	uk_spin_unlock(&hb->lock);
 	ukplat_lcpu_restore_irqf(irqf);
 
 	return (int) count;
 }
 
+/**
+ * Lock two hash buckets without deadlocking against a concurrent requeue in
+ * the opposite direction: the buckets are always locked in address order.
+ */
+static void futex_lock_pair(struct futex_bucket *hb1, struct futex_bucket *hb2)
+{
+	if (hb1 > hb2) {
+		struct futex_bucket *tmp = hb1;
+
+		hb1 = hb2;
+		hb2 = tmp;
+	}
+
+	uk_spin_lock(&hb1->lock);
+	if (hb1 != hb2)
+		uk_spin_lock(&hb2->lock);
+}
+
+static void futex_unlock_pair(struct futex_bucket *hb1,
+			      struct futex_bucket *hb2)
+{
+	if (hb1 != hb2)
+		uk_spin_unlock(&hb2->lock);
+	uk_spin_unlock(&hb1->lock);
+}
+
 /**
  * Requeue waiters from uaddr to uaddr2.
  *
@@ -228,30 +310,35 @@ static int futex_cmp_requeue(uint32_t *uaddr, uint32_t val, uint32_t val2,
 	unsigned long irqf;
 	struct uk_list_head *itr, *tmp;
 	struct uk_futex *f;
-	int woken_uaddr1;
+	struct futex_bucket *hb1 = futex_hash(uaddr);
+	struct futex_bucket *hb2 = futex_hash(uaddr2);
+	uint32_t woken_uaddr1;
 	uint32_t waiters_uaddr2 = 0;
 
-	if (unlikely(!((uint32_t)val3 == uk_load_n(uaddr))))
+	irqf = ukplat_lcpu_save_irqf();
+	futex_lock_pair(hb1, hb2);
+
+	if (unlikely(!((uint32_t)val3 == uk_load_n(uaddr)))) {
+		futex_unlock_pair(hb1, hb2);
+		ukplat_lcpu_restore_irqf(irqf);
 		return -EAGAIN;
+	}
 
 	/* Wake up val waiters on uaddr */
-	woken_uaddr1 = futex_wake(uaddr, val);
+	woken_uaddr1 = futex_wake_locked(hb1, uaddr, val);
 
 	if (!val2)
-		return woken_uaddr1;
-
-	irqf = ukplat_lcpu_save_irqf();
-	uk_spin_lock(&futex_list_lock);
+		goto out;
 
 	/* Requeue val2 waiters on uaddr2 */
-	uk_list_for_each_safe(itr, tmp, &futex_list) {
+	uk_list_for_each_safe(itr, tmp, &hb1->waiters) {
 		f = uk_list_entry(itr, struct uk_futex, list_node);
 
 		if (f->uaddr == uaddr) {
 			/* Requeue thread to uaddr2 */
 			uk_list_del(&f->list_node);
-			f->uaddr = uaddr2;
-			uk_list_add_tail(&f->list_node, &futex_list);
+			uk_store_n(&f->uaddr, uaddr2);
+			uk_list_add_tail(&f->list_node, &hb2->waiters);
 
 			/* Requeue at most val2 threads */
 			if (++waiters_uaddr2 >= val2)
@@ -259,12 +346,26 @@ static int futex_cmp_requeue(uint32_t *uaddr, uint32_t val, uint32_t val2,
 		}
 	}
 
-	uk_spin_unlock(&futex_list_lock);
+out:
+	futex_unlock_pair(hb1, hb2);
 	ukplat_lcpu_restore_irqf(irqf);
 
-	return woken_uaddr1 + waiters_uaddr2;
+	return (int) (woken_uaddr1 + waiters_uaddr2);
 }
 
+static int futex_table_init(struct uk_init_ctx *ictx __unused)
+{
+	unsigned long i;
+
+	for (i = 0; i < FUTEX_HASH_SIZE; i++) {
+		uk_spin_init(&futex_table[i].lock);
+		UK_INIT_LIST_HEAD(&futex_table[i].waiters);
+	}
+	return 0;
+}
+
+uk_early_initcall(futex_table_init, 0x0);
+
 /**
  * According to man pages, there exists no libc wrapper for futex
  *
@@ -384,8 +485,10 @@ UK_LLSYSCALL_R_DEFINE(pid_t, set_tid_address, pid_t *, tid_ref)
 
 static void thread_exit_handler(struct uk_thread *child)
 {
+	unsigned long irqf;
 	struct uk_list_head *itr, *tmp;
 	struct uk_futex *f;
+	unsigned long i;
 
 	/* Clear child TID at the stored reference */
 	if (child_tid_clear_ref != NULL) {
@@ -393,16 +496,26 @@ static void thread_exit_handler(struct uk_thread *child)
 		futex_wake((uint32_t *) child_tid_clear_ref, 0);
 	}
 
-	/* Clear this thread's entries from the list */
-	uk_spin_lock(&futex_list_lock);
-	uk_list_for_each_safe(itr, tmp, &futex_list) {
-		f = uk_list_entry(itr, struct uk_futex, list_node);
-		if (f->thread == child) {
-			uk_list_del(&f->list_node);
-			break; /* a thread can wait on one futex */
+	/* Clear this thread's entries from the table. We do not know the
+	 * address the thread may have been waiting on, so visit all buckets.
+	 */
+	for (i = 0; i < FUTEX_HASH_SIZE; i++) {
+		irqf = ukplat_lcpu_save_irqf();
+		uk_spin_lock(&futex_table[i].lock);
+		uk_list_for_each_safe(itr, tmp, &futex_table[i].waiters) {
+			f = uk_list_entry(itr, struct uk_futex, list_node);
+			if (f->thread == child) {
+				uk_list_del(&f->list_node);
+				f->queued = false;
+				/* a thread can wait on one futex */
+				uk_spin_unlock(&futex_table[i].lock);
+				ukplat_lcpu_restore_irqf(irqf);
+				return;
+			}
 		}
+		uk_spin_unlock(&futex_table[i].lock);
+		ukplat_lcpu_restore_irqf(irqf);
 	}
-	uk_spin_unlock(&futex_list_lock);
 }
 
 UK_THREAD_INIT_PRIO(0x0, thread_exit_handler, UK_PRIO_EARLIEST);
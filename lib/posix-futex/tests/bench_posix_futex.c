@@ -0,0 +1,105 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+#include <linux/futex.h>
+#include <uk/bench.h>
+#include <uk/sched.h>
+#include <uk/syscall.h>
+#include <uk/thread.h>
+
+#if defined(__X86_32__) || defined(__x86_64__)
+#define NR_FUTEX	202
+#elif (defined __ARM_32__) || (defined __ARM_64__)
+#define NR_FUTEX	240
+#endif
+
+/* Values of the futex word in the ping-pong benchmark */
+#define PING		0
+#define PONG		1
+#define STOP		2
+
+static uint32_t bench_futex;
+
+static int futex(uint32_t *uaddr, int futex_op, uint32_t val)
+{
+	return uk_syscall(NR_FUTEX, uaddr, futex_op, val, NULL, NULL, 0);
+}
+
+UK_BENCHMARK_DESC(posix_futex_benchsuite, wake_no_waiters,
+		  "FUTEX_WAKE without any waiter")
+{
+	__u64 i;
+
+	for (i = 0; i < b->n; i++)
+		futex(&bench_futex, FUTEX_WAKE, 1);
+}
+
+UK_BENCHMARK_DESC(posix_futex_benchsuite, wait_value_mismatch,
+		  "FUTEX_WAIT that returns EAGAIN right away")
+{
+	__u64 i;
+
+	bench_futex = PING;
+	for (i = 0; i < b->n; i++)
+		futex(&bench_futex, FUTEX_WAIT, PONG);
+}
+
+static __noreturn void bench_futex_ponger(void *arg __unused)
+{
+	uint32_t val;
+
+	for (;;) {
+		val = __atomic_load_n(&bench_futex, __ATOMIC_ACQUIRE);
+		if (val == STOP)
+			break;
+		if (val == PING) {
+			futex(&bench_futex, FUTEX_WAIT, PING);
+			continue;
+		}
+		__atomic_store_n(&bench_futex, PING, __ATOMIC_RELEASE);
+		futex(&bench_futex, FUTEX_WAKE, 1);
+	}
+	uk_sched_thread_exit();
+}
+
+/*
+ * Two threads hand a token back and forth, each one blocking in FUTEX_WAIT
+ * until the other one wakes it up.
+ */
+UK_BENCHMARK_DESC(posix_futex_benchsuite, wait_wake_pingpong,
+		  "round trip between two threads")
+{
+	struct uk_thread *t;
+	__u64 i;
+
+	uk_bench_timer_stop(b);
+	bench_futex = PING;
+	t = uk_sched_thread_create(uk_sched_current(), bench_futex_ponger,
+				   NULL, "bench_futex");
+	if (unlikely(!t)) {
+		uk_bench_skip(b, "failed to create thread");
+		return;
+	}
+	uk_bench_timer_start(b);
+
+	for (i = 0; i < b->n; i++) {
+		__atomic_store_n(&bench_futex, PONG, __ATOMIC_RELEASE);
+		futex(&bench_futex, FUTEX_WAKE, 1);
+		while (__atomic_load_n(&bench_futex, __ATOMIC_ACQUIRE) == PONG)
+			futex(&bench_futex, FUTEX_WAIT, PONG);
+	}
+
+	uk_bench_timer_stop(b);
+	__atomic_store_n(&bench_futex, STOP, __ATOMIC_RELEASE);
+	futex(&bench_futex, FUTEX_WAKE, 1);
+	while (!uk_thread_is_exited(t))
+		uk_sched_yield();
+}
+
+uk_benchsuite_register(posix_futex_benchsuite, NULL);
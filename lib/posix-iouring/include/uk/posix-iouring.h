@@ -0,0 +1,26 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/* io_uring support */
+
+#ifndef __UK_POSIX_IOURING_H__
+#define __UK_POSIX_IOURING_H__
+
+#include <stddef.h>
+#include <linux/io_uring.h>
+#include <uk/file.h>
+
+int uk_sys_io_uring_setup(unsigned int entries,
+			  struct io_uring_params *params);
+
+int uk_sys_io_uring_enter(const struct uk_file *f, unsigned int to_submit,
+			  unsigned int min_complete, unsigned int flags,
+			  const void *argp, size_t argsz);
+
+int uk_sys_io_uring_register(const struct uk_file *f, unsigned int opcode,
+			     void *arg, unsigned int nr_args);
+
+#endif /* __UK_POSIX_IOURING_H__ */
@@ -0,0 +1,838 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <linux/io_uring.h>
+
+#include <uk/alloc.h>
+#include <uk/arch/paging.h>
+#include <uk/assert.h>
+#include <uk/atomic.h>
+#include <uk/errptr.h>
+#include <uk/essentials.h>
+#include <uk/file/nops.h>
+#include <uk/posix-fd.h>
+#include <uk/posix-fdtab.h>
+#include <uk/posix-iouring.h>
+#include <uk/syscall.h>
+#include <uk/vmem.h>
+#include <uk/vma_types.h>
+
+
+static const char IOURING_VOLID[] = "io_uring_vol";
+
+#define IOURING_SETUP_FLAGS \
+	(IORING_SETUP_CQSIZE|IORING_SETUP_CLAMP|IORING_SETUP_SUBMIT_ALL| \
+	 IORING_SETUP_COOP_TASKRUN|IORING_SETUP_TASKRUN_FLAG| \
+	 IORING_SETUP_SINGLE_ISSUER|IORING_SETUP_DEFER_TASKRUN)
+
+#define IOURING_ENTER_FLAGS \
+	(IORING_ENTER_GETEVENTS|IORING_ENTER_SQ_WAKEUP| \
+	 IORING_ENTER_SQ_WAIT|IORING_ENTER_EXT_ARG)
+
+#define IOURING_SQE_FLAGS \
+	(IOSQE_FIXED_FILE|IOSQE_IO_DRAIN|IOSQE_IO_LINK|IOSQE_IO_HARDLINK| \
+	 IOSQE_ASYNC|IOSQE_CQE_SKIP_SUCCESS)
+
+#define IOURING_FEATURES \
+	(IORING_FEAT_SINGLE_MMAP|IORING_FEAT_NODROP| \
+	 IORING_FEAT_SUBMIT_STABLE|IORING_FEAT_RW_CUR_POS| \
+	 IORING_FEAT_EXT_ARG|IORING_FEAT_CQE_SKIP)
+
+#define IOURING_MAX_ENTRIES CONFIG_LIBPOSIX_IOURING_MAX_ENTRIES
+#define IOURING_MAX_CQ_ENTRIES (2 * IOURING_MAX_ENTRIES)
+#define IOURING_MAX_REG_BUFFERS (1U << 14)
+#define IOURING_MAX_REG_FILES (1U << 15)
+#define IOURING_MAX_REG_BUFLEN (1UL << 30)
+
+/*
+ * Ring header shared with the application. Its layout is private; the
+ * application finds the fields through the offsets returned by setup.
+ * The SQ index array follows the CQEs in the same mapping.
+ */
+struct iouring_rings {
+	__u32 sq_head;
+	__u32 sq_tail;
+	__u32 sq_ring_mask;
+	__u32 sq_ring_entries;
+	__u32 sq_flags;
+	__u32 sq_dropped;
+	__u32 cq_head __align64;
+	__u32 cq_tail;
+	__u32 cq_ring_mask;
+	__u32 cq_ring_entries;
+	__u32 cq_overflow;
+	__u32 cq_flags;
+	struct io_uring_cqe cqes[] __align64;
+};
+
+struct iouring_alloc {
+	struct uk_alloc *alloc;
+	struct uk_file f;
+	uk_file_refcnt frefcnt;
+	struct uk_file_state fstate;
+	/* Shared memory */
+	struct iouring_rings *rings;
+	__sz rings_len;
+	__u32 *sq_array;
+	struct io_uring_sqe *sqes;
+	__sz sqes_len;
+	__u32 sq_entries;
+	__u32 cq_entries;
+	/* Per-instance VMA name; tells our mappings apart from reused ones */
+	char vma_name[sizeof("io_uring")];
+	/* Registered resources; protected by the file iolock */
+	struct iovec *bufs;
+	unsigned int nbufs;
+	int *files;
+	unsigned int nfiles;
+	int evfd;
+};
+
+#define IOURING_ALLOC(f) __containerof((f), struct iouring_alloc, f)
+
+
+static __u32 iouring_roundup_pow2(__u32 v)
+{
+	__u32 r = 1;
+
+	while (r < v)
+		r <<= 1;
+	return r;
+}
+
+/* Shared memory */
+
+static int iouring_map(struct iouring_alloc *al, __sz len, void **out)
+{
+	__vaddr_t vaddr = __VADDR_ANY;
+	int r;
+
+	r = uk_vma_map_anon(uk_vas_get_active(), &vaddr, PAGE_ALIGN_UP(len),
+			    PAGE_ATTR_PROT_RW, UK_VMA_MAP_POPULATE,
+			    al->vma_name);
+	if (unlikely(r))
+		return r;
+
+	*out = (void *)vaddr;
+	return 0;
+}
+
+static void iouring_unmap(struct iouring_alloc *al, void *p, __sz len)
+{
+	struct uk_vas *vas = uk_vas_get_active();
+	const struct uk_vma *vma;
+
+	/* The application may have unmapped the area already, after which the
+	 * range could have been reused by another mapping.
+	 */
+	vma = uk_vma_find(vas, (__vaddr_t)p);
+	if (vma && vma->start == (__vaddr_t)p && vma->name == al->vma_name)
+		(void)uk_vma_unmap(vas, (__vaddr_t)p, PAGE_ALIGN_UP(len), 0);
+}
+
+/* File ops */
+
+static int iouring_ctl(const struct uk_file *f, int fam, int req,
+		       uintptr_t arg1, uintptr_t arg2, uintptr_t arg3)
+{
+	struct iouring_alloc *al = IOURING_ALLOC(f);
+	void *base;
+	__sz len;
+
+	UK_ASSERT(f->vol == IOURING_VOLID);
+	if (fam != UKFILE_CTL_FILE || req != UKFILE_CTL_FILE_MMAP)
+		return -ENOSYS;
+
+	switch ((off_t)arg1) {
+	case IORING_OFF_SQ_RING:
+	case IORING_OFF_CQ_RING:
+		base = al->rings;
+		len = al->rings_len;
+		break;
+	case IORING_OFF_SQES:
+		base = al->sqes;
+		len = al->sqes_len;
+		break;
+	default:
+		return -EINVAL;
+	}
+	if (unlikely((__sz)arg2 > PAGE_ALIGN_UP(len)))
+		return -EINVAL;
+
+	*(void **)arg3 = base;
+	return 0;
+}
+
+static const struct uk_file_ops iouring_ops = {
+	.read = uk_file_nop_read,
+	.write = uk_file_nop_write,
+	.getstat = uk_file_nop_getstat,
+	.setstat = uk_file_nop_setstat,
+	.ctl = iouring_ctl
+};
+
+static void iouring_release(const struct uk_file *f, int what)
+{
+	struct iouring_alloc *al = IOURING_ALLOC(f);
+
+	UK_ASSERT(f->vol == IOURING_VOLID);
+	if (what & UK_FILE_RELEASE_RES) {
+		if (al->rings)
+			iouring_unmap(al, al->rings, al->rings_len);
+		if (al->sqes)
+			iouring_unmap(al, al->sqes, al->sqes_len);
+		uk_free(al->alloc, al->bufs);
+		uk_free(al->alloc, al->files);
+	}
+	if (what & UK_FILE_RELEASE_OBJ)
+		uk_free(al->alloc, al);
+}
+
+/* File creation */
+
+static struct uk_file *iouring_create(__u32 sq_entries, __u32 cq_entries)
+{
+	struct uk_alloc *a = uk_alloc_get_default();
+	struct iouring_alloc *al = uk_malloc(a, sizeof(*al));
+	struct iouring_rings *rings;
+	int r;
+
+	if (unlikely(!al))
+		return ERR2PTR(-ENOMEM);
+
+	al->alloc = a;
+	al->rings = NULL;
+	al->sqes = NULL;
+	al->rings_len = offsetof(struct iouring_rings, cqes) +
+			cq_entries * sizeof(struct io_uring_cqe) +
+			sq_entries * sizeof(__u32);
+	al->sqes_len = sq_entries * sizeof(struct io_uring_sqe);
+	al->sq_entries = sq_entries;
+	al->cq_entries = cq_entries;
+	memcpy(al->vma_name, "io_uring", sizeof(al->vma_name));
+	al->bufs = NULL;
+	al->nbufs = 0;
+	al->files = NULL;
+	al->nfiles = 0;
+	al->evfd = -1;
+	al->fstate = UK_FILE_STATE_INIT_VALUE(al->fstate);
+	al->frefcnt = UK_FILE_REFCNT_INIT_VALUE;
+	al->f = (struct uk_file){
+		.vol = IOURING_VOLID,
+		.node = al,
+		.refcnt = &al->frefcnt,
+		.state = &al->fstate,
+		.ops = &iouring_ops,
+		._release = iouring_release
+	};
+
+	r = iouring_map(al, al->rings_len, (void **)&al->rings);
+	if (unlikely(r))
+		goto err_out;
+	r = iouring_map(al, al->sqes_len, (void **)&al->sqes);
+	if (unlikely(r))
+		goto err_out;
+
+	/* Fresh anonymous memory is zeroed */
+	rings = al->rings;
+	rings->sq_ring_mask = sq_entries - 1;
+	rings->sq_ring_entries = sq_entries;
+	rings->cq_ring_mask = cq_entries - 1;
+	rings->cq_ring_entries = cq_entries;
+	al->sq_array = (__u32 *)&rings->cqes[cq_entries];
+
+	return &al->f;
+
+err_out:
+	iouring_release(&al->f, UK_FILE_RELEASE_RES|UK_FILE_RELEASE_OBJ);
+	return ERR2PTR(r);
+}
+
+/* Request execution */
+
+static int iouring_op_supported(__u8 op)
+{
+	switch (op) {
+	case IORING_OP_NOP:
+	case IORING_OP_READV:
+	case IORING_OP_WRITEV:
+	case IORING_OP_FSYNC:
+	case IORING_OP_READ_FIXED:
+	case IORING_OP_WRITE_FIXED:
+	case IORING_OP_SENDMSG:
+	case IORING_OP_RECVMSG:
+	case IORING_OP_ACCEPT:
+	case IORING_OP_CONNECT:
+	case IORING_OP_FALLOCATE:
+	case IORING_OP_OPENAT:
+	case IORING_OP_CLOSE:
+	case IORING_OP_STATX:
+	case IORING_OP_READ:
+	case IORING_OP_WRITE:
+	case IORING_OP_FADVISE:
+	case IORING_OP_MADVISE:
+	case IORING_OP_SEND:
+	case IORING_OP_RECV:
+	case IORING_OP_SHUTDOWN:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/* Check that a fixed buffer access stays within the registered buffer */
+static int iouring_check_fixed(struct iouring_alloc *al,
+			       const struct io_uring_sqe *sqe)
+{
+	const struct iovec *buf;
+	__uptr base;
+
+	if (unlikely(sqe->buf_index >= al->nbufs))
+		return -EFAULT;
+
+	buf = &al->bufs[sqe->buf_index];
+	base = (__uptr)buf->iov_base;
+	if (unlikely(sqe->addr < base ||
+		     sqe->addr - base > buf->iov_len ||
+		     sqe->len > buf->iov_len - (sqe->addr - base)))
+		return -EFAULT;
+	return 0;
+}
+
+/*
+ * Execute a request through the regular system call handlers, so that it is
+ * served by whichever library provides the call (vfscore, posix-fdio,
+ * posix-socket, ...). Calls not provided by the build complete with -ENOSYS.
+ */
+static long iouring_issue(struct iouring_alloc *al,
+			  const struct io_uring_sqe *sqe)
+{
+	const int curpos = sqe->off == (__u64)-1;
+	long fd = sqe->fd;
+	long r;
+
+	if (unlikely(sqe->flags & ~IOURING_SQE_FLAGS))
+		return -EINVAL;
+
+	if (sqe->flags & IOSQE_FIXED_FILE) {
+		if (unlikely(sqe->opcode == IORING_OP_CLOSE))
+			return -EINVAL;
+		if (unlikely((unsigned int)sqe->fd >= al->nfiles ||
+			     al->files[sqe->fd] < 0))
+			return -EBADF;
+		fd = al->files[sqe->fd];
+	}
+
+	switch (sqe->opcode) {
+	case IORING_OP_NOP:
+		return 0;
+	case IORING_OP_READV:
+		if (curpos)
+			return uk_syscall_r_static(SYS_readv, fd, sqe->addr,
+						   sqe->len);
+		return uk_syscall_r_static(SYS_preadv, fd, sqe->addr,
+					   sqe->len, sqe->off);
+	case IORING_OP_WRITEV:
+		if (curpos)
+			return uk_syscall_r_static(SYS_writev, fd, sqe->addr,
+						   sqe->len);
+		return uk_syscall_r_static(SYS_pwritev, fd, sqe->addr,
+					   sqe->len, sqe->off);
+	case IORING_OP_READ_FIXED:
+		r = iouring_check_fixed(al, sqe);
+		if (unlikely(r))
+			return r;
+		/* fallthrough */
+	case IORING_OP_READ:
+		if (curpos)
+			return uk_syscall_r_static(SYS_read, fd, sqe->addr,
+						   sqe->len);
+		return uk_syscall_r_static(SYS_pread64, fd, sqe->addr,
+					   sqe->len, sqe->off);
+	case IORING_OP_WRITE_FIXED:
+		r = iouring_check_fixed(al, sqe);
+		if (unlikely(r))
+			return r;
+		/* fallthrough */
+	case IORING_OP_WRITE:
+		if (curpos)
+			return uk_syscall_r_static(SYS_write, fd, sqe->addr,
+						   sqe->len);
+		return uk_syscall_r_static(SYS_pwrite64, fd, sqe->addr,
+					   sqe->len, sqe->off);
+	case IORING_OP_FSYNC:
+		if (sqe->fsync_flags & IORING_FSYNC_DATASYNC)
+			return uk_syscall_r_static(SYS_fdatasync, fd);
+		return uk_syscall_r_static(SYS_fsync, fd);
+	case IORING_OP_SENDMSG:
+		return uk_syscall_r_static(SYS_sendmsg, fd, sqe->addr,
+					   sqe->msg_flags);
+	case IORING_OP_RECVMSG:
+		return uk_syscall_r_static(SYS_recvmsg, fd, sqe->addr,
+					   sqe->msg_flags);
+	case IORING_OP_SEND:
+		return uk_syscall_r_static(SYS_sendto, fd, sqe->addr,
+					   sqe->len, sqe->msg_flags, 0, 0);
+	case IORING_OP_RECV:
+		return uk_syscall_r_static(SYS_recvfrom, fd, sqe->addr,
+					   sqe->len, sqe->msg_flags, 0, 0);
+	case IORING_OP_ACCEPT:
+		return uk_syscall_r_static(SYS_accept4, fd, sqe->addr,
+					   sqe->addr2, sqe->accept_flags);
+	case IORING_OP_CONNECT:
+		return uk_syscall_r_static(SYS_connect, fd, sqe->addr,
+					   sqe->off);
+	case IORING_OP_SHUTDOWN:
+		return uk_syscall_r_static(SYS_shutdown, fd, sqe->len);
+	case IORING_OP_FALLOCATE:
+		return uk_syscall_r_static(SYS_fallocate, fd, sqe->len,
+					   sqe->off, sqe->addr);
+	case IORING_OP_FADVISE:
+		return uk_syscall_r_static(SYS_fadvise64, fd, sqe->off,
+					   sqe->len, sqe->fadvise_advice);
+	case IORING_OP_MADVISE:
+		return uk_syscall_r_static(SYS_madvise, sqe->addr, sqe->len,
+					   sqe->fadvise_advice);
+	case IORING_OP_OPENAT:
+		return uk_syscall_r_static(SYS_openat, fd, sqe->addr,
+					   sqe->open_flags, sqe->len);
+	case IORING_OP_CLOSE:
+		return uk_syscall_r_static(SYS_close, fd);
+	case IORING_OP_STATX:
+		return uk_syscall_r_static(SYS_statx, fd, sqe->addr,
+					   sqe->statx_flags, sqe->len,
+					   sqe->addr2);
+	default:
+		return -EINVAL;
+	}
+}
+
+static inline int iouring_cq_full(struct iouring_alloc *al)
+{
+	struct iouring_rings *rings = al->rings;
+
+	return rings->cq_tail - uk_load_n(&rings->cq_head) >= al->cq_entries;
+}
+
+static void iouring_post(struct iouring_alloc *al, __u64 user_data, __s32 res)
+{
+	struct iouring_rings *rings = al->rings;
+	__u32 tail = rings->cq_tail;
+	struct io_uring_cqe *cqe = &rings->cqes[tail & rings->cq_ring_mask];
+
+	cqe->user_data = user_data;
+	cqe->res = res;
+	cqe->flags = 0;
+	/* Publish the entry only after it is filled in */
+	uk_store_n(&rings->cq_tail, tail + 1);
+}
+
+static void iouring_notify(struct iouring_alloc *al)
+{
+	const __u64 one = 1;
+
+	uk_file_event_set(&al->f, UKFD_POLLIN);
+	if (al->evfd >= 0 &&
+	    !(uk_load_n(&al->rings->cq_flags) & IORING_CQ_EVENTFD_DISABLED))
+		(void)uk_syscall_r_static(SYS_write, al->evfd, &one,
+					  sizeof(one));
+}
+
+/*
+ * Consume up to `n` SQEs and execute them in order. Every request completes
+ * before the next one is issued, so IOSQE_IO_DRAIN holds trivially and a
+ * failed link member only needs to cancel the rest of its chain.
+ */
+static int iouring_submit(struct iouring_alloc *al, unsigned int n)
+{
+	struct iouring_rings *rings = al->rings;
+	__u32 head = rings->sq_head;
+	__u32 tail = uk_load_n(&rings->sq_tail);
+	int link_failed = 0;
+	int posted = 0;
+	int ret = 0;
+
+	n = MIN(n, tail - head);
+	while (n--) {
+		struct io_uring_sqe sqe;
+		__u32 idx;
+		long res;
+
+		/* Never drop completions; stop early instead */
+		if (unlikely(iouring_cq_full(al))) {
+			if (!ret)
+				ret = -EBUSY;
+			break;
+		}
+
+		idx = al->sq_array[head & rings->sq_ring_mask];
+		head++;
+		if (unlikely(idx >= al->sq_entries)) {
+			rings->sq_dropped++;
+			continue;
+		}
+		/* The SQE slot may be reused by the application once we
+		 * return, so work on a copy
+		 */
+		sqe = al->sqes[idx];
+
+		if (unlikely(link_failed))
+			res = -ECANCELED;
+		else
+			res = iouring_issue(al, &sqe);
+
+		if (!(res >= 0 && (sqe.flags & IOSQE_CQE_SKIP_SUCCESS))) {
+			iouring_post(al, sqe.user_data, (__s32)res);
+			posted = 1;
+		}
+
+		if (!(sqe.flags & (IOSQE_IO_LINK|IOSQE_IO_HARDLINK)))
+			link_failed = 0;
+		else if (res < 0 && !(sqe.flags & IOSQE_IO_HARDLINK))
+			link_failed = 1;
+		ret++;
+	}
+	uk_store_n(&rings->sq_head, head);
+
+	if (posted)
+		iouring_notify(al);
+	return ret;
+}
+
+/* Registration */
+
+static int iouring_register_buffers(struct iouring_alloc *al,
+				    const struct iovec *iov,
+				    unsigned int nr)
+{
+	struct iovec *bufs;
+
+	if (unlikely(al->bufs))
+		return -EBUSY;
+	if (unlikely(!nr || nr > IOURING_MAX_REG_BUFFERS))
+		return -EINVAL;
+	if (unlikely(!iov))
+		return -EFAULT;
+
+	for (unsigned int i = 0; i < nr; i++) {
+		/* Sparse entries are empty; anything else needs memory */
+		if (!iov[i].iov_base && iov[i].iov_len)
+			return -EFAULT;
+		if (unlikely(iov[i].iov_len > IOURING_MAX_REG_BUFLEN))
+			return -EFAULT;
+	}
+
+	bufs = uk_malloc(al->alloc, nr * sizeof(*bufs));
+	if (unlikely(!bufs))
+		return -ENOMEM;
+	memcpy(bufs, iov, nr * sizeof(*bufs));
+
+	/* We share the address space with the application, so requests on
+	 * fixed buffers access them directly; no pinning or copies needed.
+	 */
+	al->bufs = bufs;
+	al->nbufs = nr;
+	return 0;
+}
+
+static int iouring_register_files(struct iouring_alloc *al, const int *fds,
+				  unsigned int nr)
+{
+	int *files;
+
+	if (unlikely(al->files))
+		return -EBUSY;
+	if (unlikely(!nr || nr > IOURING_MAX_REG_FILES))
+		return -EINVAL;
+	if (unlikely(!fds))
+		return -EFAULT;
+
+	for (unsigned int i = 0; i < nr; i++)
+		if (unlikely(fds[i] < -1))
+			return -EBADF;
+
+	files = uk_malloc(al->alloc, nr * sizeof(*files));
+	if (unlikely(!files))
+		return -ENOMEM;
+	memcpy(files, fds, nr * sizeof(*files));
+
+	al->files = files;
+	al->nfiles = nr;
+	return 0;
+}
+
+static int iouring_update_files(struct iouring_alloc *al,
+				const struct io_uring_files_update *up,
+				unsigned int nr)
+{
+	const int *fds;
+
+	if (unlikely(!al->files))
+		return -ENXIO;
+	if (unlikely(!up))
+		return -EFAULT;
+	if (unlikely(up->resv))
+		return -EINVAL;
+	if (unlikely(up->offset > al->nfiles || nr > al->nfiles - up->offset))
+		return -EINVAL;
+
+	fds = (const int *)(__uptr)up->fds;
+	if (unlikely(!fds && nr))
+		return -EFAULT;
+	for (unsigned int i = 0; i < nr; i++)
+		if (unlikely(fds[i] < -1))
+			return -EBADF;
+
+	memcpy(&al->files[up->offset], fds, nr * sizeof(*fds));
+	return nr;
+}
+
+static int iouring_probe(struct io_uring_probe *p, unsigned int nr)
+{
+	if (unlikely(!p))
+		return -EFAULT;
+
+	nr = MIN(nr, (unsigned int)IORING_OP_LAST);
+	memset(p, 0, sizeof(*p) + nr * sizeof(p->ops[0]));
+	p->last_op = IORING_OP_LAST - 1;
+	p->ops_len = nr;
+	for (unsigned int i = 0; i < nr; i++) {
+		p->ops[i].op = i;
+		if (iouring_op_supported(i))
+			p->ops[i].flags = IO_URING_OP_SUPPORTED;
+	}
+	return 0;
+}
+
+/* Internal Syscalls */
+
+int uk_sys_io_uring_setup(unsigned int entries,
+			  struct io_uring_params *params)
+{
+	struct io_uring_params p;
+	struct iouring_rings *rings;
+	struct iouring_alloc *al;
+	struct uk_file *f;
+	__u32 sq_entries;
+	__u32 cq_entries;
+	int fd;
+
+	if (unlikely(!params))
+		return -EFAULT;
+	p = *params;
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(p.resv); i++)
+		if (unlikely(p.resv[i]))
+			return -EINVAL;
+	/* No kernel-side polling threads; the application always enters */
+	if (unlikely(p.flags & ~IOURING_SETUP_FLAGS))
+		return -EINVAL;
+	if (unlikely(!entries))
+		return -EINVAL;
+
+	if (entries > IOURING_MAX_ENTRIES) {
+		if (unlikely(!(p.flags & IORING_SETUP_CLAMP)))
+			return -EINVAL;
+		entries = IOURING_MAX_ENTRIES;
+	}
+	sq_entries = iouring_roundup_pow2(entries);
+
+	if (p.flags & IORING_SETUP_CQSIZE) {
+		if (unlikely(!p.cq_entries))
+			return -EINVAL;
+		if (p.cq_entries > IOURING_MAX_CQ_ENTRIES) {
+			if (unlikely(!(p.flags & IORING_SETUP_CLAMP)))
+				return -EINVAL;
+			p.cq_entries = IOURING_MAX_CQ_ENTRIES;
+		}
+		cq_entries = iouring_roundup_pow2(p.cq_entries);
+		if (unlikely(cq_entries < sq_entries))
+			return -EINVAL;
+	} else {
+		cq_entries = 2 * sq_entries;
+	}
+
+	f = iouring_create(sq_entries, cq_entries);
+	if (unlikely(PTRISERR(f)))
+		return PTR2ERR(f);
+
+	al = IOURING_ALLOC(f);
+	rings = al->rings;
+
+	p.sq_entries = sq_entries;
+	p.cq_entries = cq_entries;
+	p.features = IOURING_FEATURES;
+	p.sq_off = (struct io_sqring_offsets){
+		.head = offsetof(struct iouring_rings, sq_head),
+		.tail = offsetof(struct iouring_rings, sq_tail),
+		.ring_mask = offsetof(struct iouring_rings, sq_ring_mask),
+		.ring_entries = offsetof(struct iouring_rings, sq_ring_entries),
+		.flags = offsetof(struct iouring_rings, sq_flags),
+		.dropped = offsetof(struct iouring_rings, sq_dropped),
+		.array = (__u32)((__uptr)al->sq_array - (__uptr)rings)
+	};
+	p.cq_off = (struct io_cqring_offsets){
+		.head = offsetof(struct iouring_rings, cq_head),
+		.tail = offsetof(struct iouring_rings, cq_tail),
+		.ring_mask = offsetof(struct iouring_rings, cq_ring_mask),
+		.ring_entries = offsetof(struct iouring_rings, cq_ring_entries),
+		.overflow = offsetof(struct iouring_rings, cq_overflow),
+		.cqes = offsetof(struct iouring_rings, cqes),
+		.flags = offsetof(struct iouring_rings, cq_flags)
+	};
+
+	fd = uk_fdtab_open(f, O_RDWR|O_CLOEXEC|UKFD_O_NOSEEK|UKFD_O_NOIOLOCK);
+	uk_file_release(f);
+	if (likely(fd >= 0))
+		*params = p;
+	return fd;
+}
+
+int uk_sys_io_uring_enter(const struct uk_file *f, unsigned int to_submit,
+			  unsigned int min_complete __unused,
+			  unsigned int flags, const void *argp, size_t argsz)
+{
+	int ret = 0;
+
+	if (unlikely(f->vol != IOURING_VOLID))
+		return -EOPNOTSUPP;
+	if (unlikely(flags & ~IOURING_ENTER_FLAGS))
+		return -EINVAL;
+	if ((flags & IORING_ENTER_EXT_ARG) && argp &&
+	    unlikely(argsz != sizeof(struct io_uring_getevents_arg)))
+		return -EINVAL;
+
+	if (to_submit) {
+		uk_file_wlock(f);
+		ret = iouring_submit(IOURING_ALLOC(f), to_submit);
+		uk_file_wunlock(f);
+	}
+
+	/* Requests complete before submission returns, so there are never
+	 * requests in flight to wait for with IORING_ENTER_GETEVENTS; the
+	 * wait timeout and signal mask are irrelevant.
+	 */
+	return ret;
+}
+
+int uk_sys_io_uring_register(const struct uk_file *f, unsigned int opcode,
+			     void *arg, unsigned int nr_args)
+{
+	struct iouring_alloc *al;
+	int ret;
+
+	if (unlikely(f->vol != IOURING_VOLID))
+		return -EOPNOTSUPP;
+
+	al = IOURING_ALLOC(f);
+	uk_file_wlock(f);
+	switch (opcode) {
+	case IORING_REGISTER_BUFFERS:
+		ret = iouring_register_buffers(al, arg, nr_args);
+		break;
+	case IORING_UNREGISTER_BUFFERS:
+		if (unlikely(arg || nr_args)) {
+			ret = -EINVAL;
+		} else if (unlikely(!al->bufs)) {
+			ret = -ENXIO;
+		} else {
+			uk_free(al->alloc, al->bufs);
+			al->bufs = NULL;
+			al->nbufs = 0;
+			ret = 0;
+		}
+		break;
+	case IORING_REGISTER_FILES:
+		ret = iouring_register_files(al, arg, nr_args);
+		break;
+	case IORING_UNREGISTER_FILES:
+		if (unlikely(arg || nr_args)) {
+			ret = -EINVAL;
+		} else if (unlikely(!al->files)) {
+			ret = -ENXIO;
+		} else {
+			uk_free(al->alloc, al->files);
+			al->files = NULL;
+			al->nfiles = 0;
+			ret = 0;
+		}
+		break;
+	case IORING_REGISTER_FILES_UPDATE:
+		ret = iouring_update_files(al, arg, nr_args);
+		break;
+	case IORING_REGISTER_EVENTFD:
+	case IORING_REGISTER_EVENTFD_ASYNC:
+		if (unlikely(nr_args != 1))
+			ret = -EINVAL;
+		else if (unlikely(!arg))
+			ret = -EFAULT;
+		else if (unlikely(al->evfd >= 0))
+			ret = -EBUSY;
+		else if (unlikely(*(const int *)arg < 0))
+			ret = -EBADF;
+		else {
+			al->evfd = *(const int *)arg;
+			ret = 0;
+		}
+		break;
+	case IORING_UNREGISTER_EVENTFD:
+		if (unlikely(arg || nr_args)) {
+			ret = -EINVAL;
+		} else if (unlikely(al->evfd < 0)) {
+			ret = -ENXIO;
+		} else {
+			al->evfd = -1;
+			ret = 0;
+		}
+		break;
+	case IORING_REGISTER_PROBE:
+		ret = iouring_probe(arg, nr_args);
+		break;
+	default:
+		ret = -EINVAL;
+	}
+	uk_file_wunlock(f);
+	return ret;
+}
+
+/* Userspace Syscalls */
+
+UK_SYSCALL_R_DEFINE(int, io_uring_setup, unsigned int, entries,
+		    struct io_uring_params *, params)
+{
+	return uk_sys_io_uring_setup(entries, params);
+}
+
+UK_SYSCALL_R_DEFINE(int, io_uring_enter, unsigned int, fd,
+		    unsigned int, to_submit, unsigned int, min_complete,
+		    unsigned int, flags, const void *, argp, size_t, argsz)
+{
+	int r;
+	struct uk_ofile *of = uk_fdtab_get(fd);
+
+	if (unlikely(!of))
+		return -EBADF;
+	r = uk_sys_io_uring_enter(of->file, to_submit, min_complete,
+				  flags, argp, argsz);
+	uk_fdtab_ret(of);
+	return r;
+}
+
+UK_SYSCALL_R_DEFINE(int, io_uring_register, unsigned int, fd,
+		    unsigned int, opcode, void *, arg, unsigned int, nr_args)
+{
+	int r;
+	struct uk_ofile *of = uk_fdtab_get(fd);
+
+	if (unlikely(!of))
+		return -EBADF;
+	r = uk_sys_io_uring_register(of->file, opcode, arg, nr_args);
+	uk_fdtab_ret(of);
+	return r;
+}
@@ -0,0 +1,1030 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * Minimal dynamic linker
+ *
+ * Shared objects are mapped from the file system with private file
+ * mappings, so that their pages are loaded through the page cache, and
+ * relocated against the symbols of the image (see libdl.h), the objects
+ * loaded with RTLD_GLOBAL, and their own dependencies, in this order.
+ * Symbols are looked up through the GNU hash table of an object, or its
+ * SysV hash table if it has none. On x86_64, PLT relocations are bound
+ * lazily on the first call unless RTLD_NOW, DF_BIND_NOW, or DF_1_NOW is
+ * given. Thread-local storage is not supported.
+ */
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <uk/arch/limits.h>
+#include <uk/arch/paging.h>
+#include <uk/assert.h>
+#include <uk/essentials.h>
+#include <uk/list.h>
+#include <uk/mutex.h>
+#include <uk/print.h>
+
+#include "elf64.h"
+#include "libdl.h"
+
+#if defined(__X86_64__)
+#define DL_LAZY_BINDING		1
+#endif /* __X86_64__ */
+
+#define DL_MAX_PHDRS		32
+#define DL_ERRLEN		256
+
+struct dl_obj {
+	struct uk_list_head list;
+	char *path;
+	unsigned int refcnt;
+	int flags;
+
+	/* Load bias, i.e., run time minus link time addresses */
+	__uptr base;
+	void *map;
+	__sz maplen;
+
+	const Elf64_Dyn *dynamic;
+	const Elf64_Sym *symtab;
+	const char *strtab;
+	const Elf64_Word *gnu_hash;
+	const Elf64_Word *sysv_hash;
+	const Elf64_Rela *rela;
+	__sz relasz;
+	const Elf64_Rela *jmprel;
+	__sz jmprelsz;
+	Elf64_Addr *pltgot;
+	int bind_now;
+
+	void (*init)(void);
+	void (*fini)(void);
+	void (**init_array)(void);
+	__sz init_arraysz;
+	void (**fini_array)(void);
+	__sz fini_arraysz;
+
+	struct dl_obj **deps;
+	unsigned int ndeps;
+};
+
+/* Loaded objects, in load order */
+static UK_LIST_HEAD(dl_objs);
+static struct uk_mutex dl_lock = UK_MUTEX_INITIALIZER_RECURSIVE(dl_lock);
+
+/* Handle returned by dlopen(NULL) */
+static struct dl_obj dl_image = {
+	.path = "",
+	.refcnt = 1,
+	.flags = RTLD_GLOBAL | RTLD_NODELETE,
+};
+
+static char dl_errbuf[DL_ERRLEN];
+static int dl_errset;
+
+static void dl_seterr(const char *fmt, ...) __printf(1, 2);
+
+static void dl_seterr(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(dl_errbuf, sizeof(dl_errbuf), fmt, ap);
+	va_end(ap);
+	dl_errset = 1;
+	uk_pr_debug("%s\n", dl_errbuf);
+}
+
+/*
+ * Symbol lookup
+ */
+
+static int dl_sym_usable(const Elf64_Sym *sym)
+{
+	unsigned char bind = ELF64_ST_BIND(sym->st_info);
+	unsigned char type = ELF64_ST_TYPE(sym->st_info);
+
+	if (sym->st_shndx == SHN_UNDEF)
+		return 0;
+	if (bind != STB_GLOBAL && bind != STB_WEAK)
+		return 0;
+	return type == STT_NOTYPE || type == STT_OBJECT || type == STT_FUNC ||
+	       type == STT_COMMON || type == STT_GNU_IFUNC;
+}
+
+static __u32 dl_sysv_hash(const char *name)
+{
+	const unsigned char *s = (const unsigned char *)name;
+	__u32 h = 0, g;
+
+	while (*s) {
+		h = (h << 4) + *s++;
+		g = h & 0xf0000000;
+		if (g)
+			h ^= g >> 24;
+		h &= ~g;
+	}
+	return h;
+}
+
+static const Elf64_Sym *dl_gnu_lookup(const struct dl_obj *obj,
+				      const char *name, __u32 hash)
+{
+	const Elf64_Word *h = obj->gnu_hash;
+	__u32 nbuckets = h[0], symoffset = h[1];
+	__u32 bloom_size = h[2], bloom_shift = h[3];
+	const __u64 *bloom = (const __u64 *)&h[4];
+	const __u32 *buckets = (const __u32 *)&bloom[bloom_size];
+	const __u32 *chain = &buckets[nbuckets];
+	const Elf64_Sym *sym;
+	__u64 word, mask;
+	__u32 i, ch;
+
+	word = bloom[(hash / 64) % bloom_size];
+	mask = (1ULL << (hash % 64)) | (1ULL << ((hash >> bloom_shift) % 64));
+	if ((word & mask) != mask)
+		return __NULL;
+
+	i = buckets[hash % nbuckets];
+	if (i < symoffset)
+		return __NULL;
+
+	for (;; i++) {
+		ch = chain[i - symoffset];
+		sym = &obj->symtab[i];
+		if ((ch | 1) == (hash | 1) &&
+		    !strcmp(obj->strtab + sym->st_name, name) &&
+		    dl_sym_usable(sym))
+			return sym;
+		if (ch & 1)
+			return __NULL;
+	}
+}
+
+static const Elf64_Sym *dl_sysv_lookup(const struct dl_obj *obj,
+				       const char *name)
+{
+	const Elf64_Word *h = obj->sysv_hash;
+	__u32 nbucket = h[0];
+	const __u32 *bucket = &h[2];
+	const __u32 *chain = &bucket[nbucket];
+	const Elf64_Sym *sym;
+	__u32 i;
+
+	for (i = bucket[dl_sysv_hash(name) % nbucket]; i; i = chain[i]) {
+		sym = &obj->symtab[i];
+		if (!strcmp(obj->strtab + sym->st_name, name) &&
+		    dl_sym_usable(sym))
+			return sym;
+	}
+	return __NULL;
+}
+
+static const Elf64_Sym *dl_obj_lookup(const struct dl_obj *obj,
+				      const char *name, __u32 hash)
+{
+	if (obj == &dl_image)
+		return __NULL;
+	if (obj->gnu_hash)
+		return dl_gnu_lookup(obj, name, hash);
+	if (obj->sysv_hash)
+		return dl_sysv_lookup(obj, name);
+	return __NULL;
+}
+
+static void *dl_sym_addr(const struct dl_obj *obj, const Elf64_Sym *sym)
+{
+	void *addr = (void *)(obj->base + sym->st_value);
+
+	if (ELF64_ST_TYPE(sym->st_info) == STT_GNU_IFUNC)
+		addr = ((void *(*)(void))addr)();
+	return addr;
+}
+
+/* Looks up a symbol in an object and, breadth-first, its dependencies */
+static void *dl_lookup_deps(struct dl_obj *obj, const char *name, __u32 hash)
+{
+	const Elf64_Sym *sym;
+	unsigned int i;
+	void *addr;
+
+	sym = dl_obj_lookup(obj, name, hash);
+	if (sym)
+		return dl_sym_addr(obj, sym);
+
+	for (i = 0; i < obj->ndeps; i++) {
+		sym = dl_obj_lookup(obj->deps[i], name, hash);
+		if (sym)
+			return dl_sym_addr(obj->deps[i], sym);
+	}
+	for (i = 0; i < obj->ndeps; i++) {
+		addr = dl_lookup_deps(obj->deps[i], name, hash);
+		if (addr)
+			return addr;
+	}
+	return __NULL;
+}
+
+/* Looks up a symbol in the global scope, i.e., the image and the objects
+ * loaded with RTLD_GLOBAL
+ */
+static void *dl_lookup_global(const char *name, __u32 hash)
+{
+	const Elf64_Sym *sym;
+	struct dl_obj *obj;
+	void *addr;
+
+	addr = uk_dl_image_lookup(name, hash);
+	if (addr)
+		return addr;
+
+	uk_list_for_each_entry(obj, &dl_objs, list) {
+		if (!(obj->flags & RTLD_GLOBAL))
+			continue;
+		sym = dl_obj_lookup(obj, name, hash);
+		if (sym)
+			return dl_sym_addr(obj, sym);
+	}
+	return __NULL;
+}
+
+/* Resolves the symbol of a relocation of `obj` */
+static int dl_resolve(struct dl_obj *obj, __u32 symidx, __uptr *val)
+{
+	const Elf64_Sym *sym = &obj->symtab[symidx];
+	const char *name = obj->strtab + sym->st_name;
+	__u32 hash;
+	void *addr;
+
+	/* Local symbols bind to the object itself */
+	if (ELF64_ST_BIND(sym->st_info) == STB_LOCAL) {
+		*val = (__uptr)dl_sym_addr(obj, sym);
+		return 0;
+	}
+
+	hash = uk_dl_gnu_hash(name);
+	addr = dl_lookup_global(name, hash);
+	if (!addr)
+		addr = dl_lookup_deps(obj, name, hash);
+	if (!addr) {
+		if (ELF64_ST_BIND(sym->st_info) == STB_WEAK) {
+			*val = 0;
+			return 0;
+		}
+		dl_seterr("%s: undefined symbol: %s", obj->path, name);
+		return -ENOENT;
+	}
+
+	*val = (__uptr)addr;
+	return 0;
+}
+
+/*
+ * Relocation
+ */
+
+static int dl_relocate_one(struct dl_obj *obj, const Elf64_Rela *r)
+{
+	Elf64_Addr *where = (Elf64_Addr *)(obj->base + r->r_offset);
+	__u32 type = ELF64_R_TYPE(r->r_info);
+	__u32 symidx = ELF64_R_SYM(r->r_info);
+	__uptr val;
+	int rc;
+
+	switch (type) {
+	case R_NONE:
+		return 0;
+	case R_RELATIVE:
+		*where = obj->base + r->r_addend;
+		return 0;
+	case R_IRELATIVE:
+		*where = (Elf64_Addr)((__uptr (*)(void))
+				      (obj->base + r->r_addend))();
+		return 0;
+	case R_ABS64:
+	case R_GLOB_DAT:
+	case R_JUMP_SLOT:
+		rc = dl_resolve(obj, symidx, &val);
+		if (unlikely(rc))
+			return rc;
+#if defined(__X86_64__)
+		/* The addend of GLOB_DAT and JUMP_SLOT is implicitly 0 */
+		if (type == R_ABS64)
+			val += r->r_addend;
+#else /* !__X86_64__ */
+		val += r->r_addend;
+#endif /* !__X86_64__ */
+		*where = val;
+		return 0;
+	default:
+		dl_seterr("%s: unsupported relocation type %"__PRIu32,
+			  obj->path, type);
+		return -ENOTSUP;
+	}
+}
+
+#if DL_LAZY_BINDING
+/* PLT trampoline, see arch/<arch>/resolve.S */
+extern void uk_dl_runtime_resolve(void);
+
+/* Called by uk_dl_runtime_resolve() on the first call through a PLT slot */
+void *uk_dl_fixup(struct dl_obj *obj, unsigned long idx)
+{
+	const Elf64_Rela *r = &obj->jmprel[idx];
+	Elf64_Addr *where = (Elf64_Addr *)(obj->base + r->r_offset);
+	__uptr val;
+	int rc;
+
+	uk_mutex_lock(&dl_lock);
+	rc = dl_resolve(obj, ELF64_R_SYM(r->r_info), &val);
+	uk_mutex_unlock(&dl_lock);
+	if (unlikely(rc))
+		UK_CRASH("%s\n", dl_errbuf);
+
+	*where = val;
+	return (void *)val;
+}
+#endif /* DL_LAZY_BINDING */
+
+static int dl_relocate(struct dl_obj *obj)
+{
+	__sz i, n;
+	int rc;
+
+	n = obj->relasz / sizeof(Elf64_Rela);
+	for (i = 0; i < n; i++) {
+		rc = dl_relocate_one(obj, &obj->rela[i]);
+		if (unlikely(rc))
+			return rc;
+	}
+
+	n = obj->jmprelsz / sizeof(Elf64_Rela);
+#if DL_LAZY_BINDING
+	if (!obj->bind_now && obj->pltgot) {
+		Elf64_Addr *where;
+
+		/* Let the PLT slots point back into the PLT, which enters
+		 * the trampoline with GOT[1] and the index of the slot
+		 */
+		obj->pltgot[1] = (Elf64_Addr)obj;
+		obj->pltgot[2] = (Elf64_Addr)uk_dl_runtime_resolve;
+		for (i = 0; i < n; i++) {
+			if (ELF64_R_TYPE(obj->jmprel[i].r_info) !=
+			    R_JUMP_SLOT) {
+				rc = dl_relocate_one(obj, &obj->jmprel[i]);
+				if (unlikely(rc))
+					return rc;
+				continue;
+			}
+			where = (Elf64_Addr *)(obj->base +
+					       obj->jmprel[i].r_offset);
+			*where += obj->base;
+		}
+		return 0;
+	}
+#endif /* DL_LAZY_BINDING */
+	for (i = 0; i < n; i++) {
+		rc = dl_relocate_one(obj, &obj->jmprel[i]);
+		if (unlikely(rc))
+			return rc;
+	}
+	return 0;
+}
+
+/*
+ * Loading
+ */
+
+static int dl_pread(int fd, void *buf, __sz len, off_t off)
+{
+	ssize_t rc;
+
+	rc = pread(fd, buf, len, off);
+	if (rc < 0)
+		return -errno;
+	if ((__sz)rc != len)
+		return -ENOEXEC;
+	return 0;
+}
+
+static int dl_prot(Elf64_Word flags)
+{
+	return ((flags & PF_R) ? PROT_READ : 0) |
+	       ((flags & PF_W) ? PROT_WRITE : 0) |
+	       ((flags & PF_X) ? PROT_EXEC : 0);
+}
+
+/* Maps the PT_LOAD segments of an object. All segments are writable until
+ * the object is relocated.
+ */
+static int dl_map(struct dl_obj *obj, int fd, const Elf64_Phdr *ph,
+		  unsigned int phnum)
+{
+	Elf64_Addr lo = ~(Elf64_Addr)0, hi = 0;
+	__uptr start, fend, end;
+	const Elf64_Phdr *p;
+	unsigned int i;
+	void *addr;
+
+	for (i = 0; i < phnum; i++) {
+		if (ph[i].p_type != PT_LOAD)
+			continue;
+		lo = MIN(lo, PAGE_ALIGN_DOWN(ph[i].p_vaddr));
+		hi = MAX(hi, PAGE_ALIGN_UP(ph[i].p_vaddr + ph[i].p_memsz));
+	}
+	if (unlikely(lo >= hi)) {
+		dl_seterr("%s: no loadable segments", obj->path);
+		return -ENOEXEC;
+	}
+
+	/* Reserve the address range of the whole object */
+	obj->maplen = hi - lo;
+	obj->map = mmap(__NULL, obj->maplen, PROT_NONE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (unlikely(obj->map == MAP_FAILED)) {
+		obj->map = __NULL;
+		dl_seterr("%s: out of memory", obj->path);
+		return -ENOMEM;
+	}
+	obj->base = (__uptr)obj->map - lo;
+
+	for (i = 0; i < phnum; i++) {
+		p = &ph[i];
+		if (p->p_type != PT_LOAD)
+			continue;
+		if (unlikely(PAGE_ALIGN_DOWN(p->p_vaddr) -
+			     PAGE_ALIGN_DOWN(p->p_offset) !=
+			     p->p_vaddr - p->p_offset)) {
+			dl_seterr("%s: misaligned segment", obj->path);
+			return -ENOEXEC;
+		}
+
+		start = obj->base + PAGE_ALIGN_DOWN(p->p_vaddr);
+		fend = obj->base + p->p_vaddr + p->p_filesz;
+		end = obj->base + PAGE_ALIGN_UP(p->p_vaddr + p->p_memsz);
+
+		if (p->p_filesz) {
+			addr = mmap((void *)start, fend - start,
+				    PROT_READ | PROT_WRITE,
+				    MAP_PRIVATE | MAP_FIXED, fd,
+				    PAGE_ALIGN_DOWN(p->p_offset));
+			if (unlikely(addr == MAP_FAILED)) {
+				dl_seterr("%s: failed to map segment: %d",
+					  obj->path, errno);
+				return -errno;
+			}
+
+			/* The rest of the last page belongs to .bss */
+			if (p->p_memsz > p->p_filesz)
+				memset((void *)fend, 0,
+				       PAGE_ALIGN_UP(fend) - fend);
+		}
+
+		start = PAGE_ALIGN_UP(fend);
+		if (end > start) {
+			addr = mmap((void *)start, end - start,
+				    PROT_READ | PROT_WRITE,
+				    MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,
+				    -1, 0);
+			if (unlikely(addr == MAP_FAILED)) {
+				dl_seterr("%s: out of memory", obj->path);
+				return -ENOMEM;
+			}
+		}
+	}
+	return 0;
+}
+
+static void dl_protect(struct dl_obj *obj, const Elf64_Phdr *ph,
+		       unsigned int phnum)
+{
+	__uptr start, end;
+	unsigned int i;
+
+	for (i = 0; i < phnum; i++) {
+		if (ph[i].p_type != PT_LOAD)
+			continue;
+		start = obj->base + PAGE_ALIGN_DOWN(ph[i].p_vaddr);
+		end = obj->base + PAGE_ALIGN_UP(ph[i].p_vaddr +
+						ph[i].p_memsz);
+		if (mprotect((void *)start, end - start,
+			     dl_prot(ph[i].p_flags)))
+			uk_pr_warn("%s: failed to protect segment: %d\n",
+				   obj->path, errno);
+	}
+}
+
+static void dl_parse_dynamic(struct dl_obj *obj)
+{
+	const Elf64_Dyn *d;
+
+	for (d = obj->dynamic; d->d_tag != DT_NULL; d++) {
+		switch (d->d_tag) {
+		case DT_STRTAB:
+			obj->strtab = (const char *)(obj->base + d->d_un.d_ptr);
+			break;
+		case DT_SYMTAB:
+			obj->symtab = (const Elf64_Sym *)
+				(obj->base + d->d_un.d_ptr);
+			break;
+		case DT_GNU_HASH:
+			obj->gnu_hash = (const Elf64_Word *)
+				(obj->base + d->d_un.d_ptr);
+			break;
+		case DT_HASH:
+			obj->sysv_hash = (const Elf64_Word *)
+				(obj->base + d->d_un.d_ptr);
+			break;
+		case DT_RELA:
+			obj->rela = (const Elf64_Rela *)
+				(obj->base + d->d_un.d_ptr);
+			break;
+		case DT_RELASZ:
+			obj->relasz = d->d_un.d_val;
+			break;
+		case DT_JMPREL:
+			obj->jmprel = (const Elf64_Rela *)
+				(obj->base + d->d_un.d_ptr);
+			break;
+		case DT_PLTRELSZ:
+			obj->jmprelsz = d->d_un.d_val;
+			break;
+		case DT_PLTGOT:
+			obj->pltgot = (Elf64_Addr *)(obj->base + d->d_un.d_ptr);
+			break;
+		case DT_BIND_NOW:
+			obj->bind_now = 1;
+			break;
+		case DT_FLAGS:
+			if (d->d_un.d_val & DF_BIND_NOW)
+				obj->bind_now = 1;
+			break;
+		case DT_FLAGS_1:
+			if (d->d_un.d_val & DF_1_NOW)
+				obj->bind_now = 1;
+			break;
+		case DT_INIT:
+			obj->init = (void (*)(void))(obj->base + d->d_un.d_ptr);
+			break;
+		case DT_FINI:
+			obj->fini = (void (*)(void))(obj->base + d->d_un.d_ptr);
+			break;
+		case DT_INIT_ARRAY:
+			obj->init_array = (void (**)(void))
+				(obj->base + d->d_un.d_ptr);
+			break;
+		case DT_INIT_ARRAYSZ:
+			obj->init_arraysz = d->d_un.d_val / sizeof(void *);
+			break;
+		case DT_FINI_ARRAY:
+			obj->fini_array = (void (**)(void))
+				(obj->base + d->d_un.d_ptr);
+			break;
+		case DT_FINI_ARRAYSZ:
+			obj->fini_arraysz = d->d_un.d_val / sizeof(void *);
+			break;
+		}
+	}
+}
+
+static struct dl_obj *dl_load(const char *path, int flags);
+static void dl_release(struct dl_obj *obj);
+
+static int dl_exists(const char *path)
+{
+	struct stat st;
+
+	return !stat(path, &st) && S_ISREG(st.st_mode);
+}
+
+/* Loads an object given by path or, if the name contains no slash, from
+ * the search path. Sets `found` to 0 if there is no such file.
+ */
+static struct dl_obj *dl_open(const char *name, int flags, int *found)
+{
+	char path[PATH_MAX];
+	const char *dir, *sep;
+	__sz dlen;
+
+	*found = 1;
+	if (strchr(name, '/')) {
+		if (dl_exists(name))
+			return dl_load(name, flags);
+		*found = 0;
+		return __NULL;
+	}
+
+	for (dir = CONFIG_LIBPOSIX_LIBDL_PATH; *dir;
+	     dir = sep + (*sep == ':')) {
+		sep = strchr(dir, ':');
+		if (!sep)
+			sep = dir + strlen(dir);
+		dlen = sep - dir;
+		if (!dlen || dlen + strlen(name) + 2 > PATH_MAX)
+			continue;
+		memcpy(path, dir, dlen);
+		path[dlen] = '/';
+		strcpy(path + dlen + 1, name);
+		if (dl_exists(path))
+			return dl_load(path, flags);
+	}
+	*found = 0;
+	return __NULL;
+}
+
+/* Loads the DT_NEEDED objects that are found in the search path. Others
+ * are expected to be part of the image, e.g., the C library.
+ */
+static int dl_load_deps(struct dl_obj *obj)
+{
+	const Elf64_Dyn *d;
+	struct dl_obj *dep;
+	unsigned int n = 0;
+	const char *name;
+	int found;
+
+	for (d = obj->dynamic; d->d_tag != DT_NULL; d++)
+		if (d->d_tag == DT_NEEDED)
+			n++;
+	if (!n)
+		return 0;
+
+	obj->deps = calloc(n, sizeof(*obj->deps));
+	if (unlikely(!obj->deps)) {
+		dl_seterr("%s: out of memory", obj->path);
+		return -ENOMEM;
+	}
+
+	for (d = obj->dynamic; d->d_tag != DT_NULL; d++) {
+		if (d->d_tag != DT_NEEDED)
+			continue;
+		name = obj->strtab + d->d_un.d_val;
+
+		dep = dl_open(name, RTLD_LOCAL | (obj->flags & RTLD_LAZY),
+			      &found);
+		if (dep)
+			obj->deps[obj->ndeps++] = dep;
+		else if (found)
+			return -ENOEXEC;
+		else
+			uk_pr_debug("%s: using %s from the image\n",
+				    obj->path, name);
+	}
+	return 0;
+}
+
+static void dl_run_init(struct dl_obj *obj)
+{
+	__sz i;
+
+	if (obj->init)
+		obj->init();
+	for (i = 0; i < obj->init_arraysz; i++)
+		if (obj->init_array[i] &&
+		    obj->init_array[i] != (void (*)(void))-1)
+			obj->init_array[i]();
+}
+
+static void dl_run_fini(struct dl_obj *obj)
+{
+	__sz i;
+
+	for (i = obj->fini_arraysz; i > 0; i--)
+		if (obj->fini_array[i - 1] &&
+		    obj->fini_array[i - 1] != (void (*)(void))-1)
+			obj->fini_array[i - 1]();
+	if (obj->fini)
+		obj->fini();
+}
+
+static void dl_free(struct dl_obj *obj)
+{
+	unsigned int i;
+
+	for (i = 0; i < obj->ndeps; i++)
+		dl_release(obj->deps[i]);
+	if (obj->map)
+		munmap(obj->map, obj->maplen);
+	free(obj->deps);
+	free(obj->path);
+	free(obj);
+}
+
+static struct dl_obj *dl_find(const char *path)
+{
+	struct dl_obj *obj;
+
+	uk_list_for_each_entry(obj, &dl_objs, list)
+		if (!strcmp(obj->path, path))
+			return obj;
+	return __NULL;
+}
+
+/* Loads an object or takes another reference to it. Must be called with
+ * dl_lock held.
+ */
+static struct dl_obj *dl_load(const char *path, int flags)
+{
+	Elf64_Phdr ph[DL_MAX_PHDRS];
+	struct dl_obj *obj;
+	Elf64_Ehdr eh;
+	unsigned int i;
+	int fd, rc;
+
+	obj = dl_find(path);
+	if (obj) {
+		obj->refcnt++;
+		obj->flags |= flags & (RTLD_GLOBAL | RTLD_NODELETE);
+		return obj;
+	}
+	if (flags & RTLD_NOLOAD)
+		return __NULL;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		dl_seterr("%s: cannot open: %d", path, errno);
+		return __NULL;
+	}
+
+	obj = calloc(1, sizeof(*obj));
+	if (unlikely(!obj)) {
+		dl_seterr("%s: out of memory", path);
+		goto err_close;
+	}
+	obj->refcnt = 1;
+	obj->flags = flags;
+	obj->path = strdup(path);
+	if (unlikely(!obj->path)) {
+		dl_seterr("%s: out of memory", path);
+		goto err_free;
+	}
+
+	rc = dl_pread(fd, &eh, sizeof(eh), 0);
+	if (unlikely(rc) || memcmp(eh.e_ident, ELFMAG, SELFMAG) ||
+	    eh.e_ident[EI_CLASS] != ELFCLASS64 ||
+	    eh.e_ident[EI_DATA] != ELFDATA2LSB || eh.e_type != ET_DYN ||
+	    eh.e_machine != DL_EM || eh.e_phentsize != sizeof(Elf64_Phdr) ||
+	    eh.e_phnum > DL_MAX_PHDRS) {
+		dl_seterr("%s: not a shared object for this architecture",
+			  path);
+		goto err_free;
+	}
+
+	rc = dl_pread(fd, ph, eh.e_phnum * sizeof(Elf64_Phdr), eh.e_phoff);
+	if (unlikely(rc)) {
+		dl_seterr("%s: cannot read program headers: %d", path, rc);
+		goto err_free;
+	}
+
+	for (i = 0; i < eh.e_phnum; i++) {
+		if (ph[i].p_type == PT_TLS) {
+			dl_seterr("%s: thread-local storage is not supported",
+				  path);
+			goto err_free;
+		}
+	}
+
+	rc = dl_map(obj, fd, ph, eh.e_phnum);
+	if (unlikely(rc))
+		goto err_free;
+	close(fd);
+	fd = -1;
+
+	for (i = 0; i < eh.e_phnum; i++)
+		if (ph[i].p_type == PT_DYNAMIC)
+			obj->dynamic = (const Elf64_Dyn *)
+				(obj->base + ph[i].p_vaddr);
+	if (unlikely(!obj->dynamic)) {
+		dl_seterr("%s: no dynamic section", path);
+		goto err_free;
+	}
+	dl_parse_dynamic(obj);
+	if (unlikely(!obj->symtab || !obj->strtab ||
+		     (!obj->gnu_hash && !obj->sysv_hash))) {
+		dl_seterr("%s: no symbol table", path);
+		goto err_free;
+	}
+	if (!(flags & RTLD_LAZY))
+		obj->bind_now = 1;
+
+	/* Add the object before loading its dependencies, so that cyclic
+	 * dependencies find it instead of loading it again. Dependencies
+	 * are initialized before the object.
+	 */
+	uk_list_add_tail(&obj->list, &dl_objs);
+	rc = dl_load_deps(obj);
+	if (unlikely(rc))
+		goto err_unlink;
+
+	rc = dl_relocate(obj);
+	if (unlikely(rc))
+		goto err_unlink;
+	dl_protect(obj, ph, eh.e_phnum);
+
+	uk_pr_debug("Loaded %s at %p\n", path, obj->map);
+
+	dl_run_init(obj);
+	return obj;
+
+err_unlink:
+	uk_list_del(&obj->list);
+err_free:
+	dl_free(obj);
+err_close:
+	if (fd >= 0)
+		close(fd);
+	return __NULL;
+}
+
+/* Drops a reference to an object. Must be called with dl_lock held. */
+static void dl_release(struct dl_obj *obj)
+{
+	UK_ASSERT(obj->refcnt > 0);
+
+	if (--obj->refcnt || (obj->flags & RTLD_NODELETE))
+		return;
+
+	dl_run_fini(obj);
+	uk_list_del(&obj->list);
+	dl_free(obj);
+}
+
+static struct dl_obj *dl_handle(void *handle)
+{
+	struct dl_obj *obj;
+
+	if (handle == &dl_image)
+		return &dl_image;
+	uk_list_for_each_entry(obj, &dl_objs, list)
+		if (obj == handle)
+			return obj;
+	return __NULL;
+}
+
+/*
+ * API
+ */
+
+void *dlopen(const char *filename, int flags)
+{
+	struct dl_obj *obj;
+	int found;
+
+	if (!filename)
+		return &dl_image;
+
+	uk_mutex_lock(&dl_lock);
+	dl_errset = 0;
+	obj = dl_open(filename, flags, &found);
+	if (!found)
+		dl_seterr("%s: not found", filename);
+	uk_mutex_unlock(&dl_lock);
+
+	return obj;
+}
+
+int dlclose(void *handle)
+{
+	struct dl_obj *obj;
+
+	uk_mutex_lock(&dl_lock);
+	obj = dl_handle(handle);
+	if (unlikely(!obj)) {
+		dl_seterr("invalid handle %p", handle);
+		uk_mutex_unlock(&dl_lock);
+		return -1;
+	}
+	if (obj != &dl_image)
+		dl_release(obj);
+	uk_mutex_unlock(&dl_lock);
+	return 0;
+}
+
+void *dlsym(void *__restrict handle, const char *__restrict symbol)
+{
+	struct dl_obj *obj;
+	void *addr = __NULL;
+	__u32 hash;
+
+	if (handle == RTLD_NEXT) {
+		dl_seterr("RTLD_NEXT is not supported");
+		return __NULL;
+	}
+
+	hash = uk_dl_gnu_hash(symbol);
+
+	uk_mutex_lock(&dl_lock);
+	if (handle == RTLD_DEFAULT || handle == &dl_image) {
+		addr = dl_lookup_global(symbol, hash);
+	} else {
+		obj = dl_handle(handle);
+		if (unlikely(!obj)) {
+			dl_seterr("invalid handle %p", handle);
+			goto out;
+		}
+		addr = dl_lookup_deps(obj, symbol, hash);
+	}
+	if (!addr)
+		dl_seterr("undefined symbol: %s", symbol);
+out:
+	uk_mutex_unlock(&dl_lock);
+	return addr;
+}
+
+void *dlvsym(void *handle, const char *symbol,
+	     const char *version __unused)
+{
+	/* Symbol versions are not tracked, every version matches */
+	return dlsym(handle, symbol);
+}
+
+char *dlerror(void)
+{
+	if (!dl_errset)
+		return __NULL;
+	dl_errset = 0;
+	return dl_errbuf;
+}
+
+static __u32 dl_nsyms(const struct dl_obj *obj)
+{
+	const Elf64_Word *h;
+	const __u32 *buckets, *chain;
+	__u32 i, n = 0;
+
+	if (obj->sysv_hash)
+		return obj->sysv_hash[1];
+
+	/* The GNU hash table has no count, find the end of the last chain */
+	h = obj->gnu_hash;
+	buckets = (const __u32 *)&((const __u64 *)&h[4])[h[2]];
+	chain = &buckets[h[0]];
+	for (i = 0; i < h[0]; i++)
+		n = MAX(n, buckets[i]);
+	if (n < h[1])
+		return h[1];
+	while (!(chain[n - h[1]] & 1))
+		n++;
+	return n + 1;
+}
+
+int dladdr(const void *addr, Dl_info *info)
+{
+	const Elf64_Sym *sym, *best = __NULL;
+	struct dl_obj *obj;
+	__uptr a = (__uptr)addr;
+	void *saddr;
+	__u32 i, n;
+
+	uk_mutex_lock(&dl_lock);
+	uk_list_for_each_entry(obj, &dl_objs, list) {
+		if (a < (__uptr)obj->map || a >= (__uptr)obj->map + obj->maplen)
+			continue;
+
+		n = dl_nsyms(obj);
+		for (i = 1; i < n; i++) {
+			sym = &obj->symtab[i];
+			if (sym->st_shndx == SHN_UNDEF ||
+			    obj->base + sym->st_value > a)
+				continue;
+			if (!best || sym->st_value > best->st_value)
+				best = sym;
+		}
+
+		info->dli_fname = obj->path;
+		info->dli_fbase = obj->map;
+		info->dli_sname = best ? obj->strtab + best->st_name : __NULL;
+		info->dli_saddr = best ? (void *)(obj->base + best->st_value)
+				       : __NULL;
+		uk_mutex_unlock(&dl_lock);
+		return 1;
+	}
+	uk_mutex_unlock(&dl_lock);
+
+	info->dli_sname = uk_dl_image_addr(addr, &saddr);
+	if (!info->dli_sname)
+		return 0;
+	info->dli_fname = "";
+	info->dli_fbase = __NULL;
+	info->dli_saddr = saddr;
+	return 1;
+}
+
+int dlinfo(void *handle __unused, int request, void *info __unused)
+{
+	dl_seterr("dlinfo request %d is not supported", request);
+	return -1;
+}
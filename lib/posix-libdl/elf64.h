@@ -0,0 +1,155 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/* Subset of the ELF-64 format needed to load shared objects */
+
+#ifndef __POSIX_LIBDL_ELF64_H__
+#define __POSIX_LIBDL_ELF64_H__
+
+#include <uk/arch/types.h>
+
+typedef __u16 Elf64_Half;
+typedef __u32 Elf64_Word;
+typedef __s64 Elf64_Sxword;
+typedef __u64 Elf64_Xword;
+typedef __u64 Elf64_Addr;
+typedef __u64 Elf64_Off;
+
+#define EI_NIDENT	16
+#define EI_CLASS	4
+#define EI_DATA		5
+
+#define ELFMAG		"\177ELF"
+#define SELFMAG		4
+#define ELFCLASS64	2
+#define ELFDATA2LSB	1
+#define ET_DYN		3
+#define EM_X86_64	62
+#define EM_AARCH64	183
+
+typedef struct {
+	unsigned char e_ident[EI_NIDENT];
+	Elf64_Half e_type;
+	Elf64_Half e_machine;
+	Elf64_Word e_version;
+	Elf64_Addr e_entry;
+	Elf64_Off e_phoff;
+	Elf64_Off e_shoff;
+	Elf64_Word e_flags;
+	Elf64_Half e_ehsize;
+	Elf64_Half e_phentsize;
+	Elf64_Half e_phnum;
+	Elf64_Half e_shentsize;
+	Elf64_Half e_shnum;
+	Elf64_Half e_shstrndx;
+} Elf64_Ehdr;
+
+#define PT_LOAD		1
+#define PT_DYNAMIC	2
+#define PT_TLS		7
+#define PF_X		0x1
+#define PF_W		0x2
+#define PF_R		0x4
+
+typedef struct {
+	Elf64_Word p_type;
+	Elf64_Word p_flags;
+	Elf64_Off p_offset;
+	Elf64_Addr p_vaddr;
+	Elf64_Addr p_paddr;
+	Elf64_Xword p_filesz;
+	Elf64_Xword p_memsz;
+	Elf64_Xword p_align;
+} Elf64_Phdr;
+
+#define DT_NULL		0
+#define DT_NEEDED	1
+#define DT_PLTRELSZ	2
+#define DT_PLTGOT	3
+#define DT_HASH		4
+#define DT_STRTAB	5
+#define DT_SYMTAB	6
+#define DT_RELA		7
+#define DT_RELASZ	8
+#define DT_RELAENT	9
+#define DT_INIT		12
+#define DT_FINI		13
+#define DT_SONAME	14
+#define DT_REL		17
+#define DT_PLTREL	20
+#define DT_JMPREL	23
+#define DT_BIND_NOW	24
+#define DT_INIT_ARRAY	25
+#define DT_FINI_ARRAY	26
+#define DT_INIT_ARRAYSZ	27
+#define DT_FINI_ARRAYSZ	28
+#define DT_FLAGS	30
+#define DT_GNU_HASH	0x6ffffef5
+#define DT_FLAGS_1	0x6ffffffb
+
+#define DF_BIND_NOW	0x8
+#define DF_1_NOW	0x1
+
+typedef struct {
+	Elf64_Sxword d_tag;
+	union {
+		Elf64_Xword d_val;
+		Elf64_Addr d_ptr;
+	} d_un;
+} Elf64_Dyn;
+
+#define SHN_UNDEF	0
+#define STB_LOCAL	0
+#define STB_GLOBAL	1
+#define STB_WEAK	2
+#define STT_NOTYPE	0
+#define STT_OBJECT	1
+#define STT_FUNC	2
+#define STT_COMMON	5
+#define STT_TLS		6
+#define STT_GNU_IFUNC	10
+#define ELF64_ST_BIND(i)	((i) >> 4)
+#define ELF64_ST_TYPE(i)	((i) & 0xf)
+
+typedef struct {
+	Elf64_Word st_name;
+	unsigned char st_info;
+	unsigned char st_other;
+	Elf64_Half st_shndx;
+	Elf64_Addr st_value;
+	Elf64_Xword st_size;
+} Elf64_Sym;
+
+#define ELF64_R_SYM(i)		((i) >> 32)
+#define ELF64_R_TYPE(i)		((i) & 0xffffffffL)
+
+typedef struct {
+	Elf64_Addr r_offset;
+	Elf64_Xword r_info;
+	Elf64_Sxword r_addend;
+} Elf64_Rela;
+
+#if defined(__X86_64__)
+#define DL_EM			EM_X86_64
+#define R_NONE			0
+#define R_ABS64			1
+#define R_GLOB_DAT		6
+#define R_JUMP_SLOT		7
+#define R_RELATIVE		8
+#define R_IRELATIVE		37
+#elif defined(__ARM_64__)
+#define DL_EM			EM_AARCH64
+#define R_NONE			0
+#define R_ABS64			257
+#define R_GLOB_DAT		1025
+#define R_JUMP_SLOT		1026
+#define R_RELATIVE		1027
+#define R_IRELATIVE		1032
+#else
+#error "Unsupported architecture"
+#endif
+
+#endif /* __POSIX_LIBDL_ELF64_H__ */
@@ -0,0 +1,82 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __POSIX_LIBDL_H__
+#define __POSIX_LIBDL_H__
+
+#include <uk/arch/types.h>
+#include <uk/essentials.h>
+
+/*
+ * Symbol table of the image
+ *
+ * Shared objects are linked against symbols of the unikernel image, which
+ * is linked statically and has no dynamic symbol table. After linking,
+ * mkukdlsym.py writes the global symbols of the image into the reserved
+ * .uk_dlsym section in the following layout:
+ *
+ *   struct uk_dlsym_hdr
+ *   __u32 buckets[nbuckets]	index of the first symbol of each bucket,
+ *				UK_DLSYM_NONE if the bucket is empty
+ *   __u32 hashes[nsyms]	GNU hash of each symbol; the lowest bit is
+ *				set for the last symbol of a bucket
+ *   struct uk_dlsym syms[nsyms]	sorted by bucket
+ *   char strings[]
+ *
+ * Values are link time addresses. They are converted to run time addresses
+ * by adding the difference between the run time address of the table and
+ * `base`, the link time address of the table.
+ */
+#define UK_DLSYM_MAGIC		0x4d59534c /* "LSYM" */
+#define UK_DLSYM_NONE		0xffffffff
+
+struct uk_dlsym_hdr {
+	__u32 magic;
+	__u32 nbuckets;
+	__u32 nsyms;
+	__u32 reserved;
+	__u64 base;
+};
+
+struct uk_dlsym {
+	__u64 value;
+	/* Offset of the name in the string table */
+	__u32 name;
+	__u32 size;
+};
+
+UK_CTASSERT(sizeof(struct uk_dlsym_hdr) == 24);
+UK_CTASSERT(sizeof(struct uk_dlsym) == 16);
+
+static inline __u32 uk_dl_gnu_hash(const char *name)
+{
+	const unsigned char *s = (const unsigned char *)name;
+	__u32 h = 5381;
+
+	while (*s)
+		h = (h << 5) + h + *s++;
+	return h;
+}
+
+/**
+ * Looks up a global symbol of the image.
+ *
+ * @param name name of the symbol
+ * @param hash uk_dl_gnu_hash() of the name
+ * @return the run time address, or NULL if the image does not define it
+ */
+void *uk_dl_image_lookup(const char *name, __u32 hash);
+
+/**
+ * Finds the image symbol that contains or precedes an address.
+ *
+ * @param addr address to look up
+ * @param[out] saddr run time address of the symbol
+ * @return the name of the symbol, or NULL if there is none
+ */
+const char *uk_dl_image_addr(const void *addr, void **saddr);
+
+#endif /* __POSIX_LIBDL_H__ */
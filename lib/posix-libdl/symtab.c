@@ -0,0 +1,106 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <string.h>
+#include <uk/essentials.h>
+#include <uk/print.h>
+
+#include "libdl.h"
+
+#define UK_DLSYM_TABLE_SIZE	(CONFIG_LIBPOSIX_LIBDL_SYMTAB_SIZE * 1024)
+
+/* Written after linking by mkukdlsym.py, see libdl.h */
+static const __u8 uk_dlsym_table[UK_DLSYM_TABLE_SIZE]
+	__section(".uk_dlsym") __align(8) __used = { 0 };
+
+struct uk_dlsym_view {
+	const struct uk_dlsym_hdr *hdr;
+	const __u32 *buckets;
+	const __u32 *hashes;
+	const struct uk_dlsym *syms;
+	const char *strings;
+	__uptr delta;
+};
+
+static int uk_dlsym_view(struct uk_dlsym_view *v)
+{
+	const __u8 *tab = uk_dlsym_table;
+	static int warned;
+	__sz off;
+
+	/* The contents are written after compilation, so keep the compiler
+	 * from folding reads of the zero initializer
+	 */
+	__asm__ ("" : "+r"(tab));
+
+	v->hdr = (const struct uk_dlsym_hdr *)tab;
+	if (unlikely(v->hdr->magic != UK_DLSYM_MAGIC)) {
+		if (!warned) {
+			uk_pr_warn("No image symbols for shared objects, was mkukdlsym.py run?\n");
+			warned = 1;
+		}
+		return -1;
+	}
+
+	off = sizeof(*v->hdr);
+	v->buckets = (const __u32 *)(tab + off);
+	off += v->hdr->nbuckets * sizeof(__u32);
+	v->hashes = (const __u32 *)(tab + off);
+	off += v->hdr->nsyms * sizeof(__u32);
+	off = ALIGN_UP(off, 8);
+	v->syms = (const struct uk_dlsym *)(tab + off);
+	off += v->hdr->nsyms * sizeof(struct uk_dlsym);
+	v->strings = (const char *)(tab + off);
+	v->delta = (__uptr)tab - (__uptr)v->hdr->base;
+	return 0;
+}
+
+void *uk_dl_image_lookup(const char *name, __u32 hash)
+{
+	struct uk_dlsym_view v;
+	__u32 i;
+
+	if (uk_dlsym_view(&v) || !v.hdr->nbuckets)
+		return __NULL;
+
+	i = v.buckets[hash % v.hdr->nbuckets];
+	if (i == UK_DLSYM_NONE)
+		return __NULL;
+
+	for (; i < v.hdr->nsyms; i++) {
+		if ((v.hashes[i] | 1) == (hash | 1) &&
+		    !strcmp(v.strings + v.syms[i].name, name))
+			return (void *)(__uptr)(v.syms[i].value + v.delta);
+		if (v.hashes[i] & 1)
+			break;
+	}
+	return __NULL;
+}
+
+/* Only used by dladdr(), so a linear search is good enough */
+const char *uk_dl_image_addr(const void *addr, void **saddr)
+{
+	const struct uk_dlsym *best = __NULL;
+	struct uk_dlsym_view v;
+	__u64 a, val;
+	__u32 i;
+
+	if (uk_dlsym_view(&v))
+		return __NULL;
+
+	a = (__u64)(__uptr)addr - v.delta;
+	for (i = 0; i < v.hdr->nsyms; i++) {
+		val = v.syms[i].value;
+		if (val > a || (best && val <= best->value))
+			continue;
+		best = &v.syms[i];
+	}
+	if (!best || (best->size && a >= best->value + best->size))
+		return __NULL;
+
+	*saddr = (void *)(__uptr)(best->value + v.delta);
+	return v.strings + best->name;
+}
@@ -15,6 +15,14 @@
 #include <uk/arch/limits.h>
 #include <uk/arch/lcpu.h>
 #include <uk/vmem.h>
+#if CONFIG_LIBPOSIX_FDTAB
+#include <uk/posix-fdtab.h>
+#endif /* CONFIG_LIBPOSIX_FDTAB */
+#ifdef CONFIG_LIBVFSCORE
+#include <vfscore/dentry.h>
+#include <vfscore/file.h>
+#include <vfscore/vnode.h>
+#endif /* CONFIG_LIBVFSCORE */
 
 #ifndef MAP_UNINITIALIZED
 #define MAP_UNINITIALIZED 0x4000000
@@ -40,6 +48,63 @@ static inline unsigned long prot_to_attr(int prot)
 	return attr;
 }
 
+#if CONFIG_LIBPOSIX_FDTAB
+/* Map memory exposed by a ukfile; returns 1 if `fd` is not a ukfile */
+static int do_mmap_ukfile(void **addr, size_t len, int flags, int fd,
+			  off_t offset)
+{
+	struct uk_ofile *of;
+	void *faddr;
+	int rc;
+
+	of = uk_fdtab_get(fd);
+	if (!of)
+		return 1;
+
+	rc = uk_file_ctl(of->file, UKFILE_CTL_FILE, UKFILE_CTL_FILE_MMAP,
+			 (uintptr_t)offset, (uintptr_t)len, (uintptr_t)&faddr);
+	uk_fdtab_ret(of);
+	if (unlikely(rc)) {
+		/* The file has no memory to share */
+		if (rc == -ENOSYS)
+			return -ENODEV;
+		return rc;
+	}
+
+	/* The memory is already mapped; we cannot move it */
+	if (unlikely((flags & (MAP_FIXED | MAP_FIXED_NOREPLACE)) &&
+		     *addr != faddr))
+		return -EINVAL;
+
+	*addr = faddr;
+	return 0;
+}
+#endif /* CONFIG_LIBPOSIX_FDTAB */
+
+#ifdef CONFIG_LIBVFSCORE
+/* Tells whether `fd` is a device like /dev/zero, whose mappings are just
+ * anonymous memory. Mapping them through the file would read every page
+ * of zeros from the device at mapping time.
+ */
+static int is_zero_dev(int fd)
+{
+	struct vfscore_file *fp;
+	int ret;
+
+	/* Linux reports -ENODEV for stdout, stdin, stderr */
+	if (fd < 3)
+		return 0;
+
+	fp = vfscore_get_file(fd);
+	if (!fp)
+		return 0;
+
+	ret = fp->f_dentry && (fp->f_dentry->d_vnode->v_flags & VZERO);
+	fdrop(fp);
+	return ret;
+}
+#endif /* CONFIG_LIBVFSCORE */
+
 static int do_mmap(void **addr, size_t len, int prot, int flags, int fd,
 		   off_t offset)
 {
@@ -84,6 +149,11 @@ static int do_mmap(void **addr, size_t len, int prot, int flags, int fd,
 		vaddr = __VADDR_ANY;
 	}
 
+#ifdef CONFIG_LIBVFSCORE
+	if (!(flags & MAP_ANONYMOUS) && fd >= 0 && is_zero_dev(fd))
+		flags |= MAP_ANONYMOUS;
+#endif /* CONFIG_LIBVFSCORE */
+
 	if (flags & MAP_ANONYMOUS) {
 		if ((flags & MAP_SHARED) ||
 		    (flags & MAP_SHARED_VALIDATE) == MAP_SHARED_VALIDATE) {
@@ -119,9 +189,24 @@ static int do_mmap(void **addr, size_t len, int prot, int flags, int fd,
 #endif /* PAGE_LARGE_SHIFT */
 		}
 
+#if CONFIG_LIBPOSIX_MMAP_ANON_LARGE_PAGES
+		/* Without an explicit page size, transparently use large
+		 * pages where possible
+		 */
+		if (!(flags & MAP_HUGETLB))
+			vflags |= UK_VMA_MAP_LARGE_PAGES;
+#endif /* CONFIG_LIBPOSIX_MMAP_ANON_LARGE_PAGES */
+
 		vargs = NULL;
 		vops  = &uk_vma_anon_ops;
 	} else {
+#if CONFIG_LIBPOSIX_FDTAB
+		if (fd >= 0) {
+			rc = do_mmap_ukfile(addr, len, flags, fd, offset);
+			if (rc <= 0)
+				return rc;
+		}
+#endif /* CONFIG_LIBPOSIX_FDTAB */
 #ifdef CONFIG_LIBVFSCORE
 		if ((flags & MAP_SHARED) ||
 		    (flags & MAP_SHARED_VALIDATE) == MAP_SHARED_VALIDATE)
@@ -164,10 +249,10 @@ static int do_mmap(void **addr, size_t len, int prot, int flags, int fd,
 	/* Linux will always align len to the selected page size */
 	len = PAGE_Lx_ALIGN_UP(len, lvl);
 
-	if (flags & MAP_POPULATE)
+	/* There is no swapping, so locking the pages only needs prefaulting */
+	if (flags & (MAP_POPULATE | MAP_LOCKED))
 		vflags |= UK_VMA_MAP_POPULATE;
 
-	/* MAP_LOCKED: Ignored for now */
 	/* MAP_NONBLOCKED: Ignored for now */
 	/* MAP_NORESERVE : Ignored for now */
 
@@ -258,6 +343,9 @@ UK_SYSCALL_R_DEFINE(int, madvise, void *, addr, size_t, len, int, advice)
 	case MADV_DONTNEED:
 		vadvice |= UK_VMA_ADV_DONTNEED;
 		break;
+	case MADV_FREE:
+		vadvice |= UK_VMA_ADV_FREE;
+		break;
 	default:
 		/* Just ignore unsupported advices for now. The call to
 		 * uk_vma_advise() does not have an effect but will validate
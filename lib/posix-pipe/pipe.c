@@ -6,34 +6,50 @@
 
 #include <string.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
 
 #include <uk/atomic.h>
 #include <uk/alloc.h>
 #include <uk/essentials.h>
 #include <uk/file/nops.h>
 #include <uk/posix-fd.h>
+#include <uk/posix-fdio.h>
 #include <uk/posix-pipe.h>
 #include <uk/syscall.h>
 
 
+/* Default capacity of new pipes, and range settable with F_SETPIPE_SZ */
 #define PIPE_SIZE (1L << CONFIG_LIBPOSIX_PIPE_SIZE_ORDER)
+#define PIPE_SIZE_MIN __PAGE_SIZE
+#define PIPE_SIZE_MAX (1L << CONFIG_LIBPOSIX_PIPE_MAX_SIZE_ORDER)
 
-#define _PIPE_SZMASK (PIPE_SIZE - 1)
-#define PIPE_IDX(x) ((x) & _PIPE_SZMASK)
-
-#define PIPE_SPACE(start, lim, want) MIN((want), \
-	((start) <= (lim)) ? ((lim) - (start)) : (PIPE_SIZE - (start) + (lim)))
+/*
+ * Ring buffer arithmetic, `d` is the pipe node. Heads run freely and are
+ * only reduced modulo the size to index the buffer, so that an empty and a
+ * full buffer can be told apart without further state.
+ */
+#define PIPE_IDX(d, x) ((x) & ((d)->size - 1))
+#define PIPE_USED(rh, wh) ((pipeidx)((wh) - (rh)))
 
 static const char PIPE_VOLID[] = "pipe_vol";
 
 typedef __u32 pipeidx;
 
 
+/*
+ * The ring is safe for one writer running concurrently with any number of
+ * readers, without the file I/O lock: the writer copies data in before it
+ * publishes the new whead, and readers copy data out before they claim it
+ * by moving rhead forward.
+ */
 struct pipe_node {
 	unsigned int flags;
 	volatile pipeidx rhead;
-	pipeidx whead;
-	char buf[PIPE_SIZE];
+	volatile pipeidx whead;
+	/* Capacity, a power of two; changed only under the file write lock */
+	pipeidx size;
+	char *buf;
 };
 
 #define PIPE_HUP    1
@@ -53,11 +69,14 @@ struct pipe_alloc {
 };
 
 
-static void _pipebuf_read(const char *buf, pipeidx head, char *out, size_t n)
+static void _pipebuf_read(const struct pipe_node *d, pipeidx head,
+			  char *out, size_t n)
 {
-	if (head + n > PIPE_SIZE) {
+	const char *buf = d->buf;
+
+	if (head + n > d->size) {
 		/* pipebuf not contiguous, need 2 copies */
-		size_t l = PIPE_SIZE - head;
+		size_t l = d->size - head;
 
 		memcpy(out, &buf[head], l);
 		memcpy(&out[l], buf, n - l);
@@ -66,11 +85,14 @@ static void _pipebuf_read(const char *buf, pipeidx head, char *out, size_t n)
 	}
 }
 
-static void _pipebuf_write(char *buf, pipeidx head, const char *in, size_t n)
+static void _pipebuf_write(struct pipe_node *d, pipeidx head,
+			   const char *in, size_t n)
 {
-	if (head + n > PIPE_SIZE) {
+	char *buf = d->buf;
+
+	if (head + n > d->size) {
 		/* pipebuf not contiguous, need 2 copies */
-		size_t l = PIPE_SIZE - head;
+		size_t l = d->size - head;
 
 		memcpy(&buf[head], in, l);
 		memcpy(buf, &in[l], n - l);
@@ -79,7 +101,7 @@ static void _pipebuf_write(char *buf, pipeidx head, const char *in, size_t n)
 	}
 }
 
-static void pipebuf_iovread(const char *buf, pipeidx head,
+static void pipebuf_iovread(const struct pipe_node *d, pipeidx head,
 			    const struct iovec *iov, size_t n)
 {
 	int i;
@@ -87,15 +109,15 @@ static void pipebuf_iovread(const char *buf, pipeidx head,
 	for (i = 0; iov[i].iov_len <= n; i++) {
 		size_t len = iov[i].iov_len;
 
-		_pipebuf_read(buf, head, (char *)iov[i].iov_base, len);
+		_pipebuf_read(d, head, (char *)iov[i].iov_base, len);
 		n -= len;
-		head = PIPE_IDX(head + len);
+		head = PIPE_IDX(d, head + len);
 	}
 	if (n)
-		_pipebuf_read(buf, head, (char *)iov[i].iov_base, n);
+		_pipebuf_read(d, head, (char *)iov[i].iov_base, n);
 }
 
-static void pipebuf_iovwrite(char *buf, pipeidx head,
+static void pipebuf_iovwrite(struct pipe_node *d, pipeidx head,
 			     const struct iovec *iov, size_t n)
 {
 	int i;
@@ -103,12 +125,12 @@ static void pipebuf_iovwrite(char *buf, pipeidx head,
 	for (i = 0; iov[i].iov_len <= n; i++) {
 		size_t len = iov[i].iov_len;
 
-		_pipebuf_write(buf, head, (const char *)iov[i].iov_base, len);
+		_pipebuf_write(d, head, (const char *)iov[i].iov_base, len);
 		n -= len;
-		head = PIPE_IDX(head + len);
+		head = PIPE_IDX(d, head + len);
 	}
 	if (n)
-		_pipebuf_write(buf, head, (const char *)iov[i].iov_base, n);
+		_pipebuf_write(d, head, (const char *)iov[i].iov_base, n);
 }
 
 static ssize_t _iovsz(const struct iovec *iov, int iovcnt)
@@ -132,8 +154,8 @@ static ssize_t pipe_read(const struct uk_file *f,
 	ssize_t toread;
 	struct pipe_node *d;
 	ssize_t canread;
+	pipeidx ri, wi;
 	pipeidx rend;
-	pipeidx ri;
 
 	if (unlikely(f->vol != PIPE_VOLID))
 		return -EINVAL;
@@ -141,52 +163,60 @@ static ssize_t pipe_read(const struct uk_file *f,
 		return -ESPIPE;
 
 	toread = _iovsz(iov, iovcnt);
-	if (unlikely(toread < 0))
+	if (unlikely(toread <= 0))
 		return toread;
 
 	d = (struct pipe_node *)f->node;
-	ri = d->rhead;
-	do {
-		canread = PIPE_SPACE(ri, d->whead, toread);
-		UK_ASSERT(canread >= 0);
+	for (;;) {
+		ri = uk_load_n(&d->rhead);
+		wi = uk_load_n(&d->whead);
+		canread = MIN(toread, (ssize_t)PIPE_USED(ri, wi));
 		if (!canread) {
-			/* Ambiguous whether full or empty; check event flags */
-			if (uk_file_event_clear(f, UKFD_POLLIN) & UKFD_POLLIN)
-				canread = MIN(toread, PIPE_SIZE);
-			else
-				if (d->flags & PIPE_HUP)
-					return 0;
-				else
-					return -EAGAIN;
-		}
-		rend = PIPE_IDX(ri + canread);
-		/* If buffer will be empty after our read, clear POLLIN */
-		if (rend == d->whead)
+			if (uk_load_n(&d->flags) & PIPE_HUP) {
+				/* The writer may have left data behind */
+				if (uk_load_n(&d->whead) != wi)
+					continue;
+				return 0;
+			}
 			uk_file_event_clear(f, UKFD_POLLIN);
-	} while (!uk_compare_exchange_n(&d->rhead, &ri, rend));
-	/* Reserved `canread` bytes starting from ri */
+			/* Recheck, the writer sets POLLIN only after whead */
+			if (uk_load_n(&d->whead) != wi) {
+				uk_file_event_set(f, UKFD_POLLIN);
+				continue;
+			}
+			return -EAGAIN;
+		}
+		/* Copy out before claiming; retried if another reader won */
+		pipebuf_iovread(d, PIPE_IDX(d, ri), iov, canread);
+		if (uk_compare_exchange_n(&d->rhead, &ri, ri + canread))
+			break;
+	}
+	rend = ri + canread;
 
-	/* If we're reading only part of a full buffer, reset POLLIN */
-	if (ri == d->whead && rend != d->whead)
-		uk_file_event_set(f, UKFD_POLLIN);
-	/* Do read */
-	pipebuf_iovread(d->buf, ri, iov, canread);
-	/* If pipe was full, set POLLOUT */
-	if (ri == d->whead)
+	/* If the pipe was full, the writer may be waiting for space */
+	if (PIPE_USED(ri, wi) == d->size)
 		uk_file_event_set(f, UKFD_POLLOUT);
+	/* If we emptied the pipe, clear POLLIN unless more data came in */
+	if (uk_load_n(&d->whead) == rend) {
+		uk_file_event_clear(f, UKFD_POLLIN);
+		if (uk_load_n(&d->whead) != rend)
+			uk_file_event_set(f, UKFD_POLLIN);
+	}
 
 	return canread;
 }
 
+/* Writers must be serialized by the caller */
 static ssize_t pipe_write(const struct uk_file *f,
 			  const struct iovec *iov, int iovcnt,
 			  off_t off, long flags __unused)
 {
 	struct pipe_node *d;
 	ssize_t towrite;
-	pipeidx head;
 	ssize_t canwrite;
+	pipeidx head;
 	pipeidx wend;
+	pipeidx ri;
 
 	if (unlikely(f->vol != PIPE_VOLID))
 		return -EINVAL;
@@ -194,51 +224,138 @@ static ssize_t pipe_write(const struct uk_file *f,
 		return -ESPIPE;
 
 	d = (struct pipe_node *)f->node;
-	if (unlikely(d->flags & PIPE_HUP))
+	if (unlikely(uk_load_n(&d->flags) & PIPE_HUP))
 		return -EPIPE;
 
 	towrite = _iovsz(iov, iovcnt);
-	if (unlikely(towrite < 0))
+	if (unlikely(towrite <= 0))
 		return towrite;
 
 	head = d->whead;
-	canwrite = PIPE_SPACE(head, d->rhead, _iovsz(iov, iovcnt));
-	UK_ASSERT(canwrite >= 0);
-	if (!canwrite) {
-		/* Ambiguous whether full or empty, check flags */
-		if (uk_file_poll_immediate(f, UKFD_POLLOUT))
-			canwrite = MIN(towrite, PIPE_SIZE);
-		else
+	for (;;) {
+		ri = uk_load_n(&d->rhead);
+		canwrite = MIN(towrite,
+			       (ssize_t)(d->size - PIPE_USED(ri, head)));
+		if (canwrite)
+			break;
+		uk_file_event_clear(f, UKFD_POLLOUT);
+		/* Recheck, readers set POLLOUT only after rhead */
+		if (uk_load_n(&d->rhead) == ri)
 			return -EAGAIN;
+		uk_file_event_set(f, UKFD_POLLOUT);
 	}
 
-	wend = PIPE_IDX(head + canwrite);
-	d->whead = wend;
-	pipebuf_iovwrite(d->buf, head, iov, canwrite);
-	/* if buffer full, clear POLLOUT */
-	if (wend == d->rhead)
-		uk_file_event_clear(f, UKFD_POLLOUT);
-	/* if buffer was empty, set POLLIN */
-	if (head == d->rhead)
+	/* Copy in before publishing */
+	pipebuf_iovwrite(d, PIPE_IDX(d, head), iov, canwrite);
+	wend = head + canwrite;
+	uk_store_n(&d->whead, wend);
+
+	/* If the pipe was empty, readers may be waiting for data */
+	if (uk_load_n(&d->rhead) == head)
 		uk_file_event_set(f, UKFD_POLLIN);
+	/* If we filled the pipe, clear POLLOUT unless space was made */
+	ri = uk_load_n(&d->rhead);
+	if (PIPE_USED(ri, wend) == d->size) {
+		uk_file_event_clear(f, UKFD_POLLOUT);
+		if (uk_load_n(&d->rhead) != ri)
+			uk_file_event_set(f, UKFD_POLLOUT);
+	}
 
 	return canwrite;
 }
 
+#define PIPE_STATX_MASK \
+	(UK_STATX_TYPE|UK_STATX_MODE|UK_STATX_NLINK|UK_STATX_INO|UK_STATX_SIZE)
+
+static int pipe_getstat(const struct uk_file *f,
+			unsigned int mask __unused, struct uk_statx *arg)
+{
+	if (unlikely(f->vol != PIPE_VOLID))
+		return -EINVAL;
+
+	arg->stx_mask = PIPE_STATX_MASK;
+	arg->stx_mode = S_IFIFO|0600;
+	arg->stx_nlink = 1;
+	arg->stx_ino = (uintptr_t)f->node; /* Shared by both ends */
+	arg->stx_size = 0;
+
+	/* Following fields are always filled in, not in stx_mask */
+	arg->stx_dev_major = 0;
+	arg->stx_dev_minor = 0;
+	arg->stx_rdev_major = 0;
+	arg->stx_rdev_minor = 0;
+	arg->stx_blksize = ((struct pipe_node *)f->node)->size;
+	return 0;
+}
+
+/* Must be called with the file write lock held, i.e., without any I/O */
+static int pipe_resize(const struct uk_file *f, size_t want)
+{
+	struct pipe_alloc *al = __containerof(f->state, struct pipe_alloc,
+					      fstate);
+	struct pipe_node *d = (struct pipe_node *)f->node;
+	pipeidx size;
+	pipeidx used;
+	char *buf;
+
+	if (unlikely(want > PIPE_SIZE_MAX))
+		return -EPERM;
+	for (size = PIPE_SIZE_MIN; size < want; size <<= 1)
+		;
+	if (size == d->size)
+		return size;
+
+	used = PIPE_USED(d->rhead, d->whead);
+	if (unlikely(used > size))
+		return -EBUSY;
+
+	buf = uk_malloc(al->alloc, size);
+	if (unlikely(!buf))
+		return -ENOMEM;
+	if (used)
+		_pipebuf_read(d, PIPE_IDX(d, d->rhead), buf, used);
+	uk_free(al->alloc, d->buf);
+
+	d->buf = buf;
+	d->size = size;
+	d->rhead = 0;
+	d->whead = used;
+	if (used == size)
+		uk_file_event_clear(f, UKFD_POLLOUT);
+	else
+		uk_file_event_set(f, UKFD_POLLOUT);
+	return size;
+}
+
+static int pipe_ctl(const struct uk_file *f, int fam, int req,
+		    uintptr_t arg1, uintptr_t arg2 __unused,
+		    uintptr_t arg3 __unused)
+{
+	if (unlikely(f->vol != PIPE_VOLID))
+		return -EINVAL;
+
+	if (fam == UKFILE_CTL_FILE && req == UKFILE_CTL_FILE_PIPE_SZ) {
+		if (!arg1)
+			return ((struct pipe_node *)f->node)->size;
+		return pipe_resize(f, arg1);
+	}
+	return -ENOSYS;
+}
+
 static const struct uk_file_ops rpipe_ops = {
 	.read = pipe_read,
 	.write = uk_file_nop_write,
-	.getstat = uk_file_nop_getstat,
+	.getstat = pipe_getstat,
 	.setstat = uk_file_nop_setstat,
-	.ctl = uk_file_nop_ctl
+	.ctl = pipe_ctl
 };
 
 static const struct uk_file_ops wpipe_ops = {
 	.read = uk_file_nop_read,
 	.write = pipe_write,
-	.getstat = uk_file_nop_getstat,
+	.getstat = pipe_getstat,
 	.setstat = uk_file_nop_setstat,
-	.ctl = uk_file_nop_ctl
+	.ctl = pipe_ctl
 };
 
 
@@ -263,6 +380,7 @@ static void pipe_release(const struct uk_file *f, int what)
 							      struct pipe_alloc,
 							      fstate);
 
+			uk_free(al->alloc, al->node.buf);
 			uk_free(al->alloc, al);
 		}
 	}
@@ -286,11 +404,17 @@ int uk_pipefile_create(struct uk_file *pipes[2], int flags)
 	if (unlikely(!al))
 		return -ENOMEM;
 
+	al->node.buf = uk_malloc(a, PIPE_SIZE);
+	if (unlikely(!al->node.buf)) {
+		uk_free(a, al);
+		return -ENOMEM;
+	}
+
 	al->alloc = a;
 	al->node.flags = 0;
 	al->node.rhead = 0;
 	al->node.whead = 0;
-	memset(al->node.buf, 0, sizeof(al->node.buf));
+	al->node.size = PIPE_SIZE;
 	al->fstate = UK_FILE_STATE_INIT_VALUE(al->fstate);
 	al->rref = UK_FILE_REFCNT_INIT_VALUE;
 	al->wref = UK_FILE_REFCNT_INIT_VALUE;
@@ -366,3 +490,28 @@ UK_SYSCALL_R_DEFINE(int, pipe2, int *, pipefd, int, flags)
 {
 	return uk_sys_pipe(pipefd, flags);
 }
+
+/* Pages are not gifted, vmsplice is a plain transfer to or from the pipe */
+UK_SYSCALL_R_DEFINE(ssize_t, vmsplice, int, fd, const struct iovec *, iov,
+		    unsigned long, nr_segs, unsigned int, flags)
+{
+	struct uk_ofile *of;
+	ssize_t r;
+
+	if (unlikely(nr_segs > IOV_MAX))
+		return -EINVAL;
+
+	of = uk_fdtab_get(fd);
+	if (unlikely(!of))
+		return -EBADF;
+
+	if (unlikely(of->file->vol != PIPE_VOLID))
+		r = -EBADF;
+	else if (of->file->ops == &rpipe_ops)
+		r = uk_sys_readv(of, iov, nr_segs);
+	else
+		r = uk_sys_writev(of, iov, nr_segs);
+
+	uk_fdtab_ret(of);
+	return r;
+}
@@ -7,13 +7,17 @@
 #include <errno.h>
 
 #include <uk/atomic.h>
+#include <uk/arch/time.h>
 #include <uk/assert.h>
 #include <uk/essentials.h>
 #include <uk/file/nops.h>
 #include <uk/file/pollqueue.h>
+#include <uk/list.h>
 #include <uk/posix-fd.h>
 #include <uk/posix-fdtab.h>
 #include <uk/posix-poll.h>
+#include <uk/spinlock.h>
+#include <uk/plat/lcpu.h>
 #include <uk/timeutil.h>
 #include <uk/syscall.h>
 
@@ -31,6 +35,9 @@ static const char EPOLL_VOLID[] = "epoll_vol";
 
 #define events2mask(ev) (((ev) & EPOLL_EVENTS) | UKFD_POLL_ALWAYS)
 
+/* Initial size of the interest set hash table (log2); it doubles on demand */
+#define EPOLL_HASH_MINBITS 4
+
 #if CONFIG_LIBVFSCORE
 struct epoll_legacy {
 	struct eventpoll_cb ecb;
@@ -42,7 +49,9 @@ struct epoll_legacy {
 #endif /* CONFIG_LIBVFSCORE */
 
 struct epoll_entry {
-	struct epoll_entry *next;
+	struct epoll_entry *next; /* Hash bucket chain */
+	struct uk_list_head rdlink; /* Ready list membership */
+	int rdqueued; /* On the ready list or being delivered; under rdlock */
 #if CONFIG_LIBVFSCORE
 	int legacy;
 #endif /* CONFIG_LIBVFSCORE */
@@ -66,16 +75,125 @@ struct epoll_entry {
 };
 #define IS_EDGEPOLL(ent) (!!((ent)->event.events & EPOLLET))
 #define IS_ONESHOT(ent)  (!!((ent)->event.events & EPOLLONESHOT))
+#define IS_EXCLUSIVE(ent) (!!((ent)->event.events & EPOLLEXCLUSIVE))
+
+/* Edges and exclusive events only need a single epoll waiter to handle them */
+#define EPOLL_NWAKE(ent) \
+	((IS_EDGEPOLL(ent) || IS_EXCLUSIVE(ent)) ? 1 : UK_POLLQ_NOTIFY_ALL)
 
+/* Events that may be combined with EPOLLEXCLUSIVE */
+#define EPOLL_EXCLUSIVE_OK \
+	(EPOLLIN|EPOLLOUT|EPOLLRDNORM|EPOLLWRNORM|EPOLLERR|EPOLLHUP| \
+	 EPOLLWAKEUP|EPOLLET|EPOLLEXCLUSIVE)
 
+
+/*
+ * The interest set is a hash table keyed on (fd, file), protected by the epoll
+ * file lock. Entries with pending events are additionally linked on `rdlist`,
+ * which event callbacks append to under `rdlock`, so that waiting only visits
+ * ready entries.
+ */
 struct epoll_alloc {
 	struct uk_alloc *alloc;
 	struct uk_file f;
 	uk_file_refcnt frefcnt;
 	struct uk_file_state fstate;
-	struct epoll_entry *list;
+	struct epoll_entry **buckets;
+	unsigned int hbits;
+	unsigned int count;
+	uk_spinlock rdlock;
+	struct uk_list_head rdlist;
+	/* Most recently added file that wants to be busy polled, if any */
+	const struct uk_file *busy_f;
 };
 
+#define EPOLL_ALLOC(epf) __containerof((epf), struct epoll_alloc, f)
+
+
+/* Interest set */
+
+static inline unsigned int epoll_hash(unsigned int hbits,
+				      int fd, const void *f)
+{
+	__u64 h = ((__u64)(__uptr)f ^ (unsigned int)fd) * 0x9E3779B97F4A7C15ULL;
+
+	return h >> (64 - hbits);
+}
+
+#define epoll_entry_hash(ent, hbits) \
+	epoll_hash((hbits), (ent)->fd, (const void *)(ent)->f)
+
+/* Double the hash table; on allocation failure keep the current one */
+static void epoll_grow(struct epoll_alloc *al)
+{
+	const unsigned int nbits = al->hbits + 1;
+	struct epoll_entry **nb;
+
+	nb = uk_calloc(al->alloc, 1UL << nbits, sizeof(*nb));
+	if (unlikely(!nb))
+		return;
+
+	for (unsigned long i = 0; i < (1UL << al->hbits); i++) {
+		struct epoll_entry *p = al->buckets[i];
+
+		while (p) {
+			struct epoll_entry *ent = p;
+			unsigned int h = epoll_entry_hash(ent, nbits);
+
+			p = p->next;
+			ent->next = nb[h];
+			nb[h] = ent;
+		}
+	}
+	uk_free(al->alloc, al->buckets);
+	al->buckets = nb;
+	al->hbits = nbits;
+}
+
+static void epoll_link(struct epoll_alloc *al, struct epoll_entry *ent)
+{
+	unsigned int h;
+
+	if (al->count >= (1U << al->hbits))
+		epoll_grow(al);
+
+	h = epoll_entry_hash(ent, al->hbits);
+	ent->next = al->buckets[h];
+	al->buckets[h] = ent;
+	al->count++;
+}
+
+
+/* Ready list */
+
+static void epoll_ready_add(struct epoll_alloc *al, struct epoll_entry *ent)
+{
+	unsigned long irqf;
+
+	irqf = ukplat_lcpu_save_irqf();
+	uk_spin_lock(&al->rdlock);
+	if (!ent->rdqueued) {
+		ent->rdqueued = 1;
+		uk_list_add_tail(&ent->rdlink, &al->rdlist);
+	}
+	uk_spin_unlock(&al->rdlock);
+	ukplat_lcpu_restore_irqf(irqf);
+}
+
+static void epoll_ready_del(struct epoll_alloc *al, struct epoll_entry *ent)
+{
+	unsigned long irqf;
+
+	irqf = ukplat_lcpu_save_irqf();
+	uk_spin_lock(&al->rdlock);
+	if (ent->rdqueued) {
+		ent->rdqueued = 0;
+		uk_list_del(&ent->rdlink);
+	}
+	uk_spin_unlock(&al->rdlock);
+	ukplat_lcpu_restore_irqf(irqf);
+}
+
 
 static void epoll_unregister_entry(struct epoll_entry *ent)
 {
@@ -93,21 +211,25 @@ static void epoll_unregister_entry(struct epoll_entry *ent)
 }
 
 
-static void epoll_event_callback(uk_pollevent set,
-				 enum uk_poll_chain_op op,
-				 struct uk_poll_chain *tick)
+static int epoll_event_callback(uk_pollevent set,
+				enum uk_poll_chain_op op,
+				struct uk_poll_chain *tick)
 {
+	int r = 0;
+
 	if (op == UK_POLL_CHAINOP_SET) {
 		struct epoll_entry *ent = __containerof(
 			tick, struct epoll_entry, tick);
-		struct uk_pollq *upq = (struct uk_pollq *)tick->arg;
+		const struct uk_file *epf = (const struct uk_file *)tick->arg;
 
 		(void)uk_or(&ent->revents, set);
-		uk_pollq_set_n(upq, UKFD_POLLIN,
-			       IS_EDGEPOLL(ent) ? 1 : UK_POLLQ_NOTIFY_ALL);
+		epoll_ready_add(EPOLL_ALLOC(epf), ent);
+		r = uk_pollq_set_wake_n(&epf->state->pollq, UKFD_POLLIN,
+					EPOLL_NWAKE(ent));
 		if (IS_ONESHOT(ent))
 			tick->mask = 0;
 	}
+	return r;
 }
 
 
@@ -132,8 +254,12 @@ static int vfs_poll_register(struct vfscore_file *vfd, struct epoll_legacy *leg)
 
 	uk_list_add_tail(&leg->f_link, &vfd->f_ep);
 	(void)uk_and(&leg->revents, leg->mask);
-	if (leg->revents)
+	if (leg->revents) {
+		epoll_ready_add(EPOLL_ALLOC(leg->epf),
+				__containerof(leg, struct epoll_entry,
+					      legacy_cb));
 		uk_file_event_set(leg->epf, UKFD_POLLIN);
+	}
 	return 0;
 }
 #endif /* CONFIG_LIBVFSCORE */
@@ -142,20 +268,22 @@ static int vfs_poll_register(struct vfscore_file *vfd, struct epoll_legacy *leg)
 
 static void epoll_release(const struct uk_file *epf, int what)
 {
-	struct epoll_alloc *al = __containerof(epf, struct epoll_alloc, f);
+	struct epoll_alloc *al = EPOLL_ALLOC(epf);
 
 	if (what & UK_FILE_RELEASE_RES) {
-		struct epoll_entry **list = (struct epoll_entry **)epf->node;
-		struct epoll_entry *p = *list;
-
 		/* Free entries */
-		while (p) {
-			struct epoll_entry *ent = p;
+		for (unsigned long i = 0; i < (1UL << al->hbits); i++) {
+			struct epoll_entry *p = al->buckets[i];
 
-			p = p->next;
-			epoll_unregister_entry(ent);
-			uk_free(al->alloc, ent);
+			while (p) {
+				struct epoll_entry *ent = p;
+
+				p = p->next;
+				epoll_unregister_entry(ent);
+				uk_free(al->alloc, ent);
+			}
 		}
+		uk_free(al->alloc, al->buckets);
 	}
 	if (what & UK_FILE_RELEASE_OBJ) {
 		/* Free alloc */
@@ -173,19 +301,25 @@ static struct epoll_entry **epoll_find(const struct uk_file *epf, int fd,
 				       union uk_shim_file sf)
 #endif
 {
-	struct epoll_entry **p = (struct epoll_entry **)epf->node;
+	struct epoll_alloc *al = EPOLL_ALLOC(epf);
+	struct epoll_entry **p;
+	const void *key;
 
+#if CONFIG_LIBVFSCORE
+	if (legacy)
+		key = sf.vfile;
+	else
+#endif /* CONFIG_LIBVFSCORE */
+		key = sf.ofile->file;
+
+	p = &al->buckets[epoll_hash(al->hbits, fd, key)];
 	while (*p) {
 		struct epoll_entry *ent = *p;
 
-		if (ent->fd == fd)
+		if (ent->fd == fd && (const void *)ent->f == key)
 #if CONFIG_LIBVFSCORE
-			if ((legacy == ent->legacy) &&
-			    ((legacy && ent->vf == sf.vfile) ||
-			     (!legacy && ent->f == sf.ofile->file)))
-#else /* !CONFIG_LIBVFSCORE */
-			if (ent->f == sf.ofile->file)
-#endif /* !CONFIG_LIBVFSCORE */
+			if (legacy == ent->legacy)
+#endif /* CONFIG_LIBVFSCORE */
 				break;
 		p = &(*p)->next;
 	}
@@ -194,7 +328,6 @@ static struct epoll_entry **epoll_find(const struct uk_file *epf, int fd,
 
 static void epoll_register(const struct uk_file *epf, struct epoll_entry *ent)
 {
-	const int edge = !!(ent->event.events & EPOLLET);
 	uk_pollevent ev;
 
 #if CONFIG_LIBVFSCORE
@@ -205,16 +338,16 @@ static void epoll_register(const struct uk_file *epf, struct epoll_entry *ent)
 	if (ev) {
 		/* Need atomic OR since we're registered for updates */
 		(void)uk_or(&ent->revents, ev);
+		epoll_ready_add(EPOLL_ALLOC(epf), ent);
 		uk_pollq_set_n(&epf->state->pollq, UKFD_POLLIN,
-			       edge ? 1 : UK_POLLQ_NOTIFY_ALL);
+			       EPOLL_NWAKE(ent));
 	}
 }
 
-static int epoll_add(const struct uk_file *epf, struct epoll_entry **tail,
-		     int fd, const struct uk_file *f,
-		     const struct epoll_event *event)
+static int epoll_add(const struct uk_file *epf, int fd,
+		     const struct uk_file *f, const struct epoll_event *event)
 {
-	struct epoll_alloc *al = __containerof(epf, struct epoll_alloc, f);
+	struct epoll_alloc *al = EPOLL_ALLOC(epf);
 	struct epoll_entry *ent;
 
 	/* New entry */
@@ -225,6 +358,7 @@ static int epoll_add(const struct uk_file *epf, struct epoll_entry **tail,
 	uk_file_acquire_weak(f);
 	*ent = (struct epoll_entry){
 		.next = NULL,
+		.rdqueued = 0,
 #if CONFIG_LIBVFSCORE
 		.legacy = 0,
 #endif /* CONFIG_LIBVFSCORE */
@@ -234,23 +368,29 @@ static int epoll_add(const struct uk_file *epf, struct epoll_entry **tail,
 		.tick = UK_POLL_CHAIN_CALLBACK_INITIALIZER(
 			events2mask(event->events),
 			epoll_event_callback,
-			&epf->state->pollq
+			(void *)epf
 		),
 		.revents = 0
 	};
-	*tail = ent;
+	if (event->events & EPOLLEXCLUSIVE)
+		ent->tick.flags = UK_POLL_CHAINF_EXCLUSIVE;
+	UK_INIT_LIST_HEAD(&ent->rdlink);
+	epoll_link(al, ent);
+	/* Like Linux, busy poll the queue of the last socket that asks for it */
+	if (uk_file_ctl(f, UKFILE_CTL_FILE, UKFILE_CTL_FILE_BUSY_POLL,
+			0, 0, 0) > 0)
+		al->busy_f = f;
 	/* Poll, register & update if needed */
 	epoll_register(epf, ent);
 	return 0;
 }
 
 #if CONFIG_LIBVFSCORE
-static int epoll_add_legacy(const struct uk_file *epf,
-			    struct epoll_entry **tail,
-			    int fd, struct vfscore_file *vf,
+static int epoll_add_legacy(const struct uk_file *epf, int fd,
+			    struct vfscore_file *vf,
 			    const struct epoll_event *event)
 {
-	struct epoll_alloc *al = __containerof(epf, struct epoll_alloc, f);
+	struct epoll_alloc *al = EPOLL_ALLOC(epf);
 	struct epoll_entry *ent;
 	int r;
 
@@ -261,6 +401,7 @@ static int epoll_add_legacy(const struct uk_file *epf,
 
 	*ent = (struct epoll_entry){
 		.next = NULL,
+		.rdqueued = 0,
 		.legacy = 1,
 		.fd = fd,
 		.vf = vf,
@@ -272,6 +413,7 @@ static int epoll_add_legacy(const struct uk_file *epf,
 			.revents = 0
 		}
 	};
+	UK_INIT_LIST_HEAD(&ent->rdlink);
 	UK_INIT_LIST_HEAD(&ent->legacy_cb.ecb.cb_link);
 	UK_INIT_LIST_HEAD(&ent->legacy_cb.f_link);
 	/* Poll, register & update if needed */
@@ -284,7 +426,7 @@ static int epoll_add_legacy(const struct uk_file *epf,
 			return r;
 	}
 
-	*tail = ent;
+	epoll_link(al, ent);
 	return 0;
 }
 #endif /* CONFIG_LIBVFSCORE */
@@ -297,6 +439,7 @@ static void epoll_entry_mod(const struct uk_file *epf, struct epoll_entry *ent,
 #endif /* CONFIG_LIBVFSCORE */
 
 	uk_pollq_unregister(&ent->f->state->pollq, &ent->tick);
+	epoll_ready_del(EPOLL_ALLOC(epf), ent);
 	ent->event = *event;
 	ent->tick.mask = events2mask(event->events);
 	ent->revents = 0;
@@ -305,10 +448,12 @@ static void epoll_entry_mod(const struct uk_file *epf, struct epoll_entry *ent,
 }
 
 #if CONFIG_LIBVFSCORE
-static void epoll_entry_mod_legacy(struct epoll_entry *ent,
+static void epoll_entry_mod_legacy(const struct uk_file *epf,
+				   struct epoll_entry *ent,
 				   const struct epoll_event *event)
 {
 	UK_ASSERT(ent->legacy);
+	epoll_ready_del(EPOLL_ALLOC(epf), ent);
 	ent->legacy_cb.revents = 0;
 	ent->legacy_cb.mask = events2mask(event->events);
 	ent->event = *event;
@@ -318,11 +463,16 @@ static void epoll_entry_mod_legacy(struct epoll_entry *ent,
 
 static void epoll_entry_del(const struct uk_file *epf, struct epoll_entry **p)
 {
-	struct epoll_alloc *al = __containerof(epf, struct epoll_alloc, f);
+	struct epoll_alloc *al = EPOLL_ALLOC(epf);
 	struct epoll_entry *ent = *p;
 
 	*p = ent->next;
+	al->count--;
+	if (ent->f == al->busy_f)
+		al->busy_f = NULL;
+	/* Unregister first so no callback can requeue the entry */
 	epoll_unregister_entry(ent);
+	epoll_ready_del(al, ent);
 	uk_free(al->alloc, ent);
 }
 
@@ -337,6 +487,9 @@ void eventpoll_signal(struct eventpoll_cb *ecb, unsigned int revents)
 	revents &= leg->mask;
 	if (revents) {
 		(void)uk_or(&leg->revents, revents);
+		epoll_ready_add(EPOLL_ALLOC(leg->epf),
+				__containerof(leg, struct epoll_entry,
+					      legacy_cb));
 		uk_file_event_set(leg->epf, UKFD_POLLIN);
 	}
 }
@@ -376,14 +529,24 @@ struct uk_file *uk_epollfile_create(void)
 
 	if (!al)
 		return NULL;
+	al->buckets = uk_calloc(a, 1UL << EPOLL_HASH_MINBITS,
+				sizeof(*al->buckets));
+	if (!al->buckets) {
+		uk_free(a, al);
+		return NULL;
+	}
 	/* Set fields */
 	al->alloc = a;
-	al->list = NULL;
+	al->hbits = EPOLL_HASH_MINBITS;
+	al->count = 0;
+	al->busy_f = NULL;
+	uk_spin_init(&al->rdlock);
+	UK_INIT_LIST_HEAD(&al->rdlist);
 	al->fstate = UK_FILE_STATE_INIT_VALUE(al->fstate);
 	al->frefcnt = UK_FILE_REFCNT_INIT_VALUE;
 	al->f = (struct uk_file){
 		.vol = EPOLL_VOLID,
-		.node = &al->list,
+		.node = al,
 		.refcnt = &al->frefcnt,
 		.state = &al->fstate,
 		.ops = &uk_file_nops,
@@ -422,6 +585,7 @@ int uk_sys_epoll_ctl(const struct uk_file *epf, int op, int fd,
 {
 	int ret = 0;
 	union uk_shim_file sf;
+	const struct uk_file *tf;
 	struct epoll_entry **entp;
 #if CONFIG_LIBVFSCORE
 	int legacy;
@@ -435,11 +599,13 @@ int uk_sys_epoll_ctl(const struct uk_file *epf, int op, int fd,
 	if (unlikely(legacy < 0))
 		return -EBADF;
 	legacy = legacy == UK_SHIM_LEGACY;
+	tf = legacy ? NULL : sf.ofile->file;
 #else /* !CONFIG_LIBVFSCORE */
 	ret = uk_fdtab_shim_get(fd, &sf);
 	if (unlikely(ret < 0))
 		return -EBADF;
 	UK_ASSERT(ret == UK_SHIM_OFILE);
+	tf = sf.ofile->file;
 #endif /* !CONFIG_LIBVFSCORE */
 
 	uk_file_wlock(epf);
@@ -454,17 +620,21 @@ int uk_sys_epoll_ctl(const struct uk_file *epf, int op, int fd,
 	case EPOLL_CTL_ADD:
 		if (unlikely(!event))
 			ret = -EFAULT;
+		else if (unlikely((event->events & EPOLLEXCLUSIVE) &&
+				  ((event->events & ~EPOLL_EXCLUSIVE_OK) ||
+				   (tf && tf->vol == EPOLL_VOLID))))
+			ret = -EINVAL;
 		else if (unlikely(*entp))
 			ret = -EEXIST;
 		else
 #if CONFIG_LIBVFSCORE
 			if (legacy)
-				ret = epoll_add_legacy(epf, entp,
-						       fd, sf.vfile, event);
+				ret = epoll_add_legacy(epf, fd, sf.vfile,
+						       event);
 			else
 #endif /* CONFIG_LIBVFSCORE */
-				ret = epoll_add(epf, entp,
-						fd, sf.ofile->file, event);
+				ret = epoll_add(epf, fd, sf.ofile->file,
+						event);
 		break;
 
 	case EPOLL_CTL_MOD:
@@ -472,10 +642,14 @@ int uk_sys_epoll_ctl(const struct uk_file *epf, int op, int fd,
 			ret = -EFAULT;
 		else if (unlikely(!*entp))
 			ret = -ENOENT;
+		/* Exclusive registrations cannot be modified */
+		else if (unlikely((event->events & EPOLLEXCLUSIVE) ||
+				  IS_EXCLUSIVE(*entp)))
+			ret = -EINVAL;
 		else
 #if CONFIG_LIBVFSCORE
 			if (legacy)
-				epoll_entry_mod_legacy(*entp, event);
+				epoll_entry_mod_legacy(epf, *entp, event);
 			else
 #endif /* CONFIG_LIBVFSCORE */
 				epoll_entry_mod(epf, *entp, event);
@@ -503,11 +677,130 @@ int uk_sys_epoll_ctl(const struct uk_file *epf, int op, int fd,
 	return ret;
 }
 
+/*
+ * Deliver events from the ready list into `events`.
+ *
+ * Must be called with the epoll file read-locked, which keeps entries from
+ * being freed under us. Concurrent callers each take their own batch off the
+ * ready list. Entries stay marked as queued until they are delivered, so event
+ * callbacks arriving in the meantime only update `revents`.
+ */
+static int epoll_deliver(struct epoll_alloc *al, struct epoll_event *events,
+			 int maxevents)
+{
+	UK_LIST_HEAD(batch);
+	unsigned long irqf;
+	int nout = 0;
+
+	irqf = ukplat_lcpu_save_irqf();
+	uk_spin_lock(&al->rdlock);
+	uk_list_splice_init(&al->rdlist, &batch);
+	uk_spin_unlock(&al->rdlock);
+	ukplat_lcpu_restore_irqf(irqf);
+
+	while (nout < maxevents && !uk_list_empty(&batch)) {
+		struct epoll_entry *p = uk_list_first_entry(
+			&batch, struct epoll_entry, rdlink);
+		unsigned int revents;
+		unsigned int *revp;
+
+		/* Dequeue before consuming events so no new event is missed */
+		irqf = ukplat_lcpu_save_irqf();
+		uk_spin_lock(&al->rdlock);
+		uk_list_del_init(&p->rdlink);
+		p->rdqueued = 0;
+		uk_spin_unlock(&al->rdlock);
+		ukplat_lcpu_restore_irqf(irqf);
+
+#if CONFIG_LIBVFSCORE
+		if (p->legacy)
+			revp = &p->legacy_cb.revents;
+		else
+#endif /* CONFIG_LIBVFSCORE */
+			revp = &p->revents;
+
+		revents = uk_exchange_n(revp, 0);
+		if (!revents)
+			continue;
+
+		if (!IS_EDGEPOLL(p)) {
+			unsigned int mask;
+
+			mask = events2mask(p->event.events);
+#if CONFIG_LIBVFSCORE
+			if (p->legacy) {
+				vfs_poll(p->vf, &revents, &p->legacy_cb.ecb);
+				revents &= mask;
+			} else
+#endif /* CONFIG_LIBVFSCORE */
+			{
+				revents = uk_file_poll_immediate(p->f, mask);
+			}
+			if (!revents)
+				continue;
+
+			/* Still level-active; report again on the next wait */
+			if (!IS_ONESHOT(p)) {
+				(void)uk_or(revp, revents);
+				epoll_ready_add(al, p);
+			}
+		}
+
+		events[nout].events = revents;
+		events[nout].data = p->event.data;
+		nout++;
+	}
+
+	/* Put back what did not fit into `events` */
+	if (!uk_list_empty(&batch)) {
+		irqf = ukplat_lcpu_save_irqf();
+		uk_spin_lock(&al->rdlock);
+		uk_list_splice(&batch, &al->rdlist);
+		uk_spin_unlock(&al->rdlock);
+		ukplat_lcpu_restore_irqf(irqf);
+	}
+	return nout;
+}
+
+/*
+ * Spin on the receive path of the busy polled file until an event is ready,
+ * its busy poll time runs out, or `deadline` passes.
+ */
+static void epoll_busy_poll(const struct uk_file *epf, __nsec deadline)
+{
+	struct epoll_alloc *al = EPOLL_ALLOC(epf);
+	__nsec now, until;
+	int usec;
+
+	uk_file_rlock(epf);
+	if (!al->busy_f || !uk_list_empty(&al->rdlist))
+		goto out;
+	usec = uk_file_ctl(al->busy_f, UKFILE_CTL_FILE,
+			   UKFILE_CTL_FILE_BUSY_POLL, 0, 0, 0);
+	if (usec <= 0)
+		goto out;
+
+	now = ukplat_monotonic_clock();
+	until = now + ukarch_time_usec_to_nsec((__nsec)usec);
+	if (deadline && deadline < until)
+		until = deadline;
+	while (now < until) {
+		if (uk_file_ctl(al->busy_f, UKFILE_CTL_FILE,
+				UKFILE_CTL_FILE_BUSY_POLL, 1, 0, 0) <= 0)
+			break;
+		if (uk_file_poll_immediate(epf, UKFD_POLLIN))
+			break;
+		now = ukplat_monotonic_clock();
+	}
+out:
+	uk_file_runlock(epf);
+}
+
 int uk_sys_epoll_pwait2(const struct uk_file *epf, struct epoll_event *events,
 			int maxevents, const struct timespec *timeout,
 			const sigset_t *sigmask, size_t sigsetsize __unused)
 {
-	struct epoll_entry **list;
+	struct epoll_alloc *al;
 	__nsec deadline;
 
 	if (unlikely(epf->vol != EPOLL_VOLID))
@@ -521,7 +814,7 @@ int uk_sys_epoll_pwait2(const struct uk_file *epf, struct epoll_event *events,
 		return -ENOSYS;
 	}
 
-	list = (struct epoll_entry **)epf->node;
+	al = EPOLL_ALLOC(epf);
 
 	if (timeout) {
 		__snsec tout = uk_time_spec_to_nsec(timeout);
@@ -533,60 +826,20 @@ int uk_sys_epoll_pwait2(const struct uk_file *epf, struct epoll_event *events,
 		deadline = 0;
 	}
 
+	epoll_busy_poll(epf, deadline);
 	while (uk_file_poll_until(epf, UKFD_POLLIN, deadline)) {
-		int lvlev = 0;
-		int nout = 0;
+		int nout;
 
 		uk_file_event_clear(epf, UKFD_POLLIN);
 		uk_file_rlock(epf);
-
-		/* gather & output event list */
-		for (struct epoll_entry *p = *list;
-		     p && nout < maxevents;
-		     p = p->next) {
-			unsigned int revents;
-			unsigned int *revp;
-
-#if CONFIG_LIBVFSCORE
-			if (p->legacy)
-				revp = &p->legacy_cb.revents;
-			else
-#endif /* CONFIG_LIBVFSCORE */
-				revp = &p->revents;
-
-			revents = uk_exchange_n(revp, 0);
-			if (revents) {
-				if (!IS_EDGEPOLL(p)) {
-					unsigned int mask;
-
-					mask = events2mask(p->event.events);
-#if CONFIG_LIBVFSCORE
-					if (p->legacy) {
-						vfs_poll(p->vf, &revents,
-							 &p->legacy_cb.ecb);
-						revents &= mask;
-					} else
-#endif /* CONFIG_LIBVFSCORE */
-					{
-						revents = uk_file_poll_immediate(p->f, mask);
-					}
-					if (!revents)
-						continue;
-
-					lvlev = 1;
-					(void)uk_or(revp, revents);
-				}
-
-				events[nout].events = revents;
-				events[nout].data = p->event.data;
-				nout++;
-			}
-		}
+		nout = epoll_deliver(al, events, maxevents);
 		uk_file_runlock(epf);
 
-		/* If lvlev or limited by maxevents, update pollin back in */
-		if (lvlev || nout == maxevents)
-			uk_file_event_set(epf, UKFD_POLLIN);
+		/* If entries remain ready, update pollin back in and pass them
+		 * on to one other waiter, if any
+		 */
+		if (!uk_list_empty(&al->rdlist))
+			uk_pollq_set_n(&epf->state->pollq, UKFD_POLLIN, 1);
 
 		if (nout)
 			return nout;
@@ -11,6 +11,8 @@
 #include <uk/timeutil.h>
 #include <uk/syscall.h>
 
+#include "pollset.h"
+
 /* For performance we copy between epoll and poll events with no conversion. */
 /* This assumes them to be equal, which we ensure with these asserts */
 UK_CTASSERT(EPOLLIN == POLLIN);
@@ -24,23 +26,15 @@ UK_CTASSERT(EPOLLRDBAND == POLLRDBAND);
 UK_CTASSERT(EPOLLWRNORM == POLLWRNORM);
 UK_CTASSERT(EPOLLWRBAND == POLLWRBAND);
 
-/* HACK: Because we need to support both vfscore and uk_file, we need to defer
- * to epoll(), which can handle both. This has the limitation of not supporting
- * multiple pollfd entries with the same fd, in which case we fail early with
- * -ENOSYS.
- * Once vfscore shim is no longer needed, we can switch to a more efficient
- * and correct bespoke implementation.
- */
-
 /* Internal syscalls */
 
 int uk_sys_ppoll(struct pollfd *fds, nfds_t nfds,
 		 const struct timespec *timeout,
 		 const sigset_t *sigmask, size_t sigsetsize)
 {
-	const struct uk_file *ef;
+	struct pollset_ent ents[nfds ? nfds : 1];
+	int complete;
 	int ret;
-	int monitored;
 
 	if (unlikely(!fds))
 		return -EFAULT;
@@ -51,79 +45,27 @@ int uk_sys_ppoll(struct pollfd *fds, nfds_t nfds,
 		return -ENOSYS;
 	}
 
-	ef = uk_epollfile_create();
-	if (unlikely(!ef))
-		return -ENOMEM;
-
-	/* Register fds & prepare output */
-	ret = 0;
-	monitored = 0;
-	for (nfds_t i = 0; i < nfds; i++) {
-		struct pollfd *p = &fds[i];
-		int r = 0;
-
-		if (p->fd >= 0) {
-			struct epoll_event ev = {
-				.events = p->events,
-				.data.fd = p->fd
-			};
-
-			r = uk_sys_epoll_ctl(ef, EPOLL_CTL_ADD, p->fd, &ev);
-			monitored++;
-		}
-		switch (r) {
-		case 0:
-			p->revents = 0;
-			break;
-		case -EBADF:
-			p->revents = POLLNVAL;
-			ret++;
-			break;
-		case -EPERM:
-			/* Files without epoll support always return in|out */
-			p->revents = (POLLIN|POLLOUT) & p->events;
-			if (p->revents)
-				ret++;
-			break;
-		case -EEXIST:
-			uk_pr_warn("Duplicate fd in poll: %d\n", p->fd);
-			ret = -ENOSYS;
-			goto out;
-		default:
-			ret = r;
-			goto out;
+	for (nfds_t i = 0; i < nfds; i++)
+		ents[i] = (struct pollset_ent){
+			.fd = fds[i].fd,
+			.events = fds[i].events
+		};
+
+	/* Only register for events if nothing is ready yet */
+	ret = pollset_sweep(ents, nfds, &complete);
+	if (!ret && !(complete && timeout && !uk_time_spec_to_nsec(timeout))) {
+		ret = pollset_wait(ents, nfds, timeout, sigmask, sigsetsize);
+		if (unlikely(ret == -EEXIST)) {
+			/* epoll cannot register the same fd twice */
+			uk_pr_warn("Duplicate fd in poll\n");
+			return -ENOSYS;
 		}
+		if (unlikely(ret < 0))
+			return ret;
 	}
-	if (!monitored)
-		monitored = 1; /* Need at least 1 return entry */
-
-	/* Wait */
-	if (!ret) {
-		struct epoll_event ev[monitored];
-		nfds_t pi;
 
-		ret = uk_sys_epoll_pwait2(ef, ev, monitored, timeout,
-					  sigmask, sigsetsize);
-		/* Process epoll() output */
-		/*
-		 * HACK: this relies on epoll returning entries in the order
-		 * of registration; currently this is the case, but beware.
-		 */
-		pi = 0;
-		for (int ei = 0; ei < ret; ei++) {
-			while (pi < nfds && fds[pi].fd != ev[ei].data.fd)
-				pi++;
-			if (unlikely(pi == nfds)) {
-				uk_pr_err("Bad fd returned from epoll: %d\n",
-					  ev[ei].data.fd);
-				ret = ei;
-				break;
-			}
-			fds[pi].revents = ev[ei].events;
-		}
-	}
-out:
-	uk_file_release(ef);
+	for (nfds_t i = 0; i < nfds; i++)
+		fds[i].revents = ents[i].revents;
 	return ret;
 }
 
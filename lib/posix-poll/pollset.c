@@ -0,0 +1,243 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * poll() and select() first sweep over their files and only fall back to
+ * waiting on an epoll file when nothing is ready. Building that epoll file
+ * registers on every file and tearing it down unregisters again, so each
+ * thread keeps the epoll file of its last wait around. A call with the same
+ * entries on the same open files reuses it as is. Since epoll re-checks level
+ * events before reporting them, stale ready entries do no harm.
+ *
+ * Cached registrations hold weak references, which keep the memory of files
+ * closed in the meantime until the next wait of the thread or its exit.
+ */
+#include <errno.h>
+#include <string.h>
+
+#include <uk/alloc.h>
+#include <uk/essentials.h>
+#include <uk/posix-fd.h>
+#include <uk/posix-fdtab.h>
+#include <uk/thread.h>
+
+#if CONFIG_LIBVFSCORE
+#include <vfscore/file.h>
+#endif /* CONFIG_LIBVFSCORE */
+
+#include "pollset.h"
+
+/* Events that epoll registers for, see epoll.c */
+#define POLLSET_EVENTS \
+	(UKFD_POLLIN|UKFD_POLLOUT|EPOLLRDHUP|EPOLLPRI|UKFD_POLL_ALWAYS)
+#define events2mask(ev) (((ev) & POLLSET_EVENTS) | UKFD_POLL_ALWAYS)
+
+struct pollset_cache {
+	struct uk_file *ef;
+	unsigned int n;
+	unsigned int cap;
+	struct pollset_ent *ents;
+};
+
+static __uk_tls struct pollset_cache pollset_cache;
+
+int pollset_sweep(struct pollset_ent *ents, unsigned int n, int *complete)
+{
+	union uk_shim_file sf;
+	int ready = 0;
+	int r;
+
+	*complete = 1;
+	for (unsigned int i = 0; i < n; i++) {
+		struct pollset_ent *e = &ents[i];
+
+		e->revents = 0;
+		e->key = NULL;
+		if (e->fd < 0)
+			continue;
+
+		r = uk_fdtab_shim_get(e->fd, &sf);
+		if (unlikely(r < 0)) {
+			e->revents = POLLNVAL;
+			ready++;
+			continue;
+		}
+#if CONFIG_LIBVFSCORE
+		if (r == UK_SHIM_LEGACY) {
+			/* vfscore files can only be polled by registering */
+			*complete = 0;
+			fdrop(sf.vfile);
+			continue;
+		}
+#endif /* CONFIG_LIBVFSCORE */
+		UK_ASSERT(r == UK_SHIM_OFILE);
+
+		e->key = sf.ofile->file;
+		e->revents = uk_file_poll_immediate(sf.ofile->file,
+						    events2mask(e->events));
+		if (e->revents)
+			ready++;
+		uk_fdtab_ret(sf.ofile);
+	}
+	return ready;
+}
+
+static void pollset_cache_drop(struct pollset_cache *c)
+{
+	if (c->ef) {
+		uk_file_release(c->ef);
+		c->ef = NULL;
+	}
+	c->n = 0;
+}
+
+static int pollset_cache_match(const struct pollset_cache *c,
+			       const struct pollset_ent *ents, unsigned int n)
+{
+	if (!c->ef || c->n != n)
+		return 0;
+
+	for (unsigned int i = 0; i < n; i++) {
+		const struct pollset_ent *ce = &c->ents[i];
+
+		if (ce->fd != ents[i].fd)
+			return 0;
+		if (ce->fd >= 0 &&
+		    (ce->events != ents[i].events || ce->key != ents[i].key))
+			return 0;
+	}
+	return 1;
+}
+
+/* Only sets of files that the sweep fully checked can be cached */
+static int pollset_cacheable(const struct pollset_ent *ents, unsigned int n)
+{
+	for (unsigned int i = 0; i < n; i++)
+		if (ents[i].fd >= 0 && !ents[i].key)
+			return 0;
+	return 1;
+}
+
+/* Takes over the reference to `ef`; returns 0 if caching failed */
+static int pollset_cache_store(struct pollset_cache *c, struct uk_file *ef,
+			       const struct pollset_ent *ents, unsigned int n)
+{
+	struct uk_alloc *a = uk_alloc_get_default();
+
+	if (n > c->cap) {
+		struct pollset_ent *nents;
+
+		nents = uk_malloc(a, n * sizeof(*nents));
+		if (unlikely(!nents))
+			return 0;
+		uk_free(a, c->ents);
+		c->ents = nents;
+		c->cap = n;
+	}
+	memcpy(c->ents, ents, n * sizeof(*ents));
+	c->n = n;
+	c->ef = ef;
+	return 1;
+}
+
+/*
+ * Register the entries on a new epoll file. The data of each registration is
+ * the index of its entry. Returns the number of entries that turned out to be
+ * ready while registering, or a negative error code.
+ */
+static int pollset_build(struct pollset_ent *ents, unsigned int n,
+			 struct uk_file **efp)
+{
+	struct uk_file *ef;
+	int ready = 0;
+	int r;
+
+	ef = uk_epollfile_create();
+	if (unlikely(!ef))
+		return -ENOMEM;
+
+	for (unsigned int i = 0; i < n; i++) {
+		struct pollset_ent *e = &ents[i];
+		struct epoll_event ev = {
+			.events = e->events,
+			.data.u64 = i
+		};
+
+		if (e->fd < 0)
+			continue;
+
+		r = uk_sys_epoll_ctl(ef, EPOLL_CTL_ADD, e->fd, &ev);
+		switch (r) {
+		case 0:
+			break;
+		case -EBADF:
+			/* Closed since the sweep */
+			e->revents = POLLNVAL;
+			ready++;
+			break;
+		case -EPERM:
+			/* Files without epoll support always return in|out */
+			e->revents = (UKFD_POLLIN|UKFD_POLLOUT) & e->events;
+			if (e->revents)
+				ready++;
+			break;
+		default:
+			uk_file_release(ef);
+			return r;
+		}
+	}
+	*efp = ef;
+	return ready;
+}
+
+int pollset_wait(struct pollset_ent *ents, unsigned int n,
+		 const struct timespec *timeout,
+		 const sigset_t *sigmask, size_t sigsetsize)
+{
+	struct pollset_cache *c = &pollset_cache;
+	const unsigned int maxev = n ? n : 1; /* Need at least 1 entry */
+	struct epoll_event ev[maxev];
+	struct uk_file *ef;
+	int cached;
+	int ret;
+
+	if (pollset_cache_match(c, ents, n)) {
+		ef = c->ef;
+		cached = 1;
+	} else {
+		pollset_cache_drop(c);
+		ret = pollset_build(ents, n, &ef);
+		if (unlikely(ret < 0))
+			return ret;
+		if (ret) {
+			uk_file_release(ef);
+			return ret;
+		}
+		cached = pollset_cacheable(ents, n) &&
+			 pollset_cache_store(c, ef, ents, n);
+	}
+
+	ret = uk_sys_epoll_pwait2(ef, ev, maxev, timeout, sigmask, sigsetsize);
+	for (int i = 0; i < ret; i++)
+		ents[ev[i].data.u64].revents = ev[i].events;
+
+	if (!cached)
+		uk_file_release(ef);
+	return ret;
+}
+
+static void pollset_thread_term(struct uk_thread *child __unused)
+{
+	struct pollset_cache *c = &pollset_cache;
+
+	pollset_cache_drop(c);
+	uk_free(uk_alloc_get_default(), c->ents);
+	c->ents = NULL;
+	c->cap = 0;
+}
+
+UK_THREAD_INIT_PRIO_FLAGS(0x0, pollset_thread_term, UK_PRIO_LATEST,
+			  UK_THREAD_INITF_UKTLS);
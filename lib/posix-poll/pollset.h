@@ -0,0 +1,49 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/* Shared backend of poll() and select() */
+
+#ifndef __POSIX_POLL_POLLSET_H__
+#define __POSIX_POLL_POLLSET_H__
+
+#include <uk/posix-poll.h>
+
+struct pollset_ent {
+	int fd; /* Ignored if < 0 */
+	unsigned int events; /* Requested epoll events */
+	unsigned int revents; /* Returned epoll events, or POLLNVAL */
+	const void *key; /* Open file seen by the last sweep */
+};
+
+/**
+ * Check the entries for events without blocking or registering anywhere.
+ * Sets `revents` for every entry, to POLLNVAL if its fd is not open.
+ *
+ * @param ents Entries to check.
+ * @param n Number of entries.
+ * @param complete Set to 0 if some entries could not be checked this way
+ *   (i.e., vfscore files); these need `pollset_wait()` even with a zero
+ *   timeout.
+ *
+ * @return
+ *   The number of entries with events.
+ */
+int pollset_sweep(struct pollset_ent *ents, unsigned int n, int *complete);
+
+/**
+ * Wait until events arrive on any of the entries, or until `timeout`.
+ * Must follow a `pollset_sweep()` of the same entries. The registrations are
+ * cached per thread, so repeated calls with the same set are cheap.
+ *
+ * @return
+ *   The number of entries with events, 0 on timeout, or a negative error code.
+ *   -EEXIST if an fd appears more than once.
+ */
+int pollset_wait(struct pollset_ent *ents, unsigned int n,
+		 const struct timespec *timeout,
+		 const sigset_t *sigmask, size_t sigsetsize);
+
+#endif /* __POSIX_POLL_POLLSET_H__ */
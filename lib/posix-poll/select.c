@@ -10,10 +10,7 @@
 #include <uk/timeutil.h>
 #include <uk/syscall.h>
 
-/* HACK: Because we need to support both vfscore and uk_file, we need to defer
- * to epoll(), which can handle both. Once vfscore shim is no longer needed, we
- * can switch to a more efficient bespoke implementation.
- */
+#include "pollset.h"
 
 #define SELECT_READ   UKFD_POLLIN
 #define SELECT_WRITE  UKFD_POLLOUT
@@ -33,106 +30,57 @@ static inline void zero_fdsets(fd_set *restrict readfds,
 		FD_ZERO(exceptfds);
 }
 
-int uk_sys_pselect(int nfds, fd_set *restrict readfds,
-		   fd_set *restrict writefds,
-		   fd_set *restrict exceptfds,
-		   struct timespec *restrict timeout,
-		   const struct uk_ksigset *sigset)
+static inline unsigned int select_events(int fd, fd_set *readfds,
+					 fd_set *writefds, fd_set *exceptfds)
 {
-	const struct uk_file *ef;
-	int ret;
-	int monitored;
-	int immediate;
-	fd_set imm_rd;
-	fd_set imm_wr;
-
-	if (unlikely(nfds < 0))
-		return -EINVAL;
-	if (unlikely(timeout && uk_time_spec_to_nsec(timeout) < 0))
-		return -EINVAL;
-	if (unlikely(nfds > FD_SETSIZE)) {
-		uk_pr_warn("STUB: select fd_set too small (req %d)\n", nfds);
-		return -EINVAL;
-	}
-	if (unlikely(sigset && sigset->ss)) {
-		uk_pr_warn_once("STUB: pselect no sigmask support\n");
-		return -ENOSYS;
-	}
+	unsigned int events = 0;
+
+	if (readfds && FD_ISSET(fd, readfds))
+		events |= SELECT_READ;
+	if (writefds && FD_ISSET(fd, writefds))
+		events |= SELECT_WRITE;
+	if (exceptfds && FD_ISSET(fd, exceptfds))
+		events |= SELECT_EXCEPT;
+	return events;
+}
 
-	ef = uk_epollfile_create();
-	if (unlikely(!ef))
-		return -ENOMEM;
+/* Poll the `monitored` fds set in the fd sets */
+static int select_poll(int nfds, unsigned int monitored,
+		       fd_set *restrict readfds,
+		       fd_set *restrict writefds,
+		       fd_set *restrict exceptfds,
+		       struct timespec *restrict timeout,
+		       const struct uk_ksigset *sigset)
+{
+	struct pollset_ent ents[monitored ? monitored : 1];
+	int complete;
+	int ret;
 
-	/* Walk fds, add to epoll */
-	ret = 0;
 	monitored = 0;
-	immediate = 0;
-	FD_ZERO(&imm_rd);
-	FD_ZERO(&imm_wr);
 	for (int fd = 0; fd < nfds; fd++) {
-		int r = 0, w = 0, x = 0;
-
-		if (readfds)
-			r = FD_ISSET(fd, readfds) ? SELECT_READ : 0;
-		if (writefds)
-			w = FD_ISSET(fd, writefds) ? SELECT_WRITE : 0;
-		if (exceptfds)
-			x = FD_ISSET(fd, exceptfds) ? SELECT_EXCEPT : 0;
-
-		if (r|w|x) {
-			struct epoll_event ev = {
-				.events = r|w|x,
-				.data.fd = fd
-			};
+		unsigned int events = select_events(fd, readfds, writefds,
+						    exceptfds);
 
-			ret = uk_sys_epoll_ctl(ef, EPOLL_CTL_ADD, fd, &ev);
-			if (ret == -EPERM) {
-				/* Files without epoll support return rd|wr */
-				if (r|w)
-					immediate = fd + 1;
-				if (r)
-					FD_SET(fd, &imm_rd);
-				if (w)
-					FD_SET(fd, &imm_wr);
-				ret = 0;
-			} else if (unlikely(ret)) {
-				break;
-			}
-			monitored++;
-		}
-	}
-	if (!monitored)
-		monitored = 1;
-
-	if (immediate) {
-		ret = 0;
-		zero_fdsets(readfds, writefds, exceptfds);
-
-		for (int i = 0; i < immediate; i++) {
-			if (FD_ISSET(i, &imm_rd)) {
-				FD_SET(i, readfds);
-				ret++;
-			}
-			if (FD_ISSET(i, &imm_wr)) {
-				FD_SET(i, writefds);
-				ret++;
-			}
-		}
+		if (events)
+			ents[monitored++] = (struct pollset_ent){
+				.fd = fd,
+				.events = events
+			};
 	}
 
-	if (!ret) {
-		struct epoll_event ev[monitored];
+	/* Only register for events if nothing is ready yet */
+	ret = pollset_sweep(ents, monitored, &complete);
+	if (!ret && !(complete && timeout && !uk_time_spec_to_nsec(timeout))) {
 		__nsec t0;
 
 		if (timeout)
 			t0 = ukplat_monotonic_clock();
 		/* Wait */
 		if (sigset)
-			ret = uk_sys_epoll_pwait2(ef, ev, monitored, timeout,
-						  sigset->ss, sigset->ss_len);
+			ret = pollset_wait(ents, monitored, timeout,
+					   sigset->ss, sigset->ss_len);
 		else
-			ret = uk_sys_epoll_pwait2(ef, ev, monitored, timeout,
-						  NULL, 0);
+			ret = pollset_wait(ents, monitored, timeout, NULL, 0);
 		/* Writeout */
 		if (timeout) {
 			__snsec waited = ukplat_monotonic_clock() - t0;
@@ -140,23 +88,67 @@ int uk_sys_pselect(int nfds, fd_set *restrict readfds,
 
 			*timeout = uk_time_spec_from_nsec(left > 0 ? left : 0);
 		}
-		zero_fdsets(readfds, writefds, exceptfds);
-		for (int i = 0; i < ret; i++) {
-			int fd = ev[i].data.fd;
-
-			if (readfds && ev[i].events & SELECT_READ)
-				FD_SET(fd, readfds);
-			if (writefds && ev[i].events & SELECT_WRITE)
-				FD_SET(fd, writefds);
-			if (exceptfds && ev[i].events & SELECT_EXCEPT)
-				FD_SET(fd, exceptfds);
-		}
+		if (unlikely(ret < 0))
+			return ret;
 	}
 
-	uk_file_release(ef);
+	/* Unlike poll(), select() fails on bad fds */
+	for (unsigned int i = 0; i < monitored; i++)
+		if (unlikely(ents[i].revents == POLLNVAL))
+			return -EBADF;
+
+	ret = 0;
+	zero_fdsets(readfds, writefds, exceptfds);
+	for (unsigned int i = 0; i < monitored; i++) {
+		int fd = ents[i].fd;
+		unsigned int revents = ents[i].revents & ents[i].events;
+
+		if (revents & SELECT_READ) {
+			FD_SET(fd, readfds);
+			ret++;
+		}
+		if (revents & SELECT_WRITE) {
+			FD_SET(fd, writefds);
+			ret++;
+		}
+		if (revents & SELECT_EXCEPT) {
+			FD_SET(fd, exceptfds);
+			ret++;
+		}
+	}
 	return ret;
 }
 
+int uk_sys_pselect(int nfds, fd_set *restrict readfds,
+		   fd_set *restrict writefds,
+		   fd_set *restrict exceptfds,
+		   struct timespec *restrict timeout,
+		   const struct uk_ksigset *sigset)
+{
+	unsigned int monitored;
+
+	if (unlikely(nfds < 0))
+		return -EINVAL;
+	if (unlikely(timeout && uk_time_spec_to_nsec(timeout) < 0))
+		return -EINVAL;
+	if (unlikely(nfds > FD_SETSIZE)) {
+		uk_pr_warn("STUB: select fd_set too small (req %d)\n", nfds);
+		return -EINVAL;
+	}
+	if (unlikely(sigset && sigset->ss)) {
+		uk_pr_warn_once("STUB: pselect no sigmask support\n");
+		return -ENOSYS;
+	}
+
+	monitored = 0;
+	for (int fd = 0; fd < nfds; fd++)
+		if (select_events(fd, readfds, writefds, exceptfds))
+			monitored++;
+
+	return select_poll(nfds, monitored, readfds, writefds, exceptfds,
+			   timeout, sigset);
+}
+
 /* Userspace syscalls */
 
 UK_SYSCALL_R_DEFINE(int, pselect6, int, nfds,
@@ -39,10 +39,11 @@ void clone_setup_child_ctx(struct uk_syscall_ctx *pusc,
 	cusc->regs.spsr_el1 &= ~PSR_I;
 
 	/* Make sure we do return to what the child is expected to
-	 * have as an instruction pointer as well as a stack pointer.
+	 * have as an instruction pointer as well as a stack pointer. Without
+	 * a stack, the child continues on the parent's stack (vfork).
 	 */
 	cusc->regs.elr_el1 = pusc->regs.lr;
-	cusc->regs.sp = sp;
+	cusc->regs.sp = sp ? sp : pusc->regs.sp;
 
 	/* Use parent's user land TPIDR_EL0 if clone did not have SETTLS */
 	if (!child->tlsp)
@@ -39,10 +39,11 @@ void clone_setup_child_ctx(struct uk_syscall_ctx *pusc,
 	cusc->regs.eflags |= X86_EFLAGS_IF;
 
 	/* Finally, make sure we do return to what the child is expected to
-	 * have as an instruction pointer as well as a stack pointer.
+	 * have as an instruction pointer as well as a stack pointer. Without
+	 * a stack, the child continues on the parent's stack (vfork).
 	 */
 	cusc->regs.rip = pusc->regs.rip;
-	cusc->regs.rsp = sp;
+	cusc->regs.rsp = sp ? sp : pusc->regs.rsp;
 
 	/* Use parent's userland gs_base */
 	cusc->sysregs.gs_base = pusc->sysregs.gs_base;
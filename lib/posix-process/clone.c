@@ -34,6 +34,7 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <signal.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/prctl.h>
@@ -44,6 +45,7 @@
 #include <uk/syscall.h>
 #include <uk/arch/limits.h>
 #include <uk/sched.h>
+#include <uk/wait.h>
 
 #include "process.h"
 
@@ -60,6 +62,15 @@ static __uk_tls struct {
 	__u64 cl_flags;
 } cl_status = { false, 0x0 };
 
+/* A parent suspended by CLONE_VFORK until the child releases it */
+struct clone_vfork {
+	struct uk_waitq wq;
+	bool released;
+};
+
+/* Set in the child while its parent is suspended */
+static __uk_tls struct clone_vfork *cl_vfork;
+
 #ifdef CONFIG_LIBUKDEBUG_ENABLE_ASSERT
 #define CL_UKTLS_SANITY_MAGIC 0xb0b0f00d /* Bobo food */
 static __thread uint32_t cl_uktls_magic = CL_UKTLS_SANITY_MAGIC;
@@ -324,6 +335,7 @@ static int _clone(struct clone_args *cl_args, size_t cl_args_len,
 		  struct uk_syscall_ctx *usc)
 {
 	struct uk_thread *child = NULL;
+	struct clone_vfork vfork;
 	struct uk_thread *t;
 	struct uk_sched *s;
 	__u64 flags;
@@ -471,9 +483,23 @@ static int _clone(struct clone_args *cl_args, size_t cl_args_len,
 	/* We will return the child's thread ID in the parent */
 	ret = ukthread2tid(child);
 
+	if (flags & CLONE_VFORK) {
+		uk_waitq_init(&vfork.wq);
+		vfork.released = false;
+		uk_thread_uktls_var(child, cl_vfork) = &vfork;
+	}
+
 	/* Assign the child to the scheduler */
 	uk_sched_thread_add(s, child);
 
+	if (flags & CLONE_VFORK) {
+		/* The child runs on our stack until it calls execve() or
+		 * exits, so we must not return before
+		 */
+		uk_waitq_wait_event(&vfork.wq, vfork.released);
+		return ret;
+	}
+
 #ifdef CONFIG_LIBPOSIX_PROCESS_CLONE_PREFER_CHILD
 	uk_sched_yield();
 #endif /* CONFIG_LIBPOSIX_PROCESS_CLONE_PREFER_CHILD */
@@ -516,6 +542,20 @@ UK_LLSYSCALL_R_U_DEFINE(int, clone,
 	return _clone(&cl_args, sizeof(cl_args), usc);
 }
 
+/* vfork() shares the address space and the stack with the suspended parent.
+ * This makes it the fast path for spawning processes until execve().
+ */
+UK_LLSYSCALL_R_U_DEFINE(int, vfork)
+{
+	struct clone_args cl_args = {
+		.flags       = (__u64) (CLONE_VM | CLONE_VFORK),
+		.exit_signal = (__u64) SIGCHLD,
+		.stack       = (__u64) 0x0, /* Use the parent's stack */
+	};
+
+	return _clone(&cl_args, sizeof(cl_args), usc);
+}
+
 #if UK_LIBC_SYSCALLS
 int clone(int (*fn)(void *) __unused, void *sp __unused,
 	  int flags __unused, void *arg __unused,
@@ -545,6 +585,38 @@ static int uk_posix_clone_checkvm(const struct clone_args *cl_args,
 }
 UK_POSIX_CLONE_HANDLER(CLONE_VM, false, uk_posix_clone_checkvm, 0x0);
 
+void uk_posix_clone_vfork_release(void)
+{
+	struct clone_vfork *vfork = cl_vfork;
+
+	if (!vfork)
+		return;
+
+	cl_vfork = NULL;
+	vfork->released = true;
+	uk_waitq_wake_up(&vfork->wq);
+}
+
+/*
+ * CLONE_VFORK: The parent is suspended in `_clone()` until the child calls
+ * execve() or exits
+ */
+static int uk_posix_clone_vfork(const struct clone_args *cl_args __unused,
+				size_t cl_args_len __unused,
+				struct uk_thread *child __unused,
+				struct uk_thread *parent __unused)
+{
+	return 0;
+}
+
+static void uk_posix_clone_vfork_term(__u64 cl_flags __unused,
+				      struct uk_thread *child __unused)
+{
+	uk_posix_clone_vfork_release();
+}
+UK_POSIX_CLONE_HANDLER(CLONE_VFORK, true, uk_posix_clone_vfork,
+		       uk_posix_clone_vfork_term);
+
 /*
  * Ignore historical CLONE_DETACHED flag
  */
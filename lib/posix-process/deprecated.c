@@ -41,7 +41,9 @@
 #include <uk/print.h>
 #include <uk/syscall.h>
 #include <uk/arch/limits.h>
-#if CONFIG_LIBVFSCORE
+#if CONFIG_LIBPOSIX_FDTAB
+#include <uk/posix-fdtab.h>
+#elif CONFIG_LIBVFSCORE
 #include <vfscore/file.h>
 #endif
 
@@ -317,6 +319,11 @@ UK_SYSCALL_R_DEFINE(int, prctl, int, option,
 UK_LLSYSCALL_R_DEFINE(int, prlimit64, int, pid, unsigned int, resource,
 		      struct rlimit *, new_limit, struct rlimit *, old_limit)
 {
+#if CONFIG_LIBPOSIX_FDTAB
+	unsigned int old_nofile = uk_fdtab_get_limit();
+	int rc;
+#endif /* CONFIG_LIBPOSIX_FDTAB */
+
 	if (unlikely(pid != 0))
 		uk_pr_debug("Do not support prlimit64 on PID %u, use current process\n",
 			    pid);
@@ -329,7 +336,7 @@ UK_LLSYSCALL_R_DEFINE(int, prlimit64, int, pid, unsigned int, resource,
 	case RLIMIT_STACK:
 	case RLIMIT_AS:
 		break;
-#if CONFIG_LIBVFSCORE
+#if CONFIG_LIBPOSIX_FDTAB || CONFIG_LIBVFSCORE
 	case RLIMIT_NOFILE:
 		break;
 #endif
@@ -344,6 +351,19 @@ UK_LLSYSCALL_R_DEFINE(int, prlimit64, int, pid, unsigned int, resource,
 	 */
 	if (new_limit) {
 		switch (resource) {
+#if CONFIG_LIBPOSIX_FDTAB
+		case RLIMIT_NOFILE:
+			if (unlikely(new_limit->rlim_cur > new_limit->rlim_max))
+				return -EINVAL;
+			/* The hard limit is fixed at build time */
+			if (unlikely(new_limit->rlim_max >
+				     CONFIG_LIBPOSIX_FDTAB_MAXFDS))
+				return -EPERM;
+			rc = uk_fdtab_set_limit(new_limit->rlim_cur);
+			if (unlikely(rc))
+				return rc;
+			break;
+#endif /* CONFIG_LIBPOSIX_FDTAB */
 		default:
 			uk_pr_err("Ignore updating resource %u: cur = %llu, max = %llu\n",
 				  resource,
@@ -368,7 +388,12 @@ UK_LLSYSCALL_R_DEFINE(int, prlimit64, int, pid, unsigned int, resource,
 		old_limit->rlim_max = RLIM_INFINITY;
 		break;
 
-#if CONFIG_LIBVFSCORE
+#if CONFIG_LIBPOSIX_FDTAB
+	case RLIMIT_NOFILE:
+		old_limit->rlim_cur = old_nofile;
+		old_limit->rlim_max = CONFIG_LIBPOSIX_FDTAB_MAXFDS;
+		break;
+#elif CONFIG_LIBVFSCORE
 	case RLIMIT_NOFILE:
 		old_limit->rlim_cur = FDTABLE_MAX_FILES;
 		old_limit->rlim_max = FDTABLE_MAX_FILES;
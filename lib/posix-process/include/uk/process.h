@@ -37,6 +37,7 @@
 #include <arch/clone.h>
 #include <uk/config.h>
 #include <stdbool.h>
+#include <sys/types.h>
 #if CONFIG_LIBUKSCHED
 #include <uk/thread.h>
 #endif
@@ -138,6 +139,20 @@ int uk_posix_process_create(struct uk_alloc *a,
 void uk_posix_process_kill(struct uk_thread *thread);
 #endif /* CONFIG_LIBUKSCHED */
 
+#if CONFIG_LIBPOSIX_PROCESS_PIDS
+/**
+ * Looks up a thread by its thread ID
+ *
+ * @param tid
+ *   Thread ID
+ * @param pid
+ *   If not NULL, receives the ID of the process of the thread
+ * @return
+ *   The thread, or NULL if no thread has the ID
+ */
+struct uk_thread *uk_posix_process_thread_get(pid_t tid, pid_t *pid);
+#endif /* CONFIG_LIBPOSIX_PROCESS_PIDS */
+
 #if CONFIG_LIBPOSIX_PROCESS_CLONE
 typedef int  (*uk_posix_clone_init_func_t)(const struct clone_args *cl_args,
 					   size_t cl_args_len,
@@ -198,6 +213,13 @@ struct uk_posix_clonetab_entry {
 	_UK_POSIX_CLONETAB_ENTRY(flags_mask, presence_only, init_fn, term_fn,  \
 				 UK_PRIO_LATEST)
 
+/**
+ * Resumes the parent of the current thread if it is suspended because the
+ * thread was created with CLONE_VFORK. To be called by execve() once the
+ * thread no longer uses the memory of its parent.
+ */
+void uk_posix_clone_vfork_release(void);
+
 #endif /* CONFIG_LIBPOSIX_PROCESS_CLONE */
 
 #endif /* __UK_PROCESS_H__ */
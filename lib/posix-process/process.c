@@ -51,9 +51,8 @@
 #include <uk/init.h>
 #include <uk/errptr.h>
 #include <uk/essentials.h>
-#if CONFIG_LIBPOSIX_PROCESS_CLONE
 #include <uk/process.h>
-#endif /* CONFIG_LIBPOSIX_PROCESS_CLONE */
+#include <uk/plat/spinlock.h>
 
 #include "process.h"
 
@@ -82,12 +81,40 @@ struct posix_thread {
 };
 
 /**
- * System global lists
+ * System global TID table
+ *
+ * TIDs are grouped into leaves that map a TID to its thread and track which
+ * TIDs of the leaf are in use. A leaf is allocated when a TID of its range is
+ * first assigned, so that memory grows with the number of threads instead of
+ * with CONFIG_LIBPOSIX_PROCESS_MAX_PID. A summed bitmap marks full leaves:
+ * Reserving a TID searches it for the first leaf with a free TID and then the
+ * bitmap of that leaf. Looking up a TID indexes the leaf and its entry.
+ * Leaves are kept once allocated.
  * NOTE: We pre-allocate PID/TID 0 which is reserved by the kernel.
  *       An application should never get PID/TID 0 assigned.
  */
-static struct posix_thread *tid_thread[TIDMAP_SIZE];
-static unsigned long tid_map[UK_BITS_TO_LONGS(TIDMAP_SIZE)] = { [0] = 0x01UL };
+#define TID_LEAF_SHIFT		9
+#define TID_LEAF_SIZE		(1UL << TID_LEAF_SHIFT)
+#define TID_LEAF_ENTRIES	MIN(TID_LEAF_SIZE, TIDMAP_SIZE)
+#define TID_LEAF_COUNT		DIV_ROUND_UP(TIDMAP_SIZE, TID_LEAF_SIZE)
+
+#define tid_leaf_idx(tid)	((unsigned long)(tid) >> TID_LEAF_SHIFT)
+#define tid_leaf_off(tid)	((unsigned long)(tid) & (TID_LEAF_SIZE - 1))
+#define tid_leaf_base(idx)	((unsigned long)(idx) << TID_LEAF_SHIFT)
+
+struct tid_leaf {
+	struct posix_thread *thread[TID_LEAF_ENTRIES];
+	UK_DECLARE_BITMAP(used, TID_LEAF_ENTRIES);
+	unsigned long nr_used;
+};
+
+static struct tid_leaf *tid_leaves[TID_LEAF_COUNT];
+static UK_DECLARE_BITMAP(tid_leaves_bits, TID_LEAF_COUNT);
+static unsigned long tid_leaves_full[UK_BITMAP_SUM_LONGS(TID_LEAF_COUNT)];
+static struct uk_bitmap_sum tid_leaves_map =
+	UK_BITMAP_SUM_INITIALIZER(TID_LEAF_COUNT, tid_leaves_bits,
+				  tid_leaves_full);
+static __spinlock tid_lock = UKARCH_SPINLOCK_INITIALIZER();
 
 /**
  * Thread-local posix_thread reference
@@ -97,43 +124,141 @@ static __uk_tls struct posix_thread *pthread_self = NULL;
 /**
  * Helpers to find and reserve a `pid_t`
  */
-static inline pid_t find_free_tid(void)
+static inline void tid_leaf_mark(struct tid_leaf *leaf, unsigned long idx,
+				 unsigned long off)
+{
+	__uk_set_bit(off, leaf->used);
+	if (++leaf->nr_used == TID_LEAF_ENTRIES)
+		uk_bitmap_sum_set(&tid_leaves_map, idx);
+}
+
+/* Makes `leaf` the zero-initialized leaf with index `idx` */
+static struct tid_leaf *tid_leaf_install(unsigned long idx,
+					 struct tid_leaf *leaf)
+{
+	unsigned long off;
+
+	/* TID 0 and TIDs beyond the largest PID are never assigned */
+	if (idx == 0)
+		tid_leaf_mark(leaf, idx, 0);
+	for (off = TIDMAP_SIZE - tid_leaf_base(idx);
+	     off < TID_LEAF_ENTRIES; off++)
+		tid_leaf_mark(leaf, idx, off);
+
+	tid_leaves[idx] = leaf;
+	return leaf;
+}
+
+/* Must be called with `tid_lock` held. Returns 0 if the leaf of the next free
+ * TID has to be allocated but `*spare` is NULL. Otherwise `*spare` is consumed
+ * for it.
+ */
+static pid_t find_free_tid(struct tid_leaf **spare)
 {
 	static pid_t prev = 0;
-	unsigned long found;
+	unsigned long tid = prev + 1;
+	unsigned long idx, off;
+	struct tid_leaf *leaf;
+	int wrapped = 0;
+
+	for (;;) {
+		if (tid >= TIDMAP_SIZE) {
+			if (wrapped) {
+				/* no free PID */
+				return -1;
+			}
+			/* search again starting from the beginning */
+			wrapped = 1;
+			tid = 0;
+		}
 
-	/* search starting from last position */
-	found = uk_find_next_zero_bit(tid_map, TIDMAP_SIZE, prev);
-	if (found == TIDMAP_SIZE) {
-		/* search again starting from the beginning */
-		found = uk_find_first_zero_bit(tid_map, TIDMAP_SIZE);
-	}
-	if (found == TIDMAP_SIZE) {
-		/* no free PID */
-		return -1;
-	}
+		/* Skip full leaves */
+		idx = uk_bitmap_sum_find_next_zero(&tid_leaves_map,
+						   tid_leaf_idx(tid));
+		if (idx == TID_LEAF_COUNT) {
+			tid = TIDMAP_SIZE;
+			continue;
+		}
+		if (idx != tid_leaf_idx(tid))
+			tid = tid_leaf_base(idx);
+
+		leaf = tid_leaves[idx];
+		if (!leaf) {
+			if (!*spare)
+				return 0;
+			leaf = tid_leaf_install(idx, *spare);
+			*spare = NULL;
+		}
+
+		off = uk_find_next_zero_bit(leaf->used, TID_LEAF_ENTRIES,
+					    tid_leaf_off(tid));
+		if (off < TID_LEAF_ENTRIES) {
+			prev = tid_leaf_base(idx) + off;
+			return prev;
+		}
 
-	prev = found;
-	return found;
+		/* The free TIDs of this leaf are below the search start */
+		tid = tid_leaf_base(idx + 1);
+	}
 }
 
-static pid_t find_and_reserve_tid(void)
+static pid_t find_and_reserve_tid(struct uk_alloc *a)
 {
+	struct tid_leaf *spare = NULL;
+	unsigned long flags;
 	pid_t tid;
 
-	/* TODO: Mutex */
-	tid = find_free_tid();
-	if (tid > 0)
-		uk_set_bit(tid, tid_map);
+	for (;;) {
+		ukplat_spin_lock_irqsave(&tid_lock, flags);
+		tid = find_free_tid(&spare);
+		if (tid > 0)
+			tid_leaf_mark(tid_leaves[tid_leaf_idx(tid)],
+				      tid_leaf_idx(tid), tid_leaf_off(tid));
+		ukplat_spin_unlock_irqrestore(&tid_lock, flags);
+		if (tid != 0)
+			break;
+
+		/* Allocate the leaf outside of the lock and retry */
+		spare = uk_zalloc(a, sizeof(*spare));
+		if (!spare)
+			return -1;
+	}
+
+	/* Another thread may have installed the leaf in the meantime */
+	if (spare)
+		uk_free(a, spare);
 	return tid;
 }
 
 static void release_tid(pid_t tid)
 {
+	struct tid_leaf *leaf;
+	unsigned long flags;
+
 	UK_ASSERT(tid > 0 && tid <= CONFIG_LIBPOSIX_PROCESS_MAX_PID);
 
-	/* TODO: Mutex */
-	uk_clear_bit(tid, tid_map);
+	ukplat_spin_lock_irqsave(&tid_lock, flags);
+	leaf = tid_leaves[tid_leaf_idx(tid)];
+	UK_ASSERT(leaf);
+	UK_ASSERT(uk_test_bit(tid_leaf_off(tid), leaf->used));
+
+	leaf->thread[tid_leaf_off(tid)] = NULL;
+	__uk_clear_bit(tid_leaf_off(tid), leaf->used);
+	leaf->nr_used--;
+	uk_bitmap_sum_clear(&tid_leaves_map, tid_leaf_idx(tid));
+	ukplat_spin_unlock_irqrestore(&tid_lock, flags);
+}
+
+static inline struct posix_thread **tid_slot(pid_t tid)
+{
+	struct tid_leaf *leaf;
+
+	if (tid > CONFIG_LIBPOSIX_PROCESS_MAX_PID || tid < 0)
+		return NULL;
+	leaf = tid_leaves[tid_leaf_idx(tid)];
+	if (!leaf)
+		return NULL;
+	return &leaf->thread[tid_leaf_off(tid)];
 }
 
 /* Allocate a thread for a process */
@@ -151,7 +276,7 @@ static struct posix_thread *pprocess_create_pthread(
 	/* Take allocator from process */
 	a = pprocess->_a;
 
-	tid = find_and_reserve_tid();
+	tid = find_and_reserve_tid(a);
 	if (tid < 0) {
 		err = EAGAIN;
 		goto err_out;
@@ -170,7 +295,7 @@ static struct posix_thread *pprocess_create_pthread(
 	uk_list_add_tail(&pthread->thread_list_entry, &pprocess->threads);
 
 	/* Store reference to pthread with TID */
-	tid_thread[tid] = pthread;
+	*tid_slot(tid) = pthread;
 
 	uk_pr_debug("Process PID %d: New thread TID %d\n",
 		    (int) pprocess->pid, (int) pthread->tid);
@@ -196,7 +321,6 @@ static void pprocess_release_pthread(struct posix_thread *pthread)
 
 	/* release TID */
 	release_tid(pthread->tid);
-	tid_thread[pthread->tid] = NULL;
 
 	/* release memory */
 	uk_free(pthread->_a, pthread);
@@ -461,9 +585,10 @@ UK_THREAD_INIT_PRIO(posix_thread_init, posix_thread_fini, UK_PRIO_EARLIEST);
 
 static inline struct posix_thread *tid2pthread(pid_t tid)
 {
-	if (tid >= CONFIG_LIBPOSIX_PROCESS_MAX_PID || tid < 0)
-		return NULL;
-	return tid_thread[tid];
+	struct posix_thread **slot;
+
+	slot = tid_slot(tid);
+	return slot ? *slot : NULL;
 }
 
 static inline struct posix_process *tid2pprocess(pid_t tid)
@@ -488,6 +613,20 @@ struct uk_thread *tid2ukthread(pid_t tid)
 	return pthread->thread;
 }
 
+struct uk_thread *uk_posix_process_thread_get(pid_t tid, pid_t *pid)
+{
+	struct posix_thread *pthread;
+
+	pthread = tid2pthread(tid);
+	if (!pthread)
+		return NULL;
+
+	UK_ASSERT(pthread->process);
+	if (pid)
+		*pid = pthread->process->pid;
+	return pthread->thread;
+}
+
 pid_t ukthread2tid(struct uk_thread *thread)
 {
 	struct posix_thread *pthread;
@@ -620,14 +759,26 @@ static int pprocess_child_settid(const struct clone_args *cl_args,
 }
 UK_POSIX_CLONE_HANDLER(CLONE_CHILD_SETTID, true, pprocess_child_settid, 0x0);
 
-static int pprocess_clone_thread(const struct clone_args *cl_args __unused,
+/* Without CLONE_THREAD, the child becomes the first thread of a new process
+ * (e.g., vfork). The child shares the address space with its parent because
+ * only CLONE_VM is supported.
+ */
+static int pprocess_clone_thread(const struct clone_args *cl_args,
 				 size_t cl_args_len __unused,
-				 struct uk_thread *child __unused,
-				 struct uk_thread *parent __unused)
+				 struct uk_thread *child,
+				 struct uk_thread *parent)
 {
-	UK_WARN_STUBBED();
+	struct posix_thread *parent_pthread;
 
-	return 0;
+	if (cl_args->flags & CLONE_THREAD)
+		return 0;
+
+	parent_pthread = uk_thread_uktls_var(parent, pthread_self);
+	if (unlikely(!parent_pthread))
+		return 0;
+
+	return uk_posix_process_create(parent_pthread->process->_a,
+				       child, parent);
 }
 UK_POSIX_CLONE_HANDLER(CLONE_THREAD, false, pprocess_clone_thread, 0x0);
 #endif /* CONFIG_LIBPOSIX_PROCESS_CLONE */
@@ -0,0 +1,224 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * Scheduling policies of threads, mapped to the policies of uksched
+ */
+#include <errno.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/types.h>
+#include <uk/arch/time.h>
+#include <uk/sched.h>
+#include <uk/syscall.h>
+
+#include "process.h"
+
+#ifndef SCHED_OTHER
+#define SCHED_OTHER		0
+#define SCHED_FIFO		1
+#define SCHED_RR		2
+#endif /* !SCHED_OTHER */
+#ifndef SCHED_BATCH
+#define SCHED_BATCH		3
+#endif /* !SCHED_BATCH */
+#ifndef SCHED_IDLE
+#define SCHED_IDLE		5
+#endif /* !SCHED_IDLE */
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE		6
+#endif /* !SCHED_DEADLINE */
+#ifndef SCHED_RESET_ON_FORK
+#define SCHED_RESET_ON_FORK	0x40000000
+#endif /* !SCHED_RESET_ON_FORK */
+
+/* Layout of `struct sched_attr` of Linux, which libcs do not provide */
+struct pprocess_sched_attr {
+	__u32 size;
+	__u32 sched_policy;
+	__u64 sched_flags;
+	__s32 sched_nice;
+	__u32 sched_priority;
+	__u64 sched_runtime;
+	__u64 sched_deadline;
+	__u64 sched_period;
+};
+
+#define PPROCESS_SCHED_ATTR_SIZE_VER0	48
+
+static struct uk_thread *pprocess_sched_thread(pid_t pid)
+{
+	if (pid < 0)
+		return NULL;
+	if (pid == 0)
+		return uk_thread_current();
+	return tid2ukthread(pid);
+}
+
+/* Maps a policy of Linux to one of uksched */
+static int pprocess_sched_policy(int policy)
+{
+	switch (policy & ~SCHED_RESET_ON_FORK) {
+	case SCHED_OTHER:
+	case SCHED_BATCH:
+	case SCHED_IDLE:
+		return UK_SCHED_POLICY_NORMAL;
+	case SCHED_FIFO:
+		return UK_SCHED_POLICY_FIFO;
+	case SCHED_RR:
+		return UK_SCHED_POLICY_RR;
+	case SCHED_DEADLINE:
+		return UK_SCHED_POLICY_DEADLINE;
+	default:
+		return -EINVAL;
+	}
+}
+
+UK_SYSCALL_R_DEFINE(int, sched_setscheduler, pid_t, pid, int, policy,
+		    const struct sched_param *, param)
+{
+	struct uk_thread *t;
+	int uk_policy;
+
+	if (unlikely(!param))
+		return -EINVAL;
+
+	uk_policy = pprocess_sched_policy(policy);
+	if (unlikely(uk_policy < 0 ||
+		     uk_policy == UK_SCHED_POLICY_DEADLINE))
+		return -EINVAL; /* Deadlines need sched_setattr() */
+
+	t = pprocess_sched_thread(pid);
+	if (unlikely(!t))
+		return -ESRCH;
+
+	return uk_sched_thread_set_policy(t, uk_policy,
+					  param->sched_priority, 0);
+}
+
+UK_SYSCALL_R_DEFINE(int, sched_getscheduler, pid_t, pid)
+{
+	struct uk_thread *t;
+
+	t = pprocess_sched_thread(pid);
+	if (unlikely(!t))
+		return -ESRCH;
+
+	/* The policies of uksched have the values of Linux */
+	return t->policy;
+}
+
+UK_SYSCALL_R_DEFINE(int, sched_setparam, pid_t, pid,
+		    const struct sched_param *, param)
+{
+	struct uk_thread *t;
+
+	if (unlikely(!param))
+		return -EINVAL;
+
+	t = pprocess_sched_thread(pid);
+	if (unlikely(!t))
+		return -ESRCH;
+
+	return uk_sched_thread_set_policy(t, t->policy,
+					  param->sched_priority,
+					  t->rel_deadline);
+}
+
+UK_SYSCALL_R_DEFINE(int, sched_getparam, pid_t, pid,
+		    struct sched_param *, param)
+{
+	struct uk_thread *t;
+
+	if (unlikely(!param))
+		return -EINVAL;
+
+	t = pprocess_sched_thread(pid);
+	if (unlikely(!t))
+		return -ESRCH;
+
+	memset(param, 0, sizeof(*param));
+	param->sched_priority = t->prio;
+	return 0;
+}
+
+UK_SYSCALL_R_DEFINE(int, sched_get_priority_max, int, policy)
+{
+	switch (pprocess_sched_policy(policy)) {
+	case UK_SCHED_POLICY_FIFO:
+	case UK_SCHED_POLICY_RR:
+		return UK_SCHED_PRIO_MAX;
+	case UK_SCHED_POLICY_NORMAL:
+	case UK_SCHED_POLICY_DEADLINE:
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+UK_SYSCALL_R_DEFINE(int, sched_get_priority_min, int, policy)
+{
+	switch (pprocess_sched_policy(policy)) {
+	case UK_SCHED_POLICY_FIFO:
+	case UK_SCHED_POLICY_RR:
+		return UK_SCHED_PRIO_MIN;
+	case UK_SCHED_POLICY_NORMAL:
+	case UK_SCHED_POLICY_DEADLINE:
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+/* The deadline policy of uksched is EDF without runtime budgets, so the
+ * runtime and period of the attributes are ignored.
+ */
+UK_LLSYSCALL_R_DEFINE(int, sched_setattr, pid_t, pid,
+		      struct pprocess_sched_attr *, attr,
+		      unsigned int, flags)
+{
+	struct uk_thread *t;
+	int uk_policy;
+
+	if (unlikely(!attr || flags ||
+		     attr->size < PPROCESS_SCHED_ATTR_SIZE_VER0))
+		return -EINVAL;
+
+	uk_policy = pprocess_sched_policy(attr->sched_policy);
+	if (unlikely(uk_policy < 0))
+		return -EINVAL;
+
+	t = pprocess_sched_thread(pid);
+	if (unlikely(!t))
+		return -ESRCH;
+
+	return uk_sched_thread_set_policy(t, uk_policy,
+					  (int)attr->sched_priority,
+					  uk_policy == UK_SCHED_POLICY_DEADLINE
+					  ? attr->sched_deadline : 0);
+}
+
+UK_LLSYSCALL_R_DEFINE(int, sched_getattr, pid_t, pid,
+		      struct pprocess_sched_attr *, attr,
+		      unsigned int, size, unsigned int, flags)
+{
+	struct uk_thread *t;
+
+	if (unlikely(!attr || flags || size < PPROCESS_SCHED_ATTR_SIZE_VER0))
+		return -EINVAL;
+
+	t = pprocess_sched_thread(pid);
+	if (unlikely(!t))
+		return -ESRCH;
+
+	memset(attr, 0, PPROCESS_SCHED_ATTR_SIZE_VER0);
+	attr->size = PPROCESS_SCHED_ATTR_SIZE_VER0;
+	attr->sched_policy = t->policy;
+	attr->sched_priority = t->prio;
+	attr->sched_deadline = t->rel_deadline;
+	attr->sched_period = t->rel_deadline;
+	return 0;
+}
@@ -54,11 +54,17 @@ posix_socket_family_count(void)
 	return POSIX_SOCKET_DRIVER_COUNT;
 }
 
+/* Drivers by address family, filled on initialization */
+static struct posix_socket_driver *posix_socket_drivers[AF_MAX];
+
 struct posix_socket_driver *
 posix_socket_driver_get(int family)
 {
 	struct posix_socket_driver *d = posix_socket_driver_list_start;
 
+	if (likely(family >= 0 && family < AF_MAX))
+		return posix_socket_drivers[family];
+
 	while (d != posix_socket_driver_list_end) {
 		if (d->family == family)
 			return d;
@@ -93,9 +99,18 @@ posix_socket_family_init(struct posix_socket_driver *d)
 static int
 posix_socket_family_lib_init(struct uk_init_ctx *ictx __unused)
 {
-	struct posix_socket_driver *d = posix_socket_driver_list_start;
+	struct posix_socket_driver *d;
 	unsigned int ret = 0;
 
+	for (d = posix_socket_driver_list_start;
+	     d != posix_socket_driver_list_end; d++) {
+		if (d->family < 0 || d->family >= AF_MAX)
+			continue;
+		if (!posix_socket_drivers[d->family])
+			posix_socket_drivers[d->family] = d;
+	}
+
+	d = posix_socket_driver_list_start;
 	while (d != posix_socket_driver_list_end) {
 		/* Ensure that there are not two drivers that want to register
 		 * the same address family. Since this would violate the API,
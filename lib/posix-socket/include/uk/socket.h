@@ -40,15 +40,77 @@
 #ifndef __UK_SOCKET__
 #define __UK_SOCKET__
 
+#include <uk/config.h>
+#include <stddef.h>
+#if CONFIG_LIBPOSIX_SOCKET_ZEROCOPY
+#include <uk/arch/spinlock.h>
+#include <uk/arch/types.h>
+#endif /* CONFIG_LIBPOSIX_SOCKET_ZEROCOPY */
+
 struct posix_socket_driver;
+struct posix_sock_zc;
 
 struct posix_socket_node {
 	/** The fd or data used internally by the socket implementation */
 	void *sock_data;
 	/** The driver to use for this socket */
 	struct posix_socket_driver *driver;
+	/** Busy poll time in microseconds (SO_BUSY_POLL), 0 if disabled */
+	unsigned int busy_poll;
+	/** SO_PREFER_BUSY_POLL */
+	int prefer_busy_poll;
+#if CONFIG_LIBPOSIX_SOCKET_ZEROCOPY
+	/** SO_ZEROCOPY */
+	int zerocopy;
+	/** ID of the next zero-copy send */
+	__u32 zc_next;
+	/** Completed zero-copy sends, read with MSG_ERRQUEUE */
+	struct posix_sock_zc *zc_head;
+	struct posix_sock_zc *zc_tail;
+	__spinlock zc_lock;
+#endif /* CONFIG_LIBPOSIX_SOCKET_ZEROCOPY */
+};
+
+/**
+ * Received data that a socket driver lends to the application with
+ * uk_socket_recv_zc(). The application returns it with
+ * uk_socket_recv_zc_release() on the same socket.
+ */
+struct uk_socket_rxbuf {
+	void *base;
+	size_t len;
+	/** Owned by the socket driver, e.g., the netbuf holding the data */
+	void *cookie;
 };
 
+#if CONFIG_LIBPOSIX_SOCKET_ZEROCOPY
+/**
+ * Receives without copying: Fills `bufs` with references to received data
+ * that stays owned by the socket driver. Blocks like recvmsg() unless the
+ * socket is non-blocking.
+ *
+ * @param fd Socket file descriptor
+ * @param bufs Array of buffer descriptors to fill
+ * @param cnt Number of descriptors in bufs, at least 1
+ * @param flags Bitwise OR of zero or more MSG_* flags
+ *
+ * @return The number of filled descriptors, 0 on end of stream, -errno
+ *    otherwise (-EOPNOTSUPP if the socket driver does not support it)
+ */
+int uk_socket_recv_zc(int fd, struct uk_socket_rxbuf *bufs,
+		      unsigned int cnt, int flags);
+
+/**
+ * Returns buffers that were received with uk_socket_recv_zc(). The data must
+ * not be accessed anymore afterwards. Buffers that are not returned before
+ * the socket is closed are released by the socket driver.
+ *
+ * @return 0 on success, -errno otherwise
+ */
+int uk_socket_recv_zc_release(int fd, struct uk_socket_rxbuf *bufs,
+			      unsigned int cnt);
+#endif /* CONFIG_LIBPOSIX_SOCKET_ZEROCOPY */
+
 #ifdef CONFIG_LIBPOSIX_SOCKET_PRINT_ERRORS
 #include <uk/print.h>
 #define PSOCKET_ERR(msg, ...) uk_pr_err(msg, ##__VA_ARGS__)
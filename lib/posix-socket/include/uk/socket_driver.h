@@ -156,6 +156,55 @@ void posix_sock_event_assign(posix_sock *sock, unsigned int events)
 	uk_file_event_assign(sock, events);
 }
 
+#if CONFIG_LIBPOSIX_SOCKET_ZEROCOPY
+/*
+ * Zero-copy send
+ *
+ * Each send with MSG_ZEROCOPY gets a completion handle. Once the driver has
+ * released all its references to the handle, a notification for the send is
+ * queued on the socket's error queue. The application reads it with
+ * recvmsg(MSG_ERRQUEUE), after which it may reuse the buffers of the send.
+ */
+
+/**
+ * Takes a reference to a completion handle, e.g., for a buffer in flight.
+ * Only valid during sendmsg_zc or while holding another reference.
+ */
+void posix_sock_zc_get(struct posix_sock_zc *zc);
+
+/**
+ * Releases a reference to a completion handle. Releasing the last one
+ * queues the notification. Does not need the socket lock.
+ */
+void posix_sock_zc_put(struct posix_sock_zc *zc);
+
+/**
+ * Reports that the data of the send was copied after all, e.g., because it
+ * was too small to be worth it. The notification then tells the application
+ * that zero-copy sends of this kind do not pay off.
+ */
+void posix_sock_zc_copied(struct posix_sock_zc *zc);
+
+#if CONFIG_LIBUKNETDEV
+struct uk_netbuf;
+
+/**
+ * Allocates a netbuf that refers to `len` bytes at `data` as its external
+ * buffer and holds a reference to `zc` until it is freed.
+ *
+ * @param zc Completion handle of the send
+ * @param a Allocator for the netbuf metadata
+ * @param data Message data
+ * @param len Length of the message data
+ *
+ * @return Netbuf with `len` bytes of data, or NULL on allocation failure
+ */
+struct uk_netbuf *posix_sock_zc_netbuf(struct posix_sock_zc *zc,
+				       struct uk_alloc *a,
+				       void *data, size_t len);
+#endif /* CONFIG_LIBUKNETDEV */
+#endif /* CONFIG_LIBPOSIX_SOCKET_ZEROCOPY */
+
 /* Socket operations */
 
 /**
@@ -347,6 +396,83 @@ typedef ssize_t (*posix_socket_recvmsg_func_t)(posix_sock *sock,
 typedef ssize_t (*posix_socket_sendmsg_func_t)(posix_sock *sock,
 		const struct msghdr *msg, int flags);
 
+struct mmsghdr;
+
+/**
+ * Optional: Receive a batch of messages from a socket. Drivers without this
+ * operation are called through recvmsg for each message.
+ *
+ * @param sock Reference to the socket
+ * @param msgvec Array of messages, msg_len is set for each received one
+ * @param vlen Number of messages in msgvec, at least 1
+ * @param flags Bitwise OR of zero or more flags for the socket
+ *
+ * @return The number of messages received if at least one was, -errno
+ *    otherwise (-EAGAIN if none was available)
+ */
+typedef int (*posix_socket_recvmmsg_func_t)(posix_sock *sock,
+		struct mmsghdr *msgvec, unsigned int vlen, int flags);
+
+/**
+ * Optional: Send a batch of messages on a socket. Drivers without this
+ * operation are called through sendmsg for each message.
+ *
+ * @param sock Reference to the socket
+ * @param msgvec Array of messages, msg_len is set for each sent one
+ * @param vlen Number of messages in msgvec, at least 1
+ * @param flags Bitwise OR of zero or more flags for the socket
+ *
+ * @return The number of messages sent if at least one was, -errno otherwise
+ */
+typedef int (*posix_socket_sendmmsg_func_t)(posix_sock *sock,
+		struct mmsghdr *msgvec, unsigned int vlen, int flags);
+
+/**
+ * Optional: Send a message without copying its data (MSG_ZEROCOPY). Only
+ * called for sockets with SO_ZEROCOPY set, and serialized per socket. The
+ * driver may keep referring to the message buffers, e.g., as external
+ * buffers of netbufs, for as long as it holds references to `zc`, taken with
+ * posix_sock_zc_get(). If it keeps no reference, the data counts as copied.
+ *
+ * @param sock Reference to the socket
+ * @param msg Message structure to minimize the number of directly supplied
+ *    arguments
+ * @param flags Bitwise OR of zero or more flags for the socket
+ * @param zc Completion handle of this send
+ *
+ * @return The number of bytes sent on success, -errno otherwise
+ */
+typedef ssize_t (*posix_socket_sendmsg_zc_func_t)(posix_sock *sock,
+		const struct msghdr *msg, int flags, struct posix_sock_zc *zc);
+
+struct uk_socket_rxbuf;
+
+/**
+ * Optional: Receive without copying. The driver lends buffers of received
+ * data to the caller until they are returned with recv_zc_release, or the
+ * socket is closed.
+ *
+ * @param sock Reference to the socket
+ * @param bufs Array of buffer descriptors to fill
+ * @param cnt Number of descriptors in bufs, at least 1
+ * @param flags Bitwise OR of zero or more flags for the socket
+ *
+ * @return The number of filled descriptors, 0 on end of stream, -errno
+ *    otherwise (-EAGAIN if no data was available)
+ */
+typedef int (*posix_socket_recv_zc_func_t)(posix_sock *sock,
+		struct uk_socket_rxbuf *bufs, unsigned int cnt, int flags);
+
+/**
+ * Optional, required with recv_zc: Return buffers lent by recv_zc.
+ *
+ * @param sock Reference to the socket
+ * @param bufs Array of buffer descriptors filled by recv_zc
+ * @param cnt Number of descriptors in bufs
+ */
+typedef void (*posix_socket_recv_zc_release_func_t)(posix_sock *sock,
+		struct uk_socket_rxbuf *bufs, unsigned int cnt);
+
 /**
  * Send a message on a socket.
  *
@@ -445,6 +571,22 @@ typedef int (*posix_socket_ioctl_func_t)(posix_sock *sock,
  */
 typedef void (*posix_socket_poll_func_t)(posix_sock *sock);
 
+/**
+ * Optional: Make one pass over the receive path feeding the socket without
+ * waiting, e.g., by calling uk_netdev_rx_one() on the receive queue the
+ * socket's traffic arrives on and processing what was received. Used to
+ * busy poll sockets with SO_BUSY_POLL set, instead of waiting for the queue
+ * interrupt. Called without the socket lock held.
+ *
+ * @param sock Reference to the socket
+ * @param prefer Nonzero if SO_PREFER_BUSY_POLL is set on the socket; the
+ *    driver may then keep the queue interrupt disabled while it is polled
+ *
+ * @return The number of packets processed, -errno if the socket cannot be
+ *    busy polled
+ */
+typedef int (*posix_socket_busy_poll_func_t)(posix_sock *sock, int prefer);
+
 /**
  * A structure containing the functions exported by a Unikraft socket driver
  */
@@ -466,6 +608,11 @@ struct posix_socket_ops {
 	posix_socket_recvmsg_func_t	recvmsg;
 	posix_socket_sendmsg_func_t	sendmsg;
 	posix_socket_sendto_func_t	sendto;
+	posix_socket_recvmmsg_func_t	recvmmsg;	/* optional */
+	posix_socket_sendmmsg_func_t	sendmmsg;	/* optional */
+	posix_socket_sendmsg_zc_func_t	sendmsg_zc;	/* optional */
+	posix_socket_recv_zc_func_t	recv_zc;	/* optional */
+	posix_socket_recv_zc_release_func_t	recv_zc_release;
 	posix_socket_socketpair_func_t	socketpair;
 	posix_socket_socketpair_post_func_t	socketpair_post;
 	/* file ops */
@@ -474,6 +621,7 @@ struct posix_socket_ops {
 	posix_socket_close_func_t	close;
 	posix_socket_ioctl_func_t	ioctl;
 	posix_socket_poll_func_t	poll;
+	posix_socket_busy_poll_func_t	busy_poll;	/* optional */
 };
 
 static inline void *
@@ -51,7 +51,24 @@
 #include <uk/trace.h>
 #include <uk/syscall.h>
 #include <uk/essentials.h>
+#include <uk/atomic.h>
+#include <uk/arch/time.h>
+#include <uk/plat/time.h>
 #include <errno.h>
+#include <limits.h>
+#if CONFIG_LIBPOSIX_SOCKET_POOL
+#include <uk/allocpool.h>
+#include <uk/init.h>
+#endif /* CONFIG_LIBPOSIX_SOCKET_POOL */
+#if CONFIG_LIBPOSIX_SOCKET_ZEROCOPY
+#include <netinet/in.h>
+#include <string.h>
+#include <uk/plat/spinlock.h>
+#include <uk/refcount.h>
+#if CONFIG_LIBUKNETDEV
+#include <uk/netbuf.h>
+#endif /* CONFIG_LIBUKNETDEV */
+#endif /* CONFIG_LIBPOSIX_SOCKET_ZEROCOPY */
 
 #include "events.h"
 
@@ -63,6 +80,10 @@ static const char POSIX_SOCKET_VOLID[] = "posix_socket_vol";
 #define _ERR_BLOCK(r) ((r) == -EAGAIN || (r) == -EWOULDBLOCK)
 #define _SHOULD_BLOCK(m) !((m) & O_NONBLOCK)
 
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif /* !SO_PREFER_BUSY_POLL */
+
 struct socket_alloc {
 	struct uk_file f;
 	uk_file_refcnt fref;
@@ -71,8 +92,88 @@ struct socket_alloc {
 #if CONFIG_LIBPOSIX_SOCKET_EVENTS
 	struct uk_socket_event_data evd;
 #endif /* CONFIG_LIBPOSIX_SOCKET_EVENTS */
+#if CONFIG_LIBPOSIX_SOCKET_POOL
+	/* Pool the object was taken from, NULL if it was allocated */
+	struct uk_allocpool *pool;
+#endif /* CONFIG_LIBPOSIX_SOCKET_POOL */
 };
 
+#if CONFIG_LIBPOSIX_SOCKET_POOL
+/* Preallocated socket objects per address family */
+static struct uk_allocpool *socket_pools[AF_MAX];
+
+static int socket_pools_init(struct uk_init_ctx *ictx __unused)
+{
+	struct posix_socket_driver *d;
+	int family;
+
+	for (family = 0; family < AF_MAX; family++) {
+		d = posix_socket_driver_get(family);
+		if (!d)
+			continue;
+
+		socket_pools[family] = uk_allocpool_alloc(d->allocator,
+					CONFIG_LIBPOSIX_SOCKET_POOL_SIZE,
+					sizeof(struct socket_alloc),
+					__alignof__(struct socket_alloc));
+		if (unlikely(!socket_pools[family]))
+			uk_pr_warn("Could not preallocate sockets of family %d\n",
+				   family);
+	}
+	return 0;
+}
+
+/* After the drivers got their allocators assigned, which happens at
+ * POSIX_SOCKET_FAMILY_INIT_PRIO (see driver.c)
+ */
+#define POSIX_SOCKET_POOL_INIT_CLASS UK_INIT_CLASS_EARLY
+#define POSIX_SOCKET_POOL_INIT_PRIO 1
+
+uk_initcall_class_prio(socket_pools_init, 0x0,
+		       POSIX_SOCKET_POOL_INIT_CLASS,
+		       POSIX_SOCKET_POOL_INIT_PRIO);
+#endif /* CONFIG_LIBPOSIX_SOCKET_POOL */
+
+static struct socket_alloc *socket_alloc(struct posix_socket_driver *d)
+{
+	struct socket_alloc *al;
+
+#if CONFIG_LIBPOSIX_SOCKET_POOL
+	struct uk_allocpool *pool = NULL;
+
+	if (likely(d->family >= 0 && d->family < AF_MAX))
+		pool = socket_pools[d->family];
+	if (likely(pool)) {
+		al = uk_allocpool_take(pool);
+		if (likely(al)) {
+			al->pool = pool;
+			return al;
+		}
+	}
+#endif /* CONFIG_LIBPOSIX_SOCKET_POOL */
+
+	al = uk_malloc(d->allocator, sizeof(*al));
+#if CONFIG_LIBPOSIX_SOCKET_POOL
+	if (likely(al))
+		al->pool = NULL;
+#endif /* CONFIG_LIBPOSIX_SOCKET_POOL */
+	return al;
+}
+
+static void socket_free(struct posix_socket_driver *d, struct socket_alloc *al)
+{
+	if (!al)
+		return;
+
+#if CONFIG_LIBPOSIX_SOCKET_POOL
+	if (al->pool) {
+		uk_allocpool_return(al->pool, al);
+		return;
+	}
+#endif /* CONFIG_LIBPOSIX_SOCKET_POOL */
+	uk_free(d->allocator, al);
+}
+
 
 static struct uk_ofile *socketfd_get(int fd)
 {
@@ -88,6 +189,413 @@ static struct uk_ofile *socketfd_get(int fd)
 }
 
 
+/*
+ * Busy polling
+ *
+ * With SO_BUSY_POLL set, blocking receives first spin on the driver's receive
+ * path for up to the configured time before going to sleep, trading CPU time
+ * for the latency of interrupt delivery and thread wakeup.
+ */
+
+/* One pass over the receive path; returns the busy poll time, or 0 */
+static unsigned int socket_busy_poll_once(const struct uk_file *sock, int poll)
+{
+	struct posix_socket_node *n = (struct posix_socket_node *)sock->node;
+	unsigned int usec;
+
+	uk_file_rlock(sock);
+	/* Cleared under the write lock when the socket is closed */
+	usec = n->busy_poll;
+	if (usec && poll &&
+	    n->driver->ops->busy_poll(sock, n->prefer_busy_poll) < 0)
+		usec = 0;
+	uk_file_runlock(sock);
+	return usec;
+}
+
+/* Wait for incoming data or connections, busy polling first if enabled */
+static void socket_wait_in(const struct uk_file *sock)
+{
+	unsigned int usec;
+	__nsec until;
+
+	usec = socket_busy_poll_once(sock, 0);
+	if (usec) {
+		until = ukplat_monotonic_clock() +
+			ukarch_time_usec_to_nsec((__nsec)usec);
+		do {
+			if (!socket_busy_poll_once(sock, 1))
+				break;
+			if (uk_file_poll_immediate(sock, UKFD_POLLIN))
+				return;
+		} while (ukplat_monotonic_clock() < until);
+	}
+	(void)uk_file_poll(sock, UKFD_POLLIN);
+}
+
+static int socket_setsockopt_busy_poll(const struct uk_file *sock,
+				       int optname, const void *optval,
+				       socklen_t optlen)
+{
+	struct posix_socket_node *n = (struct posix_socket_node *)sock->node;
+	int val;
+
+	if (unlikely(optlen < sizeof(int)))
+		return -EINVAL;
+	val = *(const int *)optval;
+
+	if (optname == SO_BUSY_POLL) {
+		if (unlikely(val < 0))
+			return -EINVAL;
+		if (!n->driver->ops->busy_poll)
+			return -ENOPROTOOPT;
+		uk_store_n(&n->busy_poll, (unsigned int)val);
+	} else {
+		uk_store_n(&n->prefer_busy_poll, !!val);
+	}
+	return 0;
+}
+
+static int socket_getsockopt_busy_poll(const struct uk_file *sock,
+				       int optname, void *optval,
+				       socklen_t *optlen)
+{
+	struct posix_socket_node *n = (struct posix_socket_node *)sock->node;
+	int val;
+
+	if (unlikely(!optlen || !optval))
+		return -EFAULT;
+	if (unlikely(*optlen < sizeof(int)))
+		return -EINVAL;
+
+	if (optname == SO_BUSY_POLL)
+		val = (int)uk_load_n(&n->busy_poll);
+	else
+		val = uk_load_n(&n->prefer_busy_poll);
+	*(int *)optval = val;
+	*optlen = sizeof(int);
+	return 0;
+}
+
+#define IS_BUSY_POLL_OPT(level, optname) \
+	((level) == SOL_SOCKET && \
+	 ((optname) == SO_BUSY_POLL || (optname) == SO_PREFER_BUSY_POLL))
+
+#if CONFIG_LIBPOSIX_SOCKET_ZEROCOPY
+/*
+ * Zero-copy send
+ *
+ * Sends with MSG_ZEROCOPY on sockets with SO_ZEROCOPY set are numbered in
+ * order. Their completions are queued as ranges of these numbers, which the
+ * application reads from the error queue like on Linux.
+ */
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif /* !SO_ZEROCOPY */
+
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif /* !MSG_ZEROCOPY */
+
+#define SO_EE_ORIGIN_ZEROCOPY		5
+#define SO_EE_CODE_ZEROCOPY_COPIED	1
+
+/* struct sock_extended_err of linux/errqueue.h */
+struct socket_extended_err {
+	__u32 ee_errno;
+	__u8 ee_origin;
+	__u8 ee_type;
+	__u8 ee_code;
+	__u8 ee_pad;
+	__u32 ee_info;
+	__u32 ee_data;
+};
+
+struct posix_sock_zc {
+	const struct uk_file *sock;
+	struct posix_sock_zc *next;
+	__atomic refcnt;
+	/* Range of send IDs */
+	__u32 lo;
+	__u32 hi;
+	int copied;
+};
+
+void posix_sock_zc_get(struct posix_sock_zc *zc)
+{
+	UK_ASSERT(zc);
+	uk_refcount_acquire(&zc->refcnt);
+}
+
+void posix_sock_zc_copied(struct posix_sock_zc *zc)
+{
+	UK_ASSERT(zc);
+	uk_store_n(&zc->copied, 1);
+}
+
+/* Queues the notification, merging it into the last one if they are
+ * consecutive
+ */
+static void socket_zc_complete(struct posix_sock_zc *zc)
+{
+	const struct uk_file *sock = zc->sock;
+	struct posix_socket_node *n = (struct posix_socket_node *)sock->node;
+	struct posix_sock_zc *tail;
+	unsigned long flags;
+
+	ukplat_spin_lock_irqsave(&n->zc_lock, flags);
+	tail = n->zc_tail;
+	if (tail && tail->hi + 1 == zc->lo && tail->copied == zc->copied) {
+		tail->hi = zc->hi;
+	} else {
+		zc->next = NULL;
+		if (tail)
+			tail->next = zc;
+		else
+			n->zc_head = zc;
+		n->zc_tail = zc;
+		zc = NULL;
+	}
+	posix_sock_event_set(sock, EPOLLERR);
+	ukplat_spin_unlock_irqrestore(&n->zc_lock, flags);
+
+	if (zc)
+		uk_free(n->driver->allocator, zc);
+	uk_file_release_weak(sock);
+}
+
+void posix_sock_zc_put(struct posix_sock_zc *zc)
+{
+	UK_ASSERT(zc);
+	if (uk_refcount_release(&zc->refcnt))
+		socket_zc_complete(zc);
+}
+
+#if CONFIG_LIBUKNETDEV
+static void socket_zc_netbuf_dtor(struct uk_netbuf *nb)
+{
+	posix_sock_zc_put(*(struct posix_sock_zc **)nb->priv);
+}
+
+struct uk_netbuf *posix_sock_zc_netbuf(struct posix_sock_zc *zc,
+				       struct uk_alloc *a,
+				       void *data, size_t len)
+{
+	struct uk_netbuf *nb;
+
+	UK_ASSERT(zc);
+
+	nb = uk_netbuf_alloc_indir(a, data, len, 0, sizeof(zc),
+				   socket_zc_netbuf_dtor);
+	if (unlikely(!nb))
+		return NULL;
+
+	nb->len = len;
+	*(struct posix_sock_zc **)nb->priv = zc;
+	posix_sock_zc_get(zc);
+	return nb;
+}
+#endif /* CONFIG_LIBUKNETDEV */
+
+static ssize_t socket_sendmsg_zc(const struct uk_file *sock,
+				 const struct msghdr *msg, int flags)
+{
+	struct posix_socket_node *n = (struct posix_socket_node *)sock->node;
+	struct posix_sock_zc *zc;
+	int inflight;
+	ssize_t ret;
+
+	zc = uk_malloc(n->driver->allocator, sizeof(*zc));
+	if (unlikely(!zc))
+		return -ENOBUFS;
+	zc->sock = sock;
+	zc->next = NULL;
+	zc->copied = 0;
+	uk_refcount_init(&zc->refcnt, 1);
+
+	/* Sends are serialized so that their IDs are in order */
+	uk_file_wlock(sock);
+	zc->lo = n->zc_next;
+	zc->hi = zc->lo;
+	ret = n->driver->ops->sendmsg_zc(sock, msg, flags, zc);
+	inflight = uk_refcount_read(&zc->refcnt) > 1;
+	if (ret >= 0 || inflight) {
+		/* Failed sends only count if buffers are still in flight */
+		n->zc_next++;
+	}
+	uk_file_wunlock(sock);
+
+	if (ret < 0 && !inflight) {
+		uk_free(n->driver->allocator, zc);
+		return ret;
+	}
+
+	/* The driver only takes references while it has one */
+	if (!inflight)
+		zc->copied = 1;
+	uk_file_acquire_weak(sock);
+	posix_sock_zc_put(zc);
+	return ret;
+}
+
+/* Reads a notification from the error queue */
+static ssize_t socket_zc_recverr(const struct uk_file *sock,
+				 struct msghdr *msg)
+{
+	struct posix_socket_node *n = (struct posix_socket_node *)sock->node;
+	struct socket_extended_err ee = { .ee_origin = SO_EE_ORIGIN_ZEROCOPY };
+	struct posix_sock_zc *zc;
+	struct cmsghdr *cmsg;
+	unsigned long flags;
+
+	ukplat_spin_lock_irqsave(&n->zc_lock, flags);
+	zc = n->zc_head;
+	if (zc) {
+		n->zc_head = zc->next;
+		if (!n->zc_head) {
+			n->zc_tail = NULL;
+			posix_sock_event_clear(sock, EPOLLERR);
+		}
+	}
+	ukplat_spin_unlock_irqrestore(&n->zc_lock, flags);
+	if (!zc)
+		return -EAGAIN;
+
+	ee.ee_info = zc->lo;
+	ee.ee_data = zc->hi;
+	if (zc->copied)
+		ee.ee_code = SO_EE_CODE_ZEROCOPY_COPIED;
+	uk_free(n->driver->allocator, zc);
+
+	msg->msg_flags = MSG_ERRQUEUE;
+	if (!msg->msg_control ||
+	    msg->msg_controllen < CMSG_SPACE(sizeof(ee))) {
+		/* The notification is consumed anyway */
+		msg->msg_flags |= MSG_CTRUNC;
+		msg->msg_controllen = 0;
+		return 0;
+	}
+
+	cmsg = CMSG_FIRSTHDR(msg);
+	if (n->driver->family == AF_INET6) {
+		cmsg->cmsg_level = SOL_IPV6;
+		cmsg->cmsg_type = IPV6_RECVERR;
+	} else {
+		cmsg->cmsg_level = SOL_IP;
+		cmsg->cmsg_type = IP_RECVERR;
+	}
+	cmsg->cmsg_len = CMSG_LEN(sizeof(ee));
+	memcpy(CMSG_DATA(cmsg), &ee, sizeof(ee));
+	msg->msg_controllen = CMSG_SPACE(sizeof(ee));
+	return 0;
+}
+
+static void socket_zc_flush(struct posix_socket_node *n)
+{
+	struct posix_sock_zc *zc;
+
+	while ((zc = n->zc_head)) {
+		n->zc_head = zc->next;
+		uk_free(n->driver->allocator, zc);
+	}
+	n->zc_tail = NULL;
+}
+
+static int socket_setsockopt_zerocopy(const struct uk_file *sock,
+				      const void *optval, socklen_t optlen)
+{
+	struct posix_socket_node *n = (struct posix_socket_node *)sock->node;
+
+	if (unlikely(optlen < sizeof(int)))
+		return -EINVAL;
+	if (!n->driver->ops->sendmsg_zc)
+		return -EOPNOTSUPP;
+	uk_store_n(&n->zerocopy, !!*(const int *)optval);
+	return 0;
+}
+
+static int socket_getsockopt_zerocopy(const struct uk_file *sock,
+				      void *optval, socklen_t *optlen)
+{
+	struct posix_socket_node *n = (struct posix_socket_node *)sock->node;
+
+	if (unlikely(!optlen || !optval))
+		return -EFAULT;
+	if (unlikely(*optlen < sizeof(int)))
+		return -EINVAL;
+
+	*(int *)optval = uk_load_n(&n->zerocopy);
+	*optlen = sizeof(int);
+	return 0;
+}
+
+#define IS_ZEROCOPY_OPT(level, optname) \
+	((level) == SOL_SOCKET && (optname) == SO_ZEROCOPY)
+#endif /* CONFIG_LIBPOSIX_SOCKET_ZEROCOPY */
+
+static ssize_t socket_sendmsg(const struct uk_file *sock,
+			      const struct msghdr *msg, int flags)
+{
+	ssize_t ret;
+
+#if CONFIG_LIBPOSIX_SOCKET_ZEROCOPY
+	if (flags & MSG_ZEROCOPY) {
+		struct posix_socket_node *n =
+			(struct posix_socket_node *)sock->node;
+
+		/* Ignored without SO_ZEROCOPY, like on Linux */
+		flags &= ~MSG_ZEROCOPY;
+		if (uk_load_n(&n->zerocopy))
+			return socket_sendmsg_zc(sock, msg, flags);
+	}
+#endif /* CONFIG_LIBPOSIX_SOCKET_ZEROCOPY */
+
+	uk_file_rlock(sock);
+	ret = posix_socket_sendmsg(sock, msg, flags);
+	uk_file_runlock(sock);
+	return ret;
+}
+
+#if CONFIG_LIBPOSIX_SOCKET_ZEROCOPY
+static ssize_t socket_sendto_zc(const struct uk_file *sock,
+				const void *buf, size_t len, int flags,
+				const struct sockaddr *dest_addr,
+				socklen_t addrlen)
+{
+	struct iovec iov = {
+		.iov_base = (void *)buf,
+		.iov_len = len,
+	};
+	struct msghdr msg = {
+		.msg_name = (void *)dest_addr,
+		.msg_namelen = addrlen,
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+	};
+
+	return socket_sendmsg(sock, &msg, flags);
+}
+#endif /* CONFIG_LIBPOSIX_SOCKET_ZEROCOPY */
+
+/* The error queue is never waited on */
+static ssize_t socket_recvmsg_errqueue(const struct uk_file *sock,
+				       struct msghdr *msg, int flags)
+{
+	ssize_t ret;
+
+#if CONFIG_LIBPOSIX_SOCKET_ZEROCOPY
+	ret = socket_zc_recverr(sock, msg);
+	if (ret != -EAGAIN)
+		return ret;
+#endif /* CONFIG_LIBPOSIX_SOCKET_ZEROCOPY */
+
+	uk_file_rlock(sock);
+	ret = posix_socket_recvmsg(sock, msg, flags);
+	uk_file_runlock(sock);
+	return ret;
+}
+
+
 static ssize_t
 socket_read(const struct uk_file *sock,
 	    const struct iovec *iov, int iovcnt,
@@ -157,6 +665,10 @@ socket_ctl(const struct uk_file *sock, int fam, int req,
 	   uintptr_t arg1, uintptr_t arg2 __unused, uintptr_t arg3 __unused)
 {
 	switch (fam) {
+	case UKFILE_CTL_FILE:
+		if (req == UKFILE_CTL_FILE_BUSY_POLL)
+			return socket_busy_poll_once(sock, (int)arg1);
+		return -ENOSYS;
 	case UKFILE_CTL_IOCTL:
 	{
 		int ret;
@@ -206,6 +718,13 @@ static void socket_release(const struct uk_file *sock, int what)
 {
 	UK_ASSERT(sock->vol == POSIX_SOCKET_VOLID);
 	if (what & UK_FILE_RELEASE_RES) {
+		struct posix_socket_node *n =
+			(struct posix_socket_node *)sock->node;
+
+		/* Keep epoll from busy polling a closed socket */
+		uk_file_wlock(sock);
+		n->busy_poll = 0;
+		uk_file_wunlock(sock);
 		posix_socket_close(sock);
 	}
 	if (what & UK_FILE_RELEASE_OBJ) {
@@ -217,7 +736,10 @@ static void socket_release(const struct uk_file *sock, int what)
 		 */
 		if (uk_socket_event_has_raised(&al->evd))
 			uk_socket_event_raise(&al->evd, CLOSE);
-		uk_free(al->node.driver->allocator, al);
+#if CONFIG_LIBPOSIX_SOCKET_ZEROCOPY
+		socket_zc_flush(&al->node);
+#endif /* CONFIG_LIBPOSIX_SOCKET_ZEROCOPY */
+		socket_free(al->node.driver, al);
 	}
 }
 
@@ -227,7 +749,16 @@ static void _socket_init(struct socket_alloc *al,
 {
 	al->node = (struct posix_socket_node){
 		.sock_data = sock_data,
-		.driver = d
+		.driver = d,
+		.busy_poll = 0,
+		.prefer_busy_poll = 0,
+#if CONFIG_LIBPOSIX_SOCKET_ZEROCOPY
+		.zerocopy = 0,
+		.zc_next = 0,
+		.zc_head = NULL,
+		.zc_tail = NULL,
+		.zc_lock = UKARCH_SPINLOCK_INITIALIZER(),
+#endif /* CONFIG_LIBPOSIX_SOCKET_ZEROCOPY */
 	};
 	al->fstate = UK_FILE_STATE_INIT_VALUE(al->fstate);
 	al->fref = UK_FILE_REFCNT_INIT_VALUE;
@@ -252,14 +783,14 @@ struct uk_file *uk_socket_create(int family, int type, int protocol)
 	if (unlikely(!d))
 		return ERR2PTR(-EAFNOSUPPORT);
 
-	al = uk_malloc(d->allocator, sizeof(*al));
+	al = socket_alloc(d);
 	if (unlikely(!al))
 		return ERR2PTR(-ENOMEM);
 
 	sock_data = posix_socket_create(d, family, type, protocol);
 	/* NULL is a valid return value on success */
 	if (unlikely(sock_data && PTRISERR(sock_data))) {
-		uk_free(d->allocator, al);
+		socket_free(d, al);
 		return sock_data;
 	}
 
@@ -321,7 +852,7 @@ int uk_sys_accept(const struct uk_file *sock, int blocking,
 	unsigned int mode = SOCKET_MODE;
 	struct posix_socket_node *n = (struct posix_socket_node *)sock->node;
 
-	al = uk_malloc(n->driver->allocator, sizeof(*al));
+	al = socket_alloc(n->driver);
 	if (unlikely(!al))
 		return -ENOMEM;
 
@@ -332,10 +863,10 @@ int uk_sys_accept(const struct uk_file *sock, int blocking,
 		if (!blocking ||
 		    !PTRISERR(new_data) || !_ERR_BLOCK(PTR2ERR(new_data)))
 			break;
-		(void)uk_file_poll(sock, UKFD_POLLIN);
+		socket_wait_in(sock);
 	}
 	if (unlikely(PTRISERR(new_data))) {
-		uk_free(n->driver->allocator, al);
+		socket_free(n->driver, al);
 		return PTR2ERR(new_data);
 	}
 
@@ -569,9 +1100,19 @@ UK_SYSCALL_R_DEFINE(int, getsockopt, int, sock, int, level, int, optname,
 		goto out;
 	}
 
-	uk_file_rlock(of->file);
-	ret = posix_socket_getsockopt(of->file, level, optname, optval, optlen);
-	uk_file_runlock(of->file);
+	if (IS_BUSY_POLL_OPT(level, optname)) {
+		ret = socket_getsockopt_busy_poll(of->file, optname,
+						  optval, optlen);
+#if CONFIG_LIBPOSIX_SOCKET_ZEROCOPY
+	} else if (IS_ZEROCOPY_OPT(level, optname)) {
+		ret = socket_getsockopt_zerocopy(of->file, optval, optlen);
+#endif /* CONFIG_LIBPOSIX_SOCKET_ZEROCOPY */
+	} else {
+		uk_file_rlock(of->file);
+		ret = posix_socket_getsockopt(of->file, level, optname,
+					      optval, optlen);
+		uk_file_runlock(of->file);
+	}
 	uk_fdtab_ret(of);
 
 out:
@@ -604,9 +1145,19 @@ UK_SYSCALL_R_DEFINE(int, setsockopt, int, sock, int, level, int, optname,
 		goto out;
 	}
 
-	uk_file_rlock(of->file);
-	ret = posix_socket_setsockopt(of->file, level, optname, optval, optlen);
-	uk_file_runlock(of->file);
+	if (IS_BUSY_POLL_OPT(level, optname)) {
+		ret = socket_setsockopt_busy_poll(of->file, optname,
+						  optval, optlen);
+#if CONFIG_LIBPOSIX_SOCKET_ZEROCOPY
+	} else if (IS_ZEROCOPY_OPT(level, optname)) {
+		ret = socket_setsockopt_zerocopy(of->file, optval, optlen);
+#endif /* CONFIG_LIBPOSIX_SOCKET_ZEROCOPY */
+	} else {
+		uk_file_rlock(of->file);
+		ret = posix_socket_setsockopt(of->file, level, optname,
+					      optval, optlen);
+		uk_file_runlock(of->file);
+	}
 	uk_fdtab_ret(of);
 
 out:
@@ -653,6 +1204,8 @@ UK_SYSCALL_R_DEFINE(int, connect, int, sock, const struct sockaddr *, addr,
 		posix_socket_getsockopt(of->file, SOL_SOCKET, SO_ERROR,
 					&ret, &_opsz);
 		uk_file_runlock(of->file);
+		/* SO_ERROR is a positive errno value */
+		ret = -ret;
 	}
 	uk_fdtab_ret(of);
 
@@ -737,7 +1290,7 @@ UK_SYSCALL_R_DEFINE(ssize_t, recvfrom, int, sock, void *, buf, size_t, len,
 		uk_file_runlock(of->file);
 		if (!_SHOULD_BLOCK(mode) || !_ERR_BLOCK(ret))
 			break;
-		(void)uk_file_poll(of->file, UKFD_POLLIN);
+		socket_wait_in(of->file);
 	}
 	uk_fdtab_ret(of);
 
@@ -770,7 +1323,9 @@ UK_SYSCALL_R_DEFINE(ssize_t, recvmsg, int, sock, struct msghdr *, msg,
 
 	trace_posix_socket_recvmsg(sock, msg, flags);
 
-	if (unlikely(!msg || !msg->msg_iov))
+	if (unlikely(!msg))
+		return -EFAULT;
+	if (unlikely(!msg->msg_iov && !(flags & MSG_ERRQUEUE)))
 		return -EFAULT;
 
 	of = socketfd_get(sock);
@@ -779,6 +1334,12 @@ UK_SYSCALL_R_DEFINE(ssize_t, recvmsg, int, sock, struct msghdr *, msg,
 		goto out;
 	}
 
+	if (flags & MSG_ERRQUEUE) {
+		ret = socket_recvmsg_errqueue(of->file, msg, flags);
+		uk_fdtab_ret(of);
+		goto out;
+	}
+
 	mode = of->mode;
 	for (;;) {
 		uk_file_rlock(of->file);
@@ -786,7 +1347,7 @@ UK_SYSCALL_R_DEFINE(ssize_t, recvmsg, int, sock, struct msghdr *, msg,
 		uk_file_runlock(of->file);
 		if (!_SHOULD_BLOCK(mode) || !_ERR_BLOCK(ret))
 			break;
-		(void)uk_file_poll(of->file, UKFD_POLLIN);
+		socket_wait_in(of->file);
 	}
 	uk_fdtab_ret(of);
 
@@ -823,9 +1384,7 @@ UK_SYSCALL_R_DEFINE(ssize_t, sendmsg, int, sock, const struct msghdr *, msg,
 
 	mode = of->mode;
 	for (;;) {
-		uk_file_rlock(of->file);
-		ret = posix_socket_sendmsg(of->file, msg, flags);
-		uk_file_runlock(of->file);
+		ret = socket_sendmsg(of->file, msg, flags);
 		if (!_SHOULD_BLOCK(mode) || !_ERR_BLOCK(ret))
 			break;
 		(void)uk_file_poll(of->file, UKFD_POLLOUT);
@@ -867,10 +1426,18 @@ UK_SYSCALL_R_DEFINE(ssize_t, sendto, int, sock, const void *, buf, size_t, len,
 
 	mode = of->mode;
 	for (;;) {
-		uk_file_rlock(of->file);
-		ret = posix_socket_sendto(of->file, buf, len, flags,
-					  dest_addr, addrlen);
-		uk_file_runlock(of->file);
+#if CONFIG_LIBPOSIX_SOCKET_ZEROCOPY
+		if (flags & MSG_ZEROCOPY) {
+			ret = socket_sendto_zc(of->file, buf, len, flags,
+					       dest_addr, addrlen);
+		} else
+#endif /* CONFIG_LIBPOSIX_SOCKET_ZEROCOPY */
+		{
+			uk_file_rlock(of->file);
+			ret = posix_socket_sendto(of->file, buf, len, flags,
+						  dest_addr, addrlen);
+			uk_file_runlock(of->file);
+		}
 		if (!_SHOULD_BLOCK(mode) || !_ERR_BLOCK(ret))
 			break;
 		(void)uk_file_poll(of->file, UKFD_POLLOUT);
@@ -885,6 +1452,180 @@ out:
 	return ret;
 }
 
+/* Linux caps batches at UIO_MAXIOV, which equals IOV_MAX */
+#define MMSG_MAX IOV_MAX
+
+/* Hand a batch to the driver, or feed it message by message */
+static int socket_sendmmsg(posix_sock *sock, struct mmsghdr *msgvec,
+			   unsigned int vlen, int flags)
+{
+	struct posix_socket_driver *d = posix_sock_get_driver(sock);
+	unsigned int i;
+	ssize_t ret;
+
+	if (d->ops->sendmmsg)
+		return d->ops->sendmmsg(sock, msgvec, vlen, flags);
+
+	for (i = 0; i < vlen; i++) {
+		ret = posix_socket_sendmsg(sock, &msgvec[i].msg_hdr, flags);
+		if (ret < 0)
+			return i ? (int)i : (int)ret;
+		msgvec[i].msg_len = ret;
+	}
+	return i;
+}
+
+static int socket_recvmmsg(posix_sock *sock, struct mmsghdr *msgvec,
+			   unsigned int vlen, int flags)
+{
+	struct posix_socket_driver *d = posix_sock_get_driver(sock);
+	unsigned int i;
+	ssize_t ret;
+
+	if (d->ops->recvmmsg)
+		return d->ops->recvmmsg(sock, msgvec, vlen, flags);
+
+	for (i = 0; i < vlen; i++) {
+		ret = posix_socket_recvmsg(sock, &msgvec[i].msg_hdr, flags);
+		if (ret < 0)
+			return i ? (int)i : (int)ret;
+		msgvec[i].msg_len = ret;
+	}
+	return i;
+}
+
+UK_TRACEPOINT(trace_posix_socket_sendmmsg, "%d %p %u %u", int,
+	      struct mmsghdr *, unsigned int, unsigned int);
+UK_TRACEPOINT(trace_posix_socket_sendmmsg_ret, "%d", int);
+UK_TRACEPOINT(trace_posix_socket_sendmmsg_err, "%d", int);
+
+UK_SYSCALL_R_DEFINE(int, sendmmsg, int, sock, struct mmsghdr *, msgvec,
+		    unsigned int, vlen, unsigned int, flags)
+{
+	int ret = 0;
+	unsigned int mode;
+	struct uk_ofile *of;
+	unsigned int i;
+
+	trace_posix_socket_sendmmsg(sock, msgvec, vlen, flags);
+
+	if (unlikely(!msgvec))
+		return -EFAULT;
+	vlen = MIN(vlen, (unsigned int)MMSG_MAX);
+
+	of = socketfd_get(sock);
+	if (unlikely(PTRISERR(of))) {
+		ret = PTR2ERR(of);
+		goto out;
+	}
+
+#if CONFIG_LIBPOSIX_SOCKET_ZEROCOPY
+	/* Batches are always copied */
+	flags &= ~MSG_ZEROCOPY;
+#endif /* CONFIG_LIBPOSIX_SOCKET_ZEROCOPY */
+
+	/* Look up the socket and take its lock once for the whole batch */
+	mode = of->mode;
+	uk_file_rlock(of->file);
+	for (i = 0; i < vlen; i += ret) {
+		ret = socket_sendmmsg(of->file, &msgvec[i], vlen - i, flags);
+		if (ret > 0)
+			continue;
+		if (!_SHOULD_BLOCK(mode) || !_ERR_BLOCK(ret))
+			break;
+		uk_file_runlock(of->file);
+		(void)uk_file_poll(of->file, UKFD_POLLOUT);
+		uk_file_rlock(of->file);
+		ret = 0;
+	}
+	uk_file_runlock(of->file);
+	uk_fdtab_ret(of);
+
+	/* Errors after the first message are reported by the next call */
+	if (i)
+		ret = i;
+out:
+	if (ret < 0 && ret != -EAGAIN)
+		trace_posix_socket_sendmmsg_err(ret);
+	else
+		trace_posix_socket_sendmmsg_ret(ret);
+	return ret;
+}
+
+UK_TRACEPOINT(trace_posix_socket_recvmmsg, "%d %p %u %u %p", int,
+	      struct mmsghdr *, unsigned int, unsigned int, struct timespec *);
+UK_TRACEPOINT(trace_posix_socket_recvmmsg_ret, "%d", int);
+UK_TRACEPOINT(trace_posix_socket_recvmmsg_err, "%d", int);
+
+UK_SYSCALL_R_DEFINE(int, recvmmsg, int, sock, struct mmsghdr *, msgvec,
+		    unsigned int, vlen, unsigned int, flags,
+		    struct timespec *, timeout)
+{
+	int ret = 0;
+	unsigned int mode;
+	struct uk_ofile *of;
+	__nsec deadline = 0;
+	int waitforone;
+	int block;
+	unsigned int i;
+
+	trace_posix_socket_recvmmsg(sock, msgvec, vlen, flags, timeout);
+
+	if (unlikely(!msgvec))
+		return -EFAULT;
+	if (timeout) {
+		if (unlikely(timeout->tv_sec < 0 || timeout->tv_nsec < 0 ||
+			     timeout->tv_nsec >= UKARCH_NSEC_PER_SEC))
+			return -EINVAL;
+		deadline = ukplat_monotonic_clock() +
+			   ukarch_time_sec_to_nsec(timeout->tv_sec) +
+			   timeout->tv_nsec;
+	}
+	vlen = MIN(vlen, (unsigned int)MMSG_MAX);
+
+	of = socketfd_get(sock);
+	if (unlikely(PTRISERR(of))) {
+		ret = PTR2ERR(of);
+		goto out;
+	}
+
+	mode = of->mode;
+	block = _SHOULD_BLOCK(mode) && !(flags & MSG_DONTWAIT);
+	waitforone = flags & MSG_WAITFORONE;
+	flags &= ~MSG_WAITFORONE;
+	uk_file_rlock(of->file);
+	for (i = 0; i < vlen; i += ret) {
+		ret = socket_recvmmsg(of->file, &msgvec[i], vlen - i, flags);
+		if (ret > 0) {
+			/* Like Linux, the timeout is checked between batches */
+			if (timeout && ukplat_monotonic_clock() >= deadline) {
+				i += ret;
+				break;
+			}
+			if (waitforone)
+				block = 0;
+			continue;
+		}
+		if (!block || !_ERR_BLOCK(ret))
+			break;
+		uk_file_runlock(of->file);
+		socket_wait_in(of->file);
+		uk_file_rlock(of->file);
+		ret = 0;
+	}
+	uk_file_runlock(of->file);
+	uk_fdtab_ret(of);
+
+	if (i)
+		ret = i;
+out:
+	if (ret < 0 && ret != -EAGAIN)
+		trace_posix_socket_recvmmsg_err(ret);
+	else
+		trace_posix_socket_recvmmsg_ret(ret);
+	return ret;
+}
+
 #if UK_LIBC_SYSCALLS
 /* Provide wrapper (if not provided by Musl) or some other libc. */
 ssize_t send(int sock, const void *buf, size_t len, int flags)
@@ -905,8 +1646,8 @@ int uk_socketpair_create(int family, int type, int protocol,
 	if (unlikely(!d))
 		return -EAFNOSUPPORT;
 
-	al[0] = uk_malloc(d->allocator, sizeof(*al));
-	al[1] = uk_malloc(d->allocator, sizeof(*al));
+	al[0] = socket_alloc(d);
+	al[1] = socket_alloc(d);
 	if (unlikely(!al[0] || !al[1])) {
 		ret = -ENOMEM;
 		goto err_free;
@@ -932,8 +1673,8 @@ int uk_socketpair_create(int family, int type, int protocol,
 	return 0;
 
 err_free:
-	uk_free(d->allocator, al[0]);
-	uk_free(d->allocator, al[1]);
+	socket_free(d, al[0]);
+	socket_free(d, al[1]);
 	return ret;
 }
 
@@ -994,3 +1735,74 @@ UK_SYSCALL_R_DEFINE(int, socketpair, int, family, int, type, int, protocol,
 		trace_posix_socket_socketpair_ret(ret);
 	return ret;
 }
+
+#if CONFIG_LIBPOSIX_SOCKET_ZEROCOPY
+int uk_socket_recv_zc(int fd, struct uk_socket_rxbuf *bufs,
+		      unsigned int cnt, int flags)
+{
+	struct posix_socket_driver *d;
+	struct uk_ofile *of;
+	unsigned int mode;
+	int ret;
+
+	if (unlikely(!bufs))
+		return -EFAULT;
+	if (unlikely(!cnt))
+		return -EINVAL;
+
+	of = socketfd_get(fd);
+	if (unlikely(PTRISERR(of)))
+		return PTR2ERR(of);
+
+	d = posix_sock_get_driver(of->file);
+	if (!d->ops->recv_zc || !d->ops->recv_zc_release) {
+		ret = -EOPNOTSUPP;
+		goto out;
+	}
+
+	mode = of->mode;
+	for (;;) {
+		uk_file_rlock(of->file);
+		ret = d->ops->recv_zc(of->file, bufs, cnt, flags);
+		uk_file_runlock(of->file);
+		if (!_SHOULD_BLOCK(mode) || !_ERR_BLOCK(ret))
+			break;
+		socket_wait_in(of->file);
+	}
+
+out:
+	uk_fdtab_ret(of);
+	return ret;
+}
+
+int uk_socket_recv_zc_release(int fd, struct uk_socket_rxbuf *bufs,
+			      unsigned int cnt)
+{
+	struct posix_socket_driver *d;
+	struct uk_ofile *of;
+	int ret = 0;
+
+	if (unlikely(!bufs && cnt))
+		return -EFAULT;
+
+	of = socketfd_get(fd);
+	if (unlikely(PTRISERR(of)))
+		return PTR2ERR(of);
+
+	d = posix_sock_get_driver(of->file);
+	if (!d->ops->recv_zc_release) {
+		ret = -EOPNOTSUPP;
+		goto out;
+	}
+
+	if (cnt) {
+		uk_file_rlock(of->file);
+		d->ops->recv_zc_release(of->file, bufs, cnt);
+		uk_file_runlock(of->file);
+	}
+
+out:
+	uk_fdtab_ret(of);
+	return ret;
+}
+#endif /* CONFIG_LIBPOSIX_SOCKET_ZEROCOPY */
@@ -0,0 +1,329 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * procfs - subset of the Linux /proc file system
+ *
+ * Language runtimes size their heaps and thread pools from the files below.
+ * Their contents are generated on every read. The whole unikernel counts as
+ * the process behind /proc/self.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+
+#include <uk/arch/limits.h>
+#include <uk/essentials.h>
+#include <uk/init.h>
+#include <uk/print.h>
+#include <vfscore/dentry.h>
+#include <vfscore/file.h>
+#include <vfscore/fs.h>
+#include <vfscore/mount.h>
+#include <vfscore/prex.h>
+#include <vfscore/uio.h>
+#include <vfscore/vnode.h>
+
+#include "sysinfo.h"
+
+#define PROCFS_BUFLEN		4096
+
+struct procfs_node {
+	const char *name;
+	/* Index of the parent directory in procfs_nodes */
+	unsigned int parent;
+	/* Generates the contents, NULL for directories */
+	int (*gen)(char *buf, __sz len);
+};
+
+static int procfs_meminfo(char *buf, __sz len)
+{
+	__sz total, avail;
+
+	uk_sysinfo_memory(&total, &avail);
+	return snprintf(buf, len,
+			"MemTotal:       %8lu kB\n"
+			"MemFree:        %8lu kB\n"
+			"MemAvailable:   %8lu kB\n"
+			"Buffers:        %8lu kB\n"
+			"Cached:         %8lu kB\n"
+			"SwapTotal:      %8lu kB\n"
+			"SwapFree:       %8lu kB\n",
+			(unsigned long)(total >> 10),
+			(unsigned long)(avail >> 10),
+			(unsigned long)(avail >> 10), 0UL, 0UL, 0UL, 0UL);
+}
+
+static int procfs_cpuinfo(char *buf, __sz len)
+{
+	unsigned int i, n = uk_sysinfo_ncpus();
+	__sz off = 0;
+	int rc;
+
+	for (i = 0; i < n; i++) {
+		rc = snprintf(buf + off, len - off,
+			      "processor\t: %u\n"
+			      "cpu cores\t: %u\n"
+			      "\n", i, n);
+		if (unlikely(rc < 0 || (__sz)rc >= len - off))
+			return -ENOSPC;
+		off += rc;
+	}
+	return off;
+}
+
+static int procfs_statm(char *buf, __sz len)
+{
+	__sz total, avail;
+	unsigned long used;
+
+	uk_sysinfo_memory(&total, &avail);
+	used = (total - avail) / __PAGE_SIZE;
+
+	/* size resident shared text lib data dt, the image is not split into
+	 * text and data
+	 */
+	return snprintf(buf, len, "%lu %lu 0 0 0 %lu 0\n", used, used, used);
+}
+
+static const struct procfs_node procfs_nodes[] = {
+	{ "",		0, __NULL },		/* root */
+	{ "meminfo",	0, procfs_meminfo },
+	{ "cpuinfo",	0, procfs_cpuinfo },
+	{ "self",	0, __NULL },
+	{ "statm",	3, procfs_statm },
+};
+
+#define PROCFS_NODES	ARRAY_SIZE(procfs_nodes)
+
+/* The index of a node is also its inode number, the root has 0 */
+static inline unsigned int procfs_idx(struct vnode *vp)
+{
+	return (unsigned int)vp->v_ino;
+}
+
+static int
+procfs_read(struct vnode *vp, struct vfscore_file *fp __unused,
+	    struct uio *uio, int ioflags __unused)
+{
+	const struct procfs_node *node = &procfs_nodes[procfs_idx(vp)];
+	char *buf;
+	int len, error;
+
+	if (vp->v_type == VDIR)
+		return EISDIR;
+	if (uio->uio_offset < 0)
+		return EINVAL;
+
+	buf = malloc(PROCFS_BUFLEN);
+	if (unlikely(!buf))
+		return ENOMEM;
+
+	len = node->gen(buf, PROCFS_BUFLEN);
+	if (unlikely(len < 0)) {
+		free(buf);
+		return -len;
+	}
+	len = MIN(len, PROCFS_BUFLEN - 1);
+
+	error = 0;
+	if (uio->uio_offset < len)
+		error = vfscore_uiomove(buf + uio->uio_offset,
+					len - uio->uio_offset, uio);
+	free(buf);
+	return error;
+}
+
+static int
+procfs_lookup(struct vnode *dvp, const char *name, struct vnode **vpp)
+{
+	unsigned int dir = procfs_idx(dvp), i;
+	struct vnode *vp;
+
+	*vpp = NULL;
+
+	for (i = 1; i < PROCFS_NODES; i++)
+		if (procfs_nodes[i].parent == dir &&
+		    !strcmp(procfs_nodes[i].name, name))
+			break;
+	if (i == PROCFS_NODES)
+		return ENOENT;
+
+	if (vfscore_vget(dvp->v_mount, i, &vp)) {
+		/* found in cache */
+		*vpp = vp;
+		return 0;
+	}
+	if (!vp)
+		return ENOMEM;
+
+	vp->v_flags = 0;
+	if (procfs_nodes[i].gen) {
+		vp->v_type = VREG;
+		vp->v_mode = S_IFREG | S_IRUSR | S_IRGRP | S_IROTH;
+	} else {
+		vp->v_type = VDIR;
+		vp->v_mode = S_IFDIR | S_IRUSR | S_IXUSR | S_IRGRP |
+			     S_IXGRP | S_IROTH | S_IXOTH;
+	}
+
+	*vpp = vp;
+	return 0;
+}
+
+static int
+procfs_readdir(struct vnode *vp, struct vfscore_file *fp,
+	       struct dirent64 *dir)
+{
+	unsigned int idx = procfs_idx(vp), i;
+	off_t pos = 0;
+
+	for (i = 1; i < PROCFS_NODES; i++) {
+		if (procfs_nodes[i].parent != idx)
+			continue;
+		if (pos++ == fp->f_offset)
+			break;
+	}
+	if (i == PROCFS_NODES)
+		return ENOENT;
+
+	dir->d_type = procfs_nodes[i].gen ? DT_REG : DT_DIR;
+	strlcpy((char *)&dir->d_name, procfs_nodes[i].name,
+		sizeof(dir->d_name));
+	dir->d_fileno = i;
+
+	fp->f_offset++;
+	return 0;
+}
+
+static int
+procfs_getattr(struct vnode *vp, struct vattr *attr)
+{
+	attr->va_nodeid = vp->v_ino;
+	attr->va_type = vp->v_type;
+	attr->va_mode = vp->v_mode;
+	/* Like on Linux, the size is not known before reading */
+	attr->va_size = 0;
+	return 0;
+}
+
+static int
+procfs_unmount(struct mount *mp, int flags __unused)
+{
+	vfscore_release_mp_dentries(mp);
+	return 0;
+}
+
+#define procfs_mount	((vfsop_mount_t)vfscore_nullop)
+#define procfs_sync	((vfsop_sync_t)vfscore_nullop)
+#define procfs_vget	((vfsop_vget_t)vfscore_nullop)
+#define procfs_statfs	((vfsop_statfs_t)vfscore_nullop)
+
+#define procfs_open	((vnop_open_t)vfscore_vop_nullop)
+#define procfs_close	((vnop_close_t)vfscore_vop_nullop)
+#define procfs_write	((vnop_write_t)vfscore_vop_eperm)
+#define procfs_seek	((vnop_seek_t)vfscore_vop_nullop)
+#define procfs_ioctl	((vnop_ioctl_t)vfscore_vop_einval)
+#define procfs_fsync	((vnop_fsync_t)vfscore_vop_nullop)
+#define procfs_create	((vnop_create_t)vfscore_vop_eperm)
+#define procfs_remove	((vnop_remove_t)vfscore_vop_eperm)
+#define procfs_rename	((vnop_rename_t)vfscore_vop_eperm)
+#define procfs_mkdir	((vnop_mkdir_t)vfscore_vop_eperm)
+#define procfs_rmdir	((vnop_rmdir_t)vfscore_vop_eperm)
+#define procfs_setattr	((vnop_setattr_t)vfscore_vop_eperm)
+#define procfs_inactive	((vnop_inactive_t)vfscore_vop_nullop)
+#define procfs_truncate	((vnop_truncate_t)vfscore_vop_eperm)
+#define procfs_link	((vnop_link_t)vfscore_vop_eperm)
+#define procfs_fallocate ((vnop_fallocate_t)vfscore_vop_eperm)
+#define procfs_readlink	((vnop_readlink_t)vfscore_vop_einval)
+#define procfs_symlink	((vnop_symlink_t)vfscore_vop_eperm)
+#define procfs_poll	((vnop_poll_t)vfscore_vop_nullop)
+
+/*
+ * vnode operations
+ */
+static struct vnops procfs_vnops = {
+	procfs_open,		/* open */
+	procfs_close,		/* close */
+	procfs_read,		/* read */
+	procfs_write,		/* write */
+	procfs_seek,		/* seek */
+	procfs_ioctl,		/* ioctl */
+	procfs_fsync,		/* fsync */
+	procfs_readdir,		/* readdir */
+	procfs_lookup,		/* lookup */
+	procfs_create,		/* create */
+	procfs_remove,		/* remove */
+	procfs_rename,		/* rename */
+	procfs_mkdir,		/* mkdir */
+	procfs_rmdir,		/* rmdir */
+	procfs_getattr,		/* getattr */
+	procfs_setattr,		/* setattr */
+	procfs_inactive,	/* inactive */
+	procfs_truncate,	/* truncate */
+	procfs_link,		/* link */
+	(vnop_cache_t) NULL,	/* arc */
+	procfs_fallocate,	/* fallocate */
+	procfs_readlink,	/* read link */
+	procfs_symlink,		/* symbolic link */
+	procfs_poll,		/* poll */
+};
+
+/*
+ * File system operations
+ */
+static struct vfsops procfs_vfsops = {
+	procfs_mount,		/* mount */
+	procfs_unmount,		/* unmount */
+	procfs_sync,		/* sync */
+	procfs_vget,		/* vget */
+	procfs_statfs,		/* statfs */
+	&procfs_vnops,		/* vnops */
+};
+
+static struct vfscore_fs_type fs_procfs = {
+	.vs_name = "proc",
+	.vs_init = NULL,
+	.vs_op = &procfs_vfsops,
+};
+
+UK_FS_REGISTER(fs_procfs);
+
+#if CONFIG_LIBPOSIX_SYSINFO_PROCFS_AUTOMOUNT
+static int procfs_automount(struct uk_init_ctx *ictx __unused)
+{
+	int ret;
+
+	uk_pr_info("Mount procfs to /proc...\n");
+
+	ret = mkdir("/proc", S_IRWXU);
+	if (ret != 0 && errno != EEXIST) {
+		uk_pr_err("Failed to create /proc: %d\n", errno);
+		return -1;
+	}
+
+	ret = mount("", "/proc", "proc", 0, NULL);
+	if (ret != 0) {
+		uk_pr_err("Failed to mount procfs to /proc: %d\n", errno);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* after vfscore mounted '/' (priority 4): */
+uk_rootfs_initcall_prio(procfs_automount, 0x0, 5);
+#endif /* CONFIG_LIBPOSIX_SYSINFO_PROCFS_AUTOMOUNT */
@@ -40,11 +40,21 @@
 #include <uk/config.h>
 #include <sys/sysinfo.h>
 #include <uk/syscall.h>
+#include <uk/arch/time.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/time.h>
 
 #ifdef CONFIG_HAVE_PAGING
 #include <uk/plat/paging.h>
 #include <uk/falloc.h>
-#endif /* CONFIG_HAVE_PAGING */
+#else /* !CONFIG_HAVE_PAGING */
+#include <uk/plat/memory.h>
+#endif /* !CONFIG_HAVE_PAGING */
+#if CONFIG_LIBUKALLOC
+#include <uk/alloc.h>
+#endif /* CONFIG_LIBUKALLOC */
+
+#include "sysinfo.h"
 
 #if CONFIG_LIBVFSCORE
 /* For FDTABLE_MAX_FILES. */
@@ -81,34 +91,69 @@ static struct utsname utsname = {
 #endif
 };
 
-UK_SYSCALL_R_DEFINE(int, sysinfo, struct sysinfo *, info)
+void uk_sysinfo_memory(__sz *total, __sz *avail)
 {
 #ifdef CONFIG_HAVE_PAGING
 	struct uk_pagetable *pt;
-	__sz total_memory;
+
+	pt = ukplat_pt_get_active();
+	*total = pt->fa->total_memory;
+	*avail = pt->fa->free_memory;
+#if !CONFIG_LIBUKVMEM && CONFIG_LIBUKALLOC
+	/* Without on-demand paging, the frames of the heap are allocated up
+	 * front. Memory that is free in the heap is available nevertheless.
+	 */
+	*avail += uk_alloc_availmem_total();
+#endif /* !CONFIG_LIBUKVMEM && CONFIG_LIBUKALLOC */
+#else /* !CONFIG_HAVE_PAGING */
+	struct ukplat_memregion_desc *mrd;
+
+	/* All free memory is handed to the heaps at boot */
+	*total = 0;
+	ukplat_memregion_foreach(&mrd, UKPLAT_MEMRT_FREE, 0, 0)
+		*total += mrd->len;
+#if CONFIG_LIBUKALLOC
+	*avail = uk_alloc_availmem_total();
+#else /* !CONFIG_LIBUKALLOC */
+	*avail = 0;
+#endif /* !CONFIG_LIBUKALLOC */
+#endif /* !CONFIG_HAVE_PAGING */
+
+	*avail = MIN(*avail, *total);
+}
+
+unsigned int uk_sysinfo_ncpus(void)
+{
+#if CONFIG_LIBUKSCHEDWS
+	return ukplat_lcpu_count();
+#else /* !CONFIG_LIBUKSCHEDWS */
+	/* Other schedulers run all threads on the boot CPU */
+	return 1;
+#endif /* !CONFIG_LIBUKSCHEDWS */
+}
+
+UK_SYSCALL_R_DEFINE(int, sysinfo, struct sysinfo *, info)
+{
+	__sz total_memory, avail_memory;
 	unsigned int mem_unit = 1;
-#endif /* CONFIG_HAVE_PAGING */
 
 	if (unlikely(!info))
 		return -EFAULT;
 
 	memset(info, 0, sizeof(*info));
 
+	info->uptime = ukarch_time_nsec_to_sec(ukplat_monotonic_clock());
 	info->procs = 1; /* number of processes */
 
-#ifdef CONFIG_HAVE_PAGING
-	pt = ukplat_pt_get_active();
-
-	total_memory = pt->fa->total_memory;
+	uk_sysinfo_memory(&total_memory, &avail_memory);
 	while (total_memory > __UL_MAX) {
 		total_memory >>= 1;
 		mem_unit <<= 1;
 	}
 
-	info->totalram = (unsigned long) (pt->fa->total_memory / mem_unit);
-	info->freeram = (unsigned long) (pt->fa->free_memory / mem_unit);
+	info->totalram = (unsigned long)total_memory;
+	info->freeram = (unsigned long)(avail_memory / mem_unit);
 	info->mem_unit = mem_unit;
-#endif /* CONFIG_HAVE_PAGING */
 
 	return 0;
 }
@@ -125,8 +170,13 @@ long pathconf(const char *path __unused, int name __unused)
 
 long sysconf(int name)
 {
+	__sz total, avail;
+
 	if (name == _SC_NPROCESSORS_ONLN)
-		return 1;
+		return uk_sysinfo_ncpus();
+
+	if (name == _SC_NPROCESSORS_CONF)
+		return ukplat_lcpu_count();
 
 	if (name == _SC_PAGESIZE)
 		return __PAGE_SIZE;
@@ -136,21 +186,10 @@ long sysconf(int name)
 		return -1;
 #endif /* CONFIG_LIBPOSIX_USER */
 
-#ifdef CONFIG_HAVE_PAGING
-	if (name == _SC_PHYS_PAGES) {
-		struct uk_pagetable *pt;
-
-		pt = ukplat_pt_get_active();
-		return pt->fa->total_memory / PAGE_SIZE;
-	}
-
-	if (name == _SC_AVPHYS_PAGES) {
-		struct uk_pagetable *pt;
-
-		pt = ukplat_pt_get_active();
-		return pt->fa->free_memory / PAGE_SIZE;
+	if (name == _SC_PHYS_PAGES || name == _SC_AVPHYS_PAGES) {
+		uk_sysinfo_memory(&total, &avail);
+		return ((name == _SC_PHYS_PAGES) ? total : avail) / __PAGE_SIZE;
 	}
-#endif /* CONFIG_HAVE_PAGING */
 
 #if CONFIG_LIBVFSCORE
 	if (name == _SC_OPEN_MAX)
@@ -221,7 +260,7 @@ UK_SYSCALL_R_DEFINE(int, getcpu, unsigned int *, cpu, unsigned int *, node,
 	/* tcache is ignored since Linux 2.6.24 */
 
 	if (cpu)
-		*cpu = 0;
+		*cpu = ukplat_lcpu_idx();
 
 	if (node)
 		*node = 0;
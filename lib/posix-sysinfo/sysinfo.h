@@ -0,0 +1,23 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __POSIX_SYSINFO_H__
+#define __POSIX_SYSINFO_H__
+
+#include <uk/arch/types.h>
+
+/**
+ * Returns the total memory and the memory that is still available to the
+ * application, i.e., free frames and free memory of the heaps.
+ */
+void uk_sysinfo_memory(__sz *total, __sz *avail);
+
+/**
+ * Returns the number of CPUs that threads are scheduled on.
+ */
+unsigned int uk_sysinfo_ncpus(void);
+
+#endif /* __POSIX_SYSINFO_H__ */
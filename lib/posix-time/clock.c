@@ -0,0 +1,103 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/* Clock queries.
+ *
+ * This file is built without extended (FPU/vector) registers, so the system
+ * call handlers below can be served without saving the caller's extended
+ * register state (see `UK_ECTXSAFE_SYSCALLS`).
+ */
+
+#include <errno.h>
+#include <time.h>
+#include <sys/time.h>
+#include <uk/plat/time.h>
+#include <uk/config.h>
+#include <uk/essentials.h>
+#include <uk/syscall.h>
+
+UK_SYSCALL_R_DEFINE(time_t, time, time_t *, tloc)
+{
+	time_t secs = ukarch_time_nsec_to_sec(ukplat_wall_clock());
+
+	if (tloc)
+		*tloc = secs;
+
+	return secs;
+}
+
+UK_SYSCALL_R_DEFINE(int, gettimeofday, struct timeval *, tv, void *, tz)
+{
+	__nsec now = ukplat_wall_clock();
+
+	if (unlikely(!tv))
+		return -EINVAL;
+
+	tv->tv_sec = ukarch_time_nsec_to_sec(now);
+	tv->tv_usec = ukarch_time_nsec_to_usec(ukarch_time_subsec(now));
+	return 0;
+}
+
+UK_SYSCALL_R_DEFINE(int, clock_getres, clockid_t, clk_id,
+		    struct timespec *, tp)
+{
+	int error;
+
+	switch (clk_id) {
+	case CLOCK_MONOTONIC:
+	case CLOCK_MONOTONIC_COARSE:
+	case CLOCK_REALTIME:
+	case CLOCK_REALTIME_COARSE:
+	case CLOCK_BOOTTIME:
+		if (tp) {
+			tp->tv_sec = 0;
+			tp->tv_nsec = UKPLAT_TIME_TICK_NSEC;
+		}
+		break;
+	default:
+		error = EINVAL;
+		goto out_error;
+	}
+
+	return 0;
+
+out_error:
+	return -error;
+}
+
+UK_SYSCALL_R_DEFINE(int, clock_gettime, clockid_t, clk_id, struct timespec*, tp)
+{
+	__nsec now;
+	int error;
+
+	if (!tp) {
+		error = EFAULT;
+		goto out_error;
+	}
+
+	switch (clk_id) {
+	case CLOCK_MONOTONIC:
+	case CLOCK_MONOTONIC_RAW:
+	case CLOCK_MONOTONIC_COARSE:
+	case CLOCK_BOOTTIME:
+		now = ukplat_monotonic_clock();
+		break;
+	case CLOCK_REALTIME:
+	case CLOCK_REALTIME_COARSE:
+		now = ukplat_wall_clock();
+		break;
+	default:
+		error = EINVAL;
+		goto out_error;
+	}
+
+	tp->tv_sec = ukarch_time_nsec_to_sec(now);
+	tp->tv_nsec = ukarch_time_subsec(now);
+	return 0;
+
+out_error:
+	return -error;
+}
@@ -122,89 +122,6 @@ unsigned int sleep(unsigned int seconds)
 }
 #endif /* UK_LIBC_SYSCALLS */
 
-UK_SYSCALL_R_DEFINE(time_t, time, time_t *, tloc)
-{
-	time_t secs = ukarch_time_nsec_to_sec(ukplat_wall_clock());
-
-	if (tloc)
-		*tloc = secs;
-
-	return secs;
-}
-
-UK_SYSCALL_R_DEFINE(int, gettimeofday, struct timeval *, tv, void *, tz)
-{
-	__nsec now = ukplat_wall_clock();
-
-	if (unlikely(!tv))
-		return -EINVAL;
-
-	tv->tv_sec = ukarch_time_nsec_to_sec(now);
-	tv->tv_usec = ukarch_time_nsec_to_usec(ukarch_time_subsec(now));
-	return 0;
-}
-
-UK_SYSCALL_R_DEFINE(int, clock_getres, clockid_t, clk_id,
-		    struct timespec *, tp)
-{
-	int error;
-
-	switch (clk_id) {
-	case CLOCK_MONOTONIC:
-	case CLOCK_MONOTONIC_COARSE:
-	case CLOCK_REALTIME:
-	case CLOCK_REALTIME_COARSE:
-	case CLOCK_BOOTTIME:
-		if (tp) {
-			tp->tv_sec = 0;
-			tp->tv_nsec = UKPLAT_TIME_TICK_NSEC;
-		}
-		break;
-	default:
-		error = EINVAL;
-		goto out_error;
-	}
-
-	return 0;
-
-out_error:
-	return -error;
-}
-
-UK_SYSCALL_R_DEFINE(int, clock_gettime, clockid_t, clk_id, struct timespec*, tp)
-{
-	__nsec now;
-	int error;
-
-	if (!tp) {
-		error = EFAULT;
-		goto out_error;
-	}
-
-	switch (clk_id) {
-	case CLOCK_MONOTONIC:
-	case CLOCK_MONOTONIC_RAW:
-	case CLOCK_MONOTONIC_COARSE:
-	case CLOCK_BOOTTIME:
-		now = ukplat_monotonic_clock();
-		break;
-	case CLOCK_REALTIME:
-	case CLOCK_REALTIME_COARSE:
-		now = ukplat_wall_clock();
-		break;
-	default:
-		error = EINVAL;
-		goto out_error;
-	}
-
-	tp->tv_sec = ukarch_time_nsec_to_sec(now);
-	tp->tv_nsec = ukarch_time_subsec(now);
-	return 0;
-
-out_error:
-	return -error;
-}
-
 UK_SYSCALL_R_DEFINE(int, clock_settime, clockid_t, clk_id,
 		    const struct timespec *, tp)
 {
@@ -27,7 +27,11 @@ struct timerfd_node {
 	struct itimerspec set;
 	__u64 val;
 	clockid_t clkid;
-	struct uk_thread *upthread;
+	const struct uk_file *f;
+	/* Monotonic time of the next update, 0 if not queued */
+	__nsec deadline;
+	/* Position in the timer queue heap, valid if queued */
+	unsigned int hidx;
 };
 
 struct timerfd_alloc {
@@ -43,6 +47,116 @@ struct timerfd_status {
 	__nsec next;
 };
 
+/* Timer queue */
+
+/*
+ * All timerfds share a single service thread. Armed timers are kept in a
+ * binary min-heap ordered by the time of their next update; the service thread
+ * sleeps until the earliest one is due, updates the expired timers and
+ * requeues the ones that expire again.
+ *
+ * Timer state used by the service thread is protected by the queue lock, which
+ * is taken after the file lock. Heap slots are reserved for every timerfd when
+ * it is created, so queueing a timer never needs to allocate.
+ */
+struct timerfd_queue {
+	struct uk_mutex lock;
+	struct timerfd_node **heap;
+	unsigned int count;	/* Queued timers */
+	unsigned int size;	/* Heap slots */
+	unsigned int ntimers;	/* Existing timerfds, <= size */
+	struct uk_thread *thread;
+};
+
+static struct timerfd_queue tq = {
+	.lock = UK_MUTEX_INITIALIZER(tq.lock),
+	.heap = NULL,
+	.count = 0,
+	.size = 0,
+	.ntimers = 0,
+	.thread = NULL
+};
+
+static inline void tq_place(unsigned int i, struct timerfd_node *d)
+{
+	tq.heap[i] = d;
+	d->hidx = i;
+}
+
+static void tq_up(unsigned int i)
+{
+	struct timerfd_node *d = tq.heap[i];
+
+	while (i) {
+		unsigned int p = (i - 1) / 2;
+
+		if (tq.heap[p]->deadline <= d->deadline)
+			break;
+		tq_place(i, tq.heap[p]);
+		i = p;
+	}
+	tq_place(i, d);
+}
+
+static void tq_down(unsigned int i)
+{
+	struct timerfd_node *d = tq.heap[i];
+
+	for (;;) {
+		unsigned int c = 2 * i + 1;
+
+		if (c >= tq.count)
+			break;
+		if (c + 1 < tq.count &&
+		    tq.heap[c + 1]->deadline < tq.heap[c]->deadline)
+			c++;
+		if (d->deadline <= tq.heap[c]->deadline)
+			break;
+		tq_place(i, tq.heap[c]);
+		i = c;
+	}
+	tq_place(i, d);
+}
+
+static void tq_remove(struct timerfd_node *d)
+{
+	struct timerfd_node *last;
+	unsigned int i = d->hidx;
+
+	UK_ASSERT(d->deadline);
+	UK_ASSERT(tq.heap[i] == d);
+
+	d->deadline = 0;
+	last = tq.heap[--tq.count];
+	if (last != d) {
+		tq_place(i, last);
+		tq_up(i);
+		tq_down(last->hidx);
+	}
+}
+
+/* Queue `d` for an update at `deadline`; returns whether it is the first */
+static int tq_insert(struct timerfd_node *d, __nsec deadline)
+{
+	UK_ASSERT(!d->deadline);
+	UK_ASSERT(deadline);
+	UK_ASSERT(tq.count < tq.size);
+
+	d->deadline = deadline;
+	tq_place(tq.count, d);
+	tq_up(tq.count++);
+	return d->hidx == 0;
+}
+
+/* Requeue `d` for an update at `deadline`, or dequeue it if 0 */
+static void tq_schedule(struct timerfd_node *d, __nsec deadline)
+{
+	if (d->deadline)
+		tq_remove(d);
+	if (deadline && tq_insert(d, deadline) && tq.thread)
+		uk_thread_wake(tq.thread);
+}
+
 /* Internal */
 
 static inline
@@ -71,6 +185,7 @@ struct timerfd_status _timerfd_valnext(const struct itimerspec *set,
 	return ret;
 }
 
+/* Update the timer value and events; returns when to update next, or 0 */
 static __nsec _timerfd_update(const struct uk_file *f)
 {
 	__nsec deadline;
@@ -103,22 +218,19 @@ static __nsec _timerfd_update(const struct uk_file *f)
 		else
 			uk_file_event_clear(f, UKFD_POLLIN);
 	}
-	return deadline;
+	/* Expired one-shot timers need no further updates */
+	return st.next ? deadline : 0;
 }
 
 static void _timerfd_set(struct timerfd_node *d, const struct itimerspec *set)
 {
 	if (!set->it_value.tv_sec && !set->it_value.tv_nsec) {
 		/* Disarm */
-		if (d->set.it_value.tv_sec || d->set.it_value.tv_nsec) {
-			d->set.it_value = set->it_value;
-			uk_thread_wake(d->upthread);
-		}
+		d->set.it_value = set->it_value;
 	} else {
 		/* Arm */
 		d->set.it_value = set->it_value;
 		d->set.it_interval = set->it_interval;
-		uk_thread_wake(d->upthread);
 	}
 }
 
@@ -149,36 +261,70 @@ static ssize_t timerfd_read(const struct uk_file *f,
 	return sizeof(v);
 }
 
-static __noreturn void timerfd_updatefn(void *arg)
+static __noreturn void timerfd_servicefn(void *arg __unused)
 {
-	__nsec deadline;
-	const struct uk_file *f = (struct uk_file *)arg;
+	struct timerfd_node *d;
+	__snsec until;
 
-	UK_ASSERT(f->vol == TIMERFD_VOLID);
 	for (;;) {
-		uk_file_wlock(f);
-		deadline = _timerfd_update(f);
-		/* Unlock & wait */
-		uk_thread_block_until(uk_thread_current(), deadline);
-		uk_file_wunlock(f);
+		uk_mutex_lock(&tq.lock);
+		while (tq.count &&
+		       (d = tq.heap[0])->deadline <= ukplat_monotonic_clock()) {
+			tq_remove(d);
+			until = _timerfd_update(d->f);
+			if (until)
+				(void)tq_insert(d, until);
+		}
+		/* Unlock & wait for the earliest timer or a wakeup */
+		until = tq.count ? (__snsec)tq.heap[0]->deadline : 0;
+		uk_thread_block_until(uk_thread_current(), until);
+		uk_mutex_unlock(&tq.lock);
 
 		uk_sched_yield();
 	}
 }
 
-/* Use the priv field in `struct uk_thread` to store current
- * `struct timerfd_node` and mark the pointer to update thread as NULL to avoid
- * terminating it twice.
- */
-static void timerfd_updatefn_dtor(struct uk_thread *t)
+/* Mark the service thread as gone if it is terminated from outside */
+static void timerfd_servicefn_dtor(struct uk_thread *t __unused)
 {
-	struct timerfd_node *tn;
-
-	UK_ASSERT(t);
-	UK_ASSERT(t->priv);
+	tq.thread = NULL;
+}
 
-	tn = (struct timerfd_node *)t->priv;
-	tn->upthread = NULL;
+/* Account for a new timerfd, starting the service thread if needed */
+static int timerfd_queue_get(void)
+{
+	int ret = 0;
+
+	uk_mutex_lock(&tq.lock);
+	if (tq.ntimers == tq.size) {
+		unsigned int size = tq.size ? 2 * tq.size : 16;
+		struct timerfd_node **heap;
+
+		heap = uk_realloc(uk_alloc_get_default(), tq.heap,
+				  size * sizeof(*heap));
+		if (unlikely(!heap)) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		tq.heap = heap;
+		tq.size = size;
+	}
+	if (!tq.thread) {
+		tq.thread = uk_sched_thread_create_fn1(
+			uk_sched_current(),
+			timerfd_servicefn, NULL,
+			0x0, 0x0, false, false,
+			"timerfd_service_thread",
+			NULL, &timerfd_servicefn_dtor);
+		if (unlikely(!tq.thread)) {
+			ret = -ENODEV;
+			goto out;
+		}
+	}
+	tq.ntimers++;
+out:
+	uk_mutex_unlock(&tq.lock);
+	return ret;
 }
 
 static void timerfd_release(const struct uk_file *f, int what)
@@ -189,12 +335,13 @@ static void timerfd_release(const struct uk_file *f, int what)
 	UK_ASSERT(f->vol == TIMERFD_VOLID);
 
 	d = (struct timerfd_node *)f->node;
-	if (d->upthread && (what & UK_FILE_RELEASE_RES)) {
-
+	if (what & UK_FILE_RELEASE_RES) {
 		/* Disarm */
-		uk_file_rlock(f);
-		uk_thread_terminate(d->upthread);
-		uk_file_runlock(f);
+		uk_mutex_lock(&tq.lock);
+		if (d->deadline)
+			tq_remove(d);
+		tq.ntimers--;
+		uk_mutex_unlock(&tq.lock);
 	}
 	if (what & UK_FILE_RELEASE_OBJ) {
 		struct timerfd_alloc *al;
@@ -218,7 +365,7 @@ struct uk_file *uk_timerfile_create(clockid_t id)
 {
 	struct uk_alloc *a;
 	struct timerfd_alloc *al;
-	struct uk_thread *ut;
+	int r;
 
 	/* Check clock id */
 	if (unlikely(uk_syscall_r_clock_getres(id, (uintptr_t)NULL)))
@@ -229,6 +376,11 @@ struct uk_file *uk_timerfile_create(clockid_t id)
 	al = uk_malloc(a, sizeof(*al));
 	if (unlikely(!al))
 		return ERR2PTR(-ENOMEM);
+	r = timerfd_queue_get();
+	if (unlikely(r)) {
+		uk_free(a, al);
+		return ERR2PTR(r);
+	}
 
 	/* Fill in fields */
 	al->alloc = a;
@@ -239,7 +391,9 @@ struct uk_file *uk_timerfile_create(clockid_t id)
 		},
 		.val = 0,
 		.clkid = id,
-		.upthread = NULL
+		.f = &al->f,
+		.deadline = 0,
+		.hidx = 0
 	};
 	al->fstate = UK_FILE_STATE_INIT_VALUE(al->fstate);
 	al->frefcnt = UK_FILE_REFCNT_INIT_VALUE;
@@ -252,26 +406,6 @@ struct uk_file *uk_timerfile_create(clockid_t id)
 		._release = timerfd_release
 	};
 
-	ut = uk_sched_thread_create_fn1(
-		uk_sched_current(),
-		timerfd_updatefn, &al->f,
-		0x0, 0x0, false, false,
-		"timerfd_update_thread",
-		NULL, &timerfd_updatefn_dtor);
-	if (unlikely(!ut)) {
-		uk_free(a, al);
-		return ERR2PTR(-ENODEV);
-	}
-	/* We store in `struct timerfd_node` a reference to this very thread
-	 * so that we can terminate it on a specific timer fd's release.
-	 * However this thread may be terminated by other process or
-	 * scheduling events, that are not timerfd aware.
-	 * So use this to mark this reference as NULL in such cases so that
-	 * we do not double terminate a thread.
-	 */
-	ut->priv = &al->node;
-	al->node.upthread = ut;
-
 	return &al->f;
 }
 
@@ -328,8 +462,10 @@ int uk_sys_timerfd_settime(const struct uk_file *f, int flags,
 	}
 	if (old_value)
 		*old_value = d->set;
+	uk_mutex_lock(&tq.lock);
 	_timerfd_set(d, set);
-	(void)_timerfd_update(f);
+	tq_schedule(d, _timerfd_update(f));
+	uk_mutex_unlock(&tq.lock);
 	uk_file_wunlock(f);
 	return 0;
 }
@@ -8,7 +8,9 @@
 #include <sys/un.h>
 
 #include <uk/assert.h>
+#include <uk/atomic.h>
 #include <uk/essentials.h>
+#include <uk/sched.h>
 #include <uk/socket_driver.h>
 #include <uk/posix-pipe.h>
 #include <uk/file/pollqueue.h>
@@ -55,6 +57,8 @@ struct unix_sock_data {
 	};
 	struct unix_addr_entry bind;
 	posix_sock *remote;
+	/* Serializes writers of a connection wpipe, see unix_sock_wbegin() */
+	volatile int wbusy;
 };
 
 #define _SOCK_CONNECTION(t) ((t) == SOCK_STREAM || (t) == SOCK_SEQPACKET)
@@ -79,10 +83,41 @@ struct unix_sock_data *unix_sock_alloc(struct posix_socket_driver *d, int type)
 		.flags = 0,
 		.rpipe = NULL,
 		.wpipe = NULL,
+		.wbusy = 0,
 	};
 	return data;
 }
 
+/*
+ * Pipes need their writers to be serialized, while readers run lock-free.
+ * The wpipe of a connection has a single producer, this socket, so an
+ * uncontended flag is enough. Datagram sockets share the bound pipe of
+ * their peer with other senders and use its file lock instead.
+ */
+static inline
+void unix_sock_wbegin(struct unix_sock_data *data, const struct uk_file *wpipe)
+{
+	int idle = 0;
+
+	if (!_SOCK_CONNECTION(data->type)) {
+		uk_file_wlock(wpipe);
+		return;
+	}
+	while (!uk_compare_exchange_n(&data->wbusy, &idle, 1)) {
+		idle = 0;
+		uk_sched_yield();
+	}
+}
+
+static inline
+void unix_sock_wend(struct unix_sock_data *data, const struct uk_file *wpipe)
+{
+	if (!_SOCK_CONNECTION(data->type))
+		uk_file_wunlock(wpipe);
+	else
+		uk_store_n(&data->wbusy, 0);
+}
+
 static inline
 void unix_sock_unnamed(struct sockaddr *restrict addr,
 		       socklen_t *restrict addr_len)
@@ -158,9 +193,9 @@ out:
 
 
 static
-void unix_sock_rdown(uk_pollevent ev __maybe_unused,
-		     enum uk_poll_chain_op op __maybe_unused,
-		     struct uk_poll_chain *tick)
+int unix_sock_rdown(uk_pollevent ev __maybe_unused,
+		    enum uk_poll_chain_op op __maybe_unused,
+		    struct uk_poll_chain *tick)
 {
 	struct unix_sock_data *d;
 	struct uk_pollq *sockq;
@@ -174,13 +209,13 @@ void unix_sock_rdown(uk_pollevent ev __maybe_unused,
 	if (!d->wpipe || uk_file_poll_immediate(d->wpipe, EPOLLERR))
 		set |= EPOLLHUP;
 
-	uk_pollq_set(sockq, set);
+	return uk_pollq_set_wake_n(sockq, set, UK_POLLQ_NOTIFY_ALL);
 }
 
 static
-void unix_sock_wdown(uk_pollevent ev __maybe_unused,
-		     enum uk_poll_chain_op op __maybe_unused,
-		     struct uk_poll_chain *tick)
+int unix_sock_wdown(uk_pollevent ev __maybe_unused,
+		    enum uk_poll_chain_op op __maybe_unused,
+		    struct uk_poll_chain *tick)
 {
 	struct unix_sock_data *d;
 	struct uk_pollq *sockq;
@@ -191,7 +226,9 @@ void unix_sock_wdown(uk_pollevent ev __maybe_unused,
 	d = __containerof(tick, struct unix_sock_data, werr);
 	sockq = (struct uk_pollq *)tick->arg;
 	if (!d->rpipe || uk_file_poll_immediate(d->rpipe, EPOLLHUP))
-		uk_pollq_set(sockq, EPOLLHUP);
+		return uk_pollq_set_wake_n(sockq, EPOLLHUP,
+					   UK_POLLQ_NOTIFY_ALL);
+	return 0;
 }
 
 
@@ -687,9 +724,8 @@ ssize_t unix_socket_recvmsg(posix_sock *file, struct msghdr *msg, int flags)
 			return -EINVAL;
 	}
 
-	uk_file_rlock(data->rpipe);
+	/* Pipe reads are lock-free */
 	ret = uk_file_read(data->rpipe, msg->msg_iov, msg->msg_iovlen, 0, 0);
-	uk_file_runlock(data->rpipe);
 	/* Get remote addr */
 	if (msg->msg_name) {
 		if (_SOCK_CONNECTION(data->type))
@@ -778,9 +814,9 @@ ssize_t unix_socket_sendmsg(posix_sock *file,
 				? -EPIPE : -ECONNREFUSED)
 			: -ENOTCONN;
 
-	uk_file_wlock(wpipe);
+	unix_sock_wbegin(data, wpipe);
 	ret = uk_file_write(wpipe, msg->msg_iov, msg->msg_iovlen, 0, 0);
-	uk_file_wunlock(data->wpipe);
+	unix_sock_wend(data, wpipe);
 	/* We ignore ancillary data for now */
 
 	if (!_SOCK_CONNECTION(data->type) && remote) {
@@ -867,8 +903,8 @@ int unix_sock_shutdown(posix_sock *file, int how, int notify)
 		data->wpipe = NULL;
 		if (notify)
 			/* Signal events; reuse pipe callback */
-			unix_sock_wdown(EPOLLERR, UK_POLL_CHAINOP_SET,
-					&data->werr);
+			(void)unix_sock_wdown(EPOLLERR, UK_POLL_CHAINOP_SET,
+					      &data->werr);
 	}
 	if ((how == SHUT_RD || how == SHUT_RDWR) && data->rpipe) {
 		uk_pollq_unregister(&data->rpipe->state->pollq, &data->rio);
@@ -877,8 +913,8 @@ int unix_sock_shutdown(posix_sock *file, int how, int notify)
 		data->rpipe = NULL;
 		if (notify)
 			/* Signal events; reuse pipe callback */
-			unix_sock_rdown(EPOLLHUP, UK_POLL_CHAINOP_SET,
-					&data->rerr);
+			(void)unix_sock_rdown(EPOLLHUP, UK_POLL_CHAINOP_SET,
+					      &data->rerr);
 	}
 	return 0;
 }
@@ -35,6 +35,7 @@
 
 #include <vfscore/prex.h>
 #include <stdbool.h>
+#include <uk/mutex.h>
 
 /**
  * struct ramfs_node - A filesystem entry node for RamFS
@@ -42,11 +43,32 @@
 struct ramfs_node {
 	/* Next node in the same directory */
 	struct ramfs_node *rn_next;
+	/* Previous node in the same directory */
+	struct ramfs_node *rn_prev;
+	/* Next node in the same hash bucket of the directory */
+	struct ramfs_node *rn_hnext;
 	/*
 	 * First child node if the current node is a directory,
 	 * else NULL
 	 */
 	struct ramfs_node *rn_child;
+	/* Last child node, new nodes are appended */
+	struct ramfs_node *rn_tail;
+	/* Number of child nodes */
+	size_t rn_nchild;
+	/*
+	 * Hash table of the child nodes by name, built once the directory
+	 * has more than CONFIG_LIBRAMFS_HASH_THRESHOLD entries, else NULL
+	 */
+	struct ramfs_node **rn_htab;
+	/* Number of buckets of rn_htab, a power of two */
+	size_t rn_hsize;
+	/*
+	 * Child node returned by the last readdir and its position, so
+	 * that sequential readdir does not walk the list from the start
+	 */
+	struct ramfs_node *rn_rdnode;
+	size_t rn_rdpos;
 	/* Inode number of this node, should be unique and stable */
 	uint64_t rn_ino;
 	/*
@@ -60,10 +82,20 @@ struct ramfs_node {
 	size_t rn_namelen;
 	/* Size of the file */
 	size_t rn_size;
-	/* Buffer to the file data */
+	/*
+	 * Buffer to the data of a symbolic link or of a file that was set
+	 * with ramfs_set_file_data(), else NULL
+	 */
 	char *rn_buf;
 	/* Size of the allocated buffer */
 	size_t rn_bufsize;
+	/*
+	 * Pages holding the data of a regular file, indexed by file offset
+	 * divided by the page size. NULL entries are holes that read as zeros.
+	 */
+	char **rn_pages;
+	/* Number of entries in rn_pages */
+	size_t rn_npages;
 	/* Last change time */
 	struct timespec rn_ctime;
 	/* Last access time */
@@ -74,6 +106,12 @@ struct ramfs_node {
 	int rn_mode;
 	/* Whether the rn_buf was allocated in this ramfs_node */
 	bool rn_owns_buf;
+	/*
+	 * Protects the list and hash table of child nodes and their names if
+	 * the node is a directory. The data of a file is protected by the
+	 * lock of its vnode.
+	 */
+	struct uk_mutex rn_lock;
 };
 
 /**
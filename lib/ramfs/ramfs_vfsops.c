@@ -86,6 +86,8 @@ ramfs_mount(struct mount *mp, const char *dev __unused,
 	if (np == NULL)
 		return ENOMEM;
 	mp->m_root->d_vnode->v_data = np;
+	/* ramfs_read() only copies out of the node, readers may share it */
+	mp->m_flags |= MNT_SHAREDREAD;
 	return 0;
 }
 
@@ -45,6 +45,8 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include <uk/alloc.h>
+#include <uk/atomic.h>
 #include <uk/page.h>
 #include <vfscore/vnode.h>
 #include <vfscore/mount.h>
@@ -62,9 +64,11 @@
 #define RAMFS_IS_DELETED(np) ((np)->rn_mode & RAMFS_DELMODE)
 #define RAMFS_MARK_DELETED(np) (np)->rn_mode |= RAMFS_DELMODE
 
-static struct uk_mutex ramfs_lock = UK_MUTEX_INITIALIZER(ramfs_lock);
 static uint64_t inode_count = 1; /* inode 0 is reserved to root */
 
+/* Source for reading holes */
+static char ramfs_zero_page[__PAGE_SIZE];
+
 static void
 set_times_to_now(struct timespec *time1, struct timespec *time2,
 		 struct timespec *time3)
@@ -98,7 +102,8 @@ ramfs_allocate_node(const char *name, int type, mode_t mode)
 	}
 	strlcpy(np->rn_name, name, np->rn_namelen + 1);
 	np->rn_type = type;
-	np->rn_ino = inode_count++;
+	np->rn_ino = uk_fetch_add(&inode_count, 1);
+	uk_mutex_init_config(&np->rn_lock, UK_MUTEX_CONFIG_SPIN);
 
 	mode &= 0777;
 	if (type == VDIR)
@@ -114,72 +119,326 @@ ramfs_allocate_node(const char *name, int type, mode_t mode)
 	return np;
 }
 
+static inline char *
+ramfs_page(struct ramfs_node *np, size_t idx)
+{
+	return (idx < np->rn_npages) ? np->rn_pages[idx] : NULL;
+}
+
+/* Makes room for at least `npages` entries in the page array */
+static int
+ramfs_grow_pages(struct ramfs_node *np, size_t npages)
+{
+	char **pages;
+	size_t cnt;
+
+	if (npages <= np->rn_npages)
+		return 0;
+
+	/* Double the array so that appending stays amortized O(1) */
+	cnt = MAX(MAX(np->rn_npages * 2, npages), (size_t) 8);
+	pages = realloc(np->rn_pages, cnt * sizeof(*pages));
+	if (!pages)
+		return ENOMEM;
+	memset(pages + np->rn_npages, 0,
+	       (cnt - np->rn_npages) * sizeof(*pages));
+
+	np->rn_pages = pages;
+	np->rn_npages = cnt;
+	return 0;
+}
+
+static char *
+ramfs_alloc_page(void)
+{
+	char *page;
+
+	page = uk_palloc(uk_alloc_get_default(), 1);
+	if (page)
+		memset(page, 0, __PAGE_SIZE);
+	return page;
+}
+
+/* Frees all pages starting at index `idx` */
+static void
+ramfs_free_pages(struct ramfs_node *np, size_t idx)
+{
+	for (; idx < np->rn_npages; idx++) {
+		if (np->rn_pages[idx]) {
+			uk_pfree(uk_alloc_get_default(), np->rn_pages[idx], 1);
+			np->rn_pages[idx] = NULL;
+		}
+	}
+}
+
+/*
+ * Copies `len` bytes between the pages of a node and `uio`, starting at the
+ * offset of `uio`. Pages are allocated as they are written to; the page
+ * array must already be large enough.
+ */
+static int
+ramfs_uiomove_pages(struct ramfs_node *np, size_t len, struct uio *uio)
+{
+	size_t idx, pgoff, cnt;
+	char *page;
+	int error;
+
+	while (len > 0) {
+		idx = (size_t) uio->uio_offset / __PAGE_SIZE;
+		pgoff = (size_t) uio->uio_offset % __PAGE_SIZE;
+		cnt = MIN(__PAGE_SIZE - pgoff, len);
+
+		page = ramfs_page(np, idx);
+		if (uio->uio_rw == UIO_WRITE && !page) {
+			UK_ASSERT(idx < np->rn_npages);
+			page = ramfs_alloc_page();
+			if (!page)
+				return EIO;
+			np->rn_pages[idx] = page;
+		}
+
+		error = vfscore_uiomove(page ? page + pgoff : ramfs_zero_page,
+					(int) cnt, uio);
+		if (error)
+			return error;
+		len -= cnt;
+	}
+	return 0;
+}
+
+/*
+ * Moves the data of a file that was set with ramfs_set_file_data() to pages
+ * of its own, so that it can be modified.
+ */
+static int
+ramfs_own_data(struct ramfs_node *np)
+{
+	struct iovec iov;
+	struct uio uio;
+	int error;
+
+	if (np->rn_type != VREG || np->rn_buf == NULL)
+		return 0;
+	UK_ASSERT(!np->rn_owns_buf);
+
+	if (ramfs_grow_pages(np, DIV_ROUND_UP(np->rn_size, __PAGE_SIZE)))
+		return EIO;
+
+	iov.iov_base = np->rn_buf;
+	iov.iov_len = np->rn_size;
+	uio.uio_iov = &iov;
+	uio.uio_iovcnt = 1;
+	uio.uio_offset = 0;
+	uio.uio_resid = np->rn_size;
+	uio.uio_rw = UIO_WRITE;
+	error = ramfs_uiomove_pages(np, np->rn_size, &uio);
+	if (error) {
+		ramfs_free_pages(np, 0);
+		return error;
+	}
+
+	np->rn_buf = NULL;
+	np->rn_bufsize = 0;
+	np->rn_owns_buf = true;
+	return 0;
+}
+
 void
 ramfs_free_node(struct ramfs_node *np)
 {
 	if (np->rn_buf != NULL && np->rn_owns_buf)
 		free(np->rn_buf);
+	ramfs_free_pages(np, 0);
+	free(np->rn_pages);
+	free(np->rn_htab);
 
 	free(np->rn_name);
 	free(np);
 }
 
+/* Smallest hash table, in buckets */
+#define RAMFS_HASH_MIN	64
+
+/* FNV-1a */
+static inline __u32
+ramfs_hash(const char *name, size_t len)
+{
+	__u32 h = 0x811c9dc5;
+
+	while (len--) {
+		h ^= (unsigned char)*name++;
+		h *= 0x01000193;
+	}
+	return h;
+}
+
+static inline struct ramfs_node **
+ramfs_hash_bucket(struct ramfs_node *dnp, const char *name, size_t len)
+{
+	return &dnp->rn_htab[ramfs_hash(name, len) & (dnp->rn_hsize - 1)];
+}
+
+static void
+ramfs_hash_insert(struct ramfs_node *dnp, struct ramfs_node *np)
+{
+	struct ramfs_node **bp;
+
+	bp = ramfs_hash_bucket(dnp, np->rn_name, np->rn_namelen);
+	np->rn_hnext = *bp;
+	*bp = np;
+}
+
+static void
+ramfs_hash_remove(struct ramfs_node *dnp, struct ramfs_node *np)
+{
+	struct ramfs_node **pp;
+
+	pp = ramfs_hash_bucket(dnp, np->rn_name, np->rn_namelen);
+	while (*pp != NULL && *pp != np)
+		pp = &(*pp)->rn_hnext;
+	if (*pp != NULL)
+		*pp = np->rn_hnext;
+	np->rn_hnext = NULL;
+}
+
+/*
+ * Builds the hash table of a directory or doubles its size. If the
+ * allocation fails, the directory keeps its current table or, without one,
+ * is still scanned by lookups.
+ */
+static void
+ramfs_hash_grow(struct ramfs_node *dnp)
+{
+	struct ramfs_node **htab, *np;
+	size_t hsize;
+
+	hsize = dnp->rn_hsize ? dnp->rn_hsize << 1 : RAMFS_HASH_MIN;
+	while (hsize < dnp->rn_nchild)
+		hsize <<= 1;
+
+	htab = calloc(hsize, sizeof(*htab));
+	if (htab == NULL)
+		return;
+
+	free(dnp->rn_htab);
+	dnp->rn_htab = htab;
+	dnp->rn_hsize = hsize;
+	for (np = dnp->rn_child; np != NULL; np = np->rn_next)
+		ramfs_hash_insert(dnp, np);
+}
+
+/* Must be called with the directory lock held */
+static struct ramfs_node *
+ramfs_find_node(struct ramfs_node *dnp, const char *name, size_t len)
+{
+	struct ramfs_node *np;
+
+	if (dnp->rn_htab != NULL) {
+		for (np = *ramfs_hash_bucket(dnp, name, len); np != NULL;
+		     np = np->rn_hnext)
+			if (np->rn_namelen == len &&
+			    memcmp(name, np->rn_name, len) == 0)
+				return np;
+		return NULL;
+	}
+
+	for (np = dnp->rn_child; np != NULL; np = np->rn_next)
+		if (np->rn_namelen == len &&
+		    memcmp(name, np->rn_name, len) == 0)
+			return np;
+	return NULL;
+}
+
+/* Appends a node to the directory, must be called with its lock held */
+static void
+ramfs_link_node(struct ramfs_node *dnp, struct ramfs_node *np)
+{
+	size_t limit;
+
+	np->rn_next = NULL;
+	np->rn_prev = dnp->rn_tail;
+	if (dnp->rn_tail != NULL)
+		dnp->rn_tail->rn_next = np;
+	else
+		dnp->rn_child = np;
+	dnp->rn_tail = np;
+	dnp->rn_nchild++;
+
+	if (dnp->rn_htab != NULL)
+		ramfs_hash_insert(dnp, np);
+
+	limit = dnp->rn_htab ? dnp->rn_hsize : CONFIG_LIBRAMFS_HASH_THRESHOLD;
+	if (dnp->rn_nchild > limit)
+		ramfs_hash_grow(dnp);
+}
+
+/* Removes a node from the directory, must be called with its lock held */
+static void
+ramfs_unlink_node(struct ramfs_node *dnp, struct ramfs_node *np)
+{
+	if (np->rn_prev != NULL)
+		np->rn_prev->rn_next = np->rn_next;
+	else
+		dnp->rn_child = np->rn_next;
+	if (np->rn_next != NULL)
+		np->rn_next->rn_prev = np->rn_prev;
+	else
+		dnp->rn_tail = np->rn_prev;
+	dnp->rn_nchild--;
+
+	if (dnp->rn_htab != NULL)
+		ramfs_hash_remove(dnp, np);
+
+	/* Positions of the following entries have changed */
+	dnp->rn_rdnode = NULL;
+
+	np->rn_next = NULL;
+	np->rn_prev = NULL;
+}
+
 static struct ramfs_node *
 ramfs_add_node(struct ramfs_node *dnp, const char *name, int type, mode_t mode)
 {
-	struct ramfs_node *np, *prev;
+	struct ramfs_node *np;
 
 	np = ramfs_allocate_node(name, type, mode);
 	if (np == NULL)
 		return NULL;
 
-	uk_mutex_lock(&ramfs_lock);
+	uk_mutex_lock(&dnp->rn_lock);
 
 	/* Link to the directory list */
-	if (dnp->rn_child == NULL) {
-		dnp->rn_child = np;
-	} else {
-		prev = dnp->rn_child;
-		while (prev->rn_next != NULL)
-			prev = prev->rn_next;
-		prev->rn_next = np;
-	}
+	ramfs_link_node(dnp, np);
 
 	set_times_to_now(&(dnp->rn_mtime), &(dnp->rn_ctime), NULL);
 
-	uk_mutex_unlock(&ramfs_lock);
+	uk_mutex_unlock(&dnp->rn_lock);
 	return np;
 }
 
 static int
 ramfs_remove_node(struct ramfs_node *dnp, struct ramfs_node *np)
 {
-	struct ramfs_node *prev;
+	uk_mutex_lock(&dnp->rn_lock);
 
-	if (dnp->rn_child == NULL)
+	if (dnp->rn_child == NULL) {
+		uk_mutex_unlock(&dnp->rn_lock);
 		return EBUSY;
+	}
 
-	uk_mutex_lock(&ramfs_lock);
+	if (ramfs_find_node(dnp, np->rn_name, np->rn_namelen) != np) {
+		uk_mutex_unlock(&dnp->rn_lock);
+		return ENOENT;
+	}
 
 	/* Unlink from the directory list */
-	if (dnp->rn_child == np) {
-		dnp->rn_child = np->rn_next;
-	} else {
-		for (prev = dnp->rn_child; prev->rn_next != np;
-			 prev = prev->rn_next) {
-			if (prev->rn_next == NULL) {
-				uk_mutex_unlock(&ramfs_lock);
-				return ENOENT;
-			}
-		}
-		prev->rn_next = np->rn_next;
-	}
+	ramfs_unlink_node(dnp, np);
 	/* Mark node as deleted */
 	RAMFS_MARK_DELETED(np);
 
 	set_times_to_now(&(dnp->rn_mtime), &(dnp->rn_ctime), NULL);
 
-	uk_mutex_unlock(&ramfs_lock);
+	uk_mutex_unlock(&dnp->rn_lock);
 	return 0;
 }
 
@@ -216,37 +475,30 @@ ramfs_lookup(struct vnode *dvp, const char *name, struct vnode **vpp)
 	struct ramfs_node *np, *dnp;
 	struct vnode *vp;
 	size_t len;
-	int found;
 
 	*vpp = NULL;
 
 	if (*name == '\0')
 		return ENOENT;
 
-	uk_mutex_lock(&ramfs_lock);
-
 	len = strlen(name);
 	dnp = dvp->v_data;
-	found = 0;
-	for (np = dnp->rn_child; np != NULL; np = np->rn_next) {
-		if (np->rn_namelen == len &&
-			memcmp(name, np->rn_name, len) == 0) {
-			found = 1;
-			break;
-		}
-	}
-	if (found == 0) {
-		uk_mutex_unlock(&ramfs_lock);
+
+	uk_mutex_lock(&dnp->rn_lock);
+
+	np = ramfs_find_node(dnp, name, len);
+	if (np == NULL) {
+		uk_mutex_unlock(&dnp->rn_lock);
 		return ENOENT;
 	}
 	if (vfscore_vget(dvp->v_mount, np->rn_ino, &vp)) {
 		/* found in cache */
 		*vpp = vp;
-		uk_mutex_unlock(&ramfs_lock);
+		uk_mutex_unlock(&dnp->rn_lock);
 		return 0;
 	}
 	if (!vp) {
-		uk_mutex_unlock(&ramfs_lock);
+		uk_mutex_unlock(&dnp->rn_lock);
 		return ENOMEM;
 	}
 	vp->v_data = np;
@@ -254,7 +506,7 @@ ramfs_lookup(struct vnode *dvp, const char *name, struct vnode **vpp)
 	vp->v_type = np->rn_type;
 	vp->v_size = np->rn_size;
 
-	uk_mutex_unlock(&ramfs_lock);
+	uk_mutex_unlock(&dnp->rn_lock);
 
 	*vpp = vp;
 
@@ -348,35 +600,34 @@ static int
 ramfs_truncate(struct vnode *vp, off_t length)
 {
 	struct ramfs_node *np;
-	void *new_buf;
-	size_t new_size;
+	size_t pgoff;
+	char *page;
+	int error;
 
 	uk_pr_debug("truncate %s length=%lld\n", RAMFS_NODE(vp)->rn_name,
 		 (long long) length);
 	np = vp->v_data;
 
+	error = ramfs_own_data(np);
+	if (error)
+		return error;
+
+	if ((size_t) length < np->rn_size) {
+		ramfs_free_pages(np, DIV_ROUND_UP((size_t) length,
+						  __PAGE_SIZE));
+
+		/* Clear the tail that is exposed again when the file grows */
+		pgoff = (size_t) length % __PAGE_SIZE;
+		page = ramfs_page(np, (size_t) length / __PAGE_SIZE);
+		if (pgoff && page)
+			memset(page + pgoff, 0, __PAGE_SIZE - pgoff);
+	}
 	if (length == 0) {
-		if (np->rn_buf != NULL) {
-			if (np->rn_owns_buf)
-				free(np->rn_buf);
-			np->rn_buf = NULL;
-			np->rn_bufsize = 0;
-		}
-	} else if ((size_t) length > np->rn_bufsize) {
-		/* TODO: this could use a page level allocator */
-		new_size = round_pgup(length);
-		new_buf = malloc(new_size);
-		if (!new_buf)
-			return EIO;
-		if (np->rn_size != 0) {
-			memcpy(new_buf, np->rn_buf, vp->v_size);
-			if (np->rn_owns_buf)
-				free(np->rn_buf);
-		}
-		np->rn_buf = (char *) new_buf;
-		np->rn_bufsize = new_size;
-		np->rn_owns_buf = true;
+		free(np->rn_pages);
+		np->rn_pages = NULL;
+		np->rn_npages = 0;
 	}
+	/* Growing the file only extends the hole at its end */
 	np->rn_size = length;
 	vp->v_size = length;
 	set_times_to_now(&(np->rn_mtime), &(np->rn_ctime), NULL);
@@ -430,7 +681,9 @@ ramfs_read(struct vnode *vp, struct vfscore_file *fp __unused,
 
 	set_times_to_now(&(np->rn_atime), NULL, NULL);
 
-	return vfscore_uiomove(np->rn_buf + uio->uio_offset, len, uio);
+	if (np->rn_buf)
+		return vfscore_uiomove(np->rn_buf + uio->uio_offset, len, uio);
+	return ramfs_uiomove_pages(np, len, uio);
 }
 
 int
@@ -442,7 +695,7 @@ ramfs_set_file_data(struct vnode *vp, const void *data, size_t size)
 		return EISDIR;
 	if (vp->v_type != VREG)
 		return EINVAL;
-	if (np->rn_buf)
+	if (np->rn_buf || np->rn_size)
 		return EINVAL;
 
 	np->rn_buf = (char *) data;
@@ -458,6 +711,8 @@ static int
 ramfs_write(struct vnode *vp, struct uio *uio, int ioflag)
 {
 	struct ramfs_node *np =  vp->v_data;
+	off_t end_pos;
+	int error;
 
 	if (vp->v_type == VDIR)
 		return EISDIR;
@@ -473,33 +728,23 @@ ramfs_write(struct vnode *vp, struct uio *uio, int ioflag)
 	if (ioflag & IO_APPEND)
 		uio->uio_offset = np->rn_size;
 
-	if ((size_t) uio->uio_offset + uio->uio_resid > (size_t) vp->v_size) {
-		/* Expand the file size before writing to it */
-		off_t end_pos = uio->uio_offset + uio->uio_resid;
+	error = ramfs_own_data(np);
+	if (error)
+		return error;
 
-		if (end_pos > (off_t) np->rn_bufsize) {
-			// XXX: this could use a page level allocator
-			size_t new_size = round_pgup(end_pos);
-			void *new_buf = calloc(1, new_size);
-
-			if (!new_buf)
-				return EIO;
-			if (np->rn_size != 0) {
-				memcpy(new_buf, np->rn_buf, vp->v_size);
-				if (np->rn_owns_buf)
-					free(np->rn_buf);
-			}
-			np->rn_buf = (char *) new_buf;
-			np->rn_bufsize = new_size;
-		}
-		np->rn_size = end_pos;
-		vp->v_size = end_pos;
-		np->rn_owns_buf = true;
-	}
+	end_pos = uio->uio_offset + uio->uio_resid;
+	if (ramfs_grow_pages(np, DIV_ROUND_UP((size_t) end_pos, __PAGE_SIZE)))
+		return EIO;
 
 	set_times_to_now(&(np->rn_mtime), &(np->rn_ctime), NULL);
-	return vfscore_uiomove(np->rn_buf + uio->uio_offset, uio->uio_resid,
-			       uio);
+	error = ramfs_uiomove_pages(np, uio->uio_resid, uio);
+
+	/* Account for the data written before a possible failure */
+	if ((size_t) uio->uio_offset > np->rn_size) {
+		np->rn_size = uio->uio_offset;
+		vp->v_size = uio->uio_offset;
+	}
+	return error;
 }
 
 static int
@@ -507,7 +752,7 @@ ramfs_rename(struct vnode *dvp1, struct vnode *vp1, const char *name1 __unused,
 	     struct vnode *dvp2, struct vnode *vp2,
 	     const char *name2)
 {
-	struct ramfs_node *np, *old_np;
+	struct ramfs_node *np, *old_np, *dnp;
 	int error;
 
 	if (vp2) {
@@ -519,7 +764,15 @@ ramfs_rename(struct vnode *dvp1, struct vnode *vp1, const char *name1 __unused,
 	/* Same directory ? */
 	if (dvp1 == dvp2) {
 		/* Change the name of existing file */
+		dnp = RAMFS_NODE(dvp1);
+		uk_mutex_lock(&dnp->rn_lock);
+		/* The hash bucket depends on the name */
+		if (dnp->rn_htab != NULL)
+			ramfs_hash_remove(dnp, vp1->v_data);
 		error = ramfs_rename_node(vp1->v_data, name2);
+		if (dnp->rn_htab != NULL)
+			ramfs_hash_insert(dnp, vp1->v_data);
+		uk_mutex_unlock(&dnp->rn_lock);
 		if (error)
 			return error;
 	} else {
@@ -532,15 +785,27 @@ ramfs_rename(struct vnode *dvp1, struct vnode *vp1, const char *name1 __unused,
 
 		/* Copy children structure */
 		np->rn_child = old_np->rn_child;
+		np->rn_tail = old_np->rn_tail;
+		np->rn_nchild = old_np->rn_nchild;
+		np->rn_htab = old_np->rn_htab;
+		np->rn_hsize = old_np->rn_hsize;
 		old_np->rn_child = NULL;
-
-		if (old_np->rn_buf) {
-			/* Copy file data */
-			np->rn_buf = old_np->rn_buf;
-			np->rn_size = old_np->rn_size;
-			np->rn_bufsize = old_np->rn_bufsize;
-			old_np->rn_buf = NULL;
-		}
+		old_np->rn_tail = NULL;
+		old_np->rn_nchild = 0;
+		old_np->rn_htab = NULL;
+		old_np->rn_hsize = 0;
+		old_np->rn_rdnode = NULL;
+
+		/* Move file data */
+		np->rn_buf = old_np->rn_buf;
+		np->rn_bufsize = old_np->rn_bufsize;
+		np->rn_owns_buf = old_np->rn_owns_buf;
+		np->rn_pages = old_np->rn_pages;
+		np->rn_npages = old_np->rn_npages;
+		np->rn_size = old_np->rn_size;
+		old_np->rn_buf = NULL;
+		old_np->rn_pages = NULL;
+		old_np->rn_npages = 0;
 		/* Remove source file */
 		ramfs_remove_node(dvp1->v_data, vp1->v_data);
 	}
@@ -553,13 +818,12 @@ ramfs_rename(struct vnode *dvp1, struct vnode *vp1, const char *name1 __unused,
 static int
 ramfs_readdir(struct vnode *vp, struct vfscore_file *fp, struct dirent64 *dir)
 {
-	struct ramfs_node *np, *dnp;
-	int i;
+	struct ramfs_node *np, *dnp = vp->v_data;
+	size_t i, pos;
 
-	uk_mutex_lock(&ramfs_lock);
+	uk_mutex_lock(&dnp->rn_lock);
 
-	set_times_to_now(&(((struct ramfs_node *) vp->v_data)->rn_atime),
-			 NULL, NULL);
+	set_times_to_now(&(dnp->rn_atime), NULL, NULL);
 
 	if (fp->f_offset == 0) {
 		dir->d_type = DT_DIR;
@@ -568,20 +832,25 @@ ramfs_readdir(struct vnode *vp, struct vfscore_file *fp, struct dirent64 *dir)
 		dir->d_type = DT_DIR;
 		strlcpy((char *) &dir->d_name, "..", sizeof(dir->d_name));
 	} else {
-		dnp = vp->v_data;
-		np = dnp->rn_child;
+		pos = fp->f_offset - 2;
+
+		/* Continue from the entry of the last call if possible */
+		if (dnp->rn_rdnode != NULL && dnp->rn_rdpos <= pos) {
+			np = dnp->rn_rdnode;
+			i = dnp->rn_rdpos;
+		} else {
+			np = dnp->rn_child;
+			i = 0;
+		}
+		for (; np != NULL && i != pos; i++)
+			np = np->rn_next;
 		if (np == NULL) {
-			uk_mutex_unlock(&ramfs_lock);
+			uk_mutex_unlock(&dnp->rn_lock);
 			return ENOENT;
 		}
+		dnp->rn_rdnode = np;
+		dnp->rn_rdpos = pos;
 
-		for (i = 0; i != (fp->f_offset - 2); i++) {
-			np = np->rn_next;
-			if (np == NULL) {
-				uk_mutex_unlock(&ramfs_lock);
-				return ENOENT;
-			}
-		}
 		if (np->rn_type == VDIR)
 			dir->d_type = DT_DIR;
 		else if (np->rn_type == VLNK)
@@ -596,7 +865,7 @@ ramfs_readdir(struct vnode *vp, struct vfscore_file *fp, struct dirent64 *dir)
 
 	fp->f_offset++;
 
-	uk_mutex_unlock(&ramfs_lock);
+	uk_mutex_unlock(&dnp->rn_lock);
 	return 0;
 }
 
@@ -68,6 +68,7 @@
 #include <errno.h>
 #include <stdarg.h>
 #include <uk/print.h>
+#include <uk/preempt.h>
 #include "legacy_syscall.h"
 
 #ifdef __cplusplus
@@ -263,6 +264,61 @@ typedef long uk_syscall_arg_t;
 #define __UK_SYSCALL_USC_PRINTD(...) do {} while(0)
 #endif /* CONFIG_LIBSYSCALL_SHIM_DEBUG || CONFIG_LIBUKDEBUG_PRINTD */
 
+#if CONFIG_LIBSYSCALL_SHIM_STATS
+#include <uk/plat/time.h>
+
+/* Every system call implementation places a descriptor into the
+ * `.uk_syscall_stats` section. The counters of a system call are found by
+ * the index of its descriptor.
+ */
+struct uk_syscall_stats_desc {
+	const char *name;
+};
+
+/* Latency buckets: bucket i counts calls that took [2^i, 2^(i+1))
+ * nanoseconds, the last one all calls that took longer.
+ */
+#define UK_SYSCALL_STATS_HIST_BUCKETS	24
+/* Binary system calls that no library provides are counted up to this
+ * number
+ */
+#define UK_SYSCALL_STATS_NR_MAX		512
+
+struct uk_syscall_stats {
+	__u64 count;
+	__u64 nsec;
+	__u64 hist[UK_SYSCALL_STATS_HIST_BUCKETS];
+};
+
+/**
+ * Sums up the statistics of a system call over all logical CPUs.
+ *
+ * @param name
+ *  Name of the system call, e.g., "read"
+ * @param dst
+ *  Destination of the statistics
+ * @return
+ *  0 on success, -ENOENT if no system call with this name is provided
+ */
+int uk_syscall_stats_get(const char *name, struct uk_syscall_stats *dst);
+
+void uk_syscall_stats_count(const struct uk_syscall_stats_desc *desc,
+			    __nsec since);
+void uk_syscall_stats_count_nosys(long nr);
+
+#define __UK_SYSCALL_STATS_START(sname)					\
+	static const struct uk_syscall_stats_desc			\
+	__used __section(".uk_syscall_stats")				\
+	__uk_syscall_stats_desc = { STRINGIFY(sname) };			\
+	__nsec __uk_syscall_stats_since = ukplat_monotonic_clock()
+#define __UK_SYSCALL_STATS_END()					\
+	uk_syscall_stats_count(&__uk_syscall_stats_desc,		\
+			       __uk_syscall_stats_since)
+#else /* !CONFIG_LIBSYSCALL_SHIM_STATS */
+#define __UK_SYSCALL_STATS_START(sname) do {} while (0)
+#define __UK_SYSCALL_STATS_END() do {} while (0)
+#endif /* !CONFIG_LIBSYSCALL_SHIM_STATS */
+
 /* System call implementation that uses errno and returns -1 on errors */
 /* TODO: `void` as return type is currently not supported.
  * NOTE: Workaround is to use `int` instead.
@@ -292,9 +348,12 @@ typedef long uk_syscall_arg_t;
 	{								\
 		long ret;						\
 									\
+		__UK_SYSCALL_STATS_START(name);				\
 		__UK_SYSCALL_PRINTD(x, rtype, ename, __VA_ARGS__);	\
 		ret = (long) __##ename(					\
 			UK_ARG_MAPx(x, UK_S_ARG_CAST_ACTUAL, __VA_ARGS__)); \
+		__UK_SYSCALL_STATS_END();				\
+		uk_preempt_point();					\
 		return ret;						\
 	}								\
 	static inline rtype __##ename(UK_ARG_MAPx(x,			\
@@ -372,9 +431,12 @@ typedef long uk_syscall_arg_t;
 	{								\
 		long ret;						\
 									\
+		__UK_SYSCALL_STATS_START(name);				\
 		__UK_SYSCALL_PRINTD(x, rtype, rname, __VA_ARGS__);	\
 		ret = (long) __##rname(					\
 			UK_ARG_MAPx(x, UK_S_ARG_CAST_ACTUAL, __VA_ARGS__)); \
+		__UK_SYSCALL_STATS_END();				\
+		uk_preempt_point();					\
 		return ret;						\
 	}								\
 	static inline rtype __##rname(UK_ARG_MAPx(x,			\
@@ -410,12 +472,15 @@ typedef long uk_syscall_arg_t;
 		struct uk_syscall_ctx *usc;				\
 		long ret;						\
 									\
+		__UK_SYSCALL_STATS_START(name);				\
 		usc = (struct uk_syscall_ctx *)_usc;			\
 		__UK_SYSCALL_USC_PRINTD(x, rtype, rname,		\
 					__VA_ARGS__);			\
 		ret = (long) __##rname(UK_USC_CALLMAPx(x,		\
 						   UK_S_ARG_ACTUAL,	\
 						   __VA_ARGS__));	\
+		__UK_SYSCALL_STATS_END();				\
+		uk_preempt_point();					\
 		return ret;						\
 	}								\
 	static inline rtype __used __##rname(UK_USC_DECLMAPx(		\
@@ -0,0 +1,39 @@
+BEGIN {
+	print "/* Automatically generated file; DO NOT EDIT */"
+	print "#ifndef __LIBSYSCALL_SHIM_ECTXSAFE_SYSCALLS_H__"
+	print "#define __LIBSYSCALL_SHIM_ECTXSAFE_SYSCALLS_H__"
+	print "\n#include <uk/syscall.h>"
+	print "#include \"arch/regmap_linuxabi.h\"\n"
+
+	# Handlers that take the system call context may switch threads or
+	# otherwise rely on the full context; only plain handlers qualify
+	print "/* Calls the handler of `usc` if it is extended register-safe."
+	print " * Returns 1 if it was called, 0 otherwise."
+	print " */"
+	print "static inline int uk_syscall6_r_ectxsafe(struct uk_syscall_ctx *usc)"
+	print "{"
+	print "\tswitch (usc->regs.rsyscall) {"
+}
+
+/[a-zA-Z0-9]+-[0-9]+/{
+	name = $1
+	args_nr = $2 + 0
+	printf "\n#if defined(HAVE_uk_syscall_%s) && !defined(HAVE_uk_syscall_u_%s)\n", name, name;
+	printf "\tcase SYS_%s:\n", name;
+	printf "\t\tusc->regs.rret0 = uk_syscall_r_%s(", name;
+	for (i = 0; i < args_nr - 1; i++)
+		printf("usc->regs.rarg%d, ", i)
+	if (args_nr > 0)
+		printf("usc->regs.rarg%d", args_nr - 1)
+	printf(");\n")
+	printf "\t\treturn 1;\n"
+	printf "#endif\n";
+}
+
+END {
+	print "\tdefault:"
+	print "\t\treturn 0;"
+	print "\t}"
+	print "}"
+	print "\n#endif /* __LIBSYSCALL_SHIM_ECTXSAFE_SYSCALLS_H__ */"
+}
@@ -38,10 +38,25 @@
 #include <uk/arch/ctx.h>
 #include <uk/assert.h>
 #include <uk/essentials.h>
+#include <uk/trace.h>
 #include "arch/regmap_linuxabi.h"
+#if CONFIG_LIBSYSCALL_SHIM_HANDLER_FASTPATH
+#include <uk/bits/syscall_ectxsafe.h>
+#endif /* CONFIG_LIBSYSCALL_SHIM_HANDLER_FASTPATH */
 #if CONFIG_LIBSYSCALL_SHIM_STRACE
 #include <uk/plat/console.h> /* ukplat_coutk */
 #endif /* CONFIG_LIBSYSCALL_SHIM_STRACE */
+#if CONFIG_LIBUKSIGNAL
+#include <uk/signal.h>
+#endif /* CONFIG_LIBUKSIGNAL */
+
+/* Only system calls that are not handled by the fast path are traced: the
+ * tracepoints would clobber the extended registers of the caller.
+ */
+UK_TRACEPOINT(trace_syscall_shim_enter, "nr=%lu arg0=%lx arg1=%lx arg2=%lx",
+	      unsigned long, unsigned long, unsigned long, unsigned long);
+UK_TRACEPOINT(trace_syscall_shim_exit, "nr=%lu ret=%ld", unsigned long,
+	      long);
 
 void ukplat_syscall_handler(struct uk_syscall_ctx *usc)
 {
@@ -56,11 +71,33 @@ void ukplat_syscall_handler(struct uk_syscall_ctx *usc)
 
 	UK_ASSERT(usc);
 
+	ukarch_sysregs_switch_uk(&usc->sysregs);
+
+#if CONFIG_LIBSYSCALL_SHIM_HANDLER_FASTPATH
+	/* Handlers that are built without extended registers leave the
+	 * extended register state of the caller intact: skip saving it.
+	 */
+	if (uk_syscall6_r_ectxsafe(usc)) {
+#if CONFIG_LIBUKSIGNAL
+		/* Signal handlers clobber the extended registers */
+		if (unlikely(uk_signal_pending())) {
+			ukarch_ectx_sanitize((struct ukarch_ectx *)&usc->ectx);
+			ukarch_ectx_store((struct ukarch_ectx *)&usc->ectx);
+			uk_signal_deliver(&usc->sysregs);
+			ukarch_ectx_load((struct ukarch_ectx *)&usc->ectx);
+		}
+#endif /* CONFIG_LIBUKSIGNAL */
+		ukarch_sysregs_switch_ul(&usc->sysregs);
+		return;
+	}
+#endif /* CONFIG_LIBSYSCALL_SHIM_HANDLER_FASTPATH */
+
 	/* Save extended register state */
 	ukarch_ectx_sanitize((struct ukarch_ectx *)&usc->ectx);
 	ukarch_ectx_store((struct ukarch_ectx *)&usc->ectx);
 
-	ukarch_sysregs_switch_uk(&usc->sysregs);
+	trace_syscall_shim_enter(usc->regs.rsyscall, usc->regs.rarg0,
+				 usc->regs.rarg1, usc->regs.rarg2);
 
 #if CONFIG_LIBSYSCALL_SHIM_DEBUG_HANDLER
 	_uk_printd(uk_libid_self(), __STR_BASENAME__, __LINE__,
@@ -70,8 +107,16 @@ void ukplat_syscall_handler(struct uk_syscall_ctx *usc)
 		    usc->regs.rarg1);
 #endif /* CONFIG_LIBSYSCALL_SHIM_DEBUG_HANDLER */
 
+#if CONFIG_LIBSYSCALL_SHIM_STATS
+	/* Provided system calls are counted by their implementation */
+	if (unlikely(!uk_syscall_name_p(usc->regs.rsyscall)))
+		uk_syscall_stats_count_nosys(usc->regs.rsyscall);
+#endif /* CONFIG_LIBSYSCALL_SHIM_STATS */
+
 	usc->regs.rret0 = uk_syscall6_r_u(usc);
 
+	trace_syscall_shim_exit(usc->regs.rsyscall, usc->regs.rret0);
+
 #if CONFIG_LIBSYSCALL_SHIM_STRACE
 	prsyscalllen = uk_snprsyscall(prsyscallbuf, ARRAY_SIZE(prsyscallbuf),
 #if CONFIG_LIBSYSCALL_SHIM_STRACE_ANSI_COLOR
@@ -90,8 +135,13 @@ void ukplat_syscall_handler(struct uk_syscall_ctx *usc)
 	ukplat_coutk(prsyscallbuf, (__sz) prsyscalllen);
 #endif /* CONFIG_LIBSYSCALL_SHIM_STRACE */
 
-	ukarch_sysregs_switch_ul(&usc->sysregs);
+#if CONFIG_LIBUKSIGNAL
+	if (unlikely(uk_signal_pending()))
+		uk_signal_deliver(&usc->sysregs);
+#endif /* CONFIG_LIBUKSIGNAL */
 
 	/* Restore extended register state */
 	ukarch_ectx_load((struct ukarch_ectx *)&usc->ectx);
+
+	ukarch_sysregs_switch_ul(&usc->sysregs);
 }
@@ -0,0 +1,395 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <uk/alloc.h>
+#include <uk/atomic.h>
+#include <uk/config.h>
+#include <uk/essentials.h>
+#include <uk/init.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/time.h>
+#include <uk/print.h>
+#include <uk/syscall.h>
+#if CONFIG_LIBUKSTORE
+#include <uk/store.h>
+#endif /* CONFIG_LIBUKSTORE */
+#if CONFIG_LIBDEVFS
+#include <vfscore/uio.h>
+#include <devfs/device.h>
+#endif /* CONFIG_LIBDEVFS */
+
+extern const struct uk_syscall_stats_desc uk_syscall_stats_start[];
+extern const struct uk_syscall_stats_desc uk_syscall_stats_end[];
+
+#define NR_SYSCALLS	((__sz)(uk_syscall_stats_end - uk_syscall_stats_start))
+
+/* Counters of a logical CPU. Only the lcpu itself updates them, with
+ * interrupts disabled. Readers on other lcpus may see slightly stale values.
+ */
+struct uk_syscall_stats_lcpu {
+	/* Indexed like the descriptors */
+	struct uk_syscall_stats *stats;
+	/* Binary system calls that no library provides, indexed by number */
+	__u64 *nosys;
+};
+
+static UKPLAT_PER_LCPU_DEFINE(struct uk_syscall_stats_lcpu,
+			      uk_syscall_stats_lcpu);
+
+static inline unsigned int uk_syscall_stats_hist_idx(__u64 nsec)
+{
+	unsigned int idx;
+
+	if (!nsec)
+		return 0;
+	idx = 63 - __builtin_clzll(nsec);
+	return MIN(idx, UK_SYSCALL_STATS_HIST_BUCKETS - 1U);
+}
+
+void uk_syscall_stats_count(const struct uk_syscall_stats_desc *desc,
+			    __nsec since)
+{
+	__u64 nsec = (__u64)(ukplat_monotonic_clock() - since);
+	struct uk_syscall_stats *stats;
+	unsigned long flags;
+
+	UK_ASSERT(desc >= uk_syscall_stats_start &&
+		  desc < uk_syscall_stats_end);
+
+	flags = ukplat_lcpu_save_irqf();
+	stats = ukplat_per_lcpu_current(uk_syscall_stats_lcpu).stats;
+	if (likely(stats)) {
+		stats += desc - uk_syscall_stats_start;
+		stats->count++;
+		stats->nsec += nsec;
+		stats->hist[uk_syscall_stats_hist_idx(nsec)]++;
+	}
+	ukplat_lcpu_restore_irqf(flags);
+}
+
+void uk_syscall_stats_count_nosys(long nr)
+{
+	unsigned long flags;
+	__u64 *nosys;
+
+	if (unlikely(nr < 0 || nr >= UK_SYSCALL_STATS_NR_MAX))
+		return;
+
+	flags = ukplat_lcpu_save_irqf();
+	nosys = ukplat_per_lcpu_current(uk_syscall_stats_lcpu).nosys;
+	if (likely(nosys))
+		nosys[nr]++;
+	ukplat_lcpu_restore_irqf(flags);
+}
+
+static const struct uk_syscall_stats_desc *uk_syscall_stats_find(
+							const char *name)
+{
+	const struct uk_syscall_stats_desc *desc;
+
+	for (desc = uk_syscall_stats_start; desc < uk_syscall_stats_end;
+	     desc++)
+		if (!strcmp(desc->name, name))
+			return desc;
+	return __NULL;
+}
+
+static void uk_syscall_stats_sum(const struct uk_syscall_stats_desc *desc,
+				 struct uk_syscall_stats *dst)
+{
+	struct uk_syscall_stats *stats;
+	unsigned int i, j;
+
+	memset(dst, 0, sizeof(*dst));
+	for (i = 0; i < CONFIG_UKPLAT_LCPU_MAXCOUNT; i++) {
+		stats = ukplat_per_lcpu(uk_syscall_stats_lcpu, i).stats;
+		if (!stats)
+			continue;
+
+		stats += desc - uk_syscall_stats_start;
+		dst->count += UK_READ_ONCE(stats->count);
+		dst->nsec += UK_READ_ONCE(stats->nsec);
+		for (j = 0; j < UK_SYSCALL_STATS_HIST_BUCKETS; j++)
+			dst->hist[j] += UK_READ_ONCE(stats->hist[j]);
+	}
+}
+
+int uk_syscall_stats_get(const char *name, struct uk_syscall_stats *dst)
+{
+	const struct uk_syscall_stats_desc *desc;
+
+	UK_ASSERT(name);
+	UK_ASSERT(dst);
+
+	desc = uk_syscall_stats_find(name);
+	if (!desc)
+		return -ENOENT;
+
+	uk_syscall_stats_sum(desc, dst);
+	return 0;
+}
+
+static __u64 uk_syscall_stats_nosys(long nr)
+{
+	__u64 *nosys;
+	__u64 count = 0;
+	unsigned int i;
+
+	for (i = 0; i < CONFIG_UKPLAT_LCPU_MAXCOUNT; i++) {
+		nosys = ukplat_per_lcpu(uk_syscall_stats_lcpu, i).nosys;
+		if (nosys)
+			count += UK_READ_ONCE(nosys[nr]);
+	}
+	return count;
+}
+
+#if CONFIG_LIBUKSTORE
+static int get_count(void *cookie, __u64 *out)
+{
+	struct uk_syscall_stats stats;
+
+	uk_syscall_stats_sum(cookie, &stats);
+	*out = stats.count;
+	return 0;
+}
+
+static int get_nsec(void *cookie, __u64 *out)
+{
+	struct uk_syscall_stats stats;
+
+	uk_syscall_stats_sum(cookie, &stats);
+	*out = stats.nsec;
+	return 0;
+}
+
+/* Histogram buckets are exposed as "nsec_<bucket>", e.g., "nsec_3" */
+#define HIST_GETTER(idx)						\
+	static int get_nsec_##idx(void *cookie, __u64 *out)		\
+	{								\
+		struct uk_syscall_stats stats;				\
+									\
+		uk_syscall_stats_sum(cookie, &stats);			\
+		*out = stats.hist[idx];					\
+		return 0;						\
+	}
+
+HIST_GETTER(0)  HIST_GETTER(1)  HIST_GETTER(2)  HIST_GETTER(3)
+HIST_GETTER(4)  HIST_GETTER(5)  HIST_GETTER(6)  HIST_GETTER(7)
+HIST_GETTER(8)  HIST_GETTER(9)  HIST_GETTER(10) HIST_GETTER(11)
+HIST_GETTER(12) HIST_GETTER(13) HIST_GETTER(14) HIST_GETTER(15)
+HIST_GETTER(16) HIST_GETTER(17) HIST_GETTER(18) HIST_GETTER(19)
+HIST_GETTER(20) HIST_GETTER(21) HIST_GETTER(22) HIST_GETTER(23)
+
+#define HIST_ENTRY(idx)							\
+	UK_STORE_ENTRY(2 + (idx), nsec_##idx, u64, get_nsec_##idx, NULL)
+
+static const struct uk_store_entry *dyn_entries[] = {
+	UK_STORE_ENTRY(0, count, u64, get_count, NULL),
+	UK_STORE_ENTRY(1, nsec, u64, get_nsec, NULL),
+	HIST_ENTRY(0),  HIST_ENTRY(1),  HIST_ENTRY(2),  HIST_ENTRY(3),
+	HIST_ENTRY(4),  HIST_ENTRY(5),  HIST_ENTRY(6),  HIST_ENTRY(7),
+	HIST_ENTRY(8),  HIST_ENTRY(9),  HIST_ENTRY(10), HIST_ENTRY(11),
+	HIST_ENTRY(12), HIST_ENTRY(13), HIST_ENTRY(14), HIST_ENTRY(15),
+	HIST_ENTRY(16), HIST_ENTRY(17), HIST_ENTRY(18), HIST_ENTRY(19),
+	HIST_ENTRY(20), HIST_ENTRY(21), HIST_ENTRY(22), HIST_ENTRY(23),
+	NULL
+};
+
+UK_CTASSERT(UK_SYSCALL_STATS_HIST_BUCKETS == 24);
+
+/* One object per system call, named like the system call */
+static int uk_syscall_stats_store_init(struct uk_alloc *a)
+{
+	const struct uk_syscall_stats_desc *desc;
+	struct uk_store_object *obj;
+	int rc;
+
+	for (desc = uk_syscall_stats_start; desc < uk_syscall_stats_end;
+	     desc++) {
+		obj = uk_store_obj_alloc(a, desc - uk_syscall_stats_start,
+					 desc->name, dyn_entries,
+					 (void *)desc);
+		if (unlikely(PTRISERR(obj)))
+			return PTR2ERR(obj);
+
+		rc = uk_store_obj_add(obj);
+		if (unlikely(rc))
+			return rc;
+	}
+	return 0;
+}
+#endif /* CONFIG_LIBUKSTORE */
+
+static int uk_syscall_stats_init(struct uk_init_ctx *ictx __unused)
+{
+	struct uk_alloc *a = uk_alloc_get_default();
+	struct uk_syscall_stats_lcpu *sl;
+	unsigned int i;
+#if CONFIG_LIBUKSTORE
+	int rc;
+#endif /* CONFIG_LIBUKSTORE */
+
+	/* Counters are allocated for all possible lcpus so that secondary
+	 * lcpus that are started later do not need to allocate.
+	 */
+	for (i = 0; i < CONFIG_UKPLAT_LCPU_MAXCOUNT; i++) {
+		sl = &ukplat_per_lcpu(uk_syscall_stats_lcpu, i);
+		sl->stats = uk_calloc(a, NR_SYSCALLS, sizeof(*sl->stats));
+		sl->nosys = uk_calloc(a, UK_SYSCALL_STATS_NR_MAX,
+				      sizeof(*sl->nosys));
+		if (unlikely(!sl->stats || !sl->nosys)) {
+			uk_pr_err("Failed to allocate system call statistics\n");
+			return -ENOMEM;
+		}
+	}
+
+#if CONFIG_LIBUKSTORE
+	rc = uk_syscall_stats_store_init(a);
+	if (unlikely(rc)) {
+		uk_pr_err("Failed to register system call statistics: %d\n",
+			  rc);
+		return rc;
+	}
+#endif /* CONFIG_LIBUKSTORE */
+	return 0;
+}
+
+uk_early_initcall(uk_syscall_stats_init, 0x0);
+
+#if CONFIG_LIBDEVFS
+#define DEV_SYSCALL_STATS_NAME	"syscall_stats"
+/* Upper bound of a line: name, three counters and all buckets */
+#define LINE_MAX_LEN	(32 + 3 * 21 + UK_SYSCALL_STATS_HIST_BUCKETS * 32)
+
+/* Generates one line per system call that was called at least once:
+ * name, calls, total and average latency in nanoseconds, followed by the
+ * non-empty latency buckets as `<upper bound>:<calls>`. Binary system calls
+ * that no library provides are listed with their number of calls only.
+ */
+static __ssz uk_syscall_stats_fmt(char *buf, __sz size)
+{
+	const struct uk_syscall_stats_desc *desc;
+	struct uk_syscall_stats stats;
+	const char *name;
+	__sz len = 0;
+	__u64 count;
+	unsigned int i;
+	long nr;
+
+	len += snprintf(buf + len, size - len,
+			"# name calls total_ns avg_ns [<ns:calls ...]\n");
+	for (desc = uk_syscall_stats_start; desc < uk_syscall_stats_end;
+	     desc++) {
+		uk_syscall_stats_sum(desc, &stats);
+		if (!stats.count)
+			continue;
+
+		len += snprintf(buf + len, size - len,
+				"%s %"__PRIu64" %"__PRIu64" %"__PRIu64,
+				desc->name, stats.count, stats.nsec,
+				stats.nsec / stats.count);
+		for (i = 0; i < UK_SYSCALL_STATS_HIST_BUCKETS; i++) {
+			if (!stats.hist[i])
+				continue;
+			if (i == UK_SYSCALL_STATS_HIST_BUCKETS - 1)
+				len += snprintf(buf + len, size - len,
+						" >=%"__PRIu64":%"__PRIu64,
+						(__u64)1 << i, stats.hist[i]);
+			else
+				len += snprintf(buf + len, size - len,
+						" <%"__PRIu64":%"__PRIu64,
+						(__u64)1 << (i + 1),
+						stats.hist[i]);
+		}
+		len += snprintf(buf + len, size - len, "\n");
+	}
+
+	for (nr = 0; nr < UK_SYSCALL_STATS_NR_MAX; nr++) {
+		count = uk_syscall_stats_nosys(nr);
+		if (!count)
+			continue;
+
+		name = uk_syscall_name(nr);
+		if (name)
+			len += snprintf(buf + len, size - len,
+					"%s(ENOSYS) %"__PRIu64"\n",
+					name, count);
+		else
+			len += snprintf(buf + len, size - len,
+					"#%ld(ENOSYS) %"__PRIu64"\n",
+					nr, count);
+	}
+	return len;
+}
+
+static int dev_syscall_stats_read(struct device *dev __unused,
+				  struct uio *uio, int flags __unused)
+{
+	struct uk_alloc *a = uk_alloc_get_default();
+	__sz size;
+	__ssz len;
+	char *buf;
+	int rc;
+
+	size = (NR_SYSCALLS + UK_SYSCALL_STATS_NR_MAX + 1) * LINE_MAX_LEN;
+	buf = uk_malloc(a, size);
+	if (unlikely(!buf))
+		return ENOMEM;
+
+	len = uk_syscall_stats_fmt(buf, size);
+	if (uio->uio_offset >= len) {
+		rc = 0;
+		goto out;
+	}
+
+	rc = vfscore_uiomove(buf + uio->uio_offset,
+			     MIN((__ssz)uio->uio_resid,
+				 len - (__ssz)uio->uio_offset), uio);
+out:
+	uk_free(a, buf);
+	return rc;
+}
+
+static int dev_syscall_stats_write(struct device *dev __unused,
+				   struct uio *uio __unused,
+				   int flags __unused)
+{
+	return EPERM;
+}
+
+static struct devops syscall_stats_devops = {
+	.open = dev_noop_open,
+	.close = dev_noop_close,
+	.read = dev_syscall_stats_read,
+	.write = dev_syscall_stats_write,
+	.ioctl = dev_noop_ioctl,
+};
+
+static struct driver drv_syscall_stats = {
+	.devops = &syscall_stats_devops,
+	.devsz = 0,
+	.name = DEV_SYSCALL_STATS_NAME
+};
+
+static int devfs_register(struct uk_init_ctx *ictx __unused)
+{
+	int rc;
+
+	rc = device_create(&drv_syscall_stats, DEV_SYSCALL_STATS_NAME, D_CHR,
+			   NULL);
+	if (unlikely(rc)) {
+		uk_pr_err("Failed to register '%s' to devfs: %d\n",
+			  DEV_SYSCALL_STATS_NAME, rc);
+		return -rc;
+	}
+	return 0;
+}
+
+devfs_initcall(devfs_register);
+#endif /* CONFIG_LIBDEVFS */
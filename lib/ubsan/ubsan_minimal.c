@@ -0,0 +1,167 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * Minimal UBSAN runtime
+ *
+ * Events are reported with the kind of check and the address of the
+ * instrumented code, which identifies the site and can be resolved with
+ * addr2line. Nothing of the data passed by the compiler is evaluated, so
+ * none of the formatting of the full runtime ends up in the image. Each site
+ * is reported once; sites are remembered in a bitmap indexed by a hash of
+ * their address.
+ *
+ * Clang emits calls to the dedicated handlers of its minimal runtime
+ * (-fsanitize-minimal-runtime) which take no arguments. GCC does not have
+ * a minimal runtime, so the regular handlers are defined instead and their
+ * arguments are ignored.
+ */
+
+#include <uk/arch/types.h>
+#include <uk/assert.h>
+#include <uk/essentials.h>
+#include <uk/print.h>
+
+#define UBSAN_SITES_SHIFT	12
+#define UBSAN_SITES		(1UL << UBSAN_SITES_SHIFT)
+#define UBSAN_SITES_PER_WORD	(sizeof(unsigned long) * 8)
+
+static unsigned long ubsan_sites[UBSAN_SITES / UBSAN_SITES_PER_WORD];
+
+#define __no_sanitize		__attribute__((no_sanitize("undefined")))
+#define __ubsan_cold		__attribute__((cold, noinline))
+
+static inline __no_sanitize unsigned long ubsan_site_hash(__uptr pc)
+{
+	return (unsigned long)(((__u64)pc * 0x9e3779b97f4a7c15ULL) >>
+			       (64 - UBSAN_SITES_SHIFT));
+}
+
+/* Returns 1 if this is the first event at the site */
+static inline __no_sanitize int ubsan_site_first(__uptr pc)
+{
+	unsigned long idx = ubsan_site_hash(pc);
+	unsigned long *word = &ubsan_sites[idx / UBSAN_SITES_PER_WORD];
+	unsigned long mask = 1UL << (idx % UBSAN_SITES_PER_WORD);
+
+	/* Sites that fire repeatedly take the plain load only */
+	if (__atomic_load_n(word, __ATOMIC_RELAXED) & mask)
+		return 0;
+	return !(__atomic_fetch_or(word, mask, __ATOMIC_RELAXED) & mask);
+}
+
+static void __ubsan_cold __no_sanitize
+ubsan_report(const char *kind, __uptr pc, int stop)
+{
+	if (stop)
+		UK_CRASH("Undefined behavior at pc 0x%"__PRIuptr": %s\n",
+			 pc, kind);
+
+	if (ubsan_site_first(pc))
+		uk_pr_err("Undefined behavior at pc 0x%"__PRIuptr": %s\n",
+			  pc, kind);
+}
+
+#define _UBSAN_PC	((__uptr)__builtin_return_address(0))
+
+#if defined(__clang__)
+#define _UBSAN_HANDLER(clang, gcc, sfx)					\
+	__ubsan_handle_##clang##_minimal##sfx
+#define _UBSAN_PARAMS(nargs)	void
+#else
+#define _UBSAN_HANDLER(clang, gcc, sfx)					\
+	__ubsan_handle_##gcc##sfx
+#define _UBSAN_PARAMS_1		void *a1 __unused
+#define _UBSAN_PARAMS_2		_UBSAN_PARAMS_1, void *a2 __unused
+#define _UBSAN_PARAMS_3		_UBSAN_PARAMS_2, void *a3 __unused
+#define _UBSAN_PARAMS(nargs)	UK_CONCAT(_UBSAN_PARAMS_, nargs)
+#endif
+
+/**
+ * Define the handlers of a recoverable event.
+ *
+ * @param clang Name of the event in the minimal runtime of clang
+ * @param gcc Name of the event in the regular runtime
+ * @param nargs Number of arguments of the regular handler
+ * @param kind Description of the check that failed
+ */
+#define UBSAN_MINIMAL_RECOVERABLE(clang, gcc, nargs, kind)		\
+	void __ubsan_cold __no_sanitize					\
+	_UBSAN_HANDLER(clang, gcc, )(_UBSAN_PARAMS(nargs))		\
+	{								\
+		ubsan_report(kind, _UBSAN_PC, 0);			\
+	}								\
+	void __ubsan_cold __no_sanitize					\
+	_UBSAN_HANDLER(clang, gcc, _abort)(_UBSAN_PARAMS(nargs))	\
+	{								\
+		ubsan_report(kind, _UBSAN_PC, 1);			\
+		__builtin_unreachable();				\
+	}
+
+/**
+ * Define the handler of an unrecoverable event.
+ *
+ * @param clang Name of the event in the minimal runtime of clang
+ * @param gcc Name of the event in the regular runtime
+ * @param nargs Number of arguments of the regular handler
+ * @param kind Description of the check that failed
+ */
+#define UBSAN_MINIMAL_UNRECOVERABLE(clang, gcc, nargs, kind)		\
+	void __ubsan_cold __no_sanitize					\
+	_UBSAN_HANDLER(clang, gcc, )(_UBSAN_PARAMS(nargs))		\
+	{								\
+		ubsan_report(kind, _UBSAN_PC, 1);			\
+		__builtin_unreachable();				\
+	}
+
+UBSAN_MINIMAL_RECOVERABLE(type_mismatch, type_mismatch_v1, 2,
+			  "type mismatch")
+UBSAN_MINIMAL_RECOVERABLE(add_overflow, add_overflow, 3,
+			  "add overflow")
+UBSAN_MINIMAL_RECOVERABLE(sub_overflow, sub_overflow, 3,
+			  "sub overflow")
+UBSAN_MINIMAL_RECOVERABLE(mul_overflow, mul_overflow, 3,
+			  "mul overflow")
+UBSAN_MINIMAL_RECOVERABLE(divrem_overflow, divrem_overflow, 3,
+			  "divrem overflow")
+UBSAN_MINIMAL_RECOVERABLE(negate_overflow, negate_overflow, 2,
+			  "negate overflow")
+UBSAN_MINIMAL_RECOVERABLE(pointer_overflow, pointer_overflow, 3,
+			  "pointer overflow")
+UBSAN_MINIMAL_RECOVERABLE(out_of_bounds, out_of_bounds, 2,
+			  "out of bounds")
+UBSAN_MINIMAL_RECOVERABLE(shift_out_of_bounds, shift_out_of_bounds, 3,
+			  "shift out of bounds")
+UBSAN_MINIMAL_RECOVERABLE(vla_bound_not_positive, vla_bound_not_positive, 2,
+			  "vla bound not positive")
+UBSAN_MINIMAL_RECOVERABLE(load_invalid_value, load_invalid_value, 2,
+			  "load invalid value")
+UBSAN_MINIMAL_RECOVERABLE(nonnull_arg, nonnull_arg, 1,
+			  "nonnull arg")
+UBSAN_MINIMAL_RECOVERABLE(nullability_arg, nullability_arg, 1,
+			  "nullability arg")
+UBSAN_MINIMAL_RECOVERABLE(nonnull_return, nonnull_return_v1, 2,
+			  "nonnull return")
+UBSAN_MINIMAL_RECOVERABLE(nullability_return, nullability_return_v1, 2,
+			  "nullability return")
+UBSAN_MINIMAL_RECOVERABLE(invalid_builtin, invalid_builtin, 1,
+			  "invalid builtin")
+UBSAN_MINIMAL_UNRECOVERABLE(builtin_unreachable, builtin_unreachable, 1,
+			    "builtin unreachable")
+UBSAN_MINIMAL_UNRECOVERABLE(missing_return, missing_return, 1,
+			    "missing return")
+
+#if defined(__clang__)
+/* Checks of -fsanitize=undefined that only clang implements */
+UBSAN_MINIMAL_RECOVERABLE(alignment_assumption, alignment_assumption, 3,
+			  "alignment assumption")
+UBSAN_MINIMAL_RECOVERABLE(float_cast_overflow, float_cast_overflow, 2,
+			  "float cast overflow")
+UBSAN_MINIMAL_RECOVERABLE(implicit_conversion, implicit_conversion, 3,
+			  "implicit conversion")
+UBSAN_MINIMAL_RECOVERABLE(function_type_mismatch, function_type_mismatch, 2,
+			  "function type mismatch")
+#endif /* __clang__ */
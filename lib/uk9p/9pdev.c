@@ -33,6 +33,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include <uk/config.h>
+#include <uk/plat/lcpu.h>
 #include <uk/plat/spinlock.h>
 #include <uk/alloc.h>
 #include <uk/essentials.h>
@@ -124,19 +125,44 @@ static void _fid_mgmt_cleanup(struct uk_9pdev_fid_mgmt *fid_mgmt)
 	ukplat_spin_unlock_irqrestore(&fid_mgmt->spinlock, flags);
 }
 
-static void _req_mgmt_init(struct uk_9pdev_req_mgmt *req_mgmt)
+static inline struct uk_list_head *
+_req_mgmt_bucket(struct uk_9pdev_req_mgmt *req_mgmt, uint16_t tag)
 {
+	return &req_mgmt->req_hash[tag & (UK_9PDEV_REQ_BUCKETS - 1)];
+}
+
+/* Channel of a tag. UK_9P_NOTAG belongs to the last channel. */
+static inline struct uk_9pdev_req_mgmt *
+_req_mgmt_of_tag(struct uk_9pdev *dev, uint16_t tag)
+{
+	unsigned int ch = tag / UK_9PDEV_CHANNEL_TAGS;
+
+	if (ch >= UK_9PDEV_CHANNELS)
+		ch = UK_9PDEV_CHANNELS - 1;
+	return &dev->_req_mgmt[ch];
+}
+
+static void _req_mgmt_init(struct uk_9pdev_req_mgmt *req_mgmt,
+			   unsigned int ch)
+{
+	int i;
+
 	ukarch_spin_init(&req_mgmt->spinlock);
-	uk_bitmap_zero(req_mgmt->tag_bm, UK_9P_NUMTAGS);
-	UK_INIT_LIST_HEAD(&req_mgmt->req_list);
+	req_mgmt->tag_base = ch * UK_9PDEV_CHANNEL_TAGS;
+	uk_bitmap_zero(req_mgmt->tag_bm, UK_9PDEV_CHANNEL_TAGS);
+	req_mgmt->next_tag = 0;
+	for (i = 0; i < UK_9PDEV_REQ_BUCKETS; i++)
+		UK_INIT_LIST_HEAD(&req_mgmt->req_hash[i]);
 	UK_INIT_LIST_HEAD(&req_mgmt->req_free_list);
 }
 
 static void _req_mgmt_add_req_locked(struct uk_9pdev_req_mgmt *req_mgmt,
 				struct uk_9preq *req)
 {
-	uk_bitmap_set(req_mgmt->tag_bm, req->tag, 1);
-	uk_list_add(&req->_list, &req_mgmt->req_list);
+	if (req->tag != UK_9P_NOTAG)
+		uk_bitmap_set(req_mgmt->tag_bm,
+			      req->tag - req_mgmt->tag_base, 1);
+	uk_list_add(&req->_list, _req_mgmt_bucket(req_mgmt, req->tag));
 }
 
 static struct uk_9preq *
@@ -157,7 +183,9 @@ _req_mgmt_from_freelist_locked(struct uk_9pdev_req_mgmt *req_mgmt)
 static void _req_mgmt_del_req_locked(struct uk_9pdev_req_mgmt *req_mgmt,
 				struct uk_9preq *req)
 {
-	uk_bitmap_clear(req_mgmt->tag_bm, req->tag, 1);
+	if (req->tag != UK_9P_NOTAG)
+		uk_bitmap_clear(req_mgmt->tag_bm,
+				req->tag - req_mgmt->tag_base, 1);
 	uk_list_del(&req->_list);
 }
 
@@ -167,9 +195,25 @@ static void _req_mgmt_req_to_freelist_locked(struct uk_9pdev_req_mgmt *req_mgmt,
 	uk_list_add(&req->_list, &req_mgmt->req_free_list);
 }
 
+/*
+ * Searches for a free tag from where the last search stopped, so that the
+ * bitmap is not scanned from the start on every request and a tag is not
+ * reused right after its request was removed.
+ */
 static uint16_t _req_mgmt_next_tag_locked(struct uk_9pdev_req_mgmt *req_mgmt)
 {
-	return uk_find_next_zero_bit(req_mgmt->tag_bm, UK_9P_NUMTAGS, 0);
+	unsigned long tag;
+
+	tag = uk_find_next_zero_bit(req_mgmt->tag_bm, UK_9PDEV_CHANNEL_TAGS,
+				    req_mgmt->next_tag);
+	if (tag >= UK_9PDEV_CHANNEL_TAGS)
+		tag = uk_find_next_zero_bit(req_mgmt->tag_bm,
+					    UK_9PDEV_CHANNEL_TAGS, 0);
+	if (unlikely(tag >= UK_9PDEV_CHANNEL_TAGS))
+		return UK_9P_NOTAG;
+
+	req_mgmt->next_tag = (tag + 1 < UK_9PDEV_CHANNEL_TAGS) ? tag + 1 : 0;
+	return req_mgmt->tag_base + tag;
 }
 
 static void _req_mgmt_cleanup(struct uk_9pdev_req_mgmt *req_mgmt __unused)
@@ -177,23 +221,28 @@ static void _req_mgmt_cleanup(struct uk_9pdev_req_mgmt *req_mgmt __unused)
 	unsigned long flags;
 	uint16_t tag;
 	struct uk_9preq *req, *reqn;
+	int i;
 
 	ukplat_spin_lock_irqsave(&req_mgmt->spinlock, flags);
-	uk_list_for_each_entry_safe(req, reqn, &req_mgmt->req_list, _list) {
-		tag = req->tag;
-		_req_mgmt_del_req_locked(req_mgmt, req);
-		if (!uk_9preq_put(req)) {
-			/* If in the future these references get released, mark
-			 * _dev as NULL so uk_9pdev_req_to_freelist doesn't
-			 * attempt to place them in an invalid memory region.
-			 *
-			 * As _dev is not used for any other purpose, this
-			 * doesn't impact any other logic related to 9p request
-			 * processing.
-			 */
-			req->_dev = NULL;
-			uk_pr_err("Tag %d still has references on cleanup.\n",
-				tag);
+	for (i = 0; i < UK_9PDEV_REQ_BUCKETS; i++) {
+		uk_list_for_each_entry_safe(req, reqn, &req_mgmt->req_hash[i],
+					    _list) {
+			tag = req->tag;
+			_req_mgmt_del_req_locked(req_mgmt, req);
+			if (!uk_9preq_put(req)) {
+				/* If in the future these references get
+				 * released, mark _dev as NULL so
+				 * uk_9pdev_req_to_freelist doesn't attempt to
+				 * place them in an invalid memory region.
+				 *
+				 * As _dev is not used for any other purpose,
+				 * this doesn't impact any other logic related
+				 * to 9p request processing.
+				 */
+				req->_dev = NULL;
+				uk_pr_err("Tag %d still has references on cleanup.\n",
+					  tag);
+			}
 		}
 	}
 	uk_list_for_each_entry_safe(req, reqn, &req_mgmt->req_free_list,
@@ -210,6 +259,7 @@ struct uk_9pdev *uk_9pdev_connect(const struct uk_9pdev_trans *trans,
 				struct uk_alloc *a)
 {
 	struct uk_9pdev *dev;
+	unsigned int ch;
 	int rc = 0;
 
 	UK_ASSERT(trans);
@@ -231,7 +281,8 @@ struct uk_9pdev *uk_9pdev_connect(const struct uk_9pdev_trans *trans,
 	uk_waitq_init(&dev->xmit_wq);
 #endif
 
-	_req_mgmt_init(&dev->_req_mgmt);
+	for (ch = 0; ch < UK_9PDEV_CHANNELS; ch++)
+		_req_mgmt_init(&dev->_req_mgmt[ch], ch);
 	_fid_mgmt_init(&dev->_fid_mgmt);
 
 	rc = dev->ops->connect(dev, device_identifier, mount_args);
@@ -251,7 +302,8 @@ struct uk_9pdev *uk_9pdev_connect(const struct uk_9pdev_trans *trans,
 
 free_dev:
 	_fid_mgmt_cleanup(&dev->_fid_mgmt);
-	_req_mgmt_cleanup(&dev->_req_mgmt);
+	for (ch = 0; ch < UK_9PDEV_CHANNELS; ch++)
+		_req_mgmt_cleanup(&dev->_req_mgmt[ch]);
 	uk_free(a, dev);
 out:
 	return ERR2PTR(rc);
@@ -259,6 +311,7 @@ out:
 
 int uk_9pdev_disconnect(struct uk_9pdev *dev)
 {
+	unsigned int ch;
 	int rc = 0;
 
 	UK_ASSERT(dev);
@@ -268,7 +321,8 @@ int uk_9pdev_disconnect(struct uk_9pdev *dev)
 
 	/* Clean up the requests before closing the channel. */
 	_fid_mgmt_cleanup(&dev->_fid_mgmt);
-	_req_mgmt_cleanup(&dev->_req_mgmt);
+	for (ch = 0; ch < UK_9PDEV_CHANNELS; ch++)
+		_req_mgmt_cleanup(&dev->_req_mgmt[ch]);
 
 	/*
 	 * Even if the disconnect from the transport layer fails, the memory
@@ -323,6 +377,7 @@ void uk_9pdev_xmit_notify(struct uk_9pdev *dev)
 
 struct uk_9preq *uk_9pdev_req_create(struct uk_9pdev *dev, uint8_t type)
 {
+	struct uk_9pdev_req_mgmt *req_mgmt;
 	struct uk_9preq *req;
 	int rc = 0;
 	uint16_t tag;
@@ -330,10 +385,17 @@ struct uk_9preq *uk_9pdev_req_create(struct uk_9pdev *dev, uint8_t type)
 
 	UK_ASSERT(dev);
 
-	ukplat_spin_lock_irqsave(&dev->_req_mgmt.spinlock, flags);
-	if (!(req = _req_mgmt_from_freelist_locked(&dev->_req_mgmt))) {
+	/* Tversion must be sent with UK_9P_NOTAG */
+	if (type == UK_9P_TVERSION)
+		req_mgmt = _req_mgmt_of_tag(dev, UK_9P_NOTAG);
+	else
+		req_mgmt = &dev->_req_mgmt[ukplat_lcpu_idx() %
+					   UK_9PDEV_CHANNELS];
+
+	ukplat_spin_lock_irqsave(&req_mgmt->spinlock, flags);
+	if (!(req = _req_mgmt_from_freelist_locked(req_mgmt))) {
 		/* Don't allocate with the spinlock held. */
-		ukplat_spin_unlock_irqrestore(&dev->_req_mgmt.spinlock, flags);
+		ukplat_spin_unlock_irqrestore(&req_mgmt->spinlock, flags);
 		req = uk_calloc(dev->a, 1, sizeof(*req));
 		if (req == NULL) {
 			rc = -ENOMEM;
@@ -346,7 +408,7 @@ struct uk_9preq *uk_9pdev_req_create(struct uk_9pdev *dev, uint8_t type)
 		 * _req_mgmt_cleanup.
 		 */
 		req->_a = dev->a;
-		ukplat_spin_lock_irqsave(&dev->_req_mgmt.spinlock, flags);
+		ukplat_spin_lock_irqsave(&req_mgmt->spinlock, flags);
 	}
 
 	uk_9preq_init(req);
@@ -364,13 +426,13 @@ struct uk_9preq *uk_9pdev_req_create(struct uk_9pdev *dev, uint8_t type)
 	if (type == UK_9P_TVERSION)
 		tag = UK_9P_NOTAG;
 	else
-		tag = _req_mgmt_next_tag_locked(&dev->_req_mgmt);
+		tag = _req_mgmt_next_tag_locked(req_mgmt);
 
 	req->tag = tag;
 	req->xmit.type = type;
 
-	_req_mgmt_add_req_locked(&dev->_req_mgmt, req);
-	ukplat_spin_unlock_irqrestore(&dev->_req_mgmt.spinlock, flags);
+	_req_mgmt_add_req_locked(req_mgmt, req);
+	ukplat_spin_unlock_irqrestore(&req_mgmt->spinlock, flags);
 
 	req->state = UK_9PREQ_INITIALIZED;
 
@@ -382,19 +444,20 @@ out:
 
 struct uk_9preq *uk_9pdev_req_lookup(struct uk_9pdev *dev, uint16_t tag)
 {
+	struct uk_9pdev_req_mgmt *req_mgmt = _req_mgmt_of_tag(dev, tag);
 	unsigned long flags;
 	struct uk_9preq *req;
 	int rc = -EINVAL;
 
-	ukplat_spin_lock_irqsave(&dev->_req_mgmt.spinlock, flags);
-	uk_list_for_each_entry(req, &dev->_req_mgmt.req_list, _list) {
+	ukplat_spin_lock_irqsave(&req_mgmt->spinlock, flags);
+	uk_list_for_each_entry(req, _req_mgmt_bucket(req_mgmt, tag), _list) {
 		if (tag != req->tag)
 			continue;
 		rc = 0;
 		uk_9preq_get(req);
 		break;
 	}
-	ukplat_spin_unlock_irqrestore(&dev->_req_mgmt.spinlock, flags);
+	ukplat_spin_unlock_irqrestore(&req_mgmt->spinlock, flags);
 
 	if (rc == 0)
 		return req;
@@ -404,25 +467,28 @@ struct uk_9preq *uk_9pdev_req_lookup(struct uk_9pdev *dev, uint16_t tag)
 
 int uk_9pdev_req_remove(struct uk_9pdev *dev, struct uk_9preq *req)
 {
+	struct uk_9pdev_req_mgmt *req_mgmt = _req_mgmt_of_tag(dev, req->tag);
 	unsigned long flags;
 
-	ukplat_spin_lock_irqsave(&dev->_req_mgmt.spinlock, flags);
-	_req_mgmt_del_req_locked(&dev->_req_mgmt, req);
-	ukplat_spin_unlock_irqrestore(&dev->_req_mgmt.spinlock, flags);
+	ukplat_spin_lock_irqsave(&req_mgmt->spinlock, flags);
+	_req_mgmt_del_req_locked(req_mgmt, req);
+	ukplat_spin_unlock_irqrestore(&req_mgmt->spinlock, flags);
 
 	return uk_9preq_put(req);
 }
 
 void uk_9pdev_req_to_freelist(struct uk_9pdev *dev, struct uk_9preq *req)
 {
+	struct uk_9pdev_req_mgmt *req_mgmt;
 	unsigned long flags;
 
 	if (!dev)
 		return;
 
-	ukplat_spin_lock_irqsave(&dev->_req_mgmt.spinlock, flags);
-	_req_mgmt_req_to_freelist_locked(&dev->_req_mgmt, req);
-	ukplat_spin_unlock_irqrestore(&dev->_req_mgmt.spinlock, flags);
+	req_mgmt = _req_mgmt_of_tag(dev, req->tag);
+	ukplat_spin_lock_irqsave(&req_mgmt->spinlock, flags);
+	_req_mgmt_req_to_freelist_locked(req_mgmt, req);
+	ukplat_spin_unlock_irqrestore(&req_mgmt->spinlock, flags);
 }
 
 struct uk_9pfid *uk_9pdev_fid_create(struct uk_9pdev *dev)
@@ -264,6 +264,104 @@ int64_t uk_9p_read(struct uk_9pdev *dev, struct uk_9pfid *fid,
 int64_t uk_9p_write(struct uk_9pdev *dev, struct uk_9pfid *fid,
 		uint64_t offset, uint32_t count, const char *buf);
 
+/**
+ * Returns the maximum number of bytes a single read request on the fid can
+ * transfer, as limited by the I/O unit of the fid and the message size of
+ * the device.
+ */
+static inline uint32_t uk_9p_read_iosize(struct uk_9pdev *dev,
+		struct uk_9pfid *fid)
+{
+	uint32_t size = uk_9pdev_get_msize(dev) - 11;
+
+	return (fid->iounit != 0 && fid->iounit < size) ? fid->iounit : size;
+}
+
+/**
+ * Returns the maximum number of bytes a single write request on the fid
+ * can transfer.
+ */
+static inline uint32_t uk_9p_write_iosize(struct uk_9pdev *dev,
+		struct uk_9pfid *fid)
+{
+	uint32_t size = uk_9pdev_get_msize(dev) - 23;
+
+	return (fid->iounit != 0 && fid->iounit < size) ? fid->iounit : size;
+}
+
+/**
+ * Sends a read request like uk_9p_read() without waiting for the reply.
+ * Multiple requests may be outstanding on the same fid; each one gets its
+ * own tag. The request must be completed with uk_9p_read_finish(), which
+ * is the earliest point the buffer may be accessed again.
+ *
+ * @param dev
+ *   The Unikraft 9P Device.
+ * @param fid
+ *   9P fid to read from.
+ * @param offset
+ *   Offset at which to start reading.
+ * @param count
+ *   Maximum number of bytes to read, at most uk_9p_read_iosize().
+ * @param buf
+ *   Buffer to read into.
+ * @return
+ *   - (!ERRPTR): The sent request.
+ *   - ERRPTR: The request could not be sent.
+ */
+struct uk_9preq *uk_9p_read_start(struct uk_9pdev *dev, struct uk_9pfid *fid,
+		uint64_t offset, uint32_t count, char *buf);
+
+/**
+ * Waits for the reply to a request sent with uk_9p_read_start() and
+ * removes the request.
+ *
+ * @param dev
+ *   The Unikraft 9P Device.
+ * @param req
+ *   The request returned by uk_9p_read_start().
+ * @return
+ *   - (>= 0): Amount of bytes read.
+ *   - (< 0): An error occurred.
+ */
+int64_t uk_9p_read_finish(struct uk_9pdev *dev, struct uk_9preq *req);
+
+/**
+ * Sends a write request like uk_9p_write() without waiting for the reply.
+ * The request must be completed with uk_9p_write_finish(); the buffer must
+ * not be modified before.
+ *
+ * @param dev
+ *   The Unikraft 9P Device.
+ * @param fid
+ *   9P fid to write to.
+ * @param offset
+ *   Offset at which to start writing.
+ * @param count
+ *   Maximum number of bytes to write, at most uk_9p_write_iosize().
+ * @param buf
+ *   Data to be written.
+ * @return
+ *   - (!ERRPTR): The sent request.
+ *   - ERRPTR: The request could not be sent.
+ */
+struct uk_9preq *uk_9p_write_start(struct uk_9pdev *dev, struct uk_9pfid *fid,
+		uint64_t offset, uint32_t count, const char *buf);
+
+/**
+ * Waits for the reply to a request sent with uk_9p_write_start() and
+ * removes the request.
+ *
+ * @param dev
+ *   The Unikraft 9P Device.
+ * @param req
+ *   The request returned by uk_9p_write_start().
+ * @return
+ *   - (>= 0): Amount of bytes written.
+ *   - (< 0): An error occurred.
+ */
+int64_t uk_9p_write_finish(struct uk_9pdev *dev, struct uk_9preq *req);
+
 /**
  * Stats the given fid and places the data into the given stat structure.
  *
@@ -109,15 +109,46 @@ struct uk_9pdev_trans_ops {
 
 /**
  * @internal
- * A structure used for 9p requests' management.
+ * Number of buckets of the request hash table, a power of two. Tags are
+ * handed out in ascending order, so that the requests in flight spread
+ * evenly over the buckets as long as there are fewer of them.
+ */
+#define UK_9PDEV_REQ_BUCKETS	64
+
+/**
+ * @internal
+ * Number of request channels. Every channel manages its own range of tags
+ * under its own lock, and a logical CPU creates its requests on channel
+ * (lcpu % UK_9PDEV_CHANNELS), so that CPUs do not contend for one lock.
+ */
+#if CONFIG_LIBUK9P_CHANNELS
+#define UK_9PDEV_CHANNELS	CONFIG_LIBUK9P_CHANNELS
+#else /* !CONFIG_LIBUK9P_CHANNELS */
+#define UK_9PDEV_CHANNELS	1
+#endif /* !CONFIG_LIBUK9P_CHANNELS */
+
+/**
+ * @internal
+ * Number of tags of a channel. UK_9P_NOTAG is not part of any range.
+ */
+#define UK_9PDEV_CHANNEL_TAGS	(UK_9P_NOTAG / UK_9PDEV_CHANNELS)
+
+/**
+ * @internal
+ * A structure used for 9p requests' management of a channel.
  */
 struct uk_9pdev_req_mgmt {
 	/* Spinlock protecting this data. */
 	__spinlock                      spinlock;
-	/* Bitmap of available tags. */
-	unsigned long                   tag_bm[UK_BITS_TO_LONGS(UK_9P_NUMTAGS)];
-	/* List of requests allocated and not yet removed. */
-	struct uk_list_head             req_list;
+	/* First tag of the channel. */
+	uint16_t                        tag_base;
+	/* Bitmap of available tags, relative to tag_base. */
+	unsigned long                   tag_bm[UK_BITS_TO_LONGS(
+						UK_9PDEV_CHANNEL_TAGS)];
+	/* Tag at which the search for a free tag starts, relative. */
+	uint16_t                        next_tag;
+	/* Requests allocated and not yet removed, hashed by their tag. */
+	struct uk_list_head             req_hash[UK_9PDEV_REQ_BUCKETS];
 	/* Free-list of requests. */
 	struct uk_list_head		req_free_list;
 };
@@ -173,8 +204,8 @@ struct uk_9pdev {
 	void                            *priv;
 	/* @internal Fid management. */
 	struct uk_9pdev_fid_mgmt	_fid_mgmt;
-	/* @internal Request management. */
-	struct uk_9pdev_req_mgmt        _req_mgmt;
+	/* @internal Request management, per channel. */
+	struct uk_9pdev_req_mgmt        _req_mgmt[UK_9PDEV_CHANNELS];
 #if CONFIG_LIBUKSCHED
 	/*
 	 * Slept on by threads waiting for their turn for enough space to send
@@ -70,6 +70,29 @@ int uk_alloc_register(struct uk_alloc *a)
 	return 0;
 }
 
+int uk_alloc_set_default(struct uk_alloc *a)
+{
+	struct uk_alloc *this = _uk_alloc_head;
+	struct uk_alloc *prev = __NULL;
+
+	UK_ASSERT(a);
+
+	while (this && this != a) {
+		prev = this;
+		this = this->next;
+	}
+	if (!this)
+		return -ENOENT;
+
+	/* Move the allocator to the head of the list */
+	if (prev) {
+		prev->next = a->next;
+		a->next = _uk_alloc_head;
+		_uk_alloc_head = a;
+	}
+	return 0;
+}
+
 #ifdef CONFIG_HAVE_MEMTAG
 #define __align_metadata_ifpages __align(MEMTAG_GRANULE)
 #else
@@ -503,7 +526,7 @@ void uk_pfree_compat(struct uk_alloc *a, void *ptr,
 	/* if the object is not page aligned it was clearly not from us */
 	UK_ASSERT(page_off(ptr) == 0);
 
-	uk_free(a, ptr);
+	uk_do_free(a, ptr);
 }
 
 void *uk_palloc_compat(struct uk_alloc *a, unsigned long num_pages)
@@ -516,7 +539,7 @@ void *uk_palloc_compat(struct uk_alloc *a, unsigned long num_pages)
 	if (num_pages > (~(__sz)0)/__PAGE_SIZE)
 		return __NULL;
 
-	if (uk_posix_memalign(a, &ptr, __PAGE_SIZE, num_pages * __PAGE_SIZE))
+	if (uk_do_posix_memalign(a, &ptr, __PAGE_SIZE, num_pages * __PAGE_SIZE))
 		return __NULL;
 
 	return ptr;
@@ -528,20 +551,20 @@ void *uk_realloc_compat(struct uk_alloc *a, void *ptr, __sz size)
 
 	UK_ASSERT(a);
 	if (!ptr)
-		return uk_malloc(a, size);
+		return uk_do_malloc(a, size);
 
 	if (!size) {
-		uk_free(a, ptr);
+		uk_do_free(a, ptr);
 		return __NULL;
 	}
 
-	retptr = uk_malloc(a, size);
+	retptr = uk_do_malloc(a, size);
 	if (!retptr)
 		return __NULL;
 
 	memcpy(retptr, ptr, size);
 
-	uk_free(a, ptr);
+	uk_do_free(a, ptr);
 	return retptr;
 }
 
@@ -555,7 +578,7 @@ void *uk_calloc_compat(struct uk_alloc *a, __sz nmemb, __sz size)
 		return __NULL;
 
 	UK_ASSERT(a);
-	ptr = uk_malloc(a, tlen);
+	ptr = uk_do_malloc(a, tlen);
 	if (!ptr)
 		return __NULL;
 
@@ -568,7 +591,7 @@ void *uk_memalign_compat(struct uk_alloc *a, __sz align, __sz size)
 	void *ptr;
 
 	UK_ASSERT(a);
-	if (uk_posix_memalign(a, &ptr, align, size) != 0)
+	if (uk_do_posix_memalign(a, &ptr, align, size) != 0)
 		return __NULL;
 
 	return ptr;
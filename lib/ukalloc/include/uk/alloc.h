@@ -39,6 +39,9 @@
 #include <uk/assert.h>
 #include <uk/essentials.h>
 #include <errno.h>
+#if CONFIG_LIBUKALLOC_IFSTATS_HIST
+#include <uk/plat/time.h>
+#endif /* CONFIG_LIBUKALLOC_IFSTATS_HIST */
 
 #ifdef __cplusplus
 extern "C" {
@@ -70,6 +73,11 @@ typedef long  (*uk_alloc_getpsize_func_t)
 		(struct uk_alloc *a);
 
 #if CONFIG_LIBUKALLOC_IFSTATS
+#if CONFIG_LIBUKALLOC_IFSTATS_HIST
+/* Number of buckets of the log2 histograms */
+#define UK_ALLOC_STATS_HIST_BUCKETS 32
+#endif /* CONFIG_LIBUKALLOC_IFSTATS_HIST */
+
 struct uk_alloc_stats {
 	__sz last_alloc_size; /* size of the last allocation */
 	__sz max_alloc_size; /* biggest satisfied allocation size */
@@ -84,6 +92,18 @@ struct uk_alloc_stats {
 	__ssz max_mem_use; /* maximum amount of memory used by allocations */
 
 	__u64 nb_enomem; /* number of times failing allocation requests */
+
+#if CONFIG_LIBUKALLOC_IFSTATS_HIST
+	/* Bucket i counts values in [2^i, 2^(i+1)), the first bucket also
+	 * counts 0 and the last bucket all values beyond its range
+	 */
+	__u64 alloc_size_hist[UK_ALLOC_STATS_HIST_BUCKETS]; /* bytes */
+	__u64 alloc_nsec_hist[UK_ALLOC_STATS_HIST_BUCKETS]; /* per allocation */
+	__u64 free_nsec_hist[UK_ALLOC_STATS_HIST_BUCKETS];  /* per free */
+
+	__u64 tot_alloc_nsec; /* total time spent in allocation requests */
+	__u64 tot_free_nsec;  /* total time spent in free requests */
+#endif /* CONFIG_LIBUKALLOC_IFSTATS_HIST */
 };
 #endif /* CONFIG_LIBUKALLOC_IFSTATS */
 
@@ -138,37 +158,135 @@ static inline struct uk_alloc *uk_alloc_get_default(void)
 }
 #endif /* !CONFIG_LIBUKALLOC_IFSTATS_PERLIB */
 
+/**
+ * Makes a registered allocator the default allocator, for instance an
+ * allocator that is stacked on top of the previous default.
+ *
+ * @param a
+ *  Registered allocator
+ * @return
+ *  0 on success, -ENOENT if `a` is not registered
+ */
+int uk_alloc_set_default(struct uk_alloc *a);
+
+#if CONFIG_LIBUKALLOC_IFSTATS_HIST
+/* NOTE: Please do not use these functions directly */
+void _uk_alloc_stats_count_nsec(struct uk_alloc *a, __u64 since, int is_free);
+
+#define _uk_alloc_stats_nsec_start()				\
+	((__u64) ukplat_monotonic_clock())
+#define _uk_alloc_stats_nsec_end(a, since, is_free)		\
+	_uk_alloc_stats_count_nsec((a), (since), (is_free))
+#else /* !CONFIG_LIBUKALLOC_IFSTATS_HIST */
+#define _uk_alloc_stats_nsec_start() ((__u64) 0)
+#define _uk_alloc_stats_nsec_end(a, since, is_free)		\
+	do { (void) (since); } while (0)
+#endif /* !CONFIG_LIBUKALLOC_IFSTATS_HIST */
+
+#if CONFIG_LIBUKALLOC_DIRECT
+/*
+ * Calls are bound to the backend of the boot allocator at compile time:
+ * a wrapper compares the allocator's operation with the backend's function
+ * and, if they match, calls the function directly. This keeps indirect
+ * calls (and retpolines) off the fast path and lets LTO inline the
+ * backend. Other allocators, e.g., stacked ones, are still called through
+ * their function pointers.
+ */
+#if CONFIG_LIBUKBOOT_INITBBUDDY
+void *uk_malloc_ifpages(struct uk_alloc *a, __sz size);
+void *uk_calloc_compat(struct uk_alloc *a, __sz nmemb, __sz size);
+void *uk_realloc_ifpages(struct uk_alloc *a, void *ptr, __sz size);
+int uk_posix_memalign_ifpages(struct uk_alloc *a, void **memptr,
+			      __sz align, __sz size);
+void *uk_memalign_compat(struct uk_alloc *a, __sz align, __sz size);
+void uk_free_ifpages(struct uk_alloc *a, void *ptr);
+void *uk_allocbbuddy_palloc(struct uk_alloc *a, unsigned long num_pages);
+void uk_allocbbuddy_pfree(struct uk_alloc *a, void *ptr,
+			  unsigned long num_pages);
+
+#define __UK_ALLOC_DIRECT_malloc		uk_malloc_ifpages
+#define __UK_ALLOC_DIRECT_calloc		uk_calloc_compat
+#define __UK_ALLOC_DIRECT_realloc		uk_realloc_ifpages
+#define __UK_ALLOC_DIRECT_posix_memalign	uk_posix_memalign_ifpages
+#define __UK_ALLOC_DIRECT_memalign		uk_memalign_compat
+#define __UK_ALLOC_DIRECT_free			uk_free_ifpages
+#define __UK_ALLOC_DIRECT_palloc		uk_allocbbuddy_palloc
+#define __UK_ALLOC_DIRECT_pfree			uk_allocbbuddy_pfree
+#elif CONFIG_LIBUKBOOT_INITREGION
+void *uk_allocregion_malloc(struct uk_alloc *a, __sz size);
+void *uk_calloc_compat(struct uk_alloc *a, __sz nmemb, __sz size);
+void *uk_realloc_compat(struct uk_alloc *a, void *ptr, __sz size);
+int uk_allocregion_posix_memalign(struct uk_alloc *a, void **memptr,
+				  __sz align, __sz size);
+void *uk_memalign_compat(struct uk_alloc *a, __sz align, __sz size);
+void uk_allocregion_free(struct uk_alloc *a, void *ptr);
+void *uk_palloc_compat(struct uk_alloc *a, unsigned long num_pages);
+void uk_pfree_compat(struct uk_alloc *a, void *ptr, unsigned long num_pages);
+
+#define __UK_ALLOC_DIRECT_malloc		uk_allocregion_malloc
+#define __UK_ALLOC_DIRECT_calloc		uk_calloc_compat
+#define __UK_ALLOC_DIRECT_realloc		uk_realloc_compat
+#define __UK_ALLOC_DIRECT_posix_memalign	uk_allocregion_posix_memalign
+#define __UK_ALLOC_DIRECT_memalign		uk_memalign_compat
+#define __UK_ALLOC_DIRECT_free			uk_allocregion_free
+#define __UK_ALLOC_DIRECT_palloc		uk_palloc_compat
+#define __UK_ALLOC_DIRECT_pfree			uk_pfree_compat
+#else
+#error "LIBUKALLOC_DIRECT requires the boot allocator to be bbuddy or region"
+#endif
+
+#define __uk_alloc_call(a, op, ...)					\
+	(likely((a)->op == __UK_ALLOC_DIRECT_##op)			\
+	 ? __UK_ALLOC_DIRECT_##op((a), __VA_ARGS__)			\
+	 : (a)->op((a), __VA_ARGS__))
+#else /* !CONFIG_LIBUKALLOC_DIRECT */
+#define __uk_alloc_call(a, op, ...)					\
+	(a)->op((a), __VA_ARGS__)
+#endif /* !CONFIG_LIBUKALLOC_DIRECT */
+
 /* wrapper functions */
 static inline void *uk_do_malloc(struct uk_alloc *a, __sz size)
 {
 	UK_ASSERT(a);
-	return a->malloc(a, size);
+	return __uk_alloc_call(a, malloc, size);
 }
 
 static inline void *uk_malloc(struct uk_alloc *a, __sz size)
 {
+	__u64 since;
+	void *ret;
+
 	if (unlikely(!a)) {
 		errno = ENOMEM;
 		return __NULL;
 	}
-	return uk_do_malloc(a, size);
+	since = _uk_alloc_stats_nsec_start();
+	ret = uk_do_malloc(a, size);
+	_uk_alloc_stats_nsec_end(a, since, 0);
+	return ret;
 }
 
 static inline void *uk_do_calloc(struct uk_alloc *a,
 				 __sz nmemb, __sz size)
 {
 	UK_ASSERT(a);
-	return a->calloc(a, nmemb, size);
+	return __uk_alloc_call(a, calloc, nmemb, size);
 }
 
 static inline void *uk_calloc(struct uk_alloc *a,
 			      __sz nmemb, __sz size)
 {
+	__u64 since;
+	void *ret;
+
 	if (unlikely(!a)) {
 		errno = ENOMEM;
 		return __NULL;
 	}
-	return uk_do_calloc(a, nmemb, size);
+	since = _uk_alloc_stats_nsec_start();
+	ret = uk_do_calloc(a, nmemb, size);
+	_uk_alloc_stats_nsec_end(a, since, 0);
+	return ret;
 }
 
 #define uk_do_zalloc(a, size) uk_do_calloc((a), 1, (size))
@@ -178,85 +296,117 @@ static inline void *uk_do_realloc(struct uk_alloc *a,
 				  void *ptr, __sz size)
 {
 	UK_ASSERT(a);
-	return a->realloc(a, ptr, size);
+	return __uk_alloc_call(a, realloc, ptr, size);
 }
 
 static inline void *uk_realloc(struct uk_alloc *a, void *ptr, __sz size)
 {
+	__u64 since;
+	void *ret;
+
 	if (unlikely(!a)) {
 		errno = ENOMEM;
 		return __NULL;
 	}
-	return uk_do_realloc(a, ptr, size);
+	since = _uk_alloc_stats_nsec_start();
+	ret = uk_do_realloc(a, ptr, size);
+	_uk_alloc_stats_nsec_end(a, since, 0);
+	return ret;
 }
 
 static inline int uk_do_posix_memalign(struct uk_alloc *a, void **memptr,
 				       __sz align, __sz size)
 {
 	UK_ASSERT(a);
-	return a->posix_memalign(a, memptr, align, size);
+	return __uk_alloc_call(a, posix_memalign, memptr, align, size);
 }
 
 static inline int uk_posix_memalign(struct uk_alloc *a, void **memptr,
 				    __sz align, __sz size)
 {
+	__u64 since;
+	int ret;
+
 	if (unlikely(!a)) {
 		*memptr = __NULL;
 		return ENOMEM;
 	}
-	return uk_do_posix_memalign(a, memptr, align, size);
+	since = _uk_alloc_stats_nsec_start();
+	ret = uk_do_posix_memalign(a, memptr, align, size);
+	_uk_alloc_stats_nsec_end(a, since, 0);
+	return ret;
 }
 
 static inline void *uk_do_memalign(struct uk_alloc *a,
 				   __sz align, __sz size)
 {
 	UK_ASSERT(a);
-	return a->memalign(a, align, size);
+	return __uk_alloc_call(a, memalign, align, size);
 }
 
 static inline void *uk_memalign(struct uk_alloc *a,
 				__sz align, __sz size)
 {
+	__u64 since;
+	void *ret;
+
 	if (unlikely(!a))
 		return __NULL;
-	return uk_do_memalign(a, align, size);
+	since = _uk_alloc_stats_nsec_start();
+	ret = uk_do_memalign(a, align, size);
+	_uk_alloc_stats_nsec_end(a, since, 0);
+	return ret;
 }
 
 static inline void uk_do_free(struct uk_alloc *a, void *ptr)
 {
 	UK_ASSERT(a);
-	a->free(a, ptr);
+	__uk_alloc_call(a, free, ptr);
 }
 
 static inline void uk_free(struct uk_alloc *a, void *ptr)
 {
+	__u64 since;
+
+	since = _uk_alloc_stats_nsec_start();
 	uk_do_free(a, ptr);
+	_uk_alloc_stats_nsec_end(a, since, 1);
 }
 
 static inline void *uk_do_palloc(struct uk_alloc *a, unsigned long num_pages)
 {
 	UK_ASSERT(a);
-	return a->palloc(a, num_pages);
+	return __uk_alloc_call(a, palloc, num_pages);
 }
 
 static inline void *uk_palloc(struct uk_alloc *a, unsigned long num_pages)
 {
+	__u64 since;
+	void *ret;
+
 	if (unlikely(!a || !a->palloc))
 		return __NULL;
-	return uk_do_palloc(a, num_pages);
+	since = _uk_alloc_stats_nsec_start();
+	ret = uk_do_palloc(a, num_pages);
+	_uk_alloc_stats_nsec_end(a, since, 0);
+	return ret;
 }
 
 static inline void uk_do_pfree(struct uk_alloc *a, void *ptr,
 			       unsigned long num_pages)
 {
 	UK_ASSERT(a);
-	a->pfree(a, ptr, num_pages);
+	__uk_alloc_call(a, pfree, ptr, num_pages);
 }
 
 static inline void uk_pfree(struct uk_alloc *a, void *ptr,
 			    unsigned long num_pages)
 {
+	__u64 since;
+
+	since = _uk_alloc_stats_nsec_start();
 	uk_do_pfree(a, ptr, num_pages);
+	_uk_alloc_stats_nsec_end(a, since, 1);
 }
 
 static inline int uk_alloc_addmem(struct uk_alloc *a, void *base,
@@ -317,6 +467,32 @@ void uk_alloc_stats_get(struct uk_alloc *a, struct uk_alloc_stats *dst);
 void uk_alloc_stats_get_global(struct uk_alloc_stats *dst);
 #endif /* CONFIG_LIBUKALLOC_IFSTATS_GLOBAL */
 
+/**
+ * Prints allocator statistics, including the size and latency histograms
+ * if they are enabled, to the kernel console
+ *
+ * @param klvl
+ *  Kernel message level (e.g., KLVL_INFO)
+ * @param name
+ *  Name that is printed as heading
+ * @param stats
+ *  Statistics to print, e.g., as returned by `uk_alloc_stats_get()`
+ */
+void uk_alloc_stats_dumpk(int klvl, const char *name,
+			  const struct uk_alloc_stats *stats);
+
+/**
+ * Prints the statistics of all registered allocators, the global statistics
+ * and the per-library statistics, depending on which ones are enabled
+ *
+ * @param klvl
+ *  Kernel message level (e.g., KLVL_INFO)
+ */
+void uk_alloc_stats_dumpk_all(int klvl);
+
+#define uk_alloc_stats_dump() \
+	uk_alloc_stats_dumpk_all(KLVL_INFO)
+
 #if CONFIG_LIBUKALLOC_IFSTATS_PERLIB
 struct uk_alloc_libstats_entry {
 	const char *libname;
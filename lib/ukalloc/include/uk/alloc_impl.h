@@ -89,6 +89,24 @@ long uk_alloc_pmaxalloc_compat(struct uk_alloc *a);
 extern struct uk_alloc_stats _uk_alloc_stats_global;
 #endif /* CONFIG_LIBUKALLOC_IFSTATS_GLOBAL */
 
+#if CONFIG_LIBUKALLOC_IFSTATS_HIST
+/* NOTE: Please do not use this function directly */
+static inline unsigned int _uk_alloc_stats_hist_idx(__u64 val)
+{
+	unsigned int idx;
+
+	if (!val)
+		return 0;
+	idx = (unsigned int) (63 - __builtin_clzll(val));
+	return MIN(idx, (unsigned int) UK_ALLOC_STATS_HIST_BUCKETS - 1);
+}
+
+#define _uk_alloc_stats_count_size(stats, size)				\
+	((stats)->alloc_size_hist[_uk_alloc_stats_hist_idx(size)]++)
+#else /* !CONFIG_LIBUKALLOC_IFSTATS_HIST */
+#define _uk_alloc_stats_count_size(stats, size) do {} while (0)
+#endif /* !CONFIG_LIBUKALLOC_IFSTATS_HIST */
+
 /* NOTE: Please do not use this function directly */
 static inline void _uk_alloc_stats_refresh_minmax(struct uk_alloc_stats *stats)
 {
@@ -122,6 +140,7 @@ static inline void _uk_alloc_stats_count_alloc(struct uk_alloc_stats *stats,
 		stats->cur_nb_allocs++;
 		stats->cur_mem_use += size;
 		stats->last_alloc_size = size;
+		_uk_alloc_stats_count_size(stats, size);
 		_uk_alloc_stats_refresh_minmax(stats);
 	} else {
 		stats->nb_enomem++;
@@ -202,12 +221,12 @@ static inline void _uk_alloc_stats_count_free(struct uk_alloc_stats *stats,
 #define uk_alloc_stats_reset(a) do {} while (0)
 #endif /* !CONFIG_LIBUKALLOC_IFSTATS */
 
-/* Shortcut for doing a registration of an allocator that does not implement
- * palloc() or pfree()
+/* Like uk_alloc_init_malloc() but without registering the allocator, e.g.,
+ * for short-lived allocators that are created and destroyed at runtime
  */
-#define uk_alloc_init_malloc(a, malloc_f, calloc_f, realloc_f, free_f,	\
-			     posix_memalign_f, memalign_f, maxalloc_f,	\
-			     availmem_f, addmem_f)			\
+#define uk_alloc_setup_malloc(a, malloc_f, calloc_f, realloc_f, free_f,	\
+			      posix_memalign_f, memalign_f, maxalloc_f,	\
+			      availmem_f, addmem_f)			\
 	do {								\
 		(a)->malloc         = (malloc_f);			\
 		(a)->calloc         = (calloc_f);			\
@@ -226,6 +245,20 @@ static inline void _uk_alloc_stats_count_free(struct uk_alloc_stats *stats,
 		(a)->addmem         = (addmem_f);			\
 									\
 		uk_alloc_stats_reset((a));				\
+	} while (0)
+
+/* Shortcut for doing a registration of an allocator that does not implement
+ * palloc() or pfree()
+ */
+#define uk_alloc_init_malloc(a, malloc_f, calloc_f, realloc_f, free_f,	\
+			     posix_memalign_f, memalign_f, maxalloc_f,	\
+			     availmem_f, addmem_f)			\
+	do {								\
+		uk_alloc_setup_malloc((a), (malloc_f), (calloc_f),	\
+				      (realloc_f), (free_f),		\
+				      (posix_memalign_f), (memalign_f),	\
+				      (maxalloc_f), (availmem_f),	\
+				      (addmem_f));			\
 		uk_alloc_register((a));					\
 	} while (0)
 
@@ -18,5 +18,11 @@
 #define UK_ALLOC_STATS_CUR_MEM_USE		0x09
 #define UK_ALLOC_STATS_MAX_MEM_USE		0x0a
 #define UK_ALLOC_STATS_NUM_ENOMEM		0x0b
+#define UK_ALLOC_STATS_TOTAL_ALLOC_NSEC		0x0c
+#define UK_ALLOC_STATS_TOTAL_FREE_NSEC		0x0d
+/* Histograms: one entry per bucket, starting at these IDs */
+#define UK_ALLOC_STATS_ALLOC_SIZE_HIST		0x20
+#define UK_ALLOC_STATS_ALLOC_NSEC_HIST		0x40
+#define UK_ALLOC_STATS_FREE_NSEC_HIST		0x60
 
 #endif /* __UK_ALLOC_STORE_H__ */
@@ -102,8 +102,10 @@ static inline void update_stats(struct uk_alloc_stats *stats,
 	stats->cur_nb_allocs += nb_allocs_diff;
 	stats->nb_enomem     += nb_enomem_diff;
 	stats->cur_mem_use   += mem_use_diff;
-	if (last_alloc_size)
+	if (last_alloc_size) {
 		stats->last_alloc_size = last_alloc_size;
+		_uk_alloc_stats_count_size(stats, last_alloc_size);
+	}
 
 	/*
 	 * NOTE: Because we apply a diff to the library stats
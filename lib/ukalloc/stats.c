@@ -31,7 +31,9 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <stdio.h>
 #include <uk/store.h>
+#include <uk/print.h>
 #include <uk/alloc_impl.h>
 #include <uk/alloc_store.h>
 
@@ -50,6 +52,115 @@ void uk_alloc_stats_get(struct uk_alloc *a,
 	uk_preempt_enable();
 }
 
+#if CONFIG_LIBUKALLOC_IFSTATS_HIST
+static inline void count_nsec(struct uk_alloc_stats *stats, __u64 nsec,
+			      int is_free)
+{
+	unsigned int idx = _uk_alloc_stats_hist_idx(nsec);
+
+	/* TODO: SMP safety */
+	uk_preempt_disable();
+	if (is_free) {
+		stats->free_nsec_hist[idx]++;
+		stats->tot_free_nsec += nsec;
+	} else {
+		stats->alloc_nsec_hist[idx]++;
+		stats->tot_alloc_nsec += nsec;
+	}
+	uk_preempt_enable();
+}
+
+void _uk_alloc_stats_count_nsec(struct uk_alloc *a, __u64 since, int is_free)
+{
+	__u64 nsec = (__u64) ukplat_monotonic_clock() - since;
+
+	UK_ASSERT(a);
+
+	count_nsec(&a->_stats, nsec, is_free);
+#if CONFIG_LIBUKALLOC_IFSTATS_GLOBAL
+	count_nsec(&_uk_alloc_stats_global, nsec, is_free);
+#endif /* CONFIG_LIBUKALLOC_IFSTATS_GLOBAL */
+}
+
+static void dumpk_hist(int klvl, const char *title, const char *unit,
+		       const __u64 hist[UK_ALLOC_STATS_HIST_BUCKETS])
+{
+	unsigned int i;
+
+	uk_printk(klvl, "  %s:\n", title);
+	for (i = 0; i < UK_ALLOC_STATS_HIST_BUCKETS; ++i) {
+		if (!hist[i])
+			continue;
+		if (i == UK_ALLOC_STATS_HIST_BUCKETS - 1)
+			uk_printk(klvl, "    >= %"__PRIu64" %s: %"__PRIu64"\n",
+				  (__u64) 1 << i, unit, hist[i]);
+		else
+			uk_printk(klvl, "    < %"__PRIu64" %s: %"__PRIu64"\n",
+				  (__u64) 1 << (i + 1), unit, hist[i]);
+	}
+}
+#endif /* CONFIG_LIBUKALLOC_IFSTATS_HIST */
+
+void uk_alloc_stats_dumpk(int klvl, const char *name,
+			  const struct uk_alloc_stats *stats)
+{
+	UK_ASSERT(stats);
+
+	uk_printk(klvl, "%s:\n", name ? name : "<unnamed>");
+	uk_printk(klvl, "  allocs: %"__PRIu64" total, %"__PRIs64" current, %"__PRIs64" max\n",
+		  stats->tot_nb_allocs, stats->cur_nb_allocs,
+		  stats->max_nb_allocs);
+	uk_printk(klvl, "  frees: %"__PRIu64", enomem: %"__PRIu64"\n",
+		  stats->tot_nb_frees, stats->nb_enomem);
+	uk_printk(klvl, "  mem use: %"__PRIssz" B current, %"__PRIssz" B max\n",
+		  stats->cur_mem_use, stats->max_mem_use);
+	uk_printk(klvl, "  alloc size: %"__PRIsz" B min, %"__PRIsz" B max, %"__PRIsz" B last\n",
+		  stats->min_alloc_size, stats->max_alloc_size,
+		  stats->last_alloc_size);
+#if CONFIG_LIBUKALLOC_IFSTATS_HIST
+	if (stats->tot_nb_allocs + stats->nb_enomem)
+		uk_printk(klvl, "  alloc time: %"__PRIu64" ns total, %"__PRIu64" ns avg\n",
+			  stats->tot_alloc_nsec,
+			  stats->tot_alloc_nsec
+			  / (stats->tot_nb_allocs + stats->nb_enomem));
+	if (stats->tot_nb_frees)
+		uk_printk(klvl, "  free time: %"__PRIu64" ns total, %"__PRIu64" ns avg\n",
+			  stats->tot_free_nsec,
+			  stats->tot_free_nsec / stats->tot_nb_frees);
+	dumpk_hist(klvl, "alloc sizes", "B", stats->alloc_size_hist);
+	dumpk_hist(klvl, "alloc latencies", "ns", stats->alloc_nsec_hist);
+	dumpk_hist(klvl, "free latencies", "ns", stats->free_nsec_hist);
+#endif /* CONFIG_LIBUKALLOC_IFSTATS_HIST */
+}
+
+void uk_alloc_stats_dumpk_all(int klvl)
+{
+	struct uk_alloc_stats stats;
+	struct uk_alloc *a;
+	char name[32];
+#if CONFIG_LIBUKALLOC_IFSTATS_PERLIB
+	struct uk_alloc_libstats_entry *iter;
+#endif /* CONFIG_LIBUKALLOC_IFSTATS_PERLIB */
+
+#if CONFIG_LIBUKALLOC_IFSTATS_GLOBAL
+	uk_alloc_stats_get_global(&stats);
+	uk_alloc_stats_dumpk(klvl, "global", &stats);
+#endif /* CONFIG_LIBUKALLOC_IFSTATS_GLOBAL */
+
+	uk_alloc_foreach(a) {
+		snprintf(name, sizeof(name), "allocator %p", a);
+		uk_alloc_stats_get(a, &stats);
+		uk_alloc_stats_dumpk(klvl, name, &stats);
+	}
+
+#if CONFIG_LIBUKALLOC_IFSTATS_PERLIB
+	uk_alloc_foreach_libstats(iter) {
+		uk_alloc_stats_get(iter->a, &stats);
+		uk_alloc_stats_dumpk(klvl, iter->libname, &stats);
+	}
+#endif /* CONFIG_LIBUKALLOC_IFSTATS_PERLIB */
+}
+
 static int get_cur_mem_free(void *cookie __unused, __u64 *out)
 {
 	*out = (__u64) uk_alloc_availmem_total();
@@ -148,4 +259,57 @@ static int get_nb_enomem(void *cookie __unused, __u64 *out)
 UK_STORE_STATIC_ENTRY(UK_ALLOC_STATS_NUM_ENOMEM, nb_enomem, u64,
 		      get_nb_enomem, NULL);
 
+#if CONFIG_LIBUKALLOC_IFSTATS_HIST
+static int get_tot_alloc_nsec(void *cookie __unused, __u64 *out)
+{
+	*out = _uk_alloc_stats_global.tot_alloc_nsec;
+	return 0;
+}
+UK_STORE_STATIC_ENTRY(UK_ALLOC_STATS_TOTAL_ALLOC_NSEC, tot_alloc_nsec, u64,
+		      get_tot_alloc_nsec, NULL);
+
+static int get_tot_free_nsec(void *cookie __unused, __u64 *out)
+{
+	*out = _uk_alloc_stats_global.tot_free_nsec;
+	return 0;
+}
+UK_STORE_STATIC_ENTRY(UK_ALLOC_STATS_TOTAL_FREE_NSEC, tot_free_nsec, u64,
+		      get_tot_free_nsec, NULL);
+
+/* Histogram buckets are exposed as "<hist><bucket>", e.g., "alloc_nsec_3".
+ * Bucket i counts values in [2^i, 2^(i+1)).
+ */
+#define HIST_ENTRY(hist, base_id, idx)					\
+	static int get_##hist##_##idx(void *cookie __unused, __u64 *out) \
+	{								\
+		*out = _uk_alloc_stats_global.hist##_hist[idx];		\
+		return 0;						\
+	}								\
+	UK_STORE_STATIC_ENTRY((base_id) + (idx), hist##_##idx, u64,	\
+			      get_##hist##_##idx, NULL)
+
+#define HIST_ENTRIES(hist, base_id)					\
+	HIST_ENTRY(hist, base_id, 0);  HIST_ENTRY(hist, base_id, 1);	\
+	HIST_ENTRY(hist, base_id, 2);  HIST_ENTRY(hist, base_id, 3);	\
+	HIST_ENTRY(hist, base_id, 4);  HIST_ENTRY(hist, base_id, 5);	\
+	HIST_ENTRY(hist, base_id, 6);  HIST_ENTRY(hist, base_id, 7);	\
+	HIST_ENTRY(hist, base_id, 8);  HIST_ENTRY(hist, base_id, 9);	\
+	HIST_ENTRY(hist, base_id, 10); HIST_ENTRY(hist, base_id, 11);	\
+	HIST_ENTRY(hist, base_id, 12); HIST_ENTRY(hist, base_id, 13);	\
+	HIST_ENTRY(hist, base_id, 14); HIST_ENTRY(hist, base_id, 15);	\
+	HIST_ENTRY(hist, base_id, 16); HIST_ENTRY(hist, base_id, 17);	\
+	HIST_ENTRY(hist, base_id, 18); HIST_ENTRY(hist, base_id, 19);	\
+	HIST_ENTRY(hist, base_id, 20); HIST_ENTRY(hist, base_id, 21);	\
+	HIST_ENTRY(hist, base_id, 22); HIST_ENTRY(hist, base_id, 23);	\
+	HIST_ENTRY(hist, base_id, 24); HIST_ENTRY(hist, base_id, 25);	\
+	HIST_ENTRY(hist, base_id, 26); HIST_ENTRY(hist, base_id, 27);	\
+	HIST_ENTRY(hist, base_id, 28); HIST_ENTRY(hist, base_id, 29);	\
+	HIST_ENTRY(hist, base_id, 30); HIST_ENTRY(hist, base_id, 31)
+
+UK_CTASSERT(UK_ALLOC_STATS_HIST_BUCKETS == 32);
+HIST_ENTRIES(alloc_size, UK_ALLOC_STATS_ALLOC_SIZE_HIST);
+HIST_ENTRIES(alloc_nsec, UK_ALLOC_STATS_ALLOC_NSEC_HIST);
+HIST_ENTRIES(free_nsec, UK_ALLOC_STATS_FREE_NSEC_HIST);
+#endif /* CONFIG_LIBUKALLOC_IFSTATS_HIST */
+
 #endif
@@ -0,0 +1,177 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <uk/alloc.h>
+#include <uk/bench.h>
+#include <uk/config.h>
+#include <uk/essentials.h>
+#if CONFIG_LIBUKALLOCBBUDDY
+#include <uk/allocbbuddy.h>
+#endif /* CONFIG_LIBUKALLOCBBUDDY */
+#if CONFIG_LIBUKALLOCPOOL
+#include <uk/allocpool.h>
+#endif /* CONFIG_LIBUKALLOCPOOL */
+#if CONFIG_LIBUKALLOCREGION
+#include <uk/allocregion.h>
+#endif /* CONFIG_LIBUKALLOCREGION */
+
+/* Memory that each allocator under test manages */
+#define BENCH_HEAP_PAGES	1024
+#define BENCH_HEAP_SIZE		(BENCH_HEAP_PAGES * __PAGE_SIZE)
+#define BENCH_OBJ_SIZE		64
+/* Objects that are live at the same time in the batch benchmarks */
+#define BENCH_BATCH		64
+
+static void *batch[BENCH_BATCH] __maybe_unused;
+
+static void __maybe_unused
+bench_malloc_free(struct uk_bench_ctx *b, struct uk_alloc *a, __sz size)
+{
+	void *p;
+	__u64 i;
+
+	if (unlikely(!a)) {
+		uk_bench_skip(b, "allocator not available");
+		return;
+	}
+
+	for (i = 0; i < b->n; i++) {
+		p = uk_malloc(a, size);
+		if (unlikely(!p)) {
+			uk_bench_skip(b, "out of memory");
+			return;
+		}
+		uk_free(a, p);
+	}
+}
+
+static void __maybe_unused
+bench_malloc_free_batch(struct uk_bench_ctx *b, struct uk_alloc *a, __sz size)
+{
+	__u64 i;
+	int j;
+
+	if (unlikely(!a)) {
+		uk_bench_skip(b, "allocator not available");
+		return;
+	}
+
+	for (i = 0; i < b->n; i += BENCH_BATCH) {
+		for (j = 0; j < BENCH_BATCH; j++) {
+			batch[j] = uk_malloc(a, size);
+			if (unlikely(!batch[j])) {
+				uk_bench_skip(b, "out of memory");
+				goto out_free;
+			}
+		}
+		/* Free in reverse order to exercise coalescing */
+		for (j = BENCH_BATCH - 1; j >= 0; j--)
+			uk_free(a, batch[j]);
+	}
+	return;
+
+out_free:
+	while (--j >= 0)
+		uk_free(a, batch[j]);
+}
+
+#if CONFIG_LIBUKALLOCBBUDDY
+static struct uk_alloc *bbuddy;
+
+UK_BENCHMARK(ukalloc_benchsuite, bbuddy_malloc_free_64)
+{
+	bench_malloc_free(b, bbuddy, BENCH_OBJ_SIZE);
+}
+
+UK_BENCHMARK(ukalloc_benchsuite, bbuddy_malloc_free_4k)
+{
+	bench_malloc_free(b, bbuddy, __PAGE_SIZE);
+}
+
+UK_BENCHMARK(ukalloc_benchsuite, bbuddy_malloc_free_batch_64)
+{
+	bench_malloc_free_batch(b, bbuddy, BENCH_OBJ_SIZE);
+}
+#endif /* CONFIG_LIBUKALLOCBBUDDY */
+
+#if CONFIG_LIBUKALLOCPOOL
+static struct uk_alloc *pool;
+
+UK_BENCHMARK(ukalloc_benchsuite, pool_malloc_free_64)
+{
+	bench_malloc_free(b, pool, BENCH_OBJ_SIZE);
+}
+
+UK_BENCHMARK(ukalloc_benchsuite, pool_malloc_free_batch_64)
+{
+	bench_malloc_free_batch(b, pool, BENCH_OBJ_SIZE);
+}
+#endif /* CONFIG_LIBUKALLOCPOOL */
+
+#if CONFIG_LIBUKALLOCREGION
+static void *region_base;
+
+/* The region allocator does not free memory, so it is set up again
+ * whenever it runs out, without taking the time for it.
+ */
+UK_BENCHMARK(ukalloc_benchsuite, region_malloc_64)
+{
+	struct uk_alloc *a;
+	void *p;
+	__u64 i;
+
+	if (unlikely(!region_base)) {
+		uk_bench_skip(b, "allocator not available");
+		return;
+	}
+
+	uk_bench_timer_stop(b);
+	a = uk_allocregion_init(region_base, BENCH_HEAP_SIZE);
+	uk_bench_timer_start(b);
+
+	for (i = 0; i < b->n; i++) {
+		p = uk_malloc(a, BENCH_OBJ_SIZE);
+		if (unlikely(!p)) {
+			uk_bench_timer_stop(b);
+			a = uk_allocregion_init(region_base, BENCH_HEAP_SIZE);
+			uk_bench_timer_start(b);
+			continue;
+		}
+		uk_free(a, p);
+	}
+}
+#endif /* CONFIG_LIBUKALLOCREGION */
+
+static int ukalloc_bench_init(struct uk_benchsuite *suite __unused)
+{
+	struct uk_alloc *a __maybe_unused = uk_alloc_get_default();
+	void *base __maybe_unused;
+
+#if CONFIG_LIBUKALLOCBBUDDY
+	base = uk_palloc(a, BENCH_HEAP_PAGES);
+	if (base)
+		bbuddy = uk_allocbbuddy_init(base, BENCH_HEAP_SIZE);
+#endif /* CONFIG_LIBUKALLOCBBUDDY */
+#if CONFIG_LIBUKALLOCPOOL
+	base = uk_palloc(a, BENCH_HEAP_PAGES);
+	if (base) {
+		struct uk_allocpool *p;
+
+		p = uk_allocpool_init(base, BENCH_HEAP_SIZE, BENCH_OBJ_SIZE,
+				      sizeof(void *));
+		if (p)
+			pool = uk_allocpool2ukalloc(p);
+	}
+#endif /* CONFIG_LIBUKALLOCPOOL */
+#if CONFIG_LIBUKALLOCREGION
+	region_base = uk_palloc(a, BENCH_HEAP_PAGES);
+#endif /* CONFIG_LIBUKALLOCREGION */
+
+	/* The memory is kept: benchmarks run only once per boot */
+	return 0;
+}
+
+uk_benchsuite_register(ukalloc_benchsuite, ukalloc_bench_init);
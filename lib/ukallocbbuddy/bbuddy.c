@@ -294,7 +294,7 @@ static inline unsigned long num_pages_to_order(unsigned long num_pages)
 /*********************
  * BINARY BUDDY PAGE ALLOCATOR
  */
-static void *bbuddy_palloc(struct uk_alloc *a, unsigned long num_pages)
+void *uk_allocbbuddy_palloc(struct uk_alloc *a, unsigned long num_pages)
 {
 	struct uk_bbpalloc *b;
 	size_t i;
@@ -356,7 +356,8 @@ no_memory:
 	return NULL;
 }
 
-static void bbuddy_pfree(struct uk_alloc *a, void *obj, unsigned long num_pages)
+void uk_allocbbuddy_pfree(struct uk_alloc *a, void *obj,
+			  unsigned long num_pages)
 {
 	struct uk_bbpalloc *b;
 	chunk_head_t *freed_ch, *to_merge_ch;
@@ -595,7 +596,7 @@ struct uk_alloc *uk_allocbbuddy_init(void *base, size_t len)
 	b->memr_head = NULL;
 
 	/* initialize and register allocator interface */
-	uk_alloc_init_palloc(a, bbuddy_palloc, bbuddy_pfree,
+	uk_alloc_init_palloc(a, uk_allocbbuddy_palloc, uk_allocbbuddy_pfree,
 			     bbuddy_pmaxalloc, bbuddy_pavailmem,
 			     bbuddy_addmem);
 
@@ -0,0 +1,572 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+/*
+ * Magazine cache for small objects
+ *
+ * Requests up to the largest size class are rounded up to a power of two
+ * and served from per-CPU magazines, as described in: J. Bonwick and
+ * J. Adams, "Magazines and Vmem: Extending the Slab Allocator to Many
+ * CPUs and Arbitrary Resources", USENIX ATC 2001.
+ *
+ * Each logical CPU holds a loaded and a previous magazine per size class
+ * and only touches them with interrupts disabled. When both are empty
+ * (allocation) or full (free), whole magazines are exchanged with the
+ * depot, which is the only shared state on the fast path. New objects are
+ * carved from page slabs of the parent allocator; cached objects are never
+ * returned to it.
+ *
+ * Every object is preceded by a header of ALLOCMAG_HDR_SIZE bytes. Cached
+ * objects have a NULL base, requests that are too large or need a stricter
+ * alignment are forwarded to the parent and record the parent's pointer.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <uk/essentials.h>
+#include <uk/alloc_impl.h>
+#include <uk/allocmag.h>
+#include <uk/assert.h>
+#include <uk/print.h>
+#include <uk/spinlock.h>
+#include <uk/arch/limits.h>
+#include <uk/plat/lcpu.h>
+
+#define ALLOCMAG_MIN_SHIFT	4
+#define ALLOCMAG_NCLASSES	(CONFIG_LIBUKALLOCMAG_MAXSIZE_SHIFT - \
+				 ALLOCMAG_MIN_SHIFT + 1)
+#define ALLOCMAG_MAXSIZE	(1UL << CONFIG_LIBUKALLOCMAG_MAXSIZE_SHIFT)
+#define ALLOCMAG_ROUNDS		CONFIG_LIBUKALLOCMAG_ROUNDS
+#define ALLOCMAG_HDR_SIZE	16
+
+#define allocmag_cls2size(cls)	(1UL << ((cls) + ALLOCMAG_MIN_SHIFT))
+
+struct allocmag_hdr {
+	void *base; /* parent allocation, NULL for cached objects */
+	__sz size;  /* size class or requested size for forwarded objects */
+};
+
+UK_CTASSERT(sizeof(struct allocmag_hdr) <= ALLOCMAG_HDR_SIZE);
+
+struct allocmag_mag {
+	struct allocmag_mag *next;
+	unsigned int rounds;
+	void *objs[ALLOCMAG_ROUNDS];
+};
+
+UK_CTASSERT(sizeof(struct allocmag_mag) <= __PAGE_SIZE);
+
+/* Cached object on the overflow list of the depot */
+struct allocmag_obj {
+	struct allocmag_obj *next;
+};
+
+struct allocmag_lcpu {
+	struct allocmag_mag *loaded[ALLOCMAG_NCLASSES];
+	struct allocmag_mag *prev[ALLOCMAG_NCLASSES];
+};
+
+struct allocmag {
+	struct uk_alloc self;
+
+	struct uk_alloc *parent;
+	uk_spinlock parent_lock;
+
+	/* Depot */
+	uk_spinlock depot_lock;
+	struct allocmag_mag *full[ALLOCMAG_NCLASSES];
+	struct allocmag_mag *empty;
+	/* Objects that were freed while no empty magazine was available */
+	struct allocmag_obj *overflow[ALLOCMAG_NCLASSES];
+
+	struct allocmag_lcpu lcpu[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+};
+
+static inline struct allocmag *ukalloc2allocmag(struct uk_alloc *a)
+{
+	UK_ASSERT(a);
+	return __containerof(a, struct allocmag, self);
+}
+
+static inline struct allocmag_hdr *allocmag_hdr(void *ptr)
+{
+	return (struct allocmag_hdr *)((__uptr)ptr - ALLOCMAG_HDR_SIZE);
+}
+
+static inline unsigned int allocmag_size2cls(__sz size)
+{
+	unsigned int cls = 0;
+
+	UK_ASSERT(size <= ALLOCMAG_MAXSIZE);
+
+	while (allocmag_cls2size(cls) < size)
+		cls++;
+	return cls;
+}
+
+/*
+ * Depot
+ */
+static inline void allocmag_mag_push(struct allocmag_mag **list,
+				     struct allocmag_mag *mag)
+{
+	mag->next = *list;
+	*list = mag;
+}
+
+static inline struct allocmag_mag *allocmag_mag_pop(struct allocmag_mag **list)
+{
+	struct allocmag_mag *mag = *list;
+
+	if (mag)
+		*list = mag->next;
+	return mag;
+}
+
+static void *allocmag_parent_palloc(struct allocmag *m,
+				    unsigned long num_pages)
+{
+	void *pages;
+
+	uk_spin_lock(&m->parent_lock);
+	pages = uk_palloc(m->parent, num_pages);
+	uk_spin_unlock(&m->parent_lock);
+	return pages;
+}
+
+/* Carve one page into empty magazines and add them to the depot */
+static int allocmag_grow_mags(struct allocmag *m)
+{
+	struct allocmag_mag *mag;
+	unsigned int i, count;
+
+	mag = allocmag_parent_palloc(m, 1);
+	if (unlikely(!mag))
+		return -ENOMEM;
+
+	count = __PAGE_SIZE / sizeof(*mag);
+	uk_spin_lock(&m->depot_lock);
+	for (i = 0; i < count; i++) {
+		mag[i].rounds = 0;
+		allocmag_mag_push(&m->empty, &mag[i]);
+	}
+	uk_spin_unlock(&m->depot_lock);
+	return 0;
+}
+
+static struct allocmag_mag *allocmag_get_empty(struct allocmag *m)
+{
+	struct allocmag_mag *mag;
+
+	do {
+		uk_spin_lock(&m->depot_lock);
+		mag = allocmag_mag_pop(&m->empty);
+		uk_spin_unlock(&m->depot_lock);
+	} while (!mag && allocmag_grow_mags(m) == 0);
+
+	return mag;
+}
+
+/* Allocate a slab from the parent and add its objects to the depot */
+static int allocmag_grow_cls(struct allocmag *m, unsigned int cls)
+{
+	__sz objsz = ALLOCMAG_HDR_SIZE + allocmag_cls2size(cls);
+	unsigned long num_pages;
+	unsigned long nobj;
+	struct allocmag_hdr *hdr;
+	struct allocmag_obj *obj;
+	struct allocmag_mag *mag;
+	__uptr p;
+
+	num_pages = MAX((unsigned long)CONFIG_LIBUKALLOCMAG_SLAB_PAGES,
+			DIV_ROUND_UP(objsz * ALLOCMAG_ROUNDS, __PAGE_SIZE));
+	p = (__uptr)allocmag_parent_palloc(m, num_pages);
+	if (unlikely(!p))
+		return -ENOMEM;
+
+	nobj = (num_pages * __PAGE_SIZE) / objsz;
+	uk_pr_debug("%p: New slab for %"__PRIsz" B objects: %lu objs\n",
+		    m, allocmag_cls2size(cls), nobj);
+
+	while (nobj) {
+		mag = allocmag_get_empty(m);
+		if (unlikely(!mag))
+			break;
+
+		for (mag->rounds = 0;
+		     nobj && mag->rounds < ALLOCMAG_ROUNDS;
+		     nobj--, p += objsz) {
+			hdr = (struct allocmag_hdr *)p;
+			hdr->base = __NULL;
+			hdr->size = allocmag_cls2size(cls);
+			mag->objs[mag->rounds++] = (void *)(p + ALLOCMAG_HDR_SIZE);
+		}
+
+		uk_spin_lock(&m->depot_lock);
+		allocmag_mag_push(&m->full[cls], mag);
+		uk_spin_unlock(&m->depot_lock);
+	}
+
+	/* We ran out of magazines, keep the remaining objects on the side */
+	for (; nobj; nobj--, p += objsz) {
+		hdr = (struct allocmag_hdr *)p;
+		hdr->base = __NULL;
+		hdr->size = allocmag_cls2size(cls);
+		obj = (struct allocmag_obj *)(p + ALLOCMAG_HDR_SIZE);
+
+		uk_spin_lock(&m->depot_lock);
+		obj->next = m->overflow[cls];
+		m->overflow[cls] = obj;
+		uk_spin_unlock(&m->depot_lock);
+	}
+	return 0;
+}
+
+/*
+ * Per-CPU layer
+ */
+static void *allocmag_obj_get(struct allocmag *m, unsigned int cls)
+{
+	struct allocmag_lcpu *lc;
+	struct allocmag_mag *mag;
+	struct allocmag_obj *obj;
+	unsigned long irqf;
+	void *ret = __NULL;
+	int grown = 0;
+
+	irqf = ukplat_lcpu_save_irqf();
+	lc = &m->lcpu[ukplat_lcpu_idx()];
+
+	mag = lc->loaded[cls];
+	if (likely(mag && mag->rounds))
+		goto out;
+
+	mag = lc->prev[cls];
+	if (mag && mag->rounds) {
+		lc->prev[cls] = lc->loaded[cls];
+		lc->loaded[cls] = mag;
+		goto out;
+	}
+
+	/* Both magazines are empty: exchange the previous one for a full
+	 * magazine from the depot
+	 */
+	for (;;) {
+		uk_spin_lock(&m->depot_lock);
+		mag = allocmag_mag_pop(&m->full[cls]);
+		if (mag) {
+			if (lc->prev[cls])
+				allocmag_mag_push(&m->empty, lc->prev[cls]);
+			uk_spin_unlock(&m->depot_lock);
+
+			lc->prev[cls] = lc->loaded[cls];
+			lc->loaded[cls] = mag;
+			goto out;
+		}
+		obj = m->overflow[cls];
+		if (obj) {
+			m->overflow[cls] = obj->next;
+			uk_spin_unlock(&m->depot_lock);
+
+			ret = obj;
+			goto out_restore;
+		}
+		uk_spin_unlock(&m->depot_lock);
+
+		if (grown || allocmag_grow_cls(m, cls) < 0)
+			goto out_restore;
+		grown = 1;
+	}
+
+out:
+	UK_ASSERT(mag == lc->loaded[cls]);
+	UK_ASSERT(mag->rounds > 0);
+	ret = mag->objs[--mag->rounds];
+out_restore:
+	ukplat_lcpu_restore_irqf(irqf);
+	return ret;
+}
+
+static void allocmag_obj_put(struct allocmag *m, unsigned int cls, void *ptr)
+{
+	struct allocmag_lcpu *lc;
+	struct allocmag_mag *mag;
+	struct allocmag_obj *obj;
+	unsigned long irqf;
+
+	irqf = ukplat_lcpu_save_irqf();
+	lc = &m->lcpu[ukplat_lcpu_idx()];
+
+	mag = lc->loaded[cls];
+	if (likely(mag && mag->rounds < ALLOCMAG_ROUNDS))
+		goto out;
+
+	mag = lc->prev[cls];
+	if (mag && mag->rounds < ALLOCMAG_ROUNDS) {
+		lc->prev[cls] = lc->loaded[cls];
+		lc->loaded[cls] = mag;
+		goto out;
+	}
+
+	/* Both magazines are full: hand the previous one to the depot and
+	 * continue with an empty magazine
+	 */
+	mag = allocmag_get_empty(m);
+	if (unlikely(!mag)) {
+		obj = (struct allocmag_obj *)ptr;
+
+		uk_spin_lock(&m->depot_lock);
+		obj->next = m->overflow[cls];
+		m->overflow[cls] = obj;
+		uk_spin_unlock(&m->depot_lock);
+		goto out_restore;
+	}
+
+	if (lc->prev[cls]) {
+		uk_spin_lock(&m->depot_lock);
+		allocmag_mag_push(&m->full[cls], lc->prev[cls]);
+		uk_spin_unlock(&m->depot_lock);
+	}
+	lc->prev[cls] = lc->loaded[cls];
+	lc->loaded[cls] = mag;
+
+out:
+	UK_ASSERT(mag == lc->loaded[cls]);
+	mag->objs[mag->rounds++] = ptr;
+out_restore:
+	ukplat_lcpu_restore_irqf(irqf);
+}
+
+/*
+ * Forwarded requests
+ */
+static void *allocmag_large_alloc(struct allocmag *m, __sz align, __sz size)
+{
+	struct allocmag_hdr *hdr;
+	unsigned long irqf;
+	void *base = __NULL;
+	__sz off;
+
+	off = MAX(align, (__sz)ALLOCMAG_HDR_SIZE);
+	if (unlikely(size + off < size))
+		return __NULL;
+
+	irqf = ukplat_lcpu_save_irqf();
+	uk_spin_lock(&m->parent_lock);
+	if (off > ALLOCMAG_HDR_SIZE)
+		uk_posix_memalign(m->parent, &base, align, size + off);
+	else
+		base = uk_malloc(m->parent, size + off);
+	uk_spin_unlock(&m->parent_lock);
+	ukplat_lcpu_restore_irqf(irqf);
+	if (unlikely(!base))
+		return __NULL;
+
+	hdr = allocmag_hdr((void *)((__uptr)base + off));
+	hdr->base = base;
+	hdr->size = size;
+	return (void *)((__uptr)base + off);
+}
+
+static void allocmag_large_free(struct allocmag *m, struct allocmag_hdr *hdr)
+{
+	unsigned long irqf;
+
+	irqf = ukplat_lcpu_save_irqf();
+	uk_spin_lock(&m->parent_lock);
+	uk_free(m->parent, hdr->base);
+	uk_spin_unlock(&m->parent_lock);
+	ukplat_lcpu_restore_irqf(irqf);
+}
+
+/*
+ * uk_alloc interface
+ */
+static void *allocmag_malloc(struct uk_alloc *a, __sz size)
+{
+	struct allocmag *m = ukalloc2allocmag(a);
+	unsigned int cls;
+	void *ptr;
+
+	if (unlikely(!size))
+		return __NULL;
+
+	if (size <= ALLOCMAG_MAXSIZE) {
+		cls = allocmag_size2cls(size);
+		ptr = allocmag_obj_get(m, cls);
+		size = allocmag_cls2size(cls);
+	} else {
+		ptr = allocmag_large_alloc(m, 0, size);
+	}
+
+	if (unlikely(!ptr)) {
+		uk_alloc_stats_count_enomem(a, size);
+		errno = ENOMEM;
+		return __NULL;
+	}
+	uk_alloc_stats_count_alloc(a, ptr, size);
+	return ptr;
+}
+
+static int allocmag_posix_memalign(struct uk_alloc *a, void **memptr,
+				   __sz align, __sz size)
+{
+	struct allocmag *m = ukalloc2allocmag(a);
+
+	UK_ASSERT(memptr);
+
+	if (unlikely(!POWER_OF_2(align) || align < sizeof(void *)))
+		return EINVAL;
+
+	if (align <= ALLOCMAG_HDR_SIZE) {
+		*memptr = allocmag_malloc(a, size);
+		return *memptr ? 0 : ENOMEM;
+	}
+
+	if (unlikely(!size)) {
+		*memptr = __NULL;
+		return 0;
+	}
+
+	*memptr = allocmag_large_alloc(m, align, size);
+	if (unlikely(!*memptr)) {
+		uk_alloc_stats_count_enomem(a, size);
+		return ENOMEM;
+	}
+	uk_alloc_stats_count_alloc(a, *memptr, size);
+	return 0;
+}
+
+static void allocmag_free(struct uk_alloc *a, void *ptr)
+{
+	struct allocmag *m = ukalloc2allocmag(a);
+	struct allocmag_hdr *hdr;
+
+	if (unlikely(!ptr))
+		return;
+
+	hdr = allocmag_hdr(ptr);
+	uk_alloc_stats_count_free(a, ptr, hdr->size);
+	if (hdr->base)
+		allocmag_large_free(m, hdr);
+	else
+		allocmag_obj_put(m, allocmag_size2cls(hdr->size), ptr);
+}
+
+static void *allocmag_realloc(struct uk_alloc *a, void *ptr, __sz size)
+{
+	struct allocmag_hdr *hdr;
+	void *retptr;
+
+	if (!ptr)
+		return allocmag_malloc(a, size);
+
+	if (!size) {
+		allocmag_free(a, ptr);
+		return __NULL;
+	}
+
+	hdr = allocmag_hdr(ptr);
+	/* Cached objects already span their whole size class */
+	if (!hdr->base && size <= hdr->size)
+		return ptr;
+
+	retptr = allocmag_malloc(a, size);
+	if (unlikely(!retptr))
+		return __NULL;
+
+	memcpy(retptr, ptr, MIN(size, hdr->size));
+	allocmag_free(a, ptr);
+	return retptr;
+}
+
+static void *allocmag_palloc(struct uk_alloc *a, unsigned long num_pages)
+{
+	struct allocmag *m = ukalloc2allocmag(a);
+	unsigned long irqf;
+	void *pages;
+
+	irqf = ukplat_lcpu_save_irqf();
+	pages = allocmag_parent_palloc(m, num_pages);
+	ukplat_lcpu_restore_irqf(irqf);
+	return pages;
+}
+
+static void allocmag_pfree(struct uk_alloc *a, void *ptr,
+			   unsigned long num_pages)
+{
+	struct allocmag *m = ukalloc2allocmag(a);
+	unsigned long irqf;
+
+	irqf = ukplat_lcpu_save_irqf();
+	uk_spin_lock(&m->parent_lock);
+	uk_pfree(m->parent, ptr, num_pages);
+	uk_spin_unlock(&m->parent_lock);
+	ukplat_lcpu_restore_irqf(irqf);
+}
+
+static int allocmag_addmem(struct uk_alloc *a, void *base, __sz len)
+{
+	struct allocmag *m = ukalloc2allocmag(a);
+	unsigned long irqf;
+	int rc;
+
+	irqf = ukplat_lcpu_save_irqf();
+	uk_spin_lock(&m->parent_lock);
+	rc = uk_alloc_addmem(m->parent, base, len);
+	uk_spin_unlock(&m->parent_lock);
+	ukplat_lcpu_restore_irqf(irqf);
+	return rc;
+}
+
+/* NOTE: Objects that are cached in magazines are not accounted as
+ *       available memory
+ */
+static __ssz allocmag_maxalloc(struct uk_alloc *a)
+{
+	return uk_alloc_maxalloc(ukalloc2allocmag(a)->parent);
+}
+
+static __ssz allocmag_availmem(struct uk_alloc *a)
+{
+	return uk_alloc_availmem(ukalloc2allocmag(a)->parent);
+}
+
+struct uk_alloc *uk_allocmag_init(struct uk_alloc *parent)
+{
+	struct allocmag *m;
+	struct uk_alloc *a;
+
+	UK_ASSERT(parent);
+
+	m = uk_calloc(parent, 1, sizeof(*m));
+	if (unlikely(!m)) {
+		errno = ENOMEM;
+		return __NULL;
+	}
+
+	m->parent = parent;
+	uk_spin_init(&m->parent_lock);
+	uk_spin_init(&m->depot_lock);
+
+	a = &m->self;
+	uk_alloc_init_malloc(a,
+			     allocmag_malloc,
+			     uk_calloc_compat,
+			     allocmag_realloc,
+			     allocmag_free,
+			     allocmag_posix_memalign,
+			     uk_memalign_compat,
+			     allocmag_maxalloc,
+			     allocmag_availmem,
+			     allocmag_addmem);
+	a->palloc = allocmag_palloc;
+	a->pfree  = allocmag_pfree;
+
+	uk_pr_info("%p: Magazine cache on %p: %u size classes up to %lu B, %u objs per magazine\n",
+		   m, parent, (unsigned int)ALLOCMAG_NCLASSES,
+		   ALLOCMAG_MAXSIZE, (unsigned int)ALLOCMAG_ROUNDS);
+	return a;
+}
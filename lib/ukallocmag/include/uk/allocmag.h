@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __LIBUKALLOCMAG_H__
+#define __LIBUKALLOCMAG_H__
+
+#include <uk/alloc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Stacks a per-CPU magazine cache on top of a parent allocator. The
+ * returned allocator is registered but does not become the default
+ * allocator (see `uk_alloc_set_default()`). All subsequent allocations
+ * from the parent must go through the returned allocator because the
+ * parent is only called with the cache's own lock held.
+ *
+ * @param parent
+ *  Allocator that provides slabs and serves large requests.
+ * @return
+ *  - (NULL): If the cache could not be allocated (ENOMEM).
+ *  - pointer to the allocator interface of the cache.
+ */
+struct uk_alloc *uk_allocmag_init(struct uk_alloc *parent);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LIBUKALLOCMAG_H__ */
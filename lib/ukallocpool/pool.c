@@ -38,6 +38,10 @@
 #include <uk/alloc_impl.h>
 #include <uk/allocpool.h>
 #include <uk/list.h>
+#if CONFIG_LIBUKALLOCPOOL_SMP
+#include <uk/atomic.h>
+#include <uk/plat/lcpu.h>
+#endif /* CONFIG_LIBUKALLOCPOOL_SMP */
 #include <string.h>
 #include <errno.h>
 
@@ -63,11 +67,39 @@
 #define MIN_OBJ_ALIGN sizeof(void *)
 #define MIN_OBJ_LEN   sizeof(struct uk_list_head)
 
+#if CONFIG_LIBUKALLOCPOOL_SMP
+/*
+ * SMP-safe variant: Each logical CPU caches free objects in a small array
+ * that is only accessed with interrupts disabled. The caches are refilled
+ * from and flushed to a global lock-free LIFO stack in batches of half
+ * the cache size. Because all objects of a pool are in one contiguous
+ * range, stack entries are linked by object index. This makes it possible
+ * to combine the top of the stack with an ABA tag in a single 64-bit word
+ * that is updated with compare-and-swap.
+ */
+#define LCPU_CACHE_LEN CONFIG_LIBUKALLOCPOOL_LCPU_CACHE
+
+struct allocpool_lcpu {
+	unsigned int count;
+	void *obj[LCPU_CACHE_LEN];
+};
+#endif /* CONFIG_LIBUKALLOCPOOL_SMP */
+
 struct uk_allocpool {
 	struct uk_alloc self;
 
+#if CONFIG_LIBUKALLOCPOOL_SMP
+	/* Lower 32 bits: index + 1 of the top object (0 if empty),
+	 * upper 32 bits: ABA tag, incremented with every update
+	 */
+	__u64 free_top;
+	unsigned int free_top_count;
+	void *obj_base;
+	struct allocpool_lcpu lcpu[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+#else /* !CONFIG_LIBUKALLOCPOOL_SMP */
 	struct uk_list_head free_obj;
 	unsigned int free_obj_count;
+#endif /* !CONFIG_LIBUKALLOCPOOL_SMP */
 
 	__sz obj_align;
 	__sz obj_len;
@@ -77,9 +109,15 @@ struct uk_allocpool {
 	void *base;
 };
 
+#if CONFIG_LIBUKALLOCPOOL_SMP
+struct free_obj {
+	__u32 next; /* index + 1 of the next free object, 0 if none */
+};
+#else /* !CONFIG_LIBUKALLOCPOOL_SMP */
 struct free_obj {
 	struct uk_list_head list;
 };
+#endif /* !CONFIG_LIBUKALLOCPOOL_SMP */
 
 static inline struct uk_allocpool *ukalloc2pool(struct uk_alloc *a)
 {
@@ -96,6 +134,168 @@ struct uk_alloc *uk_allocpool2ukalloc(struct uk_allocpool *p)
 	return allocpool2ukalloc(p);
 }
 
+#if CONFIG_LIBUKALLOCPOOL_SMP
+#define FREE_TOP(idx, tag)	((((__u64) (tag)) << 32) | (__u64) (idx))
+#define FREE_TOP_IDX(top)	((__u32) (top))
+#define FREE_TOP_TAG(top)	((__u32) ((top) >> 32))
+
+static inline void *_idx2obj(struct uk_allocpool *p, __u32 idx)
+{
+	UK_ASSERT(idx > 0 && idx <= p->obj_count);
+	return (void *) ((__uptr) p->obj_base + (idx - 1) * p->obj_len);
+}
+
+static inline __u32 _obj2idx(struct uk_allocpool *p, void *obj)
+{
+	return (__u32) (((__uptr) obj - (__uptr) p->obj_base) / p->obj_len)
+	       + 1;
+}
+
+/* Push `count` objects to the global stack with a single update */
+static void _push_free_objs(struct uk_allocpool *p, void *obj[],
+			    unsigned int count)
+{
+	struct free_obj *last;
+	__u64 top, new_top;
+	unsigned int i;
+
+	UK_ASSERT(count > 0);
+
+	for (i = 0; i < count - 1; ++i)
+		((struct free_obj *) obj[i])->next = _obj2idx(p, obj[i + 1]);
+	last = (struct free_obj *) obj[count - 1];
+
+	/* Account first so that the counter never drops below zero */
+	uk_fetch_add(&p->free_top_count, count);
+
+	top = uk_load_n(&p->free_top);
+	do {
+		last->next = FREE_TOP_IDX(top);
+		new_top = FREE_TOP(_obj2idx(p, obj[0]), FREE_TOP_TAG(top) + 1);
+	} while (!uk_compare_exchange_n(&p->free_top, &top, new_top));
+}
+
+/* Pop up to `count` objects from the global stack with a single update.
+ * The links are read while other CPUs may concurrently take the same
+ * objects and overwrite them. This is detected with the tag: the chain
+ * below the top can only change after the top changed.
+ */
+static unsigned int _pop_free_objs(struct uk_allocpool *p, void *obj[],
+				   unsigned int count)
+{
+	__u64 top, new_top;
+	unsigned int i;
+	__u32 idx;
+
+	top = uk_load_n(&p->free_top);
+	do {
+		idx = FREE_TOP_IDX(top);
+		for (i = 0; i < count && idx; ++i) {
+			obj[i] = _idx2obj(p, idx);
+			idx = uk_load_n(&((struct free_obj *) obj[i])->next);
+			if (unlikely(idx > p->obj_count)) {
+				/* Stale link, the update below fails */
+				idx = 0;
+				++i;
+				break;
+			}
+		}
+		if (!i)
+			return 0;
+		new_top = FREE_TOP(idx, FREE_TOP_TAG(top) + 1);
+	} while (!uk_compare_exchange_n(&p->free_top, &top, new_top));
+
+	uk_fetch_sub(&p->free_top_count, i);
+	return i;
+}
+
+static inline unsigned int _free_obj_count(struct uk_allocpool *p)
+{
+	unsigned int count = uk_load_n(&p->free_top_count);
+	unsigned int i;
+
+	for (i = 0; i < CONFIG_UKPLAT_LCPU_MAXCOUNT; ++i)
+		count += uk_load_n(&p->lcpu[i].count);
+	return count;
+}
+
+static unsigned int _take_free_objs(struct uk_allocpool *p, void *obj[],
+				    unsigned int count)
+{
+	struct allocpool_lcpu *c;
+	unsigned long irqf;
+	unsigned int i = 0;
+
+	irqf = ukplat_lcpu_save_irqf();
+	c = &p->lcpu[ukplat_lcpu_idx()];
+
+	if (count < c->count) {
+		for (; i < count; ++i)
+			obj[i] = c->obj[--c->count];
+		goto out;
+	}
+
+	/* Drain the cache, get the rest directly from the global stack */
+	for (; c->count; ++i)
+		obj[i] = c->obj[--c->count];
+	if (i < count)
+		i += _pop_free_objs(p, &obj[i], count - i);
+
+	/* Refill the cache for subsequent calls */
+	c->count = _pop_free_objs(p, c->obj, LCPU_CACHE_LEN / 2);
+out:
+	ukplat_lcpu_restore_irqf(irqf);
+	return i;
+}
+
+static void _return_free_objs(struct uk_allocpool *p, void *obj[],
+			      unsigned int count)
+{
+	struct allocpool_lcpu *c;
+	unsigned long irqf;
+	unsigned int n;
+
+	irqf = ukplat_lcpu_save_irqf();
+	c = &p->lcpu[ukplat_lcpu_idx()];
+
+	if (count + c->count > LCPU_CACHE_LEN) {
+		/* Flush the older half of the cache... */
+		n = c->count / 2;
+		if (n) {
+			_push_free_objs(p, c->obj, n);
+			memmove(&c->obj[0], &c->obj[n],
+				(c->count - n) * sizeof(c->obj[0]));
+			c->count -= n;
+		}
+
+		/* ...and pass what does not fit directly to the stack */
+		if (count + c->count > LCPU_CACHE_LEN) {
+			n = count + c->count - LCPU_CACHE_LEN;
+			_push_free_objs(p, obj, n);
+			obj += n;
+			count -= n;
+		}
+	}
+
+	memcpy(&c->obj[c->count], obj, count * sizeof(obj[0]));
+	c->count += count;
+	ukplat_lcpu_restore_irqf(irqf);
+}
+
+static inline void *_take_free_obj(struct uk_allocpool *p)
+{
+	void *obj;
+
+	return _take_free_objs(p, &obj, 1) ? obj : NULL;
+}
+
+static inline void _prepend_free_obj(struct uk_allocpool *p, void *obj)
+{
+	UK_ASSERT(obj);
+
+	_return_free_objs(p, &obj, 1);
+}
+#else /* !CONFIG_LIBUKALLOCPOOL_SMP */
 static inline void _prepend_free_obj(struct uk_allocpool *p, void *obj)
 {
 	struct uk_list_head *entry;
@@ -114,7 +314,9 @@ static inline void *_take_free_obj(struct uk_allocpool *p)
 	struct free_obj *obj;
 
 	UK_ASSERT(p);
-	UK_ASSERT(p->free_obj_count > 0);
+
+	if (unlikely(uk_list_empty(&p->free_obj)))
+		return NULL;
 
 	/* get object from list head */
 	obj = uk_list_first_entry(&p->free_obj, struct free_obj, list);
@@ -123,6 +325,34 @@ static inline void *_take_free_obj(struct uk_allocpool *p)
 	return (void *) obj;
 }
 
+static unsigned int _take_free_objs(struct uk_allocpool *p, void *obj[],
+				    unsigned int count)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; ++i) {
+		obj[i] = _take_free_obj(p);
+		if (unlikely(!obj[i]))
+			break;
+	}
+	return i;
+}
+
+static void _return_free_objs(struct uk_allocpool *p, void *obj[],
+			      unsigned int count)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; ++i)
+		_prepend_free_obj(p, obj[i]);
+}
+
+static inline unsigned int _free_obj_count(struct uk_allocpool *p)
+{
+	return p->free_obj_count;
+}
+#endif /* !CONFIG_LIBUKALLOCPOOL_SMP */
+
 static void pool_free(struct uk_alloc *a, void *ptr)
 {
 	struct uk_allocpool *p = ukalloc2pool(a);
@@ -138,16 +368,20 @@ static void *pool_malloc(struct uk_alloc *a, __sz size)
 	struct uk_allocpool *p = ukalloc2pool(a);
 	void *obj;
 
-	if (unlikely((size > p->obj_len)
-		     || uk_list_empty(&p->free_obj))) {
-		uk_alloc_stats_count_enomem(a, p->obj_len);
-		errno = ENOMEM;
-		return NULL;
-	}
+	if (unlikely(size > p->obj_len))
+		goto enomem;
 
 	obj = _take_free_obj(p);
+	if (unlikely(!obj))
+		goto enomem;
+
 	uk_alloc_stats_count_alloc(a, obj, p->obj_len);
 	return obj;
+
+enomem:
+	uk_alloc_stats_count_enomem(a, p->obj_len);
+	errno = ENOMEM;
+	return NULL;
 }
 
 static int pool_posix_memalign(struct uk_alloc *a, void **memptr, __sz align,
@@ -156,15 +390,19 @@ static int pool_posix_memalign(struct uk_alloc *a, void **memptr, __sz align,
 	struct uk_allocpool *p = ukalloc2pool(a);
 
 	if (unlikely((size > p->obj_len)
-		     || (align > p->obj_align)
-		     || uk_list_empty(&p->free_obj))) {
-		uk_alloc_stats_count_enomem(a, p->obj_len);
-		return ENOMEM;
-	}
+		     || (align > p->obj_align)))
+		goto enomem;
 
 	*memptr = _take_free_obj(p);
+	if (unlikely(!*memptr))
+		goto enomem;
+
 	uk_alloc_stats_count_alloc(a, *memptr, p->obj_len);
 	return 0;
+
+enomem:
+	uk_alloc_stats_count_enomem(a, p->obj_len);
+	return ENOMEM;
 }
 
 void *uk_allocpool_take(struct uk_allocpool *p)
@@ -173,13 +411,13 @@ void *uk_allocpool_take(struct uk_allocpool *p)
 
 	UK_ASSERT(p);
 
-	if (unlikely(uk_list_empty(&p->free_obj))) {
+	obj = _take_free_obj(p);
+	if (unlikely(!obj)) {
 		uk_alloc_stats_count_enomem(allocpool2ukalloc(p),
 					    p->obj_len);
 		return NULL;
 	}
 
-	obj = _take_free_obj(p);
 	uk_alloc_stats_count_alloc(allocpool2ukalloc(p),
 				   obj, p->obj_len);
 	return obj;
@@ -193,13 +431,10 @@ unsigned int uk_allocpool_take_batch(struct uk_allocpool *p,
 	UK_ASSERT(p);
 	UK_ASSERT(obj);
 
-	for (i = 0; i < count; ++i) {
-		if (unlikely(uk_list_empty(&p->free_obj)))
-			break;
-		obj[i] = _take_free_obj(p);
+	count = _take_free_objs(p, obj, count);
+	for (i = 0; i < count; ++i)
 		uk_alloc_stats_count_alloc(allocpool2ukalloc(p),
 					   obj[i], p->obj_len);
-	}
 
 	if (unlikely(i == 0))
 		uk_alloc_stats_count_enomem(allocpool2ukalloc(p),
@@ -225,18 +460,17 @@ void uk_allocpool_return_batch(struct uk_allocpool *p,
 	UK_ASSERT(p);
 	UK_ASSERT(obj);
 
-	for (i = 0; i < count; ++i) {
-		_prepend_free_obj(p, obj[i]);
+	for (i = 0; i < count; ++i)
 		uk_alloc_stats_count_free(allocpool2ukalloc(p),
 					  obj[i], p->obj_len);
-	}
+	_return_free_objs(p, obj, count);
 }
 
 static __ssz pool_availmem(struct uk_alloc *a)
 {
 	struct uk_allocpool *p = ukalloc2pool(a);
 
-	return (__ssz) (p->free_obj_count * p->obj_len);
+	return (__ssz) (_free_obj_count(p) * p->obj_len);
 }
 
 static __ssz pool_maxalloc(struct uk_alloc *a)
@@ -263,7 +497,7 @@ __sz uk_allocpool_reqmem(unsigned int obj_count, __sz obj_len,
 
 unsigned int uk_allocpool_availcount(struct uk_allocpool *p)
 {
-	return p->free_obj_count;
+	return _free_obj_count(p);
 }
 
 __sz uk_allocpool_objlen(struct uk_allocpool *p)
@@ -307,6 +541,22 @@ struct uk_allocpool *uk_allocpool_init(void *base, __sz len,
 	left = len - ((__uptr) obj_ptr - (__uptr) base);
 
 	p->obj_count = 0;
+#if CONFIG_LIBUKALLOCPOOL_SMP
+	/* Chain all objects in the order of their addresses */
+	p->obj_base = obj_ptr;
+	while (left >= obj_alen) {
+		++p->obj_count;
+		((struct free_obj *) obj_ptr)->next = p->obj_count + 1;
+		obj_ptr = (void *) ((__uptr) obj_ptr + obj_alen);
+		left -= obj_alen;
+	}
+	if (p->obj_count) {
+		obj_ptr = (void *) ((__uptr) obj_ptr - obj_alen);
+		((struct free_obj *) obj_ptr)->next = 0;
+		p->free_top = FREE_TOP(1, 0);
+	}
+	p->free_top_count = p->obj_count;
+#else /* !CONFIG_LIBUKALLOCPOOL_SMP */
 	p->free_obj_count = 0;
 	UK_INIT_LIST_HEAD(&p->free_obj);
 	while (left >= obj_alen) {
@@ -315,6 +565,7 @@ struct uk_allocpool *uk_allocpool_init(void *base, __sz len,
 		obj_ptr = (void *) ((__uptr) obj_ptr + obj_alen);
 		left -= obj_alen;
 	}
+#endif /* !CONFIG_LIBUKALLOCPOOL_SMP */
 
 out:
 	p->obj_len         = obj_alen;
@@ -372,7 +623,7 @@ void uk_allocpool_free(struct uk_allocpool *p)
 	UK_ASSERT(p->parent);
 
 	/* Make sure we got all objects back */
-	UK_ASSERT(p->free_obj_count == p->obj_count);
+	UK_ASSERT(_free_obj_count(p) == p->obj_count);
 
 	/* FIXME: Unregister `ukalloc` interface from `lib/ukalloc` */
 	/* TODO: Provide unregistration interface at `lib/ukalloc` */
@@ -34,6 +34,7 @@
 #ifndef __LIBUKALLOCREGION_H__
 #define __LIBUKALLOCREGION_H__
 
+#include <uk/config.h>
 #include <uk/alloc.h>
 
 #ifdef __cplusplus
@@ -43,6 +44,67 @@ extern "C" {
 /* allocator initialization */
 struct uk_alloc *uk_allocregion_init(void *base, size_t len);
 
+#if CONFIG_LIBUKALLOCREGION_ARENA
+/*
+ * Arenas
+ *
+ * An arena is a region allocator on memory that is taken from a parent
+ * allocator in chunks of at least `len` bytes. Like with any region, free() on
+ * arena memory is a no-op. Instead, memory is returned all at once: Either
+ * back to a mark that was taken earlier, or entirely. This makes arenas
+ * suitable for allocations with a common lifetime, e.g., those of a request.
+ * Arenas are not thread-safe. Memory statistics of an arena do not account
+ * returned memory.
+ */
+
+/* Position in an arena */
+struct uk_allocregion_mark {
+	void *chunk;
+	void *base;
+};
+
+/**
+ * Creates an arena
+ *
+ * @param parent
+ *   Allocator that provides the memory of the arena
+ * @param len
+ *   Length of the chunks taken from the parent, including the metadata of
+ *   the arena. Larger allocations take chunks of their own length.
+ * @return
+ *   Arena allocator, or NULL on failure
+ */
+struct uk_alloc *uk_allocregion_arena_create(struct uk_alloc *parent,
+					     size_t len);
+
+/* Returns all memory of an arena to its parent */
+void uk_allocregion_arena_destroy(struct uk_alloc *a);
+
+/* Returns the current position of a region allocator */
+struct uk_allocregion_mark uk_allocregion_mark(struct uk_alloc *a);
+
+/**
+ * Releases all memory that was allocated after `mark` was taken. Marks taken
+ * after `mark` become invalid.
+ */
+void uk_allocregion_release(struct uk_alloc *a,
+			    struct uk_allocregion_mark mark);
+
+/* Releases all memory of an arena but keeps its first chunk */
+void uk_allocregion_reset(struct uk_alloc *a);
+
+#if CONFIG_LIBUKALLOCREGION_ARENA_THREAD
+/**
+ * Returns the arena of the calling thread. It is created from the default
+ * allocator on first use and destroyed when the thread terminates.
+ *
+ * @return
+ *   Arena allocator, or NULL if it could not be created
+ */
+struct uk_alloc *uk_allocregion_arena_self(void);
+#endif /* CONFIG_LIBUKALLOCREGION_ARENA_THREAD */
+#endif /* CONFIG_LIBUKALLOCREGION_ARENA */
+
 #ifdef __cplusplus
 }
 #endif
@@ -53,17 +53,85 @@
 #include <uk/allocregion.h>
 #include <uk/alloc_impl.h>
 #include <uk/page.h>	/* round_pgup() */
+#if CONFIG_LIBUKALLOCREGION_ARENA_THREAD
+#include <uk/thread.h>
+#endif /* CONFIG_LIBUKALLOCREGION_ARENA_THREAD */
+
+#if CONFIG_LIBUKALLOCREGION_ARENA
+/* Memory of an arena that was taken from its parent. The chunks are linked
+ * from the current one back to the first one, which also holds the allocator.
+ */
+struct uk_allocregion_chunk {
+	struct uk_allocregion_chunk *prev;
+	void *top;
+};
+#endif /* CONFIG_LIBUKALLOCREGION_ARENA */
 
 struct uk_allocregion {
 	void *heap_top;
 	void *heap_base;
+#if CONFIG_LIBUKALLOCREGION_ARENA
+	struct uk_alloc *parent;		/* NULL if not an arena */
+	struct uk_allocregion_chunk *chunk;	/* current chunk */
+	struct uk_allocregion_chunk *first;
+	size_t chunk_len;			/* minimum chunk length */
+#endif /* CONFIG_LIBUKALLOCREGION_ARENA */
 };
 
-static void *uk_allocregion_malloc(struct uk_alloc *a, size_t size)
+static void *uk_allocregion_bump(struct uk_allocregion *b, uintptr_t align,
+				 size_t size)
 {
-	struct uk_allocregion *b;
 	uintptr_t intptr, newbase;
 
+	intptr = ALIGN_UP((uintptr_t) b->heap_base, align);
+
+	newbase  = intptr + size;
+	if (newbase > (uintptr_t) b->heap_top)
+		return NULL; /* out-of-memory */
+
+	/* Check for overflow, handle malloc(0) */
+	if (newbase <= (uintptr_t) b->heap_base)
+		return NULL;
+
+	b->heap_base = (void *)(newbase);
+	return (void *) intptr;
+}
+
+#if CONFIG_LIBUKALLOCREGION_ARENA
+/* Continues an arena in a new chunk from its parent */
+static void *uk_allocregion_grow(struct uk_allocregion *b, uintptr_t align,
+				 size_t size)
+{
+	struct uk_allocregion_chunk *c;
+	size_t len;
+
+	if (!b->parent || !size)
+		return NULL;
+
+	len = sizeof(*c) + align + size;
+	if (len < size)
+		return NULL; /* overflow */
+	len = MAX(len, b->chunk_len);
+
+	c = uk_malloc(b->parent, len);
+	if (!c)
+		return NULL;
+
+	c->prev = b->chunk;
+	c->top = (void *)((uintptr_t) c + len);
+	b->chunk = c;
+	b->heap_base = (void *)(c + 1);
+	b->heap_top = c->top;
+
+	return uk_allocregion_bump(b, align, size);
+}
+#endif /* CONFIG_LIBUKALLOCREGION_ARENA */
+
+void *uk_allocregion_malloc(struct uk_alloc *a, size_t size)
+{
+	struct uk_allocregion *b;
+	void *ptr;
+
 	UK_ASSERT(a != NULL);
 
 	b = (struct uk_allocregion *)&a->priv;
@@ -73,32 +141,27 @@ static void *uk_allocregion_malloc(struct uk_alloc *a, size_t size)
 	/* return aligned pointers: this is a requirement for some
 	 * embedded systems archs, and more generally good for performance
 	 */
-	intptr = ALIGN_UP(((uintptr_t) b->heap_base),
-			     (uintptr_t) sizeof(void *));
-
-	newbase  = intptr + size;
-	if (newbase > (uintptr_t) b->heap_top)
+	ptr = uk_allocregion_bump(b, sizeof(void *), size);
+#if CONFIG_LIBUKALLOCREGION_ARENA
+	if (!ptr)
+		ptr = uk_allocregion_grow(b, sizeof(void *), size);
+#endif /* CONFIG_LIBUKALLOCREGION_ARENA */
+	if (!ptr)
 		goto enomem; /* OOM */
 
-	/* Check for overflow, handle malloc(0) */
-	if (newbase <= (uintptr_t) b->heap_base)
-		goto enomem;
-
-	b->heap_base = (void *)(newbase);
-
-	uk_alloc_stats_count_alloc(a, (void *) intptr, size);
-	return (void *) intptr;
+	uk_alloc_stats_count_alloc(a, ptr, size);
+	return ptr;
 
 enomem:
 	uk_alloc_stats_count_enomem(a, size);
 	return NULL;
 }
 
-static int uk_allocregion_posix_memalign(struct uk_alloc *a, void **memptr,
-					 size_t align, size_t size)
+int uk_allocregion_posix_memalign(struct uk_alloc *a, void **memptr,
+				  size_t align, size_t size)
 {
 	struct uk_allocregion *b;
-	uintptr_t intptr, newbase;
+	void *ptr;
 
 	UK_ASSERT(a != NULL);
 
@@ -117,20 +180,17 @@ static int uk_allocregion_posix_memalign(struct uk_alloc *a, void **memptr,
 		return EINVAL;
 	}
 
-	intptr = ALIGN_UP((uintptr_t) b->heap_base, (uintptr_t) align);
-
-	newbase  = intptr + size;
-	if (newbase > (uintptr_t) b->heap_top)
+	ptr = uk_allocregion_bump(b, align, size);
+#if CONFIG_LIBUKALLOCREGION_ARENA
+	if (!ptr)
+		ptr = uk_allocregion_grow(b, align, size);
+#endif /* CONFIG_LIBUKALLOCREGION_ARENA */
+	if (!ptr)
 		goto enomem; /* out-of-memory */
 
-	/* Check for overflow */
-	if (newbase <= (uintptr_t) b->heap_base)
-		goto enomem;
-
-	*memptr = (void *)intptr;
-	b->heap_base = (void *)(newbase);
+	*memptr = ptr;
 
-	uk_alloc_stats_count_alloc(a, (void *) intptr, size);
+	uk_alloc_stats_count_alloc(a, ptr, size);
 	return 0;
 
 enomem:
@@ -139,8 +199,8 @@ enomem:
 
 }
 
-static void uk_allocregion_free(struct uk_alloc *a __maybe_unused,
-				void *ptr __maybe_unused)
+void uk_allocregion_free(struct uk_alloc *a __maybe_unused,
+			 void *ptr __maybe_unused)
 {
 	uk_pr_debug("%p: Releasing of memory is not supported by "
 			"ukallocregion\n", a);
@@ -204,6 +264,12 @@ struct uk_alloc *uk_allocregion_init(void *base, size_t len)
 
 	b->heap_top  = (void *)((uintptr_t) base + len);
 	b->heap_base = (void *)((uintptr_t) base + metalen);
+#if CONFIG_LIBUKALLOCREGION_ARENA
+	b->parent = NULL;
+	b->chunk = NULL;
+	b->first = NULL;
+	b->chunk_len = 0;
+#endif /* CONFIG_LIBUKALLOCREGION_ARENA */
 
 	/* use exclusively "compat" wrappers for calloc, realloc, memalign,
 	 * palloc and pfree as those do not add additional metadata.
@@ -217,3 +283,156 @@ struct uk_alloc *uk_allocregion_init(void *base, size_t len)
 
 	return a;
 }
+
+#if CONFIG_LIBUKALLOCREGION_ARENA
+struct uk_alloc *uk_allocregion_arena_create(struct uk_alloc *parent,
+					     size_t len)
+{
+	struct uk_alloc *a;
+	struct uk_allocregion *b;
+	struct uk_allocregion_chunk *c;
+	size_t metalen = ALIGN_UP(sizeof(*a) + sizeof(*b), sizeof(void *));
+
+	UK_ASSERT(parent != NULL);
+
+	if (len <= metalen + sizeof(*c)) {
+		uk_pr_err("Arena length %"__PRIsz" B too small\n", len);
+		return NULL;
+	}
+
+	/* The allocator is stored at the beginning of the first chunk */
+	a = uk_malloc(parent, len);
+	if (!a)
+		return NULL;
+	b = (struct uk_allocregion *)&a->priv;
+	c = (struct uk_allocregion_chunk *)((uintptr_t) a + metalen);
+
+	c->prev = NULL;
+	c->top = (void *)((uintptr_t) a + len);
+
+	b->parent = parent;
+	b->chunk = c;
+	b->first = c;
+	b->chunk_len = len;
+	b->heap_base = (void *)(c + 1);
+	b->heap_top = c->top;
+
+	/* Arenas are not registered: They are short-lived and would remain
+	 * in the allocator list after being destroyed
+	 */
+	uk_alloc_setup_malloc(a, uk_allocregion_malloc, uk_calloc_compat,
+			      uk_realloc_compat, uk_allocregion_free,
+			      uk_allocregion_posix_memalign,
+			      uk_memalign_compat, uk_allocregion_leftspace,
+			      uk_allocregion_leftspace,
+			      uk_allocregion_addmem);
+
+	uk_pr_debug("%p: Created arena of %"__PRIsz" B from %p\n",
+		    a, len, parent);
+	return a;
+}
+
+void uk_allocregion_arena_destroy(struct uk_alloc *a)
+{
+	struct uk_allocregion *b;
+
+	UK_ASSERT(a != NULL);
+
+	b = (struct uk_allocregion *)&a->priv;
+
+	UK_ASSERT(b->parent != NULL);
+
+	uk_allocregion_reset(a);
+	uk_free(b->parent, a);
+}
+
+struct uk_allocregion_mark uk_allocregion_mark(struct uk_alloc *a)
+{
+	struct uk_allocregion *b;
+
+	UK_ASSERT(a != NULL);
+
+	b = (struct uk_allocregion *)&a->priv;
+
+	return (struct uk_allocregion_mark) {
+		.chunk = b->chunk,
+		.base = b->heap_base,
+	};
+}
+
+void uk_allocregion_release(struct uk_alloc *a,
+			    struct uk_allocregion_mark mark)
+{
+	struct uk_allocregion *b;
+	struct uk_allocregion_chunk *c;
+
+	UK_ASSERT(a != NULL);
+
+	b = (struct uk_allocregion *)&a->priv;
+
+	/* Return the chunks that were taken after the mark */
+	while (b->chunk != mark.chunk) {
+		c = b->chunk;
+		UK_ASSERT(c); /* mark of another allocator or already released */
+		b->chunk = c->prev;
+		uk_free(b->parent, c);
+	}
+
+	b->heap_base = mark.base;
+	if (b->chunk)
+		b->heap_top = b->chunk->top;
+}
+
+void uk_allocregion_reset(struct uk_alloc *a)
+{
+	struct uk_allocregion *b;
+
+	UK_ASSERT(a != NULL);
+
+	b = (struct uk_allocregion *)&a->priv;
+
+	UK_ASSERT(b->parent != NULL);
+
+	uk_allocregion_release(a, (struct uk_allocregion_mark) {
+		.chunk = b->first,
+		.base = (void *)(b->first + 1),
+	});
+}
+
+#if CONFIG_LIBUKALLOCREGION_ARENA_THREAD
+static __uk_tls struct uk_alloc *arena_self;
+
+struct uk_alloc *uk_allocregion_arena_self(void)
+{
+	if (unlikely(!arena_self)) {
+		arena_self = uk_allocregion_arena_create(
+			uk_alloc_get_default(),
+			CONFIG_LIBUKALLOCREGION_ARENA_THREAD_LEN);
+	}
+	return arena_self;
+}
+
+/* NOTE: Thread init and termination functions are called with the thread's
+ *       TLS
+ */
+static int arena_thread_init(struct uk_thread *child __unused,
+			     struct uk_thread *parent __unused)
+{
+	/* The arena is created on first use */
+	arena_self = NULL;
+	return 0;
+}
+
+static void arena_thread_term(struct uk_thread *child __unused)
+{
+	if (!arena_self)
+		return;
+
+	uk_allocregion_arena_destroy(arena_self);
+	arena_self = NULL;
+}
+
+UK_THREAD_INIT_PRIO_FLAGS(arena_thread_init, arena_thread_term, UK_PRIO_LATEST,
+			  UK_THREAD_INITF_UKTLS);
+#endif /* CONFIG_LIBUKALLOCREGION_ARENA_THREAD */
+#endif /* CONFIG_LIBUKALLOCREGION_ARENA */
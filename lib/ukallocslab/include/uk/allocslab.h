@@ -0,0 +1,34 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __LIBUKALLOCSLAB_H__
+#define __LIBUKALLOCSLAB_H__
+
+#include <uk/alloc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Creates a slab allocator that takes its pages from a parent allocator.
+ * The returned allocator is registered but does not become the default
+ * allocator (see `uk_alloc_set_default()`). Page allocations are forwarded
+ * to the parent.
+ *
+ * @param parent
+ *  Allocator that provides the pages for slabs and large objects.
+ * @return
+ *  - (NULL): If the allocator could not be created (ENOMEM).
+ *  - pointer to the allocator interface.
+ */
+struct uk_alloc *uk_allocslab_init(struct uk_alloc *parent);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LIBUKALLOCSLAB_H__ */
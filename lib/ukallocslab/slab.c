@@ -0,0 +1,483 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+/*
+ * Size-class slab allocator
+ *
+ * SLAB: MEMORY LAYOUT (one page)
+ *
+ *          ++----------------------++
+ *          || struct allocslab_slab|| <- page aligned
+ *          ++----------------------++
+ *          |    // padding //       |
+ *          +========================+ <- first object offset
+ *          |       OBJECT 0         |
+ *          +========================+
+ *          |       OBJECT 1         |
+ *          +========================+
+ *          |         ...            |
+ *          v                        v
+ *
+ * Requests up to the largest size class are served from slabs of their
+ * class. A set bit in the bitmap of a slab marks a free object. Slabs with
+ * at least one free object are kept on a per-class list, so that an
+ * allocation only inspects the first slab on that list. Objects of
+ * power-of-two classes are naturally aligned.
+ *
+ * Larger requests are satisfied with whole pages from the parent. Their
+ * header is located at the start of the page that contains the returned
+ * pointer, or the previous page if the pointer is page aligned (for
+ * alignments of a page or more). Slab objects are never page aligned, so
+ * `allocslab_page_of()` finds the header of both kinds.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <uk/essentials.h>
+#include <uk/alloc_impl.h>
+#include <uk/allocslab.h>
+#include <uk/assert.h>
+#include <uk/print.h>
+#include <uk/list.h>
+#include <uk/spinlock.h>
+#include <uk/arch/limits.h>
+#include <uk/arch/paging.h>
+#include <uk/plat/lcpu.h>
+
+#define ALLOCSLAB_LARGE		0xffff
+#define ALLOCSLAB_SLAB_HDR	64
+#define ALLOCSLAB_LARGE_HDR	32
+#define ALLOCSLAB_MIN_ALIGN	16
+#define ALLOCSLAB_BITMAP_LEN	4
+
+static const __u16 allocslab_sizes[] = {
+	16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024
+};
+
+#define ALLOCSLAB_NCLASSES	ARRAY_SIZE(allocslab_sizes)
+#define ALLOCSLAB_MAXSIZE	1024
+
+/* Common first member of slab and large object headers */
+struct allocslab_page {
+	__u16 cls;
+};
+
+struct allocslab_slab {
+	__u16 cls;
+	__u16 nfree;
+	struct uk_list_head list;
+	__u64 bitmap[ALLOCSLAB_BITMAP_LEN];
+};
+
+UK_CTASSERT(sizeof(struct allocslab_slab) <= ALLOCSLAB_SLAB_HDR);
+UK_CTASSERT((PAGE_SIZE - ALLOCSLAB_SLAB_HDR) / 16 <=
+	    ALLOCSLAB_BITMAP_LEN * 64);
+
+struct allocslab_large {
+	__u16 cls;
+	unsigned long num_pages;
+	void *base;
+	__sz size;
+};
+
+UK_CTASSERT(sizeof(struct allocslab_large) <= ALLOCSLAB_LARGE_HDR);
+
+struct allocslab_cache {
+	struct uk_list_head partial; /* slabs with free objects */
+	unsigned int nr_empty;       /* slabs on `partial` without objects */
+	__u16 size;
+	__u16 off;                   /* offset of the first object */
+	__u16 nobj;                  /* objects per slab */
+};
+
+struct uk_allocslab {
+	struct uk_alloc self;
+
+	struct uk_alloc *parent;
+	uk_spinlock lock;
+	struct allocslab_cache cache[ALLOCSLAB_NCLASSES];
+	/* Class index by (size - 1) / 16 */
+	__u8 size2cls[ALLOCSLAB_MAXSIZE / 16];
+};
+
+static inline struct uk_allocslab *ukalloc2slab(struct uk_alloc *a)
+{
+	UK_ASSERT(a);
+	return __containerof(a, struct uk_allocslab, self);
+}
+
+static inline struct allocslab_page *allocslab_page_of(const void *ptr)
+{
+	__uptr page = PAGE_ALIGN_DOWN((__uptr)ptr);
+
+	if (page == (__uptr)ptr)
+		page -= PAGE_SIZE;
+	return (struct allocslab_page *)page;
+}
+
+static inline __sz allocslab_usable_size(struct uk_allocslab *s,
+					 const void *ptr)
+{
+	struct allocslab_page *pg = allocslab_page_of(ptr);
+
+	if (pg->cls == ALLOCSLAB_LARGE)
+		return ((struct allocslab_large *)pg)->size;
+
+	UK_ASSERT(pg->cls < ALLOCSLAB_NCLASSES);
+	return s->cache[pg->cls].size;
+}
+
+/*
+ * Slabs
+ */
+static struct allocslab_slab *allocslab_slab_new(struct uk_allocslab *s,
+						 unsigned int cls)
+{
+	struct allocslab_cache *c = &s->cache[cls];
+	struct allocslab_slab *slab;
+	unsigned int i;
+
+	slab = uk_palloc(s->parent, 1);
+	if (unlikely(!slab))
+		return __NULL;
+
+	slab->cls = cls;
+	slab->nfree = c->nobj;
+	memset(slab->bitmap, 0, sizeof(slab->bitmap));
+	for (i = 0; i < c->nobj; i++)
+		slab->bitmap[i / 64] |= (1ULL << (i % 64));
+
+	uk_list_add(&slab->list, &c->partial);
+	c->nr_empty++;
+	return slab;
+}
+
+static void *allocslab_obj_alloc(struct uk_allocslab *s, unsigned int cls)
+{
+	struct allocslab_cache *c = &s->cache[cls];
+	struct allocslab_slab *slab;
+	unsigned int w, bit;
+
+	if (uk_list_empty(&c->partial)) {
+		if (unlikely(!allocslab_slab_new(s, cls)))
+			return __NULL;
+	}
+
+	slab = uk_list_first_entry(&c->partial, struct allocslab_slab, list);
+	UK_ASSERT(slab->nfree > 0);
+	if (slab->nfree == c->nobj)
+		c->nr_empty--;
+
+	for (w = 0; !slab->bitmap[w]; w++)
+		UK_ASSERT(w < ALLOCSLAB_BITMAP_LEN - 1);
+	bit = __builtin_ctzll(slab->bitmap[w]);
+	slab->bitmap[w] &= ~(1ULL << bit);
+
+	if (--slab->nfree == 0)
+		uk_list_del(&slab->list);
+
+	return (void *)((__uptr)slab + c->off + (w * 64 + bit) * c->size);
+}
+
+static void allocslab_obj_free(struct uk_allocslab *s,
+			       struct allocslab_slab *slab, void *ptr)
+{
+	struct allocslab_cache *c = &s->cache[slab->cls];
+	__uptr off = (__uptr)ptr - (__uptr)slab - c->off;
+	unsigned int idx = off / c->size;
+
+	UK_ASSERT(off % c->size == 0);
+	UK_ASSERT(idx < c->nobj);
+	UK_ASSERT(!(slab->bitmap[idx / 64] & (1ULL << (idx % 64))));
+
+	slab->bitmap[idx / 64] |= (1ULL << (idx % 64));
+	if (++slab->nfree == 1)
+		uk_list_add(&slab->list, &c->partial);
+
+	if (slab->nfree == c->nobj) {
+		/* Keep one empty slab per class, return further ones */
+		if (c->nr_empty) {
+			uk_list_del(&slab->list);
+			uk_pfree(s->parent, slab, 1);
+			return;
+		}
+		/* Prefer partially used slabs for allocations */
+		uk_list_del(&slab->list);
+		uk_list_add_tail(&slab->list, &c->partial);
+		c->nr_empty++;
+	}
+}
+
+/*
+ * Large objects
+ */
+static void *allocslab_large_alloc(struct uk_allocslab *s, __sz align,
+				   __sz size)
+{
+	struct allocslab_large *hdr;
+	unsigned long num_pages;
+	__uptr base, ptr, off;
+
+	if (align >= PAGE_SIZE) {
+		if (unlikely(size > __SZ_MAX - align))
+			return __NULL;
+		num_pages = align / PAGE_SIZE + DIV_ROUND_UP(size, PAGE_SIZE);
+	} else {
+		off = ALIGN_UP(ALLOCSLAB_LARGE_HDR, MAX(align,
+				(__sz)ALLOCSLAB_MIN_ALIGN));
+		if (unlikely(size > __SZ_MAX - off - PAGE_SIZE))
+			return __NULL;
+		num_pages = DIV_ROUND_UP(off + size, PAGE_SIZE);
+	}
+
+	base = (__uptr)uk_palloc(s->parent, num_pages);
+	if (unlikely(!base))
+		return __NULL;
+
+	if (align >= PAGE_SIZE) {
+		ptr = ALIGN_UP(base + PAGE_SIZE, align);
+		hdr = (struct allocslab_large *)(ptr - PAGE_SIZE);
+	} else {
+		ptr = base + off;
+		hdr = (struct allocslab_large *)base;
+	}
+	hdr->cls       = ALLOCSLAB_LARGE;
+	hdr->num_pages = num_pages;
+	hdr->base      = (void *)base;
+	hdr->size      = size;
+	return (void *)ptr;
+}
+
+/*
+ * uk_alloc interface
+ */
+static inline int allocslab_cls(struct uk_allocslab *s, __sz size, __sz align)
+{
+	unsigned int cls;
+
+	if (size > ALLOCSLAB_MAXSIZE || align > ALLOCSLAB_MAXSIZE)
+		return -1;
+
+	cls = s->size2cls[(MAX(size, align) - 1) / 16];
+	if (align > ALLOCSLAB_MIN_ALIGN) {
+		/* Only power-of-two classes are aligned beyond that */
+		while (!POWER_OF_2(s->cache[cls].size))
+			cls++;
+	}
+	return (int)cls;
+}
+
+static void *allocslab_do_alloc(struct uk_allocslab *s, __sz align, __sz size)
+{
+	unsigned long irqf;
+	void *ptr;
+	int cls;
+
+	cls = allocslab_cls(s, size, align);
+
+	irqf = ukplat_lcpu_save_irqf();
+	uk_spin_lock(&s->lock);
+	if (cls >= 0)
+		ptr = allocslab_obj_alloc(s, (unsigned int)cls);
+	else
+		ptr = allocslab_large_alloc(s, align, size);
+	uk_spin_unlock(&s->lock);
+	ukplat_lcpu_restore_irqf(irqf);
+
+	if (unlikely(!ptr)) {
+		uk_alloc_stats_count_enomem(&s->self, size);
+		return __NULL;
+	}
+	uk_alloc_stats_count_alloc(&s->self, ptr,
+				   allocslab_usable_size(s, ptr));
+	return ptr;
+}
+
+static void *allocslab_malloc(struct uk_alloc *a, __sz size)
+{
+	void *ptr;
+
+	if (unlikely(!size))
+		return __NULL;
+
+	ptr = allocslab_do_alloc(ukalloc2slab(a), 0, size);
+	if (unlikely(!ptr))
+		errno = ENOMEM;
+	return ptr;
+}
+
+static int allocslab_posix_memalign(struct uk_alloc *a, void **memptr,
+				    __sz align, __sz size)
+{
+	UK_ASSERT(memptr);
+
+	if (unlikely(!POWER_OF_2(align) || align < sizeof(void *)))
+		return EINVAL;
+
+	if (unlikely(!size)) {
+		*memptr = __NULL;
+		return 0;
+	}
+
+	*memptr = allocslab_do_alloc(ukalloc2slab(a), align, size);
+	return *memptr ? 0 : ENOMEM;
+}
+
+static void allocslab_free(struct uk_alloc *a, void *ptr)
+{
+	struct uk_allocslab *s = ukalloc2slab(a);
+	struct allocslab_page *pg;
+	struct allocslab_large *hdr;
+	unsigned long irqf;
+
+	if (unlikely(!ptr))
+		return;
+
+	uk_alloc_stats_count_free(a, ptr, allocslab_usable_size(s, ptr));
+
+	pg = allocslab_page_of(ptr);
+	irqf = ukplat_lcpu_save_irqf();
+	uk_spin_lock(&s->lock);
+	if (pg->cls == ALLOCSLAB_LARGE) {
+		hdr = (struct allocslab_large *)pg;
+		uk_pfree(s->parent, hdr->base, hdr->num_pages);
+	} else {
+		allocslab_obj_free(s, (struct allocslab_slab *)pg, ptr);
+	}
+	uk_spin_unlock(&s->lock);
+	ukplat_lcpu_restore_irqf(irqf);
+}
+
+static void *allocslab_realloc(struct uk_alloc *a, void *ptr, __sz size)
+{
+	struct uk_allocslab *s = ukalloc2slab(a);
+	__sz old_size;
+	void *retptr;
+
+	if (!ptr)
+		return allocslab_malloc(a, size);
+
+	if (!size) {
+		allocslab_free(a, ptr);
+		return __NULL;
+	}
+
+	old_size = allocslab_usable_size(s, ptr);
+	if (size <= old_size &&
+	    allocslab_page_of(ptr)->cls != ALLOCSLAB_LARGE)
+		return ptr;
+
+	retptr = allocslab_malloc(a, size);
+	if (unlikely(!retptr))
+		return __NULL;
+
+	memcpy(retptr, ptr, MIN(size, old_size));
+	allocslab_free(a, ptr);
+	return retptr;
+}
+
+static void *allocslab_palloc(struct uk_alloc *a, unsigned long num_pages)
+{
+	struct uk_allocslab *s = ukalloc2slab(a);
+	unsigned long irqf;
+	void *pages;
+
+	irqf = ukplat_lcpu_save_irqf();
+	uk_spin_lock(&s->lock);
+	pages = uk_palloc(s->parent, num_pages);
+	uk_spin_unlock(&s->lock);
+	ukplat_lcpu_restore_irqf(irqf);
+	return pages;
+}
+
+static void allocslab_pfree(struct uk_alloc *a, void *ptr,
+			    unsigned long num_pages)
+{
+	struct uk_allocslab *s = ukalloc2slab(a);
+	unsigned long irqf;
+
+	irqf = ukplat_lcpu_save_irqf();
+	uk_spin_lock(&s->lock);
+	uk_pfree(s->parent, ptr, num_pages);
+	uk_spin_unlock(&s->lock);
+	ukplat_lcpu_restore_irqf(irqf);
+}
+
+static int allocslab_addmem(struct uk_alloc *a, void *base, __sz len)
+{
+	struct uk_allocslab *s = ukalloc2slab(a);
+	unsigned long irqf;
+	int rc;
+
+	irqf = ukplat_lcpu_save_irqf();
+	uk_spin_lock(&s->lock);
+	rc = uk_alloc_addmem(s->parent, base, len);
+	uk_spin_unlock(&s->lock);
+	ukplat_lcpu_restore_irqf(irqf);
+	return rc;
+}
+
+/* NOTE: Free objects in slabs are not accounted as available memory */
+static __ssz allocslab_maxalloc(struct uk_alloc *a)
+{
+	return uk_alloc_maxalloc(ukalloc2slab(a)->parent);
+}
+
+static __ssz allocslab_availmem(struct uk_alloc *a)
+{
+	return uk_alloc_availmem(ukalloc2slab(a)->parent);
+}
+
+struct uk_alloc *uk_allocslab_init(struct uk_alloc *parent)
+{
+	struct uk_allocslab *s;
+	struct allocslab_cache *c;
+	struct uk_alloc *a;
+	unsigned int cls, i;
+
+	UK_ASSERT(parent);
+
+	s = uk_calloc(parent, 1, sizeof(*s));
+	if (unlikely(!s)) {
+		errno = ENOMEM;
+		return __NULL;
+	}
+
+	s->parent = parent;
+	uk_spin_init(&s->lock);
+
+	for (cls = 0, i = 0; cls < ALLOCSLAB_NCLASSES; cls++) {
+		c = &s->cache[cls];
+		c->size = allocslab_sizes[cls];
+		c->off  = POWER_OF_2(c->size)
+			  ? MAX(c->size, ALLOCSLAB_SLAB_HDR)
+			  : ALLOCSLAB_SLAB_HDR;
+		c->nobj = (PAGE_SIZE - c->off) / c->size;
+		UK_INIT_LIST_HEAD(&c->partial);
+
+		for (; i < ARRAY_SIZE(s->size2cls) && (i + 1) * 16 <= c->size;
+		     i++)
+			s->size2cls[i] = cls;
+	}
+
+	a = &s->self;
+	uk_alloc_init_malloc(a,
+			     allocslab_malloc,
+			     uk_calloc_compat,
+			     allocslab_realloc,
+			     allocslab_free,
+			     allocslab_posix_memalign,
+			     uk_memalign_compat,
+			     allocslab_maxalloc,
+			     allocslab_availmem,
+			     allocslab_addmem);
+	a->palloc = allocslab_palloc;
+	a->pfree  = allocslab_pfree;
+
+	uk_pr_info("%p: Slab allocator on %p: %u size classes up to %u B\n",
+		   s, parent, (unsigned int)ALLOCSLAB_NCLASSES,
+		   (unsigned int)ALLOCSLAB_MAXSIZE);
+	return a;
+}
@@ -110,6 +110,109 @@ extern "C" {
 		    : old;                                                     \
 	})
 
+/*
+ * Variants with explicit memory ordering
+ *
+ * The operations above are sequentially consistent, which costs a full
+ * barrier on weakly ordered architectures like arm64. Where an operation
+ * only has to order the accesses before or after it, use these instead:
+ *  _relaxed  atomicity only, e.g., for statistics counters
+ *  _acquire  later accesses are not moved before the operation, e.g., when
+ *            taking a lock or reading a published pointer
+ *  _release  earlier accesses are not moved after the operation, e.g., when
+ *            dropping a lock or publishing data
+ */
+#define uk_load_n_relaxed(src) \
+	__atomic_load_n(src, __ATOMIC_RELAXED)
+#define uk_load_n_acquire(src) \
+	__atomic_load_n(src, __ATOMIC_ACQUIRE)
+
+#define uk_store_n_relaxed(src, value) \
+	__atomic_store_n(src, value, __ATOMIC_RELAXED)
+#define uk_store_n_release(src, value) \
+	__atomic_store_n(src, value, __ATOMIC_RELEASE)
+
+#define uk_fetch_add_relaxed(src, value) \
+	__atomic_fetch_add(src, value, __ATOMIC_RELAXED)
+#define uk_fetch_add_acquire(src, value) \
+	__atomic_fetch_add(src, value, __ATOMIC_ACQUIRE)
+#define uk_fetch_add_release(src, value) \
+	__atomic_fetch_add(src, value, __ATOMIC_RELEASE)
+#define uk_fetch_sub_relaxed(src, value) \
+	__atomic_fetch_sub(src, value, __ATOMIC_RELAXED)
+#define uk_fetch_sub_acquire(src, value) \
+	__atomic_fetch_sub(src, value, __ATOMIC_ACQUIRE)
+#define uk_fetch_sub_release(src, value) \
+	__atomic_fetch_sub(src, value, __ATOMIC_RELEASE)
+
+#define uk_add_fetch_relaxed(src, value) \
+	__atomic_add_fetch(src, value, __ATOMIC_RELAXED)
+#define uk_add_fetch_acquire(src, value) \
+	__atomic_add_fetch(src, value, __ATOMIC_ACQUIRE)
+#define uk_add_fetch_release(src, value) \
+	__atomic_add_fetch(src, value, __ATOMIC_RELEASE)
+#define uk_sub_fetch_relaxed(src, value) \
+	__atomic_sub_fetch(src, value, __ATOMIC_RELAXED)
+#define uk_sub_fetch_acquire(src, value) \
+	__atomic_sub_fetch(src, value, __ATOMIC_ACQUIRE)
+#define uk_sub_fetch_release(src, value) \
+	__atomic_sub_fetch(src, value, __ATOMIC_RELEASE)
+
+#define uk_inc_relaxed(src) \
+	uk_fetch_add_relaxed(src, 1)
+#define uk_inc_acquire(src) \
+	uk_fetch_add_acquire(src, 1)
+#define uk_inc_release(src) \
+	uk_fetch_add_release(src, 1)
+#define uk_dec_relaxed(src) \
+	uk_fetch_sub_relaxed(src, 1)
+#define uk_dec_acquire(src) \
+	uk_fetch_sub_acquire(src, 1)
+#define uk_dec_release(src) \
+	uk_fetch_sub_release(src, 1)
+
+#define uk_or_relaxed(src, val) \
+	__atomic_fetch_or(src, val, __ATOMIC_RELAXED)
+#define uk_or_acquire(src, val) \
+	__atomic_fetch_or(src, val, __ATOMIC_ACQUIRE)
+#define uk_or_release(src, val) \
+	__atomic_fetch_or(src, val, __ATOMIC_RELEASE)
+
+#define uk_and_relaxed(src, val) \
+	__atomic_fetch_and(src, val, __ATOMIC_RELAXED)
+#define uk_and_acquire(src, val) \
+	__atomic_fetch_and(src, val, __ATOMIC_ACQUIRE)
+#define uk_and_release(src, val) \
+	__atomic_fetch_and(src, val, __ATOMIC_RELEASE)
+
+#define uk_exchange_n_relaxed(dst, v) \
+	__atomic_exchange_n(dst, v, __ATOMIC_RELAXED)
+#define uk_exchange_n_acquire(dst, v) \
+	__atomic_exchange_n(dst, v, __ATOMIC_ACQUIRE)
+#define uk_exchange_n_release(dst, v) \
+	__atomic_exchange_n(dst, v, __ATOMIC_RELEASE)
+
+/* On failure, *exp is updated with a relaxed load */
+#define uk_compare_exchange_n_relaxed(dst, exp, des) \
+	__atomic_compare_exchange_n(dst, exp, des, 0, \
+				    __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+#define uk_compare_exchange_n_acquire(dst, exp, des) \
+	__atomic_compare_exchange_n(dst, exp, des, 0, \
+				    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)
+#define uk_compare_exchange_n_release(dst, exp, des) \
+	__atomic_compare_exchange_n(dst, exp, des, 0, \
+				    __ATOMIC_RELEASE, __ATOMIC_RELAXED)
+
+/**
+ * Fences that order the surrounding relaxed operations
+ */
+#define uk_fence_acquire() \
+	__atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define uk_fence_release() \
+	__atomic_thread_fence(__ATOMIC_RELEASE)
+#define uk_fence() \
+	__atomic_thread_fence(__ATOMIC_SEQ_CST)
+
 #define	UK_ACCESS_ONCE(x)			(*(volatile __typeof(x) *)&(x))
 
 #define	UK_WRITE_ONCE(x, v) do {	\
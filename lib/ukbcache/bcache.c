@@ -0,0 +1,716 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <string.h>
+#include <errno.h>
+
+#include <uk/alloc.h>
+#include <uk/assert.h>
+#include <uk/atomic.h>
+#include <uk/bcache.h>
+#include <uk/essentials.h>
+#include <uk/list.h>
+#include <uk/mutex.h>
+#include <uk/print.h>
+#include <uk/wait.h>
+
+#define BC_HASH_BUCKETS		256
+#define BC_READAHEAD		((__sector)CONFIG_LIBUKBCACHE_READAHEAD)
+#define BC_DIRTY_MAX		((unsigned long)CONFIG_LIBUKBCACHE_DIRTY_MAX)
+/* Maximum number of requests submitted with one burst */
+#define BC_BATCH		32
+
+/*
+ * Locking: all fields of the cache and of its buffers are protected by
+ * `lock`, except for `io` and `error` of a buffer and for the counters that
+ * are updated by the completion callback. The callback runs in the context
+ * of uk_blkdev_queue_finish_reqs() (possibly an interrupt handler) and thus
+ * only stores the result, clears `io`, and wakes up waiters.
+ *
+ * A buffer is in the hash table as long as it belongs to the cache. It is on
+ * the LRU list if it is not referenced and on the dirty list if it was
+ * modified and not yet submitted for writeback. Only unreferenced, clean
+ * buffers without a request in flight are evicted or written back.
+ */
+struct bc_buf {
+	struct uk_bbuf b;
+	struct uk_list_head hash_link;
+	struct uk_list_head lru_link;
+	struct uk_list_head dirty_link;
+	struct uk_bcache *bc;
+	struct uk_blkreq req;
+	unsigned int refcnt;
+	int dirty;
+	/* The data is up to date (read or overwritten). Also set by the
+	 * completion callback for successful reads.
+	 */
+	int valid;
+	/* A request is in flight */
+	int io;
+	/* Result of the last request */
+	int error;
+};
+
+struct uk_bcache {
+	struct uk_alloc *a;
+	struct uk_blkdev *dev;
+	uint16_t queue_id;
+	__sz bsize;
+	/* Sectors per block */
+	__sector spb;
+	/* Number of blocks of the device */
+	__sector nblocks;
+	unsigned long nbufs;
+	unsigned long maxbufs;
+	unsigned long ndirty;
+	/* Block of the last lookup and first block not yet read ahead */
+	__sector last_blkno;
+	__sector ra_next;
+	/* Updated by the completion callback */
+	unsigned long inflight;
+	unsigned long ncompleted;
+	int wb_error;
+	struct uk_mutex lock;
+	struct uk_waitq wq;
+	struct uk_list_head lru;
+	struct uk_list_head dirty;
+	struct uk_list_head hash[BC_HASH_BUCKETS];
+};
+
+#define to_bc_buf(bbuf) __containerof(bbuf, struct bc_buf, b)
+
+static inline unsigned int bc_hash_idx(__sector blkno)
+{
+	return (unsigned int)(blkno ^ (blkno >> 8)) & (BC_HASH_BUCKETS - 1);
+}
+
+static struct bc_buf *bc_lookup(struct uk_bcache *bc, __sector blkno)
+{
+	struct bc_buf *bb;
+
+	uk_list_for_each_entry(bb, &bc->hash[bc_hash_idx(blkno)], hash_link) {
+		if (bb->b.blkno == blkno)
+			return bb;
+	}
+	return NULL;
+}
+
+static inline int bc_evictable(struct bc_buf *bb)
+{
+	return !bb->refcnt && !bb->dirty && !uk_load_n(&bb->io);
+}
+
+static void bc_buf_free(struct uk_bcache *bc, struct bc_buf *bb)
+{
+	uk_free(bc->a, bb->b.data);
+	uk_free(bc->a, bb);
+	bc->nbufs--;
+}
+
+/* Takes a buffer out of the cache, keeping its memory */
+static void bc_detach(struct bc_buf *bb)
+{
+	UK_ASSERT(bc_evictable(bb));
+
+	uk_list_del(&bb->hash_link);
+	uk_list_del(&bb->lru_link);
+}
+
+static void bc_insert(struct uk_bcache *bc, struct bc_buf *bb,
+		      __sector blkno)
+{
+	bb->b.blkno = blkno;
+	bb->refcnt = 0;
+	bb->dirty = 0;
+	bb->valid = 0;
+	bb->io = 0;
+	bb->error = 0;
+	uk_list_add(&bb->hash_link, &bc->hash[bc_hash_idx(blkno)]);
+	uk_list_add(&bb->lru_link, &bc->lru);
+}
+
+static void bc_io_done(struct uk_blkreq *req, void *cookie)
+{
+	struct bc_buf *bb = (struct bc_buf *)cookie;
+	struct uk_bcache *bc = bb->bc;
+	int error = (req->result < 0) ? -EIO : 0;
+
+	if (unlikely(error) && req->operation == UK_BLKREQ_WRITE) {
+		uk_pr_err("Failed to write back block %"__PRIsctr"\n",
+			  bb->b.blkno);
+		uk_store_n(&bc->wb_error, error);
+	}
+
+	bb->error = error;
+	if (!error && req->operation == UK_BLKREQ_READ)
+		uk_store_n(&bb->valid, 1);
+	uk_store_n(&bb->io, 0);
+	uk_dec(&bc->inflight);
+	uk_inc(&bc->ncompleted);
+	uk_waitq_wake_up(&bc->wq);
+}
+
+/* Waits until at least one request completed after `seq` was sampled */
+static void bc_wait_completion(struct uk_bcache *bc, unsigned long seq)
+{
+	uk_mutex_unlock(&bc->lock);
+	uk_waitq_wait_event(&bc->wq, uk_load_n(&bc->ncompleted) != seq);
+	uk_mutex_lock(&bc->lock);
+}
+
+/*
+ * Submits `cnt` requests with as few device notifications as possible. If
+ * the queue is full, waits for requests of the cache to complete. Returns
+ * the number of submitted requests. The others are not accounted as in
+ * flight and `*err` holds the reason why they could not be submitted.
+ */
+static unsigned int bc_submit_reqs(struct uk_bcache *bc,
+				   struct uk_blkreq *reqs[], unsigned int cnt,
+				   int *err)
+{
+	unsigned long seq;
+	unsigned int done;
+	int rc;
+
+	uk_add_fetch(&bc->inflight, cnt);
+
+	done = 0;
+	while (done < cnt) {
+		seq = uk_load_n(&bc->ncompleted);
+		rc = uk_blkdev_queue_submit_burst(bc->dev, bc->queue_id,
+						  &reqs[done],
+						  (uint16_t)(cnt - done));
+		if (rc > 0) {
+			done += rc;
+			continue;
+		}
+
+		/* The queue is full: wait for one of our own requests. If we
+		 * have none in flight, the queue is used by someone else and
+		 * we do not know when space becomes available.
+		 */
+		if (rc == 0 && uk_load_n(&bc->inflight) > cnt - done) {
+			bc_wait_completion(bc, seq);
+			continue;
+		}
+
+		if (rc == 0)
+			rc = -EBUSY;
+		uk_pr_err("Failed to submit %u requests: %d\n", cnt - done,
+			  rc);
+		uk_sub_fetch(&bc->inflight, cnt - done);
+		*err = rc;
+		break;
+	}
+	return done;
+}
+
+/*
+ * Submits requests for `cnt` buffers. Buffers that could not be submitted
+ * are completed with an error.
+ */
+static void bc_submit(struct uk_bcache *bc, struct bc_buf *bbs[],
+		      unsigned int cnt, enum uk_blkreq_op op)
+{
+	struct uk_blkreq *reqs[BC_BATCH];
+	unsigned int i, done;
+	int rc = 0;
+
+	UK_ASSERT(cnt <= BC_BATCH);
+
+	for (i = 0; i < cnt; i++) {
+		uk_blkreq_init(&bbs[i]->req, op, bbs[i]->b.blkno * bc->spb,
+			       bc->spb, bbs[i]->b.data, bc_io_done, bbs[i]);
+		bbs[i]->io = 1;
+		reqs[i] = &bbs[i]->req;
+	}
+
+	done = bc_submit_reqs(bc, reqs, cnt, &rc);
+	if (unlikely(done < cnt)) {
+		for (i = done; i < cnt; i++) {
+			bbs[i]->error = rc;
+			uk_store_n(&bbs[i]->io, 0);
+		}
+		if (op == UK_BLKREQ_WRITE)
+			uk_store_n(&bc->wb_error, rc);
+		uk_waitq_wake_up(&bc->wq);
+	}
+}
+
+/* Submits writeback for up to `max` unreferenced dirty buffers */
+static unsigned long bc_writeback(struct uk_bcache *bc, unsigned long max)
+{
+	struct bc_buf *bbs[BC_BATCH];
+	struct bc_buf *bb, *tmp;
+	unsigned long total = 0;
+	unsigned int cnt;
+
+	do {
+		cnt = 0;
+		uk_list_for_each_entry_safe(bb, tmp, &bc->dirty, dirty_link) {
+			if (bb->refcnt || bb->io)
+				continue;
+
+			uk_list_del(&bb->dirty_link);
+			bb->dirty = 0;
+			bc->ndirty--;
+			bbs[cnt++] = bb;
+			if (cnt == BC_BATCH || total + cnt == max)
+				break;
+		}
+		if (cnt)
+			bc_submit(bc, bbs, cnt, UK_BLKREQ_WRITE);
+		total += cnt;
+	} while (cnt == BC_BATCH && total < max);
+
+	return total;
+}
+
+/* Evicts the least recently used clean buffer */
+static struct bc_buf *bc_evict(struct uk_bcache *bc)
+{
+	struct bc_buf *bb;
+
+	uk_list_for_each_entry_reverse(bb, &bc->lru, lru_link) {
+		if (bc_evictable(bb)) {
+			bc_detach(bb);
+			return bb;
+		}
+	}
+	return NULL;
+}
+
+static struct bc_buf *bc_buf_new(struct uk_bcache *bc)
+{
+	struct bc_buf *bb;
+
+	if (bc->nbufs >= bc->maxbufs)
+		return NULL;
+
+	bb = uk_malloc(bc->a, sizeof(*bb));
+	if (unlikely(!bb))
+		return NULL;
+
+	bb->b.data = uk_memalign(bc->a, uk_blkdev_ioalign(bc->dev),
+				 bc->bsize);
+	if (unlikely(!bb->b.data)) {
+		uk_free(bc->a, bb);
+		return NULL;
+	}
+
+	bb->bc = bc;
+	bc->nbufs++;
+	return bb;
+}
+
+/*
+ * Gets a free buffer that is not in the cache. Unless `nowait` is set, dirty
+ * buffers are written back and in-flight requests are waited for, which
+ * temporarily releases the lock.
+ */
+static struct bc_buf *bc_buf_get(struct uk_bcache *bc, int nowait)
+{
+	struct bc_buf *bb;
+	unsigned long seq;
+
+	for (;;) {
+		bb = bc_buf_new(bc);
+		if (bb)
+			return bb;
+
+		bb = bc_evict(bc);
+		if (bb)
+			return bb;
+
+		if (nowait || (!uk_load_n(&bc->inflight) && !bc->ndirty))
+			return NULL;
+
+		seq = uk_load_n(&bc->ncompleted);
+		if (!bc_writeback(bc, BC_BATCH) && !uk_load_n(&bc->inflight))
+			return NULL; /* All dirty buffers are referenced */
+		bc_wait_completion(bc, seq);
+	}
+}
+
+/* Starts reading ahead if the lookups are sequential */
+static void bc_readahead(struct uk_bcache *bc, __sector blkno)
+{
+	struct bc_buf *bbs[BC_BATCH];
+	struct bc_buf *bb;
+	__sector end;
+	unsigned int cnt = 0;
+
+	if (blkno != bc->last_blkno + 1) {
+		bc->last_blkno = blkno;
+		bc->ra_next = blkno + 1;
+		return;
+	}
+	bc->last_blkno = blkno;
+
+	/* Read the next window once half of the current one was consumed */
+	if (bc->ra_next <= blkno)
+		bc->ra_next = blkno + 1;
+	if (bc->ra_next > blkno + BC_READAHEAD / 2 + 1)
+		return;
+
+	end = MIN(blkno + 1 + BC_READAHEAD, bc->nblocks);
+	for (; bc->ra_next < end && cnt < BC_BATCH; bc->ra_next++) {
+		if (bc_lookup(bc, bc->ra_next))
+			continue;
+
+		bb = bc_buf_get(bc, 1);
+		if (!bb)
+			break;
+
+		bc_insert(bc, bb, bc->ra_next);
+		bbs[cnt++] = bb;
+	}
+
+	if (cnt)
+		bc_submit(bc, bbs, cnt, UK_BLKREQ_READ);
+}
+
+struct uk_bbuf *uk_bcache_get(struct uk_bcache *bc, __sector blkno,
+			      int flags)
+{
+	struct bc_buf *bb, *nbb;
+	int error;
+
+	UK_ASSERT(bc);
+
+	if (unlikely(blkno >= bc->nblocks))
+		return ERR2PTR(-EINVAL);
+
+	uk_mutex_lock(&bc->lock);
+	bb = bc_lookup(bc, blkno);
+	if (!bb) {
+		nbb = bc_buf_get(bc, 0);
+		if (unlikely(!nbb)) {
+			uk_mutex_unlock(&bc->lock);
+			return ERR2PTR(-ENOMEM);
+		}
+
+		/* Someone else may have inserted the block while we waited */
+		bb = bc_lookup(bc, blkno);
+		if (unlikely(bb)) {
+			bc_buf_free(bc, nbb);
+		} else {
+			bb = nbb;
+			bc_insert(bc, bb, blkno);
+		}
+	}
+
+	if (bb->refcnt++ == 0)
+		uk_list_del_init(&bb->lru_link);
+
+	/* Not read yet or a previous read (e.g., readahead) failed */
+	if (!uk_load_n(&bb->valid) && !uk_load_n(&bb->io)) {
+		if (flags & UK_BCACHE_NOREAD)
+			bb->valid = 1;
+		else
+			bc_submit(bc, &bb, 1, UK_BLKREQ_READ);
+	}
+
+	bc_readahead(bc, blkno);
+
+	if (uk_load_n(&bb->io)) {
+		uk_mutex_unlock(&bc->lock);
+		uk_waitq_wait_event(&bc->wq, !uk_load_n(&bb->io));
+		uk_mutex_lock(&bc->lock);
+	}
+
+	if (unlikely(!uk_load_n(&bb->valid))) {
+		error = bb->error ?: -EIO;
+		uk_mutex_unlock(&bc->lock);
+		uk_bcache_put(bc, &bb->b);
+		return ERR2PTR(error);
+	}
+	uk_mutex_unlock(&bc->lock);
+
+	return &bb->b;
+}
+
+void uk_bcache_dirty(struct uk_bcache *bc, struct uk_bbuf *b)
+{
+	struct bc_buf *bb = to_bc_buf(b);
+
+	UK_ASSERT(bc);
+	UK_ASSERT(bb->refcnt);
+
+	uk_mutex_lock(&bc->lock);
+	bb->valid = 1;
+	if (!bb->dirty) {
+		bb->dirty = 1;
+		uk_list_add_tail(&bb->dirty_link, &bc->dirty);
+		bc->ndirty++;
+	}
+	uk_mutex_unlock(&bc->lock);
+}
+
+void uk_bcache_put(struct uk_bcache *bc, struct uk_bbuf *b)
+{
+	struct bc_buf *bb = to_bc_buf(b);
+
+	UK_ASSERT(bc);
+	UK_ASSERT(bb->refcnt);
+
+	uk_mutex_lock(&bc->lock);
+	if (--bb->refcnt == 0) {
+		if (!uk_load_n(&bb->valid) && !uk_load_n(&bb->io)) {
+			/* Failed read */
+			uk_list_del(&bb->hash_link);
+			bc_buf_free(bc, bb);
+		} else {
+			uk_list_add(&bb->lru_link, &bc->lru);
+		}
+	}
+
+	if (bc->ndirty > BC_DIRTY_MAX)
+		bc_writeback(bc, bc->ndirty);
+	uk_mutex_unlock(&bc->lock);
+}
+
+static void bc_flush_done(struct uk_blkreq *req __unused, void *cookie)
+{
+	struct uk_bcache *bc = (struct uk_bcache *)cookie;
+
+	uk_inc(&bc->ncompleted);
+	uk_waitq_wake_up(&bc->wq);
+}
+
+static int bc_flush(struct uk_bcache *bc)
+{
+	struct uk_blkreq req;
+	int rc;
+
+	uk_blkreq_init(&req, UK_BLKREQ_FFLUSH, 0, 0, NULL, bc_flush_done, bc);
+	rc = uk_blkdev_queue_submit_one(bc->dev, bc->queue_id, &req);
+	if (unlikely(!uk_blkdev_status_successful(rc)))
+		return (rc == -ENOTSUP) ? 0 : rc;
+
+	uk_waitq_wait_event(&bc->wq, uk_blkreq_is_done(&req));
+	return (req.result < 0) ? -EIO : 0;
+}
+
+int uk_bcache_sync(struct uk_bcache *bc)
+{
+	int rc;
+
+	UK_ASSERT(bc);
+
+	uk_mutex_lock(&bc->lock);
+	bc_writeback(bc, bc->ndirty);
+	uk_mutex_unlock(&bc->lock);
+
+	uk_waitq_wait_event(&bc->wq, !uk_load_n(&bc->inflight));
+
+	rc = bc_flush(bc);
+	if (unlikely(rc))
+		uk_pr_err("Failed to flush device: %d\n", rc);
+
+	return uk_exchange_n(&bc->wb_error, 0) ?: rc;
+}
+
+/*
+ * Prepares the cached blocks of a range for direct I/O: dirty blocks are
+ * written back and requests in flight are waited for. With `drop`, the
+ * blocks are also removed from the cache. Fails with -EBUSY if a block of
+ * the range is referenced. May temporarily release the lock.
+ */
+static int bc_range_prepare(struct uk_bcache *bc, __sector blkno,
+			    __sector count, int drop)
+{
+	struct bc_buf *bbs[BC_BATCH];
+	struct bc_buf *bb;
+	unsigned long seq;
+	unsigned int cnt;
+	__sector i;
+	int busy;
+
+	do {
+		seq = uk_load_n(&bc->ncompleted);
+		busy = 0;
+		cnt = 0;
+		for (i = blkno; i < blkno + count && bc->nbufs; i++) {
+			bb = bc_lookup(bc, i);
+			if (!bb)
+				continue;
+			if (bb->refcnt)
+				return -EBUSY;
+
+			if (uk_load_n(&bb->io)) {
+				busy = 1;
+			} else if (bb->dirty) {
+				uk_list_del(&bb->dirty_link);
+				bb->dirty = 0;
+				bc->ndirty--;
+				bbs[cnt++] = bb;
+				if (cnt == BC_BATCH) {
+					bc_submit(bc, bbs, cnt,
+						  UK_BLKREQ_WRITE);
+					cnt = 0;
+				}
+				busy = 1;
+			} else if (drop) {
+				bc_detach(bb);
+				bc_buf_free(bc, bb);
+			}
+		}
+		if (cnt)
+			bc_submit(bc, bbs, cnt, UK_BLKREQ_WRITE);
+		/* Failed submissions complete nothing but clear `io` */
+		if (busy && uk_load_n(&bc->inflight))
+			bc_wait_completion(bc, seq);
+	} while (busy);
+
+	return 0;
+}
+
+static void bc_direct_done(struct uk_blkreq *req __unused, void *cookie)
+{
+	struct uk_bcache *bc = (struct uk_bcache *)cookie;
+
+	uk_dec(&bc->inflight);
+	uk_inc(&bc->ncompleted);
+	uk_waitq_wake_up(&bc->wq);
+}
+
+int uk_bcache_direct(struct uk_bcache *bc, __sector blkno, __sector count,
+		     void *buf, int write)
+{
+	struct uk_blkreq reqs[BC_BATCH];
+	struct uk_blkreq *rp[BC_BATCH];
+	__sector start = blkno, total = count;
+	__sector maxblks, n;
+	unsigned int i, cnt, done;
+	int rc;
+
+	UK_ASSERT(bc);
+
+	if (unlikely(blkno >= bc->nblocks || count > bc->nblocks - blkno ||
+		     (__uptr)buf % uk_blkdev_ioalign(bc->dev)))
+		return -EINVAL;
+
+	maxblks = uk_blkdev_max_sec_per_req(bc->dev) / bc->spb;
+
+	uk_mutex_lock(&bc->lock);
+	rc = bc_range_prepare(bc, blkno, count, write);
+	while (!rc && count) {
+		for (cnt = 0; count && cnt < BC_BATCH; cnt++) {
+			n = MIN(count, maxblks);
+			uk_blkreq_init(&reqs[cnt],
+				       write ? UK_BLKREQ_WRITE : UK_BLKREQ_READ,
+				       blkno * bc->spb, n * bc->spb, buf,
+				       bc_direct_done, bc);
+			rp[cnt] = &reqs[cnt];
+			blkno += n;
+			count -= n;
+			buf = (char *)buf + n * bc->bsize;
+		}
+
+		done = bc_submit_reqs(bc, rp, cnt, &rc);
+		uk_mutex_unlock(&bc->lock);
+		for (i = 0; i < done; i++) {
+			uk_waitq_wait_event(&bc->wq,
+					    uk_blkreq_is_done(&reqs[i]));
+			if (unlikely(reqs[i].result < 0) && !rc)
+				rc = -EIO;
+		}
+		uk_mutex_lock(&bc->lock);
+	}
+
+	/* Readahead may have fetched blocks of the range in the meantime */
+	if (write && total)
+		bc_range_prepare(bc, start, total, 1);
+	uk_mutex_unlock(&bc->lock);
+	return rc;
+}
+
+void uk_bcache_shrink(struct uk_bcache *bc)
+{
+	struct bc_buf *bb;
+
+	UK_ASSERT(bc);
+
+	uk_mutex_lock(&bc->lock);
+	while ((bb = bc_evict(bc)))
+		bc_buf_free(bc, bb);
+	uk_mutex_unlock(&bc->lock);
+}
+
+void uk_bcache_queue_event(struct uk_blkdev *dev, uint16_t queue_id,
+			   void *argp __unused)
+{
+	int rc;
+
+	rc = uk_blkdev_queue_finish_reqs(dev, queue_id);
+	if (unlikely(rc < 0))
+		uk_pr_err("Failed to finish requests: %d\n", rc);
+}
+
+struct uk_bcache *uk_bcache_create(struct uk_alloc *a, struct uk_blkdev *dev,
+				   uint16_t queue_id, __sz bsize,
+				   __sz budget)
+{
+	struct uk_bcache *bc;
+	__sz ssize;
+	unsigned int i;
+
+	UK_ASSERT(a);
+	UK_ASSERT(dev);
+
+	ssize = uk_blkdev_ssize(dev);
+	if (unlikely(!bsize || bsize % ssize ||
+		     bsize / ssize > uk_blkdev_max_sec_per_req(dev)))
+		return ERR2PTR(-EINVAL);
+
+	if (unlikely(budget < bsize))
+		return ERR2PTR(-EINVAL);
+
+	bc = uk_calloc(a, 1, sizeof(*bc));
+	if (unlikely(!bc))
+		return ERR2PTR(-ENOMEM);
+
+	bc->a = a;
+	bc->dev = dev;
+	bc->queue_id = queue_id;
+	bc->bsize = bsize;
+	bc->spb = bsize / ssize;
+	bc->nblocks = uk_blkdev_sectors(dev) / bc->spb;
+	bc->maxbufs = budget / bsize;
+	bc->last_blkno = (__sector)-2;
+	uk_mutex_init(&bc->lock);
+	uk_waitq_init(&bc->wq);
+	UK_INIT_LIST_HEAD(&bc->lru);
+	UK_INIT_LIST_HEAD(&bc->dirty);
+	for (i = 0; i < BC_HASH_BUCKETS; i++)
+		UK_INIT_LIST_HEAD(&bc->hash[i]);
+
+	return bc;
+}
+
+int uk_bcache_destroy(struct uk_bcache *bc)
+{
+	struct bc_buf *bb, *tmp;
+	unsigned int i;
+	int rc;
+
+	UK_ASSERT(bc);
+
+	rc = uk_bcache_sync(bc);
+
+	for (i = 0; i < BC_HASH_BUCKETS; i++) {
+		uk_list_for_each_entry_safe(bb, tmp, &bc->hash[i], hash_link) {
+			UK_ASSERT(!bb->refcnt);
+			uk_list_del(&bb->hash_link);
+			bc_buf_free(bc, bb);
+		}
+	}
+	UK_ASSERT(!bc->nbufs);
+
+	uk_free(bc->a, bc);
+	return rc;
+}
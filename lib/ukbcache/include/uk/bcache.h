@@ -0,0 +1,160 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __UK_BCACHE_H__
+#define __UK_BCACHE_H__
+
+#include <uk/alloc.h>
+#include <uk/blkdev.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Block cache for raw block I/O on top of ukblkdev.
+ *
+ * A cache instance serves one queue of one block device and keeps blocks of
+ * a fixed size (a multiple of the sector size) in memory. Blocks are looked
+ * up by their block number. Unreferenced blocks are kept in LRU order and
+ * clean blocks are evicted when the memory budget of the cache is exhausted
+ * or when the allocator runs out of memory.
+ *
+ * Modified blocks are written back in batches: when the number of dirty
+ * blocks exceeds CONFIG_LIBUKBCACHE_DIRTY_MAX, when memory is needed, and on
+ * uk_bcache_sync(). Sequential lookups trigger asynchronous readahead of up
+ * to CONFIG_LIBUKBCACHE_READAHEAD blocks.
+ *
+ * The cache submits its requests asynchronously to the given queue and
+ * waits for their completion. Completions are delivered by whoever calls
+ * uk_blkdev_queue_finish_reqs() for the queue, normally the queue event
+ * callback (e.g., uk_bcache_queue_event()). The queue must therefore be
+ * configured with interrupts or dispatcher threads, like for
+ * uk_blkdev_sync_io().
+ */
+
+struct uk_bcache;
+
+struct uk_bbuf {
+	/* Number of the block (in units of the block size of the cache) */
+	__sector blkno;
+	/* Block data, aligned to the I/O alignment of the device */
+	void *data;
+};
+
+/* Flags for uk_bcache_get() */
+/* The caller overwrites the whole block, do not read it from the device */
+#define UK_BCACHE_NOREAD	(1 << 0)
+
+/**
+ * Creates a block cache.
+ *
+ * @param a
+ *	Allocator for cache management data and block buffers
+ * @param dev
+ *	The Unikraft Block Device in running state
+ * @param queue_id
+ *	The queue to submit requests to
+ * @param bsize
+ *	Block size in bytes, must be a multiple of the sector size
+ * @param budget
+ *	Maximum memory in bytes to use for block buffers
+ * @return
+ *	The new cache, or an error pointer (-EINVAL, -ENOMEM)
+ */
+struct uk_bcache *uk_bcache_create(struct uk_alloc *a, struct uk_blkdev *dev,
+				   uint16_t queue_id, __sz bsize,
+				   __sz budget);
+
+/**
+ * Writes back all dirty blocks and releases the cache. No block may be
+ * referenced anymore.
+ *
+ * @return
+ *	- 0: Success
+ *	- (<0): A writeback failed, the cache is released nonetheless
+ */
+int uk_bcache_destroy(struct uk_bcache *bc);
+
+/**
+ * Looks up a block and takes a reference to it. On a miss, the block is
+ * read from the device unless UK_BCACHE_NOREAD is given.
+ *
+ * @param bc
+ *	The block cache
+ * @param blkno
+ *	Number of the block
+ * @param flags
+ *	UK_BCACHE_* flags
+ * @return
+ *	The referenced block, or an error pointer (-EINVAL, -ENOMEM, or the
+ *	error of the read request)
+ */
+struct uk_bbuf *uk_bcache_get(struct uk_bcache *bc, __sector blkno,
+			      int flags);
+
+/**
+ * Marks a referenced block as modified. It is written back after the last
+ * reference is released.
+ */
+void uk_bcache_dirty(struct uk_bcache *bc, struct uk_bbuf *b);
+
+/**
+ * Releases a reference to a block taken with uk_bcache_get().
+ */
+void uk_bcache_put(struct uk_bcache *bc, struct uk_bbuf *b);
+
+/**
+ * Writes back all unreferenced dirty blocks, waits for completion, and
+ * flushes the write cache of the device. Blocks that are still referenced
+ * are written back once they are released.
+ *
+ * @return
+ *	- 0: Success
+ *	- (<0): Error of a writeback since the last call to uk_bcache_sync()
+ */
+int uk_bcache_sync(struct uk_bcache *bc);
+
+/**
+ * Transfers blocks directly between the device and a caller's buffer,
+ * bypassing the cache. Dirty cached blocks of the range are written back
+ * first, and on writes cached copies of the range are dropped.
+ * @param bc
+ *	The block cache
+ * @param blkno
+ *	Number of the first block
+ * @param count
+ *	Number of blocks
+ * @param buf
+ *	Buffer of `count` blocks, aligned to the I/O alignment of the device
+ * @param write
+ *	Write to the device instead of reading from it
+ * @return
+ *	- 0: Success
+ *	- (<0): -EINVAL, -EBUSY if a block of the range is referenced, or the
+ *	  error of a request
+ */
+int uk_bcache_direct(struct uk_bcache *bc, __sector blkno, __sector count,
+		     void *buf, int write);
+
+/**
+ * Drops all unreferenced clean blocks from the cache.
+ */
+void uk_bcache_shrink(struct uk_bcache *bc);
+
+/**
+ * Queue event callback that completes the requests of the queue. It can be
+ * used as `callback` in struct uk_blkdev_queue_conf for queues that are
+ * used by block caches.
+ */
+void uk_bcache_queue_event(struct uk_blkdev *dev, uint16_t queue_id,
+			   void *argp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UK_BCACHE_H__ */
@@ -44,7 +44,7 @@
  * @return The index of the least significant 1-bit of x, or if x is zero,
  *   the result is undefined. ffs(1)=0, ffs(3)=0, ffs(0x80000000)=31
  */
-#define uk_ffs(x) (__builtin_ffs(x) - 1)
+#define uk_ffs(x) ((unsigned int)__builtin_ctz(x))
 
 /**
  * Find last (highest) set bit in word.
@@ -53,7 +53,7 @@
  * @return The index of the most significant 1-bit of x, or if x is zero,
  *   the result is undefined. fls(1)=0, fls(3)=1, fls(0x80000001)=31
  */
-#define uk_fls(x) (sizeof(x) * 8 - __builtin_clz(x) - 1)
+#define uk_fls(x) ((unsigned int)(31 - __builtin_clz(x)))
 
 /**
  * Find first (lowest) set bit in long word.
@@ -62,7 +62,7 @@
  * @return The index of the least significant 1-bit of x, or if x is zero,
  *    the result is undefined. ffs(1)=0, ffs(3)=0, ffs(0x80000000)=31
  */
-#define uk_ffsl(x) (__builtin_ffsl(x) - 1)
+#define uk_ffsl(x) ((unsigned int)__builtin_ctzl(x))
 
 /**
  * Find last (highest) set bit in long word.
@@ -71,4 +71,5 @@
  * @return The index of the most significant 1-bit of x, or if x is zero,
  *   the result is undefined. fls(1)=0, fls(3)=1, fls(0x80000001)=31
  */
-#define uk_flsl(x) (sizeof(x) * 8 - __builtin_clzl(x) - 1)
+#define uk_flsl(x) \
+	((unsigned int)(sizeof(long) * 8 - 1 - __builtin_clzl(x)))
@@ -31,6 +31,12 @@
 #error Do not include this header directly
 #endif
 
+/*
+ * The compiler builtins emit tzcnt/lzcnt where the target supports them and
+ * bsf/bsr otherwise. Unlike inline assembly, they are folded at compile time
+ * for constant arguments.
+ */
+
 /**
  * Find first (lowest) set bit in word.
  * @param x The word to operate on
@@ -40,10 +46,7 @@
  */
 static inline unsigned int uk_ffs(unsigned int x)
 {
-	__asm__("bsfl %1,%0"
-		: "=r" (x)
-		: "rm" (x));
-	return x;
+	return __builtin_ctz(x);
 }
 
 /**
@@ -55,10 +58,7 @@ static inline unsigned int uk_ffs(unsigned int x)
  */
 static inline unsigned int uk_fls(unsigned int x)
 {
-	__asm__("bsrl %1,%0"
-		: "=r" (x)
-		: "rm" (x));
-	return x;
+	return 31 - __builtin_clz(x);
 }
 
 /**
@@ -70,10 +70,7 @@ static inline unsigned int uk_fls(unsigned int x)
  */
 static inline unsigned int uk_ffsl(unsigned long x)
 {
-	__asm__("bsfq %1,%0"
-		: "=r" (x)
-		: "rm" (x));
-	return x;
+	return __builtin_ctzl(x);
 }
 
 /**
@@ -85,8 +82,5 @@ static inline unsigned int uk_ffsl(unsigned long x)
  */
 static inline unsigned int uk_flsl(unsigned long x)
 {
-	__asm__("bsrq %1,%0"
-		: "=r" (x)
-		: "rm" (x));
-	return x;
+	return 63 - __builtin_clzl(x);
 }
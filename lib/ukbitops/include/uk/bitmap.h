@@ -294,6 +294,115 @@ uk_bitmap_xor(unsigned long *dst, const unsigned long *src1,
 		dst[i] = src1[i] ^ src2[i];
 }
 
+/*
+ * Bitmap sizes are integer constant expressions, so bitmaps can be declared
+ * statically or as struct members
+ */
+#define UK_DECLARE_BITMAP(name, bits)	\
+	unsigned long name[UK_BITS_TO_LONGS(bits)]
+
+/*
+ * Two-level bitmap for large maps
+ *
+ * Besides the map itself, a summary keeps one bit per map word that is set if
+ * the word has all of its bits set. Searching for a zero bit thus scans the
+ * summary, which is UK_BITS_PER_LONG times smaller than the map, and
+ * inspects a single word of the map. Zero-initialized storage is an empty
+ * bitmap. The functions are not atomic, callers serialize accesses.
+ */
+struct uk_bitmap_sum {
+	unsigned long nbits;
+	unsigned long *map;
+	unsigned long *full;
+};
+
+#define UK_BITMAP_SUM_LONGS(bits)	UK_BITS_TO_LONGS(UK_BITS_TO_LONGS(bits))
+
+#define UK_BITMAP_SUM_INITIALIZER(bits, map_, full_)			\
+	{ .nbits = (bits), .map = (map_), .full = (full_) }
+
+static inline void
+uk_bitmap_sum_init(struct uk_bitmap_sum *bs, unsigned long *map,
+	unsigned long *full, unsigned long nbits)
+{
+	bs->nbits = nbits;
+	bs->map = map;
+	bs->full = full;
+	memset(map, 0, UK_BITS_TO_LONGS(nbits) * sizeof(long));
+	memset(full, 0, UK_BITMAP_SUM_LONGS(nbits) * sizeof(long));
+}
+
+static inline int
+uk_bitmap_sum_word_full(const struct uk_bitmap_sum *bs, unsigned long w)
+{
+	unsigned long mask = ~0UL;
+
+	if (w == UK_BIT_WORD(bs->nbits - 1) && bs->nbits % UK_BITS_PER_LONG)
+		mask = UK_BITMAP_LAST_WORD_MASK(bs->nbits % UK_BITS_PER_LONG);
+	return (bs->map[w] & mask) == mask;
+}
+
+static inline int
+uk_bitmap_sum_test(const struct uk_bitmap_sum *bs, unsigned long bit)
+{
+	return !!(bs->map[UK_BIT_WORD(bit)] & UK_BIT_MASK(bit));
+}
+
+static inline void
+uk_bitmap_sum_set(struct uk_bitmap_sum *bs, unsigned long bit)
+{
+	unsigned long w = UK_BIT_WORD(bit);
+
+	bs->map[w] |= UK_BIT_MASK(bit);
+	if (uk_bitmap_sum_word_full(bs, w))
+		bs->full[UK_BIT_WORD(w)] |= UK_BIT_MASK(w);
+}
+
+static inline void
+uk_bitmap_sum_clear(struct uk_bitmap_sum *bs, unsigned long bit)
+{
+	unsigned long w = UK_BIT_WORD(bit);
+
+	bs->map[w] &= ~UK_BIT_MASK(bit);
+	bs->full[UK_BIT_WORD(w)] &= ~UK_BIT_MASK(w);
+}
+
+/**
+ * Find the next zero bit at or after `offset`.
+ *
+ * @return The index of the bit, or the size of the bitmap if there is none
+ */
+static inline unsigned long
+uk_bitmap_sum_find_next_zero(const struct uk_bitmap_sum *bs,
+	unsigned long offset)
+{
+	unsigned long nwords = UK_BITS_TO_LONGS(bs->nbits);
+	unsigned long w, mask, bit;
+
+	if (offset >= bs->nbits)
+		return bs->nbits;
+
+	/* The remainder of the word that contains `offset` */
+	w = UK_BIT_WORD(offset);
+	mask = ~bs->map[w] & UK_BITMAP_FIRST_WORD_MASK(offset);
+	if (!mask) {
+		/* Only the summary has to be searched for further words */
+		w = uk_find_next_zero_bit(bs->full, nwords, w + 1);
+		if (w >= nwords)
+			return bs->nbits;
+		mask = ~bs->map[w];
+	}
+
+	bit = w * UK_BITS_PER_LONG + uk_ffsl(mask);
+	return MIN(bit, bs->nbits);
+}
+
+static inline unsigned long
+uk_bitmap_sum_find_first_zero(const struct uk_bitmap_sum *bs)
+{
+	return uk_bitmap_sum_find_next_zero(bs, 0);
+}
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -43,6 +43,7 @@
 #include <uk/ctors.h>
 #include <uk/atomic.h>
 #include <uk/blkdev.h>
+#include <uk/plat/lcpu.h>
 
 struct uk_blkdev_list uk_blkdev_list =
 UK_TAILQ_HEAD_INITIALIZER(uk_blkdev_list);
@@ -70,6 +71,31 @@ static struct uk_blkdev_data *_alloc_data(struct uk_alloc *a,
 	return data;
 }
 
+/*
+ * Burst emulation for drivers that only provide submit_one.
+ * Stop as soon as the driver does not report any further progress.
+ */
+static int _submit_burst_emul(struct uk_blkdev *dev,
+		struct uk_blkdev_queue *queue,
+		struct uk_blkreq *reqs[], uint16_t cnt)
+{
+	uint16_t i;
+	int ret;
+
+	for (i = 0; i < cnt; i++) {
+		ret = dev->submit_one(dev, queue, reqs[i]);
+		if (unlikely(ret < 0))
+			return (i == 0) ? ret : (int) i;
+		if (!(ret & UK_BLKDEV_STATUS_SUCCESS))
+			break;
+		if (!(ret & UK_BLKDEV_STATUS_MORE)) {
+			i++;
+			break;
+		}
+	}
+	return (int) i;
+}
+
 int uk_blkdev_drv_register(struct uk_blkdev *dev, struct uk_alloc *a,
 		const char *drv_name)
 {
@@ -91,6 +117,9 @@ int uk_blkdev_drv_register(struct uk_blkdev *dev, struct uk_alloc *a,
 			|| (!dev->dev_ops->queue_intr_enable
 				&& !dev->dev_ops->queue_intr_disable));
 
+	if (!dev->submit_burst)
+		dev->submit_burst = _submit_burst_emul;
+
 	dev->_data = _alloc_data(a, blkdev_count,  drv_name);
 	if (unlikely(!dev->_data))
 		return -ENOMEM;
@@ -195,6 +224,7 @@ int uk_blkdev_configure(struct uk_blkdev *dev,
 		uk_pr_info("blkdev%"PRIu16": Configured interface\n",
 				dev->_data->id);
 		dev->_data->state = UK_BLKDEV_CONFIGURED;
+		dev->_data->nb_queues = conf->nb_queues;
 	} else
 		uk_pr_err("blkdev%"PRIu16": Failed to configure interface %d\n",
 				dev->_data->id, rc);
@@ -219,10 +249,69 @@ static __noreturn void _dispatcher(void *args)
 }
 #endif
 
+#if CONFIG_LIBUKBLKDEV_DISPATCH_WORKQ
+static void _dispatch_work(struct uk_work *work)
+{
+	struct uk_blkdev_event_handler *handler =
+		__containerof(work, struct uk_blkdev_event_handler, work);
+
+	UK_ASSERT(handler->callback);
+
+	handler->callback(handler->dev, handler->queue_id, handler->cookie);
+}
+#endif
+
+/* Reaps completions unless another thread is doing so right now */
+static int _queue_poll(struct uk_blkdev_event_handler *h)
+{
+	int rc;
+
+	if (!ukarch_spin_trylock(&h->poll_lock))
+		return 0;
+	rc = h->dev->finish_reqs(h->dev, h->dev->_queue[h->queue_id]);
+	ukarch_spin_unlock(&h->poll_lock);
+	return rc;
+}
+
+#if CONFIG_LIBUKBLKDEV_POLLERTHREADS
+static __noreturn void _poller(void *args)
+{
+	struct uk_blkdev_event_handler *h =
+		(struct uk_blkdev_event_handler *) args;
+
+	UK_ASSERT(h);
+
+	while (1) {
+		/* The queue can be reaped only while the device is running */
+		if (h->dev->_data->state != UK_BLKDEV_RUNNING ||
+		    _queue_poll(h) <= 0)
+			uk_sched_yield();
+	}
+}
+
+static int _create_poller(struct uk_blkdev_event_handler *h,
+		struct uk_sched *s)
+{
+	/* In case of errors, we just continue without a name */
+	if (asprintf(&h->poller_name, "blkdev%"PRIu16"-q%"PRIu16"-poll",
+		     h->dev->_data->id, h->queue_id) < 0)
+		h->poller_name = NULL;
+
+	h->poller = uk_sched_thread_create(s, _poller, (void *)h,
+					   h->poller_name);
+	if (unlikely(!h->poller)) {
+		free(h->poller_name);
+		h->poller_name = NULL;
+		return -ENOMEM;
+	}
+	return 0;
+}
+#endif
+
 static int _create_event_handler(uk_blkdev_queue_event_t callback,
-		void *cookie,
-#if CONFIG_LIBUKBLKDEV_DISPATCHERTHREADS
+		void *cookie, unsigned int flags,
 		struct uk_blkdev *dev, uint16_t queue_id,
+#if CONFIG_LIBUKBLKDEV_DISPATCHERTHREADS
 		struct uk_sched *s,
 #endif
 		struct uk_blkdev_event_handler *event_handler)
@@ -232,14 +321,19 @@ static int _create_event_handler(uk_blkdev_queue_event_t callback,
 
 	event_handler->callback = callback;
 	event_handler->cookie = cookie;
+	event_handler->dev = dev;
+	event_handler->queue_id = queue_id;
+	event_handler->flags = flags;
+	ukarch_spin_init(&event_handler->poll_lock);
+#if CONFIG_LIBUKBLKDEV_DISPATCH_WORKQ
+	uk_work_init(&event_handler->work, _dispatch_work);
+#endif
 
 #if CONFIG_LIBUKBLKDEV_DISPATCHERTHREADS
 	/* If we do not have a callback, we do not need a thread */
 	if (!callback)
 		return 0;
 
-	event_handler->dev = dev;
-	event_handler->queue_id = queue_id;
 	uk_semaphore_init(&event_handler->events, 0);
 	event_handler->dispatcher_s = s;
 
@@ -275,6 +369,23 @@ static void _destroy_event_handler(struct uk_blkdev_event_handler *h
 {
 	UK_ASSERT(h);
 
+#if CONFIG_LIBUKBLKDEV_POLLERTHREADS
+	if (h->poller) {
+		uk_sched_thread_terminate(h->poller);
+		h->poller = NULL;
+	}
+
+	if (h->poller_name) {
+		free(h->poller_name);
+		h->poller_name = NULL;
+	}
+#endif
+
+#if CONFIG_LIBUKBLKDEV_DISPATCH_WORKQ
+	/* A callback may still be pending from the last interrupt */
+	uk_work_wait(&h->work);
+#endif
+
 #if CONFIG_LIBUKBLKDEV_DISPATCHERTHREADS
 	if (h->dispatcher) {
 		uk_semaphore_up(&h->events);
@@ -329,9 +440,10 @@ int uk_blkdev_queue_configure(struct uk_blkdev *dev, uint16_t queue_id,
 		return -EBUSY;
 
 	err = _create_event_handler(queue_conf->callback,
-			queue_conf->callback_cookie,
+			queue_conf->callback_cookie, queue_conf->flags,
+			dev, queue_id,
 #if CONFIG_LIBUKBLKDEV_DISPATCHERTHREADS
-			dev, queue_id, queue_conf->s,
+			queue_conf->s,
 #endif
 			&dev->_data->queue_handler[queue_id]);
 	if (err)
@@ -347,10 +459,27 @@ int uk_blkdev_queue_configure(struct uk_blkdev *dev, uint16_t queue_id,
 		goto err_destroy_handler;
 	}
 
-	uk_pr_info("blkdev%"PRIu16": Configured queue %"PRIu16"\n",
-			dev->_data->id, queue_id);
+#if CONFIG_LIBUKBLKDEV_POLLERTHREADS
+	if ((queue_conf->flags & UK_BLKDEV_QUEUE_F_POLL) &&
+	    queue_conf->poll_s) {
+		err = _create_poller(&dev->_data->queue_handler[queue_id],
+				     queue_conf->poll_s);
+		if (unlikely(err))
+			goto err_unconfigure_queue;
+	}
+#endif
+
+	uk_pr_info("blkdev%"PRIu16": Configured %squeue %"PRIu16"\n",
+			dev->_data->id,
+			(queue_conf->flags & UK_BLKDEV_QUEUE_F_POLL) ?
+			"polled " : "", queue_id);
 	return 0;
 
+#if CONFIG_LIBUKBLKDEV_POLLERTHREADS
+err_unconfigure_queue:
+	dev->dev_ops->queue_unconfigure(dev, dev->_queue[queue_id]);
+	dev->_queue[queue_id] = ERR2PTR(err);
+#endif
 err_destroy_handler:
 	_destroy_event_handler(&dev->_data->queue_handler[queue_id]);
 err_out:
@@ -395,6 +524,32 @@ int uk_blkdev_queue_submit_one(struct uk_blkdev *dev,
 	return dev->submit_one(dev, dev->_queue[queue_id], req);
 }
 
+int uk_blkdev_queue_submit_burst(struct uk_blkdev *dev,
+		uint16_t queue_id,
+		struct uk_blkreq *reqs[], uint16_t cnt)
+{
+	UK_ASSERT(dev);
+	UK_ASSERT(dev->_data);
+	UK_ASSERT(dev->submit_burst);
+	UK_ASSERT(queue_id < CONFIG_LIBUKBLKDEV_MAXNBQUEUES);
+	UK_ASSERT(dev->_data->state == UK_BLKDEV_RUNNING);
+	UK_ASSERT(!PTRISERR(dev->_queue[queue_id]));
+	UK_ASSERT(reqs || cnt == 0);
+
+	return dev->submit_burst(dev, dev->_queue[queue_id], reqs, cnt);
+}
+
+uint16_t uk_blkdev_queue_id_lcpu(struct uk_blkdev *dev)
+{
+	UK_ASSERT(dev);
+	UK_ASSERT(dev->_data);
+	UK_ASSERT(dev->_data->state == UK_BLKDEV_CONFIGURED ||
+		  dev->_data->state == UK_BLKDEV_RUNNING);
+	UK_ASSERT(dev->_data->nb_queues > 0);
+
+	return (uint16_t)(ukplat_lcpu_idx() % dev->_data->nb_queues);
+}
+
 int uk_blkdev_queue_finish_reqs(struct uk_blkdev *dev,
 		uint16_t queue_id)
 {
@@ -408,6 +563,20 @@ int uk_blkdev_queue_finish_reqs(struct uk_blkdev *dev,
 	return dev->finish_reqs(dev, dev->_queue[queue_id]);
 }
 
+int uk_blkdev_queue_poll(struct uk_blkdev *dev, uint16_t queue_id)
+{
+	UK_ASSERT(dev);
+	UK_ASSERT(dev->finish_reqs);
+	UK_ASSERT(dev->_data);
+	UK_ASSERT(queue_id < CONFIG_LIBUKBLKDEV_MAXNBQUEUES);
+	UK_ASSERT(dev->_data->state == UK_BLKDEV_RUNNING);
+	UK_ASSERT(!PTRISERR(dev->_queue[queue_id]));
+	UK_ASSERT(dev->_data->queue_handler[queue_id].flags &
+		  UK_BLKDEV_QUEUE_F_POLL);
+
+	return _queue_poll(&dev->_data->queue_handler[queue_id]);
+}
+
 #if CONFIG_LIBUKBLKDEV_SYNC_IO_BLOCKED_WAITING
 /**
  * Used for sending a synchronous request.
@@ -440,6 +609,7 @@ int uk_blkdev_sync_io(struct uk_blkdev *dev,
 	struct uk_blkreq *req;
 	int rc = 0;
 	struct uk_blkdev_sync_io_request sync_io_req;
+	int polled;
 
 	UK_ASSERT(dev != NULL);
 	UK_ASSERT(queue_id < CONFIG_LIBUKBLKDEV_MAXNBQUEUES);
@@ -448,10 +618,18 @@ int uk_blkdev_sync_io(struct uk_blkdev *dev,
 	UK_ASSERT(dev->_data->state == UK_BLKDEV_RUNNING);
 	UK_ASSERT(!PTRISERR(dev->_queue[queue_id]));
 
+	polled = dev->_data->queue_handler[queue_id].flags &
+		 UK_BLKDEV_QUEUE_F_POLL;
+
 	req = &sync_io_req.req;
-	uk_blkreq_init(req, operation, start_sector, nb_sectors, buf,
-			__sync_io_callback, (void *)&sync_io_req);
-	uk_semaphore_init(&sync_io_req.s, 0);
+	if (polled) {
+		uk_blkreq_init(req, operation, start_sector, nb_sectors, buf,
+				NULL, NULL);
+	} else {
+		uk_blkreq_init(req, operation, start_sector, nb_sectors, buf,
+				__sync_io_callback, (void *)&sync_io_req);
+		uk_semaphore_init(&sync_io_req.s, 0);
+	}
 
 	rc = uk_blkdev_queue_submit_one(dev, queue_id, req);
 	if (unlikely(!uk_blkdev_status_successful(rc))) {
@@ -460,7 +638,15 @@ int uk_blkdev_sync_io(struct uk_blkdev *dev,
 		return rc;
 	}
 
-	uk_semaphore_down(&sync_io_req.s);
+	if (polled) {
+		/* Reap the completion unless a poller thread does it */
+		while (!uk_blkreq_is_done(req)) {
+			if (uk_blkdev_queue_poll(dev, queue_id) <= 0)
+				uk_sched_yield();
+		}
+	} else {
+		uk_semaphore_down(&sync_io_req.s);
+	}
 	return req->result;
 }
 #endif
@@ -507,11 +693,7 @@ int uk_blkdev_queue_unconfigure(struct uk_blkdev *dev, uint16_t queue_id)
 		uk_pr_err("Failed to unconfigure blkdev%"PRIu16"-q%"PRIu16": %d\n",
 				dev->_data->id, queue_id, rc);
 	else {
-#if CONFIG_LIBUKBLKDEV_DISPATCHERTHREADS
-		if (dev->_data->queue_handler[queue_id].callback)
-			_destroy_event_handler(
-					&dev->_data->queue_handler[queue_id]);
-#endif
+		_destroy_event_handler(&dev->_data->queue_handler[queue_id]);
 		uk_pr_info("Unconfigured blkdev%"PRIu16"-q%"PRIu16"\n",
 				dev->_data->id, queue_id);
 		dev->_queue[queue_id] = NULL;
@@ -258,6 +258,18 @@ static inline const struct uk_blkdev_cap *uk_blkdev_capabilities(
 
 #define uk_blkdev_ioalign(blkdev) \
 	(uk_blkdev_capabilities(blkdev)->ioalign)
+
+#define uk_blkdev_features(blkdev) \
+	(uk_blkdev_capabilities(blkdev)->features)
+
+#define uk_blkdev_has_feature(blkdev, feature) \
+	((uk_blkdev_features(blkdev) & (feature)) == (feature))
+
+#define uk_blkdev_max_discard_sec(blkdev) \
+	(uk_blkdev_capabilities(blkdev)->max_discard_sectors)
+
+#define uk_blkdev_max_write_zeroes_sec(blkdev) \
+	(uk_blkdev_capabilities(blkdev)->max_write_zeroes_sectors)
 /**
  * Enable interrupts for a queue.
  *
@@ -270,6 +282,7 @@ static inline const struct uk_blkdev_cap *uk_blkdev_capabilities(
  * @return
  *	- (0): Success, interrupts enabled.
  *	- (-ENOTSUP): Driver does not support interrupts.
+ *	- (-EINVAL): The queue is configured in polled mode.
  */
 static inline int uk_blkdev_queue_intr_enable(struct uk_blkdev *dev,
 		uint16_t queue_id)
@@ -282,6 +295,9 @@ static inline int uk_blkdev_queue_intr_enable(struct uk_blkdev *dev,
 
 	if (unlikely(!dev->dev_ops->queue_intr_enable))
 		return -ENOTSUP;
+	if (unlikely(dev->_data->queue_handler[queue_id].flags &
+		     UK_BLKDEV_QUEUE_F_POLL))
+		return -EINVAL;
 
 	return dev->dev_ops->queue_intr_enable(dev, dev->_queue[queue_id]);
 }
@@ -338,6 +354,45 @@ static inline int uk_blkdev_queue_intr_disable(struct uk_blkdev *dev,
 int uk_blkdev_queue_submit_one(struct uk_blkdev *dev, uint16_t queue_id,
 		struct uk_blkreq *req);
 
+/**
+ * Make a burst of aio requests to the device. Drivers that implement bursting
+ * natively notify the device only once for the whole burst.
+ *
+ * @param dev
+ *	The Unikraft Block Device
+ * @param queue_id
+ *	The index of the queue to submit to.
+ *	The value must be in the range [0, nb_queue - 1] previously supplied
+ *	to uk_blkdev_configure().
+ * @param reqs
+ *	Array of `cnt` request structures. Requests that were not submitted
+ *	(reqs[ret]...reqs[cnt - 1]) are left untouched.
+ * @param cnt
+ *	Number of requests in `reqs`
+ * @return
+ *	- (>=0): Number of requests that were put to the queue. A value
+ *	smaller than `cnt` means that the queue is full or that reqs[ret]
+ *	could not be submitted (submitting it again reports the error).
+ *	- (<0): Negative value with error code from driver, no request was sent.
+ */
+int uk_blkdev_queue_submit_burst(struct uk_blkdev *dev, uint16_t queue_id,
+		struct uk_blkreq *reqs[], uint16_t cnt);
+
+/**
+ * Returns the queue that is assigned to the calling logical CPU. Queues are
+ * distributed round-robin over the CPUs, so that each CPU gets a queue of its
+ * own when the device was configured with at least as many queues as there
+ * are CPUs. Submitting to the queue of the calling CPU avoids contention on
+ * the queue with other CPUs.
+ *
+ * @param dev
+ *	The Unikraft Block Device in configured or running state
+ * @return
+ *	Queue index in the range [0, nb_queue - 1] supplied to
+ *	uk_blkdev_configure().
+ */
+uint16_t uk_blkdev_queue_id_lcpu(struct uk_blkdev *dev);
+
 /**
  * Tests for status flags returned by `uk_blkdev_submit_one`
  * When the function returned an error code or one of the selected flags is
@@ -419,16 +474,34 @@ int uk_blkdev_queue_submit_one(struct uk_blkdev *dev, uint16_t queue_id,
  * @param queue_id
  *	queue id
  * @return
- *	- 0: Success
+ *	- (>=0): Number of finished requests
  *	- (<0): on error returned by driver
  */
 int uk_blkdev_queue_finish_reqs(struct uk_blkdev *dev, uint16_t queue_id);
 
+/**
+ * Reap the completions of a queue that is configured in polled mode
+ * (UK_BLKDEV_QUEUE_F_POLL). The callbacks of finished requests are called
+ * from the polling context. Any number of threads may poll the same queue;
+ * only one of them reaps at a time while the others return immediately.
+ *
+ * @param dev
+ *	The Unikraft Block Device in running state.
+ * @param queue_id
+ *	The index of the polled queue.
+ * @return
+ *	- (>=0): Number of finished requests, 0 also when the queue is being
+ *	         reaped by another thread
+ *	- (<0): on error returned by driver
+ */
+int uk_blkdev_queue_poll(struct uk_blkdev *dev, uint16_t queue_id);
+
 #if CONFIG_LIBUKBLKDEV_SYNC_IO_BLOCKED_WAITING
 /**
  * Make a sync io request on a specific queue.
  * `uk_blkdev_queue_finish_reqs()` must be called in queue interrupt context
  * or another thread context in order to avoid blocking of the thread forever.
+ * On polled queues, the calling thread reaps the completion itself.
  *
  * @param dev
  *	The Unikraft Block Device
@@ -38,11 +38,18 @@
 #include <uk/config.h>
 #include <uk/blkreq.h>
 #include <fcntl.h>
+#include <uk/arch/spinlock.h>
 #if defined(CONFIG_LIBUKBLKDEV_DISPATCHERTHREADS) || \
 		defined(CONFIG_LIBUKBLKDEV_SYNC_IO_BLOCKED_WAITING)
 #include <uk/sched.h>
 #include <uk/semaphore.h>
 #endif
+#if CONFIG_LIBUKBLKDEV_POLLERTHREADS
+#include <uk/sched.h>
+#endif
+#if CONFIG_LIBUKBLKDEV_DISPATCH_WORKQ
+#include <uk/workq.h>
+#endif
 
 /**
  * Unikraft block API common declarations.
@@ -129,6 +136,15 @@ struct uk_blkdev_queue;
 typedef void (*uk_blkdev_queue_event_t)(struct uk_blkdev *dev,
 		uint16_t queue_id, void *argp);
 
+/**
+ * Queue flags
+ */
+/* Polled mode: the interrupts of the queue stay disabled. Completions are
+ * reaped in batches with uk_blkdev_queue_poll(), either by the submitters
+ * or by a poller thread (see `poll_s`). The event callback is not used.
+ */
+#define UK_BLKDEV_QUEUE_F_POLL		(1 << 0)
+
 /**
  * Structure used to configure an Unikraft block device queue.
  *
@@ -140,11 +156,20 @@ struct uk_blkdev_queue_conf {
 	uk_blkdev_queue_event_t callback;
 	/* Argument pointer for callback*/
 	void *callback_cookie;
+	/* Queue flags (UK_BLKDEV_QUEUE_F_*) */
+	unsigned int flags;
 
 #if CONFIG_LIBUKBLKDEV_DISPATCHERTHREADS
 	/* Scheduler for dispatcher. */
 	struct uk_sched *s;
 #endif
+#if CONFIG_LIBUKBLKDEV_POLLERTHREADS
+	/* Scheduler for the poller thread of a polled queue (optional). The
+	 * thread reaps completions continuously while the device is running
+	 * and keeps its CPU busy.
+	 */
+	struct uk_sched *poll_s;
+#endif
 };
 
 /** Driver callback type to get initial device capabilities */
@@ -194,9 +219,17 @@ typedef int (*uk_blkdev_queue_intr_disable_t)(struct uk_blkdev *dev,
 /** Driver callback type to submit a request to Unikraft block device. */
 typedef int (*uk_blkdev_queue_submit_one_t)(struct uk_blkdev *dev,
 		struct uk_blkdev_queue *queue, struct uk_blkreq *req);
+/**
+ * Driver callback type to submit up to `cnt` requests to Unikraft block
+ * device. Returns the number of submitted requests or a negative error code.
+ */
+typedef int (*uk_blkdev_queue_submit_burst_t)(struct uk_blkdev *dev,
+		struct uk_blkdev_queue *queue, struct uk_blkreq *reqs[],
+		uint16_t cnt);
 /**
  * Driver callback type to finish
  * a bunch of requests to Unikraft block device.
+ * Returns the number of finished requests or a negative error code.
  **/
 typedef int (*uk_blkdev_queue_finish_reqs_t)(struct uk_blkdev *dev,
 		struct uk_blkdev_queue *queue);
@@ -224,6 +257,16 @@ struct uk_blkdev_ops {
 	uk_blkdev_unconfigure_t				dev_unconfigure;
 };
 
+/**
+ * Optional operations reported in uk_blkdev_cap.features
+ */
+/* UK_BLKREQ_F_FUA is supported for write requests */
+#define UK_BLKDEV_CAP_FUA		(1 << 0)
+/* UK_BLKREQ_DISCARD is supported */
+#define UK_BLKDEV_CAP_DISCARD		(1 << 1)
+/* UK_BLKREQ_WRITE_ZEROES is supported */
+#define UK_BLKDEV_CAP_WRITE_ZEROES	(1 << 2)
+
 /**
  * Device info
  */
@@ -238,6 +281,14 @@ struct uk_blkdev_cap {
 	__sector max_sectors_per_req;
 	/* Alignment (number of bytes) for data used in future requests */
 	uint16_t ioalign;
+	/* Optional operations supported by the device (UK_BLKDEV_CAP_*) */
+	unsigned int features;
+	/* Max nb of sectors for a discard op */
+	__sector max_discard_sectors;
+	/* Discard ops must be aligned to this number of sectors */
+	__sector discard_align;
+	/* Max nb of sectors for a write zeroes op */
+	__sector max_write_zeroes_sectors;
 };
 
 /**
@@ -249,14 +300,28 @@ struct uk_blkdev_event_handler {
 	uk_blkdev_queue_event_t callback;
 	/* Parameter for callback */
 	void *cookie;
-
-#if CONFIG_LIBUKBLKDEV_DISPATCHERTHREADS
-	/* Semaphore to trigger events. */
-	struct uk_semaphore events;
 	/* Reference to blk device. */
 	struct uk_blkdev    *dev;
 	/* Queue id which caused event. */
 	uint16_t            queue_id;
+	/* Queue flags (UK_BLKDEV_QUEUE_F_*) */
+	unsigned int        flags;
+	/* Held while completions of a polled queue are reaped */
+	__spinlock          poll_lock;
+#if CONFIG_LIBUKBLKDEV_POLLERTHREADS
+	/* Poller thread of a polled queue and its name. */
+	struct uk_thread    *poller;
+	char                *poller_name;
+#endif
+
+#if CONFIG_LIBUKBLKDEV_DISPATCH_WORKQ
+	/* Deferred call of the callback */
+	struct uk_work      work;
+#endif
+
+#if CONFIG_LIBUKBLKDEV_DISPATCHERTHREADS
+	/* Semaphore to trigger events. */
+	struct uk_semaphore events;
 	/* Dispatcher thread. */
 	struct uk_thread    *dispatcher;
 	/* Reference to thread name. */
@@ -282,11 +347,15 @@ struct uk_blkdev_data {
 	const char *drv_name;
 	/* Allocator */
 	struct uk_alloc *a;
+	/* Number of queues set with uk_blkdev_configure() */
+	uint16_t nb_queues;
 };
 
 struct uk_blkdev {
 	/* Pointer to submit request function */
 	uk_blkdev_queue_submit_one_t submit_one;
+	/* Pointer to submit burst function (optional, emulated otherwise) */
+	uk_blkdev_queue_submit_burst_t submit_burst;
 	/* Pointer to handle_responses function */
 	uk_blkdev_queue_finish_reqs_t finish_reqs;
 	/* Pointer to API-internal state data. */
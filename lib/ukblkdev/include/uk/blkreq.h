@@ -69,9 +69,26 @@ enum uk_blkreq_op {
 	/* Write operation */
 	UK_BLKREQ_WRITE,
 	/* Flush the volatile write cache */
-	UK_BLKREQ_FFLUSH = 4
+	UK_BLKREQ_FFLUSH = 4,
+	/* Discard a range of sectors (no data buffer) */
+	UK_BLKREQ_DISCARD = 11,
+	/* Zero a range of sectors (no data buffer) */
+	UK_BLKREQ_WRITE_ZEROES = 13
 };
 
+/**
+ * Request flags
+ */
+/* Complete the write only after the data reached stable storage.
+ * Only valid for UK_BLKREQ_WRITE and if the device reports
+ * UK_BLKDEV_CAP_FUA.
+ */
+#define UK_BLKREQ_F_FUA		(1 << 0)
+/* Allow the device to deallocate the zeroed sectors.
+ * Only valid for UK_BLKREQ_WRITE_ZEROES.
+ */
+#define UK_BLKREQ_F_UNMAP	(1 << 1)
+
 /**
  * Function type used for request callback after a response is processed.
  *
@@ -89,6 +106,8 @@ struct uk_blkreq {
 	/* Input members */
 	/* Operation type */
 	enum uk_blkreq_op			operation;
+	/* Request flags (UK_BLKREQ_F_*) */
+	unsigned int				flags;
 	/* Start Sector from where the op begin */
 	__sector				start_sector;
 	/* Size in number of sectors */
@@ -119,7 +138,7 @@ struct uk_blkreq {
  * @param nb_sectors
  *	Number of sectors
  * @param aio_buf
- *	Data buffer
+ *	Data buffer (NULL for discard and write zeroes)
  * @param cb
  *	Request callback
  * @param cb_cookie
@@ -130,6 +149,7 @@ static inline void uk_blkreq_init(struct uk_blkreq *req,
 		void *aio_buf, uk_blkreq_event_t cb, void *cb_cookie)
 {
 	req->operation = op;
+	req->flags = 0;
 	req->start_sector = start;
 	req->nb_sectors = nb_sectors;
 	req->aio_buf = aio_buf;
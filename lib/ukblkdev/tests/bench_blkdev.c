@@ -0,0 +1,329 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * IOPS, bandwidth and request latency of the ukblkdev data path, without a
+ * filesystem or block cache in between. Requests are submitted with
+ * uk_blkdev_queue_submit_one() and kept in flight up to the queue depth of
+ * the benchmark. Interrupts stay disabled: the benchmark reaps completions
+ * itself, either with uk_blkdev_queue_finish_reqs() or, for a polled queue,
+ * with uk_blkdev_queue_poll().
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+
+#include <uk/alloc.h>
+#include <uk/arch/limits.h>
+#include <uk/arch/time.h>
+#include <uk/bench.h>
+#include <uk/blkdev.h>
+#include <uk/plat/time.h>
+
+#define BENCH_QDEPTH		CONFIG_LIBUKBLKDEV_BENCH_QDEPTH
+#define BENCH_TIMEOUT		ukarch_time_sec_to_nsec(5)
+#define BENCH_MIB		(1024UL * 1024UL)
+
+struct bench_io {
+	struct uk_blkreq req;
+	/* Ticks when the request was submitted */
+	__u64 start;
+	void *buf;
+	struct bench_io *next;
+};
+
+struct bench_job {
+	unsigned int qdepth;
+	int random;
+	/* Percentage of reads */
+	unsigned int rwmixread;
+};
+
+static struct uk_blkdev *bench_dev;
+static struct bench_io bench_ios[BENCH_QDEPTH];
+static struct bench_io *bench_free;
+static unsigned int bench_inflight;
+/* First error reported by a completed request */
+static int bench_err;
+static struct uk_bench_ctx *bench_ctx;
+
+/* Sectors per request for random and sequential access */
+static __sector bench_rand_sectors;
+static __sector bench_seq_sectors;
+/* Number of sectors at the beginning of the device that are accessed */
+static __sector bench_span;
+static __sector bench_pos;
+static __u64 bench_rand_state = 0x9e3779b97f4a7c15ULL;
+
+/* xorshift64*, good enough to scatter requests over the device */
+static inline __u64 bench_rand(void)
+{
+	bench_rand_state ^= bench_rand_state >> 12;
+	bench_rand_state ^= bench_rand_state << 25;
+	bench_rand_state ^= bench_rand_state >> 27;
+	return bench_rand_state * 0x2545f4914f6cdd1dULL;
+}
+
+static __sector bench_sectors(struct uk_blkdev *dev, __sz bytes)
+{
+	__sector max = uk_blkdev_max_sec_per_req(dev);
+	__sector sectors;
+
+	sectors = DIV_ROUND_UP(bytes, uk_blkdev_ssize(dev)) ? : 1;
+	return max ? MIN(sectors, max) : sectors;
+}
+
+static int bench_dev_setup(unsigned int id)
+{
+	struct uk_alloc *a = uk_alloc_get_default();
+	struct uk_blkdev_queue_info qinfo;
+	struct uk_blkdev_queue_conf qconf;
+	struct uk_blkdev_conf conf;
+	struct uk_blkdev *dev;
+	__sz bufsz, align;
+	unsigned int i;
+	int rc;
+
+	dev = uk_blkdev_get(id);
+	if (!dev)
+		return -ENODEV;
+	/* A device that someone else set up is left alone */
+	if (uk_blkdev_state_get(dev) != UK_BLKDEV_UNCONFIGURED)
+		return -EBUSY;
+
+	conf.nb_queues = 1;
+	rc = uk_blkdev_configure(dev, &conf);
+	if (unlikely(rc))
+		return rc;
+
+	rc = uk_blkdev_queue_get_info(dev, 0, &qinfo);
+	if (unlikely(rc))
+		return rc;
+
+	memset(&qconf, 0, sizeof(qconf));
+	qconf.a = a;
+#if CONFIG_LIBUKBLKDEV_BENCH_POLL
+	qconf.flags = UK_BLKDEV_QUEUE_F_POLL;
+#endif /* CONFIG_LIBUKBLKDEV_BENCH_POLL */
+	rc = uk_blkdev_queue_configure(dev, 0, qinfo.nb_max, &qconf);
+	if (unlikely(rc))
+		return rc;
+
+	rc = uk_blkdev_start(dev);
+	if (unlikely(rc))
+		return rc;
+
+	bench_rand_sectors = bench_sectors(dev, CONFIG_LIBUKBLKDEV_BENCH_BS);
+	bench_seq_sectors = bench_sectors(dev,
+					  CONFIG_LIBUKBLKDEV_BENCH_SEQ_BS);
+	bench_span = uk_blkdev_sectors(dev);
+	if (CONFIG_LIBUKBLKDEV_BENCH_SPAN)
+		bench_span = MIN(bench_span,
+				 CONFIG_LIBUKBLKDEV_BENCH_SPAN * BENCH_MIB /
+				 uk_blkdev_ssize(dev));
+	if (bench_span < MAX(bench_rand_sectors, bench_seq_sectors))
+		return -ENOSPC;
+
+	bufsz = MAX(bench_rand_sectors, bench_seq_sectors) *
+		uk_blkdev_ssize(dev);
+	align = MAX((__sz)uk_blkdev_ioalign(dev), (__sz)__PAGE_SIZE);
+	for (i = 0; i < BENCH_QDEPTH; i++) {
+		bench_ios[i].buf = uk_memalign(a, align, bufsz);
+		if (unlikely(!bench_ios[i].buf)) {
+			while (i--)
+				uk_free(a, bench_ios[i].buf);
+			return -ENOMEM;
+		}
+		bench_ios[i].next = bench_free;
+		bench_free = &bench_ios[i];
+	}
+
+	uk_pr_info("bench: blkdev%u: %"__PRIsctr" sectors of %"__PRIsz
+		   " bytes, %"__PRIsctr"/%"__PRIsctr" sectors per request\n",
+		   id, bench_span, uk_blkdev_ssize(dev), bench_rand_sectors,
+		   bench_seq_sectors);
+	bench_dev = dev;
+	return 0;
+}
+
+static int bench_blkdev_init(struct uk_benchsuite *suite __unused)
+{
+	int rc;
+
+	rc = bench_dev_setup(CONFIG_LIBUKBLKDEV_BENCH_DEV);
+	if (unlikely(rc < 0))
+		uk_pr_warn("bench: blkdev %d is not available: %d\n",
+			   CONFIG_LIBUKBLKDEV_BENCH_DEV, rc);
+	return 0;
+}
+
+static void bench_io_done(struct uk_blkreq *req, void *cookie)
+{
+	struct bench_io *io = (struct bench_io *)cookie;
+
+	uk_bench_latency(bench_ctx, uk_bench_ticks() - io->start);
+	if (unlikely(req->result < 0) && !bench_err)
+		bench_err = req->result;
+
+	io->next = bench_free;
+	bench_free = io;
+	bench_inflight--;
+}
+
+static inline int bench_reap(void)
+{
+#if CONFIG_LIBUKBLKDEV_BENCH_POLL
+	return uk_blkdev_queue_poll(bench_dev, 0);
+#else /* !CONFIG_LIBUKBLKDEV_BENCH_POLL */
+	return uk_blkdev_queue_finish_reqs(bench_dev, 0);
+#endif /* !CONFIG_LIBUKBLKDEV_BENCH_POLL */
+}
+
+static __sector bench_next_sector(const struct bench_job *job,
+				  __sector sectors)
+{
+	__sector start;
+
+	if (job->random)
+		return (bench_rand() % (bench_span / sectors)) * sectors;
+
+	start = bench_pos;
+	bench_pos += sectors;
+	if (bench_pos + sectors > bench_span)
+		bench_pos = 0;
+	return start;
+}
+
+/* Waits for the requests in flight after a benchmark failed */
+static void bench_drain(void)
+{
+	__nsec deadline = ukplat_monotonic_clock() + BENCH_TIMEOUT;
+
+	while (bench_inflight) {
+		if (bench_reap() < 0 || ukplat_monotonic_clock() > deadline) {
+			/* The buffers may still be written by the device */
+			uk_pr_err("bench: %u requests did not complete\n",
+				  bench_inflight);
+			bench_dev = NULL;
+			return;
+		}
+	}
+}
+
+static void bench_io(struct uk_bench_ctx *b, const struct bench_job *job)
+{
+	__sector sectors;
+	__u64 submitted = 0;
+	__nsec deadline = 0;
+	struct bench_io *io;
+	enum uk_blkreq_op op;
+	int rc;
+
+	uk_bench_timer_stop(b);
+	if (!bench_dev) {
+		uk_bench_skip(b, "no block device");
+		return;
+	}
+	if (job->rwmixread < 100 && uk_blkdev_mode(bench_dev) == O_RDONLY) {
+		uk_bench_skip(b, "block device is read-only");
+		return;
+	}
+	sectors = job->random ? bench_rand_sectors : bench_seq_sectors;
+	b->bytes = sectors * uk_blkdev_ssize(bench_dev);
+	bench_ctx = b;
+	bench_err = 0;
+	uk_bench_timer_start(b);
+
+	while (submitted < b->n || bench_inflight) {
+		while (bench_inflight < job->qdepth && submitted < b->n) {
+			io = bench_free;
+			UK_ASSERT(io);
+
+			op = (job->rwmixread == 100 ||
+			      bench_rand() % 100 < job->rwmixread) ?
+			     UK_BLKREQ_READ : UK_BLKREQ_WRITE;
+			uk_blkreq_init(&io->req, op,
+				       bench_next_sector(job, sectors),
+				       sectors, io->buf, bench_io_done, io);
+			io->start = uk_bench_ticks();
+			rc = uk_blkdev_queue_submit_one(bench_dev, 0,
+							&io->req);
+			if (unlikely(rc < 0)) {
+				uk_bench_skip(b, "failed to submit: %d", rc);
+				goto err_drain;
+			}
+			if (!uk_blkdev_status_successful(rc)) {
+				/* The queue is full, retry the same range */
+				if (!job->random)
+					bench_pos = io->req.start_sector;
+				break;
+			}
+
+			bench_free = io->next;
+			bench_inflight++;
+			submitted++;
+		}
+
+		rc = bench_reap();
+		if (unlikely(rc < 0)) {
+			uk_bench_skip(b, "failed to reap completions: %d", rc);
+			goto err_drain;
+		}
+		if (unlikely(bench_err)) {
+			uk_bench_skip(b, "request failed: %d", bench_err);
+			goto err_drain;
+		}
+		if (rc) {
+			deadline = 0;
+			continue;
+		}
+
+		if (!deadline)
+			deadline = ukplat_monotonic_clock() + BENCH_TIMEOUT;
+		else if (ukplat_monotonic_clock() > deadline) {
+			uk_bench_skip(b, "requests timed out");
+			goto err_drain;
+		}
+	}
+	return;
+
+err_drain:
+	bench_drain();
+}
+
+#define BENCH_JOB(suite, name, dsc, qd, rnd, rmix)			\
+	UK_BENCHMARK_DESC(suite, name, dsc)				\
+	{								\
+		static const struct bench_job job = {			\
+			.qdepth = qd,					\
+			.random = rnd,					\
+			.rwmixread = rmix,				\
+		};							\
+									\
+		bench_io(b, &job);					\
+	}
+
+BENCH_JOB(ukblkdev_benchsuite, randread_qd1,
+	  "random reads, queue depth 1", 1, 1, 100)
+BENCH_JOB(ukblkdev_benchsuite, randread,
+	  "random reads", BENCH_QDEPTH, 1, 100)
+BENCH_JOB(ukblkdev_benchsuite, seqread,
+	  "sequential reads", BENCH_QDEPTH, 0, 100)
+
+#if CONFIG_LIBUKBLKDEV_BENCH_WRITE
+BENCH_JOB(ukblkdev_benchsuite, randwrite_qd1,
+	  "random writes, queue depth 1", 1, 1, 0)
+BENCH_JOB(ukblkdev_benchsuite, randwrite,
+	  "random writes", BENCH_QDEPTH, 1, 0)
+BENCH_JOB(ukblkdev_benchsuite, seqwrite,
+	  "sequential writes", BENCH_QDEPTH, 0, 0)
+BENCH_JOB(ukblkdev_benchsuite, randrw,
+	  "random mix of reads and writes", BENCH_QDEPTH, 1,
+	  CONFIG_LIBUKBLKDEV_BENCH_RWMIXREAD)
+#endif /* CONFIG_LIBUKBLKDEV_BENCH_WRITE */
+
+uk_benchsuite_register(ukblkdev_benchsuite, bench_blkdev_init);
@@ -64,12 +64,21 @@
 #include <uk/tinyalloc.h>
 #define uk_alloc_init uk_tinyalloc_init
 #endif
+#if CONFIG_LIBUKBOOT_ALLOCSLAB
+#include <uk/allocslab.h>
+#endif /* CONFIG_LIBUKBOOT_ALLOCSLAB */
+#if CONFIG_LIBUKBOOT_ALLOCMAG
+#include <uk/allocmag.h>
+#endif /* CONFIG_LIBUKBOOT_ALLOCMAG */
 #if CONFIG_LIBUKSCHED
 #include <uk/sched.h>
 #endif /* CONFIG_LIBUKSCHED */
 #if CONFIG_LIBUKBOOT_INITSCHEDCOOP
 #include <uk/schedcoop.h>
 #endif /* CONFIG_LIBUKBOOT_INITSCHEDCOOP */
+#if CONFIG_LIBUKBOOT_INITSCHEDWS
+#include <uk/schedws.h>
+#endif /* CONFIG_LIBUKBOOT_INITSCHEDWS */
 #include <uk/arch/lcpu.h>
 #include <uk/plat/bootstrap.h>
 #include <uk/plat/memory.h>
@@ -94,6 +103,8 @@
 #endif /* CONFIG_LIBUKBOOT_MAINTHREAD */
 #include <uk/errptr.h>
 #include "banner.h"
+#include "profile.h"
+#include "markers.h"
 
 #if CONFIG_LIBUKBOOT_NOSCHED
 #include <uk/plat/common/lcpu.h>
@@ -115,6 +126,104 @@ static void main_thread_dtor(struct uk_thread *m);
 static struct uk_vas kernel_vas;
 #endif /* CONFIG_LIBUKBOOT_HEAP_BASE && CONFIG_LIBUKVMEM */
 
+#if CONFIG_LIBUKBOOT_HEAP_DEFERRED
+/* Heap memory beyond the initial size is added to the allocator in chunks of
+ * this size by the "heap" thread
+ */
+#define HEAP_DEFERRED_CHUNK	(256UL << 20)
+#define HEAP_DEFERRED_MAX	16
+
+#if defined(CONFIG_LIBUKBOOT_HEAP_BASE) && !defined(CONFIG_LIBUKVMEM)
+/* The deferred heap is not mapped yet */
+#define HEAP_DEFERRED_MAP	1
+#endif /* CONFIG_LIBUKBOOT_HEAP_BASE && !CONFIG_LIBUKVMEM */
+
+static struct {
+	__vaddr_t base;
+	__sz len;
+} heap_deferred[HEAP_DEFERRED_MAX];
+static unsigned int heap_deferred_count;
+
+/* Budget for the memory added to the allocator during boot. The remainder
+ * of a region is deferred entirely if less than 1 MiB of the budget is left
+ */
+static __sz heap_initial_left = (__sz)CONFIG_LIBUKBOOT_HEAP_INITIAL_SIZE << 20;
+
+/* Returns how much of [base, base + len) should be added to the allocator
+ * right away, which may be 0, and remembers the rest for the "heap" thread
+ */
+static __sz heap_defer(__vaddr_t base, __sz len)
+{
+	__sz now = (heap_initial_left < (1UL << 20)) ? 0 :
+		   MIN(len, heap_initial_left);
+
+#ifdef HEAP_DEFERRED_MAP
+	/* Split on a large page boundary, so that both parts can be mapped
+	 * with large pages
+	 */
+	if (now < len && now > PAGE_LARGE_SIZE)
+		now = ALIGN_DOWN(now, PAGE_LARGE_SIZE);
+#endif /* HEAP_DEFERRED_MAP */
+
+	if (now == len || heap_deferred_count == HEAP_DEFERRED_MAX) {
+		now = len;
+	} else {
+		heap_deferred[heap_deferred_count].base = base + now;
+		heap_deferred[heap_deferred_count].len = len - now;
+		heap_deferred_count++;
+	}
+
+	heap_initial_left -= MIN(heap_initial_left, now);
+	return now;
+}
+
+static __noreturn void heap_grow_thread(void *argp)
+{
+	struct uk_alloc *a = (struct uk_alloc *)argp;
+	__vaddr_t base;
+	__sz len, chunk;
+	unsigned int i;
+	int rc;
+
+	for (i = 0; i < heap_deferred_count; i++) {
+		base = heap_deferred[i].base;
+		len = heap_deferred[i].len;
+
+		while (len) {
+			chunk = MIN(len, HEAP_DEFERRED_CHUNK);
+#ifdef HEAP_DEFERRED_MAP
+			rc = ukplat_page_map(ukplat_pt_get_active(), base,
+					     __PADDR_ANY, chunk >> PAGE_SHIFT,
+					     PAGE_ATTR_PROT_RW, 0);
+			if (unlikely(rc)) {
+				uk_pr_err("Failed to map deferred heap: %d\n",
+					  rc);
+				goto out;
+			}
+#endif /* HEAP_DEFERRED_MAP */
+			rc = uk_alloc_addmem(a, (void *)base, chunk);
+			if (unlikely(rc))
+				uk_pr_warn("Failed to grow heap by %p-%p: %d\n",
+					   (void *)base, (void *)(base + chunk),
+					   rc);
+			base += chunk;
+			len -= chunk;
+
+			/* Let the boot and the application proceed */
+			uk_sched_yield();
+		}
+	}
+
+	uk_pr_debug("Deferred heap initialization done\n");
+#ifdef HEAP_DEFERRED_MAP
+out:
+#endif /* HEAP_DEFERRED_MAP */
+	uk_sched_thread_exit();
+}
+#else /* !CONFIG_LIBUKBOOT_HEAP_DEFERRED */
+#define heap_defer(base, len)	(len)
+#endif /* !CONFIG_LIBUKBOOT_HEAP_DEFERRED */
+
 static struct uk_alloc *heap_init()
 {
 	struct uk_alloc *a = NULL;
@@ -122,12 +231,14 @@ static struct uk_alloc *heap_init()
 	struct uk_pagetable *pt = ukplat_pt_get_active();
 	__sz free_pages, alloc_pages;
 	__vaddr_t heap_base;
+	__sz len;
 #ifdef CONFIG_LIBUKVMEM
 	__vaddr_t vaddr;
 #endif /* CONFIG_LIBUKVMEM */
 	int rc;
 #else /* CONFIG_LIBUKBOOT_HEAP_BASE */
 	struct ukplat_memregion_desc *md;
+	__sz len;
 #endif /* !CONFIG_LIBUKBOOT_HEAP_BASE */
 
 #ifdef CONFIG_LIBUKBOOT_HEAP_BASE
@@ -176,25 +287,28 @@ static struct uk_alloc *heap_init()
 	vaddr = heap_base;
 	rc = uk_vma_map_anon(&kernel_vas, &vaddr,
 			     (alloc_pages + HEAP_INITIAL_PAGES) << PAGE_SHIFT,
-			     PAGE_ATTR_PROT_RW, UK_VMA_MAP_UNINITIALIZED,
+			     PAGE_ATTR_PROT_RW,
+			     UK_VMA_MAP_UNINITIALIZED | UK_VMA_MAP_LARGE_PAGES,
 			     "heap");
 	if (unlikely(rc))
 		return NULL;
 
+	len = (alloc_pages - HEAP_INITIAL_PAGES) << PAGE_SHIFT;
 	rc = uk_alloc_addmem(a, (void *)(heap_base + HEAP_INITIAL_LEN),
-			     (alloc_pages - HEAP_INITIAL_PAGES) << PAGE_SHIFT);
+			     heap_defer(heap_base + HEAP_INITIAL_LEN, len));
 	if (unlikely(rc))
 		return NULL;
 #else /* CONFIG_LIBUKVMEM */
 	free_pages  = pt->fa->free_memory >> PAGE_SHIFT;
 	alloc_pages = free_pages - PT_PAGES(free_pages);
 
+	len = heap_defer(heap_base, alloc_pages << PAGE_SHIFT);
 	rc = ukplat_page_map(pt, heap_base, __PADDR_ANY,
-			     alloc_pages, PAGE_ATTR_PROT_RW, 0);
+			     len >> PAGE_SHIFT, PAGE_ATTR_PROT_RW, 0);
 	if (unlikely(rc))
 		return NULL;
 
-	a = uk_alloc_init((void *)heap_base, alloc_pages << PAGE_SHIFT);
+	a = uk_alloc_init((void *)heap_base, len);
 #endif /* !CONFIG_LIBUKVMEM */
 #else /* CONFIG_LIBUKBOOT_HEAP_BASE */
 	/* Paging is disabled so we still have the static boot page table set
@@ -220,10 +334,14 @@ static struct uk_alloc *heap_init()
 #endif /* !CONFIG_UKPLAT_MEMRNAME */
 			    );
 
+		len = heap_defer(md->vbase, md->len);
+		if (!len)
+			continue;
+
 		if (!a)
-			a = uk_alloc_init((void *)md->vbase, md->len);
+			a = uk_alloc_init((void *)md->vbase, len);
 		else
-			uk_alloc_addmem(a, (void *)md->vbase, md->len);
+			uk_alloc_addmem(a, (void *)md->vbase, len);
 	}
 #endif /* !CONFIG_LIBUKBOOT_HEAP_BASE */
 
@@ -274,12 +392,17 @@ void ukplat_entry(int argc, char *argv[])
 	uk_ctor_func_t *ctorfn;
 	struct uk_inittab_entry *init_entry;
 	void *auxstack;
+#if CONFIG_LIBUKBOOT_PROFILE
+	__nsec init_start;
+#endif /* CONFIG_LIBUKBOOT_PROFILE */
 
 #if CONFIG_LIBUKBOOT_MAINTHREAD
 	/* Initialize shutdown control structure */
 	uk_boot_shutdown_ctl_init();
 #endif /* CONFIG_LIBUKBOOT_MAINTHREAD */
 
+	uk_boot_mark("entry");
+
 	uk_pr_info("Unikraft constructor table at %p - %p\n",
 		   &uk_ctortab_start[0], &uk_ctortab_end);
 	uk_ctortab_foreach(ctorfn, uk_ctortab_start, uk_ctortab_end) {
@@ -322,11 +445,23 @@ void ukplat_entry(int argc, char *argv[])
 	a = heap_init();
 	if (unlikely(!a))
 		UK_CRASH("Failed to initialize memory allocator\n");
-	else {
-		rc = ukplat_memallocator_set(a);
-		if (unlikely(rc != 0))
-			UK_CRASH("Could not set the platform memory allocator\n");
-	}
+	uk_boot_mark("heap");
+#if CONFIG_LIBUKBOOT_ALLOCSLAB
+	a = uk_allocslab_init(a);
+	if (unlikely(!a))
+		UK_CRASH("Failed to initialize slab allocator\n");
+	uk_alloc_set_default(a);
+#endif /* CONFIG_LIBUKBOOT_ALLOCSLAB */
+#if CONFIG_LIBUKBOOT_ALLOCMAG
+	a = uk_allocmag_init(a);
+	if (unlikely(!a))
+		UK_CRASH("Failed to initialize magazine cache\n");
+	uk_alloc_set_default(a);
+#endif /* CONFIG_LIBUKBOOT_ALLOCMAG */
+
+	rc = ukplat_memallocator_set(a);
+	if (unlikely(rc != 0))
+		UK_CRASH("Could not set the platform memory allocator\n");
 
 	/* Allocate a TLS for this execution context */
 	tls = uk_memalign(a,
@@ -370,15 +505,28 @@ void ukplat_entry(int argc, char *argv[])
 	/* On most platforms the timer depend on an initialized IRQ subsystem */
 	uk_pr_info("Initialize platform time...\n");
 	ukplat_time_init();
+	uk_boot_mark("time");
 
 #if !CONFIG_LIBUKBOOT_NOSCHED
 	uk_pr_info("Initialize scheduling...\n");
 #if CONFIG_LIBUKBOOT_INITSCHEDCOOP
 	s = uk_schedcoop_create(a);
+#elif CONFIG_LIBUKBOOT_INITSCHEDWS
+	s = uk_schedws_create(a);
 #endif
 	if (unlikely(!s))
 		UK_CRASH("Failed to initialize scheduling\n");
 	uk_sched_start(s);
+
+#if CONFIG_LIBUKBOOT_HEAP_DEFERRED
+	if (heap_deferred_count) {
+		struct uk_thread *h;
+
+		h = uk_sched_thread_create(s, heap_grow_thread, a, "heap");
+		if (unlikely(!h || PTRISERR(h)))
+			UK_CRASH("Failed to create heap thread\n");
+	}
+#endif /* CONFIG_LIBUKBOOT_HEAP_DEFERRED */
 #endif /* !CONFIG_LIBUKBOOT_NOSCHED */
 
 	ictx.cmdline.argc = argc;
@@ -392,6 +540,9 @@ void ukplat_entry(int argc, char *argv[])
 	 */
 	uk_pr_info("Init Table @ %p - %p\n",
 		   &uk_inittab_start[0], &uk_inittab_end);
+#if CONFIG_LIBUKBOOT_PROFILE
+	uk_boot_profile_init(a);
+#endif /* CONFIG_LIBUKBOOT_PROFILE */
 	uk_inittab_foreach(init_entry, uk_inittab_start, uk_inittab_end) {
 		UK_ASSERT(init_entry);
 
@@ -400,7 +551,13 @@ void ukplat_entry(int argc, char *argv[])
 
 		uk_pr_debug("Call init function: %p(%p)...\n",
 			    init_entry->init, &ictx);
+#if CONFIG_LIBUKBOOT_PROFILE
+		init_start = ukplat_monotonic_clock();
+#endif /* CONFIG_LIBUKBOOT_PROFILE */
 		rc = (*init_entry->init)(&ictx);
+#if CONFIG_LIBUKBOOT_PROFILE
+		uk_boot_profile_record(init_entry, init_start);
+#endif /* CONFIG_LIBUKBOOT_PROFILE */
 		if (rc < 0) {
 			uk_pr_err("Init function at %p returned error %d\n",
 				  init_entry->init, rc);
@@ -408,6 +565,11 @@ void ukplat_entry(int argc, char *argv[])
 		}
 	}
 
+	uk_boot_mark("inittab");
+#if CONFIG_LIBUKBOOT_PROFILE
+	uk_boot_profile_report();
+#endif /* CONFIG_LIBUKBOOT_PROFILE */
+
 #ifdef CONFIG_LIBUKSP
 	uk_stack_chk_guard_setup();
 #endif
@@ -437,6 +599,8 @@ void ukplat_entry(int argc, char *argv[])
 #endif /* CONFIG_LIBUKBOOT_MAINTHREAD */
 
 exit:
+	uk_boot_mark("halt");
+	uk_boot_mark_mem("halt");
 	uk_pr_info("Halting system (%d)\n", tctx.target);
 
 	/**
@@ -520,6 +684,12 @@ static inline int do_main(int argc, char *argv[])
 	uk_pr_info("])\n");
 #endif /* CONFIG_LIBUKDEBUG_PRINTK_INFO */
 
+#if CONFIG_LIBUKBOOT_SNAPSHOT_BEFORE_MAIN
+	uk_boot_snapshot_point();
+#endif /* CONFIG_LIBUKBOOT_SNAPSHOT_BEFORE_MAIN */
+
+	uk_boot_mark("main");
+	uk_boot_mark_mem("main");
 	ret = main(argc, argv);
 	uk_pr_info("main returned %d\n", ret);
 	return ret;
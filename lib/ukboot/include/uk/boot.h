@@ -37,6 +37,36 @@ int uk_boot_shutdown_req(enum ukplat_gstate target);
 	({ -ENOTSUP; })
 #endif /* !CONFIG_LIBUKBOOT_MAINTHREAD */
 
+/**
+ * Snapshot point: Quiesces the system so that the VMM can take a snapshot
+ * of the VM and waits until the VM runs again, either because it was
+ * restored from the snapshot or because it continues after taking it.
+ * Clones restored from the same snapshot start at this point, after the
+ * library initialization and any warm-up that the application did before.
+ *
+ * Before the snapshot, the UK_BOOT_SNAPSHOT_SUSPEND event is raised and
+ * the devices of all buses are suspended. Then the line
+ * "UKBOOT snapshot state=ready" is printed on the kernel console, which
+ * tells the VMM to pause the VM and to take the snapshot. After restoring
+ * the VM, the VMM writes any character to the console to resume it. The
+ * wall clock is then resynchronized with the host, the random number
+ * generators are rekeyed, the devices are resumed and the
+ * UK_BOOT_SNAPSHOT_RESUME event is raised. Handlers of both events
+ * (see <uk/event.h>) run in thread context and get no argument.
+ *
+ * @returns
+ *   - (0): Success, the VM runs again.
+ *   - (<0): A handler of UK_BOOT_SNAPSHOT_SUSPEND failed, no snapshot
+ *           point was reached.
+ *   - (-ENOTSUP): Snapshot points are not supported.
+ */
+#if CONFIG_LIBUKBOOT_SNAPSHOT
+int uk_boot_snapshot_point(void);
+#else /* !CONFIG_LIBUKBOOT_SNAPSHOT */
+#define uk_boot_snapshot_point() \
+	({ -ENOTSUP; })
+#endif /* !CONFIG_LIBUKBOOT_SNAPSHOT */
+
 #ifdef __cplusplus
 }
 #endif
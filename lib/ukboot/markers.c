@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+#include <uk/config.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <uk/essentials.h>
+#include <uk/plat/console.h>
+#include <uk/plat/time.h>
+#if CONFIG_LIBUKALLOC
+#include <uk/alloc.h>
+#endif /* CONFIG_LIBUKALLOC */
+#if CONFIG_HAVE_PAGING
+#include <uk/falloc.h>
+#include <uk/plat/paging.h>
+#endif /* CONFIG_HAVE_PAGING */
+#include "markers.h"
+
+/* Every marker is a single line of space-separated `key=value` pairs */
+#define MARK_PREFIX	"UKBOOT "
+#define MARK_LINE_LEN	256
+
+/* Markers bypass the kernel message levels, so they are always printed */
+static void __printf(1, 2) mark_printf(const char *fmt, ...)
+{
+	char buf[MARK_LINE_LEN];
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+
+	if (unlikely(len < 0))
+		return;
+	ukplat_coutk(buf, MIN((unsigned int)len, sizeof(buf) - 1));
+}
+
+void uk_boot_mark(const char *stage)
+{
+	/* The monotonic clock starts with the platform time, so earlier
+	 * stages are only told apart by the time the line arrives
+	 */
+	mark_printf(MARK_PREFIX "mark stage=%s ns=%"__PRInsec"\n",
+		    stage, ukplat_monotonic_clock());
+}
+
+void uk_boot_mark_mem(const char *stage)
+{
+#if CONFIG_LIBUKALLOC_IFSTATS
+	struct uk_alloc_stats stats;
+#endif /* CONFIG_LIBUKALLOC_IFSTATS */
+#if CONFIG_LIBUKALLOC
+	struct uk_alloc *a = uk_alloc_get_default();
+#endif /* CONFIG_LIBUKALLOC */
+#if CONFIG_HAVE_PAGING
+	struct uk_pagetable *pt = ukplat_pt_get_active();
+#endif /* CONFIG_HAVE_PAGING */
+
+	mark_printf(MARK_PREFIX "mem stage=%s", stage);
+
+#if CONFIG_LIBUKALLOC_IFSTATS
+#if CONFIG_LIBUKALLOC_IFSTATS_GLOBAL
+	uk_alloc_stats_get_global(&stats);
+#else /* !CONFIG_LIBUKALLOC_IFSTATS_GLOBAL */
+	if (a)
+		uk_alloc_stats_get(a, &stats);
+	else
+		memset(&stats, 0, sizeof(stats));
+#endif /* !CONFIG_LIBUKALLOC_IFSTATS_GLOBAL */
+	mark_printf(" heap_cur=%"__PRIssz" heap_peak=%"__PRIssz
+		    " heap_allocs=%"__PRIs64" heap_allocs_peak=%"__PRIs64,
+		    stats.cur_mem_use, stats.max_mem_use,
+		    stats.cur_nb_allocs, stats.max_nb_allocs);
+#endif /* CONFIG_LIBUKALLOC_IFSTATS */
+
+#if CONFIG_LIBUKALLOC
+	if (a && uk_alloc_availmem(a) >= 0)
+		mark_printf(" heap_avail=%"__PRIssz, uk_alloc_availmem(a));
+#endif /* CONFIG_LIBUKALLOC */
+
+#if CONFIG_HAVE_PAGING
+	if (pt && pt->fa)
+		mark_printf(" frames_used=%"__PRIsz" frames_peak=%"__PRIsz
+			    " frames_total=%"__PRIsz,
+			    pt->fa->total_memory - pt->fa->free_memory,
+			    pt->fa->max_used_memory, pt->fa->total_memory);
+#endif /* CONFIG_HAVE_PAGING */
+
+	mark_printf("\n");
+}
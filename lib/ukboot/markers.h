@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+#ifndef __UK_BOOT_MARKERS_H__
+#define __UK_BOOT_MARKERS_H__
+
+#include <uk/config.h>
+#include <uk/essentials.h>
+
+/*
+ * Library-internal boot stage markers: machine-readable lines on the kernel
+ * console that tell when a boot stage is reached and how much memory is in
+ * use. They are parsed by support/scripts/ukbootstat.py.
+ */
+
+#if CONFIG_LIBUKBOOT_MARKERS
+/* Prints the marker of `stage` with the current monotonic time */
+void uk_boot_mark(const char *stage);
+
+/* Prints the heap and frame allocator usage at `stage` */
+void uk_boot_mark_mem(const char *stage);
+#else /* !CONFIG_LIBUKBOOT_MARKERS */
+static inline void uk_boot_mark(const char *stage __unused) { }
+static inline void uk_boot_mark_mem(const char *stage __unused) { }
+#endif /* !CONFIG_LIBUKBOOT_MARKERS */
+
+#endif /* __UK_BOOT_MARKERS_H__ */
@@ -0,0 +1,95 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+#include <uk/assert.h>
+#include <uk/essentials.h>
+#include <uk/plat/time.h>
+#include <uk/print.h>
+#include <uk/trace.h>
+#include "profile.h"
+
+UK_TRACEPOINT(trace_ukboot_initcall, "%s:%s %llu ns",
+	      const char *, const char *, unsigned long long);
+
+struct boot_profile_rec {
+	const struct uk_inittab_entry *entry;
+	__nsec duration;
+};
+
+static struct {
+	struct uk_alloc *a;
+	struct boot_profile_rec *recs;
+	unsigned int nr_recs;
+	unsigned int max_recs;
+	__nsec start;
+} profile;
+
+void uk_boot_profile_init(struct uk_alloc *a)
+{
+	unsigned int n = &uk_inittab_end - uk_inittab_start;
+
+	profile.a = a;
+	profile.nr_recs = 0;
+	profile.max_recs = 0;
+	profile.start = ukplat_monotonic_clock();
+
+	/* Without records, we still trace and report the total */
+	profile.recs = uk_malloc(a, n * sizeof(*profile.recs));
+	if (unlikely(!profile.recs)) {
+		uk_pr_warn("Boot profile: Out of memory\n");
+		return;
+	}
+	profile.max_recs = n;
+}
+
+void uk_boot_profile_record(const struct uk_inittab_entry *entry,
+			    __nsec start)
+{
+	__nsec duration = ukplat_monotonic_clock() - start;
+
+	trace_ukboot_initcall(entry->libname, entry->name,
+			      (unsigned long long)duration);
+
+	if (profile.nr_recs == profile.max_recs)
+		return;
+
+	profile.recs[profile.nr_recs].entry = entry;
+	profile.recs[profile.nr_recs].duration = duration;
+	profile.nr_recs++;
+}
+
+void uk_boot_profile_report(void)
+{
+	__nsec total = ukplat_monotonic_clock() - profile.start;
+	struct boot_profile_rec rec;
+	unsigned int i, j;
+
+	/* Insertion sort, longest first. The inittab is short */
+	for (i = 1; i < profile.nr_recs; i++) {
+		rec = profile.recs[i];
+		for (j = i; j > 0 && profile.recs[j - 1].duration <
+				     rec.duration; j--)
+			profile.recs[j] = profile.recs[j - 1];
+		profile.recs[j] = rec;
+	}
+
+	uk_pr_info("Boot profile: inittab took %"__PRInsec".%06"__PRInsec
+		   " ms\n", ukarch_time_nsec_to_msec(total),
+		   total % 1000000);
+	for (i = 0; i < profile.nr_recs; i++) {
+		rec = profile.recs[i];
+		uk_pr_info("  %9"__PRInsec" ns %3u%% %s:%s()\n",
+			   rec.duration,
+			   (unsigned int)(total ? rec.duration * 100 / total
+						: 0),
+			   rec.entry->libname, rec.entry->name);
+	}
+
+	if (profile.recs)
+		uk_free(profile.a, profile.recs);
+	profile.recs = __NULL;
+	profile.nr_recs = 0;
+	profile.max_recs = 0;
+}
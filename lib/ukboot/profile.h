@@ -0,0 +1,33 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+#ifndef __UK_BOOT_PROFILE_H__
+#define __UK_BOOT_PROFILE_H__
+
+#include <uk/config.h>
+#if CONFIG_LIBUKBOOT_PROFILE
+#include <uk/alloc.h>
+#include <uk/arch/time.h>
+#include <uk/init.h>
+
+/*
+ * Library-internal boot profiler: records the duration of each init
+ * function of the inittab and prints a breakdown, sorted by duration,
+ * once all of them have been executed.
+ */
+
+/* Allocates the records for all entries of the inittab */
+void uk_boot_profile_init(struct uk_alloc *a);
+
+/* Records the duration of `entry`, which started at `start` */
+void uk_boot_profile_record(const struct uk_inittab_entry *entry,
+			    __nsec start);
+
+/* Prints the breakdown and releases the records */
+void uk_boot_profile_report(void);
+
+#endif /* CONFIG_LIBUKBOOT_PROFILE */
+
+#endif /* __UK_BOOT_PROFILE_H__ */
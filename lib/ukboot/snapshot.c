@@ -0,0 +1,82 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+#include <uk/config.h>
+#include <uk/boot.h>
+#include <uk/essentials.h>
+#include <uk/event.h>
+#include <uk/print.h>
+#include <uk/plat/console.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/time.h>
+#if CONFIG_LIBUKBUS
+#include <uk/bus.h>
+#endif /* CONFIG_LIBUKBUS */
+#if CONFIG_LIBUKSWRAND
+#include <uk/swrand.h>
+#endif /* CONFIG_LIBUKSWRAND */
+#include "markers.h"
+
+#define SNAPSHOT_READY		"UKBOOT snapshot state=ready\n"
+/* Interval at which the console is polled for the resume character */
+#define SNAPSHOT_POLL_NSEC	ukarch_time_msec_to_nsec(1)
+
+UK_EVENT(UK_BOOT_SNAPSHOT_SUSPEND);
+UK_EVENT(UK_BOOT_SNAPSHOT_RESUME);
+
+static void snapshot_wait(void)
+{
+	unsigned long flags;
+	char c;
+
+	flags = ukplat_lcpu_save_irqf();
+
+	/* Input that arrived before the snapshot must not resume it */
+	while (ukplat_cink(&c, 1) > 0)
+		;
+
+	ukplat_coutk(SNAPSHOT_READY, sizeof(SNAPSHOT_READY) - 1);
+	while (ukplat_cink(&c, 1) <= 0)
+		ukplat_lcpu_halt_irq_until(ukplat_monotonic_clock() +
+					   SNAPSHOT_POLL_NSEC);
+
+	ukplat_lcpu_restore_irqf(flags);
+}
+
+int uk_boot_snapshot_point(void)
+{
+	int rc;
+
+	uk_pr_info("Preparing snapshot...\n");
+	rc = uk_raise_event(UK_BOOT_SNAPSHOT_SUSPEND, NULL);
+	if (unlikely(rc < 0)) {
+		uk_pr_err("Failed to prepare snapshot: %d\n", rc);
+		return rc;
+	}
+#if CONFIG_LIBUKBUS
+	uk_bus_suspend_all();
+#endif /* CONFIG_LIBUKBUS */
+
+	snapshot_wait();
+
+	/* The VM may be a clone that runs on a different host at a later
+	 * time, so it must not reuse the time and randomness of the snapshot
+	 */
+	ukplat_time_resync();
+#if CONFIG_LIBUKSWRAND
+	uk_swrand_reseed();
+#endif /* CONFIG_LIBUKSWRAND */
+#if CONFIG_LIBUKBUS
+	uk_bus_resume_all();
+#endif /* CONFIG_LIBUKBUS */
+
+	rc = uk_raise_event(UK_BOOT_SNAPSHOT_RESUME, NULL);
+	if (unlikely(rc < 0))
+		uk_pr_err("Failed to resume from snapshot: %d\n", rc);
+
+	uk_boot_mark("resume");
+	uk_pr_info("Resumed from snapshot\n");
+	return 0;
+}
@@ -128,6 +128,46 @@ static unsigned int uk_bus_probe_all(void)
 	return ret;
 }
 
+int uk_bus_suspend_all(void)
+{
+	struct uk_bus *b;
+	int rc, ret = 0;
+
+	uk_list_for_each_entry(b, &uk_bus_list, list) {
+		if (!b->suspend)
+			continue;
+
+		uk_pr_debug("Suspend bus %p...\n", b);
+		rc = b->suspend();
+		if (unlikely(rc < 0)) {
+			uk_pr_err("Failed to suspend bus %p: %d\n", b, rc);
+			if (!ret)
+				ret = rc;
+		}
+	}
+	return ret;
+}
+
+int uk_bus_resume_all(void)
+{
+	struct uk_bus *b;
+	int rc, ret = 0;
+
+	uk_list_for_each_entry(b, &uk_bus_list, list) {
+		if (!b->resume)
+			continue;
+
+		uk_pr_debug("Resume bus %p...\n", b);
+		rc = b->resume();
+		if (unlikely(rc < 0)) {
+			uk_pr_err("Failed to resume bus %p: %d\n", b, rc);
+			if (!ret)
+				ret = rc;
+		}
+	}
+	return ret;
+}
+
 static int uk_bus_lib_init(struct uk_init_ctx *ictx __unused)
 {
 	uk_pr_info("Initialize bus handlers...\n");
@@ -51,16 +51,44 @@ extern struct uk_list_head uk_bus_list;
 
 typedef int (*uk_bus_init_func_t)(struct uk_alloc *a);
 typedef int (*uk_bus_probe_func_t)(void);
+typedef int (*uk_bus_suspend_func_t)(void);
+typedef int (*uk_bus_resume_func_t)(void);
 
 struct uk_bus {
 	struct uk_list_head list;
 	uk_bus_init_func_t init; /**< Initialize bus handler (optional) */
 	uk_bus_probe_func_t probe; /**< Probe for devices attached to the bus */
+	/** Quiesce the devices of the bus, e.g., before a VM snapshot
+	 *  (optional)
+	 */
+	uk_bus_suspend_func_t suspend;
+	/** Bring the devices back after uk_bus_suspend_all() or after the VM
+	 *  was restored from a snapshot (optional)
+	 */
+	uk_bus_resume_func_t resume;
 };
 
 /* Returns the number of registered buses */
 unsigned int uk_bus_count(void);
 
+/**
+ * Quiesces the devices of all buses, e.g., before a VM snapshot is taken
+ *
+ * @return
+ *   0 on success, the first error of a bus otherwise. The remaining buses
+ *   are suspended anyways.
+ */
+int uk_bus_suspend_all(void);
+
+/**
+ * Resumes the devices of all buses after uk_bus_suspend_all()
+ *
+ * @return
+ *   0 on success, the first error of a bus otherwise. The remaining buses
+ *   are resumed anyways.
+ */
+int uk_bus_resume_all(void);
+
 /* Do not use this function directly: */
 void _uk_bus_register(struct uk_bus *b);
 /* Do not use this function directly: */
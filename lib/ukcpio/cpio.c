@@ -35,6 +35,7 @@
 
 #include <string.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <limits.h>
 #include <errno.h>
 
@@ -48,6 +49,8 @@
 #include <unistd.h>
 #include <utime.h>
 
+#include "stream.h"
+
 /*
  * Currently only supports BSD new-style cpio archive format.
  */
@@ -120,18 +123,8 @@ snhex_to_int(const char *buf, size_t count)
 	return val;
 }
 
-#define ALIGN_4(ptr)      ((void *)ALIGN_UP((uintptr_t)(ptr), 4))
-
 #define CPIO_U32FIELD(buf) \
 	((uint32_t) snhex_to_int((buf), 8))
-#define CPIO_FILENAME(header) \
-	((char *)header + sizeof(struct cpio_header))
-#define CPIO_DATA(header, fnlen) \
-	(char *)ALIGN_4((char *)(header) + sizeof(struct cpio_header) + fnlen)
-#define CPIO_NEXT(header, fnlen, fsize) \
-	(struct cpio_header *)ALIGN_4(CPIO_DATA(header, fnlen) + fsize)
-#define CPIO_ISLAST(header) \
-	(strcmp(CPIO_FILENAME(header), "TRAILER!!!") == 0)
 
 
 /* Raw filesystem syscalls; not provided by headers */
@@ -144,14 +137,10 @@ int uk_syscall_r_mkdir(const char *, mode_t);
 int uk_syscall_r_symlink(const char *, const char *);
 int uk_syscall_r_stat(const char *, struct stat *);
 
-static enum ukcpio_error
-extract_file(const char *path, const char *contents, size_t len,
-	     mode_t mode, uint32_t mtime)
+static int
+file_create(const char *path, size_t len)
 {
-	int ret = UKCPIO_SUCCESS;
 	int fd;
-	int err;
-	struct utimbuf times = {mtime, mtime};
 
 	uk_pr_info("Extracting %s (%zu bytes)\n", path, len);
 
@@ -159,9 +148,15 @@ extract_file(const char *path, const char *contents, size_t len,
 	if (fd < 0) {
 		uk_pr_err("%s: Failed to create file: %s (%d)\n",
 			  path, strerror(-fd), -fd);
-		ret = -UKCPIO_FILE_CREATE_FAILED;
-		goto out;
+		return -UKCPIO_FILE_CREATE_FAILED;
 	}
+	return fd;
+}
+
+static enum ukcpio_error
+file_write(const char *path, int fd, const char *contents, size_t len)
+{
+	int err;
 
 	while (len) {
 		ssize_t written = uk_syscall_r_write(fd, contents, len);
@@ -170,13 +165,20 @@ extract_file(const char *path, const char *contents, size_t len,
 			err = written;
 			uk_pr_err("%s: Failed to load content: %s (%d)\n",
 				  path, strerror(-err), -err);
-			ret = -UKCPIO_FILE_WRITE_FAILED;
-			goto close_out;
+			return -UKCPIO_FILE_WRITE_FAILED;
 		}
 		UK_ASSERT(len >= (size_t)written);
 		contents += written;
 		len -= written;
 	}
+	return UKCPIO_SUCCESS;
+}
+
+static enum ukcpio_error
+file_close(const char *path, int fd, mode_t mode, uint32_t mtime)
+{
+	struct utimbuf times = {mtime, mtime};
+	int err;
 
 	if ((err = uk_syscall_r_chmod(path, mode)))
 		uk_pr_warn("%s: Failed to chmod: %s (%d)\n",
@@ -186,15 +188,12 @@ extract_file(const char *path, const char *contents, size_t len,
 		uk_pr_warn("%s: Failed to set modification time: %s (%d)",
 			   path, strerror(-err), -err);
 
-close_out:
 	if ((err = uk_syscall_r_close(fd))) {
 		uk_pr_err("%s: Failed to close file: %s (%d)\n",
 			  path, strerror(-err), -err);
-		if (!ret)
-			ret = -UKCPIO_FILE_CLOSE_FAILED;
+		return -UKCPIO_FILE_CLOSE_FAILED;
 	}
-out:
-	return ret;
+	return UKCPIO_SUCCESS;
 }
 
 static enum ukcpio_error
@@ -254,104 +253,264 @@ extract_symlink(const char *path, const char *contents, size_t len)
 	return UKCPIO_SUCCESS;
 }
 
-/**
- * Extracts a CPIO section to the dest directory.
- *
- * @param headerp
- *  Pointer to the CPIO header, on success gets advanced to next section.
- * @param fullpath
- *  Buffer containing the destination path to extract the current header to.
- * @param eof
- *  Pointer to the first byte after end of file.
- * @param prefixlen
- *  Length of the destination path already present in fullpath.
- * @return
- *  Returns 0 on success or one of ukcpio_error enum.
- */
+enum cpio_stream_state {
+	CPIO_STREAM_HEADER,	/* Collecting the header */
+	CPIO_STREAM_NAME,	/* Collecting the file name */
+	CPIO_STREAM_DATA,	/* Consuming the contents */
+	CPIO_STREAM_DONE	/* Trailer reached */
+};
+
+struct ukcpio_stream {
+	enum cpio_stream_state state;
+	/* Bytes to consume in the current state, after skipping padding */
+	size_t need;
+	size_t skip;
+	/* Archive offset, for messages */
+	size_t off;
+	enum ukcpio_error error;
+
+	/* Current section */
+	struct cpio_header header;
+	uint32_t mode;
+	uint32_t mtime;
+	uint32_t filesize;
+	uint32_t namesize;
+	int fd;
+
+	/* Destination directory, followed by the name of the section */
+	size_t prefixlen;
+	char path[PATH_MAX];
+	/* Symlink target */
+	char target[PATH_MAX];
+};
+
+/* Padding after `len` bytes, sections are 4-byte aligned */
+#define CPIO_PAD(len)	(ALIGN_UP((len), 4) - (len))
+
 static enum ukcpio_error
-process_section(const struct cpio_header **headerp, char *fullpath,
-		const char *eof, size_t prefixlen)
+stream_section_end(struct ukcpio_stream *s)
 {
-	const struct cpio_header *header = *headerp;
+	enum ukcpio_error err = UKCPIO_SUCCESS;
 
-	if (unlikely((char *)header >= eof || CPIO_FILENAME(header) > eof)) {
-		uk_pr_err("Truncated CPIO header at %p", header);
-		return -UKCPIO_INVALID_HEADER;
-	}
-	if (unlikely(!valid_magic(header))) {
-		uk_pr_err("Bad magic number in CPIO header at %p\n", header);
-		return -UKCPIO_INVALID_HEADER;
+	if (s->fd >= 0) {
+		err = file_close(s->path, s->fd, s->mode & 0777, s->mtime);
+		s->fd = -1;
+	} else if (IS_SYMLINK(s->mode)) {
+		err = extract_symlink(s->path, s->target, s->filesize);
 	}
 
-	if (CPIO_ISLAST(header)) {
-		*headerp = NULL;
+	s->state = CPIO_STREAM_HEADER;
+	s->need = sizeof(struct cpio_header);
+	s->skip += CPIO_PAD(s->filesize);
+	return err;
+}
+
+static enum ukcpio_error
+stream_section_begin(struct ukcpio_stream *s)
+{
+	const char *fname = s->path + s->prefixlen;
+	enum ukcpio_error err = UKCPIO_SUCCESS;
+	int fd;
+
+	/* namesize includes trailing NUL */
+	s->path[s->prefixlen + s->namesize - 1] = 0;
+	s->skip = CPIO_PAD(sizeof(struct cpio_header) + s->namesize);
+
+	if (strcmp(fname, "TRAILER!!!") == 0) {
+		s->state = CPIO_STREAM_DONE;
 		return UKCPIO_SUCCESS;
-	} else {
-		uint32_t mode = CPIO_U32FIELD(header->mode);
-		uint32_t filesize = CPIO_U32FIELD(header->filesize);
-		uint32_t namesize = CPIO_U32FIELD(header->namesize);
-		uint32_t mtime = CPIO_U32FIELD(header->mtime);
-		const char *fname = CPIO_FILENAME(header);
-		const char *data = CPIO_DATA(header, namesize);
-		enum ukcpio_error err;
-
-		if (unlikely(fname + namesize > eof)) {
-			uk_pr_err("File name exceeds archive bounds at %p\n",
-				  header);
-			return -UKCPIO_MALFORMED_INPUT;
-		}
-		if (unlikely(data + filesize > eof)) {
-			uk_pr_err("File exceeds archive bounds: %s\n", fname);
-			return -UKCPIO_MALFORMED_INPUT;
-		}
+	}
 
-		/* namesize includes trailing NUL */
-		if (unlikely(prefixlen + namesize > PATH_MAX)) {
-			uk_pr_err("Resulting path too long: %s\n", fname);
+	/* Skip "." as dest is already there */
+	if (IS_DIR(s->mode) && strcmp(".", fname)) {
+		err = extract_dir(s->path, s->mode & 0777);
+	} else if (IS_FILE(s->mode)) {
+		fd = file_create(s->path, s->filesize);
+		if (fd < 0)
+			return fd;
+		s->fd = fd;
+	} else if (IS_SYMLINK(s->mode)) {
+		if (unlikely(s->filesize >= PATH_MAX)) {
+			uk_pr_err("Symlink target too long: %s\n", s->path);
 			return -UKCPIO_MALFORMED_INPUT;
 		}
-		memcpy(fullpath + prefixlen, fname, namesize);
-
-		err = UKCPIO_SUCCESS;
-
-		/* Skip "." as dest is already there */
-		if (IS_DIR(mode) && strcmp(".", fname)) {
-			err = extract_dir(fullpath, mode & 0777);
-		} else if (IS_FILE(mode)) {
-			err = extract_file(fullpath, data, filesize,
-					   mode & 0777, mtime);
-		} else if (IS_SYMLINK(mode)) {
-			err = extract_symlink(fullpath, data, filesize);
-		} else {
-			uk_pr_warn("File %s unknown mode %o\n", fullpath, mode);
-		}
-
-		*headerp = CPIO_NEXT(header, namesize, filesize);
+	} else if (!IS_DIR(s->mode)) {
+		uk_pr_warn("File %s unknown mode %o\n", s->path, s->mode);
+	}
+	if (err)
 		return err;
+
+	s->state = CPIO_STREAM_DATA;
+	s->need = s->filesize;
+	if (!s->need)
+		return stream_section_end(s);
+	return UKCPIO_SUCCESS;
+}
+
+static enum ukcpio_error
+stream_header_end(struct ukcpio_stream *s)
+{
+	if (unlikely(!valid_magic(&s->header))) {
+		uk_pr_err("Bad magic number in CPIO header at offset %zu\n",
+			  s->off - sizeof(struct cpio_header));
+		return -UKCPIO_INVALID_HEADER;
+	}
+
+	s->mode = CPIO_U32FIELD(s->header.mode);
+	s->filesize = CPIO_U32FIELD(s->header.filesize);
+	s->namesize = CPIO_U32FIELD(s->header.namesize);
+	s->mtime = CPIO_U32FIELD(s->header.mtime);
+
+	if (unlikely(s->namesize == 0 ||
+		     s->prefixlen + s->namesize > PATH_MAX)) {
+		uk_pr_err("Invalid file name size at offset %zu\n",
+			  s->off - sizeof(struct cpio_header));
+		return -UKCPIO_MALFORMED_INPUT;
 	}
+
+	s->state = CPIO_STREAM_NAME;
+	s->need = s->namesize;
+	return UKCPIO_SUCCESS;
 }
 
 enum ukcpio_error
-ukcpio_extract(const char *dest, const void *buf, size_t buflen)
+ukcpio_stream_feed(struct ukcpio_stream *s, const void *buf, size_t len)
+{
+	const char *p = buf;
+	size_t n;
+
+	while (len && !s->error && s->state != CPIO_STREAM_DONE) {
+		if (s->skip) {
+			n = MIN(s->skip, len);
+			s->skip -= n;
+		} else {
+			n = MIN(s->need, len);
+			switch (s->state) {
+			case CPIO_STREAM_HEADER:
+				memcpy((char *)&s->header +
+				       sizeof(struct cpio_header) - s->need,
+				       p, n);
+				break;
+			case CPIO_STREAM_NAME:
+				memcpy(s->path + s->prefixlen +
+				       s->namesize - s->need, p, n);
+				break;
+			case CPIO_STREAM_DATA:
+				if (s->fd >= 0)
+					s->error = file_write(s->path, s->fd,
+							      p, n);
+				else if (IS_SYMLINK(s->mode))
+					memcpy(s->target + s->filesize -
+					       s->need, p, n);
+				break;
+			default:
+				UK_BUG();
+			}
+			s->need -= n;
+		}
+		p += n;
+		len -= n;
+		s->off += n;
+
+		if (s->skip || s->need || s->error)
+			continue;
+
+		switch (s->state) {
+		case CPIO_STREAM_HEADER:
+			s->error = stream_header_end(s);
+			break;
+		case CPIO_STREAM_NAME:
+			s->error = stream_section_begin(s);
+			break;
+		case CPIO_STREAM_DATA:
+			s->error = stream_section_end(s);
+			break;
+		default:
+			UK_BUG();
+		}
+	}
+	return s->error;
+}
+
+int ukcpio_stream_done(struct ukcpio_stream *s)
 {
-	enum ukcpio_error error = UKCPIO_SUCCESS;
-	const struct cpio_header *header = (struct cpio_header *)(buf);
-	char pathbuf[PATH_MAX];
+	return s->state == CPIO_STREAM_DONE || s->error;
+}
+
+struct ukcpio_stream *
+ukcpio_stream_create(const char *dest, enum ukcpio_error *err)
+{
+	struct ukcpio_stream *s;
 	size_t destlen;
 
-	if (unlikely(dest == NULL))
-		return -UKCPIO_NODEST;
+	UK_ASSERT(err);
+
+	if (unlikely(dest == NULL)) {
+		*err = -UKCPIO_NODEST;
+		return NULL;
+	}
+
+	s = malloc(sizeof(*s));
+	if (unlikely(!s)) {
+		*err = -UKCPIO_NOMEM;
+		return NULL;
+	}
 
-	if (unlikely((destlen = strlcpy(pathbuf, dest, PATH_MAX)) > PATH_MAX - 1))
-		return -UKCPIO_NODEST;
-	if (pathbuf[destlen-1] != '/') {
-		pathbuf[destlen++] = '/';
-		pathbuf[destlen] = 0;
+	destlen = strlcpy(s->path, dest, PATH_MAX);
+	if (unlikely(destlen > PATH_MAX - 1)) {
+		free(s);
+		*err = -UKCPIO_NODEST;
+		return NULL;
 	}
+	if (s->path[destlen-1] != '/') {
+		s->path[destlen++] = '/';
+		s->path[destlen] = 0;
+	}
+
+	s->state = CPIO_STREAM_HEADER;
+	s->need = sizeof(struct cpio_header);
+	s->skip = 0;
+	s->off = 0;
+	s->error = UKCPIO_SUCCESS;
+	s->mode = 0;
+	s->fd = -1;
+	s->prefixlen = destlen;
+	*err = UKCPIO_SUCCESS;
+	return s;
+}
+
+enum ukcpio_error
+ukcpio_stream_destroy(struct ukcpio_stream *s)
+{
+	enum ukcpio_error err = s->error;
 
-	while (header && error == UKCPIO_SUCCESS) {
-		error = process_section(&header, pathbuf,
-					(char *)header + buflen, destlen);
+	if (!err && s->state != CPIO_STREAM_DONE) {
+		uk_pr_err("Truncated CPIO archive at offset %zu\n", s->off);
+		err = -UKCPIO_INVALID_HEADER;
 	}
-	return error;
+	if (s->fd >= 0)
+		uk_syscall_r_close(s->fd);
+	free(s);
+	return err;
+}
+
+enum ukcpio_error
+ukcpio_extract(const char *dest, const void *buf, size_t buflen)
+{
+	struct ukcpio_stream *s;
+	enum ukcpio_error error, rc;
+
+	s = ukcpio_stream_create(dest, &error);
+	if (unlikely(!s))
+		return error;
+
+#if CONFIG_LIBUKCPIO_LZ4
+	if (ukcpio_lz4_probe(buf, buflen))
+		error = ukcpio_lz4_extract(s, buf, buflen);
+	else
+#endif /* CONFIG_LIBUKCPIO_LZ4 */
+		error = ukcpio_stream_feed(s, buf, buflen);
+
+	rc = ukcpio_stream_destroy(s);
+	return error ? error : rc;
 }
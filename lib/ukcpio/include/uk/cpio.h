@@ -53,7 +53,9 @@ enum ukcpio_error {
 	UKCPIO_MKDIR_FAILED,
 	UKCPIO_SYMLINK_FAILED,
 	UKCPIO_MALFORMED_INPUT,
-	UKCPIO_NODEST
+	UKCPIO_NODEST,
+	UKCPIO_NOMEM,
+	UKCPIO_DECOMPRESS_FAILED
 };
 
 /**
@@ -62,7 +64,9 @@ enum ukcpio_error {
  * @param dest
  *  The path location where the buffer will be extracted to.
  * @param buf
- *  A pointer to the first header of the CPIO buffer.
+ *  A pointer to the first header of the CPIO buffer. With
+ *  CONFIG_LIBUKCPIO_LZ4, the buffer may also contain LZ4 frames of the
+ *  archive, which are decompressed while the archive is extracted.
  * @param buflen
  *  The size of the CPIO buffer.
  * @return
@@ -0,0 +1,481 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * LZ4 frame decompression (https://github.com/lz4/lz4/tree/dev/doc)
+ *
+ * Supports the LZ4 frame format, the legacy frame format that is used for
+ * Linux initramfs images (`lz4 -l`), and skippable frames. Checksums are not
+ * verified. Blocks are decompressed one after another and fed to the
+ * extraction, so only one block (or one batch of blocks) is present in
+ * decompressed form at a time. With CONFIG_LIBUKCPIO_LZ4_PARALLEL,
+ * independent blocks are decompressed in batches by the workers of the
+ * other logical CPUs.
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+#include <uk/assert.h>
+#include <uk/essentials.h>
+#include <uk/print.h>
+#if CONFIG_LIBUKCPIO_LZ4_PARALLEL
+#include <uk/plat/lcpu.h>
+#include <uk/workq.h>
+#endif /* CONFIG_LIBUKCPIO_LZ4_PARALLEL */
+
+#include "stream.h"
+
+#define LZ4_MAGIC		0x184D2204
+#define LZ4_LEGACY_MAGIC	0x184C2102
+#define LZ4_SKIPPABLE_MAGIC	0x184D2A50
+#define LZ4_SKIPPABLE_MASK	0xFFFFFFF0
+
+/* Frame descriptor */
+#define LZ4_FLG_VERSION_MASK	0xC0
+#define LZ4_FLG_VERSION		0x40
+#define LZ4_FLG_BLOCK_INDEP	0x20
+#define LZ4_FLG_BLOCK_CSUM	0x10
+#define LZ4_FLG_CONTENT_SIZE	0x08
+#define LZ4_FLG_CONTENT_CSUM	0x04
+#define LZ4_FLG_DICT_ID		0x01
+#define LZ4_BD_BLOCK_MAX(bd)	(1UL << (8 + 2 * (((bd) >> 4) & 0x7)))
+
+#define LZ4_BLOCK_UNCOMPRESSED	0x80000000
+#define LZ4_LEGACY_BLOCK_MAX	(8UL << 20)
+/* Distance that matches can reach back into previous blocks */
+#define LZ4_WINDOW_SIZE		(64UL << 10)
+
+#if CONFIG_LIBUKCPIO_LZ4_PARALLEL
+#define LZ4_MAX_JOBS		CONFIG_LIBUKCPIO_LZ4_MAX_JOBS
+#else /* !CONFIG_LIBUKCPIO_LZ4_PARALLEL */
+#define LZ4_MAX_JOBS		1
+#endif /* !CONFIG_LIBUKCPIO_LZ4_PARALLEL */
+
+static inline uint32_t lz4_le32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+	       ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**
+ * Decompresses an LZ4 block
+ *
+ * @param dictlen
+ *  Number of bytes of earlier output that precede `dst` and that matches
+ *  may refer to
+ * @return
+ *  Decompressed size, or -1 if the block is corrupted or does not fit
+ */
+static ssize_t lz4_block_decode(const uint8_t *src, size_t srclen,
+				uint8_t *dst, size_t dstlen, size_t dictlen)
+{
+	const uint8_t *ip = src, *iend = src + srclen;
+	uint8_t *op = dst, *oend = dst + dstlen;
+	size_t len, off;
+	unsigned int token;
+	uint8_t *match;
+	uint8_t b;
+
+	while (ip < iend) {
+		token = *ip++;
+
+		/* Literals */
+		len = token >> 4;
+		if (len == 15) {
+			do {
+				if (unlikely(ip >= iend))
+					return -1;
+				b = *ip++;
+				len += b;
+			} while (b == 255);
+		}
+		if (unlikely(len > (size_t)(iend - ip) ||
+			     len > (size_t)(oend - op)))
+			return -1;
+		memcpy(op, ip, len);
+		op += len;
+		ip += len;
+
+		/* The last sequence consists of literals only */
+		if (ip == iend)
+			break;
+
+		/* Match */
+		if (unlikely(iend - ip < 2))
+			return -1;
+		off = ip[0] | ((size_t)ip[1] << 8);
+		ip += 2;
+		if (unlikely(off == 0 || off > (size_t)(op - dst) + dictlen))
+			return -1;
+
+		len = token & 0xf;
+		if (len == 15) {
+			do {
+				if (unlikely(ip >= iend))
+					return -1;
+				b = *ip++;
+				len += b;
+			} while (b == 255);
+		}
+		len += 4;
+		if (unlikely(len > (size_t)(oend - op)))
+			return -1;
+
+		match = op - off;
+		if (off >= len) {
+			memcpy(op, match, len);
+			op += len;
+		} else {
+			/* Overlapping copy repeats the last `off` bytes */
+			while (len--)
+				*op++ = *match++;
+		}
+	}
+	return op - dst;
+}
+
+struct lz4_block {
+	const uint8_t *src;
+	size_t srclen;
+	int compressed;
+	/* Output */
+	uint8_t *dst;
+	size_t dstlen;
+	ssize_t len;
+#if CONFIG_LIBUKCPIO_LZ4_PARALLEL
+	struct uk_work work;
+#endif /* CONFIG_LIBUKCPIO_LZ4_PARALLEL */
+};
+
+struct lz4_dec {
+	struct ukcpio_stream *s;
+	size_t block_max;
+	int independent;
+
+	/* Dependent blocks: window of earlier output, followed by the block */
+	uint8_t *window;
+	size_t window_len;
+
+	/* Independent blocks: batch of blocks decoded in parallel */
+	struct lz4_block blocks[LZ4_MAX_JOBS];
+	uint8_t *bufs[LZ4_MAX_JOBS];
+	unsigned int nbufs;
+	unsigned int nblocks;
+};
+
+static void lz4_block_run(struct lz4_block *blk)
+{
+	blk->len = lz4_block_decode(blk->src, blk->srclen,
+				    blk->dst, blk->dstlen, 0);
+}
+
+#if CONFIG_LIBUKCPIO_LZ4_PARALLEL
+static void lz4_block_work(struct uk_work *work)
+{
+	lz4_block_run(__containerof(work, struct lz4_block, work));
+}
+#endif /* CONFIG_LIBUKCPIO_LZ4_PARALLEL */
+
+static enum ukcpio_error lz4_feed(struct lz4_dec *d, const void *buf,
+				  ssize_t len)
+{
+	if (unlikely(len < 0)) {
+		uk_pr_err("Corrupted LZ4 block\n");
+		return -UKCPIO_DECOMPRESS_FAILED;
+	}
+	return ukcpio_stream_feed(d->s, buf, len);
+}
+
+/* Decompresses and extracts the queued independent blocks in order */
+static enum ukcpio_error lz4_flush(struct lz4_dec *d)
+{
+	enum ukcpio_error err = UKCPIO_SUCCESS;
+	struct lz4_block *blk;
+	unsigned int i;
+#if CONFIG_LIBUKCPIO_LZ4_PARALLEL
+	__lcpuidx self = ukplat_lcpu_idx();
+	__lcpuidx ncpu = ukplat_lcpu_count();
+
+	/* Block 0 is decoded here, the others by the workers of the other
+	 * CPUs while this CPU extracts the blocks before them
+	 */
+	for (i = 1; i < d->nblocks; i++) {
+		blk = &d->blocks[i];
+		if (!blk->compressed)
+			continue;
+		uk_work_init(&blk->work, lz4_block_work);
+		uk_work_queue_on((self + i) % ncpu, &blk->work);
+	}
+#endif /* CONFIG_LIBUKCPIO_LZ4_PARALLEL */
+
+	for (i = 0; i < d->nblocks; i++) {
+		blk = &d->blocks[i];
+		if (!blk->compressed) {
+			/* Extracted directly from the input */
+			if (!err)
+				err = lz4_feed(d, blk->src, blk->srclen);
+			continue;
+		}
+#if CONFIG_LIBUKCPIO_LZ4_PARALLEL
+		if (i > 0)
+			uk_work_wait(&blk->work);
+		else
+#endif /* CONFIG_LIBUKCPIO_LZ4_PARALLEL */
+			lz4_block_run(blk);
+		/* Waits for all jobs also on error, they use our buffers */
+		if (!err)
+			err = lz4_feed(d, blk->dst, blk->len);
+	}
+
+	d->nblocks = 0;
+	return err;
+}
+
+static enum ukcpio_error lz4_block(struct lz4_dec *d, const uint8_t *src,
+				   size_t srclen, int compressed)
+{
+	enum ukcpio_error err;
+	struct lz4_block *blk;
+	uint8_t *dst;
+	ssize_t len;
+
+	if (!d->independent) {
+		dst = d->window + d->window_len;
+		if (!compressed) {
+			len = -1;
+			if (likely(srclen <= d->block_max)) {
+				memcpy(dst, src, srclen);
+				len = srclen;
+			}
+		} else {
+			len = lz4_block_decode(src, srclen, dst, d->block_max,
+					       d->window_len);
+		}
+		err = lz4_feed(d, dst, len);
+		if (unlikely(err))
+			return err;
+
+		/* Keep the end of the output for the matches of the next
+		 * block
+		 */
+		d->window_len += len;
+		if (d->window_len > LZ4_WINDOW_SIZE) {
+			memmove(d->window, d->window + d->window_len -
+				LZ4_WINDOW_SIZE, LZ4_WINDOW_SIZE);
+			d->window_len = LZ4_WINDOW_SIZE;
+		}
+		return UKCPIO_SUCCESS;
+	}
+
+	blk = &d->blocks[d->nblocks];
+	blk->src = src;
+	blk->srclen = srclen;
+	blk->compressed = compressed;
+	blk->dst = d->bufs[d->nblocks];
+	blk->dstlen = d->block_max;
+	blk->len = -1;
+	if (!compressed && unlikely(srclen > d->block_max))
+		return lz4_feed(d, NULL, -1);
+
+	if (++d->nblocks < d->nbufs)
+		return UKCPIO_SUCCESS;
+	return lz4_flush(d);
+}
+
+static void lz4_dec_free(struct lz4_dec *d)
+{
+	unsigned int i;
+
+	free(d->window);
+	d->window = NULL;
+	for (i = 0; i < d->nbufs; i++) {
+		free(d->bufs[i]);
+		d->bufs[i] = NULL;
+	}
+	d->nbufs = 0;
+}
+
+static enum ukcpio_error lz4_dec_init(struct lz4_dec *d, size_t block_max,
+				      int independent)
+{
+	unsigned int jobs = 1;
+
+	lz4_dec_free(d);
+	d->block_max = block_max;
+	d->independent = independent;
+	d->nblocks = 0;
+
+	if (!independent) {
+		d->window_len = 0;
+		d->window = malloc(LZ4_WINDOW_SIZE + block_max);
+		if (unlikely(!d->window))
+			goto err_nomem;
+		return UKCPIO_SUCCESS;
+	}
+
+#if CONFIG_LIBUKCPIO_LZ4_PARALLEL
+	jobs = MIN((unsigned int)ukplat_lcpu_count(),
+		   (unsigned int)LZ4_MAX_JOBS);
+#endif /* CONFIG_LIBUKCPIO_LZ4_PARALLEL */
+	for (d->nbufs = 0; d->nbufs < jobs; d->nbufs++) {
+		d->bufs[d->nbufs] = malloc(block_max);
+		if (unlikely(!d->bufs[d->nbufs])) {
+			/* Continue with fewer jobs */
+			if (d->nbufs)
+				break;
+			goto err_nomem;
+		}
+	}
+	return UKCPIO_SUCCESS;
+
+err_nomem:
+	uk_pr_err("Not enough memory to decompress LZ4 blocks of %zu bytes\n",
+		  block_max);
+	return -UKCPIO_NOMEM;
+}
+
+/* Decompresses the frame that starts at `*pp` and advances `*pp` past it */
+static enum ukcpio_error lz4_frame(struct lz4_dec *d, const uint8_t **pp,
+				   const uint8_t *end)
+{
+	const uint8_t *p = *pp + 4;
+	enum ukcpio_error err;
+	uint32_t size;
+	uint8_t flg, bd;
+
+	if (unlikely(end - p < 3))
+		goto err_truncated;
+	flg = p[0];
+	bd = p[1];
+	if (unlikely((flg & LZ4_FLG_VERSION_MASK) != LZ4_FLG_VERSION ||
+		     ((bd >> 4) & 0x7) < 4)) {
+		uk_pr_err("Unsupported LZ4 frame descriptor\n");
+		return -UKCPIO_DECOMPRESS_FAILED;
+	}
+	if (unlikely(flg & LZ4_FLG_DICT_ID)) {
+		uk_pr_err("LZ4 frames with dictionary are not supported\n");
+		return -UKCPIO_DECOMPRESS_FAILED;
+	}
+	/* Descriptor, optional content size, and header checksum */
+	p += 2 + ((flg & LZ4_FLG_CONTENT_SIZE) ? 8 : 0) + 1;
+
+	err = lz4_dec_init(d, LZ4_BD_BLOCK_MAX(bd),
+			   !!(flg & LZ4_FLG_BLOCK_INDEP));
+	if (unlikely(err))
+		return err;
+
+	for (;;) {
+		if (unlikely(p > end || end - p < 4))
+			goto err_truncated;
+		size = lz4_le32(p);
+		p += 4;
+		if (size == 0)
+			break;
+
+		if (unlikely((size_t)(end - p) <
+			     (size & ~LZ4_BLOCK_UNCOMPRESSED)))
+			goto err_truncated;
+		err = lz4_block(d, p, size & ~LZ4_BLOCK_UNCOMPRESSED,
+				!(size & LZ4_BLOCK_UNCOMPRESSED));
+		if (unlikely(err))
+			return err;
+		p += size & ~LZ4_BLOCK_UNCOMPRESSED;
+		if (flg & LZ4_FLG_BLOCK_CSUM)
+			p += 4;
+
+		if (ukcpio_stream_done(d->s))
+			break;
+	}
+	if (flg & LZ4_FLG_CONTENT_CSUM)
+		p += 4;
+
+	*pp = MIN(p, end);
+	return lz4_flush(d);
+
+err_truncated:
+	uk_pr_err("Truncated LZ4 frame\n");
+	return -UKCPIO_DECOMPRESS_FAILED;
+}
+
+/* Decompresses a legacy frame, which ends at the end of the input or at the
+ * next magic number
+ */
+static enum ukcpio_error lz4_legacy_frame(struct lz4_dec *d,
+					  const uint8_t **pp,
+					  const uint8_t *end)
+{
+	const uint8_t *p = *pp + 4;
+	enum ukcpio_error err;
+	uint32_t size;
+
+	err = lz4_dec_init(d, LZ4_LEGACY_BLOCK_MAX, 1);
+	if (unlikely(err))
+		return err;
+
+	while (end - p >= 4 && !ukcpio_stream_done(d->s)) {
+		size = lz4_le32(p);
+		if (size == LZ4_MAGIC || size == LZ4_LEGACY_MAGIC ||
+		    (size & LZ4_SKIPPABLE_MASK) == LZ4_SKIPPABLE_MAGIC)
+			break;
+		p += 4;
+		if (unlikely((size_t)(end - p) < size)) {
+			uk_pr_err("Truncated LZ4 frame\n");
+			return -UKCPIO_DECOMPRESS_FAILED;
+		}
+		err = lz4_block(d, p, size, 1);
+		if (unlikely(err))
+			return err;
+		p += size;
+	}
+
+	*pp = p;
+	return lz4_flush(d);
+}
+
+int ukcpio_lz4_probe(const void *buf, size_t len)
+{
+	uint32_t magic;
+
+	if (len < 4)
+		return 0;
+	magic = lz4_le32(buf);
+	return magic == LZ4_MAGIC || magic == LZ4_LEGACY_MAGIC;
+}
+
+enum ukcpio_error ukcpio_lz4_extract(struct ukcpio_stream *s,
+				     const void *buf, size_t len)
+{
+	const uint8_t *p = buf, *end = p + len;
+	enum ukcpio_error err = UKCPIO_SUCCESS;
+	struct lz4_dec d = { .s = s };
+	uint32_t magic;
+
+	UK_ASSERT(s);
+
+	while (!err && end - p >= 4 && !ukcpio_stream_done(s)) {
+		magic = lz4_le32(p);
+		if (magic == LZ4_MAGIC) {
+			err = lz4_frame(&d, &p, end);
+		} else if (magic == LZ4_LEGACY_MAGIC) {
+			err = lz4_legacy_frame(&d, &p, end);
+		} else if ((magic & LZ4_SKIPPABLE_MASK) ==
+			   LZ4_SKIPPABLE_MAGIC) {
+			if (unlikely(end - p < 8))
+				break;
+			p += 8 + MIN((size_t)lz4_le32(p + 4),
+				     (size_t)(end - p - 8));
+		} else {
+			/* E.g., zero padding of the initrd */
+			break;
+		}
+	}
+
+	lz4_dec_free(&d);
+	return err;
+}
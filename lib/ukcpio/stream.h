@@ -0,0 +1,56 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __UKCPIO_STREAM_H__
+#define __UKCPIO_STREAM_H__
+
+#include <stddef.h>
+#include <uk/config.h>
+#include <uk/cpio.h>
+
+/*
+ * Streaming extraction
+ *
+ * The archive is fed in chunks of arbitrary size, so that it never has to be
+ * present as a whole, e.g., while it is decompressed. File contents are
+ * written directly from the chunks.
+ */
+
+struct ukcpio_stream;
+
+struct ukcpio_stream *ukcpio_stream_create(const char *dest,
+					   enum ukcpio_error *err);
+
+/**
+ * Extracts the next chunk of the archive. Data after the trailer is ignored.
+ *
+ * @return
+ *  0 on success or one of ukcpio_error enums. The error is sticky.
+ */
+enum ukcpio_error ukcpio_stream_feed(struct ukcpio_stream *s,
+				     const void *buf, size_t len);
+
+/* Tells if the trailer of the archive was reached */
+int ukcpio_stream_done(struct ukcpio_stream *s);
+
+/**
+ * Releases the stream
+ *
+ * @return
+ *  0 if the whole archive was extracted or one of ukcpio_error enums
+ */
+enum ukcpio_error ukcpio_stream_destroy(struct ukcpio_stream *s);
+
+#if CONFIG_LIBUKCPIO_LZ4
+/* Tells if `buf` starts with an LZ4 frame */
+int ukcpio_lz4_probe(const void *buf, size_t len);
+
+/* Decompresses LZ4 frames from `buf` into a stream */
+enum ukcpio_error ukcpio_lz4_extract(struct ukcpio_stream *s,
+				     const void *buf, size_t len);
+#endif /* CONFIG_LIBUKCPIO_LZ4 */
+
+#endif /* __UKCPIO_STREAM_H__ */
@@ -213,6 +213,16 @@ static inline void uk_printk_once(int lvl __unused,
 {}
 #endif /* CONFIG_LIBUKDEBUG_PRINTK */
 
+#if CONFIG_LIBUKDEBUG_PRINTK_ASYNC
+/**
+ * Writes the kernel messages that are still buffered to the console
+ */
+void uk_printk_flush(void);
+#else /* !CONFIG_LIBUKDEBUG_PRINTK_ASYNC */
+static inline void uk_printk_flush(void)
+{}
+#endif /* !CONFIG_LIBUKDEBUG_PRINTK_ASYNC */
+
 /*
  * Convenience wrapper for uk_printk() and uk_printd()
  * This is similar to the pr_* variants that you find in the Linux kernel
@@ -32,6 +32,7 @@
 
 #ifndef _UK_TRACE_H_
 #define _UK_TRACE_H_
+#include <uk/config.h>
 #include <uk/essentials.h>
 #include <stdint.h>
 #include <stddef.h>
@@ -48,6 +49,7 @@
 #define __UK_TRACE_MAX_STRLEN 80
 #define UK_TP_HEADER_MAGIC 0x64685254 /* TRhd */
 #define UK_TP_DEF_MAGIC 0x65645054 /* TPde */
+#define UK_TP_PAD_MAGIC 0x64615054 /* TPad */
 
 enum __uk_trace_arg_type {
 	__UK_TRACE_ARG_INT = 0,
@@ -56,14 +58,90 @@ enum __uk_trace_arg_type {
 
 struct uk_tracepoint_header {
 	uint32_t magic;
+	/* Size of the event after the header */
 	uint32_t size;
 	__nsec time;
 	void *cookie;
 };
 
-extern size_t uk_trace_buffer_free;
-extern char *uk_trace_buffer_writep;
+/* Each lcpu writes its events to a buffer of its own. The buffer is divided
+ * into chunks and an event never crosses the end of a chunk, so that the
+ * oldest chunk of a wrapped buffer always starts with an event. The rest of a
+ * chunk that is too short for an event starts with a padding header if it
+ * can hold one. Events with up to 7 arguments are always smaller than a
+ * chunk.
+ */
+#define UK_TRACE_CHUNK_SIZE 1024
+#define UK_TRACE_ALIGN 8
+
+struct __align64 uk_trace_lcpu {
+	/* Number of bytes ever reserved in the buffer */
+	uint64_t head;
+	/* Number of bytes sent by the trace stream */
+	uint64_t tail;
+	/* Number of events that were dropped because the buffer was full */
+	uint64_t lost;
+};
+
+#if CONFIG_LIBUKDEBUG_TRACEPOINTS
+UK_CTASSERT(CONFIG_LIBUKDEBUG_TRACE_BUFFER_SIZE % UK_TRACE_CHUNK_SIZE == 0);
+
+extern UKPLAT_PER_LCPU_DEFINE(struct uk_trace_lcpu, uk_trace_lcpu);
+extern UKPLAT_PER_LCPU_ARRAY_DEFINE(char, uk_trace_buffer,
+				    CONFIG_LIBUKDEBUG_TRACE_BUFFER_SIZE);
+#endif /* CONFIG_LIBUKDEBUG_TRACEPOINTS */
+
+#if CONFIG_LIBUKDEBUG_TRACE_STREAM
+#define UK_TRACE_STREAM_MAGIC 0x74735254 /* TRst */
+
+/* The trace stream is a sequence of frames. Each frame carries the events
+ * of one lcpu in the same format as in its trace buffer.
+ */
+struct uk_trace_stream_frame {
+	uint32_t magic;
+	/* Number of bytes of events following the frame header */
+	uint32_t size;
+	/* Offset of the first event in the buffer of the lcpu, counted from
+	 * the start of tracing. Events that are not sent are a gap in it.
+	 */
+	uint64_t pos;
+	/* Number of events the lcpu dropped so far */
+	uint64_t lost;
+	uint32_t lcpu;
+	uint32_t reserved;
+};
 
+/**
+ * Writes `len` bytes of the trace stream to the transport. Must only return
+ * once the transport does not access `buf` anymore.
+ *
+ * @return
+ *   0 on success, a negative errno value otherwise
+ */
+typedef int (*uk_trace_stream_write_t)(const void *buf, __sz len, void *arg);
+
+/**
+ * Starts a thread that periodically sends new events of all lcpus to a
+ * transport. There can only be one stream.
+ *
+ * @param write
+ *   Function writing to the transport
+ * @param arg
+ *   Argument passed to `write`
+ * @return
+ *   0 on success, a negative errno value otherwise
+ */
+int uk_trace_stream_start(uk_trace_stream_write_t write, void *arg);
+#endif /* CONFIG_LIBUKDEBUG_TRACE_STREAM */
+
+static inline size_t __uk_trace_arg_size(enum __uk_trace_arg_type type,
+					 int size, long arg)
+{
+	/* The '+1' is for storing length of the string */
+	if (type == __UK_TRACE_ARG_STRING)
+		return strnlen((char *) arg, __UK_TRACE_MAX_STRLEN) + 1;
+	return size;
+}
 
 static inline void __uk_trace_save_arg(char **pbuff,
 				      size_t *pfree,
@@ -77,16 +155,14 @@ static inline void __uk_trace_save_arg(char **pbuff,
 
 	if (type == __UK_TRACE_ARG_STRING) {
 		len = strnlen((char *) arg, __UK_TRACE_MAX_STRLEN);
-		/* The '+1' is for storing length of the string */
+		/* The string may have grown since the event was sized */
+		if ((size_t) len + 1 > free)
+			len = free ? free - 1 : 0;
 		size = len + 1;
 	}
 
-	if (free < (size_t) size) {
-		/* Block the next invocations of trace points */
-		*pfree = 0;
-		uk_trace_buffer_free = 0;
+	if (free < (size_t) size)
 		return;
-	}
 
 	switch (type) {
 	case __UK_TRACE_ARG_INT:
@@ -117,6 +193,20 @@ static inline void __uk_trace_save_arg(char **pbuff,
 		sizeof(arg),				\
 		(long) arg)
 
+#define __UK_TRACE_SIZE_ONE(arg) + __uk_trace_arg_size(	\
+		__UK_TRACE_GET_TYPE(arg),			\
+		sizeof(arg),					\
+		(long) arg)
+
+#define __UK_TRACE_SIZE_ARGS0()
+#define __UK_TRACE_SIZE_ARGS1() __UK_TRACE_SIZE_ONE(arg1)
+#define __UK_TRACE_SIZE_ARGS2() __UK_TRACE_SIZE_ARGS1() __UK_TRACE_SIZE_ONE(arg2)
+#define __UK_TRACE_SIZE_ARGS3() __UK_TRACE_SIZE_ARGS2() __UK_TRACE_SIZE_ONE(arg3)
+#define __UK_TRACE_SIZE_ARGS4() __UK_TRACE_SIZE_ARGS3() __UK_TRACE_SIZE_ONE(arg4)
+#define __UK_TRACE_SIZE_ARGS5() __UK_TRACE_SIZE_ARGS4() __UK_TRACE_SIZE_ONE(arg5)
+#define __UK_TRACE_SIZE_ARGS6() __UK_TRACE_SIZE_ARGS5() __UK_TRACE_SIZE_ONE(arg6)
+#define __UK_TRACE_SIZE_ARGS7() __UK_TRACE_SIZE_ARGS6() __UK_TRACE_SIZE_ONE(arg7)
+
 #define __UK_TRACE_SAVE_ARGS0()
 #define __UK_TRACE_SAVE_ARGS1() __UK_TRACE_SAVE_ONE(arg1)
 #define __UK_TRACE_SAVE_ARGS2() __UK_TRACE_SAVE_ARGS1(); __UK_TRACE_SAVE_ONE(arg2)
@@ -196,53 +286,67 @@ static inline void __uk_trace_save_arg(char **pbuff,
 		__UK_TRACE_ARG_TYPES(NR, __VA_ARGS__),		\
 		#trace_name, fmt }
 
-static inline char *__uk_trace_get_buff(size_t *free)
+#if CONFIG_LIBUKDEBUG_TRACEPOINTS
+/* Reserves `size` bytes for an event in the buffer of the current lcpu.
+ * Writers do not lock: a compare-and-swap on the head of the buffer gives
+ * each event its own space, even if a tracepoint interrupts another one or
+ * the thread migrates to another lcpu meanwhile.
+ */
+static inline struct uk_tracepoint_header *__uk_trace_reserve(size_t size)
 {
-	struct uk_tracepoint_header *ret;
-
-	if (uk_trace_buffer_free < sizeof(*ret))
-		return 0;
-	ret = (struct uk_tracepoint_header *) uk_trace_buffer_writep;
+	__lcpuidx idx = ukplat_lcpu_idx();
+	struct uk_trace_lcpu *tl = &ukplat_per_lcpu(uk_trace_lcpu, idx);
+	struct uk_tracepoint_header *head;
+	uint64_t old, start;
+	size_t left;
+
+	size = ALIGN_UP(size, UK_TRACE_ALIGN);
+	old = __atomic_load_n(&tl->head, __ATOMIC_RELAXED);
+	do {
+		left = UK_TRACE_CHUNK_SIZE - (old % UK_TRACE_CHUNK_SIZE);
+		start = (size > left) ? old + left : old;
+#if CONFIG_LIBUKDEBUG_TRACE_STOP
+		/* Do not overwrite events that were not streamed out yet */
+		if (start + size >
+		    __atomic_load_n(&tl->tail, __ATOMIC_ACQUIRE) +
+		    CONFIG_LIBUKDEBUG_TRACE_BUFFER_SIZE) {
+			__atomic_add_fetch(&tl->lost, 1, __ATOMIC_RELAXED);
+			return __NULL;
+		}
+#endif /* CONFIG_LIBUKDEBUG_TRACE_STOP */
+	} while (!__atomic_compare_exchange_n(&tl->head, &old, start + size,
+					      0, __ATOMIC_RELAXED,
+					      __ATOMIC_RELAXED));
+
+	if (start != old && left >= sizeof(*head)) {
+		head = (struct uk_tracepoint_header *)
+			&ukplat_per_lcpu_array(uk_trace_buffer, idx,
+				old % CONFIG_LIBUKDEBUG_TRACE_BUFFER_SIZE);
+		head->size = left - sizeof(*head);
+		__atomic_store_n(&head->magic, UK_TP_PAD_MAGIC,
+				 __ATOMIC_RELEASE);
+	}
 
-	/* In case we fail to fill the tracepoint for any reason, make
-	 * sure we do not confuse parser. We fill the header only
-	 * after the full tracepoint is completed
+	/* The event is only valid once the magic is set again, after it has
+	 * been filled. The size lets readers skip an incomplete event.
 	 */
-	ret->magic = 0;
-	*free = uk_trace_buffer_free - sizeof(*ret);
-	return (char *) (ret + 1);
+	head = (struct uk_tracepoint_header *)
+		&ukplat_per_lcpu_array(uk_trace_buffer, idx,
+				       start % CONFIG_LIBUKDEBUG_TRACE_BUFFER_SIZE);
+	__atomic_store_n(&head->magic, 0, __ATOMIC_RELAXED);
+	head->size = size - sizeof(*head);
+	barrier();
+	return head;
 }
 
-static inline void __uk_trace_finalize_buff(char *new_buff_pos, void *cookie)
+static inline void __uk_trace_commit(struct uk_tracepoint_header *head,
+				     void *cookie)
 {
-	uint32_t size;
-	struct uk_tracepoint_header *head =
-		(struct uk_tracepoint_header *) uk_trace_buffer_writep;
-
-	if (uk_trace_buffer_free == 0) {
-		/**
-		 * This means that the buffer was large enough for the header.
-		 * (__uk_trace_get_buff would have return NULL and the
-		 * tracepoint would have short-circuited), but the tracepoint
-		 * wanted to write some data which did not fit into the
-		 * remaining space. Therefore, the free variable was also set to
-		 * zero.
-		 * This implies that the event is incomplete and we must not
-		 * mark it as usable via the magic variable.
-		 */
-		return;
-	}
-
-	size = new_buff_pos - uk_trace_buffer_writep;
-	uk_trace_buffer_writep += size;
-	uk_trace_buffer_free -= size;
-
 	head->time = ukplat_monotonic_clock();
-	head->size = size - sizeof(*head);
 	head->cookie = cookie;
-	barrier();
-	head->magic = UK_TP_HEADER_MAGIC;
+	__atomic_store_n(&head->magic, UK_TP_HEADER_MAGIC, __ATOMIC_RELEASE);
 }
+#endif /* CONFIG_LIBUKDEBUG_TRACEPOINTS */
 
 /* Makes from "const char*" "const char* arg1".
  */
@@ -262,15 +366,18 @@ static inline void __uk_trace_finalize_buff(char *new_buff_pos, void *cookie)
 		       __VA_ARGS__);					\
 	static inline void trace_name(__UK_TRACE_ARGS_MAP(n, __VA_ARGS__)) \
 	{								\
-		unsigned long flags = ukplat_lcpu_save_irqf();		\
+		struct uk_tracepoint_header *head;			\
 		size_t free __maybe_unused;				\
-		char *buff = __uk_trace_get_buff(&free);		\
-		if (buff) {						\
+		char *buff __maybe_unused;				\
+									\
+		free = 0 __UK_TRACE_SIZE_ARGS ## n();			\
+		head = __uk_trace_reserve(sizeof(*head) + free);	\
+		if (head) {						\
+			buff = (char *) (head + 1);			\
+			free = head->size;				\
 			__UK_TRACE_SAVE_ARGS ## n();			\
-			__uk_trace_finalize_buff(			\
-				buff, &regdata_name);			\
+			__uk_trace_commit(head, &regdata_name);		\
 		}							\
-		ukplat_lcpu_restore_irqf(flags);			\
 	}
 #else
 #define ____UK_TRACEPOINT(n, regdata_name, trace_name, fmt, ...)	\
@@ -48,6 +48,10 @@
 #if CONFIG_LIBUKDEBUG_PRINT_THREAD
 #include <uk/thread.h>
 #endif
+#if CONFIG_LIBUKDEBUG_PRINTK_ASYNC
+#include <uk/plat/lcpu.h>
+#include "printk_ring.h"
+#endif /* CONFIG_LIBUKDEBUG_PRINTK_ASYNC */
 
 #if CONFIG_LIBUKDEBUG_ANSI_COLOR
 #define LVLC_RESET	UK_ANSI_MOD_RESET
@@ -103,9 +107,15 @@ struct _vprint_console {
 
 /* Console state for kernel output */
 #if CONFIG_LIBUKDEBUG_REDIR_PRINTD || CONFIG_LIBUKDEBUG_PRINTK
+#if CONFIG_LIBUKDEBUG_PRINTK_ASYNC
+static struct _vprint_console kern  = { .cout = printk_ring_cout,
+					.newline = 1,
+					.prevlvl = INT_MIN };
+#else /* !CONFIG_LIBUKDEBUG_PRINTK_ASYNC */
 static struct _vprint_console kern  = { .cout = ukplat_coutk,
 					.newline = 1,
 					.prevlvl = INT_MIN };
+#endif /* !CONFIG_LIBUKDEBUG_PRINTK_ASYNC */
 #endif
 
 /* Console state for debug output */
@@ -185,6 +195,10 @@ static void _vprint(struct _vprint_console *cons,
 	const char *lptr = NULL;
 	const char *nlptr = NULL;
 	const char *libname = uk_libname(libid);
+#if CONFIG_LIBUKDEBUG_PRINTK_ASYNC
+	unsigned long irqf = 0;
+	int rec = 0;
+#endif /* CONFIG_LIBUKDEBUG_PRINTK_ASYNC */
 
 	/*
 	 * Note: We reset the console colors earlier in order to exclude
@@ -211,6 +225,24 @@ static void _vprint(struct _vprint_console *cons,
 		return;
 	}
 
+#if CONFIG_LIBUKDEBUG_PRINTK_ASYNC
+	/* Messages on the kernel console are recorded and written later by
+	 * the drain thread. Critical messages are written immediately, after
+	 * the recorded ones, as the system may not continue running.
+	 */
+	if (cons->cout == printk_ring_cout) {
+		if (lvl == KLVL_CRIT)
+			uk_printk_flush();
+
+		irqf = ukplat_lcpu_save_irqf();
+		rec = (lvl == KLVL_CRIT) ? 0 : printk_ring_open();
+		if (rec < 0) {
+			ukplat_lcpu_restore_irqf(irqf);
+			return;
+		}
+	}
+#endif /* CONFIG_LIBUKDEBUG_PRINTK_ASYNC */
+
 	if (lvl != cons->prevlvl) {
 		/* level changed from previous call */
 		if (cons->prevlvl != INT_MIN && !cons->newline) {
@@ -289,6 +321,14 @@ static void _vprint(struct _vprint_console *cons,
 		len -= llen;
 		lptr = nlptr + 1;
 	}
+
+#if CONFIG_LIBUKDEBUG_PRINTK_ASYNC
+	if (cons->cout == printk_ring_cout) {
+		if (rec)
+			printk_ring_close();
+		ukplat_lcpu_restore_irqf(irqf);
+	}
+#endif /* CONFIG_LIBUKDEBUG_PRINTK_ASYNC */
 }
 
 /*
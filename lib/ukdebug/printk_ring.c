@@ -0,0 +1,227 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <string.h>
+#include <uk/arch/time.h>
+#include <uk/errptr.h>
+#include <uk/essentials.h>
+#include <uk/init.h>
+#include <uk/plat/console.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/time.h>
+#include <uk/print.h>
+#include <uk/sched.h>
+#include <uk/thread.h>
+
+#include "printk_ring.h"
+#include "snprintf.h"
+
+#define RING_SIZE	((__sz)CONFIG_LIBUKDEBUG_PRINTK_ASYNC_BUFFER_SIZE)
+#define RING_PERIOD	\
+	ukarch_time_msec_to_nsec((__nsec)CONFIG_LIBUKDEBUG_PRINTK_ASYNC_PERIOD)
+#define RING_RATELIMIT	CONFIG_LIBUKDEBUG_PRINTK_ASYNC_RATELIMIT
+
+struct __align64 printk_ring {
+	/* Number of bytes ever published to the drain thread */
+	__u64 head;
+	/* Number of bytes ever written to the console */
+	__u64 tail;
+	/* End of the message that is being recorded */
+	__u64 pos;
+	/* A message is being recorded */
+	int open;
+	/* The message being recorded did not fit into the ring */
+	int overflow;
+	/* Number of messages dropped because the ring was full */
+	__u64 lost;
+	/* Number of messages dropped by the rate limit */
+	__u64 limited;
+	/* Start of the current rate limit period and messages within it */
+	__nsec period;
+	unsigned int count;
+};
+
+static UKPLAT_PER_LCPU_DEFINE(struct printk_ring, printk_ring);
+static UKPLAT_PER_LCPU_ARRAY_DEFINE(char, printk_ring_buf, RING_SIZE);
+
+static int printk_ring_active;
+/* Only one context writes the rings to the console at a time */
+static int printk_ring_draining;
+/* Dropped messages that were already reported on the console */
+static __u64 printk_ring_lost;
+static __u64 printk_ring_limited;
+
+#if RING_RATELIMIT
+static int printk_ring_ratelimit(struct printk_ring *r)
+{
+	__nsec now = ukplat_monotonic_clock();
+
+	if (now - r->period >= UKARCH_NSEC_PER_SEC) {
+		r->period = now;
+		r->count = 0;
+	}
+	if (r->count >= RING_RATELIMIT) {
+		__atomic_store_n(&r->limited, r->limited + 1,
+				 __ATOMIC_RELAXED);
+		return 1;
+	}
+	r->count++;
+	return 0;
+}
+#else /* !RING_RATELIMIT */
+#define printk_ring_ratelimit(r) 0
+#endif /* !RING_RATELIMIT */
+
+int printk_ring_open(void)
+{
+	struct printk_ring *r = &ukplat_per_lcpu_current(printk_ring);
+
+	if (!__atomic_load_n(&printk_ring_active, __ATOMIC_ACQUIRE))
+		return 0;
+	/* A message that is printed while recording, e.g., by an exception
+	 * handler, goes to the console directly
+	 */
+	if (unlikely(r->open))
+		return 0;
+	if (printk_ring_ratelimit(r))
+		return -1;
+
+	r->pos = r->head;
+	r->overflow = 0;
+	r->open = 1;
+	return 1;
+}
+
+void printk_ring_close(void)
+{
+	struct printk_ring *r = &ukplat_per_lcpu_current(printk_ring);
+
+	r->open = 0;
+	if (unlikely(r->overflow)) {
+		__atomic_store_n(&r->lost, r->lost + 1, __ATOMIC_RELAXED);
+		return;
+	}
+	__atomic_store_n(&r->head, r->pos, __ATOMIC_RELEASE);
+}
+
+int printk_ring_cout(const char *buf, unsigned int len)
+{
+	struct printk_ring *r = &ukplat_per_lcpu_current(printk_ring);
+	char *ring = &ukplat_per_lcpu_array_current(printk_ring_buf, 0);
+	__u64 tail;
+	__sz off, part;
+
+	if (!r->open)
+		return ukplat_coutk(buf, len);
+	if (r->overflow)
+		return len;
+
+	tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+	if (r->pos + len - tail > RING_SIZE) {
+		r->overflow = 1;
+		return len;
+	}
+
+	/* The message may wrap around the end of the ring */
+	off = r->pos % RING_SIZE;
+	part = MIN((__sz)len, RING_SIZE - off);
+	memcpy(&ring[off], buf, part);
+	memcpy(ring, buf + part, len - part);
+	r->pos += len;
+	return len;
+}
+
+static void printk_ring_drain_lcpu(__lcpuidx idx)
+{
+	struct printk_ring *r = &ukplat_per_lcpu(printk_ring, idx);
+	char *ring = &ukplat_per_lcpu_array(printk_ring_buf, idx, 0);
+	__u64 tail, head;
+	__sz len;
+
+	tail = r->tail;
+	head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	while (tail < head) {
+		len = MIN(head - tail, RING_SIZE - tail % RING_SIZE);
+		ukplat_coutk(&ring[tail % RING_SIZE], len);
+		tail += len;
+		__atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+	}
+}
+
+static void printk_ring_report(void)
+{
+	__u64 lost = 0, limited = 0;
+	char buf[96];
+	__lcpuidx i;
+	int len;
+
+	for (i = 0; i < ukplat_lcpu_count(); i++) {
+		lost += __atomic_load_n(&ukplat_per_lcpu(printk_ring, i).lost,
+					__ATOMIC_RELAXED);
+		limited += __atomic_load_n(
+			&ukplat_per_lcpu(printk_ring, i).limited,
+			__ATOMIC_RELAXED);
+	}
+	if (lost == printk_ring_lost && limited == printk_ring_limited)
+		return;
+
+	len = __uk_snprintf(buf, sizeof(buf),
+			    "printk: %"__PRIu64" messages lost (ring full), "
+			    "%"__PRIu64" rate limited\n",
+			    lost - printk_ring_lost,
+			    limited - printk_ring_limited);
+	ukplat_coutk(buf, len);
+	printk_ring_lost = lost;
+	printk_ring_limited = limited;
+}
+
+void uk_printk_flush(void)
+{
+	__lcpuidx i;
+
+	if (__atomic_exchange_n(&printk_ring_draining, 1, __ATOMIC_ACQUIRE))
+		return;
+
+	for (i = 0; i < ukplat_lcpu_count(); i++)
+		printk_ring_drain_lcpu(i);
+	printk_ring_report();
+
+	__atomic_store_n(&printk_ring_draining, 0, __ATOMIC_RELEASE);
+}
+
+static __noreturn void printk_ring_thread(void *arg __unused)
+{
+	for (;;) {
+		uk_printk_flush();
+		uk_sched_thread_sleep(RING_PERIOD);
+	}
+}
+
+static int printk_ring_init(struct uk_init_ctx *ictx __unused)
+{
+	struct uk_thread *t;
+
+	t = uk_sched_thread_create(uk_sched_current(), printk_ring_thread,
+				   __NULL, "printk");
+	if (unlikely(!t || PTRISERR(t))) {
+		uk_pr_warn("Failed to start printk thread, printing "
+			   "synchronously\n");
+		return 0;
+	}
+	__atomic_store_n(&printk_ring_active, 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/* Messages of the shutdown are printed synchronously, so that none are
+ * lost when the drain thread does not run anymore
+ */
+static void printk_ring_term(const struct uk_term_ctx *tctx __unused)
+{
+	__atomic_store_n(&printk_ring_active, 0, __ATOMIC_RELEASE);
+	uk_printk_flush();
+}
+
+uk_early_initcall(printk_ring_init, printk_ring_term);
@@ -0,0 +1,41 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __UKDEBUG_INTERNAL_PRINTK_RING_H__
+#define __UKDEBUG_INTERNAL_PRINTK_RING_H__
+
+#include <uk/config.h>
+
+/*
+ * Asynchronous kernel console. Once the drain thread runs, messages are
+ * recorded into a ring of the current lcpu instead of being written to the
+ * console. Interrupts are disabled while a message is recorded, so each
+ * ring has a single writer at a time and needs no lock. The drain thread
+ * periodically writes the rings to the console.
+ */
+
+/**
+ * Starts recording a message on the current lcpu. Must be called with
+ * interrupts disabled.
+ *
+ * @return
+ *   1 if the message is recorded, 0 if it must be written synchronously
+ *   (ring not active), -1 if the message is dropped by the rate limit
+ */
+int printk_ring_open(void);
+
+/**
+ * Finishes recording and publishes the message to the drain thread
+ */
+void printk_ring_close(void);
+
+/**
+ * Console output function: appends to the message being recorded on the
+ * current lcpu or, if none is, writes to the kernel console
+ */
+int printk_ring_cout(const char *buf, unsigned int len);
+
+#endif /* __UKDEBUG_INTERNAL_PRINTK_RING_H__ */
@@ -32,16 +32,16 @@
 
 #include <stddef.h>
 #include <uk/essentials.h>
+#include <uk/trace.h>
 
-/* If the buffer is full, tracing disables itself.
- * Using a circular buffer will not make it better: in any case, losing trace
- * data is undesired and we should keep this as simple as possible.
+/* Every lcpu has a buffer of its own. Depending on the configuration, an
+ * lcpu stops tracing when its buffer is full or overwrites its oldest events.
+ * The buffers are merged by time when the trace is fetched.
  */
-char uk_trace_buffer[CONFIG_LIBUKDEBUG_TRACE_BUFFER_SIZE];
-
-size_t uk_trace_buffer_free = CONFIG_LIBUKDEBUG_TRACE_BUFFER_SIZE;
-char *uk_trace_buffer_writep = uk_trace_buffer;
-
+UKPLAT_PER_LCPU_ARRAY_DEFINE(char, uk_trace_buffer,
+			     CONFIG_LIBUKDEBUG_TRACE_BUFFER_SIZE)
+	__align(UK_TRACE_ALIGN);
+UKPLAT_PER_LCPU_DEFINE(struct uk_trace_lcpu, uk_trace_lcpu);
 
 /* Store a string in format "key = value" in the section
  * .uk_trace_keyvals. This can be anything what you want trace.py
@@ -57,6 +57,7 @@ char *uk_trace_buffer_writep = uk_trace_buffer;
 	__attribute((__section__(			\
 		".uk_trace_keyvals,\"\",@note#")))	\
 	static const char key[] __used =		\
-		#key " = " #val
+		#key " = " STRINGIFY(val)
 
-TRACE_DEFINE_KEY(format_version, 1);
+TRACE_DEFINE_KEY(format_version, 2);
+TRACE_DEFINE_KEY(chunk_size, UK_TRACE_CHUNK_SIZE);
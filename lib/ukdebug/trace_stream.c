@@ -0,0 +1,166 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <errno.h>
+#include <uk/assert.h>
+#include <uk/errptr.h>
+#include <uk/essentials.h>
+#include <uk/plat/lcpu.h>
+#include <uk/print.h>
+#include <uk/sched.h>
+#include <uk/thread.h>
+#include <uk/trace.h>
+
+#define BUFFER_SIZE	CONFIG_LIBUKDEBUG_TRACE_BUFFER_SIZE
+#define STREAM_PERIOD	\
+	((__nsec)CONFIG_LIBUKDEBUG_TRACE_STREAM_PERIOD * 1000000UL)
+
+static uk_trace_stream_write_t stream_write;
+static void *stream_arg;
+/* Number of lost events last sent for each lcpu */
+static __u64 stream_lost[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+
+/* Returns the header at `pos` of a buffer, or NULL if the rest of the chunk
+ * is too short for one.
+ */
+static struct uk_tracepoint_header *trace_stream_hdr(char *buff, __u64 pos)
+{
+	if (UK_TRACE_CHUNK_SIZE - pos % UK_TRACE_CHUNK_SIZE <
+	    sizeof(struct uk_tracepoint_header))
+		return __NULL;
+	return (struct uk_tracepoint_header *)&buff[pos % BUFFER_SIZE];
+}
+
+/* Returns the position after the event or padding at `pos` */
+static __u64 trace_stream_next(struct uk_tracepoint_header *hdr, __u32 magic,
+			       __u64 pos)
+{
+	if (!hdr || magic == UK_TP_PAD_MAGIC)
+		return ALIGN_DOWN(pos, UK_TRACE_CHUNK_SIZE) +
+		       UK_TRACE_CHUNK_SIZE;
+	return pos + sizeof(*hdr) + hdr->size;
+}
+
+/* Returns the end of the complete events between `tail` and `head`. Events
+ * are committed in the order in which they were reserved, except for those
+ * of interrupts, so stopping at the first incomplete event delays at most
+ * few events to the next round.
+ */
+static __u64 trace_stream_end(char *buff, __u64 tail, __u64 head)
+{
+	struct uk_tracepoint_header *hdr;
+	__u32 magic = 0;
+
+	while (tail < head) {
+		hdr = trace_stream_hdr(buff, tail);
+		if (hdr) {
+			magic = __atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE);
+			if (magic != UK_TP_HEADER_MAGIC &&
+			    magic != UK_TP_PAD_MAGIC)
+				break;
+		}
+		tail = trace_stream_next(hdr, magic, tail);
+	}
+	return MIN(tail, head);
+}
+
+/* Clears the headers between `tail` and `end` before the space is given back
+ * to the writers. Until a writer stores its header, a reader must not see
+ * the header of an event that was already sent.
+ */
+static void trace_stream_clear(char *buff, __u64 tail, __u64 end)
+{
+	struct uk_tracepoint_header *hdr;
+	__u32 magic = 0;
+
+	while (tail < end) {
+		hdr = trace_stream_hdr(buff, tail);
+		if (hdr) {
+			magic = hdr->magic;
+			hdr->magic = 0;
+		}
+		tail = trace_stream_next(hdr, magic, tail);
+	}
+}
+
+static int trace_stream_lcpu(__lcpuidx idx)
+{
+	struct uk_trace_lcpu *tl = &ukplat_per_lcpu(uk_trace_lcpu, idx);
+	char *buff = &ukplat_per_lcpu_array(uk_trace_buffer, idx, 0);
+	struct uk_trace_stream_frame frame;
+	__u64 tail, end;
+	__sz len;
+	int rc;
+
+	tail = tl->tail;
+	end = trace_stream_end(buff, tail,
+			       __atomic_load_n(&tl->head, __ATOMIC_ACQUIRE));
+
+	frame.magic = UK_TRACE_STREAM_MAGIC;
+	frame.size = end - tail;
+	frame.pos = tail;
+	frame.lost = __atomic_load_n(&tl->lost, __ATOMIC_RELAXED);
+	frame.lcpu = idx;
+	frame.reserved = 0;
+	if (!frame.size && frame.lost == stream_lost[idx])
+		return 0;
+
+	rc = stream_write(&frame, sizeof(frame), stream_arg);
+	if (unlikely(rc))
+		return rc;
+	stream_lost[idx] = frame.lost;
+
+	/* The events may wrap around the end of the buffer */
+	while (tail < end) {
+		len = MIN(end - tail, BUFFER_SIZE - tail % BUFFER_SIZE);
+		rc = stream_write(&buff[tail % BUFFER_SIZE], len, stream_arg);
+		if (unlikely(rc))
+			return rc;
+
+		trace_stream_clear(buff, tail, tail + len);
+		tail += len;
+		__atomic_store_n(&tl->tail, tail, __ATOMIC_RELEASE);
+	}
+	return 0;
+}
+
+static __noreturn void trace_stream_thread(void *arg __unused)
+{
+	__lcpuidx i;
+	int rc;
+
+	for (;;) {
+		for (i = 0; i < ukplat_lcpu_count(); i++) {
+			rc = trace_stream_lcpu(i);
+			if (unlikely(rc)) {
+				uk_pr_err("Failed to write trace stream: %d\n",
+					  rc);
+				uk_sched_thread_exit();
+			}
+		}
+		uk_sched_thread_sleep(STREAM_PERIOD);
+	}
+}
+
+int uk_trace_stream_start(uk_trace_stream_write_t write, void *arg)
+{
+	struct uk_thread *t;
+
+	UK_ASSERT(write);
+
+	if (stream_write)
+		return -EBUSY;
+	stream_write = write;
+	stream_arg = arg;
+
+	t = uk_sched_thread_create(uk_sched_current(), trace_stream_thread,
+				   __NULL, "trace-stream");
+	if (unlikely(!t || PTRISERR(t))) {
+		stream_write = __NULL;
+		return -ENOMEM;
+	}
+	return 0;
+}
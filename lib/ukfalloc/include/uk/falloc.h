@@ -47,6 +47,15 @@ struct uk_falloc {
 
 #define FALLOC_FLAG_ALIGNED		0x01 /* align allocation to its size */
 
+/* Prefer memory of the given NUMA node (see <uk/plat/numa.h>). Without this
+ * flag, memory of the node of the calling lcpu is preferred. If the node
+ * has no free memory left, the allocation falls back to other nodes.
+ */
+#define FALLOC_FLAG_NODE_SHIFT		8
+#define FALLOC_FLAG_NODE_MASK		(~0UL << FALLOC_FLAG_NODE_SHIFT)
+#define FALLOC_FLAG_NODE(node)						\
+	(((unsigned long)(node) + 1) << FALLOC_FLAG_NODE_SHIFT)
+
 	/**
 	 * Allocates physical memory
 	 *
@@ -128,6 +137,11 @@ struct uk_falloc {
 
 	/** The total amount of memory managed by the allocator in bytes */
 	__sz total_memory;
+
+	/** The highest amount of allocated memory (total_memory - free_memory)
+	 * seen after an allocation, in bytes
+	 */
+	__sz max_used_memory;
 };
 
 /**
@@ -41,6 +41,9 @@
 #include <uk/atomic.h>
 #include <uk/list.h>
 #include <uk/print.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/numa.h>
+#include <uk/plat/spinlock.h>
 
 #include <string.h>
 #include <errno.h>
@@ -66,6 +69,12 @@
 #error Too many levels. Reduce max allocation size.
 #endif
 
+#if CONFIG_UKPLAT_NUMA
+#define BFA_NODES			CONFIG_UKPLAT_NUMA_MAXNODES
+#else /* !CONFIG_UKPLAT_NUMA */
+#define BFA_NODES			1
+#endif /* !CONFIG_UKPLAT_NUMA */
+
 #define BFA_Lx_SHIFT(lvl)		((lvl) + PAGE_SHIFT)
 #define BFA_Lx_SIZE(lvl)		(1UL << BFA_Lx_SHIFT(lvl))
 #define BFA_Lx_MASK(lvl)		(~(BFA_Lx_SIZE(lvl) - 1))
@@ -147,24 +156,72 @@ struct bfa_memblock {
 #endif /* BFA_DIRECT_MAPPED */
 
 	unsigned int level;
+
+	/* Set if the block was reported as free to the hypervisor, which
+	 * may have discarded its contents
+	 */
+	unsigned int reported;
+
+	/* NUMA node of the free list that the block is linked in */
+	unsigned int node;
 };
 
+#ifdef CONFIG_LIBUKFALLOCBUDDY_PCP
+/* Each lcpu caches single frames and frames of the size of a large page,
+ * which are the sizes that page faults allocate. An lcpu allocates from and
+ * frees to its own cache without touching the shared free lists. The cache
+ * is refilled from and drained to the free lists in batches. Cached frames
+ * remain marked as allocated in the zone bitmaps and do not count as free
+ * memory.
+ */
+#define BFA_PCP_LISTS			2
+#define BFA_PCP_LVL(list)					\
+	((list) ? (unsigned int)(PAGE_Lx_SHIFT(1) - PAGE_SHIFT) : 0)
+#define BFA_PCP_BATCH(list)					\
+	((list) ? CONFIG_LIBUKFALLOCBUDDY_PCP_LARGE_BATCH :	\
+		  CONFIG_LIBUKFALLOCBUDDY_PCP_BATCH)
+#define BFA_PCP_HIGH(list)		(2 * BFA_PCP_BATCH(list))
+
+#if CONFIG_LIBUKFALLOCBUDDY_PCP_BATCH > CONFIG_LIBUKFALLOCBUDDY_PCP_LARGE_BATCH
+#define BFA_PCP_HIGH_MAX	(2 * CONFIG_LIBUKFALLOCBUDDY_PCP_BATCH)
+#else
+#define BFA_PCP_HIGH_MAX	(2 * CONFIG_LIBUKFALLOCBUDDY_PCP_LARGE_BATCH)
+#endif
+
+struct __align64 bfa_pcp {
+	/* Only contended when another lcpu drains all caches */
+	__spinlock lock;
+
+	unsigned int count[BFA_PCP_LISTS];
+	__paddr_t frames[BFA_PCP_LISTS][BFA_PCP_HIGH_MAX];
+};
+#endif /* CONFIG_LIBUKFALLOCBUDDY_PCP */
+
 /* The buddy allocator keeps track of all free memory across all zones in the
  * shared free lists so that a single check is enough to see if an allocation
  * of a certain size can directly be satisfied. If no element in the correct
  * free list is available, a memblock from the next higher level is taken and
  * split into its buddies. One of the buddies satisfies the request, whereas
  * the other's memblock is added to the free list. Blocks are recursively split
- * if needed.
+ * if needed. There is a set of free lists per NUMA node. A block is linked
+ * into the lists of the node of its first frame, so that allocations can
+ * prefer memory that is close to the lcpu.
  */
 struct buddy_framealloc {
 	struct uk_falloc fa;
 
+	/* Protects the zones and free lists */
+	__spinlock lock;
+
 	/* Circular singly-linked zone list. Head is moved to last used zone. */
 	struct bfa_zone *zones;
 
-	struct uk_list_head free_list[BFA_LEVELS];
-	unsigned int free_list_map;
+	struct uk_list_head free_list[BFA_NODES][BFA_LEVELS];
+	unsigned int free_list_map[BFA_NODES];
+
+#ifdef CONFIG_LIBUKFALLOCBUDDY_PCP
+	struct bfa_pcp pcp[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+#endif /* CONFIG_LIBUKFALLOCBUDDY_PCP */
 };
 
 /* Forward declarations */
@@ -633,32 +690,72 @@ static inline struct bfa_zone *bfa_paddr_to_zone(struct buddy_framealloc *bfa,
 	return __NULL;
 }
 
+static inline unsigned int bfa_paddr_node(__paddr_t paddr)
+{
+	unsigned int node = ukplat_numa_paddr_node(paddr);
+
+	UK_ASSERT(node < BFA_NODES);
+	return node;
+}
+
+/* Returns the node of which allocations prefer memory according to the
+ * allocation flags
+ */
+static inline unsigned int bfa_flags_node(unsigned long flags)
+{
+	unsigned long node = flags >> FALLOC_FLAG_NODE_SHIFT;
+
+	if (!node)
+		return ukplat_numa_node();
+
+	return (node <= BFA_NODES) ? node - 1 : 0;
+}
+
 static inline void bfa_fl_add_tail(struct buddy_framealloc *bfa,
+				   struct bfa_zone *zone,
 				   struct bfa_memblock *mb)
 {
-	uk_list_add_tail(&mb->link, &bfa->free_list[mb->level]);
-	bfa->free_list_map |= (1 << mb->level);
+	mb->reported = 0;
+	mb->node = bfa_paddr_node(bfa_mb_to_paddr(zone, mb));
+	uk_list_add_tail(&mb->link, &bfa->free_list[mb->node][mb->level]);
+	bfa->free_list_map[mb->node] |= (1 << mb->level);
 
 	UK_ASSERT(mb->level < BFA_LEVELS);
 	bfa->fa.free_memory += BFA_Lx_SIZE(mb->level);
 }
 
 static inline void bfa_fl_add(struct buddy_framealloc *bfa,
+			      struct bfa_zone *zone,
 			      struct bfa_memblock *mb)
 {
-	uk_list_add(&mb->link, &bfa->free_list[mb->level]);
-	bfa->free_list_map |= (1 << mb->level);
+	mb->reported = 0;
+	mb->node = bfa_paddr_node(bfa_mb_to_paddr(zone, mb));
+	uk_list_add(&mb->link, &bfa->free_list[mb->node][mb->level]);
+	bfa->free_list_map[mb->node] |= (1 << mb->level);
 
 	UK_ASSERT(mb->level < BFA_LEVELS);
 	bfa->fa.free_memory += BFA_Lx_SIZE(mb->level);
 }
 
+/* Reported blocks are added at the end so that allocations prefer blocks
+ * that are still backed by the hypervisor
+ */
+static inline void bfa_fl_add_reported(struct buddy_framealloc *bfa,
+				       struct bfa_zone *zone,
+				       struct bfa_memblock *mb)
+{
+	bfa_fl_add_tail(bfa, zone, mb);
+	mb->reported = 1;
+}
+
 static inline void bfa_fl_del(struct buddy_framealloc *bfa,
 			      struct bfa_memblock *mb)
 {
+	UK_ASSERT(mb->node < BFA_NODES);
+
 	uk_list_del(&mb->link);
-	if (uk_list_empty(&bfa->free_list[mb->level]))
-		bfa->free_list_map ^= (1 << mb->level);
+	if (uk_list_empty(&bfa->free_list[mb->node][mb->level]))
+		bfa->free_list_map[mb->node] ^= (1 << mb->level);
 
 	UK_ASSERT(mb->level < BFA_LEVELS);
 	UK_ASSERT(bfa->fa.free_memory >= BFA_Lx_SIZE(mb->level));
@@ -671,15 +768,26 @@ static inline void bfa_fl_del(struct buddy_framealloc *bfa,
 
 static inline struct bfa_memblock *bfa_fl_pop_mb(struct buddy_framealloc *bfa,
 						 unsigned int *level,
-						 struct bfa_zone **zone)
+						 struct bfa_zone **zone,
+						 unsigned int node)
 {
 	unsigned int map, lvl = *level;
 	struct bfa_memblock *mb;
+	unsigned int i;
 
 	UK_ASSERT(lvl < BFA_LEVELS);
+	UK_ASSERT(node < BFA_NODES);
 
-	/* Mask out all free lists that are too small */
-	map = bfa->free_list_map & -(1 << lvl);
+	/* Prefer the free lists of the given node and fall back to the next
+	 * nodes. Mask out all free lists that are too small.
+	 */
+	for (i = 0; i < BFA_NODES; i++) {
+		map = bfa->free_list_map[node] & -(1 << lvl);
+		if (map)
+			break;
+
+		node = (node + 1) % BFA_NODES;
+	}
 	if (map == 0)
 		return __NULL;
 
@@ -688,7 +796,7 @@ static inline struct bfa_memblock *bfa_fl_pop_mb(struct buddy_framealloc *bfa,
 	lvl = uk_ffs(map);
 	UK_ASSERT(lvl < BFA_LEVELS);
 
-	mb = uk_list_first_entry(&bfa->free_list[lvl],
+	mb = uk_list_first_entry(&bfa->free_list[node][lvl],
 				 struct bfa_memblock, link);
 
 	UK_ASSERT(mb);
@@ -707,6 +815,7 @@ bfa_fl_find_mb_in_zone(struct buddy_framealloc *bfa, struct bfa_zone *zone,
 		       __paddr_t paddr, unsigned int *level)
 {
 	unsigned int map, lvl = *level;
+	unsigned int node, min_lvl = *level, i;
 	struct bfa_memblock *mb;
 	__paddr_t mb_paddr;
 	__sz size;
@@ -716,41 +825,48 @@ bfa_fl_find_mb_in_zone(struct buddy_framealloc *bfa, struct bfa_zone *zone,
 
 	/* This function searches for the memory block that contains a specific
 	 * physical address in the given zone. We search from large to small
-	 * free lists to increase the chance of finding the address fast.
+	 * free lists to increase the chance of finding the address fast. The
+	 * block is linked in the lists of the node of its first frame, which
+	 * usually is the node of the address.
 	 */
+	node = bfa_paddr_node(paddr);
+	for (i = 0; i < BFA_NODES; i++) {
+		/* Mask out all free lists that are too small */
+		map = bfa->free_list_map[node] & -(1 << min_lvl);
 
-	/* Mask out all free lists that are too small */
-	map = bfa->free_list_map & -(1 << lvl);
+		while (map) {
+			/* Find largest free list that is not empty */
+			lvl = uk_fls(map);
+			UK_ASSERT(lvl < BFA_LEVELS);
 
-	while (map) {
-		/* Find largest free list that is not empty */
-		lvl = uk_fls(map);
-		UK_ASSERT(lvl < BFA_LEVELS);
+			size = BFA_Lx_SIZE(lvl);
 
-		size = BFA_Lx_SIZE(lvl);
-
-		/* Do a linear search in the free list */
-		uk_list_for_each_entry(mb, &bfa->free_list[lvl], link) {
-			UK_ASSERT(mb->level == lvl);
+			/* Do a linear search in the free list */
+			uk_list_for_each_entry(mb, &bfa->free_list[node][lvl],
+					       link) {
+				UK_ASSERT(mb->level == lvl);
 
-			if (bfa_mb_to_zone(bfa, mb) != zone)
-				continue;
+				if (bfa_mb_to_zone(bfa, mb) != zone)
+					continue;
 
-			mb_paddr = bfa_mb_to_paddr(zone, mb);
+				mb_paddr = bfa_mb_to_paddr(zone, mb);
 
-			if (paddr >= mb_paddr &&
-			    paddr < mb_paddr + size) {
-				/* Found ! */
+				if (paddr >= mb_paddr &&
+				    paddr < mb_paddr + size) {
+					/* Found ! */
 
-				*level = lvl;
+					*level = lvl;
 
-				bfa_fl_del(bfa, mb);
-				return mb;
+					bfa_fl_del(bfa, mb);
+					return mb;
+				}
 			}
+
+			/* Unset bit in map to go to next free list */
+			map ^= (1 << lvl);
 		}
 
-		/* Unset bit in map to go to next free list */
-		map ^= (1 << lvl);
+		node = (node + 1) % BFA_NODES;
 	}
 
 	return __NULL;
@@ -761,7 +877,7 @@ bfa_fl_find_mb_in_range(struct buddy_framealloc *bfa, unsigned int *level,
 			struct bfa_zone **zone, __paddr_t *paddr, __paddr_t min,
 			__paddr_t max)
 {
-	unsigned int map, to_lvl = *level;
+	unsigned int map, node, to_lvl = *level;
 	unsigned int lvl = to_lvl;
 	struct bfa_memblock *mb;
 	struct bfa_zone *zn;
@@ -815,50 +931,55 @@ bfa_fl_find_mb_in_range(struct buddy_framealloc *bfa, unsigned int *level,
 	UK_ASSERT(max - min >= to_size);
 	UK_ASSERT(BFA_Lx_ALIGNED(max - min, to_lvl));
 
-	/* Mask out all free lists that are too small */
-	map = bfa->free_list_map & -(1 << to_lvl);
+	for (node = 0; node < BFA_NODES; node++) {
+		/* Mask out all free lists that are too small */
+		map = bfa->free_list_map[node] & -(1 << to_lvl);
 
-	while (map) {
-		/* Find smallest free list that is not empty */
-		lvl = uk_ffs(map);
-		UK_ASSERT(lvl < BFA_LEVELS);
+		while (map) {
+			/* Find smallest free list that is not empty */
+			lvl = uk_ffs(map);
+			UK_ASSERT(lvl < BFA_LEVELS);
 
-		size = BFA_Lx_SIZE(lvl);
+			size = BFA_Lx_SIZE(lvl);
 
-		/* Do a linear search in the free list */
-		uk_list_for_each_entry(mb, &bfa->free_list[lvl], link) {
-			UK_ASSERT(mb->level == lvl);
+			/* Do a linear search in the free list */
+			uk_list_for_each_entry(mb, &bfa->free_list[node][lvl],
+					       link) {
+				UK_ASSERT(mb->level == lvl);
 
-			zn = bfa_mb_to_zone(bfa, mb);
+				zn = bfa_mb_to_zone(bfa, mb);
 
-			mb_paddr = bfa_mb_to_paddr(zn, mb);
-			mb_end_paddr = mb_paddr + size;
+				mb_paddr = bfa_mb_to_paddr(zn, mb);
+				mb_end_paddr = mb_paddr + size;
 
-			/* Since lvl is at least to_lvl, we know that the
-			 * memory block is large enough. But we must ensure
-			 * that we are in one of a Case C.X.
-			 */
-			if ((max <= mb_paddr) || (min >= mb_end_paddr))
-				continue; /* Cases A.1+2 and B.1+2 */
+				/* Since lvl is at least to_lvl, we know that
+				 * the memory block is large enough. But we
+				 * must ensure that we are in one of a Case C.X.
+				 */
+				if ((max <= mb_paddr) || (min >= mb_end_paddr))
+					continue; /* Cases A.1+2 and B.1+2 */
 
-			UK_ASSERT(max - mb_paddr >= to_size);
-			UK_ASSERT(BFA_Lx_ALIGNED(max - mb_paddr, to_lvl));
-			UK_ASSERT(mb_end_paddr - min >= to_size);
-			UK_ASSERT(BFA_Lx_ALIGNED(mb_end_paddr - min, to_lvl));
+				UK_ASSERT(max - mb_paddr >= to_size);
+				UK_ASSERT(BFA_Lx_ALIGNED(max - mb_paddr,
+							 to_lvl));
+				UK_ASSERT(mb_end_paddr - min >= to_size);
+				UK_ASSERT(BFA_Lx_ALIGNED(mb_end_paddr - min,
+							 to_lvl));
 
-			*level = lvl;
-			*zone = zn;
-			*paddr = MAX(mb_paddr, min);
+				*level = lvl;
+				*zone = zn;
+				*paddr = MAX(mb_paddr, min);
+
+				UK_ASSERT(BFA_Lx_ALIGNED(*paddr, to_lvl));
 
-			UK_ASSERT(BFA_Lx_ALIGNED(*paddr, to_lvl));
+				bfa_fl_del(bfa, mb);
 
-			bfa_fl_del(bfa, mb);
+				return mb;
+			}
 
-			return mb;
+			/* Unset bit in map to go to next free list */
+			map ^= (1 << lvl);
 		}
-
-		/* Unset bit in map to go to next free list */
-		map ^= (1 << lvl);
 	}
 
 	return __NULL;
@@ -939,9 +1060,9 @@ static void bfa_fl_addmem(struct buddy_framealloc *bfa, struct bfa_zone *zone,
 			/* Add completely new memory at the end so that we are
 			 * more likely to reuse areas we have already touched
 			 */
-			bfa_fl_add_tail(bfa, mb);
+			bfa_fl_add_tail(bfa, zone, mb);
 		} else
-			bfa_fl_add(bfa, mb);
+			bfa_fl_add(bfa, zone, mb);
 
 		UK_ASSERT(len >= size);
 		UK_ASSERT(paddr <= (zone->end - size));
@@ -1102,7 +1223,7 @@ EXIT_FREE:
 }
 
 static int bfa_do_alloc_any(struct buddy_framealloc *bfa, __paddr_t *paddr,
-			    __sz len)
+			    __sz len, unsigned int node)
 {
 	struct bfa_memblock *mb;
 	struct bfa_zone *zone;
@@ -1127,7 +1248,7 @@ static int bfa_do_alloc_any(struct buddy_framealloc *bfa, __paddr_t *paddr,
 	 * a suitable block, there is not enough free contiguous memory.
 	 */
 	lvl = to_lvl;
-	mb = bfa_fl_pop_mb(bfa, &lvl, &zone);
+	mb = bfa_fl_pop_mb(bfa, &lvl, &zone, node);
 	if (unlikely(!mb)) {
 		uk_pr_debug("%"__PRIuptr": Out of continuous physical memory"
 			    " (req: %"__PRIsz" free: %"__PRIsz")\n",
@@ -1169,7 +1290,7 @@ static int bfa_do_alloc_any(struct buddy_framealloc *bfa, __paddr_t *paddr,
 			mb->zone = zone;
 #endif /* BFA_DIRECT_MAPPED */
 
-			bfa_fl_add(bfa, mb);
+			bfa_fl_add(bfa, zone, mb);
 		}
 
 		UK_ASSERT(lvl == to_lvl);
@@ -1193,27 +1314,237 @@ static int bfa_do_alloc_any(struct buddy_framealloc *bfa, __paddr_t *paddr,
 	return 0;
 }
 
+static inline void bfa_update_max_used(struct buddy_framealloc *bfa)
+{
+	__sz used = bfa->fa.total_memory - bfa->fa.free_memory;
+
+	if (used > bfa->fa.max_used_memory)
+		bfa->fa.max_used_memory = used;
+}
+
+#ifdef CONFIG_LIBUKFALLOCBUDDY_PCP
+/* Returns the cache list for allocations of the given size or -1 if the size
+ * is not cached
+ */
+static inline int bfa_pcp_list(unsigned long frames)
+{
+	int list;
+
+	for (list = 0; list < BFA_PCP_LISTS; list++) {
+		if (BFA_PCP_LVL(list) >= BFA_LEVELS)
+			break;
+
+		if (frames == (1UL << BFA_PCP_LVL(list)))
+			return list;
+	}
+
+	return -1;
+}
+
+/* Must be called with the cache locked */
+static void bfa_pcp_refill(struct buddy_framealloc *bfa, struct bfa_pcp *pcp,
+			   int list)
+{
+	__sz len = BFA_Lx_SIZE(BFA_PCP_LVL(list));
+	unsigned int node = ukplat_numa_node();
+	__paddr_t paddr;
+
+	ukarch_spin_lock(&bfa->lock);
+	while (pcp->count[list] < BFA_PCP_BATCH(list)) {
+		if (bfa_do_alloc_any(bfa, &paddr, len, node))
+			break;
+
+		pcp->frames[list][pcp->count[list]++] = paddr;
+	}
+	bfa_update_max_used(bfa);
+	ukarch_spin_unlock(&bfa->lock);
+}
+
+/* Returns the `n` least recently freed frames of the list to the free lists.
+ * Must be called with the cache locked.
+ */
+static void bfa_pcp_drain(struct buddy_framealloc *bfa, struct bfa_pcp *pcp,
+			  int list, unsigned int n)
+{
+	__sz len = BFA_Lx_SIZE(BFA_PCP_LVL(list));
+	__paddr_t *frames = pcp->frames[list];
+	unsigned int i;
+	int rc __maybe_unused;
+
+	UK_ASSERT(n <= pcp->count[list]);
+
+	ukarch_spin_lock(&bfa->lock);
+	for (i = 0; i < n; i++) {
+		rc = bfa_do_free(bfa, frames[i], len);
+		UK_ASSERT(rc == 0);
+	}
+	ukarch_spin_unlock(&bfa->lock);
+
+	pcp->count[list] -= n;
+	memmove(frames, frames + n, pcp->count[list] * sizeof(*frames));
+}
+
+/* Returns all cached frames to the free lists. This is done before an
+ * allocation fails with -ENOMEM because the requested memory might be
+ * cached. Returns the number of frames drained.
+ */
+static unsigned long bfa_pcp_drain_all(struct buddy_framealloc *bfa)
+{
+	struct bfa_pcp *pcp;
+	unsigned long irqf, n = 0;
+	__lcpuidx idx;
+	int list;
+
+	for (idx = 0; idx < ukplat_lcpu_count(); idx++) {
+		pcp = &bfa->pcp[idx];
+
+		ukplat_spin_lock_irqsave(&pcp->lock, irqf);
+		for (list = 0; list < BFA_PCP_LISTS; list++) {
+			n += pcp->count[list];
+			bfa_pcp_drain(bfa, pcp, list, pcp->count[list]);
+		}
+		ukplat_spin_unlock_irqrestore(&pcp->lock, irqf);
+	}
+
+	return n;
+}
+
+static int bfa_pcp_alloc(struct buddy_framealloc *bfa, __paddr_t *paddr,
+			 int list)
+{
+	struct bfa_pcp *pcp = &bfa->pcp[ukplat_lcpu_idx()];
+	unsigned long irqf;
+	int rc = -ENOMEM;
+
+	ukplat_spin_lock_irqsave(&pcp->lock, irqf);
+	if (!pcp->count[list])
+		bfa_pcp_refill(bfa, pcp, list);
+
+	if (likely(pcp->count[list])) {
+		*paddr = pcp->frames[list][--pcp->count[list]];
+		rc = 0;
+	}
+	ukplat_spin_unlock_irqrestore(&pcp->lock, irqf);
+
+	return rc;
+}
+
+/* Puts the frame into the cache of the current lcpu. Returns a non-zero value
+ * if the frame cannot be cached and must be freed to the free lists, which
+ * properly report frames that are not managed by the allocator, not
+ * allocated, or part of a larger allocation.
+ */
+static int bfa_pcp_free(struct buddy_framealloc *bfa, __paddr_t paddr,
+			int list)
+{
+	unsigned int lvl = BFA_PCP_LVL(list);
+	struct bfa_zone *zone, *start;
+	struct bfa_pcp *pcp;
+	bfa_zbit_word_t word;
+	unsigned long irqf;
+	unsigned int idx, i;
+
+	if (unlikely(!BFA_Lx_ALIGNED(paddr, lvl)))
+		return 1;
+
+	/* Unlike bfa_paddr_to_zone(), do not move the zone list head, which
+	 * is protected by the allocator lock. Zones are never removed.
+	 */
+	zone = start = __atomic_load_n(&bfa->zones, __ATOMIC_RELAXED);
+	if (unlikely(!zone))
+		return 1;
+
+	while ((paddr < zone->start) || (paddr >= zone->end)) {
+		zone = zone->next;
+		if (unlikely(zone == start))
+			return 1;
+	}
+
+	/* The frame must be allocated with exactly this size. The bit is not
+	 * modified by other lcpus while the frame is allocated.
+	 */
+	idx  = BFA_Lx_ZBIT_IDX(zone, paddr, lvl);
+	word = __atomic_load_n(BFA_Lx_ZBIT_WORD(zone, lvl, idx),
+			       __ATOMIC_RELAXED);
+	if (unlikely(!(word & BFA_ZBIT_MASK(idx))))
+		return 1;
+
+	pcp = &bfa->pcp[ukplat_lcpu_idx()];
+	ukplat_spin_lock_irqsave(&pcp->lock, irqf);
+
+	/* Catch frames that are freed twice on this lcpu, e.g., due to
+	 * multiple mappings of the same frame
+	 */
+	for (i = 0; i < pcp->count[list]; i++) {
+		if (unlikely(pcp->frames[list][i] == paddr)) {
+			ukplat_spin_unlock_irqrestore(&pcp->lock, irqf);
+			return -ENOMEM;
+		}
+	}
+
+	if (pcp->count[list] == BFA_PCP_HIGH(list))
+		bfa_pcp_drain(bfa, pcp, list, BFA_PCP_BATCH(list));
+
+	pcp->frames[list][pcp->count[list]++] = paddr;
+	ukplat_spin_unlock_irqrestore(&pcp->lock, irqf);
+
+	return 0;
+}
+#else /* !CONFIG_LIBUKFALLOCBUDDY_PCP */
+#define bfa_pcp_drain_all(bfa)		0
+#endif /* !CONFIG_LIBUKFALLOCBUDDY_PCP */
+
 static int bfa_alloc(struct uk_falloc *fa, __paddr_t *paddr,
-		     unsigned long frames, unsigned long flags __unused)
+		     unsigned long frames, unsigned long flags)
 {
 	struct buddy_framealloc *bfa = (struct buddy_framealloc *)fa;
+	unsigned long irqf;
+	unsigned int node;
 	__sz len;
+	int rc;
+#ifdef CONFIG_LIBUKFALLOCBUDDY_PCP
+	int list;
+#endif /* CONFIG_LIBUKFALLOCBUDDY_PCP */
 
 	UK_ASSERT(frames > 0);
 	UK_ASSERT(frames <= (__SZ_MAX / PAGE_SIZE));
 
 	len = frames * PAGE_SIZE;
 
-	/* There is only FALLOC_FLAG_ALIGNED which we implicitly fulfill */
-	UK_ASSERT((flags == 0) || (flags == FALLOC_FLAG_ALIGNED));
-
-	/* If a physical address is given, the caller wants to allocate this
-	 * exact memory range. Otherwise, just take a free one from the list.
+	/* Besides the node, there is only FALLOC_FLAG_ALIGNED which we
+	 * implicitly fulfill
 	 */
-	if (*paddr == __PADDR_ANY)
-		return bfa_do_alloc_any(bfa, paddr, len);
-	else
-		return bfa_do_alloc(bfa, *paddr, len);
+	UK_ASSERT(!(flags & ~(FALLOC_FLAG_ALIGNED | FALLOC_FLAG_NODE_MASK)));
+	node = bfa_flags_node(flags);
+
+#ifdef CONFIG_LIBUKFALLOCBUDDY_PCP
+	/* The cache only holds memory of the node of this lcpu */
+	if (*paddr == __PADDR_ANY && node == ukplat_numa_node()) {
+		list = bfa_pcp_list(frames);
+		if (list >= 0 && bfa_pcp_alloc(bfa, paddr, list) == 0)
+			return 0;
+	}
+#endif /* CONFIG_LIBUKFALLOCBUDDY_PCP */
+
+	do {
+		ukplat_spin_lock_irqsave(&bfa->lock, irqf);
+
+		/* If a physical address is given, the caller wants to allocate
+		 * this exact memory range. Otherwise, just take a free one
+		 * from the list.
+		 */
+		if (*paddr == __PADDR_ANY)
+			rc = bfa_do_alloc_any(bfa, paddr, len, node);
+		else
+			rc = bfa_do_alloc(bfa, *paddr, len);
+
+		if (rc == 0)
+			bfa_update_max_used(bfa);
+
+		ukplat_spin_unlock_irqrestore(&bfa->lock, irqf);
+	} while (rc == -ENOMEM && bfa_pcp_drain_all(bfa));
+
+	return rc;
 }
 
 static int bfa_do_alloc_any_in_range(struct buddy_framealloc *bfa,
@@ -1274,24 +1605,39 @@ static int bfa_alloc_from_range(struct uk_falloc *fa, __paddr_t *paddr,
 				__paddr_t min, __paddr_t max)
 {
 	struct buddy_framealloc *bfa = (struct buddy_framealloc *)fa;
+	unsigned long irqf;
 	__sz len;
+	int rc;
 
 	UK_ASSERT(frames > 0);
 	UK_ASSERT(frames <= (__SZ_MAX / PAGE_SIZE));
 
 	len = frames * PAGE_SIZE;
 
-	/* There is only FALLOC_FLAG_ALIGNED which we implicitly fulfill */
-	UK_ASSERT((flags == 0) || (flags == FALLOC_FLAG_ALIGNED));
+	/* There is only FALLOC_FLAG_ALIGNED which we implicitly fulfill. The
+	 * range takes precedence over a node.
+	 */
+	UK_ASSERT(!(flags & ~(FALLOC_FLAG_ALIGNED | FALLOC_FLAG_NODE_MASK)));
 
 	UK_ASSERT(min <= max);
 
-	return bfa_do_alloc_any_in_range(bfa, paddr, len, min, max);
+	do {
+		ukplat_spin_lock_irqsave(&bfa->lock, irqf);
+
+		rc = bfa_do_alloc_any_in_range(bfa, paddr, len, min, max);
+		if (rc == 0)
+			bfa_update_max_used(bfa);
+
+		ukplat_spin_unlock_irqrestore(&bfa->lock, irqf);
+	} while (rc == -ENOMEM && bfa_pcp_drain_all(bfa));
+
+	return rc;
 }
 
 static struct bfa_memblock *bfa_try_merge(struct buddy_framealloc *bfa,
 					  struct bfa_zone *zone,
-					  __paddr_t paddr, unsigned int *level)
+					  __paddr_t paddr, unsigned int *level,
+					  unsigned int *reported)
 {
 	struct bfa_memblock *mb, *bmb;
 	unsigned int lvl = *level, tmp_lvl;
@@ -1336,6 +1682,9 @@ static struct bfa_memblock *bfa_try_merge(struct buddy_framealloc *bfa,
 		if (bmb->level < lvl)
 			break;
 
+		/* The merged block is only reported if both buddies are */
+		*reported &= bmb->reported;
+
 		/* We can merge. Remove the memory block from the free list and
 		 * go up one level. We set the output memory block to the one
 		 * representing the area at the next higher level (i.e., the
@@ -1358,7 +1707,7 @@ static int bfa_do_free(struct buddy_framealloc *bfa, __paddr_t paddr, __sz len)
 {
 	struct bfa_memblock *mb;
 	struct bfa_zone *zone;
-	unsigned int lvl;
+	unsigned int lvl, reported;
 	unsigned int saved_lvl __maybe_unused;
 	__sz size;
 	int rc;
@@ -1395,7 +1744,8 @@ static int bfa_do_free(struct buddy_framealloc *bfa, __paddr_t paddr, __sz len)
 		saved_lvl = lvl;
 
 		/* Merge the block if possible and add it to the free list */
-		mb = bfa_try_merge(bfa, zone, paddr, &lvl);
+		reported = 0;
+		mb = bfa_try_merge(bfa, zone, paddr, &lvl, &reported);
 		mb->level = lvl;
 #ifdef BFA_DIRECT_MAPPED
 		mb->zone = zone;
@@ -1403,7 +1753,7 @@ static int bfa_do_free(struct buddy_framealloc *bfa, __paddr_t paddr, __sz len)
 
 		UK_ASSERT(lvl >= saved_lvl);
 
-		bfa_fl_add(bfa, mb);
+		bfa_fl_add(bfa, zone, mb);
 
 #ifdef CONFIG_LIBUKFALLOCBUDDY_STATS
 		zone->nr_frees[saved_lvl][lvl]++;
@@ -1420,7 +1770,12 @@ static int bfa_free(struct uk_falloc *fa, __paddr_t paddr,
 		    unsigned long frames)
 {
 	struct buddy_framealloc *bfa = (struct buddy_framealloc *)fa;
+	unsigned long irqf;
 	__sz len;
+	int rc;
+#ifdef CONFIG_LIBUKFALLOCBUDDY_PCP
+	int list;
+#endif /* CONFIG_LIBUKFALLOCBUDDY_PCP */
 
 	if (unlikely(frames == 0))
 		return 0;
@@ -1429,7 +1784,20 @@ static int bfa_free(struct uk_falloc *fa, __paddr_t paddr,
 
 	len = frames * PAGE_SIZE;
 
-	return bfa_do_free(bfa, paddr, len);
+#ifdef CONFIG_LIBUKFALLOCBUDDY_PCP
+	list = bfa_pcp_list(frames);
+	if (list >= 0) {
+		rc = bfa_pcp_free(bfa, paddr, list);
+		if (rc <= 0)
+			return rc;
+	}
+#endif /* CONFIG_LIBUKFALLOCBUDDY_PCP */
+
+	ukplat_spin_lock_irqsave(&bfa->lock, irqf);
+	rc = bfa_do_free(bfa, paddr, len);
+	ukplat_spin_unlock_irqrestore(&bfa->lock, irqf);
+
+	return rc;
 }
 
 static int bfa_do_addmem(struct buddy_framealloc *bfa, void *metadata,
@@ -1460,7 +1828,9 @@ static int bfa_addmem(struct uk_falloc *fa, void *metadata, __paddr_t paddr,
 		      unsigned long frames, __vaddr_t dm_off)
 {
 	struct buddy_framealloc *bfa = (struct buddy_framealloc *)fa;
+	unsigned long irqf;
 	__sz len;
+	int rc;
 
 	if (unlikely(frames == 0))
 		return 0;
@@ -1469,13 +1839,17 @@ static int bfa_addmem(struct uk_falloc *fa, void *metadata, __paddr_t paddr,
 
 	len = frames * PAGE_SIZE;
 
-	return bfa_do_addmem(bfa, metadata, paddr, len, dm_off);
+	ukplat_spin_lock_irqsave(&bfa->lock, irqf);
+	rc = bfa_do_addmem(bfa, metadata, paddr, len, dm_off);
+	ukplat_spin_unlock_irqrestore(&bfa->lock, irqf);
+
+	return rc;
 }
 
 int uk_fallocbuddy_init(struct uk_falloc *fa)
 {
 	struct buddy_framealloc *bfa = (struct buddy_framealloc *)fa;
-	unsigned int i;
+	unsigned int i, node;
 
 	bfa->fa.falloc = bfa_alloc;
 	bfa->fa.falloc_from_range = bfa_alloc_from_range;
@@ -1484,17 +1858,174 @@ int uk_fallocbuddy_init(struct uk_falloc *fa)
 
 	bfa->fa.free_memory = 0;
 	bfa->fa.total_memory = 0;
+	bfa->fa.max_used_memory = 0;
 
-	for (i = 0; i < BFA_LEVELS; i++)
-		UK_INIT_LIST_HEAD(&bfa->free_list[i]);
+	for (node = 0; node < BFA_NODES; node++) {
+		for (i = 0; i < BFA_LEVELS; i++)
+			UK_INIT_LIST_HEAD(&bfa->free_list[node][i]);
 
-	bfa->free_list_map = 0;
+		bfa->free_list_map[node] = 0;
+	}
 
 	bfa->zones = __NULL;
 
+	ukarch_spin_init(&bfa->lock);
+
+#ifdef CONFIG_LIBUKFALLOCBUDDY_PCP
+	for (i = 0; i < CONFIG_UKPLAT_LCPU_MAXCOUNT; i++) {
+		ukarch_spin_init(&bfa->pcp[i].lock);
+		memset(bfa->pcp[i].count, 0, sizeof(bfa->pcp[i].count));
+	}
+#endif /* CONFIG_LIBUKFALLOCBUDDY_PCP */
+
 	return 0;
 }
 
+unsigned long uk_fallocbuddy_isolate_unreported(struct uk_falloc *fa,
+						unsigned int order,
+						__paddr_t *paddrs,
+						unsigned int *orders,
+						unsigned long max,
+						__sz reserve)
+{
+	struct buddy_framealloc *bfa = (struct buddy_framealloc *)fa;
+	struct bfa_memblock *mb, *tmp;
+	struct bfa_zone *zone;
+	unsigned long n = 0, irqf;
+	unsigned int lvl, min_lvl, node;
+	__paddr_t paddr;
+
+	UK_ASSERT(paddrs);
+	UK_ASSERT(orders);
+
+	if (unlikely(order < PAGE_SHIFT))
+		order = PAGE_SHIFT;
+
+	min_lvl = bfa_order_to_lvl(order);
+	if (unlikely(min_lvl >= BFA_LEVELS))
+		return 0;
+
+	ukplat_spin_lock_irqsave(&bfa->lock, irqf);
+
+	/* Start with the largest blocks to report as much memory as possible
+	 * with the given number of blocks
+	 */
+	lvl = BFA_LEVELS;
+	while (lvl-- > min_lvl && n < max) {
+		for (node = 0; node < BFA_NODES; node++) {
+			uk_list_for_each_entry_safe(mb, tmp,
+						    &bfa->free_list[node][lvl],
+						    link) {
+				if (n == max ||
+				    bfa->fa.free_memory <
+				    reserve + BFA_Lx_SIZE(lvl))
+					break;
+
+				UK_ASSERT(mb->level == lvl);
+				if (mb->reported)
+					continue;
+
+				zone = bfa_mb_to_zone(bfa, mb);
+				paddr = bfa_mb_to_paddr(zone, mb);
+
+				/* The block is marked as allocated so that the
+				 * hypervisor may discard its contents, which
+				 * include the memblock in direct-mapped mode
+				 */
+				bfa_fl_del(bfa, mb);
+				bfa_zbit_alloc(zone, paddr, lvl);
+
+				paddrs[n] = paddr;
+				orders[n] = BFA_Lx_SHIFT(lvl);
+				n++;
+			}
+		}
+	}
+
+	ukplat_spin_unlock_irqrestore(&bfa->lock, irqf);
+
+	return n;
+}
+
+void uk_fallocbuddy_putback_reported(struct uk_falloc *fa,
+				     const __paddr_t *paddrs,
+				     const unsigned int *orders,
+				     unsigned long count)
+{
+	struct buddy_framealloc *bfa = (struct buddy_framealloc *)fa;
+	struct bfa_memblock *mb;
+	struct bfa_zone *zone;
+	unsigned int lvl, reported;
+	unsigned long i, irqf;
+	int rc __maybe_unused;
+
+	ukplat_spin_lock_irqsave(&bfa->lock, irqf);
+	for (i = 0; i < count; i++) {
+		lvl = bfa_order_to_lvl(orders[i]);
+		UK_ASSERT(lvl < BFA_LEVELS);
+
+		zone = bfa_paddr_to_zone(bfa, paddrs[i]);
+		UK_ASSERT(zone);
+
+		rc = bfa_zbit_free(zone, paddrs[i], lvl);
+		UK_ASSERT(rc == 0);
+
+		reported = 1;
+		mb = bfa_try_merge(bfa, zone, paddrs[i], &lvl, &reported);
+		mb->level = lvl;
+#ifdef BFA_DIRECT_MAPPED
+		mb->zone = zone;
+#endif /* BFA_DIRECT_MAPPED */
+
+		if (reported)
+			bfa_fl_add_reported(bfa, zone, mb);
+		else
+			bfa_fl_add(bfa, zone, mb);
+	}
+	ukplat_spin_unlock_irqrestore(&bfa->lock, irqf);
+}
+
+void uk_fallocbuddy_update_nodes(struct uk_falloc *fa)
+{
+	struct buddy_framealloc *bfa = (struct buddy_framealloc *)fa;
+	struct bfa_memblock *mb, *tmp;
+	struct bfa_zone *zone;
+	unsigned int lvl, node, reported;
+	unsigned long irqf;
+	__paddr_t paddr;
+
+	ukplat_spin_lock_irqsave(&bfa->lock, irqf);
+	for (lvl = 0; lvl < BFA_LEVELS; lvl++) {
+		for (node = 0; node < BFA_NODES; node++) {
+			uk_list_for_each_entry_safe(mb, tmp,
+						    &bfa->free_list[node][lvl],
+						    link) {
+				zone = bfa_mb_to_zone(bfa, mb);
+				paddr = bfa_mb_to_paddr(zone, mb);
+				if (bfa_paddr_node(paddr) == node)
+					continue;
+
+				/* Relink the block into the lists of its
+				 * node. Deleting it may clobber the memblock.
+				 */
+				reported = mb->reported;
+				bfa_fl_del(bfa, mb);
+
+				mb->level = lvl;
+#ifdef BFA_DIRECT_MAPPED
+				mb->zone = zone;
+#endif /* BFA_DIRECT_MAPPED */
+
+				if (reported)
+					bfa_fl_add_reported(bfa, zone, mb);
+				else
+					bfa_fl_add(bfa, zone, mb);
+			}
+		}
+	}
+	ukplat_spin_unlock_irqrestore(&bfa->lock, irqf);
+}
+
 __sz uk_fallocbuddy_size(void)
 {
 	return sizeof(struct buddy_framealloc);
@@ -69,6 +69,53 @@ __sz uk_fallocbuddy_size(void);
  */
 __sz uk_fallocbuddy_metadata_size(unsigned long frames);
 
+/**
+ * Takes free blocks that were not reported to the hypervisor yet out of the
+ * free lists. This is used for free page reporting: The blocks are reported
+ * and then handed back with uk_fallocbuddy_putback_reported(). Blocks remain
+ * marked as reported until they are allocated again, so that they are not
+ * reported twice.
+ *
+ * @param fa the buddy frame allocator
+ * @param order the minimum order (log2 of the size in bytes) of the blocks
+ * @param [out] paddrs receives the start addresses of the blocks
+ * @param [out] orders receives the orders of the blocks
+ * @param max the maximum number of blocks to take
+ * @param reserve the amount of free memory in bytes that is not taken
+ *
+ * @return the number of blocks taken
+ */
+unsigned long uk_fallocbuddy_isolate_unreported(struct uk_falloc *fa,
+						unsigned int order,
+						__paddr_t *paddrs,
+						unsigned int *orders,
+						unsigned long max,
+						__sz reserve);
+
+/**
+ * Returns blocks taken with uk_fallocbuddy_isolate_unreported() to the free
+ * lists and marks them as reported. Blocks that were not reported must be
+ * released with ffree() instead.
+ *
+ * @param fa the buddy frame allocator
+ * @param paddrs the start addresses of the blocks
+ * @param orders the orders of the blocks
+ * @param count the number of blocks
+ */
+void uk_fallocbuddy_putback_reported(struct uk_falloc *fa,
+				     const __paddr_t *paddrs,
+				     const unsigned int *orders,
+				     unsigned long count);
+
+/**
+ * Relinks the free blocks into the free lists of their NUMA nodes. Memory
+ * is usually added before the NUMA topology is known. The platform calls
+ * this function once it is.
+ *
+ * @param fa the buddy frame allocator
+ */
+void uk_fallocbuddy_update_nodes(struct uk_falloc *fa);
+
 #ifdef __cplusplus
 }
 #endif
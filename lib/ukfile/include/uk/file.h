@@ -72,6 +72,28 @@ typedef int (*uk_file_setstat_func)(const struct uk_file *f,
  */
 #define UKFILE_CTL_FILE_FADVISE 3
 
+/*
+ * MMAP((off_t)offset, (size_t)len, (void **)addr)
+ * Get the address of `len` bytes of memory the file exposes at `offset`.
+ * Used by files backed by memory shared with the application.
+ */
+#define UKFILE_CTL_FILE_MMAP 4
+
+/*
+ * PIPE_SZ((size_t)size, void, void)
+ * Resize a pipe to hold at least `size` bytes, or query if `size` is 0.
+ * Returns the resulting capacity.
+ */
+#define UKFILE_CTL_FILE_PIPE_SZ 5
+
+/*
+ * BUSY_POLL((int)poll, void, void)
+ * Return the time in microseconds readers of the file should busy poll for
+ * before sleeping, 0 if they should not. If `poll` is nonzero, first make
+ * one non-blocking pass over the receive path feeding the file.
+ */
+#define UKFILE_CTL_FILE_BUSY_POLL 6
+
 typedef int (*uk_file_ctl_func)(const struct uk_file *f, int fam, int req,
 				uintptr_t arg1, uintptr_t arg2, uintptr_t arg3);
 
@@ -60,10 +60,21 @@ struct uk_poll_chain;
  * @param ev The events that triggered this update.
  * @param op Whether `events` are being set or cleared.
  * @param tick The update chaining ticket this callback is registered with.
+ *
+ * @return
+ *   Non-zero if the update reached a waiter, zero otherwise.
+ *   Only taken into account for exclusive tickets.
  */
-typedef void (*uk_poll_chain_callback_fn)(uk_pollevent ev,
-					  enum uk_poll_chain_op op,
-					  struct uk_poll_chain *tick);
+typedef int (*uk_poll_chain_callback_fn)(uk_pollevent ev,
+					 enum uk_poll_chain_op op,
+					 struct uk_poll_chain *tick);
+
+/*
+ * Exclusive ticket: when events are set, exclusive tickets are notified in
+ * registration order only until one of them reaches a waiter; the remaining
+ * exclusive tickets are skipped. Non-exclusive tickets are always notified.
+ */
+#define UK_POLL_CHAINF_EXCLUSIVE 0x01
 
 /**
  * Ticket for registering on the update chaining list.
@@ -78,6 +89,7 @@ struct uk_poll_chain {
 	struct uk_poll_chain *next;
 	uk_pollevent mask; /* Events to register for */
 	enum uk_poll_chain_type type;
+	unsigned int flags; /* UK_POLL_CHAINF_* */
 	union {
 		struct {
 			struct uk_pollq *queue; /* Where to propagate updates */
@@ -97,6 +109,7 @@ struct uk_poll_chain {
 	.next = NULL, \
 	.mask = (msk), \
 	.type = UK_POLL_CHAINTYPE_UPDATE, \
+	.flags = 0, \
 	.queue = (to), \
 	.set = (ev) \
 }
@@ -108,6 +121,7 @@ struct uk_poll_chain {
 	.next = NULL, \
 	.mask = (msk), \
 	.type = UK_POLL_CHAINTYPE_CALLBACK, \
+	.flags = 0, \
 	.callback = (cb), \
 	.arg = (dat) \
 }
@@ -547,6 +561,19 @@ uk_pollevent uk_pollq_clear(struct uk_pollq *q, uk_pollevent clr);
  */
 uk_pollevent uk_pollq_set_n(struct uk_pollq *q, uk_pollevent set, int n);
 
+/**
+ * Update events like `uk_pollq_set_n`, reporting how many waiters were reached.
+ *
+ * @param q Target queue.
+ * @param set Events to set.
+ * @param n Maximum number of threads to wake up. If < 0 wake up all threads.
+ *
+ * @return
+ *   The number of threads woken up, plus the number of chained tickets whose
+ *   update reached a waiter.
+ */
+int uk_pollq_set_wake_n(struct uk_pollq *q, uk_pollevent set, int n);
+
 /**
  * Replace the events in `q` with `val` and handle notifications.
  *
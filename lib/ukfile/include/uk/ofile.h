@@ -15,6 +15,7 @@
 
 struct uk_ofile {
 	const struct uk_file *file;
+	const struct uk_file_ops *ops; /* Cached `file->ops` for fast I/O */
 	unsigned int mode;
 	__atomic refcnt;
 	off_t pos;
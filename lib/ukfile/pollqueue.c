@@ -8,8 +8,10 @@
 
 #include <uk/assert.h>
 
-static void pollq_notify_n(struct uk_pollq *q, uk_pollevent set, int n)
+static int pollq_notify_n(struct uk_pollq *q, uk_pollevent set, int n)
 {
+	int woken = 0;
+
 	uk_rwlock_wlock(&q->waitlock);
 	if (q->waitmask & set) {
 		/* Walk wait list, wake up & collect */
@@ -24,6 +26,7 @@ static void pollq_notify_n(struct uk_pollq *q, uk_pollevent set, int n)
 				*p = t->next;
 				t->next = NULL;
 				uk_thread_wake(t->thread);
+				woken++;
 				n--;
 			} else {
 				seen |= t->mask;
@@ -39,15 +42,19 @@ static void pollq_notify_n(struct uk_pollq *q, uk_pollevent set, int n)
 	}
 done:
 	uk_rwlock_wunlock(&q->waitlock);
+	return woken;
 }
 
 #if CONFIG_LIBUKFILE_CHAINUPDATE
-static void pollq_propagate(struct uk_pollq *q,
-			    enum uk_poll_chain_op op, uk_pollevent set)
+static int pollq_propagate(struct uk_pollq *q,
+			   enum uk_poll_chain_op op, uk_pollevent set)
 {
+	int reached = 0;
+
 	uk_rwlock_wlock(&q->proplock);
 	if (q->propmask & set) {
 		uk_pollevent seen;
+		int excl_done = 0;
 
 		/* Tag this queue in case of chaining loops */
 		UK_ASSERT(!q->_tag);
@@ -57,8 +64,12 @@ static void pollq_propagate(struct uk_pollq *q,
 		for (struct uk_poll_chain **p = &q->prop; *p; p = &(*p)->next) {
 			struct uk_poll_chain *t = *p;
 			uk_pollevent req = set & t->mask;
+			const int excl = op == UK_POLL_CHAINOP_SET &&
+					 (t->flags & UK_POLL_CHAINF_EXCLUSIVE);
+			int r = 0;
 
-			if (req) {
+			/* Only one exclusive ticket needs to reach a waiter */
+			if (req && !(excl && excl_done)) {
 				switch (t->type) {
 				case UK_POLL_CHAINTYPE_UPDATE:
 				{
@@ -69,15 +80,22 @@ static void pollq_propagate(struct uk_pollq *q,
 						uk_pollq_clear(t->queue, ev);
 						break;
 					case UK_POLL_CHAINOP_SET:
-						uk_pollq_set(t->queue, ev);
+						r = uk_pollq_set_wake_n(
+							t->queue, ev,
+							UK_POLLQ_NOTIFY_ALL);
 						break;
 					}
 				}
 					break;
 				case UK_POLL_CHAINTYPE_CALLBACK:
-					t->callback(req, op, t);
+					r = t->callback(req, op, t);
 					break;
 				}
+				if (r) {
+					reached++;
+					if (excl)
+						excl_done = 1;
+				}
 			}
 			seen |= t->mask;
 		}
@@ -85,6 +103,7 @@ static void pollq_propagate(struct uk_pollq *q,
 		q->_tag = NULL; /* Clear tag */
 	}
 	uk_rwlock_wunlock(&q->proplock);
+	return reached;
 }
 #endif /* CONFIG_LIBUKFILE_CHAINUPDATE */
 
@@ -98,10 +117,12 @@ uk_pollevent uk_pollq_clear(struct uk_pollq *q, uk_pollevent clr)
 	return prev;
 }
 
-uk_pollevent uk_pollq_set_n(struct uk_pollq *q, uk_pollevent set, int n)
+static uk_pollevent pollq_set(struct uk_pollq *q, uk_pollevent set, int n,
+			      int *reached)
 {
 	uk_pollevent prev;
 
+	*reached = 0;
 	if (!set)
 		return 0;
 
@@ -111,13 +132,28 @@ uk_pollevent uk_pollq_set_n(struct uk_pollq *q, uk_pollevent set, int n)
 #endif /* CONFIG_LIBUKFILE_CHAINUPDATE */
 
 	prev = uk_or(&q->events, set);
-	pollq_notify_n(q, set, n);
+	*reached += pollq_notify_n(q, set, n);
 #if CONFIG_LIBUKFILE_CHAINUPDATE
-	pollq_propagate(q, UK_POLL_CHAINOP_SET, set);
+	*reached += pollq_propagate(q, UK_POLL_CHAINOP_SET, set);
 #endif /* CONFIG_LIBUKFILE_CHAINUPDATE */
 	return prev;
 }
 
+uk_pollevent uk_pollq_set_n(struct uk_pollq *q, uk_pollevent set, int n)
+{
+	int reached;
+
+	return pollq_set(q, set, n, &reached);
+}
+
+int uk_pollq_set_wake_n(struct uk_pollq *q, uk_pollevent set, int n)
+{
+	int reached;
+
+	(void)pollq_set(q, set, n, &reached);
+	return reached;
+}
+
 uk_pollevent uk_pollq_assign_n(struct uk_pollq *q, uk_pollevent val, int n)
 {
 	uk_pollevent prev = uk_exchange_n(&q->events, val);
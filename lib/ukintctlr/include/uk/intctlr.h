@@ -13,6 +13,7 @@ export "C" {
 
 #ifndef __ASSEMBLY__
 
+#include <uk/config.h>
 #include <uk/alloc.h>
 #include <uk/essentials.h>
 #include <uk/plat/lcpu.h>
@@ -56,6 +57,13 @@ struct uk_intctlr_driver_ops {
 			struct uk_intctlr_irq *irq);
 	void (*mask_irq)(unsigned int irq);
 	void (*unmask_irq)(unsigned int irq);
+	/* optional */
+	int (*msi_compose)(unsigned int irq, __lcpuidx lcpu, __u32 devid,
+			   __u64 *addr, __u32 *data);
+	/* optional, called once the memory allocator is available */
+	int (*init)(struct uk_alloc *a);
+	/* optional */
+	int (*set_affinity)(unsigned int irq, __lcpuidx lcpu);
 };
 
 /** Interrupt controller descriptor */
@@ -150,6 +158,33 @@ void uk_intctlr_irq_mask(unsigned int irq);
  */
 void uk_intctlr_irq_unmask(unsigned int irq);
 
+/**
+ * Route an interrupt to a logical CPU
+ *
+ * The handlers of the interrupt are then run on that CPU, e.g., the one
+ * that owns the device queue signaled by the interrupt. Per-CPU
+ * interrupts (e.g., timers and IPIs) cannot be routed. The destination of
+ * a message signaled interrupt is usually part of its message, set with
+ * uk_intctlr_irq_msi_compose().
+ *
+ * @param irq  Interrupt to route
+ * @param lcpu Index of the logical CPU that receives the interrupt
+ * @return zero on success, -ENOTSUP if the interrupt controller cannot
+ *         route the interrupt, or negative value on error
+ */
+int uk_intctlr_irq_set_affinity(unsigned int irq, __lcpuidx lcpu);
+
+#if CONFIG_LIBUKINTCTLR_IRQ_COUNTS
+/**
+ * Return the number of times an interrupt was handled on a logical CPU
+ *
+ * @param irq  Interrupt to query
+ * @param lcpu Index of the logical CPU
+ * @return the number of times the interrupt was handled
+ */
+__u64 uk_intctlr_irq_count(unsigned int irq, __lcpuidx lcpu);
+#endif /* CONFIG_LIBUKINTCTLR_IRQ_COUNTS */
+
 /**
  * Allocate IRQs from available pool
  *
@@ -168,6 +203,23 @@ int uk_intctlr_irq_alloc(unsigned int *irqs, __sz count);
  */
 int uk_intctlr_irq_free(unsigned int *irqs, __sz count);
 
+/**
+ * Compose the message that a device writes to signal an IRQ as a message
+ * signaled interrupt (MSI / MSI-X)
+ *
+ * @param irq   the IRQ, usually obtained with uk_intctlr_irq_alloc()
+ * @param lcpu  index of the logical CPU that receives the IRQ
+ * @param devid ID of the device that sends the message, e.g., the PCI
+ *              requester ID. Ignored by interrupt controllers that do not
+ *              translate messages per device
+ * @param addr  receives the message address
+ * @param data  receives the message data
+ * @return zero on success, -ENOTSUP if the interrupt controller does not
+ *         support MSIs, or negative value on error
+ */
+int uk_intctlr_irq_msi_compose(unsigned int irq, __lcpuidx lcpu, __u32 devid,
+			       __u64 *addr, __u32 *data);
+
 /**
  * Translate from `interrupts` fdt node to IRQ descriptor
  *
@@ -73,6 +73,17 @@ struct irq_handler {
 
 static struct irq_handler irq_handlers[MAX_IRQ][MAX_HANDLERS_PER_IRQ];
 
+#if CONFIG_LIBUKINTCTLR_IRQ_COUNTS
+/* Each lcpu counts the IRQs that it handles in cache lines of its own, so
+ * that counting does not move cache lines between CPUs
+ */
+struct __align64 irq_counts {
+	__u64 count[MAX_IRQ + 1];
+};
+
+static UKPLAT_PER_LCPU_DEFINE(struct irq_counts, irq_counts);
+#endif /* CONFIG_LIBUKINTCTLR_IRQ_COUNTS */
+
 static inline struct irq_handler *allocate_handler(unsigned long irq)
 {
 	UK_ASSERT(irq <= MAX_IRQ);
@@ -170,6 +181,13 @@ void uk_intctlr_irq_handle(struct __regs *regs, unsigned int irq)
 
 	UK_ASSERT(irq <= MAX_IRQ);
 
+#if CONFIG_LIBUKINTCTLR_IRQ_COUNTS
+	/* Interrupts are disabled, so we are the only writer */
+	__atomic_store_n(&ukplat_per_lcpu_current(irq_counts).count[irq],
+			 ukplat_per_lcpu_current(irq_counts).count[irq] + 1,
+			 __ATOMIC_RELAXED);
+#endif /* CONFIG_LIBUKINTCTLR_IRQ_COUNTS */
+
 	ctx.regs = regs;
 	ctx.irq = irq;
 	rc = uk_raise_event(UK_INTCTLR_EVENT_IRQ, &ctx);
@@ -232,6 +250,30 @@ void uk_intctlr_irq_unmask(unsigned int irq)
 	return uk_intctlr->ops->unmask_irq(irq);
 }
 
+int uk_intctlr_irq_set_affinity(unsigned int irq, __lcpuidx lcpu)
+{
+	UK_ASSERT(uk_intctlr && uk_intctlr->ops);
+	UK_ASSERT(irq <= MAX_IRQ);
+
+	if (unlikely(lcpu >= ukplat_lcpu_count()))
+		return -EINVAL;
+	if (!uk_intctlr->ops->set_affinity)
+		return -ENOTSUP;
+
+	return uk_intctlr->ops->set_affinity(irq, lcpu);
+}
+
+#if CONFIG_LIBUKINTCTLR_IRQ_COUNTS
+__u64 uk_intctlr_irq_count(unsigned int irq, __lcpuidx lcpu)
+{
+	UK_ASSERT(irq <= MAX_IRQ);
+	UK_ASSERT(lcpu < ukplat_lcpu_count());
+
+	return __atomic_load_n(&ukplat_per_lcpu(irq_counts, lcpu).count[irq],
+			       __ATOMIC_RELAXED);
+}
+#endif /* CONFIG_LIBUKINTCTLR_IRQ_COUNTS */
+
 int uk_intctlr_irq_configure(struct uk_intctlr_irq *irq)
 {
 	UK_ASSERT(uk_intctlr && uk_intctlr->ops);
@@ -294,12 +336,27 @@ int uk_intctlr_irq_free(unsigned int *irqs, __sz count)
 	return !rc;
 }
 
-int uk_intctlr_init(struct uk_alloc *a __unused)
+int uk_intctlr_irq_msi_compose(unsigned int irq, __lcpuidx lcpu, __u32 devid,
+			       __u64 *addr, __u32 *data)
+{
+	UK_ASSERT(uk_intctlr && uk_intctlr->ops);
+	UK_ASSERT(addr);
+	UK_ASSERT(data);
+
+	if (!uk_intctlr->ops->msi_compose)
+		return -ENOTSUP;
+
+	return uk_intctlr->ops->msi_compose(irq, lcpu, devid, addr, data);
+}
+
+int uk_intctlr_init(struct uk_alloc *a)
 {
 	UK_ASSERT(uk_intctlr);
 	UK_ASSERT(ukplat_lcpu_irqs_disabled());
 
-	/* Nothing for now */
+	if (uk_intctlr->ops->init)
+		return uk_intctlr->ops->init(a);
+
 	return 0;
 }
 
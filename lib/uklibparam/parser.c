@@ -52,9 +52,39 @@ static UK_LIST_HEAD(ld_head);
 #define PARSE_STOP         "--"
 #define PARSE_USAGE        "help"
 
+/*
+ * Parameters are looked up in an open-addressing hash table over
+ * "prefix.name", so that the cost of an argument does not depend on the
+ * number of parameters. The parser must work without an allocator, so the
+ * table is static. It is built from the registered library descriptors when
+ * the first argument is looked up. If there are too many parameters for the
+ * table, lookups fall back to scanning the descriptors.
+ */
+#define PARAM_HASH_SIZE    CONFIG_LIBUKLIBPARAM_HASH_SIZE
+#define PARAM_HASH_MAXLOAD ((PARAM_HASH_SIZE * 3) / 4)
+
+UK_CTASSERT(PARAM_HASH_SIZE > 0 &&
+	    (PARAM_HASH_SIZE & (PARAM_HASH_SIZE - 1)) == 0);
+
+struct param_hash_slot {
+	struct uk_libparam_libdesc *ld;
+	struct uk_libparam_param *p;
+	__u32 hash;
+};
+
+enum param_hash_state {
+	PHS_INVALID = 0,	/* Not built yet or outdated */
+	PHS_VALID,		/* All parameters are in the table */
+	PHS_OVERFLOW,		/* Too many parameters, scan descriptors */
+};
+
+static struct param_hash_slot param_hash[PARAM_HASH_SIZE];
+static enum param_hash_state param_hash_state = PHS_INVALID;
+
 void _uk_libparam_libsec_register(struct uk_libparam_libdesc *ld)
 {
 	uk_list_add_tail(&ld->next, &ld_head);
+	param_hash_state = PHS_INVALID;
 }
 
 static const char *str_param_type(enum uk_libparam_param_type pt)
@@ -200,6 +230,96 @@ static struct uk_libparam_param *find_libparam(struct uk_libparam_libdesc *ld,
 	return NULL;
 }
 
+/* FNV-1a over the library prefix, the separator, and the parameter name */
+static __u32 param_hash_fn(const char *libname, __sz libname_len,
+			   const char *paramname, __sz paramname_len)
+{
+	__u32 h = 2166136261U;
+	__sz i;
+
+	for (i = 0; i < libname_len; i++)
+		h = (h ^ (__u8)libname[i]) * 16777619U;
+	h = (h ^ (__u8)PARSE_PARAM_SEP) * 16777619U;
+	for (i = 0; i < paramname_len; i++)
+		h = (h ^ (__u8)paramname[i]) * 16777619U;
+	return h;
+}
+
+static void param_hash_build(void)
+{
+	struct uk_libparam_libdesc *ld;
+	struct uk_libparam_param *p;
+	__sz p_i, count = 0;
+	__u32 h, i;
+
+	memset(param_hash, 0x0, sizeof(param_hash));
+	UK_LIBPARAM_FOREACH_LIBDESC(ld) {
+		UK_LIBPARAM_FOREACH_PARAMIDX(ld, p_i) {
+			p = UK_LIBPARAM_PARAM_GET(ld, p_i);
+			UK_ASSERT(p);
+
+			if (unlikely(++count > PARAM_HASH_MAXLOAD)) {
+				uk_pr_debug("Too many parameters for hash table (%d slots)\n",
+					    PARAM_HASH_SIZE);
+				param_hash_state = PHS_OVERFLOW;
+				return;
+			}
+
+			/* Duplicates end up behind the first registration,
+			 * which thus wins like with a scan
+			 */
+			h = param_hash_fn(ld->prefix, strlen(ld->prefix),
+					  p->name, strlen(p->name));
+			for (i = h & (PARAM_HASH_SIZE - 1); param_hash[i].p;
+			     i = (i + 1) & (PARAM_HASH_SIZE - 1))
+				;
+			param_hash[i].ld = ld;
+			param_hash[i].p = p;
+			param_hash[i].hash = h;
+		}
+	}
+	param_hash_state = PHS_VALID;
+}
+
+/* Looks up `libname.paramname`, neither of which needs to be terminated */
+static int find_param(const char *libname, __sz libname_len,
+		      const char *paramname, __sz paramname_len,
+		      struct uk_libparam_libdesc **ld,
+		      struct uk_libparam_param **p)
+{
+	struct param_hash_slot *slot;
+	__u32 h, i;
+
+	if (param_hash_state == PHS_INVALID)
+		param_hash_build();
+
+	if (unlikely(param_hash_state == PHS_OVERFLOW)) {
+		*ld = find_libdesc(libname, libname_len);
+		*p = *ld ? find_libparam(*ld, paramname, paramname_len) : NULL;
+		return (*ld && *p) ? 0 : -ENOENT;
+	}
+
+	h = param_hash_fn(libname, libname_len, paramname, paramname_len);
+	for (i = h & (PARAM_HASH_SIZE - 1); param_hash[i].p;
+	     i = (i + 1) & (PARAM_HASH_SIZE - 1)) {
+		slot = &param_hash[i];
+		if (slot->hash != h)
+			continue;
+		if ((strncmp(slot->ld->prefix, libname, libname_len) == 0)
+		    && (slot->ld->prefix[libname_len] == '\0')
+		    && (strncmp(slot->p->name, paramname, paramname_len) == 0)
+		    && (slot->p->name[paramname_len] == '\0')) {
+			*ld = slot->ld;
+			*p = slot->p;
+			return 0;
+		}
+	}
+
+	*ld = NULL;
+	*p = NULL;
+	return -ENOENT;
+}
+
 /*
  * Internal and stripped down version of strtoull that does not use `errno`.
  * The parsed integer value is returned on `result` and its sign on
@@ -597,12 +717,9 @@ static int parse_arg(struct parse_arg_ctx *ctx, char *strbuf, int scan_only)
 			 *       not allowed characters, or empty strings).
 			 */
 			if (!scan_only) {
-				ctx->ld = find_libdesc(libname, libname_len);
-				if (ctx->ld)
-					ctx->p = find_libparam(ctx->ld,
-							       paramname,
-							       paramname_len);
-				if (!ctx->ld || !ctx->p) {
+				if (find_param(libname, libname_len,
+					       paramname, paramname_len,
+					       &ctx->ld, &ctx->p) < 0) {
 					uk_pr_warn("Parameter %.*s.%.*s: Unknown or invalid\n",
 						(int) libname_len, libname,
 						(int) paramname_len, paramname);
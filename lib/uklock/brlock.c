@@ -0,0 +1,79 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <uk/brlock.h>
+#include <uk/assert.h>
+#include <uk/atomic.h>
+
+void uk_brlock_init(struct uk_brlock *brl)
+{
+	unsigned int i;
+
+	UK_ASSERT(brl);
+
+	for (i = 0; i < CONFIG_UKPLAT_LCPU_MAXCOUNT; i++)
+		brl->readers[i].n = 0;
+	brl->writer = 0;
+	uk_waitq_init(&brl->rwait);
+	uk_waitq_init(&brl->wwait);
+}
+
+static long brlock_nreaders(struct uk_brlock *brl)
+{
+	long nreaders = 0;
+	unsigned int i;
+
+	for (i = 0; i < CONFIG_UKPLAT_LCPU_MAXCOUNT; i++)
+		nreaders += __atomic_load_n(&brl->readers[i].n,
+					    __ATOMIC_SEQ_CST);
+	return nreaders;
+}
+
+void _uk_brlock_wake_writer(struct uk_brlock *brl)
+{
+	uk_waitq_wake_up(&brl->wwait);
+}
+
+/* A writer showed up after we incremented `n`: back out and wait for it */
+void _uk_brlock_rlock_slow(struct uk_brlock *brl, long *n)
+{
+	/* We have not yielded since incrementing `n`, so we are still on the
+	 * same lcpu and undo exactly the increment the writer may have seen
+	 */
+	for (;;) {
+		__atomic_sub_fetch(n, 1, __ATOMIC_SEQ_CST);
+		_uk_brlock_wake_writer(brl);
+
+		uk_waitq_wait_event(&brl->rwait, !uk_load_n(&brl->writer));
+
+		n = &brl->readers[ukplat_lcpu_idx()].n;
+		__atomic_add_fetch(n, 1, __ATOMIC_SEQ_CST);
+		if (!__atomic_load_n(&brl->writer, __ATOMIC_SEQ_CST))
+			return;
+	}
+}
+
+void uk_brlock_wlock(struct uk_brlock *brl)
+{
+	UK_ASSERT(brl);
+
+	/* Become the only writer; this also keeps new readers out */
+	while (uk_compare_exchange_sync(&brl->writer, 0, 1) != 1)
+		uk_waitq_wait_event(&brl->wwait, !uk_load_n(&brl->writer));
+
+	/* Wait for all readers to have left the lock */
+	uk_waitq_wait_event(&brl->wwait, brlock_nreaders(brl) == 0);
+}
+
+void uk_brlock_wunlock(struct uk_brlock *brl)
+{
+	UK_ASSERT(brl);
+	UK_ASSERT(brl->writer);
+
+	uk_store_n(&brl->writer, 0);
+	uk_waitq_wake_up(&brl->rwait);
+	uk_waitq_wake_up(&brl->wwait);
+}
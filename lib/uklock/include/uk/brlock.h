@@ -0,0 +1,123 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __UK_BRLOCK_H__
+#define __UK_BRLOCK_H__
+
+#include <uk/config.h>
+
+#if CONFIG_LIBUKLOCK_BRLOCK
+#include <uk/essentials.h>
+#include <uk/plat/lcpu.h>
+#include <uk/wait.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Big-reader lock
+ *
+ * A reader-writer lock for read-mostly data. Readers only increment and
+ * decrement a counter of the lcpu they run on, so read locking does not move
+ * cache lines between lcpus as long as there is no writer. Writers are
+ * expensive in turn: they have to wait for the readers of all lcpus to leave.
+ *
+ * A reader may be migrated to another lcpu while it holds the lock, so it
+ * may decrement a different counter than it incremented; only the sum of all
+ * counters is meaningful.
+ */
+struct uk_brlock {
+	/** Readers per lcpu, each on its own cache line */
+	struct __align64 {
+		long n;
+	} readers[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+	/** 1 while a writer holds or waits for the lock */
+	int writer;
+	/** Wait queue for readers, while there is a writer */
+	struct uk_waitq rwait;
+	/** Wait queue for writers, for readers to leave or another writer */
+	struct uk_waitq wwait;
+};
+
+#define UK_BRLOCK_INITIALIZER(name) \
+	((struct uk_brlock){ \
+		.readers = { { 0 } }, \
+		.writer = 0, \
+		.rwait = UK_WAIT_QUEUE_INITIALIZER((name).rwait), \
+		.wwait = UK_WAIT_QUEUE_INITIALIZER((name).wwait), \
+	})
+
+/**
+ * Initialize a big-reader lock
+ *
+ * @param brl
+ *   Big-reader lock to operate on
+ */
+void uk_brlock_init(struct uk_brlock *brl);
+
+void _uk_brlock_rlock_slow(struct uk_brlock *brl, long *n);
+void _uk_brlock_wake_writer(struct uk_brlock *brl);
+
+/**
+ * Acquire the big-reader lock for reading. Multiple readers can acquire the
+ * lock at the same time. Blocks while there is a writer
+ *
+ * @param brl
+ *   Big-reader lock to be acquired
+ */
+static inline void uk_brlock_rlock(struct uk_brlock *brl)
+{
+	long *n = &brl->readers[ukplat_lcpu_idx()].n;
+
+	/* Pairs with the writer setting `writer` before summing up the
+	 * counters: either we see the writer, or it sees our increment
+	 */
+	__atomic_add_fetch(n, 1, __ATOMIC_SEQ_CST);
+	if (unlikely(__atomic_load_n(&brl->writer, __ATOMIC_SEQ_CST)))
+		_uk_brlock_rlock_slow(brl, n);
+}
+
+/**
+ * Release the big-reader lock, which has previously been acquired by this
+ * thread for reading
+ *
+ * @param brl
+ *   Big-reader lock to be released
+ */
+static inline void uk_brlock_runlock(struct uk_brlock *brl)
+{
+	__atomic_sub_fetch(&brl->readers[ukplat_lcpu_idx()].n, 1,
+			   __ATOMIC_SEQ_CST);
+	if (unlikely(__atomic_load_n(&brl->writer, __ATOMIC_SEQ_CST)))
+		_uk_brlock_wake_writer(brl);
+}
+
+/**
+ * Acquire the big-reader lock for writing. Only a single writer can acquire
+ * the lock at the same time. Waits for all readers to leave
+ *
+ * @param brl
+ *   Big-reader lock to be acquired
+ */
+void uk_brlock_wlock(struct uk_brlock *brl);
+
+/**
+ * Release the big-reader lock, which has previously been acquired by this
+ * thread for writing
+ *
+ * @param brl
+ *   Big-reader lock to be released
+ */
+void uk_brlock_wunlock(struct uk_brlock *brl);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* CONFIG_LIBUKLOCK_BRLOCK */
+
+#endif /* __UK_BRLOCK_H__ */
@@ -0,0 +1,120 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __UK_LOCKPROF_H__
+#define __UK_LOCKPROF_H__
+
+#include <uk/config.h>
+#include <uk/arch/types.h>
+#include <uk/arch/time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Lock contention profiler. Every acquisition of a spinlock, mutex or
+ * reader-writer lock is accounted to the pair of the lock's address and the
+ * call site that acquired it. Per site, the profiler counts acquisitions and
+ * contended acquisitions and sums up the time spent waiting for and holding
+ * the lock. Both addresses are printed in hex and can be resolved against
+ * the debug image, e.g., with `addr2line -fe <image>.dbg` for sites and
+ * `nm <image>.dbg` for statically allocated locks.
+ */
+
+enum uk_lockprof_kind {
+	UK_LOCKPROF_SPIN = 0,
+	UK_LOCKPROF_MUTEX,
+	UK_LOCKPROF_RLOCK,
+	UK_LOCKPROF_WLOCK,
+};
+
+struct uk_lockprof_site {
+	/** Address of the lock */
+	const void *lock;
+	/** Address of the code that acquires the lock */
+	__uptr site;
+	/** Type of the lock (see enum uk_lockprof_kind) */
+	unsigned int kind;
+	/** Slot state of the site table (see lockprof.c) */
+	unsigned int state;
+	/** Number of acquisitions */
+	__u64 acquisitions;
+	/** Acquisitions that found the lock held */
+	__u64 contended;
+	/** Total and longest time waited for the lock (ns) */
+	__u64 wait;
+	__u64 wait_max;
+	/** Total and longest time the lock was held (ns) */
+	__u64 hold;
+	__u64 hold_max;
+};
+
+#if CONFIG_LIBUKLOCK_PROFILE
+/* Embedded into every profiled lock. It describes the current holder. */
+struct uk_lockprof {
+	struct uk_lockprof_site *site;
+	__nsec acquired;
+};
+
+/* Address of the code that uses this macro */
+#define UK_LOCKPROF_SITE()						\
+	({								\
+		__label__ __uk_lockprof_here;				\
+	__uk_lockprof_here:						\
+		(__uptr)&&__uk_lockprof_here;				\
+	})
+
+/**
+ * Returns the current time as timestamp for the start of a wait
+ */
+__nsec uk_lockprof_clock(void);
+
+/**
+ * Accounts an acquisition of a lock
+ *
+ * @param p
+ *   Profiling state of the lock, which tracks the hold time until
+ *   uk_lockprof_released() is called. NULL if the lock is shared and its
+ *   hold time cannot be measured.
+ * @param lock
+ *   Address of the lock
+ * @param kind
+ *   Type of the lock (see enum uk_lockprof_kind)
+ * @param site
+ *   Address of the acquiring code
+ * @param wait_start
+ *   Return value of uk_lockprof_clock() taken before waiting for a held
+ *   lock, 0 if the lock was acquired without waiting
+ */
+void uk_lockprof_acquired(struct uk_lockprof *p, const void *lock,
+			  unsigned int kind, __uptr site, __nsec wait_start);
+
+/**
+ * Accounts the release of a lock that was acquired with a non-NULL `p`
+ */
+void uk_lockprof_released(struct uk_lockprof *p);
+
+/**
+ * Prints the sites with the longest total wait time to the kernel console,
+ * enclosed in UKLOCKPROF_BEGIN and UKLOCKPROF_END lines
+ *
+ * @param max
+ *   Maximum number of sites to print, 0 for all
+ */
+void uk_lockprof_dump(unsigned int max);
+
+/**
+ * Clears the counters of all sites
+ */
+void uk_lockprof_reset(void);
+#endif /* CONFIG_LIBUKLOCK_PROFILE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UK_LOCKPROF_H__ */
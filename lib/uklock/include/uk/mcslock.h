@@ -0,0 +1,150 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __UK_MCSLOCK_H__
+#define __UK_MCSLOCK_H__
+
+#include <uk/config.h>
+#include <uk/arch/lcpu.h>
+#include <uk/arch/types.h>
+#include <uk/essentials.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * MCS queued spinlocks
+ *
+ * Contending CPUs queue up in FIFO order and each one spins on a flag in its
+ * own queue node, so that acquisition is fair and a release only touches the
+ * cache line of the next waiter, instead of all waiters hammering the lock
+ * word.
+ *
+ * Queue nodes come from a small per-lcpu pool, so the interface is the same
+ * as for the other spinlocks. A node is in use from the start of an
+ * acquisition until the release, which bounds the number of MCS locks one
+ * lcpu can hold or wait on at the same time (including from interrupt
+ * context) to UK_MCSLOCK_NODES.
+ */
+
+#ifdef CONFIG_HAVE_SMP
+#include <uk/atomic.h>
+#include <uk/plat/lcpu.h>
+
+/* Maximum nesting of MCS locks on one lcpu */
+#define UK_MCSLOCK_NODES 8
+
+struct __align64 uk_mcs_node {
+	struct uk_mcs_node *next;
+	int wait;
+	__lcpuidx lcpu;
+	unsigned int idx;
+};
+
+/* Unless you know what you are doing, use uk_spinlock instead. */
+typedef struct __mcslock {
+	struct uk_mcs_node *tail;	/* Last queued CPU, NULL if unlocked */
+	struct uk_mcs_node *owner;	/* Node of the holder */
+} __mcslock;
+
+/* Initialize an MCS lock to unlocked state */
+#define UK_MCSLOCK_INITIALIZER() { __NULL, __NULL }
+
+struct uk_mcs_node *_uk_mcs_node_get(void);
+void _uk_mcs_node_put(struct uk_mcs_node *n);
+
+static inline void uk_mcs_init(__mcslock *lock)
+{
+	lock->tail = __NULL;
+	lock->owner = __NULL;
+}
+
+static inline void uk_mcs_lock(__mcslock *lock)
+{
+	struct uk_mcs_node *n = _uk_mcs_node_get();
+	struct uk_mcs_node *prev;
+
+	n->next = __NULL;
+	n->wait = 1;
+	prev = __atomic_exchange_n(&lock->tail, n, __ATOMIC_ACQ_REL);
+	if (prev) {
+		/* Queue behind `prev` and spin on our own node */
+		__atomic_store_n(&prev->next, n, __ATOMIC_RELEASE);
+		while (__atomic_load_n(&n->wait, __ATOMIC_ACQUIRE))
+			ukarch_spinwait();
+	}
+	lock->owner = n;
+}
+
+static inline int uk_mcs_trylock(__mcslock *lock)
+{
+	struct uk_mcs_node *n = _uk_mcs_node_get();
+	struct uk_mcs_node *expected = __NULL;
+
+	n->next = __NULL;
+	n->wait = 0;
+	if (!__atomic_compare_exchange_n(&lock->tail, &expected, n, 0,
+					 __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+		_uk_mcs_node_put(n);
+		return 0;
+	}
+	lock->owner = n;
+	return 1;
+}
+
+static inline void uk_mcs_unlock(__mcslock *lock)
+{
+	struct uk_mcs_node *n = lock->owner;
+	struct uk_mcs_node *next;
+
+	next = __atomic_load_n(&n->next, __ATOMIC_ACQUIRE);
+	if (!next) {
+		struct uk_mcs_node *expected = n;
+
+		/* No waiter: release the lock */
+		if (__atomic_compare_exchange_n(&lock->tail, &expected, __NULL,
+						0, __ATOMIC_RELEASE,
+						__ATOMIC_RELAXED)) {
+			_uk_mcs_node_put(n);
+			return;
+		}
+		/* A waiter is between queueing and linking itself to us */
+		while (!(next = __atomic_load_n(&n->next, __ATOMIC_ACQUIRE)))
+			ukarch_spinwait();
+	}
+	/* Hand the lock over to the next waiter */
+	__atomic_store_n(&next->wait, 0, __ATOMIC_RELEASE);
+	_uk_mcs_node_put(n);
+}
+
+static inline int uk_mcs_is_locked(__mcslock *lock)
+{
+	return __atomic_load_n(&lock->tail, __ATOMIC_RELAXED) != __NULL;
+}
+
+#else /* CONFIG_HAVE_SMP */
+
+typedef struct __mcslock {
+	/* empty */
+} __mcslock;
+
+#define UK_MCSLOCK_INITIALIZER()	{}
+#define uk_mcs_init(lock)		(void)(lock)
+#define uk_mcs_lock(lock)		\
+	do { barrier(); (void)(lock); } while (0)
+#define uk_mcs_unlock(lock)		\
+	do { barrier(); (void)(lock); } while (0)
+#define uk_mcs_trylock(lock)		({ barrier(); (void)(lock); 1; })
+#define uk_mcs_is_locked(lock)		({ barrier(); (void)(lock); 0; })
+
+#endif /* CONFIG_HAVE_SMP */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UK_MCSLOCK_H__ */
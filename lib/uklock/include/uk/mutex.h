@@ -38,11 +38,14 @@
 
 #if CONFIG_LIBUKLOCK_MUTEX
 #include <uk/assert.h>
+#include <uk/atomic.h>
+#include <uk/arch/lcpu.h>
 #include <uk/plat/lcpu.h>
 #include <uk/thread.h>
 #include <uk/wait.h>
 #include <uk/wait_types.h>
 #include <uk/plat/time.h>
+#include <uk/lockprof.h>
 
 #ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
 #include <uk/plat/spinlock.h>
@@ -54,6 +57,7 @@ extern "C" {
 #endif
 
 #define UK_MUTEX_CONFIG_RECURSE 0x01 /* Allow recursive locking */
+#define UK_MUTEX_CONFIG_SPIN    0x02 /* Spin while the owner is running */
 
 /*
  * Mutex that relies on a scheduler
@@ -64,6 +68,9 @@ struct uk_mutex {
 	unsigned int flags;
 	struct uk_thread *owner;
 	struct uk_waitq wait;
+#if CONFIG_LIBUKLOCK_PROFILE
+	struct uk_lockprof prof;
+#endif /* CONFIG_LIBUKLOCK_PROFILE */
 };
 
 static inline int uk_mutex_is_recursive(const struct uk_mutex *m)
@@ -88,6 +95,12 @@ struct uk_mutex_metrics {
 	size_t total_failed_trylocks;
 	/** Successful unlock operations since startup */
 	size_t total_unlocks;
+	/** Blocking lock operations that found the mutex locked */
+	size_t total_contended_locks;
+	/** Contended lock operations that acquired the mutex while spinning,
+	 *  the others had to wait on the mutex's wait queue
+	 */
+	size_t total_spin_locks;
 };
 
 #ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
@@ -99,20 +112,56 @@ extern __spinlock              _uk_mutex_metrics_lock;
 #endif /* CONFIG_LIBUKLOCK_MUTEX_METRICS */
 
 #define	UK_MUTEX_INITIALIZER(name)				\
-	{ 0, 0, NULL, __WAIT_QUEUE_INITIALIZER((name).wait) }
+	{ .lock_count = 0, .flags = 0, .owner = NULL,		\
+	  .wait = __WAIT_QUEUE_INITIALIZER((name).wait) }
 
 #define	UK_MUTEX_INITIALIZER_RECURSIVE(name)			\
-	{ 0, UK_MUTEX_CONFIG_RECURSE, 0,			\
-	__WAIT_QUEUE_INITIALIZER((name).wait) }
+	{ .lock_count = 0, .flags = UK_MUTEX_CONFIG_RECURSE,	\
+	  .owner = NULL, .wait = __WAIT_QUEUE_INITIALIZER((name).wait) }
 
 void uk_mutex_init_config(struct uk_mutex *m, unsigned int flags);
 void uk_mutex_get_metrics(struct uk_mutex_metrics *dst);
 
 #define uk_mutex_init(m) uk_mutex_init_config(m, 0)
 
+/*
+ * Adaptive spinning: a thread that finds the mutex locked by a thread running
+ * on another lcpu spins for a bounded time before blocking, as the owner is
+ * likely to release it soon. This saves two context switches for short
+ * critical sections.
+ *
+ * Returns 1 if the mutex was acquired, 0 if the caller has to block.
+ */
+static inline int _uk_mutex_spin(struct uk_mutex *m __maybe_unused,
+				 struct uk_thread *cur __maybe_unused)
+{
+#if CONFIG_HAVE_SMP
+	struct uk_thread *owner;
+	unsigned int i;
+
+	for (i = 0; i < CONFIG_LIBUKLOCK_MUTEX_SPIN_COUNT; i++) {
+		owner = uk_load_n(&m->owner);
+		if (!owner) {
+			if (uk_compare_exchange_sync(&m->owner,
+						     NULL, cur) == cur)
+				return 1;
+		} else if (!uk_thread_is_running(owner)) {
+			break;
+		}
+		ukarch_spinwait();
+	}
+#endif /* CONFIG_HAVE_SMP */
+	return 0;
+}
+
 static inline void uk_mutex_lock(struct uk_mutex *m)
 {
 	struct uk_thread *cur;
+	int contended = 0;
+	int spun = 0;
+#if CONFIG_LIBUKLOCK_PROFILE
+	__nsec wait_start = 0;
+#endif /* CONFIG_LIBUKLOCK_PROFILE */
 
 	UK_ASSERT(m);
 
@@ -127,24 +176,47 @@ static inline void uk_mutex_lock(struct uk_mutex *m)
 
 	UK_ASSERT(m->owner != cur);
 
+	if (m->owner) {
+		contended = 1;
+#if CONFIG_LIBUKLOCK_PROFILE
+		wait_start = uk_lockprof_clock();
+#endif /* CONFIG_LIBUKLOCK_PROFILE */
+		if ((m->flags & UK_MUTEX_CONFIG_SPIN) &&
+		    _uk_mutex_spin(m, cur)) {
+			spun = 1;
+			goto locked;
+		}
+	}
+
 	for (;;) {
-		uk_waitq_wait_event(&m->wait, m->owner == NULL);
+		uk_waitq_wait_event_exclusive(&m->wait, m->owner == NULL);
 
 		/* If there is no owner, we can acquire the lock */
-		if (uk_compare_exchange_sync(&m->owner, NULL, cur) == cur) {
-			UK_ASSERT(m->lock_count == 0);
-			m->lock_count = 1;
+		if (uk_compare_exchange_sync(&m->owner, NULL, cur) == cur)
 			break;
-		}
 	}
 
+locked:
+	UK_ASSERT(m->lock_count == 0);
+	m->lock_count = 1;
+
+#if CONFIG_LIBUKLOCK_PROFILE
+	uk_lockprof_acquired(&m->prof, m, UK_LOCKPROF_MUTEX,
+			     UK_LOCKPROF_SITE(), wait_start);
+#endif /* CONFIG_LIBUKLOCK_PROFILE */
+
 #ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
 	ukarch_spin_lock(&_uk_mutex_metrics_lock);
 	_uk_mutex_metrics.active_locked   += (m->lock_count == 1);
 	_uk_mutex_metrics.active_unlocked -= (m->lock_count == 1);
 	_uk_mutex_metrics.total_locks++;
+	_uk_mutex_metrics.total_contended_locks += contended;
+	_uk_mutex_metrics.total_spin_locks += spun;
 	ukarch_spin_unlock(&_uk_mutex_metrics_lock);
-#endif /* CONFIG_LIBUKLOCK_MUTEX_METRICS */
+#else /* !CONFIG_LIBUKLOCK_MUTEX_METRICS */
+	(void)contended;
+	(void)spun;
+#endif /* !CONFIG_LIBUKLOCK_MUTEX_METRICS */
 }
 
 static inline int uk_mutex_trylock(struct uk_mutex *m)
@@ -176,6 +248,11 @@ static inline int uk_mutex_trylock(struct uk_mutex *m)
 			UK_ASSERT(m->lock_count == 0);
 			m->lock_count = 1;
 
+#if CONFIG_LIBUKLOCK_PROFILE
+			uk_lockprof_acquired(&m->prof, m, UK_LOCKPROF_MUTEX,
+					     UK_LOCKPROF_SITE(), 0);
+#endif /* CONFIG_LIBUKLOCK_PROFILE */
+
 #ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
 			ukarch_spin_lock(&_uk_mutex_metrics_lock);
 			_uk_mutex_metrics.active_locked++;
@@ -210,12 +287,16 @@ static inline void uk_mutex_unlock(struct uk_mutex *m)
 	UK_ASSERT(m->owner == uk_thread_current());
 
 	if (--m->lock_count == 0) {
+#if CONFIG_LIBUKLOCK_PROFILE
+		uk_lockprof_released(&m->prof);
+#endif /* CONFIG_LIBUKLOCK_PROFILE */
+
 		/* Make sure lock_count is visible before resetting the
 		 * owner. The lock can be acquired afterwards.
 		 */
 		wmb();
 		m->owner = NULL;
-		uk_waitq_wake_up(&m->wait);
+		uk_waitq_wake_up_one(&m->wait);
 	}
 
 #ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
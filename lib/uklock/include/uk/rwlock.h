@@ -35,6 +35,10 @@ struct __align(8) uk_rwlock {
 	struct uk_waitq shared;
 	/** Wait queue for writers */
 	struct uk_waitq exclusive;
+#if CONFIG_LIBUKLOCK_PROFILE
+	/** Profiling state of the writer */
+	struct uk_lockprof prof;
+#endif /* CONFIG_LIBUKLOCK_PROFILE */
 };
 
 static inline int uk_rwlock_is_write_recursive(const struct uk_rwlock *rwl)
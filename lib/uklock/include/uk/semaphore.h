@@ -60,7 +60,7 @@ static inline void uk_semaphore_down(struct uk_semaphore *s)
 	UK_ASSERT(s);
 
 	for (;;) {
-		uk_waitq_wait_event(&s->wait, s->count > 0);
+		uk_waitq_wait_event_exclusive(&s->wait, s->count > 0);
 		uk_spin_lock_irqsave(&(s->sl), irqf);
 		if (s->count > 0)
 			break;
@@ -106,7 +106,8 @@ static inline __nsec uk_semaphore_down_to(struct uk_semaphore *s,
 	deadline = then + timeout;
 
 	for (;;) {
-		uk_waitq_wait_event_deadline(&s->wait, s->count > 0, deadline);
+		uk_waitq_wait_event_exclusive_deadline(&s->wait, s->count > 0,
+						       deadline);
 		uk_spin_lock_irqsave(&(s->sl), irqf);
 		if (s->count > 0 || (deadline &&
 				     ukplat_monotonic_clock() >= deadline))
@@ -142,7 +143,25 @@ static inline void uk_semaphore_up(struct uk_semaphore *s)
 	uk_pr_debug("Increased semaphore %p to %ld\n",
 		    s, s->count);
 #endif
-	uk_waitq_wake_up(&s->wait);
+	uk_waitq_wake_up_one(&s->wait);
+	uk_spin_unlock_irqrestore(&(s->sl), irqf);
+}
+
+/* Returns `n` tokens at once and wakes up as many waiters */
+static inline void uk_semaphore_up_n(struct uk_semaphore *s, long n)
+{
+	unsigned long irqf;
+
+	UK_ASSERT(s);
+	UK_ASSERT(n > 0);
+
+	uk_spin_lock_irqsave(&(s->sl), irqf);
+	s->count += n;
+#ifdef UK_SEMAPHORE_DEBUG
+	uk_pr_debug("Increased semaphore %p to %ld\n",
+		    s, s->count);
+#endif
+	uk_waitq_wake_up_nr(&s->wait, (unsigned int)MIN(n, (long)__UI_MAX));
 	uk_spin_unlock_irqrestore(&(s->sl), irqf);
 }
 
@@ -42,40 +42,124 @@ extern "C" {
 
 /* See uk/arch/spinlock.h for the interface documentation */
 
-#ifndef CONFIG_LIBUKLOCK_TICKETLOCK
-
 #ifndef uk_spinlock
+
+#if CONFIG_LIBUKLOCK_MCSLOCK
+#include <uk/mcslock.h>
+
+#define __uk_spinlock_raw __mcslock
+
+#define __UK_SPINLOCK_RAW_INITIALIZER()  UK_MCSLOCK_INITIALIZER()
+#define __uk_spin_raw_init(lock)         uk_mcs_init(lock)
+#define __uk_spin_raw_lock(lock)         uk_mcs_lock(lock)
+#define __uk_spin_raw_unlock(lock)       uk_mcs_unlock(lock)
+#define __uk_spin_raw_trylock(lock)      uk_mcs_trylock(lock)
+#define __uk_spin_raw_is_locked(lock)    uk_mcs_is_locked(lock)
+
+#elif !defined(CONFIG_LIBUKLOCK_TICKETLOCK)
 #include <uk/arch/spinlock.h>
 
-#define uk_spinlock __spinlock
+#define __uk_spinlock_raw __spinlock
 
-#define UK_SPINLOCK_INITIALIZER()  UKARCH_SPINLOCK_INITIALIZER()
-#define uk_spin_init(lock)         ukarch_spin_init(lock)
-#define uk_spin_lock(lock)         ukarch_spin_lock(lock)
-#define uk_spin_unlock(lock)       ukarch_spin_unlock(lock)
-#define uk_spin_trylock(lock)      ukarch_spin_trylock(lock)
-#define uk_spin_is_locked(lock)    ukarch_spin_is_locked(lock)
-#endif /* uk_spinlock */
+#define __UK_SPINLOCK_RAW_INITIALIZER()  UKARCH_SPINLOCK_INITIALIZER()
+#define __uk_spin_raw_init(lock)         ukarch_spin_init(lock)
+#define __uk_spin_raw_lock(lock)         ukarch_spin_lock(lock)
+#define __uk_spin_raw_unlock(lock)       ukarch_spin_unlock(lock)
+#define __uk_spin_raw_trylock(lock)      ukarch_spin_trylock(lock)
+#define __uk_spin_raw_is_locked(lock)    ukarch_spin_is_locked(lock)
 
 #else	/* CONFIG_LIBUKLOCK_TICKETLOCK */
 
-#ifndef uk_spinlock
-
 #ifdef CONFIG_ARCH_ARM_64
 #include <uk/arch/arm64/ticketlock.h>
 #endif
 
-#define uk_spinlock __ticketlock
+#define __uk_spinlock_raw __ticketlock
 
-#define UK_SPINLOCK_INITIALIZER()  UKARCH_TICKETLOCK_INITIALIZER()
-#define uk_spin_init(lock)         ukarch_ticket_init(lock)
-#define uk_spin_lock(lock)         ukarch_ticket_lock(lock)
-#define uk_spin_unlock(lock)       ukarch_ticket_unlock(lock)
-#define uk_spin_trylock(lock)      ukarch_ticket_trylock(lock)
-#define uk_spin_is_locked(lock)    ukarch_ticket_is_locked(lock)
-#endif /* uk_spinlock */
+#define __UK_SPINLOCK_RAW_INITIALIZER()  UKARCH_TICKETLOCK_INITIALIZER()
+#define __uk_spin_raw_init(lock)         ukarch_ticket_init(lock)
+#define __uk_spin_raw_lock(lock)         ukarch_ticket_lock(lock)
+#define __uk_spin_raw_unlock(lock)       ukarch_ticket_unlock(lock)
+#define __uk_spin_raw_trylock(lock)      ukarch_ticket_trylock(lock)
+#define __uk_spin_raw_is_locked(lock)    ukarch_ticket_is_locked(lock)
+
+#endif	/* CONFIG_LIBUKLOCK_MCSLOCK */
+
+#if CONFIG_LIBUKLOCK_PROFILE
+#include <uk/lockprof.h>
+
+/* The spinlock is wrapped to carry the profiling state of its holder.
+ * Acquisitions are accounted to the code that uses uk_spin_lock().
+ */
+typedef struct __uk_spinlock_prof {
+	__uk_spinlock_raw raw;
+	struct uk_lockprof prof;
+} __uk_spinlock_prof;
+
+#define uk_spinlock __uk_spinlock_prof
+
+#define UK_SPINLOCK_INITIALIZER()  { .raw = __UK_SPINLOCK_RAW_INITIALIZER() }
+
+static inline void uk_spin_init(__uk_spinlock_prof *lock)
+{
+	__uk_spin_raw_init(&lock->raw);
+	lock->prof.site = __NULL;
+}
 
-#endif	/* CONFIG_LIBUKLOCK_TICKETLOCK */
+static inline void _uk_spin_lock_prof(__uk_spinlock_prof *lock, __uptr site)
+{
+	__nsec start;
+
+	if (likely(__uk_spin_raw_trylock(&lock->raw))) {
+		uk_lockprof_acquired(&lock->prof, lock, UK_LOCKPROF_SPIN,
+				     site, 0);
+		return;
+	}
+
+	start = uk_lockprof_clock();
+	__uk_spin_raw_lock(&lock->raw);
+	uk_lockprof_acquired(&lock->prof, lock, UK_LOCKPROF_SPIN, site, start);
+}
+
+static inline int _uk_spin_trylock_prof(__uk_spinlock_prof *lock,
+					__uptr site)
+{
+	if (!__uk_spin_raw_trylock(&lock->raw))
+		return 0;
+
+	uk_lockprof_acquired(&lock->prof, lock, UK_LOCKPROF_SPIN, site, 0);
+	return 1;
+}
+
+static inline void uk_spin_unlock(__uk_spinlock_prof *lock)
+{
+	uk_lockprof_released(&lock->prof);
+	__uk_spin_raw_unlock(&lock->raw);
+}
+
+static inline int uk_spin_is_locked(__uk_spinlock_prof *lock)
+{
+	return __uk_spin_raw_is_locked(&lock->raw);
+}
+
+#define uk_spin_lock(lock)					\
+	_uk_spin_lock_prof(lock, UK_LOCKPROF_SITE())
+#define uk_spin_trylock(lock)					\
+	_uk_spin_trylock_prof(lock, UK_LOCKPROF_SITE())
+
+#else /* !CONFIG_LIBUKLOCK_PROFILE */
+
+#define uk_spinlock __uk_spinlock_raw
+
+#define UK_SPINLOCK_INITIALIZER()  __UK_SPINLOCK_RAW_INITIALIZER()
+#define uk_spin_init(lock)         __uk_spin_raw_init(lock)
+#define uk_spin_lock(lock)         __uk_spin_raw_lock(lock)
+#define uk_spin_unlock(lock)       __uk_spin_raw_unlock(lock)
+#define uk_spin_trylock(lock)      __uk_spin_raw_trylock(lock)
+#define uk_spin_is_locked(lock)    __uk_spin_raw_is_locked(lock)
+#endif /* !CONFIG_LIBUKLOCK_PROFILE */
+
+#endif /* uk_spinlock */
 
 #define uk_spin_lock_irq(lock)						\
 	do {								\
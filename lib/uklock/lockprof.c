@@ -0,0 +1,231 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <uk/arch/lcpu.h>
+#include <uk/atomic.h>
+#include <uk/essentials.h>
+#include <uk/init.h>
+#include <uk/lockprof.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/time.h>
+#include <uk/print.h>
+
+#define LOCKPROF_SITES		(1U << CONFIG_LIBUKLOCK_PROFILE_SITES_ORDER)
+
+/* Slot states. A slot is claimed once and keeps its key afterwards, so
+ * lookups need no lock. Interrupts are disabled while a slot is claimed,
+ * which guarantees that a lookup never waits for a claim on its own lcpu.
+ */
+#define LOCKPROF_FREE		0
+#define LOCKPROF_CLAIMED	1
+#define LOCKPROF_READY		2
+
+#define lockprof_printf(fmt, ...)					\
+	_uk_printk(KLVL_INFO, UKLIBID_NONE, __NULL, 0x0,		\
+		   fmt, ##__VA_ARGS__)
+
+static struct uk_lockprof_site lockprof_sites[LOCKPROF_SITES];
+/* Acquisitions that were not accounted because the table was full */
+static __u64 lockprof_dropped;
+
+/* Site indices for the dump, sorted by total wait time */
+static unsigned int lockprof_order[LOCKPROF_SITES];
+
+static const char *const lockprof_kinds[] = {
+	[UK_LOCKPROF_SPIN] = "spin",
+	[UK_LOCKPROF_MUTEX] = "mutex",
+	[UK_LOCKPROF_RLOCK] = "rlock",
+	[UK_LOCKPROF_WLOCK] = "wlock",
+};
+
+static inline unsigned int lockprof_hash(const void *lock, __uptr site)
+{
+	__u64 h = (__u64)(__uptr)lock * 0x9e3779b97f4a7c15ULL ^ site;
+
+	h ^= h >> 31;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 29;
+	return (unsigned int)h & (LOCKPROF_SITES - 1);
+}
+
+static struct uk_lockprof_site *lockprof_site_get(const void *lock,
+						  unsigned int kind,
+						  __uptr site)
+{
+	struct uk_lockprof_site *s;
+	unsigned int i, n, state;
+	unsigned long irqf;
+
+	i = lockprof_hash(lock, site);
+	for (n = 0; n < LOCKPROF_SITES; n++) {
+		s = &lockprof_sites[(i + n) & (LOCKPROF_SITES - 1)];
+		state = __atomic_load_n(&s->state, __ATOMIC_ACQUIRE);
+		if (state == LOCKPROF_FREE) {
+			irqf = ukplat_lcpu_save_irqf();
+			if (uk_compare_exchange_n(&s->state, &state,
+						  LOCKPROF_CLAIMED)) {
+				s->lock = lock;
+				s->site = site;
+				s->kind = kind;
+				__atomic_store_n(&s->state, LOCKPROF_READY,
+						 __ATOMIC_RELEASE);
+				ukplat_lcpu_restore_irqf(irqf);
+				return s;
+			}
+			ukplat_lcpu_restore_irqf(irqf);
+		}
+
+		/* Another lcpu is about to set the key of the slot */
+		while (state == LOCKPROF_CLAIMED) {
+			ukarch_spinwait();
+			state = __atomic_load_n(&s->state, __ATOMIC_ACQUIRE);
+		}
+
+		if (s->lock == lock && s->site == site)
+			return s;
+	}
+
+	uk_inc(&lockprof_dropped);
+	return __NULL;
+}
+
+static inline void lockprof_max(__u64 *max, __u64 val)
+{
+	__u64 cur = __atomic_load_n(max, __ATOMIC_RELAXED);
+
+	while (val > cur && !uk_compare_exchange_n(max, &cur, val))
+		;
+}
+
+__nsec uk_lockprof_clock(void)
+{
+	return ukplat_monotonic_clock();
+}
+
+void uk_lockprof_acquired(struct uk_lockprof *p, const void *lock,
+			  unsigned int kind, __uptr site, __nsec wait_start)
+{
+	struct uk_lockprof_site *s;
+	__nsec now, wait;
+
+	now = ukplat_monotonic_clock();
+	s = lockprof_site_get(lock, kind, site);
+	if (p) {
+		p->site = s;
+		p->acquired = now;
+	}
+	if (unlikely(!s))
+		return;
+
+	uk_inc(&s->acquisitions);
+	if (wait_start) {
+		wait = now - wait_start;
+		uk_inc(&s->contended);
+		uk_fetch_add(&s->wait, wait);
+		lockprof_max(&s->wait_max, wait);
+	}
+}
+
+void uk_lockprof_released(struct uk_lockprof *p)
+{
+	struct uk_lockprof_site *s = p->site;
+	__nsec hold;
+
+	if (unlikely(!s))
+		return;
+
+	hold = ukplat_monotonic_clock() - p->acquired;
+	p->site = __NULL;
+	uk_fetch_add(&s->hold, hold);
+	lockprof_max(&s->hold_max, hold);
+}
+
+void uk_lockprof_reset(void)
+{
+	struct uk_lockprof_site *s;
+	unsigned int i;
+
+	for (i = 0; i < LOCKPROF_SITES; i++) {
+		s = &lockprof_sites[i];
+		uk_store_n(&s->acquisitions, 0);
+		uk_store_n(&s->contended, 0);
+		uk_store_n(&s->wait, 0);
+		uk_store_n(&s->wait_max, 0);
+		uk_store_n(&s->hold, 0);
+		uk_store_n(&s->hold_max, 0);
+	}
+	uk_store_n(&lockprof_dropped, 0);
+}
+
+/* Sorts the site indices by descending total wait time, then by the
+ * number of acquisitions. Shell sort keeps the dump quick for full tables.
+ */
+static void lockprof_sort(unsigned int *idx, unsigned int cnt)
+{
+	static const unsigned int gaps[] = { 701, 301, 132, 57, 23, 10, 4, 1 };
+	const struct uk_lockprof_site *a, *b;
+	unsigned int g, i, j, v, gap;
+
+	for (g = 0; g < ARRAY_SIZE(gaps); g++) {
+		gap = gaps[g];
+		for (i = gap; i < cnt; i++) {
+			v = idx[i];
+			b = &lockprof_sites[v];
+			for (j = i; j >= gap; j -= gap) {
+				a = &lockprof_sites[idx[j - gap]];
+				if (a->wait > b->wait ||
+				    (a->wait == b->wait &&
+				     a->acquisitions >= b->acquisitions))
+					break;
+				idx[j] = idx[j - gap];
+			}
+			idx[j] = v;
+		}
+	}
+}
+
+void uk_lockprof_dump(unsigned int max)
+{
+	const struct uk_lockprof_site *s;
+	unsigned int i, cnt = 0;
+
+	for (i = 0; i < LOCKPROF_SITES; i++)
+		if (uk_load_n(&lockprof_sites[i].state) == LOCKPROF_READY &&
+		    lockprof_sites[i].acquisitions)
+			lockprof_order[cnt++] = i;
+	lockprof_sort(lockprof_order, cnt);
+	if (max && max < cnt)
+		cnt = max;
+
+	lockprof_printf("UKLOCKPROF_BEGIN\n");
+	lockprof_printf("%-5s %-18s %-18s %12s %12s %14s %12s %14s %12s\n",
+			"kind", "lock", "site", "acquired", "contended",
+			"wait_ns", "wait_max_ns", "hold_ns", "hold_max_ns");
+	for (i = 0; i < cnt; i++) {
+		s = &lockprof_sites[lockprof_order[i]];
+		lockprof_printf("%-5s 0x%016lx 0x%016lx %12"__PRIu64
+				" %12"__PRIu64" %14"__PRIu64" %12"__PRIu64
+				" %14"__PRIu64" %12"__PRIu64"\n",
+				lockprof_kinds[s->kind],
+				(unsigned long)s->lock,
+				(unsigned long)s->site,
+				s->acquisitions, s->contended, s->wait,
+				s->wait_max, s->hold, s->hold_max);
+	}
+	if (lockprof_dropped)
+		lockprof_printf("%"__PRIu64" acquisitions not profiled, "
+				"site table full\n", lockprof_dropped);
+	lockprof_printf("UKLOCKPROF_END\n");
+}
+
+#if CONFIG_LIBUKLOCK_PROFILE_DUMP
+static void lockprof_term(const struct uk_term_ctx *tctx __unused)
+{
+	uk_lockprof_dump(CONFIG_LIBUKLOCK_PROFILE_DUMP_MAX);
+}
+
+uk_late_initcall(0x0, lockprof_term);
+#endif /* CONFIG_LIBUKLOCK_PROFILE_DUMP */
@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <uk/mcslock.h>
+
+#ifdef CONFIG_HAVE_SMP
+#include <uk/assert.h>
+#include <uk/plat/lcpu.h>
+#include <uk/print.h>
+
+/* Queue nodes and their allocation bitmap; the bitmap of an lcpu is set only
+ * by that lcpu (possibly from interrupt context) and cleared by the holder of
+ * the lock a node was used for.
+ */
+static UKPLAT_PER_LCPU_ARRAY_DEFINE(struct uk_mcs_node, mcs_nodes,
+				    UK_MCSLOCK_NODES);
+static UKPLAT_PER_LCPU_DEFINE(unsigned int, mcs_used);
+
+struct uk_mcs_node *_uk_mcs_node_get(void)
+{
+	__lcpuidx lcpu = ukplat_lcpu_idx();
+	unsigned int *used = &ukplat_per_lcpu(mcs_used, lcpu);
+	unsigned int old, idx;
+	struct uk_mcs_node *n;
+
+	old = __atomic_load_n(used, __ATOMIC_RELAXED);
+	do {
+		if (unlikely(old == (1U << UK_MCSLOCK_NODES) - 1))
+			UK_CRASH("Too many nested MCS locks on lcpu %u\n",
+				 (unsigned int)lcpu);
+		idx = __builtin_ctz(~old);
+	} while (!__atomic_compare_exchange_n(used, &old, old | (1U << idx),
+					      0, __ATOMIC_ACQUIRE,
+					      __ATOMIC_RELAXED));
+
+	n = &ukplat_per_lcpu_array(mcs_nodes, lcpu, idx);
+	n->lcpu = lcpu;
+	n->idx = idx;
+	return n;
+}
+
+void _uk_mcs_node_put(struct uk_mcs_node *n)
+{
+	UK_ASSERT(n->lcpu < CONFIG_UKPLAT_LCPU_MAXCOUNT);
+	UK_ASSERT(n->idx < UK_MCSLOCK_NODES);
+
+	__atomic_and_fetch(&ukplat_per_lcpu(mcs_used, n->lcpu),
+			   ~(1U << n->idx), __ATOMIC_RELEASE);
+}
+#endif /* CONFIG_HAVE_SMP */
@@ -14,6 +14,9 @@ void uk_mutex_init_config(struct uk_mutex *m, unsigned int flags)
 	m->flags = flags;
 	m->owner = NULL;
 	uk_waitq_init(&m->wait);
+#if CONFIG_LIBUKLOCK_PROFILE
+	m->prof.site = NULL;
+#endif /* CONFIG_LIBUKLOCK_PROFILE */
 
 #ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
 	ukarch_spin_lock(&_uk_mutex_metrics_lock);
@@ -9,6 +9,14 @@
 #include <uk/rwlock.h>
 #include <uk/assert.h>
 #include <uk/config.h>
+#include <uk/lockprof.h>
+
+#if CONFIG_LIBUKLOCK_PROFILE
+/* Acquisitions are accounted to the caller of the lock functions. Readers
+ * share the lock, so only the hold time of writers is measured.
+ */
+#define RWLOCK_SITE()	((__uptr)__builtin_return_address(0))
+#endif /* CONFIG_LIBUKLOCK_PROFILE */
 
 void uk_rwlock_init_config(struct uk_rwlock *rwl, unsigned int config_flags)
 {
@@ -25,14 +33,25 @@ void uk_rwlock_init_config(struct uk_rwlock *rwl, unsigned int config_flags)
 	uk_spin_init(&rwl->sl);
 	uk_waitq_init(&rwl->shared);
 	uk_waitq_init(&rwl->exclusive);
+#if CONFIG_LIBUKLOCK_PROFILE
+	rwl->prof.site = NULL;
+#endif /* CONFIG_LIBUKLOCK_PROFILE */
 }
 
 void uk_rwlock_rlock(struct uk_rwlock *rwl)
 {
+#if CONFIG_LIBUKLOCK_PROFILE
+	__nsec wait_start;
+#endif /* CONFIG_LIBUKLOCK_PROFILE */
+
 	UK_ASSERT(rwl);
 
 	uk_spin_lock(&rwl->sl);
 	rwl->npending_reads++;
+#if CONFIG_LIBUKLOCK_PROFILE
+	wait_start = (rwl->npending_writes > 0 || rwl->nactive < 0) ?
+		     uk_lockprof_clock() : 0;
+#endif /* CONFIG_LIBUKLOCK_PROFILE */
 
 	/* We let readers wait when there are writers pending. This is
 	 * necessary to avoid a situation where new readers continuously enter
@@ -62,23 +81,35 @@ void uk_rwlock_rlock(struct uk_rwlock *rwl)
 	rwl->nactive++;
 	rwl->npending_reads--;
 	uk_spin_unlock(&rwl->sl);
+
+#if CONFIG_LIBUKLOCK_PROFILE
+	uk_lockprof_acquired(NULL, rwl, UK_LOCKPROF_RLOCK, RWLOCK_SITE(),
+			     wait_start);
+#endif /* CONFIG_LIBUKLOCK_PROFILE */
 }
 
 void uk_rwlock_wlock(struct uk_rwlock *rwl)
 {
+#if CONFIG_LIBUKLOCK_PROFILE
+	__nsec wait_start;
+#endif /* CONFIG_LIBUKLOCK_PROFILE */
+
 	UK_ASSERT(rwl);
 
 	uk_spin_lock(&rwl->sl);
 	rwl->npending_writes++;
+#if CONFIG_LIBUKLOCK_PROFILE
+	wait_start = rwl->nactive ? uk_lockprof_clock() : 0;
+#endif /* CONFIG_LIBUKLOCK_PROFILE */
 
 	/* Wait for all readers to have left the lock. New readers will
 	 * block in uk_rwlock_rlock while we are waiting.
 	 */
-	uk_waitq_wait_event_locked(&rwl->exclusive,
-				   rwl->nactive == 0,
-				   uk_spin_lock,
-				   uk_spin_unlock,
-				   &rwl->sl);
+	uk_waitq_wait_event_exclusive_locked(&rwl->exclusive,
+					     rwl->nactive == 0,
+					     uk_spin_lock,
+					     uk_spin_unlock,
+					     &rwl->sl);
 
 	UK_ASSERT(rwl->npending_writes > 0);
 	UK_ASSERT(rwl->nactive == 0);
@@ -86,6 +117,11 @@ void uk_rwlock_wlock(struct uk_rwlock *rwl)
 	rwl->npending_writes--;
 	rwl->nactive = -1;
 	uk_spin_unlock(&rwl->sl);
+
+#if CONFIG_LIBUKLOCK_PROFILE
+	uk_lockprof_acquired(&rwl->prof, rwl, UK_LOCKPROF_WLOCK,
+			     RWLOCK_SITE(), wait_start);
+#endif /* CONFIG_LIBUKLOCK_PROFILE */
 }
 
 void uk_rwlock_runlock(struct uk_rwlock *rwl)
@@ -116,6 +152,10 @@ void uk_rwlock_wunlock(struct uk_rwlock *rwl)
 
 	UK_ASSERT(rwl);
 
+#if CONFIG_LIBUKLOCK_PROFILE
+	uk_lockprof_released(&rwl->prof);
+#endif /* CONFIG_LIBUKLOCK_PROFILE */
+
 	uk_spin_lock(&rwl->sl);
 	UK_ASSERT(rwl->nactive == -1);
 
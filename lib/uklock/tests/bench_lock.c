@@ -0,0 +1,138 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <uk/bench.h>
+#include <uk/config.h>
+#include <uk/spinlock.h>
+#if CONFIG_LIBUKLOCK_MUTEX
+#include <uk/mutex.h>
+#include <uk/sched.h>
+#include <uk/thread.h>
+#endif /* CONFIG_LIBUKLOCK_MUTEX */
+#if CONFIG_HAVE_SMP
+#include <uk/plat/lcpu.h>
+#endif /* CONFIG_HAVE_SMP */
+
+static int bench_stop __maybe_unused;
+
+static uk_spinlock bench_spinlock = UK_SPINLOCK_INITIALIZER();
+
+UK_BENCHMARK(uklock_benchsuite, spin_lock_unlock)
+{
+	__u64 i;
+
+	for (i = 0; i < b->n; i++) {
+		uk_spin_lock(&bench_spinlock);
+		uk_spin_unlock(&bench_spinlock);
+	}
+}
+
+#if CONFIG_HAVE_SMP
+static int bench_spin_started;
+
+static void bench_spin_contender(struct __regs *regs __unused,
+				 void *arg __unused)
+{
+	__atomic_store_n(&bench_spin_started, 1, __ATOMIC_RELEASE);
+	while (!__atomic_load_n(&bench_stop, __ATOMIC_ACQUIRE)) {
+		uk_spin_lock(&bench_spinlock);
+		uk_spin_unlock(&bench_spinlock);
+	}
+	__atomic_store_n(&bench_spin_started, 0, __ATOMIC_RELEASE);
+}
+
+/* Another CPU takes the lock in a tight loop at the same time */
+UK_BENCHMARK_DESC(uklock_benchsuite, spin_lock_unlock_contended,
+		  "against one other CPU")
+{
+	struct ukplat_lcpu_func fn = { .fn = bench_spin_contender };
+	__lcpuidx idx = 1;
+	unsigned int num = 1;
+	__u64 i;
+
+	uk_bench_timer_stop(b);
+	if (ukplat_lcpu_count() < 2) {
+		uk_bench_skip(b, "needs at least 2 CPUs");
+		return;
+	}
+	__atomic_store_n(&bench_stop, 0, __ATOMIC_RELEASE);
+	if (unlikely(ukplat_lcpu_run(&idx, &num, &fn, 0))) {
+		uk_bench_skip(b, "failed to run on CPU 1");
+		return;
+	}
+	while (!__atomic_load_n(&bench_spin_started, __ATOMIC_ACQUIRE))
+		;
+	uk_bench_timer_start(b);
+
+	for (i = 0; i < b->n; i++) {
+		uk_spin_lock(&bench_spinlock);
+		uk_spin_unlock(&bench_spinlock);
+	}
+
+	uk_bench_timer_stop(b);
+	__atomic_store_n(&bench_stop, 1, __ATOMIC_RELEASE);
+	while (__atomic_load_n(&bench_spin_started, __ATOMIC_ACQUIRE))
+		;
+}
+#endif /* CONFIG_HAVE_SMP */
+
+#if CONFIG_LIBUKLOCK_MUTEX
+static struct uk_mutex bench_mutex = UK_MUTEX_INITIALIZER(bench_mutex);
+
+UK_BENCHMARK(uklock_benchsuite, mutex_lock_unlock)
+{
+	__u64 i;
+
+	for (i = 0; i < b->n; i++) {
+		uk_mutex_lock(&bench_mutex);
+		uk_mutex_unlock(&bench_mutex);
+	}
+}
+
+static __noreturn void bench_mutex_contender(void *arg __unused)
+{
+	while (!__atomic_load_n(&bench_stop, __ATOMIC_ACQUIRE)) {
+		uk_mutex_lock(&bench_mutex);
+		uk_sched_yield();
+		uk_mutex_unlock(&bench_mutex);
+	}
+	uk_sched_thread_exit();
+}
+
+/*
+ * The lock is held across a yield, so the other thread blocks on the mutex
+ * and has to be woken up on every unlock.
+ */
+UK_BENCHMARK_DESC(uklock_benchsuite, mutex_lock_unlock_contended,
+		  "with one blocked waiter, including a thread switch")
+{
+	struct uk_thread *t;
+	__u64 i;
+
+	uk_bench_timer_stop(b);
+	__atomic_store_n(&bench_stop, 0, __ATOMIC_RELEASE);
+	t = uk_sched_thread_create(uk_sched_current(), bench_mutex_contender,
+				   NULL, "bench_mutex");
+	if (unlikely(!t)) {
+		uk_bench_skip(b, "failed to create thread");
+		return;
+	}
+	uk_bench_timer_start(b);
+
+	for (i = 0; i < b->n; i++) {
+		uk_mutex_lock(&bench_mutex);
+		uk_sched_yield();
+		uk_mutex_unlock(&bench_mutex);
+	}
+
+	uk_bench_timer_stop(b);
+	__atomic_store_n(&bench_stop, 1, __ATOMIC_RELEASE);
+	while (!uk_thread_is_exited(t))
+		uk_sched_yield();
+}
+#endif /* CONFIG_LIBUKLOCK_MUTEX */
+
+uk_benchsuite_register(uklock_benchsuite, NULL);
@@ -58,6 +58,10 @@ __nsec uk_mbox_post_to(struct uk_mbox *m, void *msg, __nsec timeout);
 void uk_mbox_recv(struct uk_mbox *m, void **msg);
 int uk_mbox_recv_try(struct uk_mbox *m, void **msg);
 __nsec uk_mbox_recv_to(struct uk_mbox *m, void **msg, __nsec timeout);
+unsigned int uk_mbox_recv_burst(struct uk_mbox *m, void **msgs,
+				unsigned int count);
+unsigned int uk_mbox_recv_burst_try(struct uk_mbox *m, void **msgs,
+				    unsigned int count);
 
 #ifdef __cplusplus
 }
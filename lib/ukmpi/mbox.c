@@ -15,10 +15,10 @@ struct uk_mbox *uk_mbox_create(struct uk_alloc *a, size_t size)
 
 	m->len = size + 1;
 
-	uk_semaphore_init(&m->readsem, 0);
+	_mbox_sem_init(&m->readsem, 0);
 	m->readpos = 0;
 
-	uk_semaphore_init(&m->writesem, (long) size);
+	_mbox_sem_init(&m->writesem, (long) size);
 	m->writepos = 0;
 
 	uk_pr_debug("Created mailbox %p\n", m);
@@ -48,7 +48,7 @@ void uk_mbox_post(struct uk_mbox *m, void *msg)
 	 */
 	UK_ASSERT(m);
 
-	uk_semaphore_down(&m->writesem);
+	_mbox_sem_down(&m->writesem);
 	_do_mbox_post(m, msg);
 }
 
@@ -56,7 +56,7 @@ int uk_mbox_post_try(struct uk_mbox *m, void *msg)
 {
 	UK_ASSERT(m);
 
-	if (unlikely(!uk_semaphore_down_try(&m->writesem)))
+	if (unlikely(!_mbox_sem_down_try_n(&m->writesem, 1)))
 		return -ENOBUFS;
 	_do_mbox_post(m, msg);
 	return 0;
@@ -68,7 +68,7 @@ __nsec uk_mbox_post_to(struct uk_mbox *m, void *msg, __nsec timeout)
 
 	UK_ASSERT(m);
 
-	ret = uk_semaphore_down_to(&m->writesem, timeout);
+	ret = _mbox_sem_down_to(&m->writesem, timeout);
 	if (ret != __NSEC_MAX)
 		_do_mbox_post(m, msg);
 	return ret;
@@ -84,7 +84,7 @@ void uk_mbox_recv(struct uk_mbox *m, void **msg)
 
 	UK_ASSERT(m);
 
-	uk_semaphore_down(&m->readsem);
+	_mbox_sem_down(&m->readsem);
 	rmsg =  _do_mbox_recv(m);
 	if (msg)
 		*msg = rmsg;
@@ -108,7 +108,7 @@ int uk_mbox_recv_try(struct uk_mbox *m, void **msg)
 
 	UK_ASSERT(m);
 
-	if (unlikely(!uk_semaphore_down_try(&m->readsem)))
+	if (unlikely(!_mbox_sem_down_try_n(&m->readsem, 1)))
 		return -ENOMSG;
 
 	rmsg =  _do_mbox_recv(m);
@@ -136,7 +136,7 @@ __nsec uk_mbox_recv_to(struct uk_mbox *m, void **msg, __nsec timeout)
 
 	UK_ASSERT(m);
 
-	ret = uk_semaphore_down_to(&m->readsem, timeout);
+	ret = _mbox_sem_down_to(&m->readsem, timeout);
 	if (ret != __NSEC_MAX)
 		rmsg = _do_mbox_recv(m);
 
@@ -144,3 +144,39 @@ __nsec uk_mbox_recv_to(struct uk_mbox *m, void **msg, __nsec timeout)
 		*msg = rmsg;
 	return ret;
 }
+
+/* Blocks the thread until at least one message arrives in the mailbox and
+ * receives up to `count` messages at once. Returns the number of received
+ * messages.
+ */
+unsigned int uk_mbox_recv_burst(struct uk_mbox *m, void **msgs,
+				unsigned int count)
+{
+	long n;
+
+	UK_ASSERT(m);
+	UK_ASSERT(msgs);
+	UK_ASSERT(count > 0);
+
+	_mbox_sem_down(&m->readsem);
+	n = 1 + _mbox_sem_down_try_n(&m->readsem, (long) count - 1);
+	_do_mbox_recv_n(m, msgs, n);
+	return (unsigned int) n;
+}
+
+/* Receives up to `count` messages that are present in the mailbox without
+ * blocking. Returns the number of received messages.
+ */
+unsigned int uk_mbox_recv_burst_try(struct uk_mbox *m, void **msgs,
+				    unsigned int count)
+{
+	long n;
+
+	UK_ASSERT(m);
+	UK_ASSERT(msgs || count == 0);
+
+	n = _mbox_sem_down_try_n(&m->readsem, (long) count);
+	if (n)
+		_do_mbox_recv_n(m, msgs, n);
+	return (unsigned int) n;
+}
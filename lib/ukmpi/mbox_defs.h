@@ -3,6 +3,8 @@
 
 #include <stddef.h>
 #include <uk/semaphore.h>
+#include <uk/essentials.h>
+#include <uk/plat/time.h>
 
 /*
  * NOTE: The definitions below are included by both isr-safe and normal
@@ -10,34 +12,126 @@
  * requires special care.
  */
 
+/*
+ * Counting semaphore with a lock-free fast path. `count` holds the number
+ * of available tokens or, if negative, the number of sleeping threads. The
+ * wait queue semaphore is only touched to put a thread to sleep or to wake
+ * one up, so that posting to and receiving from a mailbox that is neither
+ * empty nor full needs a single atomic operation per side.
+ */
+struct uk_mbox_sem {
+	long count;
+	struct uk_semaphore sleep;
+};
+
+static inline void _mbox_sem_init(struct uk_mbox_sem *s, long count)
+{
+	s->count = count;
+	uk_semaphore_init(&s->sleep, 0);
+}
+
+/* Takes up to `n` tokens without sleeping, returns the number taken */
+static inline long _mbox_sem_down_try_n(struct uk_mbox_sem *s, long n)
+{
+	long c = __atomic_load_n(&s->count, __ATOMIC_RELAXED);
+
+	while (c > 0 && n > 0) {
+		if (__atomic_compare_exchange_n(&s->count, &c, c - MIN(c, n),
+						0, __ATOMIC_ACQUIRE,
+						__ATOMIC_RELAXED))
+			return MIN(c, n);
+	}
+	return 0;
+}
+
+static inline void _mbox_sem_down(struct uk_mbox_sem *s)
+{
+	if (_mbox_sem_down_try_n(s, 1))
+		return;
+	if (__atomic_fetch_sub(&s->count, 1, __ATOMIC_ACQUIRE) > 0)
+		return;
+	uk_semaphore_down(&s->sleep);
+}
+
+/* Returns __NSEC_MAX on timeout, expired time when down was successful */
+static inline __nsec _mbox_sem_down_to(struct uk_mbox_sem *s, __nsec timeout)
+{
+	__nsec then, ret;
+	long c;
+
+	if (_mbox_sem_down_try_n(s, 1))
+		return 0;
+
+	then = ukplat_monotonic_clock();
+	if (__atomic_fetch_sub(&s->count, 1, __ATOMIC_ACQUIRE) > 0)
+		return 0;
+	ret = uk_semaphore_down_to(&s->sleep, timeout);
+	if (ret != __NSEC_MAX)
+		return ret;
+
+	/* Stop waiting, unless an up() has already counted on us */
+	c = __atomic_load_n(&s->count, __ATOMIC_RELAXED);
+	while (c < 0) {
+		if (__atomic_compare_exchange_n(&s->count, &c, c + 1, 0,
+						__ATOMIC_RELAXED,
+						__ATOMIC_RELAXED))
+			return __NSEC_MAX;
+	}
+	uk_semaphore_down(&s->sleep);
+	return ukplat_monotonic_clock() - then;
+}
+
+/* Returns `n` tokens and wakes up as many sleeping threads */
+static inline void _mbox_sem_up_n(struct uk_mbox_sem *s, long n)
+{
+	long c;
+
+	c = __atomic_fetch_add(&s->count, n, __ATOMIC_RELEASE);
+	c = MIN(-c, n);
+	if (c > 0)
+		uk_semaphore_up_n(&s->sleep, c);
+}
+
 struct uk_mbox {
 	size_t len;
-	struct uk_semaphore readsem;
+	struct uk_mbox_sem readsem;
 	long readpos;
-	struct uk_semaphore writesem;
+	struct uk_mbox_sem writesem;
 	long writepos;
 
 	void *msgs[];
 };
 
 /*
- * Fetch a message from a mailbox. Internal version that actually does the
- * fetch.
+ * Fetch `n` messages from a mailbox. Internal version that actually does the
+ * fetch. The caller got `n` read tokens.
  */
-static inline void *_do_mbox_recv(struct uk_mbox *m)
+static inline void _do_mbox_recv_n(struct uk_mbox *m, void **msgs, long n)
 {
 	unsigned long irqf;
-	void *ret;
+	long i;
 
-	uk_pr_debug("Receive message from mailbox %p\n", m);
+	uk_pr_debug("Receive %ld messages from mailbox %p\n", n, m);
 	irqf = ukplat_lcpu_save_irqf();
-	UK_ASSERT(m->readpos != m->writepos);
-	ret = m->msgs[m->readpos];
-	m->readpos = (m->readpos + 1) % m->len;
+	for (i = 0; i < n; i++) {
+		UK_ASSERT(m->readpos != m->writepos);
+		msgs[i] = m->msgs[m->readpos];
+		m->readpos = (m->readpos + 1) % m->len;
+	}
 	ukplat_lcpu_restore_irqf(irqf);
 
-	uk_semaphore_up(&m->writesem);
+	_mbox_sem_up_n(&m->writesem, n);
+}
+
+/*
+ * Fetch a message from a mailbox. Internal version that actually does the
+ * fetch.
+ */
+static inline void *_do_mbox_recv(struct uk_mbox *m)
+{
+	void *ret;
 
+	_do_mbox_recv_n(m, &ret, 1);
 	return ret;
 }
 
@@ -61,7 +155,7 @@ static inline void _do_mbox_post(struct uk_mbox *m, void *msg)
 	ukplat_lcpu_restore_irqf(irqf);
 	uk_pr_debug("Posted message %p to mailbox %p\n", msg, m);
 
-	uk_semaphore_up(&m->readsem);
+	_mbox_sem_up_n(&m->readsem, 1);
 }
 
 #endif /* __MBOX_DEFS_H__ */
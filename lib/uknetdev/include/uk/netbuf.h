@@ -132,6 +132,36 @@ typedef void (*uk_netbuf_dtor_t)(struct uk_netbuf *);
 #define UK_NETBUF_F_GSO_TCPV4_BIT    2
 #define UK_NETBUF_F_GSO_TCPV4        (1 << UK_NETBUF_F_GSO_TCPV4_BIT)
 
+/* Same as UK_NETBUF_F_GSO_TCPV4 for TCP over IPv6. On receive, both flags
+ * indicate that the device coalesced multiple TCP segments into the packet.
+ */
+#define UK_NETBUF_F_GSO_TCPV6_BIT    3
+#define UK_NETBUF_F_GSO_TCPV6        (1 << UK_NETBUF_F_GSO_TCPV6_BIT)
+
+/* Received packet carries the flow hash computed by the device in `hash`.
+ * `hash_type` tells over which header fields the hash was computed.
+ */
+#define UK_NETBUF_F_HASH_BIT         4
+#define UK_NETBUF_F_HASH             (1 << UK_NETBUF_F_HASH_BIT)
+
+/* The 802.1Q tag of the packet is kept in `vlan_tci` instead of the frame
+ * data. On transmit, the device inserts the tag; on receive, the device
+ * stripped it. This requires that the device supports this.
+ */
+#define UK_NETBUF_F_VLAN_BIT         5
+#define UK_NETBUF_F_VLAN             (1 << UK_NETBUF_F_VLAN_BIT)
+
+/* Header fields covered by `hash` if UK_NETBUF_F_HASH is set. IPv6 variants
+ * include packets with extension headers.
+ */
+#define UK_NETBUF_HASH_NONE          0
+#define UK_NETBUF_HASH_IPV4          1
+#define UK_NETBUF_HASH_TCPV4         2
+#define UK_NETBUF_HASH_UDPV4         3
+#define UK_NETBUF_HASH_IPV6          4
+#define UK_NETBUF_HASH_TCPV6         5
+#define UK_NETBUF_HASH_UDPV6         6
+
 struct uk_netbuf {
 	struct uk_netbuf *next;
 	struct uk_netbuf *prev;
@@ -164,6 +194,17 @@ struct uk_netbuf {
 				 * Maximum size of each packet beyond the header
 				 */
 
+	uint32_t hash;         /**< Used if UK_NETBUF_F_HASH is set;
+				 * Flow hash computed by the device on receive
+				 */
+	uint8_t hash_type;     /**< Used if UK_NETBUF_F_HASH is set;
+				 * One of UK_NETBUF_HASH_*
+				 */
+	uint16_t vlan_tci;     /**< Used if UK_NETBUF_F_VLAN is set;
+				 * Tag control information (PCP, DEI, VID) in
+				 * host byte order
+				 */
+
 	uk_netbuf_dtor_t dtor; /**< Destructor callback */
 	struct uk_alloc *_a;   /**< @internal Allocator for free'ing */
 	void *_b;              /**< @internal Base address for free'ing */
@@ -345,6 +386,90 @@ struct uk_netbuf *uk_netbuf_prepare_buf(void *mem, size_t size,
 					uint16_t headroom,
 					size_t privlen, uk_netbuf_dtor_t dtor);
 
+#if CONFIG_LIBUKALLOCPOOL
+/**
+ * Pool of netbufs with data buffer area. All netbufs of a pool have the same
+ * buffer size, alignment, headroom, and private data length. They are
+ * initialized once when the pool is created and are re-initialized and
+ * returned to the pool by uk_netbuf_free() when their refcount reaches zero.
+ * Netbufs taken from a pool must not get a different destructor.
+ */
+struct uk_netbuf_pool;
+
+/**
+ * Allocates a netbuf pool and initializes all of its netbufs.
+ * @param a
+ *   Allocator on which the pool is allocated (single allocation)
+ * @param count
+ *   Number of netbufs of the pool
+ * @param buflen
+ *   Size of the buffer area of each netbuf
+ * @param bufalign
+ *   Alignment for the buffer areas (`m->buf` will be aligned to it)
+ * @param headroom
+ *   Number of bytes reserved as headroom from each buffer area, see
+ *   uk_netbuf_alloc_buf(). `headroom` has to be smaller or equal to `buflen`.
+ * @param privlen
+ *   Length for reserved memory to store private data with each netbuf
+ * @returns
+ *   - (NULL): Allocation failed
+ *   - initialized netbuf pool
+ */
+struct uk_netbuf_pool *uk_netbuf_pool_alloc(struct uk_alloc *a,
+					    unsigned int count, size_t buflen,
+					    size_t bufalign, uint16_t headroom,
+					    size_t privlen);
+
+/**
+ * Frees a netbuf pool. All netbufs have to be returned to the pool before.
+ * @param p
+ *   Netbuf pool
+ */
+void uk_netbuf_pool_free(struct uk_netbuf_pool *p);
+
+/**
+ * Returns the number of netbufs that are currently available in a pool.
+ * @param p
+ *   Netbuf pool
+ */
+unsigned int uk_netbuf_pool_availcount(struct uk_netbuf_pool *p);
+
+/**
+ * Takes a netbuf from a pool. The netbuf is initialized like a netbuf
+ * returned by uk_netbuf_alloc_buf().
+ * @param p
+ *   Netbuf pool
+ * @returns
+ *   - (NULL): No netbuf available
+ *   - initialized uk_netbuf
+ */
+struct uk_netbuf *uk_netbuf_pool_take(struct uk_netbuf_pool *p);
+
+/**
+ * Takes multiple netbufs from a pool.
+ * @param p
+ *   Netbuf pool
+ * @param m
+ *   Array that is filled with the taken netbufs
+ * @param count
+ *   Maximum number of netbufs to take
+ * @returns
+ *   Number of netbufs placed in m[0]...m[ret - 1]
+ */
+uint16_t uk_netbuf_pool_take_batch(struct uk_netbuf_pool *p,
+				   struct uk_netbuf *m[], uint16_t count);
+
+/**
+ * Receive buffer allocator for `struct uk_netdev_rxqueue_conf` that takes
+ * netbufs from the pool given as `argp`. `m->len` of each netbuf is set to
+ * the space available after the headroom.
+ * @param argp
+ *   Netbuf pool (`struct uk_netbuf_pool *`)
+ */
+uint16_t uk_netbuf_pool_alloc_rxpkts(void *argp, struct uk_netbuf *m[],
+				     uint16_t count);
+#endif /* CONFIG_LIBUKALLOCPOOL */
+
 /**
  * Retrieves the last element of a netbuf chain
  * @param m
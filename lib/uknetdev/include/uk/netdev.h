@@ -178,6 +178,28 @@ void uk_netdev_info_get(struct uk_netdev *dev,
 const char *uk_netdev_einfo_get(struct uk_netdev *dev,
 				enum uk_netdev_einfo_type einfo);
 
+#ifdef CONFIG_LIBUKNETDEV_STATS
+/**
+ * Reads the statistics of a receive queue. The counters are updated without
+ * locking, a concurrent receive may or may not be included.
+ *
+ * @param dev
+ *   The Unikraft Network Device.
+ * @param queue_id
+ *   The index of the receive queue.
+ * @param stats
+ *   Destination of the statistics.
+ */
+void uk_netdev_rxq_stats_get(struct uk_netdev *dev, uint16_t queue_id,
+			     struct uk_netdev_queue_stats *stats);
+
+/**
+ * Reads the statistics of a transmit queue. See uk_netdev_rxq_stats_get().
+ */
+void uk_netdev_txq_stats_get(struct uk_netdev *dev, uint16_t queue_id,
+			     struct uk_netdev_queue_stats *stats);
+#endif /* CONFIG_LIBUKNETDEV_STATS */
+
 /**
  * Configures an Unikraft network device.
  *
@@ -185,9 +207,13 @@ const char *uk_netdev_einfo_get(struct uk_netdev *dev,
  *   The Unikraft Network Device in unconfigured state.
  * @param dev_conf
  *   The pointer to the configuration data to be used for the Unikraft
- *   network device.
+ *   network device. Receive-side scaling (`rss`) is done by the device if it
+ *   has UK_NETDEV_F_RSS, otherwise in software if libuknetdev is configured
+ *   with software RSS.
  * @return
  *   - (0): Success, device is in configured state.
+ *   - (-ENOTSUP): Receive-side scaling was requested but is not available.
+ *   - (-EINVAL): Invalid receive-side scaling configuration.
  *   - (<0): Error code returned by the driver.
  */
 int uk_netdev_configure(struct uk_netdev *dev,
@@ -435,6 +461,110 @@ static inline int uk_netdev_rxq_intr_disable(struct uk_netdev *dev,
 	return dev->ops->rxq_intr_disable(dev, dev->_rx_queue[queue_id]);
 }
 
+#if CONFIG_LIBUKNETDEV_DIRECT
+/*
+ * Packet operations are bound to the virtio-net driver at compile time: the
+ * operation of a device is compared with the driver's function and, if they
+ * match, the function is called directly. This keeps the indirect call off
+ * the packet path and lets LTO inline the driver. Devices of other drivers
+ * are still called through their function pointers.
+ */
+int virtio_netdev_recv(struct uk_netdev *dev,
+		       struct uk_netdev_rx_queue *queue,
+		       struct uk_netbuf **pkt);
+int virtio_netdev_xmit(struct uk_netdev *dev,
+		       struct uk_netdev_tx_queue *queue,
+		       struct uk_netbuf *pkt);
+int virtio_netdev_recv_burst(struct uk_netdev *dev,
+			     struct uk_netdev_rx_queue *queue,
+			     struct uk_netbuf *pkts[], __u16 cnt);
+int virtio_netdev_xmit_burst(struct uk_netdev *dev,
+			     struct uk_netdev_tx_queue *queue,
+			     struct uk_netbuf *pkts[], __u16 cnt);
+
+#define __UK_NETDEV_DIRECT_rx_one	virtio_netdev_recv
+#define __UK_NETDEV_DIRECT_tx_one	virtio_netdev_xmit
+#define __UK_NETDEV_DIRECT_rx_burst	virtio_netdev_recv_burst
+#define __UK_NETDEV_DIRECT_tx_burst	virtio_netdev_xmit_burst
+
+#define __uk_netdev_call(dev, op, ...)					\
+	(likely((dev)->op == __UK_NETDEV_DIRECT_##op)			\
+	 ? __UK_NETDEV_DIRECT_##op((dev), __VA_ARGS__)			\
+	 : (dev)->op((dev), __VA_ARGS__))
+#else /* !CONFIG_LIBUKNETDEV_DIRECT */
+#define __uk_netdev_call(dev, op, ...)					\
+	(dev)->op((dev), __VA_ARGS__)
+#endif /* !CONFIG_LIBUKNETDEV_DIRECT */
+
+/* @internal Receive one packet from the driver and account for it */
+static inline int _uk_netdev_rx_one(struct uk_netdev *dev, uint16_t queue_id,
+				    struct uk_netbuf **pkt)
+{
+	int ret;
+
+	ret = __uk_netdev_call(dev, rx_one, dev->_rx_queue[queue_id], pkt);
+
+#ifdef CONFIG_LIBUKNETDEV_STATS
+	if (ret >= 0 && (ret & UK_NETDEV_STATUS_SUCCESS)) {
+		struct uk_netdev_queue_stats *stats;
+		struct uk_netbuf *nb;
+
+		stats = &dev->_rxq_stats[queue_id];
+		UK_NETBUF_CHAIN_FOREACH(nb, *pkt)
+			stats->bytes += nb->len;
+		stats->packets++;
+	} else if (ret < 0) {
+		dev->_rxq_stats[queue_id].drops++;
+	}
+#endif /* CONFIG_LIBUKNETDEV_STATS */
+
+	return ret;
+}
+
+/* @internal Receive a burst from the driver and account for it */
+static inline int _uk_netdev_rx_burst(struct uk_netdev *dev, uint16_t queue_id,
+				      struct uk_netbuf *pkts[], uint16_t cnt)
+{
+	int ret;
+
+	ret = __uk_netdev_call(dev, rx_burst, dev->_rx_queue[queue_id], pkts,
+			       cnt);
+
+#ifdef CONFIG_LIBUKNETDEV_STATS
+	if (ret > 0) {
+		struct uk_netdev_queue_stats *stats;
+		struct uk_netbuf *nb;
+		int i;
+
+		stats = &dev->_rxq_stats[queue_id];
+		for (i = 0; i < ret; i++)
+			UK_NETBUF_CHAIN_FOREACH(nb, pkts[i])
+				stats->bytes += nb->len;
+		stats->packets += ret;
+	} else if (ret < 0) {
+		dev->_rxq_stats[queue_id].drops++;
+	}
+#endif /* CONFIG_LIBUKNETDEV_STATS */
+
+	return ret;
+}
+
+#if CONFIG_LIBUKNETDEV_SWRSS
+/* @internal Receive functions with software RSS */
+int uk_netdev_swrss_rx_one(struct uk_netdev *dev, uint16_t queue_id,
+			   struct uk_netbuf **pkt);
+int uk_netdev_swrss_rx_burst(struct uk_netdev *dev, uint16_t queue_id,
+			     struct uk_netbuf *pkts[], uint16_t cnt);
+#endif /* CONFIG_LIBUKNETDEV_SWRSS */
+
+#if CONFIG_LIBUKNETDEV_RXFILTER
+/* @internal Receive functions with an early receive filter */
+int uk_netdev_rxfilter_rx_one(struct uk_netdev *dev, uint16_t queue_id,
+			      struct uk_netbuf **pkt);
+int uk_netdev_rxfilter_rx_burst(struct uk_netdev *dev, uint16_t queue_id,
+				struct uk_netbuf *pkts[], uint16_t cnt);
+#endif /* CONFIG_LIBUKNETDEV_RXFILTER */
+
 /**
  * Receive one packet and re-program used receive descriptors. In order to avoid
  * race conditions, queue interrupts have to be off while executing this
@@ -474,8 +604,6 @@ static inline int uk_netdev_rxq_intr_disable(struct uk_netdev *dev,
 static inline int uk_netdev_rx_one(struct uk_netdev *dev, uint16_t queue_id,
 				   struct uk_netbuf **pkt)
 {
-	int ret;
-
 	UK_ASSERT(dev);
 	UK_ASSERT(dev->rx_one);
 	UK_ASSERT(queue_id < CONFIG_LIBUKNETDEV_MAXNBQUEUES);
@@ -483,35 +611,15 @@ static inline int uk_netdev_rx_one(struct uk_netdev *dev, uint16_t queue_id,
 	UK_ASSERT(!PTRISERR(dev->_rx_queue[queue_id]));
 	UK_ASSERT(pkt);
 
-
-	ret = dev->rx_one(dev, dev->_rx_queue[queue_id], pkt);
-
-#ifdef CONFIG_LIBUKNETDEV_STATS
-	if (ret >= 0 && (ret & UK_NETDEV_STATUS_SUCCESS)) {
-		struct uk_netbuf *nb;
-
-		ukarch_spin_lock(&dev->_stats_lock);
-		UK_NETBUF_CHAIN_FOREACH(nb, *pkt)
-			dev->_stats.rx_m.bytes += (*pkt)->len;
-		dev->_stats.rx_m.packets++;
-		ukarch_spin_unlock(&dev->_stats_lock);
-		return ret;
-	}
-	if (ret >= 0 && (ret & UK_NETDEV_STATUS_UNDERRUN)) {
-		ukarch_spin_lock(&dev->_stats_lock);
-		dev->_stats.rx_m.fifo++;
-		ukarch_spin_unlock(&dev->_stats_lock);
-		return ret;
-	}
-	if (ret < 0) {
-		ukarch_spin_lock(&dev->_stats_lock);
-		dev->_stats.rx_m.errors++;
-		ukarch_spin_unlock(&dev->_stats_lock);
-		return ret;
-	}
-#endif /* CONFIG_LIBUKNETDEV_STATS */
-
-	return ret;
+#if CONFIG_LIBUKNETDEV_RXFILTER
+	if (dev->_rxfilter)
+		return uk_netdev_rxfilter_rx_one(dev, queue_id, pkt);
+#endif /* CONFIG_LIBUKNETDEV_RXFILTER */
+#if CONFIG_LIBUKNETDEV_SWRSS
+	if (dev->_swrss)
+		return uk_netdev_swrss_rx_one(dev, queue_id, pkt);
+#endif /* CONFIG_LIBUKNETDEV_SWRSS */
+	return _uk_netdev_rx_one(dev, queue_id, pkt);
 }
 
 /**
@@ -552,30 +660,192 @@ static inline int uk_netdev_tx_one(struct uk_netdev *dev, uint16_t queue_id,
 	UK_ASSERT(!PTRISERR(dev->_tx_queue[queue_id]));
 	UK_ASSERT(pkt);
 
-	ret = dev->tx_one(dev, dev->_tx_queue[queue_id], pkt);
+#ifdef CONFIG_LIBUKNETDEV_STATS
+	/* Count bytes before submission: The packet may be free'd by the
+	 * driver as soon as it is handed over
+	 */
+	struct uk_netbuf *nb;
+	__sz bytes = 0;
+
+	UK_NETBUF_CHAIN_FOREACH(nb, pkt)
+		bytes += nb->len;
+#endif /* CONFIG_LIBUKNETDEV_STATS */
+
+	ret = __uk_netdev_call(dev, tx_one, dev->_tx_queue[queue_id], pkt);
 
 #ifdef CONFIG_LIBUKNETDEV_STATS
 	if (ret >= 0 && (ret & UK_NETDEV_STATUS_SUCCESS)) {
-		struct uk_netbuf *nb;
-
-		ukarch_spin_lock(&dev->_stats_lock);
-		UK_NETBUF_CHAIN_FOREACH(nb, pkt)
-			dev->_stats.tx_m.bytes += nb->len;
-		dev->_stats.tx_m.packets++;
-		ukarch_spin_unlock(&dev->_stats_lock);
-		return ret;
+		dev->_txq_stats[queue_id].bytes += bytes;
+		dev->_txq_stats[queue_id].packets++;
+	} else if (ret < 0) {
+		dev->_txq_stats[queue_id].drops++;
 	}
-	if (ret >= 0 && (ret & UK_NETDEV_STATUS_UNDERRUN)) {
-		ukarch_spin_lock(&dev->_stats_lock);
-		dev->_stats.tx_m.fifo++;
-		ukarch_spin_unlock(&dev->_stats_lock);
-		return ret;
-	}
-	if (ret < 0) {
-		ukarch_spin_lock(&dev->_stats_lock);
-		dev->_stats.tx_m.errors++;
-		ukarch_spin_unlock(&dev->_stats_lock);
-		return ret;
+#endif /* CONFIG_LIBUKNETDEV_STATS */
+
+	return ret;
+}
+
+/**
+ * Receive a burst of packets and re-program used receive descriptors once for
+ * the whole burst. The same interrupt rules as for uk_netdev_rx_one() apply:
+ * Queue interrupts have to be off while executing this function. Interrupts
+ * are enabled again (if they were requested with uk_netdev_rxq_intr_enable())
+ * when the receive queue was drained, which is the case whenever less than
+ * `cnt` packets are returned.
+ *
+ * @param dev
+ *   The Unikraft Network Device.
+ * @param queue_id
+ *   The index of the receive queue to receive from.
+ *   The value must be in the range [0, nb_rx_queue - 1] previously supplied
+ *   to uk_netdev_configure().
+ * @param pkts
+ *   Array of netbuf pointers that will point to the received packets after
+ *   the function call. The array must have space for at least `cnt` entries.
+ * @param cnt
+ *   Maximum number of packets to receive.
+ * @return
+ *   - (>=0): Number of received packets, placed in pkts[0]...pkts[ret - 1].
+ *   - (<0): Negative value with error code from driver, no packet is returned.
+ */
+static inline int uk_netdev_rx_burst(struct uk_netdev *dev, uint16_t queue_id,
+				     struct uk_netbuf *pkts[], uint16_t cnt)
+{
+	UK_ASSERT(dev);
+	UK_ASSERT(dev->rx_burst);
+	UK_ASSERT(queue_id < CONFIG_LIBUKNETDEV_MAXNBQUEUES);
+	UK_ASSERT(dev->_data->state == UK_NETDEV_RUNNING);
+	UK_ASSERT(!PTRISERR(dev->_rx_queue[queue_id]));
+	UK_ASSERT(pkts || cnt == 0);
+
+#if CONFIG_LIBUKNETDEV_RXFILTER
+	if (dev->_rxfilter)
+		return uk_netdev_rxfilter_rx_burst(dev, queue_id, pkts, cnt);
+#endif /* CONFIG_LIBUKNETDEV_RXFILTER */
+#if CONFIG_LIBUKNETDEV_SWRSS
+	if (dev->_swrss)
+		return uk_netdev_swrss_rx_burst(dev, queue_id, pkts, cnt);
+#endif /* CONFIG_LIBUKNETDEV_SWRSS */
+	return _uk_netdev_rx_burst(dev, queue_id, pkts, cnt);
+}
+
+#if CONFIG_LIBUKNETDEV_SWRSS
+/**
+ * Receive packets that other logical CPUs steered to the calling one with
+ * software RSS (see struct uk_netdev_rss_conf). uk_netdev_rx_one() and
+ * uk_netdev_rx_burst() return these packets as well; this function serves
+ * lcpus that do not poll a receive queue of the device themselves. No
+ * interrupt signals newly steered packets.
+ *
+ * @param dev
+ *   The Unikraft Network Device.
+ * @param pkts
+ *   Array of netbuf pointers that will point to the received packets after
+ *   the function call. The array must have space for at least `cnt` entries.
+ * @param cnt
+ *   Maximum number of packets to receive.
+ * @return
+ *   - (>=0): Number of received packets, placed in pkts[0]...pkts[ret - 1].
+ *   - (-ENOTSUP): Software RSS is not enabled on the device.
+ */
+int uk_netdev_swrss_rx_steered(struct uk_netdev *dev,
+			       struct uk_netbuf *pkts[], uint16_t cnt);
+#endif /* CONFIG_LIBUKNETDEV_SWRSS */
+
+#if CONFIG_LIBUKNETDEV_RXFILTER
+/**
+ * Installs an early receive filter on a device. uk_netdev_rx_one() and
+ * uk_netdev_rx_burst() run the filter on every packet the driver returns
+ * before handing the packet to the caller, so packets that are dropped,
+ * transmitted back, or redirected never reach the network stack:
+ * - UK_NETDEV_RXF_PASS: The packet is returned to the caller.
+ * - UK_NETDEV_RXF_DROP: The packet is freed.
+ * - UK_NETDEV_RXF_TX: The packet is sent on the transmit queue with the
+ *   index of the receive queue. The caller of the receive function must own
+ *   that transmit queue. The packet is freed if it cannot be sent.
+ * - UK_NETDEV_RXF_REDIRECT(q): The packet is returned by the next receive
+ *   call on receive queue `q`, and a receive event is signaled for `q`.
+ *   The packet is freed if too many packets are waiting for `q`.
+ * Must be called after the receive queues are configured and before the
+ * device is started.
+ *
+ * @param dev
+ *   The Unikraft Network Device.
+ * @param filter
+ *   Filter function, or NULL to remove the filter.
+ * @param argp
+ *   Argument that is passed to the filter function.
+ * @return
+ *   - (0): Success.
+ *   - (-EINVAL): The device is not in the configured state.
+ *   - (-ENOMEM): Could not allocate the redirect rings.
+ */
+int uk_netdev_rx_filter_set(struct uk_netdev *dev,
+			    uk_netdev_rx_filter_t filter, void *argp);
+#endif /* CONFIG_LIBUKNETDEV_RXFILTER */
+
+/**
+ * Transmit a burst of packets. Drivers that implement bursting natively
+ * notify the device only once for the whole burst.
+ *
+ * @param dev
+ *   The Unikraft Network Device.
+ * @param queue_id
+ *   The index of the transmit queue to send to.
+ *   The value must be in the range [0, nb_tx_queue - 1] previously supplied
+ *   to uk_netdev_configure().
+ * @param pkts
+ *   Array of `cnt` netbufs to send. Packets are free'd by the driver after
+ *   sending was successfully finished by the device. Packets that were not
+ *   submitted (pkts[ret]...pkts[cnt - 1]) remain owned by the caller.
+ *   The same headroom requirements as for uk_netdev_tx_one() apply.
+ * @param cnt
+ *   Number of packets in `pkts`, at least 1.
+ * @return
+ *   - (>=0): Number of packets that were put to the transmit queue. A value
+ *      smaller than `cnt` means that the transmit queue is full or that
+ *      pkts[ret] could not be sent (submitting it again reports the error).
+ *   - (<0): Negative value with error code from driver, no packet was sent.
+ */
+static inline int uk_netdev_tx_burst(struct uk_netdev *dev, uint16_t queue_id,
+				     struct uk_netbuf *pkts[], uint16_t cnt)
+{
+	int ret;
+
+	UK_ASSERT(dev);
+	UK_ASSERT(dev->tx_burst);
+	UK_ASSERT(queue_id < CONFIG_LIBUKNETDEV_MAXNBQUEUES);
+	UK_ASSERT(dev->_data->state == UK_NETDEV_RUNNING);
+	UK_ASSERT(!PTRISERR(dev->_tx_queue[queue_id]));
+	UK_ASSERT(pkts);
+	UK_ASSERT(cnt > 0);
+
+#ifdef CONFIG_LIBUKNETDEV_STATS
+	/* Count bytes before submission: Packets may be free'd by the driver
+	 * as soon as they are handed over. Packets that were not submitted
+	 * remain ours, so their bytes are subtracted afterwards.
+	 */
+	struct uk_netbuf *nb;
+	__sz bytes = 0;
+	int i;
+
+	for (i = 0; i < cnt; i++)
+		UK_NETBUF_CHAIN_FOREACH(nb, pkts[i])
+			bytes += nb->len;
+#endif /* CONFIG_LIBUKNETDEV_STATS */
+
+	ret = __uk_netdev_call(dev, tx_burst, dev->_tx_queue[queue_id], pkts,
+			       cnt);
+
+#ifdef CONFIG_LIBUKNETDEV_STATS
+	if (ret > 0) {
+		for (i = ret; i < cnt; i++)
+			UK_NETBUF_CHAIN_FOREACH(nb, pkts[i])
+				bytes -= nb->len;
+		dev->_txq_stats[queue_id].bytes += bytes;
+		dev->_txq_stats[queue_id].packets += ret;
+	} else if (ret < 0) {
+		dev->_txq_stats[queue_id].drops++;
 	}
 #endif /* CONFIG_LIBUKNETDEV_STATS */
 
@@ -42,14 +42,12 @@
 #include <uk/netbuf.h>
 #include <uk/list.h>
 #include <uk/alloc.h>
+#include <uk/arch/lcpu.h>
 #include <uk/essentials.h>
 #ifdef CONFIG_LIBUKNETDEV_DISPATCHERTHREADS
 #include <uk/sched.h>
 #include <uk/semaphore.h>
 #endif
-#ifdef CONFIG_LIBUKNETDEV_STATS
-#include <uk/arch/spinlock.h>
-#endif /* CONFIG_LIBUKNETDEV_STATS */
 
 
 /**
@@ -147,6 +145,26 @@ struct uk_hwaddr {
 #define UK_NETDEV_F_TSO4_BIT		3
 #define UK_NETDEV_F_TSO4		(1UL << UK_NETDEV_F_TSO4_BIT)
 
+/* Indicates that the network device supports sending netbufs with the
+ * UK_NETBUF_F_GSO_TCPV6 bit set. */
+#define UK_NETDEV_F_TSO6_BIT		4
+#define UK_NETDEV_F_TSO6		(1UL << UK_NETDEV_F_TSO6_BIT)
+
+/* Indicates that the network device reports a flow hash with received
+ * netbufs (UK_NETBUF_F_HASH). */
+#define UK_NETDEV_F_RXHASH_BIT		5
+#define UK_NETDEV_F_RXHASH		(1UL << UK_NETDEV_F_RXHASH_BIT)
+
+/* Indicates that the network device inserts the VLAN tag of netbufs sent
+ * with UK_NETBUF_F_VLAN set, and strips the tag of received frames. */
+#define UK_NETDEV_F_VLAN_BIT		6
+#define UK_NETDEV_F_VLAN		(1UL << UK_NETDEV_F_VLAN_BIT)
+
+/* Indicates that the network device spreads received packets over its
+ * receive queues according to a struct uk_netdev_rss_conf. */
+#define UK_NETDEV_F_RSS_BIT		7
+#define UK_NETDEV_F_RSS			(1UL << UK_NETDEV_F_RSS_BIT)
+
 #define uk_netdev_rxintr_supported(feature)	\
 	(feature & (UK_NETDEV_F_RXQ_INTR))
 #define uk_netdev_txintr_supported(feature)	\
@@ -155,6 +173,14 @@ struct uk_hwaddr {
 	(feature & (UK_NETDEV_F_PARTIAL_CSUM))
 #define uk_netdev_tso4_supported(feature) \
 	(feature & (UK_NETDEV_F_TSO4))
+#define uk_netdev_tso6_supported(feature) \
+	(feature & (UK_NETDEV_F_TSO6))
+#define uk_netdev_rxhash_supported(feature) \
+	(feature & (UK_NETDEV_F_RXHASH))
+#define uk_netdev_vlan_supported(feature) \
+	(feature & (UK_NETDEV_F_VLAN))
+#define uk_netdev_rss_supported(feature) \
+	(feature & (UK_NETDEV_F_RSS))
 /**
  * A structure used to describe network device capabilities.
  */
@@ -179,12 +205,61 @@ struct uk_netdev_queue_info {
 	int nb_is_power_of_two; /**< Number of descriptors should be a power of two. */
 };
 
+/* Header fields that receive-side scaling hashes over. Packets of types
+ * that are not selected are steered by their IP addresses if the
+ * corresponding IP type is selected, otherwise to the first entry of the
+ * indirection table.
+ */
+#define UK_NETDEV_RSS_HASH_IPV4		(1U << 0)
+#define UK_NETDEV_RSS_HASH_TCPV4	(1U << 1)
+#define UK_NETDEV_RSS_HASH_UDPV4	(1U << 2)
+#define UK_NETDEV_RSS_HASH_IPV6		(1U << 3)
+#define UK_NETDEV_RSS_HASH_TCPV6	(1U << 4)
+#define UK_NETDEV_RSS_HASH_UDPV6	(1U << 5)
+#define UK_NETDEV_RSS_HASH_ALL		((1U << 6) - 1)
+
+/* Length of the Toeplitz key, enough for hashing IPv6 addresses and ports */
+#define UK_NETDEV_RSS_KEY_LEN		40
+
+/* Maximum number of entries of the indirection table */
+#define UK_NETDEV_RSS_RETA_MAXSIZE	256
+
+/**
+ * Receive-side scaling (RSS) configuration. The destination of a received
+ * packet is taken from the indirection table at the index given by the lower
+ * bits of the Toeplitz hash over its addresses and ports, so all packets of
+ * a connection arrive at the same destination.
+ *
+ * Devices with UK_NETDEV_F_RSS steer to receive queues. Otherwise, if
+ * software RSS is enabled, the destinations are logical CPUs: The receive
+ * functions of the API hand every packet to the lcpu its flow maps to,
+ * regardless of the queue it was received on.
+ */
+struct uk_netdev_rss_conf {
+	uint32_t hash_types;    /**< UK_NETDEV_RSS_HASH_*, 0 selects all */
+	const uint8_t *key;     /**< UK_NETDEV_RSS_KEY_LEN bytes, NULL for
+				 * uk_netdev_rss_default_key
+				 */
+	const uint16_t *reta;   /**< Indirection table (queue or lcpu indices),
+				 * NULL to spread evenly over all
+				 * destinations
+				 */
+	uint16_t reta_size;     /**< Entries in `reta`, a power of two */
+};
+
+/**
+ * Default Toeplitz key, as used by most NIC drivers
+ */
+extern const uint8_t uk_netdev_rss_default_key[UK_NETDEV_RSS_KEY_LEN];
+
 /**
  * A structure used to configure a network device.
  */
 struct uk_netdev_conf {
 	uint16_t nb_rx_queues;
 	uint16_t nb_tx_queues;
+	/** Receive-side scaling, NULL to disable */
+	const struct uk_netdev_rss_conf *rss;
 };
 
 /**
@@ -282,6 +357,18 @@ struct uk_netdev_rxqueue_conf {
 
 	uk_netdev_alloc_rxpkts alloc_rxpkts; /**< Allocator for rx netbufs */
 	void *alloc_rxpkts_argp;             /**< Argument for alloc_rxpkts */
+
+	/**
+	 * Interrupt moderation (optional, 0 disables it): Queue events are
+	 * delayed by up to `coalesce_usecs` microseconds or until
+	 * `coalesce_max_pkts` packets arrived. Drivers that cannot delay
+	 * interrupts in the device moderate adaptively instead: when an
+	 * event yields at least `coalesce_max_pkts` packets, the drained
+	 * queue is polled for up to `coalesce_usecs` before the interrupt is
+	 * re-armed, until the packet rate drops again.
+	 */
+	uint32_t coalesce_usecs;             /**< Max. delay of an event */
+	uint32_t coalesce_max_pkts;          /**< Max. packets per event */
 #ifdef CONFIG_LIBUKNETDEV_DISPATCHERTHREADS
 	struct uk_sched *s;               /**< Scheduler for dispatcher. */
 #endif
@@ -389,6 +476,24 @@ typedef int (*uk_netdev_tx_one_t)(struct uk_netdev *dev,
 				  struct uk_netdev_tx_queue *queue,
 				  struct uk_netbuf *pkt);
 
+/**
+ * Driver callback type to retrieve up to `cnt` packets from a RX queue.
+ * Returns the number of received packets or a negative error code.
+ */
+typedef int (*uk_netdev_rx_burst_t)(struct uk_netdev *dev,
+				    struct uk_netdev_rx_queue *queue,
+				    struct uk_netbuf *pkts[],
+				    uint16_t cnt);
+
+/**
+ * Driver callback type to submit up to `cnt` packets to a TX queue.
+ * Returns the number of submitted packets or a negative error code.
+ */
+typedef int (*uk_netdev_tx_burst_t)(struct uk_netdev *dev,
+				    struct uk_netdev_tx_queue *queue,
+				    struct uk_netbuf *pkts[],
+				    uint16_t cnt);
+
 /**
  * A structure containing the functions exported by a driver.
  */
@@ -459,37 +564,66 @@ struct uk_netdev_data {
 struct uk_netdev_einfo_overwrites;
 #endif /* CONFIG_LIBUKNETDEV_EINFO_LIBPARAM */
 
-struct uk_netdev_tx_stats {
-	/** The total number of bytes of data transmitted by the interface */
-	size_t bytes;
+#if CONFIG_LIBUKNETDEV_SWRSS
+struct uk_netdev_swrss;
+#endif /* CONFIG_LIBUKNETDEV_SWRSS */
 
-	/** The total number of packets of data transmitted by the interface */
-	size_t packets;
+#if CONFIG_LIBUKNETDEV_RXFILTER
+struct uk_netdev_rxfilter;
 
-	/** The total number of transmit errors detected by the device driver */
-	size_t errors;
+/* Actions of a receive filter, see uk_netdev_rx_filter_set() */
+#define UK_NETDEV_RXF_PASS		0	/**< Hand to the caller */
+#define UK_NETDEV_RXF_DROP		1	/**< Free the packet */
+#define UK_NETDEV_RXF_TX		2	/**< Transmit back */
+#define UK_NETDEV_RXF_REDIRECT_FLAG	0x10000
+/** Hand to the caller of receive queue `queue_id` */
+#define UK_NETDEV_RXF_REDIRECT(queue_id)				\
+	(UK_NETDEV_RXF_REDIRECT_FLAG | ((queue_id) & 0xffff))
 
-	/** The number of FIFO buffer errors */
-	size_t fifo;
-};
+/**
+ * Function type of a receive filter. It is called for every packet that is
+ * received from the device, on the CPU and in the context that calls the
+ * receive function, and must not block. The filter may modify the packet,
+ * e.g., to swap the addresses before it is transmitted back.
+ *
+ * @param dev
+ *   The Unikraft Network Device.
+ * @param queue_id
+ *   Index of the receive queue the packet was received on.
+ * @param pkt
+ *   Received packet.
+ * @param argp
+ *   Argument that was passed to uk_netdev_rx_filter_set().
+ * @return
+ *   One of the UK_NETDEV_RXF_* actions.
+ */
+typedef int (*uk_netdev_rx_filter_t)(struct uk_netdev *dev, uint16_t queue_id,
+				     struct uk_netbuf *pkt, void *argp);
+#endif /* CONFIG_LIBUKNETDEV_RXFILTER */
 
-struct uk_netdev_rx_stats {
-	/** The total number of bytes of data received by the interface */
-	size_t bytes;
+/**
+ * Counters of a receive or transmit queue. A queue is used by one thread at
+ * a time only, so the counters are updated without locking. Every queue has
+ * its own cache lines so that queues served by different CPUs do not share
+ * them.
+ */
+struct __align(CACHE_LINE_SIZE) uk_netdev_queue_stats {
+	/** Packets received or transmitted on the queue */
+	__u64 packets;
 
-	/** The total number of packets of data received by the interface */
-	size_t packets;
+	/** Bytes of the received or transmitted packets */
+	__u64 bytes;
 
-	/** The total number of receive errors detected by the device driver */
-	size_t errors;
+	/** Packets lost because of an error reported by the driver */
+	__u64 drops;
 
-	/** The number of FIFO buffer errors */
-	size_t fifo;
-};
+	/** RX: The receive ring could not be refilled completely (starvation)
+	 *  TX: A transmission found the transmit ring full
+	 */
+	__u64 ring_full;
 
-struct uk_netdev_stats {
-	struct uk_netdev_tx_stats tx_m;
-	struct uk_netdev_rx_stats rx_m;
+	/** Notifications of the device about new descriptors */
+	__u64 kicks;
 };
 
 /**
@@ -500,6 +634,10 @@ struct uk_netdev_stats {
  * registering the netdev. They change during device life time. Packet RX/TX
  * functions are added directly to this structure for performance reasons.
  * It prevents another indirection to ops.
+ * The burst variants (tx_burst, rx_burst) are optional for drivers. When they
+ * are not provided, libuknetdev emulates them with tx_one and rx_one.
+ * The fields used on the data path come first, so that they share the first
+ * cache line. Per-queue statistics are on cache lines of their own.
  */
 struct uk_netdev {
 	/** Packet transmission. */
@@ -508,16 +646,33 @@ struct uk_netdev {
 	/** Packet reception. */
 	uk_netdev_rx_one_t          rx_one; /* by driver */
 
+	/** Burst packet transmission. */
+	uk_netdev_tx_burst_t        tx_burst; /* by driver, optional */
+
+	/** Burst packet reception. */
+	uk_netdev_rx_burst_t        rx_burst; /* by driver, optional */
+
 	/** Pointer to API-internal state data. */
 	struct uk_netdev_data       *_data;
 
 	/** Functions callbacks by driver. */
 	const struct uk_netdev_ops  *ops;   /* by driver */
 
+#if CONFIG_LIBUKNETDEV_SWRSS
+	/** Software receive-side scaling state (API-private) */
+	struct uk_netdev_swrss *_swrss;
+#endif /* CONFIG_LIBUKNETDEV_SWRSS */
+
+#if CONFIG_LIBUKNETDEV_RXFILTER
+	/** Early receive filter (API-private) */
+	struct uk_netdev_rxfilter *_rxfilter;
+#endif /* CONFIG_LIBUKNETDEV_RXFILTER */
+
 	/** Pointers to queues (API-private) */
 	struct uk_netdev_rx_queue   *_rx_queue[CONFIG_LIBUKNETDEV_MAXNBQUEUES];
 	struct uk_netdev_tx_queue   *_tx_queue[CONFIG_LIBUKNETDEV_MAXNBQUEUES];
 
+	/* Fields below are not used for packet reception and transmission */
 	UK_TAILQ_ENTRY(struct uk_netdev) _list;
 
 #if CONFIG_LIBUKNETDEV_EINFO_LIBPARAM
@@ -530,12 +685,15 @@ struct uk_netdev {
 #endif /* CONFIG_UK_NETDEV_SCRATCH_SIZE */
 
 #ifdef CONFIG_LIBUKNETDEV_STATS
-	/* TODO: Per-queue stats to reduce contention */
-	struct uk_netdev_stats _stats;
-	__spinlock _stats_lock;
+	/** Per-queue statistics (API-private, updated by API and driver) */
+	struct uk_netdev_queue_stats _rxq_stats[CONFIG_LIBUKNETDEV_MAXNBQUEUES];
+	struct uk_netdev_queue_stats _txq_stats[CONFIG_LIBUKNETDEV_MAXNBQUEUES];
 #endif /* CONFIG_LIBUKNETDEV_STATS */
 };
 
+/* The data path fields before the queue pointers fit in one cache line */
+UK_CTASSERT(__offsetof(struct uk_netdev, _rx_queue) <= CACHE_LINE_SIZE);
+
 #ifdef __cplusplus
 }
 #endif
@@ -97,6 +97,31 @@ static inline void uk_netdev_drv_rx_event(struct uk_netdev *dev,
 #endif /* !CONFIG_LIBUKNETDEV_DISPATCHERTHREADS */
 }
 
+/**
+ * Increments a counter of the statistics of a receive or transmit queue, see
+ * `struct uk_netdev_queue_stats`. Packets, bytes, and drops are counted by
+ * libuknetdev, drivers count `ring_full` and `kicks`. Has no effect when
+ * statistics are not collected.
+ *
+ * @param dev
+ *   Unikraft network device
+ * @param queue_id
+ *   Receive or transmit queue ID
+ * @param counter
+ *   Name of the counter, e.g., `kicks`
+ */
+#ifdef CONFIG_LIBUKNETDEV_STATS
+#define uk_netdev_drv_rxq_stats_inc(dev, queue_id, counter)		\
+	((dev)->_rxq_stats[(queue_id)].counter++)
+#define uk_netdev_drv_txq_stats_inc(dev, queue_id, counter)		\
+	((dev)->_txq_stats[(queue_id)].counter++)
+#else /* !CONFIG_LIBUKNETDEV_STATS */
+#define uk_netdev_drv_rxq_stats_inc(dev, queue_id, counter)		\
+	do {} while (0)
+#define uk_netdev_drv_txq_stats_inc(dev, queue_id, counter)		\
+	do {} while (0)
+#endif /* !CONFIG_LIBUKNETDEV_STATS */
+
 #ifdef __cplusplus
 }
 #endif
@@ -17,4 +17,20 @@
 #define UK_NETDEV_STATS_RX_ERRORS	0x30
 #define UK_NETDEV_STATS_RX_FIFO		0x40
 
+#define UK_NETDEV_STATS_TX_KICKS	0x05
+#define UK_NETDEV_STATS_RX_KICKS	0x50
+
+/* Per-queue stats object IDs */
+#define UK_NETDEV_STATS_RXQ_OBJ_ID(dev_id, queue_id)			\
+	((1ULL << 32) | ((__u64)(dev_id) << 16) | (queue_id))
+#define UK_NETDEV_STATS_TXQ_OBJ_ID(dev_id, queue_id)			\
+	((2ULL << 32) | ((__u64)(dev_id) << 16) | (queue_id))
+
+/* Per-queue stats entry IDs */
+#define UK_NETDEV_STATS_Q_PACKETS	0x01
+#define UK_NETDEV_STATS_Q_BYTES		0x02
+#define UK_NETDEV_STATS_Q_DROPS		0x03
+#define UK_NETDEV_STATS_Q_RING_FULL	0x04
+#define UK_NETDEV_STATS_Q_KICKS		0x05
+
 #endif /* __UK_NETDEV_STORE_H__ */
@@ -32,6 +32,9 @@
 #include <uk/netbuf.h>
 #include <uk/essentials.h>
 #include <uk/print.h>
+#if CONFIG_LIBUKALLOCPOOL
+#include <uk/allocpool.h>
+#endif /* CONFIG_LIBUKALLOCPOOL */
 
 /* Used to align netbuf's priv and data areas to `long long` data type */
 #define NETBUF_ADDR_ALIGNMENT (sizeof(long long))
@@ -188,6 +191,161 @@ struct uk_netbuf *uk_netbuf_prepare_buf(void *mem, size_t size,
 	return m;
 }
 
+#if CONFIG_LIBUKALLOCPOOL
+struct uk_netbuf_pool {
+	struct uk_allocpool *ap;
+	struct uk_alloc *a;
+	/* Offset of the netbuf within a pool object */
+	size_t m_off;
+	size_t buflen;
+	uint16_t headroom;
+	size_t privlen;
+};
+
+static inline struct uk_netbuf *pool_obj2netbuf(struct uk_netbuf_pool *p,
+						void *obj)
+{
+	return (struct uk_netbuf *)((__uptr) obj + p->m_off);
+}
+
+/* Pool netbufs have no allocator (`_a`) so that uk_netbuf_free_single() does
+ * not free them, `_b` references the pool instead.
+ */
+static void pool_netbuf_dtor(struct uk_netbuf *m);
+
+static inline void pool_netbuf_init(struct uk_netbuf_pool *p, void *obj)
+{
+	struct uk_netbuf *m = pool_obj2netbuf(p, obj);
+
+	uk_netbuf_init_indir(m, obj, p->buflen, p->headroom,
+			     p->privlen > 0 ? (void *)((__uptr) m + sizeof(*m))
+					    : NULL,
+			     pool_netbuf_dtor);
+	m->_b = p;
+}
+
+static void pool_netbuf_dtor(struct uk_netbuf *m)
+{
+	struct uk_netbuf_pool *p = m->_b;
+
+	UK_ASSERT(p);
+	UK_ASSERT(m == pool_obj2netbuf(p, m->buf));
+
+	/* Re-initialize now, so that taking is just a pool operation */
+	pool_netbuf_init(p, m->buf);
+	uk_allocpool_return(p->ap, m->buf);
+}
+
+struct uk_netbuf_pool *uk_netbuf_pool_alloc(struct uk_alloc *a,
+					    unsigned int count, size_t buflen,
+					    size_t bufalign, uint16_t headroom,
+					    size_t privlen)
+{
+	struct uk_netbuf_pool *p;
+	struct uk_netbuf *m, *head = NULL;
+	unsigned int i;
+	void *obj;
+
+	UK_ASSERT(count > 0);
+	UK_ASSERT(buflen > 0);
+	UK_ASSERT(headroom <= buflen);
+
+	p = uk_malloc(a, sizeof(*p));
+	if (!p)
+		return NULL;
+
+	/* Same layout as uk_netbuf_alloc_buf(): buffer area first,
+	 * followed by `struct uk_netbuf` and private data
+	 */
+	p->a = a;
+	p->m_off = NETBUF_ADDR_ALIGN_UP(buflen);
+	p->buflen = p->m_off;
+	p->headroom = headroom;
+	p->privlen = privlen;
+	p->ap = uk_allocpool_alloc(a, count,
+				   p->m_off + NETBUF_ADDR_ALIGN_UP(
+					sizeof(struct uk_netbuf) + privlen),
+				   MAX(bufalign, NETBUF_ADDR_ALIGNMENT));
+	if (!p->ap) {
+		uk_free(a, p);
+		return NULL;
+	}
+
+	/* Take all objects once for initializing them, chained with `next` */
+	for (i = 0; i < count; i++) {
+		obj = uk_allocpool_take(p->ap);
+		UK_ASSERT(obj);
+
+		pool_netbuf_init(p, obj);
+		m = pool_obj2netbuf(p, obj);
+		m->next = head;
+		head = m;
+	}
+	while (head) {
+		m = head;
+		head = m->next;
+		m->next = NULL;
+		uk_allocpool_return(p->ap, m->buf);
+	}
+
+	return p;
+}
+
+void uk_netbuf_pool_free(struct uk_netbuf_pool *p)
+{
+	UK_ASSERT(p);
+
+	uk_allocpool_free(p->ap);
+	uk_free(p->a, p);
+}
+
+unsigned int uk_netbuf_pool_availcount(struct uk_netbuf_pool *p)
+{
+	UK_ASSERT(p);
+
+	return uk_allocpool_availcount(p->ap);
+}
+
+struct uk_netbuf *uk_netbuf_pool_take(struct uk_netbuf_pool *p)
+{
+	void *obj;
+
+	UK_ASSERT(p);
+
+	obj = uk_allocpool_take(p->ap);
+	if (unlikely(!obj))
+		return NULL;
+	return pool_obj2netbuf(p, obj);
+}
+
+uint16_t uk_netbuf_pool_take_batch(struct uk_netbuf_pool *p,
+				   struct uk_netbuf *m[], uint16_t count)
+{
+	uint16_t i, cnt;
+
+	UK_ASSERT(p);
+	UK_ASSERT(m || count == 0);
+
+	/* The objects are converted to netbufs in place */
+	cnt = (uint16_t) uk_allocpool_take_batch(p->ap, (void **) m, count);
+	for (i = 0; i < cnt; i++)
+		m[i] = pool_obj2netbuf(p, m[i]);
+	return cnt;
+}
+
+uint16_t uk_netbuf_pool_alloc_rxpkts(void *argp, struct uk_netbuf *m[],
+				     uint16_t count)
+{
+	uint16_t i, cnt;
+
+	cnt = uk_netbuf_pool_take_batch((struct uk_netbuf_pool *) argp,
+					m, count);
+	for (i = 0; i < cnt; i++)
+		m[i]->len = uk_netbuf_tailroom(m[i]);
+	return cnt;
+}
+#endif /* CONFIG_LIBUKALLOCPOOL */
+
 struct uk_netbuf *uk_netbuf_disconnect(struct uk_netbuf *m)
 {
 	struct uk_netbuf *remhead = NULL;
@@ -46,6 +46,10 @@
 #include "stats.h"
 #endif /* CONFIG_LIBUKNETDEV_STATS */
 
+#if CONFIG_LIBUKNETDEV_SWRSS
+#include "rss.h"
+#endif /* CONFIG_LIBUKNETDEV_SWRSS */
+
 struct uk_netdev_list uk_netdev_list =
 	UK_TAILQ_HEAD_INITIALIZER(uk_netdev_list);
 static uint16_t netdev_count;
@@ -159,6 +163,52 @@ static struct uk_netdev_einfo_overwrites *_alloc_einfo(struct uk_alloc *a,
 }
 #endif /* CONFIG_LIBUKNETDEV_EINFO_LIBPARAM */
 
+/*
+ * Burst emulation for drivers that only provide rx_one/tx_one.
+ * Stop as soon as the driver does not report any further progress.
+ */
+static int _rx_burst_emul(struct uk_netdev *dev,
+			  struct uk_netdev_rx_queue *queue,
+			  struct uk_netbuf *pkts[], uint16_t cnt)
+{
+	uint16_t i;
+	int ret;
+
+	for (i = 0; i < cnt; i++) {
+		ret = dev->rx_one(dev, queue, &pkts[i]);
+		if (unlikely(ret < 0))
+			return (i == 0) ? ret : (int) i;
+		if (!(ret & UK_NETDEV_STATUS_SUCCESS))
+			break;
+		if (!(ret & UK_NETDEV_STATUS_MORE)) {
+			i++;
+			break;
+		}
+	}
+	return (int) i;
+}
+
+static int _tx_burst_emul(struct uk_netdev *dev,
+			  struct uk_netdev_tx_queue *queue,
+			  struct uk_netbuf *pkts[], uint16_t cnt)
+{
+	uint16_t i;
+	int ret;
+
+	for (i = 0; i < cnt; i++) {
+		ret = dev->tx_one(dev, queue, pkts[i]);
+		if (unlikely(ret < 0))
+			return (i == 0) ? ret : (int) i;
+		if (!(ret & UK_NETDEV_STATUS_SUCCESS))
+			break;
+		if (!(ret & UK_NETDEV_STATUS_MORE)) {
+			i++;
+			break;
+		}
+	}
+	return (int) i;
+}
+
 int uk_netdev_drv_register(struct uk_netdev *dev, struct uk_alloc *a,
 			   const char *drv_name)
 {
@@ -182,6 +232,11 @@ int uk_netdev_drv_register(struct uk_netdev *dev, struct uk_alloc *a,
 	UK_ASSERT(dev->rx_one);
 	UK_ASSERT(dev->tx_one);
 
+	if (!dev->rx_burst)
+		dev->rx_burst = _rx_burst_emul;
+	if (!dev->tx_burst)
+		dev->tx_burst = _tx_burst_emul;
+
 	dev->_data = _alloc_data(a, netdev_count, drv_name);
 	if (unlikely(!dev->_data))
 		return -ENOMEM;
@@ -381,6 +436,44 @@ int uk_netdev_txq_info_get(struct uk_netdev *dev, uint16_t queue_id,
 	return dev->ops->txq_info_get(dev, queue_id, queue_info);
 }
 
+const uint8_t uk_netdev_rss_default_key[UK_NETDEV_RSS_KEY_LEN] = {
+	0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2,
+	0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0,
+	0xd0, 0xca, 0x2b, 0xcb, 0xae, 0x7b, 0x30, 0xb4,
+	0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30, 0xf2, 0x0c,
+	0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa,
+};
+
+static int uk_netdev_rss_conf_check(const struct uk_netdev_conf *dev_conf,
+				    const struct uk_netdev_info *dev_info)
+{
+	const struct uk_netdev_rss_conf *rss = dev_conf->rss;
+	uint16_t i;
+
+	if (!uk_netdev_rss_supported(dev_info->features)) {
+#if CONFIG_LIBUKNETDEV_SWRSS
+		/* Destinations are lcpus, checked by the software RSS */
+		if (rss->reta && rss->reta_size > UK_NETDEV_RSS_RETA_MAXSIZE)
+			return -EINVAL;
+		if (rss->reta && (rss->reta_size & (rss->reta_size - 1)))
+			return -EINVAL;
+		return 0;
+#else /* !CONFIG_LIBUKNETDEV_SWRSS */
+		return -ENOTSUP;
+#endif /* !CONFIG_LIBUKNETDEV_SWRSS */
+	}
+
+	if (!rss->reta)
+		return 0;
+	if (!rss->reta_size || rss->reta_size > UK_NETDEV_RSS_RETA_MAXSIZE ||
+	    (rss->reta_size & (rss->reta_size - 1)))
+		return -EINVAL;
+	for (i = 0; i < rss->reta_size; i++)
+		if (rss->reta[i] >= dev_conf->nb_rx_queues)
+			return -EINVAL;
+	return 0;
+}
+
 int uk_netdev_configure(struct uk_netdev *dev,
 			const struct uk_netdev_conf *dev_conf)
 {
@@ -401,6 +494,11 @@ int uk_netdev_configure(struct uk_netdev *dev,
 		return -EINVAL;
 	if (dev_conf->nb_tx_queues > dev_info.max_tx_queues)
 		return -EINVAL;
+	if (dev_conf->rss) {
+		ret = uk_netdev_rss_conf_check(dev_conf, &dev_info);
+		if (unlikely(ret))
+			return ret;
+	}
 
 	ret = dev->ops->configure(dev, dev_conf);
 	if (ret >= 0) {
@@ -408,8 +506,18 @@ int uk_netdev_configure(struct uk_netdev *dev,
 			   dev->_data->id);
 		dev->_data->state = UK_NETDEV_CONFIGURED;
 
+#if CONFIG_LIBUKNETDEV_SWRSS
+	if (dev_conf->rss && !uk_netdev_rss_supported(dev_info.features)) {
+		ret = uk_netdev_swrss_init(dev, dev_conf->rss);
+		if (unlikely(ret)) {
+			uk_pr_err("Could not initialize software RSS\n");
+			return ret;
+		}
+	}
+#endif /* CONFIG_LIBUKNETDEV_SWRSS */
+
 #ifdef CONFIG_LIBUKNETDEV_STATS
-	ret = uk_netdev_stats_init(dev);
+	ret = uk_netdev_stats_init(dev, dev_conf);
 	if (unlikely(ret)) {
 		uk_pr_err("Could not initialize netdev stats\n");
 		return ret;
@@ -0,0 +1,287 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+#include <errno.h>
+#include <string.h>
+
+#include <uk/alloc.h>
+#include <uk/essentials.h>
+#include <uk/netdev.h>
+#include <uk/netstructs.h>
+#include <uk/plat/lcpu.h>
+#include <uk/print.h>
+#include <uk/ring.h>
+
+#include "rss.h"
+
+#define SWRSS_RING_SIZE		CONFIG_LIBUKNETDEV_SWRSS_RING_SIZE
+
+struct uk_netdev_swrss {
+	__u32 hash_types;
+	__u8 key[UK_NETDEV_RSS_KEY_LEN];
+	/* Packets steered to an lcpu, consumed by the lcpu only */
+	struct uk_ring *ring[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+	__u16 reta_mask;
+	__u16 reta[];
+};
+
+/* Toeplitz hash of `len` bytes, `len` must be at most
+ * UK_NETDEV_RSS_KEY_LEN - 4
+ */
+static __u32 swrss_toeplitz(const __u8 *key, const __u8 *data, __sz len)
+{
+	__u32 hash = 0;
+	__u32 v;
+	__sz i;
+	int b;
+
+	v = (__u32)key[0] << 24 | (__u32)key[1] << 16 |
+	    (__u32)key[2] << 8 | key[3];
+	for (i = 0; i < len; i++) {
+		for (b = 7; b >= 0; b--) {
+			if (data[i] & (1 << b))
+				hash ^= v;
+			v = (v << 1) | ((key[i + 4] >> b) & 1);
+		}
+	}
+	return hash;
+}
+
+static inline __u16 swrss_be16(const __u8 *p)
+{
+	return (__u16)(p[0] << 8 | p[1]);
+}
+
+/* Hash over the addresses and ports of the first netbuf of a frame, 0 if the
+ * frame is not of a selected type
+ */
+static __u32 swrss_hash(const struct uk_netdev_swrss *rss,
+			const struct uk_netbuf *pkt)
+{
+	const __u8 *d = pkt->data;
+	__u8 tuple[2 * 16 + 2 * 2];
+	__sz off = UK_ETHER_HDR_LEN;
+	__sz tlen, l4;
+	__u32 ip_type, tcp_type, udp_type;
+	__u16 type;
+	__u8 proto;
+	int frag;
+
+	/* Reuse the hash computed by the device */
+	if (pkt->flags & UK_NETBUF_F_HASH)
+		return pkt->hash;
+
+	if (unlikely(pkt->len < UK_ETHER_HDR_LEN))
+		return 0;
+	type = swrss_be16(&d[off - UK_ETHER_TYPE_LEN]);
+	if (type == UK_ETHERTYPE_VLAN) {
+		off += UK_ETHER_VLAN_ENCAP_LEN;
+		if (unlikely(pkt->len < off))
+			return 0;
+		type = swrss_be16(&d[off - UK_ETHER_TYPE_LEN]);
+	}
+
+	switch (type) {
+	case UK_ETHERTYPE_IP:
+		if (unlikely(pkt->len < off + sizeof(struct uk_iphdr)))
+			return 0;
+		ip_type = UK_NETDEV_RSS_HASH_IPV4;
+		tcp_type = UK_NETDEV_RSS_HASH_TCPV4;
+		udp_type = UK_NETDEV_RSS_HASH_UDPV4;
+		proto = d[off + __offsetof(struct uk_iphdr, ip_p)];
+		frag = swrss_be16(&d[off + __offsetof(struct uk_iphdr,
+						       ip_off)])
+		       & (UK_IP_MF | UK_IP_OFFMASK);
+		tlen = 2 * 4;
+		memcpy(tuple, &d[off + __offsetof(struct uk_iphdr, ip_src)],
+		       tlen);
+		l4 = off + (d[off] & 0xf) * 4;
+		break;
+	case UK_ETHERTYPE_IPV6:
+		/* Extension headers are not followed */
+		if (unlikely(pkt->len < off + 40))
+			return 0;
+		ip_type = UK_NETDEV_RSS_HASH_IPV6;
+		tcp_type = UK_NETDEV_RSS_HASH_TCPV6;
+		udp_type = UK_NETDEV_RSS_HASH_UDPV6;
+		proto = d[off + 6];
+		frag = 0;
+		tlen = 2 * 16;
+		memcpy(tuple, &d[off + 8], tlen);
+		l4 = off + 40;
+		break;
+	default:
+		return 0;
+	}
+
+	/* Fragments do not carry ports beyond the first one */
+	if (!frag && pkt->len >= l4 + 2 * 2 &&
+	    ((proto == UK_IPPROTO_TCP && (rss->hash_types & tcp_type)) ||
+	     (proto == UK_IPPROTO_UDP && (rss->hash_types & udp_type)))) {
+		memcpy(&tuple[tlen], &d[l4], 2 * 2);
+		tlen += 2 * 2;
+	} else if (!(rss->hash_types & ip_type)) {
+		return 0;
+	}
+
+	return swrss_toeplitz(rss->key, tuple, tlen);
+}
+
+/* Keeps the packets for `self` at the front of `pkts` and hands all others
+ * to their lcpu. Returns the number of kept packets.
+ */
+static int swrss_steer(struct uk_netdev *dev, uint16_t queue_id,
+		       __lcpuidx self, struct uk_netbuf *pkts[], int cnt)
+{
+	struct uk_netdev_swrss *rss = dev->_swrss;
+	__lcpuidx dst;
+	int i, n = 0;
+
+	for (i = 0; i < cnt; i++) {
+		dst = rss->reta[swrss_hash(rss, pkts[i]) & rss->reta_mask];
+		if (dst == self) {
+			pkts[n++] = pkts[i];
+			continue;
+		}
+		if (unlikely(uk_ring_enqueue(rss->ring[dst], pkts[i]))) {
+			uk_netbuf_free(pkts[i]);
+#ifdef CONFIG_LIBUKNETDEV_STATS
+			dev->_rxq_stats[queue_id].drops++;
+#endif /* CONFIG_LIBUKNETDEV_STATS */
+		}
+	}
+	return n;
+}
+
+static int swrss_dequeue(struct uk_netdev_swrss *rss, __lcpuidx self,
+			 struct uk_netbuf *pkts[], int cnt)
+{
+	struct uk_netbuf *pkt;
+	int n = 0;
+
+	if (!rss->ring[self])
+		return 0;
+
+	while (n < cnt) {
+		pkt = uk_ring_dequeue_sc(rss->ring[self]);
+		if (!pkt)
+			break;
+		pkts[n++] = pkt;
+	}
+	return n;
+}
+
+int uk_netdev_swrss_rx_one(struct uk_netdev *dev, uint16_t queue_id,
+			   struct uk_netbuf **pkt)
+{
+	__lcpuidx self = ukplat_lcpu_idx();
+	int ret;
+
+	if (swrss_dequeue(dev->_swrss, self, pkt, 1))
+		return UK_NETDEV_STATUS_SUCCESS | UK_NETDEV_STATUS_MORE;
+
+	do {
+		ret = _uk_netdev_rx_one(dev, queue_id, pkt);
+		if (ret < 0 || !(ret & UK_NETDEV_STATUS_SUCCESS))
+			return ret;
+		if (swrss_steer(dev, queue_id, self, pkt, 1))
+			return ret;
+	} while (ret & UK_NETDEV_STATUS_MORE);
+
+	/* The last packet went to another lcpu and the queue is drained */
+	*pkt = NULL;
+	return ret & ~UK_NETDEV_STATUS_SUCCESS;
+}
+
+int uk_netdev_swrss_rx_burst(struct uk_netdev *dev, uint16_t queue_id,
+			     struct uk_netbuf *pkts[], uint16_t cnt)
+{
+	__lcpuidx self = ukplat_lcpu_idx();
+	uint16_t req;
+	int n, ret;
+
+	n = swrss_dequeue(dev->_swrss, self, pkts, cnt);
+
+	/* Less than requested from the driver means that the queue is
+	 * drained. Only then we may return less than `cnt` packets, so that
+	 * the caller can rely on the queue interrupt.
+	 */
+	while (n < cnt) {
+		req = cnt - n;
+		ret = _uk_netdev_rx_burst(dev, queue_id, &pkts[n], req);
+		if (unlikely(ret < 0))
+			return n ? n : ret;
+
+		n += swrss_steer(dev, queue_id, self, &pkts[n], ret);
+		if (ret < req)
+			break;
+	}
+	return n;
+}
+
+int uk_netdev_swrss_rx_steered(struct uk_netdev *dev,
+			       struct uk_netbuf *pkts[], uint16_t cnt)
+{
+	UK_ASSERT(dev);
+	UK_ASSERT(pkts || cnt == 0);
+
+	if (!dev->_swrss)
+		return -ENOTSUP;
+
+	return swrss_dequeue(dev->_swrss, ukplat_lcpu_idx(), pkts, cnt);
+}
+
+int uk_netdev_swrss_init(struct uk_netdev *dev,
+			 const struct uk_netdev_rss_conf *conf)
+{
+	struct uk_alloc *a = uk_alloc_get_default();
+	struct uk_netdev_swrss *rss;
+	__u16 reta_size;
+	__u32 nb_lcpus;
+	int i, rc;
+
+	UK_ASSERT(dev);
+	UK_ASSERT(conf);
+
+	reta_size = conf->reta ? conf->reta_size : UK_NETDEV_RSS_RETA_MAXSIZE;
+	rss = uk_zalloc(a, sizeof(*rss) + reta_size * sizeof(rss->reta[0]));
+	if (unlikely(!rss))
+		return -ENOMEM;
+
+	rss->hash_types = conf->hash_types ? conf->hash_types
+					   : UK_NETDEV_RSS_HASH_ALL;
+	memcpy(rss->key, conf->key ? conf->key : uk_netdev_rss_default_key,
+	       UK_NETDEV_RSS_KEY_LEN);
+	rss->reta_mask = reta_size - 1;
+
+	nb_lcpus = ukplat_lcpu_count();
+	for (i = 0; i < reta_size; i++) {
+		rss->reta[i] = conf->reta ? conf->reta[i] : i % nb_lcpus;
+		if (unlikely(rss->reta[i] >= CONFIG_UKPLAT_LCPU_MAXCOUNT)) {
+			rc = -EINVAL;
+			goto err_free;
+		}
+		if (rss->ring[rss->reta[i]])
+			continue;
+
+		rss->ring[rss->reta[i]] = uk_ring_alloc(SWRSS_RING_SIZE, a);
+		if (unlikely(!rss->ring[rss->reta[i]])) {
+			rc = -ENOMEM;
+			goto err_free;
+		}
+	}
+
+	dev->_swrss = rss;
+	uk_pr_info("netdev%"PRIu16": Software RSS over %"PRIu16" entries\n",
+		   dev->_data->id, reta_size);
+	return 0;
+
+err_free:
+	for (i = 0; i < CONFIG_UKPLAT_LCPU_MAXCOUNT; i++)
+		if (rss->ring[i])
+			uk_ring_free(rss->ring[i], a);
+	uk_free(a, rss);
+	return rc;
+}
@@ -0,0 +1,9 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/* Set up software RSS for a device without UK_NETDEV_F_RSS */
+int uk_netdev_swrss_init(struct uk_netdev *dev,
+			 const struct uk_netdev_rss_conf *conf);
@@ -0,0 +1,223 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+#include <errno.h>
+
+#include <uk/alloc.h>
+#include <uk/essentials.h>
+#include <uk/netdev.h>
+#include <uk/netdev_driver.h>
+#include <uk/print.h>
+#include <uk/ring.h>
+
+#define RXFILTER_RING_SIZE	CONFIG_LIBUKNETDEV_RXFILTER_RING_SIZE
+
+struct uk_netdev_rxfilter {
+	uk_netdev_rx_filter_t filter;
+	void *argp;
+	/* Packets redirected to a receive queue, consumed by its owner */
+	struct uk_ring *ring[CONFIG_LIBUKNETDEV_MAXNBQUEUES];
+};
+
+/* Receives from the driver, or from software RSS if it is enabled */
+static inline int rxfilter_next_one(struct uk_netdev *dev, uint16_t queue_id,
+				    struct uk_netbuf **pkt)
+{
+#if CONFIG_LIBUKNETDEV_SWRSS
+	if (dev->_swrss)
+		return uk_netdev_swrss_rx_one(dev, queue_id, pkt);
+#endif /* CONFIG_LIBUKNETDEV_SWRSS */
+	return _uk_netdev_rx_one(dev, queue_id, pkt);
+}
+
+static inline int rxfilter_next_burst(struct uk_netdev *dev, uint16_t queue_id,
+				      struct uk_netbuf *pkts[], uint16_t cnt)
+{
+#if CONFIG_LIBUKNETDEV_SWRSS
+	if (dev->_swrss)
+		return uk_netdev_swrss_rx_burst(dev, queue_id, pkts, cnt);
+#endif /* CONFIG_LIBUKNETDEV_SWRSS */
+	return _uk_netdev_rx_burst(dev, queue_id, pkts, cnt);
+}
+
+static void rxfilter_reflect(struct uk_netdev *dev, uint16_t queue_id,
+			     struct uk_netbuf *pkt)
+{
+	int ret;
+
+	if (unlikely(PTRISERR(dev->_tx_queue[queue_id]))) {
+		uk_netbuf_free(pkt);
+		return;
+	}
+
+	ret = uk_netdev_tx_one(dev, queue_id, pkt);
+	if (unlikely(ret < 0 || !(ret & UK_NETDEV_STATUS_SUCCESS)))
+		uk_netbuf_free(pkt);
+}
+
+static void rxfilter_redirect(struct uk_netdev *dev, uint16_t queue_id,
+			      struct uk_netbuf *pkt)
+{
+	struct uk_ring *ring;
+
+	ring = (queue_id < CONFIG_LIBUKNETDEV_MAXNBQUEUES)
+	       ? dev->_rxfilter->ring[queue_id] : NULL;
+	if (unlikely(!ring || uk_ring_enqueue(ring, pkt))) {
+		uk_netbuf_free(pkt);
+		return;
+	}
+
+	/* The owner of the queue may be waiting for an interrupt */
+	uk_netdev_drv_rx_event(dev, queue_id);
+}
+
+/* Runs the filter over `pkts`, keeps the passed packets at the front, and
+ * returns their number
+ */
+static int rxfilter_apply(struct uk_netdev *dev, uint16_t queue_id,
+			  struct uk_netbuf *pkts[], int cnt)
+{
+	struct uk_netdev_rxfilter *rxf = dev->_rxfilter;
+	int i, act, n = 0;
+
+	for (i = 0; i < cnt; i++) {
+		act = rxf->filter(dev, queue_id, pkts[i], rxf->argp);
+		if (likely(act == UK_NETDEV_RXF_PASS)) {
+			pkts[n++] = pkts[i];
+		} else if (act == UK_NETDEV_RXF_TX) {
+			rxfilter_reflect(dev, queue_id, pkts[i]);
+		} else if (act & UK_NETDEV_RXF_REDIRECT_FLAG) {
+			if ((__u16)act == queue_id)
+				pkts[n++] = pkts[i];
+			else
+				rxfilter_redirect(dev, (__u16)act, pkts[i]);
+		} else {
+			uk_netbuf_free(pkts[i]);
+		}
+	}
+	return n;
+}
+
+static int rxfilter_dequeue(struct uk_netdev_rxfilter *rxf, uint16_t queue_id,
+			    struct uk_netbuf *pkts[], int cnt)
+{
+	struct uk_netbuf *pkt;
+	int n = 0;
+
+	if (!rxf->ring[queue_id])
+		return 0;
+
+	while (n < cnt) {
+		pkt = uk_ring_dequeue_sc(rxf->ring[queue_id]);
+		if (!pkt)
+			break;
+		pkts[n++] = pkt;
+	}
+	return n;
+}
+
+int uk_netdev_rxfilter_rx_one(struct uk_netdev *dev, uint16_t queue_id,
+			      struct uk_netbuf **pkt)
+{
+	int ret;
+
+	if (rxfilter_dequeue(dev->_rxfilter, queue_id, pkt, 1))
+		return UK_NETDEV_STATUS_SUCCESS | UK_NETDEV_STATUS_MORE;
+
+	do {
+		ret = rxfilter_next_one(dev, queue_id, pkt);
+		if (ret < 0 || !(ret & UK_NETDEV_STATUS_SUCCESS))
+			return ret;
+		if (rxfilter_apply(dev, queue_id, pkt, 1))
+			return ret;
+	} while (ret & UK_NETDEV_STATUS_MORE);
+
+	/* The last packet was filtered and the queue is drained */
+	*pkt = NULL;
+	return ret & ~UK_NETDEV_STATUS_SUCCESS;
+}
+
+int uk_netdev_rxfilter_rx_burst(struct uk_netdev *dev, uint16_t queue_id,
+				struct uk_netbuf *pkts[], uint16_t cnt)
+{
+	uint16_t req;
+	int n, ret;
+
+	n = rxfilter_dequeue(dev->_rxfilter, queue_id, pkts, cnt);
+
+	/* Less than requested from the driver means that the queue is
+	 * drained. Only then we may return less than `cnt` packets, so that
+	 * the caller can rely on the queue interrupt.
+	 */
+	while (n < cnt) {
+		req = cnt - n;
+		ret = rxfilter_next_burst(dev, queue_id, &pkts[n], req);
+		if (unlikely(ret < 0))
+			return n ? n : ret;
+
+		n += rxfilter_apply(dev, queue_id, &pkts[n], ret);
+		if (ret < req)
+			break;
+	}
+	return n;
+}
+
+static void rxfilter_free(struct uk_netdev_rxfilter *rxf, struct uk_alloc *a)
+{
+	struct uk_netbuf *pkt;
+	int i;
+
+	for (i = 0; i < CONFIG_LIBUKNETDEV_MAXNBQUEUES; i++) {
+		if (!rxf->ring[i])
+			continue;
+		while ((pkt = uk_ring_dequeue_sc(rxf->ring[i])))
+			uk_netbuf_free(pkt);
+		uk_ring_free(rxf->ring[i], a);
+	}
+	uk_free(a, rxf);
+}
+
+int uk_netdev_rx_filter_set(struct uk_netdev *dev,
+			    uk_netdev_rx_filter_t filter, void *argp)
+{
+	struct uk_alloc *a = uk_alloc_get_default();
+	struct uk_netdev_rxfilter *rxf;
+	int i;
+
+	UK_ASSERT(dev);
+	UK_ASSERT(dev->_data);
+
+	if (unlikely(dev->_data->state != UK_NETDEV_CONFIGURED))
+		return -EINVAL;
+
+	if (dev->_rxfilter) {
+		rxfilter_free(dev->_rxfilter, a);
+		dev->_rxfilter = NULL;
+	}
+	if (!filter)
+		return 0;
+
+	rxf = uk_zalloc(a, sizeof(*rxf));
+	if (unlikely(!rxf))
+		return -ENOMEM;
+	rxf->filter = filter;
+	rxf->argp = argp;
+
+	for (i = 0; i < CONFIG_LIBUKNETDEV_MAXNBQUEUES; i++) {
+		if (PTRISERR(dev->_rx_queue[i]))
+			continue;
+
+		rxf->ring[i] = uk_ring_alloc(RXFILTER_RING_SIZE, a);
+		if (unlikely(!rxf->ring[i])) {
+			rxfilter_free(rxf, a);
+			return -ENOMEM;
+		}
+	}
+
+	dev->_rxfilter = rxf;
+	uk_pr_info("netdev%"PRIu16": Installed receive filter %p\n",
+		   dev->_data->id, filter);
+	return 0;
+}
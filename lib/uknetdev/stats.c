@@ -5,148 +5,164 @@
  */
 #define _GNU_SOURCE /* asprintf */
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include <uk/atomic.h>
 #include <uk/essentials.h>
 #include <uk/event.h>
 #include <uk/libid.h>
 #include <uk/netdev.h>
 #include <uk/netdev_store.h>
-#include <uk/spinlock.h>
 #include <uk/store.h>
 
-static int get_tx_bytes(void *cookie, __u64 *out)
+static inline __u64 sum_counter(const struct uk_netdev_queue_stats *stats,
+				__sz offset)
 {
-	struct uk_netdev *dev = (struct uk_netdev *)cookie;
+	__u64 sum = 0;
+	int i;
 
-	UK_ASSERT(dev);
-
-	uk_spin_lock(&dev->_stats_lock);
-	*out = dev->_stats.tx_m.bytes;
-	uk_spin_unlock(&dev->_stats_lock);
-
-	return 0;
-}
-
-static int get_tx_packets(void *cookie, __u64 *out)
-{
-	struct uk_netdev *dev = (struct uk_netdev *)cookie;
-
-	UK_ASSERT(dev);
-
-	uk_spin_lock(&dev->_stats_lock);
-	*out = dev->_stats.tx_m.packets;
-	uk_spin_unlock(&dev->_stats_lock);
-
-	return 0;
-}
-
-static int get_tx_errors(void *cookie, __u64 *out)
-{
-	struct uk_netdev *dev = (struct uk_netdev *)cookie;
-
-	UK_ASSERT(dev);
-
-	uk_spin_lock(&dev->_stats_lock);
-	*out = dev->_stats.tx_m.errors;
-	uk_spin_unlock(&dev->_stats_lock);
-
-	return 0;
+	for (i = 0; i < CONFIG_LIBUKNETDEV_MAXNBQUEUES; i++)
+		sum += UK_READ_ONCE(*(const __u64 *)((const char *)&stats[i] +
+						     offset));
+	return sum;
 }
 
-static int get_tx_fifo(void *cookie, __u64 *out)
-{
-	struct uk_netdev *dev = (struct uk_netdev *)cookie;
-
-	UK_ASSERT(dev);
-
-	uk_spin_lock(&dev->_stats_lock);
-	*out = dev->_stats.tx_m.fifo;
-	uk_spin_unlock(&dev->_stats_lock);
-
-	return 0;
-}
+/* Device totals are the sums over all queues */
+#define DEV_GETTER(dir, name, counter)					\
+	static int get_##dir##_##name(void *cookie, __u64 *out)	\
+	{								\
+		struct uk_netdev *dev = (struct uk_netdev *)cookie;	\
+									\
+		UK_ASSERT(dev);						\
+									\
+		*out = sum_counter(dev->_##dir##q_stats,		\
+				   __offsetof(struct uk_netdev_queue_stats, \
+					      counter));		\
+		return 0;						\
+	}
 
-static int get_rx_bytes(void *cookie, __u64 *out)
-{
-	struct uk_netdev *dev = (struct uk_netdev *)cookie;
+DEV_GETTER(tx, bytes, bytes)
+DEV_GETTER(tx, packets, packets)
+DEV_GETTER(tx, errors, drops)
+DEV_GETTER(tx, fifo, ring_full)
+DEV_GETTER(tx, kicks, kicks)
+DEV_GETTER(rx, bytes, bytes)
+DEV_GETTER(rx, packets, packets)
+DEV_GETTER(rx, errors, drops)
+DEV_GETTER(rx, fifo, ring_full)
+DEV_GETTER(rx, kicks, kicks)
 
-	UK_ASSERT(dev);
+static const struct uk_store_entry *dyn_entries[] = {
+	UK_STORE_ENTRY(UK_NETDEV_STATS_TX_BYTES, tx_bytes, u64,
+		       get_tx_bytes, NULL),
+	UK_STORE_ENTRY(UK_NETDEV_STATS_TX_PACKETS, tx_packets, u64,
+		       get_tx_packets, NULL),
+	UK_STORE_ENTRY(UK_NETDEV_STATS_TX_ERRORS, tx_errors, u64,
+		       get_tx_errors, NULL),
+	UK_STORE_ENTRY(UK_NETDEV_STATS_TX_FIFO, tx_fifo, u64,
+		       get_tx_fifo, NULL),
+	UK_STORE_ENTRY(UK_NETDEV_STATS_TX_KICKS, tx_kicks, u64,
+		       get_tx_kicks, NULL),
+	UK_STORE_ENTRY(UK_NETDEV_STATS_RX_BYTES, rx_bytes, u64,
+		       get_rx_bytes, NULL),
+	UK_STORE_ENTRY(UK_NETDEV_STATS_RX_PACKETS, rx_packets, u64,
+		       get_rx_packets, NULL),
+	UK_STORE_ENTRY(UK_NETDEV_STATS_RX_ERRORS, rx_errors, u64,
+		       get_rx_errors, NULL),
+	UK_STORE_ENTRY(UK_NETDEV_STATS_RX_FIFO, rx_fifo, u64,
+		       get_rx_fifo, NULL),
+	UK_STORE_ENTRY(UK_NETDEV_STATS_RX_KICKS, rx_kicks, u64,
+		       get_rx_kicks, NULL),
+	NULL
+};
 
-	uk_spin_lock(&dev->_stats_lock);
-	*out = dev->_stats.rx_m.bytes;
-	uk_spin_unlock(&dev->_stats_lock);
+#define QUEUE_GETTER(counter)						\
+	static int get_q_##counter(void *cookie, __u64 *out)		\
+	{								\
+		struct uk_netdev_queue_stats *stats = cookie;		\
+									\
+		UK_ASSERT(stats);					\
+									\
+		*out = UK_READ_ONCE(stats->counter);			\
+		return 0;						\
+	}
 
-	return 0;
-}
+QUEUE_GETTER(packets)
+QUEUE_GETTER(bytes)
+QUEUE_GETTER(drops)
+QUEUE_GETTER(ring_full)
+QUEUE_GETTER(kicks)
+
+static const struct uk_store_entry *queue_entries[] = {
+	UK_STORE_ENTRY(UK_NETDEV_STATS_Q_PACKETS, packets, u64,
+		       get_q_packets, NULL),
+	UK_STORE_ENTRY(UK_NETDEV_STATS_Q_BYTES, bytes, u64,
+		       get_q_bytes, NULL),
+	UK_STORE_ENTRY(UK_NETDEV_STATS_Q_DROPS, drops, u64,
+		       get_q_drops, NULL),
+	UK_STORE_ENTRY(UK_NETDEV_STATS_Q_RING_FULL, ring_full, u64,
+		       get_q_ring_full, NULL),
+	UK_STORE_ENTRY(UK_NETDEV_STATS_Q_KICKS, kicks, u64,
+		       get_q_kicks, NULL),
+	NULL
+};
 
-static int get_rx_packets(void *cookie, __u64 *out)
+void uk_netdev_rxq_stats_get(struct uk_netdev *dev, uint16_t queue_id,
+			     struct uk_netdev_queue_stats *stats)
 {
-	struct uk_netdev *dev = (struct uk_netdev *)cookie;
-
 	UK_ASSERT(dev);
+	UK_ASSERT(queue_id < CONFIG_LIBUKNETDEV_MAXNBQUEUES);
+	UK_ASSERT(stats);
 
-	uk_spin_lock(&dev->_stats_lock);
-	*out = dev->_stats.rx_m.packets;
-	uk_spin_unlock(&dev->_stats_lock);
-
-	return 0;
+	memcpy(stats, &dev->_rxq_stats[queue_id], sizeof(*stats));
 }
 
-static int get_rx_errors(void *cookie, __u64 *out)
+void uk_netdev_txq_stats_get(struct uk_netdev *dev, uint16_t queue_id,
+			     struct uk_netdev_queue_stats *stats)
 {
-	struct uk_netdev *dev = (struct uk_netdev *)cookie;
-
 	UK_ASSERT(dev);
+	UK_ASSERT(queue_id < CONFIG_LIBUKNETDEV_MAXNBQUEUES);
+	UK_ASSERT(stats);
 
-	uk_spin_lock(&dev->_stats_lock);
-	*out = dev->_stats.rx_m.errors;
-	uk_spin_unlock(&dev->_stats_lock);
-
-	return 0;
+	memcpy(stats, &dev->_txq_stats[queue_id], sizeof(*stats));
 }
 
-static int get_rx_fifo(void *cookie, __u64 *out)
+/* Creates a store object for a queue, e.g., "netdev0_rxq1" */
+static int queue_stats_init(struct uk_netdev_queue_stats *stats,
+			    __u64 obj_id, uint16_t dev_id, const char *dir,
+			    uint16_t queue_id)
 {
-	struct uk_netdev *dev = (struct uk_netdev *)cookie;
+	struct uk_store_object *obj;
+	char *obj_name;
+	int res;
 
-	UK_ASSERT(dev);
+	res = asprintf(&obj_name, "netdev%d_%sq%d", dev_id, dir, queue_id);
+	if (unlikely(res == -1)) {
+		uk_pr_err("Could not allocate object name\n");
+		return -ENOMEM;
+	}
 
-	uk_spin_lock(&dev->_stats_lock);
-	*out = dev->_stats.rx_m.fifo;
-	uk_spin_unlock(&dev->_stats_lock);
+	obj = uk_store_obj_alloc(uk_alloc_get_default(), obj_id, obj_name,
+				 queue_entries, (void *)stats);
+	free(obj_name);
+	if (PTRISERR(obj))
+		return PTR2ERR(obj);
 
-	return 0;
+	return uk_store_obj_add(obj);
 }
 
-static const struct uk_store_entry *dyn_entries[] = {
-	UK_STORE_ENTRY(UK_NETDEV_STATS_TX_BYTES, "tx_bytes", u64,
-		       get_tx_bytes, NULL),
-	UK_STORE_ENTRY(UK_NETDEV_STATS_TX_PACKETS, "tx_packets", u64,
-		       get_tx_packets, NULL),
-	UK_STORE_ENTRY(UK_NETDEV_STATS_TX_ERRORS, "tx_errors", u64,
-		       get_tx_errors, NULL),
-	UK_STORE_ENTRY(UK_NETDEV_STATS_TX_FIFO, "tx_fifo", u64,
-		       get_tx_fifo, NULL),
-	UK_STORE_ENTRY(UK_NETDEV_STATS_RX_BYTES, "rx_bytes", u64,
-		       get_rx_bytes, NULL),
-	UK_STORE_ENTRY(UK_NETDEV_STATS_RX_PACKETS, "rx_packets", u64,
-		       get_rx_packets, NULL),
-	UK_STORE_ENTRY(UK_NETDEV_STATS_RX_ERRORS, "rx_errors", u64,
-		       get_rx_errors, NULL),
-	UK_STORE_ENTRY(UK_NETDEV_STATS_RX_FIFO, "rx_fifo", u64,
-		       get_rx_fifo, NULL),
-	NULL
-};
-
-int uk_netdev_stats_init(struct uk_netdev *dev)
+int uk_netdev_stats_init(struct uk_netdev *dev,
+			 const struct uk_netdev_conf *conf)
 {
 	int res;
 	struct uk_store_object *obj = NULL;
 	uint16_t dev_id = uk_netdev_id_get(dev);
 	char *obj_name;
+	uint16_t i;
 
-	memset(&dev->_stats, 0, sizeof(dev->_stats));
-	ukarch_spin_init(&dev->_stats_lock);
+	memset(dev->_rxq_stats, 0, sizeof(dev->_rxq_stats));
+	memset(dev->_txq_stats, 0, sizeof(dev->_txq_stats));
 
 	/* Create stats object */
 	res = asprintf(&obj_name, "netdev%d", dev_id);
@@ -157,6 +173,7 @@ int uk_netdev_stats_init(struct uk_netdev *dev)
 
 	obj = uk_store_obj_alloc(uk_alloc_get_default(), dev_id, obj_name,
 				 dyn_entries, (void *)dev);
+	free(obj_name);
 	if (PTRISERR(obj))
 		return PTR2ERR(obj);
 
@@ -164,5 +181,20 @@ int uk_netdev_stats_init(struct uk_netdev *dev)
 	if (unlikely(res))
 		return res;
 
+	for (i = 0; i < conf->nb_rx_queues; i++) {
+		res = queue_stats_init(&dev->_rxq_stats[i],
+				       UK_NETDEV_STATS_RXQ_OBJ_ID(dev_id, i),
+				       dev_id, "rx", i);
+		if (unlikely(res))
+			return res;
+	}
+	for (i = 0; i < conf->nb_tx_queues; i++) {
+		res = queue_stats_init(&dev->_txq_stats[i],
+				       UK_NETDEV_STATS_TXQ_OBJ_ID(dev_id, i),
+				       dev_id, "tx", i);
+		if (unlikely(res))
+			return res;
+	}
+
 	return 0;
 }
@@ -5,4 +5,5 @@
  */
 
 /* Initialize netdev stats */
-int uk_netdev_stats_init(struct uk_netdev *dev);
+int uk_netdev_stats_init(struct uk_netdev *dev,
+			 const struct uk_netdev_conf *conf);
@@ -0,0 +1,428 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * Packet rate and throughput of the uknetdev data path, without a network
+ * stack. Frames are sent on the transmit device and, in the loopback
+ * benchmarks, received again on the receive device. The host has to forward
+ * frames between the two, e.g., by attaching both tap devices to a bridge.
+ * If both are the same device, the host has to reflect the frames.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <uk/alloc.h>
+#include <uk/arch/time.h>
+#include <uk/bench.h>
+#include <uk/netbuf.h>
+#include <uk/netdev.h>
+#include <uk/plat/time.h>
+#if CONFIG_LIBUKNETDEV_DISPATCHERTHREADS
+#include <uk/sched.h>
+#endif /* CONFIG_LIBUKNETDEV_DISPATCHERTHREADS */
+
+/* IEEE 802 local experimental EtherType */
+#define BENCH_ETHERTYPE		0x88b5
+#define BENCH_LEN_MIN		UK_ETH_FRAME_MINLEN
+#define BENCH_LEN_MAX		\
+	(UK_ETH_HDR_UNTAGGED_LEN + UK_ETH_PAYLOAD_MAXLEN)
+#define BENCH_BUFLEN		2048
+#define BENCH_POOL_SIZE		2048
+#define BENCH_BURST		CONFIG_LIBUKNETDEV_BENCH_BURST
+#define BENCH_TIMEOUT		ukarch_time_sec_to_nsec(1)
+
+struct bench_port {
+	struct uk_netdev *dev;
+	struct uk_netbuf_pool *pool;
+	struct uk_hwaddr hwaddr;
+	/* Statistics at the start of the current run */
+	struct uk_netdev_queue_stats rxs;
+	struct uk_netdev_queue_stats txs;
+};
+
+static struct bench_port bench_ports[2];
+static struct bench_port *txp;
+static struct bench_port *rxp;
+
+static __u64 bench_irqs;
+static __u64 bench_irqs_start;
+
+static void bench_rx_event(struct uk_netdev *dev __unused,
+			   uint16_t queue_id __unused, void *argp __unused)
+{
+	__atomic_add_fetch(&bench_irqs, 1, __ATOMIC_RELAXED);
+}
+
+static int bench_port_setup(struct bench_port *p, unsigned int idx)
+{
+	struct uk_alloc *a = uk_alloc_get_default();
+	struct uk_netdev_rxqueue_conf rxq_conf;
+	struct uk_netdev_txqueue_conf txq_conf;
+	struct uk_netdev_conf conf;
+	struct uk_netdev_info info;
+	const struct uk_hwaddr *hwaddr;
+	uint16_t headroom;
+	int rc;
+
+	p->dev = uk_netdev_get(idx);
+	if (!p->dev)
+		return -ENODEV;
+
+	if (uk_netdev_state_get(p->dev) == UK_NETDEV_UNPROBED) {
+		rc = uk_netdev_probe(p->dev);
+		if (unlikely(rc < 0))
+			return rc;
+	}
+	/* A device that someone else set up is left alone */
+	if (uk_netdev_state_get(p->dev) != UK_NETDEV_UNCONFIGURED)
+		return -EBUSY;
+
+	uk_netdev_info_get(p->dev, &info);
+	headroom = MAX(info.nb_encap_tx, info.nb_encap_rx);
+	p->pool = uk_netbuf_pool_alloc(a, BENCH_POOL_SIZE,
+				       BENCH_BUFLEN + headroom,
+				       MAX(info.ioalign, sizeof(void *)),
+				       headroom, 0);
+	if (unlikely(!p->pool))
+		return -ENOMEM;
+
+	conf.nb_rx_queues = 1;
+	conf.nb_tx_queues = 1;
+	conf.rss = NULL;
+	rc = uk_netdev_configure(p->dev, &conf);
+	if (unlikely(rc < 0))
+		return rc;
+
+	memset(&rxq_conf, 0, sizeof(rxq_conf));
+	rxq_conf.callback = bench_rx_event;
+	rxq_conf.a = a;
+	rxq_conf.alloc_rxpkts = uk_netbuf_pool_alloc_rxpkts;
+	rxq_conf.alloc_rxpkts_argp = p->pool;
+#if CONFIG_LIBUKNETDEV_DISPATCHERTHREADS
+	rxq_conf.s = uk_sched_current();
+#endif /* CONFIG_LIBUKNETDEV_DISPATCHERTHREADS */
+	rc = uk_netdev_rxq_configure(p->dev, 0, 0, &rxq_conf);
+	if (unlikely(rc < 0))
+		return rc;
+
+	txq_conf.a = a;
+	rc = uk_netdev_txq_configure(p->dev, 0, 0, &txq_conf);
+	if (unlikely(rc < 0))
+		return rc;
+
+	rc = uk_netdev_start(p->dev);
+	if (unlikely(rc < 0))
+		return rc;
+
+	hwaddr = uk_netdev_hwaddr_get(p->dev);
+	if (hwaddr)
+		p->hwaddr = *hwaddr;
+
+	/* Interrupts are counted per packet. Devices without interrupt
+	 * support are polled all the same.
+	 */
+	uk_netdev_rxq_intr_enable(p->dev, 0);
+	return 0;
+}
+
+static int bench_netdev_init(struct uk_benchsuite *suite __unused)
+{
+	int rc;
+
+	rc = bench_port_setup(&bench_ports[0],
+			      CONFIG_LIBUKNETDEV_BENCH_TXDEV);
+	if (unlikely(rc < 0)) {
+		uk_pr_warn("bench: netdev %d is not available: %d\n",
+			   CONFIG_LIBUKNETDEV_BENCH_TXDEV, rc);
+		return 0;
+	}
+	txp = &bench_ports[0];
+
+	if (CONFIG_LIBUKNETDEV_BENCH_RXDEV == CONFIG_LIBUKNETDEV_BENCH_TXDEV) {
+		rxp = txp;
+		return 0;
+	}
+
+	rc = bench_port_setup(&bench_ports[1],
+			      CONFIG_LIBUKNETDEV_BENCH_RXDEV);
+	if (unlikely(rc < 0)) {
+		uk_pr_warn("bench: netdev %d is not available: %d\n",
+			   CONFIG_LIBUKNETDEV_BENCH_RXDEV, rc);
+		return 0;
+	}
+	rxp = &bench_ports[1];
+	return 0;
+}
+
+static void bench_stats_start(void)
+{
+	uk_netdev_txq_stats_get(txp->dev, 0, &txp->txs);
+	if (rxp)
+		uk_netdev_rxq_stats_get(rxp->dev, 0, &rxp->rxs);
+	bench_irqs_start = __atomic_load_n(&bench_irqs, __ATOMIC_RELAXED);
+}
+
+/* Count device notifications and interrupts of the current run */
+static void bench_stats_stop(struct uk_bench_ctx *b)
+{
+	struct uk_netdev_queue_stats s;
+	__u64 kicks;
+
+	uk_netdev_txq_stats_get(txp->dev, 0, &s);
+	kicks = s.kicks - txp->txs.kicks;
+	if (rxp) {
+		uk_netdev_rxq_stats_get(rxp->dev, 0, &s);
+		kicks += s.kicks - rxp->rxs.kicks;
+	}
+	uk_bench_count(b, "kicks", kicks);
+	uk_bench_count(b, "irqs", __atomic_load_n(&bench_irqs,
+						  __ATOMIC_RELAXED) -
+				   bench_irqs_start);
+}
+
+static struct uk_netbuf *bench_pkt(uint16_t len)
+{
+	struct uk_netbuf *nb;
+	__u8 *hdr;
+
+	nb = uk_netbuf_pool_take(txp->pool);
+	if (unlikely(!nb))
+		return NULL;
+
+	hdr = nb->data;
+	memcpy(hdr, rxp ? &rxp->hwaddr : &txp->hwaddr, UK_ETH_ADDR_LEN);
+	memcpy(hdr + UK_ETH_ADDR_LEN, &txp->hwaddr, UK_ETH_ADDR_LEN);
+	hdr[2 * UK_ETH_ADDR_LEN] = BENCH_ETHERTYPE >> 8;
+	hdr[2 * UK_ETH_ADDR_LEN + 1] = BENCH_ETHERTYPE & 0xff;
+	nb->len = len;
+	return nb;
+}
+
+static inline int bench_is_own(struct uk_netbuf *nb)
+{
+	const __u8 *hdr = nb->data;
+
+	return nb->len >= UK_ETH_HDR_UNTAGGED_LEN &&
+	       hdr[2 * UK_ETH_ADDR_LEN] == (BENCH_ETHERTYPE >> 8) &&
+	       hdr[2 * UK_ETH_ADDR_LEN + 1] == (BENCH_ETHERTYPE & 0xff);
+}
+
+/* Sends `cnt` frames, with tx_one() if `burst` is not set */
+static int bench_send(uint16_t len, unsigned int cnt, int burst)
+{
+	struct uk_netbuf *pkts[BENCH_BURST];
+	unsigned int i, sent = 0;
+	__nsec deadline = 0;
+	int rc;
+
+	UK_ASSERT(cnt <= BENCH_BURST);
+
+	for (i = 0; i < cnt; i++) {
+		pkts[i] = bench_pkt(len);
+		if (unlikely(!pkts[i])) {
+			rc = -ENOBUFS;
+			goto out_free;
+		}
+	}
+
+	while (sent < cnt) {
+		if (burst) {
+			rc = uk_netdev_tx_burst(txp->dev, 0, pkts + sent,
+						cnt - sent);
+			if (unlikely(rc < 0))
+				goto out_free;
+			sent += rc;
+			if (sent == cnt)
+				break;
+		} else {
+			rc = uk_netdev_tx_one(txp->dev, 0, pkts[sent]);
+			if (unlikely(rc < 0))
+				goto out_free;
+			if (uk_netdev_status_successful(rc)) {
+				sent++;
+				continue;
+			}
+		}
+
+		/* The transmit ring is full until the host catches up */
+		if (!deadline)
+			deadline = ukplat_monotonic_clock() + BENCH_TIMEOUT;
+		else if (ukplat_monotonic_clock() > deadline) {
+			rc = -ETIMEDOUT;
+			goto out_free;
+		}
+	}
+	return 0;
+
+out_free:
+	while (sent < i)
+		uk_netbuf_free(pkts[sent++]);
+	return rc;
+}
+
+/* Receives `cnt` of the frames that were sent, dropping all others */
+static int bench_recv(unsigned int cnt, int burst)
+{
+	struct uk_netbuf *pkts[BENCH_BURST];
+	__nsec deadline = 0;
+	unsigned int got = 0;
+	int i, rc;
+
+	UK_ASSERT(cnt <= BENCH_BURST);
+
+	while (got < cnt) {
+		if (burst) {
+			rc = uk_netdev_rx_burst(rxp->dev, 0, pkts, cnt - got);
+			if (unlikely(rc < 0))
+				return rc;
+		} else {
+			rc = uk_netdev_rx_one(rxp->dev, 0, pkts);
+			if (unlikely(rc < 0))
+				return rc;
+			rc = uk_netdev_status_successful(rc) ? 1 : 0;
+		}
+
+		for (i = 0; i < rc; i++) {
+			if (bench_is_own(pkts[i]))
+				got++;
+			uk_netbuf_free(pkts[i]);
+		}
+		if (rc)
+			continue;
+
+		if (!deadline)
+			deadline = ukplat_monotonic_clock() + BENCH_TIMEOUT;
+		else if (ukplat_monotonic_clock() > deadline)
+			return -ETIMEDOUT;
+	}
+	return 0;
+}
+
+/* Drops frames that are left over from previous runs */
+static void bench_drain(void)
+{
+	struct uk_netbuf *pkts[BENCH_BURST];
+	int i, rc;
+
+	do {
+		rc = uk_netdev_rx_burst(rxp->dev, 0, pkts, BENCH_BURST);
+		for (i = 0; i < rc; i++)
+			uk_netbuf_free(pkts[i]);
+	} while (rc > 0);
+}
+
+static void bench_tx(struct uk_bench_ctx *b, uint16_t len, int burst)
+{
+	unsigned int cnt;
+	__u64 i;
+	int rc;
+
+	uk_bench_timer_stop(b);
+	if (!txp) {
+		uk_bench_skip(b, "no transmit device");
+		return;
+	}
+	b->bytes = len;
+	bench_stats_start();
+	uk_bench_timer_start(b);
+
+	for (i = 0; i < b->n; i += cnt) {
+		cnt = burst ? MIN(b->n - i, (__u64)BENCH_BURST) : 1;
+		rc = bench_send(len, cnt, burst);
+		if (unlikely(rc < 0)) {
+			uk_bench_skip(b, "failed to send: %d", rc);
+			return;
+		}
+	}
+
+	uk_bench_timer_stop(b);
+	bench_stats_stop(b);
+}
+
+static void bench_loopback(struct uk_bench_ctx *b, uint16_t len, int burst)
+{
+	unsigned int cnt;
+	__u64 i;
+	int rc;
+
+	uk_bench_timer_stop(b);
+	if (!txp || !rxp) {
+		uk_bench_skip(b, "no transmit or receive device");
+		return;
+	}
+	b->bytes = len;
+	bench_drain();
+	bench_stats_start();
+	uk_bench_timer_start(b);
+
+	for (i = 0; i < b->n; i += cnt) {
+		cnt = burst ? MIN(b->n - i, (__u64)BENCH_BURST) : 1;
+		rc = bench_send(len, cnt, burst);
+		if (unlikely(rc < 0)) {
+			uk_bench_skip(b, "failed to send: %d", rc);
+			return;
+		}
+		rc = bench_recv(cnt, burst);
+		if (unlikely(rc < 0)) {
+			uk_bench_skip(b, "failed to receive: %d", rc);
+			return;
+		}
+	}
+
+	uk_bench_timer_stop(b);
+	bench_stats_stop(b);
+}
+
+UK_BENCHMARK_DESC(uknetdev_benchsuite, tx_one_min,
+		  "uk_netdev_tx_one(), minimum size frames")
+{
+	bench_tx(b, BENCH_LEN_MIN, 0);
+}
+
+UK_BENCHMARK_DESC(uknetdev_benchsuite, tx_one_max,
+		  "uk_netdev_tx_one(), full size frames")
+{
+	bench_tx(b, BENCH_LEN_MAX, 0);
+}
+
+UK_BENCHMARK_DESC(uknetdev_benchsuite, tx_burst_min,
+		  "uk_netdev_tx_burst(), minimum size frames")
+{
+	bench_tx(b, BENCH_LEN_MIN, 1);
+}
+
+UK_BENCHMARK_DESC(uknetdev_benchsuite, tx_burst_max,
+		  "uk_netdev_tx_burst(), full size frames")
+{
+	bench_tx(b, BENCH_LEN_MAX, 1);
+}
+
+UK_BENCHMARK_DESC(uknetdev_benchsuite, loopback_one_min,
+		  "uk_netdev_tx_one() and rx_one(), minimum size frames")
+{
+	bench_loopback(b, BENCH_LEN_MIN, 0);
+}
+
+UK_BENCHMARK_DESC(uknetdev_benchsuite, loopback_one_max,
+		  "uk_netdev_tx_one() and rx_one(), full size frames")
+{
+	bench_loopback(b, BENCH_LEN_MAX, 0);
+}
+
+UK_BENCHMARK_DESC(uknetdev_benchsuite, loopback_burst_min,
+		  "uk_netdev_tx_burst() and rx_burst(), minimum size frames")
+{
+	bench_loopback(b, BENCH_LEN_MIN, 1);
+}
+
+UK_BENCHMARK_DESC(uknetdev_benchsuite, loopback_burst_max,
+		  "uk_netdev_tx_burst() and rx_burst(), full size frames")
+{
+	bench_loopback(b, BENCH_LEN_MAX, 1);
+}
+
+uk_benchsuite_register(uknetdev_benchsuite, bench_netdev_init);
@@ -303,8 +303,8 @@ int fdt_node_offset_by_compatible_list(const void *fdt, int startoffset,
 	int idx, min_offset = INT_MAX, offset;
 
 	for (idx = 0; compatibles[idx] != NULL; idx++) {
-		offset = fdt_node_offset_by_compatible(fdt, startoffset,
-				  compatibles[idx]);
+		offset = fdt_node_offset_by_compatible_cached(fdt,
+				  startoffset, compatibles[idx]);
 		if (offset >= 0 && offset < min_offset)
 			min_offset = offset;
 	}
@@ -321,8 +321,8 @@ int fdt_node_offset_idx_by_compatible_list(const void *fdt, int startoffset,
 	int idx, min_offset = INT_MAX, offset, compatible_idx;
 
 	for (idx = 0; compatibles[idx] != NULL; idx++) {
-		offset = fdt_node_offset_by_compatible(fdt, startoffset,
-				  compatibles[idx]);
+		offset = fdt_node_offset_by_compatible_cached(fdt,
+				  startoffset, compatibles[idx]);
 		if (offset >= 0 && offset < min_offset) {
 			min_offset = offset;
 			compatible_idx = idx;
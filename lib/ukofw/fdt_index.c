@@ -0,0 +1,134 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * Index of device tree nodes by compatible string
+ *
+ * Drivers look up their nodes by compatible string, and libfdt walks the
+ * whole structure block for every lookup. The index is built in one pass
+ * over the tree on the first lookup: every string of every 'compatible'
+ * property becomes an entry, chained into a bucket by its hash. The entries
+ * of a chain are in tree order, so the first match after the start offset
+ * is also the first in the tree.
+ *
+ * Node offsets only change if nodes or properties are added or removed,
+ * which changes the size of the structure block. The index is rebuilt if
+ * the size differs. If the tree has more compatible strings than entries,
+ * lookups fall back to libfdt.
+ */
+
+#include <libfdt_env.h>
+#include <fdt.h>
+#include <libfdt.h>
+
+#include <uk/arch/types.h>
+#include <uk/essentials.h>
+#include <uk/ofw/fdt.h>
+#include <uk/print.h>
+
+#define FDT_INDEX_ENTRIES	CONFIG_LIBUKOFW_FDT_INDEX_ENTRIES
+#define FDT_INDEX_BUCKETS	256
+#define FDT_INDEX_NONE		((__u32)-1)
+
+struct fdt_index_entry {
+	__u32 hash;
+	__u32 next;
+	int offset;
+};
+
+static struct {
+	const void *fdt;
+	__u32 struct_size;
+	int valid;
+	__u32 buckets[FDT_INDEX_BUCKETS];
+	struct fdt_index_entry entries[FDT_INDEX_ENTRIES];
+} fdt_index;
+
+/* FNV-1a */
+static __u32 fdt_index_hash(const char *s, __sz len)
+{
+	__u32 h = 2166136261U;
+
+	while (len-- && *s)
+		h = (h ^ (unsigned char)*s++) * 16777619U;
+	return h;
+}
+
+static int fdt_index_build(const void *fdt)
+{
+	const char *p, *end;
+	__u32 n = 0, i, b;
+	int node, len;
+
+	for (node = fdt_next_node(fdt, -1, NULL); node >= 0;
+	     node = fdt_next_node(fdt, node, NULL)) {
+		p = fdt_getprop(fdt, node, "compatible", &len);
+		if (!p || len <= 0)
+			continue;
+
+		for (end = p + len; p < end; p += strnlen(p, end - p) + 1) {
+			if (unlikely(n == FDT_INDEX_ENTRIES)) {
+				uk_pr_warn("Device tree has more than %d compatible strings, not indexed\n",
+					   FDT_INDEX_ENTRIES);
+				return 0;
+			}
+			fdt_index.entries[n].hash = fdt_index_hash(p, end - p);
+			fdt_index.entries[n].offset = node;
+			n++;
+		}
+	}
+
+	for (b = 0; b < FDT_INDEX_BUCKETS; b++)
+		fdt_index.buckets[b] = FDT_INDEX_NONE;
+
+	/* Push in reverse so that each chain is in tree order */
+	for (i = n; i-- > 0;) {
+		b = fdt_index.entries[i].hash % FDT_INDEX_BUCKETS;
+		fdt_index.entries[i].next = fdt_index.buckets[b];
+		fdt_index.buckets[b] = i;
+	}
+
+	uk_pr_debug("Indexed %"__PRIu32" compatible strings of device tree %p\n",
+		    n, fdt);
+	return 1;
+}
+
+static int fdt_index_ready(const void *fdt)
+{
+	__u32 struct_size = fdt_size_dt_struct(fdt);
+
+	if (fdt != fdt_index.fdt || struct_size != fdt_index.struct_size) {
+		if (fdt_check_header(fdt))
+			return 0;
+
+		fdt_index.fdt = fdt;
+		fdt_index.struct_size = struct_size;
+		fdt_index.valid = fdt_index_build(fdt);
+	}
+	return fdt_index.valid;
+}
+
+int fdt_node_offset_by_compatible_cached(const void *fdt, int startoffset,
+					 const char *compatible)
+{
+	__u32 h, i;
+
+	if (unlikely(!fdt_index_ready(fdt)))
+		return fdt_node_offset_by_compatible(fdt, startoffset,
+						     compatible);
+
+	h = fdt_index_hash(compatible, (__sz)-1);
+	for (i = fdt_index.buckets[h % FDT_INDEX_BUCKETS]; i != FDT_INDEX_NONE;
+	     i = fdt_index.entries[i].next) {
+		if (fdt_index.entries[i].hash != h ||
+		    fdt_index.entries[i].offset <= startoffset)
+			continue;
+		if (!fdt_node_check_compatible(fdt, fdt_index.entries[i].offset,
+					       compatible))
+			return fdt_index.entries[i].offset;
+	}
+	return -FDT_ERR_NOTFOUND;
+}
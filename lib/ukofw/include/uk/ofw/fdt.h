@@ -34,6 +34,7 @@
 #define __UK_OFW_FDT_H__
 
 #include <stdbool.h>
+#include <uk/config.h>
 #include <libfdt.h>
 
 #define FDT_BAD_ADDR (uint64_t)(-1)
@@ -133,6 +134,39 @@ static inline uint64_t fdt_reg_read_number(const fdt32_t *regs, uint32_t size)
 int fdt_get_address(const void *fdt, int nodeoffset, uint32_t index,
 			uint64_t *addr, uint64_t *size);
 
+/**
+ * fdt_node_offset_by_compatible_cached - find nodes with a given
+ *                                        'compatible' value
+ * @fdt: pointer to the device tree blob
+ * @startoffset: only find nodes after this offset
+ * @compatible: 'compatible' string to match against
+ * Like fdt_node_offset_by_compatible(), but looks the string up in an
+ * index of the tree instead of walking the whole tree, if
+ * CONFIG_LIBUKOFW_FDT_INDEX is enabled.
+ *
+ * returns:
+ *     structure block offset of the located node (>= 0, >startoffset),
+ *              on success
+ *     -FDT_ERR_NOTFOUND, no node matching the criterion exists in the
+ *             tree after startoffset
+ *     -FDT_ERR_BADOFFSET, nodeoffset does not refer to a BEGIN_NODE tag
+ *     -FDT_ERR_BADMAGIC,
+ *     -FDT_ERR_BADVERSION,
+ *     -FDT_ERR_BADSTATE,
+ *     -FDT_ERR_BADSTRUCTURE, standard meanings
+ */
+#if CONFIG_LIBUKOFW_FDT_INDEX
+int fdt_node_offset_by_compatible_cached(const void *fdt, int startoffset,
+					 const char *compatible);
+#else /* !CONFIG_LIBUKOFW_FDT_INDEX */
+static inline int
+fdt_node_offset_by_compatible_cached(const void *fdt, int startoffset,
+				     const char *compatible)
+{
+	return fdt_node_offset_by_compatible(fdt, startoffset, compatible);
+}
+#endif /* !CONFIG_LIBUKOFW_FDT_INDEX */
+
 /**
  * fdt_node_offset_by_compatible_list - find nodes with a given
  *                                     'compatible' list value
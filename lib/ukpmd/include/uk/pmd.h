@@ -0,0 +1,170 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __UK_PMD_H__
+#define __UK_PMD_H__
+
+#include <uk/config.h>
+#include <uk/arch/types.h>
+#include <uk/arch/time.h>
+#include <uk/arch/spinlock.h>
+#include <uk/atomic.h>
+#include <uk/essentials.h>
+#include <uk/percpu.h>
+#if CONFIG_LIBUKNETDEV
+#include <uk/netdev.h>
+#endif /* CONFIG_LIBUKNETDEV */
+#if CONFIG_LIBUKBLKDEV
+#include <uk/blkdev.h>
+#endif /* CONFIG_LIBUKBLKDEV */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Polling-mode device queues
+ *
+ * Device queues are attached to a logical CPU that polls them instead of
+ * waiting for their interrupts. The idle thread of the scheduler on that CPU
+ * polls the queues whenever there is no thread to run, pausing between empty
+ * rounds instead of halting. A thread that owns its CPU, e.g., the only
+ * thread on a dedicated CPU, can also enter uk_pmd_loop() to poll the queues
+ * with interrupts disabled until the end of time.
+ *
+ * Poll functions run on the polling CPU with interrupts enabled or disabled
+ * and must not block.
+ */
+
+struct uk_pmd_queue;
+
+/**
+ * Processes the completed work of a queue
+ *
+ * @return
+ *   Number of processed events (e.g., packets or requests), or a negative
+ *   error code
+ */
+typedef int (*uk_pmd_poll_fn_t)(struct uk_pmd_queue *q);
+
+struct uk_pmd_queue {
+	uk_pmd_poll_fn_t poll;
+	/* Device and queue index, for the poll function */
+	void *dev;
+	__u16 queue_id;
+	/* Argument of the poll function */
+	void *cookie;
+	/* Number of events that were processed from this queue */
+	__u64 events;
+
+	struct uk_pmd_queue *next;
+};
+
+struct uk_pmd_stats {
+	/* Poll rounds over all queues of the CPU */
+	__u64 rounds;
+	/* Rounds that processed at least one event */
+	__u64 busy_rounds;
+	/* Processed events */
+	__u64 events;
+	/* Poll functions that returned an error */
+	__u64 errors;
+	/* Time spent in busy rounds */
+	__nsec busy_ns;
+};
+
+struct uk_pmd_lcpu {
+	struct uk_pmd_queue *queues;
+	/* Held while the queues are polled or the list is changed */
+	__spinlock lock;
+	/* Only updated by the CPU itself */
+	struct uk_pmd_stats stats;
+};
+
+UK_PERCPU_DECLARE(struct uk_pmd_lcpu, uk_pmd_lcpu);
+
+/* Tells if logical CPU `lcpu` polls device queues */
+static inline int uk_pmd_lcpu_active(__lcpuidx lcpu)
+{
+	return uk_load_n(&uk_percpu(uk_pmd_lcpu, lcpu).queues) != __NULL;
+}
+
+/**
+ * Attaches a queue to a logical CPU. The caller is responsible for
+ * disabling the interrupts of the queue.
+ *
+ * @param lcpu
+ *   Index of the polling logical CPU
+ * @param q
+ *   Queue with `poll` set
+ * @return
+ *   0 on success, a negative error code otherwise
+ */
+int uk_pmd_queue_add(__lcpuidx lcpu, struct uk_pmd_queue *q);
+
+/**
+ * Detaches a queue from its logical CPU. Returns after the queue is not
+ * polled anymore.
+ */
+void uk_pmd_queue_remove(__lcpuidx lcpu, struct uk_pmd_queue *q);
+
+/**
+ * Polls all queues of the current logical CPU once
+ *
+ * @return
+ *   Number of processed events
+ */
+unsigned int uk_pmd_poll(void);
+
+/**
+ * Polls the queues of the current logical CPU with interrupts disabled and
+ * never returns. The calling thread must own its CPU.
+ */
+void __noreturn uk_pmd_loop(void);
+
+/**
+ * Reads the statistics of a logical CPU
+ *
+ * @param lcpu
+ *   Index of the logical CPU
+ * @param stats
+ *   Filled with the statistics
+ */
+void uk_pmd_stats_get(__lcpuidx lcpu, struct uk_pmd_stats *stats);
+
+#if CONFIG_LIBUKNETDEV
+/**
+ * Disables the interrupts of a receive queue and attaches it to a logical
+ * CPU. The poll function receives the packets, e.g., with
+ * uk_netdev_rx_burst(), and returns their number. `q->dev` and
+ * `q->queue_id` are set.
+ *
+ * @return
+ *   0 on success, a negative error code otherwise
+ */
+int uk_pmd_netdev_rxq_add(__lcpuidx lcpu, struct uk_pmd_queue *q,
+			  struct uk_netdev *dev, __u16 queue_id);
+#endif /* CONFIG_LIBUKNETDEV */
+
+#if CONFIG_LIBUKBLKDEV
+/**
+ * Attaches a block device queue that is configured in polled mode
+ * (UK_BLKDEV_QUEUE_F_POLL) to a logical CPU. The queue is reaped with
+ * uk_blkdev_queue_poll(), so the callbacks of finished requests run on
+ * the polling CPU. `q->poll`, `q->dev`, and `q->queue_id` are set.
+ *
+ * @return
+ *   0 on success, a negative error code otherwise
+ */
+int uk_pmd_blkdev_queue_add(__lcpuidx lcpu, struct uk_pmd_queue *q,
+			    struct uk_blkdev *dev, __u16 queue_id);
+#endif /* CONFIG_LIBUKBLKDEV */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __UK_PMD_H__ */
@@ -0,0 +1,162 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <uk/arch/lcpu.h>
+#include <uk/assert.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/time.h>
+#include <uk/pmd.h>
+#include <uk/print.h>
+
+UK_PERCPU_DEFINE(uk_pmd_lcpu);
+
+int uk_pmd_queue_add(__lcpuidx lcpu, struct uk_pmd_queue *q)
+{
+	struct uk_pmd_lcpu *pl;
+	unsigned long flags;
+
+	UK_ASSERT(q);
+	UK_ASSERT(q->poll);
+
+	if (unlikely(lcpu >= ukplat_lcpu_count()))
+		return -EINVAL;
+
+	pl = &uk_percpu(uk_pmd_lcpu, lcpu);
+	q->events = 0;
+
+	flags = ukplat_lcpu_save_irqf();
+	ukarch_spin_lock(&pl->lock);
+	q->next = pl->queues;
+	uk_store_n(&pl->queues, q);
+	ukarch_spin_unlock(&pl->lock);
+	ukplat_lcpu_restore_irqf(flags);
+
+	uk_pr_info("Polling queue %p on LCPU %u\n", q, (unsigned int)lcpu);
+	return 0;
+}
+
+void uk_pmd_queue_remove(__lcpuidx lcpu, struct uk_pmd_queue *q)
+{
+	struct uk_pmd_queue **pprev;
+	struct uk_pmd_lcpu *pl;
+	unsigned long flags;
+
+	UK_ASSERT(lcpu < ukplat_lcpu_count());
+	UK_ASSERT(q);
+
+	pl = &uk_percpu(uk_pmd_lcpu, lcpu);
+
+	/* Waits for a poll round in progress */
+	flags = ukplat_lcpu_save_irqf();
+	ukarch_spin_lock(&pl->lock);
+	for (pprev = &pl->queues; *pprev; pprev = &(*pprev)->next) {
+		if (*pprev == q) {
+			uk_store_n(pprev, q->next);
+			break;
+		}
+	}
+	ukarch_spin_unlock(&pl->lock);
+	ukplat_lcpu_restore_irqf(flags);
+}
+
+unsigned int uk_pmd_poll(void)
+{
+	struct uk_pmd_lcpu *pl = &uk_percpu_current(uk_pmd_lcpu);
+	struct uk_pmd_queue *q;
+	unsigned int events = 0;
+	__nsec start;
+	int rc;
+
+	/* The list is being changed */
+	if (!ukarch_spin_trylock(&pl->lock))
+		return 0;
+
+	start = ukplat_monotonic_clock();
+	for (q = pl->queues; q; q = q->next) {
+		rc = q->poll(q);
+		if (unlikely(rc < 0)) {
+			pl->stats.errors++;
+			continue;
+		}
+		q->events += rc;
+		events += rc;
+	}
+	ukarch_spin_unlock(&pl->lock);
+
+	pl->stats.rounds++;
+	if (events) {
+		pl->stats.busy_rounds++;
+		pl->stats.events += events;
+		pl->stats.busy_ns += ukplat_monotonic_clock() - start;
+	}
+	return events;
+}
+
+void __noreturn uk_pmd_loop(void)
+{
+	uk_pr_info("LCPU %u enters polling mode\n",
+		   (unsigned int)ukplat_lcpu_idx());
+
+	ukplat_lcpu_disable_irq();
+	for (;;) {
+		if (!uk_pmd_poll())
+			ukarch_spinwait();
+	}
+}
+
+void uk_pmd_stats_get(__lcpuidx lcpu, struct uk_pmd_stats *stats)
+{
+	UK_ASSERT(lcpu < ukplat_lcpu_count());
+	UK_ASSERT(stats);
+
+	/* The counters are updated by their CPU without synchronization,
+	 * so a snapshot of a busy CPU is not necessarily consistent
+	 */
+	memcpy(stats, &uk_percpu(uk_pmd_lcpu, lcpu).stats, sizeof(*stats));
+}
+
+#if CONFIG_LIBUKNETDEV
+int uk_pmd_netdev_rxq_add(__lcpuidx lcpu, struct uk_pmd_queue *q,
+			  struct uk_netdev *dev, __u16 queue_id)
+{
+	int rc;
+
+	UK_ASSERT(q);
+	UK_ASSERT(dev);
+
+	rc = uk_netdev_rxq_intr_disable(dev, queue_id);
+	if (unlikely(rc < 0 && rc != -ENOTSUP)) {
+		uk_pr_err("Failed to disable interrupts of RX queue %u: %d\n",
+			  (unsigned int)queue_id, rc);
+		return rc;
+	}
+
+	q->dev = dev;
+	q->queue_id = queue_id;
+	return uk_pmd_queue_add(lcpu, q);
+}
+#endif /* CONFIG_LIBUKNETDEV */
+
+#if CONFIG_LIBUKBLKDEV
+static int pmd_blkdev_poll(struct uk_pmd_queue *q)
+{
+	return uk_blkdev_queue_poll((struct uk_blkdev *)q->dev, q->queue_id);
+}
+
+int uk_pmd_blkdev_queue_add(__lcpuidx lcpu, struct uk_pmd_queue *q,
+			    struct uk_blkdev *dev, __u16 queue_id)
+{
+	UK_ASSERT(q);
+	UK_ASSERT(dev);
+
+	q->poll = pmd_blkdev_poll;
+	q->dev = dev;
+	q->queue_id = queue_id;
+	return uk_pmd_queue_add(lcpu, q);
+}
+#endif /* CONFIG_LIBUKBLKDEV */
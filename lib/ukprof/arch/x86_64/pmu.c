@@ -0,0 +1,157 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <errno.h>
+#include <uk/asm/apic.h>
+#include <uk/atomic.h>
+#include <uk/essentials.h>
+#include <uk/event.h>
+#include <uk/intctlr.h>
+#include <uk/nofault.h>
+#include <uk/plat/config.h>
+#include <uk/print.h>
+#include <x86/cpu.h>
+
+#include "prof.h"
+
+#define X86_MSR_PMC0			0x0c1
+#define X86_MSR_PERFEVTSEL0		0x186
+#define X86_MSR_PERF_GLOBAL_CTRL	0x38f
+#define X86_MSR_PERF_GLOBAL_OVF_CTRL	0x390
+
+/* Architectural event "UnHalted Core Cycles" */
+#define PERFEVTSEL_CYCLES		0x3c
+#define PERFEVTSEL_USR			(1 << 16)
+#define PERFEVTSEL_OS			(1 << 17)
+#define PERFEVTSEL_INT			(1 << 20)
+#define PERFEVTSEL_EN			(1 << 22)
+
+/* Writes to IA32_PMCx are sign-extended from bit 31 */
+#define PERIOD_MAX			0x7fffffffULL
+
+static unsigned int pmu_version;
+static unsigned int pmi_irq = ~0U;
+
+static void pmu_arm(void)
+{
+	wrmsr(X86_MSR_PMC0, (__u32)-MIN(ukprof_period, PERIOD_MAX), 0);
+	/* Delivering the overflow interrupt masks the LVT entry */
+	wrmsr(APIC_MSR_LVT_PERF, 32 + pmi_irq, 0);
+}
+
+static void pmu_disable(void)
+{
+	wrmsr(X86_MSR_PERFEVTSEL0, 0, 0);
+	wrmsr(APIC_MSR_LVT_PERF, APIC_LVT_MASKED | (32 + pmi_irq), 0);
+}
+
+/* Walks the frame pointer chain of the interrupted code. The interrupted
+ * code may not maintain frame pointers, so a frame is only followed if it
+ * lies above the previous one within the same stack, and it is read without
+ * faulting.
+ */
+static unsigned int pmi_backtrace(struct __regs *regs, __uptr *pc)
+{
+	__uptr frame[2]; /* saved frame pointer, return address */
+	__uptr fp = regs->rbp;
+	__uptr lo = regs->rsp;
+	unsigned int depth = 0;
+
+	pc[depth++] = regs->rip;
+	while (depth < UKPROF_DEPTH) {
+		if (fp < lo || fp - regs->rsp >= STACK_SIZE ||
+		    fp & (sizeof(__uptr) - 1))
+			break;
+		if (uk_nofault_memcpy((char *)frame, (const char *)fp,
+				      sizeof(frame), UK_NOFAULTF_NOPAGING) !=
+		    sizeof(frame))
+			break;
+		if (!frame[1])
+			break;
+
+		pc[depth++] = frame[1];
+		lo = fp + sizeof(frame);
+		fp = frame[0];
+	}
+	return depth;
+}
+
+static int pmi_handler(void *data)
+{
+	struct uk_intctlr_event_irq_data *ctx = data;
+	__uptr pc[UKPROF_DEPTH];
+
+	if (ctx->irq != pmi_irq)
+		return UK_EVENT_NOT_HANDLED;
+
+	if (pmu_version >= 2)
+		wrmsr(X86_MSR_PERF_GLOBAL_OVF_CTRL, 1, 0);
+
+	if (unlikely(!UK_READ_ONCE(ukprof_running))) {
+		pmu_disable();
+		return UK_EVENT_HANDLED;
+	}
+
+	ukprof_record(pc, pmi_backtrace(ctx->regs, pc));
+	pmu_arm();
+	return UK_EVENT_HANDLED;
+}
+
+UK_EVENT_HANDLER(UK_INTCTLR_EVENT_IRQ, pmi_handler);
+
+int ukprof_arch_init(void)
+{
+	__u32 eax, ebx, ecx, edx;
+	int rc;
+
+	cpuid(0, 0, &eax, &ebx, &ecx, &edx);
+	if (eax < 0xa)
+		goto err_nopmu;
+
+	/* Version, number of general-purpose counters, and length of the
+	 * bit vector of unavailable architectural events
+	 */
+	cpuid(0xa, 0, &eax, &ebx, &ecx, &edx);
+	pmu_version = eax & 0xff;
+	if (!pmu_version || !((eax >> 8) & 0xff) || !((eax >> 24) & 0xff) ||
+	    (ebx & 1))
+		goto err_nopmu;
+
+	/* The LVT is only accessed in x2APIC mode */
+	rdmsr(APIC_MSR_BASE, &eax, &edx);
+	if (!(eax & APIC_BASE_EXTD))
+		goto err_nopmu;
+
+	rc = uk_intctlr_irq_alloc(&pmi_irq, 1);
+	if (unlikely(rc)) {
+		uk_pr_err("Failed to allocate overflow interrupt: %d\n", rc);
+		return rc;
+	}
+
+	uk_pr_info("Architectural performance monitoring version %u\n",
+		   pmu_version);
+	return 0;
+
+err_nopmu:
+	uk_pr_err("No architectural performance counter for cycles\n");
+	return -ENOTSUP;
+}
+
+void ukprof_arch_start(struct __regs *regs __unused, void *arg __unused)
+{
+	wrmsr(X86_MSR_PERFEVTSEL0, 0, 0);
+	pmu_arm();
+	wrmsr(X86_MSR_PERFEVTSEL0, PERFEVTSEL_CYCLES | PERFEVTSEL_USR |
+	      PERFEVTSEL_OS | PERFEVTSEL_INT | PERFEVTSEL_EN, 0);
+	if (pmu_version >= 2)
+		wrmsrl(X86_MSR_PERF_GLOBAL_CTRL,
+		       rdmsrl(X86_MSR_PERF_GLOBAL_CTRL) | 1);
+}
+
+void ukprof_arch_stop(struct __regs *regs __unused, void *arg __unused)
+{
+	pmu_disable();
+}
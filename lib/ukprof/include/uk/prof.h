@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __UK_PROF_H__
+#define __UK_PROF_H__
+
+#include <uk/arch/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Output function for uk_prof_dump()
+ *
+ * @param buf
+ *   Text to write
+ * @param len
+ *   Length of the text in bytes
+ * @param arg
+ *   Argument given to uk_prof_dump()
+ * @return
+ *   0 on success, a negative error code otherwise
+ */
+typedef int (*uk_prof_write_t)(const char *buf, __sz len, void *arg);
+
+/**
+ * Starts sampling on all online logical CPUs. Every logical CPU records the
+ * interrupted instruction pointer and a frame pointer backtrace each time its
+ * performance counter counted `period` unhalted cycles. Samples recorded
+ * before are discarded.
+ *
+ * @param period
+ *   Number of cycles between two samples, or 0 for the configured default
+ * @return
+ *   0 on success, -ENOTSUP if the CPU has no usable performance counter,
+ *   -EBUSY if the profiler is already running, or another negative error code
+ */
+int uk_prof_start(__u64 period);
+
+/**
+ * Stops sampling. The recorded samples are kept until the next start.
+ */
+void uk_prof_stop(void);
+
+/**
+ * Writes the recorded samples as folded stacks, one line per sample:
+ * the return addresses from the outermost frame to the interrupted
+ * instruction pointer, in hexadecimal and separated by semicolons, followed
+ * by the number of samples. `support/scripts/ukprof.py` resolves the
+ * addresses against the debug image and merges identical stacks.
+ *
+ * @param write
+ *   Output function, or NULL to write to the kernel console. The console
+ *   output is framed by marker lines so that it can be cut out of a log.
+ * @param arg
+ *   Argument passed to `write`
+ * @return
+ *   0 on success, or the first error returned by `write`
+ */
+int uk_prof_dump(uk_prof_write_t write, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UK_PROF_H__ */
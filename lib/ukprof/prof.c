@@ -0,0 +1,184 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <uk/alloc.h>
+#include <uk/atomic.h>
+#include <uk/config.h>
+#include <uk/essentials.h>
+#include <uk/init.h>
+#include <uk/plat/console.h>
+#include <uk/plat/lcpu.h>
+#include <uk/print.h>
+#include <uk/prof.h>
+
+#include "prof.h"
+
+#define BUFFER_WORDS	(CONFIG_LIBUKPROF_BUFFER_SIZE * 1024 / sizeof(__uptr))
+
+UKPLAT_PER_LCPU_DEFINE(struct ukprof_lcpu, ukprof_lcpu);
+int ukprof_running;
+__u64 ukprof_period;
+
+static int ukprof_initialized;
+
+static int ukprof_alloc(void)
+{
+	struct uk_alloc *a = uk_alloc_get_default();
+	struct ukprof_lcpu *pl;
+	__lcpuidx i;
+
+	for (i = 0; i < ukplat_lcpu_count(); i++) {
+		pl = &ukplat_per_lcpu(ukprof_lcpu, i);
+		if (!pl->buf) {
+			pl->buf = uk_malloc(a, BUFFER_WORDS * sizeof(__uptr));
+			if (unlikely(!pl->buf))
+				return -ENOMEM;
+			pl->size = BUFFER_WORDS;
+		}
+		pl->pos = 0;
+		pl->lost = 0;
+	}
+	return 0;
+}
+
+/* Runs `fn` on all online lcpus. The other lcpus run it asynchronously. */
+static void ukprof_run(void (*fn)(struct __regs *, void *))
+{
+	unsigned long flags;
+#ifdef CONFIG_HAVE_SMP
+	struct ukplat_lcpu_func f = { .fn = fn, .user = __NULL };
+	int rc;
+
+	rc = ukplat_lcpu_run(__NULL, __NULL, &f, 0);
+	if (unlikely(rc))
+		uk_pr_warn("Failed to reach all lcpus: %d\n", rc);
+#endif /* CONFIG_HAVE_SMP */
+
+	flags = ukplat_lcpu_save_irqf();
+	fn(__NULL, __NULL);
+	ukplat_lcpu_restore_irqf(flags);
+}
+
+int uk_prof_start(__u64 period)
+{
+	int rc;
+
+	if (UK_READ_ONCE(ukprof_running))
+		return -EBUSY;
+
+	if (!ukprof_initialized) {
+		rc = ukprof_arch_init();
+		if (unlikely(rc))
+			return rc;
+		ukprof_initialized = 1;
+	}
+
+	rc = ukprof_alloc();
+	if (unlikely(rc))
+		return rc;
+
+	ukprof_period = period ? period : CONFIG_LIBUKPROF_PERIOD;
+	UK_WRITE_ONCE(ukprof_running, 1);
+	ukprof_run(ukprof_arch_start);
+
+	uk_pr_info("Sampling every %"__PRIu64" cycles\n", ukprof_period);
+	return 0;
+}
+
+void uk_prof_stop(void)
+{
+	if (!UK_READ_ONCE(ukprof_running))
+		return;
+
+	UK_WRITE_ONCE(ukprof_running, 0);
+	ukprof_run(ukprof_arch_stop);
+}
+
+static int ukprof_coutk(const char *buf, __sz len, void *arg __unused)
+{
+	int rc;
+
+	rc = ukplat_coutk(buf, len);
+	return rc < 0 ? rc : 0;
+}
+
+static int ukprof_dump_lcpu(struct ukprof_lcpu *pl, uk_prof_write_t write,
+			    void *arg)
+{
+	char line[UKPROF_DEPTH * 19 + 8];
+	__sz pos, end, depth, i;
+	int len, rc;
+
+	end = __atomic_load_n(&pl->pos, __ATOMIC_ACQUIRE);
+	for (pos = 0; pos < end; pos += depth + 1) {
+		depth = pl->buf[pos];
+
+		/* Folded stacks start with the outermost frame */
+		len = 0;
+		for (i = depth; i > 0; i--)
+			len += snprintf(line + len, sizeof(line) - len,
+					"%s0x%lx", i < depth ? ";" : "",
+					(unsigned long)pl->buf[pos + i]);
+		len += snprintf(line + len, sizeof(line) - len, " 1\n");
+
+		rc = write(line, len, arg);
+		if (unlikely(rc))
+			return rc;
+	}
+	return 0;
+}
+
+int uk_prof_dump(uk_prof_write_t write, void *arg)
+{
+	struct ukprof_lcpu *pl;
+	__u64 lost = 0;
+	__lcpuidx i;
+	int rc = 0;
+
+	if (!write) {
+		write = ukprof_coutk;
+		ukplat_coutk("UKPROF_BEGIN\n", 13);
+	}
+
+	for (i = 0; i < ukplat_lcpu_count(); i++) {
+		pl = &ukplat_per_lcpu(ukprof_lcpu, i);
+		if (!pl->buf)
+			continue;
+
+		rc = ukprof_dump_lcpu(pl, write, arg);
+		if (unlikely(rc))
+			break;
+		lost += UK_READ_ONCE(pl->lost);
+	}
+
+	if (write == ukprof_coutk)
+		ukplat_coutk("UKPROF_END\n", 11);
+	if (lost)
+		uk_pr_warn("%"__PRIu64" samples lost, buffers full\n", lost);
+	return rc;
+}
+
+#if CONFIG_LIBUKPROF_AUTOSTART
+static int ukprof_init(struct uk_init_ctx *ictx __unused)
+{
+	int rc;
+
+	rc = uk_prof_start(0);
+	if (unlikely(rc))
+		uk_pr_err("Failed to start profiler: %d\n", rc);
+	return 0;
+}
+
+static void ukprof_term(const struct uk_term_ctx *tctx __unused)
+{
+	uk_prof_stop();
+	uk_prof_dump(__NULL, __NULL);
+}
+
+uk_late_initcall(ukprof_init, ukprof_term);
+#endif /* CONFIG_LIBUKPROF_AUTOSTART */
@@ -0,0 +1,76 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __UKPROF_H__
+#define __UKPROF_H__
+
+#include <uk/arch/lcpu.h>
+#include <uk/arch/types.h>
+#include <uk/essentials.h>
+#include <uk/plat/lcpu.h>
+
+#define UKPROF_DEPTH		CONFIG_LIBUKPROF_DEPTH
+
+/* Samples of a logical CPU. Only the lcpu itself writes to its buffer, from
+ * the overflow interrupt. A sample is stored as the number of its addresses
+ * followed by the addresses, innermost first. `pos` is advanced after the
+ * sample is complete, so a reader on another lcpu sees whole samples only.
+ */
+struct ukprof_lcpu {
+	__uptr *buf;
+	/* Size of the buffer in words */
+	__sz size;
+	__sz pos;
+	/* Samples that did not fit into the buffer anymore */
+	__u64 lost;
+};
+
+extern UKPLAT_PER_LCPU_DEFINE(struct ukprof_lcpu, ukprof_lcpu);
+
+/* Set while sampling. Overflow interrupts that arrive after the profiler was
+ * stopped do not record anything and disable the counter.
+ */
+extern int ukprof_running;
+extern __u64 ukprof_period;
+
+/**
+ * Checks the performance monitoring capabilities of the CPU and sets up the
+ * overflow interrupt. Called once before the first start.
+ *
+ * @return 0 on success, -ENOTSUP if there is no usable counter
+ */
+int ukprof_arch_init(void);
+
+/* Programs the counter of the current lcpu to overflow after `ukprof_period`
+ * cycles. Run on every lcpu, with interrupts disabled.
+ */
+void ukprof_arch_start(struct __regs *regs, void *arg);
+
+/* Disables the counter of the current lcpu. Run on every lcpu, with
+ * interrupts disabled.
+ */
+void ukprof_arch_stop(struct __regs *regs, void *arg);
+
+/* Appends a sample to the buffer of the current lcpu. Called by the
+ * architecture code from the overflow interrupt.
+ */
+static inline void ukprof_record(const __uptr *pc, unsigned int depth)
+{
+	struct ukprof_lcpu *pl = &ukplat_per_lcpu_current(ukprof_lcpu);
+	unsigned int i;
+
+	if (unlikely(pl->size - pl->pos < depth + 1)) {
+		pl->lost++;
+		return;
+	}
+
+	pl->buf[pl->pos] = depth;
+	for (i = 0; i < depth; i++)
+		pl->buf[pl->pos + 1 + i] = pc[i];
+	__atomic_store_n(&pl->pos, pl->pos + depth + 1, __ATOMIC_RELEASE);
+}
+
+#endif /* __UKPROF_H__ */
@@ -0,0 +1,126 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __UK_RCU_H__
+#define __UK_RCU_H__
+
+#include <uk/config.h>
+#include <uk/essentials.h>
+#include <uk/atomic.h>
+#include <uk/percpu.h>
+#include <uk/preempt.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Quiescent-state-based read-copy-update
+ *
+ * Readers access a data structure between uk_rcu_read_lock() and
+ * uk_rcu_read_unlock() without taking a lock. A read-side section must not
+ * block or yield. Writers serialize among themselves, publish new objects
+ * with uk_rcu_assign_pointer(), and free unlinked objects only after a grace
+ * period, either by waiting in uk_rcu_synchronize() or by deferring the free
+ * with uk_rcu_call().
+ *
+ * A grace period ends once every logical CPU passed a quiescent state, i.e.,
+ * a context switch or idling, because no reader can be in a read-side
+ * section at that point. The schedulers report these states, so read-side
+ * sections do not write to shared memory.
+ */
+
+struct uk_rcu_head {
+	struct uk_rcu_head *next;
+	void (*func)(struct uk_rcu_head *head);
+};
+
+/* Marks the beginning of a read-side section, which may be nested */
+#define uk_rcu_read_lock()		uk_preempt_disable()
+
+/* Marks the end of a read-side section */
+#define uk_rcu_read_unlock()		uk_preempt_enable()
+
+/* Loads a pointer that is protected by RCU within a read-side section */
+#define uk_rcu_dereference(p)		uk_load_n_acquire(&(p))
+
+/* Publishes an initialized object to readers */
+#define uk_rcu_assign_pointer(p, v)	uk_store_n_release(&(p), (v))
+
+/**
+ * Waits until all read-side sections that are in progress have finished.
+ * Must be called from a thread outside of a read-side section.
+ */
+void uk_rcu_synchronize(void);
+
+/**
+ * Calls `func` after a grace period, from a thread. Can be called from
+ * any context, including interrupt handlers and read-side sections.
+ *
+ * @param head
+ *   Embedded in the object to reclaim, e.g., passed to __containerof() by
+ *   `func`
+ * @param func
+ *   Function that reclaims the object
+ */
+void uk_rcu_call(struct uk_rcu_head *head,
+		 void (*func)(struct uk_rcu_head *head));
+
+/*
+ * Interface for schedulers
+ */
+
+struct uk_rcu_lcpu {
+	/* Last grace period in which the LCPU passed a quiescent state,
+	 * 0 if the LCPU does not run a scheduler
+	 */
+	unsigned long qs_seq;
+	/* Set while the LCPU idles */
+	int idle;
+};
+
+UK_PERCPU_DECLARE(struct uk_rcu_lcpu, uk_rcu_lcpu);
+extern unsigned long uk_rcu_gp_seq;
+
+/* Reports a quiescent state of the current LCPU, e.g., on a context switch */
+static inline void uk_rcu_quiescent(void)
+{
+	/* Orders the reads of earlier read-side sections before the report,
+	 * and the reads of later ones after the updates that started the
+	 * current grace period
+	 */
+	uk_store_n_release(&uk_percpu_current(uk_rcu_lcpu).qs_seq,
+			   uk_load_n_acquire(&uk_rcu_gp_seq));
+}
+
+/* Called when a scheduler starts running threads on the current LCPU */
+static inline void uk_rcu_lcpu_online(void)
+{
+	uk_rcu_quiescent();
+}
+
+/* Called before the current LCPU halts */
+static inline void uk_rcu_idle_enter(void)
+{
+	uk_rcu_quiescent();
+	uk_store_n_release(&uk_percpu_current(uk_rcu_lcpu).idle, 1);
+}
+
+/* Called when the current LCPU wakes up, before it handles interrupts */
+static inline void uk_rcu_idle_exit(void)
+{
+	uk_store_n(&uk_percpu_current(uk_rcu_lcpu).idle, 0);
+	/* Either a concurrent grace period sees that we are busy again, or
+	 * we see the updates that it waits for
+	 */
+	uk_fence();
+}
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __UK_RCU_H__ */
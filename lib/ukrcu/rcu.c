@@ -0,0 +1,124 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <errno.h>
+#include <uk/assert.h>
+#include <uk/errptr.h>
+#include <uk/essentials.h>
+#include <uk/init.h>
+#include <uk/plat/lcpu.h>
+#include <uk/print.h>
+#include <uk/rcu.h>
+#include <uk/sched.h>
+#include <uk/spinlock.h>
+#include <uk/thread.h>
+#include <uk/wait.h>
+
+/* Sequence number of the latest grace period. Starts at 1, so that 0 marks
+ * LCPUs that do not take part.
+ */
+unsigned long uk_rcu_gp_seq = 1;
+UK_PERCPU_DEFINE(uk_rcu_lcpu);
+
+/* Callbacks waiting for a grace period, in the order they were queued */
+static struct uk_rcu_head *rcu_cbs;
+static struct uk_rcu_head **rcu_cbs_tail = &rcu_cbs;
+static uk_spinlock rcu_cbs_lock = UK_SPINLOCK_INITIALIZER();
+static struct uk_waitq rcu_wq = UK_WAIT_QUEUE_INITIALIZER(rcu_wq);
+
+static int rcu_lcpu_passed(__lcpuidx idx, unsigned long seq)
+{
+	struct uk_rcu_lcpu *rl = &uk_percpu(uk_rcu_lcpu, idx);
+	unsigned long qs;
+
+	qs = uk_load_n_acquire(&rl->qs_seq);
+	if (!qs || (long)(qs - seq) >= 0)
+		return 1;
+	return uk_load_n(&rl->idle);
+}
+
+void uk_rcu_synchronize(void)
+{
+	unsigned long seq;
+	__lcpuidx i;
+
+	UK_ASSERT(uk_thread_current());
+
+	/* Start a new grace period. Readers that see it also see the updates
+	 * of the caller, so only earlier readers have to be waited for.
+	 */
+	seq = uk_add_fetch(&uk_rcu_gp_seq, 1);
+	uk_fence();
+
+	/* The caller is not in a read-side section */
+	uk_rcu_quiescent();
+
+	for (i = 0; i < ukplat_lcpu_count(); i++) {
+		/* Yielding lets readers on this LCPU finish and reports
+		 * a quiescent state of this LCPU
+		 */
+		while (!rcu_lcpu_passed(i, seq))
+			uk_sched_yield();
+	}
+}
+
+void uk_rcu_call(struct uk_rcu_head *head,
+		 void (*func)(struct uk_rcu_head *head))
+{
+	unsigned long flags;
+
+	UK_ASSERT(head);
+	UK_ASSERT(func);
+
+	head->next = __NULL;
+	head->func = func;
+
+	uk_spin_lock_irqsave(&rcu_cbs_lock, flags);
+	*rcu_cbs_tail = head;
+	rcu_cbs_tail = &head->next;
+	uk_spin_unlock_irqrestore(&rcu_cbs_lock, flags);
+
+	uk_waitq_wake_up(&rcu_wq);
+}
+
+static __noreturn void rcu_thread(void *arg __unused)
+{
+	struct uk_rcu_head *head, *next;
+	unsigned long flags;
+
+	for (;;) {
+		uk_waitq_wait_event(&rcu_wq, uk_load_n(&rcu_cbs) != __NULL);
+
+		/* All callbacks queued so far share the next grace period */
+		uk_spin_lock_irqsave(&rcu_cbs_lock, flags);
+		head = rcu_cbs;
+		rcu_cbs = __NULL;
+		rcu_cbs_tail = &rcu_cbs;
+		uk_spin_unlock_irqrestore(&rcu_cbs_lock, flags);
+
+		uk_rcu_synchronize();
+
+		for (; head; head = next) {
+			next = head->next;
+			head->func(head);
+		}
+	}
+}
+
+static int rcu_init(struct uk_init_ctx *ictx __unused)
+{
+	struct uk_thread *t;
+
+	t = uk_sched_thread_create(uk_sched_current(), rcu_thread,
+				   __NULL, "rcu");
+	if (unlikely(!t || PTRISERR(t))) {
+		uk_pr_err("Failed to start RCU callback thread\n");
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+uk_lib_initcall(rcu_init, 0x0);
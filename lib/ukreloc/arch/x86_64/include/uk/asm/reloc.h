@@ -148,7 +148,7 @@ start_uk_reloc32:
 	movb	16(%ebx), %cl
 	/* Check whether we reached sentinel or not */
 	test	%ecx, %ecx
-	jz	.finish_uk_reloc32
+	jz	.packed_uk_reloc32
 	movl	%esi, %edx
 	/* Add m_off to load vaddr */
 	addl	0(%ebx), %edx
@@ -203,6 +203,54 @@ start_uk_reloc32:
 	addl	$0x18, %ebx
 	jmp	.foreach_uk_reloc32
 
+.packed_uk_reloc32:
+	/* The sentinel holds the number of packed words and the link time
+	 * base address. Keep the difference between the load vaddr and the
+	 * link time base address in %esi:%edi, the word count in %ecx and
+	 * the next place in %edx (see reloc.h).
+	 */
+	movl	4(%esp), %edi
+	movl	0(%esp), %esi
+	subl	8(%ebx), %edi
+	sbbl	12(%ebx), %esi
+	movl	0(%ebx), %ecx
+	addl	$0x18, %ebx
+.foreach_packed_uk_reloc32:
+	test	%ecx, %ecx
+	jz	.finish_uk_reloc32
+	movl	0(%ebx), %eax
+	test	$1, %eax
+	jnz	.packed_bitmap_uk_reloc32
+
+	/* Offset of a place, relative to the load paddr */
+	movl	8(%esp), %edx
+	addl	%eax, %edx
+	addl	%edi, 0(%edx)
+	adcl	%esi, 4(%edx)
+	addl	$8, %edx
+	jmp	.next_packed_uk_reloc32
+
+.packed_bitmap_uk_reloc32:
+	/* Drop the tag bit and mark the end of the bitmap in bit 31, so that
+	 * %eax is 1 after UKRELOC_PACKED_SLOTS shifts
+	 */
+	shrl	$1, %eax
+	orl	$0x80000000, %eax
+.foreach_packed_slot_uk_reloc32:
+	shrl	$1, %eax
+	jnc	.packed_slot_skip_uk_reloc32
+	addl	%edi, 0(%edx)
+	adcl	%esi, 4(%edx)
+.packed_slot_skip_uk_reloc32:
+	addl	$8, %edx
+	cmpl	$1, %eax
+	jne	.foreach_packed_slot_uk_reloc32
+
+.next_packed_uk_reloc32:
+	addl	$4, %ebx
+	decl	%ecx
+	jmp	.foreach_packed_uk_reloc32
+
 .finish_uk_reloc32:
 	/* Restore caller's registers */
 	popl	%esi
@@ -161,6 +161,21 @@ struct uk_reloc_hdr {
 	struct uk_reloc urs[];
 } __packed;
 
+/* The uk_reloc entries are terminated by an entry with r_sz == 0. Its
+ * r_mem_off is the number of packed relocation words that follow and its
+ * r_addr is the link time base address.
+ *
+ * Packed relocations are 64-bit virtual relocations whose places already hold
+ * their link time value, i.e., the relocator just adds the difference between
+ * the runtime and the link time base address. They are encoded like ELF RELR
+ * relocations, but in 32-bit words: an even word is the offset of a place
+ * relative to the base address. An odd word is a bitmap whose bits 1 to
+ * UKRELOC_PACKED_SLOTS tell which of the following 8-byte places are
+ * relocated, continuing after the place of the preceding word. mkukreloc.py
+ * packs all relocations from .rela.dyn that fit, which are the vast majority.
+ */
+#define UKRELOC_PACKED_SLOTS		31
+
 UK_CTASSERT(sizeof(struct uk_reloc_hdr) == 4);
 
 /* Misaligned access here is never going to happen for a non-x86 architecture
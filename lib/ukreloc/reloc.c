@@ -60,6 +60,28 @@ static inline struct uk_reloc_hdr *get_uk_reloc_hdr()
 	return ur_hdr;
 }
 
+/* Applies the packed relocations following the uk_reloc sentinel */
+static void do_uk_reloc_packed(const __u32 *words, __u64 count, __u64 delta)
+{
+	__u64 *where = NULL;
+	__u64 *place;
+	__u32 w;
+
+	for (; count; count--, words++) {
+		w = *words;
+		if (!(w & 1)) {
+			where = (__u64 *)(rt_baddr + w);
+			*where++ += delta;
+			continue;
+		}
+
+		for (place = where; (w >>= 1); place++)
+			if (w & 1)
+				*place += delta;
+		where += UKRELOC_PACKED_SLOTS;
+	}
+}
+
 void __used do_uk_reloc(__paddr_t r_paddr, __vaddr_t r_vaddr)
 {
 	unsigned long bkp_lt_baddr;
@@ -98,6 +120,10 @@ void __used do_uk_reloc(__paddr_t r_paddr, __vaddr_t r_vaddr)
 		apply_uk_reloc(ur, val, (void *)rt_baddr);
 	}
 
+	/* `ur` is the sentinel now. Packed places hold link time addresses. */
+	do_uk_reloc_packed((const __u32 *)(ur + 1), ur->r_mem_off,
+			   (__u64)r_vaddr - ur->r_addr);
+
 	/* Restore link time base address previously relocated to contain the
 	 * runtime base address.
 	 */
@@ -120,6 +120,88 @@ uk_ring_enqueue(struct uk_ring *br, void *buf)
 	return 0;
 }
 
+/*
+ * multi-producer safe lock-free bulk enqueue
+ * reserves room for up to n buffers with a single compare-and-swap and
+ * returns the number of enqueued buffers, which are the first ones of bufs
+ */
+static __inline unsigned int
+uk_ring_enqueue_burst(struct uk_ring *br, void * const *bufs, unsigned int n)
+{
+	uint32_t prod_head, prod_next, cons_tail;
+	unsigned int i, k;
+
+	critical_enter();
+	do {
+		prod_head = br->br_prod_head;
+		cons_tail = uk_load_n(&br->br_cons_tail);
+		k = MIN(n, (cons_tail - prod_head - 1) & br->br_prod_mask);
+
+		if (k == 0) {
+			rmb();
+			if (prod_head == br->br_prod_head &&
+			    cons_tail == br->br_cons_tail) {
+				br->br_drops += n;
+				critical_exit();
+				return 0;
+			}
+			continue;
+		}
+		prod_next = (prod_head + k) & br->br_prod_mask;
+	} while (!uk_compare_exchange_sync((uint32_t *) &br->br_prod_head,
+			prod_head, prod_next));
+
+	for (i = 0; i < k; i++)
+		br->br_ring[(prod_head + i) & br->br_prod_mask] = bufs[i];
+
+	/*
+	 * Publish in reservation order, see uk_ring_enqueue()
+	 */
+	while (br->br_prod_tail != prod_head)
+		ukarch_spinwait();
+	uk_store_n(&br->br_prod_tail, prod_next);
+	br->br_drops += n - k;
+	critical_exit();
+	return k;
+}
+
+/*
+ * single-producer bulk enqueue
+ * use where only one context enqueues, e.g. one lcpu handing work over to
+ * another. Together with the single-consumer dequeues this gives a ring
+ * without any read-modify-write atomics. Must not be mixed with the
+ * multi-producer enqueues on the same ring.
+ */
+static __inline unsigned int
+uk_ring_enqueue_burst_sp(struct uk_ring *br, void * const *bufs,
+			 unsigned int n)
+{
+	uint32_t prod_head, prod_next, cons_tail;
+	unsigned int i, k;
+
+	prod_head = br->br_prod_head;
+	cons_tail = __atomic_load_n(&br->br_cons_tail, __ATOMIC_ACQUIRE);
+	k = MIN(n, (cons_tail - prod_head - 1) & br->br_prod_mask);
+
+	for (i = 0; i < k; i++)
+		br->br_ring[(prod_head + i) & br->br_prod_mask] = bufs[i];
+
+	prod_next = (prod_head + k) & br->br_prod_mask;
+	br->br_prod_head = prod_next;
+	__atomic_store_n(&br->br_prod_tail, prod_next, __ATOMIC_RELEASE);
+	br->br_drops += n - k;
+	return k;
+}
+
+/*
+ * single-producer enqueue
+ */
+static __inline int
+uk_ring_enqueue_sp(struct uk_ring *br, void *buf)
+{
+	return uk_ring_enqueue_burst_sp(br, &buf, 1) ? 0 : -ENOBUFS;
+}
+
 /*
  * multi-consumer safe dequeue 
  *
@@ -236,6 +318,69 @@ uk_ring_dequeue_sc(struct uk_ring *br)
 	return buf;
 }
 
+/*
+ * multi-consumer safe bulk dequeue
+ * takes up to n buffers with a single compare-and-swap and returns the
+ * number of buffers stored to bufs
+ */
+static __inline unsigned int
+uk_ring_dequeue_burst_mc(struct uk_ring *br, void **bufs, unsigned int n)
+{
+	uint32_t cons_head, cons_next, prod_tail;
+	unsigned int i, k;
+
+	critical_enter();
+	do {
+		cons_head = br->br_cons_head;
+		prod_tail = uk_load_n(&br->br_prod_tail);
+		k = MIN(n, (prod_tail - cons_head) & br->br_cons_mask);
+
+		if (k == 0) {
+			critical_exit();
+			return 0;
+		}
+		cons_next = (cons_head + k) & br->br_cons_mask;
+	} while (!uk_compare_exchange_sync((uint32_t *) &br->br_cons_head,
+			cons_head, cons_next));
+
+	for (i = 0; i < k; i++)
+		bufs[i] = br->br_ring[(cons_head + i) & br->br_cons_mask];
+
+	/*
+	 * Release the slots in reservation order, see uk_ring_dequeue_mc()
+	 */
+	while (br->br_cons_tail != cons_head)
+		ukarch_spinwait();
+	uk_store_n(&br->br_cons_tail, cons_next);
+	critical_exit();
+	return k;
+}
+
+/*
+ * single-consumer bulk dequeue
+ * use where dequeue is protected by a lock or only one context consumes
+ */
+static __inline unsigned int
+uk_ring_dequeue_burst_sc(struct uk_ring *br, void **bufs, unsigned int n)
+{
+	uint32_t cons_head, cons_next, prod_tail;
+	unsigned int i, k;
+
+	cons_head = br->br_cons_head;
+	/* The buffers must not be read before the producer published them */
+	prod_tail = __atomic_load_n(&br->br_prod_tail, __ATOMIC_ACQUIRE);
+	k = MIN(n, (prod_tail - cons_head) & br->br_cons_mask);
+
+	for (i = 0; i < k; i++)
+		bufs[i] = br->br_ring[(cons_head + i) & br->br_cons_mask];
+
+	cons_next = (cons_head + k) & br->br_cons_mask;
+	br->br_cons_head = cons_next;
+	/* The slots must not be reused before the buffers were read */
+	__atomic_store_n(&br->br_cons_tail, cons_next, __ATOMIC_RELEASE);
+	return k;
+}
+
 /*
  * single-consumer advance after a peek
  * use where it is protected by a lock
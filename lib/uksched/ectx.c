@@ -0,0 +1,47 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * Lazy switching of the extended context
+ *
+ * `uk_sched_thread_switch()` only stores the extended context of a thread
+ * that accessed the extended registers during its time slice, and it does
+ * not load the context of the next thread. Instead, it lets the next access
+ * trap (#NM) and the trap handler loads the context of the thread that is
+ * running then. Threads that never use FPU, SSE, or AVX registers thus do
+ * not pay for saving and restoring them.
+ *
+ * The context in the thread is always up to date while the thread is not
+ * running, so threads can migrate between logical CPUs and be released
+ * without further bookkeeping.
+ */
+#include <uk/arch/lcpu.h>
+#include <uk/arch/traps.h>
+#include <uk/sched_impl.h>
+#include <uk/thread.h>
+
+UK_PERCPU_DEFINE(__uk_sched_ectx_trapping);
+
+static int uk_sched_ectx_trap(void *data)
+{
+	struct ukarch_trap_ctx *ctx = (struct ukarch_trap_ctx *)data;
+	struct uk_thread *t;
+
+	if (ctx->trapnr != UKARCH_TRAP_X86_NM_TRAPNR ||
+	    !uk_percpu_current(__uk_sched_ectx_trapping))
+		return UK_EVENT_NOT_HANDLED;
+
+	ukarch_x86_ectx_trap_clear();
+	uk_percpu_current(__uk_sched_ectx_trapping) = 0;
+
+	t = uk_thread_current();
+	if (t && t->ectx)
+		ukarch_ectx_load(t->ectx);
+
+	return UK_EVENT_HANDLED;
+}
+
+UK_EVENT_HANDLER(UKARCH_TRAP_MATH, uk_sched_ectx_trap);
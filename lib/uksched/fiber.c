@@ -0,0 +1,136 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <uk/fiber.h>
+#include <uk/assert.h>
+#include <uk/print.h>
+#include <uk/plat/config.h>
+
+/* The root fiber stands for the context of the thread itself. Its ctx is
+ * only written when the thread switches to a fiber.
+ */
+static __uk_tls struct uk_fiber fiber_root;
+static __uk_tls struct uk_fiber *fiber_cur;
+
+struct uk_fiber *uk_fiber_current(void)
+{
+	return fiber_cur ? fiber_cur : &fiber_root;
+}
+
+static void _uk_fiber_switch(struct uk_fiber *from, struct uk_fiber *to)
+{
+	UK_ASSERT(from != to);
+	UK_ASSERT(!uk_fiber_is_finished(to));
+
+	if (from->flags & UK_FIBER_ECTX)
+		ukarch_ectx_store(from->ectx);
+
+	fiber_cur = to;
+	ukarch_ctx_switch(&from->ctx, &to->ctx);
+
+	/* Back on `from`: Restore what the other fibers might have changed */
+	if (from->flags & UK_FIBER_ECTX)
+		ukarch_ectx_load(from->ectx);
+}
+
+static void __noreturn _uk_fiber_entry(long arg)
+{
+	struct uk_fiber *f = (struct uk_fiber *)arg;
+
+	if (f->flags & UK_FIBER_ECTX)
+		ukarch_ectx_load(f->ectx);
+
+	f->fn(f->argp);
+
+	f->flags |= UK_FIBER_FINISHED;
+	_uk_fiber_switch(f, f->caller);
+	UK_CRASH("Finished fiber %p was resumed\n", f);
+}
+
+struct uk_fiber *uk_fiber_create(struct uk_alloc *a, size_t stack_len,
+				 unsigned int flags, uk_fiber_fn_t fn,
+				 void *argp)
+{
+	struct uk_fiber *f;
+	size_t len;
+	void *mem;
+
+	UK_ASSERT(a);
+	UK_ASSERT(fn);
+	UK_ASSERT(!(flags & ~UK_FIBER_ECTX));
+
+	stack_len = stack_len ? ALIGN_UP(stack_len, UKARCH_SP_ALIGN)
+			      : STACK_SIZE;
+
+	/* The fiber and its extended context are placed above the stack
+	 * within the same allocation
+	 */
+	len = stack_len + sizeof(*f);
+	if (flags & UK_FIBER_ECTX)
+		len += ukarch_ectx_size() + ukarch_ectx_align();
+
+	mem = uk_memalign(a, UKARCH_SP_ALIGN, len);
+	if (unlikely(!mem))
+		return NULL;
+
+	f = (struct uk_fiber *)((__uptr)mem + stack_len);
+	*f = (struct uk_fiber){
+		.flags = flags,
+		.fn = fn,
+		.argp = argp,
+		.a = a,
+		.stack = mem,
+	};
+
+	if (flags & UK_FIBER_ECTX) {
+		f->ectx = (struct ukarch_ectx *)ALIGN_UP((__uptr)(f + 1),
+							 ukarch_ectx_align());
+		ukarch_ectx_init(f->ectx);
+	}
+
+	ukarch_ctx_init_entry1(&f->ctx, ukarch_gen_sp(mem, stack_len), 1,
+			       _uk_fiber_entry, (long)f);
+	return f;
+}
+
+void uk_fiber_release(struct uk_fiber *f)
+{
+	UK_ASSERT(f);
+	UK_ASSERT(f != uk_fiber_current());
+
+	/* The fiber lives in the allocation of its stack */
+	uk_free(f->a, f->stack);
+}
+
+void uk_fiber_resume(struct uk_fiber *f)
+{
+	struct uk_fiber *cur = uk_fiber_current();
+
+	UK_ASSERT(f);
+
+	f->caller = cur;
+	_uk_fiber_switch(cur, f);
+}
+
+void uk_fiber_yield(void)
+{
+	struct uk_fiber *cur = uk_fiber_current();
+
+	UK_ASSERT(cur->caller); /* The root fiber has nowhere to yield to */
+
+	_uk_fiber_switch(cur, cur->caller);
+}
+
+void uk_fiber_yield_to(struct uk_fiber *f)
+{
+	struct uk_fiber *cur = uk_fiber_current();
+
+	UK_ASSERT(f);
+	UK_ASSERT(cur->caller);
+
+	f->caller = cur->caller;
+	_uk_fiber_switch(cur, f);
+}
@@ -0,0 +1,115 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __UK_SCHED_FIBER_H__
+#define __UK_SCHED_FIBER_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <uk/alloc.h>
+#include <uk/arch/ctx.h>
+#include <uk/essentials.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Fibers are stackful coroutines that run within the thread that resumes
+ * them. Switching between fibers uses the same context switch as the
+ * scheduler but never enters the scheduler: A fiber runs until it yields
+ * back to the fiber that resumed it or hands over to another fiber. Each
+ * thread implicitly runs its own root fiber.
+ *
+ * Because a fiber switch is a function call, all vector and floating point
+ * registers are caller-saved by the ABI. The extended context (see
+ * `ukarch_ectx_store()`) is therefore only saved and restored for fibers
+ * created with `UK_FIBER_ECTX`, e.g., fibers that change floating point
+ * control state.
+ */
+
+typedef void (*uk_fiber_fn_t)(void *argp);
+
+#define UK_FIBER_ECTX		0x1	/**< Preserve extended context */
+#define UK_FIBER_FINISHED	0x2	/**< Entry function returned */
+
+struct uk_fiber {
+	struct ukarch_ctx ctx;
+	struct uk_fiber *caller;	/**< Fiber to switch to on yield */
+	struct ukarch_ectx *ectx;	/**< Extended context (optional) */
+	unsigned int flags;
+	uk_fiber_fn_t fn;
+	void *argp;
+	struct uk_alloc *a;
+	void *stack;
+};
+
+/**
+ * Creates a fiber with its own stack. The fiber starts executing `fn` when
+ * it is resumed for the first time.
+ *
+ * @param a
+ *   Allocator for the fiber and its stack
+ * @param stack_len
+ *   Size of the stack, 0 selects the default thread stack size
+ * @param flags
+ *   `UK_FIBER_ECTX` or 0
+ * @param fn
+ *   Entry function
+ * @param argp
+ *   Argument for the entry function
+ * @return
+ *   The new fiber or NULL if there is not enough memory
+ */
+struct uk_fiber *uk_fiber_create(struct uk_alloc *a, size_t stack_len,
+				 unsigned int flags, uk_fiber_fn_t fn,
+				 void *argp);
+
+/**
+ * Frees a fiber. The fiber must not be the current one and must not be
+ * resumed again.
+ */
+void uk_fiber_release(struct uk_fiber *f);
+
+/**
+ * Returns the fiber that runs on the current thread. This is the root
+ * fiber of the thread when no fiber was resumed.
+ */
+struct uk_fiber *uk_fiber_current(void);
+
+/**
+ * Runs a fiber until it yields or its entry function returns. The current
+ * fiber becomes the caller of `f`.
+ *
+ * @param f
+ *   Fiber to run, must not have finished
+ */
+void uk_fiber_resume(struct uk_fiber *f);
+
+/**
+ * Switches back to the fiber that resumed the current one
+ */
+void uk_fiber_yield(void);
+
+/**
+ * Switches to `f` without returning to the caller first. `f` takes over the
+ * caller of the current fiber, so that its yield returns there.
+ *
+ * @param f
+ *   Fiber to run, must not have finished
+ */
+void uk_fiber_yield_to(struct uk_fiber *f);
+
+static inline bool uk_fiber_is_finished(struct uk_fiber *f)
+{
+	return f->flags & UK_FIBER_FINISHED;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UK_SCHED_FIBER_H__ */
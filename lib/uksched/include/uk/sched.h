@@ -42,6 +42,7 @@
 #include <uk/thread.h>
 #include <uk/assert.h>
 #include <uk/arch/types.h>
+#include <uk/arch/spinlock.h>
 #include <uk/essentials.h>
 #include <errno.h>
 
@@ -72,6 +73,10 @@ typedef void  (*uk_sched_thread_blocked_func_t)
 typedef void  (*uk_sched_thread_woken_func_t)
 		(struct uk_sched *s, struct uk_thread *t);
 
+typedef int   (*uk_sched_thread_set_policy_func_t)
+		(struct uk_sched *s, struct uk_thread *t,
+		 int policy, int prio, __nsec rel_deadline);
+
 typedef const struct uk_thread * (*uk_sched_idle_thread_func_t)
 		(struct uk_sched *s, unsigned int proc_id);
 
@@ -86,6 +91,7 @@ struct uk_sched {
 	uk_sched_thread_woken_func_t    thread_woken;
 	uk_sched_thread_woken_func_t    thread_woken_isr;
 	uk_sched_idle_thread_func_t     idle_thread;
+	uk_sched_thread_set_policy_func_t thread_set_policy; /**< optional */
 
 	uk_sched_start_t sched_start;
 
@@ -93,6 +99,7 @@ struct uk_sched {
 	bool is_started;
 	struct uk_thread_list thread_list;
 	struct uk_thread_list exited_threads;
+	__spinlock thread_list_lock; /**< protects thread and exited lists */
 	struct uk_alloc *a;       /**< default allocator for struct uk_thread */
 	struct uk_alloc *a_stack; /**< default allocator for stacks */
 	struct uk_alloc *a_auxstack; /**< default allocator for aux stacks */
@@ -117,6 +124,41 @@ int uk_sched_thread_add(struct uk_sched *s, struct uk_thread *t);
 
 int uk_sched_thread_remove(struct uk_thread *t);
 
+/*
+ * Scheduling policies, with the values used by Linux. Runnable deadline
+ * threads run first, earliest deadline first. Threads with a fixed priority
+ * run next, highest priority first. Normal threads only run when no other
+ * thread is runnable. Schedulers without support for policies treat all
+ * threads as normal ones.
+ */
+#define UK_SCHED_POLICY_NORMAL		0
+#define UK_SCHED_POLICY_FIFO		1
+#define UK_SCHED_POLICY_RR		2
+#define UK_SCHED_POLICY_DEADLINE	6
+
+/* Priorities of the FIFO and RR policies */
+#define UK_SCHED_PRIO_MIN		1
+#define UK_SCHED_PRIO_MAX		99
+
+/**
+ * Changes the scheduling policy of a thread
+ *
+ * @param t
+ *   Thread to change
+ * @param policy
+ *   One of `UK_SCHED_POLICY_*`
+ * @param prio
+ *   Priority for the FIFO and RR policies, 0 otherwise
+ * @param rel_deadline
+ *   Deadline relative to each wakeup of the thread for the deadline
+ *   policy, 0 otherwise
+ * @return
+ *   0 on success, -EINVAL for invalid arguments, or -ENOTSUP if the
+ *   scheduler of the thread does not support the policy
+ */
+int uk_sched_thread_set_policy(struct uk_thread *t, int policy, int prio,
+			       __nsec rel_deadline);
+
 static inline void uk_sched_thread_blocked(struct uk_thread *t)
 {
 	struct uk_sched *s;
@@ -43,6 +43,9 @@
 #define __UK_SCHED_IMPL_H__
 
 #include <uk/sched.h>
+#if CONFIG_LIBUKRCU
+#include <uk/rcu.h>
+#endif /* CONFIG_LIBUKRCU */
 
 #ifdef __cplusplus
 extern "C" {
@@ -50,6 +53,11 @@ extern "C" {
 
 extern struct uk_sched *uk_sched_head;
 
+#if CONFIG_LIBUKSCHED_LAZY_ECTX
+/* Set while accesses to the extended registers trap, see ectx.c */
+UK_PERCPU_DECLARE(int, __uk_sched_ectx_trapping);
+#endif /* CONFIG_LIBUKSCHED_LAZY_ECTX */
+
 int uk_sched_register(struct uk_sched *s);
 
 #define uk_sched_init(s, start_func, yield_func, \
@@ -66,6 +74,7 @@ int uk_sched_register(struct uk_sched *s);
 		(s)->thread_woken     = thread_woken_func; \
 		(s)->thread_woken_isr = thread_woken_isr_func; \
 		(s)->idle_thread      = idle_thread_func; \
+		(s)->thread_set_policy = NULL; \
 		uk_sched_register((s)); \
 		\
 		(s)->a = (def_allocator); \
@@ -74,10 +83,14 @@ int uk_sched_register(struct uk_sched *s);
 		(s)->a_uktls = (def_allocator); \
 		UK_TAILQ_INIT(&(s)->thread_list); \
 		UK_TAILQ_INIT(&(s)->exited_threads); \
+		ukarch_spin_init(&(s)->thread_list_lock); \
 	} while (0)
 
 /**
- * Releases self-exited threads (garbage collection)
+ * Releases self-exited threads (garbage collection). Only threads that
+ * last ran on the calling logical CPU are released, so that their context
+ * is known to be no longer in use. At most CONFIG_LIBUKSCHED_REAP_BATCH
+ * threads are released per call.
  *
  * @return
  *   - (0): No work was done
@@ -90,23 +103,43 @@ void uk_sched_thread_switch(struct uk_thread *next)
 {
 	struct uk_thread *prev;
 
-	prev = ukplat_per_lcpu_current(__uk_sched_thread_current);
+	prev = uk_percpu_current(__uk_sched_thread_current);
 
 	UK_ASSERT(prev);
 
-	ukplat_per_lcpu_current(__uk_sched_thread_current) = next;
+#if CONFIG_LIBUKRCU
+	/* Threads do not switch within RCU read-side sections */
+	uk_rcu_quiescent();
+#endif /* CONFIG_LIBUKRCU */
+
+	uk_percpu_current(__uk_sched_thread_current) = next;
 
 	prev->tlsp = ukplat_tlsp_get();
+#if CONFIG_LIBUKSCHED_LAZY_ECTX
+	/* The registers only hold the extended context of `prev` if it
+	 * accessed them since it was switched to. The context of `next` is
+	 * loaded on its first access.
+	 */
+	if (!uk_percpu_current(__uk_sched_ectx_trapping)) {
+		if (prev->ectx)
+			ukarch_ectx_store(prev->ectx);
+		ukarch_x86_ectx_trap_set();
+		uk_percpu_current(__uk_sched_ectx_trapping) = 1;
+	}
+#else /* !CONFIG_LIBUKSCHED_LAZY_ECTX */
 	if (prev->ectx)
 		ukarch_ectx_store(prev->ectx);
+#endif /* !CONFIG_LIBUKSCHED_LAZY_ECTX */
 
 	/* Load next TLS and extended registers before context switch.
 	 * This avoids requiring special initialization code for newly
 	 * created threads to do the loading.
 	 */
 	ukplat_tlsp_set(next->tlsp);
+#if !CONFIG_LIBUKSCHED_LAZY_ECTX
 	if (next->ectx)
 		ukarch_ectx_load(next->ectx);
+#endif /* !CONFIG_LIBUKSCHED_LAZY_ECTX */
 
 	ukplat_lcpu_set_auxsp(next->auxsp);
 
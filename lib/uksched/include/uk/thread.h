@@ -35,6 +35,7 @@
 #include <uk/arch/time.h>
 #include <uk/arch/ctx.h>
 #include <uk/plat/lcpu.h>
+#include <uk/percpu.h>
 #include <uk/plat/tls.h>
 #include <uk/wait_types.h>
 #include <uk/list.h>
@@ -54,6 +55,11 @@ typedef void (*uk_thread_fn0_t)(void) __noreturn;
 typedef void (*uk_thread_fn1_t)(void *) __noreturn;
 typedef void (*uk_thread_fn2_t)(void *, void *) __noreturn;
 
+/*
+ * The fields that are accessed on every context switch and scheduling
+ * decision come first and fit into the first two cache lines. The fields
+ * that are only used to create, release, or identify a thread follow.
+ */
 struct uk_thread {
 	struct ukarch_ctx    ctx;	/**< Architecture context */
 	struct ukarch_ectx *ectx;	/**< Extended context (FPU, VPU, ...) */
@@ -63,17 +69,28 @@ struct uk_thread {
 
 	UK_TAILQ_ENTRY(struct uk_thread) queue;
 	uint32_t flags;
+	unsigned int wakeup_idx;	/**< Slot in the scheduler's timeouts */
 	__snsec wakeup_time;
+	int policy;			/**< Scheduling policy */
+	int prio;			/**< Priority (FIFO and RR policies) */
+	__nsec rel_deadline;		/**< Relative deadline (EDF policy) */
+	__snsec deadline;		/**< Absolute deadline (EDF policy) */
 	struct uk_sched *sched;
+	__nsec exec_time;		/**< Time the thread was scheduled */
+	__lcpuidx lcpu;			/**< Logical CPU the thread last ran on */
 
+	/* Cold fields */
 	struct {
 		struct uk_alloc *t_a;
 		void            *stack;
 		struct uk_alloc *stack_a;
+		size_t           stack_len;
+		bool             stack_vma;	/**< Stack is a guarded VMA */
 		void            *uktls;
 		struct uk_alloc *uktls_a;
 		void            *auxstack;
 		struct uk_alloc *auxstack_a;
+		size_t           auxstack_len;
 	} _mem;				/**< Associated allocs (internal!) */
 	uk_thread_gc_t _gc_fn;		/**< Extra gc function (internal!) */
 	void *_gc_argp;			/**< Argument for gc fn (internal!) */
@@ -81,11 +98,14 @@ struct uk_thread {
 	uk_thread_dtor_t dtor;		/**< User provided destructor */
 	void *priv;			/**< Private field, free for use */
 
-	__nsec exec_time;		/**< Time the thread was scheduled */
 	const char *name;		/**< Reference to thread name */
 	UK_TAILQ_ENTRY(struct uk_thread) thread_list;
 };
 
+#if __SIZEOF_LONG__ == 8
+UK_CTASSERT(__offsetof(struct uk_thread, _mem) <= 2 * CACHE_LINE_SIZE);
+#endif /* __SIZEOF_LONG__ == 8 */
+
 UK_TAILQ_HEAD(uk_thread_list, struct uk_thread);
 
 #define uk_thread_terminate(thread) \
@@ -94,12 +114,32 @@ UK_TAILQ_HEAD(uk_thread_list, struct uk_thread);
 	uk_sched_thread_exit()
 
 /* managed by sched.c */
-extern UKPLAT_PER_LCPU_DEFINE(struct uk_thread *, __uk_sched_thread_current);
+UK_PERCPU_DECLARE(struct uk_thread *, __uk_sched_thread_current);
 
 static inline
 struct uk_thread *uk_thread_current(void)
 {
-	return ukplat_per_lcpu_current(__uk_sched_thread_current);
+	return uk_percpu_current(__uk_sched_thread_current);
+}
+
+/**
+ * Check whether a thread is currently executing on a logical CPU. This is a
+ * hint only: the thread may be switched in or out right after the check.
+ *
+ * @param t
+ *   Thread to check
+ * @return
+ *   Non-zero if `t` is the current thread of the logical CPU it last ran on
+ */
+static inline
+int uk_thread_is_running(const struct uk_thread *t)
+{
+	__lcpuidx lcpu = __atomic_load_n(&t->lcpu, __ATOMIC_RELAXED);
+
+	if (unlikely(lcpu >= CONFIG_UKPLAT_LCPU_MAXCOUNT))
+		return 0;
+	return __atomic_load_n(&uk_percpu(__uk_sched_thread_current, lcpu),
+			       __ATOMIC_RELAXED) == t;
 }
 
 /*
@@ -155,6 +195,8 @@ struct uk_thread *uk_thread_current(void)
  *  present in the run queue.
  */
 #define UK_THREADF_QUEUEABLE  (0x020)
+/* The scheduler keeps the thread on the logical CPU in `lcpu` */
+#define UK_THREADF_PINNED     (0x040)
 
 #define uk_thread_is_exited(t)   ((t)->flags & UK_THREADF_EXITED)
 #define uk_thread_is_runnable(t) (!uk_thread_is_exited(t) \
@@ -163,6 +205,7 @@ struct uk_thread *uk_thread_current(void)
 				  (UK_THREADF_EXITED | UK_THREADF_RUNNABLE) == \
 				  0x0)
 #define uk_thread_is_queueable(t) ((t)->flags & UK_THREADF_QUEUEABLE)
+#define uk_thread_is_pinned(t)   ((t)->flags & UK_THREADF_PINNED)
 
 #define uk_thread_set_runnable(t) \
 	do { (t)->flags |= UK_THREADF_RUNNABLE; } while (0)
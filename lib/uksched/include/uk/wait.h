@@ -26,6 +26,7 @@
 #ifndef __UK_SCHED_WAIT_H__
 #define __UK_SCHED_WAIT_H__
 
+#include <uk/arch/limits.h>
 #include <uk/essentials.h>
 #include <uk/plat/lcpu.h>
 #include <uk/plat/time.h>
@@ -49,6 +50,7 @@ void uk_waitq_entry_init(struct uk_waitq_entry *entry,
 {
 	entry->thread = thread;
 	entry->waiting = 0;
+	entry->exclusive = 0;
 }
 
 static inline
@@ -57,16 +59,34 @@ int uk_waitq_empty(struct uk_waitq *wq)
 	return UK_STAILQ_EMPTY(&(wq->wait_list));
 }
 
+/*
+ * Non-exclusive waiters are queued in front of exclusive ones, so that a
+ * wakeup that stops after a number of exclusive waiters still reaches all of
+ * them. Exclusive waiters are woken in FIFO order.
+ */
 static inline
 void uk_waitq_add(struct uk_waitq *wq,
 		struct uk_waitq_entry *entry)
 {
 	if (!entry->waiting) {
-		UK_STAILQ_INSERT_TAIL(&(wq->wait_list), entry, thread_list);
+		if (entry->exclusive)
+			UK_STAILQ_INSERT_TAIL(&(wq->wait_list), entry,
+					      thread_list);
+		else
+			UK_STAILQ_INSERT_HEAD(&(wq->wait_list), entry,
+					      thread_list);
 		entry->waiting = 1;
 	}
 }
 
+static inline
+void uk_waitq_add_exclusive(struct uk_waitq *wq,
+		struct uk_waitq_entry *entry)
+{
+	entry->exclusive = 1;
+	uk_waitq_add(wq, entry);
+}
+
 static inline
 void uk_waitq_remove(struct uk_waitq *wq,
 		struct uk_waitq_entry *entry)
@@ -95,13 +115,19 @@ do { \
 	ukplat_spin_unlock_irqrestore(&((wq)->sl), flags); \
 } while (0)
 
+/*
+ * An exclusive waiter that gives up after it was picked by a wakeup passes
+ * the wakeup on to the next exclusive waiter, otherwise it would be lost.
+ */
 #define __wq_wait_event_deadline(wq, condition, deadline, deadline_condition, \
-				 lock_fn, unlock_fn, lock) \
+				 lock_fn, unlock_fn, lock, excl) \
 ({ \
 	struct uk_thread *__current; \
 	unsigned long flags; \
 	int timedout = 0; \
+	int __passon = 0; \
 	DEFINE_WAIT(__wait); \
+	__wait.exclusive = (excl); \
 	if (!(condition)) { \
 		__current = uk_thread_current(); \
 		for (;;) { \
@@ -132,8 +158,11 @@ do { \
 		ukplat_spin_lock_irqsave(&((wq)->sl), flags); \
 		/* need to wake up */ \
 		uk_thread_wake(__current); \
+		__passon = timedout && __wait.exclusive && !__wait.waiting; \
 		uk_waitq_remove(wq, &__wait); \
 		ukplat_spin_unlock_irqrestore(&((wq)->sl), flags); \
+		if (__passon) \
+			uk_waitq_wake_up_nr(wq, 1); \
 	} \
 	timedout; \
 })
@@ -174,48 +203,78 @@ static inline void __lock_dummy(void *lock __unused) {}
 
 #define uk_waitq_wait_event(wq, condition) \
 	__wq_wait_event_deadline(wq, (condition), 0, 0, \
-				 __lock_dummy, __lock_dummy, NULL)
+				 __lock_dummy, __lock_dummy, NULL, 0)
 
 #define uk_waitq_wait_event_locked(wq, condition, lock_fn, unlock_fn, lock) \
 	__wq_wait_event_deadline(wq, (condition), 0, 0, \
-				 lock_fn, unlock_fn, lock)
+				 lock_fn, unlock_fn, lock, 0)
 
 #define uk_waitq_wait_event_deadline(wq, condition, deadline) \
 	__wq_wait_event_deadline(wq, (condition), \
 		(deadline), \
 		(deadline) && ukplat_monotonic_clock() >= (deadline), \
-		__lock_dummy, __lock_dummy, NULL)
+		__lock_dummy, __lock_dummy, NULL, 0)
 
 #define uk_waitq_wait_event_deadline_locked(wq, condition, deadline, \
 					    lock_fn, unlock_fn, lock) \
 	__wq_wait_event_deadline(wq, (condition), \
 		(deadline), \
 		(deadline) && ukplat_monotonic_clock() >= (deadline), \
-		lock_fn, unlock_fn, lock)
+		lock_fn, unlock_fn, lock, 0)
+
+/*
+ * Exclusive variants: the waiter is only woken by uk_waitq_wake_up() or if
+ * it is among the first `nr` exclusive waiters of uk_waitq_wake_up_nr().
+ * Use them when a single wakeup lets a single waiter make progress, e.g., a
+ * token or a lock becoming available.
+ */
+#define uk_waitq_wait_event_exclusive(wq, condition) \
+	__wq_wait_event_deadline(wq, (condition), 0, 0, \
+				 __lock_dummy, __lock_dummy, NULL, 1)
+
+#define uk_waitq_wait_event_exclusive_locked(wq, condition, lock_fn, \
+					     unlock_fn, lock) \
+	__wq_wait_event_deadline(wq, (condition), 0, 0, \
+				 lock_fn, unlock_fn, lock, 1)
+
+#define uk_waitq_wait_event_exclusive_deadline(wq, condition, deadline) \
+	__wq_wait_event_deadline(wq, (condition), \
+		(deadline), \
+		(deadline) && ukplat_monotonic_clock() >= (deadline), \
+		__lock_dummy, __lock_dummy, NULL, 1)
 
+/*
+ * Wakes up all non-exclusive waiters and up to `nr` exclusive waiters.
+ * Woken waiters are taken off the queue, so that a following wakeup goes to
+ * the next waiter instead of one that did not get to run yet.
+ */
 static inline
-void uk_waitq_wake_up(struct uk_waitq *wq)
+void uk_waitq_wake_up_nr(struct uk_waitq *wq, unsigned int nr)
 {
-	struct uk_waitq_entry *curr, *tmp;
+	struct uk_waitq_entry *curr;
 	unsigned long flags;
 
 	ukplat_spin_lock_irqsave(&(wq->sl), flags);
-	UK_STAILQ_FOREACH_SAFE(curr, &(wq->wait_list), thread_list, tmp)
+	while (nr && (curr = UK_STAILQ_FIRST(&wq->wait_list))) {
+		UK_STAILQ_REMOVE_HEAD(&wq->wait_list, thread_list);
+		curr->waiting = 0;
 		uk_thread_wake(curr->thread);
+		if (curr->exclusive)
+			nr--;
+	}
 	ukplat_spin_unlock_irqrestore(&(wq->sl), flags);
 }
 
 static inline
-void uk_waitq_wake_up_one(struct uk_waitq *wq)
+void uk_waitq_wake_up(struct uk_waitq *wq)
 {
-	struct uk_waitq_entry *head;
-	unsigned long flags;
+	uk_waitq_wake_up_nr(wq, __UI_MAX);
+}
 
-	ukplat_spin_lock_irqsave(&(wq->sl), flags);
-	head = UK_STAILQ_FIRST(&wq->wait_list);
-	if (head)
-		uk_thread_wake(head->thread);
-	ukplat_spin_unlock_irqrestore(&(wq->sl), flags);
+static inline
+void uk_waitq_wake_up_one(struct uk_waitq *wq)
+{
+	uk_waitq_wake_up_nr(wq, 1);
 }
 
 #ifdef __cplusplus
@@ -35,6 +35,8 @@ extern "C" {
 
 struct uk_waitq_entry {
 	int waiting;
+	/* Exclusive waiters are woken one at a time, see uk_waitq_wake_up_nr */
+	int exclusive;
 	struct uk_thread *thread;
 	UK_STAILQ_ENTRY(struct uk_waitq_entry) thread_list;
 };
@@ -58,6 +60,7 @@ struct uk_waitq {
 #define DEFINE_WAIT(name) \
 struct uk_waitq_entry name = { \
 	.waiting      = 0, \
+	.exclusive    = 0, \
 	.thread       = uk_thread_current(), \
 	.thread_list  = { NULL } \
 }
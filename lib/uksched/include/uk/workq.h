@@ -0,0 +1,143 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __UK_SCHED_WORKQ_H__
+#define __UK_SCHED_WORKQ_H__
+
+#include <uk/arch/time.h>
+#include <uk/essentials.h>
+#include <uk/plat/lcpu.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Kernel workqueue
+ *
+ * Every logical CPU has a worker thread that stays on it. Work items are
+ * functions that are deferred to the worker of a logical CPU, typically from
+ * an interrupt handler that wants to do its bottom half processing on the
+ * CPU that received the interrupt. Items queued until the worker runs again
+ * are processed as one batch and wake the worker only once.
+ *
+ * A work item is queued at most once at a time: queueing a pending item is a
+ * no-op. An item may requeue itself from its function. Work functions run in
+ * thread context and may block, but they delay the other items of their CPU
+ * in the meantime.
+ */
+
+struct uk_work;
+
+typedef void (*uk_work_fn_t)(struct uk_work *work);
+
+#define UK_WORK_PENDING		0x1	/**< Queued, not yet running */
+#define UK_WORK_RUNNING		0x2	/**< Work function is executing */
+
+struct uk_work {
+	struct uk_work *next;
+	uk_work_fn_t fn;
+	unsigned int state;
+};
+
+struct uk_delayed_work {
+	struct uk_work work;
+	struct uk_delayed_work *next;
+	__nsec deadline;
+	__lcpuidx lcpu;
+};
+
+#define UK_WORK_INITIALIZER(work_fn)					\
+	{ .next = __NULL, .fn = (work_fn), .state = 0 }
+
+#define UK_DELAYED_WORK_INITIALIZER(work_fn)				\
+	{ .work = UK_WORK_INITIALIZER(work_fn), .next = __NULL,	\
+	  .deadline = 0, .lcpu = 0 }
+
+static inline void uk_work_init(struct uk_work *work, uk_work_fn_t fn)
+{
+	work->next = __NULL;
+	work->fn = fn;
+	work->state = 0;
+}
+
+static inline void uk_delayed_work_init(struct uk_delayed_work *dwork,
+					uk_work_fn_t fn)
+{
+	uk_work_init(&dwork->work, fn);
+	dwork->next = __NULL;
+	dwork->deadline = 0;
+	dwork->lcpu = 0;
+}
+
+/**
+ * Queues a work item on the worker of a logical CPU. Can be called from any
+ * context, including interrupt handlers.
+ *
+ * @param lcpu
+ *   Index of the logical CPU
+ * @param work
+ *   Work item to queue
+ * @return
+ *   1 if the item was queued, 0 if it was pending already
+ */
+int uk_work_queue_on(__lcpuidx lcpu, struct uk_work *work);
+
+/* Queues a work item on the worker of the current logical CPU */
+static inline int uk_work_queue(struct uk_work *work)
+{
+	return uk_work_queue_on(ukplat_lcpu_idx(), work);
+}
+
+/**
+ * Queues a work item on the worker of a logical CPU after a delay. Can be
+ * called from any context, including interrupt handlers.
+ *
+ * @param lcpu
+ *   Index of the logical CPU
+ * @param dwork
+ *   Delayed work item to queue
+ * @param delay
+ *   Delay in nanoseconds, 0 queues the item immediately
+ * @return
+ *   1 if the item was queued, 0 if it was pending already
+ */
+int uk_work_queue_delayed_on(__lcpuidx lcpu, struct uk_delayed_work *dwork,
+			     __nsec delay);
+
+/* Queues a delayed work item on the worker of the current logical CPU */
+static inline int uk_work_queue_delayed(struct uk_delayed_work *dwork,
+					__nsec delay)
+{
+	return uk_work_queue_delayed_on(ukplat_lcpu_idx(), dwork, delay);
+}
+
+/**
+ * Cancels a delayed work item whose delay has not expired yet.
+ *
+ * @return
+ *   1 if the item was cancelled, 0 if it was not pending or its delay
+ *   expired already
+ */
+int uk_work_cancel_delayed(struct uk_delayed_work *dwork);
+
+/**
+ * Waits until a work item is neither pending nor running. Must be called
+ * from a thread other than the worker that runs the item.
+ */
+void uk_work_wait(struct uk_work *work);
+
+static inline int uk_work_is_pending(struct uk_work *work)
+{
+	return __atomic_load_n(&work->state, __ATOMIC_RELAXED) &
+	       UK_WORK_PENDING;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UK_SCHED_WORKQ_H__ */
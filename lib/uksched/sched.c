@@ -41,11 +41,12 @@
 #include <uk/alloc.h>
 #include <uk/plat/lcpu.h>
 #include <uk/sched.h>
+#include <uk/sched_impl.h>
 #include <uk/syscall.h>
 
 struct uk_sched *uk_sched_head;
 
-UKPLAT_PER_LCPU_DEFINE(struct uk_thread *, __uk_sched_thread_current);
+UK_PERCPU_DEFINE(__uk_sched_thread_current);
 
 int uk_sched_register(struct uk_sched *s)
 {
@@ -64,6 +65,16 @@ int uk_sched_register(struct uk_sched *s)
 	return 0;
 }
 
+/* Release threads that exited on this CPU before allocating a new one, so
+ * that their memory goes back to the thread cache even if the idle thread
+ * does not get to run
+ */
+static inline void uk_sched_thread_reap(struct uk_sched *s)
+{
+	if (!UK_TAILQ_EMPTY(&s->exited_threads))
+		uk_sched_thread_gc(s);
+}
+
 struct uk_thread *uk_sched_thread_create_fn0(struct uk_sched *s,
 					     uk_thread_fn0_t fn0,
 					     size_t stack_len,
@@ -84,6 +95,8 @@ struct uk_thread *uk_sched_thread_create_fn0(struct uk_sched *s,
 	if (!no_uktls && !s->a_uktls)
 		goto err_out;
 
+	uk_sched_thread_reap(s);
+
 	t = uk_thread_create_fn0(s->a,
 				 fn0,
 				 s->a_stack, stack_len,
@@ -129,6 +142,8 @@ struct uk_thread *uk_sched_thread_create_fn1(struct uk_sched *s,
 	if (!no_uktls && !s->a_uktls)
 		goto err_out;
 
+	uk_sched_thread_reap(s);
+
 	t = uk_thread_create_fn1(s->a,
 				 fn1, argp,
 				 s->a_stack, stack_len,
@@ -174,6 +189,8 @@ struct uk_thread *uk_sched_thread_create_fn2(struct uk_sched *s,
 	if (!no_uktls && !s->a_uktls)
 		goto err_out;
 
+	uk_sched_thread_reap(s);
+
 	t = uk_thread_create_fn2(s->a,
 				 fn2, argp0, argp1,
 				 s->a_stack, stack_len,
@@ -225,6 +242,7 @@ int uk_sched_start(struct uk_sched *s)
 		goto err_out;
 	}
 	main_thread->sched = s;
+	main_thread->lcpu = ukplat_lcpu_idx();
 
 	/* Because `main_thread` acts as container for storing the current
 	 * context, it does not have IP and SP set. We have to manually mark
@@ -233,10 +251,15 @@ int uk_sched_start(struct uk_sched *s)
 	uk_thread_set_runnable(main_thread);
 
 	/* Set main_thread as current scheduled thread */
-	ukplat_per_lcpu_current(__uk_sched_thread_current) = main_thread;
+	uk_percpu_current(__uk_sched_thread_current) = main_thread;
+#if CONFIG_LIBUKRCU
+	uk_rcu_lcpu_online();
+#endif /* CONFIG_LIBUKRCU */
 
 	/* Add main to the scheduler's thread list */
+	ukarch_spin_lock(&s->thread_list_lock);
 	UK_TAILQ_INSERT_TAIL(&s->thread_list, main_thread, thread_list);
+	ukarch_spin_unlock(&s->thread_list_lock);
 
 	/* Enable scheduler, like time slicing, etc. and notify that `s`
 	 * has an (already) scheduled thread
@@ -248,7 +271,7 @@ int uk_sched_start(struct uk_sched *s)
 	return 0;
 
 err_unset_thread_current:
-	ukplat_per_lcpu_current(__uk_sched_thread_current) = NULL;
+	uk_percpu_current(__uk_sched_thread_current) = NULL;
 	uk_thread_release(main_thread);
 err_out:
 	return ret;
@@ -256,12 +279,34 @@ err_out:
 
 unsigned int uk_sched_thread_gc(struct uk_sched *sched)
 {
+	struct uk_thread_list gc_list = UK_TAILQ_HEAD_INITIALIZER(gc_list);
 	struct uk_thread *thread, *tmp;
+	__lcpuidx lcpuidx = ukplat_lcpu_idx();
+	unsigned long flags;
 	unsigned int num = 0;
 
-	/* Cleanup finished threads */
+	/* Pick up a batch of finished threads of this logical CPU. Threads
+	 * that exited on a different CPU may still be in the middle of their
+	 * final context switch and are left to that CPU. The rest of the list
+	 * is left to the next run.
+	 */
+	flags = ukplat_lcpu_save_irqf();
+	ukarch_spin_lock(&sched->thread_list_lock);
 	UK_TAILQ_FOREACH_SAFE(thread, &sched->exited_threads,
 			      thread_list, tmp) {
+		if (thread->lcpu != lcpuidx)
+			continue;
+
+		UK_TAILQ_REMOVE(&sched->exited_threads, thread, thread_list);
+		UK_TAILQ_INSERT_TAIL(&gc_list, thread, thread_list);
+		if (++num == CONFIG_LIBUKSCHED_REAP_BATCH)
+			break;
+	}
+	ukarch_spin_unlock(&sched->thread_list_lock);
+	ukplat_lcpu_restore_irqf(flags);
+
+	/* Cleanup finished threads */
+	UK_TAILQ_FOREACH_SAFE(thread, &gc_list, thread_list, tmp) {
 		UK_ASSERT(thread != uk_thread_current());
 		UK_ASSERT(uk_thread_is_exited(thread));
 
@@ -269,11 +314,10 @@ unsigned int uk_sched_thread_gc(struct uk_sched *sched)
 			    sched, thread,
 			    thread->name ? thread->name : "<unnamed>");
 
-		UK_TAILQ_REMOVE(&sched->exited_threads, thread, thread_list);
+		UK_TAILQ_REMOVE(&gc_list, thread, thread_list);
 		if (thread->_gc_fn)
 			thread->_gc_fn(thread,  thread->_gc_argp);
 		uk_thread_release(thread);
-		++num;
 	}
 
 	return num;
@@ -282,6 +326,7 @@ unsigned int uk_sched_thread_gc(struct uk_sched *sched)
 void uk_sched_thread_terminate(struct uk_thread *thread)
 {
 	struct uk_sched *sched;
+	unsigned long flags;
 
 	UK_ASSERT(thread);
 	 /* NOTE: The following assertion can also fail on a double-termination.
@@ -307,8 +352,12 @@ void uk_sched_thread_terminate(struct uk_thread *thread)
 		uk_pr_debug("%p: thread %p (%s) on gc list\n",
 			    sched, thread, thread->name ?
 					   thread->name : "<unnamed>");
+		flags = ukplat_lcpu_save_irqf();
+		ukarch_spin_lock(&sched->thread_list_lock);
 		UK_TAILQ_INSERT_TAIL(&sched->exited_threads, thread,
 				     thread_list);
+		ukarch_spin_unlock(&sched->thread_list_lock);
+		ukplat_lcpu_restore_irqf(flags);
 
 		/* leave this thread */
 		sched->yield(sched); /* we won't return */
@@ -361,7 +410,9 @@ int uk_sched_thread_add(struct uk_sched *s, struct uk_thread *t)
 		goto out;
 
 	t->sched = s;
+	ukarch_spin_lock(&s->thread_list_lock);
 	UK_TAILQ_INSERT_TAIL(&s->thread_list, t, thread_list);
+	ukarch_spin_unlock(&s->thread_list_lock);
 out:
 	ukplat_lcpu_restore_irqf(flags);
 	return rc;
@@ -379,11 +430,52 @@ int uk_sched_thread_remove(struct uk_thread *t)
 	s = t->sched;
 	s->thread_remove(s, t);
 	t->sched = NULL;
+	ukarch_spin_lock(&s->thread_list_lock);
 	UK_TAILQ_REMOVE(&s->thread_list, t, thread_list);
+	ukarch_spin_unlock(&s->thread_list_lock);
 	ukplat_lcpu_restore_irqf(flags);
 	return 0;
 }
 
+int uk_sched_thread_set_policy(struct uk_thread *t, int policy, int prio,
+			       __nsec rel_deadline)
+{
+	struct uk_sched *s;
+
+	UK_ASSERT(t);
+
+	switch (policy) {
+	case UK_SCHED_POLICY_NORMAL:
+		if (prio || rel_deadline)
+			return -EINVAL;
+		break;
+	case UK_SCHED_POLICY_FIFO:
+	case UK_SCHED_POLICY_RR:
+		if (prio < UK_SCHED_PRIO_MIN || prio > UK_SCHED_PRIO_MAX ||
+		    rel_deadline)
+			return -EINVAL;
+		break;
+	case UK_SCHED_POLICY_DEADLINE:
+		if (prio || !rel_deadline)
+			return -EINVAL;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	s = t->sched;
+	if (s && s->thread_set_policy)
+		return s->thread_set_policy(s, t, policy, prio, rel_deadline);
+	if (s && policy != UK_SCHED_POLICY_NORMAL)
+		return -ENOTSUP;
+
+	/* Not attached to a scheduler yet: Applies when it is added */
+	t->policy = policy;
+	t->prio = prio;
+	t->rel_deadline = rel_deadline;
+	return 0;
+}
+
 UK_SYSCALL_R_DEFINE(int, sched_yield)
 {
 	uk_sched_yield();
@@ -0,0 +1,96 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <uk/bench.h>
+#include <uk/sched.h>
+#include <uk/thread.h>
+
+static int bench_stop;
+static struct uk_thread *bench_main;
+
+static __noreturn void bench_yielder(void *arg __unused)
+{
+	while (!__atomic_load_n(&bench_stop, __ATOMIC_ACQUIRE))
+		uk_sched_yield();
+	uk_sched_thread_exit();
+}
+
+static __noreturn void bench_blocker(void *arg __unused)
+{
+	while (!__atomic_load_n(&bench_stop, __ATOMIC_ACQUIRE)) {
+		uk_thread_wake(bench_main);
+		uk_thread_block(uk_thread_current());
+		uk_sched_yield();
+	}
+	uk_sched_thread_exit();
+}
+
+static struct uk_thread *bench_partner(struct uk_bench_ctx *b,
+				       uk_thread_fn1_t fn)
+{
+	struct uk_thread *t;
+
+	__atomic_store_n(&bench_stop, 0, __ATOMIC_RELEASE);
+	bench_main = uk_thread_current();
+	t = uk_sched_thread_create(uk_sched_current(), fn, NULL,
+				   "bench_sched");
+	if (unlikely(!t))
+		uk_bench_skip(b, "failed to create thread");
+	return t;
+}
+
+static void bench_partner_stop(struct uk_thread *t)
+{
+	__atomic_store_n(&bench_stop, 1, __ATOMIC_RELEASE);
+	uk_thread_wake(t);
+	while (!uk_thread_is_exited(t))
+		uk_sched_yield();
+}
+
+/* Every iteration switches to the other thread and back */
+UK_BENCHMARK_DESC(uksched_benchsuite, yield_pingpong,
+		  "two thread switches through uk_sched_yield()")
+{
+	struct uk_thread *t;
+	__u64 i;
+
+	uk_bench_timer_stop(b);
+	t = bench_partner(b, bench_yielder);
+	if (unlikely(!t))
+		return;
+	uk_bench_timer_start(b);
+
+	for (i = 0; i < b->n; i++)
+		uk_sched_yield();
+
+	uk_bench_timer_stop(b);
+	bench_partner_stop(t);
+}
+
+/* The threads wake each other up and block in turns */
+UK_BENCHMARK_DESC(uksched_benchsuite, block_wake_pingpong,
+		  "two thread switches through blocking and waking")
+{
+	struct uk_thread *t;
+	__u64 i;
+
+	uk_bench_timer_stop(b);
+	t = bench_partner(b, bench_blocker);
+	if (unlikely(!t))
+		return;
+	uk_bench_timer_start(b);
+
+	for (i = 0; i < b->n; i++) {
+		uk_thread_wake(t);
+		uk_thread_block(uk_thread_current());
+		uk_sched_yield();
+	}
+
+	uk_bench_timer_stop(b);
+	bench_partner_stop(t);
+}
+
+uk_benchsuite_register(uksched_benchsuite, NULL);
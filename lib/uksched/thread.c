@@ -43,13 +43,19 @@
 #include <uk/wait.h>
 #include <uk/print.h>
 #include <uk/assert.h>
+#include <uk/trace.h>
 #include <uk/arch/tls.h>
 #include <uk/plat/memory.h>
+#include <uk/plat/spinlock.h>
 
 #if CONFIG_LIBUKSCHED_TCB_INIT && !CONFIG_UKARCH_TLS_HAVE_TCB
 #error CONFIG_LIBUKSCHED_TCB_INIT requires that a TLS contains reserved space for a TCB
 #endif
 
+UK_TRACEPOINT(trace_uksched_block, "thread=%p until=%lld", void *,
+	      long long);
+UK_TRACEPOINT(trace_uksched_wake, "thread=%p", void *);
+
 extern const struct uk_thread_inittab_entry _uk_thread_inittab_start[];
 extern const struct uk_thread_inittab_entry _uk_thread_inittab_end;
 
@@ -370,6 +376,119 @@ int uk_thread_init_bare_fn2(struct uk_thread *t,
 	return _uk_thread_call_inittab(t);
 }
 
+/** Allocates a thread stack, placed in a stack VMA with a guard page below
+ *  it if possible
+ */
+static void *_uk_thread_stack_alloc(struct uk_alloc *a, size_t len,
+				    bool *is_vma)
+{
+#if CONFIG_LIBUKSCHED_STACK_GUARD
+	struct uk_vas *vas = uk_vas_get_active();
+	__vaddr_t va = __VADDR_ANY;
+
+	/* NOTE: The stack is populated completely because a fault on a
+	 *       missing stack page cannot be handled on that same stack.
+	 */
+	if (vas && PAGE_ALIGNED(len) &&
+	    uk_vma_map_stack(vas, &va, len + PAGE_SIZE, 0, "thread_stack",
+			     len) == 0) {
+		*is_vma = true;
+		return (void *)(va + PAGE_SIZE);
+	}
+#endif /* CONFIG_LIBUKSCHED_STACK_GUARD */
+
+	*is_vma = false;
+	return uk_memalign(a, UKARCH_SP_ALIGN, len);
+}
+
+/** Reverts `_uk_thread_stack_alloc()` */
+static void _uk_thread_stack_free(struct uk_alloc *a, void *stack,
+				  size_t len, bool is_vma)
+{
+#if CONFIG_LIBUKSCHED_STACK_GUARD
+	if (is_vma) {
+		uk_vma_unmap(uk_vas_get_active(),
+			     (__vaddr_t)stack - PAGE_SIZE, len + PAGE_SIZE, 0);
+		return;
+	}
+#else /* !CONFIG_LIBUKSCHED_STACK_GUARD */
+	UK_ASSERT(!is_vma);
+	(void)len;
+#endif /* !CONFIG_LIBUKSCHED_STACK_GUARD */
+
+	uk_free(a, stack);
+}
+
+#if CONFIG_LIBUKSCHED_THREAD_CACHE
+/* Stack, auxiliary stack, and TLS (including the TCB and the ectx) of a
+ * released thread
+ */
+struct _uk_thread_cache_entry {
+	struct uk_alloc *stack_a;
+	void *stack;
+	size_t stack_len;
+	bool stack_vma;
+	struct uk_alloc *auxstack_a;
+	void *auxstack;
+	size_t auxstack_len;
+	struct uk_alloc *uktls_a;
+	void *uktls;
+};
+
+/* Memory of released threads is kept here and handed to the next thread
+ * that is created with the same allocators and sizes. This saves the
+ * allocations and, with guarded stacks, the mapping of the stack VMA.
+ */
+static struct _uk_thread_cache_entry
+	_uk_thread_cache[CONFIG_LIBUKSCHED_THREAD_CACHE];
+static unsigned int _uk_thread_cache_count;
+static __spinlock _uk_thread_cache_lock = UKARCH_SPINLOCK_INITIALIZER();
+
+/** Takes matching memory from the cache, returns false on a miss */
+static bool _uk_thread_cache_get(struct _uk_thread_cache_entry *e)
+{
+	struct _uk_thread_cache_entry *c;
+	unsigned long flags;
+	bool found = false;
+	unsigned int i;
+
+	ukplat_spin_lock_irqsave(&_uk_thread_cache_lock, flags);
+	for (i = _uk_thread_cache_count; i > 0; i--) {
+		c = &_uk_thread_cache[i - 1];
+		if (c->stack_a != e->stack_a ||
+		    c->stack_len != e->stack_len ||
+		    c->auxstack_a != e->auxstack_a ||
+		    c->auxstack_len != e->auxstack_len ||
+		    c->uktls_a != e->uktls_a)
+			continue;
+
+		*e = *c;
+		*c = _uk_thread_cache[--_uk_thread_cache_count];
+		found = true;
+		break;
+	}
+	ukplat_spin_unlock_irqrestore(&_uk_thread_cache_lock, flags);
+
+	return found;
+}
+
+/** Puts memory into the cache, returns false if the cache is full */
+static bool _uk_thread_cache_put(const struct _uk_thread_cache_entry *e)
+{
+	unsigned long flags;
+	bool put = false;
+
+	ukplat_spin_lock_irqsave(&_uk_thread_cache_lock, flags);
+	if (_uk_thread_cache_count < ARRAY_SIZE(_uk_thread_cache)) {
+		_uk_thread_cache[_uk_thread_cache_count++] = *e;
+		put = true;
+	}
+	ukplat_spin_unlock_irqrestore(&_uk_thread_cache_lock, flags);
+
+	return put;
+}
+#endif /* CONFIG_LIBUKSCHED_THREAD_CACHE */
+
 /** Initializes uk_thread struct and allocates stack & TLS */
 static int _uk_thread_struct_init_alloc(struct uk_thread *t,
 					struct uk_alloc *a_stack,
@@ -384,11 +503,36 @@ static int _uk_thread_struct_init_alloc(struct uk_thread *t,
 					uk_thread_dtor_t dtor)
 {
 	void *stack = NULL;
+	bool stack_vma = false;
 	void *auxstack = NULL;
 	void *tls = NULL;
 	uintptr_t tlsp = 0x0;
 	int rc;
 
+#if CONFIG_LIBUKSCHED_THREAD_CACHE
+	/* Only complete sets of stack, auxiliary stack, and TLS with ectx
+	 * are cached
+	 */
+	if (a_stack && stack_len && a_auxstack && auxstack_len &&
+	    a_uktls && !custom_ectx) {
+		struct _uk_thread_cache_entry e = {
+			.stack_a = a_stack,
+			.stack_len = stack_len,
+			.auxstack_a = a_auxstack,
+			.auxstack_len = auxstack_len,
+			.uktls_a = a_uktls,
+		};
+
+		if (_uk_thread_cache_get(&e)) {
+			stack = e.stack;
+			stack_vma = e.stack_vma;
+			auxstack = e.auxstack;
+			tls = e.uktls;
+			goto init_struct;
+		}
+	}
+#endif /* CONFIG_LIBUKSCHED_THREAD_CACHE */
+
 	if (a_auxstack && auxstack_len) {
 		auxstack = uk_memalign(a_auxstack, UKPLAT_AUXSP_ALIGN,
 				       auxstack_len);
@@ -411,7 +555,7 @@ static int _uk_thread_struct_init_alloc(struct uk_thread *t,
 	}
 
 	if (a_stack && stack_len) {
-		stack = uk_memalign(a_stack, UKARCH_SP_ALIGN, stack_len);
+		stack = _uk_thread_stack_alloc(a_stack, stack_len, &stack_vma);
 		if (!stack) {
 			rc = -ENOMEM;
 			goto err_free_auxstack;
@@ -430,13 +574,6 @@ static int _uk_thread_struct_init_alloc(struct uk_thread *t,
 				rc = -ENOMEM;
 				goto err_free_stack;
 			}
-
-			/* When custom_ectx is not set, we ignore user's
-			 * ectx argument and overwrite it...
-			 */
-			ectx = (struct ukarch_ectx *) ALIGN_UP(
-				(uintptr_t) tls + ukarch_tls_area_size(),
-				ukarch_ectx_align());
 		} else {
 			tls = uk_memalign(a_uktls, ukarch_tls_area_align(),
 					  ukarch_tls_area_size());
@@ -445,6 +582,19 @@ static int _uk_thread_struct_init_alloc(struct uk_thread *t,
 				goto err_free_stack;
 			}
 		}
+	}
+
+#if CONFIG_LIBUKSCHED_THREAD_CACHE
+init_struct:
+#endif /* CONFIG_LIBUKSCHED_THREAD_CACHE */
+	if (tls) {
+		/* When custom_ectx is not set, we ignore user's
+		 * ectx argument and overwrite it...
+		 */
+		if (!custom_ectx)
+			ectx = (struct ukarch_ectx *) ALIGN_UP(
+				(uintptr_t) tls + ukarch_tls_area_size(),
+				ukarch_ectx_align());
 
 		tlsp = ukarch_tls_tlsp(tls);
 	}
@@ -459,11 +609,14 @@ static int _uk_thread_struct_init_alloc(struct uk_thread *t,
 	if (stack) {
 		t->_mem.stack = stack;
 		t->_mem.stack_a = a_stack;
+		t->_mem.stack_len = stack_len;
+		t->_mem.stack_vma = stack_vma;
 	}
 
 	if (auxstack) {
 		t->_mem.auxstack = auxstack;
 		t->_mem.auxstack_a = a_auxstack;
+		t->_mem.auxstack_len = auxstack_len;
 	}
 
 	if (tls) {
@@ -489,7 +642,7 @@ err_free_tls:
 #endif /* CONFIG_LIBUKSCHED_TCB_INIT */
 err_free_stack:
 	if (stack)
-		uk_free(a_stack, stack);
+		_uk_thread_stack_free(a_stack, stack, stack_len, stack_vma);
 err_free_auxstack:
 	if (auxstack)
 		uk_free(a_auxstack, auxstack);
@@ -513,7 +666,8 @@ void _uk_thread_struct_free_alloc(struct uk_thread *t)
 		t->_mem.uktls   = NULL;
 	}
 	if (t->_mem.stack_a && t->_mem.stack) {
-		uk_free(t->_mem.stack_a, t->_mem.stack);
+		_uk_thread_stack_free(t->_mem.stack_a, t->_mem.stack,
+				      t->_mem.stack_len, t->_mem.stack_vma);
 		t->_mem.stack_a = NULL;
 		t->_mem.stack   = NULL;
 	}
@@ -830,6 +984,7 @@ struct uk_thread *uk_thread_create_container2(struct uk_alloc *a,
 	if (auxsp) {
 		t->_mem.auxstack = auxstack;
 		t->_mem.auxstack_a = a_auxstack;
+		t->_mem.auxstack_len = auxstack_len;
 	}
 
 	/* Minimal context initialization where the stack pointer
@@ -1014,6 +1169,12 @@ void uk_thread_release(struct uk_thread *t)
 	void *stack;
 	void *auxstack;
 	void *tls;
+	size_t stack_len;
+	bool stack_vma;
+#if CONFIG_LIBUKSCHED_THREAD_CACHE
+	struct _uk_thread_cache_entry e;
+	bool cacheable;
+#endif /* CONFIG_LIBUKSCHED_THREAD_CACHE */
 
 	UK_ASSERT(t);
 	UK_ASSERT(t != uk_thread_current());
@@ -1028,11 +1189,36 @@ void uk_thread_release(struct uk_thread *t)
 	a = t->_mem.t_a;
 	stack_a = t->_mem.stack_a;
 	stack = t->_mem.stack;
+	stack_len = t->_mem.stack_len;
+	stack_vma = t->_mem.stack_vma;
 	auxstack_a = t->_mem.auxstack_a;
 	auxstack = t->_mem.auxstack;
 	tls_a = t->_mem.uktls_a;
 	tls = t->_mem.uktls;
 
+#if CONFIG_LIBUKSCHED_THREAD_CACHE
+	/* Only memory that matches what `_uk_thread_struct_init_alloc()`
+	 * takes from the cache: The ectx must be placed behind the TLS.
+	 */
+	cacheable = stack_a && stack && auxstack_a && auxstack &&
+		    tls_a && tls &&
+		    (__uptr)t->ectx == ALIGN_UP((__uptr)tls +
+						ukarch_tls_area_size(),
+						ukarch_ectx_align());
+	if (cacheable)
+		e = (struct _uk_thread_cache_entry) {
+			.stack_a = stack_a,
+			.stack = stack,
+			.stack_len = stack_len,
+			.stack_vma = stack_vma,
+			.auxstack_a = auxstack_a,
+			.auxstack = auxstack,
+			.auxstack_len = t->_mem.auxstack_len,
+			.uktls_a = tls_a,
+			.uktls = tls,
+		};
+#endif /* CONFIG_LIBUKSCHED_THREAD_CACHE */
+
 #if CONFIG_LIBUKSCHED_TCB_INIT
 	if (tls_a && tls)
 		uk_thread_uktcb_fini(t, uk_thread_uktcb(t));
@@ -1040,11 +1226,16 @@ void uk_thread_release(struct uk_thread *t)
 	if (t->dtor)
 		t->dtor(t);
 
+#if CONFIG_LIBUKSCHED_THREAD_CACHE
+	if (cacheable && _uk_thread_cache_put(&e))
+		tls = stack = auxstack = NULL;
+#endif /* CONFIG_LIBUKSCHED_THREAD_CACHE */
+
 	/* Free memory that was allocated by us */
 	if (tls_a   && tls)
 		uk_free(tls_a,   tls);
 	if (stack_a && stack)
-		uk_free(stack_a, stack);
+		_uk_thread_stack_free(stack_a, stack, stack_len, stack_vma);
 	if (auxstack_a && auxstack)
 		uk_free(auxstack_a, auxstack);
 	if (a)
@@ -1058,6 +1249,7 @@ void uk_thread_block_until(struct uk_thread *thread, __snsec until)
 	UK_ASSERT(thread);
 
 	flags = ukplat_lcpu_save_irqf();
+	trace_uksched_block(thread, until);
 	thread->wakeup_time = until;
 	if (uk_thread_is_runnable(thread)) {
 		uk_thread_set_blocked(thread);
@@ -1089,6 +1281,7 @@ void uk_thread_wake(struct uk_thread *thread)
 
 	flags = ukplat_lcpu_save_irqf();
 	if (!uk_thread_is_runnable(thread)) {
+		trace_uksched_wake(thread);
 		uk_thread_set_runnable(thread);
 		if (thread->sched)
 			uk_sched_thread_woken(thread);
@@ -0,0 +1,272 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <uk/assert.h>
+#include <uk/init.h>
+#include <uk/isr/wait.h>
+#include <uk/percpu.h>
+#include <uk/plat/spinlock.h>
+#include <uk/plat/time.h>
+#include <uk/print.h>
+#include <uk/sched.h>
+#include <uk/workq.h>
+
+struct workq_lcpu {
+	/* Items queued for immediate processing, most recent first. Pushed
+	 * without a lock, so that interrupt handlers on other CPUs do not
+	 * contend with the worker.
+	 */
+	struct uk_work *pending;
+	/* Delayed items, sorted by deadline and protected by `lock` */
+	struct uk_delayed_work *delayed;
+	__spinlock lock;
+	struct uk_waitq wq;
+	char name[16];
+};
+
+UK_PERCPU(struct workq_lcpu, workq_lcpu);
+
+static void workq_kick(struct workq_lcpu *wl)
+{
+	/* The worker is only registered on the wait queue after checking
+	 * the pending list under the queue lock, so the wake-up cannot get
+	 * lost. Before the worker exists, it drains the list on its start.
+	 */
+	uk_waitq_wake_up_isr(&wl->wq);
+}
+
+int uk_work_queue_on(__lcpuidx lcpu, struct uk_work *work)
+{
+	struct workq_lcpu *wl;
+	struct uk_work *head;
+
+	UK_ASSERT(lcpu < ukplat_lcpu_count());
+	UK_ASSERT(work);
+	UK_ASSERT(work->fn);
+
+	if (__atomic_fetch_or(&work->state, UK_WORK_PENDING,
+			      __ATOMIC_ACQ_REL) & UK_WORK_PENDING)
+		return 0;
+
+	wl = &uk_percpu(workq_lcpu, lcpu);
+	head = __atomic_load_n(&wl->pending, __ATOMIC_RELAXED);
+	do {
+		work->next = head;
+	} while (!__atomic_compare_exchange_n(&wl->pending, &head, work, 0,
+					      __ATOMIC_RELEASE,
+					      __ATOMIC_RELAXED));
+
+	/* Only the first item of a batch has to wake the worker */
+	if (!head)
+		workq_kick(wl);
+	return 1;
+}
+
+int uk_work_queue_delayed_on(__lcpuidx lcpu, struct uk_delayed_work *dwork,
+			     __nsec delay)
+{
+	struct uk_delayed_work **pprev;
+	struct workq_lcpu *wl;
+	unsigned long flags;
+	bool first;
+
+	UK_ASSERT(lcpu < ukplat_lcpu_count());
+	UK_ASSERT(dwork);
+	UK_ASSERT(dwork->work.fn);
+
+	if (!delay)
+		return uk_work_queue_on(lcpu, &dwork->work);
+
+	if (__atomic_fetch_or(&dwork->work.state, UK_WORK_PENDING,
+			      __ATOMIC_ACQ_REL) & UK_WORK_PENDING)
+		return 0;
+
+	wl = &uk_percpu(workq_lcpu, lcpu);
+	dwork->lcpu = lcpu;
+	dwork->deadline = ukplat_monotonic_clock() + delay;
+
+	ukplat_spin_lock_irqsave(&wl->lock, flags);
+	for (pprev = &wl->delayed; *pprev; pprev = &(*pprev)->next)
+		if ((*pprev)->deadline > dwork->deadline)
+			break;
+	dwork->next = *pprev;
+	*pprev = dwork;
+	first = (wl->delayed == dwork);
+	ukplat_spin_unlock_irqrestore(&wl->lock, flags);
+
+	/* The worker has to shorten its timeout */
+	if (first)
+		workq_kick(wl);
+	return 1;
+}
+
+int uk_work_cancel_delayed(struct uk_delayed_work *dwork)
+{
+	struct uk_delayed_work **pprev;
+	struct workq_lcpu *wl;
+	unsigned long flags;
+	int ret = 0;
+
+	UK_ASSERT(dwork);
+
+	if (!uk_work_is_pending(&dwork->work))
+		return 0;
+
+	wl = &uk_percpu(workq_lcpu, dwork->lcpu);
+	ukplat_spin_lock_irqsave(&wl->lock, flags);
+	for (pprev = &wl->delayed; *pprev; pprev = &(*pprev)->next) {
+		if (*pprev == dwork) {
+			*pprev = dwork->next;
+			__atomic_and_fetch(&dwork->work.state,
+					   ~UK_WORK_PENDING, __ATOMIC_RELEASE);
+			ret = 1;
+			break;
+		}
+	}
+	ukplat_spin_unlock_irqrestore(&wl->lock, flags);
+
+	return ret;
+}
+
+void uk_work_wait(struct uk_work *work)
+{
+	UK_ASSERT(work);
+
+	while (__atomic_load_n(&work->state, __ATOMIC_ACQUIRE))
+		uk_sched_yield();
+}
+
+static void workq_run(struct uk_work *work)
+{
+	/* Clearing the pending flag first allows the function to requeue
+	 * the item
+	 */
+	__atomic_store_n(&work->state, UK_WORK_RUNNING, __ATOMIC_RELAXED);
+	work->fn(work);
+	__atomic_and_fetch(&work->state, ~UK_WORK_RUNNING, __ATOMIC_RELEASE);
+}
+
+/* Deadline of the earliest delayed item, 0 if there is none */
+static __nsec workq_deadline(struct workq_lcpu *wl)
+{
+	unsigned long flags;
+	__nsec deadline;
+
+	ukplat_spin_lock_irqsave(&wl->lock, flags);
+	deadline = wl->delayed ? wl->delayed->deadline : 0;
+	ukplat_spin_unlock_irqrestore(&wl->lock, flags);
+
+	return deadline;
+}
+
+static void workq_run_delayed(struct workq_lcpu *wl)
+{
+	struct uk_delayed_work *expired, *dwork, **pprev;
+	unsigned long flags;
+	__nsec now;
+
+	now = ukplat_monotonic_clock();
+
+	ukplat_spin_lock_irqsave(&wl->lock, flags);
+	expired = wl->delayed;
+	for (pprev = &wl->delayed; *pprev; pprev = &(*pprev)->next)
+		if ((*pprev)->deadline > now)
+			break;
+	wl->delayed = *pprev;
+	*pprev = __NULL;
+	ukplat_spin_unlock_irqrestore(&wl->lock, flags);
+
+	while (expired) {
+		dwork = expired;
+		expired = dwork->next;
+		workq_run(&dwork->work);
+	}
+}
+
+static void workq_run_pending(struct workq_lcpu *wl)
+{
+	struct uk_work *batch, *work, *fifo = __NULL;
+
+	batch = __atomic_exchange_n(&wl->pending, __NULL, __ATOMIC_ACQUIRE);
+
+	/* Restore the order in which the items were queued */
+	while (batch) {
+		work = batch;
+		batch = work->next;
+		work->next = fifo;
+		fifo = work;
+	}
+
+	while (fifo) {
+		work = fifo;
+		fifo = work->next;
+		workq_run(work);
+	}
+}
+
+static __noreturn void workq_worker(void *arg)
+{
+	struct workq_lcpu *wl = (struct workq_lcpu *)arg;
+
+	for (;;) {
+		workq_run_delayed(wl);
+		workq_run_pending(wl);
+
+		/* The timeout is re-evaluated on every wake-up, so that
+		 * earlier delayed items shorten it
+		 */
+		uk_waitq_wait_event_deadline(&wl->wq,
+			__atomic_load_n(&wl->pending, __ATOMIC_RELAXED),
+			workq_deadline(wl));
+	}
+}
+
+static int workq_init(struct uk_init_ctx *ictx __unused)
+{
+	struct uk_sched *s = uk_sched_current();
+	struct workq_lcpu *wl;
+	struct uk_thread *t;
+	__lcpuidx i;
+	int rc;
+
+	UK_ASSERT(s);
+
+	for (i = 0; i < ukplat_lcpu_count(); i++) {
+		wl = &uk_percpu(workq_lcpu, i);
+		ukarch_spin_init(&wl->lock);
+		uk_waitq_init(&wl->wq);
+		snprintf(wl->name, sizeof(wl->name), "workq/%u",
+			 (unsigned int)i);
+
+		t = uk_thread_create_fn1(s->a, workq_worker, wl,
+					 s->a_stack, 0x0,
+					 s->a_auxstack, 0x0,
+					 s->a_uktls, false,
+					 wl->name, __NULL, __NULL);
+		if (unlikely(!t)) {
+			uk_pr_err("Failed to create worker of LCPU %u\n",
+				  (unsigned int)i);
+			return -ENOMEM;
+		}
+
+		/* Keep the worker on its CPU */
+		t->lcpu = i;
+		t->flags |= UK_THREADF_PINNED;
+
+		rc = uk_sched_thread_add(s, t);
+		if (unlikely(rc < 0)) {
+			uk_pr_err("Failed to start worker of LCPU %u: %d\n",
+				  (unsigned int)i, rc);
+			uk_thread_release(t);
+			return rc;
+		}
+	}
+
+	return 0;
+}
+
+uk_early_initcall(workq_init, 0x0);
@@ -12,9 +12,10 @@ void schedcoop_thread_woken_isr(struct uk_sched *s, struct uk_thread *t)
 	UK_ASSERT(ukplat_lcpu_irqs_disabled());
 
 	if (t->wakeup_time > 0)
-		UK_TAILQ_REMOVE(&c->sleep_queue, t, queue);
+		schedcoop_sleep_remove(c, t);
 	if (uk_thread_is_queueable(t) && uk_thread_is_runnable(t)) {
-		UK_TAILQ_INSERT_TAIL(&c->run_queue, t, queue);
+		schedcoop_deadline_start(t);
+		schedcoop_runq_add(c, t);
 		uk_thread_clear_queueable(t);
 	}
 }
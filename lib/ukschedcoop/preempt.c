@@ -0,0 +1,92 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * Timer-driven preemption
+ *
+ * Whenever a time-sliced thread is scheduled, the timer is armed for the
+ * end of its slice. On the return from each interrupt, the platform calls
+ * `ukplat_lcpu_irq_return()`, which checks whether the slice expired. If
+ * so, it only marks the preemption pending: The interrupted code may hold a
+ * lock-free structure (e.g., the allocator or a wait queue) in an
+ * inconsistent state, so the thread is never switched from interrupt
+ * context. Instead, it yields at the next safe point, which is the return
+ * from a system call or the end of the outermost `uk_preempt_disable()`
+ * section (see `uk_preempt_point()`). Code that runs without reaching a
+ * safe point is not preempted.
+ *
+ * This file is built with the ISR flags because the check runs in
+ * interrupt context.
+ */
+#include <uk/arch/lcpu.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/time.h>
+#include <uk/preempt.h>
+#include <uk/sched_impl.h>
+#include "schedcoop.h"
+
+#define SCHEDCOOP_TIME_SLICE \
+	((__nsec) ukarch_time_usec_to_nsec(CONFIG_LIBUKSCHEDCOOP_TIME_SLICE))
+
+UK_PERCPU_DEFINE(uk_preempt_count);
+UK_PERCPU_DEFINE(uk_preempt_pending);
+
+/* Set once the scheduler started. We only support one LCPU. */
+static struct schedcoop *schedcoop_preempt_sched;
+
+static inline bool schedcoop_preempt_sliced(struct schedcoop *c,
+					    struct uk_thread *t)
+{
+	return t != &c->idle &&
+	       (t->policy == UK_SCHED_POLICY_NORMAL ||
+		t->policy == UK_SCHED_POLICY_RR);
+}
+
+void schedcoop_preempt_start(struct schedcoop *c)
+{
+	c->slice_end = 0;
+	schedcoop_preempt_sched = c;
+}
+
+void schedcoop_preempt_arm(struct schedcoop *c, struct uk_thread *next,
+			   __nsec now)
+{
+	UK_ASSERT(ukplat_lcpu_irqs_disabled());
+
+	uk_percpu_current(uk_preempt_pending) = 0;
+
+	if (!schedcoop_preempt_sliced(c, next)) {
+		c->slice_end = 0;
+		return;
+	}
+
+	c->slice_end = now + SCHEDCOOP_TIME_SLICE;
+	ukplat_time_arm(c->slice_end);
+}
+
+void ukplat_lcpu_irq_return(struct __regs *regs __unused)
+{
+	struct schedcoop *c = schedcoop_preempt_sched;
+
+	if (!c || !c->slice_end || ukplat_monotonic_clock() < c->slice_end)
+		return;
+
+	/* Disarm, so that further interrupts do not check again before
+	 * the thread reached the scheduler
+	 */
+	c->slice_end = 0;
+	uk_percpu_current(uk_preempt_pending) = 1;
+}
+
+void uk_preempt_schedule(void)
+{
+	/* Leave the preemption pending if we cannot yield here */
+	if (ukplat_lcpu_irqs_disabled() || !schedcoop_preempt_sched)
+		return;
+
+	uk_percpu_current(uk_preempt_pending) = 0;
+	uk_sched_yield();
+}
@@ -26,8 +26,10 @@
  * DEALINGS IN THE SOFTWARE.
  */
 /*
- * The scheduler is non-preemptive (cooperative), and schedules according
- * to Round Robin algorithm.
+ * The scheduler is non-preemptive (cooperative) unless timer-driven
+ * preemption is enabled (see preempt.c), and schedules according
+ * to Round Robin algorithm. Threads with the deadline policy are picked
+ * before threads with a fixed priority, and those before normal threads.
  */
 #include <uk/plat/config.h>
 #include <uk/plat/lcpu.h>
@@ -36,21 +38,61 @@
 #include <uk/sched_impl.h>
 #include <uk/schedcoop.h>
 #include <uk/essentials.h>
+#include <uk/trace.h>
+#if CONFIG_LIBUKPMD
+#include <uk/pmd.h>
+#endif /* CONFIG_LIBUKPMD */
 #include "schedcoop.h"
 
+/* Initial number of slots of the sleep heap */
+#define SCHEDCOOP_SLEEP_HEAP_MIN 16U
+
+#define SCHEDCOOP_TIMER_SLACK \
+	((__snsec) ukarch_time_usec_to_nsec(CONFIG_LIBUKSCHEDCOOP_TIMER_SLACK))
+
+#if CONFIG_LIBUKSCHEDCOOP_IDLE_POLL
+#define SCHEDCOOP_IDLE_POLL_MAX \
+	((__nsec) ukarch_time_usec_to_nsec(CONFIG_LIBUKSCHEDCOOP_IDLE_POLL_MAX))
+/* Window after the first short idle period, as in Linux' haltpoll */
+#define SCHEDCOOP_IDLE_POLL_START \
+	MIN((__nsec) ukarch_time_usec_to_nsec(50), SCHEDCOOP_IDLE_POLL_MAX)
+#endif /* CONFIG_LIBUKSCHEDCOOP_IDLE_POLL */
+
+UK_TRACEPOINT(trace_uksched_switch, "%p -> %p", void *, void *);
+
+#if CONFIG_LIBUKSCHEDCOOP_TIMER_SLACK > 0
+/* Returns the latest timeout that is not after `bound` in the subheap at `i`.
+ * Only subheaps with timeouts within the bound are visited.
+ */
+static __snsec schedcoop_sleep_latest(struct schedcoop *c, unsigned int i,
+				      __snsec bound)
+{
+	__snsec latest, sub;
+
+	if (i >= c->sleep_len || c->sleep_heap[i]->wakeup_time > bound)
+		return 0;
+
+	latest = c->sleep_heap[i]->wakeup_time;
+	sub = schedcoop_sleep_latest(c, 2 * i + 1, bound);
+	latest = MAX(latest, sub);
+	sub = schedcoop_sleep_latest(c, 2 * i + 2, bound);
+	return MAX(latest, sub);
+}
+#endif /* CONFIG_LIBUKSCHEDCOOP_TIMER_SLACK > 0 */
+
 static void schedcoop_schedule(struct uk_sched *s)
 {
 	struct schedcoop *c = uksched2schedcoop(s);
-	struct uk_thread *prev, *next, *thread, *tmp;
+	struct uk_thread *prev, *next, *thread;
 	__snsec now, min_wakeup_time;
 	unsigned long flags;
 
 	if (unlikely(ukplat_lcpu_irqs_disabled()))
 		UK_CRASH("Must not call %s with IRQs disabled\n", __func__);
 
+	flags = ukplat_lcpu_save_irqf();
 	now = ukplat_monotonic_clock();
 	prev = uk_thread_current();
-	flags = ukplat_lcpu_save_irqf();
 
 #if 0 //TODO
 	if (in_callback)
@@ -65,44 +107,41 @@ static void schedcoop_schedule(struct uk_sched *s)
 	prev->exec_time += now - c->ts_prev_switch;
 	c->ts_prev_switch = now;
 
-	/* Examine all sleeping threads.
-	 * Wake up expired ones and find the time when the next timeout expires.
-	 */
-	min_wakeup_time = 0;
-	UK_TAILQ_FOREACH_SAFE(thread, &c->sleep_queue,
-			      queue, tmp) {
-		if (likely(thread->wakeup_time)) {
-			if (thread->wakeup_time <= now)
-				uk_thread_wake(thread);
-			else if (!min_wakeup_time
-				 || thread->wakeup_time < min_wakeup_time)
-				min_wakeup_time = thread->wakeup_time;
-		}
+	/* Wake up expired threads. The heap top is the next timeout. */
+	while ((thread = schedcoop_sleep_first(c))
+	       && thread->wakeup_time <= now) {
+		UK_ASSERT(!uk_thread_is_runnable(thread));
+		uk_thread_wake(thread);
 	}
+	min_wakeup_time = thread ? thread->wakeup_time : 0;
+
+	/* Put previous thread on the end of its queue. It keeps running if
+	 * no thread of a higher class or priority is runnable.
+	 */
+	if ((prev != &c->idle)
+	    && uk_thread_is_runnable(prev)
+	    && !uk_thread_is_exited(prev))
+		schedcoop_runq_add(c, prev);
 
-	next = UK_TAILQ_FIRST(&c->run_queue);
+	next = schedcoop_runq_first(c);
 	if (next) {
-		UK_ASSERT(next != prev);
 		UK_ASSERT(uk_thread_is_runnable(next));
 		UK_ASSERT(!uk_thread_is_exited(next));
-		UK_TAILQ_REMOVE(&c->run_queue, next,
-				queue);
-
-		/* Put previous thread on the end of the list */
-		if ((prev != &c->idle)
-		    && uk_thread_is_runnable(prev)
-		    && !uk_thread_is_exited(prev))
-			UK_TAILQ_INSERT_TAIL(&c->run_queue, prev,
-					     queue);
-	} else if (uk_thread_is_runnable(prev)
-		   && !uk_thread_is_exited(prev)) {
-		next = prev;
+		schedcoop_runq_remove(c, next);
 	} else {
 		/*
 		 * Schedule idle thread that will halt the CPU
 		 * We select the idle thread only if we do not have anything
 		 * else to execute
 		 */
+#if CONFIG_LIBUKSCHEDCOOP_TIMER_SLACK > 0
+		/* Coalesce the timeouts within the slack window into one
+		 * wakeup at the latest of them
+		 */
+		if (min_wakeup_time)
+			min_wakeup_time = schedcoop_sleep_latest(c, 0,
+					min_wakeup_time + SCHEDCOOP_TIMER_SLACK);
+#endif /* CONFIG_LIBUKSCHEDCOOP_TIMER_SLACK > 0 */
 		c->idle_return_time = min_wakeup_time;
 		next = &c->idle;
 	}
@@ -117,25 +156,59 @@ static void schedcoop_schedule(struct uk_sched *s)
 		uk_thread_clear_queueable(next);
 	}
 
+#if CONFIG_LIBUKSCHEDCOOP_PREEMPT
+	schedcoop_preempt_arm(c, next, now);
+#endif /* CONFIG_LIBUKSCHEDCOOP_PREEMPT */
+
 	ukplat_lcpu_restore_irqf(flags);
 
 	/* Interrupting the switch is equivalent to having the next thread
 	 * interrupted at the return instruction. And therefore at safe point.
 	 */
-	if (prev != next)
+	if (prev != next) {
+		trace_uksched_switch(prev, next);
 		uk_sched_thread_switch(next);
+	}
+}
+
+/* Makes sure that the sleep heap can hold `nr_threads` threads */
+static int schedcoop_sleep_reserve(struct schedcoop *c,
+				   unsigned int nr_threads)
+{
+	struct uk_thread **heap;
+	unsigned int cap;
+
+	if (likely(nr_threads <= c->sleep_cap))
+		return 0;
+
+	cap = MAX(c->sleep_cap * 2, SCHEDCOOP_SLEEP_HEAP_MIN);
+	heap = uk_realloc(c->sched.a, c->sleep_heap, cap * sizeof(*heap));
+	if (unlikely(!heap))
+		return -ENOMEM;
+
+	c->sleep_heap = heap;
+	c->sleep_cap = cap;
+	return 0;
 }
 
 static int schedcoop_thread_add(struct uk_sched *s, struct uk_thread *t)
 {
 	struct schedcoop *c = uksched2schedcoop(s);
+	int rc;
 
 	UK_ASSERT(t);
 	UK_ASSERT(!uk_thread_is_exited(t));
 
+	rc = schedcoop_sleep_reserve(c, c->nr_threads + 1);
+	if (unlikely(rc))
+		return rc;
+	c->nr_threads++;
+
 	/* Add to run queue if runnable */
-	if (uk_thread_is_runnable(t))
-		UK_TAILQ_INSERT_TAIL(&c->run_queue, t, queue);
+	if (uk_thread_is_runnable(t)) {
+		schedcoop_deadline_start(t);
+		schedcoop_runq_add(c, t);
+	}
 
 	return 0;
 }
@@ -144,10 +217,15 @@ static void schedcoop_thread_remove(struct uk_sched *s, struct uk_thread *t)
 {
 	struct schedcoop *c = uksched2schedcoop(s);
 
-	/* Remove from run_queue */
+	/* Remove from run_queue or from the sleeping threads */
 	if (t != uk_thread_current()
 	    && uk_thread_is_runnable(t))
-		UK_TAILQ_REMOVE(&c->run_queue, t, queue);
+		schedcoop_runq_remove(c, t);
+	else if (!uk_thread_is_runnable(t) && t->wakeup_time > 0)
+		schedcoop_sleep_remove(c, t);
+
+	UK_ASSERT(c->nr_threads > 0);
+	c->nr_threads--;
 }
 
 static void schedcoop_thread_blocked(struct uk_sched *s, struct uk_thread *t)
@@ -157,35 +235,120 @@ static void schedcoop_thread_blocked(struct uk_sched *s, struct uk_thread *t)
 	UK_ASSERT(ukplat_lcpu_irqs_disabled());
 
 	if (t != uk_thread_current())
-		UK_TAILQ_REMOVE(&c->run_queue, t, queue);
+		schedcoop_runq_remove(c, t);
 	if (t->wakeup_time > 0)
-		UK_TAILQ_INSERT_TAIL(&c->sleep_queue, t, queue);
+		schedcoop_sleep_insert(c, t);
 }
 
+static int schedcoop_thread_set_policy(struct uk_sched *s,
+				       struct uk_thread *t, int policy,
+				       int prio, __nsec rel_deadline)
+{
+	struct schedcoop *c = uksched2schedcoop(s);
+	unsigned long flags;
+	bool queued;
+
+	if (unlikely(t == &c->idle))
+		return -EINVAL;
+
+	flags = ukplat_lcpu_save_irqf();
+
+	queued = t != uk_thread_current() && uk_thread_is_runnable(t);
+	if (queued)
+		schedcoop_runq_remove(c, t);
+
+	t->policy = policy;
+	t->prio = prio;
+	t->rel_deadline = rel_deadline;
+	if (uk_thread_is_runnable(t))
+		schedcoop_deadline_start(t);
+
+	if (queued)
+		schedcoop_runq_add(c, t);
+
+	ukplat_lcpu_restore_irqf(flags);
+	return 0;
+}
+
+#if CONFIG_LIBUKSCHEDCOOP_IDLE_POLL
+/* Spins with interrupts enabled for the current poll window, but not beyond
+ * the next timeout. Called and returns with interrupts disabled. Returns 1
+ * if the idle period ended, i.e., a thread became runnable or the timeout
+ * was reached.
+ */
+static int schedcoop_idle_poll(struct schedcoop *c, __nsec now,
+			       __nsec wake_up_time)
+{
+	__nsec until = now + c->idle_poll;
+	int timeout = 0;
+
+	if (!c->idle_poll)
+		return 0;
+
+	if (wake_up_time && wake_up_time <= until) {
+		until = wake_up_time;
+		timeout = 1;
+	}
+
+	while (now < until) {
+		ukplat_lcpu_enable_irq();
+		ukarch_spinwait();
+		ukplat_lcpu_disable_irq();
+
+		if (schedcoop_runq_first(c))
+			return 1;
+		now = ukplat_monotonic_clock();
+	}
+	return timeout;
+}
+
+/* Adapts the poll window to the length of an idle period that ended with a
+ * halt: polling would have caught wakeups within the maximum window
+ */
+static void schedcoop_idle_adapt(struct schedcoop *c, __nsec idle)
+{
+	if (idle > SCHEDCOOP_IDLE_POLL_MAX)
+		c->idle_poll /= 2;
+	else if (idle > c->idle_poll)
+		c->idle_poll = MIN(MAX(2 * c->idle_poll,
+				       SCHEDCOOP_IDLE_POLL_START),
+				   SCHEDCOOP_IDLE_POLL_MAX);
+}
+#endif /* CONFIG_LIBUKSCHEDCOOP_IDLE_POLL */
+
 static __noreturn void idle_thread_fn(void *argp)
 {
 	struct schedcoop *c = (struct schedcoop *) argp;
 	__nsec now, wake_up_time;
+	unsigned int reaped;
 	unsigned long flags;
 
 	UK_ASSERT(c);
 
-	for (;;) {
-		flags = ukplat_lcpu_save_irqf();
+#if CONFIG_LIBUKSCHEDCOOP_IDLE_POLL && CONFIG_HAVE_LCPU_HALT_POLL_HINT
+	/* We poll ourselves before halting */
+	ukplat_lcpu_halt_poll_hint(0);
+#endif /* CONFIG_LIBUKSCHEDCOOP_IDLE_POLL && CONFIG_HAVE_LCPU_HALT_POLL_HINT */
 
+	for (;;) {
 		/*
 		 * FIXME: We assume that `uk_sched_thread_gc()` is non-blocking
 		 *        because we implement a cooperative scheduler. However,
 		 *        this assumption may not be true depending on the
 		 *        destructor functions that are assigned to the threads
 		 *        and are called by `uk_sched_thred_gc()`.
-		 *	  Also check if in the meantime we got a runnable
-		 *	  thread.
 		 * NOTE:  This idle thread must be non-blocking so that the
 		 *        scheduler has always something to schedule.
+		 *        Threads are released in batches with interrupts
+		 *        enabled, so that freeing many of them does not delay
+		 *        interrupt handling.
 		 */
-		if (uk_sched_thread_gc(&c->sched) > 0 ||
-		    UK_TAILQ_FIRST(&c->run_queue)) {
+		reaped = uk_sched_thread_gc(&c->sched);
+
+		flags = ukplat_lcpu_save_irqf();
+
+		/* Also check if in the meantime we got a runnable thread */
+		if (reaped > 0 || schedcoop_runq_first(c)) {
 			/* We collected successfully some garbage or there is
 			 * a runnable thread in the queue.
 			 * Check if something else can be scheduled now.
@@ -196,15 +359,47 @@ static __noreturn void idle_thread_fn(void *argp)
 			continue;
 		}
 
+#if CONFIG_LIBUKPMD
+		if (uk_pmd_lcpu_active(ukplat_lcpu_idx())) {
+			/* Poll the device queues of this CPU instead of
+			 * halting, pausing between empty rounds
+			 */
+			ukplat_lcpu_restore_irqf(flags);
+			if (!uk_pmd_poll())
+				ukarch_spinwait();
+			schedcoop_schedule(&c->sched);
+
+			continue;
+		}
+#endif /* CONFIG_LIBUKPMD */
+
 		/* Read return time set by last schedule operation */
 		wake_up_time = (volatile __nsec) c->idle_return_time;
 		now = ukplat_monotonic_clock();
 
 		if (!wake_up_time || wake_up_time > now) {
+#if CONFIG_LIBUKSCHEDCOOP_IDLE_POLL
+			if (schedcoop_idle_poll(c, now, wake_up_time)) {
+				ukplat_lcpu_restore_irqf(flags);
+				schedcoop_schedule(&c->sched);
+
+				continue;
+			}
+#endif /* CONFIG_LIBUKSCHEDCOOP_IDLE_POLL */
+#if CONFIG_LIBUKRCU
+			uk_rcu_idle_enter();
+#endif /* CONFIG_LIBUKRCU */
 			if (wake_up_time)
 				ukplat_lcpu_halt_irq_until(wake_up_time);
 			else
 				ukplat_lcpu_halt_irq();
+#if CONFIG_LIBUKRCU
+			uk_rcu_idle_exit();
+#endif /* CONFIG_LIBUKRCU */
+#if CONFIG_LIBUKSCHEDCOOP_IDLE_POLL
+			schedcoop_idle_adapt(c,
+					     ukplat_monotonic_clock() - now);
+#endif /* CONFIG_LIBUKSCHEDCOOP_IDLE_POLL */
 
 			/* handle pending events if any */
 			ukplat_lcpu_irqs_handle_pending();
@@ -221,6 +416,7 @@ static int schedcoop_start(struct uk_sched *s,
 			   struct uk_thread *main_thread __maybe_unused)
 {
 	struct schedcoop *c = uksched2schedcoop(s);
+	int rc;
 
 	UK_ASSERT(main_thread);
 	UK_ASSERT(main_thread->sched == s);
@@ -233,11 +429,21 @@ static int schedcoop_start(struct uk_sched *s,
 	 */
 	c->ts_prev_switch = ukplat_monotonic_clock();
 
+	/* `main_thread` is not added with `schedcoop_thread_add()` */
+	rc = schedcoop_sleep_reserve(c, c->nr_threads + 1);
+	if (unlikely(rc))
+		return rc;
+	c->nr_threads++;
+
 	/* NOTE: We do not put `main_thread` into the thread list.
 	 *       Current running threads will be added as soon as
 	 *       a different thread is scheduled.
 	 */
 
+#if CONFIG_LIBUKSCHEDCOOP_PREEMPT
+	schedcoop_preempt_start(c);
+#endif /* CONFIG_LIBUKSCHEDCOOP_PREEMPT */
+
 	ukplat_lcpu_enable_irq();
 
 	return 0;
@@ -258,6 +464,7 @@ static const struct uk_thread *schedcoop_idle_thread(struct uk_sched *s,
 struct uk_sched *uk_schedcoop_create(struct uk_alloc *a)
 {
 	struct schedcoop *c = NULL;
+	unsigned int i;
 	int rc;
 
 	uk_pr_info("Initializing cooperative scheduler\n");
@@ -266,7 +473,9 @@ struct uk_sched *uk_schedcoop_create(struct uk_alloc *a)
 		goto err_out;
 
 	UK_TAILQ_INIT(&c->run_queue);
-	UK_TAILQ_INIT(&c->sleep_queue);
+	UK_TAILQ_INIT(&c->edf_queue);
+	for (i = 0; i < ARRAY_SIZE(c->prio_queue); i++)
+		UK_TAILQ_INIT(&c->prio_queue[i]);
 
 	/* Create idle thread */
 	rc = uk_thread_init_fn1(&c->idle,
@@ -293,6 +502,7 @@ struct uk_sched *uk_schedcoop_create(struct uk_alloc *a)
 			schedcoop_thread_woken_isr,
 			schedcoop_idle_thread,
 			a);
+	c->sched.thread_set_policy = schedcoop_thread_set_policy;
 
 	/* Add idle thread to the scheduler's thread list */
 	UK_TAILQ_INSERT_TAIL(&c->sched.thread_list, &c->idle, thread_list);
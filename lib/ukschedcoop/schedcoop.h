@@ -7,15 +7,41 @@
 #define __UK_SCHEDCOOP_SCHEDCOOP_H__
 
 #include <uk/schedcoop.h>
+#include <uk/plat/time.h>
+
+/* Number of words of the bitmap of non-empty priority queues */
+#define SCHEDCOOP_PRIO_WORDS	((UK_SCHED_PRIO_MAX + 64) / 64)
 
 struct schedcoop {
 	struct uk_sched sched;
-	struct uk_thread_list run_queue;
-	struct uk_thread_list sleep_queue;
+	struct uk_thread_list run_queue;	/**< Normal threads */
+
+	/* Runnable threads with a fixed priority, one queue per priority.
+	 * A bit is set in `prio_map` for each non-empty queue.
+	 */
+	struct uk_thread_list prio_queue[UK_SCHED_PRIO_MAX + 1];
+	__u64 prio_map[SCHEDCOOP_PRIO_WORDS];
+	/* Runnable deadline threads, ordered by absolute deadline */
+	struct uk_thread_list edf_queue;
+
+	/* Binary min-heap of sleeping threads, keyed on `wakeup_time`.
+	 * It has room for every thread of the scheduler so that blocking
+	 * never allocates.
+	 */
+	struct uk_thread **sleep_heap;
+	unsigned int sleep_len;
+	unsigned int sleep_cap;
+	unsigned int nr_threads;
 
 	struct uk_thread idle;
 	__nsec idle_return_time;
 	__nsec ts_prev_switch;
+#if CONFIG_LIBUKSCHEDCOOP_IDLE_POLL
+	__nsec idle_poll;	/**< Current poll window of the idle thread */
+#endif /* CONFIG_LIBUKSCHEDCOOP_IDLE_POLL */
+#if CONFIG_LIBUKSCHEDCOOP_PREEMPT
+	__nsec slice_end;	/**< End of the time slice, 0 if none */
+#endif /* CONFIG_LIBUKSCHEDCOOP_PREEMPT */
 };
 
 static inline struct schedcoop *uksched2schedcoop(struct uk_sched *s)
@@ -25,6 +51,165 @@ static inline struct schedcoop *uksched2schedcoop(struct uk_sched *s)
 	return __containerof(s, struct schedcoop, sched);
 }
 
+static inline void schedcoop_sleep_set(struct schedcoop *c, unsigned int i,
+				       struct uk_thread *t)
+{
+	c->sleep_heap[i] = t;
+	t->wakeup_idx = i;
+}
+
+static inline void schedcoop_sleep_sift_up(struct schedcoop *c, unsigned int i)
+{
+	struct uk_thread *t = c->sleep_heap[i];
+	unsigned int p;
+
+	while (i > 0) {
+		p = (i - 1) / 2;
+		if (c->sleep_heap[p]->wakeup_time <= t->wakeup_time)
+			break;
+		schedcoop_sleep_set(c, i, c->sleep_heap[p]);
+		i = p;
+	}
+	schedcoop_sleep_set(c, i, t);
+}
+
+static inline void schedcoop_sleep_sift_down(struct schedcoop *c,
+					     unsigned int i)
+{
+	struct uk_thread *t = c->sleep_heap[i];
+	unsigned int m;
+
+	for (;;) {
+		m = 2 * i + 1;
+		if (m >= c->sleep_len)
+			break;
+		if (m + 1 < c->sleep_len &&
+		    c->sleep_heap[m + 1]->wakeup_time <
+		    c->sleep_heap[m]->wakeup_time)
+			++m;
+		if (c->sleep_heap[m]->wakeup_time >= t->wakeup_time)
+			break;
+		schedcoop_sleep_set(c, i, c->sleep_heap[m]);
+		i = m;
+	}
+	schedcoop_sleep_set(c, i, t);
+}
+
+/** Returns the sleeping thread with the earliest timeout, or NULL */
+static inline struct uk_thread *schedcoop_sleep_first(struct schedcoop *c)
+{
+	return c->sleep_len ? c->sleep_heap[0] : NULL;
+}
+
+static inline void schedcoop_sleep_insert(struct schedcoop *c,
+					  struct uk_thread *t)
+{
+	UK_ASSERT(c->sleep_len < c->sleep_cap);
+
+	c->sleep_heap[c->sleep_len] = t;
+	schedcoop_sleep_sift_up(c, c->sleep_len++);
+}
+
+static inline void schedcoop_sleep_remove(struct schedcoop *c,
+					  struct uk_thread *t)
+{
+	unsigned int i = t->wakeup_idx;
+	struct uk_thread *last;
+
+	UK_ASSERT(i < c->sleep_len && c->sleep_heap[i] == t);
+
+	last = c->sleep_heap[--c->sleep_len];
+	if (last == t)
+		return;
+
+	schedcoop_sleep_set(c, i, last);
+	if (i > 0 &&
+	    c->sleep_heap[(i - 1) / 2]->wakeup_time > last->wakeup_time)
+		schedcoop_sleep_sift_up(c, i);
+	else
+		schedcoop_sleep_sift_down(c, i);
+}
+
+/** Queues a runnable thread according to its policy */
+static inline void schedcoop_runq_add(struct schedcoop *c,
+				      struct uk_thread *t)
+{
+	struct uk_thread *itr;
+
+	switch (t->policy) {
+	case UK_SCHED_POLICY_DEADLINE:
+		UK_TAILQ_FOREACH(itr, &c->edf_queue, queue) {
+			if (itr->deadline > t->deadline) {
+				UK_TAILQ_INSERT_BEFORE(itr, t, queue);
+				return;
+			}
+		}
+		UK_TAILQ_INSERT_TAIL(&c->edf_queue, t, queue);
+		break;
+	case UK_SCHED_POLICY_FIFO:
+	case UK_SCHED_POLICY_RR:
+		UK_TAILQ_INSERT_TAIL(&c->prio_queue[t->prio], t, queue);
+		c->prio_map[t->prio / 64] |= 1ULL << (t->prio % 64);
+		break;
+	default:
+		UK_TAILQ_INSERT_TAIL(&c->run_queue, t, queue);
+		break;
+	}
+}
+
+static inline void schedcoop_runq_remove(struct schedcoop *c,
+					 struct uk_thread *t)
+{
+	switch (t->policy) {
+	case UK_SCHED_POLICY_DEADLINE:
+		UK_TAILQ_REMOVE(&c->edf_queue, t, queue);
+		break;
+	case UK_SCHED_POLICY_FIFO:
+	case UK_SCHED_POLICY_RR:
+		UK_TAILQ_REMOVE(&c->prio_queue[t->prio], t, queue);
+		if (UK_TAILQ_EMPTY(&c->prio_queue[t->prio]))
+			c->prio_map[t->prio / 64] &=
+				~(1ULL << (t->prio % 64));
+		break;
+	default:
+		UK_TAILQ_REMOVE(&c->run_queue, t, queue);
+		break;
+	}
+}
+
+/** Returns the runnable thread that should run next, or NULL */
+static inline struct uk_thread *schedcoop_runq_first(struct schedcoop *c)
+{
+	struct uk_thread *t;
+	unsigned int i;
+
+	t = UK_TAILQ_FIRST(&c->edf_queue);
+	if (t)
+		return t;
+
+	for (i = SCHEDCOOP_PRIO_WORDS; i > 0; i--) {
+		if (c->prio_map[i - 1])
+			return UK_TAILQ_FIRST(&c->prio_queue[(i - 1) * 64 + 63 -
+					__builtin_clzll(c->prio_map[i - 1])]);
+	}
+
+	return UK_TAILQ_FIRST(&c->run_queue);
+}
+
+/** Starts a new deadline period for a thread that became runnable */
+static inline void schedcoop_deadline_start(struct uk_thread *t)
+{
+	if (t->policy == UK_SCHED_POLICY_DEADLINE)
+		t->deadline = ukplat_monotonic_clock() + t->rel_deadline;
+}
+
 void schedcoop_thread_woken_isr(struct uk_sched *s, struct uk_thread *t);
 
+#if CONFIG_LIBUKSCHEDCOOP_PREEMPT
+/* See preempt.c */
+void schedcoop_preempt_start(struct schedcoop *c);
+void schedcoop_preempt_arm(struct schedcoop *c, struct uk_thread *next,
+			   __nsec now);
+#endif /* CONFIG_LIBUKSCHEDCOOP_PREEMPT */
+
 #endif /* __UK_SCHEDCOOP_SCHEDCOOP_H__ */
@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+/*
+ * Non-preemptive Round Robin scheduler with per-logical-CPU run queues
+ * and work stealing.
+ */
+
+#ifndef __UK_SCHEDWS_H__
+#define __UK_SCHEDWS_H__
+
+#include <uk/sched.h>
+#include <uk/alloc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Creates the work-stealing scheduler. The scheduler manages all logical
+ * CPUs of the system: it starts the secondary CPUs when it is started with
+ * `uk_sched_start()` from the boot CPU. Only one instance may be created.
+ *
+ * @param a
+ *   Allocator for the scheduler and its idle threads
+ * @return
+ *   - (NULL): Allocation failed or an instance exists already
+ *   - Reference to the scheduler
+ */
+struct uk_sched *uk_schedws_create(struct uk_alloc *a);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UK_SCHEDWS_H__ */
@@ -0,0 +1,64 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+#include "schedws.h"
+
+void schedws_lcpu_kick(struct schedws *ws __maybe_unused,
+		       struct schedws_lcpu *lc __maybe_unused)
+{
+#if CONFIG_HAVE_SMP
+	__lcpuidx self = ukplat_lcpu_idx();
+	__lcpuidx idx = schedws_lcpu_idx(ws, lc);
+	unsigned int num = 1;
+	__lcpuidx i;
+
+	if (idx != self && uk_load_n(&lc->halted)) {
+		ukplat_lcpu_wakeup(&idx, &num);
+		return;
+	}
+
+	/* The owner is busy: let a halted sibling steal the work */
+	for (i = 0; i < ws->nr_lcpus; i++) {
+		if (i == self || i == idx)
+			continue;
+		if (uk_load_n(&ws->lcpu[i].halted)) {
+			ukplat_lcpu_wakeup(&i, &num);
+			return;
+		}
+	}
+
+#if CONFIG_LIBUKSCHEDWS_LAZY_LCPUS
+	/* All started CPUs are busy: bring up another one */
+	schedws_lcpu_start_next(ws);
+#endif /* CONFIG_LIBUKSCHEDWS_LAZY_LCPUS */
+#endif /* CONFIG_HAVE_SMP */
+}
+
+void schedws_thread_woken_isr(struct uk_sched *s, struct uk_thread *t)
+{
+	struct schedws *ws = uksched2schedws(s);
+	struct schedws_lcpu *lc;
+	bool queued = false;
+
+	UK_ASSERT(ukplat_lcpu_irqs_disabled());
+
+	lc = schedws_thread_lock(ws, t);
+	/* Clearing the wakeup time makes a concurrent wake of the same
+	 * thread from another CPU a no-op.
+	 */
+	if (t->wakeup_time > 0) {
+		UK_TAILQ_REMOVE(&lc->sleep_queue, t, queue);
+		t->wakeup_time = 0;
+	}
+	if (uk_thread_is_queueable(t) && uk_thread_is_runnable(t)) {
+		UK_TAILQ_INSERT_TAIL(&lc->run_queue, t, queue);
+		uk_thread_clear_queueable(t);
+		queued = true;
+	}
+	uk_spin_unlock(&lc->lock);
+
+	if (queued)
+		schedws_lcpu_kick(ws, lc);
+}
@@ -0,0 +1,618 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+/*
+ * The scheduler is non-preemptive (cooperative) and schedules according
+ * to Round Robin algorithm. Each logical CPU has its own run queue; idle
+ * logical CPUs steal runnable threads from their siblings.
+ *
+ * Only LCPU 0 programs the platform timer: it expires the sleeping threads
+ * of all logical CPUs and wakes their owners up with an IPI. Secondary
+ * CPUs halt until they receive an IPI.
+ */
+#include <uk/plat/config.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/memory.h>
+#include <uk/plat/time.h>
+#include <uk/sched_impl.h>
+#include <uk/essentials.h>
+#include <uk/trace.h>
+#if CONFIG_LIBUKPMD
+#include <uk/pmd.h>
+#endif /* CONFIG_LIBUKPMD */
+#include "schedws.h"
+
+UK_TRACEPOINT(trace_uksched_switch, "%p -> %p", void *, void *);
+
+/* Secondary CPUs enter the scheduler without arguments */
+static struct schedws *schedws_instance;
+
+/**
+ * Wakes up the expired threads on the sleep queue of `lc`, which must be
+ * locked by the caller. Returns the number of threads that were put on the
+ * run queue and updates `min_wakeup_time` with the next timeout.
+ */
+static unsigned int schedws_expire(struct schedws_lcpu *lc, __snsec now,
+				   __snsec *min_wakeup_time)
+{
+	struct uk_thread *thread, *tmp;
+	unsigned int num = 0;
+
+	UK_TAILQ_FOREACH_SAFE(thread, &lc->sleep_queue, queue, tmp) {
+		if (unlikely(!thread->wakeup_time))
+			continue;
+
+		if (thread->wakeup_time <= now) {
+			/* Same as `uk_thread_wake()`, but we hold the lock
+			 * that the woken callback would take
+			 */
+			UK_TAILQ_REMOVE(&lc->sleep_queue, thread, queue);
+			thread->wakeup_time = 0;
+			uk_thread_set_runnable(thread);
+			if (uk_thread_is_queueable(thread)) {
+				UK_TAILQ_INSERT_TAIL(&lc->run_queue, thread,
+						     queue);
+				uk_thread_clear_queueable(thread);
+				++num;
+			}
+		} else if (!*min_wakeup_time
+			   || thread->wakeup_time < *min_wakeup_time) {
+			*min_wakeup_time = thread->wakeup_time;
+		}
+	}
+
+	return num;
+}
+
+/**
+ * LCPU 0 handles the timeouts of the secondary CPUs because it is the only
+ * one that receives timer interrupts.
+ */
+static __snsec schedws_expire_remote(struct schedws *ws, __snsec now)
+{
+	struct schedws_lcpu *lc;
+	__snsec min_wakeup_time = 0;
+	unsigned int i;
+
+	uk_exchange_n(&ws->timer_dirty, 0);
+	for (i = 1; i < ws->nr_lcpus; i++) {
+		lc = &ws->lcpu[i];
+		if (UK_TAILQ_EMPTY(&lc->sleep_queue))
+			continue;
+
+		uk_spin_lock(&lc->lock);
+		if (schedws_expire(lc, now, &min_wakeup_time) > 0) {
+			uk_spin_unlock(&lc->lock);
+			schedws_lcpu_kick(ws, lc);
+			continue;
+		}
+		uk_spin_unlock(&lc->lock);
+	}
+
+	return min_wakeup_time;
+}
+
+/**
+ * Steals a runnable thread from a sibling and puts it on the run queue of
+ * `lc`, which must be locked by the caller. The victim's lock is only tried
+ * so that two stealing CPUs cannot deadlock.
+ *
+ * @return
+ *   - (1): A thread was stolen
+ *   - (0): There is nothing to steal
+ *   - (-EBUSY): A sibling has work but it could not be taken right now
+ */
+static int schedws_steal(struct schedws *ws, struct schedws_lcpu *lc)
+{
+	__lcpuidx self = schedws_lcpu_idx(ws, lc);
+	struct schedws_lcpu *victim;
+	struct uk_thread *thread;
+	int ret = 0;
+	unsigned int i;
+
+	for (i = 1; i < ws->nr_lcpus; i++) {
+		victim = &ws->lcpu[(self + i) % ws->nr_lcpus];
+		if (UK_TAILQ_EMPTY(&victim->run_queue))
+			continue;
+
+		if (!uk_spin_trylock(&victim->lock)) {
+			ret = -EBUSY;
+			continue;
+		}
+
+		/* Take from the tail, the owner takes from the head. Skip
+		 * pinned threads and threads whose context is still being
+		 * saved.
+		 */
+		UK_TAILQ_FOREACH_REVERSE(thread, &victim->run_queue,
+					 uk_thread_list, queue) {
+			if (uk_thread_is_pinned(thread))
+				continue;
+			if (thread->ctx.ip != 0)
+				break;
+			ret = -EBUSY;
+		}
+		if (thread) {
+			rmb();
+			UK_TAILQ_REMOVE(&victim->run_queue, thread, queue);
+			uk_store_n(&thread->lcpu, self);
+			UK_TAILQ_INSERT_TAIL(&lc->run_queue, thread, queue);
+		}
+		uk_spin_unlock(&victim->lock);
+
+		if (thread)
+			return 1;
+	}
+
+	return ret;
+}
+
+static void schedws_schedule(struct uk_sched *s)
+{
+	struct schedws *ws = uksched2schedws(s);
+	struct uk_thread *prev, *next;
+	struct schedws_lcpu *lc;
+	__snsec now, min_wakeup_time;
+	unsigned long flags;
+	bool prev_queued = false;
+
+	if (unlikely(ukplat_lcpu_irqs_disabled()))
+		UK_CRASH("Must not call %s with IRQs disabled\n", __func__);
+
+	now = ukplat_monotonic_clock();
+	prev = uk_thread_current();
+	lc = &ws->lcpu[ukplat_lcpu_idx()];
+	flags = ukplat_lcpu_save_irqf();
+
+	min_wakeup_time = 0;
+	if (lc == &ws->lcpu[0] && ws->nr_lcpus > 1)
+		min_wakeup_time = schedws_expire_remote(ws, now);
+
+	uk_spin_lock(&lc->lock);
+
+	/* Update execution time of current thread */
+	prev->exec_time += now - lc->ts_prev_switch;
+	lc->ts_prev_switch = now;
+
+	/* Examine our sleeping threads */
+	schedws_expire(lc, now, &min_wakeup_time);
+
+	next = UK_TAILQ_FIRST(&lc->run_queue);
+	if (next) {
+		UK_ASSERT(next != prev);
+		UK_ASSERT(uk_thread_is_runnable(next));
+		UK_ASSERT(!uk_thread_is_exited(next));
+		UK_TAILQ_REMOVE(&lc->run_queue, next, queue);
+
+		/* Put previous thread on the end of the list */
+		if ((prev != &lc->idle)
+		    && uk_thread_is_runnable(prev)
+		    && !uk_thread_is_exited(prev)) {
+			UK_TAILQ_INSERT_TAIL(&lc->run_queue, prev, queue);
+			prev_queued = true;
+		}
+	} else if (uk_thread_is_runnable(prev)
+		   && !uk_thread_is_exited(prev)) {
+		next = prev;
+	} else {
+		lc->idle_return_time = min_wakeup_time;
+		next = &lc->idle;
+	}
+
+	if (next != prev) {
+		/* Queueable is used to cover the case when during a
+		 * context switch, the thread that is about to be
+		 * evacuated is interrupted and woken up. Different to
+		 * ukschedcoop, a thread that we put on the run queue is
+		 * not queueable: the flag tells other CPUs that the
+		 * thread is on neither queue.
+		 */
+		if (!prev_queued)
+			uk_thread_set_queueable(prev);
+		uk_thread_clear_queueable(next);
+
+		/* The context switch stores the IP last. Until then,
+		 * other CPUs must not steal `prev`.
+		 */
+		if (prev != &lc->idle)
+			prev->ctx.ip = 0;
+		lc->curr = next;
+	}
+
+	uk_spin_unlock(&lc->lock);
+	ukplat_lcpu_restore_irqf(flags);
+
+	if (prev != next) {
+		trace_uksched_switch(prev, next);
+		uk_sched_thread_switch(next);
+	}
+}
+
+static int schedws_thread_add(struct uk_sched *s, struct uk_thread *t)
+{
+	struct schedws *ws = uksched2schedws(s);
+	struct schedws_lcpu *lc;
+	bool runnable;
+
+	UK_ASSERT(t);
+	UK_ASSERT(!uk_thread_is_exited(t));
+
+	/* New threads start on the current CPU; idle siblings steal them.
+	 * Pinned threads start on the CPU they are pinned to, or stay on the
+	 * current one if that CPU is not available.
+	 */
+	lc = &ws->lcpu[ukplat_lcpu_idx()];
+	if (uk_thread_is_pinned(t) && schedws_lcpu_online(ws, t->lcpu))
+		lc = &ws->lcpu[t->lcpu];
+	t->lcpu = schedws_lcpu_idx(ws, lc);
+
+	uk_spin_lock(&lc->lock);
+	runnable = uk_thread_is_runnable(t);
+	if (runnable)
+		UK_TAILQ_INSERT_TAIL(&lc->run_queue, t, queue);
+	else
+		uk_thread_set_queueable(t);
+	uk_spin_unlock(&lc->lock);
+
+	if (runnable)
+		schedws_lcpu_kick(ws, lc);
+
+	return 0;
+}
+
+static void schedws_thread_remove(struct uk_sched *s, struct uk_thread *t)
+{
+	struct schedws *ws = uksched2schedws(s);
+	struct schedws_lcpu *lc;
+
+	lc = schedws_thread_lock(ws, t);
+	if (t != lc->curr && !uk_thread_is_queueable(t)
+	    && uk_thread_is_runnable(t))
+		UK_TAILQ_REMOVE(&lc->run_queue, t, queue);
+	else if (!uk_thread_is_runnable(t) && t->wakeup_time > 0)
+		UK_TAILQ_REMOVE(&lc->sleep_queue, t, queue);
+	uk_spin_unlock(&lc->lock);
+}
+
+static void schedws_thread_blocked(struct uk_sched *s, struct uk_thread *t)
+{
+	struct schedws *ws = uksched2schedws(s);
+	struct schedws_lcpu *lc;
+	bool sleeping;
+
+	UK_ASSERT(ukplat_lcpu_irqs_disabled());
+
+	lc = schedws_thread_lock(ws, t);
+	if (t != lc->curr && !uk_thread_is_queueable(t))
+		UK_TAILQ_REMOVE(&lc->run_queue, t, queue);
+	sleeping = (t->wakeup_time > 0);
+	if (sleeping)
+		UK_TAILQ_INSERT_TAIL(&lc->sleep_queue, t, queue);
+	uk_spin_unlock(&lc->lock);
+
+#if CONFIG_HAVE_SMP
+	/* Make LCPU 0 reconsider its timer. The store to `timer_dirty` and
+	 * the load of `halted` pair with the idle thread of LCPU 0, which
+	 * does the opposite.
+	 */
+	if (sleeping && ukplat_lcpu_idx() != 0) {
+		__lcpuidx idx = 0;
+		unsigned int num = 1;
+
+		uk_store_n(&ws->timer_dirty, 1);
+		mb();
+		if (uk_load_n(&ws->lcpu[0].halted))
+			ukplat_lcpu_wakeup(&idx, &num);
+	}
+#endif /* CONFIG_HAVE_SMP */
+}
+
+static __noreturn void idle_thread_fn(void *argp)
+{
+	struct schedws *ws = (struct schedws *) argp;
+	struct schedws_lcpu *lc;
+	__nsec now, wake_up_time;
+	unsigned long flags;
+	int rc;
+
+	UK_ASSERT(ws);
+
+	/* Secondary CPUs switch to their idle thread with IRQs disabled */
+	ukplat_lcpu_enable_irq();
+	lc = &ws->lcpu[ukplat_lcpu_idx()];
+
+	for (;;) {
+		/*
+		 * NOTE: Like in ukschedcoop, we assume that
+		 *       `uk_sched_thread_gc()` is non-blocking. It releases
+		 *       a batch of threads with interrupts enabled.
+		 */
+		if (uk_sched_thread_gc(&ws->sched) > 0) {
+			schedws_schedule(&ws->sched);
+			continue;
+		}
+
+		flags = ukplat_lcpu_save_irqf();
+
+		uk_spin_lock(&lc->lock);
+		rc = 0;
+		if (UK_TAILQ_EMPTY(&lc->run_queue))
+			rc = schedws_steal(ws, lc);
+		if (rc < 0 || !UK_TAILQ_EMPTY(&lc->run_queue)) {
+			uk_spin_unlock(&lc->lock);
+			ukplat_lcpu_restore_irqf(flags);
+			if (rc < 0)
+				ukarch_spinwait();
+			schedws_schedule(&ws->sched);
+			continue;
+		}
+#if CONFIG_LIBUKPMD
+		if (uk_pmd_lcpu_active(schedws_lcpu_idx(ws, lc))) {
+			/* Poll the device queues of this CPU instead of
+			 * halting. Without `halted`, wakers do not send IPIs
+			 * to this CPU because it sees new work on its own.
+			 */
+			uk_spin_unlock(&lc->lock);
+			ukplat_lcpu_restore_irqf(flags);
+			if (!uk_pmd_poll())
+				ukarch_spinwait();
+			schedws_schedule(&ws->sched);
+			continue;
+		}
+#endif /* CONFIG_LIBUKPMD */
+		/* Wakers check this flag after queueing under our lock */
+		uk_store_n(&lc->halted, 1);
+		uk_spin_unlock(&lc->lock);
+#if CONFIG_LIBUKRCU
+		uk_rcu_idle_enter();
+#endif /* CONFIG_LIBUKRCU */
+
+		if (lc == &ws->lcpu[0]) {
+			mb();
+			/* Read return time set by last schedule operation */
+			wake_up_time = (volatile __nsec) lc->idle_return_time;
+			now = ukplat_monotonic_clock();
+
+			if (uk_load_n(&ws->timer_dirty)) {
+				/* A secondary CPU queued a new timeout */
+			} else if (!wake_up_time || wake_up_time > now) {
+				if (wake_up_time)
+					ukplat_lcpu_halt_irq_until(wake_up_time);
+				else
+					ukplat_lcpu_halt_irq();
+			}
+		} else {
+			ukplat_lcpu_halt_irq();
+		}
+
+#if CONFIG_LIBUKRCU
+		uk_rcu_idle_exit();
+#endif /* CONFIG_LIBUKRCU */
+
+		/* handle pending events if any */
+		ukplat_lcpu_irqs_handle_pending();
+		uk_store_n(&lc->halted, 0);
+
+		ukplat_lcpu_restore_irqf(flags);
+
+		/* try to schedule a thread that might now be available */
+		schedws_schedule(&ws->sched);
+	}
+}
+
+#if CONFIG_HAVE_SMP
+static void __noreturn schedws_lcpu_entry(void)
+{
+	struct schedws *ws = schedws_instance;
+	struct schedws_lcpu *lc = &ws->lcpu[ukplat_lcpu_idx()];
+
+	/* Like the main thread on the boot CPU, `boot` only acts as
+	 * container for the current context. It is never scheduled again.
+	 */
+	uk_percpu_current(__uk_sched_thread_current) = &lc->boot;
+#if CONFIG_LIBUKRCU
+	uk_rcu_lcpu_online();
+#endif /* CONFIG_LIBUKRCU */
+	lc->ts_prev_switch = ukplat_monotonic_clock();
+	lc->curr = &lc->idle;
+
+	uk_sched_thread_switch(&lc->idle);
+	UK_CRASH("Unexpectedly returned to startup context of LCPU %u\n",
+		 (unsigned int) schedws_lcpu_idx(ws, lc));
+}
+
+#if CONFIG_LIBUKSCHEDWS_LAZY_LCPUS
+void schedws_lcpu_start_next(struct schedws *ws)
+{
+	ukplat_lcpu_entry_t entry = schedws_lcpu_entry;
+	unsigned int num = 1;
+	__lcpuidx idx;
+	void *sp;
+	int rc;
+
+	/* Claim the next secondary CPU that has not been started yet */
+	idx = uk_load_n(&ws->nr_started);
+	do {
+		if (idx >= ws->nr_lcpus)
+			return;
+	} while (!__atomic_compare_exchange_n(&ws->nr_started, &idx, idx + 1,
+					      0, __ATOMIC_ACQ_REL,
+					      __ATOMIC_RELAXED));
+
+	sp = (__u8 *) ws->lcpu[idx].boot_stack + STACK_SIZE;
+	rc = ukplat_lcpu_start(&idx, &num, &sp, &entry, 0);
+	if (unlikely(rc))
+		uk_pr_err("Failed to start LCPU %u: %d\n",
+			  (unsigned int) idx, rc);
+}
+#endif /* CONFIG_LIBUKSCHEDWS_LAZY_LCPUS */
+
+static int schedws_start_lcpus(struct schedws *ws)
+{
+	ukplat_lcpu_entry_t *entry __maybe_unused;
+	void **sp __maybe_unused;
+	unsigned int i, n;
+	int rc = -ENOMEM;
+
+	n = ws->nr_lcpus - 1;
+	if (!n)
+		return 0;
+
+	/* Boot stacks are allocated upfront also if the CPUs are started
+	 * lazily, because they may be started from interrupt context
+	 */
+	for (i = 0; i < n; i++) {
+		struct schedws_lcpu *lc = &ws->lcpu[i + 1];
+
+		lc->boot_stack = uk_malloc(ws->sched.a, STACK_SIZE);
+		if (unlikely(!lc->boot_stack))
+			goto err_free_stacks;
+	}
+
+#if CONFIG_LIBUKSCHEDWS_LAZY_LCPUS
+	/* CPUs are started one by one when there is more work than halted
+	 * CPUs to take it (see schedws_lcpu_kick())
+	 */
+	ws->nr_started = 1;
+	return 0;
+#else /* !CONFIG_LIBUKSCHEDWS_LAZY_LCPUS */
+	sp = uk_malloc(ws->sched.a, n * sizeof(*sp));
+	if (unlikely(!sp))
+		goto err_free_stacks;
+	entry = uk_malloc(ws->sched.a, n * sizeof(*entry));
+	if (unlikely(!entry))
+		goto err_free_sp;
+
+	for (i = 0; i < n; i++) {
+		sp[i] = (__u8 *) ws->lcpu[i + 1].boot_stack + STACK_SIZE;
+		entry[i] = schedws_lcpu_entry;
+	}
+
+	rc = ukplat_lcpu_start(NULL, NULL, sp, entry, 0);
+
+	uk_free(ws->sched.a, entry);
+	uk_free(ws->sched.a, sp);
+	return rc;
+
+err_free_sp:
+	uk_free(ws->sched.a, sp);
+#endif /* !CONFIG_LIBUKSCHEDWS_LAZY_LCPUS */
+err_free_stacks:
+	while (i-- > 0) {
+		uk_free(ws->sched.a, ws->lcpu[i + 1].boot_stack);
+		ws->lcpu[i + 1].boot_stack = NULL;
+	}
+	return rc;
+}
+#endif /* CONFIG_HAVE_SMP */
+
+static int schedws_start(struct uk_sched *s,
+			 struct uk_thread *main_thread __maybe_unused)
+{
+	struct schedws *ws = uksched2schedws(s);
+	struct schedws_lcpu *lc = &ws->lcpu[0];
+	int rc __maybe_unused;
+
+	UK_ASSERT(main_thread);
+	UK_ASSERT(main_thread->sched == s);
+	UK_ASSERT(uk_thread_is_runnable(main_thread));
+	UK_ASSERT(!uk_thread_is_exited(main_thread));
+	UK_ASSERT(uk_thread_current() == main_thread);
+	UK_ASSERT(ukplat_lcpu_idx() == 0);
+
+	lc->ts_prev_switch = ukplat_monotonic_clock();
+	lc->curr = main_thread;
+
+#if CONFIG_HAVE_SMP
+	/* Secondary CPUs that fail to start keep empty queues and are
+	 * never selected for work, so we can continue without them.
+	 */
+	rc = schedws_start_lcpus(ws);
+	if (unlikely(rc))
+		uk_pr_err("Failed to start secondary LCPUs: %d\n", rc);
+#endif /* CONFIG_HAVE_SMP */
+
+	ukplat_lcpu_enable_irq();
+
+	return 0;
+}
+
+static const struct uk_thread *schedws_idle_thread(struct uk_sched *s,
+						   unsigned int proc_id)
+{
+	struct schedws *ws = uksched2schedws(s);
+
+	if (proc_id >= ws->nr_lcpus)
+		return NULL;
+
+	return &ws->lcpu[proc_id].idle;
+}
+
+struct uk_sched *uk_schedws_create(struct uk_alloc *a)
+{
+	struct schedws *ws = NULL;
+	struct schedws_lcpu *lc;
+	unsigned int i;
+	int rc;
+
+	if (unlikely(schedws_instance))
+		goto err_out;
+
+	uk_pr_info("Initializing work-stealing scheduler\n");
+	ws = uk_zalloc(a, sizeof(struct schedws));
+	if (!ws)
+		goto err_out;
+
+	ws->nr_lcpus = MIN((__u32) ukplat_lcpu_count(),
+			   (__u32) CONFIG_UKPLAT_LCPU_MAXCOUNT);
+
+	/* Create one idle thread per logical CPU */
+	for (i = 0; i < ws->nr_lcpus; i++) {
+		lc = &ws->lcpu[i];
+
+		uk_spin_init(&lc->lock);
+		UK_TAILQ_INIT(&lc->run_queue);
+		UK_TAILQ_INIT(&lc->sleep_queue);
+
+		rc = uk_thread_init_fn1(&lc->idle,
+					idle_thread_fn, (void *) ws,
+					a, STACK_SIZE,
+					a, 0,  /* Default auxiliary stack size */
+					a, false,
+					NULL,
+					"idle",
+					NULL,
+					NULL);
+		if (rc < 0)
+			goto err_free_ws;
+
+		lc->idle.sched = &ws->sched;
+		lc->idle.lcpu = i;
+	}
+
+	uk_sched_init(&ws->sched,
+			schedws_start,
+			schedws_schedule,
+			schedws_thread_add,
+			schedws_thread_remove,
+			schedws_thread_blocked,
+			schedws_thread_woken_isr,
+			schedws_thread_woken_isr,
+			schedws_idle_thread,
+			a);
+
+	/* Add idle threads to the scheduler's thread list */
+	for (i = 0; i < ws->nr_lcpus; i++)
+		UK_TAILQ_INSERT_TAIL(&ws->sched.thread_list,
+				     &ws->lcpu[i].idle, thread_list);
+
+	schedws_instance = ws;
+	return &ws->sched;
+
+err_free_ws:
+	uk_free(a, ws);
+err_out:
+	return NULL;
+}
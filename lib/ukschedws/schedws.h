@@ -0,0 +1,113 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+#ifndef __UK_SCHEDWS_SCHEDWS_H__
+#define __UK_SCHEDWS_SCHEDWS_H__
+
+#include <uk/plat/lcpu.h>
+#include <uk/atomic.h>
+#include <uk/spinlock.h>
+#include <uk/schedws.h>
+
+/*
+ * Locking: every thread belongs to the logical CPU stored in `t->lcpu`.
+ * The run queue and the sleep queue of a logical CPU, as well as the
+ * scheduling state of the threads on them, are protected by the lock of
+ * that CPU. Locks are only taken with interrupts disabled. A CPU never
+ * holds two of these locks at the same time, except for stealing, where
+ * the victim's lock is only tried.
+ */
+struct schedws_lcpu {
+	uk_spinlock lock;
+	struct uk_thread_list run_queue;
+	struct uk_thread_list sleep_queue;
+
+	/* Thread that currently owns the logical CPU */
+	struct uk_thread *curr;
+	/* Set while the logical CPU is halted by its idle thread */
+	int halted;
+
+	struct uk_thread idle;
+	__nsec idle_return_time;
+	__nsec ts_prev_switch;
+
+	/* Container for the startup context of secondary CPUs */
+	struct uk_thread boot;
+	void *boot_stack;
+};
+
+struct schedws {
+	struct uk_sched sched;
+	unsigned int nr_lcpus;
+	/* Set when a sleep queue changed after LCPU 0 scanned it last */
+	int timer_dirty;
+#if CONFIG_LIBUKSCHEDWS_LAZY_LCPUS
+	/* Number of logical CPUs that have been started, including LCPU 0 */
+	__lcpuidx nr_started;
+#endif /* CONFIG_LIBUKSCHEDWS_LAZY_LCPUS */
+
+	struct schedws_lcpu lcpu[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+};
+
+static inline struct schedws *uksched2schedws(struct uk_sched *s)
+{
+	UK_ASSERT(s);
+
+	return __containerof(s, struct schedws, sched);
+}
+
+static inline __lcpuidx schedws_lcpu_idx(struct schedws *ws,
+					 struct schedws_lcpu *lc)
+{
+	return (__lcpuidx)(lc - ws->lcpu);
+}
+
+/* Tells if logical CPU `idx` has been started and runs the scheduler */
+static inline bool schedws_lcpu_online(struct schedws *ws, __lcpuidx idx)
+{
+#if CONFIG_LIBUKSCHEDWS_LAZY_LCPUS
+	return idx < uk_load_n(&ws->nr_started);
+#else /* !CONFIG_LIBUKSCHEDWS_LAZY_LCPUS */
+	return idx < ws->nr_lcpus;
+#endif /* !CONFIG_LIBUKSCHEDWS_LAZY_LCPUS */
+}
+
+/**
+ * Acquires the lock of the logical CPU that `t` belongs to. The assignment
+ * can change while we spin on the lock (stealing), so it is re-checked.
+ */
+static inline struct schedws_lcpu *schedws_thread_lock(struct schedws *ws,
+						       struct uk_thread *t)
+{
+	struct schedws_lcpu *lc;
+
+	UK_ASSERT(ukplat_lcpu_irqs_disabled());
+
+	for (;;) {
+		lc = &ws->lcpu[uk_load_n(&t->lcpu)];
+		uk_spin_lock(&lc->lock);
+		if (likely(lc == &ws->lcpu[t->lcpu]))
+			return lc;
+		uk_spin_unlock(&lc->lock);
+	}
+}
+
+/**
+ * Notifies that runnable threads were queued on `lc`: wakes up `lc` if it
+ * is halted, or a halted sibling that can steal the work otherwise.
+ */
+void schedws_lcpu_kick(struct schedws *ws, struct schedws_lcpu *lc);
+
+#if CONFIG_LIBUKSCHEDWS_LAZY_LCPUS
+/**
+ * Starts the next secondary logical CPU that has not been started yet, if
+ * any. The CPU enters its idle thread and steals work from its siblings.
+ */
+void schedws_lcpu_start_next(struct schedws *ws);
+#endif /* CONFIG_LIBUKSCHEDWS_LAZY_LCPUS */
+
+void schedws_thread_woken_isr(struct uk_sched *s, struct uk_thread *t);
+
+#endif /* __UK_SCHEDWS_SCHEDWS_H__ */
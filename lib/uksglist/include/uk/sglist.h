@@ -63,8 +63,28 @@ struct uk_sglist {
 	__atomic    sg_refs; /* Reference count for the sg list */
 	uint16_t    sg_nseg; /* Number of segment in the sg list */
 	uint16_t    sg_maxseg; /* Maximum number of segment in the sg list */
+	size_t      sg_maxsegsz; /* Maximum length of a segment, 0: no limit */
 };
 
+/**
+ * Define a scatter/gather list together with storage for `nsegs`
+ * segments, e.g., on the stack of a request path, so that no separate
+ * segment array has to be declared or allocated.
+ * @param name
+ *	Name of the sg list variable.
+ * @param nsegs
+ *	The max nr of segments.
+ */
+#define UK_SGLIST_DEFINE(name, nsegs)					\
+	struct uk_sglist_seg name##_segs[(nsegs)];			\
+	struct uk_sglist name = {					\
+		.sg_segs = name##_segs,					\
+		.sg_refs = UK_REFCOUNT_INITIALIZER(1),			\
+		.sg_nseg = 0,						\
+		.sg_maxseg = (nsegs),					\
+		.sg_maxsegsz = 0,					\
+	}
+
 /*
  * Convenience macros to save the state of an sglist so it can be restored
  * if an append attempt fails.  Since sglist's only grow we only need to
@@ -110,9 +130,26 @@ static inline void uk_sglist_init(struct uk_sglist *sg,
 	sg->sg_segs = segs;
 	sg->sg_nseg = 0;
 	sg->sg_maxseg = maxsegs;
+	sg->sg_maxsegsz = 0;
 	uk_refcount_init(&sg->sg_refs, 1);
 }
 
+/**
+ * Limit the length of the segments of the sg list. Physically contiguous
+ * ranges that are appended afterwards are split at this length instead of
+ * being merged into a single segment. Devices use this to announce their
+ * maximum descriptor size.
+ * @param sg
+ *	A reference to sg list.
+ * @param maxsegsz
+ *	The max length of a segment, 0 for no limit.
+ */
+static inline void uk_sglist_set_maxsegsz(struct uk_sglist *sg,
+					  size_t maxsegsz)
+{
+	sg->sg_maxsegsz = maxsegsz;
+}
+
 /**
  * Reset the sg list.
  * @param sg
@@ -139,7 +176,9 @@ int uk_sglist_count(void *buf, size_t len) __nonnull;
 
 /**
  * Append the segments to describe a single kernel virtual address range to a
- * scatter gather list.
+ * scatter gather list. Physically contiguous pages, also across the boundary
+ * to the last segment of the list, are merged into a single segment as long
+ * as the segment length limit of the list permits it.
  *
  * @param sg
  *	A reference to the scatter gather list.
@@ -50,37 +50,75 @@
 #include <uk/arch/paging.h>
 #include <uk/vmem.h>
 #endif /* CONFIG_LIBUKVMEM*/
+#ifdef CONFIG_PAGING
+#include <uk/plat/paging.h>
+#endif /* CONFIG_PAGING */
 
 #define page_off(x)    ((unsigned long)(x) & (__PAGE_SIZE - 1))
-#define trunc_page(x)    ((unsigned long)(x) & (__PAGE_MASK))
 
-static inline int _sglist_append_range(struct uk_sglist *sg,
-			struct uk_sglist_seg **ssp, __paddr_t paddr,
-			size_t len);
-static inline int _sglist_append_buf(struct uk_sglist *sg, void *buf,
-				size_t len, size_t *donep);
 /**
- * Append a single (paddr, len) to a sglist.  sg is the list and ss is
- * the current segment in the list.  If we run out of segments then
- * EFBIG will be returned.
+ * Translate a virtual address. `*lenp` returns the number of bytes starting
+ * at `vaddr` that are physically contiguous for sure, i.e., the remainder of
+ * the page that maps `vaddr`. With paging, this is the remainder of a large
+ * page if the address is mapped by one, so that a buffer in a large page is
+ * translated only once instead of once per base page.
+ */
+static inline __paddr_t _sglist_virt_to_phys(__vaddr_t vaddr, size_t *lenp)
+{
+#ifdef CONFIG_PAGING
+	unsigned int level = PAGE_LEVEL;
+	__pte_t pte;
+	int rc;
+
+	rc = ukplat_pt_walk(ukplat_pt_get_active(), PAGE_ALIGN_DOWN(vaddr),
+			    &level, __NULL, &pte);
+	if (likely(rc == 0 && PT_Lx_PTE_PRESENT(pte, level) &&
+		   PAGE_Lx_IS(pte, level))) {
+		*lenp = PAGE_Lx_SIZE(level) -
+			(vaddr - PAGE_Lx_ALIGN_DOWN(vaddr, level));
+		return PT_Lx_PTE_PADDR(pte, level) +
+		       (vaddr - PAGE_Lx_ALIGN_DOWN(vaddr, level));
+	}
+#endif /* CONFIG_PAGING */
+	*lenp = __PAGE_SIZE - page_off(vaddr);
+	return ukplat_virt_to_phys((void *)vaddr);
+}
+
+/**
+ * Append a single (paddr, len) to a sglist. The range is merged into the
+ * last segment if it continues it physically, and split into several
+ * segments if it exceeds the segment length limit of the list. If we run out
+ * of segments then EFBIG will be returned.
  */
 static inline int _sglist_append_range(struct uk_sglist *sg,
-			struct uk_sglist_seg **ssp, __paddr_t paddr,
-			size_t len)
+				       __paddr_t paddr, size_t len)
 {
-	struct uk_sglist_seg *ss;
+	struct uk_sglist_seg *ss = __NULL;
+	size_t seglen;
 
-	ss = *ssp;
-	if (ss->ss_paddr + ss->ss_len == paddr)
-		ss->ss_len += len;
-	else {
+	if (sg->sg_nseg > 0) {
+		ss = &sg->sg_segs[sg->sg_nseg - 1];
+		if (ss->ss_paddr + ss->ss_len == paddr) {
+			seglen = len;
+			if (sg->sg_maxsegsz)
+				seglen = MIN(len, sg->sg_maxsegsz - ss->ss_len);
+			ss->ss_len += seglen;
+			paddr += seglen;
+			len -= seglen;
+		}
+	}
+
+	while (len > 0) {
 		if (unlikely(sg->sg_nseg == sg->sg_maxseg))
 			return -EFBIG;
-		ss++;
+		seglen = len;
+		if (sg->sg_maxsegsz)
+			seglen = MIN(len, sg->sg_maxsegsz);
+		ss = &sg->sg_segs[sg->sg_nseg++];
 		ss->ss_paddr = paddr;
-		ss->ss_len = len;
-		sg->sg_nseg++;
-		*ssp = ss;
+		ss->ss_len = seglen;
+		paddr += seglen;
+		len -= seglen;
 	}
 	return 0;
 }
@@ -92,8 +130,7 @@ static inline int _sglist_append_range(struct uk_sglist *sg,
 static inline int _sglist_append_buf(struct uk_sglist *sg, void *buf,
 				size_t len, size_t *donep)
 {
-	struct uk_sglist_seg *ss;
-	__vaddr_t vaddr, offset;
+	__vaddr_t vaddr;
 	__paddr_t paddr;
 	size_t seglen;
 	int error;
@@ -104,41 +141,22 @@ static inline int _sglist_append_buf(struct uk_sglist *sg, void *buf,
 		return 0;
 
 	vaddr = (__vaddr_t)buf;
-	offset = page_off(vaddr);
 
 #ifdef CONFIG_LIBUKVMEM
 	/* Ensure the buffer is backed by physical memory */
 	error = uk_vma_advise(uk_vas_get_active(),
 			      PAGE_ALIGN_DOWN(vaddr),
-			      PAGE_ALIGN_UP(len + offset), UK_VMA_ADV_WILLNEED,
-			      UK_VMA_FLAG_UNINITIALIZED);
+			      PAGE_ALIGN_UP(len + page_off(vaddr)),
+			      UK_VMA_ADV_WILLNEED, UK_VMA_FLAG_UNINITIALIZED);
 	if (unlikely(error))
 		return error;
 #endif /* CONFIG_LIBUKVMEM */
 
-	/* Do the first page. It may have an offset. */
-	paddr = ukplat_virt_to_phys((void *)vaddr);
-	seglen = MIN(len, __PAGE_SIZE - offset);
-	if (sg->sg_nseg == 0) {
-		ss = sg->sg_segs;
-		ss->ss_paddr = paddr;
-		ss->ss_len = seglen;
-		sg->sg_nseg = 1;
-	} else {
-		ss = &sg->sg_segs[sg->sg_nseg - 1];
-		error = _sglist_append_range(sg, &ss, paddr, seglen);
-		if (error)
-			return error;
-	}
-	vaddr += seglen;
-	len -= seglen;
-	if (donep)
-		*donep += seglen;
-
+	/* Translate once per page. The first page may have an offset. */
 	while (len > 0) {
-		seglen = MIN(len, __PAGE_SIZE);
-		paddr = ukplat_virt_to_phys((void *)vaddr);
-		error = _sglist_append_range(sg, &ss, paddr, seglen);
+		paddr = _sglist_virt_to_phys(vaddr, &seglen);
+		seglen = MIN(len, seglen);
+		error = _sglist_append_range(sg, paddr, seglen);
 		if (error)
 			return error;
 		vaddr += seglen;
@@ -154,22 +172,24 @@ int uk_sglist_count(void *buf, size_t len)
 {
 	__vaddr_t vaddr, vendaddr;
 	__paddr_t lastaddr, paddr;
+	size_t seglen;
 	int nsegs;
 
 	if (len == 0)
 		return 0;
 
-	vaddr = trunc_page((__vaddr_t)buf);
-	vendaddr = (__vaddr_t)buf + len;
+	vaddr = (__vaddr_t)buf;
+	vendaddr = vaddr + len;
 	nsegs = 1;
-	lastaddr = ukplat_virt_to_phys((void *)vaddr);
-	vaddr += __PAGE_SIZE;
+	lastaddr = _sglist_virt_to_phys(vaddr, &seglen);
+	lastaddr += seglen;
+	vaddr += seglen;
 	while (vaddr < vendaddr) {
-		paddr = ukplat_virt_to_phys((void *)vaddr);
-		if (lastaddr + __PAGE_SIZE != paddr)
+		paddr = _sglist_virt_to_phys(vaddr, &seglen);
+		if (lastaddr != paddr)
 			nsegs++;
-		lastaddr = paddr;
-		vaddr += __PAGE_SIZE;
+		lastaddr = paddr + seglen;
+		vaddr += seglen;
 	}
 	return nsegs;
 }
@@ -197,7 +217,6 @@ int uk_sglist_append_sglist(struct uk_sglist *sg,
 			size_t offset, size_t length)
 {
 	struct uk_sgsave save;
-	struct uk_sglist_seg *ss;
 	size_t seglen;
 	int error, i;
 
@@ -207,7 +226,6 @@ int uk_sglist_append_sglist(struct uk_sglist *sg,
 		return -EINVAL;
 	UK_SGLIST_SAVE(sg, save);
 	error = -EINVAL;
-	ss = &sg->sg_segs[sg->sg_nseg - 1];
 	for (i = 0; i < source->sg_nseg; i++) {
 		if (offset >= source->sg_segs[i].ss_len) {
 			offset -= source->sg_segs[i].ss_len;
@@ -216,7 +234,7 @@ int uk_sglist_append_sglist(struct uk_sglist *sg,
 		seglen = source->sg_segs[i].ss_len - offset;
 		if (seglen > length)
 			seglen = length;
-		error = _sglist_append_range(sg, &ss,
+		error = _sglist_append_range(sg,
 		    source->sg_segs[i].ss_paddr + offset, seglen);
 		if (error)
 			break;
@@ -264,7 +282,9 @@ int uk_sglist_join(struct uk_sglist *first, struct uk_sglist *second)
 	flast = &first->sg_segs[first->sg_nseg - 1];
 	sfirst = &second->sg_segs[0];
 	if (first->sg_nseg != 0 &&
-	    flast->ss_paddr + flast->ss_len == sfirst->ss_paddr)
+	    flast->ss_paddr + flast->ss_len == sfirst->ss_paddr &&
+	    (!first->sg_maxsegsz ||
+	     flast->ss_len + sfirst->ss_len <= first->sg_maxsegsz))
 		append = 1;
 
 	/* Make sure 'first' has enough room. */
@@ -276,7 +296,7 @@ int uk_sglist_join(struct uk_sglist *first, struct uk_sglist *second)
 		flast->ss_len += sfirst->ss_len;
 
 	/* Append new segments from 'second' to 'first'. */
-	memmove(second->sg_segs + append, first->sg_segs + first->sg_nseg,
+	memmove(first->sg_segs + first->sg_nseg, second->sg_segs + append,
 	    (second->sg_nseg - append) * sizeof(struct uk_sglist_seg));
 	first->sg_nseg += second->sg_nseg - append;
 	uk_sglist_reset(second);
@@ -355,6 +375,7 @@ struct uk_sglist *uk_sglist_clone(struct uk_sglist *sg,
 	}
 
 	new->sg_nseg = sg->sg_nseg;
+	new->sg_maxsegsz = sg->sg_maxsegsz;
 	memmove(new->sg_segs, sg->sg_segs,
 			sizeof(struct uk_sglist_seg) * sg->sg_nseg);
 	return new;
@@ -0,0 +1,71 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __UK_UKSIGNAL_H__
+#define __UK_UKSIGNAL_H__
+
+#include <uk/arch/types.h>
+#include <uk/essentials.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Signals are numbered from 1 to UK_SIGNAL_MAX, like with Linux */
+#define UK_SIGNAL_MAX		64
+#define UK_SIGNAL_BIT(sig)	((__u64)1 << ((sig) - 1))
+
+struct uk_thread;
+struct ukarch_sysregs;
+
+/* Signals pending for the current thread, set by other threads without
+ * locks
+ */
+extern __uk_tls __u64 uk_signal_thread_pending;
+/* Signals blocked by the current thread, only changed by the thread */
+extern __uk_tls __u64 uk_signal_thread_blocked;
+/* Signals pending for the process, taken by any thread not blocking them */
+extern __u64 uk_signal_proc_pending;
+
+/**
+ * Checks whether the current thread has a signal to handle. This is the only
+ * cost of signals at system call exit while none is pending.
+ */
+static inline int uk_signal_pending(void)
+{
+	__u64 pending;
+
+	pending = __atomic_load_n(&uk_signal_thread_pending, __ATOMIC_RELAXED)
+		  | __atomic_load_n(&uk_signal_proc_pending, __ATOMIC_RELAXED);
+	return (pending & ~uk_signal_thread_blocked) != 0;
+}
+
+/**
+ * Runs the handlers of the signals pending for the current thread
+ *
+ * @param sysregs
+ *   System registers of the application, which are switched to while a
+ *   handler runs. NULL if the caller runs with the registers of the
+ *   application already.
+ */
+void uk_signal_deliver(struct ukarch_sysregs *sysregs);
+
+/**
+ * Makes a signal pending for a thread. The thread handles the signal at its
+ * next system call exit.
+ *
+ * @param thread
+ *   Target thread
+ * @param sig
+ *   Signal number
+ */
+void uk_signal_thread_raise(struct uk_thread *thread, int sig);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UK_UKSIGNAL_H__ */
@@ -38,16 +38,158 @@
 #include <signal.h>
 #include <unistd.h>
 
+#include <string.h>
+
 #include <uk/config.h>
 #include <uk/essentials.h>
+#include <uk/signal.h>
 #include <uk/syscall.h>
+#include <uk/thread.h>
+#include <uk/plat/spinlock.h>
 #ifndef __NEED_struct_timespec
 #define __NEED_struct_timespec
 #endif
 #include <sys/types.h>
+#if CONFIG_LIBPOSIX_PROCESS_PIDS
+#include <uk/process.h>
+#endif /* CONFIG_LIBPOSIX_PROCESS_PIDS */
 #include "sigset.h"
 #include "ksigaction.h"
 
+#ifndef SI_USER
+#define SI_USER		0
+#endif /* !SI_USER */
+#ifndef SI_TKILL
+#define SI_TKILL	(-6)
+#endif /* !SI_TKILL */
+
+/* Signals that can be neither caught nor blocked */
+#define UNBLOCKABLE	(UK_SIGNAL_BIT(SIGKILL) | UK_SIGNAL_BIT(SIGSTOP))
+
+__uk_tls __u64 uk_signal_thread_pending;
+__uk_tls __u64 uk_signal_thread_blocked;
+__u64 uk_signal_proc_pending;
+
+/* Handlers are shared by all threads */
+static struct k_sigaction uksignal_act[UK_SIGNAL_MAX];
+static __spinlock uksignal_act_lock = UKARCH_SPINLOCK_INITIALIZER();
+
+static inline int uksignal_valid(int sig)
+{
+	return sig > 0 && sig <= UK_SIGNAL_MAX;
+}
+
+/* Kernel signal sets are 64 bits, libc ones may be larger */
+static inline __u64 uksignal_set_load(const void *set, size_t size)
+{
+	__u64 s = 0;
+
+	memcpy(&s, set, MIN(size, sizeof(s)));
+	return s;
+}
+
+static inline void uksignal_set_store(void *set, size_t size, __u64 s)
+{
+	memset(set, 0, size);
+	memcpy(set, &s, MIN(size, sizeof(s)));
+}
+
+/* Atomically takes the lowest signal of `set` that is not blocked */
+static int uksignal_take(__u64 *set, __u64 blocked)
+{
+	__u64 pending, bit;
+
+	pending = __atomic_load_n(set, __ATOMIC_RELAXED);
+	do {
+		if (!(pending & ~blocked))
+			return 0;
+		bit = pending & ~blocked;
+		bit &= -bit;
+	} while (!__atomic_compare_exchange_n(set, &pending, pending & ~bit, 0,
+					      __ATOMIC_ACQUIRE,
+					      __ATOMIC_RELAXED));
+	return __builtin_ctzll(bit) + 1;
+}
+
+static void uksignal_handle(int sig, int code,
+			    struct ukarch_sysregs *sysregs __maybe_unused)
+{
+	struct k_sigaction act;
+	unsigned long flags;
+	__u64 blocked;
+	siginfo_t info;
+
+	ukplat_spin_lock_irqsave(&uksignal_act_lock, flags);
+	act = uksignal_act[sig - 1];
+	if (act.flags & SA_RESETHAND)
+		uksignal_act[sig - 1] = (struct k_sigaction){0};
+	ukplat_spin_unlock_irqrestore(&uksignal_act_lock, flags);
+
+	/* Default actions are not implemented, the signal is discarded */
+	if (act.handler == SIG_DFL || act.handler == SIG_IGN)
+		return;
+
+	blocked = uk_signal_thread_blocked;
+	uk_signal_thread_blocked |= uksignal_set_load(act.mask,
+						      sizeof(act.mask));
+	if (!(act.flags & SA_NODEFER))
+		uk_signal_thread_blocked |= UK_SIGNAL_BIT(sig);
+	uk_signal_thread_blocked &= ~UNBLOCKABLE;
+
+	info = (siginfo_t){0};
+	info.si_signo = sig;
+	info.si_code = code;
+
+#if CONFIG_LIBSYSCALL_SHIM
+	if (sysregs)
+		ukarch_sysregs_switch_ul(sysregs);
+#endif /* CONFIG_LIBSYSCALL_SHIM */
+
+	/* There is no user context to hand to the handler */
+	if (act.flags & SA_SIGINFO)
+		((void (*)(int, siginfo_t *, void *))(void (*)(void))
+		 act.handler)(sig, &info, NULL);
+	else
+		act.handler(sig);
+
+#if CONFIG_LIBSYSCALL_SHIM
+	if (sysregs)
+		ukarch_sysregs_switch_uk(sysregs);
+#endif /* CONFIG_LIBSYSCALL_SHIM */
+
+	uk_signal_thread_blocked = blocked;
+}
+
+void uk_signal_deliver(struct ukarch_sysregs *sysregs)
+{
+	int sig;
+
+	for (;;) {
+		sig = uksignal_take(&uk_signal_thread_pending,
+				    uk_signal_thread_blocked);
+		if (sig) {
+			uksignal_handle(sig, SI_TKILL, sysregs);
+			continue;
+		}
+
+		sig = uksignal_take(&uk_signal_proc_pending,
+				    uk_signal_thread_blocked);
+		if (!sig)
+			break;
+		uksignal_handle(sig, SI_USER, sysregs);
+	}
+}
+
+void uk_signal_thread_raise(struct uk_thread *thread, int sig)
+{
+	UK_ASSERT(thread);
+	UK_ASSERT(uksignal_valid(sig));
+
+	__atomic_fetch_or(&uk_thread_uktls_var(thread,
+					       uk_signal_thread_pending),
+			  UK_SIGNAL_BIT(sig), __ATOMIC_RELEASE);
+}
+
 UK_SYSCALL_R_DEFINE(int, sigaltstack, const stack_t *, ss,
 		    stack_t *, old_ss)
 {
@@ -55,28 +197,43 @@ UK_SYSCALL_R_DEFINE(int, sigaltstack, const stack_t *, ss,
 }
 
 UK_SYSCALL_R_DEFINE(int, rt_sigaction, int, signum,
-		    const struct k_sigaction *__unused, act,
+		    const struct k_sigaction *, act,
 		    struct k_sigaction *, oldact,
 		    size_t __unused, sigsetsize)
 {
+	unsigned long flags;
+
+	if (unlikely(!uksignal_valid(signum)))
+		return -EINVAL;
 	if (unlikely(signum == SIGKILL || signum == SIGSTOP))
 		return -EINVAL;
 
+	ukplat_spin_lock_irqsave(&uksignal_act_lock, flags);
 	if (oldact)
-		*oldact = (struct k_sigaction){0};
+		*oldact = uksignal_act[signum - 1];
+	if (act)
+		uksignal_act[signum - 1] = *act;
+	ukplat_spin_unlock_irqrestore(&uksignal_act_lock, flags);
 
 	return 0;
 }
 
 #if UK_LIBC_SYSCALLS
-int sigaction(int signum, const struct sigaction __unused *act,
+int sigaction(int signum, const struct sigaction *act,
               struct sigaction *oldact)
 {
-	/* Not actually an implementation of sigaction.
-	 * Do minimal argument matching for the stub syscall. */
 	int r;
-	struct k_sigaction kold;
-	r = rt_sigaction(signum, NULL, oldact ? &kold : NULL, sizeof(sigset_t));
+	struct k_sigaction kact, kold;
+
+	if (act) {
+		kact = (struct k_sigaction){0};
+		kact.handler = act->sa_handler;
+		kact.flags = act->sa_flags;
+		memcpy(kact.mask, &act->sa_mask,
+		       MIN(sizeof(kact.mask), sizeof(act->sa_mask)));
+	}
+	r = rt_sigaction(signum, act ? &kact : NULL, oldact ? &kold : NULL,
+			 sizeof(sigset_t));
 	if (oldact && !r) {
 		oldact->sa_handler = kold.handler;
 		oldact->sa_flags = kold.flags;
@@ -101,9 +258,13 @@ sighandler_t signal(int signum, sighandler_t handler)
 
 UK_SYSCALL_R_DEFINE(int, rt_sigpending,
 		    sigset_t *, set,
-		    size_t __unused, sigsetsize)
+		    size_t, sigsetsize)
 {
-	sigemptyset(set);
+	__u64 pending;
+
+	pending = __atomic_load_n(&uk_signal_thread_pending, __ATOMIC_RELAXED)
+		  | __atomic_load_n(&uk_signal_proc_pending, __ATOMIC_RELAXED);
+	uksignal_set_store(set, sigsetsize, pending & uk_signal_thread_blocked);
 
 	return 0;
 }
@@ -116,11 +277,38 @@ int sigpending(sigset_t *set)
 #endif /* UK_LIBC_SYSCALLS */
 
 UK_SYSCALL_R_DEFINE(int, rt_sigprocmask,
-		    int __unused, how,
-		    const sigset_t *__unused, set,
-		    sigset_t *__unused, oldset,
-		    size_t __unused, sigsetsize)
+		    int, how,
+		    const sigset_t *, set,
+		    sigset_t *, oldset,
+		    size_t, sigsetsize)
 {
+	__u64 s;
+
+	if (oldset)
+		uksignal_set_store(oldset, sigsetsize,
+				   uk_signal_thread_blocked);
+	if (!set)
+		return 0;
+
+	s = uksignal_set_load(set, sigsetsize);
+	switch (how) {
+	case SIG_BLOCK:
+		uk_signal_thread_blocked |= s;
+		break;
+	case SIG_UNBLOCK:
+		uk_signal_thread_blocked &= ~s;
+		break;
+	case SIG_SETMASK:
+		uk_signal_thread_blocked = s;
+		break;
+	default:
+		return -EINVAL;
+	}
+	uk_signal_thread_blocked &= ~UNBLOCKABLE;
+
+	/* Unblocked signals are due before sigprocmask returns */
+	if (uk_signal_pending())
+		uk_signal_deliver(NULL);
 	return 0;
 }
 
@@ -170,13 +358,58 @@ int sigwait(const sigset_t *set, int *sig)
 }
 #endif /* UK_LIBC_SYSCALLS */
 
-UK_SYSCALL_R_DEFINE(int, tkill,
-		    int __unused, tid,
-		    int __unused, sig)
+/* Makes `sig` pending for thread `tid` of process `tgid`, any process if
+ * `tgid` is -1
+ */
+static int uksignal_tgkill(pid_t tgid, pid_t tid, int sig)
 {
+	struct uk_thread *thread;
+	pid_t pid __maybe_unused;
+
+	if (unlikely(sig != 0 && !uksignal_valid(sig)))
+		return -EINVAL;
+
+#if CONFIG_LIBPOSIX_PROCESS_PIDS
+	if (tid == -1)
+		thread = uk_thread_current();
+	else
+		thread = uk_posix_process_thread_get(tid, &pid);
+	if (unlikely(!thread || (tgid != -1 && tid != -1 && pid != tgid)))
+		return -ESRCH;
+#else /* !CONFIG_LIBPOSIX_PROCESS_PIDS */
+	/* Without thread IDs, signals can only target the caller */
+	thread = uk_thread_current();
+#endif /* !CONFIG_LIBPOSIX_PROCESS_PIDS */
+
+	if (sig == 0)
+		return 0;
+
+	uk_signal_thread_raise(thread, sig);
+
+	/* Like with raise(), a signal to the caller is due before return */
+	if (thread == uk_thread_current() && uk_signal_pending())
+		uk_signal_deliver(NULL);
 	return 0;
 }
 
+UK_SYSCALL_R_DEFINE(int, tkill,
+		    int, tid,
+		    int, sig)
+{
+	return uksignal_tgkill(-1, tid, sig);
+}
+
+UK_SYSCALL_R_DEFINE(int, tgkill,
+		    int, tgid,
+		    int, tid,
+		    int, sig)
+{
+	if (unlikely(tgid <= 0 || tid <= 0))
+		return -EINVAL;
+
+	return uksignal_tgkill(tgid, tid, sig);
+}
+
 #if UK_LIBC_SYSCALLS
 int raise(int sig)
 {
@@ -186,11 +419,25 @@ int raise(int sig)
 
 UK_SYSCALL_R_DEFINE(int, kill,
 		    pid_t, pid,
-		    int __unused, sig)
+		    int, sig)
 {
+#if CONFIG_LIBPOSIX_PROCESS_PIDS
+	if (unlikely(pid != 0 && pid != uk_syscall_r_getpid()))
+		return -ESRCH;
+#else /* !CONFIG_LIBPOSIX_PROCESS_PIDS */
 	if (unlikely(pid != 0))
 		return -ESRCH;
+#endif /* !CONFIG_LIBPOSIX_PROCESS_PIDS */
+	if (unlikely(sig != 0 && !uksignal_valid(sig)))
+		return -EINVAL;
+
+	if (sig == 0)
+		return 0;
 
+	__atomic_fetch_or(&uk_signal_proc_pending, UK_SIGNAL_BIT(sig),
+			  __ATOMIC_RELEASE);
+	if (uk_signal_pending())
+		uk_signal_deliver(NULL);
 	return 0;
 }
 
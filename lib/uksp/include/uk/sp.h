@@ -37,6 +37,10 @@
 #include <uk/swrand.h>
 #endif
 #include <uk/config.h>
+#if CONFIG_LIBUKSP_TLS
+#include <uk/arch/types.h>
+#include <uk/plat/tls.h>
+#endif /* CONFIG_LIBUKSP_TLS */
 
 #ifdef __cplusplus
 extern "C" {
@@ -44,6 +48,37 @@ extern "C" {
 
 extern const unsigned long __stack_chk_guard;
 
+#if CONFIG_LIBUKSP_TLS
+/*
+ * Offset of the canary from the TLS pointer. The compiler is told the same
+ * offset with -mstack-protector-guard-offset, see Makefile.uk.
+ */
+#if defined(__X86_64__)
+/* Like on Linux, %fs:0x28 */
+#define UK_SP_TLS_GUARD_OFFSET	0x28
+#elif defined(__ARM_64__)
+/* Second word of the 16 bytes that the ABI reserves at tpidr_el0 */
+#define UK_SP_TLS_GUARD_OFFSET	0x8
+#endif
+
+/* Used as TLS by code that runs before the boot thread has one */
+extern unsigned long uk_sp_boot_tcb[];
+
+/* Set once the canaries of new threads are random */
+extern int uk_sp_tls_random;
+
+static inline unsigned long *uk_sp_tls_guard_ptr(__uptr tlsp)
+{
+	return (unsigned long *)(tlsp + UK_SP_TLS_GUARD_OFFSET);
+}
+
+/**
+ * Returns the canary for a new TLS area. If the canary is random, each call
+ * returns a new value.
+ */
+unsigned long uk_sp_tls_guard(void);
+#endif /* CONFIG_LIBUKSP_TLS */
+
 /*
  * Note: This function must always be inlined and may only be called from
  * a function that never returns.
@@ -58,6 +93,10 @@ static inline void uk_stack_chk_guard_setup(void)
 	guard &= ~0xFFul; /* Use least significant byte as null terminator */
 
 	(*DECONST(unsigned long *, &__stack_chk_guard)) = guard;
+#if CONFIG_LIBUKSP_TLS && !CONFIG_UKARCH_TLS_HAVE_TCB
+	*uk_sp_tls_guard_ptr(ukplat_tlsp_get()) = guard;
+	uk_sp_tls_random = 1;
+#endif /* CONFIG_LIBUKSP_TLS && !CONFIG_UKARCH_TLS_HAVE_TCB */
 #endif
 }
 
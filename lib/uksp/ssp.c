@@ -35,13 +35,40 @@
 #include <uk/assert.h>
 #include <uk/config.h>
 #include <uk/ctors.h>
+#include <uk/sp.h>
 
 #ifdef CONFIG_LIBUKSP_VALUE_USECONSTANT
-const unsigned long __stack_chk_guard = CONFIG_LIBUKSP_VALUE_CONSTANT;
+#define UK_SP_GUARD_INIT CONFIG_LIBUKSP_VALUE_CONSTANT
 #else
-const unsigned long __stack_chk_guard = 0xFF0A0D00; /* terminator canary */
+#define UK_SP_GUARD_INIT 0xFF0A0D00 /* terminator canary */
 #endif
 
+const unsigned long __stack_chk_guard = UK_SP_GUARD_INIT;
+
+#if CONFIG_LIBUKSP_TLS
+#define UK_SP_BOOT_TCB_GUARD (UK_SP_TLS_GUARD_OFFSET / sizeof(unsigned long))
+
+unsigned long uk_sp_boot_tcb[UK_SP_BOOT_TCB_GUARD + 1] = {
+	[UK_SP_BOOT_TCB_GUARD] = UK_SP_GUARD_INIT,
+};
+
+int uk_sp_tls_random;
+
+unsigned long uk_sp_tls_guard(void)
+{
+#ifdef CONFIG_LIBUKSP_VALUE_RANDOM
+	unsigned long guard;
+
+	/* Threads created during boot run before swrand is initialized */
+	if (uk_sp_tls_random) {
+		uk_swrand_fill_buffer(&guard, sizeof(guard));
+		return guard & ~0xFFul;
+	}
+#endif /* CONFIG_LIBUKSP_VALUE_RANDOM */
+	return __stack_chk_guard;
+}
+#endif /* CONFIG_LIBUKSP_TLS */
+
 __attribute__((noreturn))
 void __stack_chk_fail(void)
 {
@@ -48,13 +48,15 @@
 #include <uk/arch/types.h>
 #include <uk/essentials.h>
 #include <uk/list.h>
+#include <uk/plat/lcpu.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 /* All basic types that exist - use these when interacting with the API.
- * The list of types is: s8, u8, s16, u16, s32, u32, s64, u64, uptr, charp
+ * The list of types is: s8, u8, s16, u16, s32, u32, s64, u64, uptr, charp,
+ * counter
  */
 enum uk_store_entry_type {
 	_LIB_UK_STORE_ENTRY_TYPE___undef = 0,
@@ -67,13 +69,53 @@ enum uk_store_entry_type {
 	_LIB_UK_STORE_ENTRY_TYPE___s64,
 	_LIB_UK_STORE_ENTRY_TYPE___u64,
 	_LIB_UK_STORE_ENTRY_TYPE___uptr,
-	_LIB_UK_STORE_ENTRY_TYPE___charp
+	_LIB_UK_STORE_ENTRY_TYPE___charp,
+	_LIB_UK_STORE_ENTRY_TYPE___counter
 };
 
 /* Transforms a simple data type to a ukstore specific one */
 #define UK_STORE_ENTRY_TYPE(simple_type)	\
 	(_LIB_UK_STORE_ENTRY_TYPE___ ## simple_type)
 
+/*
+ * Per-lcpu counter, e.g., for statistics that are updated on the data path.
+ * An update only touches the cache line of the current lcpu, a read sums up
+ * all lcpus. An entry of type `counter` points to the counter instead of a
+ * getter function and is read-only. It can be read as any integer type.
+ */
+struct uk_store_counter {
+	struct __align64 {
+		__u64 n;
+	} lcpu[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+};
+
+/**
+ * Adds `n` to a counter. May be called from interrupt context.
+ */
+static inline void uk_store_counter_add(struct uk_store_counter *c, __u64 n)
+{
+	__atomic_fetch_add(&c->lcpu[ukplat_lcpu_idx()].n, n,
+			   __ATOMIC_RELAXED);
+}
+
+#define uk_store_counter_inc(c) \
+	uk_store_counter_add((c), 1)
+
+/**
+ * Returns the sum of a counter over all lcpus. Concurrent updates may or
+ * may not be included.
+ */
+static inline __u64 uk_store_counter_read(const struct uk_store_counter *c)
+{
+	__u64 sum = 0;
+	unsigned int i;
+
+	for (i = 0; i < CONFIG_UKPLAT_LCPU_MAXCOUNT; i++)
+		sum += __atomic_load_n(&c->lcpu[i].n, __ATOMIC_RELAXED);
+
+	return sum;
+}
+
 /* Getter definitions */
 typedef int (*uk_store_get_s8_func_t)(void *, __s8 *);
 typedef int (*uk_store_get_u8_func_t)(void *, __u8 *);
@@ -85,6 +127,8 @@ typedef int (*uk_store_get_s64_func_t)(void *, __s64 *);
 typedef int (*uk_store_get_u64_func_t)(void *, __u64 *);
 typedef int (*uk_store_get_uptr_func_t)(void *, __uptr *);
 typedef int (*uk_store_get_charp_func_t)(void *, char **);
+/* Counters are read directly, without a getter */
+typedef const struct uk_store_counter *uk_store_get_counter_func_t;
 
 /* Setter definitions */
 typedef int (*uk_store_set_s8_func_t)(void *, __s8);
@@ -97,6 +141,8 @@ typedef int (*uk_store_set_s64_func_t)(void *, __s64);
 typedef int (*uk_store_set_u64_func_t)(void *, __u64);
 typedef int (*uk_store_set_uptr_func_t)(void *, __uptr);
 typedef int (*uk_store_set_charp_func_t)(void *, const char *);
+/* Counters are read-only, the setter must be NULL */
+typedef const void *uk_store_set_counter_func_t;
 
 struct uk_store_entry {
 	/* Function getter pointer */
@@ -111,6 +157,7 @@ struct uk_store_entry {
 		uk_store_get_u64_func_t    u64;
 		uk_store_get_uptr_func_t   uptr;
 		uk_store_get_charp_func_t  charp;
+		uk_store_get_counter_func_t counter;
 	} get;
 
 	/* Function setter pointer */
@@ -125,6 +172,7 @@ struct uk_store_entry {
 		uk_store_set_u64_func_t   u64;
 		uk_store_set_uptr_func_t  uptr;
 		uk_store_set_charp_func_t charp;
+		uk_store_set_counter_func_t counter;
 	} set;
 
 	/* Entry unique id */
@@ -235,8 +283,8 @@ struct uk_store_event_data {
  *
  * @_id   entry id
  * @_name entry name (without quotes)
- * @_type entry type, e.g s8, u16, charp
- * @get   getter function
+ * @_type entry type, e.g s8, u16, charp, counter
+ * @get   getter function, or pointer to the counter
  * @set   setter function
  */
 #define UK_STORE_ENTRY(_id, _name, _type, _get, _set)		\
@@ -301,7 +349,9 @@ _uk_store_obj_add(__u16 library_id, struct uk_store_object *object);
 /**
  * Acquires an object
  *
- * Increments the object's refcount and returns the object.
+ * Increments the object's refcount and returns the object. The lookup does
+ * not take a lock, so it can be called at a high rate, e.g., by monitoring
+ * agents, without contending with the producers.
  * Evern call must be paired with a call to uk_store_release_object()
  * to decrement the refcount.
  *
@@ -341,6 +391,31 @@ uk_store_static_entry_get(__u16 library_id, __u64 entry_id);
 const struct uk_store_entry *
 uk_store_obj_entry_get(struct uk_store_object *object_id, __u64 entry_id);
 
+/**
+ * Function called for every entry by uk_store_foreach_entry()
+ *
+ * @param library_id owner library id as returned by uklibid
+ * @param object     the object of the entry, or NULL for static entries
+ * @param entry      the entry
+ * @param arg        the argument passed to uk_store_foreach_entry()
+ * @return           0 to continue, anything else stops the iteration
+ */
+typedef int (*uk_store_foreach_func_t)(__u16 library_id,
+				       struct uk_store_object *object,
+				       const struct uk_store_entry *entry,
+				       void *arg);
+
+/**
+ * Calls a function for the static entries and the entries of the dynamic
+ * objects of all libraries. Objects are not acquired; they cannot be freed
+ * until the iteration returns, so `fn` must not release objects.
+ *
+ * @param fn  function to call for every entry
+ * @param arg argument passed to `fn`
+ * @return    0, or the first non-zero return value of `fn`
+ */
+int uk_store_foreach_entry(uk_store_foreach_func_t fn, void *arg);
+
 /**
  * Calls the getter to get it's value.
  * The caller is responsible for freeing the returned value if it is a charp.
@@ -0,0 +1,103 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __UK_STORE_SHM_H__
+#define __UK_STORE_SHM_H__
+
+#include <uk/arch/types.h>
+#include <uk/essentials.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Binary layout of uk_store entries exported to shared memory, e.g., an
+ * ivshmem region that is mapped by an agent on the host. The layout is
+ * little-endian and only changes together with UK_STORE_SHM_VERSION. New
+ * fields are only ever added into the reserved space, so readers must
+ * ignore fields they do not know.
+ *
+ * The region starts with a header that is followed by an array of
+ * `capacity` entries, of which the first `count` are valid. The guest
+ * rewrites the entries periodically. While it does, `seq` is odd. Readers
+ * copy the region and retry if `seq` was odd or changed meanwhile.
+ */
+
+/* "UKST" */
+#define UK_STORE_SHM_MAGIC		0x54534b55
+#define UK_STORE_SHM_VERSION		1
+
+struct uk_store_shm_hdr {
+	/* UK_STORE_SHM_MAGIC */
+	__u32 magic;
+	/* UK_STORE_SHM_VERSION */
+	__u16 version;
+	/* Size of an entry in bytes */
+	__u16 entry_size;
+	/* Sequence counter, odd while the entries are updated */
+	__u32 seq;
+	/* Number of valid entries */
+	__u32 count;
+	/* Number of entries that fit into the region */
+	__u32 capacity;
+	/* Number of entries that did not fit into the region */
+	__u32 dropped;
+	/* Monotonic time of the last update (ns) */
+	__u64 updated;
+	__u8 reserved[32];
+};
+
+#define UK_STORE_SHM_NAME_LEN		48
+
+/* The value is unsigned */
+#define UK_STORE_SHM_TYPE_U64		1
+/* The value is signed */
+#define UK_STORE_SHM_TYPE_S64		2
+
+/* The getter failed, the value is invalid */
+#define UK_STORE_SHM_F_ERROR		(1 << 0)
+
+struct uk_store_shm_entry {
+	/* "library/entry" or "library/object/entry", NUL-terminated and
+	 * truncated to fit
+	 */
+	char name[UK_STORE_SHM_NAME_LEN];
+	/* UK_STORE_SHM_TYPE_* */
+	__u16 type;
+	/* UK_STORE_SHM_F_* */
+	__u16 flags;
+	__u32 reserved;
+	__u64 value;
+};
+
+UK_CTASSERT(sizeof(struct uk_store_shm_hdr) == 64);
+UK_CTASSERT(sizeof(struct uk_store_shm_entry) == 64);
+
+/**
+ * Initializes the header of an export region. The region does not contain
+ * entries until uk_store_shm_update() is called.
+ *
+ * @param base start of the region, 8-byte aligned
+ * @param len  size of the region in bytes
+ * @return     0 on success, -EINVAL if the region is too small
+ */
+int uk_store_shm_init(void *base, __sz len);
+
+/**
+ * Rewrites the entries of an export region with the current values of all
+ * numeric uk_store entries. Entries of the charp type are not exported.
+ * Must not be called concurrently for the same region.
+ *
+ * @param base start of the region initialized by uk_store_shm_init()
+ */
+void uk_store_shm_update(void *base);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UK_STORE_SHM_H__ */
@@ -0,0 +1,140 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <uk/arch/limits.h>
+#include <uk/assert.h>
+#include <uk/essentials.h>
+#include <uk/libid.h>
+#include <uk/plat/time.h>
+#include <uk/store.h>
+#include <uk/store_shm.h>
+
+struct shm_update {
+	struct uk_store_shm_entry *entries;
+	__u32 capacity;
+	__u32 count;
+	__u32 dropped;
+};
+
+/* The region may be mapped as device memory, which does not tolerate the
+ * unaligned accesses of an optimized memcpy(). Copy in aligned words.
+ */
+static void shm_entry_write(struct uk_store_shm_entry *dst,
+			    const struct uk_store_shm_entry *src)
+{
+	volatile __u64 *d = (volatile __u64 *)dst;
+	const __u64 *s = (const __u64 *)src;
+	__sz i;
+
+	for (i = 0; i < sizeof(*src) / sizeof(__u64); i++)
+		d[i] = s[i];
+}
+
+static int shm_export_entry(__u16 libid, struct uk_store_object *obj,
+			    const struct uk_store_entry *e, void *arg)
+{
+	struct shm_update *u = (struct shm_update *)arg;
+	struct uk_store_shm_entry ent = { 0 };
+	const char *libname;
+	__u64 uval;
+	__s64 sval;
+	int rc;
+
+	if (e->type == UK_STORE_ENTRY_TYPE(charp))
+		return 0;
+	if (unlikely(u->count >= u->capacity)) {
+		u->dropped++;
+		return 0;
+	}
+
+	switch (e->type) {
+	case UK_STORE_ENTRY_TYPE(s8):
+	case UK_STORE_ENTRY_TYPE(s16):
+	case UK_STORE_ENTRY_TYPE(s32):
+	case UK_STORE_ENTRY_TYPE(s64):
+		ent.type = UK_STORE_SHM_TYPE_S64;
+		rc = uk_store_get_value(e, s64, &sval);
+		ent.value = (__u64)sval;
+		break;
+	default:
+		ent.type = UK_STORE_SHM_TYPE_U64;
+		rc = uk_store_get_value(e, u64, &uval);
+		ent.value = uval;
+		break;
+	}
+	if (unlikely(rc < 0)) {
+		ent.flags = UK_STORE_SHM_F_ERROR;
+		ent.value = 0;
+	}
+
+	libname = uk_libname(libid);
+	if (obj)
+		snprintf(ent.name, sizeof(ent.name), "%s/%s/%s",
+			 libname ? libname : "?", obj->name, e->name);
+	else
+		snprintf(ent.name, sizeof(ent.name), "%s/%s",
+			 libname ? libname : "?", e->name);
+
+	shm_entry_write(&u->entries[u->count++], &ent);
+	return 0;
+}
+
+int uk_store_shm_init(void *base, __sz len)
+{
+	struct uk_store_shm_hdr *hdr = (struct uk_store_shm_hdr *)base;
+	__sz capacity;
+	__sz i;
+
+	UK_ASSERT(base);
+
+	if (unlikely(len < sizeof(*hdr) + sizeof(struct uk_store_shm_entry)))
+		return -EINVAL;
+
+	capacity = (len - sizeof(*hdr)) / sizeof(struct uk_store_shm_entry);
+
+	hdr->version = UK_STORE_SHM_VERSION;
+	hdr->entry_size = sizeof(struct uk_store_shm_entry);
+	hdr->seq = 0;
+	hdr->count = 0;
+	hdr->capacity = (__u32)MIN(capacity, (__sz)__U32_MAX);
+	hdr->dropped = 0;
+	hdr->updated = 0;
+	for (i = 0; i < sizeof(hdr->reserved); i++)
+		hdr->reserved[i] = 0;
+
+	/* Readers check the magic before anything else */
+	__atomic_store_n(&hdr->magic, UK_STORE_SHM_MAGIC, __ATOMIC_RELEASE);
+	return 0;
+}
+
+void uk_store_shm_update(void *base)
+{
+	struct uk_store_shm_hdr *hdr = (struct uk_store_shm_hdr *)base;
+	struct shm_update u;
+	__u32 seq;
+
+	UK_ASSERT(hdr);
+	UK_ASSERT(hdr->magic == UK_STORE_SHM_MAGIC);
+
+	u.entries = (struct uk_store_shm_entry *)(hdr + 1);
+	u.capacity = hdr->capacity;
+	u.count = 0;
+	u.dropped = 0;
+
+	/* Readers must see the odd sequence before any entry changes */
+	seq = hdr->seq;
+	__atomic_store_n(&hdr->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	uk_store_foreach_entry(shm_export_entry, &u);
+
+	hdr->count = u.count;
+	hdr->dropped = u.dropped;
+	hdr->updated = ukplat_monotonic_clock();
+	__atomic_store_n(&hdr->seq, seq + 2, __ATOMIC_RELEASE);
+}
@@ -36,6 +36,8 @@
 #include <uk/arch/types.h>
 #include <uk/errptr.h>
 #include <uk/event.h>
+#include <uk/mutex.h>
+#include <uk/sched.h>
 #include <uk/refcount.h>
 #include <uk/spinlock.h>
 #include <uk/store.h>
@@ -67,7 +69,22 @@ struct uk_store_object_entry {
 
 /* The starting point of all dynamic objects for each library */
 static struct uk_list_head dynamic_heads[__UKLIBID_COUNT__] = { NULL, };
-static __spinlock dynamic_heads_lock = UK_SPINLOCK_INITIALIZER();
+
+/*
+ * Objects are looked up far more often than they are added or removed, so
+ * lookups do not take a lock (RCU-style). Writers serialize on
+ * `dynamic_heads_lock` and publish list updates with release stores, which
+ * readers pair with acquire loads. Readers count themselves per lcpu in the
+ * current epoch. A writer that unlinked an object waits until the readers of
+ * both epochs left before freeing it. It flips the epoch before each wait,
+ * so that new readers cannot delay it.
+ */
+static struct uk_mutex dynamic_heads_lock =
+	UK_MUTEX_INITIALIZER(dynamic_heads_lock);
+static struct __align64 {
+	long n[2];
+} dynamic_readers[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+static unsigned int dynamic_epoch;
 
 #include <uk/bits/store_array.h>
 
@@ -121,6 +138,7 @@ _UK_STORE_DYNAMIC_CREATE_TYPED(u64);
 _UK_STORE_DYNAMIC_CREATE_TYPED(s64);
 _UK_STORE_DYNAMIC_CREATE_TYPED(uptr);
 _UK_STORE_DYNAMIC_CREATE_TYPED(charp);
+_UK_STORE_DYNAMIC_CREATE_TYPED(counter);
 
 /* Capital types used internally */
 #define S8  __do_not_expand__
@@ -172,17 +190,96 @@ static void free_object(struct uk_store_object *object)
 		entry = &iter->entry;
 		release_entry(entry);
 	}
+	object->a->free(object->a, object);
+}
+
+static unsigned int dynamic_read_lock(void)
+{
+	unsigned int epoch;
+
+	/* Pairs with the writer flipping the epoch before summing up the
+	 * counters: either the writer sees our increment, or we see the
+	 * lists as they are after the writer's update
+	 */
+	epoch = __atomic_load_n(&dynamic_epoch, __ATOMIC_SEQ_CST) & 1;
+	__atomic_add_fetch(&dynamic_readers[ukplat_lcpu_idx()].n[epoch], 1,
+			   __ATOMIC_SEQ_CST);
+	return epoch;
+}
+
+static void dynamic_read_unlock(unsigned int epoch)
+{
+	/* The reader may have been migrated, only the sum is meaningful */
+	__atomic_sub_fetch(&dynamic_readers[ukplat_lcpu_idx()].n[epoch], 1,
+			   __ATOMIC_SEQ_CST);
+}
+
+/* Must be called with `dynamic_heads_lock` held */
+static void dynamic_synchronize(void)
+{
+	unsigned int epoch, i, j;
+	long n;
+
+	for (j = 0; j < 2; j++) {
+		epoch = __atomic_fetch_add(&dynamic_epoch, 1,
+					   __ATOMIC_SEQ_CST) & 1;
+		for (;;) {
+			n = 0;
+			for (i = 0; i < CONFIG_UKPLAT_LCPU_MAXCOUNT; i++)
+				n += __atomic_load_n(
+					&dynamic_readers[i].n[epoch],
+					__ATOMIC_SEQ_CST);
+			if (!n)
+				break;
+			/* Lookups are short, but the reader may have been
+			 * preempted on this lcpu
+			 */
+			uk_sched_yield();
+		}
+	}
 }
 
+/* Must be called with `dynamic_heads_lock` held */
+static void dynamic_publish(struct uk_list_head *head,
+			    struct uk_store_object *obj)
+{
+	struct uk_list_head *e = &obj->object_head;
+
+	e->next = head->next;
+	e->prev = head;
+	head->next->prev = e;
+	__atomic_store_n(&head->next, e, __ATOMIC_RELEASE);
+}
+
+/* Must be called with `dynamic_heads_lock` held. The object stays
+ * reachable for concurrent readers until dynamic_synchronize() returns.
+ */
+static void dynamic_unlink(struct uk_store_object *obj)
+{
+	struct uk_list_head *e = &obj->object_head;
+
+	e->next->prev = e->prev;
+	__atomic_store_n(&e->prev->next, e->next, __ATOMIC_RELEASE);
+}
+
+/* Must be called between dynamic_read_lock() and dynamic_read_unlock() */
 static struct uk_store_object *get_obj_by_id(unsigned int lib_id, __u64 obj_id)
 {
-	struct uk_store_object *obj = NULL;
+	struct uk_list_head *head = &dynamic_heads[lib_id];
+	struct uk_list_head *pos;
+	struct uk_store_object *obj;
 
-	uk_list_for_each_entry(obj, &dynamic_heads[lib_id], object_head)
-		if (obj->id == obj_id)
-			break;
+	for (pos = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+	     pos && pos != head;
+	     pos = __atomic_load_n(&pos->next, __ATOMIC_ACQUIRE)) {
+		obj = uk_list_entry(pos, struct uk_store_object, object_head);
+		/* Skip objects whose last reference is being dropped */
+		if (obj->id == obj_id &&
+		    uk_refcount_acquire_if_not_zero(&obj->refcount))
+			return obj;
+	}
 
-	return obj;
+	return NULL;
 }
 
 struct uk_store_object *
@@ -290,6 +387,13 @@ uk_store_obj_alloc(struct uk_alloc *a, __u64 id, const char *name,
 							     e->get.charp,
 							     e->set.charp);
 			break;
+		case UK_STORE_ENTRY_TYPE(counter):
+			_uk_store_create_dynamic_entry_counter(new_object,
+							       e->id,
+							       e->name,
+							       e->get.counter,
+							       e->set.counter);
+			break;
 		default:
 			return ERR2PTR(EINVAL);
 		};
@@ -304,11 +408,14 @@ int _uk_store_obj_add(__u16 library_id, struct uk_store_object *object)
 
 	UK_ASSERT(object);
 
-	if (!dynamic_heads[library_id].next)
-		UK_INIT_LIST_HEAD(&dynamic_heads[library_id]);
-
 	object->libid = library_id;
-	uk_list_add(&object->object_head, &dynamic_heads[library_id]);
+	uk_mutex_lock(&dynamic_heads_lock);
+	if (!dynamic_heads[library_id].next) {
+		dynamic_heads[library_id].prev = &dynamic_heads[library_id];
+		dynamic_heads[library_id].next = &dynamic_heads[library_id];
+	}
+	dynamic_publish(&dynamic_heads[library_id], object);
+	uk_mutex_unlock(&dynamic_heads_lock);
 
 	/* Notify consumers */
 	event_data = (struct uk_store_event_data) {
@@ -323,41 +430,33 @@ int _uk_store_obj_add(__u16 library_id, struct uk_store_object *object)
 
 struct uk_store_object *uk_store_obj_acquire(__u16 library_id, __u64 object_id)
 {
-	struct uk_store_object *obj = NULL;
-
-	if (!dynamic_heads[library_id].next)
-		return NULL;
-
-	uk_spin_lock(&dynamic_heads_lock);
+	struct uk_store_object *obj;
+	unsigned int epoch;
 
+	epoch = dynamic_read_lock();
 	obj = get_obj_by_id(library_id, object_id);
-	if (unlikely(!obj))
-		goto out;
-
-	uk_refcount_acquire(&obj->refcount);
-out:
-	uk_spin_unlock(&dynamic_heads_lock);
+	dynamic_read_unlock(epoch);
 
 	return obj;
 }
 
 void uk_store_obj_release(struct uk_store_object *object)
 {
-	int res;
-
 	UK_ASSERT(object);
 
 	if (!dynamic_heads[object->libid].next)
 		return;
 
-	uk_spin_lock(&dynamic_heads_lock);
+	/* Lookups do not take references of objects at zero anymore */
+	if (!uk_refcount_release(&object->refcount))
+		return;
+
+	uk_mutex_lock(&dynamic_heads_lock);
+	dynamic_unlink(object);
+	dynamic_synchronize();
+	uk_mutex_unlock(&dynamic_heads_lock);
 
-	res = uk_refcount_release_if_not_last(&object->refcount);
-	if (!res) {
-		uk_list_del(&(object->object_head));
-		free_object(object);
-	}
-	uk_spin_unlock(&dynamic_heads_lock);
+	free_object(object);
 }
 
 const struct uk_store_entry *uk_store_static_entry_get(__u16 libid,
@@ -373,6 +472,49 @@ const struct uk_store_entry *uk_store_static_entry_get(__u16 libid,
 	return NULL;
 }
 
+int uk_store_foreach_entry(uk_store_foreach_func_t fn, void *arg)
+{
+	struct uk_store_object_entry *oe;
+	struct uk_store_object *obj;
+	struct uk_store_entry *entry;
+	struct uk_list_head *head, *pos;
+	unsigned int epoch;
+	__u16 libid;
+	int rc = 0;
+
+	UK_ASSERT(fn);
+
+	for (libid = 0; libid < __UKLIBID_COUNT__; libid++) {
+		for (entry = static_entries[2 * libid];
+		     entry != static_entries[2 * libid + 1]; ++entry) {
+			rc = fn(libid, NULL, entry, arg);
+			if (rc)
+				return rc;
+		}
+	}
+
+	/* Objects are only freed after the readers of the epoch left */
+	epoch = dynamic_read_lock();
+	for (libid = 0; libid < __UKLIBID_COUNT__; libid++) {
+		head = &dynamic_heads[libid];
+		for (pos = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+		     pos && pos != head;
+		     pos = __atomic_load_n(&pos->next, __ATOMIC_ACQUIRE)) {
+			obj = uk_list_entry(pos, struct uk_store_object,
+					    object_head);
+			uk_list_for_each_entry(oe, &obj->entry_head,
+					       list_head) {
+				rc = fn(libid, obj, &oe->entry, arg);
+				if (rc)
+					goto out;
+			}
+		}
+	}
+out:
+	dynamic_read_unlock(epoch);
+	return rc;
+}
+
 const struct uk_store_entry *
 uk_store_obj_entry_get(struct uk_store_object *object, __u64 entry_id)
 {
@@ -1030,6 +1172,20 @@ _uk_store_set_charp(const struct uk_store_entry *e, const char *val)
 		}							\
 	} while (0)
 
+/* Per-lcpu counter, summed up on read */
+#define GETCASE_COUNTER(entry, PTYPE, var, eparam)			\
+	do {								\
+		case UK_STORE_ENTRY_TYPE(counter): {			\
+			__u64 val;					\
+									\
+			val = uk_store_counter_read((entry)->get.counter);\
+			if (unlikely(val > (__u64)__ ## PTYPE ## _MAX))	\
+				return -ERANGE;				\
+			*(var)  = (__ ## eparam) val;			\
+			return 0;					\
+		}							\
+	} while (0)
+
 /**
  * All getters below use this description.
  * Gets a new value using the save getter and checks the ranges of the values.
@@ -1062,6 +1218,7 @@ _uk_store_get_u8(const struct uk_store_entry *e, __u8 *out)
 	GETCASE_DOWNCASTUU(e, u64, U8, out, u8, cookie);
 	GETCASE_DOWNCASTSU(e, s64, U8, out, u8, cookie);
 	GETCASE_DOWNCASTUU(e, uptr, U8, out, u8, cookie);
+	GETCASE_COUNTER(e, U8, out, u8);
 
 	case UK_STORE_ENTRY_TYPE(charp): {
 		char *val = NULL;
@@ -1106,6 +1263,7 @@ _uk_store_get_s8(const struct uk_store_entry *e, __s8 *out)
 	GETCASE_DOWNCASTUS(e, u64, S8, out, s8, cookie);
 	GETCASE_DOWNCASTSS(e, s64, S8, out, s8, cookie);
 	GETCASE_DOWNCASTUS(e, uptr, S8, out, s8, cookie);
+	GETCASE_COUNTER(e, S8, out, s8);
 
 	case UK_STORE_ENTRY_TYPE(charp): {
 		char *val = NULL;
@@ -1150,6 +1308,7 @@ _uk_store_get_u16(const struct uk_store_entry *e, __u16 *out)
 	GETCASE_DOWNCASTUU(e, u64, U16, out, u16, cookie);
 	GETCASE_DOWNCASTSU(e, s64, U16, out, u16, cookie);
 	GETCASE_DOWNCASTUU(e, uptr, U16, out, u16, cookie);
+	GETCASE_COUNTER(e, U16, out, u16);
 
 	case UK_STORE_ENTRY_TYPE(charp): {
 		char *val = NULL;
@@ -1194,6 +1353,7 @@ _uk_store_get_s16(const struct uk_store_entry *e, __s16 *out)
 	GETCASE_DOWNCASTUS(e, u64, S16, out, s16, cookie);
 	GETCASE_DOWNCASTSS(e, s64, S16, out, s16, cookie);
 	GETCASE_DOWNCASTUS(e, uptr, S16, out, s16, cookie);
+	GETCASE_COUNTER(e, S16, out, s16);
 
 	case UK_STORE_ENTRY_TYPE(charp): {
 		char *val = NULL;
@@ -1238,6 +1398,7 @@ _uk_store_get_u32(const struct uk_store_entry *e, __u32 *out)
 	GETCASE_DOWNCASTUU(e, u64, U32, out, u32, cookie);
 	GETCASE_DOWNCASTSU(e, s64, U32, out, u32, cookie);
 	GETCASE_DOWNCASTUU(e, uptr, U32, out, u32, cookie);
+	GETCASE_COUNTER(e, U32, out, u32);
 
 	case UK_STORE_ENTRY_TYPE(charp): {
 		char *val = NULL;
@@ -1282,6 +1443,7 @@ _uk_store_get_s32(const struct uk_store_entry *e, __s32 *out)
 	GETCASE_DOWNCASTUS(e, u64, S32, out, s32, cookie);
 	GETCASE_DOWNCASTSS(e, s64, S32, out, s32, cookie);
 	GETCASE_DOWNCASTUS(e, uptr, S32, out, s32, cookie);
+	GETCASE_COUNTER(e, S32, out, s32);
 
 	case UK_STORE_ENTRY_TYPE(charp): {
 		char *val = NULL;
@@ -1326,6 +1488,7 @@ _uk_store_get_u64(const struct uk_store_entry *e, __u64 *out)
 	GETCASE_UPCAST(e, u64, U64, out, u64, cookie);
 	GETCASE_UPCASTSU(e, s64, U64, out, u64, cookie);
 	GETCASE_UPCAST(e, uptr, U64, out, u64, cookie);
+	GETCASE_COUNTER(e, U64, out, u64);
 
 	case UK_STORE_ENTRY_TYPE(charp): {
 		char *val = NULL;
@@ -1370,6 +1533,7 @@ _uk_store_get_s64(const struct uk_store_entry *e, __s64 *out)
 	GETCASE_DOWNCASTUS(e, u64, S64, out, s64, cookie);
 	GETCASE_UPCAST(e, s64, S64, out, s64, cookie);
 	GETCASE_DOWNCASTUS(e, uptr, S64, out, s64, cookie);
+	GETCASE_COUNTER(e, S64, out, s64);
 
 	case UK_STORE_ENTRY_TYPE(charp): {
 		char *val = NULL;
@@ -1414,6 +1578,7 @@ _uk_store_get_uptr(const struct uk_store_entry *e, __uptr *out)
 	GETCASE_UPCAST(e, u64, PTR, out, uptr, cookie);
 	GETCASE_UPCASTSU(e, s64, PTR, out, uptr, cookie);
 	GETCASE_UPCAST(e, uptr, PTR, out, uptr, cookie);
+	GETCASE_COUNTER(e, PTR, out, uptr);
 
 	case UK_STORE_ENTRY_TYPE(charp): {
 		char *val = NULL;
@@ -1625,6 +1790,21 @@ _uk_store_get_charp(const struct uk_store_entry *e, char **out)
 		return ret;
 	}
 
+	case UK_STORE_ENTRY_TYPE(counter): {
+		if (UK_STORE_ENTRY_ISSTATIC(e))
+			str = calloc(_U64_STRLEN, sizeof(char));
+		else
+			str = a->calloc(a, _U64_STRLEN, sizeof(char));
+
+		if (unlikely(!str))
+			return -ENOMEM;
+
+		snprintf(str, _U64_STRLEN, "%" __PRIu64,
+			 uk_store_counter_read(e->get.counter));
+		*out  = str;
+		return 0;
+	}
+
 	case UK_STORE_ENTRY_TYPE(charp): {
 		char *val = NULL;
 
@@ -1746,6 +1926,11 @@ _uk_store_get_ncharp(const struct uk_store_entry *e, char *out, __sz maxlen)
 		return ret;
 	}
 
+	case UK_STORE_ENTRY_TYPE(counter):
+		snprintf(out, maxlen, "%" __PRIu64,
+			 uk_store_counter_read(e->get.counter));
+		return 0;
+
 	case UK_STORE_ENTRY_TYPE(charp): {
 		char *val;
 
@@ -35,13 +35,35 @@
 #include <uk/print.h>
 #include <uk/assert.h>
 #include <uk/ctors.h>
+#include <uk/essentials.h>
+#include <uk/atomic.h>
+
+/* Blocks generated at once by uk_swrand_fill_r(). With SIMD, every lane of
+ * a vector register holds the same word of a different block.
+ */
+#if defined(__AVX2__)
+#define CHACHA_LANES	8
+#else
+#define CHACHA_LANES	4
+#endif /* __AVX2__ */
+#define CHACHA_BLOCK	64
+
+#define RESEED_BLOCKS	\
+	(CONFIG_LIBUKSWRAND_RESEED_INTERVAL * 1024 / CHACHA_BLOCK)
+
+typedef __u32 chacha_vec __attribute__((vector_size(CHACHA_LANES * 4)));
 
 struct uk_swrand {
+	/* Next unused word of output */
 	int k;
+	/* Blocks left until the next reseed */
+	int reseed;
 	__u32 input[16], output[16];
 };
 
 struct uk_swrand uk_swrand_def;
+/* Generators of the secondary lcpus, keyed from the default generator */
+static UKPLAT_PER_LCPU_DEFINE(struct uk_swrand, swrand_lcpu);
 
 /* This value isn't important, as long as it's sufficiently asymmetric */
 static const char sigma[16] = "expand 32-byte k";
@@ -89,6 +111,88 @@ _uk_salsa20_wordtobyte(__u32 output[16], const __u32 input[16])
 		output[i] += input[i];
 }
 
+#define _UK_ROTLV(v, c)	(((v) << (c)) | ((v) >> (32 - (c))))
+
+#define _UK_QUARTERROUNDV(x, a, b, c, d)				\
+	do {								\
+		x[a] += x[b]; x[d] = _UK_ROTLV(x[d] ^ x[a], 16);	\
+		x[c] += x[d]; x[b] = _UK_ROTLV(x[b] ^ x[c], 12);	\
+		x[a] += x[b]; x[d] = _UK_ROTLV(x[d] ^ x[a], 8);		\
+		x[c] += x[d]; x[b] = _UK_ROTLV(x[b] ^ x[c], 7);		\
+	} while (0)
+
+/* Computes CHACHA_LANES consecutive blocks starting at the block counter of
+ * `input` and stores them to `out`
+ */
+static void _uk_chacha_blocks(__u8 *out, const __u32 input[16])
+{
+	chacha_vec x[16], in[16];
+	__u32 lo;
+	int i, l;
+
+	for (i = 0; i < 16; i++)
+		in[i] = (chacha_vec){} + input[i];
+	for (l = 0; l < CHACHA_LANES; l++) {
+		lo = input[12] + l;
+		in[12][l] = lo;
+		in[13][l] = input[13] + (lo < input[12]);
+	}
+
+	for (i = 0; i < 16; i++)
+		x[i] = in[i];
+
+	for (i = 8; i > 0; i -= 2) {
+		_UK_QUARTERROUNDV(x, 0, 4, 8, 12);
+		_UK_QUARTERROUNDV(x, 1, 5, 9, 13);
+		_UK_QUARTERROUNDV(x, 2, 6, 10, 14);
+		_UK_QUARTERROUNDV(x, 3, 7, 11, 15);
+		_UK_QUARTERROUNDV(x, 0, 5, 10, 15);
+		_UK_QUARTERROUNDV(x, 1, 6, 11, 12);
+		_UK_QUARTERROUNDV(x, 2, 7, 8, 13);
+		_UK_QUARTERROUNDV(x, 3, 4, 9, 14);
+	}
+
+	for (i = 0; i < 16; i++)
+		x[i] += in[i];
+
+	/* Lane `l` holds block `l` */
+	for (l = 0; l < CHACHA_LANES; l++)
+		for (i = 0; i < 16; i++) {
+			lo = x[i][l];
+			memcpy(out + l * CHACHA_BLOCK + i * 4, &lo, 4);
+		}
+}
+
+#if RESEED_BLOCKS
+static void _uk_reseed(struct uk_swrand *r)
+{
+	__u32 seedv[8];
+	int i;
+
+	r->reseed = RESEED_BLOCKS;
+	if (uk_swrand_entropy_get(seedv, ARRAY_SIZE(seedv)))
+		return;
+
+	/* The old key stays in, a weak source cannot weaken the state */
+	for (i = 0; i < 8; i++)
+		r->input[4 + i] ^= seedv[i];
+}
+#endif /* RESEED_BLOCKS */
+
+static inline void _uk_counter_add(struct uk_swrand *r, __u32 n)
+{
+	r->input[12] += n;
+	if (r->input[12] < n)
+		r->input[13]++;
+
+#if RESEED_BLOCKS
+	r->reseed -= n;
+	if (unlikely(r->reseed <= 0 ||
+		     UK_READ_ONCE(uk_swrand_entropy_pending)))
+		_uk_reseed(r);
+#endif /* RESEED_BLOCKS */
+}
+
 static inline void _uk_key_setup(struct uk_swrand *r, __u32 k[8])
 {
 	int i;
@@ -135,24 +239,55 @@ void uk_swrand_init_r(struct uk_swrand *r, unsigned int seedc,
 	_uk_iv_setup(r, iv);
 
 	r->k = 16;
+	r->reseed = RESEED_BLOCKS;
 }
 
 __u32 uk_swrand_randr_r(struct uk_swrand *r)
 {
-	__u32 res;
+	if (r->k >= 16) {
+		_uk_salsa20_wordtobyte(r->output, r->input);
+		_uk_counter_add(r, 1);
+		r->k = 0;
+	}
+	return r->output[r->k++];
+}
+
+void uk_swrand_fill_r(struct uk_swrand *r, void *buf, size_t buflen)
+{
+	__u8 *p = buf;
+	size_t len;
+
+	UK_ASSERT(r);
 
 	for (;;) {
-		_uk_salsa20_wordtobyte(r->output, r->input);
-		r->input[12] = r->input[12] + 1;
-		if (r->input[12] == 0)
-			r->input[13]++;
-
-		if (r->k < 16) {
-			res = r->output[r->k];
-			r->k += 1;
-			return res;
+		/* Hand out the rest of the current block first */
+		while (buflen > 0 && r->k < 16) {
+			len = MIN(buflen, sizeof(r->output[0]));
+			memcpy(p, &r->output[r->k++], len);
+			p += len;
+			buflen -= len;
+		}
+
+		/* Whole blocks go directly to the buffer */
+		while (buflen >= CHACHA_LANES * CHACHA_BLOCK) {
+			_uk_chacha_blocks(p, r->input);
+			_uk_counter_add(r, CHACHA_LANES);
+			p += CHACHA_LANES * CHACHA_BLOCK;
+			buflen -= CHACHA_LANES * CHACHA_BLOCK;
 		}
 
+		if (buflen == 0)
+			return;
+
+		_uk_salsa20_wordtobyte(r->output, r->input);
+		_uk_counter_add(r, 1);
 		r->k = 0;
 	}
 }
+
+struct uk_swrand *uk_swrand_lcpu(__lcpuidx idx)
+{
+	UK_ASSERT(idx < CONFIG_UKPLAT_LCPU_MAXCOUNT);
+
+	return idx ? &ukplat_per_lcpu(swrand_lcpu, idx) : &uk_swrand_def;
+}
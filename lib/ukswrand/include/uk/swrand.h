@@ -52,18 +52,68 @@ extern struct uk_swrand uk_swrand_def;
 void uk_swrand_init_r(struct uk_swrand *r, unsigned int seedc,
 			const __u32 seedv[]);
 __u32 uk_swrand_randr_r(struct uk_swrand *r);
+/* Fills `buf` with `buflen` random bytes, faster than calling
+ * uk_swrand_randr_r() for each word
+ */
+void uk_swrand_fill_r(struct uk_swrand *r, void *buf, size_t buflen);
+
+/* Returns the generator of lcpu `idx`. Depending on the algorithm, lcpus may
+ * share the default generator.
+ */
+struct uk_swrand *uk_swrand_lcpu(__lcpuidx idx);
 
 __u32 uk_swrandr_gen_seed32(void);
+
+/* Number of words collected from entropy sources between two reseeds */
+#define UK_SWRAND_ENTROPY_WORDS	8
+
+/* Set while entropy added with uk_swrand_add_entropy() was not consumed */
+extern int uk_swrand_entropy_pending;
+
+/**
+ * Mixes `buflen` bytes of entropy, e.g., from a hardware device, into the
+ * generators. The entropy is consumed by the next reseed. May be called from
+ * interrupt context.
+ */
+void uk_swrand_add_entropy(const void *buf, size_t buflen);
+
+typedef void (*uk_swrand_entropy_refill_t)(void *arg);
+
+/**
+ * Registers an entropy source. `refill` is called right away and whenever
+ * the entropy added by the source was consumed, possibly with interrupts
+ * disabled. It should request new entropy and hand it in asynchronously with
+ * uk_swrand_add_entropy().
+ *
+ * @return 0 on success, -EBUSY if a source is registered already
+ */
+int uk_swrand_entropy_source_register(uk_swrand_entropy_refill_t refill,
+				      void *arg);
+
+/**
+ * Fills `seedv` with fresh entropy from the CPU random number generator and
+ * from the registered source, if any.
+ *
+ * @return 0 on success, -ENOENT if no entropy was available
+ */
+int uk_swrand_entropy_get(__u32 seedv[], unsigned int seedc);
+
+/**
+ * Rekeys all generators with fresh entropy and the wall clock time, e.g.,
+ * after the VM was restored from a snapshot. Clones of the same snapshot
+ * would produce the same random numbers otherwise.
+ */
+void uk_swrand_reseed(void);
+
 /* Uses the pre-initialized default generator  */
 /* TODO: Add assertion when we can test if we are in interrupt context */
-/* TODO: Revisit with multi-CPU support */
 static inline __u32 uk_swrand_randr(void)
 {
 	unsigned long iflags;
 	__u32 ret;
 
 	iflags = ukplat_lcpu_save_irqf();
-	ret = uk_swrand_randr_r(&uk_swrand_def);
+	ret = uk_swrand_randr_r(uk_swrand_lcpu(ukplat_lcpu_idx()));
 	ukplat_lcpu_restore_irqf(iflags);
 
 	return ret;
@@ -34,6 +34,7 @@
 #include <string.h>
 #include <uk/swrand.h>
 #include <uk/assert.h>
+#include <uk/essentials.h>
 
 /* https://stackoverflow.com/questions/9492581/c-random-number-generation-pure-c-code-no-libraries-or-functions */
 #define PHI 0x9e3779b9
@@ -88,3 +89,26 @@ __u32 uk_swrand_randr_r(struct uk_swrand *r)
 	r->c = c;
 	return (r->Q[i] = y - x);
 }
+
+void uk_swrand_fill_r(struct uk_swrand *r, void *buf, size_t buflen)
+{
+	__u32 rd;
+
+	UK_ASSERT(r);
+
+	for (; buflen >= sizeof(rd); buflen -= sizeof(rd)) {
+		rd = uk_swrand_randr_r(r);
+		memcpy(buf, &rd, sizeof(rd));
+		buf = (char *)buf + sizeof(rd);
+	}
+	if (buflen > 0) {
+		rd = uk_swrand_randr_r(r);
+		memcpy(buf, &rd, buflen);
+	}
+}
+
+struct uk_swrand *uk_swrand_lcpu(__lcpuidx idx __unused)
+{
+	/* The state is too large to keep one per lcpu */
+	return &uk_swrand_def;
+}
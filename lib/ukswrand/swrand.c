@@ -27,16 +27,55 @@
  * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
  * POSSIBILITY OF SUCH DAMAGE.
  */
+#include <errno.h>
 #include <string.h>
 #include <uk/swrand.h>
 #include <uk/config.h>
 #include <uk/print.h>
 #include <uk/init.h>
+#include <uk/arch/random.h>
+#include <uk/assert.h>
+#include <uk/atomic.h>
+#include <uk/plat/spinlock.h>
+#include <uk/essentials.h>
+
+#if CONFIG_HAVE_RANDOM
+/* Set if the CPU provides a hardware random number generator */
+static int hwrng_avail;
+#endif /* CONFIG_HAVE_RANDOM */
+
+/* Entropy handed in by devices, consumed by the next reseed */
+static __u32 entropy_pool[UK_SWRAND_ENTROPY_WORDS];
+static unsigned int entropy_pos;
+int uk_swrand_entropy_pending;
+static uk_swrand_entropy_refill_t entropy_refill;
+static void *entropy_refill_arg;
+static __spinlock entropy_lock = UKARCH_SPINLOCK_INITIALIZER();
+
+#if CONFIG_HAVE_RANDOM
+static int _uk_swrand_hw_seed32(__u32 *val)
+{
+	if (!hwrng_avail)
+		return -ENOTSUP;
+
+	/* RDSEED and RNDRRS may run dry, the DRBG output is the fallback */
+	if (ukarch_random_seed_u32(val) == 0)
+		return 0;
+	if (ukarch_random_u32(val) == 0)
+		return 0;
+	return -EAGAIN;
+}
+#endif /* CONFIG_HAVE_RANDOM */
 
 __u32 uk_swrandr_gen_seed32(void)
 {
 	__u32 val;
 
+#if CONFIG_HAVE_RANDOM
+	if (_uk_swrand_hw_seed32(&val) == 0)
+		return val;
+#endif /* CONFIG_HAVE_RANDOM */
+
 #ifdef CONFIG_LIBUKSWRAND_INITIALSEED_TIME
 	val = (__u32)ukplat_wall_clock();
 #endif
@@ -53,21 +92,135 @@ __u32 uk_swrandr_gen_seed32(void)
 	return val;
 }
 
-ssize_t uk_swrand_fill_buffer(void *buf, size_t buflen)
+void uk_swrand_add_entropy(const void *buf, size_t buflen)
+{
+	const __u8 *p = buf;
+	unsigned long flags;
+	size_t len;
+	__u32 w;
+
+	ukplat_spin_lock_irqsave(&entropy_lock, flags);
+	for (; buflen > 0; buflen -= len) {
+		len = MIN(buflen, sizeof(w));
+		w = 0;
+		memcpy(&w, p, len);
+		p += len;
+
+		entropy_pool[entropy_pos] ^= w;
+		entropy_pos = (entropy_pos + 1) % UK_SWRAND_ENTROPY_WORDS;
+	}
+	UK_WRITE_ONCE(uk_swrand_entropy_pending, 1);
+	ukplat_spin_unlock_irqrestore(&entropy_lock, flags);
+}
+
+int uk_swrand_entropy_source_register(uk_swrand_entropy_refill_t refill,
+				      void *arg)
+{
+	unsigned long flags;
+	int rc = 0;
+
+	UK_ASSERT(refill);
+
+	ukplat_spin_lock_irqsave(&entropy_lock, flags);
+	if (entropy_refill) {
+		rc = -EBUSY;
+	} else {
+		entropy_refill = refill;
+		entropy_refill_arg = arg;
+	}
+	ukplat_spin_unlock_irqrestore(&entropy_lock, flags);
+
+	if (rc == 0)
+		refill(arg);
+	return rc;
+}
+
+int uk_swrand_entropy_get(__u32 seedv[], unsigned int seedc)
+{
+	uk_swrand_entropy_refill_t refill = NULL;
+	unsigned long flags;
+	unsigned int i;
+	int rc = -ENOENT;
+#if CONFIG_HAVE_RANDOM
+	__u32 w;
+#endif /* CONFIG_HAVE_RANDOM */
+
+	memset(seedv, 0, seedc * sizeof(*seedv));
+
+#if CONFIG_HAVE_RANDOM
+	for (i = 0; i < seedc; i++) {
+		if (_uk_swrand_hw_seed32(&w))
+			break;
+		seedv[i] ^= w;
+		rc = 0;
+	}
+#endif /* CONFIG_HAVE_RANDOM */
+
+	ukplat_spin_lock_irqsave(&entropy_lock, flags);
+	if (uk_swrand_entropy_pending) {
+		for (i = 0; i < UK_SWRAND_ENTROPY_WORDS; i++) {
+			seedv[i % seedc] ^= entropy_pool[i];
+			entropy_pool[i] = 0;
+		}
+		uk_swrand_entropy_pending = 0;
+		refill = entropy_refill;
+		rc = 0;
+	}
+	ukplat_spin_unlock_irqrestore(&entropy_lock, flags);
+
+	/* Ask the source for the entropy of the next reseed */
+	if (refill)
+		refill(entropy_refill_arg);
+	return rc;
+}
+
+void uk_swrand_reseed(void)
 {
-	size_t step, chunk_size, i;
-	__u32 rd;
+#ifdef CONFIG_LIBUKSWRAND_CHACHA
+	__u32 seedv[10], fresh[10];
+#else
+	__u32 seedv[2], fresh[2];
+#endif
+	struct uk_swrand *r;
+	unsigned long iflags;
+	__nsec now;
+	unsigned int i, j;
 
-	step = sizeof(__u32);
-	chunk_size = buflen % step;
+	for (j = 0; j < CONFIG_UKPLAT_LCPU_MAXCOUNT; j++) {
+		r = uk_swrand_lcpu(j);
+		if (j > 0 && r == &uk_swrand_def)
+			break;
 
-	for (i = 0; i < buflen - chunk_size; i += step)
-		*(__u32 *)((char *) buf + i) = uk_swrand_randr();
+		/* The old state stays in, so a weak source cannot weaken it */
+		uk_swrand_entropy_get(fresh, ARRAY_SIZE(fresh));
+		now = ukplat_wall_clock();
+		fresh[0] ^= (__u32)now;
+		fresh[1] ^= (__u32)(now >> 32);
 
-	/* fill the remaining bytes of the buffer */
-	if (chunk_size > 0) {
-		rd = uk_swrand_randr();
-		memcpy(buf + i, &rd, chunk_size);
+		iflags = ukplat_lcpu_save_irqf();
+		uk_swrand_fill_r(r, seedv, sizeof(seedv));
+		for (i = 0; i < ARRAY_SIZE(seedv); i++)
+			seedv[i] ^= fresh[i];
+		uk_swrand_init_r(r, ARRAY_SIZE(seedv), seedv);
+		ukplat_lcpu_restore_irqf(iflags);
+	}
+}
+
+/* Interrupts are disabled for at most one chunk at a time */
+#define FILL_CHUNK	4096UL
+
+ssize_t uk_swrand_fill_buffer(void *buf, size_t buflen)
+{
+	unsigned long iflags;
+	size_t off, len;
+
+	for (off = 0; off < buflen; off += len) {
+		len = MIN(buflen - off, FILL_CHUNK);
+
+		iflags = ukplat_lcpu_save_irqf();
+		uk_swrand_fill_r(uk_swrand_lcpu(ukplat_lcpu_idx()),
+				 (char *)buf + off, len);
+		ukplat_lcpu_restore_irqf(iflags);
 	}
 
 	return buflen;
@@ -75,7 +228,7 @@ ssize_t uk_swrand_fill_buffer(void *buf, size_t buflen)
 
 static int _uk_swrand_init(struct uk_init_ctx *ictx __unused)
 {
-	unsigned int i;
+	unsigned int i, j;
 #ifdef CONFIG_LIBUKSWRAND_CHACHA
 	unsigned int seedc = 10;
 	__u32 seedv[10];
@@ -85,11 +238,25 @@ static int _uk_swrand_init(struct uk_init_ctx *ictx __unused)
 #endif
 	uk_pr_info("Initialize random number generator...\n");
 
+#if CONFIG_HAVE_RANDOM
+	hwrng_avail = (ukarch_random_init() == 0);
+	if (hwrng_avail)
+		uk_pr_info("Seeding from hardware random number generator\n");
+#endif /* CONFIG_HAVE_RANDOM */
+
 	for (i = 0; i < seedc; i++)
 		seedv[i] = uk_swrandr_gen_seed32();
 
 	uk_swrand_init_r(&uk_swrand_def, seedc, seedv);
 
+	/* Secondary lcpus get independent keys from the default generator */
+	for (j = 1; j < CONFIG_UKPLAT_LCPU_MAXCOUNT; j++) {
+		if (uk_swrand_lcpu(j) == &uk_swrand_def)
+			break;
+		uk_swrand_fill_r(&uk_swrand_def, seedv, sizeof(seedv));
+		uk_swrand_init_r(uk_swrand_lcpu(j), seedc, seedv);
+	}
+
 	return seedc;
 }
 
@@ -0,0 +1,317 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <string.h>
+
+#include <uk/bench.h>
+#include <uk/arch/time.h>
+#include <uk/assert.h>
+#include <uk/essentials.h>
+#include <uk/plat/time.h>
+#include <uk/print.h>
+
+#define UK_BENCH_CALIBRATE_NSEC	ukarch_time_msec_to_nsec(10)
+#define UK_BENCH_SAMPLE_NSEC					\
+	((__u64)CONFIG_LIBUKTEST_BENCH_SAMPLE_USEC * 1000)
+/* Upper bound of the factor by which iterations grow between runs */
+#define UK_BENCH_MAX_SCALE	100
+
+#define bench_printf(fmt, ...)						\
+	_uk_printk(KLVL_INFO, UKLIBID_NONE, __NULL, 0x0,		\
+		   fmt, ##__VA_ARGS__)
+
+/* Latencies are kept in a log-linear histogram: each power of two is split
+ * into 2^UK_BENCH_LAT_SUB_BITS buckets, which bounds the error to ~6%.
+ */
+#define UK_BENCH_LAT_SUB_BITS	4
+#define UK_BENCH_LAT_SUB	(1U << UK_BENCH_LAT_SUB_BITS)
+#define UK_BENCH_LAT_BUCKETS	((64 - UK_BENCH_LAT_SUB_BITS + 1) *	\
+				 UK_BENCH_LAT_SUB)
+
+/* Ticks per second of uk_bench_ticks() */
+static __u64 bench_freq;
+static __u64 bench_samples[CONFIG_LIBUKTEST_BENCH_SAMPLES];
+
+static __u32 bench_lat[UK_BENCH_LAT_BUCKETS];
+static __u64 bench_lat_cnt;
+static __u64 bench_lat_max;
+
+static void bench_calibrate(void)
+{
+	__nsec t0, t1;
+	__u64 c0, c1;
+
+	t0 = ukplat_monotonic_clock();
+	c0 = uk_bench_ticks();
+	do {
+		t1 = ukplat_monotonic_clock();
+	} while (t1 - t0 < UK_BENCH_CALIBRATE_NSEC);
+	c1 = uk_bench_ticks();
+
+	bench_freq = (c1 - c0) * UKARCH_NSEC_PER_SEC / (t1 - t0);
+	if (unlikely(!bench_freq))
+		bench_freq = 1;
+	bench_printf("bench: %"__PRIu64" ticks per second\n", bench_freq);
+}
+
+static inline __u64 bench_ticks_to_nsec(__u64 ticks)
+{
+	return ticks * UKARCH_NSEC_PER_SEC / bench_freq;
+}
+
+static inline unsigned int bench_lat_bucket(__u64 ticks)
+{
+	unsigned int msb;
+
+	if (ticks < UK_BENCH_LAT_SUB)
+		return ticks;
+
+	msb = 63 - __builtin_clzll(ticks);
+	return (msb - UK_BENCH_LAT_SUB_BITS + 1) * UK_BENCH_LAT_SUB +
+	       ((ticks >> (msb - UK_BENCH_LAT_SUB_BITS)) &
+		(UK_BENCH_LAT_SUB - 1));
+}
+
+/* The middle of the range of ticks that falls into a bucket */
+static inline __u64 bench_lat_value(unsigned int bucket)
+{
+	unsigned int shift;
+
+	if (bucket < 2 * UK_BENCH_LAT_SUB)
+		return bucket;
+
+	shift = bucket / UK_BENCH_LAT_SUB - 1;
+	return ((__u64)(UK_BENCH_LAT_SUB + bucket % UK_BENCH_LAT_SUB)
+		<< shift) + (1ULL << (shift - 1));
+}
+
+void uk_bench_latency(struct uk_bench_ctx *b, __u64 ticks)
+{
+	if (!b->record)
+		return;
+
+	bench_lat[bench_lat_bucket(ticks)]++;
+	bench_lat_cnt++;
+	if (ticks > bench_lat_max)
+		bench_lat_max = ticks;
+}
+
+/* Returns the ticks one run of `n` iterations took, 0 if it was skipped.
+ * Counted events and the bytes per iteration are added to `sum`, if given.
+ */
+static __u64 bench_run_once(struct uk_bench *bench, __u64 n,
+			    struct uk_bench_ctx *sum)
+{
+	struct uk_bench_ctx b = {
+		.n = n,
+		.record = !!sum,
+	};
+	unsigned int i;
+
+	uk_bench_timer_start(&b);
+	bench->func(&b);
+	uk_bench_timer_stop(&b);
+
+	if (unlikely(b.skipped))
+		return 0;
+
+	if (sum) {
+		sum->n += n;
+		sum->bytes = b.bytes;
+		for (i = 0; i < b.nr_counters; i++)
+			uk_bench_count(sum, b.counters[i].name,
+				       b.counters[i].val);
+	}
+	return b.elapsed ? : 1;
+}
+
+/* Find the number of iterations whose run takes at least a sample time */
+static __u64 bench_scale(struct uk_bench *bench)
+{
+	__u64 n = 1, next, ticks, nsec;
+
+	for (;;) {
+		ticks = bench_run_once(bench, n, NULL);
+		if (unlikely(!ticks))
+			return 0;
+
+		nsec = bench_ticks_to_nsec(ticks);
+		if (nsec >= UK_BENCH_SAMPLE_NSEC)
+			return n;
+
+		/* Aim a bit beyond the target so that we converge quickly */
+		next = nsec ? n * UK_BENCH_SAMPLE_NSEC / nsec : 0;
+		next += next / 4;
+		n = MIN(MAX(next, n + 1), n * UK_BENCH_MAX_SCALE);
+	}
+}
+
+static void bench_sort(__u64 *s, unsigned int cnt)
+{
+	unsigned int i, j;
+	__u64 v;
+
+	for (i = 1; i < cnt; i++) {
+		v = s[i];
+		for (j = i; j > 0 && s[j - 1] > v; j--)
+			s[j] = s[j - 1];
+		s[j] = v;
+	}
+}
+
+/* Nearest-rank percentile of the sorted samples */
+static inline __u64 bench_percentile(const __u64 *s, unsigned int cnt,
+				     unsigned int p)
+{
+	unsigned int rank = (p * cnt + 99) / 100;
+
+	return s[rank ? rank - 1 : 0];
+}
+
+/* Print a value per operation with three decimal places */
+static void bench_print_milli(const char *label, __u64 milli)
+{
+	bench_printf(" %s %"__PRIu64".%03"__PRIu64, label,
+		     milli / 1000, milli % 1000);
+}
+
+static inline void bench_print_op(const char *label, __u64 ticks, __u64 n)
+{
+	bench_print_milli(label, bench_ticks_to_nsec(ticks) * 1000 / n);
+}
+
+static void bench_print_extra(const struct uk_bench_ctx *sum, __u64 median,
+			      __u64 n)
+{
+	__u64 nsec = bench_ticks_to_nsec(median) ? : 1;
+	unsigned int i;
+
+	bench_printf("\tp50:");
+	bench_print_milli("ticks/op", median * 1000 / n);
+	bench_printf(", %"__PRIu64" op/s",
+		     n * UKARCH_NSEC_PER_SEC / nsec);
+	if (sum->bytes)
+		bench_printf(", %"__PRIu64" Mbit/s",
+			     sum->bytes * 8 * n * 1000 / nsec);
+	bench_printf("\n");
+
+	if (!sum->nr_counters)
+		return;
+
+	bench_printf("\tevents:");
+	for (i = 0; i < sum->nr_counters; i++) {
+		bench_printf("%s", i ? "," : "");
+		bench_print_milli(sum->counters[i].name,
+				  sum->counters[i].val * 1000 / sum->n);
+		bench_printf("/op");
+	}
+	bench_printf("\n");
+}
+
+/* Nearest-rank percentile of the recorded latencies, in per mille */
+static __u64 bench_lat_percentile(unsigned int pm)
+{
+	__u64 rank = (pm * bench_lat_cnt + 999) / 1000;
+	__u64 cnt = 0;
+	unsigned int i;
+
+	for (i = 0; i < UK_BENCH_LAT_BUCKETS; i++) {
+		cnt += bench_lat[i];
+		if (cnt >= rank)
+			return MIN(bench_lat_value(i), bench_lat_max);
+	}
+	return bench_lat_max;
+}
+
+static void bench_print_latency(void)
+{
+	static const struct {
+		const char *label;
+		unsigned int pm;
+	} pcts[] = {
+		{ "p50", 500 }, { "p90", 900 }, { "p99", 990 },
+		{ "p99.9", 999 },
+	};
+	unsigned int i;
+
+	bench_printf("\tlatency ns:");
+	for (i = 0; i < ARRAY_SIZE(pcts); i++)
+		bench_printf(" %s %"__PRIu64, pcts[i].label,
+			     bench_ticks_to_nsec(
+				     bench_lat_percentile(pcts[i].pm)));
+	bench_printf(" max %"__PRIu64" (%"__PRIu64" operations)\n",
+		     bench_ticks_to_nsec(bench_lat_max), bench_lat_cnt);
+}
+
+static void bench_run(struct uk_benchsuite *suite, struct uk_bench *bench)
+{
+	const unsigned int cnt = CONFIG_LIBUKTEST_BENCH_SAMPLES;
+	struct uk_bench_ctx sum = { 0 };
+	unsigned int i;
+	__u64 n, median;
+
+	bench_printf(LVLC_TESTNAME "bench:" UK_ANSI_MOD_RESET " %s->%s",
+		     suite->name, bench->name);
+	if (bench->desc)
+		bench_printf(": %s", bench->desc);
+	bench_printf("\n");
+
+	n = bench_scale(bench);
+	if (unlikely(!n))
+		return;
+
+	for (i = 0; i < CONFIG_LIBUKTEST_BENCH_WARMUP; i++)
+		if (unlikely(!bench_run_once(bench, n, NULL)))
+			return;
+
+	memset(bench_lat, 0, sizeof(bench_lat));
+	bench_lat_cnt = 0;
+	bench_lat_max = 0;
+
+	for (i = 0; i < cnt; i++) {
+		bench_samples[i] = bench_run_once(bench, n, &sum);
+		if (unlikely(!bench_samples[i]))
+			return;
+	}
+	bench_sort(bench_samples, cnt);
+
+	bench_printf("\tns/op:");
+	bench_print_op("min", bench_samples[0], n);
+	median = bench_percentile(bench_samples, cnt, 50);
+	bench_print_op("p50", median, n);
+	bench_print_op("p90", bench_percentile(bench_samples, cnt, 90), n);
+	bench_print_op("p99", bench_percentile(bench_samples, cnt, 99), n);
+	bench_print_op("max", bench_samples[cnt - 1], n);
+	bench_printf(" (%u x %"__PRIu64" iterations)\n", cnt, n);
+	bench_print_extra(&sum, median, n);
+	if (bench_lat_cnt)
+		bench_print_latency();
+}
+
+int uk_benchsuite_run(struct uk_benchsuite *suite)
+{
+	struct uk_bench *bench;
+	int ret;
+
+	UK_ASSERT(suite);
+
+	if (!bench_freq)
+		bench_calibrate();
+
+	if (suite->init) {
+		ret = suite->init(suite);
+		if (ret != 0) {
+			uk_pr_err("Could not initialize benchmark suite: %s\n",
+				  suite->name);
+			return ret;
+		}
+	}
+
+	uk_benchsuite_foreach(suite, bench)
+		bench_run(suite, bench);
+
+	return 0;
+}
@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <string.h>
+
+#include <uk/bench.h>
+
+#define BENCH_BUF_SIZE		(64 * 1024)
+
+static char src[BENCH_BUF_SIZE] __align(64);
+static char dst[BENCH_BUF_SIZE] __align(64);
+
+static inline void bench_memcpy(struct uk_bench_ctx *b, __sz len)
+{
+	__u64 i;
+
+	for (i = 0; i < b->n; i++) {
+		memcpy(dst, src, len);
+		uk_bench_use(dst);
+	}
+}
+
+static inline void bench_memset(struct uk_bench_ctx *b, __sz len)
+{
+	__u64 i;
+
+	for (i = 0; i < b->n; i++) {
+		memset(dst, (int)i, len);
+		uk_bench_use(dst);
+	}
+}
+
+UK_BENCHMARK(uktest_string_benchsuite, memcpy_64)
+{
+	bench_memcpy(b, 64);
+}
+
+UK_BENCHMARK(uktest_string_benchsuite, memcpy_4k)
+{
+	bench_memcpy(b, 4096);
+}
+
+UK_BENCHMARK(uktest_string_benchsuite, memcpy_64k)
+{
+	bench_memcpy(b, BENCH_BUF_SIZE);
+}
+
+UK_BENCHMARK(uktest_string_benchsuite, memset_64)
+{
+	bench_memset(b, 64);
+}
+
+UK_BENCHMARK(uktest_string_benchsuite, memset_4k)
+{
+	bench_memset(b, 4096);
+}
+
+UK_BENCHMARK(uktest_string_benchsuite, memset_64k)
+{
+	bench_memset(b, BENCH_BUF_SIZE);
+}
+
+uk_benchsuite_register(uktest_string_benchsuite, NULL);
@@ -0,0 +1,357 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __UK_BENCH_H__
+#define __UK_BENCH_H__
+
+/**
+ * ## Overview
+ * Benchmarks are organised like tests (see `uk/test.h`): a benchmark suite
+ * groups benchmarks of one library or sub-system and is registered to the
+ * inittab, so it runs before the application's `main` method.
+ *
+ * A benchmark is a function that performs the measured operation `b->n`
+ * times. `uktest` runs it with a growing `b->n` until one run takes at least
+ * `CONFIG_LIBUKTEST_BENCH_SAMPLE_USEC`, discards a number of warm-up runs and
+ * then takes `CONFIG_LIBUKTEST_BENCH_SAMPLES` samples with that number of
+ * iterations. The minimum, the 50th, 90th and 99th percentile and the
+ * maximum time per operation are reported, as well as the ticks per
+ * operation (TSC cycles on x86). A benchmark may set `b->bytes` to get the
+ * throughput reported, count events per operation with `uk_bench_count()`
+ * and record the latency of individual operations, e.g., of overlapping I/O
+ * requests, with `uk_bench_latency()`:
+ * ```c
+ * UK_BENCHMARK(uklock_benchsuite, mutex_lock_unlock)
+ * {
+ *         __u64 i;
+ *
+ *         for (i = 0; i < b->n; i++) {
+ *                 uk_mutex_lock(&mutex);
+ *                 uk_mutex_unlock(&mutex);
+ *         }
+ * }
+ *
+ * uk_benchsuite_register(uklock_benchsuite, NULL);
+ * ```
+ * Time is taken from the time stamp counter of the CPU, which is calibrated
+ * against the monotonic platform clock once. Work that should not be
+ * measured, like setting up or tearing down state, is excluded with
+ * `uk_bench_timer_stop()` and `uk_bench_timer_start()`. A benchmark that
+ * cannot run, e.g., because memory is missing, bails out with
+ * `uk_bench_skip()`.
+ *
+ * Following the conventions for tests, benchmark suites are stored in the
+ * `tests/` folder of a library in files prefixed with `bench_` and are
+ * enabled with a `LIBNAME_BENCH` option, or all at once with
+ * `LIBUKTEST_BENCH_ALL`.
+ */
+
+#include <uk/arch/types.h>
+#include <uk/essentials.h>
+#include <uk/config.h>
+#include <uk/init.h>
+#include <uk/test.h>
+#include <uk/plat/time.h>
+
+/* Maximum number of event counters per benchmark, see uk_bench_count() */
+#define UK_BENCH_MAX_COUNTERS	4
+
+/**
+ * struct uk_bench_counter - Events counted by a benchmark.
+ */
+struct uk_bench_counter {
+	/* The name of the event, reported as "<name>/op". */
+	const char *name;
+	/* The number of events in the current run. */
+	__u64 val;
+};
+
+/**
+ * struct uk_bench_ctx - The state of a running benchmark.
+ */
+struct uk_bench_ctx {
+	/* The number of iterations the benchmark has to perform. */
+	__u64 n;
+	/* Ticks accumulated while the timer was running. */
+	__u64 elapsed;
+	/* Ticks when the timer was started last, 0 if it is stopped. */
+	__u64 start;
+	/* Bytes processed per iteration, reported as throughput if set. */
+	__u64 bytes;
+	/* Events counted with uk_bench_count(). */
+	struct uk_bench_counter counters[UK_BENCH_MAX_COUNTERS];
+	unsigned int nr_counters;
+	/* Set if latencies are recorded in the current run. */
+	int record;
+	/* Set if the benchmark could not be run. */
+	int skipped;
+};
+
+/**
+ * struct uk_bench - An individual benchmark.
+ */
+struct uk_bench {
+	/* The name of the benchmark. */
+	const char *name;
+	/* An optional short description. */
+	const char *desc;
+	/* Pointer to the benchmark method. */
+	void (*func)(struct uk_bench_ctx *b __maybe_unused);
+	/* Name of the file where the benchmark exists. */
+	const char *file;
+} __packed;
+
+/**
+ * struct uk_benchsuite - A series of benchmarks.
+ */
+struct uk_benchsuite {
+	/* The name of the benchmark suite. */
+	const char *name;
+	/* An optional initialization method for the suite. */
+	int (*init)(struct uk_benchsuite *suite __maybe_unused);
+	/* Benchmarks are stored directly after the suite until this marker. */
+	struct uk_bench *benches_end;
+} __packed;
+
+/**
+ * Read the free-running tick counter that benchmarks are timed with.
+ */
+static inline __u64 uk_bench_ticks(void)
+{
+#if defined(__X86_64__)
+	__u32 lo, hi;
+
+	/* Do not let rdtsc run ahead of the measured instructions */
+	__asm__ __volatile__("lfence\n"
+			     "rdtsc" : "=a"(lo), "=d"(hi) :: "memory");
+	return ((__u64)hi << 32) | lo;
+#elif defined(__ARM_64__)
+	__u64 cnt;
+
+	__asm__ __volatile__("isb\n"
+			     "mrs %0, cntvct_el0" : "=r"(cnt) :: "memory");
+	return cnt;
+#else
+	return ukplat_monotonic_clock();
+#endif
+}
+
+/**
+ * Start measuring time. The timer is already running when the benchmark
+ * function is entered.
+ */
+static inline void uk_bench_timer_start(struct uk_bench_ctx *b)
+{
+	if (!b->start)
+		b->start = uk_bench_ticks() ? : 1;
+}
+
+/**
+ * Stop measuring time, e.g., to set up state for the next iterations.
+ */
+static inline void uk_bench_timer_stop(struct uk_bench_ctx *b)
+{
+	if (b->start) {
+		b->elapsed += uk_bench_ticks() - b->start;
+		b->start = 0;
+	}
+}
+
+/**
+ * Discard the time measured so far, e.g., after a costly setup.
+ */
+static inline void uk_bench_timer_reset(struct uk_bench_ctx *b)
+{
+	b->elapsed = 0;
+	if (b->start)
+		b->start = uk_bench_ticks() ? : 1;
+}
+
+/**
+ * Add events, e.g., device notifications, to a counter of the benchmark.
+ * The average number of events per iteration over all samples is reported
+ * along with the time. Counters are told apart by the address of `name`.
+ */
+static inline void uk_bench_count(struct uk_bench_ctx *b, const char *name,
+				  __u64 val)
+{
+	unsigned int i;
+
+	for (i = 0; i < b->nr_counters; i++) {
+		if (b->counters[i].name == name) {
+			b->counters[i].val += val;
+			return;
+		}
+	}
+	if (likely(i < UK_BENCH_MAX_COUNTERS)) {
+		b->counters[i].name = name;
+		b->counters[i].val = val;
+		b->nr_counters++;
+	}
+}
+
+/**
+ * Record the latency of a single operation in ticks. The percentiles of the
+ * latencies recorded while taking samples are reported in addition to the
+ * time per iteration, which is the inverse of the rate for operations that
+ * overlap.
+ */
+void uk_bench_latency(struct uk_bench_ctx *b, __u64 ticks);
+
+/**
+ * Abort the benchmark because it cannot be run. Must be followed by a
+ * return from the benchmark function.
+ */
+#define uk_bench_skip(b, fmt, ...)					\
+	do {								\
+		(b)->skipped = 1;					\
+		uk_pr_warn("bench: skipped: " fmt "\n", ##__VA_ARGS__);\
+	} while (0)
+
+/**
+ * Prevent the compiler from optimizing away computations of the benchmark
+ * whose results are otherwise unused.
+ */
+#define uk_bench_use(val)						\
+	__asm__ __volatile__("" : : "r"(val) : "memory")
+
+/**
+ * Standard naming convention macro wrappers.
+ */
+#define _UK_BENCHSUITE_NAME(suite)					\
+	benchsuite_ ## suite
+#define _UK_BENCHSUITE_RUN_NAME(suite)					\
+	benchsuite_run_ ## suite
+#define _UK_BENCHSUITE_RUN_NAME_END(suite)				\
+	benchsuite_run_ ## suite ## __end
+#define _UK_BENCH_NAME(suite, fn)					\
+	_uk_benchsuite_ ## suite ## _bench_ ## fn
+#define _UK_BENCH_LABEL(suite, fn)					\
+	_uk_benchtab_ ## suite ## _ ## fn
+
+/**
+ * Macros for registering new benchmark suite entries.
+ * @param suite
+ *   Reference to the benchmark suite.
+ * @param initfn
+ *   The initialization function for the suite.
+ */
+#define _UK_BENCH_SECTION_HEADER(suite, initfn)				\
+	extern struct uk_bench _UK_BENCHSUITE_RUN_NAME_END(suite)[];	\
+	struct uk_benchsuite						\
+	__used __section(".uk_benchtab_" #suite "~") __align(1)		\
+	_UK_BENCHSUITE_NAME(suite) = {					\
+		.name = #suite,						\
+		.init = initfn,						\
+		.benches_end = _UK_BENCHSUITE_RUN_NAME_END(suite),	\
+	}
+
+#define __UK_BENCHSUITE(name, initfn)					\
+	_UK_BENCH_SECTION_HEADER(name, initfn);				\
+	_UK_TEST_SECTION_LABEL(".uk_benchtab_" #name "~~",		\
+		_UK_BENCHSUITE_RUN_NAME_END(name))
+
+#define _UK_BENCHSUITE(name, initfn)					\
+	__UK_BENCHSUITE(name, initfn)
+
+/**
+ * Create a new benchmark based on a function with a description.
+ * @param suite
+ *   The benchmark suite of the benchmark.
+ * @param fn
+ *   The function the benchmark invokes.
+ * @param dsc
+ *   A short description of the benchmark.
+ */
+#define UK_BENCHMARK_DESC(suite, fn, dsc)				\
+	void _UK_BENCH_NAME(suite, fn)(					\
+		struct uk_bench_ctx *b __maybe_unused);			\
+	struct uk_bench							\
+	__used __section(".uk_benchtab_" #suite "~" #fn) __align(1)	\
+	_UK_BENCH_LABEL(suite, fn) = {					\
+		.name = #fn,						\
+		.desc = dsc,						\
+		.func = _UK_BENCH_NAME(suite, fn),			\
+		.file = __FILE__					\
+	};								\
+	void _UK_BENCH_NAME(suite, fn)(					\
+		struct uk_bench_ctx *b __maybe_unused)
+
+/**
+ * Create a new benchmark based on a function.
+ * @param suite
+ *   The benchmark suite of the benchmark.
+ * @param fn
+ *   The function the benchmark invokes.
+ */
+#define UK_BENCHMARK(suite, fn)						\
+	UK_BENCHMARK_DESC(suite, fn, NULL)
+
+/**
+ * Helper macro which iterates each benchmark in a benchmark suite.
+ *
+ * @param suite
+ *   A statically initialized `struct uk_benchsuite`.
+ * @param bench
+ *   A reference pointer to a benchmark available on each iteration.
+ */
+#define uk_benchsuite_foreach(suite, bench)				\
+	for ((bench) = (struct uk_bench *)((suite) + 1);		\
+	     (bench) < ((suite)->benches_end);				\
+	     (bench)++)
+
+int uk_benchsuite_run(struct uk_benchsuite *suite);
+
+/**
+ * Add a benchmark suite to inittab at a specific class and priority level.
+ *
+ * @param suite
+ *   A reference to a `struct uk_benchsuite`.
+ * @param initfn
+ *   The initialization function for the suite.
+ * @param class
+ *   The class at which this suite should be inserted within the inittab.
+ * @param prio
+ *   The priority of this benchmark suite.
+ */
+#define UK_BENCHSUITE_AT_INITCALL_PRIO(suite, initfn, class, prio)	\
+	_UK_BENCHSUITE(suite, initfn);					\
+	static int _UK_BENCHSUITE_RUN_NAME(suite)(struct uk_init_ctx	\
+						       *__ictx __unused)\
+	{								\
+		return uk_benchsuite_run(&_UK_BENCHSUITE_NAME(suite));	\
+	}								\
+	uk_initcall_class_prio(_UK_BENCHSUITE_RUN_NAME(suite), 0x0,	\
+			       class, prio)
+
+/**
+ * The default registration for a benchmark suite with a desired priority
+ * level. Benchmarks run in the "late" stage of the inittab, when all
+ * sub-systems are up.
+ *
+ * @param suite
+ *   The pointer to the suite to add.
+ * @param initfn
+ *   The initialization function for the suite.
+ * @param prio
+ *   The priority of this suite.
+ */
+#define uk_benchsuite_prio(suite, initfn, prio)				\
+	UK_BENCHSUITE_AT_INITCALL_PRIO(suite, initfn,			\
+				       UK_INIT_CLASS_LATE, prio)
+
+/**
+ * The default registration for a benchmark suite.
+ *
+ * @param suite
+ *   The pointer to the suite to add.
+ * @param initfn
+ *   The initialization function for the suite.
+ */
+#define uk_benchsuite_register(suite, initfn)				\
+	uk_benchsuite_prio(suite, initfn, UK_PRIO_LATEST)
+
+#endif /* __UK_BENCH_H__ */
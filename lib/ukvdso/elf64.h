@@ -0,0 +1,119 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/* Subset of the ELF-64 format needed to describe the vDSO image */
+
+#ifndef __UKVDSO_ELF64_H__
+#define __UKVDSO_ELF64_H__
+
+#include <uk/arch/types.h>
+
+typedef __u16 Elf64_Half;
+typedef __u32 Elf64_Word;
+typedef __s64 Elf64_Sxword;
+typedef __u64 Elf64_Xword;
+typedef __u64 Elf64_Addr;
+typedef __u64 Elf64_Off;
+
+#define EI_NIDENT	16
+#define EI_CLASS	4
+#define EI_DATA		5
+#define EI_VERSION	6
+#define EI_OSABI	7
+
+#define ELFCLASS64	2
+#define ELFDATA2LSB	1
+#define EV_CURRENT	1
+#define ELFOSABI_SYSV	0
+#define ET_DYN		3
+#define EM_X86_64	62
+
+typedef struct {
+	unsigned char e_ident[EI_NIDENT];
+	Elf64_Half e_type;
+	Elf64_Half e_machine;
+	Elf64_Word e_version;
+	Elf64_Addr e_entry;
+	Elf64_Off e_phoff;
+	Elf64_Off e_shoff;
+	Elf64_Word e_flags;
+	Elf64_Half e_ehsize;
+	Elf64_Half e_phentsize;
+	Elf64_Half e_phnum;
+	Elf64_Half e_shentsize;
+	Elf64_Half e_shnum;
+	Elf64_Half e_shstrndx;
+} Elf64_Ehdr;
+
+#define PT_LOAD		1
+#define PT_DYNAMIC	2
+#define PF_X		0x1
+#define PF_R		0x4
+
+typedef struct {
+	Elf64_Word p_type;
+	Elf64_Word p_flags;
+	Elf64_Off p_offset;
+	Elf64_Addr p_vaddr;
+	Elf64_Addr p_paddr;
+	Elf64_Xword p_filesz;
+	Elf64_Xword p_memsz;
+	Elf64_Xword p_align;
+} Elf64_Phdr;
+
+#define DT_NULL		0
+#define DT_HASH		4
+#define DT_STRTAB	5
+#define DT_SYMTAB	6
+#define DT_STRSZ	10
+#define DT_SYMENT	11
+#define DT_SONAME	14
+#define DT_VERSYM	0x6ffffff0
+#define DT_VERDEF	0x6ffffffc
+#define DT_VERDEFNUM	0x6ffffffd
+
+typedef struct {
+	Elf64_Sxword d_tag;
+	union {
+		Elf64_Xword d_val;
+		Elf64_Addr d_ptr;
+	} d_un;
+} Elf64_Dyn;
+
+#define STB_GLOBAL	1
+#define STB_WEAK	2
+#define STT_FUNC	2
+#define STV_DEFAULT	0
+#define ELF64_ST_INFO(b, t) (((b) << 4) + ((t) & 0xf))
+
+typedef struct {
+	Elf64_Word st_name;
+	unsigned char st_info;
+	unsigned char st_other;
+	Elf64_Half st_shndx;
+	Elf64_Addr st_value;
+	Elf64_Xword st_size;
+} Elf64_Sym;
+
+#define VER_DEF_CURRENT	1
+#define VER_FLG_BASE	0x1
+
+typedef struct {
+	Elf64_Half vd_version;
+	Elf64_Half vd_flags;
+	Elf64_Half vd_ndx;
+	Elf64_Half vd_cnt;
+	Elf64_Word vd_hash;
+	Elf64_Word vd_aux;
+	Elf64_Word vd_next;
+} Elf64_Verdef;
+
+typedef struct {
+	Elf64_Word vda_name;
+	Elf64_Word vda_next;
+} Elf64_Verdaux;
+
+#endif /* __UKVDSO_ELF64_H__ */
@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/* vDSO for binary-compatible applications */
+
+#ifndef __UK_VDSO_H__
+#define __UK_VDSO_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Returns the ELF header of the vDSO image. Loaders of binary-compatible
+ * applications pass this address as the AT_SYSINFO_EHDR auxiliary vector
+ * entry, so that the libc resolves the time queries to the vDSO.
+ *
+ * @return
+ *   Address of the vDSO image
+ */
+const void *uk_vdso_ehdr(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UK_VDSO_H__ */
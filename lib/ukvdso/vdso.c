@@ -0,0 +1,358 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include <uk/arch/limits.h>
+#include <uk/assert.h>
+#include <uk/essentials.h>
+#include <uk/init.h>
+#include <uk/plat/time.h>
+#include <uk/syscall.h>
+#include <uk/vdso.h>
+#include <x86/cpu.h>
+
+#include "elf64.h"
+
+#define VDSO_SONAME	"linux-vdso.so.1"
+#define VDSO_VERSION	"LINUX_2.6"
+
+/*
+ * Data page
+ *
+ * The vDSO functions run in the context of the application and only read
+ * from here. The contents do not change after initialization. The clock
+ * parameters are the ones of the platform, which may update them at any
+ * time under their sequence counter.
+ */
+static struct vdso_data {
+	const struct ukplat_clock_params *clock;
+} vdso_data __align(__PAGE_SIZE);
+
+/*
+ * vDSO functions
+ *
+ * These run in the context of the application, with its TLS and stack.
+ * Whatever cannot be answered from the data page is forwarded to the
+ * regular binary system call handler, so results are identical to the
+ * ones of the system calls.
+ */
+
+static inline long vdso_syscall(long nr, long arg0, long arg1, long arg2)
+{
+	long ret;
+
+	__asm__ __volatile__(
+		"syscall"
+		: "=a" (ret)
+		: "a" (nr), "D" (arg0), "S" (arg1), "d" (arg2)
+		: "rcx", "r11", "memory"
+	);
+	return ret;
+}
+
+/* Returns 0 and the current time of `clk` or -1 if it must be queried
+ * with a system call
+ */
+static inline int vdso_clock_read(clockid_t clk, __nsec *now)
+{
+	const struct ukplat_clock_params *cp = vdso_data.clock;
+	__nsec mono, epoch;
+	__u32 seq;
+
+	if (unlikely(!cp))
+		return -1;
+
+	/* Same as the platform clock, see ukplat_clock_params() */
+	do {
+		seq = ukplat_clock_params_read_begin(cp);
+		mono = ukplat_clock_params_monotonic(cp, rdtsc());
+		epoch = cp->epoch_offset;
+	} while (unlikely(ukplat_clock_params_read_retry(cp, seq)));
+
+	switch (clk) {
+	case CLOCK_MONOTONIC:
+	case CLOCK_MONOTONIC_RAW:
+	case CLOCK_MONOTONIC_COARSE:
+	case CLOCK_BOOTTIME:
+		*now = mono;
+		return 0;
+	case CLOCK_REALTIME:
+	case CLOCK_REALTIME_COARSE:
+		*now = mono + epoch;
+		return 0;
+	default:
+		return -1;
+	}
+}
+
+static int vdso_clock_gettime(clockid_t clk, struct timespec *ts)
+{
+	__nsec now;
+
+	if (unlikely(!ts || vdso_clock_read(clk, &now)))
+		return vdso_syscall(SYS_clock_gettime, clk, (long)ts, 0);
+
+	ts->tv_sec = ukarch_time_nsec_to_sec(now);
+	ts->tv_nsec = ukarch_time_subsec(now);
+	return 0;
+}
+
+static int vdso_gettimeofday(struct timeval *tv, void *tz)
+{
+	__nsec now;
+
+	if (unlikely(!tv || tz || vdso_clock_read(CLOCK_REALTIME, &now)))
+		return vdso_syscall(SYS_gettimeofday, (long)tv, (long)tz, 0);
+
+	tv->tv_sec = ukarch_time_nsec_to_sec(now);
+	tv->tv_usec = ukarch_time_nsec_to_usec(ukarch_time_subsec(now));
+	return 0;
+}
+
+static time_t vdso_time(time_t *tloc)
+{
+	time_t secs;
+	__nsec now;
+
+	if (unlikely(vdso_clock_read(CLOCK_REALTIME, &now)))
+		return vdso_syscall(SYS_time, (long)tloc, 0, 0);
+
+	secs = ukarch_time_nsec_to_sec(now);
+	if (tloc)
+		*tloc = secs;
+	return secs;
+}
+
+static int vdso_getcpu(unsigned int *cpu, unsigned int *node,
+		       void *tcache __unused)
+{
+#if CONFIG_HAVE_SMP
+	/* The CPU index is only reachable with the kernel GS base */
+	return vdso_syscall(SYS_getcpu, (long)cpu, (long)node, 0);
+#else /* !CONFIG_HAVE_SMP */
+	if (cpu)
+		*cpu = 0;
+	if (node)
+		*node = 0;
+	return 0;
+#endif /* !CONFIG_HAVE_SMP */
+}
+
+/*
+ * ELF image
+ *
+ * A shared object as expected by the dynamic loaders of libcs for a vDSO:
+ * a dynamic section with a hashed and versioned symbol table. The image
+ * contains no code; symbol values are relative to the image base and point
+ * to the functions above, which the application can call directly as it
+ * shares the address space with us.
+ */
+
+static const struct {
+	const char *name;
+	void *fn;
+	unsigned char bind;
+} vdso_syms[] = {
+	{ "__vdso_clock_gettime", vdso_clock_gettime, STB_GLOBAL },
+	{ "__vdso_gettimeofday",  vdso_gettimeofday,  STB_GLOBAL },
+	{ "__vdso_time",          vdso_time,          STB_GLOBAL },
+	{ "__vdso_getcpu",        vdso_getcpu,        STB_GLOBAL },
+	{ "clock_gettime",        vdso_clock_gettime, STB_WEAK },
+	{ "gettimeofday",         vdso_gettimeofday,  STB_WEAK },
+	{ "time",                 vdso_time,          STB_WEAK },
+	{ "getcpu",               vdso_getcpu,        STB_WEAK },
+};
+
+/* Symbol 0 is the undefined symbol */
+#define VDSO_NSYMS	(ARRAY_SIZE(vdso_syms) + 1)
+#define VDSO_NDYN	10
+#define VDSO_STRSZ	256
+
+/* Version indices, 1 is the base version (the object itself) */
+#define VDSO_VER_BASE	1
+#define VDSO_VER	2
+
+struct vdso_verdef {
+	Elf64_Verdef vd;
+	Elf64_Verdaux vda;
+};
+
+struct vdso_image {
+	Elf64_Ehdr ehdr;
+	Elf64_Phdr phdr[2];
+	Elf64_Dyn dyn[VDSO_NDYN];
+	Elf64_Sym sym[VDSO_NSYMS];
+	/* nbucket, nchain, buckets, chains */
+	Elf64_Word hash[2 + 2 * VDSO_NSYMS];
+	Elf64_Half versym[VDSO_NSYMS];
+	struct vdso_verdef verdef[2];
+	char strtab[VDSO_STRSZ];
+};
+
+static struct vdso_image vdso_image __align(__PAGE_SIZE);
+
+#define VDSO_OFF(field) offsetof(struct vdso_image, field)
+
+static Elf64_Word vdso_elf_hash(const char *name)
+{
+	Elf64_Word h = 0;
+	Elf64_Word g;
+
+	while (*name) {
+		h = (h << 4) + (unsigned char)*name++;
+		g = h & 0xf0000000;
+		if (g)
+			h ^= g >> 24;
+		h &= ~g;
+	}
+	return h;
+}
+
+/* Appends `s` to the string table and returns its offset */
+static Elf64_Word vdso_str(struct vdso_image *img, __sz *strsz,
+			   const char *s)
+{
+	Elf64_Word off = *strsz;
+	__sz len = strlen(s) + 1;
+
+	UK_ASSERT(off + len <= sizeof(img->strtab));
+	memcpy(&img->strtab[off], s, len);
+	*strsz += len;
+	return off;
+}
+
+static void vdso_image_build(struct vdso_image *img)
+{
+	Elf64_Word *buckets = &img->hash[2];
+	Elf64_Word *chains = &img->hash[2 + VDSO_NSYMS];
+	Elf64_Word soname, vername;
+	__sz strsz = 1; /* Offset 0 is the empty string */
+	unsigned int i;
+
+	memset(img, 0, sizeof(*img));
+
+	soname = vdso_str(img, &strsz, VDSO_SONAME);
+	vername = vdso_str(img, &strsz, VDSO_VERSION);
+
+	/* Symbols, hashed into VDSO_NSYMS buckets */
+	img->hash[0] = VDSO_NSYMS;
+	img->hash[1] = VDSO_NSYMS;
+	for (i = 1; i < VDSO_NSYMS; i++) {
+		Elf64_Sym *sym = &img->sym[i];
+		const char *name = vdso_syms[i - 1].name;
+		Elf64_Word b = vdso_elf_hash(name) % VDSO_NSYMS;
+
+		sym->st_name = vdso_str(img, &strsz, name);
+		sym->st_info = ELF64_ST_INFO(vdso_syms[i - 1].bind, STT_FUNC);
+		sym->st_other = STV_DEFAULT;
+		/* There are no section headers; loaders only check that the
+		 * symbol is not undefined
+		 */
+		sym->st_shndx = 1;
+		sym->st_value = (Elf64_Addr)vdso_syms[i - 1].fn -
+				(Elf64_Addr)img;
+
+		chains[i] = buckets[b];
+		buckets[b] = i;
+
+		img->versym[i] = VDSO_VER;
+	}
+
+	img->verdef[0] = (struct vdso_verdef){
+		.vd = {
+			.vd_version = VER_DEF_CURRENT,
+			.vd_flags = VER_FLG_BASE,
+			.vd_ndx = VDSO_VER_BASE,
+			.vd_cnt = 1,
+			.vd_hash = vdso_elf_hash(VDSO_SONAME),
+			.vd_aux = sizeof(Elf64_Verdef),
+			.vd_next = sizeof(struct vdso_verdef)
+		},
+		.vda = { .vda_name = soname }
+	};
+	img->verdef[1] = (struct vdso_verdef){
+		.vd = {
+			.vd_version = VER_DEF_CURRENT,
+			.vd_ndx = VDSO_VER,
+			.vd_cnt = 1,
+			.vd_hash = vdso_elf_hash(VDSO_VERSION),
+			.vd_aux = sizeof(Elf64_Verdef)
+		},
+		.vda = { .vda_name = vername }
+	};
+
+	i = 0;
+	img->dyn[i++] = (Elf64_Dyn){ DT_SONAME, { soname } };
+	img->dyn[i++] = (Elf64_Dyn){ DT_HASH, { VDSO_OFF(hash) } };
+	img->dyn[i++] = (Elf64_Dyn){ DT_STRTAB, { VDSO_OFF(strtab) } };
+	img->dyn[i++] = (Elf64_Dyn){ DT_SYMTAB, { VDSO_OFF(sym) } };
+	img->dyn[i++] = (Elf64_Dyn){ DT_STRSZ, { strsz } };
+	img->dyn[i++] = (Elf64_Dyn){ DT_SYMENT, { sizeof(Elf64_Sym) } };
+	img->dyn[i++] = (Elf64_Dyn){ DT_VERSYM, { VDSO_OFF(versym) } };
+	img->dyn[i++] = (Elf64_Dyn){ DT_VERDEF, { VDSO_OFF(verdef) } };
+	img->dyn[i++] = (Elf64_Dyn){ DT_VERDEFNUM, { 2 } };
+	img->dyn[i++] = (Elf64_Dyn){ DT_NULL, { 0 } };
+	UK_ASSERT(i == VDSO_NDYN);
+
+	img->phdr[0] = (Elf64_Phdr){
+		.p_type = PT_LOAD,
+		.p_flags = PF_R | PF_X,
+		.p_offset = 0,
+		.p_vaddr = 0,
+		.p_filesz = sizeof(*img),
+		.p_memsz = sizeof(*img),
+		.p_align = __PAGE_SIZE
+	};
+	img->phdr[1] = (Elf64_Phdr){
+		.p_type = PT_DYNAMIC,
+		.p_flags = PF_R,
+		.p_offset = VDSO_OFF(dyn),
+		.p_vaddr = VDSO_OFF(dyn),
+		.p_filesz = sizeof(img->dyn),
+		.p_memsz = sizeof(img->dyn),
+		.p_align = 8
+	};
+
+	img->ehdr = (Elf64_Ehdr){
+		.e_ident = {
+			0x7f, 'E', 'L', 'F',
+			[EI_CLASS] = ELFCLASS64,
+			[EI_DATA] = ELFDATA2LSB,
+			[EI_VERSION] = EV_CURRENT,
+			[EI_OSABI] = ELFOSABI_SYSV
+		},
+		.e_type = ET_DYN,
+		.e_machine = EM_X86_64,
+		.e_version = EV_CURRENT,
+		.e_phoff = VDSO_OFF(phdr),
+		.e_ehsize = sizeof(Elf64_Ehdr),
+		.e_phentsize = sizeof(Elf64_Phdr),
+		.e_phnum = ARRAY_SIZE(img->phdr)
+	};
+}
+
+const void *uk_vdso_ehdr(void)
+{
+	return &vdso_image;
+}
+
+static int vdso_init(struct uk_init_ctx *ictx __unused)
+{
+	const struct ukplat_clock_params *cp = ukplat_clock_params();
+
+	/* Without clock parameters all queries fall back to system calls */
+	if (cp && cp->cnt_mult)
+		vdso_data.clock = cp;
+
+	vdso_image_build(&vdso_image);
+	return 0;
+}
+
+uk_lib_initcall(vdso_init, 0x0);
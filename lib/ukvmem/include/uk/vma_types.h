@@ -229,6 +229,17 @@ struct uk_vma_file {
 
 	/** Start offset describing what position in the file is mapped */
 	__off offset;
+
+#if CONFIG_LIBUKVMEM_FILE_READAHEAD
+	/** Read-ahead buffer holding file contents starting at ra_off */
+	void *ra_buf;
+	__off ra_off;
+	__sz ra_len;
+	/** Size of the next read-ahead, grows with sequential faults */
+	__sz ra_win;
+	/** File offset following the last fault */
+	__off ra_next;
+#endif /* CONFIG_LIBUKVMEM_FILE_READAHEAD */
 };
 
 struct uk_vma_file_args {
@@ -68,6 +68,12 @@ struct uk_vas {
 	/** List of VMAs, sorted by address */
 	struct uk_list_head vma_list;
 
+	/** Root of the tree that indexes the VMAs by address */
+	struct uk_vma *vma_root;
+
+	/** VMA found by the last lookup */
+	struct uk_vma *vma_cache;
+
 	/** VAS flags */
 #define UK_VAS_FLAG_NO_PAGING		0x1 /* On-demand paging disabled */
 	unsigned long flags;
@@ -106,6 +112,21 @@ static inline void uk_vas_paging_restoref(struct uk_vas *vas,
 }
 
 /** Virtual memory area (VMA) */
+/** Node of the VMA tree of a VAS, an AVL tree ordered by address */
+struct uk_vma_node {
+	struct uk_vma *parent;
+	struct uk_vma *left;
+	struct uk_vma *right;
+	int height;
+
+	/** Start of the first and end of the last VMA in the subtree */
+	__vaddr_t sub_start;
+	__vaddr_t sub_end;
+
+	/** Largest gap between two VMAs of the subtree */
+	__sz max_gap;
+};
+
 struct uk_vma {
 	__vaddr_t start;
 	__vaddr_t end;
@@ -114,12 +135,15 @@ struct uk_vma {
 	const struct uk_vma_ops *ops;
 
 	struct uk_list_head vma_list;
+	struct uk_vma_node vma_node;
 
 	/** Page attributes for pages in the VMA (see PAGE_ATTR_*) */
 	unsigned long attr;
 
 	/** VMA flags - high word bits are from mapping flags */
 #define UK_VMA_FLAG_UNINITIALIZED	0x1 /* Do not initialize memory */
+#define UK_VMA_FLAG_LARGE_PAGES		0x2 /* Prefer large pages */
+#define UK_VMA_FLAG_LAZYFREE		0x4 /* Has lazily freed pages */
 	unsigned long flags;
 
 	/** Desired page level (-1 = no preference) */
@@ -485,6 +509,7 @@ static inline const struct uk_vma *uk_vma_next(const struct uk_vma *vma)
 #define UK_VMA_MAP_POPULATE		0x01 /* Prefault memory */
 #define UK_VMA_MAP_UNINITIALIZED	0x02 /* Do not zero anonymous memory */
 #define UK_VMA_MAP_REPLACE		0x04 /* Replace existing VMAs */
+#define UK_VMA_MAP_LARGE_PAGES		0x08 /* Prefer large pages */
 
 #define UK_VMA_MAP_SIZE_SHIFT		5
 #define UK_VMA_MAP_SIZE_BITS		6
@@ -540,6 +565,14 @@ static inline const struct uk_vma *uk_vma_next(const struct uk_vma *vma)
  *   len must be aligned to the default page size of the architecture (i.e.,
  *   4KiB on x86).
  *
+ *   Use UK_VMA_MAP_LARGE_PAGES to back an area without an enforced page size
+ *   with pages up to CONFIG_LIBUKVMEM_LARGE_PAGE_IN_SIZE, where alignment and
+ *   the contiguity of free physical memory allow. If vaddr is __VADDR_ANY the
+ *   area is aligned accordingly. On page faults, the VMA falls back to smaller
+ *   pages if no large frame is available. With
+ *   CONFIG_LIBUKVMEM_LARGE_PAGE_PROMOTE, ranges of anonymous memory that are
+ *   fully populated with smaller pages are promoted to a large page.
+ *
  *   Use UK_VMA_MAP_REPLACE to replace any colliding address ranges from other
  *   VMAs with this one. Note that this only works if the conflicting VMAs
  *   implement and allow the split and unmap operations.
@@ -624,6 +657,7 @@ int uk_vma_set_attr(struct uk_vas *vas, __vaddr_t vaddr, __sz len,
 /* VMA advices */
 #define UK_VMA_ADV_DONTNEED		0x01 /* Physical memory can be freed */
 #define UK_VMA_ADV_WILLNEED		0x02 /* Area should be prefaulted */
+#define UK_VMA_ADV_FREE			0x04 /* Memory may be freed lazily */
 
 /* The high word bits of the advice are usable for VMA-type specific advices */
 #define UK_VMA_ADV_EXTF_SHIFT		(sizeof(unsigned long) * 4)
@@ -656,6 +690,12 @@ int uk_vma_set_attr(struct uk_vas *vas, __vaddr_t vaddr, __sz len,
  *   UK_VMA_ADV_WILLNEED informs the virtual memory system that the pages will
  *   be needed soon and should be paged in. This can be used to reduce the
  *   number of page faults.
+ *
+ *   UK_VMA_ADV_FREE informs the virtual memory system that the contents in
+ *   the address range is not needed anymore, but keeps the physical memory
+ *   until memory runs short. Pages written to after the advice keep their
+ *   contents. The other pages are released with uk_vas_reclaim(), after which
+ *   they behave like on the first access. Only anonymous memory is affected.
  * @param flags
  *   One of the generic flags (UK_VMA_FLAG_*)
  *
@@ -665,6 +705,19 @@ int uk_vma_set_attr(struct uk_vas *vas, __vaddr_t vaddr, __sz len,
 int uk_vma_advise(struct uk_vas *vas, __vaddr_t vaddr, __sz len,
 		  unsigned long advice, unsigned long flags);
 
+/**
+ * Releases the physical memory of pages that were freed lazily with
+ * UK_VMA_ADV_FREE and not written to since. This is done automatically when a
+ * page fault cannot be served for a lack of memory.
+ *
+ * @param vas
+ *   The virtual address space to operate on
+ *
+ * @return
+ *   The number of bytes released
+ */
+__sz uk_vas_reclaim(struct uk_vas *vas);
+
 #ifdef __cplusplus
 }
 #endif
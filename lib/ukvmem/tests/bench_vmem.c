@@ -0,0 +1,75 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <uk/arch/paging.h>
+#include <uk/bench.h>
+#include <uk/plat/paging.h>
+#include <uk/vma_types.h>
+#include <uk/vmem.h>
+
+/* Pages that are mapped and faulted in at a time */
+#define BENCH_VMA_PAGES		256
+
+/*
+ * Every iteration touches a page of a fresh anonymous mapping, so that
+ * vmem_pagefault() populates it. Mapping and unmapping is not measured.
+ */
+static void bench_pagefault(struct uk_bench_ctx *b, int write)
+{
+	struct uk_vas *vas = uk_vas_get_active();
+	volatile char *p;
+	__vaddr_t vaddr;
+	__u64 i = 0;
+	__sz pages;
+	__sz j;
+	int rc;
+
+	while (i < b->n) {
+		pages = MIN(b->n - i, (__u64)BENCH_VMA_PAGES);
+
+		uk_bench_timer_stop(b);
+		vaddr = __VADDR_ANY;
+		rc = uk_vma_map_anon(vas, &vaddr, pages * PAGE_SIZE,
+				     PAGE_ATTR_PROT_RW, 0, "bench");
+		if (unlikely(rc)) {
+			uk_bench_skip(b, "failed to map memory: %d", rc);
+			return;
+		}
+		uk_bench_timer_start(b);
+
+		p = (volatile char *)vaddr;
+		for (j = 0; j < pages; j++, p += PAGE_SIZE) {
+			if (write)
+				*p = 1;
+			else
+				(void)*p;
+		}
+
+		uk_bench_timer_stop(b);
+		rc = uk_vma_unmap(vas, vaddr, pages * PAGE_SIZE, 0);
+		if (unlikely(rc)) {
+			uk_bench_skip(b, "failed to unmap memory: %d", rc);
+			return;
+		}
+		uk_bench_timer_start(b);
+
+		i += pages;
+	}
+}
+
+UK_BENCHMARK_DESC(ukvmem_benchsuite, pagefault_read,
+		  "first read of an anonymous page")
+{
+	bench_pagefault(b, 0);
+}
+
+UK_BENCHMARK_DESC(ukvmem_benchsuite, pagefault_write,
+		  "first write to an anonymous page")
+{
+	bench_pagefault(b, 1);
+}
+
+uk_benchsuite_register(ukvmem_benchsuite, NULL);
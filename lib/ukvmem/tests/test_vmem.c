@@ -298,6 +298,65 @@ UK_TESTCASE(ukvmem, test_basic_vas_layout)
 	vas_clean(vas);
 }
 
+/**
+ * Tests lookups and the search for free address ranges with many VMAs, which
+ * exercises rebalancing of the VMA index when VMAs are added, split, merged,
+ * and removed.
+ */
+#define VMEM_TEST_NUM_VMAS 64
+UK_TESTCASE(ukvmem, test_vas_many_vmas)
+{
+	struct uk_vas *vas = vas_init();
+	const struct uk_vma *vma;
+	__vaddr_t va;
+	int i, rc;
+
+	/* Create VMAs with a one-page hole after each one */
+	for (i = VMEM_TEST_NUM_VMAS - 1; i >= 0; i--) {
+		va = MAPPING_BASE + 2 * i * PAGE_SIZE;
+		rc = uk_vma_reserve(vas, &va, PAGE_SIZE);
+		UK_TEST_EXPECT_ZERO(rc);
+	}
+
+	for (i = 0; i < VMEM_TEST_NUM_VMAS; i++) {
+		va = MAPPING_BASE + 2 * i * PAGE_SIZE;
+		vma = uk_vma_find(vas, va);
+		UK_TEST_EXPECT_NOT_NULL(vma);
+		UK_TEST_EXPECT_PTR_EQ((void *)(vma ? vma->start : 0),
+				      (void *)va);
+
+		UK_TEST_EXPECT_NULL(uk_vma_find(vas, va + PAGE_SIZE));
+	}
+
+	/* Too large for the holes */
+	va = __VADDR_ANY;
+	rc = uk_vma_reserve(vas, &va, 2 * PAGE_SIZE);
+	UK_TEST_EXPECT_ZERO(rc);
+	UK_TEST_EXPECT_PTR_EQ((void *)va, (void *)(MAPPING_BASE +
+			      (2 * VMEM_TEST_NUM_VMAS - 1) * PAGE_SIZE));
+
+	/* Fits the first hole */
+	va = __VADDR_ANY;
+	rc = uk_vma_reserve(vas, &va, PAGE_SIZE);
+	UK_TEST_EXPECT_ZERO(rc);
+	UK_TEST_EXPECT_PTR_EQ((void *)va, (void *)(MAPPING_BASE + PAGE_SIZE));
+
+	/* Punch a larger hole into the middle */
+	va = MAPPING_BASE + VMEM_TEST_NUM_VMAS * PAGE_SIZE;
+	rc = uk_vma_unmap(vas, va, 3 * PAGE_SIZE, 0);
+	UK_TEST_EXPECT_ZERO(rc);
+	UK_TEST_EXPECT_NULL(uk_vma_find(vas, va));
+
+	/* The new hole starts with the hole in front of the removed VMAs */
+	va = __VADDR_ANY;
+	rc = uk_vma_reserve(vas, &va, 3 * PAGE_SIZE);
+	UK_TEST_EXPECT_ZERO(rc);
+	UK_TEST_EXPECT_PTR_EQ((void *)va, (void *)(MAPPING_BASE +
+			      (VMEM_TEST_NUM_VMAS - 1) * PAGE_SIZE));
+
+	vas_clean(vas);
+}
+
 static inline int is_zero(__vaddr_t va, __sz len)
 {
 	unsigned long *p = (unsigned long *)va;
@@ -506,6 +565,53 @@ UK_TESTCASE(ukvmem, test_vma_anon_large)
 
 	vas_clean(vas);
 }
+
+#if CONFIG_LIBUKVMEM_LARGE_PAGE_IN_SIZE >= PAGE_LARGE_SHIFT
+/**
+ * Tests if anonymous mappings that prefer large pages are aligned and
+ * paged-in with large pages, while keeping the normal page granularity.
+ */
+UK_TESTCASE(ukvmem, test_vma_anon_large_pages)
+{
+	struct uk_vas *vas = vas_init();
+	__vaddr_t va;
+	unsigned int lvl;
+	int rc;
+	__sz len;
+
+	va = __VADDR_ANY;
+	rc = uk_vma_map_anon(vas, &va, PAGE_LARGE_SIZE + PAGE_SIZE, PROT_RW,
+			     UK_VMA_MAP_LARGE_PAGES, NULL);
+	UK_TEST_EXPECT_ZERO(rc);
+	UK_TEST_EXPECT(PAGE_LARGE_ALIGNED(va));
+
+	len = probe_rw(va, PAGE_LARGE_SIZE + PAGE_SIZE);
+	UK_TEST_EXPECT_SNUM_EQ(len, PAGE_LARGE_SIZE + PAGE_SIZE);
+
+	/* The first part fits into a large page, the rest does not */
+	lvl = PAGE_LEVEL;
+	rc = ukplat_pt_walk(vas->pt, va, &lvl, NULL, NULL);
+	vmem_bug_on(rc != 0);
+	UK_TEST_EXPECT_SNUM_EQ(lvl, PAGE_LARGE_LEVEL);
+
+	lvl = PAGE_LEVEL;
+	rc = ukplat_pt_walk(vas->pt, va + PAGE_LARGE_SIZE, &lvl, NULL, NULL);
+	vmem_bug_on(rc != 0);
+	UK_TEST_EXPECT_SNUM_EQ(lvl, PAGE_LEVEL);
+
+	/* Unlike with an enforced page size, we can split at any page */
+	rc = uk_vma_set_attr(vas, va + PAGE_SIZE, PAGE_SIZE, PROT_R, 0);
+	UK_TEST_EXPECT_ZERO(rc);
+
+	UK_TEST_EXPECT_ZERO(chk_vas(vas, (struct vma_entry[]){
+		{va, va + PAGE_SIZE, PROT_RW},
+		{va + PAGE_SIZE, va + 2 * PAGE_SIZE, PROT_R},
+		{va + 2 * PAGE_SIZE, va + PAGE_LARGE_SIZE + PAGE_SIZE, PROT_RW},
+	}, 3));
+
+	vas_clean(vas);
+}
+#endif /* CONFIG_LIBUKVMEM_LARGE_PAGE_IN_SIZE >= PAGE_LARGE_SHIFT */
 #endif /* PAGE_LARGE_SHIFT */
 
 /**
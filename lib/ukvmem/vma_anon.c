@@ -28,33 +28,46 @@ static __vaddr_t vma_op_anon_get_base(struct uk_vas *vas __unused,
 }
 #endif /* CONFIG_LIBUKVMEM_ANON_BASE */
 
-static int vma_op_anon_fault(struct uk_vma *vma, struct uk_vm_fault *fault)
+int vma_anon_falloc(struct uk_vma *vma, __paddr_t *paddr, unsigned long pages,
+		    unsigned long flags)
 {
 	struct uk_pagetable * const pt = vma->vas->pt;
-	unsigned long pages = fault->len / PAGE_SIZE;
-	__paddr_t paddr = __PADDR_ANY;
 	__vaddr_t vaddr;
 	int rc;
 
-	UK_ASSERT(PAGE_ALIGNED(fault->len));
-	UK_ASSERT(fault->len == PAGE_Lx_SIZE(fault->level));
-	UK_ASSERT(fault->type & UK_VMA_FAULT_NONPRESENT);
-
-	rc = pt->fa->falloc(pt->fa, &paddr, pages, FALLOC_FLAG_ALIGNED);
+	*paddr = __PADDR_ANY;
+	rc = pt->fa->falloc(pt->fa, paddr, pages, flags);
 	if (unlikely(rc))
 		return rc;
 
 	if (!(vma->flags & UK_VMA_FLAG_UNINITIALIZED)) {
-		vaddr = ukplat_page_kmap(pt, paddr, pages, 0);
+		vaddr = ukplat_page_kmap(pt, *paddr, pages, 0);
 		if (unlikely(vaddr == __VADDR_INV)) {
-			pt->fa->ffree(pt->fa, paddr, pages);
+			pt->fa->ffree(pt->fa, *paddr, pages);
 			return -ENOMEM;
 		}
 
-		memset_isr((void *)vaddr, 0, fault->len);
+		memset_isr((void *)vaddr, 0, pages * PAGE_SIZE);
 		ukplat_page_kunmap(pt, vaddr, pages, 0);
 	}
 
+	return 0;
+}
+
+static int vma_op_anon_fault(struct uk_vma *vma, struct uk_vm_fault *fault)
+{
+	unsigned long pages = fault->len / PAGE_SIZE;
+	__paddr_t paddr;
+	int rc;
+
+	UK_ASSERT(PAGE_ALIGNED(fault->len));
+	UK_ASSERT(fault->len == PAGE_Lx_SIZE(fault->level));
+	UK_ASSERT(fault->type & UK_VMA_FAULT_NONPRESENT);
+
+	rc = vma_anon_falloc(vma, &paddr, pages, FALLOC_FLAG_ALIGNED);
+	if (unlikely(rc))
+		return rc;
+
 	fault->paddr = paddr;
 	return 0;
 }
@@ -20,6 +20,7 @@
 #include <vfscore/file.h>
 #include <vfscore/vnode.h>
 #include <vfscore/uio.h>
+#include <vfscore/pagecache.h>
 #include <uk/isr/string.h>
 
 #ifdef CONFIG_LIBUKVMEM_FILE_BASE
@@ -70,6 +71,12 @@ int vma_op_file_new(struct uk_vas *vas, __vaddr_t vaddr __unused,
 		return -EBADF;
 	}
 	vma_file->offset = args->offset;
+#if CONFIG_LIBUKVMEM_FILE_READAHEAD
+	vma_file->ra_buf  = __NULL;
+	vma_file->ra_len  = 0;
+	vma_file->ra_win  = 0;
+	vma_file->ra_next = -1;
+#endif /* CONFIG_LIBUKVMEM_FILE_READAHEAD */
 
 	/* Use the file name as VMA name. Since the memory management of the
 	 * string is tied to the file object, we do not need to care about
@@ -89,6 +96,11 @@ static void vma_op_file_destroy(struct uk_vma *vma)
 
 	UK_ASSERT(vma_file->f);
 	fdrop(vma_file->f);
+
+#if CONFIG_LIBUKVMEM_FILE_READAHEAD
+	if (vma_file->ra_buf)
+		uk_free(vma->vas->a, vma_file->ra_buf);
+#endif /* CONFIG_LIBUKVMEM_FILE_READAHEAD */
 }
 
 static int vma_file_read(struct vfscore_file *fp, __vaddr_t buf, __sz len,
@@ -109,7 +121,13 @@ static int vma_file_read(struct vfscore_file *fp, __vaddr_t buf, __sz len,
 	int rc;
 
 	vn_lock(vp);
-	rc = VOP_READ(vp, fp, &uio, 0);
+	/* Go through the page cache so that mappings of the same file share
+	 * their loads from the file system
+	 */
+	if (vfscore_pagecache_enabled(vp))
+		rc = vfscore_pagecache_read(fp, &uio);
+	else
+		rc = VOP_READ(vp, fp, &uio, 0);
 	vn_unlock(vp);
 
 	if (unlikely(rc))
@@ -121,6 +139,83 @@ static int vma_file_read(struct vfscore_file *fp, __vaddr_t buf, __sz len,
 	return 0;
 }
 
+#if CONFIG_LIBUKVMEM_FILE_READAHEAD
+#define RA_MAX_LEN	((__sz)CONFIG_LIBUKVMEM_FILE_READAHEAD << 10)
+
+/**
+ * Reads `len` bytes at file offset `off` that are loaded into a page of the
+ * VMA. Consecutive loads grow a read-ahead window so that the file is read
+ * with few large requests, with the following pages being served from the
+ * read-ahead buffer.
+ */
+static int vma_file_read_ahead(struct uk_vma_file *vma_file, __vaddr_t buf,
+			       __sz len, __off off, __sz *bytes)
+{
+	struct uk_vma *vma = &vma_file->base;
+	__off vma_end = vma_file->offset + (__off)vmem_vma_len(vma);
+	__sz win, cnt;
+	int rc;
+
+	/* Pages as large as the maximum window are read directly */
+	if (len >= RA_MAX_LEN)
+		goto read_direct;
+
+	if (!vma_file->ra_buf || off < vma_file->ra_off ||
+	    off + (__off)len > vma_file->ra_off + (__off)vma_file->ra_len) {
+		/* Grow the window for sequential loads, restart otherwise */
+		if (off == vma_file->ra_next)
+			win = MIN(MAX(vma_file->ra_win * 2, len), RA_MAX_LEN);
+		else
+			win = len;
+		vma_file->ra_win = win;
+		vma_file->ra_next = off + (__off)len;
+
+		/* Do not read beyond the end of the VMA */
+		win = MIN(win, (__sz)(vma_end - off));
+		if (win <= len)
+			goto read_direct;
+
+		if (!vma_file->ra_buf) {
+			vma_file->ra_buf = uk_malloc(vma->vas->a, RA_MAX_LEN);
+			if (unlikely(!vma_file->ra_buf))
+				goto read_direct;
+		}
+
+		rc = vma_file_read(vma_file->f, (__vaddr_t)vma_file->ra_buf,
+				   win, off, &cnt);
+		if (unlikely(rc)) {
+			vma_file->ra_len = 0;
+			return rc;
+		}
+
+		vma_file->ra_off = off;
+		vma_file->ra_len = cnt;
+	} else {
+		vma_file->ra_next = off + (__off)len;
+	}
+
+	/* The file may end within the buffered range */
+	cnt = MIN(len, vma_file->ra_len - (__sz)(off - vma_file->ra_off));
+	memcpy_isr((void *)buf,
+		   (char *)vma_file->ra_buf + (off - vma_file->ra_off), cnt);
+	*bytes = cnt;
+
+	/* Release the buffer once everything up to the end of the VMA has
+	 * been loaded, which completes the population of the mapping
+	 */
+	if (off + (__off)len >= vma_end) {
+		uk_free(vma->vas->a, vma_file->ra_buf);
+		vma_file->ra_buf = __NULL;
+		vma_file->ra_len = 0;
+	}
+	return 0;
+
+read_direct:
+	vma_file->ra_next = off + (__off)len;
+	return vma_file_read(vma_file->f, buf, len, off, bytes);
+}
+#endif /* CONFIG_LIBUKVMEM_FILE_READAHEAD */
+
 static int vma_op_file_fault(struct uk_vma *vma, struct uk_vm_fault *fault)
 {
 	struct uk_vma_file *vma_file = (struct uk_vma_file *)vma;
@@ -149,7 +244,12 @@ static int vma_op_file_fault(struct uk_vma *vma, struct uk_vm_fault *fault)
 
 		off = (fault->vbase - vma->start) + vma_file->offset;
 
+#if CONFIG_LIBUKVMEM_FILE_READAHEAD
+		rc = vma_file_read_ahead(vma_file, vaddr, fault->len, off,
+					 &bytes);
+#else /* !CONFIG_LIBUKVMEM_FILE_READAHEAD */
 		rc = vma_file_read(vma_file->f, vaddr, fault->len, off, &bytes);
+#endif /* !CONFIG_LIBUKVMEM_FILE_READAHEAD */
 		if (unlikely(rc)) {
 			ukplat_page_kunmap(pt, vaddr, pages, 0);
 			pt->fa->ffree(pt->fa, paddr, pages);
@@ -188,6 +288,13 @@ static int vma_op_file_split(struct uk_vma *vma, __vaddr_t vaddr,
 	fhold(vma_file->f);
 	v->f = vma_file->f;
 
+#if CONFIG_LIBUKVMEM_FILE_READAHEAD
+	v->ra_buf  = __NULL;
+	v->ra_len  = 0;
+	v->ra_win  = 0;
+	v->ra_next = -1;
+#endif /* CONFIG_LIBUKVMEM_FILE_READAHEAD */
+
 	UK_ASSERT(new_vma);
 	*new_vma = &v->base;
 
@@ -0,0 +1,301 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * Index of the VMAs of a VAS
+ *
+ * The VMAs are kept in an AVL tree ordered by address. Every node
+ * additionally stores the address range and the largest gap between the VMAs
+ * of its subtree, so that lookups and first-fit searches for free address
+ * ranges need O(log n) steps instead of a walk over the VMA list.
+ */
+#include <stddef.h>
+
+#include "vmem.h"
+
+#include <uk/essentials.h>
+#include <uk/assert.h>
+
+#define VMA_NODE(vma)	(&(vma)->vma_node)
+
+static inline int vma_tree_height(struct uk_vma *vma)
+{
+	return vma ? VMA_NODE(vma)->height : 0;
+}
+
+/* Recomputes the height and the augmented data of a node from its children */
+static void vma_tree_pull(struct uk_vma *vma)
+{
+	struct uk_vma_node *n = VMA_NODE(vma);
+	struct uk_vma *l = n->left;
+	struct uk_vma *r = n->right;
+
+	n->height = MAX(vma_tree_height(l), vma_tree_height(r)) + 1;
+	n->sub_start = l ? VMA_NODE(l)->sub_start : vma->start;
+	n->sub_end = r ? VMA_NODE(r)->sub_end : vma->end;
+
+	n->max_gap = 0;
+	if (l)
+		n->max_gap = MAX(VMA_NODE(l)->max_gap,
+				 vma->start - VMA_NODE(l)->sub_end);
+	if (r) {
+		n->max_gap = MAX(n->max_gap, VMA_NODE(r)->max_gap);
+		n->max_gap = MAX(n->max_gap,
+				 VMA_NODE(r)->sub_start - vma->end);
+	}
+}
+
+/* Replaces the child `old` of `parent` with `new` */
+static void vma_tree_replace(struct uk_vas *vas, struct uk_vma *parent,
+			     struct uk_vma *old, struct uk_vma *new)
+{
+	if (!parent)
+		vas->vma_root = new;
+	else if (VMA_NODE(parent)->left == old)
+		VMA_NODE(parent)->left = new;
+	else
+		VMA_NODE(parent)->right = new;
+
+	if (new)
+		VMA_NODE(new)->parent = parent;
+}
+
+static struct uk_vma *vma_tree_rotate_left(struct uk_vas *vas,
+					   struct uk_vma *vma)
+{
+	struct uk_vma *r = VMA_NODE(vma)->right;
+
+	vma_tree_replace(vas, VMA_NODE(vma)->parent, vma, r);
+
+	VMA_NODE(vma)->right = VMA_NODE(r)->left;
+	if (VMA_NODE(vma)->right)
+		VMA_NODE(VMA_NODE(vma)->right)->parent = vma;
+
+	VMA_NODE(r)->left = vma;
+	VMA_NODE(vma)->parent = r;
+
+	vma_tree_pull(vma);
+	vma_tree_pull(r);
+	return r;
+}
+
+static struct uk_vma *vma_tree_rotate_right(struct uk_vas *vas,
+					    struct uk_vma *vma)
+{
+	struct uk_vma *l = VMA_NODE(vma)->left;
+
+	vma_tree_replace(vas, VMA_NODE(vma)->parent, vma, l);
+
+	VMA_NODE(vma)->left = VMA_NODE(l)->right;
+	if (VMA_NODE(vma)->left)
+		VMA_NODE(VMA_NODE(vma)->left)->parent = vma;
+
+	VMA_NODE(l)->right = vma;
+	VMA_NODE(vma)->parent = l;
+
+	vma_tree_pull(vma);
+	vma_tree_pull(l);
+	return l;
+}
+
+/* Balances the subtree of `vma` and returns its new root */
+static struct uk_vma *vma_tree_balance(struct uk_vas *vas, struct uk_vma *vma)
+{
+	struct uk_vma *l = VMA_NODE(vma)->left;
+	struct uk_vma *r = VMA_NODE(vma)->right;
+	int bf = vma_tree_height(l) - vma_tree_height(r);
+
+	if (bf > 1) {
+		if (vma_tree_height(VMA_NODE(l)->left) <
+		    vma_tree_height(VMA_NODE(l)->right))
+			vma_tree_rotate_left(vas, l);
+		return vma_tree_rotate_right(vas, vma);
+	}
+
+	if (bf < -1) {
+		if (vma_tree_height(VMA_NODE(r)->right) <
+		    vma_tree_height(VMA_NODE(r)->left))
+			vma_tree_rotate_right(vas, r);
+		return vma_tree_rotate_left(vas, vma);
+	}
+
+	vma_tree_pull(vma);
+	return vma;
+}
+
+/* Restores balance and augmented data from `vma` up to the root */
+static void vma_tree_fixup(struct uk_vas *vas, struct uk_vma *vma)
+{
+	while (vma) {
+		vma = vma_tree_balance(vas, vma);
+		vma = VMA_NODE(vma)->parent;
+	}
+}
+
+struct uk_vma *vmem_vma_tree_insert(struct uk_vas *vas, struct uk_vma *vma)
+{
+	struct uk_vma **link = &vas->vma_root;
+	struct uk_vma *parent = __NULL;
+	struct uk_vma *prev = __NULL;
+
+	UK_ASSERT(vas);
+	UK_ASSERT(vma);
+
+	while (*link) {
+		parent = *link;
+		if (vma->start < parent->start) {
+			link = &VMA_NODE(parent)->left;
+		} else {
+			prev = parent;
+			link = &VMA_NODE(parent)->right;
+		}
+	}
+
+	VMA_NODE(vma)->parent = parent;
+	VMA_NODE(vma)->left = __NULL;
+	VMA_NODE(vma)->right = __NULL;
+	*link = vma;
+
+	vma_tree_fixup(vas, vma);
+	return prev;
+}
+
+void vmem_vma_tree_remove(struct uk_vas *vas, struct uk_vma *vma)
+{
+	struct uk_vma *l = VMA_NODE(vma)->left;
+	struct uk_vma *r = VMA_NODE(vma)->right;
+	struct uk_vma *parent = VMA_NODE(vma)->parent;
+	struct uk_vma *succ, *fix;
+
+	UK_ASSERT(vas);
+
+	if (vas->vma_cache == vma)
+		vas->vma_cache = __NULL;
+
+	if (!l || !r) {
+		vma_tree_replace(vas, parent, vma, l ? l : r);
+		fix = parent;
+	} else {
+		/* Replace the VMA with its successor */
+		succ = r;
+		while (VMA_NODE(succ)->left)
+			succ = VMA_NODE(succ)->left;
+
+		if (succ != r) {
+			fix = VMA_NODE(succ)->parent;
+			vma_tree_replace(vas, fix, succ,
+					 VMA_NODE(succ)->right);
+
+			VMA_NODE(succ)->right = r;
+			VMA_NODE(r)->parent = succ;
+		} else {
+			fix = succ;
+		}
+
+		VMA_NODE(succ)->left = l;
+		VMA_NODE(l)->parent = succ;
+		vma_tree_replace(vas, parent, vma, succ);
+	}
+
+	vma_tree_fixup(vas, fix);
+}
+
+void vmem_vma_tree_update(struct uk_vas *vas, struct uk_vma *vma)
+{
+	vma_tree_fixup(vas, vma);
+}
+
+struct uk_vma *vmem_vma_tree_lookup(struct uk_vas *vas, __vaddr_t vaddr)
+{
+	struct uk_vma *vma = vas->vma_root;
+	struct uk_vma *found = __NULL;
+
+	while (vma) {
+		if (vma->end > vaddr) {
+			found = vma;
+			vma = VMA_NODE(vma)->left;
+		} else {
+			vma = VMA_NODE(vma)->right;
+		}
+	}
+
+	return found;
+}
+
+/* Returns the lowest address from `vaddr` on, aligned to `align`, where `len`
+ * bytes fit below `limit`
+ */
+static __vaddr_t vma_tree_fit_below(__vaddr_t vaddr, __vaddr_t limit,
+				    __sz align, __sz len)
+{
+	/* We are scanning for an empty address range, so we need to be careful
+	 * not to overflow. Checks are thus always active and not just asserts.
+	 */
+	if (unlikely(vaddr > __VADDR_MAX - align))
+		return __VADDR_INV;
+
+	vaddr = ALIGN_UP(vaddr, align);
+
+	if (unlikely(vaddr > __VADDR_MAX - len))
+		return __VADDR_INV;
+
+	return (vaddr + len <= limit) ? vaddr : __VADDR_INV;
+}
+
+/* Searches the subtree of `vma` in address order for the first free range.
+ * `*vaddr` is the lowest free address in front of the subtree. If nothing
+ * fits, it is advanced past the subtree.
+ */
+static __vaddr_t vma_tree_fit(struct uk_vma *vma, __vaddr_t *vaddr,
+			      __sz align, __sz len)
+{
+	struct uk_vma_node *n;
+	__vaddr_t va;
+
+	if (!vma)
+		return __VADDR_INV;
+
+	/* Skip subtrees below the search range and subtrees with neither a
+	 * large enough gap in front of them nor between their VMAs
+	 */
+	n = VMA_NODE(vma);
+	if (n->sub_end <= *vaddr ||
+	    (n->max_gap < len &&
+	     (n->sub_start <= *vaddr || n->sub_start - *vaddr < len))) {
+		*vaddr = MAX(*vaddr, n->sub_end);
+		return __VADDR_INV;
+	}
+
+	va = vma_tree_fit(n->left, vaddr, align, len);
+	if (va != __VADDR_INV)
+		return va;
+
+	va = vma_tree_fit_below(*vaddr, vma->start, align, len);
+	if (va != __VADDR_INV)
+		return va;
+
+	*vaddr = MAX(*vaddr, vma->end);
+	return vma_tree_fit(n->right, vaddr, align, len);
+}
+
+__vaddr_t vmem_vma_tree_first_fit(struct uk_vas *vas, __vaddr_t base,
+				  __sz align, __sz len)
+{
+	__vaddr_t vaddr = base;
+	__vaddr_t va;
+
+	UK_ASSERT(vas);
+
+	va = vma_tree_fit(vas->vma_root, &vaddr, align, len);
+	if (va != __VADDR_INV)
+		return va;
+
+	/* Behind the last VMA */
+	if (unlikely(vaddr > __VADDR_MAX - align))
+		return __VADDR_INV;
+
+	return ALIGN_UP(vaddr, align);
+}
@@ -18,7 +18,11 @@
 #include <uk/alloc.h>
 #include <uk/assert.h>
 #include <uk/list.h>
+#include <uk/print.h>
 #include <uk/config.h>
+#include <uk/falloc.h>
+#include <uk/vma_types.h>
+#include <uk/isr/string.h>
 
 /*
  * Pointer to currently active virtual address space.
@@ -68,6 +72,8 @@ int uk_vas_init(struct uk_vas *vas, struct uk_pagetable *pt __maybe_unused,
 	vas->flags = 0;
 
 	UK_INIT_LIST_HEAD(&vas->vma_list);
+	vas->vma_root = __NULL;
+	vas->vma_cache = __NULL;
 
 	return 0;
 }
@@ -82,6 +88,7 @@ void uk_vas_destroy(struct uk_vas *vas)
 	}
 
 	UK_ASSERT(uk_list_empty(&vas->vma_list));
+	UK_ASSERT(!vas->vma_root);
 
 	if (vmem_active_vas == vas)
 		vmem_active_vas = __NULL;
@@ -102,6 +109,7 @@ static void vmem_vma_unlink_and_free(struct uk_vma *vma)
 	UK_ASSERT(vma);
 	UK_ASSERT(!uk_list_empty(&vma->vma_list));
 
+	vmem_vma_tree_remove(vma->vas, vma);
 	uk_list_del(&vma->vma_list);
 	vmem_vma_destroy(vma);
 }
@@ -116,12 +124,17 @@ static struct uk_vma *vmem_vma_find(struct uk_vas *vas, __vaddr_t vaddr,
 	UK_ASSERT(vas);
 	UK_ASSERT(vaddr <= __VADDR_MAX - len);
 
-	uk_list_for_each_entry(vma, &vas->vma_list, vma_list) {
-		if ((vend > vma->start) && (vstart < vma->end))
-			return vma;
+	/* Consecutive lookups, e.g., page faults, often hit the same VMA */
+	vma = vas->vma_cache;
+	if (!vma || vstart < vma->start || vstart >= vma->end) {
+		vma = vmem_vma_tree_lookup(vas, vstart);
+		if (!vma)
+			return __NULL;
+
+		vas->vma_cache = vma;
 	}
 
-	return __NULL;
+	return (vend > vma->start) ? vma : __NULL;
 }
 
 const struct uk_vma *uk_vma_find(struct uk_vas *vas, __vaddr_t vaddr)
@@ -227,26 +240,35 @@ static int vmem_vma_find_range(struct uk_vas *vas, __vaddr_t *vaddr, __sz *len,
 
 static void vmem_vma_insert(struct uk_vas *vas, struct uk_vma *vma)
 {
-	struct uk_list_head *prev;
-	struct uk_vma *cur;
+	struct uk_vma *prev;
 
 	UK_ASSERT(vas);
 	UK_ASSERT(uk_list_empty(&vma->vma_list));
 	UK_ASSERT(!vmem_vma_find(vas, vma->start, vma->end - vma->start));
 
-	prev = &vas->vma_list;
-	uk_list_for_each_entry(cur, &vas->vma_list, vma_list) {
-		if (vma->start < cur->end) {
-			UK_ASSERT(vma->end <= cur->start);
+	prev = vmem_vma_tree_insert(vas, vma);
+	uk_list_add(&vma->vma_list, prev ? &prev->vma_list : &vas->vma_list);
+}
 
-			uk_list_add(&vma->vma_list, prev);
-			return;
-		}
+/* Unlinks all VMAs from start to end without freeing them */
+static void vmem_vma_unlink_vmas(struct uk_vas *vas, struct uk_vma *start,
+				 struct uk_vma *end)
+{
+	struct uk_vma *vma = start;
+
+	UK_ASSERT(start);
+	UK_ASSERT(end);
 
-		prev = &cur->vma_list;
+	for (;;) {
+		vmem_vma_tree_remove(vas, vma);
+		if (vma == end)
+			break;
+
+		vma = uk_list_next_entry(vma, vma_list);
 	}
 
-	uk_list_add_tail(&vma->vma_list, &vas->vma_list);
+	start->vma_list.prev->next = end->vma_list.next;
+	end->vma_list.next->prev   = start->vma_list.prev;
 }
 
 static inline int vmem_vma_can_merge(struct uk_vma *vma, struct uk_vma *next)
@@ -258,7 +280,7 @@ static inline int vmem_vma_can_merge(struct uk_vma *vma, struct uk_vma *next)
 	return ((vma->end == next->start) &&
 		(vma->ops == next->ops) &&
 		(vma->attr == next->attr) &&
-		(vma->flags == next->flags) &&
+		((vma->flags ^ next->flags) & ~UK_VMA_FLAG_LAZYFREE) == 0 &&
 		(vma->page_lvl == next->page_lvl) &&
 		(vma->name == next->name));
 }
@@ -284,9 +306,11 @@ static int vmem_vma_do_try_merge_with_next(struct uk_vma *vma)
 
 	/* Expand the VMA to include the next VMA */
 	vma->end = next->end;
+	vma->flags |= next->flags;
 
 	/* Remove and destroy the next VMA. However, we keep the mapping! */
 	vmem_vma_unlink_and_free(next);
+	vmem_vma_tree_update(vma->vas, vma);
 
 	return 0;
 }
@@ -353,6 +377,8 @@ static int vmem_vma_split(struct uk_vma *vma, __vaddr_t vaddr,
 	vma->end	= vaddr;
 
 	uk_list_add(&v->vma_list, &vma->vma_list);
+	vmem_vma_tree_update(vma->vas, vma);
+	vmem_vma_tree_insert(vma->vas, v);
 
 	*new_vma = v;
 	return 0;
@@ -511,10 +537,7 @@ int uk_vma_unmap(struct uk_vas *vas, __vaddr_t vaddr, __sz len,
 		return rc;
 	}
 
-	/* Unlink all VMAs starting from vma_start to vma_end */
-	vma_start->vma_list.prev->next = vma_end->vma_list.next;
-	vma_end->vma_list.next->prev   = vma_start->vma_list.prev;
-
+	vmem_vma_unlink_vmas(vas, vma_start, vma_end);
 	vmem_vma_unmap_and_free_vmas(vma_start, vma_end);
 
 	return 0;
@@ -523,41 +546,68 @@ int uk_vma_unmap(struct uk_vas *vas, __vaddr_t vaddr, __sz len,
 static __vaddr_t vmem_first_fit(struct uk_vas *vas, __vaddr_t base, __sz align,
 				__sz len)
 {
-	__vaddr_t vaddr = base;
-	struct uk_vma *cur;
+	return vmem_vma_tree_first_fit(vas, base, align, len);
+}
 
-	UK_ASSERT(vas);
+struct mapx_populate_ctx {
+	/** VMA to populate */
+	struct uk_vma *vma;
+	/** End of the populated address range */
+	__vaddr_t end;
+	/** Cleared frames allocated in advance for small anonymous pages */
+	__paddr_t paddr;
+	/** Number of frames left in advance */
+	unsigned long frames;
+};
 
-	/* Since we are scanning the VAS for an empty address range, we need
-	 * to be careful not to overflow. Checks are thus always active and not
-	 * just asserts.
-	 */
-	uk_list_for_each_entry(cur, &vas->vma_list, vma_list) {
-		if (unlikely(vaddr > __VADDR_MAX - align))
-			return __VADDR_INV;
+/* Allocates frames for the small pages from vaddr to the end of the range or
+ * the next large page boundary, whatever comes first. The page table code
+ * only maps small pages there, so that all frames are used unless pages are
+ * present already.
+ */
+static void vmem_populate_batch(struct mapx_populate_ctx *ctx,
+				__vaddr_t vaddr)
+{
+	__vaddr_t end;
+	unsigned long pages;
 
-		vaddr = ALIGN_UP(vaddr, align);
+	UK_ASSERT(ctx->frames == 0);
 
-		if (unlikely(vaddr > __VADDR_MAX - len))
-			return __VADDR_INV;
+	end = PAGE_Lx_ALIGN_DOWN(vaddr, PAGE_LEVEL + 1);
+	if (end <= __VADDR_MAX - PAGE_Lx_SIZE(PAGE_LEVEL + 1))
+		end = MIN(end + PAGE_Lx_SIZE(PAGE_LEVEL + 1), ctx->end);
+	else
+		end = ctx->end;
 
-		if (vaddr + len <= cur->start)
-			return vaddr;
+	pages = (end - vaddr) >> PAGE_SHIFT;
+	if (pages <= 1)
+		return;
 
-		vaddr = MAX(cur->end, base);
-	}
+	/* Fall back to allocating each page on its own */
+	if (unlikely(vma_anon_falloc(ctx->vma, &ctx->paddr, pages, 0)))
+		return;
+
+	ctx->frames = pages;
+}
 
-	if (unlikely(vaddr > __VADDR_MAX - align))
-		return __VADDR_INV;
+/* Frees the frames not used by the population */
+static void vmem_populate_release(struct mapx_populate_ctx *ctx)
+{
+	struct uk_pagetable *pt = ctx->vma->vas->pt;
 
-	return ALIGN_UP(vaddr, align);
+	if (!ctx->frames)
+		return;
+
+	pt->fa->ffree(pt->fa, ctx->paddr, ctx->frames);
+	ctx->frames = 0;
 }
 
 static int vmem_mapx_populate(struct uk_pagetable *pt __unused,
 			      __vaddr_t vaddr, __vaddr_t pt_vaddr __unused,
 			      unsigned int level, __pte_t *pte, void *user)
 {
-	struct uk_vma *vma = (struct uk_vma *)user;
+	struct mapx_populate_ctx *ctx = (struct mapx_populate_ctx *)user;
+	struct uk_vma *vma = ctx->vma;
 	struct uk_vm_fault fault = {
 		.vaddr = vaddr,
 		.vbase = vaddr,
@@ -573,6 +623,21 @@ static int vmem_mapx_populate(struct uk_pagetable *pt __unused,
 	UK_ASSERT(vma->ops);
 	UK_ASSERT(vma->ops->fault);
 
+	/* Take small anonymous pages from a single allocation instead of
+	 * going through the fault handler for each page
+	 */
+	if (level == PAGE_LEVEL && vma->ops == &uk_vma_anon_ops) {
+		if (!ctx->frames)
+			vmem_populate_batch(ctx, vaddr);
+
+		if (ctx->frames) {
+			*pte = PT_Lx_PTE_SET_PADDR(*pte, level, ctx->paddr);
+			ctx->paddr += PAGE_SIZE;
+			ctx->frames--;
+			return 0;
+		}
+	}
+
 	rc = vma->ops->fault(vma, &fault);
 	if (unlikely(rc)) {
 		if (rc == -ENOMEM)
@@ -588,18 +653,33 @@ static int vmem_mapx_populate(struct uk_pagetable *pt __unused,
 	return 0;
 }
 
+/* Largest page level for VMAs preferring large pages that fits into len */
+static inline unsigned int vmem_large_page_lvl(__sz len)
+{
+	unsigned int lvl =
+		PAGE_SHIFT_Lx(CONFIG_LIBUKVMEM_LARGE_PAGE_IN_SIZE);
+
+	while (lvl > PAGE_LEVEL &&
+	       (!PAGE_Lx_HAS(lvl) || PAGE_Lx_SIZE(lvl) > len))
+		lvl--;
+
+	return lvl;
+}
+
 int uk_vma_map(struct uk_vas *vas, __vaddr_t *vaddr, __sz len,
 	       unsigned long attr, unsigned long flags, const char *name,
 	       const struct uk_vma_ops *ops, void *args)
 {
 	unsigned int order = UK_VMA_MAP_SIZE_TO_ORDER(flags);
 	int rc, to_lvl, algn_lvl, strict;
+	unsigned int lvl;
 	struct uk_vma *vma_start = __NULL;
 	struct uk_vma *vma_end = __NULL;
 	struct uk_vma *vma = __NULL;
 	unsigned long extf;
 	unsigned long flgs;
 	__vaddr_t va, base;
+	struct mapx_populate_ctx ctx = { 0 };
 
 	UK_ASSERT(vas);
 	UK_ASSERT(vaddr);
@@ -629,7 +709,21 @@ int uk_vma_map(struct uk_vas *vas, __vaddr_t *vaddr, __sz len,
 		base = (ops->get_base) ? ops->get_base(vas, args, flags) :
 					 vas->vma_base;
 
-		va = vmem_first_fit(vas, base, PAGE_Lx_SIZE(algn_lvl), len);
+		va = __VADDR_INV;
+
+		/* Try to align areas that prefer large pages, so that they
+		 * can actually be backed with large pages.
+		 */
+		if ((flags & UK_VMA_MAP_LARGE_PAGES) && order == 0) {
+			lvl = vmem_large_page_lvl(len);
+			if (lvl > (unsigned int)algn_lvl)
+				va = vmem_first_fit(vas, base,
+						    PAGE_Lx_SIZE(lvl), len);
+		}
+
+		if (va == __VADDR_INV)
+			va = vmem_first_fit(vas, base, PAGE_Lx_SIZE(algn_lvl),
+					    len);
 		if (unlikely(va == __VADDR_INV))
 			return -ENOMEM;
 	} else {
@@ -689,10 +783,7 @@ int uk_vma_map(struct uk_vas *vas, __vaddr_t *vaddr, __sz len,
 	if (vma_start) {
 		UK_ASSERT(vma_end);
 
-		/* Unlink all VMAs starting from vma_start to vma_end */
-		vma_start->vma_list.prev->next = vma_end->vma_list.next;
-		vma_end->vma_list.next->prev   = vma_start->vma_list.prev;
-
+		vmem_vma_unlink_vmas(vas, vma_start, vma_end);
 		vmem_vma_unmap_and_free_vmas(vma_start, vma_end);
 	}
 
@@ -715,6 +806,9 @@ int uk_vma_map(struct uk_vas *vas, __vaddr_t *vaddr, __sz len,
 	if (flags & UK_VMA_MAP_UNINITIALIZED)
 		vma->flags |= UK_VMA_FLAG_UNINITIALIZED;
 
+	if ((flags & UK_VMA_MAP_LARGE_PAGES) && order == 0)
+		vma->flags |= UK_VMA_FLAG_LARGE_PAGES;
+
 	if (flags & UK_VMA_MAP_POPULATE) {
 		UK_ASSERT(vma->ops->fault);
 
@@ -726,13 +820,17 @@ int uk_vma_map(struct uk_vas *vas, __vaddr_t *vaddr, __sz len,
 			flgs = 0;
 		}
 
+		ctx.vma = vma;
+		ctx.end = vma->end;
+
 		rc = ukplat_page_mapx(vas->pt, vma->start, 0,
 				      len >> PAGE_Lx_SHIFT(algn_lvl),
 				      vma->attr, flgs,
 				      &(struct ukplat_page_mapx){
 						.map = vmem_mapx_populate,
-						.ctx = vma,
+						.ctx = &ctx,
 				      });
+		vmem_populate_release(&ctx);
 		if (unlikely(rc)) {
 			/* If the address range replaces existing mappings, we
 			 * have an unrecoverable error and the address range
@@ -857,9 +955,123 @@ static int vmem_mapx_advise(struct uk_pagetable *pt,
 	return vmem_mapx_populate(pt, vaddr, pt_vaddr, level, pte, user);
 }
 
+/* Write-protects lazily freed pages. A write fault makes a page writable
+ * again, so that all pages that are still write-protected on reclaim have not
+ * been written to since and can be freed.
+ */
+static int vmem_vma_lazyfree(struct uk_vma *vma, __vaddr_t vaddr, __sz len)
+{
+	unsigned long pages;
+	unsigned long flgs;
+	int rc;
+
+	/* Other VMAs may not discard their contents */
+	if (vma->ops != &uk_vma_anon_ops)
+		return 0;
+
+	/* Read-only memory cannot be written to again, so free it now */
+	if (!(vma->attr & PAGE_ATTR_PROT_WRITE))
+		return vma_op_unmap(vma, vaddr, len);
+
+	pages = vmem_len_to_pages(vma, len, &flgs);
+	rc = ukplat_page_set_attr(vma->vas->pt, vaddr, pages,
+				  vma->attr & ~PAGE_ATTR_PROT_WRITE, flgs);
+	if (unlikely(rc))
+		return rc;
+
+	vma->flags |= UK_VMA_FLAG_LAZYFREE;
+	return 0;
+}
+
+/* Makes a lazily freed page writable again on a write access */
+static int vmem_vma_lazyfree_cancel(struct uk_vma *vma, __vaddr_t vaddr)
+{
+	struct uk_pagetable *pt = vma->vas->pt;
+	unsigned int lvl = PAGE_LEVEL;
+	__pte_t pte;
+	int rc;
+
+	rc = ukplat_pt_walk(pt, vaddr, &lvl, __NULL, &pte);
+	if (unlikely(rc || !PT_Lx_PTE_PRESENT(pte, lvl) ||
+		     !PAGE_Lx_IS(pte, lvl)))
+		return -EFAULT;
+
+	return ukplat_page_set_attr(pt, PAGE_Lx_ALIGN_DOWN(vaddr, lvl), 1,
+				    vma->attr, PAGE_FLAG_SIZE(lvl));
+}
+
+/* Unmaps the pages of a VMA that were lazily freed and not written to since.
+ * Returns the number of bytes freed.
+ */
+static __sz vmem_vma_reclaim(struct uk_vma *vma)
+{
+	struct uk_pagetable *pt = vma->vas->pt;
+	__vaddr_t vaddr = vma->start;
+	__vaddr_t run_start = 0, run_end = 0;
+	unsigned int lvl;
+	__sz freed = 0;
+	__pte_t pte;
+	int rc;
+
+	UK_ASSERT(vma->flags & UK_VMA_FLAG_LAZYFREE);
+	UK_ASSERT(vma->attr & PAGE_ATTR_PROT_WRITE);
+
+	while (vaddr < vma->end) {
+		lvl = PAGE_LEVEL;
+		rc = ukplat_pt_walk(pt, vaddr, &lvl, __NULL, &pte);
+		vaddr = PAGE_Lx_ALIGN_DOWN(vaddr, lvl);
+
+		if (rc == 0 && PT_Lx_PTE_PRESENT(pte, lvl) &&
+		    PAGE_Lx_IS(pte, lvl) &&
+		    !(ukplat_pte_attr(pte, lvl) & PAGE_ATTR_PROT_WRITE)) {
+			/* Unmap contiguous pages with a single call */
+			if (vaddr != run_end) {
+				if (run_end > run_start)
+					vma_op_unmap(vma, run_start,
+						     run_end - run_start);
+				run_start = vaddr;
+			}
+
+			run_end = vaddr + PAGE_Lx_SIZE(lvl);
+			freed  += PAGE_Lx_SIZE(lvl);
+		}
+
+		vaddr += PAGE_Lx_SIZE(lvl);
+	}
+
+	if (run_end > run_start)
+		vma_op_unmap(vma, run_start, run_end - run_start);
+
+	vma->flags &= ~UK_VMA_FLAG_LAZYFREE;
+	return freed;
+}
+
+__sz uk_vas_reclaim(struct uk_vas *vas)
+{
+	struct uk_vma *vma;
+	__sz freed = 0;
+
+	UK_ASSERT(vas);
+
+	uk_list_for_each_entry(vma, &vas->vma_list, vma_list) {
+		if (!(vma->flags & UK_VMA_FLAG_LAZYFREE))
+			continue;
+
+		freed += vmem_vma_reclaim(vma);
+	}
+
+	uk_pr_debug("Reclaimed %"__PRIsz" bytes of lazily freed memory\n",
+		    freed);
+	return freed;
+}
+
 int vma_op_advise(struct uk_vma *vma, __vaddr_t vaddr, __sz len,
 		  unsigned long advice)
 {
+	struct mapx_populate_ctx ctx = {
+		.vma = vma,
+		.end = vaddr + len,
+	};
 	unsigned int lvl;
 	unsigned long flgs;
 	int rc;
@@ -880,8 +1092,9 @@ int vma_op_advise(struct uk_vma *vma, __vaddr_t vaddr, __sz len,
 				      vma->attr, flgs,
 				      &(struct ukplat_page_mapx){
 						.map = vmem_mapx_advise,
-						.ctx = vma,
+						.ctx = &ctx,
 				      });
+		vmem_populate_release(&ctx);
 		if (unlikely(rc))
 			return rc;
 	} else if (advice & UK_VMA_ADV_DONTNEED) {
@@ -892,6 +1105,10 @@ int vma_op_advise(struct uk_vma *vma, __vaddr_t vaddr, __sz len,
 		rc = vma_op_unmap(vma, vaddr, len);
 		if (unlikely(rc))
 			return rc;
+	} else if (advice & UK_VMA_ADV_FREE) {
+		rc = vmem_vma_lazyfree(vma, vaddr, len);
+		if (unlikely(rc))
+			return rc;
 	}
 
 	/* Add further advices here */
@@ -1024,10 +1241,129 @@ static int vmem_mapx_pagefault(struct uk_pagetable *pt __unused,
 	return 0;
 }
 
+#ifdef CONFIG_LIBUKVMEM_LARGE_PAGE_PROMOTE
+/**
+ * Replaces the pages of the next smaller size that completely populate the
+ * range of the level `lvl` page containing `vaddr` with a single page of
+ * level `lvl`. The contents are copied to a new frame. Nothing is changed if
+ * the range is not fully populated or a large frame is not available.
+ */
+static int vmem_promote(struct uk_vma *vma, __vaddr_t vaddr, unsigned int lvl)
+{
+	struct uk_pagetable *pt = vma->vas->pt;
+	const unsigned long pages = PAGE_Lx_SIZE(lvl) / PAGE_SIZE;
+	const unsigned int plvl = lvl - 1;
+	__vaddr_t vbase = PAGE_Lx_ALIGN_DOWN(vaddr, lvl);
+	__paddr_t paddr = __PADDR_ANY;
+	__vaddr_t pt_vaddr, kvaddr;
+	unsigned int i, wlvl = plvl;
+	__pte_t pte;
+	int rc;
+
+	UK_ASSERT(lvl > PAGE_LEVEL);
+	UK_ASSERT(PAGE_Lx_HAS(lvl));
+
+	if (vbase < vma->start || vma->end - vbase < PAGE_Lx_SIZE(lvl))
+		return -EINVAL;
+
+	/* We need a page table at the next smaller level with every entry
+	 * being a present page
+	 */
+	rc = ukplat_pt_walk(pt, vbase, &wlvl, &pt_vaddr, __NULL);
+	if (unlikely(rc))
+		return rc;
+	if (wlvl != plvl)
+		return -EINVAL;
+
+	for (i = 0; i < PT_Lx_PTES(plvl); ++i) {
+		rc = ukarch_pte_read(pt_vaddr, plvl, i, &pte);
+		if (unlikely(rc))
+			return rc;
+		if (!PT_Lx_PTE_PRESENT(pte, plvl) || !PAGE_Lx_IS(pte, plvl))
+			return -EINVAL;
+	}
+
+	rc = pt->fa->falloc(pt->fa, &paddr, pages, FALLOC_FLAG_ALIGNED);
+	if (unlikely(rc))
+		return rc;
+
+	kvaddr = ukplat_page_kmap(pt, paddr, pages, 0);
+	if (unlikely(kvaddr == __VADDR_INV)) {
+		pt->fa->ffree(pt->fa, paddr, pages);
+		return -ENOMEM;
+	}
+
+	memcpy_isr((void *)kvaddr, (const void *)vbase, PAGE_Lx_SIZE(lvl));
+	ukplat_page_kunmap(pt, kvaddr, pages, 0);
+
+	/* Release the small pages together with their page table and
+	 * install the large page
+	 */
+	rc = ukplat_page_unmap(pt, vbase, pages, 0);
+	if (unlikely(rc))
+		goto err_free;
+
+	rc = ukplat_page_map(pt, vbase, paddr, 1, vma->attr,
+			     PAGE_FLAG_SIZE(lvl) | PAGE_FLAG_FORCE_SIZE);
+	if (unlikely(rc)) {
+		/* The page table for the small pages is gone. Try to map the
+		 * new frame with whatever page size works.
+		 */
+		rc = ukplat_page_map(pt, vbase, paddr, pages, vma->attr, 0);
+		if (unlikely(rc))
+			goto err_free;
+	}
+
+	return 0;
+
+err_free:
+	uk_pr_err("Failed to promote 0x%" __PRIvaddr " to level %u: %d\n",
+		  vbase, lvl, rc);
+	pt->fa->ffree(pt->fa, paddr, pages);
+	return rc;
+}
+#endif /* CONFIG_LIBUKVMEM_LARGE_PAGE_PROMOTE */
+
+#if CONFIG_LIBUKVMEM_FAULT_AROUND_SIZE > PAGE_SHIFT
+/**
+ * Populates the small pages that are not present yet in the fault-around
+ * window containing `vaddr`. All pages come from a single frame allocation
+ * and are mapped in one pass over the page table. This is best effort, so
+ * errors are ignored.
+ */
+static void vmem_fault_around(struct uk_vma *vma, __vaddr_t vaddr)
+{
+	const __sz size = 1UL << CONFIG_LIBUKVMEM_FAULT_AROUND_SIZE;
+	struct mapx_populate_ctx ctx = {
+		.vma = vma,
+	};
+	__vaddr_t start;
+
+	start = ALIGN_DOWN(vaddr, size);
+	if (start <= __VADDR_MAX - size)
+		ctx.end = MIN(start + size, vma->end);
+	else
+		ctx.end = vma->end;
+
+	start = MAX(start, vma->start);
+
+	ukplat_page_mapx(vma->vas->pt, start, 0,
+			 (ctx.end - start) >> PAGE_SHIFT, vma->attr,
+			 PAGE_FLAG_SIZE(PAGE_LEVEL) | PAGE_FLAG_FORCE_SIZE,
+			 &(struct ukplat_page_mapx){
+				.map = vmem_mapx_advise,
+				.ctx = &ctx,
+			 });
+	vmem_populate_release(&ctx);
+}
+#endif /* CONFIG_LIBUKVMEM_FAULT_AROUND_SIZE > PAGE_SHIFT */
+
 int vmem_pagefault(__vaddr_t vaddr, unsigned int type, struct __regs *regs)
 {
 	const unsigned int demand_lvl =
 		PAGE_SHIFT_Lx(CONFIG_LIBUKVMEM_DEMAND_PAGE_IN_SIZE);
+	const unsigned int large_lvl =
+		PAGE_SHIFT_Lx(CONFIG_LIBUKVMEM_LARGE_PAGE_IN_SIZE);
 	struct uk_vas *vas;
 	struct uk_pagetable *pt;
 	struct mapx_pagefault_ctx ctx = {
@@ -1041,6 +1377,7 @@ int vmem_pagefault(__vaddr_t vaddr, unsigned int type, struct __regs *regs)
 	};
 	__vaddr_t vbase;
 	unsigned int lvl = PAGE_LEVEL;
+	unsigned int max_lvl;
 	unsigned long flags;
 	int rc;
 
@@ -1062,6 +1399,12 @@ int vmem_pagefault(__vaddr_t vaddr, unsigned int type, struct __regs *regs)
 	if (unlikely(!vmem_access_allowed(ctx.vma->attr, type)))
 		return -EFAULT;
 
+	/* Writes to lazily freed pages keep the pages */
+	if ((ctx.vma->flags & UK_VMA_FLAG_LAZYFREE) &&
+	    !(type & UK_VMA_FAULT_NONPRESENT) &&
+	    (type & UK_VMA_FAULT_ACCESSTYPE) == UK_VMA_FAULT_WRITE)
+		return vmem_vma_lazyfree_cancel(ctx.vma, vaddr);
+
 	/* Fail early if the VMA does not have a fault handler */
 	if (unlikely(!ctx.vma->ops->fault))
 		return -EFAULT;
@@ -1070,13 +1413,16 @@ int vmem_pagefault(__vaddr_t vaddr, unsigned int type, struct __regs *regs)
 	UK_ASSERT(ctx.vma->vas->pt);
 	pt = ctx.vma->vas->pt;
 
+	max_lvl = (ctx.vma->flags & UK_VMA_FLAG_LARGE_PAGES) ?
+		  MAX(large_lvl, demand_lvl) : demand_lvl;
+
 	/* Find the page level at which we want to page-in. If the VMA does not
 	 * enforce a specific page size and the configuration allows to page-in
 	 * large pages, we first check up to which level we find page tables.
 	 * We cannot create pages larger than that. Afterwards, we adjust
 	 * according to alignment and VMA boundaries.
 	 */
-	if (ctx.vma->page_lvl < 0 && demand_lvl > PAGE_LEVEL) {
+	if (ctx.vma->page_lvl < 0 && max_lvl > PAGE_LEVEL) {
 		rc = ukplat_pt_walk(pt, vaddr, &lvl, __NULL, __NULL);
 		if (unlikely(rc))
 			return rc;
@@ -1084,7 +1430,7 @@ int vmem_pagefault(__vaddr_t vaddr, unsigned int type, struct __regs *regs)
 		vbase = MAX(PAGE_Lx_ALIGN_DOWN(vaddr, lvl), ctx.vma->start);
 
 		lvl = vmem_largest_level(vbase, ctx.vma->end - vbase,
-					 MIN(lvl, demand_lvl));
+					 MIN(lvl, max_lvl));
 
 		flags = PAGE_FLAG_FORCE_SIZE;
 	} else {
@@ -1092,15 +1438,55 @@ int vmem_pagefault(__vaddr_t vaddr, unsigned int type, struct __regs *regs)
 		flags = 0;
 	}
 
-	vbase = PAGE_Lx_ALIGN_DOWN(vaddr, lvl);
+	for (;;) {
+		vbase = PAGE_Lx_ALIGN_DOWN(vaddr, lvl);
+
+		UK_ASSERT(vbase >= ctx.vma->start &&
+			  vbase < ctx.vma->end);
+		UK_ASSERT(vbase <= __VADDR_MAX - PAGE_Lx_SIZE(lvl));
+		UK_ASSERT(vbase + PAGE_Lx_SIZE(lvl) >= ctx.vma->start &&
+			  vbase + PAGE_Lx_SIZE(lvl) <= ctx.vma->end);
+
+		rc = ukplat_page_mapx(pt, vbase, 0, 1, ctx.vma->attr,
+				      PAGE_FLAG_SIZE(lvl) | flags, &mapx);
+
+		/* If we selected a large page but there is no contiguous
+		 * physical memory left for it, retry with smaller pages.
+		 */
+		if (rc != -ENOMEM || !(flags & PAGE_FLAG_FORCE_SIZE) ||
+		    lvl == PAGE_LEVEL)
+			break;
+
+		lvl = vmem_largest_level(PAGE_Lx_ALIGN_DOWN(vaddr, lvl - 1),
+					 __SZ_MAX, lvl - 1);
+	}
+
+	/* Out of memory, free lazily freed pages and retry once */
+	if (rc == -ENOMEM && uk_vas_reclaim(vas)) {
+		vbase = PAGE_Lx_ALIGN_DOWN(vaddr, lvl);
+		rc = ukplat_page_mapx(pt, vbase, 0, 1, ctx.vma->attr,
+				      PAGE_FLAG_SIZE(lvl) | flags, &mapx);
+	}
 
-	UK_ASSERT(vbase >= ctx.vma->start &&
-		  vbase < ctx.vma->end);
-	UK_ASSERT(vbase <= __VADDR_MAX - PAGE_Lx_SIZE(lvl));
-	UK_ASSERT(vbase + PAGE_Lx_SIZE(lvl) >= ctx.vma->start &&
-		  vbase + PAGE_Lx_SIZE(lvl) <= ctx.vma->end);
+#if CONFIG_LIBUKVMEM_FAULT_AROUND_SIZE > PAGE_SHIFT
+	/* Sequential accesses to anonymous memory would otherwise take one
+	 * fault per page
+	 */
+	if (rc == 0 && lvl == PAGE_LEVEL &&
+	    ctx.vma->ops == &uk_vma_anon_ops)
+		vmem_fault_around(ctx.vma, vaddr);
+#endif /* CONFIG_LIBUKVMEM_FAULT_AROUND_SIZE > PAGE_SHIFT */
+
+#ifdef CONFIG_LIBUKVMEM_LARGE_PAGE_PROMOTE
+	if (rc == 0 && ctx.vma->page_lvl < 0 &&
+	    (ctx.vma->flags & UK_VMA_FLAG_LARGE_PAGES) &&
+	    ctx.vma->ops == &uk_vma_anon_ops) {
+		while (++lvl <= max_lvl && PAGE_Lx_HAS(lvl))
+			if (vmem_promote(ctx.vma, vaddr, lvl))
+				break;
+	}
+#endif /* CONFIG_LIBUKVMEM_LARGE_PAGE_PROMOTE */
 
-	return ukplat_page_mapx(pt, vbase, 0, 1, ctx.vma->attr,
-				PAGE_FLAG_SIZE(lvl) | flags, &mapx);
+	return rc;
 }
 #endif /* CONFIG_HAVE_PAGING */
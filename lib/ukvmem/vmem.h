@@ -59,6 +59,25 @@ vmem_len_to_pages(struct uk_vma *vma, __sz len, unsigned long *flags)
 	UK_ASSERT(PAGE_Lx_ALIGNED(len, to_lvl));
 	return len / PAGE_Lx_SIZE(to_lvl);
 }
+
+/**
+ * Allocates physically contiguous frames for an anonymous VMA and clears
+ * them unless the VMA is uninitialized.
+ *
+ * @param vma
+ *   The anonymous VMA the frames are for
+ * @param[out] paddr
+ *   Receives the physical address of the first frame
+ * @param pages
+ *   The number of frames to allocate
+ * @param flags
+ *   Allocation flags (FALLOC_FLAG_*)
+ *
+ * @return
+ *   0 on success, a negative error code otherwise
+ */
+int vma_anon_falloc(struct uk_vma *vma, __paddr_t *paddr, unsigned long pages,
+		    unsigned long flags);
 #endif /* CONFIG_HAVE_PAGING */
 
 /* Macros for safe VMA op invocation */
@@ -83,6 +102,37 @@ static inline __sz vmem_vma_len(struct uk_vma *vma)
 	return vma->end - vma->start;
 }
 
+/* VMA tree (vma_tree.c) */
+
+/**
+ * Inserts a VMA into the tree of a VAS.
+ *
+ * @return
+ *   The VMA preceding the inserted one, NULL if there is none
+ */
+struct uk_vma *vmem_vma_tree_insert(struct uk_vas *vas, struct uk_vma *vma);
+
+void vmem_vma_tree_remove(struct uk_vas *vas, struct uk_vma *vma);
+
+/**
+ * Updates the tree after the start or end address of a VMA changed without
+ * changing its order relative to the other VMAs.
+ */
+void vmem_vma_tree_update(struct uk_vas *vas, struct uk_vma *vma);
+
+/**
+ * Returns the VMA with the lowest address that ends above `vaddr`, NULL if
+ * there is none.
+ */
+struct uk_vma *vmem_vma_tree_lookup(struct uk_vas *vas, __vaddr_t vaddr);
+
+/**
+ * Returns the lowest address from `base` on, aligned to `align`, with `len`
+ * bytes free. __VADDR_INV if there is no such address.
+ */
+__vaddr_t vmem_vma_tree_first_fit(struct uk_vas *vas, __vaddr_t base,
+				  __sz align, __sz len);
+
 /* Default VMA op handlers */
 int vma_op_deny();
 
@@ -55,6 +55,8 @@
 #include <uk/arch/types.h>
 #include <uk/argparse.h>
 
+#include "vfs.h"
+
 #define LIBVFSCORE_MOUNTOPTS_SEP				','
 #define LIBVFSCORE_FSTAB_VOLUME_ARGS_SEP		':'
 #define LIBVFSCORE_FSTAB_UKOPTS_ARGS_SEP \
@@ -865,6 +867,7 @@ static void vfscore_autoumount(const struct uk_term_ctx *tctx __unused)
 	uk_list_for_each_entry_reverse(mp, &mount_list, mnt_list) {
 		uk_pr_info("Unmounting %s (%s)...\n", mp->m_path,
 			   mp->m_dev ? mp->m_dev : "none");
+		dentry_cache_flush(mp);
 		/* For now, flags = 0 is enough. */
 		rc = VFS_UNMOUNT(mp, 0);
 		if (unlikely(rc))
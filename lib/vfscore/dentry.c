@@ -32,6 +32,7 @@
 
 #define _GNU_SOURCE
 
+#include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
 
@@ -41,18 +42,58 @@
 #include <uk/mutex.h>
 #include "vfs.h"
 
-#define DENTRY_BUCKETS 32
+#define DENTRY_BUCKETS 256
 
-static struct uk_hlist_head dentry_hash_table[DENTRY_BUCKETS];
-static UK_HLIST_HEAD(fake);
-static struct uk_mutex dentry_hash_lock = UK_MUTEX_INITIALIZER(dentry_hash_lock);
+/*
+ * Each bucket has its own lock, which protects the bucket's list and the
+ * transition of the reference count of its dentries to zero: references
+ * are taken and dropped atomically, but the last one is only dropped with
+ * the bucket locked, so that dentry_lookup() never finds a dentry that is
+ * being released.
+ */
+struct dentry_bucket {
+	struct uk_hlist_head head;
+	struct uk_mutex lock;
+};
 
+static struct dentry_bucket dentry_hash_table[DENTRY_BUCKETS];
+
+#if CONFIG_LIBVFSCORE_DCACHE
 /*
- * Get the hash value from the mount point and path name.
- * XXX: replace with a better hash for 64-bit pointers.
+ * Dentries are freed with their last reference, which would make every
+ * open of a path that is not in use walk the file system again. The cache
+ * holds a reference to the most recently allocated dentries and drops the
+ * oldest one when it is full. Removed dentries leave the cache right away.
  */
+#define DCACHE_SIZE CONFIG_LIBVFSCORE_DCACHE_SIZE
+
+static struct dentry *dcache[DCACHE_SIZE];
+static unsigned int dcache_next;
+static struct uk_mutex dcache_lock = UK_MUTEX_INITIALIZER(dcache_lock);
+#endif /* CONFIG_LIBVFSCORE_DCACHE */
+
+#if CONFIG_LIBVFSCORE_DCACHE_NEGATIVE
+/*
+ * Paths that do not exist, in a direct-mapped table. Entries are only
+ * valid while their generation is the current one. Anything that can
+ * make a path exist bumps the generation, which invalidates all entries
+ * at once.
+ */
+#define DNEG_SIZE CONFIG_LIBVFSCORE_DCACHE_NEGATIVE
+
+struct dentry_negative {
+	struct mount *mp;
+	char *path;
+	unsigned long gen;
+};
+
+static struct dentry_negative dneg[DNEG_SIZE];
+static unsigned long dneg_gen = 1;
+static struct uk_mutex dneg_lock = UK_MUTEX_INITIALIZER(dneg_lock);
+#endif /* CONFIG_LIBVFSCORE_DCACHE_NEGATIVE */
+
 static unsigned int
-dentry_hash(struct mount *mp, const char *path)
+dentry_path_hash(struct mount *mp, const char *path)
 {
 	unsigned int val = 0;
 
@@ -61,9 +102,161 @@ dentry_hash(struct mount *mp, const char *path)
 			val = ((val << 5) + val) + *path++;
 		}
 	}
-	return (val ^ (unsigned long) mp) & (DENTRY_BUCKETS - 1);
+	val ^= (unsigned int)((uintptr_t)mp >> 6);
+	val *= 0x9e3779b1U;
+	return val >> 16;
+}
+
+/*
+ * Get the hash value from the mount point and path name.
+ */
+static unsigned int
+dentry_hash(struct mount *mp, const char *path)
+{
+	return dentry_path_hash(mp, path) & (DENTRY_BUCKETS - 1);
+}
+
+static void
+dentry_hash_add(struct dentry *dp)
+{
+	struct dentry_bucket *b;
+
+	dp->d_bucket = dentry_hash(dp->d_mount, dp->d_path);
+	b = &dentry_hash_table[dp->d_bucket];
+	uk_mutex_lock(&b->lock);
+	uk_hlist_add_head(&dp->d_link, &b->head);
+	uk_mutex_unlock(&b->lock);
+}
+
+static void
+dentry_hash_del(struct dentry *dp)
+{
+	struct dentry_bucket *b = &dentry_hash_table[dp->d_bucket];
+
+	uk_mutex_lock(&b->lock);
+	uk_hlist_del_init(&dp->d_link);
+	uk_mutex_unlock(&b->lock);
+}
+
+#if CONFIG_LIBVFSCORE_DCACHE
+static void
+dentry_cache_add(struct dentry *dp)
+{
+	struct dentry *old;
+
+	dref(dp);
+
+	uk_mutex_lock(&dcache_lock);
+	old = dcache[dcache_next];
+	if (old)
+		old->d_cslot = 0;
+	dcache[dcache_next] = dp;
+	dp->d_cslot = dcache_next + 1;
+	dcache_next = (dcache_next + 1) % DCACHE_SIZE;
+	uk_mutex_unlock(&dcache_lock);
+
+	if (old)
+		drele(old);
+}
+
+static void
+dentry_cache_del(struct dentry *dp)
+{
+	unsigned int slot;
+
+	uk_mutex_lock(&dcache_lock);
+	slot = dp->d_cslot;
+	if (slot) {
+		dcache[slot - 1] = NULL;
+		dp->d_cslot = 0;
+	}
+	uk_mutex_unlock(&dcache_lock);
+
+	if (slot)
+		drele(dp);
+}
+
+void
+dentry_cache_flush(struct mount *mp)
+{
+	struct dentry *dp;
+	unsigned int i;
+
+	for (i = 0; i < DCACHE_SIZE; i++) {
+		uk_mutex_lock(&dcache_lock);
+		dp = dcache[i];
+		if (dp && dp->d_mount == mp) {
+			dcache[i] = NULL;
+			dp->d_cslot = 0;
+		} else {
+			dp = NULL;
+		}
+		uk_mutex_unlock(&dcache_lock);
+
+		if (dp)
+			drele(dp);
+	}
+}
+#else /* !CONFIG_LIBVFSCORE_DCACHE */
+static inline void
+dentry_cache_add(struct dentry *dp __unused)
+{
+}
+
+static inline void
+dentry_cache_del(struct dentry *dp __unused)
+{
 }
+#endif /* !CONFIG_LIBVFSCORE_DCACHE */
 
+#if CONFIG_LIBVFSCORE_DCACHE_NEGATIVE
+unsigned long
+dentry_negative_gen(void)
+{
+	return uk_load_n(&dneg_gen);
+}
+
+void
+dentry_negative_add(struct mount *mp, const char *path, unsigned long gen)
+{
+	struct dentry_negative *e;
+	char *old, *copy;
+
+	copy = strdup(path);
+	if (!copy)
+		return;
+
+	e = &dneg[dentry_path_hash(mp, path) % DNEG_SIZE];
+	uk_mutex_lock(&dneg_lock);
+	old = e->path;
+	e->mp = mp;
+	e->path = copy;
+	e->gen = gen;
+	uk_mutex_unlock(&dneg_lock);
+
+	free(old);
+}
+
+int
+dentry_negative_lookup(struct mount *mp, const char *path)
+{
+	struct dentry_negative *e;
+	int found;
+
+	e = &dneg[dentry_path_hash(mp, path) % DNEG_SIZE];
+	uk_mutex_lock(&dneg_lock);
+	found = e->path && e->mp == mp && e->gen == uk_load_n(&dneg_gen) &&
+		!strncmp(e->path, path, PATH_MAX);
+	uk_mutex_unlock(&dneg_lock);
+	return found;
+}
+
+void
+dentry_negative_invalidate(void)
+{
+	uk_inc(&dneg_gen);
+}
+#endif /* CONFIG_LIBVFSCORE_DCACHE_NEGATIVE */
 
 struct dentry *
 dentry_alloc(struct dentry *parent_dp, struct vnode *vp, const char *path)
@@ -84,6 +277,7 @@ dentry_alloc(struct dentry *parent_dp, struct vnode *vp, const char *path)
 	vref(vp);
 
 	dp->d_refcnt = 1;
+	UK_INIT_HLIST_NODE(&dp->d_link);
 	dp->d_vnode = vp;
 	dp->d_mount = mp;
 	UK_INIT_LIST_HEAD(&dp->d_child_list);
@@ -100,27 +294,26 @@ dentry_alloc(struct dentry *parent_dp, struct vnode *vp, const char *path)
 
 	vn_add_name(vp, dp);
 
-	uk_mutex_lock(&dentry_hash_lock);
-	uk_hlist_add_head(&dp->d_link,
-			  &dentry_hash_table[dentry_hash(mp, path)]);
-	uk_mutex_unlock(&dentry_hash_lock);
+	dentry_hash_add(dp);
+	dentry_cache_add(dp);
 	return dp;
 };
 
 struct dentry *
 dentry_lookup(struct mount *mp, char *path)
 {
+	struct dentry_bucket *b = &dentry_hash_table[dentry_hash(mp, path)];
 	struct dentry *dp;
 
-	uk_mutex_lock(&dentry_hash_lock);
-	uk_hlist_for_each_entry(dp, &dentry_hash_table[dentry_hash(mp, path)], d_link) {
+	uk_mutex_lock(&b->lock);
+	uk_hlist_for_each_entry(dp, &b->head, d_link) {
 		if (dp->d_mount == mp && !strncmp(dp->d_path, path, PATH_MAX)) {
-			dp->d_refcnt++;
-			uk_mutex_unlock(&dentry_hash_lock);
+			uk_inc(&dp->d_refcnt);
+			uk_mutex_unlock(&b->lock);
 			return dp;
 		}
 	}
-	uk_mutex_unlock(&dentry_hash_lock);
+	uk_mutex_unlock(&b->lock);
 	return NULL;                /* not found */
 }
 
@@ -132,7 +325,7 @@ static void dentry_children_remove(struct dentry *dp)
 	uk_list_for_each_entry(entry, &dp->d_child_list, d_child_link) {
 		UK_ASSERT(entry);
 		UK_ASSERT(entry->d_refcnt > 0);
-		uk_hlist_del(&entry->d_link);
+		dentry_hash_del(entry);
 	}
 	uk_mutex_unlock(&dp->d_lock);
 
@@ -166,19 +359,16 @@ dentry_move(struct dentry *dp, struct dentry *parent_dp, char *path)
 		uk_mutex_unlock(&parent_dp->d_lock);
 	}
 
-	uk_mutex_lock(&dentry_hash_lock);
 	// Remove all dp's child dentries from the hashtable.
 	dentry_children_remove(dp);
 	// Remove dp with outdated hash info from the hashtable.
-	uk_hlist_del(&dp->d_link);
+	dentry_hash_del(dp);
 	// Update dp.
 	dp->d_path = new_path;
 
 	dp->d_parent = parent_dp;
 	// Insert dp updated hash info into the hashtable.
-	uk_hlist_add_head(&dp->d_link,
-			  &dentry_hash_table[dentry_hash(dp->d_mount, path)]);
-	uk_mutex_unlock(&dentry_hash_lock);
+	dentry_hash_add(dp);
 
 	if (old_pdp) {
 		drele(old_pdp);
@@ -191,11 +381,8 @@ dentry_move(struct dentry *dp, struct dentry *parent_dp, char *path)
 void
 dentry_remove(struct dentry *dp)
 {
-	uk_mutex_lock(&dentry_hash_lock);
-	uk_hlist_del(&dp->d_link);
-	/* put it on a fake list for drele() to work*/
-	uk_hlist_add_head(&dp->d_link, &fake);
-	uk_mutex_unlock(&dentry_hash_lock);
+	dentry_hash_del(dp);
+	dentry_cache_del(dp);
 }
 
 void
@@ -204,26 +391,35 @@ dref(struct dentry *dp)
 	UK_ASSERT(dp);
 	UK_ASSERT(dp->d_refcnt > 0);
 
-	uk_mutex_lock(&dentry_hash_lock);
-	dp->d_refcnt++;
-	uk_mutex_unlock(&dentry_hash_lock);
+	uk_inc(&dp->d_refcnt);
 }
 
 void
 drele(struct dentry *dp)
 {
+	struct dentry_bucket *b;
+
 	UK_ASSERT(dp);
 	UK_ASSERT(dp->d_refcnt > 0);
 
-	uk_mutex_lock(&dentry_hash_lock);
-	if (--dp->d_refcnt) {
-		uk_mutex_unlock(&dentry_hash_lock);
+	if (vfs_refcnt_release_if_not_last(&dp->d_refcnt))
+		return;
+
+	/*
+	 * Nobody else holds a reference, so the dentry cannot be moved to
+	 * another bucket anymore, but it can still be found by a lookup
+	 * until it is unhashed.
+	 */
+	b = &dentry_hash_table[dp->d_bucket];
+	uk_mutex_lock(&b->lock);
+	if (uk_sub_fetch(&dp->d_refcnt, 1) > 0) {
+		uk_mutex_unlock(&b->lock);
 		return;
 	}
-	uk_hlist_del(&dp->d_link);
-	vn_del_name(dp->d_vnode, dp);
+	uk_hlist_del_init(&dp->d_link);
+	uk_mutex_unlock(&b->lock);
 
-	uk_mutex_unlock(&dentry_hash_lock);
+	vn_del_name(dp->d_vnode, dp);
 
 	if (dp->d_parent) {
 		uk_mutex_lock(&dp->d_parent->d_lock);
@@ -246,6 +442,7 @@ dentry_init(void)
 	int i;
 
 	for (i = 0; i < DENTRY_BUCKETS; i++) {
-		UK_INIT_HLIST_HEAD(&dentry_hash_table[i]);
+		UK_INIT_HLIST_HEAD(&dentry_hash_table[i].head);
+		uk_mutex_init(&dentry_hash_table[i].lock);
 	}
 }
@@ -35,6 +35,7 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <vfscore/file.h>
+#include <vfscore/pagecache.h>
 #include "vfs.h"
 
 #include <uk/assert.h>
@@ -51,7 +52,9 @@ int vfs_close(struct vfscore_file *fp)
 	 * NOTE: We do this because on umount not all of our filesystem drivers
 	 * may flush cached contents.
 	 */
-	error = VOP_FSYNC(vp, fp);
+	error = vfscore_pagecache_flush(vp);
+	if (likely(!error))
+		error = VOP_FSYNC(vp, fp);
 	if (unlikely(error))
 		return error;
 
@@ -68,6 +71,43 @@ int vfs_close(struct vfscore_file *fp)
 	return 0;
 }
 
+/* File systems may move data of O_DIRECT files straight to and from the
+ * caller's buffers
+ */
+static inline int vfs_ioflags(struct vfscore_file *fp)
+{
+	return (fp->f_flags & O_DIRECT) ? IO_DIRECT : 0;
+}
+
+/*
+ * Reads without the vnode lock, see vn_shared_read(). Reads at the file
+ * offset are still serialized per open file to keep f_offset consistent.
+ */
+static int vfs_read_shared(struct vfscore_file *fp, struct uio *uio,
+			   int flags)
+{
+	struct vnode *vp = fp->f_dentry->d_vnode;
+	int use_offset = !(flags & FOF_OFFSET);
+	ssize_t bytes = uio->uio_resid;
+	int error;
+
+	if (use_offset) {
+		FD_LOCK(fp);
+		uio->uio_offset = fp->f_offset;
+	}
+
+	uk_rwlock_rlock(&vp->v_iolock);
+	error = VOP_READ(vp, fp, uio, vfs_ioflags(fp));
+	uk_rwlock_runlock(&vp->v_iolock);
+
+	if (use_offset) {
+		if (!error && !(fp->f_vfs_flags & UK_VFSCORE_NOPOS))
+			fp->f_offset += bytes - uio->uio_resid;
+		FD_UNLOCK(fp);
+	}
+	return error;
+}
+
 int vfs_read(struct vfscore_file *fp, struct uio *uio, int flags)
 {
 	struct vnode *vp = fp->f_dentry->d_vnode;
@@ -75,13 +115,19 @@ int vfs_read(struct vfscore_file *fp, struct uio *uio, int flags)
 	size_t count;
 	ssize_t bytes;
 
+	if (vn_shared_read(vp))
+		return vfs_read_shared(fp, uio, flags);
+
 	bytes = uio->uio_resid;
 
 	vn_lock(vp);
 	if ((flags & FOF_OFFSET) == 0)
 		uio->uio_offset = fp->f_offset;
 
-	error = VOP_READ(vp, fp, uio, 0);
+	if (vfscore_pagecache_enabled(vp))
+		error = vfscore_pagecache_read(fp, uio);
+	else
+		error = VOP_READ(vp, fp, uio, vfs_ioflags(fp));
 	if (!error) {
 		count = bytes - uio->uio_resid;
 		if (((flags & FOF_OFFSET) == 0) &&
@@ -97,7 +143,7 @@ int vfs_read(struct vfscore_file *fp, struct uio *uio, int flags)
 int vfs_write(struct vfscore_file *fp, struct uio *uio, int flags)
 {
 	struct vnode *vp = fp->f_dentry->d_vnode;
-	int ioflags = 0;
+	int ioflags = vfs_ioflags(fp);
 	int error;
 	size_t count;
 	ssize_t bytes;
@@ -114,7 +160,13 @@ int vfs_write(struct vfscore_file *fp, struct uio *uio, int flags)
 	if ((flags & FOF_OFFSET) == 0)
 		uio->uio_offset = fp->f_offset;
 
-	error = VOP_WRITE(vp, uio, ioflags);
+	if (vfscore_pagecache_enabled(vp)) {
+		error = vfscore_pagecache_write(fp, uio, ioflags);
+	} else {
+		vn_io_wlock(vp);
+		error = VOP_WRITE(vp, uio, ioflags);
+		vn_io_wunlock(vp);
+	}
 	if (!error) {
 		count = bytes - uio->uio_resid;
 		if (!(flags & FOF_OFFSET) &&
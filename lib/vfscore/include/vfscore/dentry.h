@@ -41,6 +41,7 @@ struct vnode;
 
 struct dentry {
 	struct uk_hlist_node d_link;	/* link for hash list */
+	unsigned int	d_bucket;	/* hash bucket of d_link */
 	int		d_refcnt;	/* reference count */
 	char		*d_path;	/* pointer to path in fs */
 	struct vnode	*d_vnode;
@@ -50,6 +51,7 @@ struct dentry {
 	struct uk_mutex	d_lock;
 	struct uk_list_head d_child_list;
 	struct uk_list_head d_child_link;
+	unsigned int	d_cslot;	/* dentry cache slot + 1, 0 if none */
 };
 
 struct dentry *dentry_alloc(struct dentry *parent_dp, struct vnode *vp, const char *path);
@@ -35,12 +35,30 @@
 #include <sys/mount.h>
 #include <sys/statfs.h>
 #include <limits.h>
+#include <uk/config.h>
 #include <uk/list.h>
+#if CONFIG_LIBVFSCORE_GROUP_SYNC
+#include <uk/mutex.h>
+#include <uk/wait.h>
+#endif /* CONFIG_LIBVFSCORE_GROUP_SYNC */
 #include <vfscore/vnode.h>
 
 /*
  * Mount data
  */
+#if CONFIG_LIBVFSCORE_GROUP_SYNC
+/* Group commit state of a mount, see sys_fsync() */
+struct vfscore_gsync {
+	struct uk_mutex	lock;
+	struct uk_waitq	wq;
+	unsigned long	started;	/* last started sync */
+	unsigned long	done;		/* last completed sync */
+	unsigned long	failed;		/* last failed sync */
+	int		error;		/* error of the last failed sync */
+	int		running;	/* a leader collects or runs a sync */
+};
+#endif /* CONFIG_LIBVFSCORE_GROUP_SYNC */
+
 struct mount {
 	struct vfsops	*m_op;		/* pointer to vfs operation */
 	int		m_flags;	/* mount flag */
@@ -53,6 +71,9 @@ struct mount {
 	void		*m_data;	/* private data for fs */
 	struct uk_list_head mnt_list;
 	fsid_t 		m_fsid; 	/* id that uniquely identifies the fs */
+#if CONFIG_LIBVFSCORE_GROUP_SYNC
+	struct vfscore_gsync m_gsync;	/* shared syncs of MNT_SYNCALL */
+#endif /* CONFIG_LIBVFSCORE_GROUP_SYNC */
 };
 
 
@@ -122,6 +143,15 @@ struct mount {
 #ifndef	MNT_ROOTFS
 #define	MNT_ROOTFS	0x00004000	/* identifies the root filesystem */
 #endif
+#ifndef	MNT_PAGECACHE
+#define	MNT_PAGECACHE	0x00010000	/* file contents are page cached */
+#endif
+#ifndef	MNT_SHAREDREAD
+#define	MNT_SHAREDREAD	0x00020000	/* concurrent VOP_READ is safe */
+#endif
+#ifndef	MNT_SYNCALL
+#define	MNT_SYNCALL	0x00040000	/* VOP_FSYNC syncs all files */
+#endif
 
 /*
  * Mask of flags that are visible to statfs()
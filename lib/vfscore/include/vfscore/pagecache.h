@@ -0,0 +1,109 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __VFSCORE_PAGECACHE_H__
+#define __VFSCORE_PAGECACHE_H__
+
+#include <errno.h>
+#include <uk/config.h>
+#include <uk/essentials.h>
+#include <vfscore/file.h>
+#include <vfscore/mount.h>
+#include <vfscore/uio.h>
+#include <vfscore/vnode.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The page cache keeps the contents of regular files of file systems that
+ * set MNT_PAGECACHE on their mount in memory. Pages are looked up by
+ * (vnode, page index). Clean pages are kept in a global LRU list and are
+ * evicted when the cache is full or when memory runs out. Dirty pages are
+ * pinned to the dirty list of their vnode until they are written back, which
+ * happens on fsync, close, stat, truncate, and when a file accumulates more
+ * than CONFIG_LIBVFSCORE_PAGECACHE_DIRTY dirty pages.
+ *
+ * All functions must be called with the vnode locked and return a positive
+ * errno on failure, like the vnode operations.
+ */
+
+#if CONFIG_LIBVFSCORE_PAGECACHE
+static inline int vfscore_pagecache_enabled(struct vnode *vp)
+{
+	return vp->v_type == VREG && vp->v_mount &&
+	       (vp->v_mount->m_flags & MNT_PAGECACHE);
+}
+
+/**
+ * Reads from a file through the page cache. Missing pages are filled with
+ * VOP_READ() on `fp`.
+ */
+int vfscore_pagecache_read(struct vfscore_file *fp, struct uio *uio);
+
+/**
+ * Writes to a file through the page cache. The data is written back later
+ * unless `ioflags` contains IO_SYNC.
+ */
+int vfscore_pagecache_write(struct vfscore_file *fp, struct uio *uio,
+			    int ioflags);
+
+/**
+ * Writes all dirty pages of a vnode back to the file system.
+ */
+int vfscore_pagecache_flush(struct vnode *vp);
+
+/**
+ * Drops the cached pages of a vnode starting at file offset `off`. Dirty
+ * pages in that range are discarded, so the caller must flush first if
+ * their contents are still needed.
+ */
+void vfscore_pagecache_truncate(struct vnode *vp, off_t off);
+
+/**
+ * Writes back and drops all cached pages of a vnode that is released.
+ */
+void vfscore_pagecache_release(struct vnode *vp);
+#else /* !CONFIG_LIBVFSCORE_PAGECACHE */
+static inline int vfscore_pagecache_enabled(struct vnode *vp __unused)
+{
+	return 0;
+}
+
+static inline int vfscore_pagecache_read(struct vfscore_file *fp __unused,
+					 struct uio *uio __unused)
+{
+	return EINVAL;
+}
+
+static inline int vfscore_pagecache_write(struct vfscore_file *fp __unused,
+					  struct uio *uio __unused,
+					  int ioflags __unused)
+{
+	return EINVAL;
+}
+
+static inline int vfscore_pagecache_flush(struct vnode *vp __unused)
+{
+	return 0;
+}
+
+static inline void vfscore_pagecache_truncate(struct vnode *vp __unused,
+					      off_t off __unused)
+{
+}
+
+static inline void vfscore_pagecache_release(struct vnode *vp __unused)
+{
+}
+#endif /* !CONFIG_LIBVFSCORE_PAGECACHE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __VFSCORE_PAGECACHE_H__ */
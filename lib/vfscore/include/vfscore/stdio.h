@@ -0,0 +1,41 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __VFSCORE_STDIO_H__
+#define __VFSCORE_STDIO_H__
+
+#include <uk/arch/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Writes `len` bytes of stdout or stderr output. Must only return once the
+ * output does not access `buf` anymore.
+ *
+ * @return
+ *   0 on success, a negative errno value otherwise
+ */
+typedef int (*vfscore_stdio_write_t)(const void *buf, __sz len, void *arg);
+
+/**
+ * Redirects stdout and stderr from the kernel console to another output,
+ * e.g., a device that is faster than an emulated UART. Input and its echo
+ * stay on the kernel console.
+ *
+ * @param write
+ *   Function writing the output, NULL for the kernel console
+ * @param arg
+ *   Argument passed to `write`
+ */
+void vfscore_stdio_output_set(vfscore_stdio_write_t write, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __VFSCORE_STDIO_H__ */
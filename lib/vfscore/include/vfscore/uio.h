@@ -47,6 +47,8 @@ enum	uio_rw { UIO_READ, UIO_WRITE };
 #define IOSIZE_MAX      INT_MAX
 
 #define UIO_MAXIOV 1024
+/* Vectors up to this length are copied on the stack by sys_read/write */
+#define UIO_SMALLIOV 8
 
 #define UIO_SYSSPACE 0
 
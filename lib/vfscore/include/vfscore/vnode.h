@@ -37,6 +37,7 @@
 #include <dirent.h>
 
 #include <uk/mutex.h>
+#include <uk/rwlock.h>
 #include <uk/list.h>
 #include <uk/config.h>
 #include <time.h>
@@ -93,14 +94,21 @@ struct vnode {
 	mode_t		v_mode;		/* file mode */
 	off_t		v_size;		/* file size */
 	struct uk_mutex	v_lock;		/* lock for this vnode */
+	struct uk_rwlock v_iolock;	/* readers vs. writers, MNT_SHAREDREAD */
 	struct uk_list_head v_names;	/* directory entries pointing at this */
 	void		*v_data;	/* private data for fs */
+#if CONFIG_LIBVFSCORE_PAGECACHE
+	struct uk_list_head v_dirty;	/* dirty pages in the page cache */
+	unsigned long	v_npages;	/* number of cached pages */
+	unsigned long	v_ndirty;	/* number of dirty pages */
+#endif /* CONFIG_LIBVFSCORE_PAGECACHE */
 };
 
 /* flags for vnode */
 #define VROOT		0x0001		/* root of its file system */
 #define VISTTY		0x0002		/* device is tty */
 #define VPROTDEV	0x0004		/* protected device */
+#define VZERO		0x0008		/* device maps as anonymous memory */
 
 /*
  * Vnode attribute
@@ -95,6 +95,27 @@ namei_follow_link(struct dentry *dp, char *node, char *name, char *fp, size_t mo
 	name[0] = 0;
 	return (0);
 }
+
+/*
+ * Look up a name in a directory, consulting and updating the negative
+ * dentry cache for the path of the name.
+ */
+static int
+namei_vop_lookup(struct mount *mp, struct vnode *dvp, char *name,
+		 const char *node, struct vnode **vpp)
+{
+	unsigned long gen;
+	int error;
+
+	if (dentry_negative_lookup(mp, node))
+		return ENOENT;
+
+	gen = dentry_negative_gen();
+	error = VOP_LOOKUP(dvp, name, vpp);
+	if (error == ENOENT)
+		dentry_negative_add(mp, node, gen);
+	return error;
+}
 /*
  * Resolve a pathname into a pointer to a dentry and a realpath.
  *
@@ -154,6 +175,10 @@ namei_resolve(const char *path, struct dentry **dpp, char *realpath)
 			*dpp = dp;
 			goto out;
 		}
+		if (dentry_negative_lookup(mp, node)) {
+			error = ENOENT;
+			goto out;
+		}
 		/*
 		 * Find target vnode, started from root directory.
 		 * This is done to attach the fs specific data to
@@ -197,7 +222,8 @@ namei_resolve(const char *path, struct dentry **dpp, char *realpath)
 			dp = dentry_lookup(mp, node);
 			if (dp == NULL) {
 				/* Find a vnode in this directory. */
-				error = VOP_LOOKUP(dvp, name, &vp);
+				error = namei_vop_lookup(mp, dvp, name, node,
+							 &vp);
 				if (error) {
 					vn_unlock(dvp);
 					drele(ddp);
@@ -325,7 +351,7 @@ namei_last_nofollow(char *path, struct dentry *ddp, struct dentry **dpp)
 	vn_lock(dvp);
 	dp = dentry_lookup(mp, node);
 	if (dp == NULL) {
-		error = VOP_LOOKUP(dvp, name, &vp);
+		error = namei_vop_lookup(mp, dvp, name, node, &vp);
 		if (error != 0) {
 			goto out;
 		}
@@ -370,7 +396,7 @@ namei_last_nofollow_locked(char *path, struct dentry *ddp, struct dentry **dpp)
 	dvp = ddp->d_vnode;
 	dp = dentry_lookup(mp, node);
 	if (dp == NULL) {
-		error = VOP_LOOKUP(dvp, name, &vp);
+		error = namei_vop_lookup(mp, dvp, name, node, &vp);
 		if (error != 0) {
 			goto out;
 		}
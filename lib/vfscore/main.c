@@ -2611,6 +2611,9 @@ static void vfscore_init(void)
 
 	vnode_init();
 	lookup_init();
+#if CONFIG_LIBVFSCORE_PAGECACHE
+	vfscore_pagecache_init();
+#endif /* CONFIG_LIBVFSCORE_PAGECACHE */
 }
 
 UK_CTOR_PRIO(vfscore_init, 1);
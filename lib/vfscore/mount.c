@@ -48,7 +48,7 @@
 #include <sys/stat.h>
 #include <time.h>
 #include <uk/list.h>
-#include <uk/mutex.h>
+#include <uk/brlock.h>
 #include <vfscore/prex.h>
 #include <vfscore/dentry.h>
 #include <vfscore/vnode.h>
@@ -63,7 +63,8 @@ UK_LIST_HEAD(mount_list);
 /*
  * Global lock to access mount point.
  */
-static struct uk_mutex mount_lock = UK_MUTEX_INITIALIZER(mount_lock);
+/* Read on every path lookup, written only by mount and umount */
+static struct uk_brlock mount_lock = UK_BRLOCK_INITIALIZER(mount_lock);
 
 extern const struct vfscore_fs_type *uk_fslist_start;
 extern const struct vfscore_fs_type *uk_fslist_end;
@@ -148,16 +149,16 @@ UK_SYSCALL_R_DEFINE(int, mount, const char*, dev, const char*, dir,
 	/* static mutex sys_mount_lock; */
 	/* SCOPE_LOCK(sys_mount_lock); */
 
-	uk_mutex_lock(&mount_lock);
+	uk_brlock_rlock(&mount_lock);
 	uk_list_for_each_entry(mp, &mount_list, mnt_list) {
 		if (!strcmp(mp->m_path, dir) ||
 		    (device && mp->m_dev == device)) {
 			error = EBUSY;  /* Already mounted */
-			uk_mutex_unlock(&mount_lock);
+			uk_brlock_runlock(&mount_lock);
 			goto err1;
 		}
 	}
-	uk_mutex_unlock(&mount_lock);
+	uk_brlock_runlock(&mount_lock);
 	/*
 	 * Create VFS mount entry.
 	 */
@@ -171,6 +172,10 @@ UK_SYSCALL_R_DEFINE(int, mount, const char*, dev, const char*, dir,
 	mp->m_flags = flags;
 	mp->m_dev = device;
 	mp->m_data = NULL;
+#if CONFIG_LIBVFSCORE_GROUP_SYNC
+	uk_mutex_init(&mp->m_gsync.lock);
+	uk_waitq_init(&mp->m_gsync.wq);
+#endif /* CONFIG_LIBVFSCORE_GROUP_SYNC */
 	mp->m_path = strndup(dir, PATH_MAX - 1);
 	if (!mp->m_path) {
 		error = ENOMEM;
@@ -233,12 +238,14 @@ UK_SYSCALL_R_DEFINE(int, mount, const char*, dev, const char*, dir,
 	/*
 	 * Insert to mount list
 	 */
-	uk_mutex_lock(&mount_lock);
+	uk_brlock_wlock(&mount_lock);
 	uk_list_add_tail(&mp->mnt_list, &mount_list);
-	uk_mutex_unlock(&mount_lock);
+	uk_brlock_wunlock(&mount_lock);
+	dentry_negative_invalidate();
 
 	return 0;   /* success */
  err4:
+	dentry_cache_flush(mp);
 	drele(mp->m_root);
  err3:
 	if (dp_covered)
@@ -275,7 +282,7 @@ UK_SYSCALL_R_DEFINE(int, umount2, const char*, path, int, flags)
 
 	uk_pr_info("VFS: unmounting %s\n", path);
 
-	uk_mutex_lock(&mount_lock);
+	uk_brlock_wlock(&mount_lock);
 
 	pathlen = strlen(path);
 	if (pathlen >= MAXPATHLEN) {
@@ -303,6 +310,7 @@ found:
 		goto out;
 	}
 
+	dentry_cache_flush(mp);
 	if ((error = VFS_UNMOUNT(mp, flags)) != 0)
 		goto out;
 	uk_list_del_init(&mp->mnt_list);
@@ -318,7 +326,7 @@ found:
 	free(mp->m_path);
 	free(mp);
  out:
-	uk_mutex_unlock(&mount_lock);
+	uk_brlock_wunlock(&mount_lock);
 	return error;
 }
 
@@ -383,7 +391,7 @@ sys_pivot_root(const char *new_root, const char *put_old)
 UK_LLSYSCALL_R_DEFINE(int, sync)
 {
 	struct mount *mp;
-	uk_mutex_lock(&mount_lock);
+	uk_brlock_rlock(&mount_lock);
 
 	/* Call each mounted file system. */
 	uk_list_for_each_entry(mp, &mount_list, mnt_list) {
@@ -392,7 +400,7 @@ UK_LLSYSCALL_R_DEFINE(int, sync)
 #ifdef HAVE_BUFFERS
 	bio_sync();
 #endif
-	uk_mutex_unlock(&mount_lock);
+	uk_brlock_runlock(&mount_lock);
 
 	return 0;
 }
@@ -449,7 +457,7 @@ vfs_findroot(const char *path, struct mount **mp, char **root)
 		return -1;
 
 	/* Find mount point from nearest path */
-	uk_mutex_lock(&mount_lock);
+	uk_brlock_rlock(&mount_lock);
 	uk_list_for_each_entry(tmp, &mount_list, mnt_list) {
 		len = count_match(path, tmp->m_path);
 		if (len > max_len) {
@@ -457,7 +465,7 @@ vfs_findroot(const char *path, struct mount **mp, char **root)
 			m = tmp;
 		}
 	}
-	uk_mutex_unlock(&mount_lock);
+	uk_brlock_runlock(&mount_lock);
 	if (m == NULL)
 		return -1;
 	*root = (char *)(path + max_len);
@@ -509,7 +517,7 @@ void
 vfscore_mount_dump(void)
 {
 	struct mount *mp;
-	uk_mutex_lock(&mount_lock);
+	uk_brlock_rlock(&mount_lock);
 
 	uk_pr_debug("vfscore_mount_dump\n");
 	uk_pr_debug("dev      count root\n");
@@ -518,6 +526,6 @@ vfscore_mount_dump(void)
 	uk_list_for_each_entry(mp, &mount_list, mnt_list) {
 		uk_pr_debug("%8p %5d %s\n", mp->m_dev, mp->m_count, mp->m_path);
 	}
-	uk_mutex_unlock(&mount_lock);
+	uk_brlock_runlock(&mount_lock);
 }
 #endif
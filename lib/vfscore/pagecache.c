@@ -0,0 +1,511 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include <uk/alloc.h>
+#include <uk/arch/limits.h>
+#include <uk/assert.h>
+#include <uk/essentials.h>
+#include <uk/list.h>
+#include <uk/mutex.h>
+#include <uk/print.h>
+#include <vfscore/fs.h>
+#include <vfscore/pagecache.h>
+#include "vfs.h"
+
+#define PC_HASH_BUCKETS		256
+#define PC_MAX_PAGES		((unsigned long)CONFIG_LIBVFSCORE_PAGECACHE_MAX)
+#define PC_DIRTY_MAX		((unsigned long)CONFIG_LIBVFSCORE_PAGECACHE_DIRTY)
+#define PC_DIRECT_MIN		((ssize_t)CONFIG_LIBVFSCORE_PAGECACHE_DIRECT_MIN \
+				 * 1024)
+/* Number of clean pages given back per allocation failure */
+#define PC_RECLAIM_PAGES	16
+
+#define PC_PAGE_OFF(index)	((off_t)(index) * (off_t)__PAGE_SIZE)
+
+/*
+ * Locking: the hash table, the LRU list, the counters, and the link of a
+ * page are protected by `pc_lock`. Any thread may evict a clean page, so the
+ * contents of clean pages are only accessed with `pc_lock` held. Dirty pages
+ * are not on the LRU list and are only ever released by a holder of their
+ * vnode lock, so they can be accessed with just the vnode lock held. Pages of
+ * a vnode are only inserted by a holder of the vnode lock.
+ */
+struct pc_page {
+	struct uk_list_head hash_link;
+	/* Link in the LRU list if clean, in the dirty list of vp otherwise */
+	struct uk_list_head list_link;
+	struct vnode *vp;
+	off_t index;
+	/* Number of bytes at the start of the page that hold file data */
+	size_t len;
+	int dirty;
+	void *data;
+};
+
+static struct uk_list_head pc_hash[PC_HASH_BUCKETS];
+static UK_LIST_HEAD(pc_lru);
+static unsigned long pc_npages;
+static struct uk_mutex pc_lock = UK_MUTEX_INITIALIZER(pc_lock);
+
+static inline unsigned int pc_hash_idx(struct vnode *vp, off_t index)
+{
+	return (unsigned int)(((uintptr_t)vp >> 6) ^ (uintptr_t)index) &
+	       (PC_HASH_BUCKETS - 1);
+}
+
+static struct pc_page *pc_lookup(struct vnode *vp, off_t index)
+{
+	struct pc_page *p;
+
+	uk_list_for_each_entry(p, &pc_hash[pc_hash_idx(vp, index)],
+			       hash_link) {
+		if (p->vp == vp && p->index == index)
+			return p;
+	}
+	return NULL;
+}
+
+static void pc_page_free(struct pc_page *p)
+{
+	uk_pfree(uk_alloc_get_default(), p->data, 1);
+	free(p);
+}
+
+static void pc_page_remove(struct pc_page *p)
+{
+	uk_list_del(&p->hash_link);
+	uk_list_del(&p->list_link);
+	if (p->dirty)
+		p->vp->v_ndirty--;
+	p->vp->v_npages--;
+	pc_npages--;
+}
+
+/* Releases up to `n` clean pages, starting with the least recently used */
+static unsigned long pc_evict(unsigned long n)
+{
+	struct pc_page *p;
+	unsigned long cnt;
+
+	for (cnt = 0; cnt < n && !uk_list_empty(&pc_lru); cnt++) {
+		p = uk_list_last_entry(&pc_lru, struct pc_page, list_link);
+		pc_page_remove(p);
+		pc_page_free(p);
+	}
+	return cnt;
+}
+
+static struct pc_page *pc_page_alloc(void)
+{
+	struct pc_page *p;
+	unsigned long evicted;
+
+	uk_mutex_lock(&pc_lock);
+	if (pc_npages >= PC_MAX_PAGES)
+		pc_evict(pc_npages - PC_MAX_PAGES + 1);
+	uk_mutex_unlock(&pc_lock);
+
+	for (;;) {
+		p = malloc(sizeof(*p));
+		if (likely(p)) {
+			p->data = uk_palloc(uk_alloc_get_default(), 1);
+			if (likely(p->data))
+				return p;
+			free(p);
+		}
+
+		/* Memory is short: give clean pages back and retry */
+		uk_mutex_lock(&pc_lock);
+		evicted = pc_evict(PC_RECLAIM_PAGES);
+		uk_mutex_unlock(&pc_lock);
+		if (!evicted)
+			return NULL;
+	}
+}
+
+static void pc_page_insert(struct vnode *vp, struct pc_page *p, off_t index)
+{
+	p->vp = vp;
+	p->index = index;
+	p->dirty = 0;
+	uk_list_add(&p->hash_link, &pc_hash[pc_hash_idx(vp, index)]);
+	uk_list_add(&p->list_link, &pc_lru);
+	vp->v_npages++;
+	pc_npages++;
+}
+
+static int pc_page_fill(struct vfscore_file *fp, struct pc_page *p,
+			off_t index)
+{
+	struct vnode *vp = fp->f_dentry->d_vnode;
+	struct iovec iov = {
+		.iov_base = p->data,
+		.iov_len = __PAGE_SIZE,
+	};
+	struct uio uio = {
+		.uio_iov = &iov,
+		.uio_iovcnt = 1,
+		.uio_offset = PC_PAGE_OFF(index),
+		.uio_resid = __PAGE_SIZE,
+		.uio_rw = UIO_READ,
+	};
+	int error;
+
+	if (!(fp->f_flags & UK_FREAD))
+		return EBADF;
+
+	error = VOP_READ(vp, fp, &uio, 0);
+	if (unlikely(error))
+		return error;
+
+	p->len = __PAGE_SIZE - (size_t)uio.uio_resid;
+	memset((char *)p->data + p->len, 0, __PAGE_SIZE - p->len);
+	return 0;
+}
+
+/**
+ * Looks up the page at `index`, allocating it on a miss. The page is filled
+ * from the file if `fill` is set and zeroed otherwise. On success, the page
+ * is returned with `pc_lock` held.
+ */
+static int pc_page_get(struct vfscore_file *fp, off_t index, int fill,
+		       struct pc_page **pp)
+{
+	struct vnode *vp = fp->f_dentry->d_vnode;
+	struct pc_page *p;
+	int error;
+
+	uk_mutex_lock(&pc_lock);
+	p = pc_lookup(vp, index);
+	if (p) {
+		if (!p->dirty)
+			uk_list_move(&p->list_link, &pc_lru);
+		*pp = p;
+		return 0;
+	}
+	uk_mutex_unlock(&pc_lock);
+
+	p = pc_page_alloc();
+	if (unlikely(!p))
+		return ENOMEM;
+
+	if (fill) {
+		error = pc_page_fill(fp, p, index);
+		if (unlikely(error)) {
+			pc_page_free(p);
+			return error;
+		}
+	} else {
+		p->len = 0;
+		memset(p->data, 0, __PAGE_SIZE);
+	}
+
+	uk_mutex_lock(&pc_lock);
+	pc_page_insert(vp, p, index);
+	*pp = p;
+	return 0;
+}
+
+/* Drops the pages in the index range [first, last] */
+static void pc_drop(struct vnode *vp, off_t first, off_t last)
+{
+	struct pc_page *p, *n;
+	off_t index;
+	unsigned int i;
+
+	UK_ASSERT(first <= last);
+
+	uk_mutex_lock(&pc_lock);
+	if (!vp->v_npages)
+		goto out;
+
+	if ((uintptr_t)(last - first) < PC_HASH_BUCKETS) {
+		for (index = first; index <= last; index++) {
+			p = pc_lookup(vp, index);
+			if (p) {
+				pc_page_remove(p);
+				pc_page_free(p);
+			}
+		}
+		goto out;
+	}
+
+	for (i = 0; i < PC_HASH_BUCKETS && vp->v_npages; i++) {
+		uk_list_for_each_entry_safe(p, n, &pc_hash[i], hash_link) {
+			if (p->vp == vp &&
+			    p->index >= first && p->index <= last) {
+				pc_page_remove(p);
+				pc_page_free(p);
+			}
+		}
+	}
+out:
+	uk_mutex_unlock(&pc_lock);
+}
+
+static int pc_page_writeback(struct vnode *vp, struct pc_page *p)
+{
+	off_t off = PC_PAGE_OFF(p->index);
+	size_t len;
+	struct iovec iov;
+	struct uio uio;
+	int error;
+
+	if (off >= vp->v_size)
+		return 0;
+	len = MIN(p->len, (size_t)(vp->v_size - off));
+
+	iov.iov_base = p->data;
+	iov.iov_len = len;
+	uio.uio_iov = &iov;
+	uio.uio_iovcnt = 1;
+	uio.uio_offset = off;
+	uio.uio_resid = (ssize_t)len;
+	uio.uio_rw = UIO_WRITE;
+
+	error = VOP_WRITE(vp, &uio, 0);
+	if (unlikely(error))
+		return error;
+	if (unlikely(uio.uio_resid))
+		return EIO;
+	return 0;
+}
+
+int vfscore_pagecache_flush(struct vnode *vp)
+{
+	struct pc_page *p;
+	int error;
+
+	if (!vfscore_pagecache_enabled(vp))
+		return 0;
+
+	/* Only we can change the dirty list, as we hold the vnode lock */
+	while (!uk_list_empty(&vp->v_dirty)) {
+		p = uk_list_first_entry(&vp->v_dirty, struct pc_page,
+					list_link);
+		error = pc_page_writeback(vp, p);
+		if (unlikely(error)) {
+			uk_pr_err("Failed to write back page %lld of vnode %p: %d\n",
+				  (long long)p->index, vp, error);
+			return error;
+		}
+
+		uk_mutex_lock(&pc_lock);
+		p->dirty = 0;
+		vp->v_ndirty--;
+		uk_list_move(&p->list_link, &pc_lru);
+		uk_mutex_unlock(&pc_lock);
+	}
+	return 0;
+}
+
+void vfscore_pagecache_truncate(struct vnode *vp, off_t off)
+{
+	struct pc_page *p;
+	off_t index;
+	size_t pgoff;
+
+	if (!vfscore_pagecache_enabled(vp))
+		return;
+
+	UK_ASSERT(off >= 0);
+	index = off / __PAGE_SIZE;
+	pgoff = (size_t)(off % __PAGE_SIZE);
+
+	/* Clear the tail of a page that now contains the end of the file */
+	if (pgoff) {
+		uk_mutex_lock(&pc_lock);
+		p = pc_lookup(vp, index);
+		if (p && p->len > pgoff) {
+			memset((char *)p->data + pgoff, 0, p->len - pgoff);
+			p->len = pgoff;
+		}
+		uk_mutex_unlock(&pc_lock);
+		index++;
+	}
+
+	pc_drop(vp, index, __OFF_MAX / __PAGE_SIZE);
+}
+
+void vfscore_pagecache_release(struct vnode *vp)
+{
+	int error;
+
+	if (!vfscore_pagecache_enabled(vp))
+		return;
+
+	error = vfscore_pagecache_flush(vp);
+	if (unlikely(error))
+		uk_pr_warn("Dropping dirty pages of vnode %p\n", vp);
+	vfscore_pagecache_truncate(vp, 0);
+	UK_ASSERT(!vp->v_npages);
+}
+
+/*
+ * Transfers on files opened with O_DIRECT and transfers of at least
+ * PC_DIRECT_MIN bytes bypass the cache, so that file systems that can
+ * (e.g., 9pfs) move the data straight between the device and the caller's
+ * buffers. Large reads that start in a cached page still use the cache.
+ */
+static int pc_direct(struct vfscore_file *fp, struct uio *uio, int read)
+{
+	struct vnode *vp = fp->f_dentry->d_vnode;
+	int cached;
+
+	if (fp->f_flags & O_DIRECT)
+		return 1;
+	if (!PC_DIRECT_MIN || uio->uio_resid < PC_DIRECT_MIN)
+		return 0;
+	if (!read)
+		return 1;
+
+	uk_mutex_lock(&pc_lock);
+	cached = pc_lookup(vp, uio->uio_offset / __PAGE_SIZE) != NULL;
+	uk_mutex_unlock(&pc_lock);
+	return !cached;
+}
+
+int vfscore_pagecache_read(struct vfscore_file *fp, struct uio *uio)
+{
+	struct vnode *vp = fp->f_dentry->d_vnode;
+	struct pc_page *p;
+	off_t index;
+	size_t pgoff, cnt;
+	int error;
+
+	UK_ASSERT(vfscore_pagecache_enabled(vp));
+
+	if (uio->uio_offset < 0)
+		return EINVAL;
+
+	if (pc_direct(fp, uio, 1)) {
+		/* Cached clean pages match the file, dirty ones are newer */
+		error = vfscore_pagecache_flush(vp);
+		if (unlikely(error))
+			return error;
+		return VOP_READ(vp, fp, uio, IO_DIRECT);
+	}
+
+	while (uio->uio_resid > 0 && uio->uio_offset < vp->v_size) {
+		index = uio->uio_offset / __PAGE_SIZE;
+		pgoff = (size_t)(uio->uio_offset % __PAGE_SIZE);
+		cnt = MIN(__PAGE_SIZE - pgoff, (size_t)uio->uio_resid);
+		cnt = MIN(cnt, (size_t)(vp->v_size - uio->uio_offset));
+
+		error = pc_page_get(fp, index, 1, &p);
+		if (unlikely(error))
+			return error;
+
+		/* The file system may hold less data than the vnode size */
+		if (p->len <= pgoff) {
+			uk_mutex_unlock(&pc_lock);
+			break;
+		}
+		cnt = MIN(cnt, p->len - pgoff);
+
+		error = vfscore_uiomove((char *)p->data + pgoff, (int)cnt, uio);
+		uk_mutex_unlock(&pc_lock);
+		if (unlikely(error))
+			return error;
+	}
+	return 0;
+}
+
+/* Writes the rest of `uio` directly to the file system */
+static int pc_write_through(struct vnode *vp, struct uio *uio, int ioflags)
+{
+	off_t start = uio->uio_offset;
+	int error;
+
+	error = vfscore_pagecache_flush(vp);
+	if (unlikely(error))
+		return error;
+
+	error = VOP_WRITE(vp, uio, ioflags & ~IO_APPEND);
+	if (uio->uio_offset > start)
+		pc_drop(vp, start / __PAGE_SIZE,
+			(uio->uio_offset - 1) / __PAGE_SIZE);
+	return error;
+}
+
+int vfscore_pagecache_write(struct vfscore_file *fp, struct uio *uio,
+			    int ioflags)
+{
+	struct vnode *vp = fp->f_dentry->d_vnode;
+	struct pc_page *p;
+	off_t index;
+	size_t pgoff, cnt;
+	int fill;
+	int error;
+
+	UK_ASSERT(vfscore_pagecache_enabled(vp));
+
+	if (uio->uio_offset < 0)
+		return EINVAL;
+	if (ioflags & IO_APPEND)
+		uio->uio_offset = vp->v_size;
+
+	if (pc_direct(fp, uio, 0))
+		return pc_write_through(vp, uio, ioflags | IO_DIRECT);
+
+	while (uio->uio_resid > 0) {
+		index = uio->uio_offset / __PAGE_SIZE;
+		pgoff = (size_t)(uio->uio_offset % __PAGE_SIZE);
+		cnt = MIN(__PAGE_SIZE - pgoff, (size_t)uio->uio_resid);
+
+		/* Partially overwritten pages need their current contents */
+		fill = (pgoff || cnt < __PAGE_SIZE) &&
+		       PC_PAGE_OFF(index) < vp->v_size;
+
+		error = pc_page_get(fp, index, fill, &p);
+		if (error == ENOMEM || error == EBADF)
+			return pc_write_through(vp, uio, ioflags);
+		if (unlikely(error))
+			return error;
+
+		/* Dirty pages are not evicted, so we can drop the lock */
+		if (!p->dirty) {
+			p->dirty = 1;
+			vp->v_ndirty++;
+			uk_list_move(&p->list_link, &vp->v_dirty);
+		}
+		uk_mutex_unlock(&pc_lock);
+
+		error = vfscore_uiomove((char *)p->data + pgoff, (int)cnt, uio);
+		if (unlikely(error))
+			return error;
+
+		p->len = MAX(p->len, pgoff + cnt);
+		if (uio->uio_offset > vp->v_size)
+			vp->v_size = uio->uio_offset;
+
+		if (vp->v_ndirty > PC_DIRTY_MAX) {
+			error = vfscore_pagecache_flush(vp);
+			if (unlikely(error))
+				return error;
+		}
+	}
+
+	if (ioflags & IO_SYNC)
+		return vfscore_pagecache_flush(vp);
+	return 0;
+}
+
+void vfscore_pagecache_init(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < PC_HASH_BUCKETS; i++)
+		UK_INIT_LIST_HEAD(&pc_hash[i]);
+}
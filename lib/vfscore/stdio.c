@@ -37,10 +37,12 @@
 #include <vfscore/fs.h>
 #include <uk/plat/console.h>
 #include <uk/syscall.h>
+#include <uk/atomic.h>
 #include <uk/essentials.h>
 #include <termios.h>
 #include <vfscore/vnode.h>
 #include <unistd.h>
+#include <vfscore/stdio.h>
 #include <vfscore/uio.h>
 #include <vfscore/vnode.h>
 #include <vfscore/mount.h>
@@ -61,9 +63,26 @@
 long uk_syscall_r_dup3(long oldfd, long newfd, long flags);
 #endif /* !CONFIG_LIBSYSCALL_SHIM */
 
+static vfscore_stdio_write_t stdio_output;
+static void *stdio_output_arg;
+
+void vfscore_stdio_output_set(vfscore_stdio_write_t write, void *arg)
+{
+	UK_WRITE_ONCE(stdio_output_arg, arg);
+	UK_WRITE_ONCE(stdio_output, write);
+}
+
 static int __write_fn(void *dst __unused, void *src, size_t *cnt)
 {
-	int ret = ukplat_coutk(src, *cnt);
+	vfscore_stdio_write_t output = UK_READ_ONCE(stdio_output);
+	int ret;
+
+	if (output) {
+		ret = output(src, *cnt, UK_READ_ONCE(stdio_output_arg));
+		return (ret < 0) ? -ret : 0;
+	}
+
+	ret = ukplat_coutk(src, *cnt);
 
 	if (ret < 0)
 		/* TODO: remove -1 when vfscore switches to negative
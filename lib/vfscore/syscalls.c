@@ -49,11 +49,17 @@
 #if CONFIG_LIBPOSIX_PROCESS_CLONE
 #include <uk/process.h>
 #endif /* CONFIG_LIBPOSIX_PROCESS_CLONE */
+#if CONFIG_LIBVFSCORE_GROUP_SYNC
+#include <uk/atomic.h>
+#include <uk/sched.h>
+#include <uk/wait.h>
+#endif /* CONFIG_LIBVFSCORE_GROUP_SYNC */
 
 #include <dirent.h>
 #include <vfscore/prex.h>
 #include <vfscore/vnode.h>
 #include <vfscore/file.h>
+#include <vfscore/pagecache.h>
 
 #include "vfs.h"
 #include <vfscore/fs.h>
@@ -137,6 +143,8 @@ sys_open(char *path, int flags, mode_t mode, struct vfscore_file **fpp)
 			mode &= ~S_IFMT;
 			mode |= S_IFREG;
 			error = VOP_CREATE(ddp->d_vnode, filename, mode);
+			if (!error)
+				dentry_negative_invalidate();
 			vn_unlock(ddp->d_vnode);
 			drele(ddp);
 
@@ -207,7 +215,7 @@ sys_open(char *path, int flags, mode_t mode, struct vfscore_file **fpp)
 	 */
 	fp->f_dentry = dp;
 
-	uk_mutex_init(&fp->f_lock);
+	uk_mutex_init_config(&fp->f_lock, UK_MUTEX_CONFIG_SPIN);
 	UK_INIT_LIST_HEAD(&fp->f_ep);
 
 	if (flags & O_TRUNC) {
@@ -216,9 +224,12 @@ sys_open(char *path, int flags, mode_t mode, struct vfscore_file **fpp)
 			goto out_fp_free_unlock;
 		}
 
+		vn_io_wlock(vp);
 		error = VOP_TRUNCATE(vp, 0);
+		vn_io_wunlock(vp);
 		if (error)
 			goto out_fp_free_unlock;
+		vfscore_pagecache_truncate(vp, 0);
 	}
 
 	error = VOP_OPEN(vp, fp);
@@ -252,6 +263,7 @@ sys_read(struct vfscore_file *fp, const struct iovec *iov, size_t niov,
 		off_t offset, size_t *count)
 {
 	int error = 0;
+	struct iovec small_iov[UIO_SMALLIOV];
 	struct iovec *copy_iov;
 	if ((fp->f_flags & UK_FREAD) == 0)
 		return EBADF;
@@ -279,10 +291,17 @@ sys_read(struct vfscore_file *fp, const struct iovec *iov, size_t niov,
 	 * "Unfortunately, the current implementation of fp->read
 	 *  zeros the iov_len fields when it reads from disk, so we
 	 *  have to copy iov. "
+	 *
+	 * Short vectors, like the single one of read(), are copied to the
+	 * stack.
 	 */
-	copy_iov = calloc(sizeof(struct iovec), niov);
-	if (!copy_iov)
-		return ENOMEM;
+	if (niov <= UIO_SMALLIOV) {
+		copy_iov = small_iov;
+	} else {
+		copy_iov = calloc(sizeof(struct iovec), niov);
+		if (!copy_iov)
+			return ENOMEM;
+	}
 	memcpy(copy_iov, iov, sizeof(struct iovec)*niov);
 
 	uio.uio_iov = copy_iov;
@@ -293,7 +312,8 @@ sys_read(struct vfscore_file *fp, const struct iovec *iov, size_t niov,
 	error = vfs_read(fp, &uio, (offset == -1) ? 0 : FOF_OFFSET);
 	*count = bytes - uio.uio_resid;
 
-	free(copy_iov);
+	if (copy_iov != small_iov)
+		free(copy_iov);
 	return error;
 }
 
@@ -301,6 +321,7 @@ int
 sys_write(struct vfscore_file *fp, const struct iovec *iov, size_t niov,
 		off_t offset, size_t *count)
 {
+	struct iovec small_iov[UIO_SMALLIOV];
 	struct iovec *copy_iov;
 	int error = 0;
 	if ((fp->f_flags & UK_FWRITE) == 0)
@@ -329,9 +350,13 @@ sys_write(struct vfscore_file *fp, const struct iovec *iov, size_t niov,
 	 *  iov_len fields when it writes to disk, so we have to copy iov.
 	 */
 	/* std::vector<iovec> copy_iov(iov, iov + niov); */
-	copy_iov = calloc(sizeof(struct iovec), niov);
-	if (!copy_iov)
-		return ENOMEM;
+	if (niov <= UIO_SMALLIOV) {
+		copy_iov = small_iov;
+	} else {
+		copy_iov = calloc(sizeof(struct iovec), niov);
+		if (!copy_iov)
+			return ENOMEM;
+	}
 	memcpy(copy_iov, iov, sizeof(struct iovec)*niov);
 
 	uio.uio_iov = copy_iov;
@@ -342,7 +367,8 @@ sys_write(struct vfscore_file *fp, const struct iovec *iov, size_t niov,
 	error = vfs_write(fp, &uio, (offset == -1) ? 0 : FOF_OFFSET);
 	*count = bytes - uio.uio_resid;
 
-	free(copy_iov);
+	if (copy_iov != small_iov)
+		free(copy_iov);
 	return error;
 }
 
@@ -430,6 +456,68 @@ exit:
 	return error;
 }
 
+#if CONFIG_LIBVFSCORE_GROUP_SYNC
+#define GROUP_SYNC_WINDOW \
+	((__nsec)ukarch_time_usec_to_nsec(CONFIG_LIBVFSCORE_GROUP_SYNC_WINDOW))
+
+/*
+ * Group commit on MNT_SYNCALL file systems, where any VOP_FSYNC() makes the
+ * whole file system durable. The first caller becomes the leader: it waits
+ * for the group commit window and runs one sync on behalf of everybody who
+ * arrived until then. Callers that arrive while the sync is running may
+ * not be covered by it and are served by the next one.
+ */
+static int
+group_sync(struct vfscore_file *fp)
+{
+	struct vnode *vp = fp->f_dentry->d_vnode;
+	struct vfscore_gsync *gs = &vp->v_mount->m_gsync;
+	unsigned long target, gen, done;
+	int error;
+
+	uk_mutex_lock(&gs->lock);
+	/* The next sync to start covers all data written so far */
+	target = gs->started + 1;
+	while (gs->done < target) {
+		if (gs->running) {
+			done = gs->done;
+			uk_mutex_unlock(&gs->lock);
+			uk_waitq_wait_event(&gs->wq,
+					    uk_load_n(&gs->done) != done);
+			uk_mutex_lock(&gs->lock);
+			continue;
+		}
+
+		gs->running = 1;
+		uk_mutex_unlock(&gs->lock);
+		if (GROUP_SYNC_WINDOW)
+			uk_sched_thread_sleep(GROUP_SYNC_WINDOW);
+
+		uk_mutex_lock(&gs->lock);
+		gen = ++gs->started;
+		uk_mutex_unlock(&gs->lock);
+
+		vn_lock(vp);
+		error = VOP_FSYNC(vp, fp);
+		vn_unlock(vp);
+
+		uk_mutex_lock(&gs->lock);
+		if (unlikely(error)) {
+			gs->failed = gen;
+			gs->error = error;
+		}
+		gs->running = 0;
+		uk_store_n(&gs->done, gen);
+		uk_waitq_wake_up(&gs->wq);
+	}
+
+	/* Report a failure of our sync, or of a later one if we missed it */
+	error = (gs->failed >= target) ? gs->error : 0;
+	uk_mutex_unlock(&gs->lock);
+	return error;
+}
+#endif /* CONFIG_LIBVFSCORE_GROUP_SYNC */
+
 int
 sys_fsync(struct vfscore_file *fp)
 {
@@ -443,7 +531,15 @@ sys_fsync(struct vfscore_file *fp)
 
 	vp = fp->f_dentry->d_vnode;
 	vn_lock(vp);
-	error = VOP_FSYNC(vp, fp);
+	error = vfscore_pagecache_flush(vp);
+#if CONFIG_LIBVFSCORE_GROUP_SYNC
+	if (!error && vp->v_mount && (vp->v_mount->m_flags & MNT_SYNCALL)) {
+		vn_unlock(vp);
+		return group_sync(fp);
+	}
+#endif /* CONFIG_LIBVFSCORE_GROUP_SYNC */
+	if (!error)
+		error = VOP_FSYNC(vp, fp);
 	vn_unlock(vp);
 	return error;
 }
@@ -603,6 +699,8 @@ sys_mkdir(char *path, mode_t mode)
 	mode |= S_IFDIR;
 
 	error = VOP_MKDIR(ddp->d_vnode, name, mode);
+	if (!error)
+		dentry_negative_invalidate();
  out:
 	vn_unlock(ddp->d_vnode);
 	drele(ddp);
@@ -692,6 +790,8 @@ sys_mknod(char *path, mode_t mode)
 		error = VOP_MKDIR(ddp->d_vnode, name, mode);
 	else
 		error = VOP_CREATE(ddp->d_vnode, name, mode);
+	if (!error)
+		dentry_negative_invalidate();
  out:
 	vn_unlock(ddp->d_vnode);
 	drele(ddp);
@@ -864,6 +964,7 @@ sys_rename(char *src, char *dest)
 	error = VOP_RENAME(dvp1, vp1, sname, dvp2, vp2, dname);
 	if (error)
 		goto err3;
+	dentry_negative_invalidate();
 
 	error = dentry_move(dp1, ddp2, dname);
 
@@ -925,6 +1026,8 @@ sys_symlink(const char *oldpath, const char *newpath)
 		goto out_unlock;
 
 	error = VOP_SYMLINK(newdirdp->d_vnode, name, oldpath);
+	if (!error)
+		dentry_negative_invalidate();
 
 out_unlock:
 	vn_unlock(newdirdp->d_vnode);
@@ -986,6 +1089,8 @@ sys_link(char *oldpath, char *newpath)
 	}
 
 	error = VOP_LINK(newdirdp->d_vnode, vp, name);
+	if (!error)
+		dentry_negative_invalidate();
  out1:
 	vn_unlock(newdirdp->d_vnode);
 	drele(newdirdp);
@@ -1178,7 +1283,14 @@ sys_truncate(char *path, off_t length)
 		return error;
 
 	vn_lock(dp->d_vnode);
-	error = VOP_TRUNCATE(dp->d_vnode, length);
+	error = vfscore_pagecache_flush(dp->d_vnode);
+	if (!error) {
+		vn_io_wlock(dp->d_vnode);
+		error = VOP_TRUNCATE(dp->d_vnode, length);
+		vn_io_wunlock(dp->d_vnode);
+	}
+	if (!error)
+		vfscore_pagecache_truncate(dp->d_vnode, length);
 	vn_unlock(dp->d_vnode);
 
 	drele(dp);
@@ -1196,7 +1308,14 @@ sys_ftruncate(struct vfscore_file *fp, off_t length)
 
 	vp = fp->f_dentry->d_vnode;
 	vn_lock(vp);
-	error = VOP_TRUNCATE(vp, length);
+	error = vfscore_pagecache_flush(vp);
+	if (!error) {
+		vn_io_wlock(vp);
+		error = VOP_TRUNCATE(vp, length);
+		vn_io_wunlock(vp);
+	}
+	if (!error)
+		vfscore_pagecache_truncate(vp, length);
 	vn_unlock(vp);
 
 	return error;
@@ -1544,7 +1663,9 @@ sys_fallocate(struct vfscore_file *fp, int mode, off_t offset, off_t len)
 		goto ret;
 	}
 
+	vn_io_wlock(vp);
 	error = VOP_FALLOCATE(vp, mode, offset, len);
+	vn_io_wunlock(vp);
 ret:
 	vn_unlock(vp);
 	return error;
@@ -35,6 +35,10 @@
 
 #define _GNU_SOURCE
 #include <vfscore/mount.h>
+#include <vfscore/pagecache.h>
+#include <vfscore/vnode.h>
+#include <uk/atomic.h>
+#include <uk/rwlock.h>
 
 #include <limits.h>
 #include <fcntl.h>
@@ -706,6 +710,14 @@ void vnode_init(void);
  */
 void lookup_init(void);
 
+#if CONFIG_LIBVFSCORE_PAGECACHE
+/**
+ * Initializes the hash table of the page cache.
+ * It is called once (from vfscore_init()) in initialization.
+ */
+void vfscore_pagecache_init(void);
+#endif /* CONFIG_LIBVFSCORE_PAGECACHE */
+
 /**
  * Gets the root directory and mount point for specified path.
  *
@@ -750,6 +762,72 @@ int fs_noop(void);
  */
 void dentry_init(void);
 
+#if CONFIG_LIBVFSCORE_DCACHE
+/**
+ * Drops the references that the dentry cache holds on the dentries of a
+ * mount point. Must be called before the file system is unmounted.
+ *
+ * @param mp
+ *	Mount point
+ */
+void dentry_cache_flush(struct mount *mp);
+#else /* !CONFIG_LIBVFSCORE_DCACHE */
+static inline void dentry_cache_flush(struct mount *mp __unused) {}
+#endif /* !CONFIG_LIBVFSCORE_DCACHE */
+
+#if CONFIG_LIBVFSCORE_DCACHE_NEGATIVE
+/**
+ * Returns the generation of the negative dentry cache. Must be read before
+ * the lookup whose failure is passed to dentry_negative_add().
+ */
+unsigned long dentry_negative_gen(void);
+
+/**
+ * Records that a path does not exist.
+ *
+ * @param mp
+ *	Mount point
+ * @param path
+ *	Path in the file system
+ * @param gen
+ *	Generation returned by dentry_negative_gen() before the lookup. The
+ *	entry is not valid if the generation has changed meanwhile.
+ */
+void dentry_negative_add(struct mount *mp, const char *path,
+			 unsigned long gen);
+
+/**
+ * Tells whether a path is known not to exist.
+ *
+ * @param mp
+ *	Mount point
+ * @param path
+ *	Path in the file system
+ * @return
+ *	- (1): The path does not exist
+ *	- (0): Unknown
+ */
+int dentry_negative_lookup(struct mount *mp, const char *path);
+
+/**
+ * Invalidates the negative dentry cache. Must be called after anything
+ * that can make a path exist, e.g., creating, linking, renaming, or
+ * mounting.
+ */
+void dentry_negative_invalidate(void);
+#else /* !CONFIG_LIBVFSCORE_DCACHE_NEGATIVE */
+static inline unsigned long dentry_negative_gen(void) { return 0; }
+static inline void dentry_negative_add(struct mount *mp __unused,
+				       const char *path __unused,
+				       unsigned long gen __unused) {}
+static inline int dentry_negative_lookup(struct mount *mp __unused,
+					 const char *path __unused)
+{
+	return 0;
+}
+static inline void dentry_negative_invalidate(void) {}
+#endif /* !CONFIG_LIBVFSCORE_DCACHE_NEGATIVE */
+
 /**
  * Releases the resources associated with the fp.
  *
@@ -858,6 +936,58 @@ int fget(int fd, struct vfscore_file **out_fp);
  */
 int fdalloc(struct vfscore_file *fp, int *newfd);
 
+/**
+ * Atomically decrements the reference count `*cnt` unless this would drop
+ * the last reference. Dentries and vnodes drop their last reference with
+ * their hash bucket locked, so that lookups cannot find them anymore.
+ *
+ * @param cnt
+ *	Pointer to the reference count
+ * @return
+ *	- (1): The reference was dropped
+ *	- (0): This is the last reference, nothing was changed
+ */
+static inline int vfs_refcnt_release_if_not_last(int *cnt)
+{
+	int old = uk_load_n(cnt);
+
+	do {
+		if (old == 1)
+			return 0;
+	} while (!uk_compare_exchange_n(cnt, &old, old - 1));
+	return 1;
+}
+
+/**
+ * Tells whether reads from a vnode run without its vnode lock. This is the
+ * case for regular files on mounts with MNT_SHAREDREAD that are not page
+ * cached: readers only take `v_iolock` shared, and everything that changes
+ * the contents or size of the file takes it exclusively in addition to the
+ * vnode lock (see vn_io_wlock()).
+ */
+static inline int vn_shared_read(struct vnode *vp)
+{
+	return vp->v_type == VREG && vp->v_mount &&
+	       (vp->v_mount->m_flags & MNT_SHAREDREAD) &&
+	       !vfscore_pagecache_enabled(vp);
+}
+
+/**
+ * Excludes shared readers of a vnode. Must be called with the vnode locked,
+ * around operations that change the contents or size of the file.
+ */
+static inline void vn_io_wlock(struct vnode *vp)
+{
+	if (vn_shared_read(vp))
+		uk_rwlock_wlock(&vp->v_iolock);
+}
+
+static inline void vn_io_wunlock(struct vnode *vp)
+{
+	if (vn_shared_read(vp))
+		uk_rwlock_wunlock(&vp->v_iolock);
+}
+
 #ifdef DEBUG_VFS
 
 /**
@@ -47,6 +47,7 @@
 #include <vfscore/prex.h>
 #include <vfscore/dentry.h>
 #include <vfscore/vnode.h>
+#include <vfscore/pagecache.h>
 #include "vfs.h"
 
 #define __UK_S_BLKSIZE 512
@@ -73,53 +74,60 @@ int vttoif_tab[10] = {
  * vrele      -1        *
  */
 
-#define VNODE_BUCKETS 32		/* size of vnode hash table */
+#define VNODE_BUCKETS 256		/* size of vnode hash table */
 
 /*
  * vnode table.
  * All active (opened) vnodes are stored on this hash table.
- * They can be accessed by its path name.
- */
-static struct uk_list_head vnode_table[VNODE_BUCKETS];
-
-/*
- * Global lock to access all vnodes and vnode table.
- * If a vnode is already locked, there is no need to
- * lock this global lock to access internal data.
+ * They can be accessed by their mount point and inode number.
+ *
+ * Each bucket has its own lock, which protects the bucket's list and the
+ * transition of the reference count of its vnodes to zero: references are
+ * taken and dropped atomically, but the last one is only dropped with the
+ * bucket locked, so that vn_lookup() never finds a vnode that is being
+ * released.
  */
-static struct uk_mutex vnode_lock = UK_MUTEX_INITIALIZER(vnode_lock);
-#define VNODE_LOCK()	uk_mutex_lock(&vnode_lock)
-#define VNODE_UNLOCK()	uk_mutex_unlock(&vnode_lock)
+struct vnode_bucket {
+	struct uk_list_head head;
+	struct uk_mutex lock;
+};
 
-/* TODO: implement mutex_owned */
-#define VNODE_OWNED()	(1)
-/* #define VNODE_OWNED()	mutex_owned(&vnode_lock) */
+static struct vnode_bucket vnode_table[VNODE_BUCKETS];
 
+/* Protects the v_names lists of all vnodes */
+static struct uk_mutex vnode_names_lock =
+	UK_MUTEX_INITIALIZER(vnode_names_lock);
 
 /*
- * Get the hash value from the mount point and path name.
- * XXX(hch): replace with a better hash for 64-bit pointers.
+ * Get the hash value from the mount point and inode number.
  */
 static unsigned int vn_hash(struct mount *mp, uint64_t ino)
 {
-	return (ino ^ (unsigned long)mp) & (VNODE_BUCKETS - 1);
+	uint64_t val = ino ^ ((uintptr_t)mp >> 6);
+
+	val *= 0x9e3779b97f4a7c15ULL;
+	return (unsigned int)(val >> 32) & (VNODE_BUCKETS - 1);
+}
+
+static inline struct vnode_bucket *vn_bucket(struct mount *mp, uint64_t ino)
+{
+	return &vnode_table[vn_hash(mp, ino)];
 }
 
 /*
  * Returns locked vnode for specified mount point and path.
  * vn_lock() will increment the reference count of vnode.
  *
- * Locking: VNODE_LOCK must be held.
+ * Locking: the lock of the vnode's bucket must be held.
  */
 struct vnode *
 vn_lookup(struct mount *mp, uint64_t ino)
 {
 	struct vnode *vp;
 
-	UK_ASSERT(VNODE_OWNED());
-	uk_list_for_each_entry(vp, &vnode_table[vn_hash(mp, ino)], v_link) {
+	uk_list_for_each_entry(vp, &vn_bucket(mp, ino)->head, v_link) {
 		if (vp->v_mount == mp && vp->v_ino == ino) {
-			vp->v_refcnt++;
+			uk_inc(&vp->v_refcnt);
 			uk_mutex_lock(&vp->v_lock);
 			return vp;
 		}
@@ -127,6 +135,28 @@ vn_lookup(struct mount *mp, uint64_t ino)
 	return NULL;		/* not found */
 }
 
+/*
+ * Drops a reference to the vnode. Returns 1 if it was the last one, in
+ * which case the vnode has been removed from the vnode table.
+ */
+static int vn_release(struct vnode *vp)
+{
+	struct vnode_bucket *b;
+
+	if (vfs_refcnt_release_if_not_last(&vp->v_refcnt))
+		return 0;
+
+	b = vn_bucket(vp->v_mount, vp->v_ino);
+	uk_mutex_lock(&b->lock);
+	if (uk_sub_fetch(&vp->v_refcnt, 1) > 0) {
+		uk_mutex_unlock(&b->lock);
+		return 0;
+	}
+	uk_list_del(&vp->v_link);
+	uk_mutex_unlock(&b->lock);
+	return 1;
+}
+
 #ifdef DEBUG_VFS
 static const char *
 vn_path(struct vnode *vp)
@@ -175,6 +205,7 @@ vn_unlock(struct vnode *vp)
 int
 vfscore_vget(struct mount *mp, uint64_t ino, struct vnode **vpp)
 {
+	struct vnode_bucket *b = vn_bucket(mp, ino);
 	struct vnode *vp;
 	int error;
 
@@ -182,40 +213,45 @@ vfscore_vget(struct mount *mp, uint64_t ino, struct vnode **vpp)
 
 	DPRINTF(VFSDB_VNODE, ("vfscore_vget %llu\n", (unsigned long long) ino));
 
-	VNODE_LOCK();
+	uk_mutex_lock(&b->lock);
 
 	vp = vn_lookup(mp, ino);
 	if (vp) {
-		VNODE_UNLOCK();
+		uk_mutex_unlock(&b->lock);
 		*vpp = vp;
 		return 1;
 	}
 
 	vp = calloc(1, sizeof(*vp));
 	if (!vp) {
-		VNODE_UNLOCK();
+		uk_mutex_unlock(&b->lock);
 		return 0;
 	}
 
 	UK_INIT_LIST_HEAD(&vp->v_names);
+#if CONFIG_LIBVFSCORE_PAGECACHE
+	UK_INIT_LIST_HEAD(&vp->v_dirty);
+#endif /* CONFIG_LIBVFSCORE_PAGECACHE */
 	vp->v_ino = ino;
 	vp->v_mount = mp;
 	vp->v_refcnt = 1;
 	vp->v_op = mp->m_op->vfs_vnops;
-	uk_mutex_init_config(&vp->v_lock, UK_MUTEX_CONFIG_RECURSE);
+	uk_mutex_init_config(&vp->v_lock,
+			     UK_MUTEX_CONFIG_RECURSE | UK_MUTEX_CONFIG_SPIN);
+	uk_rwlock_init(&vp->v_iolock);
 	/*
 	 * Request to allocate fs specific data for vnode.
 	 */
 	if ((error = VFS_VGET(mp, vp)) != 0) {
-		VNODE_UNLOCK();
+		uk_mutex_unlock(&b->lock);
 		free(vp);
 		return 0;
 	}
 	vfs_busy(vp->v_mount);
 	uk_mutex_lock(&vp->v_lock);
 
-	uk_list_add(&vp->v_link, &vnode_table[vn_hash(mp, ino)]);
-	VNODE_UNLOCK();
+	uk_list_add(&vp->v_link, &b->head);
+	uk_mutex_unlock(&b->lock);
 
 	*vpp = vp;
 
@@ -232,15 +268,12 @@ vput(struct vnode *vp)
 	UK_ASSERT(vp->v_refcnt > 0);
 	DPRINTF(VFSDB_VNODE, ("vput: ref=%d %s\n", vp->v_refcnt, vn_path(vp)));
 
-	VNODE_LOCK();
-	vp->v_refcnt--;
-	if (vp->v_refcnt > 0) {
-	    VNODE_UNLOCK();
+	if (!vn_release(vp)) {
 		vn_unlock(vp);
 		return;
 	}
-	uk_list_del(&vp->v_link);
-	VNODE_UNLOCK();
+
+	vfscore_pagecache_release(vp);
 
 	/*
 	 * Deallocate fs specific vnode data
@@ -261,10 +294,8 @@ vref(struct vnode *vp)
 	UK_ASSERT(vp);
 	UK_ASSERT(vp->v_refcnt > 0);	/* Need vfscore_vget */
 
-	VNODE_LOCK();
 	DPRINTF(VFSDB_VNODE, ("vref: ref=%d\n", vp->v_refcnt));
-	vp->v_refcnt++;
-	VNODE_UNLOCK();
+	uk_inc(&vp->v_refcnt);
 }
 
 /*
@@ -279,15 +310,11 @@ vrele(struct vnode *vp)
 	UK_ASSERT(vp);
 	UK_ASSERT(vp->v_refcnt > 0);
 
-	VNODE_LOCK();
 	DPRINTF(VFSDB_VNODE, ("vrele: ref=%d\n", vp->v_refcnt));
-	vp->v_refcnt--;
-	if (vp->v_refcnt > 0) {
-		VNODE_UNLOCK();
+	if (!vn_release(vp))
 		return;
-	}
-	uk_list_del(&vp->v_link);
-	VNODE_UNLOCK();
+
+	vfscore_pagecache_release(vp);
 
 	/*
 	 * Deallocate fs specific vnode data
@@ -319,6 +346,13 @@ vn_stat(struct vnode *vp, struct stat *st)
 
 	memset(vap, 0, sizeof(struct vattr));
 
+	/* Make the file system report the size including cached writes */
+	vn_lock(vp);
+	error = vfscore_pagecache_flush(vp);
+	vn_unlock(vp);
+	if (error)
+		return error;
+
 	error = VOP_GETATTR(vp, vap);
 	if (error)
 		return error;
@@ -456,14 +490,13 @@ vnode_dump(void)
 #endif /* CONFIG_LIBPOSIX_EVENT */
 			 };
 
-	VNODE_LOCK();
-
 	uk_pr_debug("Dump vnode\n");
 	uk_pr_debug(" vnode            mount            type  refcnt path\n");
 	uk_pr_debug(" ---------------- ---------------- ----- ------ ------------------------------\n");
 
 	for (i = 0; i < VNODE_BUCKETS; i++) {
-		uk_list_for_each_entry(vp, &vnode_table[i], v_link) {
+		uk_mutex_lock(&vnode_table[i].lock);
+		uk_list_for_each_entry(vp, &vnode_table[i].head, v_link) {
 			mp = vp->v_mount;
 
 
@@ -474,9 +507,9 @@ vnode_dump(void)
 				    (strlen(mp->m_path) == 1) ? "\0" : mp->m_path,
 				    vn_path(vp));
 		}
+		uk_mutex_unlock(&vnode_table[i].lock);
 	}
 	uk_pr_debug("\n");
-	VNODE_UNLOCK();
 }
 #endif
 
@@ -513,8 +546,10 @@ vnode_init(void)
 {
 	int i;
 
-	for (i = 0; i < VNODE_BUCKETS; i++)
-		UK_INIT_LIST_HEAD(&vnode_table[i]);
+	for (i = 0; i < VNODE_BUCKETS; i++) {
+		UK_INIT_LIST_HEAD(&vnode_table[i].head);
+		uk_mutex_init(&vnode_table[i].lock);
+	}
 }
 
 void vn_add_name(struct vnode *vp __unused, struct dentry *dp)
@@ -522,7 +557,9 @@ void vn_add_name(struct vnode *vp __unused, struct dentry *dp)
 	/* TODO: Re-enable this check when preemption and/or smp is
 	 * here */
 	/* UK_ASSERT(uk_mutex_is_locked(&vp->v_lock)); */
+	uk_mutex_lock(&vnode_names_lock);
 	uk_list_add(&dp->d_names_link, &vp->v_names);
+	uk_mutex_unlock(&vnode_names_lock);
 }
 
 void vn_del_name(struct vnode *vp __unused, struct dentry *dp)
@@ -530,5 +567,7 @@ void vn_del_name(struct vnode *vp __unused, struct dentry *dp)
 	/* TODO: Re-enable this check when preemption and/or smp is
 	 * here */
 	/* UK_ASSERT(uk_mutex_is_locked(&vp->v_lock)); */
+	uk_mutex_lock(&vnode_names_lock);
 	uk_list_del(&dp->d_names_link);
+	uk_mutex_unlock(&vnode_names_lock);
 }
@@ -0,0 +1,430 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __VIRTIOFS_H__
+#define __VIRTIOFS_H__
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include <uk/arch/time.h>
+#include <uk/essentials.h>
+#include <uk/list.h>
+#include <uk/mutex.h>
+#include <uk/virtio_fs.h>
+#include <vfscore/mount.h>
+#include <vfscore/vnode.h>
+
+/*
+ * FUSE protocol (<linux/fuse.h>), as far as it is used here
+ */
+
+#define FUSE_KERNEL_VERSION		7
+#define FUSE_KERNEL_MINOR_VERSION	31
+
+#define FUSE_ROOT_ID			1
+
+enum fuse_opcode {
+	FUSE_LOOKUP		= 1,
+	FUSE_FORGET		= 2,
+	FUSE_GETATTR		= 3,
+	FUSE_SETATTR		= 4,
+	FUSE_READLINK		= 5,
+	FUSE_SYMLINK		= 6,
+	FUSE_MKNOD		= 8,
+	FUSE_MKDIR		= 9,
+	FUSE_UNLINK		= 10,
+	FUSE_RMDIR		= 11,
+	FUSE_RENAME		= 12,
+	FUSE_LINK		= 13,
+	FUSE_OPEN		= 14,
+	FUSE_READ		= 15,
+	FUSE_WRITE		= 16,
+	FUSE_STATFS		= 17,
+	FUSE_RELEASE		= 18,
+	FUSE_FSYNC		= 20,
+	FUSE_INIT		= 26,
+	FUSE_OPENDIR		= 27,
+	FUSE_READDIR		= 28,
+	FUSE_RELEASEDIR		= 29,
+	FUSE_FSYNCDIR		= 30,
+	FUSE_DESTROY		= 38,
+	FUSE_FALLOCATE		= 43,
+	FUSE_SETUPMAPPING	= 48,
+	FUSE_REMOVEMAPPING	= 49,
+};
+
+/* Flags of FUSE_INIT */
+#define FUSE_BIG_WRITES		(1U << 5)
+#define FUSE_DONT_MASK		(1U << 6)
+#define FUSE_MAX_PAGES		(1U << 22)
+#define FUSE_MAP_ALIGNMENT	(1U << 26)
+
+/* Valid fields of FUSE_SETATTR */
+#define FATTR_MODE		(1U << 0)
+#define FATTR_UID		(1U << 1)
+#define FATTR_GID		(1U << 2)
+#define FATTR_SIZE		(1U << 3)
+#define FATTR_ATIME		(1U << 4)
+#define FATTR_MTIME		(1U << 5)
+#define FATTR_FH		(1U << 6)
+#define FATTR_ATIME_NOW		(1U << 7)
+#define FATTR_MTIME_NOW		(1U << 8)
+
+/* Flags of FUSE_SETUPMAPPING */
+#define FUSE_SETUPMAPPING_FLAG_WRITE	(1U << 0)
+#define FUSE_SETUPMAPPING_FLAG_READ	(1U << 1)
+
+struct fuse_in_header {
+	__u32 len;
+	__u32 opcode;
+	__u64 unique;
+	__u64 nodeid;
+	__u32 uid;
+	__u32 gid;
+	__u32 pid;
+	__u16 total_extlen;
+	__u16 padding;
+};
+
+struct fuse_out_header {
+	__u32 len;
+	__s32 error;
+	__u64 unique;
+};
+
+struct fuse_attr {
+	__u64 ino;
+	__u64 size;
+	__u64 blocks;
+	__u64 atime;
+	__u64 mtime;
+	__u64 ctime;
+	__u32 atimensec;
+	__u32 mtimensec;
+	__u32 ctimensec;
+	__u32 mode;
+	__u32 nlink;
+	__u32 uid;
+	__u32 gid;
+	__u32 rdev;
+	__u32 blksize;
+	__u32 flags;
+};
+
+struct fuse_entry_out {
+	__u64 nodeid;
+	__u64 generation;
+	__u64 entry_valid;
+	__u64 attr_valid;
+	__u32 entry_valid_nsec;
+	__u32 attr_valid_nsec;
+	struct fuse_attr attr;
+};
+
+struct fuse_forget_in {
+	__u64 nlookup;
+};
+
+struct fuse_getattr_in {
+	__u32 getattr_flags;
+	__u32 dummy;
+	__u64 fh;
+};
+
+struct fuse_attr_out {
+	__u64 attr_valid;
+	__u32 attr_valid_nsec;
+	__u32 dummy;
+	struct fuse_attr attr;
+};
+
+struct fuse_mknod_in {
+	__u32 mode;
+	__u32 rdev;
+	__u32 umask;
+	__u32 padding;
+};
+
+struct fuse_mkdir_in {
+	__u32 mode;
+	__u32 umask;
+};
+
+struct fuse_rename_in {
+	__u64 newdir;
+};
+
+struct fuse_link_in {
+	__u64 oldnodeid;
+};
+
+struct fuse_setattr_in {
+	__u32 valid;
+	__u32 padding;
+	__u64 fh;
+	__u64 size;
+	__u64 lock_owner;
+	__u64 atime;
+	__u64 mtime;
+	__u64 ctime;
+	__u32 atimensec;
+	__u32 mtimensec;
+	__u32 ctimensec;
+	__u32 mode;
+	__u32 unused4;
+	__u32 uid;
+	__u32 gid;
+	__u32 unused5;
+};
+
+struct fuse_open_in {
+	__u32 flags;
+	__u32 open_flags;
+};
+
+struct fuse_open_out {
+	__u64 fh;
+	__u32 open_flags;
+	__u32 padding;
+};
+
+struct fuse_release_in {
+	__u64 fh;
+	__u32 flags;
+	__u32 release_flags;
+	__u64 lock_owner;
+};
+
+struct fuse_read_in {
+	__u64 fh;
+	__u64 offset;
+	__u32 size;
+	__u32 read_flags;
+	__u64 lock_owner;
+	__u32 flags;
+	__u32 padding;
+};
+
+struct fuse_write_in {
+	__u64 fh;
+	__u64 offset;
+	__u32 size;
+	__u32 write_flags;
+	__u64 lock_owner;
+	__u32 flags;
+	__u32 padding;
+};
+
+struct fuse_write_out {
+	__u32 size;
+	__u32 padding;
+};
+
+struct fuse_kstatfs {
+	__u64 blocks;
+	__u64 bfree;
+	__u64 bavail;
+	__u64 files;
+	__u64 ffree;
+	__u32 bsize;
+	__u32 namelen;
+	__u32 frsize;
+	__u32 padding;
+	__u32 spare[6];
+};
+
+struct fuse_fsync_in {
+	__u64 fh;
+	__u32 fsync_flags;
+	__u32 padding;
+};
+
+struct fuse_fallocate_in {
+	__u64 fh;
+	__u64 offset;
+	__u64 length;
+	__u32 mode;
+	__u32 padding;
+};
+
+struct fuse_init_in {
+	__u32 major;
+	__u32 minor;
+	__u32 max_readahead;
+	__u32 flags;
+};
+
+struct fuse_init_out {
+	__u32 major;
+	__u32 minor;
+	__u32 max_readahead;
+	__u32 flags;
+	__u16 max_background;
+	__u16 congestion_threshold;
+	__u32 max_write;
+	__u32 time_gran;
+	__u16 max_pages;
+	__u16 map_alignment;
+	__u32 flags2;
+	__u32 unused[7];
+};
+
+struct fuse_dirent {
+	__u64 ino;
+	__u64 off;
+	__u32 namelen;
+	__u32 type;
+	char name[];
+};
+
+#define FUSE_DIRENT_ALIGN(x)	ALIGN_UP((x), sizeof(__u64))
+#define FUSE_DIRENT_SIZE(d) \
+	FUSE_DIRENT_ALIGN(__offsetof(struct fuse_dirent, name) + (d)->namelen)
+
+struct fuse_setupmapping_in {
+	__u64 fh;
+	__u64 foffset;
+	__u64 len;
+	__u64 flags;
+	__u64 moffset;
+};
+
+struct fuse_removemapping_in {
+	__u32 count;
+};
+
+struct fuse_removemapping_one {
+	__u64 moffset;
+	__u64 len;
+};
+
+/*
+ * In-memory structures
+ */
+
+/* The DAX window is handed out in slots of 2 MiB, each mapping the
+ * aligned range of a file at the same offset within its chunk.
+ */
+#define VIRTIOFS_DAX_SHIFT	21
+#define VIRTIOFS_DAX_SIZE	(1UL << VIRTIOFS_DAX_SHIFT)
+
+/* Buffers of the caller that a FUSE_READ or FUSE_WRITE may span */
+#define VIRTIOFS_UIO_SEGS	4
+
+struct virtiofs_node;
+
+struct virtiofs_dax_slot {
+	/* In the LRU list of the mount, most recently used first */
+	struct uk_list_head lru;
+	/* In the slot list of the node */
+	struct uk_list_head node_link;
+	/* Node whose chunk the slot maps, NULL if the slot is free */
+	struct virtiofs_node *np;
+	__u64 chunk;
+	int writable;
+};
+
+enum virtiofs_dax_mode {
+	VIRTIOFS_DAX_AUTO,
+	VIRTIOFS_DAX_NEVER,
+	VIRTIOFS_DAX_ALWAYS,
+};
+
+struct virtiofs_mount {
+	struct uk_virtio_fs_dev *dev;
+	struct virtiofs_node *root;
+	__u64 unique;
+	/* Largest payload of a READ and a WRITE request */
+	__u32 max_read;
+	__u32 max_write;
+	enum virtiofs_dax_mode dax_mode;
+	/* DAX window, dax_nslots is 0 if DAX is not used */
+	struct virtiofs_dax_slot *dax_slots;
+	__sz dax_nslots;
+	struct uk_list_head dax_lru;
+	/* Serializes DAX mappings and the accesses through them */
+	struct uk_mutex dax_lock;
+};
+
+struct virtiofs_node {
+	__u64 nodeid;
+	/* Number of lookups that the host counted for the node */
+	__u64 nlookup;
+	/* Handle for writes, which are not associated with an open file */
+	__u64 wfh;
+	int has_wfh;
+	/* Written since the last FUSE_FSYNC */
+	int dirty;
+	/* Attributes, valid until attr_expiry */
+	struct fuse_attr attr;
+	__nsec attr_expiry;
+	/* Mapped DAX slots and the last one used */
+	struct uk_list_head dax_slots;
+	struct virtiofs_dax_slot *dax_last;
+};
+
+struct virtiofs_file {
+	__u64 fh;
+	/* Entries of the last FUSE_READDIR reply */
+	char *dirbuf;
+	__u32 dirbuf_len;
+	__u32 dirbuf_off;
+	/* Directory offset of the next buffered entry */
+	off_t dirbuf_pos;
+};
+
+#define VIRTIOFS_MOUNT(mp)	((struct virtiofs_mount *)(mp)->m_data)
+#define VIRTIOFS_NODE(vp)	((struct virtiofs_node *)(vp)->v_data)
+#define VIRTIOFS_FILE(fp)	((struct virtiofs_file *)(fp)->f_data)
+
+/*
+ * virtiofs_subr.c
+ * Functions return 0 or a negative errno.
+ */
+
+/**
+ * Sends a FUSE request and waits for the reply
+ *
+ * @param vm
+ *   The mount
+ * @param opcode
+ *   FUSE_* opcode
+ * @param nodeid
+ *   Node that the request refers to
+ * @param in
+ *   Arguments of the request, without the header
+ * @param in_cnt
+ *   Number of arguments
+ * @param out
+ *   Buffers for the reply, without the header. May be NULL for requests
+ *   without a reply payload.
+ * @param out_cnt
+ *   Number of reply buffers
+ * @param len
+ *   Set to the length of the reply payload, may be NULL
+ */
+int virtiofs_request(struct virtiofs_mount *vm, __u32 opcode, __u64 nodeid,
+		     const struct iovec *in, unsigned int in_cnt,
+		     const struct iovec *out, unsigned int out_cnt,
+		     __sz *len);
+
+void virtiofs_forget(struct virtiofs_mount *vm, __u64 nodeid,
+		     __u64 nlookup);
+int virtiofs_release(struct virtiofs_mount *vm, __u64 nodeid, __u64 fh,
+		     int dir);
+
+int virtiofs_dax_init(struct virtiofs_mount *vm);
+void virtiofs_dax_fini(struct virtiofs_mount *vm);
+int virtiofs_dax_rw(struct virtiofs_mount *vm, struct virtiofs_node *np,
+		    __u64 fh, struct uio *uio, __sz len, int write);
+void virtiofs_dax_drop(struct virtiofs_mount *vm, struct virtiofs_node *np);
+
+static inline int virtiofs_dax(struct virtiofs_mount *vm)
+{
+	return vm->dax_nslots != 0;
+}
+
+#endif /* __VIRTIOFS_H__ */
@@ -0,0 +1,299 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <uk/assert.h>
+#include <uk/essentials.h>
+#include <uk/print.h>
+#include <vfscore/uio.h>
+
+#include "virtiofs.h"
+
+/* Header, arguments, and reply buffers of the largest request */
+#define VIRTIOFS_IOV_MAX	8
+
+int virtiofs_request(struct virtiofs_mount *vm, __u32 opcode, __u64 nodeid,
+		     const struct iovec *in, unsigned int in_cnt,
+		     const struct iovec *out, unsigned int out_cnt,
+		     __sz *len)
+{
+	struct iovec iov[VIRTIOFS_IOV_MAX];
+	struct fuse_in_header ih;
+	struct fuse_out_header oh;
+	unsigned int i, cnt = 0;
+	__sz rlen;
+	int rc;
+
+	UK_ASSERT(in_cnt + out_cnt + 2 <= VIRTIOFS_IOV_MAX);
+
+	memset(&ih, 0, sizeof(ih));
+	ih.len = sizeof(ih);
+	ih.opcode = opcode;
+	ih.unique = __atomic_add_fetch(&vm->unique, 1, __ATOMIC_RELAXED);
+	ih.nodeid = nodeid;
+
+	iov[cnt].iov_base = &ih;
+	iov[cnt++].iov_len = sizeof(ih);
+	for (i = 0; i < in_cnt; i++) {
+		ih.len += in[i].iov_len;
+		iov[cnt++] = in[i];
+	}
+	iov[cnt].iov_base = &oh;
+	iov[cnt++].iov_len = sizeof(oh);
+	for (i = 0; i < out_cnt; i++)
+		iov[cnt++] = out[i];
+
+	rc = uk_virtio_fs_request(vm->dev, iov, in_cnt + 1, out_cnt + 1,
+				  &rlen);
+	if (unlikely(rc))
+		return rc;
+	if (unlikely(rlen < sizeof(oh) || oh.len < sizeof(oh) ||
+		     oh.unique != ih.unique)) {
+		uk_pr_err("Invalid reply to opcode %"__PRIu32"\n", opcode);
+		return -EIO;
+	}
+	if (oh.error)
+		return (oh.error < 0) ? oh.error : -EIO;
+
+	if (len)
+		*len = MIN(rlen, (__sz)oh.len) - sizeof(oh);
+	return 0;
+}
+
+void virtiofs_forget(struct virtiofs_mount *vm, __u64 nodeid, __u64 nlookup)
+{
+	struct fuse_forget_in arg = { .nlookup = nlookup };
+	struct fuse_in_header ih;
+	struct iovec iov[2];
+	int rc;
+
+	memset(&ih, 0, sizeof(ih));
+	ih.len = sizeof(ih) + sizeof(arg);
+	ih.opcode = FUSE_FORGET;
+	ih.unique = __atomic_add_fetch(&vm->unique, 1, __ATOMIC_RELAXED);
+	ih.nodeid = nodeid;
+
+	iov[0].iov_base = &ih;
+	iov[0].iov_len = sizeof(ih);
+	iov[1].iov_base = &arg;
+	iov[1].iov_len = sizeof(arg);
+
+	/* FORGET has no reply. A lost one only leaks the inode on the host */
+	rc = uk_virtio_fs_request_hiprio(vm->dev, iov, 2);
+	if (unlikely(rc))
+		uk_pr_warn("Failed to forget node %"__PRIu64": %d\n",
+			   nodeid, rc);
+}
+
+int virtiofs_release(struct virtiofs_mount *vm, __u64 nodeid, __u64 fh,
+		     int dir)
+{
+	struct fuse_release_in arg;
+	struct iovec in;
+
+	memset(&arg, 0, sizeof(arg));
+	arg.fh = fh;
+
+	in.iov_base = &arg;
+	in.iov_len = sizeof(arg);
+	return virtiofs_request(vm, dir ? FUSE_RELEASEDIR : FUSE_RELEASE,
+				nodeid, &in, 1, NULL, 0, NULL);
+}
+
+/*
+ * DAX window
+ *
+ * Slots are taken from the tail of the LRU list, where free slots are
+ * kept as well, and move to its head on every access. All functions are
+ * called with vm->dax_lock held.
+ */
+
+static inline __u64 dax_moffset(struct virtiofs_mount *vm,
+				struct virtiofs_dax_slot *s)
+{
+	return (__u64)(s - vm->dax_slots) << VIRTIOFS_DAX_SHIFT;
+}
+
+static int dax_unmap(struct virtiofs_mount *vm, struct virtiofs_dax_slot *s)
+{
+	struct fuse_removemapping_in arg = { .count = 1 };
+	struct fuse_removemapping_one one;
+	struct virtiofs_node *np = s->np;
+	struct iovec in[2];
+	int rc;
+
+	UK_ASSERT(np);
+
+	one.moffset = dax_moffset(vm, s);
+	one.len = VIRTIOFS_DAX_SIZE;
+	in[0].iov_base = &arg;
+	in[0].iov_len = sizeof(arg);
+	in[1].iov_base = &one;
+	in[1].iov_len = sizeof(one);
+	rc = virtiofs_request(vm, FUSE_REMOVEMAPPING, np->nodeid, in, 2,
+			      NULL, 0, NULL);
+
+	/* The slot is reused even if the host failed to remove the mapping,
+	 * the next SETUPMAPPING replaces it.
+	 */
+	uk_list_del_init(&s->node_link);
+	if (np->dax_last == s)
+		np->dax_last = NULL;
+	s->np = NULL;
+	uk_list_move_tail(&s->lru, &vm->dax_lru);
+	return rc;
+}
+
+static int dax_map(struct virtiofs_mount *vm, struct virtiofs_dax_slot *s,
+		   struct virtiofs_node *np, __u64 fh, __u64 chunk, int write)
+{
+	struct fuse_setupmapping_in arg;
+	struct iovec in;
+	int rc;
+
+	memset(&arg, 0, sizeof(arg));
+	arg.fh = fh;
+	arg.foffset = chunk << VIRTIOFS_DAX_SHIFT;
+	arg.len = VIRTIOFS_DAX_SIZE;
+	arg.flags = FUSE_SETUPMAPPING_FLAG_READ;
+	if (write)
+		arg.flags |= FUSE_SETUPMAPPING_FLAG_WRITE;
+	arg.moffset = dax_moffset(vm, s);
+
+	in.iov_base = &arg;
+	in.iov_len = sizeof(arg);
+	rc = virtiofs_request(vm, FUSE_SETUPMAPPING, np->nodeid, &in, 1,
+			      NULL, 0, NULL);
+	if (unlikely(rc))
+		return rc;
+
+	if (s->np != np) {
+		s->np = np;
+		uk_list_add(&s->node_link, &np->dax_slots);
+	}
+	s->chunk = chunk;
+	s->writable = write;
+	return 0;
+}
+
+/* Returns the slot that maps `chunk` of the node, mapping it if needed */
+static int dax_get(struct virtiofs_mount *vm, struct virtiofs_node *np,
+		   __u64 fh, __u64 chunk, int write,
+		   struct virtiofs_dax_slot **sp)
+{
+	struct virtiofs_dax_slot *s, *it;
+	int rc;
+
+	s = np->dax_last;
+	if (!s || s->chunk != chunk) {
+		s = NULL;
+		uk_list_for_each_entry(it, &np->dax_slots, node_link) {
+			if (it->chunk == chunk) {
+				s = it;
+				break;
+			}
+		}
+	}
+
+	if (!s) {
+		s = uk_list_last_entry(&vm->dax_lru, struct virtiofs_dax_slot,
+				       lru);
+		if (s->np) {
+			rc = dax_unmap(vm, s);
+			if (unlikely(rc))
+				uk_pr_warn("Failed to unmap DAX slot: %d\n",
+					   rc);
+		}
+		rc = dax_map(vm, s, np, fh, chunk, write);
+		if (unlikely(rc))
+			return rc;
+	} else if (write && !s->writable) {
+		/* Mapping again over the same range upgrades it */
+		rc = dax_map(vm, s, np, fh, chunk, write);
+		if (unlikely(rc))
+			return rc;
+	}
+
+	uk_list_move(&s->lru, &vm->dax_lru);
+	np->dax_last = s;
+	*sp = s;
+	return 0;
+}
+
+int virtiofs_dax_rw(struct virtiofs_mount *vm, struct virtiofs_node *np,
+		    __u64 fh, struct uio *uio, __sz len, int write)
+{
+	struct virtiofs_dax_slot *s;
+	__u64 off, chunk;
+	__sz cnt;
+	char *p;
+	int rc = 0;
+
+	uk_mutex_lock(&vm->dax_lock);
+	while (len > 0) {
+		off = uio->uio_offset;
+		chunk = off >> VIRTIOFS_DAX_SHIFT;
+		cnt = MIN(len, VIRTIOFS_DAX_SIZE -
+			       (off & (VIRTIOFS_DAX_SIZE - 1)));
+
+		rc = dax_get(vm, np, fh, chunk, write, &s);
+		if (unlikely(rc))
+			break;
+
+		p = (char *)vm->dev->dax_base + dax_moffset(vm, s) +
+		    (off & (VIRTIOFS_DAX_SIZE - 1));
+		rc = vfscore_uiomove(p, cnt, uio);
+		if (unlikely(rc))
+			break;
+		len -= cnt;
+	}
+	uk_mutex_unlock(&vm->dax_lock);
+	return rc;
+}
+
+void virtiofs_dax_drop(struct virtiofs_mount *vm, struct virtiofs_node *np)
+{
+	struct virtiofs_dax_slot *s, *tmp;
+
+	if (!virtiofs_dax(vm))
+		return;
+
+	uk_mutex_lock(&vm->dax_lock);
+	uk_list_for_each_entry_safe(s, tmp, &np->dax_slots, node_link)
+		dax_unmap(vm, s);
+	uk_mutex_unlock(&vm->dax_lock);
+}
+
+int virtiofs_dax_init(struct virtiofs_mount *vm)
+{
+	__sz i;
+
+	vm->dax_nslots = vm->dev->dax_len >> VIRTIOFS_DAX_SHIFT;
+	if (!vm->dev->dax_base || !vm->dax_nslots) {
+		vm->dax_nslots = 0;
+		return 0;
+	}
+
+	vm->dax_slots = calloc(vm->dax_nslots, sizeof(*vm->dax_slots));
+	if (unlikely(!vm->dax_slots)) {
+		vm->dax_nslots = 0;
+		return -ENOMEM;
+	}
+	for (i = 0; i < vm->dax_nslots; i++) {
+		UK_INIT_LIST_HEAD(&vm->dax_slots[i].node_link);
+		uk_list_add_tail(&vm->dax_slots[i].lru, &vm->dax_lru);
+	}
+	return 0;
+}
+
+void virtiofs_dax_fini(struct virtiofs_mount *vm)
+{
+	free(vm->dax_slots);
+	vm->dax_slots = NULL;
+	vm->dax_nslots = 0;
+}
@@ -0,0 +1,268 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/statfs.h>
+#include <uk/arch/limits.h>
+#include <uk/errptr.h>
+#include <uk/print.h>
+#include <vfscore/dentry.h>
+#include <vfscore/mount.h>
+#include <vfscore/vnode.h>
+
+#include "virtiofs.h"
+
+#define FUSE_SUPER_MAGIC	0x65735546
+
+/* Default for servers that do not announce the number of pages */
+#define VIRTIOFS_MAX_PAGES	32
+
+extern struct vnops virtiofs_vnops;
+
+static int virtiofs_mount(struct mount *mp, const char *dev, int flags,
+			  const void *data);
+static int virtiofs_unmount(struct mount *mp, int flags);
+static int virtiofs_statfs(struct mount *mp, struct statfs *statp);
+
+#define virtiofs_sync	((vfsop_sync_t)vfscore_nullop)
+#define virtiofs_vget	((vfsop_vget_t)vfscore_nullop)
+
+struct vfsops virtiofs_vfsops = {
+	.vfs_mount	= virtiofs_mount,
+	.vfs_unmount	= virtiofs_unmount,
+	.vfs_sync	= virtiofs_sync,
+	.vfs_vget	= virtiofs_vget,
+	.vfs_statfs	= virtiofs_statfs,
+	.vfs_vnops	= &virtiofs_vnops
+};
+
+static struct vfscore_fs_type virtiofs_fs = {
+	.vs_name	= "virtiofs",
+	.vs_init	= NULL,
+	.vs_op		= &virtiofs_vfsops
+};
+
+UK_FS_REGISTER(virtiofs_fs);
+
+/*
+ * Mount options are separated by commas:
+ *   dax=auto|always|never  Access file contents through the DAX window of
+ *                          the device if it has one (default: auto)
+ */
+static int virtiofs_parse_options(struct virtiofs_mount *vm, const char *data)
+{
+	char *opts, *opt, *save;
+	int rc = 0;
+
+	vm->dax_mode = VIRTIOFS_DAX_AUTO;
+	if (!data || *data == '\0')
+		return 0;
+
+	opts = strdup(data);
+	if (unlikely(!opts))
+		return ENOMEM;
+
+	for (opt = strtok_r(opts, ",", &save); opt;
+	     opt = strtok_r(NULL, ",", &save)) {
+		if (!strcmp(opt, "dax") || !strcmp(opt, "dax=always")) {
+			vm->dax_mode = VIRTIOFS_DAX_ALWAYS;
+		} else if (!strcmp(opt, "dax=never")) {
+			vm->dax_mode = VIRTIOFS_DAX_NEVER;
+		} else if (!strcmp(opt, "dax=auto")) {
+			vm->dax_mode = VIRTIOFS_DAX_AUTO;
+		} else {
+			uk_pr_err("Unknown mount option \"%s\"\n", opt);
+			rc = EINVAL;
+			break;
+		}
+	}
+	free(opts);
+	return rc;
+}
+
+static int virtiofs_init(struct virtiofs_mount *vm)
+{
+	struct fuse_init_in arg;
+	struct fuse_init_out out;
+	struct iovec in, rep;
+	__sz len, msg;
+	__u32 max_pages;
+	int rc;
+
+	memset(&arg, 0, sizeof(arg));
+	arg.major = FUSE_KERNEL_VERSION;
+	arg.minor = FUSE_KERNEL_MINOR_VERSION;
+	arg.flags = FUSE_BIG_WRITES | FUSE_DONT_MASK | FUSE_MAX_PAGES |
+		    FUSE_MAP_ALIGNMENT;
+
+	memset(&out, 0, sizeof(out));
+	in.iov_base = &arg;
+	in.iov_len = sizeof(arg);
+	rep.iov_base = &out;
+	rep.iov_len = sizeof(out);
+	rc = virtiofs_request(vm, FUSE_INIT, 0, &in, 1, &rep, 1, &len);
+	if (unlikely(rc))
+		return -rc;
+	if (out.major != FUSE_KERNEL_VERSION) {
+		uk_pr_err("Unsupported FUSE version %"__PRIu32".%"__PRIu32"\n",
+			  out.major, out.minor);
+		return EPROTO;
+	}
+
+	/* Leave room for the pages that headers and unaligned buffers of
+	 * the caller occupy in addition.
+	 */
+	msg = 2 * VIRTIOFS_UIO_SEGS * __PAGE_SIZE;
+	if (unlikely(vm->dev->max_msg < 2 * msg)) {
+		uk_pr_err("Request queue of the device is too small\n");
+		return ENOSPC;
+	}
+	msg = vm->dev->max_msg - msg;
+	max_pages = (out.flags & FUSE_MAX_PAGES) && out.max_pages ?
+		    out.max_pages : VIRTIOFS_MAX_PAGES;
+	vm->max_read = MIN(msg, (__sz)max_pages * __PAGE_SIZE);
+	vm->max_write = MIN(msg, (__sz)out.max_write);
+	if (!vm->max_write)
+		vm->max_write = __PAGE_SIZE;
+
+	if (vm->dax_mode == VIRTIOFS_DAX_NEVER)
+		return 0;
+
+	/* Mappings are set up in slots that the host must be able to map */
+	if (!vm->dev->dax_base || !(out.flags & FUSE_MAP_ALIGNMENT) ||
+	    out.map_alignment > VIRTIOFS_DAX_SHIFT) {
+		if (vm->dax_mode == VIRTIOFS_DAX_ALWAYS) {
+			uk_pr_err("DAX is not available\n");
+			return ENOTSUP;
+		}
+		return 0;
+	}
+	return -virtiofs_dax_init(vm);
+}
+
+static int
+virtiofs_mount(struct mount *mp, const char *dev, int flags __unused,
+	       const void *data)
+{
+	struct virtiofs_mount *vm;
+	struct virtiofs_node *root;
+	int rc;
+
+	uk_pr_debug("%s: dev=%s\n", __func__, dev);
+
+	if (!dev || *dev == '\0')
+		return ENODEV;
+
+	vm = calloc(1, sizeof(*vm));
+	if (unlikely(!vm))
+		return ENOMEM;
+	uk_mutex_init(&vm->dax_lock);
+	UK_INIT_LIST_HEAD(&vm->dax_lru);
+
+	rc = virtiofs_parse_options(vm, data);
+	if (unlikely(rc))
+		goto err_free_vm;
+
+	vm->dev = uk_virtio_fs_get(dev);
+	if (PTRISERR(vm->dev)) {
+		rc = -PTR2ERR(vm->dev);
+		uk_pr_err("Failed to get virtio-fs device \"%s\": %d\n",
+			  dev, rc);
+		goto err_free_vm;
+	}
+
+	root = calloc(1, sizeof(*root));
+	if (unlikely(!root)) {
+		rc = ENOMEM;
+		goto err_put_dev;
+	}
+	root->nodeid = FUSE_ROOT_ID;
+	UK_INIT_LIST_HEAD(&root->dax_slots);
+	vm->root = root;
+
+	rc = virtiofs_init(vm);
+	if (unlikely(rc))
+		goto err_free_root;
+
+	/* Without DAX, file contents are cached in the guest. Accesses
+	 * through the window are not, and go on in parallel.
+	 */
+	if (virtiofs_dax(vm))
+		mp->m_flags |= MNT_SHAREDREAD;
+	else
+		mp->m_flags |= MNT_PAGECACHE;
+
+	mp->m_data = vm;
+	mp->m_root->d_vnode->v_data = root;
+
+	uk_pr_info("virtiofs: mounted %s (max. read %"__PRIu32", write %"
+		   __PRIu32" bytes, DAX %s)\n", dev, vm->max_read,
+		   vm->max_write, virtiofs_dax(vm) ? "on" : "off");
+	return 0;
+
+err_free_root:
+	free(root);
+err_put_dev:
+	uk_virtio_fs_put(vm->dev);
+err_free_vm:
+	free(vm);
+	return rc;
+}
+
+static int
+virtiofs_unmount(struct mount *mp, int flags __unused)
+{
+	struct virtiofs_mount *vm = VIRTIOFS_MOUNT(mp);
+	int rc;
+
+	/* Releasing the dentries drops the vnodes, which forget their nodes
+	 * and give their DAX slots back.
+	 */
+	vfscore_release_mp_dentries(mp);
+
+	rc = virtiofs_request(vm, FUSE_DESTROY, 0, NULL, 0, NULL, 0, NULL);
+	if (unlikely(rc))
+		uk_pr_warn("Failed to end session: %d\n", rc);
+
+	uk_virtio_fs_put(vm->dev);
+	virtiofs_dax_fini(vm);
+	free(vm->root);
+	free(vm);
+	mp->m_data = NULL;
+	return 0;
+}
+
+static int
+virtiofs_statfs(struct mount *mp, struct statfs *statp)
+{
+	struct virtiofs_mount *vm = VIRTIOFS_MOUNT(mp);
+	struct fuse_kstatfs st;
+	struct iovec rep;
+	__sz len;
+	int rc;
+
+	rep.iov_base = &st;
+	rep.iov_len = sizeof(st);
+	rc = virtiofs_request(vm, FUSE_STATFS, FUSE_ROOT_ID, NULL, 0, &rep, 1,
+			      &len);
+	if (rc)
+		return -rc;
+	if (unlikely(len < sizeof(st)))
+		return EIO;
+
+	statp->f_type = FUSE_SUPER_MAGIC;
+	statp->f_bsize = st.bsize;
+	statp->f_frsize = st.frsize;
+	statp->f_blocks = st.blocks;
+	statp->f_bfree = st.bfree;
+	statp->f_bavail = st.bavail;
+	statp->f_files = st.files;
+	statp->f_ffree = st.ffree;
+	statp->f_namelen = st.namelen;
+	return 0;
+}
@@ -0,0 +1,916 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <uk/essentials.h>
+#include <uk/plat/time.h>
+#include <uk/print.h>
+#include <vfscore/file.h>
+#include <vfscore/fs.h>
+#include <vfscore/mount.h>
+#include <vfscore/uio.h>
+#include <vfscore/vnode.h>
+
+#include "virtiofs.h"
+
+#define VIRTIOFS_DIRBUF_SIZE	4096
+
+/* Open flags passed to the host. Creation and truncation are separate
+ * operations, and vfscore positions appending writes by itself.
+ */
+#define VIRTIOFS_OFLAGS		(O_ACCMODE | O_SYNC | O_DSYNC)
+
+/* The root directory is vnode 0 in vfscore */
+static inline __u64 virtiofs_ino(__u64 nodeid)
+{
+	return (nodeid == FUSE_ROOT_ID) ? 0 : nodeid;
+}
+
+static void virtiofs_attr_cache(struct virtiofs_node *np,
+				const struct fuse_attr *attr,
+				__u64 valid, __u32 valid_nsec)
+{
+	np->attr = *attr;
+	np->attr_expiry = ukplat_monotonic_clock() +
+			  ukarch_time_sec_to_nsec(MIN(valid, UINT32_MAX)) +
+			  valid_nsec;
+}
+
+static int virtiofs_attr_get(struct virtiofs_mount *vm,
+			     struct virtiofs_node *np)
+{
+	struct fuse_getattr_in arg;
+	struct fuse_attr_out out;
+	struct iovec in, rep;
+	__sz len;
+	int rc;
+
+	if (ukplat_monotonic_clock() < np->attr_expiry)
+		return 0;
+
+	memset(&arg, 0, sizeof(arg));
+	in.iov_base = &arg;
+	in.iov_len = sizeof(arg);
+	rep.iov_base = &out;
+	rep.iov_len = sizeof(out);
+	rc = virtiofs_request(vm, FUSE_GETATTR, np->nodeid, &in, 1, &rep, 1,
+			      &len);
+	if (unlikely(rc))
+		return -rc;
+	if (unlikely(len < sizeof(out)))
+		return EIO;
+	virtiofs_attr_cache(np, &out.attr, out.attr_valid,
+			    out.attr_valid_nsec);
+	return 0;
+}
+
+/*
+ * Returns the vnode of an entry that the host returned from a lookup or a
+ * creating request. The host counts every such reply as a lookup of the
+ * node that is balanced with FUSE_FORGET in virtiofs_inactive().
+ */
+static int virtiofs_entry_vget(struct mount *mp,
+			       const struct fuse_entry_out *entry,
+			       struct vnode **vpp)
+{
+	struct virtiofs_mount *vm = VIRTIOFS_MOUNT(mp);
+	struct virtiofs_node *np;
+	struct vnode *vp;
+
+	if (vfscore_vget(mp, virtiofs_ino(entry->nodeid), &vp)) {
+		/* found in cache */
+		np = VIRTIOFS_NODE(vp);
+		__atomic_add_fetch(&np->nlookup, 1, __ATOMIC_RELAXED);
+		*vpp = vp;
+		return 0;
+	}
+	if (!vp) {
+		virtiofs_forget(vm, entry->nodeid, 1);
+		return ENOMEM;
+	}
+
+	np = calloc(1, sizeof(*np));
+	if (unlikely(!np)) {
+		virtiofs_forget(vm, entry->nodeid, 1);
+		vput(vp);
+		return ENOMEM;
+	}
+	np->nodeid = entry->nodeid;
+	np->nlookup = 1;
+	UK_INIT_LIST_HEAD(&np->dax_slots);
+	virtiofs_attr_cache(np, &entry->attr, entry->attr_valid,
+			    entry->attr_valid_nsec);
+
+	vp->v_data = np;
+	vp->v_type = IFTOVT(entry->attr.mode);
+	vp->v_mode = entry->attr.mode & ~S_IFMT;
+	vp->v_size = entry->attr.size;
+	*vpp = vp;
+	return 0;
+}
+
+/* Drops the lookup that a creating request added for its new entry */
+static void virtiofs_entry_put(struct virtiofs_mount *vm,
+			       const struct fuse_entry_out *entry)
+{
+	if (entry->nodeid)
+		virtiofs_forget(vm, entry->nodeid, 1);
+}
+
+static int virtiofs_lookup(struct vnode *dvp, const char *name,
+			   struct vnode **vpp)
+{
+	struct virtiofs_mount *vm = VIRTIOFS_MOUNT(dvp->v_mount);
+	struct virtiofs_node *dnp = VIRTIOFS_NODE(dvp);
+	struct fuse_entry_out entry;
+	struct iovec in, rep;
+	__sz len;
+	int rc;
+
+	*vpp = NULL;
+
+	if (*name == '\0')
+		return ENOENT;
+
+	in.iov_base = (void *)name;
+	in.iov_len = strlen(name) + 1;
+	rep.iov_base = &entry;
+	rep.iov_len = sizeof(entry);
+	rc = virtiofs_request(vm, FUSE_LOOKUP, dnp->nodeid, &in, 1, &rep, 1,
+			      &len);
+	if (rc)
+		return -rc;
+	if (unlikely(len < sizeof(entry)))
+		return EIO;
+	/* A node ID of 0 is a cacheable negative entry */
+	if (entry.nodeid == 0)
+		return ENOENT;
+
+	return virtiofs_entry_vget(dvp->v_mount, &entry, vpp);
+}
+
+static int virtiofs_inactive(struct vnode *vp)
+{
+	struct virtiofs_mount *vm = VIRTIOFS_MOUNT(vp->v_mount);
+	struct virtiofs_node *np = VIRTIOFS_NODE(vp);
+
+	if (!np || np->nodeid == FUSE_ROOT_ID)
+		return 0;
+
+	virtiofs_dax_drop(vm, np);
+	if (np->has_wfh)
+		virtiofs_release(vm, np->nodeid, np->wfh, 0);
+	virtiofs_forget(vm, np->nodeid, np->nlookup);
+	free(np);
+	vp->v_data = NULL;
+	return 0;
+}
+
+static int virtiofs_do_open(struct virtiofs_mount *vm,
+			    struct virtiofs_node *np, int dir, int oflags,
+			    __u64 *fh)
+{
+	struct fuse_open_in arg;
+	struct fuse_open_out out;
+	struct iovec in, rep;
+	__sz len;
+	int rc;
+
+	memset(&arg, 0, sizeof(arg));
+	arg.flags = oflags & VIRTIOFS_OFLAGS;
+	in.iov_base = &arg;
+	in.iov_len = sizeof(arg);
+	rep.iov_base = &out;
+	rep.iov_len = sizeof(out);
+	rc = virtiofs_request(vm, dir ? FUSE_OPENDIR : FUSE_OPEN, np->nodeid,
+			      &in, 1, &rep, 1, &len);
+	if (rc)
+		return -rc;
+	if (unlikely(len < sizeof(out)))
+		return EIO;
+	*fh = out.fh;
+	return 0;
+}
+
+/*
+ * Writes reach the file system without a file (e.g., from the page cache),
+ * so they go through a handle of the node. It is opened for reading as
+ * well, which DAX mappings require.
+ */
+static int virtiofs_wfh(struct virtiofs_mount *vm, struct virtiofs_node *np,
+			__u64 *fh)
+{
+	int rc;
+
+	if (!np->has_wfh) {
+		rc = virtiofs_do_open(vm, np, 0, O_RDWR, &np->wfh);
+		if (rc)
+			return rc;
+		np->has_wfh = 1;
+	}
+	*fh = np->wfh;
+	return 0;
+}
+
+static int virtiofs_open(struct vfscore_file *fp)
+{
+	struct vnode *vp = fp->f_dentry->d_vnode;
+	struct virtiofs_mount *vm = VIRTIOFS_MOUNT(vp->v_mount);
+	struct virtiofs_file *vf;
+	int rc;
+
+	if (vp->v_type != VREG && vp->v_type != VDIR)
+		return 0;
+
+	vf = calloc(1, sizeof(*vf));
+	if (unlikely(!vf))
+		return ENOMEM;
+
+	rc = virtiofs_do_open(vm, VIRTIOFS_NODE(vp), vp->v_type == VDIR,
+			      vfscore_oflags(fp->f_flags), &vf->fh);
+	if (rc) {
+		free(vf);
+		return rc;
+	}
+	fp->f_data = vf;
+	return 0;
+}
+
+static int virtiofs_close(struct vnode *vp, struct vfscore_file *fp)
+{
+	struct virtiofs_mount *vm = VIRTIOFS_MOUNT(vp->v_mount);
+	struct virtiofs_file *vf = VIRTIOFS_FILE(fp);
+	int rc;
+
+	if (!vf)
+		return 0;
+
+	rc = virtiofs_release(vm, VIRTIOFS_NODE(vp)->nodeid, vf->fh,
+			      vp->v_type == VDIR);
+	free(vf->dirbuf);
+	free(vf);
+	fp->f_data = NULL;
+	return -rc;
+}
+
+/* Advances a uio without copying, see vfscore_uioforeach() */
+static int virtiofs_uio_skip(void *dst __unused, void *src __unused,
+			     size_t *cnt __unused)
+{
+	return 0;
+}
+
+/*
+ * Transfers up to `len` bytes between the file and the buffers of `uio`
+ * with a single FUSE_READ or FUSE_WRITE. The buffers are passed to the
+ * device as they are, and `uio` is advanced by the bytes transferred.
+ */
+static int virtiofs_rw_request(struct virtiofs_mount *vm,
+			       struct virtiofs_node *np, __u64 fh,
+			       struct uio *uio, __sz len, int write,
+			       __sz *done)
+{
+	struct iovec iov[VIRTIOFS_UIO_SEGS + 2];
+	union {
+		struct fuse_read_in r;
+		struct fuse_write_in w;
+	} arg;
+	struct fuse_write_out wout;
+	unsigned int i, cnt = 0;
+	__sz rem = len, rlen;
+	int rc;
+
+	/* Only a few segments of the caller fit into a request */
+	for (i = 0; i < (unsigned int)uio->uio_iovcnt && rem > 0 &&
+		    cnt < VIRTIOFS_UIO_SEGS; i++) {
+		if (!uio->uio_iov[i].iov_len)
+			continue;
+		iov[cnt].iov_base = uio->uio_iov[i].iov_base;
+		iov[cnt].iov_len = MIN(uio->uio_iov[i].iov_len, rem);
+		rem -= iov[cnt++].iov_len;
+	}
+	len -= rem;
+
+	memset(&arg, 0, sizeof(arg));
+	if (write) {
+		arg.w.fh = fh;
+		arg.w.offset = uio->uio_offset;
+		arg.w.size = len;
+		memmove(&iov[1], &iov[0], cnt * sizeof(*iov));
+		iov[0].iov_base = &arg.w;
+		iov[0].iov_len = sizeof(arg.w);
+		wout.size = 0;
+		iov[cnt + 1].iov_base = &wout;
+		iov[cnt + 1].iov_len = sizeof(wout);
+		rc = virtiofs_request(vm, FUSE_WRITE, np->nodeid, iov, cnt + 1,
+				      &iov[cnt + 1], 1, &rlen);
+		if (!rc)
+			rlen = (rlen < sizeof(wout)) ? 0 : MIN(wout.size, len);
+	} else {
+		struct iovec in;
+
+		arg.r.fh = fh;
+		arg.r.offset = uio->uio_offset;
+		arg.r.size = len;
+		in.iov_base = &arg.r;
+		in.iov_len = sizeof(arg.r);
+		rc = virtiofs_request(vm, FUSE_READ, np->nodeid, &in, 1,
+				      iov, cnt, &rlen);
+		if (!rc)
+			rlen = MIN(rlen, len);
+	}
+	if (rc)
+		return -rc;
+
+	vfscore_uioforeach(virtiofs_uio_skip, NULL, rlen, uio);
+	*done = rlen;
+	return 0;
+}
+
+static int virtiofs_read(struct vnode *vp, struct vfscore_file *fp,
+			 struct uio *uio, int ioflag __unused)
+{
+	struct virtiofs_mount *vm = VIRTIOFS_MOUNT(vp->v_mount);
+	struct virtiofs_node *np = VIRTIOFS_NODE(vp);
+	struct virtiofs_file *vf = fp ? VIRTIOFS_FILE(fp) : NULL;
+	__sz len, done;
+	__u64 fh;
+	int rc;
+
+	if (vp->v_type == VDIR)
+		return EISDIR;
+	if (vp->v_type != VREG)
+		return EINVAL;
+	if (uio->uio_offset < 0)
+		return EINVAL;
+	if (uio->uio_resid == 0)
+		return 0;
+
+	/* The page cache fills pages of write-only files as well */
+	if (vf && (vfscore_oflags(fp->f_flags) & O_ACCMODE) != O_WRONLY) {
+		fh = vf->fh;
+	} else {
+		rc = virtiofs_wfh(vm, np, &fh);
+		if (rc)
+			return rc;
+	}
+
+	if (virtiofs_dax(vm)) {
+		/* Mappings must not reach beyond the end of the file */
+		if (uio->uio_offset >= vp->v_size)
+			return 0;
+		len = MIN((__u64)uio->uio_resid,
+			  (__u64)(vp->v_size - uio->uio_offset));
+		return -virtiofs_dax_rw(vm, np, fh, uio, len, 0);
+	}
+
+	while (uio->uio_resid > 0) {
+		len = MIN((__sz)uio->uio_resid, vm->max_read);
+		rc = virtiofs_rw_request(vm, np, fh, uio, len, 0, &done);
+		if (rc)
+			return rc;
+		if (done < len)
+			break;
+	}
+	return 0;
+}
+
+static int virtiofs_write(struct vnode *vp, struct uio *uio, int ioflag)
+{
+	struct virtiofs_mount *vm = VIRTIOFS_MOUNT(vp->v_mount);
+	struct virtiofs_node *np = VIRTIOFS_NODE(vp);
+	__sz len, done;
+	__u64 fh;
+	int rc;
+
+	if (vp->v_type == VDIR)
+		return EISDIR;
+	if (vp->v_type != VREG)
+		return EINVAL;
+	if (uio->uio_offset < 0)
+		return EINVAL;
+	if (uio->uio_resid == 0)
+		return 0;
+
+	rc = virtiofs_wfh(vm, np, &fh);
+	if (rc)
+		return rc;
+
+	if (ioflag & IO_APPEND)
+		uio->uio_offset = vp->v_size;
+
+	np->dirty = 1;
+	np->attr_expiry = 0;
+
+	/* Writes that extend the file cannot go through a mapping */
+	if (virtiofs_dax(vm) &&
+	    uio->uio_offset + uio->uio_resid <= vp->v_size)
+		return -virtiofs_dax_rw(vm, np, fh, uio, uio->uio_resid, 1);
+
+	rc = 0;
+	while (uio->uio_resid > 0) {
+		len = MIN((__sz)uio->uio_resid, vm->max_write);
+		rc = virtiofs_rw_request(vm, np, fh, uio, len, 1, &done);
+		if (rc)
+			break;
+		if (unlikely(done == 0)) {
+			rc = EIO;
+			break;
+		}
+	}
+	if (uio->uio_offset > vp->v_size)
+		vp->v_size = uio->uio_offset;
+	return rc;
+}
+
+static int virtiofs_setattr_do(struct virtiofs_mount *vm,
+			       struct virtiofs_node *np,
+			       struct fuse_setattr_in *arg)
+{
+	struct fuse_attr_out out;
+	struct iovec in, rep;
+	__sz len;
+	int rc;
+
+	in.iov_base = arg;
+	in.iov_len = sizeof(*arg);
+	rep.iov_base = &out;
+	rep.iov_len = sizeof(out);
+	rc = virtiofs_request(vm, FUSE_SETATTR, np->nodeid, &in, 1, &rep, 1,
+			      &len);
+	if (rc)
+		return -rc;
+	if (len >= sizeof(out))
+		virtiofs_attr_cache(np, &out.attr, out.attr_valid,
+				    out.attr_valid_nsec);
+	else
+		np->attr_expiry = 0;
+	return 0;
+}
+
+static int virtiofs_truncate(struct vnode *vp, off_t length)
+{
+	struct virtiofs_mount *vm = VIRTIOFS_MOUNT(vp->v_mount);
+	struct virtiofs_node *np = VIRTIOFS_NODE(vp);
+	struct fuse_setattr_in arg;
+	int rc;
+
+	if (vp->v_type == VDIR)
+		return EISDIR;
+	if (length < 0)
+		return EINVAL;
+
+	/* Mappings of truncated ranges would fault on the host */
+	if (length < vp->v_size)
+		virtiofs_dax_drop(vm, np);
+
+	memset(&arg, 0, sizeof(arg));
+	arg.valid = FATTR_SIZE;
+	arg.size = length;
+	rc = virtiofs_setattr_do(vm, np, &arg);
+	if (rc)
+		return rc;
+	vp->v_size = length;
+	np->dirty = 1;
+	return 0;
+}
+
+static int virtiofs_fsync(struct vnode *vp, struct vfscore_file *fp)
+{
+	struct virtiofs_mount *vm = VIRTIOFS_MOUNT(vp->v_mount);
+	struct virtiofs_node *np = VIRTIOFS_NODE(vp);
+	struct virtiofs_file *vf = fp ? VIRTIOFS_FILE(fp) : NULL;
+	struct fuse_fsync_in arg;
+	struct iovec in;
+	int rc;
+
+	/* vfscore syncs on every close, skip files that were not written */
+	if (!np->dirty || !vf)
+		return 0;
+
+	memset(&arg, 0, sizeof(arg));
+	arg.fh = vf->fh;
+	in.iov_base = &arg;
+	in.iov_len = sizeof(arg);
+	rc = virtiofs_request(vm, (vp->v_type == VDIR) ? FUSE_FSYNCDIR
+						       : FUSE_FSYNC,
+			      np->nodeid, &in, 1, NULL, 0, NULL);
+	if (rc == -ENOSYS)
+		rc = 0;
+	if (!rc)
+		np->dirty = 0;
+	return -rc;
+}
+
+/*
+ * The offset of a directory is the offset that the host reported for the
+ * last entry returned. Entries are fetched in batches, which are dropped
+ * when the offset was changed in between.
+ */
+static int virtiofs_readdir(struct vnode *vp, struct vfscore_file *fp,
+			    struct dirent64 *dir)
+{
+	struct virtiofs_mount *vm = VIRTIOFS_MOUNT(vp->v_mount);
+	struct virtiofs_file *vf = VIRTIOFS_FILE(fp);
+	struct fuse_dirent *de;
+	struct fuse_read_in arg;
+	struct iovec in, rep;
+	__sz len;
+	int rc;
+
+	if (!vf->dirbuf) {
+		vf->dirbuf = malloc(VIRTIOFS_DIRBUF_SIZE);
+		if (unlikely(!vf->dirbuf))
+			return ENOMEM;
+	}
+
+	if (vf->dirbuf_pos != fp->f_offset ||
+	    vf->dirbuf_off + sizeof(*de) > vf->dirbuf_len) {
+		memset(&arg, 0, sizeof(arg));
+		arg.fh = vf->fh;
+		arg.offset = fp->f_offset;
+		arg.size = VIRTIOFS_DIRBUF_SIZE;
+		in.iov_base = &arg;
+		in.iov_len = sizeof(arg);
+		rep.iov_base = vf->dirbuf;
+		rep.iov_len = VIRTIOFS_DIRBUF_SIZE;
+		rc = virtiofs_request(vm, FUSE_READDIR,
+				      VIRTIOFS_NODE(vp)->nodeid, &in, 1,
+				      &rep, 1, &len);
+		if (rc)
+			return -rc;
+		vf->dirbuf_len = len;
+		vf->dirbuf_off = 0;
+		vf->dirbuf_pos = fp->f_offset;
+		if (len < sizeof(*de))
+			return ENOENT;
+	}
+
+	de = (struct fuse_dirent *)(vf->dirbuf + vf->dirbuf_off);
+	if (unlikely(vf->dirbuf_off + FUSE_DIRENT_SIZE(de) >
+		     vf->dirbuf_len)) {
+		vf->dirbuf_len = 0;
+		return EIO;
+	}
+
+	dir->d_ino = de->ino;
+	dir->d_off = de->off;
+	dir->d_type = de->type;
+	len = MIN((__sz)de->namelen, sizeof(dir->d_name) - 1);
+	memcpy(dir->d_name, de->name, len);
+	dir->d_name[len] = '\0';
+
+	vf->dirbuf_off += FUSE_DIRENT_SIZE(de);
+	fp->f_offset = de->off;
+	vf->dirbuf_pos = de->off;
+	return 0;
+}
+
+/* Creates regular files, and special files for mknod() */
+static int virtiofs_create(struct vnode *dvp, const char *name, mode_t mode)
+{
+	struct virtiofs_mount *vm = VIRTIOFS_MOUNT(dvp->v_mount);
+	struct fuse_entry_out entry;
+	struct fuse_mknod_in arg;
+	struct iovec in[2], rep;
+	__sz len;
+	int rc;
+
+	memset(&arg, 0, sizeof(arg));
+	arg.mode = (mode & S_IFMT) ? mode : (mode | S_IFREG);
+	in[0].iov_base = &arg;
+	in[0].iov_len = sizeof(arg);
+	in[1].iov_base = (void *)name;
+	in[1].iov_len = strlen(name) + 1;
+	rep.iov_base = &entry;
+	rep.iov_len = sizeof(entry);
+	rc = virtiofs_request(vm, FUSE_MKNOD, VIRTIOFS_NODE(dvp)->nodeid,
+			      in, 2, &rep, 1, &len);
+	if (rc)
+		return -rc;
+	if (len >= sizeof(entry))
+		virtiofs_entry_put(vm, &entry);
+	return 0;
+}
+
+static int virtiofs_mkdir(struct vnode *dvp, const char *name, mode_t mode)
+{
+	struct virtiofs_mount *vm = VIRTIOFS_MOUNT(dvp->v_mount);
+	struct fuse_entry_out entry;
+	struct fuse_mkdir_in arg;
+	struct iovec in[2], rep;
+	__sz len;
+	int rc;
+
+	memset(&arg, 0, sizeof(arg));
+	arg.mode = mode & ~S_IFMT;
+	in[0].iov_base = &arg;
+	in[0].iov_len = sizeof(arg);
+	in[1].iov_base = (void *)name;
+	in[1].iov_len = strlen(name) + 1;
+	rep.iov_base = &entry;
+	rep.iov_len = sizeof(entry);
+	rc = virtiofs_request(vm, FUSE_MKDIR, VIRTIOFS_NODE(dvp)->nodeid,
+			      in, 2, &rep, 1, &len);
+	if (rc)
+		return -rc;
+	if (len >= sizeof(entry))
+		virtiofs_entry_put(vm, &entry);
+	return 0;
+}
+
+static int virtiofs_symlink(struct vnode *dvp, const char *name,
+			    const char *link)
+{
+	struct virtiofs_mount *vm = VIRTIOFS_MOUNT(dvp->v_mount);
+	struct fuse_entry_out entry;
+	struct iovec in[2], rep;
+	__sz len;
+	int rc;
+
+	in[0].iov_base = (void *)name;
+	in[0].iov_len = strlen(name) + 1;
+	in[1].iov_base = (void *)link;
+	in[1].iov_len = strlen(link) + 1;
+	rep.iov_base = &entry;
+	rep.iov_len = sizeof(entry);
+	rc = virtiofs_request(vm, FUSE_SYMLINK, VIRTIOFS_NODE(dvp)->nodeid,
+			      in, 2, &rep, 1, &len);
+	if (rc)
+		return -rc;
+	if (len >= sizeof(entry))
+		virtiofs_entry_put(vm, &entry);
+	return 0;
+}
+
+static int virtiofs_link(struct vnode *tdvp, struct vnode *svp,
+			 const char *name)
+{
+	struct virtiofs_mount *vm = VIRTIOFS_MOUNT(tdvp->v_mount);
+	struct fuse_entry_out entry;
+	struct fuse_link_in arg;
+	struct iovec in[2], rep;
+	__sz len;
+	int rc;
+
+	arg.oldnodeid = VIRTIOFS_NODE(svp)->nodeid;
+	in[0].iov_base = &arg;
+	in[0].iov_len = sizeof(arg);
+	in[1].iov_base = (void *)name;
+	in[1].iov_len = strlen(name) + 1;
+	rep.iov_base = &entry;
+	rep.iov_len = sizeof(entry);
+	rc = virtiofs_request(vm, FUSE_LINK, VIRTIOFS_NODE(tdvp)->nodeid,
+			      in, 2, &rep, 1, &len);
+	if (rc)
+		return -rc;
+	if (len >= sizeof(entry))
+		virtiofs_entry_put(vm, &entry);
+	VIRTIOFS_NODE(svp)->attr_expiry = 0;
+	return 0;
+}
+
+static int virtiofs_unlink(struct vnode *dvp, struct vnode *vp,
+			   const char *name, __u32 opcode)
+{
+	struct virtiofs_mount *vm = VIRTIOFS_MOUNT(dvp->v_mount);
+	struct iovec in;
+	int rc;
+
+	in.iov_base = (void *)name;
+	in.iov_len = strlen(name) + 1;
+	rc = virtiofs_request(vm, opcode, VIRTIOFS_NODE(dvp)->nodeid, &in, 1,
+			      NULL, 0, NULL);
+	if (rc)
+		return -rc;
+	if (vp && VIRTIOFS_NODE(vp))
+		VIRTIOFS_NODE(vp)->attr_expiry = 0;
+	return 0;
+}
+
+static int virtiofs_remove(struct vnode *dvp, struct vnode *vp,
+			   const char *name)
+{
+	return virtiofs_unlink(dvp, vp, name, FUSE_UNLINK);
+}
+
+static int virtiofs_rmdir(struct vnode *dvp, struct vnode *vp,
+			  const char *name)
+{
+	return virtiofs_unlink(dvp, vp, name, FUSE_RMDIR);
+}
+
+static int virtiofs_rename(struct vnode *dvp1, struct vnode *vp1 __unused,
+			   const char *name1, struct vnode *dvp2,
+			   struct vnode *vp2 __unused, const char *name2)
+{
+	struct virtiofs_mount *vm = VIRTIOFS_MOUNT(dvp1->v_mount);
+	struct fuse_rename_in arg;
+	struct iovec in[3];
+
+	arg.newdir = VIRTIOFS_NODE(dvp2)->nodeid;
+	in[0].iov_base = &arg;
+	in[0].iov_len = sizeof(arg);
+	in[1].iov_base = (void *)name1;
+	in[1].iov_len = strlen(name1) + 1;
+	in[2].iov_base = (void *)name2;
+	in[2].iov_len = strlen(name2) + 1;
+	return -virtiofs_request(vm, FUSE_RENAME, VIRTIOFS_NODE(dvp1)->nodeid,
+				 in, 3, NULL, 0, NULL);
+}
+
+static int virtiofs_getattr(struct vnode *vp, struct vattr *attr)
+{
+	struct virtiofs_mount *vm = VIRTIOFS_MOUNT(vp->v_mount);
+	struct virtiofs_node *np = VIRTIOFS_NODE(vp);
+	struct fuse_attr *fa = &np->attr;
+	int rc;
+
+	rc = virtiofs_attr_get(vm, np);
+	if (rc)
+		return rc;
+
+	attr->va_nodeid = fa->ino;
+	attr->va_type = vp->v_type;
+	attr->va_mode = fa->mode & ~S_IFMT;
+	attr->va_nlink = fa->nlink;
+	attr->va_uid = fa->uid;
+	attr->va_gid = fa->gid;
+	attr->va_rdev = fa->rdev;
+	attr->va_size = fa->size;
+	attr->va_nblocks = fa->blocks;
+	attr->va_atime.tv_sec = fa->atime;
+	attr->va_atime.tv_nsec = fa->atimensec;
+	attr->va_mtime.tv_sec = fa->mtime;
+	attr->va_mtime.tv_nsec = fa->mtimensec;
+	attr->va_ctime.tv_sec = fa->ctime;
+	attr->va_ctime.tv_nsec = fa->ctimensec;
+	return 0;
+}
+
+static int virtiofs_setattr(struct vnode *vp, struct vattr *attr)
+{
+	struct virtiofs_mount *vm = VIRTIOFS_MOUNT(vp->v_mount);
+	struct virtiofs_node *np = VIRTIOFS_NODE(vp);
+	struct fuse_setattr_in arg;
+	int rc;
+
+	memset(&arg, 0, sizeof(arg));
+	if (attr->va_mask & AT_MODE) {
+		arg.valid |= FATTR_MODE;
+		arg.mode = attr->va_mode & ~S_IFMT;
+	}
+	if (attr->va_mask & AT_UID) {
+		arg.valid |= FATTR_UID;
+		arg.uid = attr->va_uid;
+	}
+	if (attr->va_mask & AT_GID) {
+		arg.valid |= FATTR_GID;
+		arg.gid = attr->va_gid;
+	}
+	if (attr->va_mask & AT_ATIME) {
+		if (attr->va_atime.tv_nsec == UTIME_NOW) {
+			arg.valid |= FATTR_ATIME | FATTR_ATIME_NOW;
+		} else {
+			arg.valid |= FATTR_ATIME;
+			arg.atime = attr->va_atime.tv_sec;
+			arg.atimensec = attr->va_atime.tv_nsec;
+		}
+	}
+	if (attr->va_mask & AT_MTIME) {
+		if (attr->va_mtime.tv_nsec == UTIME_NOW) {
+			arg.valid |= FATTR_MTIME | FATTR_MTIME_NOW;
+		} else {
+			arg.valid |= FATTR_MTIME;
+			arg.mtime = attr->va_mtime.tv_sec;
+			arg.mtimensec = attr->va_mtime.tv_nsec;
+		}
+	}
+	if (!arg.valid)
+		return 0;
+
+	rc = virtiofs_setattr_do(vm, np, &arg);
+	if (rc)
+		return rc;
+	if (arg.valid & FATTR_MODE)
+		vp->v_mode = arg.mode;
+	return 0;
+}
+
+static int virtiofs_fallocate(struct vnode *vp, int mode, off_t offset,
+			      off_t len)
+{
+	struct virtiofs_mount *vm = VIRTIOFS_MOUNT(vp->v_mount);
+	struct virtiofs_node *np = VIRTIOFS_NODE(vp);
+	struct fuse_fallocate_in arg;
+	struct iovec in;
+	__u64 fh;
+	int rc;
+
+	if (vp->v_type != VREG)
+		return ENODEV;
+
+	rc = virtiofs_wfh(vm, np, &fh);
+	if (rc)
+		return rc;
+
+	/* Punched holes must not stay mapped */
+	if (mode & FALLOC_FL_PUNCH_HOLE)
+		virtiofs_dax_drop(vm, np);
+
+	memset(&arg, 0, sizeof(arg));
+	arg.fh = fh;
+	arg.offset = offset;
+	arg.length = len;
+	arg.mode = mode;
+	in.iov_base = &arg;
+	in.iov_len = sizeof(arg);
+	rc = virtiofs_request(vm, FUSE_FALLOCATE, np->nodeid, &in, 1,
+			      NULL, 0, NULL);
+	if (rc)
+		return (rc == -ENOSYS) ? EOPNOTSUPP : -rc;
+
+	np->dirty = 1;
+	np->attr_expiry = 0;
+	if (!(mode & FALLOC_FL_KEEP_SIZE) && offset + len > vp->v_size)
+		vp->v_size = offset + len;
+	return 0;
+}
+
+static int virtiofs_readlink(struct vnode *vp, struct uio *uio)
+{
+	struct virtiofs_mount *vm = VIRTIOFS_MOUNT(vp->v_mount);
+	struct iovec rep;
+	char *buf;
+	__sz len;
+	int rc;
+
+	if (vp->v_type != VLNK)
+		return EINVAL;
+
+	buf = malloc(PATH_MAX);
+	if (unlikely(!buf))
+		return ENOMEM;
+
+	rep.iov_base = buf;
+	rep.iov_len = PATH_MAX;
+	rc = virtiofs_request(vm, FUSE_READLINK, VIRTIOFS_NODE(vp)->nodeid,
+			      NULL, 0, &rep, 1, &len);
+	if (!rc)
+		rc = -vfscore_uiomove(buf, MIN(len, (__sz)uio->uio_resid),
+				      uio);
+	free(buf);
+	return -rc;
+}
+
+static int virtiofs_ioctl(struct vnode *vp __unused,
+			  struct vfscore_file *fp __unused,
+			  unsigned long com, void *data __unused)
+{
+	if (com == FIONBIO)
+		return 0;
+	return ENOTTY;
+}
+
+#define virtiofs_seek	((vnop_seek_t)vfscore_vop_nullop)
+#define virtiofs_cache	((vnop_cache_t)NULL)
+#define virtiofs_poll	((vnop_poll_t)vfscore_vop_einval)
+
+struct vnops virtiofs_vnops = {
+	.vop_open	= virtiofs_open,
+	.vop_close	= virtiofs_close,
+	.vop_read	= virtiofs_read,
+	.vop_write	= virtiofs_write,
+	.vop_seek	= virtiofs_seek,
+	.vop_ioctl	= virtiofs_ioctl,
+	.vop_fsync	= virtiofs_fsync,
+	.vop_readdir	= virtiofs_readdir,
+	.vop_lookup	= virtiofs_lookup,
+	.vop_create	= virtiofs_create,
+	.vop_remove	= virtiofs_remove,
+	.vop_rename	= virtiofs_rename,
+	.vop_mkdir	= virtiofs_mkdir,
+	.vop_rmdir	= virtiofs_rmdir,
+	.vop_getattr	= virtiofs_getattr,
+	.vop_setattr	= virtiofs_setattr,
+	.vop_inactive	= virtiofs_inactive,
+	.vop_truncate	= virtiofs_truncate,
+	.vop_link	= virtiofs_link,
+	.vop_cache	= virtiofs_cache,
+	.vop_fallocate	= virtiofs_fallocate,
+	.vop_readlink	= virtiofs_readlink,
+	.vop_symlink	= virtiofs_symlink,
+	.vop_poll	= virtiofs_poll,
+};
@@ -44,13 +44,19 @@
 #define BIOS_ROM_START		0xE0000UL
 #define BIOS_ROM_END		0xFFFFFUL
 #define BIOS_ROM_STEP		16
+#define ACPI_INDEX_SIZE		256
 
 static struct acpi_madt *acpi_madt;
 static struct acpi_fadt *acpi_fadt;
+static struct acpi_srat *acpi_srat;
+static struct acpi_slit *acpi_slit;
 static __u8 acpi_rsdt_entries;
 static void *acpi_rsdt;
 static __u8 acpi10;
 
+/* All valid tables of the RSDT, hashed by signature */
+static struct acpi_sdt_hdr *acpi_index[ACPI_INDEX_SIZE];
+
 static struct {
 	struct acpi_sdt_hdr **sdt;
 	const char *sig;
@@ -63,6 +69,14 @@ static struct {
 		.sdt = (struct acpi_sdt_hdr **)&acpi_madt,
 		.sig = ACPI_MADT_SIG,
 	},
+	{
+		.sdt = (struct acpi_sdt_hdr **)&acpi_srat,
+		.sig = ACPI_SRAT_SIG,
+	},
+	{
+		.sdt = (struct acpi_sdt_hdr **)&acpi_slit,
+		.sig = ACPI_SLIT_SIG,
+	},
 };
 
 static inline __paddr_t get_rsdt_entry(int idx)
@@ -91,35 +105,60 @@ static __u8 get_acpi_checksum(void __maybe_unused *buf, __sz __maybe_unused len)
 #endif
 }
 
-static void acpi_init_tables(void)
+/* Signature to slot, the RSDT has at most ACPI_INDEX_SIZE - 1 entries */
+static inline unsigned int acpi_index_slot(const char *sig)
 {
-	struct acpi_sdt_hdr *h;
-	const char *sig;
-	__sz i, j;
+	__u32 v;
 
-	UK_ASSERT(acpi_rsdt);
+	memcpy(&v, sig, sizeof(v));
+	return (v * 0x9e3779b1U) >> 24;
+}
 
-	for (i = 0; i < acpi_rsdt_entries; i++)
-		for (j = 0; j < ARRAY_SIZE(acpi_sdts); j++) {
-			if (*acpi_sdts[j].sdt)
-				continue;
+static void acpi_index_insert(struct acpi_sdt_hdr *h)
+{
+	unsigned int slot = acpi_index_slot(h->sig);
 
-			h = (struct acpi_sdt_hdr *)get_rsdt_entry(i);
-			sig = acpi_sdts[j].sig;
+	while (acpi_index[slot]) {
+		/* Keep the first table with a signature */
+		if (!memcmp(acpi_index[slot]->sig, h->sig, ACPI_SDT_SIG_LEN))
+			return;
+		slot = (slot + 1) % ACPI_INDEX_SIZE;
+	}
+	acpi_index[slot] = h;
+}
 
-			if (!memcmp(h->sig, sig, ACPI_SDT_SIG_LEN)) {
-				if (unlikely(get_acpi_checksum(h,
-							       h->tab_len))) {
-					uk_pr_warn("ACPI %s corrupted\n", sig);
+struct acpi_sdt_hdr *acpi_get_table(const char *sig)
+{
+	unsigned int slot = acpi_index_slot(sig);
 
-					continue;
-				}
+	while (acpi_index[slot]) {
+		if (!memcmp(acpi_index[slot]->sig, sig, ACPI_SDT_SIG_LEN))
+			return acpi_index[slot];
+		slot = (slot + 1) % ACPI_INDEX_SIZE;
+	}
+	return NULL;
+}
 
-				*acpi_sdts[j].sdt = h;
+static void acpi_init_tables(void)
+{
+	struct acpi_sdt_hdr *h;
+	__sz i;
+
+	UK_ASSERT(acpi_rsdt);
 
-				continue;
-			}
+	for (i = 0; i < acpi_rsdt_entries; i++) {
+		h = (struct acpi_sdt_hdr *)get_rsdt_entry(i);
+		if (unlikely(get_acpi_checksum(h, h->tab_len))) {
+			uk_pr_warn("ACPI %.4s corrupted\n", h->sig);
+
+			continue;
 		}
+
+		acpi_index_insert(h);
+	}
+
+	for (i = 0; i < ARRAY_SIZE(acpi_sdts); i++)
+		*acpi_sdts[i].sdt = acpi_get_table(acpi_sdts[i].sig);
 }
 
 /*
@@ -134,11 +173,11 @@ static void acpi_list_tables(void)
 
 	uk_pr_debug("%d ACPI tables found from %.4s\n", acpi_rsdt_entries,
 		    acpi10 ? ACPI_RSDT_SIG : ACPI_XSDT_SIG);
-	for (i = 0; i < ARRAY_SIZE(acpi_sdts); i++) {
-		if (!acpi_sdts[i].sdt)
+	for (i = 0; i < ACPI_INDEX_SIZE; i++) {
+		if (!acpi_index[i])
 			continue;
 
-		uk_pr_debug("%p: %.4s\n", acpi_sdts[i].sdt, acpi_sdts[i].sig);
+		uk_pr_debug("%p: %.4s\n", acpi_index[i], acpi_index[i]->sig);
 	}
 }
 #endif /* UK_DEBUG */
@@ -277,3 +316,19 @@ struct acpi_fadt *acpi_get_fadt(void)
 {
 	return acpi_fadt;
 }
+
+/*
+ * Return the System Resource Affinity Table (SRAT).
+ */
+struct acpi_srat *acpi_get_srat(void)
+{
+	return acpi_srat;
+}
+
+/*
+ * Return the System Locality Information Table (SLIT).
+ */
+struct acpi_slit *acpi_get_slit(void)
+{
+	return acpi_slit;
+}
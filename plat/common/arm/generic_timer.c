@@ -307,3 +307,9 @@ __nsec ukplat_wall_clock(void)
 {
 	return generic_timer_monotonic() + generic_timer_epochoffset();
 }
+
+const struct ukplat_clock_params *ukplat_clock_params(void)
+{
+	/* Not supported yet */
+	return NULL;
+}
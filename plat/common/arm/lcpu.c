@@ -43,8 +43,6 @@
 #include <uk/intctlr/gic.h>
 #include <libfdt.h>
 
-#define CPU_ID_MASK 0xff00ffffffUL
-
 /*
  *  CPU_EXCEPT_STACK_SIZE  CPU_EXCEPT_STACK_SIZE
  * <---------------------><--------------------->
@@ -350,6 +348,15 @@ int lcpu_arch_run(struct lcpu *lcpu, const struct ukplat_lcpu_func *fn,
 	return 0;
 }
 
+int lcpu_arch_kick(struct lcpu *lcpu)
+{
+	UK_ASSERT(lcpu->id != lcpu_arch_id());
+
+	gic->ops.gic_sgi_gen(*lcpu_run_irqv, lcpu->id);
+
+	return 0;
+}
+
 int lcpu_arch_wakeup(struct lcpu *lcpu)
 {
 	UK_ASSERT(lcpu->id != lcpu_arch_id());
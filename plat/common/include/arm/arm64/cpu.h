@@ -55,6 +55,9 @@ static inline void _init_cpufeatures(void)
  */
 extern smccc_conduit_fn_t smccc_psci_call;
 
+/* The affinity fields of MPIDR_EL1, which form the ID of an lcpu */
+#define CPU_ID_MASK 0xff00ffffffUL
+
 /* CPU native APIs */
 void halt(void);
 void reset(void);
@@ -37,6 +37,7 @@
 
 #include "sdt.h"
 #include "madt.h"
+#include "srat.h"
 
 #define RSDP_SIG		"RSD PTR "
 #define RSDP_SIG_LEN		8
@@ -53,6 +54,15 @@ struct acpi_rsdp {
 	__u8 reserved[3];
 } __packed;
 
+/**
+ * Get an ACPI table listed in the RSDT/XSDT.
+ *
+ * @param sig The 4 character signature of the table (e.g., "APIC")
+ *
+ * @return ACPI table pointer on success, NULL otherwise.
+ */
+struct acpi_sdt_hdr *acpi_get_table(const char *sig);
+
 /**
  * Get the Multiple APIC Descriptor Table (MADT).
  *
@@ -67,6 +77,20 @@ struct acpi_madt *acpi_get_madt(void);
  */
 struct acpi_fadt *acpi_get_fadt(void);
 
+/**
+ * Get the System Resource Affinity Table (SRAT).
+ *
+ * @return ACPI table pointer on success, NULL otherwise.
+ */
+struct acpi_srat *acpi_get_srat(void);
+
+/**
+ * Get the System Locality Information Table (SLIT).
+ *
+ * @return ACPI table pointer on success, NULL otherwise.
+ */
+struct acpi_slit *acpi_get_slit(void);
+
 /**
  * Detect ACPI version and fetch ACPI tables.
  *
@@ -154,6 +154,7 @@ UK_CTASSERT(sizeof(struct ukplat_lcpu_func)        == LCPU_FUNC_SIZE);
 
 UK_CTASSERT(__offsetof(struct lcpu, state)         == LCPU_STATE_OFFSET);
 UK_CTASSERT(__offsetof(struct lcpu, idx)           == LCPU_IDX_OFFSET);
+UK_CTASSERT(LCPU_IDX_OFFSET == UKPLAT_LCPU_IDX_OFFSET);
 UK_CTASSERT(__offsetof(struct lcpu, id)            == LCPU_ID_OFFSET);
 UK_CTASSERT(__offsetof(struct lcpu, s_args.entry)  == LCPU_ENTRY_OFFSET);
 UK_CTASSERT(__offsetof(struct lcpu, s_args.stackp) == LCPU_STACKP_OFFSET);
@@ -430,6 +431,15 @@ int lcpu_arch_post_start(const __lcpuidx lcpuidx[], unsigned int *num);
 int lcpu_arch_run(struct lcpu *lcpu, const struct ukplat_lcpu_func *fn,
 		  unsigned long flags);
 
+/**
+ * Send a run IRQ to the given logical CPU without queuing a function, so
+ * that the CPU executes the calls queued with ukplat_lcpu_call()
+ *
+ * @param lcpu the target logical CPU
+ * @return 0 on success, -errno otherwise
+ */
+int lcpu_arch_kick(struct lcpu *lcpu);
+
 /**
  * Send a wakeup IRQ to the specified logical CPU. The wakeup IRQ may be
  * implemented in such a way that the IRQ handler just acknowledges the IRQ and
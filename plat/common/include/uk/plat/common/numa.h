@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __PLAT_CMN_NUMA_H__
+#define __PLAT_CMN_NUMA_H__
+
+#include <uk/config.h>
+#include <uk/plat/numa.h>
+
+#if CONFIG_UKPLAT_NUMA
+/**
+ * Reads the NUMA topology from the ACPI SRAT and SLIT or, if there is no
+ * SRAT, from the numa-node-id properties of the device tree. Must be called
+ * after the lcpus are enumerated (see lcpu_mp_init()) and after ACPI is
+ * initialized. Without topology information, everything is on node 0.
+ *
+ * @param fdt
+ *   Pointer to the device tree or NULL
+ *
+ * @return
+ *   0 on success, a negative errno value otherwise
+ */
+int numa_init(void *fdt);
+#endif /* CONFIG_UKPLAT_NUMA */
+
+#endif /* __PLAT_CMN_NUMA_H__ */
@@ -81,6 +81,22 @@ struct acpi_madt {
 	__u8 entries[];
 } __packed;
 
+#define ACPI_SRAT_SIG					"SRAT"
+struct acpi_srat {
+	struct acpi_sdt_hdr hdr;
+	__u32 reserved0;
+	__u64 reserved1;
+	__u8 entries[];
+} __packed;
+
+#define ACPI_SLIT_SIG					"SLIT"
+struct acpi_slit {
+	struct acpi_sdt_hdr hdr;
+	__u64 nr_domains;
+	/* nr_domains x nr_domains matrix of relative distances */
+	__u8 distance[];
+} __packed;
+
 #define ACPI_GAS_ASID_SYS_MEM				0x00
 #define ACPI_GAS_ASID_SYS_IO				0x01
 #define ACPI_GAS_ASID_PCI_CFG				0x02
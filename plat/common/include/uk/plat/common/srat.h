@@ -0,0 +1,71 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __PLAT_CMN_SRAT_H__
+#define __PLAT_CMN_SRAT_H__
+
+#include "sdt.h"
+
+#define ACPI_SRAT_LAPIC						0x00
+#define ACPI_SRAT_MEM						0x01
+#define ACPI_SRAT_X2APIC					0x02
+#define ACPI_SRAT_GICC						0x03
+
+/*
+ * The following structures are declared according to the ACPI
+ * specification version 6.3.
+ */
+
+/* Processor Local APIC/SAPIC Affinity Structure */
+#define ACPI_SRAT_LAPIC_FLAGS_EN				0x01
+struct acpi_srat_lapic {
+	struct acpi_subsdt_hdr hdr;
+	__u8 domain_lo;
+	__u8 lapic_id;
+	__u32 flags;
+	__u8 lsapic_eid;
+	__u8 domain_hi[3];
+	__u32 clock_domain;
+} __packed;
+
+/* Memory Affinity Structure */
+#define ACPI_SRAT_MEM_FLAGS_EN					0x01
+#define ACPI_SRAT_MEM_FLAGS_HOTPLUG				0x02
+#define ACPI_SRAT_MEM_FLAGS_NV					0x04
+struct acpi_srat_mem {
+	struct acpi_subsdt_hdr hdr;
+	__u32 domain;
+	__u16 reserved0;
+	__u64 base;
+	__u64 len;
+	__u32 reserved1;
+	__u32 flags;
+	__u64 reserved2;
+} __packed;
+
+/* Processor Local x2APIC Affinity Structure */
+#define ACPI_SRAT_X2APIC_FLAGS_EN				0x01
+struct acpi_srat_x2apic {
+	struct acpi_subsdt_hdr hdr;
+	__u16 reserved0;
+	__u32 domain;
+	__u32 x2apic_id;
+	__u32 flags;
+	__u32 clock_domain;
+	__u32 reserved1;
+} __packed;
+
+/* GICC Affinity Structure */
+#define ACPI_SRAT_GICC_FLAGS_EN					0x01
+struct acpi_srat_gicc {
+	struct acpi_subsdt_hdr hdr;
+	__u32 domain;
+	__u32 uid;
+	__u32 flags;
+	__u32 clock_domain;
+} __packed;
+
+#endif /* __PLAT_CMN_SRAT_H__ */
@@ -49,6 +49,28 @@ static inline void cpuid(__u32 fn, __u32 subfn,
 		     : "a"(fn), "c" (subfn));
 }
 
+#define KVM_CPUID_SIGNATURE	0x40000000
+#define KVM_CPUID_FEATURES	0x40000001
+#define KVM_SIGNATURE_EBX	0x4b4d564b /* "KVMK" */
+#define KVM_SIGNATURE_ECX	0x564b4d56 /* "VMKV" */
+#define KVM_SIGNATURE_EDX	0x0000004d /* "M\0\0\0" */
+
+/* Returns the KVM paravirtual feature bits (KVM_FEATURE_*), or 0 if we do
+ * not run on KVM
+ */
+static inline __u32 kvm_cpuid_features(void)
+{
+	__u32 eax, ebx, ecx, edx;
+
+	cpuid(KVM_CPUID_SIGNATURE, 0, &eax, &ebx, &ecx, &edx);
+	if (eax < KVM_CPUID_FEATURES || ebx != KVM_SIGNATURE_EBX ||
+	    ecx != KVM_SIGNATURE_ECX || edx != KVM_SIGNATURE_EDX)
+		return 0;
+
+	cpuid(KVM_CPUID_FEATURES, 0, &eax, &ebx, &ecx, &edx);
+	return eax;
+}
+
 unsigned long read_cr2(void);
 
 static inline void write_cr3(unsigned long cr3)
@@ -216,11 +216,6 @@ __lcpuid ukplat_lcpu_id(void)
 	return lcpu_get_current()->id;
 }
 
-__lcpuidx ukplat_lcpu_idx(void)
-{
-	return lcpu_arch_idx();
-}
-
 int lcpu_fn_enqueue(struct lcpu *lcpu, const struct ukplat_lcpu_func *fn)
 {
 	void (*old_fn)(struct __regs *, void *);
@@ -266,11 +261,58 @@ static void lcpu_fn_dequeue(struct lcpu *this_lcpu, struct ukplat_lcpu_func *fn)
 	this_lcpu->fn.fn = NULL;
 }
 
+/* Calls queued with ukplat_lcpu_call(). The list is in LIFO order and
+ * `pending` is set while a run IRQ for the calls is on its way
+ */
+struct __align(CACHE_LINE_SIZE) lcpu_callq {
+	struct ukplat_lcpu_call *head;
+	int pending;
+};
+
+static UKPLAT_PER_LCPU_DEFINE(struct lcpu_callq, lcpu_callqs);
+
+static void lcpu_calls_run(struct lcpu_callq *q)
+{
+	struct ukplat_lcpu_call *call, *next, *fifo = NULL;
+
+	/* Clear the pending flag before taking the calls: a call queued after
+	 * this point either is taken below or sends a new IRQ
+	 */
+	__atomic_store_n(&q->pending, 0, __ATOMIC_SEQ_CST);
+	call = __atomic_exchange_n(&q->head, NULL, __ATOMIC_ACQUIRE);
+	if (!call)
+		return;
+
+	/* Restore the queuing order */
+	while (call) {
+		next = call->next;
+		call->next = fifo;
+		fifo = call;
+		call = next;
+	}
+
+	for (call = fifo; call; call = next) {
+		/* The call may be released by the completion callback */
+		next = call->next;
+
+		/* TODO: Provide the register snapshot from the trap frame */
+		call->func.fn(NULL, call->func.user);
+		if (call->done)
+			call->done(call);
+	}
+}
+
 static int lcpu_ipi_run_handler(void *args __unused)
 {
 	struct lcpu *this_lcpu = lcpu_get_current();
 	struct ukplat_lcpu_func fn;
 
+	lcpu_calls_run(&ukplat_per_lcpu(lcpu_callqs, this_lcpu->idx));
+
+	/* The IRQ might have been sent for queued calls only */
+	if (!uk_load_n(&this_lcpu->fn.fn))
+		return 1;
+
 	lcpu_fn_dequeue(this_lcpu, &fn);
 
 	/* TODO: Provide the register snapshot from the trap frame */
@@ -558,6 +600,62 @@ int ukplat_lcpu_run(const __lcpuidx lcpuidx[], unsigned int *num,
 	return 0;
 }
 
+static void lcpu_call_push(struct lcpu_callq *q, struct ukplat_lcpu_call *call)
+{
+	call->next = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&q->head, &call->next, call, 0,
+					    __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		;
+}
+
+int ukplat_lcpu_call(__lcpuidx lcpuidx, struct ukplat_lcpu_call *call,
+		     unsigned long flags)
+{
+	struct lcpu *lcpu;
+
+	UK_ASSERT(lcpuidx < ukplat_lcpu_count());
+	UK_ASSERT(call);
+	UK_ASSERT(call->func.fn);
+
+	lcpu = lcpu_get(lcpuidx);
+	if (unlikely(!lcpu_state_is_online(uk_load_n(&lcpu->state))))
+		return -EINVAL;
+
+	lcpu_call_push(&ukplat_per_lcpu(lcpu_callqs, lcpuidx), call);
+
+	/* Calls to ourselves are always run right away */
+	if ((flags & UKPLAT_LCPU_CFLG_NOKICK) && lcpuidx != ukplat_lcpu_idx())
+		return 0;
+
+	return ukplat_lcpu_call_kick(lcpuidx);
+}
+
+int ukplat_lcpu_call_kick(__lcpuidx lcpuidx)
+{
+	struct lcpu_callq *q;
+	struct lcpu *lcpu;
+
+	UK_ASSERT(lcpuidx < ukplat_lcpu_count());
+
+	lcpu = lcpu_get(lcpuidx);
+	q = &ukplat_per_lcpu(lcpu_callqs, lcpuidx);
+
+	if (lcpuidx == ukplat_lcpu_idx()) {
+		/* Run in the same context as a remote CPU would */
+		unsigned long irqf = ukplat_lcpu_save_irqf();
+
+		lcpu_calls_run(q);
+		ukplat_lcpu_restore_irqf(irqf);
+		return 0;
+	}
+
+	/* Batch: only the first kick since the last run sends an IRQ */
+	if (__atomic_exchange_n(&q->pending, 1, __ATOMIC_SEQ_CST))
+		return 0;
+
+	return lcpu_arch_kick(lcpu);
+}
+
 int ukplat_lcpu_wait(const __lcpuidx lcpuidx[], unsigned int *num,
 		     __nsec timeout)
 {
@@ -0,0 +1,404 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <errno.h>
+#include <uk/assert.h>
+#include <uk/essentials.h>
+#include <uk/print.h>
+#include <uk/plat/common/lcpu.h>
+#include <uk/plat/common/numa.h>
+#if CONFIG_UKPLAT_ACPI
+#include <uk/plat/common/acpi.h>
+#endif /* CONFIG_UKPLAT_ACPI */
+#if CONFIG_ARCH_ARM_64
+#include <arm/arm64/cpu.h>
+#include <uk/ofw/fdt.h>
+#include <libfdt.h>
+#endif /* CONFIG_ARCH_ARM_64 */
+#if CONFIG_PAGING
+#include <uk/plat/paging.h>
+#include <uk/fallocbuddy.h>
+#endif /* CONFIG_PAGING */
+
+#define NUMA_MAX_NODES		CONFIG_UKPLAT_NUMA_MAXNODES
+#define NUMA_MAX_RANGES		CONFIG_UKPLAT_NUMA_MAXRANGES
+
+#if CONFIG_ARCH_ARM_64
+#define FDT_ADDR_CELLS_DEFAULT	2
+#endif /* CONFIG_ARCH_ARM_64 */
+
+struct numa_range {
+	__paddr_t start;
+	__paddr_t end;
+	unsigned int node;
+};
+
+static struct numa_range numa_ranges[NUMA_MAX_RANGES];
+static unsigned int numa_range_count;
+
+/* Firmware ID of each node, i.e., the ACPI proximity domain or the value
+ * of the numa-node-id property. Nodes are numbered in the order in which
+ * the firmware lists them.
+ */
+static __u32 numa_ids[NUMA_MAX_NODES];
+static unsigned int numa_node_cnt;
+
+static __u8 numa_lcpu_nodes[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+
+/* 0 if the firmware does not provide the distance */
+static __u8 numa_distances[NUMA_MAX_NODES][NUMA_MAX_NODES];
+
+unsigned int ukplat_numa_node_count(void)
+{
+	return MAX(numa_node_cnt, 1U);
+}
+
+unsigned int ukplat_numa_lcpu_node(__lcpuidx idx)
+{
+	UK_ASSERT(idx < CONFIG_UKPLAT_LCPU_MAXCOUNT);
+
+	return numa_lcpu_nodes[idx];
+}
+
+unsigned int ukplat_numa_paddr_node(__paddr_t paddr)
+{
+	unsigned int i;
+
+	for (i = 0; i < numa_range_count; i++)
+		if (paddr >= numa_ranges[i].start &&
+		    paddr < numa_ranges[i].end)
+			return numa_ranges[i].node;
+
+	return 0;
+}
+
+unsigned int ukplat_numa_distance(unsigned int from, unsigned int to)
+{
+	UK_ASSERT(from < ukplat_numa_node_count());
+	UK_ASSERT(to < ukplat_numa_node_count());
+
+	if (numa_distances[from][to])
+		return numa_distances[from][to];
+
+	return (from == to) ? UKPLAT_NUMA_DISTANCE_LOCAL :
+			      UKPLAT_NUMA_DISTANCE_REMOTE;
+}
+
+/* Returns the node of a firmware ID and allocates one for a new ID */
+static int numa_node_get(__u32 id)
+{
+	unsigned int i;
+
+	for (i = 0; i < numa_node_cnt; i++)
+		if (numa_ids[i] == id)
+			return i;
+
+	if (unlikely(numa_node_cnt == NUMA_MAX_NODES))
+		return -ENOSPC;
+
+	numa_ids[numa_node_cnt] = id;
+	return numa_node_cnt++;
+}
+
+/* Returns the node of a firmware ID or -ENOENT if the ID is unknown */
+static int numa_node_find(__u32 id)
+{
+	unsigned int i;
+
+	for (i = 0; i < numa_node_cnt; i++)
+		if (numa_ids[i] == id)
+			return i;
+
+	return -ENOENT;
+}
+
+static int numa_add_range(__u32 id, __paddr_t start, __sz len)
+{
+	int node;
+
+	if (unlikely(!len))
+		return 0;
+
+	node = numa_node_get(id);
+	if (unlikely(node < 0))
+		return node;
+
+	if (unlikely(numa_range_count == NUMA_MAX_RANGES))
+		return -ENOSPC;
+
+	numa_ranges[numa_range_count].start = start;
+	numa_ranges[numa_range_count].end = start + len;
+	numa_ranges[numa_range_count].node = node;
+	numa_range_count++;
+
+	return 0;
+}
+
+static int numa_set_lcpu(__u32 id, __lcpuid cpu_id)
+{
+	__lcpuidx idx;
+	int node;
+
+	node = numa_node_get(id);
+	if (unlikely(node < 0))
+		return node;
+
+	/* CPUs without an lcpu, e.g., beyond the maximum count, are ignored */
+	for (idx = 0; idx < ukplat_lcpu_count(); idx++) {
+		if (lcpu_get(idx)->id == cpu_id) {
+			numa_lcpu_nodes[idx] = node;
+			break;
+		}
+	}
+
+	return 0;
+}
+
+#if CONFIG_UKPLAT_ACPI
+#if CONFIG_ARCH_ARM_64
+/* GICC affinity structures refer to CPUs by their ACPI processor UID, which
+ * the MADT maps to the MPIDR
+ */
+static int numa_acpi_gicc_id(__u32 uid, __lcpuid *cpu_id)
+{
+	union {
+		struct acpi_madt_gicc *gicc;
+		struct acpi_subsdt_hdr *h;
+	} m;
+	struct acpi_madt *madt;
+	__sz off, len;
+
+	madt = acpi_get_madt();
+	if (unlikely(!madt))
+		return -ENOENT;
+
+	len = madt->hdr.tab_len - sizeof(*madt);
+	for (off = 0; off < len; off += m.h->len) {
+		m.h = (struct acpi_subsdt_hdr *)(madt->entries + off);
+
+		if (m.h->type != ACPI_MADT_GICC || m.gicc->uid != uid)
+			continue;
+
+		*cpu_id = m.gicc->mpidr & CPU_ID_MASK;
+		return 0;
+	}
+
+	return -ENOENT;
+}
+#endif /* CONFIG_ARCH_ARM_64 */
+
+static int numa_acpi_init(void)
+{
+	union {
+		struct acpi_srat_lapic *lapic;
+		struct acpi_srat_mem *mem;
+		struct acpi_srat_x2apic *x2apic;
+		struct acpi_srat_gicc *gicc;
+		struct acpi_subsdt_hdr *h;
+	} m;
+	struct acpi_srat *srat;
+	struct acpi_slit *slit;
+	__lcpuid cpu_id __maybe_unused;
+	unsigned int i, j;
+	__sz off, len;
+	__u64 n;
+	__u32 id;
+	int rc = 0;
+
+	srat = acpi_get_srat();
+	if (!srat)
+		return -ENOENT;
+
+	len = srat->hdr.tab_len - sizeof(*srat);
+	for (off = 0; off < len && rc == 0; off += m.h->len) {
+		m.h = (struct acpi_subsdt_hdr *)(srat->entries + off);
+
+		switch (m.h->type) {
+		case ACPI_SRAT_LAPIC:
+			if (!(m.lapic->flags & ACPI_SRAT_LAPIC_FLAGS_EN))
+				continue; /* goto next SRAT entry */
+
+			id = m.lapic->domain_lo |
+			     (__u32)m.lapic->domain_hi[0] << 8 |
+			     (__u32)m.lapic->domain_hi[1] << 16 |
+			     (__u32)m.lapic->domain_hi[2] << 24;
+			rc = numa_set_lcpu(id, m.lapic->lapic_id);
+			break;
+
+		case ACPI_SRAT_X2APIC:
+			if (!(m.x2apic->flags & ACPI_SRAT_X2APIC_FLAGS_EN))
+				continue; /* goto next SRAT entry */
+
+			rc = numa_set_lcpu(m.x2apic->domain,
+					   m.x2apic->x2apic_id);
+			break;
+
+#if CONFIG_ARCH_ARM_64
+		case ACPI_SRAT_GICC:
+			if (!(m.gicc->flags & ACPI_SRAT_GICC_FLAGS_EN) ||
+			    numa_acpi_gicc_id(m.gicc->uid, &cpu_id))
+				continue; /* goto next SRAT entry */
+
+			rc = numa_set_lcpu(m.gicc->domain, cpu_id);
+			break;
+#endif /* CONFIG_ARCH_ARM_64 */
+
+		case ACPI_SRAT_MEM:
+			if (!(m.mem->flags & ACPI_SRAT_MEM_FLAGS_EN))
+				continue; /* goto next SRAT entry */
+
+			rc = numa_add_range(m.mem->domain, m.mem->base,
+					    m.mem->len);
+			break;
+
+		default:
+			continue; /* goto next SRAT entry */
+		}
+	}
+	if (unlikely(rc))
+		uk_pr_warn("NUMA: Ignoring the rest of the SRAT: %d\n", rc);
+
+	/* The SLIT is a matrix that is indexed by proximity domains */
+	slit = acpi_get_slit();
+	if (!slit)
+		return 0;
+
+	n = slit->nr_domains;
+	for (i = 0; i < numa_node_cnt; i++) {
+		for (j = 0; j < numa_node_cnt; j++) {
+			if (numa_ids[i] >= n || numa_ids[j] >= n)
+				continue;
+
+			numa_distances[i][j] =
+				slit->distance[numa_ids[i] * n + numa_ids[j]];
+		}
+	}
+
+	return 0;
+}
+#endif /* CONFIG_UKPLAT_ACPI */
+
+#if CONFIG_ARCH_ARM_64
+static int numa_fdt_id(const void *fdt, int offs, __u32 *id)
+{
+	const fdt32_t *prop;
+	int len;
+
+	prop = fdt_getprop(fdt, offs, "numa-node-id", &len);
+	if (!prop || len != sizeof(*prop))
+		return -ENOENT;
+
+	*id = fdt32_to_cpu(*prop);
+	return 0;
+}
+
+/* See Documentation/devicetree/bindings/numa.txt in Linux */
+static int numa_fdt_init(const void *fdt)
+{
+	const fdt32_t *prop;
+	int offs, cpus, naddr, len, i, from, to;
+	__u64 base, size;
+	__u32 id;
+	int rc = 0;
+
+	offs = fdt_node_offset_by_prop_value(fdt, -1, "device_type",
+					     "memory", sizeof("memory"));
+	while (offs >= 0 && rc == 0) {
+		if (!numa_fdt_id(fdt, offs, &id)) {
+			for (i = 0; rc == 0 &&
+			     !fdt_get_address(fdt, offs, i, &base, &size); i++)
+				rc = numa_add_range(id, base, size);
+		}
+
+		offs = fdt_node_offset_by_prop_value(fdt, offs, "device_type",
+						     "memory",
+						     sizeof("memory"));
+	}
+	if (!numa_node_cnt)
+		return -ENOENT;
+
+	cpus = fdt_path_offset(fdt, "/cpus");
+	if (cpus >= 0) {
+		naddr = fdt_address_cells(fdt, cpus);
+		if (unlikely(naddr < 0 || naddr > FDT_ADDR_CELLS_DEFAULT))
+			naddr = FDT_ADDR_CELLS_DEFAULT;
+
+		fdt_for_each_subnode(offs, fdt, cpus) {
+			if (rc || numa_fdt_id(fdt, offs, &id))
+				continue;
+
+			prop = fdt_getprop(fdt, offs, "reg", &len);
+			if (!prop || len < naddr * (int)sizeof(*prop))
+				continue;
+
+			rc = numa_set_lcpu(id, fdt_reg_read_number(prop,
+								   naddr));
+		}
+	}
+	if (unlikely(rc))
+		uk_pr_warn("NUMA: Ignoring the rest of the device tree: %d\n",
+			   rc);
+
+	/* The distance matrix consists of <from to distance> triplets */
+	offs = fdt_node_offset_by_compatible_cached(fdt, -1,
+						    "numa-distance-map-v1");
+	if (offs < 0)
+		return 0;
+
+	prop = fdt_getprop(fdt, offs, "distance-matrix", &len);
+	if (!prop)
+		return 0;
+
+	len /= sizeof(*prop);
+	for (i = 0; i + 3 <= len; i += 3) {
+		from = numa_node_find(fdt32_to_cpu(prop[i]));
+		to = numa_node_find(fdt32_to_cpu(prop[i + 1]));
+		if (from < 0 || to < 0)
+			continue;
+
+		numa_distances[from][to] = fdt32_to_cpu(prop[i + 2]);
+	}
+
+	return 0;
+}
+#endif /* CONFIG_ARCH_ARM_64 */
+
+int numa_init(void *fdt __maybe_unused)
+{
+	unsigned int i;
+	int rc = -ENOENT;
+
+#if CONFIG_UKPLAT_ACPI
+	rc = numa_acpi_init();
+#endif /* CONFIG_UKPLAT_ACPI */
+#if CONFIG_ARCH_ARM_64
+	if (rc == -ENOENT && fdt)
+		rc = numa_fdt_init(fdt);
+#endif /* CONFIG_ARCH_ARM_64 */
+	if (rc == -ENOENT) {
+		uk_pr_debug("NUMA: No topology found\n");
+		return 0;
+	}
+	if (unlikely(rc))
+		return rc;
+
+	uk_pr_info("NUMA: %u nodes\n", ukplat_numa_node_count());
+	for (i = 0; i < numa_range_count; i++)
+		uk_pr_debug("NUMA: %"__PRIpaddr"-%"__PRIpaddr" on node %u\n",
+			    numa_ranges[i].start, numa_ranges[i].end,
+			    numa_ranges[i].node);
+	for (i = 0; i < ukplat_lcpu_count(); i++)
+		uk_pr_debug("NUMA: lcpu %u on node %u\n", i,
+			    numa_lcpu_nodes[i]);
+
+#if CONFIG_PAGING
+	/* The frame allocator was set up before the topology was known */
+	if (ukplat_pt_get_active())
+		uk_fallocbuddy_update_nodes(ukplat_pt_get_active()->fa);
+#endif /* CONFIG_PAGING */
+
+	return 0;
+}
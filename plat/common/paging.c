@@ -45,6 +45,7 @@
 #include <uk/essentials.h>
 #include <uk/assert.h>
 #include <uk/print.h>
+#include <uk/plat/lcpu.h>
 #include <uk/plat/paging.h>
 #include <uk/plat/common/sections.h>
 #include <uk/plat/common/bootinfo.h>
@@ -69,9 +70,11 @@ static inline void pg_pt_free(struct uk_pagetable *pt, __vaddr_t pt_vaddr,
 static int pg_page_split(struct uk_pagetable *pt, __vaddr_t pt_vaddr,
 			 __vaddr_t vaddr, unsigned int level);
 
+struct pg_tlb_batch;
+
 static int pg_page_unmap(struct uk_pagetable *pt, __vaddr_t pt_vaddr,
 			 unsigned int level, __vaddr_t vaddr, __sz len,
-			 unsigned long flags);
+			 unsigned long flags, struct pg_tlb_batch *tlb);
 
 #ifdef CONFIG_PAGING_STATS
 #define PAGE_FLAG_INTERN_STATS_KEEP	0x80000000 /* Don't update stats */
@@ -91,6 +94,162 @@ static unsigned int pg_page_largest_level = PAGE_LEVEL;
 static struct uk_pagetable kernel_pt;
 static struct uk_pagetable *pg_active_pt;
 
+/*
+ * TLB invalidations of a single unmap or attribute change are gathered and
+ * issued at the end, instead of one at a time while walking the page table.
+ * Up to PG_TLB_BATCH_MAX entries are invalidated individually, beyond that
+ * the whole TLB is flushed. With SMP, the other lcpus are shot down once per
+ * batch, unless the architecture broadcasts TLB invalidations anyway.
+ *
+ * Frames released by an unmap are freed only after the invalidation, so that
+ * they cannot be reused while a stale TLB entry still refers to them.
+ * Physically contiguous frames are gathered into runs and returned to the
+ * frame allocator together.
+ */
+#define PG_TLB_BATCH_MAX	32
+#define PG_FREE_BATCH_MAX	8
+
+struct pg_free_run {
+	__paddr_t paddr;
+	unsigned long pages;
+};
+
+struct pg_tlb_batch {
+	/* Number of entries; above PG_TLB_BATCH_MAX, flush the whole TLB */
+	unsigned int nr;
+	__vaddr_t vaddr[PG_TLB_BATCH_MAX];
+#if CONFIG_HAVE_SMP && !defined(UKARCH_TLB_FLUSH_BROADCAST)
+	/* Number of lcpus yet to complete the shootdown */
+	int pending;
+#endif /* CONFIG_HAVE_SMP && !UKARCH_TLB_FLUSH_BROADCAST */
+	/* Frames to free after the invalidation */
+	struct uk_pagetable *pt;
+	unsigned int nr_free;
+	struct pg_free_run free[PG_FREE_BATCH_MAX];
+};
+
+static inline void pg_tlb_batch_init(struct pg_tlb_batch *tlb,
+				     struct uk_pagetable *pt)
+{
+	tlb->nr = 0;
+	tlb->pt = pt;
+	tlb->nr_free = 0;
+}
+
+/* Queue the invalidation of `vaddr`. Invalidates immediately if there is no
+ * batch
+ */
+static inline void pg_tlb_batch_add(struct pg_tlb_batch *tlb, __vaddr_t vaddr)
+{
+	if (!tlb) {
+		ukarch_tlb_flush_entry(vaddr);
+		return;
+	}
+
+	if (tlb->nr < PG_TLB_BATCH_MAX)
+		tlb->vaddr[tlb->nr] = vaddr;
+	if (tlb->nr <= PG_TLB_BATCH_MAX)
+		tlb->nr++;
+}
+
+static void pg_tlb_batch_run(struct __regs *regs __unused, void *arg)
+{
+	struct pg_tlb_batch *tlb = (struct pg_tlb_batch *)arg;
+	unsigned int i;
+
+	if (tlb->nr > PG_TLB_BATCH_MAX) {
+		ukarch_tlb_flush();
+		return;
+	}
+
+	for (i = 0; i < tlb->nr; i++)
+		ukarch_tlb_flush_entry(tlb->vaddr[i]);
+}
+
+#if CONFIG_HAVE_SMP && !defined(UKARCH_TLB_FLUSH_BROADCAST)
+static void pg_tlb_shootdown_done(struct ukplat_lcpu_call *call)
+{
+	struct pg_tlb_batch *tlb = (struct pg_tlb_batch *)call->func.user;
+
+	__atomic_sub_fetch(&tlb->pending, 1, __ATOMIC_RELEASE);
+}
+
+static void pg_tlb_shootdown(struct pg_tlb_batch *tlb)
+{
+	struct ukplat_lcpu_call calls[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+	__lcpuidx this_lcpu = ukplat_lcpu_idx();
+	__u32 count = ukplat_lcpu_count();
+	__lcpuidx i;
+
+	if (count == 1)
+		return;
+
+	tlb->pending = 0;
+	for (i = 0; i < count; i++) {
+		if (i == this_lcpu)
+			continue;
+
+		calls[i].func.fn = pg_tlb_batch_run;
+		calls[i].func.user = tlb;
+		calls[i].done = pg_tlb_shootdown_done;
+
+		__atomic_add_fetch(&tlb->pending, 1, __ATOMIC_RELAXED);
+		if (ukplat_lcpu_call(i, &calls[i], 0))
+			/* Not online, nothing to invalidate */
+			__atomic_sub_fetch(&tlb->pending, 1, __ATOMIC_RELAXED);
+	}
+
+	/* Keep running calls queued to us while waiting, so that two lcpus
+	 * shooting down each other with IRQs disabled do not deadlock
+	 */
+	while (__atomic_load_n(&tlb->pending, __ATOMIC_ACQUIRE)) {
+		ukplat_lcpu_call_kick(this_lcpu);
+		ukarch_spinwait();
+	}
+}
+#endif /* CONFIG_HAVE_SMP && !UKARCH_TLB_FLUSH_BROADCAST */
+
+static void pg_free_run(struct uk_pagetable *pt, struct pg_free_run *run)
+{
+	unsigned long i;
+	int rc;
+
+	UK_ASSERT(pt->fa->ffree);
+
+	rc = pt->fa->ffree(pt->fa, run->paddr, run->pages);
+	if (likely(rc == 0))
+		return;
+
+	/* The run may cover frames the allocator does not manage or that have
+	 * been freed already (see pg_ffree()). Free the rest one by one.
+	 */
+	for (i = 0; i < run->pages; i++)
+		pt->fa->ffree(pt->fa, run->paddr + i * PAGE_SIZE, 1);
+}
+
+/* Issue and reset the queued invalidations and free the queued frames */
+static void pg_tlb_batch_flush(struct pg_tlb_batch *tlb)
+{
+	unsigned int i;
+
+	if (!tlb)
+		return;
+
+	if (tlb->nr) {
+		pg_tlb_batch_run(__NULL, tlb);
+#if CONFIG_HAVE_SMP && !defined(UKARCH_TLB_FLUSH_BROADCAST)
+		pg_tlb_shootdown(tlb);
+#endif /* CONFIG_HAVE_SMP && !UKARCH_TLB_FLUSH_BROADCAST */
+
+		tlb->nr = 0;
+	}
+
+	for (i = 0; i < tlb->nr_free; i++)
+		pg_free_run(tlb->pt, &tlb->free[i]);
+
+	tlb->nr_free = 0;
+}
+
 struct uk_pagetable *ukplat_pt_get_active(void)
 {
 	return pg_active_pt;
@@ -235,7 +394,7 @@ EXIT:
 
 EXIT_FREE:
 	pg_page_unmap(pt_dst, pt_vaddr_dcache[PT_LEVELS - 1], PT_LEVELS - 1,
-		      __VADDR_ANY, __SZ_MAX, PAGE_FLAG_KEEP_FRAMES);
+		      __VADDR_ANY, __SZ_MAX, PAGE_FLAG_KEEP_FRAMES, __NULL);
 
 	pg_pt_free(pt_dst, pt_vaddr_dcache[PT_LEVELS - 1], PT_LEVELS - 1);
 
@@ -328,7 +487,7 @@ int ukplat_pt_free(struct uk_pagetable *pt, unsigned long flags)
 	UK_ASSERT(pt->pt_pbase != __PADDR_INV);
 
 	rc = pg_page_unmap(pt, pt->pt_vbase, PT_LEVELS - 1, __VADDR_ANY,
-			   __SZ_MAX, flags & PAGE_FLAG_KEEP_FRAMES);
+			   __SZ_MAX, flags & PAGE_FLAG_KEEP_FRAMES, __NULL);
 	if (unlikely(rc))
 		return rc;
 
@@ -399,6 +558,13 @@ int ukplat_pt_walk(struct uk_pagetable *pt, __vaddr_t vaddr,
 	return rc;
 }
 
+unsigned long ukplat_pte_attr(__pte_t pte, unsigned int level)
+{
+	UK_ASSERT(PAGE_Lx_IS(pte, level));
+
+	return pgarch_attr_from_pte(pte, level);
+}
+
 #define PG_Lx_L0_PAGES(lvl)					\
 	(1UL << (PAGE_Lx_SHIFT(lvl) - PAGE_Lx_SHIFT(0)))
 
@@ -436,6 +602,39 @@ static inline void pg_ffree(struct uk_pagetable *pt, __paddr_t paddr,
 	UK_ASSERT(rc == 0 || rc == -EFAULT || rc == -ENOMEM);
 }
 
+/* Queue the frames of a level `level` page for freeing after the
+ * invalidation. Frees immediately if there is no batch
+ */
+static void pg_tlb_batch_ffree(struct uk_pagetable *pt,
+			       struct pg_tlb_batch *tlb, __paddr_t paddr,
+			       unsigned int level)
+{
+	unsigned long pages = PG_Lx_L0_PAGES(level);
+	struct pg_free_run *run;
+
+	if (!tlb) {
+		pg_ffree(pt, paddr, level);
+		return;
+	}
+
+	UK_ASSERT(tlb->pt == pt);
+
+	if (tlb->nr_free > 0) {
+		run = &tlb->free[tlb->nr_free - 1];
+		if (run->paddr + run->pages * PAGE_SIZE == paddr) {
+			run->pages += pages;
+			return;
+		}
+	}
+
+	if (tlb->nr_free == PG_FREE_BATCH_MAX)
+		pg_tlb_batch_flush(tlb);
+
+	run = &tlb->free[tlb->nr_free++];
+	run->paddr = paddr;
+	run->pages = pages;
+}
+
 static inline int pg_pt_alloc(struct uk_pagetable *pt, __vaddr_t *pt_vaddr,
 			      __paddr_t *pt_paddr, unsigned int level)
 {
@@ -922,7 +1121,7 @@ EXIT_FREE:
 #endif /* CONFIG_PAGING_STATS */
 
 	pg_page_unmap(pt, new_pt_vaddr, level - 1, __VADDR_ANY,
-		      __SZ_MAX, flags);
+		      __SZ_MAX, flags, __NULL);
 
 	pg_pt_free(pt, new_pt_vaddr, level - 1);
 
@@ -931,7 +1130,7 @@ EXIT_FREE:
 
 static int pg_page_unmap(struct uk_pagetable *pt, __vaddr_t pt_vaddr,
 			 unsigned int level, __vaddr_t vaddr, __sz len,
-			 unsigned long flags)
+			 unsigned long flags, struct pg_tlb_batch *tlb)
 {
 	unsigned int to_lvl = PAGE_FLAG_SIZE_TO_LEVEL(flags);
 	unsigned int plvl, lvl = level;
@@ -1043,7 +1242,7 @@ static int pg_page_unmap(struct uk_pagetable *pt, __vaddr_t pt_vaddr,
 				return rc;
 
 			if (vaddr != __VADDR_ANY && pt == pg_active_pt)
-				ukarch_tlb_flush_entry(vaddr);
+				pg_tlb_batch_add(tlb, vaddr);
 
 #ifdef CONFIG_PAGING_STATS
 			if (!(flags & PAGE_FLAG_INTERN_STATS_KEEP)) {
@@ -1053,7 +1252,9 @@ static int pg_page_unmap(struct uk_pagetable *pt, __vaddr_t pt_vaddr,
 #endif /* CONFIG_PAGING_STATS */
 
 			if (!(flags & PAGE_FLAG_KEEP_FRAMES))
-				pg_ffree(pt, PT_Lx_PTE_PADDR(pte, lvl), lvl);
+				pg_tlb_batch_ffree(pt, tlb,
+						   PT_Lx_PTE_PADDR(pte, lvl),
+						   lvl);
 		}
 
 		/* If this is not the last PTE and there are still pages to
@@ -1152,8 +1353,13 @@ static int pg_page_unmap(struct uk_pagetable *pt, __vaddr_t pt_vaddr,
 			if (unlikely(rc))
 				return rc;
 
-			if (vaddr != __VADDR_ANY && pt == pg_active_pt)
-				ukarch_tlb_flush_entry(vaddr);
+			/* The page table must not be reused before no TLB
+			 * refers to it anymore, so do not defer this one
+			 */
+			if (vaddr != __VADDR_ANY && pt == pg_active_pt) {
+				pg_tlb_batch_add(tlb, vaddr);
+				pg_tlb_batch_flush(tlb);
+			}
 
 			pg_pt_free(pt, pt_vaddr_cache[plvl], plvl);
 		}
@@ -1186,7 +1392,9 @@ int ukplat_page_unmap(struct uk_pagetable *pt, __vaddr_t vaddr,
 		      unsigned long pages, unsigned long flags)
 {
 	unsigned int level = PAGE_FLAG_SIZE_TO_LEVEL(flags);
+	struct pg_tlb_batch tlb;
 	__sz len = __SZ_MAX;
+	int rc;
 
 	if (unlikely(pages == 0))
 		return 0;
@@ -1207,13 +1415,18 @@ int ukplat_page_unmap(struct uk_pagetable *pt, __vaddr_t vaddr,
 	UK_ASSERT(pt->pt_vbase != __VADDR_INV);
 	UK_ASSERT(pt->pt_pbase != __PADDR_INV);
 
-	return pg_page_unmap(pt, pt->pt_vbase, PT_LEVELS - 1, vaddr, len,
-			     flags);
+	pg_tlb_batch_init(&tlb, pt);
+	rc = pg_page_unmap(pt, pt->pt_vbase, PT_LEVELS - 1, vaddr, len,
+			   flags, &tlb);
+	pg_tlb_batch_flush(&tlb);
+
+	return rc;
 }
 
 static int pg_page_set_attr(struct uk_pagetable *pt, __vaddr_t pt_vaddr,
 			    unsigned int level, __vaddr_t vaddr, __sz len,
-			    unsigned long new_attr, unsigned long flags)
+			    unsigned long new_attr, unsigned long flags,
+			    struct pg_tlb_batch *tlb)
 {
 	unsigned int to_lvl = PAGE_FLAG_SIZE_TO_LEVEL(flags);
 	unsigned int lvl = level;
@@ -1315,7 +1528,7 @@ static int pg_page_set_attr(struct uk_pagetable *pt, __vaddr_t pt_vaddr,
 				return rc;
 
 			if (vaddr != __VADDR_ANY && pt == pg_active_pt)
-				ukarch_tlb_flush_entry(vaddr);
+				pg_tlb_batch_add(tlb, vaddr);
 		}
 
 		/* Bail out if there is nothing more to do */
@@ -1365,7 +1578,9 @@ int ukplat_page_set_attr(struct uk_pagetable *pt, __vaddr_t vaddr,
 			 unsigned long flags)
 {
 	unsigned int level = PAGE_FLAG_SIZE_TO_LEVEL(flags);
+	struct pg_tlb_batch tlb;
 	__sz len = __SZ_MAX;
+	int rc;
 
 	if (unlikely(pages == 0))
 		return 0;
@@ -1386,8 +1601,12 @@ int ukplat_page_set_attr(struct uk_pagetable *pt, __vaddr_t vaddr,
 	UK_ASSERT(pt->pt_vbase != __VADDR_INV);
 	UK_ASSERT(pt->pt_pbase != __PADDR_INV);
 
-	return pg_page_set_attr(pt, pt->pt_vbase, PT_LEVELS - 1, vaddr, len,
-				new_attr, flags);
+	pg_tlb_batch_init(&tlb, pt);
+	rc = pg_page_set_attr(pt, pt->pt_vbase, PT_LEVELS - 1, vaddr, len,
+			      new_attr, flags, &tlb);
+	pg_tlb_batch_flush(&tlb);
+
+	return rc;
 }
 
 __vaddr_t ukplat_page_kmap(struct uk_pagetable *pt, __paddr_t paddr,
@@ -69,10 +69,6 @@ int lcpu_arch_init(struct lcpu *this_lcpu)
 {
 #ifdef CONFIG_HAVE_SMP
 	int rc;
-
-	rc = apic_enable();
-	if (unlikely(rc))
-		return rc;
 #endif /* CONFIG_HAVE_SMP */
 
 	traps_lcpu_init(this_lcpu);
@@ -80,6 +76,13 @@ int lcpu_arch_init(struct lcpu *this_lcpu)
 	wrkgsbase((__uptr)this_lcpu);
 	wrgsbase((__uptr)this_lcpu);
 
+#ifdef CONFIG_HAVE_SMP
+	/* The APIC may register per-CPU state, which needs the lcpu */
+	rc = apic_enable();
+	if (unlikely(rc))
+		return rc;
+#endif /* CONFIG_HAVE_SMP */
+
 	return 0;
 }
 
@@ -276,17 +279,20 @@ int lcpu_arch_post_start(const __lcpuidx lcpuidx[], unsigned int *num)
 	/* wait 10 msec (according to Intel manual 8.4.4.1) */
 	mdelay(10);
 
-	lcpu_lcpuidx_list_foreach(lcpuidx, num, n, i, lcpu) {
-		if (lcpu->id == this_cpu_id)
-			continue;
+	/* Send the STARTUP IPIs to all CPUs before waiting, so that the
+	 * CPUs boot in parallel and the delays do not add up per CPU
+	 */
+	for (j = 0; j < 2; j++) {
+		lcpu_lcpuidx_list_foreach(lcpuidx, num, n, i, lcpu) {
+			if (lcpu->id == this_cpu_id)
+				continue;
 
-		for (j = 0; j < 2; j++) {
 			/* Send STARTUP IPI */
 			apic_send_sipi(x86_start16_addr, lcpu->id);
-
-			/* wait 200 usec (according to Intel manual 8.4.4.1) */
-			udelay(200);
 		}
+
+		/* wait 200 usec (according to Intel manual 8.4.4.1) */
+		udelay(200);
 	}
 
 	return 0;
@@ -308,6 +314,15 @@ int lcpu_arch_run(struct lcpu *lcpu, const struct ukplat_lcpu_func *fn,
 	return 0;
 }
 
+int lcpu_arch_kick(struct lcpu *lcpu)
+{
+	UK_ASSERT(lcpu->id != lcpu_arch_id());
+
+	apic_send_ipi(*lcpu_run_irqv, lcpu->id);
+
+	return 0;
+}
+
 int lcpu_arch_wakeup(struct lcpu *lcpu)
 {
 	UK_ASSERT(lcpu->id != lcpu_arch_id());
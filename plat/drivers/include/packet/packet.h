@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+#ifndef __PLAT_DRV_PACKET_H
+#define __PLAT_DRV_PACKET_H
+
+#include <uk/arch/types.h>
+
+int packet_open(void);
+int packet_close(int fd);
+int packet_ifindex_get(int fd, const char *ifname);
+int packet_bind(int fd, int ifindex);
+int packet_promisc_set(int fd, int ifindex);
+/**
+ * Sets up a receive and a transmit ring of `frame_nr` frames each and maps
+ * them to `rings`. The transmit ring follows the receive ring.
+ */
+int packet_rings_map(int fd, unsigned int frame_size, unsigned int frame_nr,
+		     void **rings);
+int packet_rings_unmap(void *rings, unsigned int frame_size,
+		       unsigned int frame_nr);
+/* Asks the host to send all frames marked for sending in the transmit ring */
+int packet_kick(int fd);
+
+#endif /* __PLAT_DRV_PACKET_H */
@@ -40,12 +40,16 @@
  */
 #define IFNAMSIZ        16
 
+struct uk_iovec;
+
 int tap_open(__u32 flags);
 int tap_close(int fd);
 int tap_dev_configure(int fd, __u32 feature_flags, void *arg);
+int tap_dev_offload_set(int fd, unsigned int offloads);
 int tap_netif_configure(int fd, __u32 request, void *arg);
 int tap_netif_create(void);
 __ssz tap_read(int fd, void *buf, size_t count);
 __ssz tap_write(int fd, const void *buf, size_t count);
+__ssz tap_writev(int fd, const struct uk_iovec *iov, int iovcnt);
 
 #endif /* __PLAT_DRV_TAP_H */
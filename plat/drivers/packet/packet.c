@@ -0,0 +1,629 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+/*
+ * Network device on a packet socket with memory mapped rings
+ *
+ * The socket is bound to a host interface, typically one end of a veth pair
+ * whose other end is attached to a bridge. The receive and the transmit ring
+ * are shared with the host kernel: received frames are picked up from the
+ * ring without any system call and transmitted frames are handed over with
+ * a single system call per burst, instead of a read() or write() per packet
+ * as with the tap driver.
+ */
+#include <errno.h>
+#include <string.h>
+#include <uk/alloc.h>
+#include <uk/arch/types.h>
+#include <uk/essentials.h>
+#include <uk/netdev_core.h>
+#include <uk/netdev_driver.h>
+#include <uk/netbuf.h>
+#include <uk/errptr.h>
+#include <uk/libparam.h>
+#include <uk/bus.h>
+#include <packet/packet.h>
+
+#ifdef CONFIG_PLAT_LINUXU
+#include <linuxu/packet.h>
+#else
+#error "The driver is supported on linuxu platform"
+#endif /* CONFIG_PLAT_LINUXU */
+
+#define DRIVER_NAME		"packet-net"
+
+#define ETH_PKT_PAYLOAD_LEN	1500
+#define PACKET_FRAME_SIZE	2048
+#define PACKET_FRAME_NR		CONFIG_PACKET_NET_FRAMES
+#define PACKET_TX_DATA_LEN	(PACKET_FRAME_SIZE - UK_TPACKET2_TX_DATA_OFF)
+
+#define to_packetnetdev(dev) \
+		__containerof(dev, struct packet_net_dev, ndev)
+
+struct uk_netdev_tx_queue {
+	/* tx queue identifier */
+	int queue_id;
+	/* Allocator for the txq */
+	struct uk_alloc *a;
+	/* Packet socket of the device */
+	int fd;
+	/* Transmit ring shared with the host */
+	__u8 *ring;
+	/* Next frame to fill */
+	__u32 head;
+};
+
+struct uk_netdev_rx_queue {
+	/* rx queue identifier */
+	int queue_id;
+	/* Allocator for the rxq */
+	struct uk_alloc *a;
+	/* Receive ring shared with the host */
+	__u8 *ring;
+	/* Next frame to consume */
+	__u32 head;
+	/* Callback for filling the buffer */
+	uk_netdev_alloc_rxpkts alloc_rxpkts;
+	/* Reference to a user data */
+	void *alloc_rxpkts_argp;
+};
+
+struct packet_net_dev {
+	/* Net device structure */
+	struct uk_netdev ndev;
+	/* The list of the packet devices */
+	UK_TAILQ_ENTRY(struct packet_net_dev) next;
+	/* Configured queues */
+	struct uk_netdev_rx_queue *rxq;
+	struct uk_netdev_tx_queue *txq;
+	/* Mac address of the device */
+	struct uk_hwaddr hw_addr;
+	/* Packet device identifier */
+	__u16 pid;
+	/* UK Netdevice identifier */
+	__u16 id;
+	/* Packet socket bound to the host interface */
+	int fd;
+	/* Index of the host interface */
+	int ifindex;
+	/* Name of the host interface */
+	const char *ifname;
+	/* Receive ring followed by the transmit ring */
+	__u8 *rings;
+	/* RX promiscuous mode */
+	__u8 promisc : 1;
+};
+
+struct packet_net_drv {
+	/* allocator to initialize the driver data structure */
+	struct uk_alloc *a;
+	/* list of packet devices */
+	UK_TAILQ_HEAD(pdev_list, struct packet_net_dev) dev_list;
+	/* Number of packet devices */
+	__u16 dev_cnt;
+};
+
+/**
+ * Module level variables
+ */
+static struct packet_net_drv packet_drv = {0};
+static const char *drv_name = DRIVER_NAME;
+static char *ifnames;
+
+/**
+ * Module Parameters.
+ */
+/**
+ * packet.ifnames="veth0 veth1 ... vethn"
+ */
+UK_LIB_PARAM_STR(ifnames);
+
+static inline struct uk_tpacket2_hdr *packet_frame(__u8 *ring, __u32 idx)
+{
+	return (struct uk_tpacket2_hdr *)(ring + idx * PACKET_FRAME_SIZE);
+}
+
+static inline __u32 packet_frame_status(struct uk_tpacket2_hdr *hdr)
+{
+	/* Frame contents are valid only after reading the status */
+	return __atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE);
+}
+
+static inline void packet_frame_release(struct uk_tpacket2_hdr *hdr,
+					__u32 status)
+{
+	/* Hands the frame over after all contents are written */
+	__atomic_store_n(&hdr->tp_status, status, __ATOMIC_RELEASE);
+}
+
+/**
+ * Copies the frame at the head of the receive ring to a new netbuf and
+ * returns the frame to the host.
+ * @return
+ *	1 on success, 0 if the ring is empty, < 0 on failure.
+ */
+static int packet_netdev_rxq_dequeue(struct uk_netdev *dev,
+				     struct uk_netdev_rx_queue *rxq,
+				     struct uk_netbuf **pkt)
+{
+	struct uk_tpacket2_hdr *hdr;
+	struct uk_netbuf *_pkt;
+	__u32 status;
+
+	for (;;) {
+		hdr = packet_frame(rxq->ring, rxq->head);
+		status = packet_frame_status(hdr);
+		if (!(status & UK_TP_STATUS_USER))
+			return 0;
+
+		if (unlikely(!rxq->alloc_rxpkts(rxq->alloc_rxpkts_argp,
+						&_pkt, 1))) {
+			/* The frame stays in the ring for the next attempt */
+			uk_netdev_drv_rxq_stats_inc(dev, rxq->queue_id,
+						    ring_full);
+			return -ENOMEM;
+		}
+
+		rxq->head = (rxq->head + 1) % PACKET_FRAME_NR;
+		if (likely(hdr->tp_snaplen <= _pkt->len))
+			break;
+
+		uk_pr_err(DRIVER_NAME": Dropping oversized packet of %"__PRIu32" bytes\n",
+			  hdr->tp_snaplen);
+		packet_frame_release(hdr, UK_TP_STATUS_KERNEL);
+		uk_netbuf_free(_pkt);
+		uk_netdev_drv_rxq_stats_inc(dev, rxq->queue_id, drops);
+	}
+
+	memcpy(_pkt->data, (__u8 *)hdr + hdr->tp_mac, hdr->tp_snaplen);
+	_pkt->len = hdr->tp_snaplen;
+	/* Packets sent by the host itself may carry no checksum yet. They
+	 * never crossed a wire, so they are as good as verified.
+	 */
+	_pkt->flags = (status & (UK_TP_STATUS_CSUMNOTREADY
+				 | UK_TP_STATUS_CSUM_VALID))
+		      ? UK_NETBUF_F_DATA_VALID : 0x0;
+	packet_frame_release(hdr, UK_TP_STATUS_KERNEL);
+
+	*pkt = _pkt;
+	return 1;
+}
+
+static int packet_netdev_recv(struct uk_netdev *dev,
+			      struct uk_netdev_rx_queue *queue,
+			      struct uk_netbuf **pkt)
+{
+	int rc;
+
+	UK_ASSERT(dev);
+	UK_ASSERT(queue && pkt);
+
+	*pkt = NULL;
+	rc = packet_netdev_rxq_dequeue(dev, queue, pkt);
+	if (rc == -ENOMEM)
+		return UK_NETDEV_STATUS_UNDERRUN | UK_NETDEV_STATUS_MORE;
+	if (rc <= 0)
+		return rc;
+
+	rc = UK_NETDEV_STATUS_SUCCESS;
+	if (packet_frame_status(packet_frame(queue->ring, queue->head))
+	    & UK_TP_STATUS_USER)
+		rc |= UK_NETDEV_STATUS_MORE;
+	return rc;
+}
+
+static int packet_netdev_recv_burst(struct uk_netdev *dev,
+				    struct uk_netdev_rx_queue *queue,
+				    struct uk_netbuf *pkts[], __u16 cnt)
+{
+	__u16 nb_rx = 0;
+	int rc;
+
+	UK_ASSERT(dev && queue);
+	UK_ASSERT(pkts || cnt == 0);
+
+	while (nb_rx < cnt) {
+		rc = packet_netdev_rxq_dequeue(dev, queue, &pkts[nb_rx]);
+		if (rc <= 0) {
+			if (unlikely(rc < 0 && nb_rx == 0))
+				return rc;
+			break;
+		}
+		nb_rx++;
+	}
+	return nb_rx;
+}
+
+/**
+ * Copies a packet to the next free frame of the transmit ring. The caller
+ * has to kick the host to send the frame.
+ * @return
+ *	0 on success, -ENOSPC if the ring is full, < 0 on failure.
+ */
+static int packet_netdev_xmit_enqueue(struct uk_netdev_tx_queue *txq,
+				      struct uk_netbuf *pkt)
+{
+	struct uk_tpacket2_hdr *hdr;
+	struct uk_netbuf *nb;
+	__u8 *data;
+	__u32 len = 0;
+
+	hdr = packet_frame(txq->ring, txq->head);
+	if (packet_frame_status(hdr) & (UK_TP_STATUS_SEND_REQUEST
+					| UK_TP_STATUS_SENDING))
+		return -ENOSPC;
+
+	UK_NETBUF_CHAIN_FOREACH(nb, pkt)
+		len += nb->len;
+	if (unlikely(len > PACKET_TX_DATA_LEN)) {
+		uk_pr_err(DRIVER_NAME": Packet of %"__PRIu32" bytes too large\n",
+			  len);
+		return -EINVAL;
+	}
+
+	data = (__u8 *)hdr + UK_TPACKET2_TX_DATA_OFF;
+	UK_NETBUF_CHAIN_FOREACH(nb, pkt) {
+		memcpy(data, nb->data, nb->len);
+		data += nb->len;
+	}
+	hdr->tp_len = len;
+	packet_frame_release(hdr, UK_TP_STATUS_SEND_REQUEST);
+
+	txq->head = (txq->head + 1) % PACKET_FRAME_NR;
+	uk_netbuf_free(pkt);
+	return 0;
+}
+
+static void packet_netdev_xmit_kick(struct uk_netdev *dev,
+				    struct uk_netdev_tx_queue *txq)
+{
+	/* On failure the frames stay marked and go out with the next kick */
+	packet_kick(txq->fd);
+	uk_netdev_drv_txq_stats_inc(dev, txq->queue_id, kicks);
+}
+
+static int packet_netdev_xmit(struct uk_netdev *dev,
+			      struct uk_netdev_tx_queue *queue,
+			      struct uk_netbuf *pkt)
+{
+	int rc;
+
+	UK_ASSERT(dev);
+	UK_ASSERT(queue && pkt);
+
+	rc = packet_netdev_xmit_enqueue(queue, pkt);
+	if (rc == -ENOSPC) {
+		uk_netdev_drv_txq_stats_inc(dev, queue->queue_id, ring_full);
+		return UK_NETDEV_STATUS_UNDERRUN;
+	} else if (unlikely(rc < 0)) {
+		return rc;
+	}
+	packet_netdev_xmit_kick(dev, queue);
+
+	rc = UK_NETDEV_STATUS_SUCCESS;
+	if (!(packet_frame_status(packet_frame(queue->ring, queue->head))
+	      & (UK_TP_STATUS_SEND_REQUEST | UK_TP_STATUS_SENDING)))
+		rc |= UK_NETDEV_STATUS_MORE;
+	return rc;
+}
+
+static int packet_netdev_xmit_burst(struct uk_netdev *dev,
+				    struct uk_netdev_tx_queue *queue,
+				    struct uk_netbuf *pkts[], __u16 cnt)
+{
+	__u16 i;
+	int rc = 0;
+
+	UK_ASSERT(dev);
+	UK_ASSERT(queue);
+	UK_ASSERT(pkts || cnt == 0);
+
+	for (i = 0; i < cnt; i++) {
+		UK_ASSERT(pkts[i]);
+
+		rc = packet_netdev_xmit_enqueue(queue, pkts[i]);
+		if (unlikely(rc < 0))
+			break;
+	}
+
+	if (unlikely(rc == -ENOSPC))
+		uk_netdev_drv_txq_stats_inc(dev, queue->queue_id, ring_full);
+
+	/* A single system call for the whole batch of frames */
+	if (likely(i > 0))
+		packet_netdev_xmit_kick(dev, queue);
+	else if (rc < 0 && rc != -ENOSPC)
+		return rc;
+
+	return i;
+}
+
+static int packet_netdev_rxq_info_get(struct uk_netdev *dev __unused,
+				      __u16 queue_id __unused,
+				      struct uk_netdev_queue_info *qinfo)
+{
+	UK_ASSERT(qinfo);
+
+	/* The ring size is fixed when the rings are mapped */
+	qinfo->nb_min = PACKET_FRAME_NR;
+	qinfo->nb_max = PACKET_FRAME_NR;
+	qinfo->nb_align = 1;
+	qinfo->nb_is_power_of_two = 0;
+	return 0;
+}
+
+static int packet_netdev_txq_info_get(struct uk_netdev *dev __unused,
+				      __u16 queue_id __unused,
+				      struct uk_netdev_queue_info *qinfo)
+{
+	UK_ASSERT(qinfo);
+
+	qinfo->nb_min = PACKET_FRAME_NR;
+	qinfo->nb_max = PACKET_FRAME_NR;
+	qinfo->nb_align = 1;
+	qinfo->nb_is_power_of_two = 0;
+	return 0;
+}
+
+static struct uk_netdev_rx_queue *packet_netdev_rxq_setup(
+					struct uk_netdev *dev,
+					__u16 queue_id,
+					__u16 nb_desc __unused,
+					struct uk_netdev_rxqueue_conf *conf)
+{
+	struct uk_netdev_rx_queue *rxq;
+	struct packet_net_dev *pdev;
+
+	UK_ASSERT(dev && conf);
+	pdev = to_packetnetdev(dev);
+
+	rxq = uk_zalloc(conf->a, sizeof(*rxq));
+	if (!rxq) {
+		uk_pr_err(DRIVER_NAME": Failed to allocate the rx queue %d\n",
+			  queue_id);
+		return ERR2PTR(-ENOMEM);
+	}
+
+	rxq->queue_id = queue_id;
+	rxq->a = conf->a;
+	rxq->ring = pdev->rings;
+	rxq->alloc_rxpkts = conf->alloc_rxpkts;
+	rxq->alloc_rxpkts_argp = conf->alloc_rxpkts_argp;
+	pdev->rxq = rxq;
+	return rxq;
+}
+
+static struct uk_netdev_tx_queue *packet_netdev_txq_setup(
+					struct uk_netdev *dev,
+					__u16 queue_id,
+					__u16 nb_desc __unused,
+					struct uk_netdev_txqueue_conf *conf)
+{
+	struct uk_netdev_tx_queue *txq;
+	struct packet_net_dev *pdev;
+
+	UK_ASSERT(dev && conf);
+	pdev = to_packetnetdev(dev);
+
+	txq = uk_zalloc(conf->a, sizeof(*txq));
+	if (!txq) {
+		uk_pr_err(DRIVER_NAME": Failed to allocate the tx queue\n");
+		return ERR2PTR(-ENOMEM);
+	}
+
+	txq->queue_id = queue_id;
+	txq->a = conf->a;
+	txq->fd = pdev->fd;
+	txq->ring = pdev->rings + PACKET_FRAME_NR * PACKET_FRAME_SIZE;
+	pdev->txq = txq;
+	return txq;
+}
+
+static int packet_netdev_start(struct uk_netdev *n)
+{
+	struct packet_net_dev *pdev;
+	int rc;
+
+	UK_ASSERT(n);
+	pdev = to_packetnetdev(n);
+
+	/* Frames for our address are not addressed to the host interface */
+	rc = packet_promisc_set(pdev->fd, pdev->ifindex);
+	if (rc < 0)
+		return rc;
+	pdev->promisc = 1;
+	return 0;
+}
+
+static void packet_netdev_info_get(struct uk_netdev *dev __unused,
+				   struct uk_netdev_info *dev_info)
+{
+	UK_ASSERT(dev_info);
+	dev_info->max_rx_queues = 1;
+	dev_info->max_tx_queues = 1;
+	dev_info->nb_encap_tx = 0;
+	dev_info->nb_encap_rx = 0;
+	dev_info->features = 0;
+}
+
+static unsigned int packet_netdev_promisc_get(struct uk_netdev *n)
+{
+	UK_ASSERT(n);
+	return to_packetnetdev(n)->promisc;
+}
+
+static __u16 packet_netdev_mtu_get(struct uk_netdev *n __unused)
+{
+	return ETH_PKT_PAYLOAD_LEN;
+}
+
+static const struct uk_hwaddr *packet_netdev_mac_get(struct uk_netdev *n)
+{
+	UK_ASSERT(n);
+	return &to_packetnetdev(n)->hw_addr;
+}
+
+static int packet_netdev_mac_set(struct uk_netdev *n,
+				 const struct uk_hwaddr *hwaddr)
+{
+	UK_ASSERT(n && hwaddr);
+
+	/* The address is ours only, the host interface keeps its own */
+	memcpy(&to_packetnetdev(n)->hw_addr, hwaddr, sizeof(*hwaddr));
+	return 0;
+}
+
+static void packet_mac_generate(__u8 *addr, __u8 dev_id)
+{
+	const char fmt[] = {0x2, 0x0, 0x0, 0x0, 0x1, 0x0};
+
+	memcpy(addr, fmt, UK_NETDEV_HWADDR_LEN - 1);
+	addr[UK_NETDEV_HWADDR_LEN - 1] = (__u8)(dev_id + 1);
+}
+
+static int packet_netdev_configure(struct uk_netdev *n,
+				   const struct uk_netdev_conf *conf)
+{
+	struct packet_net_dev *pdev;
+	void *rings;
+	int rc;
+
+	UK_ASSERT(n && conf);
+	pdev = to_packetnetdev(n);
+
+	if (unlikely(conf->nb_rx_queues > 1 || conf->nb_tx_queues > 1)) {
+		uk_pr_err(DRIVER_NAME": rx-queue:%d, tx-queue:%d not supported\n",
+			  conf->nb_rx_queues, conf->nb_tx_queues);
+		return -ENOTSUP;
+	}
+
+	rc = packet_open();
+	if (rc < 0)
+		return rc;
+	pdev->fd = rc;
+
+	rc = packet_ifindex_get(pdev->fd, pdev->ifname);
+	if (rc < 0)
+		goto close_fd;
+	pdev->ifindex = rc;
+
+	/* The rings have to exist before binding, otherwise frames queue
+	 * up in the socket buffer in the meantime
+	 */
+	rc = packet_rings_map(pdev->fd, PACKET_FRAME_SIZE, PACKET_FRAME_NR,
+			      &rings);
+	if (rc < 0)
+		goto close_fd;
+	pdev->rings = rings;
+
+	rc = packet_bind(pdev->fd, pdev->ifindex);
+	if (rc < 0)
+		goto unmap_rings;
+
+	packet_mac_generate(&pdev->hw_addr.addr_bytes[0], pdev->id);
+	uk_pr_info(DRIVER_NAME": Attached to %s with %d frames per ring\n",
+		   pdev->ifname, PACKET_FRAME_NR);
+	return 0;
+
+unmap_rings:
+	packet_rings_unmap(pdev->rings, PACKET_FRAME_SIZE, PACKET_FRAME_NR);
+	pdev->rings = NULL;
+close_fd:
+	packet_close(pdev->fd);
+	pdev->fd = -1;
+	return rc;
+}
+
+static const struct uk_netdev_ops packet_netdev_ops = {
+	.configure = packet_netdev_configure,
+	.rxq_configure = packet_netdev_rxq_setup,
+	.txq_configure = packet_netdev_txq_setup,
+	.start = packet_netdev_start,
+	.info_get = packet_netdev_info_get,
+	.promiscuous_get = packet_netdev_promisc_get,
+	.hwaddr_get = packet_netdev_mac_get,
+	.hwaddr_set = packet_netdev_mac_set,
+	.mtu_get = packet_netdev_mtu_get,
+	.txq_info_get = packet_netdev_txq_info_get,
+	.rxq_info_get = packet_netdev_rxq_info_get,
+};
+
+/**
+ * Registering the network device.
+ */
+static int packet_dev_init(int id, const char *ifname)
+{
+	struct packet_net_dev *pdev;
+	int rc;
+
+	pdev = uk_zalloc(packet_drv.a, sizeof(*pdev));
+	if (!pdev) {
+		uk_pr_err(DRIVER_NAME": Failed to allocate packet device\n");
+		return -ENOMEM;
+	}
+	pdev->ndev.rx_one = packet_netdev_recv;
+	pdev->ndev.tx_one = packet_netdev_xmit;
+	pdev->ndev.rx_burst = packet_netdev_recv_burst;
+	pdev->ndev.tx_burst = packet_netdev_xmit_burst;
+	pdev->ndev.ops = &packet_netdev_ops;
+	pdev->pid = id;
+	pdev->fd = -1;
+	pdev->ifname = ifname;
+
+	rc = uk_netdev_drv_register(&pdev->ndev, packet_drv.a, drv_name);
+	if (rc < 0) {
+		uk_pr_err(DRIVER_NAME": Failed to register the network device\n");
+		uk_free(packet_drv.a, pdev);
+		return rc;
+	}
+	pdev->id = rc;
+	uk_pr_info(DRIVER_NAME": device(%d) registered with the libuknet\n",
+		   pdev->id);
+
+	UK_TAILQ_INSERT_TAIL(&packet_drv.dev_list, pdev, next);
+	return 0;
+}
+
+/**
+ * Registers a device for every interface name given on the command line.
+ */
+static int packet_drv_probe(void)
+{
+	char *idx = ifnames, *prev_idx;
+	int rc;
+
+	while (idx && *idx) {
+		prev_idx = idx;
+		idx = strchr(idx, ' ');
+		if (idx) {
+			*idx = '\0';
+			idx++;
+		}
+		if (!*prev_idx)
+			continue;
+
+		rc = packet_dev_init(packet_drv.dev_cnt, prev_idx);
+		if (rc < 0) {
+			uk_pr_err(DRIVER_NAME": Failed to initialize the device for %s\n",
+				  prev_idx);
+			return rc;
+		}
+		packet_drv.dev_cnt++;
+	}
+	return 0;
+}
+
+static int packet_drv_init(struct uk_alloc *_a)
+{
+	packet_drv.a = _a;
+	UK_TAILQ_INIT(&packet_drv.dev_list);
+	return 0;
+}
+
+static struct uk_bus packet_bus = {
+	.init = packet_drv_init,
+	.probe = packet_drv_probe,
+};
+UK_BUS_REGISTER(&packet_bus);
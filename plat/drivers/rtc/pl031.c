@@ -164,7 +164,7 @@ int pl031_init_rtc(void *dtb)
 
 	uk_pr_info("Probing RTC...\n");
 
-	offs = fdt_node_offset_by_compatible(dtb, -1, PL031_COMPATIBLE);
+	offs = fdt_node_offset_by_compatible_cached(dtb, -1, PL031_COMPATIBLE);
 	if (unlikely(offs < 0)) {
 		uk_pr_err("Could not find RTC node (%d)\n", offs);
 		return -EINVAL;
@@ -35,6 +35,7 @@
 #include <string.h>
 #include <uk/alloc.h>
 #include <uk/arch/types.h>
+#include <uk/essentials.h>
 #include <uk/netdev_core.h>
 #include <uk/netdev_driver.h>
 #include <uk/netbuf.h>
@@ -57,6 +58,12 @@
 #define DRIVER_NAME             "tap-net"
 
 #define ETH_PKT_PAYLOAD_LEN       1500
+#define TAP_VNET_HDR_LEN          sizeof(struct uk_tap_vnet_hdr)
+#define TAP_MAX_QUEUES            CONFIG_TAP_NET_MAX_QUEUES
+/* Vnet header and segments of a netbuf chain written at once */
+#define TAP_TX_IOV_MAX            64
+/* Receive buffers allocated at once */
+#define TAP_RX_BURST              32
 
 /**
  * TODO: Find a better way of forwarding the command line argument to the
@@ -92,6 +99,9 @@ struct uk_netdev_rx_queue {
 	uk_netdev_alloc_rxpkts alloc_rxpkts;
 	/* Reference to a user data */
 	void *alloc_rxpkts_argp;
+	/* Allocated buffers not filled yet */
+	struct uk_netbuf *rxbuf[TAP_RX_BURST];
+	__u16 rxbuf_cnt;
 };
 
 struct tap_net_dev {
@@ -115,8 +125,10 @@ struct tap_net_dev {
 	__u16 tid;
 	/* UK Netdevice identifier */
 	__u16 id;
-	/* File Descriptor for the tap device */
-	int tap_fd;
+	/* File Descriptors for the tap device, one per queue pair */
+	int tap_fd[TAP_MAX_QUEUES];
+	/* Number of opened file descriptors */
+	__u16 tap_fd_cnt;
 	/* Control socket descriptor */
 	int ctrl_sock;
 	/* Name of the character device */
@@ -190,7 +202,9 @@ static int tap_netdev_rxq_info_get(struct uk_netdev *dev, __u16 queue_id,
 				   struct uk_netdev_queue_info *qinfo);
 static int tap_netdev_txq_info_get(struct uk_netdev *dev, __u16 queue_id,
 				   struct uk_netdev_queue_info *qinfo);
-static int tap_device_create(struct tap_net_dev *tdev, __u32 feature_flags);
+static int tap_device_create(struct tap_net_dev *tdev, __u32 feature_flags,
+			     __u16 nb_queues);
+static void tap_device_close(struct tap_net_dev *tdev);
 static int tap_mac_generate(__u8 *addr, __u8 dev_id);
 static int tap_dev_br_add(struct tap_net_dev *tdev);
 static int tap_dev_index_get(struct tap_net_dev *tdev);
@@ -250,84 +264,178 @@ exit:
 	return rc;
 }
 
-static int tap_netdev_recv(struct uk_netdev *dev,
-			   struct uk_netdev_rx_queue *queue,
-			   struct uk_netbuf **pkt)
+/**
+ * Copy the offload information of the vnet header in front of a received
+ * packet to the netbuf.
+ */
+static void tap_netdev_rxhdr_parse(struct uk_netbuf *pkt)
+{
+	struct uk_tap_vnet_hdr *vhdr = pkt->data;
+
+	pkt->flags = (vhdr->flags & UK_TAP_VNET_HDR_F_DATA_VALID)
+		     ? UK_NETBUF_F_DATA_VALID : 0x0;
+	if (vhdr->flags & UK_TAP_VNET_HDR_F_NEEDS_CSUM) {
+		pkt->flags |= UK_NETBUF_F_PARTIAL_CSUM;
+		pkt->csum_offset = vhdr->csum_offset;
+		/* NOTE: csum_start is without vnet header
+		 *       (uk_netbuf_header() will remove it again)
+		 */
+		pkt->csum_start  = vhdr->csum_start + TAP_VNET_HDR_LEN;
+	}
+}
+
+/**
+ * Fill the vnet header that is written in front of a packet.
+ */
+static void tap_netdev_txhdr_fill(const struct uk_netbuf *pkt,
+				  struct uk_tap_vnet_hdr *vhdr)
+{
+	memset(vhdr, 0, TAP_VNET_HDR_LEN);
+	if (pkt->flags & UK_NETBUF_F_PARTIAL_CSUM) {
+		vhdr->flags       |= UK_TAP_VNET_HDR_F_NEEDS_CSUM;
+		vhdr->csum_start   = pkt->csum_start;
+		vhdr->csum_offset  = pkt->csum_offset;
+	}
+	if (pkt->flags & (UK_NETBUF_F_GSO_TCPV4 | UK_NETBUF_F_GSO_TCPV6)) {
+		vhdr->gso_type     = (pkt->flags & UK_NETBUF_F_GSO_TCPV4)
+				     ? UK_TAP_VNET_HDR_GSO_TCPV4
+				     : UK_TAP_VNET_HDR_GSO_TCPV6;
+		vhdr->hdr_len      = pkt->header_len;
+		vhdr->gso_size     = pkt->gso_size;
+	}
+}
+
+/**
+ * Read a single packet from the tap device into `pkt`.
+ * @return
+ *	1 on success, 0 if no packet is pending, < 0 on failure.
+ */
+static int tap_netdev_rxq_read(struct uk_netdev_rx_queue *queue,
+			       struct uk_netbuf *pkt)
+{
+	int rc;
+
+	rc = tap_read(queue->fd, pkt->data, pkt->len);
+	if (rc > (int)TAP_VNET_HDR_LEN) {
+		uk_pr_debug(DRIVER_NAME": Recv pkt size: %d\n", rc);
+		/* Setting the length of the packet */
+		pkt->len = rc;
+		tap_netdev_rxhdr_parse(pkt);
+		rc = uk_netbuf_header(pkt, -((__s16)TAP_VNET_HDR_LEN));
+		UK_ASSERT(rc == 1);
+		return 1;
+	} else if (rc > 0) {
+		uk_pr_err(DRIVER_NAME": Received invalid packet size: %d\n", rc);
+		return -EINVAL;
+	} else if (rc == 0 || rc == -EWOULDBLOCK || rc == -EAGAIN) {
+		return 0;
+	}
+
+	uk_pr_err(DRIVER_NAME": Failed(%d) to read the packet\n", rc);
+	return rc;
+}
+
+static int tap_netdev_recv_burst(struct uk_netdev *dev,
+				 struct uk_netdev_rx_queue *queue,
+				 struct uk_netbuf *pkts[], __u16 cnt)
 {
+	__u16 nb_rx = 0;
 	int rc = 0;
-	struct tap_net_dev *tdev __maybe_unused;
-	struct uk_netbuf *_pkt = NULL;
 
 	UK_ASSERT(dev);
-	UK_ASSERT(queue && pkt);
-
-	tdev = to_tapnetdev(dev);
+	UK_ASSERT(queue);
+	UK_ASSERT(pkts || cnt == 0);
 
 	if (unlikely(!queue->alloc_rxpkts))
 		return -EINVAL;
 
-
-	/**
-	 * Allocate the packet in which the packet will be received.
+	/* Drain the device until it would block. Buffers that were not
+	 * filled are kept for the next call, so that polling an idle device
+	 * does not allocate.
 	 */
-	rc = queue->alloc_rxpkts(queue->alloc_rxpkts_argp, &_pkt, 1);
-	if (rc == 0) {
-		uk_pr_err(DRIVER_NAME": Failed to allocate the memory\n");
-		_pkt = NULL;
-		rc = UK_NETDEV_STATUS_UNDERRUN | UK_NETDEV_STATUS_MORE;
-		return rc;
-	}
-	uk_pr_debug(DRIVER_NAME": Receiving on interface %s(%d) %p(%d)\n",
-		    tdev->name, queue->fd, _pkt->data, _pkt->len);
-	rc = tap_read(queue->fd, _pkt->data, _pkt->len);
-	if (rc > 0) {
-		uk_pr_debug(DRIVER_NAME": Recv pkt size: %d\n", rc);
-		/* Setting the length of the packet */
-		_pkt->len = rc;
-		rc = UK_NETDEV_STATUS_SUCCESS | UK_NETDEV_STATUS_MORE;
-	} else if (rc == 0 || rc == -EWOULDBLOCK || rc == -EAGAIN) {
-		rc = 0;
-		goto err_exit;
-	} else {
-		uk_pr_err(DRIVER_NAME": Failed(%d) to read the packet\n", rc);
-		goto err_exit;
+	while (nb_rx < cnt) {
+		if (!queue->rxbuf_cnt) {
+			queue->rxbuf_cnt = queue->alloc_rxpkts(
+					queue->alloc_rxpkts_argp,
+					queue->rxbuf, TAP_RX_BURST);
+			if (unlikely(!queue->rxbuf_cnt)) {
+				uk_netdev_drv_rxq_stats_inc(dev,
+							    queue->queue_id,
+							    ring_full);
+				rc = -ENOMEM;
+				break;
+			}
+		}
+
+		rc = tap_netdev_rxq_read(queue,
+					 queue->rxbuf[queue->rxbuf_cnt - 1]);
+		if (rc <= 0)
+			break;
+		pkts[nb_rx++] = queue->rxbuf[--queue->rxbuf_cnt];
 	}
-	uk_pr_debug("uk_netdev buf ptr: %p\n", _pkt);
 
-	*pkt = _pkt;
+	if (unlikely(rc < 0 && nb_rx == 0))
+		return rc;
+	return nb_rx;
+}
 
-exit:
-	return rc;
+static int tap_netdev_recv(struct uk_netdev *dev,
+			   struct uk_netdev_rx_queue *queue,
+			   struct uk_netbuf **pkt)
+{
+	int rc;
+
+	UK_ASSERT(pkt);
 
-err_exit:
-	if (_pkt)
-		uk_netbuf_free(_pkt);
 	*pkt = NULL;
-	goto exit;
+	rc = tap_netdev_recv_burst(dev, queue, pkt, 1);
+	if (rc == -ENOMEM)
+		return UK_NETDEV_STATUS_UNDERRUN | UK_NETDEV_STATUS_MORE;
+	if (rc <= 0)
+		return rc;
+	return UK_NETDEV_STATUS_SUCCESS | UK_NETDEV_STATUS_MORE;
 }
 
 static int tap_netdev_xmit(struct uk_netdev *dev,
 			   struct uk_netdev_tx_queue *queue,
 			   struct uk_netbuf *pkt)
 {
-	int rc = -EINVAL;
-	struct tap_net_dev *tdev __unused;
+	struct uk_iovec iov[TAP_TX_IOV_MAX];
+	struct uk_tap_vnet_hdr vhdr;
+	struct uk_netbuf *nb;
+	int iovcnt = 1;
+	ssize_t rc;
 
 	UK_ASSERT(dev);
 	UK_ASSERT(queue && pkt);
 
-	tdev = to_tapnetdev(dev);
+	tap_netdev_txhdr_fill(pkt, &vhdr);
+	iov[0].iov_base = &vhdr;
+	iov[0].iov_len = TAP_VNET_HDR_LEN;
+	UK_NETBUF_CHAIN_FOREACH(nb, pkt) {
+		if (unlikely(iovcnt == TAP_TX_IOV_MAX)) {
+			uk_pr_err(DRIVER_NAME": Too many segments in packet\n");
+			return -EINVAL;
+		}
+		iov[iovcnt].iov_base = nb->data;
+		iov[iovcnt].iov_len = nb->len;
+		iovcnt++;
+	}
 
-	rc = tap_write(queue->fd, pkt->data, pkt->len);
+	/* Every write hands a whole packet over to the host, including all
+	 * segments of a GSO packet
+	 */
+	rc = tap_writev(queue->fd, iov, iovcnt);
+	uk_netdev_drv_txq_stats_inc(dev, queue->queue_id, kicks);
 	if (rc > 0) {
-		uk_pr_info(DRIVER_NAME": Send packet of size %d\n", rc);
+		uk_pr_debug(DRIVER_NAME": Send packet of size %ld\n", rc);
 		uk_netbuf_free(pkt);
-		rc = UK_NETDEV_STATUS_SUCCESS | UK_NETDEV_STATUS_MORE;
+		return UK_NETDEV_STATUS_SUCCESS | UK_NETDEV_STATUS_MORE;
 	} else if (rc == -EWOULDBLOCK || rc == -EAGAIN) {
-		uk_pr_info(DRIVER_NAME": The send queue is full\n");
-		rc = UK_NETDEV_STATUS_UNDERRUN;
+		uk_pr_debug(DRIVER_NAME": The send queue is full\n");
+		uk_netdev_drv_txq_stats_inc(dev, queue->queue_id, ring_full);
+		return UK_NETDEV_STATUS_UNDERRUN;
 	}
-
 	return rc;
 }
 
@@ -442,7 +550,7 @@ static struct uk_netdev_rx_queue *tap_netdev_rxq_setup(struct uk_netdev *dev,
 	rxq->a = conf->a;
 	rxq->alloc_rxpkts = conf->alloc_rxpkts;
 	rxq->alloc_rxpkts_argp = conf->alloc_rxpkts_argp;
-	rxq->fd = tdev->tap_fd;
+	rxq->fd = tdev->tap_fd[queue_id];
 	UK_TAILQ_INSERT_TAIL(&tdev->rxqs, rxq, next);
 	tdev->rxq_cnt++;
 exit:
@@ -474,7 +582,7 @@ static struct uk_netdev_tx_queue *tap_netdev_txq_setup(struct uk_netdev *dev,
 	}
 
 	txq->queue_id = queue_id;
-	txq->fd = tdev->tap_fd;
+	txq->fd = tdev->tap_fd[queue_id];
 	txq->a = conf->a;
 	UK_TAILQ_INSERT_TAIL(&tdev->txqs, txq, next);
 	tdev->txq_cnt++;
@@ -510,15 +618,21 @@ static int tap_netdev_start(struct uk_netdev *n)
 	return 0;
 }
 
-static void tap_netdev_info_get(struct uk_netdev *dev __unused,
+static void tap_netdev_info_get(struct uk_netdev *dev,
 				struct uk_netdev_info *dev_info)
 {
-	UK_ASSERT(dev_info);
-	dev_info->max_rx_queues = 1;
-	dev_info->max_tx_queues = 1;
+	struct tap_net_dev *tdev;
+
+	UK_ASSERT(dev && dev_info);
+	tdev = to_tapnetdev(dev);
+
+	dev_info->max_rx_queues = tdev->max_qpairs;
+	dev_info->max_tx_queues = tdev->max_qpairs;
+	/* The vnet header is written from a separate buffer */
 	dev_info->nb_encap_tx = 0;
-	dev_info->nb_encap_rx = 0;
-	dev_info->features = 0;
+	dev_info->nb_encap_rx = TAP_VNET_HDR_LEN;
+	dev_info->features = UK_NETDEV_F_PARTIAL_CSUM | UK_NETDEV_F_TSO4
+			     | UK_NETDEV_F_TSO6;
 }
 
 static unsigned int tap_netdev_promisc_get(struct uk_netdev *n)
@@ -647,6 +761,7 @@ static int tap_netdev_configure(struct uk_netdev *n,
 	int rc = 0;
 	struct tap_net_dev *tdev = NULL;
 	__u32 feature_flag = 0;
+	__u16 nb_queues;
 
 	UK_ASSERT(n && conf);
 	tdev = to_tapnetdev(n);
@@ -656,22 +771,32 @@ static int tap_netdev_configure(struct uk_netdev *n,
 		uk_pr_err(DRIVER_NAME": rx-queue:%d, tx-queue:%d not supported",
 			  conf->nb_rx_queues, conf->nb_tx_queues);
 		return -ENOTSUP;
-	} else if (conf->nb_rx_queues > 1 || conf->nb_tx_queues > 1)
-		/**
-		 * TODO:
-		 * We don't support multi-queues on the uknetdev. Might need to
-		 * revisit this when implementing multi-queue support on
-		 * uknetdev
-		 */
+	}
+
+	/* Every queue pair gets its own file descriptor of the interface */
+	nb_queues = MAX(MAX(conf->nb_rx_queues, conf->nb_tx_queues), 1);
+	if (nb_queues > 1)
 		feature_flag |= UK_IFF_MULTI_QUEUE;
 
+	/* Exchange offload information with the host in a header in front
+	 * of every packet.
+	 */
+	feature_flag |= UK_IFF_VNET_HDR;
+
 	/* Open the device and configure the tap interface */
-	rc = tap_device_create(tdev, feature_flag);
+	rc = tap_device_create(tdev, feature_flag, nb_queues);
 	if (rc < 0) {
 		uk_pr_err(DRIVER_NAME": Failed to configure the tap device\n");
 		goto exit;
 	}
 
+	/* Receive packets with partial checksums. Without this, the host
+	 * completes the checksums before handing the packets to us.
+	 */
+	rc = tap_dev_offload_set(tdev->tap_fd[0], UK_TUN_F_CSUM);
+	if (rc < 0)
+		uk_pr_warn(DRIVER_NAME": Receive checksum offloading disabled\n");
+
 	/* Create a control socket for the network interface */
 	rc = tapdev_ctrlsock_create(tdev);
 	if (rc != 0) {
@@ -708,42 +833,56 @@ exit:
 close_ctrl_sock:
 	tap_close(tdev->ctrl_sock);
 close_tap_dev:
-	tap_close(tdev->tap_fd);
+	tap_device_close(tdev);
 	goto exit;
 }
 
-static int tap_device_create(struct tap_net_dev *tdev, __u32 feature_flags)
+static int tap_device_create(struct tap_net_dev *tdev, __u32 feature_flags,
+			     __u16 nb_queues)
 {
 	int rc = 0;
 	struct uk_ifreq ifreq = {0};
 
-	/* Open the tap device */
-	rc = tap_open(O_RDWR | O_NONBLOCK);
-	if (rc < 0) {
-		uk_pr_err(DRIVER_NAME": Failed(%d) to open the tap device\n",
-			  rc);
-		return rc;
-	}
+	UK_ASSERT(nb_queues > 0 && nb_queues <= TAP_MAX_QUEUES);
 
-	tdev->tap_fd = rc;
+	/* The first open creates the interface, the others attach a queue
+	 * to the interface of the same name
+	 */
+	for (tdev->tap_fd_cnt = 0; tdev->tap_fd_cnt < nb_queues;
+	     tdev->tap_fd_cnt++) {
+		rc = tap_open(O_RDWR | O_NONBLOCK);
+		if (rc < 0) {
+			uk_pr_err(DRIVER_NAME": Failed(%d) to open the tap device\n",
+				  rc);
+			goto close_tap;
+		}
+		tdev->tap_fd[tdev->tap_fd_cnt] = rc;
 
-	rc = tap_dev_configure(tdev->tap_fd, feature_flags, &ifreq);
-	if (rc < 0) {
-		uk_pr_err(DRIVER_NAME": Failed to setup the tap device\n");
-		goto close_tap;
+		rc = tap_dev_configure(rc, feature_flags, &ifreq);
+		if (rc < 0) {
+			uk_pr_err(DRIVER_NAME": Failed to setup the tap device\n");
+			tap_close(tdev->tap_fd[tdev->tap_fd_cnt]);
+			goto close_tap;
+		}
 	}
 
 	snprintf(tdev->name, sizeof(tdev->name), "%s", ifreq.ifr_name);
-	uk_pr_info(DRIVER_NAME": Configured tap device %s\n", tdev->name);
+	uk_pr_info(DRIVER_NAME": Configured tap device %s with %d queues\n",
+		   tdev->name, nb_queues);
 
 exit:
 	return rc;
 close_tap:
-	tap_close(tdev->tap_fd);
-	tdev->tap_fd = -1;
+	tap_device_close(tdev);
 	goto exit;
 }
 
+static void tap_device_close(struct tap_net_dev *tdev)
+{
+	while (tdev->tap_fd_cnt > 0)
+		tap_close(tdev->tap_fd[--tdev->tap_fd_cnt]);
+}
+
 static const struct uk_netdev_ops tap_netdev_ops = {
 	.configure = tap_netdev_configure,
 	.rxq_configure = tap_netdev_rxq_setup,
@@ -775,13 +914,10 @@ static int tap_dev_init(int id)
 	}
 	tdev->ndev.rx_one = tap_netdev_recv;
 	tdev->ndev.tx_one = tap_netdev_xmit;
+	tdev->ndev.rx_burst = tap_netdev_recv_burst;
 	tdev->ndev.ops = &tap_netdev_ops;
 	tdev->tid = id;
-	/**
-	 * TODO:
-	 * As an initial implementation we have limit on the number of queues.
-	 */
-	tdev->max_qpairs = 1;
+	tdev->max_qpairs = TAP_MAX_QUEUES;
 
 	/* Registering the tap device with libuknet*/
 	rc = uk_netdev_drv_register(&tdev->ndev, tap_drv.a, drv_name);
@@ -27,6 +27,7 @@
 #include <uk/plat/common/acpi.h>
 #include <uk/plat/lcpu.h>
 #include <uk/plat/common/lcpu.h>
+#include <uk/plat/common/numa.h>
 #include <kvm-arm64/uart.h>
 #ifdef CONFIG_RTC_PL031
 #include <rtc/pl031.h>
@@ -227,6 +228,12 @@ void __no_pauth _ukplat_entry(struct ukplat_bootinfo *bi)
 			  fdt);
 	if (unlikely(rc))
 		UK_CRASH("SMP initialization failed: %d.\n", rc);
+
+#if CONFIG_UKPLAT_NUMA
+	rc = numa_init(fdt);
+	if (unlikely(rc))
+		uk_pr_err("NUMA init failed: %d\n", rc);
+#endif /* CONFIG_UKPLAT_NUMA */
 #endif /* CONFIG_HAVE_SMP */
 
 	rc = get_psci_method(bi);
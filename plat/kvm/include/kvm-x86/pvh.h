@@ -0,0 +1,64 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __KVM_X86_PVH_H__
+#define __KVM_X86_PVH_H__
+
+/*
+ * Xen PVH boot ABI (xen/include/public/arch-x86/hvm/start_info.h)
+ *
+ * The VMM enters the 32-bit entry point that is published with the
+ * XEN_ELFNOTE_PHYS32_ENTRY ELF note in protected mode with paging disabled,
+ * flat 4GiB CS, DS, ES, and SS segments, and interrupts disabled. EBX holds
+ * the physical address of struct hvm_start_info.
+ */
+
+#define XEN_ELFNOTE_PHYS32_ENTRY		18
+
+#define XEN_HVM_START_MAGIC_VALUE		0x336ec578
+
+/* Memory map entry types (same as E820) */
+#define XEN_HVM_MEMMAP_TYPE_RAM			1
+#define XEN_HVM_MEMMAP_TYPE_RESERVED		2
+#define XEN_HVM_MEMMAP_TYPE_ACPI		3
+#define XEN_HVM_MEMMAP_TYPE_NVS			4
+#define XEN_HVM_MEMMAP_TYPE_UNUSABLE		5
+#define XEN_HVM_MEMMAP_TYPE_DISABLED		6
+#define XEN_HVM_MEMMAP_TYPE_PMEM		7
+
+#ifndef __ASSEMBLY__
+#include <uk/arch/types.h>
+
+struct hvm_start_info {
+	__u32 magic;		/* XEN_HVM_START_MAGIC_VALUE */
+	__u32 version;		/* 1 if the memory map is present */
+	__u32 flags;
+	__u32 nr_modules;
+	__u64 modlist_paddr;	/* struct hvm_modlist_entry[nr_modules] */
+	__u64 cmdline_paddr;	/* Null-terminated command line */
+	__u64 rsdp_paddr;	/* ACPI RSDP */
+	/* Version 1 */
+	__u64 memmap_paddr;	/* struct hvm_memmap_table_entry[] */
+	__u32 memmap_entries;
+	__u32 reserved;
+} __packed;
+
+struct hvm_modlist_entry {
+	__u64 paddr;
+	__u64 size;
+	__u64 cmdline_paddr;
+	__u64 reserved;
+} __packed;
+
+struct hvm_memmap_table_entry {
+	__u64 addr;
+	__u64 size;
+	__u32 type;
+	__u32 reserved;
+} __packed;
+#endif /* !__ASSEMBLY__ */
+
+#endif /* __KVM_X86_PVH_H__ */
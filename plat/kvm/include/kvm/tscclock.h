@@ -33,8 +33,13 @@
 #ifndef __KVM_TSCCLOCK_H__
 #define __KVM_TSCCLOCK_H__
 
+#include <uk/plat/time.h>
+
 int tscclock_init(void);
 __u64 tscclock_monotonic(void);
 __u64 tscclock_epochoffset(void);
+void tscclock_resync(void);
+const struct ukplat_clock_params *tscclock_params(void);
+void tscclock_arm(__u64 until);
 
 #endif /* __KVM_TSCCLOCK_H__ */
@@ -32,8 +32,10 @@
  */
 
 #include <stdint.h>
+#include <uk/config.h>
 #include <uk/assert.h>
 #include <uk/plat/lcpu.h>
+#include <x86/cpu.h>
 #include <x86/irq.h>
 
 void ukplat_lcpu_enable_irq(void)
@@ -86,3 +88,21 @@ void ukplat_lcpu_irqs_handle_pending(void)
 {
 
 }
+
+void __weak ukplat_lcpu_irq_return(struct __regs *regs __unused)
+{
+}
+
+#if CONFIG_HAVE_LCPU_HALT_POLL_HINT
+#define KVM_FEATURE_POLL_CONTROL	(1 << 12)
+#define MSR_KVM_POLL_CONTROL		0x4b564d05
+
+void ukplat_lcpu_halt_poll_hint(int host_poll)
+{
+	if (!(kvm_cpuid_features() & KVM_FEATURE_POLL_CONTROL))
+		return;
+
+	/* Bit 0 enables halt polling in the host */
+	wrmsrl(MSR_KVM_POLL_CONTROL, host_poll ? 1 : 0);
+}
+#endif /* CONFIG_HAVE_LCPU_HALT_POLL_HINT */
@@ -0,0 +1,146 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <uk/essentials.h>
+#include <uk/arch/limits.h>
+#include <uk/arch/types.h>
+#include <uk/arch/paging.h>
+#include <uk/plat/bootstrap.h>
+#include <uk/plat/common/bootinfo.h>
+#include <uk/plat/common/lcpu.h>
+#include <uk/plat/common/memory.h>
+#include <uk/plat/common/sections.h>
+#include <uk/reloc.h>
+#include <kvm-x86/pvh.h>
+
+#include <errno.h>
+#include <string.h>
+
+#define pvh_crash(msg, rc)	ukplat_crash()
+
+void _ukplat_entry(struct lcpu *lcpu, struct ukplat_bootinfo *bi);
+
+static inline void mrd_insert(struct ukplat_bootinfo *bi,
+			      const struct ukplat_memregion_desc *mrd)
+{
+	int rc;
+
+	if (unlikely(mrd->len == 0))
+		return;
+
+	rc = ukplat_memregion_list_insert(&bi->mrds, mrd);
+	if (unlikely(rc < 0))
+		pvh_crash("Cannot insert bootinfo memory region", rc);
+}
+
+/**
+ * PVH entry point called after lcpu initialization. We enter with the
+ * 1:1 boot page table set. Physical and virtual addresses thus match for all
+ * regions in the mapped range.
+ */
+void pvh_entry(struct lcpu *lcpu, struct hvm_start_info *si)
+{
+	struct ukplat_bootinfo *bi;
+	struct ukplat_memregion_desc mrd = {0};
+	struct hvm_memmap_table_entry *m;
+	struct hvm_modlist_entry *mods;
+	__sz cmdline_len;
+	__paddr_t start, end;
+	__u32 i;
+	int rc;
+
+	bi = ukplat_bootinfo_get();
+	if (unlikely(!bi))
+		pvh_crash("Incompatible or corrupted bootinfo", -EINVAL);
+
+	/* The early do_uk_reloc32 relocator does not relocate the
+	 * UKPLAT_MEMRT_KERNEL mrd's, see multiboot.c
+	 */
+	do_uk_reloc_kmrds(0, 0);
+
+	/* Ensure that the memory map contains the legacy high mem area */
+	rc = ukplat_memregion_list_insert_legacy_hi_mem(&bi->mrds);
+	if (unlikely(rc))
+		pvh_crash("Could not insert legacy memory region", rc);
+
+	/* Add the cmdline */
+	if (si->cmdline_paddr) {
+		cmdline_len = strlen((const char *)(__uptr)si->cmdline_paddr);
+		mrd.pbase = si->cmdline_paddr;
+		mrd.vbase = si->cmdline_paddr; /* 1:1 mapping */
+		mrd.len   = cmdline_len;
+		mrd.type  = UKPLAT_MEMRT_CMDLINE;
+		mrd.flags = UKPLAT_MEMRF_READ | UKPLAT_MEMRF_MAP;
+
+		mrd_insert(bi, &mrd);
+
+		bi->cmdline = si->cmdline_paddr;
+		bi->cmdline_len = cmdline_len;
+	}
+
+	memcpy(bi->bootprotocol, "pvh", sizeof("pvh"));
+
+	/* Add modules as initial RAM disks */
+	mods = (struct hvm_modlist_entry *)(__uptr)si->modlist_paddr;
+	for (i = 0; mods && i < si->nr_modules; i++) {
+		mrd.pbase = mods[i].paddr;
+		mrd.vbase = mods[i].paddr; /* 1:1 mapping */
+		mrd.len   = mods[i].size;
+		mrd.type  = UKPLAT_MEMRT_INITRD;
+		mrd.flags = UKPLAT_MEMRF_READ | UKPLAT_MEMRF_MAP;
+
+#ifdef CONFIG_UKPLAT_MEMRNAME
+		if (mods[i].cmdline_paddr)
+			strncpy(mrd.name,
+				(char *)(__uptr)mods[i].cmdline_paddr,
+				sizeof(mrd.name) - 1);
+#endif /* CONFIG_UKPLAT_MEMRNAME */
+
+		mrd_insert(bi, &mrd);
+	}
+
+#ifdef CONFIG_UKPLAT_MEMRNAME
+	memset(mrd.name, 0, sizeof(mrd.name));
+#endif /* CONFIG_UKPLAT_MEMRNAME */
+
+	/* Add the E820-style memory map. Version 0 of the start info does
+	 * not carry one, in which case the VMM is not usable.
+	 * CAUTION: Free ranges could overlap with regions already in the
+	 * list, see multiboot.c.
+	 */
+	if (unlikely(si->version < 1 || !si->memmap_paddr))
+		pvh_crash("No memory map in PVH start info", -EINVAL);
+
+	m = (struct hvm_memmap_table_entry *)(__uptr)si->memmap_paddr;
+	for (i = 0; i < si->memmap_entries; i++) {
+		start = MAX(m[i].addr, __PAGE_SIZE);
+		end   = m[i].addr + m[i].size;
+		if (unlikely(end <= start || end - start < PAGE_SIZE))
+			continue;
+
+		mrd.pbase = start;
+		mrd.vbase = start; /* 1:1 mapping */
+		mrd.len   = end - start;
+
+		if (m[i].type == XEN_HVM_MEMMAP_TYPE_RAM) {
+			mrd.type  = UKPLAT_MEMRT_FREE;
+			mrd.flags = UKPLAT_MEMRF_READ | UKPLAT_MEMRF_WRITE;
+		} else {
+			mrd.type  = UKPLAT_MEMRT_RESERVED;
+			mrd.flags = UKPLAT_MEMRF_READ | UKPLAT_MEMRF_MAP;
+		}
+
+		mrd_insert(bi, &mrd);
+	}
+
+	ukplat_memregion_list_coalesce(&bi->mrds);
+
+	rc = ukplat_memregion_alloc_sipi_vect();
+	if (unlikely(rc))
+		pvh_crash("Could not insert SIPI vector region", rc);
+
+	_ukplat_entry(lcpu, bi);
+}
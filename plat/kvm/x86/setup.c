@@ -21,6 +21,7 @@
 
 #include <uk/plat/lcpu.h>
 #include <uk/plat/common/lcpu.h>
+#include <uk/plat/common/numa.h>
 #include <uk/plat/common/sections.h>
 #include <uk/plat/common/bootinfo.h>
 
@@ -121,6 +122,11 @@ void _ukplat_entry(struct lcpu *lcpu, struct ukplat_bootinfo *bi)
 				  NULL);
 		if (unlikely(rc))
 			uk_pr_err("SMP init failed: %d\n", rc);
+#if CONFIG_UKPLAT_NUMA
+		rc = numa_init(NULL);
+		if (unlikely(rc))
+			uk_pr_err("NUMA init failed: %d\n", rc);
+#endif /* CONFIG_UKPLAT_NUMA */
 	} else {
 		uk_pr_err("ACPI init failed: %d\n", rc);
 	}
@@ -56,9 +56,24 @@ __nsec ukplat_wall_clock(void)
 	return tscclock_monotonic() + tscclock_epochoffset();
 }
 
-/* NB: If this ever does more than an immediate return, it will need to be
- * compiled with NO_X86_EXTREGS_FLAGS to prevent potential clobbering of
- * registers that are not saved on interrupt handling.
+const struct ukplat_clock_params *ukplat_clock_params(void)
+{
+	return tscclock_params();
+}
+
+void ukplat_time_arm(__nsec until)
+{
+	tscclock_arm(until);
+}
+
+void ukplat_time_resync(void)
+{
+	tscclock_resync();
+}
+
+/* NB: This file is built with the ISR flags, so the handler cannot clobber
+ * extended registers, which are not saved on interrupt handling. The clock
+ * readers above rely on the same for the system call fast path.
  */
 static int timer_handler(void *arg __unused)
 {
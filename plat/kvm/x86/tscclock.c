@@ -52,6 +52,7 @@
  * SUCH DAMAGE.
  */
 
+#include <string.h>
 #include <uk/plat/lcpu.h>
 #include <uk/plat/time.h>
 #include <x86/cpu.h>
@@ -59,6 +60,11 @@
 #include <uk/print.h>
 #include <uk/assert.h>
 #include <uk/bitops.h>
+#include <uk/essentials.h>
+#include <uk/plat/io.h>
+#if CONFIG_KVM_TSC_DEADLINE_TIMER
+#include <uk/intctlr/apic.h>
+#endif /* CONFIG_KVM_TSC_DEADLINE_TIMER */
 
 #define TIMER_CNTR           0x40
 #define TIMER_MODE           0x43
@@ -98,13 +104,56 @@ static __u64 rtc_epochoffset;
  * TSC clock specific.
  */
 
-/* Base time values at the last call to tscclock_monotonic(). */
-static __u64 time_base;
+/* TSC value at monotonic time 0 */
 static __u64 tsc_base;
 
 /* Multiplier for converting TSC ticks to nsecs. (0.32) fixed point. */
 static __u32 tsc_mult;
 
+/* Published once the TSC is calibrated. With kvmclock, the hypervisor
+ * updates the counter fields in place.
+ */
+static struct ukplat_clock_params tsc_params __align64;
+
+#if CONFIG_KVM_PVCLOCK
+#define KVM_FEATURE_CLOCKSOURCE2	(1 << 3)
+#define KVM_FEATURE_CLOCKSOURCE_STABLE	(1 << 24)
+#define MSR_KVM_WALL_CLOCK_NEW		0x4b564d00
+#define MSR_KVM_SYSTEM_TIME_NEW		0x4b564d01
+#define KVM_MSR_ENABLED			1
+#define PVCLOCK_TSC_STABLE_BIT		(1 << 0)
+
+/* Wall clock time at kvmclock time 0, written by KVM on request */
+struct pvclock_wall_clock {
+	__u32 version;
+	__u32 sec;
+	__u32 nsec;
+} __packed;
+
+/* Set if KVM maintains tsc_params */
+static int pvclock_enabled;
+
+/* The hypervisor writes a pvclock structure to the start of tsc_params */
+UK_CTASSERT(__offsetof(struct ukplat_clock_params, cnt_base) == 8);
+UK_CTASSERT(__offsetof(struct ukplat_clock_params, ns_base) == 16);
+UK_CTASSERT(__offsetof(struct ukplat_clock_params, cnt_mult) == 24);
+UK_CTASSERT(__offsetof(struct ukplat_clock_params, cnt_shift) == 28);
+UK_CTASSERT(__offsetof(struct ukplat_clock_params, flags) == 29);
+UK_CTASSERT(__offsetof(struct ukplat_clock_params, epoch_offset) == 32);
+#endif /* CONFIG_KVM_PVCLOCK */
+
+#if CONFIG_KVM_TSC_DEADLINE_TIMER
+/* The LAPIC timer raises the same IRQ as the i8254 */
+#define TSC_DEADLINE_VECTOR	32
+
+/* Set if timed halts use the LAPIC TSC-deadline timer */
+static int tsc_deadline;
+
+/* Multiplier for converting nsecs to TSC ticks: (32.0) + (0.32) parts. */
+static __u32 tsc_ns_mult_int;
+static __u32 tsc_ns_mult_frac;
+#endif /* CONFIG_KVM_TSC_DEADLINE_TIMER */
+
 /*
  * Multiplier for converting nsecs to PIT ticks. (1.32) fixed point.
  *
@@ -198,19 +247,169 @@ static __u64 rtc_gettimeofday(void)
  */
 __u64 tscclock_monotonic(void)
 {
-	__u64 tsc_now, tsc_delta;
+	__u64 now;
+	__u32 seq;
 
 	/*
-	 * Update time_base (monotonic time) and tsc_base (TSC time).
+	 * The conversion uses the full 128-bit product, so we can convert the
+	 * whole TSC delta at once and do not need to accumulate shared state.
+	 * This keeps the clock readable without calling into the platform
+	 * (see tscclock_params()). The parameters only change under their
+	 * sequence counter, i.e., if kvmclock is used.
 	 */
-	tsc_now = rdtsc();
-	tsc_delta = tsc_now - tsc_base;
-	if (tsc_delta >= UINT64_MAX / 2)
-		tsc_delta = 1;
-	time_base += mul64_32(tsc_delta, tsc_mult);
-	tsc_base = tsc_now;
-
-	return time_base;
+	do {
+		seq = ukplat_clock_params_read_begin(&tsc_params);
+		now = ukplat_clock_params_monotonic(&tsc_params, rdtsc());
+	} while (unlikely(ukplat_clock_params_read_retry(&tsc_params, seq)));
+
+	return now;
+}
+
+#if CONFIG_KVM_PVCLOCK
+static int pvclock_supported(void)
+{
+	__u32 eax = kvm_cpuid_features();
+
+	return (eax & KVM_FEATURE_CLOCKSOURCE2) &&
+	       (eax & KVM_FEATURE_CLOCKSOURCE_STABLE);
+}
+
+/*
+ * Let KVM maintain the counter parameters (kvmclock). KVM updates them
+ * whenever the relation between TSC and system time changes, e.g., after a
+ * live migration, so the TSC frequency does not need to be calibrated.
+ * Only one structure is registered, which is valid on all CPUs as long as
+ * KVM reports a stable TSC.
+ *
+ * Returns the TSC frequency, or 0 if kvmclock cannot be used.
+ */
+static __u64 pvclock_init(void)
+{
+	__u64 tsc_freq;
+	__u32 mult;
+	__s8 shift;
+	__u8 flags;
+	__u32 seq;
+
+	if (!pvclock_supported())
+		return 0;
+
+	wrmsrl(MSR_KVM_SYSTEM_TIME_NEW,
+	       ukplat_virt_to_phys(&tsc_params) | KVM_MSR_ENABLED);
+
+	do {
+		seq = ukplat_clock_params_read_begin(&tsc_params);
+		mult = tsc_params.cnt_mult;
+		shift = tsc_params.cnt_shift;
+		flags = tsc_params.flags;
+	} while (ukplat_clock_params_read_retry(&tsc_params, seq));
+
+	if (unlikely(!mult || !(flags & PVCLOCK_TSC_STABLE_BIT))) {
+		wrmsrl(MSR_KVM_SYSTEM_TIME_NEW, 0);
+		memset(&tsc_params, 0, sizeof(tsc_params));
+		return 0;
+	}
+
+	/* Inverse of the conversion, see struct ukplat_clock_params */
+	tsc_freq = (UKARCH_NSEC_PER_SEC << 32) / mult;
+	if (shift < 0)
+		tsc_freq <<= -shift;
+	else
+		tsc_freq >>= shift;
+
+	return tsc_freq;
+}
+#endif /* CONFIG_KVM_PVCLOCK */
+
+#if CONFIG_KVM_TSC_DEADLINE_TIMER
+/*
+ * Switch the LAPIC timer of the current CPU to TSC-deadline mode, if it is
+ * supported. The LVT registers are only accessible once the interrupt
+ * controller enabled the APIC, in x2APIC or xAPIC mode.
+ */
+static void tsc_deadline_init(__u64 tsc_freq)
+{
+	__u32 eax, ebx, ecx, edx;
+
+	cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+	if (!(ecx & X86_CPUID1_ECX_TSCDEADLINE))
+		return;
+
+	rdmsr(APIC_MSR_BASE, &eax, &edx);
+	if (!(eax & APIC_BASE_EN))
+		return;
+
+	tsc_ns_mult_int = tsc_freq / UKARCH_NSEC_PER_SEC;
+	tsc_ns_mult_frac = ((tsc_freq % UKARCH_NSEC_PER_SEC) << 32)
+			   / UKARCH_NSEC_PER_SEC;
+
+	apic_write(APIC_MSR_LVT_TIMER,
+		   APIC_LVT_TIMER_TSC_DEADLINE | TSC_DEADLINE_VECTOR);
+	tsc_deadline = 1;
+
+	uk_pr_info("Timer: LAPIC TSC-deadline\n");
+}
+#endif /* CONFIG_KVM_TSC_DEADLINE_TIMER */
+
+/*
+ * Retrieve the TSC frequency via the hypervisor generic cpuid timing
+ * information leaf. 0x40000010 returns the (virtual) TSC frequency in kHz,
+ * or 0 if the feature is not supported by the hypervisor.
+ */
+static __u64 tsc_freq_hypervisor(void)
+{
+	__u32 eax, ebx, ecx, edx;
+
+	cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+	if (!(ecx & X86_CPUID1_ECX_HYPERVISOR))
+		return 0;
+
+	cpuid(0x40000000, 0, &eax, &ebx, &ecx, &edx);
+	if (eax < 0x40000010)
+		return 0;
+
+	cpuid(0x40000010, 0, &eax, &ebx, &ecx, &edx);
+	if (eax)
+		uk_pr_info("Retrieving TSC clock frequency from hypervisor\n");
+	return (__u64)eax * 1000;
+}
+
+#define X86_CPUID_INTEL_EBX	0x756e6547 /* "Genu" */
+#define X86_CPUID_INTEL_ECX	0x6c65746e /* "ntel" */
+#define X86_CPUID_INTEL_EDX	0x49656e69 /* "ineI" */
+
+/*
+ * Retrieve the TSC frequency from the CPU. Leaf 0x15 reports the ratio of
+ * the TSC to the core crystal clock and, on most CPUs, the crystal
+ * frequency. If the latter is missing, the TSC runs at the base frequency
+ * of leaf 0x16. Other vendors do not define the TSC by these leaves.
+ */
+static __u64 tsc_freq_cpuid(void)
+{
+	__u32 max, eax, ebx, ecx, edx;
+	__u64 tsc_freq = 0;
+
+	cpuid(0, 0, &max, &ebx, &ecx, &edx);
+	if (ebx != X86_CPUID_INTEL_EBX || ecx != X86_CPUID_INTEL_ECX ||
+	    edx != X86_CPUID_INTEL_EDX || max < 0x15)
+		return 0;
+
+	/* eax: denominator, ebx: numerator, ecx: crystal frequency (Hz) */
+	cpuid(0x15, 0, &eax, &ebx, &ecx, &edx);
+	if (!eax || !ebx)
+		return 0;
+
+	if (ecx) {
+		tsc_freq = (__u64)ecx * ebx / eax;
+	} else if (max >= 0x16) {
+		/* eax: base frequency (MHz) */
+		cpuid(0x16, 0, &eax, &ebx, &ecx, &edx);
+		tsc_freq = (__u64)(eax & 0xffff) * 1000000;
+	}
+
+	if (tsc_freq)
+		uk_pr_info("Retrieving TSC clock frequency from CPUID\n");
+	return tsc_freq;
 }
 
 /*
@@ -219,7 +418,6 @@ __u64 tscclock_monotonic(void)
 int tscclock_init(void)
 {
 	__u64 tsc_freq = 0, rtc_boot;
-	__u32 eax, ebx, ecx, edx;
 
 	/* Initialise i8254 timer channel 0 to mode 2 at CONFIG_HZ frequency */
 	outb(TIMER_MODE, TIMER_SEL0 | TIMER_RATEGEN | TIMER_16BIT);
@@ -232,22 +430,24 @@ int tscclock_init(void)
 	 */
 	rtc_boot = rtc_gettimeofday();
 
-	/*
-	 * Attempt to retrieve TSC frequency via the hypervisor generic cpuid
-	 * timing information leaf. 0x40000010 returns the (virtual) TSC
-	 * frequency in kHz, or 0 if the feature is not supported by the
-	 * hypervisor.
-	 */
-	cpuid(0x40000000, 0, &eax, &ebx, &ecx, &edx);
-	if (eax >= 0x40000010) {
-		uk_pr_info("Retrieving TSC clock frequency from hypervisor\n");
-		tsc_base = rdtsc();
-		cpuid(0x40000010, 0, &eax, &ebx, &ecx, &edx);
-		tsc_freq = eax * 1000;
+#if CONFIG_KVM_PVCLOCK
+	tsc_freq = pvclock_init();
+	if (tsc_freq) {
+		pvclock_enabled = 1;
+		uk_pr_info("Clock source: kvmclock, TSC frequency is %llu Hz\n",
+			   (unsigned long long)tsc_freq);
+		goto epoch;
 	}
+#endif /* CONFIG_KVM_PVCLOCK */
+
+	tsc_freq = tsc_freq_hypervisor();
+	if (!tsc_freq)
+		tsc_freq = tsc_freq_cpuid();
+	if (tsc_freq)
+		tsc_base = rdtsc();
 
 	/*
-	 * If we could not retrieve the TSC frequency from the hypervisor,
+	 * If neither the hypervisor nor the CPU report the TSC frequency,
 	 * calibrate against an 0.1s delay using the i8254 timer. This is
 	 * undesirable as it delays the boot sequence.
 	 */
@@ -263,11 +463,6 @@ int tscclock_init(void)
 	 *
 	 * (0.32) tsc_mult = UKARCH_NSEC_PER_SEC (32.32) / tsc_freq (32.0)
 	 *
-	 * Warning, do not print anything between TSC calibration and the
-	 * setting of tsc_mult: if CONFIG_LIBUKDEBUG_PRINT_TIME is enabled
-	 * this will trigger a reset of tsc_base via tscclock_monotonic
-	 * and delay the clock starting point.
-	 *
 	 * FIXME: this will overflow with small TSC frequencies. We should
 	 * probably calculate the TSC shift dynamically like solo5/hvt does.
 	 */
@@ -280,13 +475,23 @@ int tscclock_init(void)
 	 * Monotonic time begins at tsc_base (first read of TSC before
 	 * calibration).
 	 */
-	tscclock_monotonic();
+	tsc_params.cnt_base = tsc_base;
+	tsc_params.cnt_mult = tsc_mult;
 
+#if CONFIG_KVM_PVCLOCK
+epoch:
+#endif /* CONFIG_KVM_PVCLOCK */
 	/*
-	 * Compute RTC epoch offset by subtracting monotonic time_base from RTC
-	 * time at boot.
+	 * Compute RTC epoch offset by subtracting the current monotonic time
+	 * from RTC time at boot. It is not part of the fields that kvmclock
+	 * updates.
 	 */
-	rtc_epochoffset = rtc_boot - time_base;
+	rtc_epochoffset = rtc_boot - tscclock_monotonic();
+	tsc_params.epoch_offset = rtc_epochoffset;
+
+#if CONFIG_KVM_TSC_DEADLINE_TIMER
+	tsc_deadline_init(tsc_freq);
+#endif /* CONFIG_KVM_TSC_DEADLINE_TIMER */
 
 	/*
 	 * Initialise i8254 timer channel 0 to mode 4 (one shot).
@@ -298,6 +503,50 @@ int tscclock_init(void)
 	return 0;
 }
 
+#if CONFIG_KVM_PVCLOCK
+/*
+ * Read the wall clock time at kvmclock time 0 from KVM, with nanosecond
+ * resolution.
+ */
+static __u64 pvclock_epochoffset(void)
+{
+	static struct pvclock_wall_clock wc __align(4);
+	__u32 version;
+	__u64 ns;
+
+	wrmsrl(MSR_KVM_WALL_CLOCK_NEW, ukplat_virt_to_phys(&wc));
+	do {
+		version = __atomic_load_n(&wc.version, __ATOMIC_ACQUIRE);
+		ns = (__u64)wc.sec * UKARCH_NSEC_PER_SEC + wc.nsec;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while ((version & 1) ||
+		 version != __atomic_load_n(&wc.version, __ATOMIC_RELAXED));
+
+	return ns;
+}
+#endif /* CONFIG_KVM_PVCLOCK */
+
+/*
+ * Recompute the epoch offset, e.g., after the VM was restored from a
+ * snapshot. The monotonic clock continues where it stopped, but the wall
+ * clock has to follow the time of the host.
+ */
+void tscclock_resync(void)
+{
+	__u64 epochoffset;
+
+#if CONFIG_KVM_PVCLOCK
+	if (pvclock_enabled)
+		epochoffset = pvclock_epochoffset();
+	else
+#endif /* CONFIG_KVM_PVCLOCK */
+		epochoffset = rtc_gettimeofday() - tscclock_monotonic();
+
+	__atomic_store_n(&rtc_epochoffset, epochoffset, __ATOMIC_RELAXED);
+	__atomic_store_n(&tsc_params.epoch_offset, epochoffset,
+			 __ATOMIC_RELAXED);
+}
+
 /*
  * Return epoch offset (wall time offset to monotonic clock start).
  */
@@ -306,6 +555,33 @@ __u64 tscclock_epochoffset(void)
 	return rtc_epochoffset;
 }
 
+/*
+ * Return the TSC parameters of the monotonic and wall clocks.
+ */
+const struct ukplat_clock_params *tscclock_params(void)
+{
+	return &tsc_params;
+}
+
+#if CONFIG_KVM_TSC_DEADLINE_TIMER
+/* `cnt_base` is the TSC value at monotonic time `ns_base` */
+static inline __u64 tsc_deadline_of(__u64 until)
+{
+	__u64 base, delta;
+	__u32 seq;
+
+	do {
+		seq = ukplat_clock_params_read_begin(&tsc_params);
+		base = tsc_params.cnt_base;
+		delta = (until > tsc_params.ns_base)
+			? until - tsc_params.ns_base : 0;
+	} while (unlikely(ukplat_clock_params_read_retry(&tsc_params, seq)));
+
+	return base + delta * tsc_ns_mult_int
+	       + mul64_32(delta, tsc_ns_mult_frac);
+}
+#endif /* CONFIG_KVM_TSC_DEADLINE_TIMER */
+
 /*
  * Minimum delta to sleep using PIT. Programming seems to have an overhead of
  * 3-4us, but play it safe here.
@@ -323,6 +599,27 @@ __u64 tscclock_epochoffset(void)
  * kind of mutex_lock. It will simply halt the cpu, not allowing any
  * other thread to execute.
  */
+#if CONFIG_KVM_TSC_DEADLINE_TIMER
+static void tsc_deadline_cpu_block(__u64 until)
+{
+	__u64 deadline;
+
+	if (until <= tscclock_monotonic())
+		return;
+
+	deadline = tsc_deadline_of(until);
+	wrmsrl(APIC_MSR_TSC_DEADLINE, deadline);
+
+	ukplat_lcpu_halt_irq();
+
+	/* Disarm the timer if a different interrupt woke us up, so that it
+	 * does not cause a spurious wakeup later.
+	 */
+	if (rdtsc() < deadline)
+		wrmsrl(APIC_MSR_TSC_DEADLINE, 0);
+}
+#endif /* CONFIG_KVM_TSC_DEADLINE_TIMER */
+
 static void tscclock_cpu_block(__u64 until)
 {
 	__u64 now, delta_ns;
@@ -331,6 +628,13 @@ static void tscclock_cpu_block(__u64 until)
 
 	UK_ASSERT(ukplat_lcpu_irqs_disabled());
 
+#if CONFIG_KVM_TSC_DEADLINE_TIMER
+	if (tsc_deadline) {
+		tsc_deadline_cpu_block(until);
+		return;
+	}
+#endif /* CONFIG_KVM_TSC_DEADLINE_TIMER */
+
 	now = ukplat_monotonic_clock();
 
 	/*
@@ -382,6 +686,41 @@ static void tscclock_cpu_block(__u64 until)
 	ukplat_lcpu_halt_irq();
 }
 
+/*
+ * Programs the timer to interrupt the CPU at `until` without waiting for it.
+ * A deadline that already passed or is too close fires after the minimum
+ * delay. Blocking with tscclock_cpu_block() replaces the programmed time.
+ */
+void tscclock_arm(__u64 until)
+{
+	__u64 now, delta_ns;
+	__u64 delta_ticks;
+	unsigned int ticks;
+
+#if CONFIG_KVM_TSC_DEADLINE_TIMER
+	if (tsc_deadline) {
+		wrmsrl(APIC_MSR_TSC_DEADLINE, tsc_deadline_of(until));
+		return;
+	}
+#endif /* CONFIG_KVM_TSC_DEADLINE_TIMER */
+
+	now = tscclock_monotonic();
+	delta_ns = (until > now) ? until - now : 0;
+
+	delta_ticks = mul64_32(delta_ns, pit_mult);
+	if (delta_ticks < PIT_MIN_DELTA)
+		ticks = PIT_MIN_DELTA;
+	else if (delta_ticks > 65535)
+		ticks = 65535;
+	else
+		ticks = delta_ticks;
+
+	/* The interrupt is delivered in N + 1 ticks, see tscclock_cpu_block() */
+	ticks -= 1;
+	outb(TIMER_CNTR, ticks & 0xff);
+	outb(TIMER_CNTR, ticks >> 8);
+}
+
 unsigned long sched_have_pending_events;
 
 void time_block_until(__snsec until)
@@ -0,0 +1,104 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+#ifndef __PLAT_LINUXU_PACKET_H__
+#define __PLAT_LINUXU_PACKET_H__
+
+#include <uk/arch/types.h>
+#include <uk/essentials.h>
+#include <linuxu/syscall.h>
+#include <linuxu/ioctl.h>
+
+/**
+ * Definitions of the Linux packet socket interface with memory mapped
+ * rings (PACKET_MMAP), see linux/if_packet.h
+ */
+#ifndef AF_PACKET
+#define AF_PACKET		17
+#endif /* AF_PACKET */
+
+/* Receive frames of all protocols, in network byte order */
+#define UK_ETH_P_ALL_BE		0x0300
+
+#define UK_SOL_PACKET		263
+#define UK_PACKET_ADD_MEMBERSHIP 1
+#define UK_PACKET_RX_RING	5
+#define UK_PACKET_VERSION	10
+#define UK_PACKET_TX_RING	13
+#define UK_PACKET_QDISC_BYPASS	20
+
+#define UK_PACKET_MR_PROMISC	1
+
+#define UK_TPACKET_V2		1
+
+/* Status of a receive frame */
+#define UK_TP_STATUS_KERNEL		0x0
+#define UK_TP_STATUS_USER		0x1
+#define UK_TP_STATUS_LOSING		0x4
+#define UK_TP_STATUS_CSUMNOTREADY	0x8
+#define UK_TP_STATUS_CSUM_VALID		0x80
+
+/* Status of a transmit frame */
+#define UK_TP_STATUS_AVAILABLE		0x0
+#define UK_TP_STATUS_SEND_REQUEST	0x1
+#define UK_TP_STATUS_SENDING		0x2
+#define UK_TP_STATUS_WRONG_FORMAT	0x4
+
+#define UK_MSG_DONTWAIT		0x40
+
+#define UK_TPACKET_ALIGNMENT	16
+#define UK_TPACKET_ALIGN(x) \
+	(((x) + UK_TPACKET_ALIGNMENT - 1) & ~(UK_TPACKET_ALIGNMENT - 1))
+
+struct uk_sockaddr_ll {
+	__u16 sll_family;
+	__u16 sll_protocol;
+	__s32 sll_ifindex;
+	__u16 sll_hatype;
+	__u8 sll_pkttype;
+	__u8 sll_halen;
+	__u8 sll_addr[8];
+};
+
+struct uk_packet_mreq {
+	__s32 mr_ifindex;
+	__u16 mr_type;
+	__u16 mr_alen;
+	__u8 mr_address[8];
+};
+
+struct uk_tpacket_req {
+	unsigned int tp_block_size;
+	unsigned int tp_block_nr;
+	unsigned int tp_frame_size;
+	unsigned int tp_frame_nr;
+};
+
+/**
+ * Header in front of every frame of the rings. The owner of a frame is
+ * given by `tp_status`: the kernel or the application.
+ */
+struct uk_tpacket2_hdr {
+	__u32 tp_status;
+	__u32 tp_len;
+	__u32 tp_snaplen;
+	__u16 tp_mac;
+	__u16 tp_net;
+	__u32 tp_sec;
+	__u32 tp_nsec;
+	__u16 tp_vlan_tci;
+	__u16 tp_vlan_tpid;
+	__u8 tp_padding[4];
+};
+
+#define UK_TPACKET2_HDRLEN \
+	(UK_TPACKET_ALIGN(sizeof(struct uk_tpacket2_hdr)) + \
+	 sizeof(struct uk_sockaddr_ll))
+
+/* Offset of the packet data in a transmit frame */
+#define UK_TPACKET2_TX_DATA_OFF \
+	(UK_TPACKET2_HDRLEN - sizeof(struct uk_sockaddr_ll))
+
+#endif /* __PLAT_LINUXU_PACKET_H__ */
@@ -45,6 +45,7 @@
 #define __SC_MUNMAP	91
 #define __SC_FSTAT	108
 #define __SC_RT_SIGPROCMASK	126
+#define __SC_WRITEV	146
 #define __SC_ARCH_PRCTL	172
 #define __SC_RT_SIGACTION	174
 #define __SC_MMAP	192 /* use mmap2() since mmap() is obsolete */
@@ -55,6 +56,9 @@
 #define __SC_TIMER_DELETE	261
 #define __SC_CLOCK_GETTIME	263
 #define __SC_SOCKET	281
+#define __SC_BIND	282
+#define __SC_SENDTO	290
+#define __SC_SETSOCKOPT	294
 #define __SC_OPENAT	322
 #define __SC_PSELECT6	335
 
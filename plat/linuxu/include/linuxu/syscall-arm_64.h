@@ -44,6 +44,7 @@
 #define __SC_CLOSE	57
 #define __SC_READ	63
 #define __SC_WRITE	64
+#define __SC_WRITEV	66
 #define __SC_PSELECT6	72
 #define __SC_FSTAT	80
 #define __SC_EXIT	93
@@ -57,6 +58,9 @@
 #define __SC_RT_SIGPROCMASK	135
 #define __SC_ARCH_PRCTL	167
 #define __SC_SOCKET	198
+#define __SC_BIND	200
+#define __SC_SENDTO	206
+#define __SC_SETSOCKOPT	208
 #define __SC_MUNMAP	215
 #define __SC_MMAP	222 /* use mmap2() since mmap() is obsolete */
 
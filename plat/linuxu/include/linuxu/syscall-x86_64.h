@@ -45,7 +45,11 @@
 #define __SC_RT_SIGACTION	13
 #define __SC_RT_SIGPROCMASK	14
 #define __SC_IOCTL	16
+#define __SC_WRITEV	20
 #define __SC_SOCKET	41
+#define __SC_SENDTO	44
+#define __SC_BIND	49
+#define __SC_SETSOCKOPT	54
 #define __SC_EXIT	60
 #define __SC_FCNTL	72
 #define __SC_ARCH_PRCTL	158
@@ -73,6 +73,20 @@ static inline ssize_t sys_write(int fd, const char *buf, size_t len)
 				  (long) (len));
 }
 
+struct uk_iovec {
+	void *iov_base;
+	size_t iov_len;
+};
+
+static inline ssize_t sys_writev(int fd, const struct uk_iovec *iov,
+				 int iovcnt)
+{
+	return (ssize_t) syscall3(__SC_WRITEV,
+				  (long) (fd),
+				  (long) (iov),
+				  (long) (iovcnt));
+}
+
 struct stat;
 static inline int sys_fstat(int fd, struct k_stat *statbuf)
 {
@@ -163,6 +177,38 @@ static inline int sys_socket(int domain, int type, int protocol)
 				  (long) protocol);
 }
 
+static inline int sys_bind(int fd, const void *addr, unsigned int addrlen)
+{
+	return (int) syscall3(__SC_BIND,
+			      (long) fd,
+			      (long) addr,
+			      (long) addrlen);
+}
+
+static inline int sys_setsockopt(int fd, int level, int optname,
+				 const void *optval, unsigned int optlen)
+{
+	return (int) syscall5(__SC_SETSOCKOPT,
+			      (long) fd,
+			      (long) level,
+			      (long) optname,
+			      (long) optval,
+			      (long) optlen);
+}
+
+static inline ssize_t sys_sendto(int fd, const void *buf, size_t len,
+				 int flags, const void *addr,
+				 unsigned int addrlen)
+{
+	return (ssize_t) syscall6(__SC_SENDTO,
+				  (long) fd,
+				  (long) buf,
+				  (long) len,
+				  (long) flags,
+				  (long) addr,
+				  (long) addrlen);
+}
+
 static inline int sys_exit(int status)
 {
 	return (int) syscall1(__SC_EXIT,
@@ -198,6 +244,13 @@ static inline void *sys_mmap(void *addr, size_t len, int prot, int flags,
 				 (long) (offset));
 }
 
+static inline int sys_munmap(void *addr, size_t len)
+{
+	return (int) syscall2(__SC_MUNMAP,
+			      (long) (addr),
+			      (long) (len));
+}
+
 #define sys_mapmem(addr, len)				  \
 	sys_mmap((addr), (len), (PROT_READ | PROT_WRITE), \
 		 (MAP_SHARED | MAP_ANONYMOUS), -1, 0)
@@ -34,6 +34,7 @@
 #define __PLAT_LINUXU_TAP_H__
 
 #include <uk/arch/types.h>
+#include <uk/essentials.h>
 #include <linuxu/syscall.h>
 #include <linuxu/ioctl.h>
 
@@ -149,4 +150,31 @@ struct uk_ifreq {
 /* Adding the bridge interface */
 #define UK_SIOCBRADDIF (0x89a2)
 
+#define UK_TUNSETOFFLOAD (0x400454d0)
+
+/* Offloads the host may use for packets it hands to us */
+#define UK_TUN_F_CSUM	(0x01)
+#define UK_TUN_F_TSO4	(0x02)
+#define UK_TUN_F_TSO6	(0x04)
+#define UK_TUN_F_TSO_ECN (0x08)
+
+/**
+ * Header in front of every packet read and written when the device is
+ * created with UK_IFF_VNET_HDR. Same layout as the legacy virtio-net header.
+ */
+struct uk_tap_vnet_hdr {
+#define UK_TAP_VNET_HDR_F_NEEDS_CSUM	1
+#define UK_TAP_VNET_HDR_F_DATA_VALID	2
+	__u8 flags;
+#define UK_TAP_VNET_HDR_GSO_NONE	0
+#define UK_TAP_VNET_HDR_GSO_TCPV4	1
+#define UK_TAP_VNET_HDR_GSO_TCPV6	4
+#define UK_TAP_VNET_HDR_GSO_ECN		0x80
+	__u8 gso_type;
+	__u16 hdr_len;
+	__u16 gso_size;
+	__u16 csum_start;
+	__u16 csum_offset;
+} __packed;
+
 #endif /* __PLAT_LINUXU_TAP_H */
@@ -0,0 +1,149 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <uk/print.h>
+#include <uk/arch/types.h>
+#include <uk/errptr.h>
+#include <linuxu/tap.h>
+#include <linuxu/packet.h>
+
+#define PACKET_BLOCK_SIZE	4096
+
+int packet_open(void)
+{
+	int rc;
+
+	rc = sys_socket(AF_PACKET, SOCK_RAW, UK_ETH_P_ALL_BE);
+	if (rc < 0)
+		uk_pr_err("Failed(%d) to open a packet socket\n", rc);
+	return rc;
+}
+
+int packet_close(int fd)
+{
+	return sys_close(fd);
+}
+
+int packet_ifindex_get(int fd, const char *ifname)
+{
+	struct uk_ifreq ifrq = {0};
+	int rc;
+
+	snprintf(ifrq.ifr_name, sizeof(ifrq.ifr_name), "%s", ifname);
+	rc = sys_ioctl(fd, UK_SIOCGIFINDEX, &ifrq);
+	if (rc < 0) {
+		uk_pr_err("Failed(%d) to find the interface %s\n", rc, ifname);
+		return rc;
+	}
+	return ifrq.ifr_ifindex;
+}
+
+int packet_bind(int fd, int ifindex)
+{
+	struct uk_sockaddr_ll sll = {0};
+	int rc;
+
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = UK_ETH_P_ALL_BE;
+	sll.sll_ifindex = ifindex;
+	rc = sys_bind(fd, &sll, sizeof(sll));
+	if (rc < 0)
+		uk_pr_err("Failed(%d) to bind the packet socket\n", rc);
+	return rc;
+}
+
+int packet_promisc_set(int fd, int ifindex)
+{
+	struct uk_packet_mreq mreq = {0};
+	int rc;
+
+	mreq.mr_ifindex = ifindex;
+	mreq.mr_type = UK_PACKET_MR_PROMISC;
+	rc = sys_setsockopt(fd, UK_SOL_PACKET, UK_PACKET_ADD_MEMBERSHIP,
+			    &mreq, sizeof(mreq));
+	if (rc < 0)
+		uk_pr_err("Failed(%d) to enable the promiscuous mode\n", rc);
+	return rc;
+}
+
+int packet_rings_map(int fd, unsigned int frame_size, unsigned int frame_nr,
+		     void **rings)
+{
+	struct uk_tpacket_req req;
+	int version = UK_TPACKET_V2;
+	int one = 1;
+	void *addr;
+	int rc;
+
+	rc = sys_setsockopt(fd, UK_SOL_PACKET, UK_PACKET_VERSION,
+			    &version, sizeof(version));
+	if (rc < 0) {
+		uk_pr_err("Failed(%d) to select TPACKET_V2\n", rc);
+		return rc;
+	}
+
+	/* Frames are sent without passing the queueing discipline */
+	rc = sys_setsockopt(fd, UK_SOL_PACKET, UK_PACKET_QDISC_BYPASS,
+			    &one, sizeof(one));
+	if (rc < 0)
+		uk_pr_warn("Failed(%d) to bypass the queueing discipline\n",
+			   rc);
+
+	/* The host requires blocks of whole pages. Frames that divide the
+	 * page size fill the blocks without gaps, so that frame `i` of a ring
+	 * starts at `i * frame_size`.
+	 */
+	if (unlikely(frame_size > PACKET_BLOCK_SIZE
+		     || PACKET_BLOCK_SIZE % frame_size
+		     || frame_nr % (PACKET_BLOCK_SIZE / frame_size)))
+		return -EINVAL;
+	req.tp_block_size = PACKET_BLOCK_SIZE;
+	req.tp_block_nr = frame_nr / (PACKET_BLOCK_SIZE / frame_size);
+	req.tp_frame_size = frame_size;
+	req.tp_frame_nr = frame_nr;
+	rc = sys_setsockopt(fd, UK_SOL_PACKET, UK_PACKET_RX_RING,
+			    &req, sizeof(req));
+	if (rc < 0) {
+		uk_pr_err("Failed(%d) to set up the receive ring\n", rc);
+		return rc;
+	}
+	rc = sys_setsockopt(fd, UK_SOL_PACKET, UK_PACKET_TX_RING,
+			    &req, sizeof(req));
+	if (rc < 0) {
+		uk_pr_err("Failed(%d) to set up the transmit ring\n", rc);
+		return rc;
+	}
+
+	addr = sys_mmap(NULL, 2 * (size_t)frame_size * frame_nr,
+			PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (PTRISERR(addr)) {
+		rc = PTR2ERR(addr);
+		uk_pr_err("Failed(%d) to map the rings\n", rc);
+		return rc;
+	}
+	*rings = addr;
+	return 0;
+}
+
+int packet_rings_unmap(void *rings, unsigned int frame_size,
+		       unsigned int frame_nr)
+{
+	return sys_munmap(rings, 2 * (size_t)frame_size * frame_nr);
+}
+
+int packet_kick(int fd)
+{
+	ssize_t rc;
+
+	rc = sys_sendto(fd, NULL, 0, UK_MSG_DONTWAIT, NULL, 0);
+	if (rc == -11)
+		/* Explicitly added since linux errno has -11 for EAGAIN */
+		rc = -EAGAIN;
+	else if (rc < 0)
+		uk_pr_err("Failed(%ld) to kick the transmit ring\n", rc);
+	return (int)rc;
+}
@@ -60,6 +60,18 @@ int tap_dev_configure(int fd, __u32 feature_flags, void *arg)
 	return rc;
 }
 
+int tap_dev_offload_set(int fd, unsigned int offloads)
+{
+	int rc;
+
+	rc = sys_ioctl(fd, UK_TUNSETOFFLOAD, (void *)(unsigned long)offloads);
+	if (rc < 0)
+		uk_pr_err("Failed(%d) to set the offloads of the tap device\n",
+			  rc);
+
+	return rc;
+}
+
 int tap_netif_configure(int fd, __u32 request, void *arg)
 {
 	int rc;
@@ -154,6 +166,24 @@ ssize_t tap_write(int fd, const void *buf, size_t count)
 	return (ssize_t)written;
 }
 
+ssize_t tap_writev(int fd, const struct uk_iovec *iov, int iovcnt)
+{
+	ssize_t rc;
+
+	/* The tap device takes every write as a whole packet */
+	do {
+		rc = sys_writev(fd, iov, iovcnt);
+	} while (rc == -EINTR);
+
+	if (rc == -11)
+		/* Explicitly added since linux errno has -11 for EAGAIN */
+		rc = -EAGAIN;
+	else if (rc < 0)
+		uk_pr_err("Failed(%ld) to write to the tap device\n", rc);
+
+	return rc;
+}
+
 int tap_close(int fd)
 {
 	return sys_close(fd);
@@ -73,6 +73,12 @@ __nsec ukplat_wall_clock(void)
 	return ret;
 }
 
+const struct ukplat_clock_params *ukplat_clock_params(void)
+{
+	/* Time is provided by the host kernel */
+	return NULL;
+}
+
 static int timer_handler(void *arg __unused)
 {
 	/* We only use the timer interrupt to wake up. As we end up here, the
@@ -114,6 +114,12 @@ __nsec ukplat_wall_clock(void)
 	return ukplat_monotonic_clock();
 }
 
+const struct ukplat_clock_params *ukplat_clock_params(void)
+{
+	/* Not supported yet */
+	return NULL;
+}
+
 /* Set the timer and mask. */
 void write_timer_ctl(uint32_t value)
 {
@@ -32,6 +32,7 @@
  * Deals with events received on event channels
  * Ported from Mini-OS
  */
+#include <errno.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <common/hypervisor.h>
@@ -42,8 +43,6 @@
 #include <uk/assert.h>
 #include <uk/bitops.h>
 
-#define NR_EVS 1024
-
 UK_EVENT(UKPLAT_EVENT_IRQ);
 
 /* this represents a event handler. Chaining or sharing is not allowed */
@@ -221,6 +220,30 @@ void fini_events(void)
 	arch_fini_events();
 }
 
+void init_events_late(void)
+{
+#if CONFIG_XEN_EVTCHN_FIFO
+	shared_info_t *s = HYPERVISOR_shared_info;
+	evtchn_port_t port;
+	int rc;
+
+	rc = evtchn_fifo_init();
+	if (rc) {
+		uk_pr_info("FIFO event channels not available (%d)\n", rc);
+		return;
+	}
+
+	/* Pending events of bound ports are lost with the switch */
+	for (port = 0; port < NR_EVS; port++) {
+		if (uk_test_bit(port, bound_ports) &&
+		    !uk_test_bit(port, &s->evtchn_mask[0]))
+			evtchn_fifo_unmask(port);
+	}
+
+	uk_pr_info("Using FIFO event channels\n");
+#endif /* CONFIG_XEN_EVTCHN_FIFO */
+}
+
 #ifdef CONFIG_MIGRATION /* TODO */
 void suspend_events(void)
 {
@@ -310,10 +333,39 @@ int evtchn_get_peercontext(evtchn_port_t local_port, char *ctx, int size)
 	return rc;
 }
 
+int evtchn_bind_vcpu(evtchn_port_t port, unsigned int vcpu)
+{
+	struct evtchn_bind_vcpu op;
+
+	op.port = port;
+	op.vcpu = vcpu;
+	return HYPERVISOR_event_channel_op(EVTCHNOP_bind_vcpu, &op);
+}
+
+int evtchn_set_priority(evtchn_port_t port, unsigned int priority)
+{
+	struct evtchn_set_priority op;
+
+#if CONFIG_XEN_EVTCHN_FIFO
+	if (!evtchn_fifo_active)
+#endif /* CONFIG_XEN_EVTCHN_FIFO */
+		return -ENOTSUP;
+
+	op.port = port;
+	op.priority = priority;
+	return HYPERVISOR_event_channel_op(EVTCHNOP_set_priority, &op);
+}
+
 inline void mask_evtchn(evtchn_port_t port)
 {
 	shared_info_t *s = HYPERVISOR_shared_info;
 
+#if CONFIG_XEN_EVTCHN_FIFO
+	if (evtchn_fifo_active) {
+		evtchn_fifo_mask(port);
+		return;
+	}
+#endif /* CONFIG_XEN_EVTCHN_FIFO */
 	uk_set_bit(port, &s->evtchn_mask[0]);
 }
 
@@ -322,6 +374,20 @@ inline void unmask_evtchn(evtchn_port_t port)
 	shared_info_t *s = HYPERVISOR_shared_info;
 	vcpu_info_t *vcpu_info = &s->vcpu_info[smp_processor_id()];
 
+#if CONFIG_XEN_EVTCHN_FIFO
+	if (evtchn_fifo_active) {
+		/* Xen links the event and raises the upcall if it is pending */
+		evtchn_fifo_unmask(port);
+		if (!vcpu_info->evtchn_upcall_pending)
+			return;
+#ifdef XEN_HAVE_PV_UPCALL_MASK
+		if (!vcpu_info->evtchn_upcall_mask)
+#endif
+			ukplat_lcpu_irqs_handle_pending();
+		return;
+	}
+#endif /* CONFIG_XEN_EVTCHN_FIFO */
+
 	uk_clear_bit(port, &s->evtchn_mask[0]);
 
 	/*
@@ -344,6 +410,12 @@ inline void clear_evtchn(evtchn_port_t port)
 {
 	shared_info_t *s = HYPERVISOR_shared_info;
 
+#if CONFIG_XEN_EVTCHN_FIFO
+	if (evtchn_fifo_active) {
+		evtchn_fifo_clear(port);
+		return;
+	}
+#endif /* CONFIG_XEN_EVTCHN_FIFO */
 	uk_clear_bit(port, &s->evtchn_pending[0]);
 }
 
@@ -0,0 +1,190 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+/*
+ * FIFO-based event channel ABI
+ *
+ * Every vCPU registers a control block with one queue per priority. Xen
+ * links pending events into the queue of the vCPU the port is bound to and
+ * marks the queue as ready, so the upcall handler consumes events by
+ * priority instead of scanning the pending bitmaps of the 2-level ABI.
+ */
+#include <stdint.h>
+#include <common/hypervisor.h>
+#include <common/events.h>
+#if defined(__i386__) || defined(__x86_64__)
+#include <xen-x86/mm.h>
+#elif defined(__aarch64__)
+#include <xen-arm/mm.h>
+#endif
+#include <uk/assert.h>
+#include <uk/bitops.h>
+#include <uk/essentials.h>
+#include <uk/plat/lcpu.h>
+#include <uk/print.h>
+
+#define EVENT_WORDS_PER_PAGE	(PAGE_SIZE / sizeof(event_word_t))
+#define EVENT_ARRAY_PAGES	DIV_ROUND_UP(NR_EVS, EVENT_WORDS_PER_PAGE)
+
+#define EVENT_BIT(b)		((event_word_t)1 << (b))
+
+int evtchn_fifo_active;
+
+/* The memory allocator is not available yet when events are initialized */
+static event_word_t event_array[EVENT_ARRAY_PAGES][EVENT_WORDS_PER_PAGE]
+	__align(PAGE_SIZE);
+static union {
+	evtchn_fifo_control_block_t cb;
+	char page[PAGE_SIZE];
+} control_blocks[CONFIG_UKPLAT_LCPU_MAXCOUNT] __align(PAGE_SIZE);
+
+/* Local heads of the queues. Xen only updates the head in the control
+ * block when it links an event into an empty queue.
+ */
+static uint32_t queue_heads[CONFIG_UKPLAT_LCPU_MAXCOUNT]
+			   [EVTCHN_FIFO_MAX_QUEUES];
+
+static inline event_word_t *event_word(evtchn_port_t port)
+{
+	UK_ASSERT(port < NR_EVS);
+	return &event_array[port / EVENT_WORDS_PER_PAGE]
+			   [port % EVENT_WORDS_PER_PAGE];
+}
+
+void evtchn_fifo_mask(evtchn_port_t port)
+{
+	__atomic_fetch_or(event_word(port), EVENT_BIT(EVTCHN_FIFO_MASKED),
+			  __ATOMIC_SEQ_CST);
+}
+
+void evtchn_fifo_unmask(evtchn_port_t port)
+{
+	event_word_t *word = event_word(port);
+	struct evtchn_unmask op;
+
+	__atomic_fetch_and(word, ~EVENT_BIT(EVTCHN_FIFO_MASKED),
+			   __ATOMIC_SEQ_CST);
+
+	/* Xen links an event that became pending while it was masked only
+	 * when asked to
+	 */
+	if (__atomic_load_n(word, __ATOMIC_SEQ_CST) &
+	    EVENT_BIT(EVTCHN_FIFO_PENDING)) {
+		op.port = port;
+		HYPERVISOR_event_channel_op(EVTCHNOP_unmask, &op);
+	}
+}
+
+void evtchn_fifo_clear(evtchn_port_t port)
+{
+	__atomic_fetch_and(event_word(port), ~EVENT_BIT(EVTCHN_FIFO_PENDING),
+			   __ATOMIC_SEQ_CST);
+}
+
+/* Unlinks the event at the head of a queue and handles it */
+static void evtchn_fifo_consume(unsigned int cpu, unsigned int prio,
+				uint32_t *ready, struct __regs *regs)
+{
+	evtchn_fifo_control_block_t *cb = &control_blocks[cpu].cb;
+	event_word_t *word;
+	event_word_t w, new;
+	evtchn_port_t port;
+	uint32_t head;
+
+	head = queue_heads[cpu][prio];
+	if (!head) {
+		rmb();
+		head = UK_READ_ONCE(cb->head[prio]);
+	}
+
+	if (unlikely(!head || head >= NR_EVS)) {
+		*ready &= ~(1U << prio);
+		return;
+	}
+
+	port = head;
+	word = event_word(port);
+
+	/* Clearing the link leaves the next event as the new head */
+	w = __atomic_load_n(word, __ATOMIC_RELAXED);
+	do {
+		new = w & ~(EVENT_BIT(EVTCHN_FIFO_LINKED) |
+			    EVTCHN_FIFO_LINK_MASK);
+	} while (!__atomic_compare_exchange_n(word, &w, new, 0,
+					      __ATOMIC_SEQ_CST,
+					      __ATOMIC_SEQ_CST));
+	head = w & EVTCHN_FIFO_LINK_MASK;
+	if (!head)
+		*ready &= ~(1U << prio);
+	queue_heads[cpu][prio] = head;
+
+	w = __atomic_load_n(word, __ATOMIC_SEQ_CST);
+	if ((w & EVENT_BIT(EVTCHN_FIFO_PENDING)) &&
+	    !(w & EVENT_BIT(EVTCHN_FIFO_MASKED)))
+		do_event(port, regs);
+}
+
+void evtchn_fifo_handle_events(unsigned int cpu, struct __regs *regs)
+{
+	evtchn_fifo_control_block_t *cb = &control_blocks[cpu].cb;
+	uint32_t ready;
+
+	ready = __atomic_exchange_n(&cb->ready, 0, __ATOMIC_SEQ_CST);
+	while (ready) {
+		/* Queue 0 has the highest priority */
+		evtchn_fifo_consume(cpu, uk_ffsl(ready), &ready, regs);
+		ready |= __atomic_exchange_n(&cb->ready, 0, __ATOMIC_SEQ_CST);
+	}
+}
+
+static int evtchn_fifo_init_vcpu(unsigned int cpu)
+{
+	struct evtchn_init_control op;
+	int rc;
+
+	op.control_gfn = virt_to_mfn(&control_blocks[cpu]);
+	op.offset = 0;
+	op.vcpu = cpu;
+	rc = HYPERVISOR_event_channel_op(EVTCHNOP_init_control, &op);
+	if (rc)
+		return rc;
+
+	UK_ASSERT(op.link_bits >= EVTCHN_FIFO_LINK_BITS);
+	return 0;
+}
+
+int evtchn_fifo_init(void)
+{
+	struct evtchn_expand_array expand;
+	unsigned int i, j;
+	int rc;
+
+	/* Events are disabled until they are unmasked */
+	for (i = 0; i < EVENT_ARRAY_PAGES; i++)
+		for (j = 0; j < EVENT_WORDS_PER_PAGE; j++)
+			event_array[i][j] = EVENT_BIT(EVTCHN_FIFO_MASKED);
+
+	/* Xen switches the domain to the FIFO ABI with the first vCPU */
+	for (i = 0; i < ukplat_lcpu_count(); i++) {
+		rc = evtchn_fifo_init_vcpu(i);
+		if (unlikely(rc)) {
+			if (i == 0)
+				return rc;
+			UK_CRASH("Failed to init FIFO events of vCPU %u: %d\n",
+				 i, rc);
+		}
+	}
+
+	for (i = 0; i < EVENT_ARRAY_PAGES; i++) {
+		expand.array_gfn = virt_to_mfn(event_array[i]);
+		rc = HYPERVISOR_event_channel_op(EVTCHNOP_expand_array,
+						 &expand);
+		if (unlikely(rc))
+			UK_CRASH("Failed to add event array page: %d\n", rc);
+	}
+
+	evtchn_fifo_active = 1;
+	return 0;
+}
@@ -95,6 +95,58 @@ static void put_free_entry(grant_ref_t gref)
 	uk_semaphore_up(&gnttab.sem);
 }
 
+/* Takes free entries for all slots of `grefs` that hold GRANT_INVALID_REF */
+static void get_free_entries(grant_ref_t *grefs, unsigned int n,
+		unsigned int nfree)
+{
+	unsigned long flags;
+	unsigned int i;
+	grant_ref_t gref;
+
+	for (i = 0; i < nfree; i++)
+		uk_semaphore_down(&gnttab.sem);
+
+	flags = ukplat_lcpu_save_irqf();
+
+	for (i = 0; i < n; i++) {
+		if (grefs[i] != GRANT_INVALID_REF)
+			continue;
+
+		gref = gnttab.gref_list[0];
+		UK_ASSERT(gref >= GNTTAB_NR_RESERVED_ENTRIES &&
+			gref < NR_GRANT_ENTRIES);
+		gnttab.gref_list[0] = gnttab.gref_list[gref];
+#ifdef DBGGNT
+		UK_ASSERT(!gnttab.inuse[gref]);
+		gnttab.inuse[gref] = 1;
+#endif
+		grefs[i] = gref;
+	}
+
+	ukplat_lcpu_restore_irqf(flags);
+}
+
+static void put_free_entries(const grant_ref_t *grefs, unsigned int n)
+{
+	unsigned long flags;
+	unsigned int i;
+
+	flags = ukplat_lcpu_save_irqf();
+
+	for (i = 0; i < n; i++) {
+#ifdef DBGGNT
+		UK_ASSERT(gnttab.inuse[grefs[i]]);
+		gnttab.inuse[grefs[i]] = 0;
+#endif
+		gnttab.gref_list[grefs[i]] = gnttab.gref_list[0];
+		gnttab.gref_list[0] = grefs[i];
+	}
+
+	ukplat_lcpu_restore_irqf(flags);
+
+	uk_semaphore_up_n(&gnttab.sem, n);
+}
+
 static void gnttab_grant_init(grant_ref_t gref, domid_t domid,
 		unsigned long mfn)
 {
@@ -172,6 +224,65 @@ int gnttab_update_grant(grant_ref_t gref,
 	return 1;
 }
 
+int gnttab_grant_access_batch(domid_t domid, const unsigned long *mfns,
+		grant_ref_t *grefs, unsigned int n, int readonly)
+{
+	unsigned int i, nfree = 0;
+
+	/* Revoke the grants that are updated */
+	for (i = 0; i < n; i++) {
+		if (grefs[i] == GRANT_INVALID_REF) {
+			nfree++;
+			continue;
+		}
+
+		UK_ASSERT(grefs[i] >= GNTTAB_NR_RESERVED_ENTRIES &&
+			grefs[i] < NR_GRANT_ENTRIES);
+		if (!gnttab_reset_flags(grefs[i]))
+			return 0;
+	}
+
+	if (nfree)
+		get_free_entries(grefs, n, nfree);
+
+	/* A single barrier orders the entries before all flags */
+	for (i = 0; i < n; i++) {
+		gnttab.table[grefs[i]].frame = mfns[i];
+		gnttab.table[grefs[i]].domid = domid;
+	}
+	wmb();
+
+	readonly *= GTF_readonly;
+	for (i = 0; i < n; i++)
+		gnttab.table[grefs[i]].flags = GTF_permit_access | readonly;
+
+	return 1;
+}
+
+unsigned int gnttab_end_access_batch(grant_ref_t *grefs, unsigned int n)
+{
+	unsigned int i, nend = 0;
+	grant_ref_t gref;
+
+	/* Grants that are still in use are moved behind the ended ones */
+	for (i = 0; i < n; i++) {
+		gref = grefs[i];
+		UK_ASSERT(gref >= GNTTAB_NR_RESERVED_ENTRIES &&
+			gref < NR_GRANT_ENTRIES);
+
+		if (!gnttab_reset_flags(gref))
+			continue;
+
+		grefs[i] = grefs[nend];
+		grefs[nend++] = gref;
+	}
+
+	if (nend)
+		put_free_entries(grefs, nend);
+
+	return nend;
+}
+
 int gnttab_end_access(grant_ref_t gref)
 {
 	int rc;
@@ -64,6 +64,14 @@ void do_hypervisor_callback(struct __regs *regs)
 	/* Clear master flag /before/ clearing selector flag. */
 	wmb();
 #endif
+#if CONFIG_XEN_EVTCHN_FIFO
+	if (evtchn_fifo_active) {
+		evtchn_fifo_handle_events(cpu, regs);
+		in_callback = 0;
+		return;
+	}
+#endif /* CONFIG_XEN_EVTCHN_FIFO */
+
 	l1 = uk_exchange_n(&vcpu_info->evtchn_pending_sel, 0);
 	while (l1 != 0) {
 		l1i = uk_ffsl(l1);
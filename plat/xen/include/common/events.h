@@ -48,6 +48,8 @@
 #include <uk/arch/lcpu.h>
 
 
+#define NR_EVS 1024
+
 typedef void (*evtchn_handler_t)(evtchn_port_t, struct __regs *, void *);
 
 /* prototypes */
@@ -88,6 +90,41 @@ int evtchn_bind_interdomain(domid_t pal, evtchn_port_t remote_port,
 			    evtchn_handler_t handler, void *data,
 			    evtchn_port_t *local_port);
 int evtchn_get_peercontext(evtchn_port_t local_port, char *ctx, int size);
+
+/*
+ * Deliver the events of <port> to <vcpu>. Interdomain channels and
+ * per-vCPU VIRQs can be rebound.
+ */
+int evtchn_bind_vcpu(evtchn_port_t port, unsigned int vcpu);
+
+/*
+ * Set the priority of <port>, from EVTCHN_FIFO_PRIORITY_MAX (0) to
+ * EVTCHN_FIFO_PRIORITY_MIN (15). Only supported with FIFO event channels.
+ */
+int evtchn_set_priority(evtchn_port_t port, unsigned int priority);
+
+#if CONFIG_XEN_EVTCHN_FIFO
+/* Set once the FIFO ABI replaced the 2-level ABI */
+extern int evtchn_fifo_active;
+
+/*
+ * Switch to the FIFO ABI. Needs the physical to machine mapping, i.e., has
+ * to be called after the memory is initialized.
+ * Returns 0 on success, or the error of the hypervisor if it does not
+ * support FIFO event channels.
+ */
+int evtchn_fifo_init(void);
+void evtchn_fifo_handle_events(unsigned int cpu, struct __regs *regs);
+void evtchn_fifo_mask(evtchn_port_t port);
+void evtchn_fifo_unmask(evtchn_port_t port);
+void evtchn_fifo_clear(evtchn_port_t port);
+#endif /* CONFIG_XEN_EVTCHN_FIFO */
+
+/*
+ * Use FIFO event channels if enabled and supported by the hypervisor.
+ * Ports that are already bound keep their mask state.
+ */
+void init_events_late(void);
 void unbind_all_ports(void);
 
 static inline int notify_remote_via_evtchn(evtchn_port_t port)
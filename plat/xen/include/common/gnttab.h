@@ -48,6 +48,25 @@ int gnttab_update_grant(grant_ref_t gref,
 unsigned long gnttab_end_transfer(grant_ref_t gref);
 int gnttab_end_access(grant_ref_t gref);
 
+/*
+ * Grants access to `n` frames at once. Slots of `grefs` that hold
+ * GRANT_INVALID_REF get a new grant reference, the other grants are
+ * updated like with gnttab_update_grant(). Grant table entries are
+ * written to shared memory, so no hypercall is needed; a batch takes the
+ * free list and issues the write barrier only once.
+ *
+ * Returns 1 on success. Returns 0 if one of the updated grants is still in
+ * use by the other end; grants checked before it are left revoked.
+ */
+int gnttab_grant_access_batch(domid_t domid, const unsigned long *mfns,
+			      grant_ref_t *grefs, unsigned int n, int readonly);
+/*
+ * Ends access to `n` grants at once and returns the number of ended grants.
+ * They are moved to the front of `grefs`, grants that are still in use by
+ * the other end stay allocated and are moved behind them.
+ */
+unsigned int gnttab_end_access_batch(grant_ref_t *grefs, unsigned int n);
+
 const char *gnttabop_error(__s16 status);
 
 grant_entry_v1_t *gnttab_arch_init(int nr_grant_frames);
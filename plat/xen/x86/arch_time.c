@@ -192,6 +192,12 @@ __nsec ukplat_wall_clock(void)
 	return ret;
 }
 
+const struct ukplat_clock_params *ukplat_clock_params(void)
+{
+	/* The Xen system time is not derived from a plain counter */
+	return NULL;
+}
+
 void time_block_until(__snsec until)
 {
 	UK_ASSERT(irqs_disabled());
@@ -218,6 +224,8 @@ void ukplat_time_init(void)
 {
 	uk_pr_debug("Initializing timer interface\n");
 	port = bind_virq(VIRQ_TIMER, &timer_handler, NULL);
+	/* Ticks are not queued behind device events (FIFO ABI only) */
+	evtchn_set_priority(port, EVTCHN_FIFO_PRIORITY_MAX);
 	unmask_evtchn(port);
 }
 
@@ -273,6 +273,9 @@ void _libxenplat_x86entry(void *start_info)
 
 	_libxenplat_x86bootinfo_setup();
 
+	/* Needs the physical to machine mapping */
+	init_events_late();
+
 #if CONFIG_HAVE_X86PKU
 	_check_ospke();
 #endif /* CONFIG_HAVE_X86PKU */
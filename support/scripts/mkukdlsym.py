@@ -0,0 +1,144 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: BSD-3-Clause
+# Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+# Licensed under the BSD-3-Clause License (the "License").
+# You may not use this file except in compliance with the License.
+
+# Builds the contents of the .uk_dlsym section, the table of global symbols
+# of the image that shared objects are linked against (see
+# lib/posix-libdl/libdl.h).
+
+import argparse
+import re
+import subprocess
+
+UK_DLSYM_MAGIC = 0x4D59534C
+UK_DLSYM_NONE = 0xFFFFFFFF
+
+# Size of struct uk_dlsym_hdr and struct uk_dlsym
+HDR_SIZE = 24
+SYM_SIZE = 16
+
+# Symbol types of `nm` for defined symbols in text, data, read-only data,
+# and bss, including weak ones
+NM_TYPES = "BDGRSTVW"
+
+# Section header format from `readelf -S -W`:
+# [Nr] Name Type Address Off Size ...
+SHDR_EXP = (
+    r"^\s*\[\s*[0-9]+\]\s+(\S+)\s+\S+\s+([0-9a-f]+)\s+([0-9a-f]+)\s+"
+    r"([0-9a-f]+)\s"
+)
+
+
+def get_section(elf, name):
+    out = subprocess.check_output(["readelf", "-S", "-W", elf])
+    for s in re.findall(SHDR_EXP, out.decode("ASCII"), re.MULTILINE):
+        if s[0] == name:
+            return int(s[1], 16), int(s[3], 16)
+
+    raise Exception("Could not find the " + name + " section.")
+
+
+# Return (name, value, size) of the global defined symbols, each name once
+def get_syms(elf):
+    out = subprocess.check_output(
+        ["nm", "-P", "-g", "--defined-only", "-t", "x", elf]
+    )
+
+    syms = {}
+    for line in out.decode("ASCII").splitlines():
+        f = line.split()
+        if len(f) < 3 or f[1] not in NM_TYPES or f[0] in syms:
+            continue
+        size = int(f[3], 16) if len(f) > 3 else 0
+        syms[f[0]] = (int(f[2], 16), size)
+
+    return [(n, v[0], v[1]) for n, v in syms.items()]
+
+
+def gnu_hash(name):
+    h = 5381
+    for c in name.encode("ASCII"):
+        h = (h * 33 + c) & 0xFFFFFFFF
+    return h
+
+
+def build_table(syms, base, endianness):
+    nbuckets = max(1, len(syms) // 2)
+
+    entries = sorted(
+        ((gnu_hash(s[0]), s) for s in syms),
+        key=lambda e: (e[0] % nbuckets, e[1][0]),
+    )
+
+    strings = bytearray()
+    buckets = [UK_DLSYM_NONE] * nbuckets
+    hashes = []
+    symtab = bytearray()
+    for i, (h, (name, value, size)) in enumerate(entries):
+        b = h % nbuckets
+        if buckets[b] == UK_DLSYM_NONE:
+            buckets[b] = i
+
+        # Mark the last symbol of each bucket
+        last = i + 1 == len(entries) or entries[i + 1][0] % nbuckets != b
+        hashes.append((h & ~1) | 1 if last else h & ~1)
+
+        symtab += value.to_bytes(8, endianness)
+        symtab += len(strings).to_bytes(4, endianness)
+        symtab += min(size, 0xFFFFFFFF).to_bytes(4, endianness)
+        strings += name.encode("ASCII") + b"\0"
+
+    table = bytearray()
+    table += UK_DLSYM_MAGIC.to_bytes(4, endianness)
+    table += nbuckets.to_bytes(4, endianness)
+    table += len(entries).to_bytes(4, endianness)
+    table += (0).to_bytes(4, endianness)
+    table += base.to_bytes(8, endianness)
+    for b in buckets:
+        table += b.to_bytes(4, endianness)
+    for h in hashes:
+        table += h.to_bytes(4, endianness)
+    table += bytes(-len(table) % 8)
+    table += symtab
+    table += strings
+
+    return table
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Builds the .uk_dlsym section off the global symbols of "
+        "an ELF binary"
+    )
+    parser.add_argument("elf", help="path to ELF binary to process")
+    parser.add_argument(
+        "-b", "--big", action="store_true", help="use big endianness"
+    )
+    opt = parser.parse_args()
+
+    if opt.big:
+        endianness = "big"
+    else:
+        endianness = "little"
+
+    base, size = get_section(opt.elf, ".uk_dlsym")
+    table = build_table(get_syms(opt.elf), base, endianness)
+    if len(table) > size:
+        raise Exception(
+            "The .uk_dlsym section needs "
+            + str(len(table))
+            + " bytes but only "
+            + str(size)
+            + " bytes are available. Increase "
+            "CONFIG_LIBPOSIX_LIBDL_SYMTAB_SIZE."
+        )
+
+    with open(opt.elf + ".uk_dlsym.bin", "wb") as f:
+        f.write(table)
+        f.write(bytes(size - len(table)))
+
+
+if __name__ == "__main__":
+    main()
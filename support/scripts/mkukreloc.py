@@ -328,6 +328,71 @@ def uk_reloc_sym_to_struct(elf, uk_reloc_sym):
     return [offset, value, size, flags]
 
 
+# Number of 8-byte slots that a packed bitmap word covers (see reloc.h)
+UKRELOC_PACKED_SLOTS = 31
+
+
+# Return the bytes at a link time address in the loaded image, or None if the
+# address is not backed by the file (e.g., in .bss)
+def read_image(elf_bytes, shdrs, addr, size):
+    for s in shdrs:
+        if s["Type"] == "NOBITS" or s["Address"] == 0:
+            continue
+        if s["Address"] <= addr and addr + size <= s["Address"] + s["Size"]:
+            off = s["Offset"] + addr - s["Address"]
+            return elf_bytes[off : off + size]
+
+    return None
+
+
+# A relocation can be packed if it is a plain 64-bit virtual relocation at an
+# aligned offset whose place already holds the link time value. This is the
+# case for relative relocations, since the linker resolves them statically
+# anyway. Relocations of the ur_* macros hold a placeholder instead.
+# Places between _uk_reloc_start and _uk_reloc_end are never packed, since
+# the relocator must not modify the packed words while it reads them.
+def is_packable(ur, elf_bytes, shdrs, endianness, ur_start, ur_end):
+    if ur[2] != 8 or ur[3] != 0 or ur[0] % 8 or ur[0] >= 1 << 32:
+        return False
+    if ur_start <= BASE_ADDR + ur[0] < ur_end:
+        return False
+
+    place = read_image(elf_bytes, shdrs, BASE_ADDR + ur[0], 8)
+    if place is None:
+        return False
+
+    return int.from_bytes(place, endianness) == BASE_ADDR + ur[1]
+
+
+# Encode the sorted offsets of packable relocations in 32-bit words, like
+# RELR does: an even word is the offset of a relocation, an odd word is a
+# bitmap of which of the following UKRELOC_PACKED_SLOTS slots of 8 bytes
+# need to be relocated.
+def pack_uk_relocs(offsets):
+    words = []
+    i = 0
+    while i < len(offsets):
+        where = offsets[i]
+        words.append(where)
+        where += 8
+        i += 1
+
+        while True:
+            bitmap = 0
+            while (
+                i < len(offsets)
+                and offsets[i] - where < UKRELOC_PACKED_SLOTS * 8
+            ):
+                bitmap |= 1 << ((offsets[i] - where) // 8)
+                i += 1
+            if bitmap == 0:
+                break
+            words.append((bitmap << 1) | 1)
+            where += UKRELOC_PACKED_SLOTS * 8
+
+    return words
+
+
 # A uk_reloc entry has the same definition as `struct uk_reloc`.
 # See reloc.h.
 def build_uk_relocs(elf, rela_dyn_secs, max_r_mem_off):
@@ -433,13 +498,33 @@ def main():
 
     uk_reloc_start = int(get_nm_syms(opt.elf, r"_uk_reloc_start")[0][0], 16)
     uk_reloc_end = int(get_nm_syms(opt.elf, r"_uk_reloc_end")[0][0], 16)
+
+    # Move the relocations that only need the load offset added into the
+    # packed table that follows the sentinel.
+    with open(opt.elf, "rb") as f:
+        elf_bytes = f.read()
+    packed = sorted(
+        ur[0]
+        for ur in uk_relocs
+        if is_packable(
+            ur, elf_bytes, shdrs, endianness, uk_reloc_start, uk_reloc_end
+        )
+    )
+    packed_set = set(packed)
+    uk_relocs = [ur for ur in uk_relocs if ur[0] not in packed_set]
+    packed_words = pack_uk_relocs(packed)
+
     uk_reloc_sz = 24
-    if uk_reloc_end - uk_reloc_start < uk_reloc_sz * len(uk_relocs):
+    uk_reloc_total = (
+        4 + uk_reloc_sz * (len(uk_relocs) + 1) + 4 * len(packed_words)
+    )
+    if uk_reloc_end - uk_reloc_start < uk_reloc_total:
         raise Exception(
-            "There are " + str(len(uk_relocs)) + " struct uk_reloc"
-            "entries but the maximum amount is of "
-            + str(int((uk_reloc_end - uk_reloc_start) / uk_reloc_sz))
-            + " entries."
+            "The .uk_reloc section needs "
+            + str(uk_reloc_total)
+            + " bytes but only "
+            + str(uk_reloc_end - uk_reloc_start)
+            + " bytes are available."
         )
 
     # Write the binary blob with `struct uk_reloc` entries
@@ -455,9 +540,14 @@ def main():
         for ur in uk_relocs:
             write_uk_reloc_to_ur_bin(ur)
 
-        # Now write the sentinel (a zeroed out entry, but only r_sz is required
-        # to be 0 anyway)
-        write_uk_reloc_to_ur_bin([0, 0, 0, 0])
+        # Now write the sentinel. Only r_sz is required to be 0. r_mem_off
+        # holds the number of packed words that follow and r_addr the link
+        # time base address, relative to which the packed places hold their
+        # values.
+        write_uk_reloc_to_ur_bin([len(packed_words), BASE_ADDR, 0, 0])
+
+        for w in packed_words:
+            ur_bin.write(w.to_bytes(4, endianness))
 
 
 if __name__ == "__main__":
@@ -48,25 +48,40 @@ PTR_SIZE = type_void.pointer().sizeof
 
 
 def get_trace_buffer():
+    """Returns the events of each lcpu, oldest first"""
     inf = gdb.selected_inferior()
 
     try:
         trace_buff = gdb.parse_and_eval("uk_trace_buffer")
-        # trace_buff_size = trace_buff.type.sizeof
-        trace_buff_addr = int(trace_buff.address)
-        trace_buff_writep = int(gdb.parse_and_eval("uk_trace_buffer_writep"))
-    except gdb.error:
+        trace_lcpu = gdb.parse_and_eval("uk_trace_lcpu")
+        chunk_size = int(parse.get_keyvals(
+            gdb.current_progspace().filename)["chunk_size"])
+    except (gdb.error, KeyError):
         gdb.write("Error getting the trace buffer. Is tracing enabled?\n")
         raise gdb.error
 
-    if trace_buff_writep == 0:
-        # This can happen as effect of compile optimization if none of
-        # tracepoints were called
-        used = 0
-    else:
-        used = trace_buff_writep - trace_buff_addr
-
-    return bytes(inf.read_memory(trace_buff_addr, used))
+    lcpus = trace_lcpu.type.range()[1] + 1
+    buff_size = trace_buff[0].type.sizeof
+
+    ret = []
+    for i in range(lcpus):
+        head = int(trace_lcpu[i]["head"])
+        addr = int(trace_buff[i].address)
+        if head <= buff_size:
+            ret.append(bytes(inf.read_memory(addr, head)))
+            continue
+
+        # The buffer has wrapped. The oldest complete chunk follows the
+        # one that is currently written to.
+        pos = head % buff_size
+        start = parse.align_up(pos, chunk_size) % buff_size
+        data = bytes(inf.read_memory(addr, buff_size))
+        if start == 0:
+            ret.append(data[:pos] if pos else data)
+        else:
+            ret.append(data[start:] + data[:pos])
+
+    return ret
 
 
 def save_traces(out):
@@ -37,12 +37,16 @@ import tempfile
 
 TP_HEADER_MAGIC = "TRhd"
 TP_DEF_MAGIC = "TPde"
+TP_PAD_MAGIC = "TPad"
+TP_HEADER_FMT = "4sLQQ"
+TRACE_STREAM_MAGIC = "TRst"
+TRACE_STREAM_FRAME_FMT = "4sIQQII"
 UK_TRACE_ARG_INT = 0
 UK_TRACE_ARG_STRING = 1
 # Not sure why gcc aligns data on 32 bytes
 __STRUCT_ALIGNMENT = 32
 
-FORMAT_VERSION = 1
+FORMAT_VERSION = 2
 
 
 def align_down(v, alignment):
@@ -54,18 +58,20 @@ def align_up(v, alignment):
 
 
 class tp_sample:
-    def __init__(self, tp, time, args):
+    def __init__(self, tp, time, args, lcpu=0):
         self.tp = tp
         self.args = args
         self.time = time
+        self.lcpu = lcpu
 
     def __str__(self):
-        return ("%016d %s: " % (self.time, self.tp.name)) + (
+        return ("%016d %3d %s: " % (self.time, self.lcpu, self.tp.name)) + (
             self.tp.fmt % self.args
         )
 
     def tabulate_fmt(self):
-        return [self.time, self.tp.name, (self.tp.fmt % self.args)]
+        return [self.time, self.lcpu, self.tp.name,
+                (self.tp.fmt % self.args)]
 
 
 class EndOfBuffer(Exception):
@@ -91,34 +97,118 @@ class sample_parser:
                 "Warning: Version of trace format is more recent",
                 file=sys.stderr,
             )
-        self.data = unpacker(trace_buff)
         self.tps = get_tp_definitions(tp_defs_data, ptr_size)
 
-    def __iter__(self):
-        self.data.pos = 0
-        return self
+        # Up to format version 1 there is a single buffer without chunks
+        if isinstance(trace_buff, (bytes, bytearray)):
+            trace_buff = [trace_buff]
+        chunk_size = int(keyvals.get("chunk_size", 0))
+
+        # Merge the buffers of all lcpus by time. Within a buffer, events
+        # are in the order in which they were started, which may differ
+        # from the order of their timestamps if they were nested.
+        self.samples = []
+        for lcpu, buff in enumerate(trace_buff):
+            self.samples += self.parse_buffer(buff, chunk_size, lcpu)
+        self.samples.sort(key=lambda sample: sample.time)
+
+    def parse_buffer(self, buff, chunk_size, lcpu, offset=0):
+        """Parses events of an lcpu. offset is the position of buff in the
+        buffer of the lcpu, which determines where chunks end"""
+        data = unpacker(buff)
+        hdr_size = struct.calcsize("<" + TP_HEADER_FMT)
+        ret = []
+
+        while True:
+            start = data.pos
+            if chunk_size:
+                chunk_end = start + chunk_size - (offset + start) % chunk_size
+                if chunk_end - start < hdr_size:
+                    # The rest of the chunk is too short for an event
+                    data.pos = chunk_end
+                    continue
+            try:
+                # TODO: generate format. Cookie can be 4 bytes long on other
+                # platforms
+                magic, size, time, cookie = data.unpack(TP_HEADER_FMT)
+            except EndOfBuffer:
+                break
+
+            magic = magic.decode(errors="replace")
+            if magic == TP_PAD_MAGIC:
+                data.pos = chunk_end
+                continue
+            if magic != TP_HEADER_MAGIC:
+                if not chunk_size:
+                    break
+                # Incomplete event, skip it
+                data.pos = start + hdr_size + size
+                continue
+
+            tp = self.tps[cookie]
+            args = []
+            for i in range(tp.args_nr):
+                if tp.types[i] == UK_TRACE_ARG_STRING:
+                    args += [data.unpack_string()]
+                else:
+                    args += [data.unpack_int(tp.sizes[i])]
+            ret.append(tp_sample(tp, time, tuple(args), lcpu))
+
+            if chunk_size:
+                data.pos = start + hdr_size + size
 
-    def __next__(self):
-        try:
-            # TODO: generate format. Cookie can be 4 bytes long on other
-            # platforms
-            magic, _, time, cookie = self.data.unpack("4sLQQ")
-        except EndOfBuffer:
-            raise StopIteration
+        return ret
 
-        magic = magic.decode()
-        if magic != TP_HEADER_MAGIC:
-            raise StopIteration
+    def __iter__(self):
+        return iter(self.samples)
+
+
+class stream_parser:
+    """Decodes a trace stream, see struct uk_trace_stream_frame"""
+
+    def __init__(self, keyvals, tp_defs_data, ptr_size):
+        self.parser = sample_parser(keyvals, tp_defs_data, [], ptr_size)
+        self.chunk_size = int(keyvals["chunk_size"])
+        self.lost = dict()
+
+    def frames(self, stream):
+        """Yields the lcpu and the events of each frame as it arrives"""
+        frame_size = struct.calcsize("<" + TRACE_STREAM_FRAME_FMT)
+        while True:
+            hdr = read_exact(stream, frame_size)
+            if hdr is None:
+                return
+            magic, size, pos, lost, lcpu, _ = struct.unpack(
+                "<" + TRACE_STREAM_FRAME_FMT, hdr
+            )
+            if magic.decode(errors="replace") != TRACE_STREAM_MAGIC:
+                raise Exception("Wrong trace stream frame magic")
+
+            data = read_exact(stream, size)
+            if data is None:
+                return
+            if lost != self.lost.get(lcpu, 0):
+                print(
+                    "Warning: lcpu %d lost %d events"
+                    % (lcpu, lost - self.lost.get(lcpu, 0)),
+                    file=sys.stderr,
+                )
+                self.lost[lcpu] = lost
+
+            yield lcpu, self.parser.parse_buffer(
+                data, self.chunk_size, lcpu, pos
+            )
 
-        tp = self.tps[cookie]
-        args = []
-        for i in range(tp.args_nr):
-            if tp.types[i] == UK_TRACE_ARG_STRING:
-                args += [self.data.unpack_string()]
-            else:
-                args += [self.data.unpack_int(tp.sizes[i])]
 
-        return tp_sample(tp, time, tuple(args))
+def read_exact(stream, size):
+    """Reads size bytes, or returns None at the end of the stream"""
+    ret = b""
+    while len(ret) < size:
+        data = stream.read(size - len(ret))
+        if not data:
+            return None
+        ret += data
+    return ret
 
 
 class unpacker:
@@ -227,3 +317,12 @@ def get_keyvals(elf):
         ret[key] = val
 
     return ret
+
+
+def get_ptr_size(elf):
+    readelf_cmd = "readelf -h %s" % elf
+    readelf_cmd = readelf_cmd.split()
+    raw_data = subprocess.check_output(readelf_cmd).decode()
+    if re.search(r"^\s*Class:\s+ELF32$", raw_data, re.MULTILINE):
+        return 4
+    return 8
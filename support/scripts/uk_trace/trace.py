@@ -31,9 +31,11 @@
 # POSSIBILITY OF SUCH DAMAGE.
 
 import click
+import json
 import os
 import sys
 import pickle
+import socket
 import subprocess
 from tabulate import tabulate
 
@@ -72,7 +74,7 @@ def list(trace_file, no_tabulate):
     """Parse binary trace file fetched from Unikraft"""
     if not no_tabulate:
         print_data = [x.tabulate_fmt() for x in parse_tf(trace_file)]
-        print(tabulate(print_data, headers=["time", "tp_name", "msg"]))
+        print(tabulate(print_data, headers=["time", "lcpu", "tp_name", "msg"]))
     else:
         for i in parse_tf(trace_file):
             print(i)
@@ -141,5 +143,63 @@ def fetch(uk_img, out, remote, do_list, verbose):
             print(i)
 
 
+@cli.command()
+@click.argument("uk_img", type=click.Path(exists=True))
+@click.argument("stream", type=click.Path(exists=True))
+@click.option(
+    "--json",
+    "to_json",
+    is_flag=True,
+    default=False,
+    help="Write events in the Chrome JSON trace format, which Perfetto "
+    + "and chrome://tracing can open",
+)
+def stream(uk_img, stream, to_json):
+    """Decode a trace stream sent by Unikraft
+
+    STREAM is a file or a UNIX socket that the host end of the transport
+    (e.g., a QEMU chardev) writes the stream to. UK_IMG is the debug image
+    (with symbols) of the unikernel.
+    """
+    uk_img = click.format_filename(uk_img)
+    sp = parse.stream_parser(
+        parse.get_keyvals(uk_img),
+        parse.get_tp_sections(uk_img),
+        parse.get_ptr_size(uk_img),
+    )
+
+    if os.path.exists(stream) and not os.path.isfile(stream):
+        sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        sock.connect(stream)
+        f = sock.makefile("rb")
+    else:
+        f = open(stream, "rb")
+
+    if to_json:
+        # The array may stay unterminated if the stream is interrupted,
+        # which the format allows
+        print("[")
+    try:
+        for lcpu, samples in sp.frames(f):
+            for s in samples:
+                if not to_json:
+                    print(s, flush=True)
+                    continue
+                event = {
+                    "name": s.tp.name,
+                    "ph": "i",
+                    "s": "t",
+                    "ts": s.time / 1000,
+                    "pid": 0,
+                    "tid": lcpu,
+                    "args": {"msg": s.tp.fmt % s.args},
+                }
+                print(json.dumps(event) + ",", flush=True)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        f.close()
+
+
 if __name__ == "__main__":
     cli()
@@ -0,0 +1,181 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: BSD-3-Clause
+# Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+# Licensed under the BSD-3-Clause License (the "License").
+# You may not use this file except in compliance with the License.
+
+# Measures boot time and memory footprint of a unikernel that was built
+# with CONFIG_LIBUKBOOT_MARKERS. The given VMM command is started several
+# times and its console output (stdout) is scanned for the boot stage
+# markers. The time from starting the VMM until a marker arrives is taken
+# on the host; the guest's monotonic time and the memory usage come from
+# the markers. A summary is printed as JSON or CSV, so that it can be
+# stored per commit and compared, e.g.:
+#
+#   ukbootstat.py -n 20 --label $(git rev-parse --short HEAD) -- \
+#       qemu-system-x86_64 -nographic -kernel build/app_qemu-x86_64
+import sys
+import argparse
+import csv
+import json
+import os
+import selectors
+import statistics
+import subprocess
+import time
+
+MARK_PREFIX = "UKBOOT "
+
+
+def parse_marker(line):
+    """Returns the kind and the key/value pairs of a marker line"""
+    pos = line.find(MARK_PREFIX)
+    if pos < 0:
+        return None, None
+    kind, *pairs = line[pos + len(MARK_PREFIX):].split()
+    fields = {}
+    for pair in pairs:
+        key, sep, val = pair.partition("=")
+        if not sep:
+            continue
+        fields[key] = int(val) if val.lstrip("-").isdigit() else val
+    return kind, fields
+
+
+class Run:
+    def __init__(self):
+        self.metrics = {}
+
+    def feed(self, line, host_ms=None):
+        """Processes a console line, returns the stage of a marker"""
+        kind, fields = parse_marker(line)
+        if kind is None or "stage" not in fields:
+            return None
+        stage = fields.pop("stage")
+        if kind == "mark":
+            if host_ms is not None:
+                self.metrics["%s.host_ms" % stage] = round(host_ms, 3)
+            self.metrics["%s.guest_ms" % stage] = fields["ns"] / 1e6
+        elif kind == "mem":
+            for key, val in fields.items():
+                self.metrics["%s.%s" % (stage, key)] = val
+        return kind, stage
+
+
+def run_vmm(cmd, until, timeout):
+    run = Run()
+    sel = selectors.DefaultSelector()
+    start = time.monotonic()
+    proc = subprocess.Popen(cmd, stdin=subprocess.DEVNULL,
+                            stdout=subprocess.PIPE,
+                            stderr=subprocess.STDOUT)
+    sel.register(proc.stdout, selectors.EVENT_READ)
+    buf = b""
+    done = False
+    try:
+        while not done:
+            left = start + timeout - time.monotonic()
+            if left <= 0:
+                raise TimeoutError("no '%s' marker after %.1f s"
+                                   % (until, timeout))
+            if not sel.select(left):
+                continue
+            data = os.read(proc.stdout.fileno(), 4096)
+            now_ms = (time.monotonic() - start) * 1e3
+            if not data:
+                raise EOFError("VMM exited before the '%s' marker"
+                               % until)
+            buf += data
+            *lines, buf = buf.split(b"\n")
+            for line in lines:
+                res = run.feed(line.decode("utf-8", "replace"), now_ms)
+                # The memory usage follows the mark of a stage
+                if res == ("mem", until):
+                    done = True
+    finally:
+        proc.kill()
+        proc.wait()
+        sel.close()
+    return run
+
+
+def summarize(runs):
+    values = {}
+    for run in runs:
+        for key, val in run.metrics.items():
+            values.setdefault(key, []).append(val)
+
+    summary = {}
+    for key, vals in values.items():
+        summary[key] = {
+            "min": min(vals),
+            "median": statistics.median(vals),
+            "max": max(vals),
+            "runs": len(vals),
+        }
+    return summary
+
+
+def print_summary(args, summary):
+    if args.format == "json":
+        json.dump({"label": args.label, "metrics": summary}, sys.stdout,
+                  indent=2, sort_keys=True)
+        print()
+        return
+
+    writer = csv.writer(sys.stdout)
+    writer.writerow(["label", "metric", "min", "median", "max", "runs"])
+    for key in sorted(summary):
+        m = summary[key]
+        writer.writerow([args.label, key, m["min"], m["median"], m["max"],
+                         m["runs"]])
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Measure boot time and memory footprint")
+    parser.add_argument("-n", "--runs", type=int, default=10,
+                        help="Number of boots (default: 10)")
+    parser.add_argument("-t", "--timeout", type=float, default=10.0,
+                        help="Timeout per boot in seconds (default: 10)")
+    parser.add_argument("-u", "--until", default="main",
+                        choices=["main", "halt"],
+                        help="Stage after which the VMM is stopped "
+                             "(default: main)")
+    parser.add_argument("-l", "--label", default="",
+                        help="Label of the results, e.g., the commit")
+    parser.add_argument("-f", "--format", default="json",
+                        choices=["json", "csv"],
+                        help="Output format (default: json)")
+    parser.add_argument("--log", type=argparse.FileType("r"),
+                        help="Evaluate a console log instead of "
+                             "starting a VMM (no host times)")
+    parser.add_argument("cmd", nargs=argparse.REMAINDER,
+                        help="VMM command line, after '--'")
+    args = parser.parse_args()
+
+    if args.cmd and args.cmd[0] == "--":
+        args.cmd = args.cmd[1:]
+
+    runs = []
+    if args.log:
+        run = Run()
+        for line in args.log:
+            run.feed(line)
+        runs.append(run)
+    elif args.cmd:
+        for i in range(args.runs):
+            try:
+                runs.append(run_vmm(args.cmd, args.until, args.timeout))
+            except (TimeoutError, EOFError) as e:
+                print("Run %d: %s" % (i, e), file=sys.stderr)
+                return 1
+    else:
+        parser.error("either a VMM command or --log is required")
+
+    print_summary(args, summarize(runs))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: BSD-3-Clause
+# Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+# Licensed under the BSD-3-Clause License (the "License").
+# You may not use this file except in compliance with the License.
+
+# Resolves the folded stacks dumped by ukprof against the debug image
+# (`<image>.dbg`) and merges identical stacks. The output can be fed to
+# flamegraph.pl or speedscope.
+#
+# NOTE: The script requires pyelftools (pip3 install)
+import sys
+import argparse
+import bisect
+from collections import Counter
+from elftools.elf.elffile import ELFFile
+from elftools.elf.sections import SymbolTableSection
+
+UKPROF_BEGIN = "UKPROF_BEGIN"
+UKPROF_END = "UKPROF_END"
+
+
+class Symbols:
+    def __init__(self, path):
+        syms = []
+        with open(path, "rb") as f:
+            elf = ELFFile(f)
+            for sec in elf.iter_sections():
+                if not isinstance(sec, SymbolTableSection):
+                    continue
+                for sym in sec.iter_symbols():
+                    if sym["st_info"]["type"] != "STT_FUNC":
+                        continue
+                    if sym["st_shndx"] == "SHN_UNDEF":
+                        continue
+                    syms.append((sym["st_value"], sym["st_size"],
+                                 sym.name))
+        syms.sort()
+        self._addrs = [s[0] for s in syms]
+        self._syms = syms
+
+    def resolve(self, addr):
+        i = bisect.bisect_right(self._addrs, addr) - 1
+        if i >= 0:
+            start, size, name = self._syms[i]
+            if addr < start + size or size == 0:
+                return name
+        return "0x%x" % addr
+
+
+def read_stacks(f):
+    # Console logs contain other output around the dump
+    lines = f.read().splitlines()
+    if UKPROF_BEGIN in lines:
+        lines = lines[lines.index(UKPROF_BEGIN) + 1:]
+        if UKPROF_END in lines:
+            lines = lines[:lines.index(UKPROF_END)]
+
+    for line in lines:
+        stack, _, count = line.strip().rpartition(" ")
+        if not stack or not count.isdigit():
+            continue
+        yield [int(a, 16) for a in stack.split(";")], int(count)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Resolve ukprof folded stacks")
+    parser.add_argument("image", help="Debug image of the unikernel")
+    parser.add_argument("dump", nargs="?", type=argparse.FileType("r"),
+                        default=sys.stdin,
+                        help="Dump or console log (default: stdin)")
+    parser.add_argument("--offset", type=lambda x: int(x, 0), default=0,
+                        help="Load offset of a relocated image")
+    parser.add_argument("--addresses", action="store_true",
+                        help="Append the addresses to the function names")
+    args = parser.parse_args()
+
+    syms = Symbols(args.image)
+    stacks = Counter()
+    for addrs, count in read_stacks(args.dump):
+        frames = []
+        for i, addr in enumerate(addrs):
+            addr -= args.offset
+            # All but the innermost address are return addresses, which
+            # may already belong to the next line or function
+            name = syms.resolve(addr if i == len(addrs) - 1 else addr - 1)
+            if args.addresses:
+                name = "%s@0x%x" % (name, addr)
+            frames.append(name)
+        stacks[";".join(frames)] += count
+
+    for stack, count in stacks.most_common():
+        print("%s %d" % (stack, count))
+
+
+if __name__ == "__main__":
+    main()